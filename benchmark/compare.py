@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+# Copyright (c) 2016 by contributors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Train xLearn and the reference implementations on the same files of
+prepare_data.py with the same hyper-parameters, for each number of the
+threads, and report the training time of an epoch, the speedup over the
+fewest threads, the peak RSS and the final logloss of the validation set:
+
+  python3 compare.py -xlearn build/src/solver/xlearn_train \\
+                     -libffm libffm/ffm-train -data criteo_1m \\
+                     -threads 1,2,4,8 -out criteo_1m.csv
+
+The ffm model (-model ffm) is compared with libffm, and the fm model
+(-model fm) with libFM. Each run is a child process, whose peak RSS is
+given by wait4(). The epoch time of xLearn is its update time (the
+-metrics log), which excludes the parsing and the validation. The other
+tools report their cumulative training time (libffm) or only the total
+time (libFM, whose epoch time is the wall time over the epochs). The
+first run of xLearn on a file builds its binary cache, so the runs of
+xLearn start with one untimed warm-up run.
+"""
+
+import argparse
+import csv
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def run(cmd, log_file):
+    """Run cmd, and return its wall time and peak RSS (MB)."""
+    start = time.time()
+    with open(log_file, 'w') as log:
+        proc = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.time() - start
+    if status != 0:
+        sys.exit('[Error] %s failed, see %s' % (cmd[0], log_file))
+    rss = usage.ru_maxrss / 1024.0
+    if sys.platform == 'darwin':
+        rss /= 1024.0  # bytes on macOS
+    return wall, rss
+
+
+def logloss(labels, probs):
+    eps = 1e-15
+    total = 0.0
+    for y, p in zip(labels, probs):
+        p = min(max(p, eps), 1 - eps)
+        total -= math.log(p) if y > 0 else math.log(1 - p)
+    return total / max(len(labels), 1)
+
+
+def read_labels(filename):
+    with open(filename) as f:
+        return [float(line.split(None, 1)[0]) for line in f if line.strip()]
+
+
+def run_xlearn(args, threads, tmp):
+    metrics = os.path.join(tmp, 'xlearn_%d.json' % threads)
+    cmd = [args.xlearn, args.data + '.tr.ffm',
+           '-s', '1' if args.model == 'ffm' else '2',
+           '-t', args.data + '.va.ffm', '-x', 'logloss',
+           '-k', str(args.k), '-r', str(args.lr), '-b', str(args.regu),
+           '-e', str(args.epochs), '-nthread', str(threads),
+           '-m', 'none', '-l', os.path.join(tmp, 'xlearn_log'),
+           '-metrics', metrics]
+    if not args.norm:
+        cmd.append('--no-norm')
+    wall, rss = run(cmd, os.path.join(tmp, 'xlearn_%d.log' % threads))
+    epoch_time = []
+    loss = float('nan')
+    with open(metrics) as f:
+        for line in f:
+            record = json.loads(line)
+            if record.get('type') == 'epoch':
+                epoch_time.append(record['update_time'])
+                loss = record.get('test_loss', loss)
+    return epoch_time, loss, wall, rss
+
+
+def run_libffm(args, threads, tmp):
+    log = os.path.join(tmp, 'libffm_%d.log' % threads)
+    cmd = [args.libffm, '-k', str(args.k), '-r', str(args.lr),
+           '-l', str(args.regu), '-t', str(args.epochs),
+           '-s', str(threads), '-p', args.data + '.va.ffm']
+    if not args.norm:
+        cmd.append('--no-norm')
+    cmd += [args.data + '.tr.ffm', os.path.join(tmp, 'libffm.model')]
+    wall, rss = run(cmd, log)
+    # "iter tr_logloss va_logloss tr_time", with the cumulative time
+    epoch_time = []
+    loss = float('nan')
+    last = 0.0
+    with open(log) as f:
+        for line in f:
+            cols = line.split()
+            if len(cols) == 4 and re.match(r'^\d+$', cols[0]):
+                loss = float(cols[2])
+                epoch_time.append(float(cols[3]) - last)
+                last = float(cols[3])
+    return epoch_time, loss, wall, rss
+
+
+def run_libfm(args, threads, tmp):
+    out = os.path.join(tmp, 'libfm.out')
+    cmd = [args.libfm, '-task', 'c', '-method', 'sgd',
+           '-train', args.data + '.tr.svm', '-test', args.data + '.va.svm',
+           '-dim', '1,1,%d' % args.k, '-iter', str(args.epochs),
+           '-learn_rate', str(args.lr),
+           '-regular', '0,%g,%g' % (args.regu, args.regu),
+           '-init_stdev', '0.1', '-out', out]
+    wall, rss = run(cmd, os.path.join(tmp, 'libfm.log'))
+    with open(out) as f:
+        probs = [float(line) for line in f if line.strip()]
+    loss = logloss(read_labels(args.data + '.va.svm'), probs)
+    return [wall / args.epochs] * args.epochs, loss, wall, rss
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-data', required=True,
+                        help='prefix of the files of prepare_data.py')
+    parser.add_argument('-xlearn', required=True, help='path of xlearn_train')
+    parser.add_argument('-libffm', help='path of ffm-train of libffm')
+    parser.add_argument('-libfm', help='path of libFM')
+    parser.add_argument('-model', choices=['ffm', 'fm'], default='ffm')
+    parser.add_argument('-threads', default='1,2,4,8',
+                        help='numbers of the threads (default 1,2,4,8)')
+    parser.add_argument('-k', type=int, default=4)
+    parser.add_argument('-lr', type=float, default=0.2)
+    parser.add_argument('-regu', type=float, default=0.00002)
+    parser.add_argument('-epochs', type=int, default=10)
+    parser.add_argument('--no-norm', dest='norm', action='store_false',
+                        help='close the instance-wise normalization, '
+                             'which libFM never has')
+    parser.add_argument('-out', help='write the results to the csv file')
+    args = parser.parse_args()
+
+    threads = [int(t) for t in args.threads.split(',')]
+    systems = [('xlearn', run_xlearn, threads)]
+    if args.model == 'ffm' and args.libffm:
+        systems.append(('libffm', run_libffm, threads))
+    if args.model == 'fm' and args.libfm:
+        if args.norm:
+            print('[Warning] libFM has no normalization, so xLearn '
+                  'should be run with --no-norm')
+        # libFM has one thread
+        systems.append(('libfm', run_libfm, [1]))
+    tmp = tempfile.mkdtemp(prefix='xlearn_bench_')
+    # The binary cache of xLearn is built before the timed runs
+    run_xlearn(args, threads[0], tmp)
+    results = []
+    for name, func, counts in systems:
+        base = None
+        for t in counts:
+            epoch_time, loss, wall, rss = func(args, t, tmp)
+            mean = sum(epoch_time) / max(len(epoch_time), 1)
+            base = base or mean
+            results.append({'system': name, 'model': args.model,
+                            'threads': t, 'epochs': len(epoch_time),
+                            'epoch_time': mean,
+                            'speedup': base / mean if mean > 0 else 0,
+                            'peak_rss_mb': rss, 'wall_time': wall,
+                            'logloss': loss})
+            print('%-8s threads %2d: %.3f sec/epoch, speedup %.2f, '
+                  'peak RSS %.1f MB, logloss %.5f' %
+                  (name, t, mean, results[-1]['speedup'], rss, loss))
+            sys.stdout.flush()
+    if args.out:
+        with open(args.out, 'w') as f:
+            writer = csv.DictWriter(f, fieldnames=list(results[0].keys()))
+            writer.writeheader()
+            writer.writerows(results)
+        print('Write the results to %s' % args.out)
+    print('Logs: %s' % tmp)
+
+
+if __name__ == '__main__':
+    main()
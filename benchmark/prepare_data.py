@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+# Copyright (c) 2016 by contributors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Convert the first rows of the public CTR datasets into the files of
+compare.py, i.e., <prefix>.tr.ffm and <prefix>.va.ffm in libffm format
+for xLearn and libffm, and <prefix>.tr.svm and <prefix>.va.svm with the
+same features in libsvm format for libFM:
+
+  python3 prepare_data.py criteo dac/train.txt criteo_1m -rows 1000000
+  python3 prepare_data.py avazu avazu/train.csv avazu_1m -rows 1000000
+
+The criteo file is the train.txt of the Criteo display advertising
+challenge (label, 13 integer and 26 categorical columns separated by
+tabs), and the avazu file is the train.csv of the Avazu CTR prediction
+(id, click, hour and 21 categorical columns). Every value is a binary
+feature of its field, hashed into the buckets by md5 as the libffm
+solution of criteo does, and the integers larger than 2 are binned by
+floor(log(v)^2). The last rows (by -valid) are the validation set, so
+the split is the same for any run.
+"""
+
+import argparse
+import hashlib
+import math
+import sys
+
+
+def hash_feature(field, value, bucket):
+    key = ('%d-%s' % (field, value)).encode('utf-8')
+    return int(hashlib.md5(key).hexdigest(), 16) % bucket
+
+
+def criteo_fields(line):
+    cols = line.rstrip('\n').split('\t')
+    if len(cols) != 40:
+        return None, None
+    values = []
+    for i, v in enumerate(cols[1:14]):
+        if v == '':
+            values.append('')
+            continue
+        v = int(v)
+        values.append('I%d' % int(math.log(v) ** 2) if v > 2 else str(v))
+    values.extend(cols[14:])
+    return cols[0], values
+
+
+def avazu_fields(line):
+    cols = line.rstrip('\n').split(',')
+    if len(cols) != 24 or cols[1] not in ('0', '1'):
+        return None, None
+    # The hour of the day, without the date
+    values = [cols[2][-2:]] + cols[3:]
+    return cols[1], values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('dataset', choices=['criteo', 'avazu'])
+    parser.add_argument('input', help='raw file of the dataset')
+    parser.add_argument('prefix', help='prefix of the output files')
+    parser.add_argument('-rows', type=int, default=1000000,
+                        help='number of the rows (default 1000000)')
+    parser.add_argument('-valid', type=float, default=0.1,
+                        help='ratio of the validation rows (default 0.1)')
+    parser.add_argument('-bucket', type=int, default=1000000,
+                        help='number of the hashed features (default 1e6)')
+    args = parser.parse_args()
+
+    fields = criteo_fields if args.dataset == 'criteo' else avazu_fields
+    num_train = int(args.rows * (1 - args.valid))
+    out = {}
+    for part in ('tr', 'va'):
+        for fmt in ('ffm', 'svm'):
+            out[part, fmt] = open('%s.%s.%s' % (args.prefix, part, fmt), 'w')
+    rows = 0
+    with open(args.input) as f:
+        for line in f:
+            if rows == args.rows:
+                break
+            label, values = fields(line)
+            if label is None:
+                continue
+            part = 'tr' if rows < num_train else 'va'
+            ffm = [label]
+            svm = [label]
+            for field, value in enumerate(values):
+                if value == '':
+                    continue
+                feat = hash_feature(field, value, args.bucket)
+                ffm.append('%d:%d:1' % (field, feat))
+                svm.append('%d:1' % feat)
+            # libsvm needs the ascending ids
+            svm[1:] = sorted(set(svm[1:]), key=lambda s: int(s.split(':')[0]))
+            out[part, 'ffm'].write(' '.join(ffm) + '\n')
+            out[part, 'svm'].write(' '.join(svm) + '\n')
+            rows += 1
+    for f in out.values():
+        f.close()
+    if rows < args.rows:
+        sys.stderr.write('Only %d rows in %s\n' % (rows, args.input))
+    print('Write %d training and %d validation rows to %s.{tr,va}.{ffm,svm}'
+          % (min(rows, num_train), max(rows - num_train, 0), args.prefix))
+
+
+if __name__ == '__main__':
+    main()
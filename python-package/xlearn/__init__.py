@@ -0,0 +1,20 @@
+# Copyright (c) 2016 by contributors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""xLearn: the training and the prediction of linear, fm and ffm models
+on the SciPy and NumPy arrays (see core.py)."""
+
+from .core import DMatrix, Model, NODE_DTYPE, XLearnError, train
+
+__all__ = ['DMatrix', 'Model', 'NODE_DTYPE', 'XLearnError', 'train']
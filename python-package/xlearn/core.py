@@ -0,0 +1,238 @@
+# Copyright (c) 2016 by contributors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""The Python binding of xLearn on the C API (c_api.h and c_train_api.h).
+
+The rows are given as a SciPy CSR matrix, a dense NumPy array, or the
+nodes in the layout of xLearn, and the training and the prediction run
+in the shared library libxlearn_api.so (built by cmake -DXLEARN_PYTHON=ON)
+without the GIL, since the ctypes calls of a CDLL release it:
+
+    import xlearn
+    dtrain = xlearn.DMatrix(X_train, y_train, field=field_of_column)
+    xlearn.train({'score': 'ffm', 'k': 8, 'epoch': 5}, dtrain,
+                 '/tmp/model.bin')
+    with xlearn.Model('/tmp/model.bin') as model:
+        prob = model.predict(xlearn.DMatrix(X_test))
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+# The layout of XLearnNode, which is the Node of xLearn
+NODE_DTYPE = np.dtype([('field', '<u4'), ('feat', '<u4'), ('value', '<f4')])
+
+# Error codes of c_api.h
+_ERRORS = {
+    -1: 'Illegal argument',
+    -2: 'Cannot open the file',
+    -3: 'Not a memory-mappable model',
+    -4: 'Cannot load the feature map',
+    -5: 'Illegal rows of the training',
+}
+
+# Flags of XLearnOpenModel()
+_NO_NORM = 1
+_RAW_SCORE = 2
+
+
+class XLearnError(Exception):
+    """The error of the C API, with its code."""
+
+    def __init__(self, code, message=''):
+        self.code = code
+        Exception.__init__(self, message or _ERRORS.get(code, str(code)))
+
+
+class _Rows(ctypes.Structure):
+    _fields_ = [('nodes', ctypes.c_void_p),
+                ('offset', ctypes.c_void_p),
+                ('label', ctypes.c_void_p),
+                ('num_rows', ctypes.c_uint64)]
+
+
+def _find_library():
+    """The library of XLEARN_LIBRARY, or the one next to the package,
+    or the one of the build directory of the source tree."""
+    path = os.environ.get('XLEARN_LIBRARY')
+    if path:
+        return path
+    here = os.path.dirname(os.path.abspath(__file__))
+    for candidate in (os.path.join(here, 'libxlearn_api.so'),
+                      os.path.join(here, '..', '..', 'build', 'src',
+                                   'c_api', 'libxlearn_api.so')):
+        if os.path.exists(candidate):
+            return candidate
+    return 'libxlearn_api.so'
+
+
+_LIB = None
+
+
+def _lib():
+    global _LIB
+    if _LIB is None:
+        lib = ctypes.CDLL(_find_library())
+        lib.XLearnTrainRows.argtypes = [
+            ctypes.POINTER(_Rows), ctypes.POINTER(_Rows),
+            ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_char_p),
+            ctypes.c_int, ctypes.c_char_p]
+        lib.XLearnLastError.restype = ctypes.c_char_p
+        lib.XLearnOpenModel.argtypes = [
+            ctypes.c_char_p, ctypes.c_int, ctypes.POINTER(ctypes.c_void_p)]
+        lib.XLearnCloseModel.argtypes = [ctypes.c_void_p]
+        lib.XLearnScoreRows.argtypes = [
+            ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+            ctypes.c_uint64, ctypes.c_void_p]
+        lib.XLearnNumFeature.argtypes = [ctypes.c_void_p]
+        lib.XLearnNumFeature.restype = ctypes.c_uint32
+        _LIB = lib
+    return _LIB
+
+
+def _contiguous(array, dtype):
+    """The array itself if it has the dtype and is C-contiguous,
+    otherwise a copy of it."""
+    return np.ascontiguousarray(array, dtype=dtype)
+
+
+class DMatrix(object):
+    """The rows of the training or the prediction.
+
+    X is one of:
+      - a SciPy sparse matrix (CSR, or converted to CSR),
+      - a dense 2-D NumPy array, whose zeros are dropped,
+      - a tuple (nodes, indptr) of the nodes of NODE_DTYPE and their
+        row offsets, which are used in place without any copy.
+
+    field is the field of each column (or of each stored value) for
+    ffm, and y is the label of each row (0/1 for cross-entropy).
+
+    The nodes of a CSR matrix are packed once into NODE_DTYPE, since
+    its indices and data are two arrays, and the DMatrix keeps them, so
+    the calls of train() and predict() do not copy the nodes again.
+    """
+
+    def __init__(self, X, y=None, field=None):
+        if isinstance(X, tuple):
+            nodes, indptr = X
+            if nodes.dtype != NODE_DTYPE:
+                raise ValueError('The nodes should be of NODE_DTYPE')
+            self.nodes = _contiguous(nodes, NODE_DTYPE)
+            self.indptr = _contiguous(indptr, np.uint64)
+        else:
+            if not hasattr(X, 'tocsr'):
+                X = np.asarray(X)
+                if X.ndim != 2:
+                    raise ValueError('X should be a 2-D array')
+                rows, cols = np.nonzero(X)
+                counts = np.bincount(rows, minlength=X.shape[0])
+                indptr = np.concatenate(([0], np.cumsum(counts)))
+                indices, data = cols, X[rows, cols]
+            else:
+                X = X.tocsr()
+                X.sort_indices()
+                indptr, indices, data = X.indptr, X.indices, X.data
+            self.indptr = _contiguous(indptr, np.uint64)
+            self.nodes = np.empty(len(indices), dtype=NODE_DTYPE)
+            self.nodes['feat'] = indices
+            self.nodes['value'] = data
+            if field is None:
+                self.nodes['field'] = 0
+            else:
+                field = np.asarray(field, dtype=np.uint32)
+                if len(field) == len(indices):
+                    self.nodes['field'] = field
+                else:
+                    self.nodes['field'] = field[indices]
+        self.num_rows = len(self.indptr) - 1
+        if y is None:
+            self.label = np.zeros(self.num_rows, dtype=np.float32)
+        else:
+            self.label = _contiguous(y, np.float32)
+            if len(self.label) != self.num_rows:
+                raise ValueError('The length of y is not the number of rows')
+
+    def _rows(self):
+        # The arrays are kept by the DMatrix during the call
+        return _Rows(self.nodes.ctypes.data, self.indptr.ctypes.data,
+                     self.label.ctypes.data, self.num_rows)
+
+
+def train(params, dtrain, model_file, dvalid=None):
+    """Train the model of the params on dtrain and save it into the
+    memory-mappable model_file, which is opened by Model. The params
+    are the keys of c_train_api.h, e.g., {'score': 'fm', 'k': 8}, and
+    dvalid is evaluated after each epoch."""
+    keys = [str(k).encode() for k in params]
+    values = []
+    for k in params:
+        v = params[k]
+        if isinstance(v, bool):
+            v = int(v)
+        values.append(str(v).encode())
+    key_array = (ctypes.c_char_p * len(keys))(*keys)
+    value_array = (ctypes.c_char_p * len(values))(*values)
+    train_rows = dtrain._rows()
+    valid_rows = dvalid._rows() if dvalid is not None else None
+    lib = _lib()
+    ret = lib.XLearnTrainRows(
+        ctypes.byref(train_rows),
+        ctypes.byref(valid_rows) if valid_rows is not None else None,
+        key_array, value_array, len(keys), model_file.encode())
+    if ret != 0:
+        raise XLearnError(ret, lib.XLearnLastError().decode())
+
+
+class Model(object):
+    """The model saved by train(), which is mapped in read-only mode.
+    predict() returns the probability for cross-entropy, the class for
+    hinge and the raw score for squared loss, or the raw score of each
+    row if raw_score is True. norm should be the one of the training."""
+
+    def __init__(self, model_file, norm=True, raw_score=False):
+        flags = (0 if norm else _NO_NORM) | (_RAW_SCORE if raw_score else 0)
+        self._handle = ctypes.c_void_p()
+        ret = _lib().XLearnOpenModel(model_file.encode(), flags,
+                                     ctypes.byref(self._handle))
+        if ret != 0:
+            raise XLearnError(ret)
+
+    def num_feature(self):
+        return _lib().XLearnNumFeature(self._handle)
+
+    def predict(self, dmatrix):
+        out = np.empty(dmatrix.num_rows, dtype=np.float32)
+        ret = _lib().XLearnScoreRows(self._handle, dmatrix.nodes.ctypes.data,
+                                     dmatrix.indptr.ctypes.data,
+                                     dmatrix.num_rows, out.ctypes.data)
+        if ret != 0:
+            raise XLearnError(ret)
+        return out
+
+    def close(self):
+        if self._handle:
+            _lib().XLearnCloseModel(self._handle)
+            self._handle = ctypes.c_void_p()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
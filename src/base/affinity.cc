@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the CPU affinity utilities.
+*/
+
+#include "src/base/affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <set>
+
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "src/base/split_string.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+// Parse the non-negative integer of the whole string
+static bool parse_cpu(const std::string& str, int* cpu) {
+  if (str.empty() || str.size() > 6) { return false; }
+  int value = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] < '0' || str[i] > '9') { return false; }
+    value = value * 10 + (str[i] - '0');
+  }
+  *cpu = value;
+  return true;
+}
+
+bool ParseCpuList(const std::string& list, std::vector<int>* cpus) {
+  std::vector<std::string> items;
+  SplitStringUsing(list, ", \n", &items);
+  if (items.empty()) { return false; }
+  std::set<int> cpu_set;
+  for (size_t i = 0; i < items.size(); ++i) {
+    size_t dash = items[i].find('-');
+    int first = 0, last = 0;
+    if (dash == std::string::npos) {
+      if (!parse_cpu(items[i], &first)) { return false; }
+      last = first;
+    } else if (!parse_cpu(items[i].substr(0, dash), &first) ||
+               !parse_cpu(items[i].substr(dash + 1), &last) ||
+               last < first) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpu_set.insert(cpu);
+    }
+  }
+  cpus->assign(cpu_set.begin(), cpu_set.end());
+  return true;
+}
+
+// Read the CPU list in the sysfs file
+static bool read_cpu_list(const std::string& filename,
+                          std::vector<int>* cpus) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) { return false; }
+  char buf[4096];
+  size_t size = fread(buf, 1, sizeof(buf) - 1, file);
+  fclose(file);
+  buf[size] = '\0';
+  return ParseCpuList(std::string(buf), cpus);
+}
+
+// The first CPU of the siblings of each core is kept
+static bool physical_cpus(const std::vector<int>& cpus,
+                          std::vector<int>* result) {
+  result->clear();
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    std::vector<int> siblings;
+    std::string filename = StringPrintf(
+      "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+      cpus[i]);
+    if (!read_cpu_list(filename, &siblings)) { return false; }
+    if (siblings[0] == cpus[i]) { result->push_back(cpus[i]); }
+  }
+  return !result->empty();
+}
+
+bool GetAffinityCpus(const std::string& spec, std::vector<int>* cpus) {
+  std::vector<std::string> items;
+  SplitStringUsing(spec, ":", &items);
+  if (items.empty()) { return false; }
+  std::vector<int> all;
+  size_t next = 0;
+  if (items[0] == "node") {
+    int node = 0;
+    if (items.size() < 2 || !parse_cpu(items[1], &node)) { return false; }
+    std::string filename = StringPrintf(
+      "/sys/devices/system/node/node%d/cpulist", node);
+    if (!read_cpu_list(filename, &all)) { return false; }
+    next = 2;
+  } else if (items[0] == "physical") {
+    if (!read_cpu_list("/sys/devices/system/cpu/online", &all)) {
+      return false;
+    }
+  } else {
+    if (items.size() != 1) { return false; }
+    return ParseCpuList(items[0], cpus);
+  }
+  if (next < items.size() && items[next] == "physical") { next++; }
+  if (next != items.size()) { return false; }
+  if (items.back() == "physical") {
+    return physical_cpus(all, cpus);
+  }
+  cpus->swap(all);
+  return !cpus->empty();
+}
+
+bool PinThread(std::thread* thread, int cpu) {
+#ifdef __linux__
+  if (cpu < 0 || cpu >= CPU_SETSIZE) { return false; }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  return pthread_setaffinity_np(thread->native_handle(),
+                                sizeof(cpu_set), &cpu_set) == 0;
+#else
+  return false;
+#endif
+}
+
+bool GetNumaNodes(std::vector<int>* nodes) {
+  return read_cpu_list("/sys/devices/system/node/online", nodes);
+}
+
+#ifdef __linux__
+// The memory policies of mbind(), see numaif.h
+static const int kMpolPreferred = 1;
+static const int kMpolInterleave = 3;
+
+// Bind the pages to the nodes, which fails if the
+// system call is not permitted (e.g., in a container)
+static bool bind_pages(char* begin, char* end, int mode,
+                       const std::vector<int>& nodes) {
+  if (end <= begin) { return true; }
+  const size_t kBits = 8 * sizeof(unsigned long);
+  // The kernel reads maxnode - 1 bits of the mask
+  std::vector<unsigned long> mask(nodes.back() / kBits + 1, 0);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    mask[nodes[i] / kBits] |= 1UL << (nodes[i] % kBits);
+  }
+  return syscall(SYS_mbind, begin, end - begin, mode, mask.data(),
+                 mask.size() * kBits + 1, 0) == 0;
+}
+
+// Zero-fill the part of the node by its CPUs
+static void touch_pages(char* begin, char* end, int node) {
+  if (end <= begin) { return; }
+  std::vector<int> cpus;
+  if (!GetAffinityCpus(StringPrintf("node:%d", node), &cpus)) {
+    cpus.assign(1, -1);
+  }
+  size_t num_page = (end - begin) / sysconf(_SC_PAGESIZE);
+  size_t num_thread = std::max((size_t)1, std::min(cpus.size(), num_page));
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_thread; ++i) {
+    char* first = begin + (end - begin) * i / num_thread;
+    char* last = begin + (end - begin) * (i + 1) / num_thread;
+    int cpu = cpus[i];
+    threads.emplace_back([first, last, cpu]() {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+      }
+      memset(first, 0, last - first);
+    });
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+}
+#endif
+
+// Only the whole pages in the memory are placed, and the
+// part of each node starts at a page boundary
+bool PlaceMemory(void* addr, size_t size, const std::string& policy) {
+  if (policy != "none" && policy != "interleave" &&
+      policy != "partition") {
+    return false;
+  }
+#ifdef __linux__
+  std::vector<int> nodes;
+  if (policy == "none" || addr == nullptr ||
+      !GetNumaNodes(&nodes) || nodes.size() < 2) {
+    return true;
+  }
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  char* begin = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(addr) + page - 1) / page * page);
+  char* end = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(addr) + size) / page * page);
+  if (end <= begin) { return true; }
+  size_t num_page = (end - begin) / page;
+  std::vector<char*> parts(nodes.size() + 1);
+  for (size_t n = 0; n <= nodes.size(); ++n) {
+    parts[n] = begin + num_page * n / nodes.size() * page;
+  }
+  if (policy == "interleave") {
+    bind_pages(begin, end, kMpolInterleave, nodes);
+  } else {
+    for (size_t n = 0; n < nodes.size(); ++n) {
+      bind_pages(parts[n], parts[n+1], kMpolPreferred,
+                 std::vector<int>(1, nodes[n]));
+    }
+  }
+  // The nodes touch their parts at the same time
+  std::vector<std::thread> threads;
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    threads.emplace_back(touch_pages, parts[n], parts[n+1], nodes[n]);
+  }
+  for (size_t n = 0; n < threads.size(); ++n) {
+    threads[n].join();
+  }
+#endif
+  return true;
+}
+
+}  // namespace xLearn
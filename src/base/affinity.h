@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file provides the utilities of CPU affinity, which pin
+the threads of xLearn to a set of CPUs.
+*/
+
+#ifndef XLEARN_BASE_AFFINITY_H_
+#define XLEARN_BASE_AFFINITY_H_
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The CPUs used by xLearn are given by a spec, which can be:
+//
+//   "0-3,8,10-11"      /* a CPU list, as the format of taskset -c */
+//   "physical"         /* one hardware thread of each physical core */
+//   "node:1"           /* the CPUs of NUMA node 1 */
+//   "node:1:physical"  /* one hardware thread of each core of node 1 */
+//
+// The CPU lists of the NUMA nodes and the hyperthread siblings are read
+// from /sys/devices/system, so only the CPU list works on other systems:
+//
+//   std::vector<int> cpus;
+//   if (!GetAffinityCpus("node:0:physical", &cpus)) { /* bad spec */ }
+//   ThreadPool pool(cpus.size(), cpus);  /* pin worker i to cpus[i] */
+//------------------------------------------------------------------------------
+
+// Parse the CPU list like "0-3,8" into cpus in ascending
+// order. Return false for the illegal list
+bool ParseCpuList(const std::string& list, std::vector<int>* cpus);
+
+// Get the CPUs of the spec. Return false for the illegal
+// spec or the spec gives no CPU
+bool GetAffinityCpus(const std::string& spec, std::vector<int>* cpus);
+
+// Pin the thread to the cpu. Return false if this is not
+// supported on current system or the cpu is not available
+bool PinThread(std::thread* thread, int cpu);
+
+//------------------------------------------------------------------------------
+// The pages of a large buffer (like the model) are placed on the NUMA
+// nodes by a policy before they are touched:
+//
+//   "none"        /* the node of the thread that first touches a page */
+//   "interleave"  /* the pages are interleaved over the nodes */
+//   "partition"   /* the buffer is split into one contiguous part of each
+//                    node, e.g., the feature ranges of the model */
+//
+// PlaceMemory() binds the pages by mbind(), and the pages are touched by
+// the threads pinned to the CPUs of their nodes, so the placement is also
+// kept by the first touch if mbind() is not permitted:
+//
+//   void* buf = nullptr;
+//   posix_memalign(&buf, 4096, size);
+//   if (!PlaceMemory(buf, size, "partition")) { /* bad policy */ }
+//   ... set the values of buf ...
+//------------------------------------------------------------------------------
+
+// Get the online NUMA nodes in ascending order. Return
+// false if the nodes are unknown on current system
+bool GetNumaNodes(std::vector<int>* nodes);
+
+// Place the memory on the NUMA nodes by the policy. The pages are
+// zero-filled if there are several nodes, and the memory is not
+// touched on a single node. Return false for the illegal policy
+bool PlaceMemory(void* addr, size_t size, const std::string& policy);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_AFFINITY_H_
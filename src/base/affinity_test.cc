@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests affinity.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+
+#include "src/base/affinity.h"
+
+namespace xLearn {
+
+TEST(AffinityTest, ParseCpuList) {
+  std::vector<int> cpus;
+  EXPECT_TRUE(ParseCpuList("0-3,8,10-11\n", &cpus));
+  ASSERT_EQ(cpus.size(), 7);
+  EXPECT_EQ(cpus[0], 0);
+  EXPECT_EQ(cpus[3], 3);
+  EXPECT_EQ(cpus[4], 8);
+  EXPECT_EQ(cpus[6], 11);
+  // The duplicated cpus are merged in ascending order
+  EXPECT_TRUE(ParseCpuList("5,1-2,2", &cpus));
+  ASSERT_EQ(cpus.size(), 3);
+  EXPECT_EQ(cpus[0], 1);
+  EXPECT_EQ(cpus[2], 5);
+  EXPECT_FALSE(ParseCpuList("", &cpus));
+  EXPECT_FALSE(ParseCpuList("3-1", &cpus));
+  EXPECT_FALSE(ParseCpuList("a,1", &cpus));
+  EXPECT_FALSE(ParseCpuList("1-", &cpus));
+}
+
+TEST(AffinityTest, GetAffinityCpus) {
+  std::vector<int> cpus;
+  EXPECT_TRUE(GetAffinityCpus("2,4", &cpus));
+  ASSERT_EQ(cpus.size(), 2);
+  EXPECT_EQ(cpus[1], 4);
+  EXPECT_FALSE(GetAffinityCpus("node", &cpus));
+  EXPECT_FALSE(GetAffinityCpus("node:x", &cpus));
+  EXPECT_FALSE(GetAffinityCpus("node:0:logical", &cpus));
+  EXPECT_FALSE(GetAffinityCpus("physical:1", &cpus));
+#ifdef __linux__
+  // Every system has the first node and the physical cores
+  // if the sysfs is mounted
+  if (GetAffinityCpus("physical", &cpus)) {
+    EXPECT_GT(cpus.size(), 0);
+  }
+  if (GetAffinityCpus("node:0:physical", &cpus)) {
+    EXPECT_GT(cpus.size(), 0);
+  }
+#endif
+}
+
+TEST(AffinityTest, PinThread) {
+  std::vector<int> cpus;
+  // The thread keeps running until it is pinned
+  std::atomic_bool done(false);
+  std::thread thread([&done]() { while (!done) { } });
+#ifdef __linux__
+  if (GetAffinityCpus("physical", &cpus)) {
+    EXPECT_TRUE(PinThread(&thread, cpus[0]));
+  }
+#endif
+  EXPECT_FALSE(PinThread(&thread, -1));
+  done = true;
+  thread.join();
+}
+
+TEST(AffinityTest, PlaceMemory) {
+  std::vector<int> nodes;
+  if (GetNumaNodes(&nodes)) {
+    EXPECT_GT(nodes.size(), 0);
+  }
+  // The memory is not page-aligned, and the pages are
+  // zero-filled only on the system of several nodes
+  size_t size = 1 << 20;
+  std::vector<char> buf(size + 100, 1);
+  EXPECT_TRUE(PlaceMemory(buf.data() + 100, size, "interleave"));
+  EXPECT_TRUE(PlaceMemory(buf.data() + 100, size, "partition"));
+  EXPECT_TRUE(PlaceMemory(buf.data(), size, "none"));
+  EXPECT_TRUE(PlaceMemory(buf.data(), 10, "partition"));
+  EXPECT_FALSE(PlaceMemory(buf.data(), size, "node"));
+  EXPECT_EQ(buf[0], 1);
+}
+
+}  // namespace xLearn
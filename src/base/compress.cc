@@ -0,0 +1,156 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of compress.h
+*/
+
+#include "src/base/compress.h"
+
+#include <string.h>  // for memcpy()
+
+namespace xLearn {
+
+static const uint32 kMinMatch = 4;
+static const uint32 kMaxOffset = 65535;
+static const uint32 kHashLog = 14;
+static const uint32 kNoPos = 0xFFFFFFFF;
+
+// Read 4 bytes without alignment
+static inline uint32 read32(const uint8* p) {
+  uint32 val;
+  memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+static inline uint32 hash32(uint32 val) {
+  return (val * 2654435761U) >> (32 - kHashLog);
+}
+
+// Write the extra bytes of a length that is larger than 15
+static inline void write_length(uint64 len, std::vector<char>* dst) {
+  while (len >= 255) {
+    dst->push_back((char)255);
+    len -= 255;
+  }
+  dst->push_back((char)len);
+}
+
+// Write a (literals, match) pair. match_len == 0 means no match
+static void write_sequence(const uint8* literal, uint64 literal_len,
+                           uint32 offset, uint64 match_len,
+                           std::vector<char>* dst) {
+  uint64 match_code = match_len > 0 ? match_len - kMinMatch : 0;
+  uint8 token = (uint8)((literal_len < 15 ? literal_len : 15) << 4);
+  token |= (uint8)(match_code < 15 ? match_code : 15);
+  dst->push_back((char)token);
+  if (literal_len >= 15) { write_length(literal_len - 15, dst); }
+  dst->insert(dst->end(), literal, literal + literal_len);
+  if (match_len == 0) { return; }
+  dst->push_back((char)(offset & 0xFF));
+  dst->push_back((char)(offset >> 8));
+  if (match_code >= 15) { write_length(match_code - 15, dst); }
+}
+
+uint64 Compress(const char* src, uint64 size, std::vector<char>* dst) {
+  CHECK_NOTNULL(dst);
+  CHECK_LT(size, (uint64)kNoPos);
+  uint64 start = dst->size();
+  dst->reserve(start + size + size / 255 + 16);
+  const uint8* in = reinterpret_cast<const uint8*>(src);
+  std::vector<uint32> table(1 << kHashLog, kNoPos);
+  uint64 anchor = 0;
+  uint64 pos = 0;
+  while (pos + kMinMatch <= size) {
+    uint32 val = read32(in + pos);
+    uint32 h = hash32(val);
+    uint32 ref = table[h];
+    table[h] = (uint32)pos;
+    if (ref == kNoPos || pos - ref > kMaxOffset ||
+        read32(in + ref) != val) {
+      pos++;
+      continue;
+    }
+    uint64 len = kMinMatch;
+    while (pos + len < size && in[ref+len] == in[pos+len]) { len++; }
+    write_sequence(in + anchor, pos - anchor,
+                   (uint32)(pos - ref), len, dst);
+    pos += len;
+    anchor = pos;
+  }
+  write_sequence(in + anchor, size - anchor, 0, 0, dst);
+  return dst->size() - start;
+}
+
+// Read the extra bytes of a length. Return false on overflow
+static inline bool read_length(const uint8** ip, const uint8* end,
+                               uint64* len) {
+  uint8 byte = 255;
+  while (byte == 255) {
+    if (*ip >= end) { return false; }
+    byte = *(*ip)++;
+    *len += byte;
+  }
+  return true;
+}
+
+bool Decompress(const char* src, uint64 size,
+                char* dst, uint64 raw_size) {
+  const uint8* ip = reinterpret_cast<const uint8*>(src);
+  const uint8* end = ip + size;
+  uint8* out = reinterpret_cast<uint8*>(dst);
+  uint64 op = 0;
+  while (ip < end) {
+    uint8 token = *ip++;
+    uint64 literal_len = token >> 4;
+    if (literal_len == 15 && !read_length(&ip, end, &literal_len)) {
+      return false;
+    }
+    if (literal_len > (uint64)(end - ip) ||
+        literal_len > raw_size - op) {
+      return false;
+    }
+    memcpy(out + op, ip, literal_len);
+    ip += literal_len;
+    op += literal_len;
+    // The last sequence has no match
+    if (ip == end) { break; }
+    if (end - ip < 2) { return false; }
+    uint64 offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    uint64 match_len = token & 0x0F;
+    if (match_len == 15 && !read_length(&ip, end, &match_len)) {
+      return false;
+    }
+    match_len += kMinMatch;
+    if (offset == 0 || offset > op || match_len > raw_size - op) {
+      return false;
+    }
+    // The match can overlap with the output
+    uint8* m = out + op - offset;
+    if (offset >= match_len) {
+      memcpy(out + op, m, match_len);
+    } else {
+      for (uint64 i = 0; i < match_len; ++i) { out[op+i] = m[i]; }
+    }
+    op += match_len;
+  }
+  return op == raw_size;
+}
+
+}  // namespace xLearn
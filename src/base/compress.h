@@ -0,0 +1,65 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines a fast block compressor, which is used
+to reduce the size of the binary cache file.
+*/
+
+#ifndef XLEARN_BASE_COMPRESS_H_
+#define XLEARN_BASE_COMPRESS_H_
+
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// A small LZ77-style codec, which is designed for speed rather
+// than ratio. Each block is compressed independently, so multiple
+// blocks can be decoded in parallel. We can use it like this:
+//
+//   std::vector<char> comp;
+//   Compress(raw.data(), raw.size(), &comp);
+//
+//   std::vector<char> out(raw.size());
+//   CHECK(Decompress(comp.data(), comp.size(),
+//                    out.data(), out.size()));
+//
+// The compressed block is a sequence of (literals, match) pairs.
+// Each pair starts with a token byte: the high 4 bits is the
+// literal length and the low 4 bits is the match length minus 4.
+// The value of 15 means that more length bytes follow. A match is
+// stored as a 2-byte back offset. The last pair has no match.
+// Note that the raw size of the block is not stored in the block,
+// so the caller needs to record it.
+//------------------------------------------------------------------------------
+
+// Compress the src buffer and append the result to dst.
+// Return the size (byte) of the compressed block.
+uint64 Compress(const char* src, uint64 size, std::vector<char>* dst);
+
+// Decompress the src block into dst, which has raw_size bytes.
+// Return false if the block is corrupted.
+bool Decompress(const char* src, uint64 size,
+                char* dst, uint64 raw_size);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_COMPRESS_H_
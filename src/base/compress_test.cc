@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests compress.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <vector>
+#include <string>
+#include <stdlib.h>
+
+#include "src/base/common.h"
+#include "src/base/compress.h"
+
+namespace xLearn {
+
+void CheckRoundTrip(const std::vector<char>& raw) {
+  std::vector<char> comp;
+  uint64 size = Compress(raw.data(), raw.size(), &comp);
+  EXPECT_EQ(size, comp.size());
+  std::vector<char> out(raw.size() + 1, 'x');
+  EXPECT_TRUE(Decompress(comp.data(), comp.size(),
+                         out.data(), raw.size()));
+  out.resize(raw.size());
+  EXPECT_EQ(out, raw);
+}
+
+TEST(COMPRESS_TEST, Empty) {
+  std::vector<char> raw;
+  CheckRoundTrip(raw);
+}
+
+TEST(COMPRESS_TEST, Short) {
+  std::string str = "abc";
+  CheckRoundTrip(std::vector<char>(str.begin(), str.end()));
+}
+
+TEST(COMPRESS_TEST, Repeat) {
+  // Long runs and overlapped matches
+  std::vector<char> raw(100000, 'a');
+  CheckRoundTrip(raw);
+  std::vector<char> comp;
+  Compress(raw.data(), raw.size(), &comp);
+  EXPECT_LT(comp.size(), raw.size() / 100);
+  std::string str;
+  for (int i = 0; i < 10000; ++i) {
+    str += "1:0:0.5 2:1:1 3:2:0.25\n";
+  }
+  CheckRoundTrip(std::vector<char>(str.begin(), str.end()));
+}
+
+TEST(COMPRESS_TEST, Random) {
+  srand(0);
+  std::vector<char> raw(300000);
+  for (size_t i = 0; i < raw.size(); ++i) {
+    // Mix random bytes and repeated pattern
+    raw[i] = (i / 1000) % 2 ? (char)(rand() % 256) : (char)(i % 7);
+  }
+  CheckRoundTrip(raw);
+}
+
+TEST(COMPRESS_TEST, Corrupted) {
+  std::string str;
+  for (int i = 0; i < 100; ++i) { str += "xlearn "; }
+  std::vector<char> comp;
+  Compress(str.data(), str.size(), &comp);
+  std::vector<char> out(str.size());
+  // Wrong raw size
+  EXPECT_FALSE(Decompress(comp.data(), comp.size(),
+                          out.data(), str.size() - 1));
+  // Truncated block
+  EXPECT_FALSE(Decompress(comp.data(), comp.size() / 2,
+                          out.data(), str.size()));
+}
+
+}  // namespace xLearn
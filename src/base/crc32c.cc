@@ -0,0 +1,86 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the CRC32C by the tables.
+*/
+
+#include "src/base/crc32c.h"
+
+#include <string.h>
+
+namespace xLearn {
+
+// The reflected polynomial of CRC32C
+static const uint32 kCrc32cPoly = 0x82f63b78;
+
+// table[k][b] is the CRC of the byte b followed by k zero bytes
+struct Crc32cTable {
+  uint32 table[8][256];
+
+  Crc32cTable() {
+    for (uint32 b = 0; b < 256; ++b) {
+      uint32 crc = b;
+      for (int i = 0; i < 8; ++i) {
+        crc = (crc >> 1) ^ (kCrc32cPoly & (0 - (crc & 1)));
+      }
+      table[0][b] = crc;
+    }
+    for (uint32 b = 0; b < 256; ++b) {
+      for (int k = 1; k < 8; ++k) {
+        uint32 prev = table[k-1][b];
+        table[k][b] = (prev >> 8) ^ table[0][prev & 0xff];
+      }
+    }
+  }
+};
+
+uint32 Crc32cSoftware(const char* data, uint64 len, uint32 crc) {
+  static const Crc32cTable tables;
+  const uint32 (*t)[256] = tables.table;
+  const uint8* p = reinterpret_cast<const uint8*>(data);
+  crc = ~crc;
+  // The little-endian words of 8 bytes
+  for (; len >= 8; len -= 8, p += 8) {
+    uint32 lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+          t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+          t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+  }
+  for (; len > 0; --len, ++p) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+  }
+  return ~crc;
+}
+
+bool SupportCrc32cSSE42() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+
+uint32 Crc32c(const char* data, uint64 len, uint32 crc) {
+  static const bool sse42 = SupportCrc32cSSE42();
+  return sse42 ? Crc32cSSE42(data, len, crc) :
+                 Crc32cSoftware(data, len, crc);
+}
+
+}  // namespace xLearn
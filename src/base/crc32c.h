@@ -0,0 +1,53 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the CRC32C (Castagnoli) checksum, which is used
+to detect the corrupted chunks of the model files.
+*/
+
+#ifndef XLEARN_BASE_CRC32C_H_
+#define XLEARN_BASE_CRC32C_H_
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The CRC32C of the bytes, which can be computed in pieces:
+//
+//   uint32 crc = Crc32c(data, len);
+//   uint32 same = Crc32c(data + 10, len - 10, Crc32c(data, 10));
+//
+// It uses the crc32 instruction of SSE4.2 (about 8 bytes per cycle)
+// if the CPU supports it, and the slicing-by-8 tables otherwise.
+//------------------------------------------------------------------------------
+uint32 Crc32c(const char* data, uint64 len, uint32 crc = 0);
+
+// The same checksum by the tables, which is used by the tests
+uint32 Crc32cSoftware(const char* data, uint64 len, uint32 crc = 0);
+
+// The same checksum by SSE4.2, which the CPU should support
+uint32 Crc32cSSE42(const char* data, uint64 len, uint32 crc);
+
+// The CPU supports the crc32 instruction of SSE4.2
+bool SupportCrc32cSSE42();
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_CRC32C_H_
@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the CRC32C by SSE4.2, which is
+compiled with -msse4.2 and only invoked if the CPU supports it.
+*/
+
+#include <nmmintrin.h>
+#include <string.h>
+
+#include "src/base/crc32c.h"
+
+namespace xLearn {
+
+// The crc32 instruction has the latency of 3 cycles and the throughput
+// of 1 cycle, so the long buffers are computed in 3 interleaved streams,
+// whose CRCs are combined by shifting them over the zeros of the next
+// streams (see crc32c_shift)
+static const uint64 kLongBytes = 8192;
+static const uint64 kShortBytes = 256;
+
+// The reflected polynomial of CRC32C
+static const uint32 kPoly = 0x82f63b78;
+
+// Multiply the vector by the matrix over GF(2)
+static uint32 gf2_matrix_times(const uint32* mat, uint32 vec) {
+  uint32 sum = 0;
+  for (; vec != 0; vec >>= 1, ++mat) {
+    if (vec & 1) { sum ^= *mat; }
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32* square, const uint32* mat) {
+  for (int n = 0; n < 32; ++n) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+// The operator of appending len zero bytes to a CRC
+static void zeros_op(uint32* even, uint64 len) {
+  uint32 odd[32];
+  odd[0] = kPoly;
+  uint32 row = 1;
+  for (int n = 1; n < 32; ++n) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  gf2_matrix_square(even, odd);  /* 2 zero bits */
+  gf2_matrix_square(odd, even);  /* 4 zero bits */
+  // The first square gives one zero byte
+  for (;;) {
+    gf2_matrix_square(even, odd);
+    len >>= 1;
+    if (len == 0) { return; }
+    gf2_matrix_square(odd, even);
+    len >>= 1;
+    if (len == 0) { break; }
+  }
+  for (int n = 0; n < 32; ++n) { even[n] = odd[n]; }
+}
+
+// The tables of the operator of each byte of the CRC
+struct ShiftTable {
+  uint32 table[4][256];
+
+  explicit ShiftTable(uint64 len) {
+    uint32 op[32];
+    zeros_op(op, len);
+    for (uint32 n = 0; n < 256; ++n) {
+      table[0][n] = gf2_matrix_times(op, n);
+      table[1][n] = gf2_matrix_times(op, n << 8);
+      table[2][n] = gf2_matrix_times(op, n << 16);
+      table[3][n] = gf2_matrix_times(op, n << 24);
+    }
+  }
+};
+
+// The CRC after the zeros of the table
+static inline uint32 crc32c_shift(const ShiftTable& zeros, uint32 crc) {
+  return zeros.table[0][crc & 0xff] ^ zeros.table[1][(crc >> 8) & 0xff] ^
+         zeros.table[2][(crc >> 16) & 0xff] ^ zeros.table[3][crc >> 24];
+}
+
+static inline uint64 load_word(const uint8* p) {
+  uint64 word;
+  memcpy(&word, p, 8);
+  return word;
+}
+
+// Compute the 3 streams of block bytes of p
+static inline uint64 crc32c_triple(const ShiftTable& zeros, uint64 block,
+                                   uint64 crc0, const uint8* p) {
+  uint64 crc1 = 0, crc2 = 0;
+  for (uint64 i = 0; i < block; i += 8) {
+    crc0 = _mm_crc32_u64(crc0, load_word(p + i));
+    crc1 = _mm_crc32_u64(crc1, load_word(p + block + i));
+    crc2 = _mm_crc32_u64(crc2, load_word(p + 2 * block + i));
+  }
+  crc0 = crc32c_shift(zeros, (uint32)crc0) ^ crc1;
+  return crc32c_shift(zeros, (uint32)crc0) ^ crc2;
+}
+
+uint32 Crc32cSSE42(const char* data, uint64 len, uint32 crc) {
+  static const ShiftTable long_zeros(kLongBytes);
+  static const ShiftTable short_zeros(kShortBytes);
+  const uint8* p = reinterpret_cast<const uint8*>(data);
+  uint64 c = (uint32)~crc;
+  for (; len >= 3 * kLongBytes; len -= 3 * kLongBytes) {
+    c = crc32c_triple(long_zeros, kLongBytes, c, p);
+    p += 3 * kLongBytes;
+  }
+  for (; len >= 3 * kShortBytes; len -= 3 * kShortBytes) {
+    c = crc32c_triple(short_zeros, kShortBytes, c, p);
+    p += 3 * kShortBytes;
+  }
+  for (; len >= 8; len -= 8, p += 8) {
+    c = _mm_crc32_u64(c, load_word(p));
+  }
+  uint32 c32 = static_cast<uint32>(c);
+  for (; len > 0; --len, ++p) {
+    c32 = _mm_crc32_u8(c32, *p);
+  }
+  return ~c32;
+}
+
+}  // namespace xLearn
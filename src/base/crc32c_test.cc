@@ -0,0 +1,65 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests crc32c.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/base/crc32c.h"
+
+namespace xLearn {
+
+TEST(Crc32cTest, Check_value) {
+  // The check value of CRC32C
+  std::string str = "123456789";
+  EXPECT_EQ(Crc32c(str.data(), str.size()), 0xe3069283);
+  EXPECT_EQ(Crc32cSoftware(str.data(), str.size()), 0xe3069283);
+  EXPECT_EQ(Crc32c(str.data(), 0), 0);
+  // 32 bytes of zeros (RFC 3720)
+  std::vector<char> zero(32, 0);
+  EXPECT_EQ(Crc32c(zero.data(), zero.size()), 0x8a9136aa);
+}
+
+TEST(Crc32cTest, Pieces_and_SSE42) {
+  // The long and short interleaved blocks of SSE4.2
+  std::vector<char> buf(100000);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = (char)(i * 131 + 7);
+  }
+  uint32 crc = Crc32cSoftware(buf.data(), buf.size());
+  for (size_t split = 0; split < 20; ++split) {
+    uint32 first = Crc32c(buf.data(), split);
+    EXPECT_EQ(Crc32c(buf.data() + split, buf.size() - split, first), crc);
+    // The unaligned start
+    EXPECT_EQ(Crc32c(buf.data() + split, 1000 + split * 997),
+              Crc32cSoftware(buf.data() + split, 1000 + split * 997));
+  }
+  if (SupportCrc32cSSE42()) {
+    EXPECT_EQ(Crc32cSSE42(buf.data(), buf.size(), 0), crc);
+  }
+  // One bit flip is detected
+  buf[50000] ^= 1;
+  EXPECT_NE(Crc32c(buf.data(), buf.size()), crc);
+}
+
+}  // namespace xLearn
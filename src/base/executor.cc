@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the Executor.
+*/
+
+#include "src/base/executor.h"
+
+#include <pthread.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "src/base/resource.h"
+
+namespace xLearn {
+
+typedef std::pair<size_t, std::vector<int> > PoolKey;
+
+// The pools are never destroyed before exit, so the
+// pointers returned by Get() stay valid
+static std::mutex& pool_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+static std::map<PoolKey, std::unique_ptr<ThreadPool> >& pool_map() {
+  static std::map<PoolKey, std::unique_ptr<ThreadPool> > pools;
+  return pools;
+}
+
+size_t Executor::ThreadNumber(size_t thread_number) {
+  if (thread_number == 0) {
+    thread_number = AvailableCpus();
+  }
+  if (thread_number == 0) { thread_number = 1; }
+  return thread_number;
+}
+
+ThreadPool* Executor::Get(size_t thread_number,
+                          const std::vector<int>& cpus) {
+  PoolKey key(ThreadNumber(thread_number), cpus);
+  std::lock_guard<std::mutex> lock(pool_mutex());
+  std::unique_ptr<ThreadPool>& pool = pool_map()[key];
+  if (pool == nullptr) {
+    pool.reset(new ThreadPool(key.first, cpus));
+  }
+  return pool.get();
+}
+
+size_t Executor::NumPool() {
+  std::lock_guard<std::mutex> lock(pool_mutex());
+  return pool_map().size();
+}
+
+size_t Executor::NumWorker() {
+  std::lock_guard<std::mutex> lock(pool_mutex());
+  size_t num = 0;
+  for (auto iter = pool_map().begin(); iter != pool_map().end(); ++iter) {
+    num += iter->second->size();
+  }
+  return num;
+}
+
+uint64 Executor::MemorySize() {
+  std::lock_guard<std::mutex> lock(pool_mutex());
+  uint64 size = 0;
+  for (auto iter = pool_map().begin(); iter != pool_map().end(); ++iter) {
+    size += iter->second->MemorySize();
+  }
+  return size;
+}
+
+uint64 Executor::StackSize() {
+  size_t size = 0;
+  pthread_attr_t attr;
+  if (pthread_attr_init(&attr) == 0) {
+    pthread_attr_getstacksize(&attr, &size);
+    pthread_attr_destroy(&attr);
+  }
+  return size;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,77 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file provides the process-wide thread pool, which is
+shared by the Loss, the Parser and the BlockCache of xLearn.
+*/
+
+#ifndef XLEARN_BASE_EXECUTOR_H_
+#define XLEARN_BASE_EXECUTOR_H_
+
+#include <vector>
+
+#include "src/base/thread_pool.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The subsystems of xLearn get their threads from the Executor instead of
+// creating their own ThreadPool, so the parsing, training and evaluation
+// do not oversubscribe the cores with several pools. The pool of the same
+// thread number and cpus (see affinity.h) is created once and shared by
+// all the callers, and it lives until the exit of the process:
+//
+//   ThreadPool* pool = Executor::Get(thread_number, cpus);
+//
+//   /* The compute tasks run before the I/O tasks */
+//   pool->ParallelFor(0, row_len, 0, fn);
+//   auto res = pool->enqueue_priority(kPriorityIO, parse, chunk);
+//   res.get();
+//
+// The Solver passes the same thread number and cpus to all the
+// subsystems, so one training process has one pool.
+//------------------------------------------------------------------------------
+class Executor {
+ public:
+  // Return the shared pool of the thread number and cpus. The
+  // thread_number 0 means AvailableCpus() (see resource.h)
+  static ThreadPool* Get(size_t thread_number,
+                         const std::vector<int>& cpus = std::vector<int>());
+
+  // The thread number used by Get() for thread_number
+  static size_t ThreadNumber(size_t thread_number);
+
+  // Number of pools that have been created
+  static size_t NumPool();
+
+  // Number of the workers of all the pools
+  static size_t NumWorker();
+
+  // Bytes of the structures of all the pools (see
+  // ThreadPool::MemorySize()), excluding the stacks
+  static uint64 MemorySize();
+
+  // Bytes of the stack reserved for each worker, which is
+  // the default stack size of the new threads
+  static uint64 StackSize();
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_EXECUTOR_H_
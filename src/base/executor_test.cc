@@ -0,0 +1,71 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests executor.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+
+#include "src/base/executor.h"
+
+namespace xLearn {
+
+TEST(ExecutorTest, Shared_pool) {
+  ThreadPool* pool = Executor::Get(2);
+  EXPECT_EQ(pool->size(), 2);
+  EXPECT_EQ(Executor::Get(2), pool);
+  size_t num_pool = Executor::NumPool();
+  // Different cpus or thread number
+  std::vector<int> cpus(1, 0);
+  EXPECT_NE(Executor::Get(2, cpus), pool);
+  EXPECT_NE(Executor::Get(3), pool);
+  EXPECT_EQ(Executor::NumPool(), num_pool + 2);
+  // 0 means the number of hardware threads
+  EXPECT_EQ(Executor::Get(0)->size(), Executor::ThreadNumber(0));
+  EXPECT_EQ(Executor::Get(0), Executor::Get(Executor::ThreadNumber(0)));
+}
+
+TEST(ExecutorTest, Shared_by_threads) {
+  ThreadPool* pool = Executor::Get(2);
+  std::atomic<int> count(0);
+  // The loop and the tasks of two callers
+  std::thread other([pool, &count]() {
+    for (int n = 0; n < 20; ++n) {
+      pool->ParallelFor(0, 100, 7,
+        [&count](size_t id, size_t start, size_t end) {
+          count += end - start;
+        });
+    }
+  });
+  for (int n = 0; n < 20; ++n) {
+    auto res = pool->enqueue_priority(kPriorityIO,
+                                      [&count]() { count += 1; });
+    res.get();
+    pool->ParallelFor(0, 100, 0,
+      [&count](size_t id, size_t start, size_t end) {
+        count += end - start;
+      });
+  }
+  other.join();
+  EXPECT_EQ(count, 20 * 100 + 20 + 20 * 100);
+}
+
+}  // namespace xLearn
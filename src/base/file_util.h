@@ -23,10 +23,19 @@ This file contains facilitlies controlling the file.
 #ifndef XLEARN_BASE_FILE_UTIL_H_
 #define XLEARN_BASE_FILE_UTIL_H_
 
+#include <dirent.h>
+#include <errno.h>
+#include <glob.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>  // for remove()
+#include <string.h>  // for strlen() and memcpy()
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 #include "src/base/common.h"
 #include "src/base/stringprintf.h"
@@ -69,6 +78,10 @@ This file contains facilitlies controlling the file.
 //    CHECK_EQ(number, 999);
 //    Close(file_r);
 //
+//    /* Or at the offset of the file descriptor by several threads */
+//    WriteDataAt(fd, (char*)&number, sizeof(number), offset);
+//    CHECK(ReadDataAt(fd, (char*)&number, sizeof(number), offset));
+//
 //    /* (8) Delete file from disk */
 //    RemoveFile(filename.c_str());
 //
@@ -99,10 +112,23 @@ This file contains facilitlies controlling the file.
 //    /* (14) Generate hash value for file  */
 //    uint64 hash_1 = HashFile(filename, true);   /* for one block */
 //    uint64 hash_2 = HashFile(filename, false);  /* for the whole file */
+//    uint64 hash_3 = FingerprintFile(filename);  /* for stat and samples */
+//    uint64 hash_4 = FingerprintPrefix(filename, 1024);  /* for samples */
 //
 //    /* (15) Read the whole file into in-memory buffer */
 //    char *buffer = nullptr;
 //    uint64 file_size = ReadFileToMemory(filename, &buffer);
+//
+//    /* (16) Map the whole file into memory (read-only) */
+//    char *addr = nullptr;
+//    uint64 map_size = MapFileToMemory(filename, &addr);
+//    AdviseMemory(addr, map_size, MADV_SEQUENTIAL);
+//    ReleaseMappedPages(addr, map_size);  /* after reading */
+//    UnmapFile(addr, map_size);
+//
+//    /* (17) Expand a list, a directory or a glob into the files */
+//    std::vector<std::string> files;
+//    bool bo = ExpandFileList("/data/day1,/data/day2/part-*", &files);
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
@@ -191,6 +217,40 @@ inline size_t WriteDataToDisk(FILE* file, const char* buf, size_t len) {
   return write_len;
 }
 
+// Write the whole buffer at the offset of the file descriptor by
+// pwrite(), so the threads can write the ranges of one file
+inline void WriteDataAt(int fd, const char* buf, uint64 len, uint64 offset) {
+  CHECK_NOTNULL(buf);
+  while (len > 0) {
+    ssize_t ret = pwrite(fd, buf, len, offset);
+    if (ret < 0 && errno == EINTR) { continue; }
+    if (ret <= 0) {
+      LOG(FATAL) << "Error: invoke pwrite(): " << strerror(errno);
+    }
+    buf += ret;
+    len -= ret;
+    offset += ret;
+  }
+}
+
+// Read len bytes at the offset of the file descriptor by pread().
+// Return false if the file ends before them
+inline bool ReadDataAt(int fd, char* buf, uint64 len, uint64 offset) {
+  CHECK_NOTNULL(buf);
+  while (len > 0) {
+    ssize_t ret = pread(fd, buf, len, offset);
+    if (ret < 0 && errno == EINTR) { continue; }
+    if (ret < 0) {
+      LOG(FATAL) << "Error: invoke pread(): " << strerror(errno);
+    }
+    if (ret == 0) { return false; }
+    buf += ret;
+    len -= ret;
+    offset += ret;
+  }
+  return true;
+}
+
 // Read data from disk file to a buffer
 // Return the data size we have read
 // If we reach the end of the file, return 0
@@ -285,6 +345,21 @@ inline void ReadStringFromFile(FILE* file_ptr, std::string& str) {
 // Some tool functions used by Reader
 //------------------------------------------------------------------------------
 
+// Mix the data of buffer into the hash value
+inline uint64_t HashBuffer(uint64_t magic, const char* buf, long size) {
+  long i = 0;
+  while(i < size - 8) {
+    uint64_t x = *reinterpret_cast<const uint64_t*>(buf + i);
+    magic = ( (magic + x) * (magic + x + 1) >> 1) + x;
+    i += 8;
+  }
+  for(; i < size; i++) {
+    char x = buf[i];
+    magic = ( (magic + x) * (magic + x + 1) >> 1) + x;
+  }
+  return magic;
+}
+
 // Calculate the hash value of current txt file
 // If one_block == true, we just read a smalle chunk of data
 // If one_block == false, we read all the data from the file
@@ -297,23 +372,12 @@ inline uint64_t HashFile(const std::string& filename, bool one_block=false) {
   CHECK_EQ(static_cast<int>(f.tellg()), 0);
 
   uint64_t magic = 90359;
+  std::vector<char> buffer(kChunkSize);
   for(long pos = 0; pos < end; ) {
     long next_pos = std::min(pos + kChunkSize, end);
     long size = next_pos - pos;
-    std::vector<char> buffer(kChunkSize);
     f.read(buffer.data(), size);
-
-    int i = 0;
-    while(i < size - 8) {
-      uint64_t x = *reinterpret_cast<uint64_t*>(buffer.data() + i);
-      magic = ( (magic + x) * (magic + x + 1) >> 1) + x;
-      i += 8;
-    }
-    for(; i < size; i++) {
-      char x = buffer[i];
-      magic = ( (magic + x) * (magic + x + 1) >> 1) + x;
-    }
-
+    magic = HashBuffer(magic, buffer.data(), size);
     pos = next_pos;
     if(one_block) { break; }
   }
@@ -321,6 +385,67 @@ inline uint64_t HashFile(const std::string& filename, bool one_block=false) {
   return magic;
 }
 
+// Number and size (byte) of the blocks sampled by FingerprintFile()
+static const int kFingerprintBlocks = 4;
+static const long kFingerprintBlockSize = 64 * 1024;
+
+// Calculate a cheap fingerprint of current txt file, which is
+// the hash of its size, mtime and inode, and a few blocks sampled
+// evenly from the head to the tail of the file. It reads at most
+// kFingerprintBlocks * kFingerprintBlockSize bytes, so the cache
+// can be validated without a pass over a large file. Return 0
+// if the file cannot be accessed
+// Hash the blocks sampled evenly from [0, end) of the file
+inline uint64_t hash_sampled_blocks(FILE* file, long end, uint64_t magic) {
+  std::vector<char> buffer(kFingerprintBlockSize);
+  long last = std::max(end - kFingerprintBlockSize, 0L);
+  for (int i = 0; i < kFingerprintBlocks; ++i) {
+    long pos = last / (kFingerprintBlocks - 1) * i;
+    if (i == kFingerprintBlocks - 1) { pos = last; }
+    if (fseek(file, pos, SEEK_SET) != 0) { break; }
+    long size = fread(buffer.data(), 1,
+                      std::min(kFingerprintBlockSize, end - pos), file);
+    magic = HashBuffer(magic, buffer.data(), size);
+    // The whole range is sampled by the first block
+    if (last == 0) { break; }
+  }
+  return magic;
+}
+
+inline uint64_t FingerprintFile(const std::string& filename) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) { return 0; }
+  uint64_t meta[4];
+  meta[0] = static_cast<uint64_t>(st.st_size);
+  meta[1] = static_cast<uint64_t>(st.st_mtim.tv_sec);
+  meta[2] = static_cast<uint64_t>(st.st_mtim.tv_nsec);
+  meta[3] = static_cast<uint64_t>(st.st_ino);
+  uint64_t magic = HashBuffer(90359, (char*)meta, sizeof(meta));
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) { return 0; }
+  magic = hash_sampled_blocks(file, static_cast<long>(st.st_size), magic);
+  fclose(file);
+  return magic;
+}
+
+// Calculate the fingerprint of the first size bytes of the file
+// from the blocks sampled as FingerprintFile(), which does not
+// change when the file is appended. So it can check whether a
+// file is the former one with some appended data. Return 0 if
+// the file cannot be accessed or it is shorter than size
+inline uint64_t FingerprintPrefix(const std::string& filename,
+                                  uint64_t size) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) { return 0; }
+  if (static_cast<uint64_t>(st.st_size) < size) { return 0; }
+  uint64_t magic = HashBuffer(90359, (char*)&size, sizeof(size));
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) { return 0; }
+  magic = hash_sampled_blocks(file, static_cast<long>(size), magic);
+  fclose(file);
+  return magic;
+}
+
 // Read the whole file to a memory buffer and Return size of current file
 inline uint64 ReadFileToMemory(const std::string& filename, char **buf) {
   CHECK(!filename.empty());
@@ -337,4 +462,148 @@ inline uint64 ReadFileToMemory(const std::string& filename, char **buf) {
   return len;
 }
 
+// Map the whole file into memory in read-only mode and Return
+// size of current file. The pages are loaded lazily and shared
+// with the page cache, so there is no copy and no allocation.
+// The mapped memory should be released by UnmapFile()
+inline uint64 MapFileToMemory(const std::string& filename, char **buf) {
+  CHECK(!filename.empty());
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(FATAL) << "Cannot open file: " << filename;
+  }
+  uint64 len = lseek(fd, 0, SEEK_END);
+  CHECK_GT(len, 0);
+  void* addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    LOG(FATAL) << "Error: invoke mmap() for file: " << filename;
+  }
+  // The mapping is still valid after closing the file
+  close(fd);
+  *buf = reinterpret_cast<char*>(addr);
+  return len;
+}
+
+// The same as MapFileToMemory(), but return 0 without logging
+// if the file cannot be mapped, which is used by the library
+// that should not exit the process
+inline uint64 TryMapFileToMemory(const std::string& filename, char **buf) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) { return 0; }
+  off_t len = lseek(fd, 0, SEEK_END);
+  void* addr = MAP_FAILED;
+  if (len > 0) {
+    addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (addr == MAP_FAILED) { return 0; }
+  *buf = reinterpret_cast<char*>(addr);
+  return len;
+}
+
+// Give the kernel a hint of how the memory that mapped by
+// MapFileToMemory() will be accessed, e.g., MADV_SEQUENTIAL for
+// reading the file once from the head to the tail. It is only
+// an advice, so the failure is ignored
+inline void AdviseMemory(char* buf, uint64 len, int advice) {
+  CHECK_NOTNULL(buf);
+  madvise(buf, len, advice);
+}
+
+// Release the physical pages of [buf, buf + len) that mapped by
+// MapFileToMemory(), which no longer take the resident memory and
+// are loaded from the file again if they are accessed later. Only
+// the whole pages inside the range are released
+inline void ReleaseMappedPages(char* buf, uint64 len) {
+  CHECK_NOTNULL(buf);
+  static const uint64 page = sysconf(_SC_PAGESIZE);
+  uint64 begin = (reinterpret_cast<uint64>(buf) + page - 1) / page * page;
+  uint64 end = (reinterpret_cast<uint64>(buf) + len) / page * page;
+  if (begin >= end) { return; }
+  if (madvise(reinterpret_cast<char*>(begin),
+              end - begin, MADV_DONTNEED) == -1) {
+    LOG(FATAL) << "Error: invoke madvise().";
+  }
+}
+
+// Release the memory that mapped by MapFileToMemory()
+inline void UnmapFile(char* buf, uint64 len) {
+  CHECK_NOTNULL(buf);
+  if (munmap(buf, len) == -1) {
+    LOG(FATAL) << "Error: invoke munmap().";
+  }
+}
+
+// True for the binary caches that xLearn writes next to the
+// txt file, e.g., "part-0.bin" and "part-0.disk.2of4"
+inline bool IsCacheFile(const std::string& filename) {
+  const char* suffix[] = { ".bin", ".disk" };
+  for (int i = 0; i < 2; ++i) {
+    size_t pos = filename.rfind(suffix[i]);
+    while (pos != std::string::npos) {
+      size_t end = pos + strlen(suffix[i]);
+      if (end == filename.size() || filename[end] == '.') { return true; }
+      if (pos == 0) { break; }
+      pos = filename.rfind(suffix[i], pos - 1);
+    }
+  }
+  return false;
+}
+
+// Expand the comma-separated paths into the files in order. Each path
+// is a file (kept as it is), a directory (its files in the order of
+// name) or a glob pattern (see glob(3)). The hidden files and the
+// binary caches of the directories and the patterns are skipped.
+// Return false if a directory or a pattern has no file
+inline bool ExpandFileList(const std::string& spec,
+                           std::vector<std::string>* files) {
+  CHECK_NOTNULL(files);
+  files->clear();
+  size_t begin = 0;
+  while (begin <= spec.size()) {
+    size_t end = spec.find(',', begin);
+    if (end == std::string::npos) { end = spec.size(); }
+    std::string path = spec.substr(begin, end - begin);
+    begin = end + 1;
+    if (path.empty()) { continue; }
+    std::vector<std::string> matched;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      DIR* dir = opendir(path.c_str());
+      if (dir == nullptr) { return false; }
+      struct dirent* entry = nullptr;
+      while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.') { continue; }
+        std::string file = path + "/" + entry->d_name;
+        if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+          matched.push_back(file);
+        }
+      }
+      closedir(dir);
+      std::sort(matched.begin(), matched.end());
+    } else if (path.find_first_of("*?[") != std::string::npos) {
+      glob_t result;
+      if (glob(path.c_str(), 0, nullptr, &result) == 0) {
+        for (size_t i = 0; i < result.gl_pathc; ++i) {
+          matched.push_back(result.gl_pathv[i]);
+        }
+      }
+      globfree(&result);
+    } else {
+      files->push_back(path);
+      continue;
+    }
+    size_t num_file = files->size();
+    for (size_t i = 0; i < matched.size(); ++i) {
+      size_t slash = matched[i].rfind('/');
+      std::string name = slash == std::string::npos ?
+                         matched[i] : matched[i].substr(slash + 1);
+      if (name[0] == '.' || IsCacheFile(name)) { continue; }
+      files->push_back(matched[i]);
+    }
+    if (files->size() == num_file) { return false; }
+  }
+  return !files->empty();
+}
+
 #endif  // XLEARN_BASE_FILE_UTIL_H_
@@ -165,6 +165,51 @@ TEST(FileTest, HashFile) {
   RemoveFile("./tmp_3");
 }
 
+TEST(FileTest, FingerprintFile) {
+  // A file larger than the sampled blocks
+  std::string str(kFingerprintBlocks * kFingerprintBlockSize * 2, 'a');
+  FILE* file = OpenFileOrDie("./tmp_1", "w");
+  WriteDataToDisk(file, (char*)str.data(), str.size());
+  Close(file);
+  uint64 hash = FingerprintFile("./tmp_1");
+  EXPECT_NE(hash, 0);
+  EXPECT_EQ(FingerprintFile("./tmp_1"), hash);
+  // Change the last byte of the file
+  str[str.size() - 1] = 'b';
+  file = OpenFileOrDie("./tmp_1", "w");
+  WriteDataToDisk(file, (char*)str.data(), str.size());
+  Close(file);
+  EXPECT_NE(FingerprintFile("./tmp_1"), hash);
+  // Same data, but another inode
+  FILE* file_2 = OpenFileOrDie("./tmp_2", "w");
+  WriteDataToDisk(file_2, (char*)str.data(), str.size());
+  Close(file_2);
+  EXPECT_NE(FingerprintFile("./tmp_1"), FingerprintFile("./tmp_2"));
+  EXPECT_EQ(FingerprintFile("./tmp_3"), 0);
+  RemoveFile("./tmp_1");
+  RemoveFile("./tmp_2");
+}
+
+TEST(FileTest, FingerprintPrefix) {
+  std::string str(kFingerprintBlocks * kFingerprintBlockSize * 2, 'a');
+  str[str.size() / 3] = 'b';
+  FILE* file = OpenFileOrDie("./tmp_1", "w");
+  WriteDataToDisk(file, (char*)str.data(), str.size());
+  Close(file);
+  uint64 hash = FingerprintPrefix("./tmp_1", str.size());
+  EXPECT_NE(hash, 0);
+  uint64 hash_head = FingerprintPrefix("./tmp_1", 100);
+  EXPECT_NE(hash_head, hash);
+  // The prefix is not changed by the appended data
+  file = OpenFileOrDie("./tmp_1", "a");
+  WriteDataToDisk(file, (char*)str.data(), str.size());
+  Close(file);
+  EXPECT_EQ(FingerprintPrefix("./tmp_1", str.size()), hash);
+  EXPECT_EQ(FingerprintPrefix("./tmp_1", 100), hash_head);
+  EXPECT_EQ(FingerprintPrefix("./tmp_1", str.size() * 3), 0);
+  RemoveFile("./tmp_1");
+}
+
 TEST(FileTest, ReadFile) {
   FILE* file = OpenFileOrDie("./tmp.bin", "w");
   int num = 999;
@@ -177,4 +222,70 @@ TEST(FileTest, ReadFile) {
   RemoveFile("./tmp.bin");
 }
 
+TEST(FileTest, MapFile) {
+  FILE* file = OpenFileOrDie("./tmp.bin", "w");
+  int num[2] = { 999, 666 };
+  WriteDataToDisk(file, (char*)num, sizeof(num));
+  Close(file);
+  char* addr = nullptr;
+  uint64 len = MapFileToMemory("./tmp.bin", &addr);
+  EXPECT_EQ(len, sizeof(num));
+  EXPECT_EQ(((int*)addr)[0], 999);
+  EXPECT_EQ(((int*)addr)[1], 666);
+  UnmapFile(addr, len);
+  RemoveFile("./tmp.bin");
+}
+
+TEST(FileTest, ReleaseMappedPages) {
+  std::vector<int> num(1024 * 64);
+  for (int i = 0; i < num.size(); ++i) { num[i] = i; }
+  FILE* file = OpenFileOrDie("./tmp.bin", "w");
+  WriteDataToDisk(file, (char*)num.data(), num.size() * sizeof(int));
+  Close(file);
+  char* addr = nullptr;
+  uint64 len = MapFileToMemory("./tmp.bin", &addr);
+  AdviseMemory(addr, len, MADV_SEQUENTIAL);
+  int* data = (int*)addr;
+  EXPECT_EQ(data[num.size() - 1], num.size() - 1);
+  // The pages are loaded from the file again
+  ReleaseMappedPages(addr + 1, len - 1);
+  ReleaseMappedPages(addr, len);
+  for (int i = 0; i < num.size(); ++i) {
+    EXPECT_EQ(data[i], i);
+  }
+  UnmapFile(addr, len);
+  RemoveFile("./tmp.bin");
+}
+
+TEST(FileTest, ExpandFileList) {
+  mkdir("./tmp_parts", 0755);
+  const char* names[] = { "part-1", "part-0", "part-0.bin",
+                          "part-1.disk.2of4", ".hidden" };
+  for (int i = 0; i < 5; ++i) {
+    std::string filename = std::string("./tmp_parts/") + names[i];
+    Close(OpenFileOrDie(filename.c_str(), "w"));
+  }
+  std::vector<std::string> expect = { "./tmp_parts/part-0",
+                                      "./tmp_parts/part-1" };
+  std::vector<std::string> files;
+  // The caches and the hidden files are skipped
+  EXPECT_TRUE(ExpandFileList("./tmp_parts", &files));
+  EXPECT_EQ(files, expect);
+  EXPECT_TRUE(ExpandFileList("./tmp_parts/part-*", &files));
+  EXPECT_EQ(files, expect);
+  // The files of the list are kept as they are
+  EXPECT_TRUE(ExpandFileList("./tmp_parts/part-1,./tmp_parts/part-0.bin",
+                             &files));
+  EXPECT_EQ(files, std::vector<std::string>({ "./tmp_parts/part-1",
+                                              "./tmp_parts/part-0.bin" }));
+  EXPECT_FALSE(ExpandFileList("./tmp_parts/day-*", &files));
+  EXPECT_TRUE(IsCacheFile("train.txt.bin.range"));
+  EXPECT_FALSE(IsCacheFile("train.binary"));
+  for (int i = 0; i < 5; ++i) {
+    std::string filename = std::string("./tmp_parts/") + names[i];
+    RemoveFile(filename.c_str());
+  }
+  rmdir("./tmp_parts");
+}
+
 }  // namespace xLearn
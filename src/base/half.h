@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file provides the conversion between float and the 16-bit
+floating point formats (IEEE fp16 and bfloat16), which are used
+to store the latent factors of the model in reduced precision.
+*/
+
+#ifndef XLEARN_BASE_HALF_H_
+#define XLEARN_BASE_HALF_H_
+
+#include <string.h>
+
+#include "src/base/common.h"
+
+// The bits of a float
+static inline uint32 FloatBits(float x) {
+  uint32 u;
+  memcpy(&u, &x, sizeof(u));
+  return u;
+}
+
+static inline float BitsFloat(uint32 u) {
+  float x;
+  memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+// bfloat16 is the high 16 bits of float. We round to the
+// nearest even, and keep NaN as a quiet NaN
+static inline uint16 FloatToBFloat16(float x) {
+  uint32 u = FloatBits(x);
+  if ((u & 0x7fffffffu) > 0x7f800000u) {
+    return (uint16)((u >> 16) | 0x40);
+  }
+  u += 0x7fffu + ((u >> 16) & 1);
+  return (uint16)(u >> 16);
+}
+
+static inline float BFloat16ToFloat(uint16 h) {
+  return BitsFloat((uint32)h << 16);
+}
+
+// IEEE 754 half precision: 1 sign bit, 5 exponent bits and 10
+// mantissa bits. We round to the nearest even, the values out of
+// range become infinity, and the small values become subnormal
+static inline uint16 FloatToHalf(float x) {
+  uint32 u = FloatBits(x);
+  uint16 sign = (uint16)((u >> 16) & 0x8000);
+  uint32 abs = u & 0x7fffffffu;
+  if (abs >= 0x7f800000u) {  // Inf or NaN
+    return sign | (abs > 0x7f800000u ? 0x7e00 : 0x7c00);
+  }
+  if (abs >= 0x477ff000u) {  // Overflow after rounding
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000u) {   // Subnormal or zero
+    if (abs < 0x33000000u) { return sign; }
+    uint32 exp = abs >> 23;
+    uint32 mant = (abs & 0x7fffffu) | 0x800000u;
+    uint32 shift = 126 - exp;
+    uint32 h = mant >> shift;
+    uint32 rem = mant & ((1u << shift) - 1);
+    uint32 half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) { ++h; }
+    return sign | (uint16)h;
+  }
+  // Normal: rebias the exponent from 127 to 15
+  abs -= 0x38000000u;
+  abs += 0xfffu + ((abs >> 13) & 1);
+  return sign | (uint16)(abs >> 13);
+}
+
+static inline float HalfToFloat(uint16 h) {
+  uint32 sign = (uint32)(h & 0x8000) << 16;
+  uint32 exp = (h >> 10) & 0x1f;
+  uint32 mant = h & 0x3ff;
+  if (exp == 0x1f) {         // Inf or NaN
+    return BitsFloat(sign | 0x7f800000u | (mant << 13));
+  }
+  if (exp == 0) {
+    // Zero or subnormal: mant * 2^-24
+    float val = (float)mant * (1.0f / 16777216.0f);
+    return sign ? -val : val;
+  }
+  return BitsFloat(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+#endif  // XLEARN_BASE_HALF_H_
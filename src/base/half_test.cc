@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests half.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include "src/base/half.h"
+
+TEST(HalfTest, Half_exact) {
+  // These values are exact in half precision
+  const float list[] = { 0.0f, 1.0f, -2.5f, 0.125f, 1024.0f,
+                         65504.0f, 6.103515625e-05f, 5.9604645e-08f };
+  for (size_t i = 0; i < sizeof(list) / sizeof(list[0]); ++i) {
+    EXPECT_EQ(HalfToFloat(FloatToHalf(list[i])), list[i]);
+  }
+  EXPECT_EQ(FloatToHalf(1.0f), 0x3c00);
+  EXPECT_EQ(FloatToHalf(-2.0f), 0xc000);
+}
+
+TEST(HalfTest, Half_round) {
+  for (int i = -1000; i <= 1000; ++i) {
+    float x = i * 0.0137f;
+    float y = HalfToFloat(FloatToHalf(x));
+    EXPECT_LE(fabs(y - x), fabs(x) / 2048 + 1e-7);
+  }
+  // Round to nearest even: 1 + 2^-11 is in the middle of
+  // 1 and 1 + 2^-10, and 1 is even
+  EXPECT_EQ(FloatToHalf(1.0f + 1.0f / 2048), 0x3c00);
+  EXPECT_EQ(FloatToHalf(1.0f + 3.0f / 2048), 0x3c02);
+  // Overflow and tiny values
+  EXPECT_EQ(FloatToHalf(1e6f), 0x7c00);
+  EXPECT_EQ(FloatToHalf(-1e6f), 0xfc00);
+  EXPECT_EQ(FloatToHalf(1e-9f), 0);
+  EXPECT_TRUE(isnan(HalfToFloat(FloatToHalf(NAN))));
+}
+
+TEST(HalfTest, BFloat16) {
+  EXPECT_EQ(BFloat16ToFloat(FloatToBFloat16(1.0f)), 1.0f);
+  EXPECT_EQ(BFloat16ToFloat(FloatToBFloat16(-3.5f)), -3.5f);
+  EXPECT_EQ(FloatToBFloat16(1.0f), 0x3f80);
+  for (int i = -1000; i <= 1000; ++i) {
+    float x = i * 0.0137f;
+    float y = BFloat16ToFloat(FloatToBFloat16(x));
+    EXPECT_LE(fabs(y - x), fabs(x) / 256);
+  }
+  EXPECT_TRUE(isnan(BFloat16ToFloat(FloatToBFloat16(NAN))));
+}
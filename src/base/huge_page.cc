@@ -0,0 +1,125 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the huge page utilities.
+*/
+
+#include "src/base/huge_page.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "src/base/logging.h"
+
+namespace xLearn {
+
+bool IsHugePagePolicy(const std::string& policy) {
+  return policy == "none" || policy == "thp" || policy == "explicit";
+}
+
+bool TransparentHugePagesEnabled() {
+#ifdef __linux__
+  FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if (file == nullptr) { return false; }
+  char buf[256];
+  size_t size = fread(buf, 1, sizeof(buf) - 1, file);
+  fclose(file);
+  buf[size] = '\0';
+  // The current mode is in the brackets, e.g., "always [madvise] never"
+  return size > 0 && strstr(buf, "[never]") == nullptr;
+#else
+  return false;
+#endif
+}
+
+// The memory of "thp" and "none" is freed by free()
+static void* aligned_or_die(uint64 size, uint64 align) {
+  void* addr = nullptr;
+  if (posix_memalign(&addr, align, size) != 0) { addr = nullptr; }
+  CHECK_NOTNULL(addr);
+  return addr;
+}
+
+void* AllocHugePages(uint64 size, const std::string& policy,
+                     std::string* used, uint64 align) {
+  CHECK(IsHugePagePolicy(policy));
+  CHECK_NOTNULL(used);
+  CHECK_GT(size, 0);
+#ifdef __linux__
+  if (policy == "explicit") {
+    uint64 bytes = (size + kHugePageSize - 1) / kHugePageSize *
+                   kHugePageSize;
+    void* addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) {
+      *used = "explicit";
+      return addr;
+    }
+  }
+  if (policy != "none" && TransparentHugePagesEnabled()) {
+    void* addr = aligned_or_die(size, std::max(align, kHugePageSize));
+    if (madvise(addr, size / kHugePageSize * kHugePageSize,
+                MADV_HUGEPAGE) == 0) {
+      *used = "thp";
+      return addr;
+    }
+    free(addr);
+  }
+#endif
+  *used = "none";
+  return aligned_or_die(size, align);
+}
+
+void FreeHugePages(void* addr, uint64 size, const std::string& used) {
+  if (addr == nullptr) { return; }
+#ifdef __linux__
+  if (used == "explicit") {
+    uint64 bytes = (size + kHugePageSize - 1) / kHugePageSize *
+                   kHugePageSize;
+    munmap(addr, bytes);
+    return;
+  }
+#endif
+  free(addr);
+}
+
+bool AdviseHugePages(void* addr, uint64 size) {
+#ifdef __linux__
+  if (addr == nullptr || !TransparentHugePagesEnabled()) { return false; }
+  uint64 begin = (reinterpret_cast<uint64>(addr) + kHugePageSize - 1) /
+                 kHugePageSize * kHugePageSize;
+  uint64 end = (reinterpret_cast<uint64>(addr) + size) /
+               kHugePageSize * kHugePageSize;
+  if (begin >= end) { return false; }
+  return madvise(reinterpret_cast<void*>(begin), end - begin,
+                 MADV_HUGEPAGE) == 0;
+#else
+  return false;
+#endif
+}
+
+}  // namespace xLearn
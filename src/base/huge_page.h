@@ -0,0 +1,79 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file provides the memory backed by the huge pages, which
+reduces the TLB misses of the random access of a large model.
+*/
+
+#ifndef XLEARN_BASE_HUGE_PAGE_H_
+#define XLEARN_BASE_HUGE_PAGE_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// The size of a huge page on x86-64
+const uint64 kHugePageSize = 2 * 1024 * 1024;
+
+//------------------------------------------------------------------------------
+// The huge pages are given by a policy, which can be:
+//
+//   "none"      /* the base pages of malloc() */
+//   "thp"       /* the transparent huge pages, where the memory is aligned
+//                  to the huge page and advised by madvise(MADV_HUGEPAGE) */
+//   "explicit"  /* the reserved huge pages of vm.nr_hugepages, which are
+//                  mapped by mmap(MAP_HUGETLB) */
+//
+// The policy falls back from "explicit" to "thp" if there are not enough
+// reserved huge pages, and from "thp" to "none" if the transparent huge
+// pages are disabled, so the caller can report the policy that is used:
+//
+//   std::string used;
+//   void* buf = AllocHugePages(size, "explicit", &used);
+//   if (used != "explicit") { /* report the fallback */ }
+//   ...
+//   FreeHugePages(buf, size, used);
+//------------------------------------------------------------------------------
+
+// Return true for "none", "thp" and "explicit"
+bool IsHugePagePolicy(const std::string& policy);
+
+// Whether the transparent huge pages can be used by madvise(),
+// i.e., /sys/kernel/mm/transparent_hugepage/enabled is not never
+bool TransparentHugePagesEnabled();
+
+// Allocate size bytes by the policy, which are aligned to at least
+// align bytes (a power of two). The used policy is stored in used
+void* AllocHugePages(uint64 size, const std::string& policy,
+                     std::string* used, uint64 align = 16);
+
+// Free the memory of AllocHugePages() of the used policy
+void FreeHugePages(void* addr, uint64 size, const std::string& used);
+
+// Advise the transparent huge pages of the whole huge pages in
+// [addr, addr + size), e.g., a large buffer of std::vector before it
+// is filled. Return false if the huge pages are not used
+bool AdviseHugePages(void* addr, uint64 size);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_HUGE_PAGE_H_
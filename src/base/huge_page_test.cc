@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests huge_page.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "src/base/huge_page.h"
+
+namespace xLearn {
+
+TEST(HugePageTest, Policy) {
+  EXPECT_TRUE(IsHugePagePolicy("none"));
+  EXPECT_TRUE(IsHugePagePolicy("thp"));
+  EXPECT_TRUE(IsHugePagePolicy("explicit"));
+  EXPECT_FALSE(IsHugePagePolicy("2m"));
+}
+
+// Each policy gives the usable memory, which falls back
+// to an available policy of the system
+TEST(HugePageTest, Alloc) {
+  const char* policies[] = { "none", "thp", "explicit" };
+  uint64 size = kHugePageSize * 2 + 100;
+  for (int p = 0; p < 3; ++p) {
+    std::string used;
+    char* buf = reinterpret_cast<char*>(
+        AllocHugePages(size, policies[p], &used, 64));
+    ASSERT_TRUE(buf != nullptr);
+    EXPECT_TRUE(IsHugePagePolicy(used));
+    EXPECT_EQ((uint64)buf % 64, 0);
+    if (used != "none") {
+      EXPECT_EQ((uint64)buf % kHugePageSize, 0);
+    }
+    if (p == 0) { EXPECT_EQ(used, "none"); }
+    if (p == 1) { EXPECT_NE(used, "explicit"); }
+    if (used == "thp") { EXPECT_TRUE(TransparentHugePagesEnabled()); }
+    memset(buf, p, size);
+    EXPECT_EQ(buf[size - 1], p);
+    FreeHugePages(buf, size, used);
+  }
+}
+
+TEST(HugePageTest, Advise) {
+  // The buffer has no whole huge page
+  std::vector<char> small(1000);
+  EXPECT_FALSE(AdviseHugePages(small.data(), small.size()));
+  std::vector<char> large(kHugePageSize * 3);
+  EXPECT_EQ(AdviseHugePages(large.data(), large.size()),
+            TransparentHugePagesEnabled());
+}
+
+}  // namespace xLearn
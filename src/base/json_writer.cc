@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of json_writer.h
+*/
+
+#include "src/base/json_writer.h"
+
+#include <math.h>
+
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+std::string JsonString(const std::string& str) {
+  std::string res = "\"";
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = str[i];
+    switch (c) {
+      case '"':  res += "\\\""; break;
+      case '\\': res += "\\\\"; break;
+      case '\n': res += "\\n"; break;
+      case '\r': res += "\\r"; break;
+      case '\t': res += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          StringAppendF(&res, "\\u%04x", c);
+        } else {
+          res += c;
+        }
+    }
+  }
+  return res + "\"";
+}
+
+std::string JsonArray(const std::vector<std::string>& items) {
+  std::string res = "[";
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (i > 0) { res += ","; }
+    res += items[i];
+  }
+  return res + "]";
+}
+
+JsonObject& JsonObject::AddString(const std::string& key,
+                                  const std::string& value) {
+  return AddRaw(key, JsonString(value));
+}
+
+JsonObject& JsonObject::AddInt(const std::string& key, int64 value) {
+  return AddRaw(key, StringPrintf("%lld", (long long)value));
+}
+
+JsonObject& JsonObject::AddReal(const std::string& key, double value) {
+  if (isnan(value) || isinf(value)) { return AddRaw(key, "null"); }
+  return AddRaw(key, StringPrintf("%.7g", value));
+}
+
+JsonObject& JsonObject::AddBool(const std::string& key, bool value) {
+  return AddRaw(key, value ? "true" : "false");
+}
+
+JsonObject& JsonObject::AddRaw(const std::string& key,
+                               const std::string& json) {
+  if (!body_.empty()) { body_ += ","; }
+  body_ += JsonString(key) + ":" + json;
+  return *this;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,79 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the JsonObject class, which builds a flat
+JSON object for the machine-readable output of xLearn.
+*/
+
+#ifndef XLEARN_BASE_JSON_WRITER_H_
+#define XLEARN_BASE_JSON_WRITER_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// Return the quoted JSON string of the str
+std::string JsonString(const std::string& str);
+
+// Return the JSON array of the items, which are JSON values
+std::string JsonArray(const std::vector<std::string>& items);
+
+//------------------------------------------------------------------------------
+// JsonObject builds the JSON text of the members in the order they are
+// added. The keys are not checked for duplicates, and the NaN and infinite
+// numbers are written as null:
+//
+//   JsonObject obj;
+//   obj.AddString("type", "epoch");
+//   obj.AddInt("epoch", 3);
+//   obj.AddReal("loss", 0.125);
+//   obj.ToString();   /* {"type":"epoch","epoch":3,"loss":0.125} */
+//
+// The nested object or array is added by AddRaw() with its JSON text.
+//------------------------------------------------------------------------------
+class JsonObject {
+ public:
+  JsonObject() { }
+
+  JsonObject& AddString(const std::string& key, const std::string& value);
+  JsonObject& AddInt(const std::string& key, int64 value);
+  JsonObject& AddReal(const std::string& key, double value);
+  JsonObject& AddBool(const std::string& key, bool value);
+
+  // Add a member whose value is the JSON text
+  JsonObject& AddRaw(const std::string& key, const std::string& json);
+
+  // True if no member has been added
+  bool Empty() const { return body_.empty(); }
+
+  // The JSON text of the object, in one line
+  std::string ToString() const { return "{" + body_ + "}"; }
+
+ protected:
+  /* The members separated by ',' */
+  std::string body_;
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_JSON_WRITER_H_
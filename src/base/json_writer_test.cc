@@ -0,0 +1,70 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests json_writer.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/json_writer.h"
+
+namespace xLearn {
+
+TEST(JsonWriterTest, Object) {
+  JsonObject obj;
+  EXPECT_TRUE(obj.Empty());
+  EXPECT_EQ(obj.ToString(), "{}");
+  obj.AddString("type", "epoch")
+     .AddInt("epoch", 3)
+     .AddInt("rows", -12345678901LL)
+     .AddReal("loss", 0.125)
+     .AddBool("quiet", false);
+  EXPECT_FALSE(obj.Empty());
+  EXPECT_EQ(obj.ToString(),
+            "{\"type\":\"epoch\",\"epoch\":3,\"rows\":-12345678901,"
+            "\"loss\":0.125,\"quiet\":false}");
+}
+
+TEST(JsonWriterTest, Escape) {
+  EXPECT_EQ(JsonString("a\"b\\c\n\t"), "\"a\\\"b\\\\c\\n\\t\"");
+  EXPECT_EQ(JsonString(std::string("\x01", 1)), "\"\\u0001\"");
+  JsonObject obj;
+  obj.AddReal("nan", NAN).AddReal("inf", INFINITY);
+  EXPECT_EQ(obj.ToString(), "{\"nan\":null,\"inf\":null}");
+}
+
+TEST(JsonWriterTest, Nested) {
+  std::vector<std::string> items;
+  EXPECT_EQ(JsonArray(items), "[]");
+  JsonObject inner;
+  inner.AddInt("a", 1);
+  items.push_back(inner.ToString());
+  items.push_back("2");
+  JsonObject obj;
+  obj.AddRaw("list", JsonArray(items));
+  EXPECT_EQ(obj.ToString(), "{\"list\":[{\"a\":1},2]}");
+}
+
+}  // namespace xLearn
@@ -23,8 +23,16 @@ This file is the implementation of the logging facilities.
 #include "src/base/logging.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 //------------------------------------------------------------------------------
 // Logger
 //------------------------------------------------------------------------------
@@ -33,9 +41,17 @@ std::ofstream Logger::info_log_file_;
 std::ofstream Logger::warn_log_file_;
 std::ofstream Logger::erro_log_file_;
 
+// The writes of the files in the async mode, by the background
+// thread and by the threads of the synchronous messages
+static std::mutex& write_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
 void InitializeLogger(const std::string& info_log_filename,
                       const std::string& warn_log_filename,
                       const std::string& erro_log_filename) {
+  std::lock_guard<std::mutex> lock(write_mutex());
   Logger::info_log_file_.open(info_log_filename.c_str());
   Logger::warn_log_file_.open(warn_log_filename.c_str());
   Logger::erro_log_file_.open(erro_log_filename.c_str());
@@ -53,22 +69,234 @@ std::ostream& Logger::GetStream(LogSeverity severity) {
   return std::cout; // Print message
 }
 
-/*static*/
-std::ostream& Logger::Start(LogSeverity severity,
-                            const std::string& file,
-                            int line,
-                            const std::string& function) {
-  time_t tm;
-  time(&tm);
+// The head of a message
+static void write_head(std::ostream& out, time_t tm, const char* file,
+                       int line, const char* function) {
   char time_string[128];
   ctime_r(&tm, time_string);
-  return GetStream(severity) << time_string
-                             << " " << file << ":" << line
-                             << " (" << function << ") " << std::flush;
+  out << time_string << " " << file << ":" << line
+      << " (" << function << ") ";
+}
+
+//------------------------------------------------------------------------------
+// AsyncLogRing
+//------------------------------------------------------------------------------
+
+// The bytes of the body of a message in a slot
+static const size_t kLogSlotText = 448;
+
+// Interval of the background thread when the ring is empty
+static const std::chrono::milliseconds kLogFlushInterval(5);
+
+// A message in the ring. The file and function are the string
+// literals of LOG(), so only their pointers are kept. The seq is
+// the position of the slot if it is free, and the position + 1 if
+// it holds the message of the position (see AsyncLogRing)
+struct LogSlot {
+  std::atomic<uint64_t> seq;
+  LogSeverity severity;
+  time_t time;
+  const char* file;
+  int line;
+  const char* function;
+  uint32_t length;
+  char text[kLogSlotText];
+};
+
+// The bounded ring of many writers and one reader (the background
+// thread). A writer claims a position by the CAS of tail_ and then
+// publishes the slot by its seq, so the writers never take a lock
+class AsyncLogRing {
+ public:
+  explicit AsyncLogRing(size_t capacity)
+    : slots_(new LogSlot[capacity]), mask_(capacity - 1),
+      tail_(0), head_(0), written_(0), dropped_(0), stop_(false) {
+    for (size_t i = 0; i < capacity; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    thread_ = std::thread(&AsyncLogRing::run, this);
+  }
+
+  // The messages in the ring are written before the thread stops
+  ~AsyncLogRing() {
+    stop_.store(true);
+    thread_.join();
+    std::lock_guard<std::mutex> lock(write_mutex());
+    drain();
+  }
+
+  // Put the message of the logger, and return false if the ring is
+  // full, or if it waits for a free slot and the message is too long
+  bool Push(const Logger& logger, const std::string& text, bool wait) {
+    if (text.size() > kLogSlotText) { return false; }
+    uint64_t pos = tail_.load(std::memory_order_relaxed);
+    LogSlot* slot = nullptr;
+    for (;;) {
+      slot = &slots_[pos & mask_];
+      uint64_t seq = slot->seq.load(std::memory_order_acquire);
+      int64_t diff = (int64_t)seq - (int64_t)pos;
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The ring is full
+        if (!wait) { return false; }
+        std::this_thread::yield();
+        pos = tail_.load(std::memory_order_relaxed);
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->severity = logger.severity_;
+    slot->time = time(nullptr);
+    slot->file = logger.file_;
+    slot->line = logger.line_;
+    slot->function = logger.function_;
+    slot->length = text.size();
+    memcpy(slot->text, text.data(), text.size());
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Wait until the messages put before are written
+  void Flush() {
+    uint64_t target = tail_.load(std::memory_order_acquire);
+    while (written_.load(std::memory_order_acquire) < target) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+  void CountDropped() { dropped_.fetch_add(1, std::memory_order_relaxed); }
+  uint64_t Dropped() const { return dropped_.load(); }
+
+ private:
+  std::unique_ptr<LogSlot[]> slots_;
+  uint64_t mask_;
+  /* The next position of the writers */
+  std::atomic<uint64_t> tail_;
+  /* The next position of the reader */
+  uint64_t head_;
+  /* The positions before it are written and flushed */
+  std::atomic<uint64_t> written_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+
+  void run() {
+    while (!stop_.load()) {
+      size_t num = 0;
+      {
+        std::lock_guard<std::mutex> lock(write_mutex());
+        num = drain();
+      }
+      if (num == 0) { std::this_thread::sleep_for(kLogFlushInterval); }
+    }
+  }
+
+  // Write the published slots in order, and flush the
+  // streams. Return the number of the messages
+  size_t drain() {
+    size_t num = 0;
+    bool used[FATAL + 1] = { false };
+    for (;;) {
+      LogSlot& slot = slots_[head_ & mask_];
+      if (slot.seq.load(std::memory_order_acquire) != head_ + 1) { break; }
+      std::ostream& out = Logger::GetStream(slot.severity);
+      write_head(out, slot.time, slot.file, slot.line, slot.function);
+      out.write(slot.text, slot.length);
+      out << "\n";
+      used[slot.severity] = true;
+      slot.seq.store(head_ + mask_ + 1, std::memory_order_release);
+      ++head_;
+      ++num;
+    }
+    for (int i = 0; i <= FATAL; ++i) {
+      if (used[i]) { Logger::GetStream((LogSeverity)i).flush(); }
+    }
+    written_.store(head_, std::memory_order_release);
+    return num;
+  }
+};
+
+// The ring of the async mode, or nullptr
+static std::atomic<AsyncLogRing*> async_ring(nullptr);
+
+void EnableAsyncLogging(size_t capacity) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    LOG(FATAL) << "The capacity of the log ring should be a power of 2";
+  }
+  static std::once_flag exit_flag;
+  std::call_once(exit_flag, []() { atexit(DisableAsyncLogging); });
+  AsyncLogRing* ring = new AsyncLogRing(capacity);
+  AsyncLogRing* old = async_ring.exchange(ring);
+  delete old;
+}
+
+void DisableAsyncLogging() {
+  delete async_ring.exchange(nullptr);
+}
+
+void FlushLogger() {
+  AsyncLogRing* ring = async_ring.load(std::memory_order_acquire);
+  if (ring != nullptr) { ring->Flush(); }
+}
+
+uint64_t DroppedLogMessages() {
+  AsyncLogRing* ring = async_ring.load(std::memory_order_acquire);
+  return ring != nullptr ? ring->Dropped() : 0;
+}
+
+// The buffers of the async messages of this thread, and the
+// number in use, since LOG() can be nested in a message
+static thread_local std::vector<std::unique_ptr<std::ostringstream>>
+  log_buffers;
+static thread_local size_t log_depth = 0;
+
+std::ostream& Logger::Start(LogSeverity severity,
+                            const char* file,
+                            int line,
+                            const char* function) {
+  if (async_ring.load(std::memory_order_acquire) != nullptr) {
+    file_ = file;
+    line_ = line;
+    function_ = function;
+    if (log_depth == log_buffers.size()) {
+      log_buffers.emplace_back(new std::ostringstream());
+    }
+    buffer_ = log_buffers[log_depth++].get();
+    buffer_->str("");
+    buffer_->clear();
+    return *buffer_;
+  }
+  write_head(GetStream(severity), time(nullptr), file, line, function);
+  return GetStream(severity) << std::flush;
 }
 
 Logger::~Logger() {
-  GetStream(severity_) << "\n" << std::flush;
+  if (buffer_ != nullptr) {
+    std::string text = buffer_->str();
+    --log_depth;
+    AsyncLogRing* ring = async_ring.load(std::memory_order_acquire);
+    if (ring != nullptr && severity_ < ERROR &&
+        ring->Push(*this, text, severity_ == WARNING)) {
+      return;
+    }
+    if (ring != nullptr && severity_ == INFO &&
+        text.size() <= kLogSlotText) {
+      ring->CountDropped();
+      return;
+    }
+    // The messages in the ring are written first
+    if (ring != nullptr) { ring->Flush(); }
+    std::lock_guard<std::mutex> lock(write_mutex());
+    std::ostream& out = GetStream(severity_);
+    write_head(out, time(nullptr), file_, line_, function_);
+    out << text << "\n" << std::flush;
+  } else {
+    GetStream(severity_) << "\n" << std::flush;
+  }
   if (severity_ == FATAL) {
     info_log_file_.close();
     warn_log_file_.close();
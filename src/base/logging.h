@@ -24,9 +24,12 @@ their severities.
 #ifndef XLEARN_BASE_LOGGING_H_
 #define XLEARN_BASE_LOGGING_H_
 
+#include <stdint.h>
+
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 //------------------------------------------------------------------------------
@@ -44,33 +47,101 @@ their severities.
 //                  << "and kills current process by a segmentation fault.";
 //     return 0;
 //   }
+//
+// By default, each message is written and flushed by the thread of LOG().
+// The messages of INFO and WARNING can be written by a background thread
+// instead, so the logging of the batches (or of the training threads) does
+// not wait for the files. LOG() only formats the body of the message into
+// a slot of a lock-free ring, and the background thread adds the head of
+// the message (the time, file, line and function) and writes the slots
+// every few milliseconds:
+//
+//     EnableAsyncLogging();
+//     ... LOG(INFO) << "batch " << i << " loss " << loss;
+//     FlushLogger();            /* all the messages are written */
+//     DisableAsyncLogging();    /* also done at exit */
+//
+// If the ring is full, the INFO messages are dropped (and counted by
+// DroppedLogMessages()), and the WARNING messages wait for a free slot.
+// The ERROR and FATAL messages, which are usually followed by abort(),
+// and the messages longer than a slot are always written by the thread
+// of LOG() after the messages in the ring.
+//
+// The levels below XLEARN_MIN_LOG_LEVEL (0 for INFO, 1 for WARNING) are
+// removed at compile time, and so are VLOG(n) for n > XLEARN_MAX_VLOG,
+// whose messages are INFO, e.g., for the messages of each batch:
+//
+//     VLOG(1) << "batch " << i;   /* only with -DXLEARN_MAX_VLOG=1 */
+//
+// The arguments of a removed message are not evaluated.
 //------------------------------------------------------------------------------
 
 void InitializeLogger(const std::string& info_log_filename,
                       const std::string& warn_log_filename,
                       const std::string& erro_log_filename);
 
+// Write the INFO and WARNING messages by a background thread through a
+// ring of capacity (a power of 2) slots, until DisableAsyncLogging()
+void EnableAsyncLogging(size_t capacity = 4096);
+
+// Write the messages in the ring, and stop the background thread
+void DisableAsyncLogging();
+
+// Wait until the messages logged before are written and flushed
+void FlushLogger();
+
+// Number of the INFO messages dropped since the ring was full
+uint64_t DroppedLogMessages();
+
 enum LogSeverity { INFO, WARNING, ERROR, FATAL };
 
+#ifndef XLEARN_MIN_LOG_LEVEL
+#define XLEARN_MIN_LOG_LEVEL 0
+#endif
+
+#ifndef XLEARN_MAX_VLOG
+#define XLEARN_MAX_VLOG 0
+#endif
+
+// ERROR and FATAL are never removed
+constexpr bool LogEnabled(int severity) {
+  return severity >= XLEARN_MIN_LOG_LEVEL || severity >= ERROR;
+}
+
 class Logger {
   friend void InitializeLogger(const std::string& info_log_filename,
                                const std::string& warn_log_filename,
                                const std::string& erro_log_filename);
+  friend class AsyncLogRing;
  public:
-  Logger(LogSeverity s) : severity_(s) {}
+  Logger(LogSeverity s) : severity_(s), buffer_(nullptr) {}
   ~Logger();
 
   static std::ostream& GetStream(LogSeverity severity);
-  static std::ostream& Start(LogSeverity severity,
-                             const std::string& file,
-                             int line,
-                             const std::string& function);
+
+  // The stream of the message body, which is the file of the
+  // severity, or the buffer of the message if it is async
+  std::ostream& Start(LogSeverity severity,
+                      const char* file,
+                      int line,
+                      const char* function);
 
  private:
   static std::ofstream info_log_file_;
   static std::ofstream warn_log_file_;
   static std::ofstream erro_log_file_;
   LogSeverity severity_;
+  /* The head and buffer of the async message, or nullptr */
+  const char* file_;
+  int line_;
+  const char* function_;
+  std::ostringstream* buffer_;
+};
+
+// Turn the stream of LOG() into void for the ?: of LOG()
+class LogVoidify {
+ public:
+  void operator&(std::ostream&) { }
 };
 
 //-----------------------------------------------------------------------------
@@ -94,8 +165,19 @@ class Logger {
 // program crashing between invocations to Logger::Start() and
 // destructor only causes the lose of the last message body; while the
 // message head will be there.
+//
+// In the async mode, Logger::Start() returns the buffer of the thread,
+// and the destructor puts the message into the ring. The messages of
+// the removed levels are the "true" branch of the ?: of LOG(), which
+// is a constant, so the compiler drops the other branch.
 //-----------------------------------------------------------------------------
 #define LOG(severity)                                                       \
-  Logger(severity).Start(severity, __FILE__, __LINE__, __FUNCTION__)
+  !LogEnabled(severity) ? (void)0 :                                         \
+  LogVoidify() & Logger(severity).Start(severity, __FILE__, __LINE__,      \
+                                        __FUNCTION__)
+
+#define VLOG(level)                                                         \
+  ((level) > XLEARN_MAX_VLOG || !LogEnabled(INFO)) ? (void)0 :             \
+  LogVoidify() & Logger(INFO).Start(INFO, __FILE__, __LINE__, __FUNCTION__)
 
 #endif   // XLEARN_BASE_LOGGING_H_
@@ -0,0 +1,101 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests logging.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/logging.h"
+
+const std::string kInfoFile = "./test_logging.INFO";
+const std::string kWarnFile = "./test_logging.WARN";
+const std::string kErroFile = "./test_logging.ERROR";
+
+// Number of the lines of the file that contain the word
+int count_lines(const std::string& filename, const std::string& word) {
+  std::ifstream file(filename.c_str());
+  std::string line;
+  int count = 0;
+  while (std::getline(file, line)) {
+    if (line.find(word) != std::string::npos) { ++count; }
+  }
+  return count;
+}
+
+int nested_message() {
+  LOG(INFO) << "nested";
+  return 1;
+}
+
+TEST(LoggingTest, Async) {
+  // The INFO messages are removed by XLEARN_MIN_LOG_LEVEL
+  if (!LogEnabled(INFO)) { return; }
+  InitializeLogger(kInfoFile, kWarnFile, kErroFile);
+  EnableAsyncLogging(1024);
+  const int kThreads = 4;
+  const int kMessages = 500;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([t]() {
+      for (int i = 0; i < kMessages; ++i) {
+        LOG(INFO) << "message " << t << " " << i;
+      }
+      LOG(WARNING) << "warning " << t;
+    });
+  }
+  for (int t = 0; t < kThreads; ++t) { threads[t].join(); }
+  LOG(INFO) << "outer " << nested_message();
+  // The long message is written by this thread
+  LOG(INFO) << "long " << std::string(1000, 'x');
+  LOG(ERROR) << "error";
+  FlushLogger();
+  // The INFO messages are dropped only if the ring is full
+  EXPECT_EQ(count_lines(kInfoFile, "message ") + DroppedLogMessages(),
+            kThreads * kMessages);
+  EXPECT_EQ(count_lines(kWarnFile, "warning "), kThreads);
+  EXPECT_EQ(count_lines(kErroFile, "error"), 1);
+  EXPECT_EQ(count_lines(kInfoFile, "outer 1"), 1);
+  EXPECT_EQ(count_lines(kInfoFile, "nested"), 1);
+  EXPECT_EQ(count_lines(kInfoFile, "long xxx"), 1);
+  // The messages after it are synchronous
+  DisableAsyncLogging();
+  LOG(INFO) << "sync";
+  EXPECT_EQ(count_lines(kInfoFile, "sync"), 1);
+  remove(kInfoFile.c_str());
+  remove(kWarnFile.c_str());
+  remove(kErroFile.c_str());
+}
+
+// The arguments of the removed levels are not evaluated
+TEST(LoggingTest, Vlog) {
+  if (!LogEnabled(INFO)) { return; }
+  int count = 0;
+  VLOG(XLEARN_MAX_VLOG + 1) << ++count;
+  EXPECT_EQ(count, 0);
+  VLOG(0) << ++count;
+  EXPECT_EQ(count, 1);
+}
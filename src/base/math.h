@@ -170,11 +170,33 @@ static inline real_t fastersigmoid(real_t x) {
 //------------------------------------------------------------------------------
 static inline real_t InvSqrt(real_t x) {
   real_t xhalf = 0.5f*x;
-  int i = *(int*)&x;       // get bits for floating VALUE
-  i = 0x5f375a86- (i>>1);  // gives initial guess y0
-  x = *(real_t*)&i;        // convert bits BACK to float
+  union { real_t f; int i; } v = { x };
+  v.i = 0x5f375a86- (v.i>>1);  // gives initial guess y0
+  x = v.f;                     // convert bits BACK to float
   x = x*(1.5f-xhalf*x*x);  // Newton step, repeating increases accuracy
   return x;
 }
 
+//------------------------------------------------------------------------------
+// Precision of the 1 / sqrt() in adagrad, which is used by both the
+// scalar InvSqrt(x, precision) below and the SIMD kernels:
+//   kSqrtFast:   the approximate rsqrt (InvSqrt() above, _mm_rsqrt_ps),
+//   kSqrtNewton: the approximate rsqrt refined by one Newton step,
+//   kSqrtExact:  1 / sqrt(x).
+//------------------------------------------------------------------------------
+enum SqrtPrecision {
+  kSqrtFast = 0,
+  kSqrtNewton = 1,
+  kSqrtExact = 2
+};
+
+static inline real_t InvSqrt(real_t x, SqrtPrecision precision) {
+  if (precision == kSqrtExact) { return 1.0f / sqrtf(x); }
+  real_t y = InvSqrt(x);
+  if (precision == kSqrtNewton) {
+    y = y * (1.5f - 0.5f * x * y * y);
+  }
+  return y;
+}
+
 #endif   // XLEARN_BASE_MATH_H_
@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of the SSE kernel
+and the runtime selection of MathKernel.
+*/
+
+#include "src/base/math_kernel.h"
+
+#include <stdlib.h>  // for getenv()
+#include <string.h>  // for strcmp()
+
+#include "src/base/math_kernel_impl.h"
+
+namespace xLearn {
+
+const MathKernel& SSEMathKernel() {
+  return get_math_kernel<SSEVec>("sse");
+}
+
+// The CPU supports AVX2 and FMA
+static bool support_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") &&
+         __builtin_cpu_supports("fma");
+}
+
+// The CPU supports AVX-512F
+static bool support_avx512() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f");
+}
+
+std::vector<const MathKernel*> SupportedMathKernels() {
+  std::vector<const MathKernel*> list;
+  list.push_back(&SSEMathKernel());
+  if (support_avx2()) { list.push_back(&AVX2MathKernel()); }
+  if (support_avx512()) { list.push_back(&AVX512MathKernel()); }
+  return list;
+}
+
+// The widest kernel in SupportedMathKernels(), or the
+// kernel given by XLEARN_KERNEL, the same as ScoreKernel
+static const MathKernel* select_kernel() {
+  std::vector<const MathKernel*> list = SupportedMathKernels();
+  const char* name = getenv("XLEARN_KERNEL");
+  if (name != nullptr) {
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (strcmp(list[i]->name, name) == 0) { return list[i]; }
+    }
+  }
+  return list.back();
+}
+
+const MathKernel& GetMathKernel() {
+  static const MathKernel* kernel = select_kernel();
+  return *kernel;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,86 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file defines the SIMD kernels of exp(), log1p() and sigmoid()
+on arrays, which are selected at runtime.
+*/
+
+#ifndef XLEARN_BASE_MATH_KERNEL_H_
+#define XLEARN_BASE_MATH_KERNEL_H_
+
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// MathKernel is a table of the transcendental functions on arrays, which
+// are used by the evaluation of the loss and the output of prediction.
+// Like ScoreKernel (src/score/score_kernel.h), we build one table for each
+// instruction set in its own file, and the widest one supported by current
+// CPU (or the one given by XLEARN_KERNEL) is selected on the first call:
+//
+//   const MathKernel& kernel = GetMathKernel();
+//   kernel.sigmoid(pred.data(), prob.data(), pred.size());
+//   real_t loss = kernel.log_loss(pred.data(), label.data(), n);
+//
+// The functions use the polynomials of Cephes, which are accurate to a few
+// ulp, rather than the coarse approximations of fastexp() in math.h:
+//   exp():     relative error < 5e-7 on [-87, 88], and the input is
+//              clamped to this range (so exp(-100) is 1.6e-38, not 0),
+//   log1p():   relative error < 5e-7 for x > -1 that is not NaN,
+//   sigmoid(): absolute error < 1e-7.
+// The input and output arrays can be the same.
+//------------------------------------------------------------------------------
+struct MathKernel {
+  /* Name of the instruction set */
+  const char* name;
+
+  // y[i] = exp(x[i])
+  void (*exp)(const real_t* x, real_t* y, size_t n);
+
+  // y[i] = log(1 + x[i])
+  void (*log1p)(const real_t* x, real_t* y, size_t n);
+
+  // y[i] = 1 / (1 + exp(-x[i]))
+  void (*sigmoid)(const real_t* x, real_t* y, size_t n);
+
+  // sum( log(1 + exp(-y[i] * pred[i])) ) of the cross-entropy
+  // loss, where y[i] is 1 if label[i] > 0 and -1 otherwise
+  real_t (*log_loss)(const real_t* pred, const real_t* label,
+                     size_t n);
+};
+
+// Kernel tables of each instruction set
+const MathKernel& SSEMathKernel();
+const MathKernel& AVX2MathKernel();
+const MathKernel& AVX512MathKernel();
+
+// Return all the kernels supported by current CPU,
+// and the first one is the SSE kernel
+std::vector<const MathKernel*> SupportedMathKernels();
+
+// Return the widest kernel supported by current CPU
+const MathKernel& GetMathKernel();
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_MATH_KERNEL_H_
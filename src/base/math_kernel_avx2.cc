@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of the AVX2 and FMA kernel
+of MathKernel. It is compiled with the AVX2 and FMA
+instructions, and it is only used when the CPU supports them.
+*/
+
+#include <immintrin.h>  // for AVX2
+
+#include "src/base/math_kernel.h"
+#include "src/base/math_kernel_impl.h"
+
+namespace xLearn {
+namespace {
+
+struct AVX2Vec {
+  typedef __m256 reg;
+  typedef __m256i ireg;
+  typedef __m256 mask;
+  static const size_t kWidth = 8;
+  static inline reg zero() { return _mm256_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm256_set1_ps(x); }
+  static inline reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+  static inline reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+  static inline reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+  static inline reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+  static inline reg madd(reg a, reg b, reg c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  static inline reg load(const real_t* p) { return _mm256_loadu_ps(p); }
+  static inline void store(real_t* p, reg a) { _mm256_storeu_ps(p, a); }
+  static inline real_t reduce(reg a) {
+    return SSEVec::reduce(_mm_add_ps(_mm256_castps256_ps128(a),
+                                     _mm256_extractf128_ps(a, 1)));
+  }
+  static inline mask lt(reg a, reg b) {
+    return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+  }
+  static inline reg select(mask m, reg a, reg b) {
+    return _mm256_blendv_ps(b, a, m);
+  }
+  static inline ireg round(reg a) { return _mm256_cvtps_epi32(a); }
+  static inline reg to_float(ireg a) { return _mm256_cvtepi32_ps(a); }
+  static inline reg pow2(ireg n) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+  }
+  static inline ireg exponent(reg x) {
+    return _mm256_sub_epi32(
+      _mm256_srli_epi32(_mm256_castps_si256(x), 23),
+      _mm256_set1_epi32(126));
+  }
+  static inline reg mantissa(reg x) {
+    return _mm256_or_ps(_mm256_and_ps(x, _mm256_castsi256_ps(
+                          _mm256_set1_epi32(0x007FFFFF))),
+                        _mm256_set1_ps(0.5f));
+  }
+};
+
+}  // namespace
+
+const MathKernel& AVX2MathKernel() {
+  return get_math_kernel<AVX2Vec>("avx2");
+}
+
+}  // namespace xLearn
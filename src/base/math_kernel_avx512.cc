@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of the AVX-512 kernel of
+MathKernel. It is compiled with the AVX-512F instructions,
+and it is only used when the CPU supports them.
+*/
+
+#include <immintrin.h>  // for AVX512
+
+#include "src/base/math_kernel.h"
+#include "src/base/math_kernel_impl.h"
+
+namespace xLearn {
+namespace {
+
+// The bitwise operations of floats need AVX-512DQ, so
+// they are done on the integer registers
+struct AVX512Vec {
+  typedef __m512 reg;
+  typedef __m512i ireg;
+  typedef __mmask16 mask;
+  static const size_t kWidth = 16;
+  static inline reg zero() { return _mm512_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm512_set1_ps(x); }
+  static inline reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+  static inline reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+  static inline reg min(reg a, reg b) { return _mm512_min_ps(a, b); }
+  static inline reg max(reg a, reg b) { return _mm512_max_ps(a, b); }
+  static inline reg madd(reg a, reg b, reg c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+  static inline reg load(const real_t* p) { return _mm512_loadu_ps(p); }
+  static inline void store(real_t* p, reg a) { _mm512_storeu_ps(p, a); }
+  static inline real_t reduce(reg a) { return _mm512_reduce_add_ps(a); }
+  static inline mask lt(reg a, reg b) {
+    return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+  }
+  static inline reg select(mask m, reg a, reg b) {
+    return _mm512_mask_blend_ps(m, b, a);
+  }
+  static inline ireg round(reg a) { return _mm512_cvtps_epi32(a); }
+  static inline reg to_float(ireg a) { return _mm512_cvtepi32_ps(a); }
+  static inline reg pow2(ireg n) {
+    return _mm512_castsi512_ps(_mm512_slli_epi32(
+      _mm512_add_epi32(n, _mm512_set1_epi32(127)), 23));
+  }
+  static inline ireg exponent(reg x) {
+    return _mm512_sub_epi32(
+      _mm512_srli_epi32(_mm512_castps_si512(x), 23),
+      _mm512_set1_epi32(126));
+  }
+  static inline reg mantissa(reg x) {
+    return _mm512_castsi512_ps(_mm512_or_si512(
+      _mm512_and_si512(_mm512_castps_si512(x),
+                       _mm512_set1_epi32(0x007FFFFF)),
+      _mm512_set1_epi32(0x3F000000)));
+  }
+};
+
+}  // namespace
+
+const MathKernel& AVX512MathKernel() {
+  return get_math_kernel<AVX512Vec>("avx512");
+}
+
+}  // namespace xLearn
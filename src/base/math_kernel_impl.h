@@ -0,0 +1,240 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file contains the generic implementation of the SIMD kernels
+of math_kernel.h. It is only included by math_kernel*.cc, and each
+of them instantiates the kernels with its own register type.
+*/
+
+#ifndef XLEARN_BASE_MATH_KERNEL_IMPL_H_
+#define XLEARN_BASE_MATH_KERNEL_IMPL_H_
+
+#include <emmintrin.h>  // for SSE2
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+#include "src/base/math_kernel.h"
+
+namespace xLearn {
+// Everything here has internal linkage, so that the code
+// compiled with different instruction sets won't be mixed
+namespace {
+
+//------------------------------------------------------------------------------
+// A register type V provides:
+//   V::reg (kWidth floats), V::ireg (kWidth int32) and V::mask
+//   (the result of a comparison), zero(), set1(), add(), sub(), mul(),
+//   div(), min(), max(), madd(a, b, c) = a * b + c, load(), store(),
+//   reduce() for the sum of the lanes, lt(a, b) for a < b, select(m,
+//   a, b) for m ? a : b, round() to the nearest int32, to_float(),
+//   pow2(n) for 2^n (-126 <= n <= 127), and exponent() and mantissa()
+//   of a positive normal float x = mantissa * 2^exponent, where the
+//   mantissa is in [0.5, 1).
+//------------------------------------------------------------------------------
+struct SSEVec {
+  typedef __m128 reg;
+  typedef __m128i ireg;
+  typedef __m128 mask;
+  static const size_t kWidth = 4;
+  static inline reg zero() { return _mm_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm_set1_ps(x); }
+  static inline reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+  static inline reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+  static inline reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+  static inline reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+  static inline reg madd(reg a, reg b, reg c) {
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  }
+  static inline reg load(const real_t* p) { return _mm_loadu_ps(p); }
+  static inline void store(real_t* p, reg a) { _mm_storeu_ps(p, a); }
+  static inline real_t reduce(reg a) {
+    real_t v[kWidth];
+    _mm_storeu_ps(v, a);
+    return (v[0] + v[1]) + (v[2] + v[3]);
+  }
+  static inline mask lt(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+  static inline reg select(mask m, reg a, reg b) {
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+  }
+  static inline ireg round(reg a) { return _mm_cvtps_epi32(a); }
+  static inline reg to_float(ireg a) { return _mm_cvtepi32_ps(a); }
+  static inline reg pow2(ireg n) {
+    return _mm_castsi128_ps(_mm_slli_epi32(
+      _mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+  }
+  static inline ireg exponent(reg x) {
+    return _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(x), 23),
+                         _mm_set1_epi32(126));
+  }
+  static inline reg mantissa(reg x) {
+    return _mm_or_ps(_mm_and_ps(x, _mm_castsi128_ps(
+                       _mm_set1_epi32(0x007FFFFF))),
+                     _mm_set1_ps(0.5f));
+  }
+};
+
+//------------------------------------------------------------------------------
+// The functions on one register, from the single precision
+// functions of the Cephes library
+//------------------------------------------------------------------------------
+
+// exp(x) = 2^n * exp(r), where n = round(x / ln2) and
+// r = x - n * ln2 in [-ln2 / 2, ln2 / 2]
+template<class V>
+inline typename V::reg exp_reg(typename V::reg x) {
+  typedef typename V::reg reg;
+  x = V::min(V::max(x, V::set1(-87.0f)), V::set1(88.0f));
+  typename V::ireg n = V::round(V::mul(x, V::set1(1.44269504088896341f)));
+  reg fn = V::to_float(n);
+  // ln2 in two parts, so that n * ln2 is exact
+  x = V::sub(x, V::mul(fn, V::set1(0.693359375f)));
+  x = V::sub(x, V::mul(fn, V::set1(-2.12194440e-4f)));
+  reg z = V::mul(x, x);
+  reg y = V::set1(1.9875691500e-4f);
+  y = V::madd(y, x, V::set1(1.3981999507e-3f));
+  y = V::madd(y, x, V::set1(8.3334519073e-3f));
+  y = V::madd(y, x, V::set1(4.1665795894e-2f));
+  y = V::madd(y, x, V::set1(1.6666665459e-1f));
+  y = V::madd(y, x, V::set1(5.0000001201e-1f));
+  y = V::madd(y, z, V::add(x, V::set1(1.0f)));
+  return V::mul(y, V::pow2(n));
+}
+
+// log(x) = e * ln2 + log(m) for the positive normal x = m * 2^e,
+// where m is scaled to [sqrt(0.5), sqrt(2))
+template<class V>
+inline typename V::reg log_reg(typename V::reg x) {
+  typedef typename V::reg reg;
+  reg one = V::set1(1.0f);
+  reg e = V::to_float(V::exponent(x));
+  reg m = V::mantissa(x);
+  typename V::mask small = V::lt(m, V::set1(0.707106781186547524f));
+  e = V::select(small, V::sub(e, one), e);
+  m = V::select(small, V::sub(V::add(m, m), one), V::sub(m, one));
+  reg z = V::mul(m, m);
+  reg y = V::set1(7.0376836292e-2f);
+  y = V::madd(y, m, V::set1(-1.1514610310e-1f));
+  y = V::madd(y, m, V::set1(1.1676998740e-1f));
+  y = V::madd(y, m, V::set1(-1.2420140846e-1f));
+  y = V::madd(y, m, V::set1(1.4249322787e-1f));
+  y = V::madd(y, m, V::set1(-1.6668057665e-1f));
+  y = V::madd(y, m, V::set1(2.0000714765e-1f));
+  y = V::madd(y, m, V::set1(-2.4999993993e-1f));
+  y = V::madd(y, m, V::set1(3.3333331174e-1f));
+  y = V::mul(V::mul(y, m), z);
+  y = V::madd(e, V::set1(-2.12194440e-4f), y);
+  y = V::madd(z, V::set1(-0.5f), y);
+  m = V::add(m, y);
+  return V::madd(e, V::set1(0.693359375f), m);
+}
+
+// log1p(x) = log(u) + (x - (u - 1)) / u for u = 1 + x, in which
+// the second term corrects the rounding error of u for small x
+template<class V>
+inline typename V::reg log1p_reg(typename V::reg x) {
+  typedef typename V::reg reg;
+  reg u = V::add(x, V::set1(1.0f));
+  reg c = V::div(V::sub(x, V::sub(u, V::set1(1.0f))), u);
+  return V::add(log_reg<V>(u), c);
+}
+
+template<class V>
+inline typename V::reg sigmoid_reg(typename V::reg x) {
+  typedef typename V::reg reg;
+  reg one = V::set1(1.0f);
+  return V::div(one, V::add(one, exp_reg<V>(V::sub(V::zero(), x))));
+}
+
+// log(1 + exp(z)) = max(z, 0) + log1p(exp(-|z|)) for z = -y * pred,
+// which never overflows
+template<class V>
+inline typename V::reg log_loss_reg(typename V::reg pred,
+                                    typename V::reg label) {
+  typedef typename V::reg reg;
+  reg zero = V::zero();
+  reg one = V::set1(1.0f);
+  reg y = V::select(V::lt(zero, label), one, V::set1(-1.0f));
+  reg z = V::mul(V::sub(zero, y), pred);
+  reg neg_abs = V::min(z, V::sub(zero, z));
+  return V::add(V::max(z, zero), log1p_reg<V>(exp_reg<V>(neg_abs)));
+}
+
+//------------------------------------------------------------------------------
+// The functions on arrays. The tail of fewer than kWidth floats
+// is computed in a padded register, so every element is computed
+// by the same instructions
+//------------------------------------------------------------------------------
+
+template<class V, typename V::reg (*F)(typename V::reg)>
+void apply_array(const real_t* x, real_t* y, size_t n) {
+  size_t i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth) {
+    V::store(y + i, F(V::load(x + i)));
+  }
+  if (i < n) {
+    real_t buf[V::kWidth];
+    for (size_t j = 0; j < V::kWidth; ++j) {
+      buf[j] = i + j < n ? x[i + j] : 0;
+    }
+    V::store(buf, F(V::load(buf)));
+    for (size_t j = 0; i + j < n; ++j) { y[i + j] = buf[j]; }
+  }
+}
+
+template<class V>
+real_t log_loss_array(const real_t* pred, const real_t* label,
+                      size_t n) {
+  typename V::reg sum = V::zero();
+  size_t i = 0;
+  for (; i + V::kWidth <= n; i += V::kWidth) {
+    sum = V::add(sum, log_loss_reg<V>(V::load(pred + i),
+                                      V::load(label + i)));
+  }
+  real_t res = V::reduce(sum);
+  if (i < n) {
+    real_t p[V::kWidth], l[V::kWidth];
+    for (size_t j = 0; j < V::kWidth; ++j) {
+      p[j] = i + j < n ? pred[i + j] : 0;
+      l[j] = i + j < n ? label[i + j] : 0;
+    }
+    V::store(p, log_loss_reg<V>(V::load(p), V::load(l)));
+    for (size_t j = 0; i + j < n; ++j) { res += p[j]; }
+  }
+  return res;
+}
+
+// The kernel table of the register type
+template<class V>
+const MathKernel& get_math_kernel(const char* name) {
+  static const MathKernel kernel = {
+    name,
+    &apply_array<V, exp_reg<V> >,
+    &apply_array<V, log1p_reg<V> >,
+    &apply_array<V, sigmoid_reg<V> >,
+    &log_loss_array<V>
+  };
+  return kernel;
+}
+
+}  // namespace
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_MATH_KERNEL_IMPL_H_
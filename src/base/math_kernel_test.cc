@@ -0,0 +1,141 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests math_kernel.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "src/base/math_kernel.h"
+
+namespace xLearn {
+
+// The inputs in [lo, hi], whose size is not a multiple of any width
+static std::vector<real_t> inputs(real_t lo, real_t hi) {
+  const size_t kNum = 10007;
+  std::vector<real_t> x(kNum);
+  for (size_t i = 0; i < kNum; ++i) {
+    x[i] = lo + (hi - lo) * i / (kNum - 1);
+  }
+  return x;
+}
+
+static double rel_error(double a, double b) {
+  return fabs(a - b) / std::max(fabs(b), 1e-30);
+}
+
+TEST(MathKernelTest, Exp) {
+  std::vector<real_t> x = inputs(-87, 88);
+  std::vector<real_t> y(x.size());
+  for (const MathKernel* kernel : SupportedMathKernels()) {
+    kernel->exp(x.data(), y.data(), x.size());
+    double max_error = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      max_error = std::max(max_error, rel_error(y[i], exp((double)x[i])));
+    }
+    EXPECT_LT(max_error, 5e-7) << kernel->name;
+    // Clamped out of the range
+    real_t big[2] = {-1000, 1000};
+    kernel->exp(big, big, 2);
+    EXPECT_GE(big[0], 0) << kernel->name;
+    EXPECT_LT(big[0], 1e-37) << kernel->name;
+    EXPECT_TRUE(std::isfinite(big[1])) << kernel->name;
+    EXPECT_GT(big[1], 1e38) << kernel->name;
+  }
+}
+
+TEST(MathKernelTest, Log1p) {
+  std::vector<real_t> x = inputs(-0.999, 100);
+  std::vector<real_t> small = inputs(-1e-6, 1e-6);
+  std::vector<real_t> large = inputs(1e3, 1e30);
+  x.insert(x.end(), small.begin(), small.end());
+  x.insert(x.end(), large.begin(), large.end());
+  std::vector<real_t> y(x.size());
+  for (const MathKernel* kernel : SupportedMathKernels()) {
+    kernel->log1p(x.data(), y.data(), x.size());
+    double max_error = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      if (x[i] == 0) {
+        EXPECT_EQ(y[i], 0) << kernel->name;
+        continue;
+      }
+      max_error = std::max(max_error,
+                           rel_error(y[i], log1p((double)x[i])));
+    }
+    EXPECT_LT(max_error, 5e-7) << kernel->name;
+  }
+}
+
+TEST(MathKernelTest, Sigmoid) {
+  std::vector<real_t> x = inputs(-100, 100);
+  for (const MathKernel* kernel : SupportedMathKernels()) {
+    // In place
+    std::vector<real_t> y = x;
+    kernel->sigmoid(y.data(), y.data(), y.size());
+    double max_error = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      double expected = 1.0 / (1.0 + exp(-(double)x[i]));
+      max_error = std::max(max_error, fabs(y[i] - expected));
+      EXPECT_GE(y[i], 0) << kernel->name;
+      EXPECT_LE(y[i], 1) << kernel->name;
+    }
+    EXPECT_LT(max_error, 1e-7) << kernel->name;
+  }
+}
+
+TEST(MathKernelTest, LogLoss) {
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<real_t> score(-30, 30);
+  for (size_t n = 0; n < 40; ++n) {
+    std::vector<real_t> pred(n), label(n);
+    double expected = 0;
+    for (size_t i = 0; i < n; ++i) {
+      pred[i] = score(rng);
+      label[i] = (rng() % 2 == 0) ? 1 : -1;
+      double z = -(label[i] > 0 ? 1.0 : -1.0) * pred[i];
+      expected += z > 0 ? z + log1p(exp(-z)) : log1p(exp(z));
+    }
+    for (const MathKernel* kernel : SupportedMathKernels()) {
+      real_t loss = kernel->log_loss(pred.data(), label.data(), n);
+      EXPECT_NEAR(loss, expected, 1e-5 * std::max(expected, 1.0))
+        << kernel->name << " n = " << n;
+    }
+  }
+  // The labels of 0 are negative, and the large scores never overflow
+  real_t pred[3] = {1000, -1000, 0};
+  real_t label[3] = {0, 1, 1};
+  EXPECT_NEAR(GetMathKernel().log_loss(pred, label, 3),
+              2000 + log(2.0), 1e-3);
+}
+
+TEST(MathKernelTest, Select) {
+  std::vector<const MathKernel*> list = SupportedMathKernels();
+  ASSERT_FALSE(list.empty());
+  EXPECT_STREQ(list[0]->name, "sse");
+  EXPECT_STREQ(GetMathKernel().name, list.back()->name);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,172 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of output_writer.h
+*/
+
+#include "src/base/output_writer.h"
+#include "src/base/file_util.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace xLearn {
+
+// The exact powers of 10 in double
+static const double kPow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+  1e21, 1e22
+};
+
+// x * 10^k, in which |k| <= 22
+static inline double scale(double x, int k) {
+  return k >= 0 ? x * kPow10[k] : x / kPow10[-k];
+}
+
+// Write the digits of d (at most 6 digits), and return the end
+static inline char* write_digits(char* p, uint32 d, int num) {
+  for (int i = num - 1; i >= 0; --i) {
+    p[i] = '0' + d % 10;
+    d /= 10;
+  }
+  return p + num;
+}
+
+// The value is rounded to 6 significant digits d * 10^(e-5),
+// and then it is printed in the style of "%g": the exponent style
+// if e < -4 or e >= 6, and the fixed style otherwise, and the
+// trailing zeros are removed. The product of the float and the
+// exact power of 10 is correctly rounded in double, so only the
+// values near a tie of the rounding (which are very rare) need
+// snprintf() to get the same result
+int FormatFloat(float val, char* buf) {
+  double x = val;
+  if (x == 0) {
+    return snprintf(buf, kMaxFloatText, "%g", val);
+  }
+  char* p = buf;
+  if (x < 0) { x = -x; }
+  if (!(x >= 1e-15 && x < 1e15)) {  // also nan and inf
+    return snprintf(buf, kMaxFloatText, "%g", val);
+  }
+  // The decimal exponent from the binary exponent, which
+  // is at most one less than the exact one
+  int b = 0;
+  frexp(x, &b);
+  int e = (int)floor((b - 1) * 0.30102999566398120);
+  double m = scale(x, 5 - e);
+  while (m >= 1e6) { m = scale(x, 5 - (++e)); }
+  while (m < 1e5) { m = scale(x, 5 - (--e)); }
+  uint32 d = (uint32)m;
+  double frac = m - d;
+  if (fabs(frac - 0.5) < 1e-6) {
+    return snprintf(buf, kMaxFloatText, "%g", val);
+  }
+  if (frac > 0.5) { ++d; }
+  if (d == 1000000) { d = 100000; ++e; }
+  // Remove the trailing zeros
+  int num = 6;
+  while (d % 10 == 0) { d /= 10; --num; }
+  char digits[8] = { 0 };
+  write_digits(digits, d, num);
+  if (val < 0) { *p++ = '-'; }
+  if (e < -4 || e >= 6) {
+    *p++ = digits[0];
+    if (num > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, num - 1);
+      p += num - 1;
+    }
+    *p++ = 'e';
+    *p++ = e < 0 ? '-' : '+';
+    int abs_e = e < 0 ? -e : e;
+    p = write_digits(p, abs_e, 2);
+  } else if (e >= 0) {
+    if (num <= e + 1) {
+      memcpy(p, digits, num);
+      p += num;
+      for (int i = num; i <= e; ++i) { *p++ = '0'; }
+    } else {
+      memcpy(p, digits, e + 1);
+      p += e + 1;
+      *p++ = '.';
+      memcpy(p, digits + e + 1, num - e - 1);
+      p += num - e - 1;
+    }
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = 0; i < -e - 1; ++i) { *p++ = '0'; }
+    memcpy(p, digits, num);
+    p += num;
+  }
+  *p = '\0';
+  return p - buf;
+}
+
+void OutputWriter::Open(const std::string& filename, bool binary) {
+  Close();
+  file_ = OpenFileOrDie(filename.c_str(), "w");
+  binary_ = binary;
+  buf_ = new char[kBufferSize + kMaxFloatText];
+  size_ = 0;
+}
+
+void OutputWriter::Write(const float* val, size_t n) {
+  CHECK_NOTNULL(file_);
+  if (binary_) {
+    const char* src = reinterpret_cast<const char*>(val);
+    size_t len = n * sizeof(float);
+    while (len > 0) {
+      size_t copy = kBufferSize - size_;
+      if (copy > len) { copy = len; }
+      memcpy(buf_ + size_, src, copy);
+      size_ += copy;
+      src += copy;
+      len -= copy;
+      if (size_ >= kBufferSize) { Flush(); }
+    }
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    size_ += FormatFloat(val[i], buf_ + size_);
+    buf_[size_++] = '\n';
+    if (size_ >= kBufferSize) { Flush(); }
+  }
+}
+
+void OutputWriter::Flush() {
+  if (file_ != nullptr && size_ > 0) {
+    WriteDataToDisk(file_, buf_, size_);
+    size_ = 0;
+  }
+}
+
+void OutputWriter::Close() {
+  if (file_ == nullptr) { return; }
+  Flush();
+  ::Close(file_);
+  file_ = nullptr;
+  delete [] buf_;
+  buf_ = nullptr;
+}
+
+} // namespace xLearn
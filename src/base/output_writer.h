@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the OutputWriter class, which writes the
+predictions to the output file.
+*/
+
+#ifndef XLEARN_BASE_OUTPUT_WRITER_H_
+#define XLEARN_BASE_OUTPUT_WRITER_H_
+
+#include <stdio.h>
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+/* The buffer size of FormatFloat() */
+const int kMaxFloatText = 32;
+
+// Format val like printf("%g"), and return the length of the
+// string (without '\0'). The buf should have kMaxFloatText bytes.
+// The common values are converted by integer arithmetic, and
+// the others (e.g., nan, inf and the very small or very large
+// values) fall back to snprintf()
+int FormatFloat(float val, char* buf);
+
+//------------------------------------------------------------------------------
+// OutputWriter writes the predictions, one value per line in the text
+// format, or the raw float32 values in the binary format. The output
+// goes through a large buffer, and the buffer is written to disk only
+// when it is full:
+//
+//   OutputWriter writer;
+//   writer.Open("/tmp/out.txt", false);
+//   writer.Write(pred.data(), pred.size());
+//   writer.Close();
+//
+// The binary output has no header, so the i-th prediction is the i-th
+// float (in the byte order of current machine) of the file.
+//------------------------------------------------------------------------------
+class OutputWriter {
+ public:
+  OutputWriter() { }
+  ~OutputWriter() { Close(); }
+
+  // Open the output file, and binary is true for float32 output
+  void Open(const std::string& filename, bool binary);
+
+  // Append n values to the output
+  void Write(const float* val, size_t n);
+
+  // Write the buffer to disk
+  void Flush();
+
+  // Flush and close the file
+  void Close();
+
+ protected:
+  /* Size of the output buffer */
+  static const size_t kBufferSize = 4 * 1024 * 1024;
+
+  FILE* file_ = nullptr;
+  bool binary_ = false;
+  char* buf_ = nullptr;
+  size_t size_ = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(OutputWriter);
+};
+
+} // namespace xLearn
+
+#endif  // XLEARN_BASE_OUTPUT_WRITER_H_
@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests output_writer.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/output_writer.h"
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+void ExpectSameAsPrintf(float val) {
+  char buf[kMaxFloatText];
+  char expect[kMaxFloatText];
+  int len = FormatFloat(val, buf);
+  snprintf(expect, sizeof(expect), "%g", val);
+  EXPECT_EQ(len, strlen(expect));
+  EXPECT_STREQ(buf, expect) << val;
+}
+
+TEST(OutputWriterTest, FormatFloat) {
+  float special[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 0.1f, 1e-4f,
+                      1e-5f, 9.999995e-5f, 0.99999949f, 0.9999995f,
+                      999999.5f, 1e6f, 123456.0f, 1234567.0f, 1e-15f,
+                      1e15f, 3e38f, 1e-40f, INFINITY, -INFINITY, NAN };
+  for (size_t i = 0; i < sizeof(special) / sizeof(float); ++i) {
+    ExpectSameAsPrintf(special[i]);
+  }
+  // The probability and the raw score
+  srand(0);
+  for (int i = 0; i < 200000; ++i) {
+    ExpectSameAsPrintf((float)rand() / RAND_MAX);
+    ExpectSameAsPrintf(((float)rand() / RAND_MAX - 0.5f) *
+                       powf(10.0f, rand() % 30 - 15));
+  }
+  // All the bits of the float
+  for (uint32 bits = 0; bits < 0xFFFFFFFFu - 4093; bits += 4093) {
+    float val;
+    memcpy(&val, &bits, sizeof(val));
+    ExpectSameAsPrintf(val);
+  }
+}
+
+TEST(OutputWriterTest, Write) {
+  const std::string filename = "./test_output_writer.txt";
+  std::vector<float> pred;
+  std::string expect;
+  char str[kMaxFloatText];
+  for (int i = 0; i < 1000000; ++i) {
+    pred.push_back(1.0f / (i + 1));
+    snprintf(str, sizeof(str), "%g\n", pred.back());
+    expect += str;
+  }
+  // Text format, which is larger than the buffer
+  OutputWriter writer;
+  writer.Open(filename, false);
+  writer.Write(pred.data(), 10);
+  writer.Write(pred.data() + 10, pred.size() - 10);
+  writer.Close();
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buf);
+  EXPECT_EQ(std::string(buf, size), expect);
+  delete [] buf;
+  // Binary format
+  writer.Open(filename, true);
+  writer.Write(pred.data(), pred.size());
+  writer.Close();
+  size = ReadFileToMemory(filename, &buf);
+  ASSERT_EQ(size, pred.size() * sizeof(float));
+  EXPECT_EQ(memcmp(buf, pred.data(), size), 0);
+  delete [] buf;
+  RemoveFile(filename.c_str());
+}
+
+} // namespace xLearn
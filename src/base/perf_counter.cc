@@ -0,0 +1,167 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of perf_counter.h
+*/
+
+#include "src/base/perf_counter.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "src/base/logging.h"
+
+namespace xLearn {
+
+const char* PerfEventName(int event) {
+  static const char* kName[kNumPerfEvents] = {
+    "cycles", "instructions", "LLC-misses", "dTLB-misses"
+  };
+  CHECK_LT(event, kNumPerfEvents);
+  return kName[event];
+}
+
+#ifdef __linux__
+
+// The type and config of each PerfEvent
+static void event_attr(int event, struct perf_event_attr* attr) {
+  memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->disabled = 1;
+  attr->exclude_kernel = 1;
+  attr->exclude_hv = 1;
+  attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                      PERF_FORMAT_TOTAL_TIME_RUNNING;
+  uint64 miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  switch (event) {
+    case kPerfCycles:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case kPerfInstructions:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case kPerfLLCMisses:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_LL | miss;
+      break;
+    default:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_DTLB | miss;
+      break;
+  }
+}
+
+// The ids of the threads of current process
+static std::vector<int> thread_ids() {
+  std::vector<int> tids;
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) { return tids; }
+  struct dirent* entry = nullptr;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') { continue; }
+    tids.push_back(atoi(entry->d_name));
+  }
+  closedir(dir);
+  return tids;
+}
+
+bool PerfCounter::Start() {
+  close_all();
+  std::vector<int> tids = thread_ids();
+  if (tids.empty()) { return false; }
+  for (size_t t = 0; t < tids.size(); ++t) {
+    for (int e = 0; e < kNumPerfEvents; ++e) {
+      struct perf_event_attr attr;
+      event_attr(e, &attr);
+      int fd = syscall(__NR_perf_event_open, &attr, tids[t], -1, -1, 0);
+      if (fd < 0) {
+        close_all();
+        return false;
+      }
+      fds_.push_back(fd);
+    }
+  }
+  for (size_t i = 0; i < fds_.size(); ++i) {
+    ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+  return true;
+}
+
+void PerfCounter::Stop(PerfValues* values) {
+  CHECK_NOTNULL(values);
+  for (size_t i = 0; i < fds_.size(); ++i) {
+    ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+  }
+  for (size_t i = 0; i < fds_.size(); ++i) {
+    // value, time_enabled and time_running
+    uint64 data[3] = { 0, 0, 0 };
+    if (read(fds_[i], data, sizeof(data)) != sizeof(data)) { continue; }
+    uint64 count = data[0];
+    if (data[2] > 0 && data[2] < data[1]) {
+      count = (uint64)((double)count * data[1] / data[2]);
+    }
+    values->value[i % kNumPerfEvents] += count;
+  }
+  close_all();
+}
+
+void PerfCounter::close_all() {
+  for (size_t i = 0; i < fds_.size(); ++i) { close(fds_[i]); }
+  fds_.clear();
+}
+
+#else  // The events are not counted on the other systems
+
+bool PerfCounter::Start() { return false; }
+
+void PerfCounter::Stop(PerfValues* values) { CHECK_NOTNULL(values); }
+
+void PerfCounter::close_all() { }
+
+#endif
+
+bool PerfCounter::Available() {
+  static bool available = []() {
+    PerfCounter counter;
+    bool ok = counter.Start();
+    if (ok) {
+      PerfValues values;
+      counter.Stop(&values);
+    } else {
+      LOG(ERROR) << "The hardware events cannot be counted by "
+                 << "perf_event_open()";
+    }
+    return ok;
+  }();
+  return available;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,101 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the PerfCounter class, which counts the hardware
+events of current process by perf_event_open() on Linux. It is only
+built with -DXLEARN_PERF_COUNTERS=ON.
+*/
+
+#ifndef XLEARN_BASE_PERF_COUNTER_H_
+#define XLEARN_BASE_PERF_COUNTER_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// The hardware events counted by PerfCounter
+enum PerfEvent {
+  kPerfCycles = 0,
+  kPerfInstructions,
+  kPerfLLCMisses,
+  kPerfDTLBMisses,
+  kNumPerfEvents
+};
+
+// The name of the event in the report
+const char* PerfEventName(int event);
+
+// The counts of the events
+struct PerfValues {
+  uint64 value[kNumPerfEvents] = { 0 };
+  void Add(const PerfValues& other) {
+    for (int i = 0; i < kNumPerfEvents; ++i) {
+      value[i] += other.value[i];
+    }
+  }
+};
+
+//------------------------------------------------------------------------------
+// PerfCounter counts the events in user space of all the threads of
+// current process, e.g., including the threads of the ThreadPool of the
+// Loss, which are opened one by one from /proc/self/task at Start().
+// The threads created after Start() are not counted. The counts are
+// scaled by the running time if the events are multiplexed:
+//
+//   PerfCounter counter;
+//   if (counter.Start()) {
+//     ...
+//     PerfValues values;
+//     counter.Stop(&values);
+//   }
+//
+// Start() returns false if the events cannot be counted, e.g., in a VM
+// without the PMU or with a restrictive kernel.perf_event_paranoid.
+//------------------------------------------------------------------------------
+class PerfCounter {
+ public:
+  PerfCounter() { }
+  ~PerfCounter() { close_all(); }
+
+  // Open and enable the counters
+  bool Start();
+
+  // Disable and read the counters, and add the counts to values
+  void Stop(PerfValues* values);
+
+  // True if the events can be counted, which is checked once
+  static bool Available();
+
+ protected:
+  /* One file descriptor for each event of each thread */
+  std::vector<int> fds_;
+
+  void close_all();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PerfCounter);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_PERF_COUNTER_H_
@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests perf_counter.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include "src/base/perf_counter.h"
+#include "src/base/phase_timer.h"
+
+namespace xLearn {
+
+// A loop that the compiler cannot remove
+static uint64 work(uint64 n) {
+  volatile uint64 sum = 0;
+  for (uint64 i = 0; i < n; ++i) { sum = sum + i * i; }
+  return sum;
+}
+
+TEST(PerfCounterTest, Count) {
+  // The events cannot be counted in some VMs and containers
+  if (!PerfCounter::Available()) { return; }
+  PerfCounter counter;
+  ASSERT_TRUE(counter.Start());
+  work(1000000);
+  PerfValues values;
+  counter.Stop(&values);
+  EXPECT_GT(values.value[kPerfCycles], 0);
+  EXPECT_GT(values.value[kPerfInstructions], 1000000);
+}
+
+TEST(PerfCounterTest, Threads) {
+  if (!PerfCounter::Available()) { return; }
+  // The threads that exist at Start() are counted
+  std::vector<std::thread> threads;
+  std::vector<int> ready(2, 0);
+  volatile bool go = false;
+  for (int i = 0; i < 2; ++i) {
+    threads.push_back(std::thread([&, i]() {
+      __atomic_store_n(&ready[i], 1, __ATOMIC_SEQ_CST);
+      while (!go) { }
+      work(2000000);
+    }));
+  }
+  for (int i = 0; i < 2; ++i) {
+    while (!__atomic_load_n(&ready[i], __ATOMIC_SEQ_CST)) { }
+  }
+  PerfCounter counter;
+  ASSERT_TRUE(counter.Start());
+  go = true;
+  for (size_t i = 0; i < threads.size(); ++i) { threads[i].join(); }
+  PerfValues values;
+  counter.Stop(&values);
+  EXPECT_GT(values.value[kPerfInstructions], 4000000);
+}
+
+TEST(PerfCounterTest, Phase) {
+  if (!PerfCounter::Available()) { return; }
+  PhaseTimer& timer = PhaseTimer::Get();
+  timer.Reset();
+  {
+    ScopedPhase phase("gradient", true);
+    work(1000000);
+    phase.AddRows(1000);
+  }
+  PhaseStats stats;
+  ASSERT_TRUE(timer.Find("gradient", &stats));
+  EXPECT_EQ(stats.counted, 1);
+  EXPECT_GT(stats.events.value[kPerfInstructions], 0);
+  EXPECT_NE(timer.CounterSummary().find("gradient"), std::string::npos);
+  timer.Reset();
+}
+
+}  // namespace xLearn
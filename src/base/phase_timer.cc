@@ -0,0 +1,221 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of phase_timer.h
+*/
+
+#include "src/base/phase_timer.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "src/base/logging.h"
+#include "src/base/stringprintf.h"
+#include "src/base/trace.h"
+
+namespace xLearn {
+
+// The paths of the phases opened by current thread
+static std::vector<std::string>& phase_stack() {
+  static thread_local std::vector<std::string> stack;
+  return stack;
+}
+
+PhaseTimer& PhaseTimer::Get() {
+  static PhaseTimer timer;
+  return timer;
+}
+
+size_t PhaseTimer::find_or_add(const std::string& path) {
+  auto iter = index_.find(path);
+  if (iter != index_.end()) { return iter->second; }
+  PhaseStats stats;
+  stats.path = path;
+  stats.depth = std::count(path.begin(), path.end(), '/');
+  stats.count = 0;
+  stats.total = 0;
+  stats.max = 0;
+  stats.rows = 0;
+#ifdef XLEARN_PERF_COUNTERS
+  stats.counted = 0;
+#endif
+  phases_.push_back(stats);
+  index_[path] = phases_.size() - 1;
+  return phases_.size() - 1;
+}
+
+void PhaseTimer::Register(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  find_or_add(path);
+}
+
+void PhaseTimer::Add(const std::string& path, double seconds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PhaseStats& stats = phases_[find_or_add(path)];
+  stats.count++;
+  stats.total += seconds;
+  stats.max = std::max(stats.max, seconds);
+}
+
+void PhaseTimer::AddRows(const std::string& path, uint64 rows) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  phases_[find_or_add(path)].rows += rows;
+}
+
+#ifdef XLEARN_PERF_COUNTERS
+void PhaseTimer::AddEvents(const std::string& path,
+                           const PerfValues& events) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PhaseStats& stats = phases_[find_or_add(path)];
+  stats.events.Add(events);
+  stats.counted++;
+}
+#endif
+
+std::vector<PhaseStats> PhaseTimer::Phases() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return phases_;
+}
+
+bool PhaseTimer::Find(const std::string& path, PhaseStats* stats) const {
+  CHECK_NOTNULL(stats);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = index_.find(path);
+  if (iter == index_.end() || phases_[iter->second].count == 0) {
+    return false;
+  }
+  *stats = phases_[iter->second];
+  return true;
+}
+
+void PhaseTimer::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  phases_.clear();
+  index_.clear();
+}
+
+std::string PhaseTimer::Summary() const {
+  std::vector<PhaseStats> phases = Phases();
+  std::unordered_map<std::string, double> total;
+  for (size_t i = 0; i < phases.size(); ++i) {
+    total[phases[i].path] = phases[i].total;
+  }
+  std::string res;
+  SStringPrintf(&res, "%-32s %8s %12s %12s %12s %8s\n", "Phase",
+                "Count", "Total(sec)", "Mean(sec)", "Max(sec)", "Share");
+  for (size_t i = 0; i < phases.size(); ++i) {
+    const PhaseStats& stats = phases[i];
+    if (stats.count == 0) { continue; }
+    size_t pos = stats.path.rfind('/');
+    std::string name = std::string(2 * stats.depth, ' ') +
+      (pos == std::string::npos ? stats.path : stats.path.substr(pos + 1));
+    std::string share = "-";
+    if (pos != std::string::npos) {
+      double parent = total[stats.path.substr(0, pos)];
+      if (parent > 0) {
+        share = StringPrintf("%.1f%%", stats.total * 100 / parent);
+      }
+    }
+    StringAppendF(&res, "%-32s %8llu %12.3f %12.3f %12.3f %8s\n",
+                  name.c_str(), (unsigned long long)stats.count,
+                  stats.total, stats.total / stats.count, stats.max,
+                  share.c_str());
+  }
+  return res;
+}
+
+#ifdef XLEARN_PERF_COUNTERS
+std::string PhaseTimer::CounterSummary() const {
+  std::vector<PhaseStats> phases = Phases();
+  std::string res;
+  for (size_t i = 0; i < phases.size(); ++i) {
+    const PhaseStats& stats = phases[i];
+    if (stats.counted == 0) { continue; }
+    if (res.empty()) {
+      SStringPrintf(&res, "%-32s %12s %8s %12s %12s %12s\n", "Phase",
+                    "Rows", "IPC", "Cycles/row", "LLC-miss/row",
+                    "dTLB-miss/row");
+    }
+    const uint64* value = stats.events.value;
+    double rows = stats.rows > 0 ? stats.rows : 1;
+    double ipc = value[kPerfCycles] > 0 ?
+      (double)value[kPerfInstructions] / value[kPerfCycles] : 0;
+    StringAppendF(&res, "%-32s %12llu %8.2f %12.1f %12.3f %12.3f\n",
+                  stats.path.c_str(), (unsigned long long)stats.rows,
+                  ipc, value[kPerfCycles] / rows,
+                  value[kPerfLLCMisses] / rows,
+                  value[kPerfDTLBMisses] / rows);
+  }
+  return res;
+}
+#endif
+
+void PhaseTimer::PrintSummary() const {
+  std::string summary = Summary();
+#ifdef XLEARN_PERF_COUNTERS
+  std::string counters = CounterSummary();
+  if (!counters.empty()) {
+    summary += "Hardware events of the phases: \n" + counters;
+  }
+#endif
+  printf("Wall-clock time of the phases: \n%s", summary.c_str());
+  LOG(INFO) << "Wall-clock time of the phases: \n" << summary;
+}
+
+ScopedPhase::ScopedPhase(const std::string& name, bool count_events)
+  : seconds_(0), stopped_(false), rows_(0) {
+  std::vector<std::string>& stack = phase_stack();
+  path_ = stack.empty() ? name : stack.back() + "/" + name;
+  stack.push_back(path_);
+  PhaseTimer::Get().Register(path_);
+#ifdef XLEARN_PERF_COUNTERS
+  counting_ = count_events && PerfCounter::Available() &&
+              counter_.Start();
+#endif
+  begin_ = std::chrono::steady_clock::now();
+}
+
+double ScopedPhase::Stop() {
+  if (stopped_) { return seconds_; }
+  stopped_ = true;
+  std::chrono::steady_clock::time_point end =
+    std::chrono::steady_clock::now();
+  seconds_ = std::chrono::duration<double>(end - begin_).count();
+  // The phases are also the spans of the timeline
+  if (TraceLog::Enabled()) {
+    TraceLog::Get().AddComplete(path_, "phase", begin_, end);
+  }
+#ifdef XLEARN_PERF_COUNTERS
+  if (counting_) {
+    PerfValues events;
+    counter_.Stop(&events);
+    PhaseTimer::Get().AddEvents(path_, events);
+  }
+#endif
+  std::vector<std::string>& stack = phase_stack();
+  CHECK(!stack.empty() && stack.back() == path_);
+  stack.pop_back();
+  PhaseTimer::Get().Add(path_, seconds_);
+  if (rows_ > 0) { PhaseTimer::Get().AddRows(path_, rows_); }
+  return seconds_;
+}
+
+}  // namespace xLearn
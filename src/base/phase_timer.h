@@ -0,0 +1,185 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the PhaseTimer class and the ScopedPhase class,
+which measure the wall-clock time of the phases of a task. With
+-DXLEARN_PERF_COUNTERS=ON, they also count the hardware events of
+the phases that ask for it.
+*/
+
+#ifndef XLEARN_BASE_PHASE_TIMER_H_
+#define XLEARN_BASE_PHASE_TIMER_H_
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/base/common.h"
+#ifdef XLEARN_PERF_COUNTERS
+#include "src/base/perf_counter.h"
+#endif
+
+namespace xLearn {
+
+// The wall-clock time of all the runs of one phase
+struct PhaseStats {
+  /* Full path of the phase, e.g., "train/epoch" */
+  std::string path;
+  /* Number of parents in the path */
+  int depth;
+  /* Number of runs */
+  uint64 count;
+  /* Total and maximal time (sec) of the runs */
+  double total;
+  double max;
+  /* Number of rows processed by the runs, for the per-row counts */
+  uint64 rows;
+#ifdef XLEARN_PERF_COUNTERS
+  /* Hardware events of the runs, and the runs that counted them */
+  PerfValues events;
+  uint64 counted;
+#endif
+};
+
+//------------------------------------------------------------------------------
+// PhaseTimer collects the wall-clock time of the phases, which are
+// measured by ScopedPhase. Unlike clock(), the time is not summed over
+// the threads, so it is the time that the user waits for. The phases
+// are nested by the scopes of the calling thread, and there is one
+// PhaseTimer for the whole process:
+//
+//   {
+//     ScopedPhase read("read");
+//     {
+//       ScopedPhase parse("parse");   /* recorded as "read/parse" */
+//       ...
+//     }
+//   }
+//   for (int n = 0; n < epoch; ++n) {
+//     ScopedPhase phase("epoch");     /* 'epoch' runs of "epoch" */
+//     ...
+//   }
+//   PhaseTimer::Get().PrintSummary();
+//
+// The runs of the same path are added up, and the summary table shows
+// the phases in the order of their first run, indented by depth.
+//------------------------------------------------------------------------------
+class PhaseTimer {
+ public:
+  // The PhaseTimer of current process
+  static PhaseTimer& Get();
+
+  // Add a phase that has not been run, so it keeps its place
+  // in the summary before its children finish
+  void Register(const std::string& path);
+
+  // Add one run of seconds to the phase
+  void Add(const std::string& path, double seconds);
+
+  // Add the rows processed by the phase
+  void AddRows(const std::string& path, uint64 rows);
+
+#ifdef XLEARN_PERF_COUNTERS
+  // Add the hardware events of one run of the phase
+  void AddEvents(const std::string& path, const PerfValues& events);
+#endif
+
+  // The phases in the order of their first run
+  std::vector<PhaseStats> Phases() const;
+
+  // The stats of the phase, or nullptr if it has no run
+  bool Find(const std::string& path, PhaseStats* stats) const;
+
+  // Remove all the phases
+  void Reset();
+
+  // The summary table, in which the share of each phase is
+  // the percentage of the time of its parent
+  std::string Summary() const;
+
+#ifdef XLEARN_PERF_COUNTERS
+  // The table of the hardware events of the phases that counted
+  // them, i.e., IPC and the misses per row. Empty if none
+  std::string CounterSummary() const;
+#endif
+
+  // Print the summary table to the screen and the log
+  void PrintSummary() const;
+
+ protected:
+  mutable std::mutex mutex_;
+  std::vector<PhaseStats> phases_;
+  /* Path -> index of phases_ */
+  std::unordered_map<std::string, size_t> index_;
+
+  // Return the index of the path (adding it if needed).
+  // The caller should hold mutex_
+  size_t find_or_add(const std::string& path);
+};
+
+//------------------------------------------------------------------------------
+// ScopedPhase measures one run of the phase from its construction to
+// Stop() or its destruction. The phase is nested in the phase opened
+// last by the same thread, so the phases should end in reverse order.
+// The run is also a span of the timeline if the TraceLog is open.
+// The hot phases can ask for the hardware events, which are counted
+// only with -DXLEARN_PERF_COUNTERS=ON, and report the rows they
+// processed for the per-row numbers:
+//
+//   ScopedPhase gradient("gradient", true);
+//   ...
+//   gradient.AddRows(num_rows);
+//------------------------------------------------------------------------------
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(const std::string& name,
+                       bool count_events = false);
+  ~ScopedPhase() { Stop(); }
+
+  // Add the rows processed by this run
+  void AddRows(uint64 rows) { rows_ += rows; }
+
+  // End the phase, and return its seconds. The later
+  // calls return the same seconds
+  double Stop();
+
+  // The full path of the phase
+  const std::string& Path() const { return path_; }
+
+ protected:
+  std::string path_;
+  std::chrono::steady_clock::time_point begin_;
+  double seconds_;
+  bool stopped_;
+  uint64 rows_;
+#ifdef XLEARN_PERF_COUNTERS
+  PerfCounter counter_;
+  bool counting_;
+#endif
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedPhase);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_PHASE_TIMER_H_
@@ -0,0 +1,117 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests phase_timer.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/phase_timer.h"
+
+namespace xLearn {
+
+TEST(PhaseTimerTest, Nested) {
+  PhaseTimer& timer = PhaseTimer::Get();
+  timer.Reset();
+  {
+    ScopedPhase train("train");
+    EXPECT_EQ(train.Path(), "train");
+    for (int n = 0; n < 3; ++n) {
+      ScopedPhase epoch("epoch");
+      EXPECT_EQ(epoch.Path(), "train/epoch");
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    ScopedPhase save("save");
+    double seconds = save.Stop();
+    EXPECT_GE(seconds, 0);
+    EXPECT_EQ(save.Stop(), seconds);
+  }
+  // The parent keeps its place before its children
+  std::vector<PhaseStats> phases = timer.Phases();
+  ASSERT_EQ(phases.size(), 3);
+  EXPECT_EQ(phases[0].path, "train");
+  EXPECT_EQ(phases[1].path, "train/epoch");
+  EXPECT_EQ(phases[2].path, "train/save");
+  EXPECT_EQ(phases[0].depth, 0);
+  EXPECT_EQ(phases[1].depth, 1);
+  PhaseStats epoch;
+  ASSERT_TRUE(timer.Find("train/epoch", &epoch));
+  EXPECT_EQ(epoch.count, 3);
+  EXPECT_GE(epoch.total, 0.006);
+  EXPECT_GE(epoch.total, epoch.max);
+  PhaseStats train;
+  ASSERT_TRUE(timer.Find("train", &train));
+  EXPECT_EQ(train.count, 1);
+  EXPECT_GE(train.total, epoch.total);
+  EXPECT_FALSE(timer.Find("epoch", &epoch));
+  // The table has the header and a line for each phase
+  std::string summary = timer.Summary();
+  EXPECT_NE(summary.find("  epoch"), std::string::npos);
+  EXPECT_EQ(std::count(summary.begin(), summary.end(), '\n'), 4);
+  timer.Reset();
+  EXPECT_TRUE(timer.Phases().empty());
+}
+
+TEST(PhaseTimerTest, Threads) {
+  PhaseTimer& timer = PhaseTimer::Get();
+  timer.Reset();
+  ScopedPhase parent("parent");
+  // Each thread has its own nesting
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread([]() {
+      ScopedPhase phase("worker");
+      EXPECT_EQ(phase.Path(), "worker");
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) { threads[i].join(); }
+  parent.Stop();
+  PhaseStats worker;
+  ASSERT_TRUE(timer.Find("worker", &worker));
+  EXPECT_EQ(worker.count, 4);
+  timer.Add("parent/extra", 1.5);
+  PhaseStats extra;
+  ASSERT_TRUE(timer.Find("parent/extra", &extra));
+  EXPECT_EQ(extra.total, 1.5);
+  timer.Reset();
+}
+
+TEST(PhaseTimerTest, Rows) {
+  PhaseTimer& timer = PhaseTimer::Get();
+  timer.Reset();
+  for (int n = 0; n < 2; ++n) {
+    ScopedPhase gradient("gradient", true);
+    gradient.AddRows(100);
+    gradient.AddRows(20);
+  }
+  PhaseStats gradient;
+  ASSERT_TRUE(timer.Find("gradient", &gradient));
+  EXPECT_EQ(gradient.count, 2);
+  EXPECT_EQ(gradient.rows, 240);
+  timer.Reset();
+}
+
+}  // namespace xLearn
@@ -0,0 +1,216 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the resource detection.
+*/
+
+#include "src/base/resource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "src/base/split_string.h"
+
+namespace xLearn {
+
+// The v1 memory limit of no limit is a huge number
+// like 0x7FFFFFFFFFFFF000, so the huge ones are ignored
+static const uint64 kNoMemoryLimit = 1ull << 60;
+
+// Read the small file, and return false if it does not exist
+static bool read_text(const std::string& filename, std::string* text) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) { return false; }
+  char buf[4096];
+  size_t size = fread(buf, 1, sizeof(buf) - 1, file);
+  fclose(file);
+  text->assign(buf, size);
+  return true;
+}
+
+// The path of the cgroup of the controller in the cgroup file, whose
+// lines are "hierarchy-id:controller-list:path". The controller is
+// empty for cgroup v2. Return false if it is not found
+static bool cgroup_path(const std::string& cgroup_file,
+                        const std::string& controller,
+                        std::string* controllers,
+                        std::string* path) {
+  std::string text;
+  if (!read_text(cgroup_file, &text)) { return false; }
+  std::vector<std::string> lines;
+  SplitStringUsing(text, "\n", &lines);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    size_t first = lines[i].find(':');
+    size_t second = lines[i].find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos) {
+      continue;
+    }
+    std::string list = lines[i].substr(first + 1, second - first - 1);
+    std::vector<std::string> names;
+    SplitStringUsing(list, ",", &names);
+    bool match = controller.empty() ? list.empty() : false;
+    for (size_t j = 0; j < names.size(); ++j) {
+      if (names[j] == controller) { match = true; }
+    }
+    if (match) {
+      *controllers = list;
+      *path = lines[i].substr(second + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+// The directories of the cgroup and its ancestors under the mount
+// point base. In a container of its own cgroup namespace, the path
+// is "/" and the mount point is the cgroup of the container
+static std::vector<std::string> cgroup_dirs(const std::string& base,
+                                            const std::string& path) {
+  std::vector<std::string> dirs;
+  std::string dir = path;
+  while (!dir.empty() && dir.back() == '/') { dir.pop_back(); }
+  for (;;) {
+    dirs.push_back(base + dir);
+    size_t pos = dir.rfind('/');
+    if (pos == std::string::npos || dir.empty()) { break; }
+    dir = dir.substr(0, pos);
+  }
+  return dirs;
+}
+
+// The directories of the v2 cgroup, or of the v1 hierarchy of the
+// controller, which is mounted at root/<controller-list> or at
+// root/<controller>
+static std::vector<std::string> limit_dirs(const std::string& cgroup_file,
+                                           const std::string& root,
+                                           const std::string& controller,
+                                           bool* is_v2) {
+  std::string controllers, path;
+  if (cgroup_path(cgroup_file, controller, &controllers, &path)) {
+    *is_v2 = false;
+    std::string base = root + "/" + controllers;
+    std::string text;
+    if (!read_text(base + "/cgroup.procs", &text)) {
+      base = root + "/" + controller;
+    }
+    return cgroup_dirs(base, path);
+  }
+  if (cgroup_path(cgroup_file, "", &controllers, &path)) {
+    *is_v2 = true;
+    return cgroup_dirs(root, path);
+  }
+  return std::vector<std::string>();
+}
+
+double CgroupCpuLimit(const std::string& cgroup_file,
+                      const std::string& root) {
+  bool is_v2 = false;
+  std::vector<std::string> dirs = limit_dirs(cgroup_file, root,
+                                             "cpu", &is_v2);
+  double limit = 0;
+  for (size_t i = 0; i < dirs.size(); ++i) {
+    double quota = -1, period = 0;
+    std::string text;
+    if (is_v2) {
+      // "max 100000" for no limit
+      if (!read_text(dirs[i] + "/cpu.max", &text)) { continue; }
+      std::vector<std::string> items;
+      SplitStringUsing(text, " \n", &items);
+      if (items.size() != 2 || items[0] == "max") { continue; }
+      quota = atof(items[0].c_str());
+      period = atof(items[1].c_str());
+    } else {
+      // The quota -1 for no limit
+      if (!read_text(dirs[i] + "/cpu.cfs_quota_us", &text)) { continue; }
+      quota = atof(text.c_str());
+      if (!read_text(dirs[i] + "/cpu.cfs_period_us", &text)) { continue; }
+      period = atof(text.c_str());
+    }
+    if (quota <= 0 || period <= 0) { continue; }
+    double cpus = quota / period;
+    if (limit == 0 || cpus < limit) { limit = cpus; }
+  }
+  return limit;
+}
+
+uint64 CgroupMemoryLimit(const std::string& cgroup_file,
+                         const std::string& root) {
+  bool is_v2 = false;
+  std::vector<std::string> dirs = limit_dirs(cgroup_file, root,
+                                             "memory", &is_v2);
+  uint64 limit = 0;
+  for (size_t i = 0; i < dirs.size(); ++i) {
+    std::string text;
+    std::string filename = dirs[i] + (is_v2 ? "/memory.max" :
+                                      "/memory.limit_in_bytes");
+    if (!read_text(filename, &text)) { continue; }
+    // "max" for no limit
+    if (text.compare(0, 3, "max") == 0) { continue; }
+    uint64 bytes = strtoull(text.c_str(), nullptr, 10);
+    if (bytes == 0 || bytes >= kNoMemoryLimit) { continue; }
+    if (limit == 0 || bytes < limit) { limit = bytes; }
+  }
+  return limit;
+}
+
+// The limits do not change in the life of the process
+size_t AvailableCpus() {
+  static const size_t num = []() {
+    size_t cpus = std::thread::hardware_concurrency();
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      cpus = CPU_COUNT(&set);
+    }
+#endif
+    double limit = CgroupCpuLimit();
+    if (limit > 0 && std::ceil(limit) < cpus) {
+      cpus = std::ceil(limit);
+    }
+    return cpus > 0 ? cpus : 1;
+  }();
+  return num;
+}
+
+uint64 AvailableMemory() {
+  static const uint64 bytes = []() {
+    uint64 memory = 0;
+#ifdef __linux__
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0) {
+      memory = (uint64)pages * page_size;
+    }
+#endif
+    uint64 limit = CgroupMemoryLimit();
+    if (limit > 0 && (memory == 0 || limit < memory)) { memory = limit; }
+    return memory;
+  }();
+  return bytes;
+}
+
+}  // namespace xLearn
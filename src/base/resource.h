@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file provides the CPUs and the memory that the process can
+use, which are limited by the cgroup of a container.
+*/
+
+#ifndef XLEARN_BASE_RESOURCE_H_
+#define XLEARN_BASE_RESOURCE_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// In a container, the hardware threads and the physical memory are the
+// ones of the host, but the process is throttled by the CPU quota of its
+// cgroup and killed beyond its memory limit. The limits are read from the
+// cgroup v2 files (cpu.max and memory.max), or the cgroup v1 files
+// (cpu.cfs_quota_us, cpu.cfs_period_us and memory.limit_in_bytes), of the
+// cgroup of the process and all of its ancestors:
+//
+//   size_t num_thread = AvailableCpus();  /* e.g., 4 of a 96-core host */
+//   uint64 memory = AvailableMemory();
+//
+// The cgroup of the process is given by /proc/self/cgroup, and the files
+// are under the mount point /sys/fs/cgroup. Both are the arguments of the
+// Cgroup*Limit() functions, which are used by the tests.
+//------------------------------------------------------------------------------
+
+// The CPU limit of the cgroup, e.g., 2.5 for the quota of 250 ms
+// per 100 ms, or 0 for no limit
+double CgroupCpuLimit(const std::string& cgroup_file = "/proc/self/cgroup",
+                      const std::string& root = "/sys/fs/cgroup");
+
+// The memory limit (bytes) of the cgroup, or 0 for no limit
+uint64 CgroupMemoryLimit(const std::string& cgroup_file = "/proc/self/cgroup",
+                         const std::string& root = "/sys/fs/cgroup");
+
+// Number of the CPUs of the affinity mask of the process, bounded
+// by the CPU limit of the cgroup (rounded up), which is at least 1.
+// It is the default number of the threads of xLearn
+size_t AvailableCpus();
+
+// The physical memory (bytes) bounded by the memory limit of the
+// cgroup, or 0 if it is unknown
+uint64 AvailableMemory();
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_RESOURCE_H_
@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests resource.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <thread>
+
+#include "src/base/resource.h"
+
+namespace xLearn {
+
+const std::string kRoot = "/tmp/test_resource_cgroup";
+
+void WriteText(const std::string& filename, const std::string& text) {
+  FILE* file = fopen(filename.c_str(), "w");
+  ASSERT_TRUE(file != nullptr);
+  fputs(text.c_str(), file);
+  fclose(file);
+}
+
+void MakeDir(const std::string& dir) {
+  mkdir(dir.c_str(), 0755);
+}
+
+void RemoveRoot() {
+  std::string cmd = "rm -rf " + kRoot;
+  EXPECT_EQ(system(cmd.c_str()), 0);
+}
+
+TEST(ResourceTest, CgroupV2) {
+  RemoveRoot();
+  MakeDir(kRoot);
+  MakeDir(kRoot + "/pod");
+  MakeDir(kRoot + "/pod/app");
+  WriteText(kRoot + "/cgroup", "0::/pod/app\n");
+  // No limit
+  EXPECT_EQ(CgroupCpuLimit(kRoot + "/cgroup", kRoot), 0);
+  EXPECT_EQ(CgroupMemoryLimit(kRoot + "/cgroup", kRoot), 0);
+  WriteText(kRoot + "/pod/app/cpu.max", "max 100000\n");
+  WriteText(kRoot + "/pod/app/memory.max", "max\n");
+  EXPECT_EQ(CgroupCpuLimit(kRoot + "/cgroup", kRoot), 0);
+  EXPECT_EQ(CgroupMemoryLimit(kRoot + "/cgroup", kRoot), 0);
+  // The limit of the parent applies
+  WriteText(kRoot + "/pod/cpu.max", "400000 100000\n");
+  WriteText(kRoot + "/pod/memory.max", "4294967296\n");
+  EXPECT_DOUBLE_EQ(CgroupCpuLimit(kRoot + "/cgroup", kRoot), 4.0);
+  EXPECT_EQ(CgroupMemoryLimit(kRoot + "/cgroup", kRoot), 4294967296ull);
+  // The smallest limit of the cgroup and its ancestors
+  WriteText(kRoot + "/pod/app/cpu.max", "250000 100000\n");
+  WriteText(kRoot + "/pod/app/memory.max", "1073741824\n");
+  EXPECT_DOUBLE_EQ(CgroupCpuLimit(kRoot + "/cgroup", kRoot), 2.5);
+  EXPECT_EQ(CgroupMemoryLimit(kRoot + "/cgroup", kRoot), 1073741824ull);
+  // The container of its own cgroup namespace
+  WriteText(kRoot + "/cgroup", "0::/\n");
+  WriteText(kRoot + "/cpu.max", "150000 100000\n");
+  EXPECT_DOUBLE_EQ(CgroupCpuLimit(kRoot + "/cgroup", kRoot), 1.5);
+  RemoveRoot();
+}
+
+TEST(ResourceTest, CgroupV1) {
+  RemoveRoot();
+  MakeDir(kRoot);
+  MakeDir(kRoot + "/cpu,cpuacct");
+  MakeDir(kRoot + "/cpu,cpuacct/docker");
+  MakeDir(kRoot + "/memory");
+  WriteText(kRoot + "/cpu,cpuacct/cgroup.procs", "1\n");
+  WriteText(kRoot + "/memory/cgroup.procs", "1\n");
+  WriteText(kRoot + "/cgroup",
+            "5:memory:/docker\n"
+            "3:cpu,cpuacct:/docker\n"
+            "0::/\n");
+  WriteText(kRoot + "/cpu,cpuacct/docker/cpu.cfs_quota_us", "-1\n");
+  WriteText(kRoot + "/cpu,cpuacct/docker/cpu.cfs_period_us", "100000\n");
+  WriteText(kRoot + "/memory/memory.limit_in_bytes",
+            "9223372036854771712\n");
+  EXPECT_EQ(CgroupCpuLimit(kRoot + "/cgroup", kRoot), 0);
+  EXPECT_EQ(CgroupMemoryLimit(kRoot + "/cgroup", kRoot), 0);
+  WriteText(kRoot + "/cpu,cpuacct/docker/cpu.cfs_quota_us", "300000\n");
+  WriteText(kRoot + "/memory/memory.limit_in_bytes", "536870912\n");
+  EXPECT_DOUBLE_EQ(CgroupCpuLimit(kRoot + "/cgroup", kRoot), 3.0);
+  // The cgroup directory /docker is not mounted, and
+  // the limit of the mount point is used
+  EXPECT_EQ(CgroupMemoryLimit(kRoot + "/cgroup", kRoot), 536870912ull);
+  RemoveRoot();
+}
+
+TEST(ResourceTest, NoCgroup) {
+  EXPECT_EQ(CgroupCpuLimit(kRoot + "/no_such_file", kRoot), 0);
+  EXPECT_EQ(CgroupMemoryLimit(kRoot + "/no_such_file", kRoot), 0);
+}
+
+TEST(ResourceTest, Available) {
+  size_t cpus = AvailableCpus();
+  EXPECT_GE(cpus, 1);
+  if (std::thread::hardware_concurrency() > 0) {
+    EXPECT_LE(cpus, std::thread::hardware_concurrency());
+  }
+  EXPECT_EQ(AvailableCpus(), cpus);
+  EXPECT_GT(AvailableMemory(), 0);
+}
+
+}  // namespace xLearn
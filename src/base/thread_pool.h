@@ -34,7 +34,9 @@ pool that used by xLearn.
 #include <functional>
 #include <stdexcept>
 #include <atomic>
+#include <algorithm>
 
+#include "src/base/affinity.h"
 #include "src/base/common.h"
 
 namespace xLearn {
@@ -46,70 +48,268 @@ namespace xLearn {
 //  This class requires a number of c++11 features be present in your compiler.
 //
 //                         master_thread
-//                      /       |         \
-//                     /        |          \
+//                      /       |         \ .
+//                     /        |          \ .
 //                thread_1    thread_2    thread_3
 //                   |           |           |
 //                    \          |           /
 //                     \         |          /
 //                       \       |        /
 //                         master_thread
+//
+//  Sync() waits until all the enqueued tasks have been done, and any number of
+//  tasks can be enqueued between two Sync(). The master thread spins for a
+//  short while (which catches the small batches without a context switch) and
+//  then blocks on a condition variable, so it does not steal a core from the
+//  workers when the batch is long or the host is oversubscribed.
+//
+//  ParallelFor() runs a loop over [begin, end) on the persistent workers
+//  without any allocation per call, and it returns after the whole loop is
+//  done. The fn is invoked as fn(thread_id, start, end) on sub-ranges:
+//
+//    /* static: one contiguous range for each of the N workers */
+//    pool.ParallelFor(0, row_len, 0,
+//      [&](size_t id, size_t start, size_t end) { ... });
+//
+//    /* dynamic: the workers fetch chunks of 64 rows */
+//    pool.ParallelFor(0, row_len, 64,
+//      [&](size_t id, size_t start, size_t end) { ... });
+//
+//    /* work-stealing: each worker takes chunks of 64 rows from its own
+//     static range, and then steals the back half of the range of the
+//     other workers. So the rows of each worker stay contiguous, and the
+//     skewed cost of the rows does not leave one worker finishing last */
+//    pool.ParallelFor(0, row_len, 64,
+//      [&](size_t id, size_t start, size_t end) { ... }, kScheduleSteal);
+//
+//  The schedule of the dynamic chunks and work-stealing picks the grain
+//  by itself if the grain is 0.
+//
+//  If the cost of the items is not even, the static range and the first
+//  range of work-stealing of each worker can have the same cost instead
+//  of the same number of items, where cost[i] is the total cost of the
+//  items [0, i) (e.g., DMatrix::row_cost):
+//
+//    pool.ParallelFor(0, row_len, 0, fn, kScheduleStatic, cost);
+//
+//  The thread_id is in [0, N), so fn can use per-thread state. The empty
+//  ranges are skipped. It must be invoked by one master thread at a time.
+//
+//  The workers can be pinned to a set of CPUs (see affinity.h), and the
+//  worker i runs on cpus[i % cpus.size()]:
+//
+//    ThreadPool pool(4, cpus);
+//
+//  The pool can be shared by several subsystems (see executor.h). The loop
+//  of ParallelFor() only waits for itself, and the tasks have a priority.
+//  The workers run the loop first, then the compute tasks, and then the
+//  I/O tasks such as the parsing of the prefetch thread, which should not
+//  delay the training:
+//
+//    auto res = pool.enqueue_priority(kPriorityIO, parse, chunk);
+//    res.get();   /* wait for this task only */
 //------------------------------------------------------------------------------
+enum Schedule {
+  kScheduleStatic = 0,   /* one range of each worker */
+  kScheduleDynamic = 1,  /* chunks from a shared counter */
+  kScheduleSteal = 2     /* chunks from own range, then steal */
+};
+
+enum Priority {
+  kPriorityCompute = 0,  /* the tasks that the trainer waits for */
+  kPriorityIO = 1,       /* the background tasks, like prefetch */
+  kNumPriority = 2
+};
+
 class ThreadPool {
  public:
   // Constructor and Destructor
-  ThreadPool(size_t);
+  ThreadPool(size_t, const std::vector<int>& cpus = std::vector<int>());
   ~ThreadPool();
 
   // Add task to current queue
   template<class F, class... Args>
   auto enqueue(F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+    return enqueue_priority(kPriorityCompute, std::forward<F>(f),
+                            std::forward<Args>(args)...);
+  }
+
+  // Add task to the queue of the priority
+  template<class F, class... Args>
+  auto enqueue_priority(Priority priority, F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type>;
 
-  // Sync threads
+  // Wait until all the enqueued tasks are done
   void Sync();
 
+  // Run fn over [begin, end) and wait for it. The grain 0 means
+  // static partition, otherwise the chunks of grain are dynamic
+  template<class F>
+  void ParallelFor(size_t begin, size_t end, size_t grain, const F& fn) {
+    ParallelFor(begin, end, grain, fn,
+                grain == 0 ? kScheduleStatic : kScheduleDynamic);
+  }
+
+  // Run fn over [begin, end) by the schedule. The ranges of
+  // the workers are split by the prefix sum of cost if it is
+  // not nullptr, which has at least end + 1 items
+  template<class F>
+  void ParallelFor(size_t begin, size_t end, size_t grain,
+                   const F& fn, Schedule schedule,
+                   const uint64* cost = nullptr);
+
+  // Number of workers
+  inline size_t size() const { return workers.size(); }
+
+  // Bytes of the pool and of the per-worker structures,
+  // excluding the stacks of the workers
+  inline uint64 MemorySize() const {
+    size_t num = workers.size();
+    return sizeof(ThreadPool) +
+           num * (sizeof(std::thread) + sizeof(StealRange)) +
+           (num + 1) * sizeof(size_t);
+  }
+
 private:
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
+    // the task queue of each priority
+    std::queue< std::function<void()> > tasks[kNumPriority];
 
     // synchronization
     std::mutex queue_mutex;
     std::condition_variable condition;
     bool stop;
-    std::atomic_int sync { 0 };
+    // number of tasks that are enqueued but not done
+    std::atomic_int pending { 0 };
+    std::mutex done_mutex;
+    std::condition_variable done_condition;
+    // number of workers that have not finished the loop
+    std::atomic_int job_pending { 0 };
+    // one loop of ParallelFor() at a time
+    std::mutex job_mutex;
+
+    // the loop of ParallelFor(), which is published by
+    // increasing job_id under queue_mutex
+    size_t job_id { 0 };
+    size_t job_begin { 0 };
+    size_t job_end { 0 };
+    size_t job_grain { 0 };
+    Schedule job_schedule { kScheduleStatic };
+    std::atomic<size_t> job_next { 0 };
+    const void* job_fn { nullptr };
+    void (*job_call)(const void*, size_t, size_t, size_t) { nullptr };
+
+    // the remaining range of each worker in work-stealing,
+    // which is allocated in the constructor
+    struct StealRange {
+      std::mutex lock;
+      size_t begin;
+      size_t end;
+    };
+    std::unique_ptr<StealRange[]> steal_range;
+
+    // the first item of the range of each worker and the end of the
+    // loop, which are split by the cost, or nullptr for the even split
+    std::unique_ptr<size_t[]> job_bound;
+    const uint64* job_cost { nullptr };
+
+    // split [begin, end) into the ranges of the same cost
+    void split_cost(size_t begin, size_t end, const uint64* cost);
+
+    // the range of worker id in the static partition
+    void static_range(size_t id, size_t* start, size_t* end) const;
+
+    // the range of worker id in the loop
+    void run_job(size_t id);
+
+    // true if any task is in the queues
+    bool has_task() const {
+      for (int p = 0; p < kNumPriority; ++p) {
+        if (!tasks[p].empty()) { return true; }
+      }
+      return false;
+    }
+
+    // spin-then-block until the counter is 0
+    void wait_zero(const std::atomic_int& counter);
+
+    // take a chunk from the front of own range
+    bool pop_chunk(size_t id, size_t* start, size_t* end);
+
+    // move the back half of another range into own range
+    bool steal_chunk(size_t id);
+
+    template<class F>
+    static void call_fn(const void* fn, size_t id,
+                        size_t start, size_t end) {
+      (*static_cast<const F*>(fn))(id, start, end);
+    }
 };
 
+// Number of polls before Sync() blocks
+const int kSyncSpinCount = 2000;
+
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads)
-    : stop(false) {
+inline ThreadPool::ThreadPool(size_t threads, const std::vector<int>& cpus)
+    : stop(false), steal_range(new StealRange[threads]),
+      job_bound(new size_t[threads + 1]) {
   for(size_t i = 0; i<threads; ++i)
     workers.emplace_back(
-      [this]
+      [this, i]
       {
+        size_t seen_job = 0;
         for(;;) {
             std::function<void()> task;
             {
               std::unique_lock<std::mutex> lock(this->queue_mutex);
               this->condition.wait(lock,
-                [this]{ return this->stop || !this->tasks.empty(); });
-              if(this->stop && this->tasks.empty())
-                return;
-              task = std::move(this->tasks.front());
-              this->tasks.pop();
+                [this, &seen_job]{ return this->stop ||
+                                          this->has_task() ||
+                                          this->job_id != seen_job; });
+              if (this->job_id != seen_job) {
+                seen_job = this->job_id;
+              } else {
+                if(this->stop && !this->has_task())
+                  return;
+                for (int p = 0; p < kNumPriority; ++p) {
+                  if (this->tasks[p].empty()) { continue; }
+                  task = std::move(this->tasks[p].front());
+                  this->tasks[p].pop();
+                  break;
+                }
+              }
             }
-         task();
-         sync++;
+         bool done = false;
+         if (task) {
+           task();
+         } else {
+           this->run_job(i);
+           done = (--this->job_pending == 0);
+         }
+         // The lock makes sure that the notification is
+         // not lost between the check and wait of Sync()
+         if ((--this->pending == 0) || done) {
+           std::lock_guard<std::mutex> lock(this->done_mutex);
+           this->done_condition.notify_all();
+         }
       }
     }
   );
+  if (!cpus.empty()) {
+    for (size_t i = 0; i < workers.size(); ++i) {
+      if (!PinThread(&workers[i], cpus[i % cpus.size()])) {
+        LOG(WARNING) << "Cannot pin the thread to cpu "
+                     << cpus[i % cpus.size()];
+      }
+    }
+  }
 }
 
 // add new work item to the pool
 template<class F, class... Args>
-auto ThreadPool::enqueue(F&& f, Args&&... args)
+auto ThreadPool::enqueue_priority(Priority priority, F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type>
 {
     using return_type = typename std::result_of<F(Args...)>::type;
@@ -126,16 +326,154 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
         if(stop)
             throw std::runtime_error("enqueue on stopped ThreadPool");
 
-        tasks.emplace([task](){ (*task)(); });
+        tasks[priority].emplace([task](){ (*task)(); });
+        pending++;
     }
     condition.notify_one();
     return res;
 }
 
-// Wait all thread to finish their jobs
+// Spin-then-block, and the yield gives the core to the
+// workers while spinning
 inline void ThreadPool::Sync() {
-  while (sync != workers.size()) {}
-  sync = 0;
+  wait_zero(pending);
+}
+
+inline void ThreadPool::wait_zero(const std::atomic_int& counter) {
+  for (int i = 0; i < kSyncSpinCount; ++i) {
+    if (counter == 0) { return; }
+    std::this_thread::yield();
+  }
+  std::unique_lock<std::mutex> lock(done_mutex);
+  done_condition.wait(lock, [&counter]{ return counter == 0; });
+}
+
+template<class F>
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain,
+                             const F& fn, Schedule schedule,
+                             const uint64* cost) {
+  if (end <= begin) { return; }
+  size_t num = workers.size();
+  if (grain == 0 && schedule != kScheduleStatic) {
+    grain = std::max((end - begin) / (num * 16), (size_t)1);
+  }
+  std::lock_guard<std::mutex> job_lock(job_mutex);
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    job_begin = begin;
+    job_end = end;
+    job_grain = grain;
+    job_schedule = schedule;
+    job_next = begin;
+    job_fn = &fn;
+    job_call = &call_fn<F>;
+    job_cost = schedule == kScheduleDynamic ? nullptr : cost;
+    if (job_cost != nullptr) { split_cost(begin, end, job_cost); }
+    if (schedule == kScheduleSteal) {
+      for (size_t t = 0; t < num; ++t) {
+        static_range(t, &steal_range[t].begin, &steal_range[t].end);
+      }
+    }
+    // Each worker counts as one task
+    pending += num;
+    job_pending = num;
+    job_id++;
+  }
+  condition.notify_all();
+  wait_zero(job_pending);
+}
+
+// The static range of each worker is balanced
+// within one row
+inline void ThreadPool::static_range(size_t id, size_t* start,
+                                     size_t* end) const {
+  if (job_cost != nullptr) {
+    *start = job_bound[id];
+    *end = job_bound[id + 1];
+    return;
+  }
+  size_t count = job_end - job_begin;
+  size_t num = workers.size();
+  *start = job_begin + count * id / num;
+  *end = job_begin + count * (id + 1) / num;
+}
+
+// The worker t starts from the first item whose prefix
+// cost reaches t / num of the total cost
+inline void ThreadPool::split_cost(size_t begin, size_t end,
+                                   const uint64* cost) {
+  size_t num = workers.size();
+  uint64 base = cost[begin];
+  uint64 total = cost[end] - base;
+  job_bound[0] = begin;
+  for (size_t t = 1; t < num; ++t) {
+    uint64 target = base + (uint64)((double)total * t / num);
+    size_t pos = std::lower_bound(cost + job_bound[t-1], cost + end,
+                                  target) - cost;
+    job_bound[t] = std::min(pos, end);
+  }
+  job_bound[num] = end;
+}
+
+inline void ThreadPool::run_job(size_t id) {
+  if (job_schedule == kScheduleStatic) {
+    size_t start = 0, end = 0;
+    static_range(id, &start, &end);
+    if (start < end) { job_call(job_fn, id, start, end); }
+    return;
+  }
+  if (job_schedule == kScheduleDynamic) {
+    for (;;) {
+      size_t start = job_next.fetch_add(job_grain);
+      if (start >= job_end) { break; }
+      job_call(job_fn, id, start, std::min(start + job_grain, job_end));
+    }
+    return;
+  }
+  size_t start = 0, end = 0;
+  for (;;) {
+    if (pop_chunk(id, &start, &end)) {
+      job_call(job_fn, id, start, end);
+    } else if (!steal_chunk(id)) {
+      break;
+    }
+  }
+}
+
+inline bool ThreadPool::pop_chunk(size_t id, size_t* start, size_t* end) {
+  StealRange& own = steal_range[id];
+  std::lock_guard<std::mutex> lock(own.lock);
+  if (own.begin >= own.end) { return false; }
+  *start = own.begin;
+  *end = std::min(own.begin + job_grain, own.end);
+  own.begin = *end;
+  return true;
+}
+
+// Only one lock is held at a time, and the range is
+// empty for other thieves until it is set
+inline bool ThreadPool::steal_chunk(size_t id) {
+  size_t num = workers.size();
+  for (size_t k = 1; k < num; ++k) {
+    StealRange& victim = steal_range[(id + k) % num];
+    size_t begin = 0, end = 0;
+    {
+      std::lock_guard<std::mutex> lock(victim.lock);
+      if (victim.begin >= victim.end) { continue; }
+      size_t remain = victim.end - victim.begin;
+      // Take all of the last chunk
+      begin = remain <= job_grain ? victim.begin
+                                  : victim.end - remain / 2;
+      end = victim.end;
+      victim.end = begin;
+    }
+    StealRange& own = steal_range[id];
+    std::lock_guard<std::mutex> lock(own.lock);
+    own.begin = begin;
+    own.end = end;
+    return true;
+  }
+  return false;
 }
 
 // the destructor joins all threads
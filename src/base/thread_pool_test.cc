@@ -70,4 +70,140 @@ TEST(ThreadPoolTest, Sum_test) {
   EXPECT_EQ(sum, 75);
 }
 
+// More tasks than workers, and the long tasks make
+// Sync() block after spinning
+TEST(ThreadPoolTest, Many_task_test) {
+  ThreadPool pool(3);
+  std::atomic_int count(0);
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 100; ++j) {
+      pool.enqueue([&count, j]() {
+        if (j % 10 == 0) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        count++;
+      });
+    }
+    pool.Sync();
+    EXPECT_EQ(count, (i + 1) * 100);
+  }
+  // Sync() returns at once without any task
+  pool.Sync();
+  EXPECT_EQ(count, 400);
+}
+
+TEST(ThreadPoolTest, ParallelFor_test) {
+  ThreadPool pool(3);
+  EXPECT_EQ(pool.size(), 3);
+  Schedule schedule[] = { kScheduleStatic,
+                          kScheduleDynamic,
+                          kScheduleSteal };
+  for (int s = 0; s < 3; ++s) {
+    for (size_t grain = 0; grain < 5; ++grain) {
+      for (size_t len = 0; len < 40; ++len) {
+        std::vector<int> hit(len + 3, 0);
+        std::vector<int> chunk(pool.size(), 0);
+        pool.ParallelFor(3, len + 3, grain,
+          [&](size_t id, size_t start, size_t end) {
+            ASSERT_LT(id, 3);
+            ASSERT_LT(start, end);
+            if (grain > 0 && s > 0) { ASSERT_LE(end - start, grain); }
+            chunk[id]++;
+            for (size_t i = start; i < end; ++i) { hit[i]++; }
+          }, schedule[s]);
+        // Each row is visited once
+        for (size_t i = 0; i < hit.size(); ++i) {
+          EXPECT_EQ(hit[i], i < 3 ? 0 : 1);
+        }
+        // At most one static range of each thread
+        if (s == 0) {
+          for (size_t t = 0; t < chunk.size(); ++t) {
+            EXPECT_LE(chunk[t], 1);
+          }
+        }
+      }
+    }
+  }
+  // The loop and the tasks can be mixed
+  int count = 0;
+  pool.enqueue([&count]() { count++; });
+  pool.Sync();
+  pool.ParallelFor(0, 10, 1,
+    [&](size_t id, size_t start, size_t end) { });
+  EXPECT_EQ(count, 1);
+}
+
+// The rows of the first worker are much more costly, and
+// they are stolen by the other workers
+TEST(ThreadPoolTest, Steal_test) {
+  ThreadPool pool(2);
+  std::vector<int> owner(40, -1);
+  pool.ParallelFor(0, 40, 1,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) {
+        owner[i] = id;
+        if (i < 20) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+      }
+    }, kScheduleSteal);
+  int stolen = 0;
+  for (size_t i = 0; i < 20; ++i) {
+    ASSERT_NE(owner[i], -1);
+    if (owner[i] == 1) { stolen++; }
+  }
+  EXPECT_GT(stolen, 0);
+}
+
+// The compute tasks run before the I/O tasks
+TEST(ThreadPoolTest, Priority_test) {
+  ThreadPool pool(1);
+  std::atomic<bool> release(false);
+  std::vector<int> order;
+  // Block the worker until all the tasks are enqueued
+  auto blocker = pool.enqueue([&release]() {
+    while (!release) { std::this_thread::yield(); }
+  });
+  auto io = pool.enqueue_priority(kPriorityIO,
+                                  [&order]() { order.push_back(1); });
+  auto compute = pool.enqueue([&order]() { order.push_back(0); });
+  release = true;
+  blocker.get();
+  io.get();
+  compute.get();
+  ASSERT_EQ(order.size(), 2);
+  EXPECT_EQ(order[0], 0);
+  EXPECT_EQ(order[1], 1);
+}
+
+// The static ranges are split by the cost of the items
+TEST(ThreadPoolTest, Cost_test) {
+  ThreadPool pool(2);
+  const size_t kItem = 100;
+  // The first 10 items are 100 times heavier
+  std::vector<uint64> cost(kItem + 1, 0);
+  for (size_t i = 0; i < kItem; ++i) {
+    cost[i+1] = cost[i] + (i < 10 ? 100 : 1);
+  }
+  std::vector<int> owner(kItem, -1);
+  pool.ParallelFor(0, kItem, 0,
+    [&owner](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) { owner[i] = id; }
+    }, kScheduleStatic, cost.data());
+  // The prefix cost of item 6 is 600 >= 1090 / 2
+  for (size_t i = 0; i < kItem; ++i) {
+    EXPECT_EQ(owner[i], i < 6 ? 0 : 1);
+  }
+  // The sub-range and the work-stealing
+  std::vector<std::atomic<int> > count(kItem);
+  for (size_t i = 0; i < kItem; ++i) { count[i] = 0; }
+  pool.ParallelFor(3, 90, 4,
+    [&count](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) { count[i]++; }
+    }, kScheduleSteal, cost.data());
+  for (size_t i = 0; i < kItem; ++i) {
+    EXPECT_EQ(count[i], (i >= 3 && i < 90) ? 1 : 0);
+  }
+}
+
 }  // namespace xLearn
@@ -0,0 +1,140 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of trace.h
+*/
+
+#include "src/base/trace.h"
+
+#include "src/base/json_writer.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+std::atomic<bool> TraceLog::enabled_(false);
+
+const size_t TraceLog::kMaxEvents;
+
+TraceLog& TraceLog::Get() {
+  static TraceLog trace;
+  return trace;
+}
+
+// The ids are given in the order that the threads
+// add their first event or name
+int TraceLog::thread_id() {
+  static std::atomic<int> next_id(0);
+  static thread_local int id = -1;
+  if (id < 0) { id = next_id++; }
+  return id;
+}
+
+bool TraceLog::Open(const std::string& filename) {
+  Close();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_ = fopen(filename.c_str(), "w");
+    if (file_ == nullptr) { return false; }
+    origin_ = clock::now();
+    events_.clear();
+    threads_.clear();
+    dropped_ = 0;
+    session_++;
+  }
+  enabled_ = true;
+  NameThread("main");
+  return true;
+}
+
+void TraceLog::AddComplete(const std::string& name, const char* category,
+                           clock::time_point begin, clock::time_point end) {
+  int tid = thread_id();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == nullptr) { return; }
+  if (events_.size() >= kMaxEvents) {
+    dropped_++;
+    return;
+  }
+  Event event;
+  event.name = name;
+  event.category = category;
+  event.tid = tid;
+  event.ts = std::chrono::duration<double, std::micro>(
+               begin - origin_).count();
+  event.dur = std::chrono::duration<double, std::micro>(
+                end - begin).count();
+  events_.push_back(event);
+}
+
+void TraceLog::NameThread(const std::string& name, int index) {
+  // The thread is named again in the next Open()
+  static thread_local int named_session = -1;
+  if (!Enabled() || named_session == session_) { return; }
+  named_session = session_;
+  std::string thread_name = name;
+  if (index >= 0) { StringAppendF(&thread_name, " %d", index); }
+  int tid = thread_id();
+  std::lock_guard<std::mutex> lock(mutex_);
+  threads_.push_back(std::make_pair(tid, thread_name));
+}
+
+size_t TraceLog::NumEvents() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return events_.size();
+}
+
+uint64 TraceLog::NumDropped() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+// The events are written one per line, so the large
+// trace can be read by the line-based tools
+void TraceLog::Close() {
+  enabled_ = false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == nullptr) { return; }
+  fprintf(file_, "{\"traceEvents\":[\n");
+  bool first = true;
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    fprintf(file_, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+            "\"pid\":1,\"tid\":%d,\"args\":{\"name\":%s}}",
+            first ? "" : ",\n", threads_[i].first,
+            JsonString(threads_[i].second).c_str());
+    first = false;
+  }
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const Event& e = events_[i];
+    fprintf(file_, "%s{\"name\":%s,\"cat\":\"%s\",\"ph\":\"X\","
+            "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+            first ? "" : ",\n", JsonString(e.name).c_str(),
+            e.category, e.ts, e.dur, e.tid);
+    first = false;
+  }
+  fprintf(file_, "\n],\"displayTimeUnit\":\"ms\","
+          "\"otherData\":{\"dropped_events\":%llu}}\n",
+          (unsigned long long)dropped_);
+  fclose(file_);
+  file_ = nullptr;
+  std::vector<Event>().swap(events_);
+  threads_.clear();
+}
+
+}  // namespace xLearn
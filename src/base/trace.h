@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the TraceLog class and the ScopedTrace class,
+which record the timeline of the threads of xLearn in the Chrome
+trace format, which can be opened by chrome://tracing or Perfetto.
+*/
+
+#ifndef XLEARN_BASE_TRACE_H_
+#define XLEARN_BASE_TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// TraceLog collects the events of all the threads of the process, and
+// writes them to a JSON file of the Chrome trace format in Close(). Each
+// event is a span of one thread, and the threads can be named so the
+// timeline shows the main thread, the workers and the prefetch thread:
+//
+//   TraceLog::Get().Open("xlearn.trace.json");
+//   {
+//     ScopedTrace trace("read block", "reader");
+//     ...
+//   }
+//   TraceLog::Get().Close();
+//
+// The events are dropped if no file is open, in which case a ScopedTrace
+// only checks one atomic flag. The events are kept in memory until
+// Close(), and at most kMaxEvents of them are kept.
+//------------------------------------------------------------------------------
+class TraceLog {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  // The TraceLog of current process
+  static TraceLog& Get();
+
+  // True if the events are recorded
+  static bool Enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Start to record the events for the file, which is created
+  // here. The calling thread is named "main"
+  bool Open(const std::string& filename);
+
+  // Write the events to the file, and stop recording
+  void Close();
+
+  // Add a span from begin to end of current thread
+  void AddComplete(const std::string& name, const char* category,
+                   clock::time_point begin, clock::time_point end);
+
+  // Name current thread, e.g., NameThread("worker", 2) gives
+  // "worker 2". The thread keeps the first name it is given
+  // after Open()
+  void NameThread(const std::string& name, int index = -1);
+
+  // Number of the events recorded, and the dropped ones
+  size_t NumEvents() const;
+  uint64 NumDropped() const;
+
+  static const size_t kMaxEvents = 1 << 22;
+
+ protected:
+  struct Event {
+    std::string name;
+    const char* category;
+    int tid;
+    /* Microseconds from Open() */
+    double ts;
+    double dur;
+  };
+
+  static std::atomic<bool> enabled_;
+
+  mutable std::mutex mutex_;
+  FILE* file_ = nullptr;
+  clock::time_point origin_;
+  std::vector<Event> events_;
+  /* tid -> name of the named threads */
+  std::vector<std::pair<int, std::string> > threads_;
+  uint64 dropped_ = 0;
+  /* Number of Open(), by which the threads are named once per file */
+  std::atomic<int> session_{0};
+
+  // The trace id of current thread
+  static int thread_id();
+};
+
+//------------------------------------------------------------------------------
+// ScopedTrace records a span of current thread from its construction to
+// its destruction, if the TraceLog is enabled at the construction:
+//
+//   ScopedTrace trace("wait for prefetch", "reader");
+//------------------------------------------------------------------------------
+class ScopedTrace {
+ public:
+  ScopedTrace(const char* name, const char* category)
+    : name_(name), category_(category),
+      enabled_(TraceLog::Enabled()) {
+    if (enabled_) { begin_ = TraceLog::clock::now(); }
+  }
+
+  ~ScopedTrace() {
+    if (enabled_) {
+      TraceLog::Get().AddComplete(name_, category_, begin_,
+                                  TraceLog::clock::now());
+    }
+  }
+
+ protected:
+  const char* name_;
+  const char* category_;
+  bool enabled_;
+  TraceLog::clock::time_point begin_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedTrace);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_BASE_TRACE_H_
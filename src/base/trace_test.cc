@@ -0,0 +1,111 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests trace.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "src/base/trace.h"
+#include "src/base/phase_timer.h"
+
+namespace xLearn {
+
+static std::string read_file(const std::string& filename) {
+  std::ifstream in(filename);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+static int count(const std::string& str, const std::string& sub) {
+  int num = 0;
+  for (size_t pos = str.find(sub); pos != std::string::npos;
+       pos = str.find(sub, pos + 1)) {
+    num++;
+  }
+  return num;
+}
+
+TEST(TraceTest, Disabled) {
+  EXPECT_FALSE(TraceLog::Enabled());
+  {
+    ScopedTrace trace("nothing", "test");
+  }
+  EXPECT_EQ(TraceLog::Get().NumEvents(), 0);
+}
+
+TEST(TraceTest, Events) {
+  std::string filename = "/tmp/xlearn_trace_test.json";
+  ASSERT_TRUE(TraceLog::Get().Open(filename));
+  EXPECT_TRUE(TraceLog::Enabled());
+  {
+    ScopedTrace trace("span", "test");
+  }
+  {
+    ScopedPhase phase("phase");
+  }
+  std::thread worker([]() {
+    TraceLog::Get().NameThread("worker", 3);
+    TraceLog::Get().NameThread("other");
+    ScopedTrace trace("task", "worker");
+  });
+  worker.join();
+  EXPECT_EQ(TraceLog::Get().NumEvents(), 3);
+  EXPECT_EQ(TraceLog::Get().NumDropped(), 0);
+  TraceLog::Get().Close();
+  EXPECT_FALSE(TraceLog::Enabled());
+  {
+    ScopedTrace trace("after close", "test");
+  }
+  std::string json = read_file(filename);
+  EXPECT_EQ(json.find("{\"traceEvents\":["), 0);
+  EXPECT_EQ(count(json, "\"ph\":\"X\""), 3);
+  EXPECT_EQ(count(json, "\"ph\":\"M\""), 2);
+  EXPECT_NE(json.find("{\"name\":\"main\"}"), std::string::npos);
+  EXPECT_NE(json.find("{\"name\":\"worker 3\"}"), std::string::npos);
+  EXPECT_EQ(json.find("{\"name\":\"other\"}"), std::string::npos);
+  EXPECT_NE(json.find("\"name\":\"phase\",\"cat\":\"phase\""),
+            std::string::npos);
+  EXPECT_NE(json.find("\"name\":\"task\",\"cat\":\"worker\""),
+            std::string::npos);
+  EXPECT_EQ(json.find("after close"), std::string::npos);
+  // The threads are named again in a new file
+  ASSERT_TRUE(TraceLog::Get().Open(filename));
+  EXPECT_EQ(TraceLog::Get().NumEvents(), 0);
+  TraceLog::Get().Close();
+  json = read_file(filename);
+  EXPECT_NE(json.find("{\"name\":\"main\"}"), std::string::npos);
+  remove(filename.c_str());
+}
+
+TEST(TraceTest, OpenFail) {
+  EXPECT_FALSE(TraceLog::Get().Open("/not/exist/dir/trace.json"));
+  EXPECT_FALSE(TraceLog::Enabled());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,333 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the C API of xLearn.
+*/
+
+#include "src/c_api/c_api.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/math_kernel.h"
+#include "src/base/stringprintf.h"
+#include "src/data/data_structure.h"
+#include "src/data/feature_map.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_function.h"
+#include "src/score/fm_score.h"
+#include "src/score/ffm_score.h"
+
+using xLearn::FFMContext;
+using xLearn::FFMScore;
+using xLearn::FMContext;
+using xLearn::FMScore;
+using xLearn::FeatureMap;
+using xLearn::GetMathKernel;
+using xLearn::Model;
+using xLearn::Node;
+using xLearn::RowView;
+using xLearn::Score;
+using xLearn::index_t;
+using xLearn::real_t;
+
+// The nodes of the caller are used as the Node of xLearn
+// without any copy
+static_assert(sizeof(XLearnNode) == sizeof(Node) &&
+              offsetof(XLearnNode, field) == offsetof(Node, field_id) &&
+              offsetof(XLearnNode, feat) == offsetof(Node, feat_id) &&
+              offsetof(XLearnNode, value) == offsetof(Node, feat_val),
+              "XLearnNode should have the layout of Node");
+
+// How the score of a row is returned
+enum Transform {
+  kTransformRaw,
+  kTransformSigmoid,
+  kTransformSign
+};
+
+// All the states of an opened model
+struct XLearnModel {
+  XLearnModel() : score(nullptr), has_map(false),
+                  norm(true), transform(kTransformRaw),
+                  num_feat(0), num_field(0) { }
+  ~XLearnModel() { delete score; }
+
+  Model model;
+  Score* score;
+  /* The feature map of the model trained with --remap */
+  FeatureMap map;
+  bool has_map;
+  /* The instance-wise normalization of the row */
+  bool norm;
+  Transform transform;
+  /* The nodes of the features out of the model are ignored */
+  index_t num_feat;
+  index_t num_field;
+};
+
+namespace xLearn {
+
+// Create the score of the model, and the score specialized
+// on the aligned K of the model is used if it exists
+static Score* create_score(Model& model) {
+  const std::string& score_func = model.GetScoreFunction();
+  Score* score = nullptr;
+  if (score_func.compare("fm") == 0 ||
+      score_func.compare("ffm") == 0 ||
+      score_func.compare("hofm") == 0) {
+    std::string name = StringPrintf("%s_k%d", score_func.c_str(),
+                                    model.get_aligned_k());
+    score = CREATE_SCORE(name.c_str());
+  }
+  if (score == nullptr &&
+      (score_func.compare("linear") == 0 ||
+       score_func.compare("fm") == 0 ||
+       score_func.compare("ffm") == 0 ||
+       score_func.compare("hofm") == 0)) {
+    score = CREATE_SCORE(score_func.c_str());
+  }
+  return score;
+}
+
+} // namespace xLearn
+
+int XLearnOpenModel(const char* filename, int flags, XLearnHandle* handle) {
+  if (filename == nullptr || handle == nullptr) {
+    return XLEARN_ERR_ARGUMENT;
+  }
+  if (!FileExist(filename)) { return XLEARN_ERR_OPEN; }
+  XLearnModel* xl = new XLearnModel();
+  if (!xl->model.MapFile(filename)) {
+    delete xl;
+    return XLEARN_ERR_FORMAT;
+  }
+  xl->score = xLearn::create_score(xl->model);
+  if (xl->score == nullptr) {
+    delete xl;
+    return XLEARN_ERR_FORMAT;
+  }
+  xl->score->Initialize(0, 0, &xl->model);
+  std::string dict_file = std::string(filename) + ".dict";
+  if (FileExist(dict_file.c_str())) {
+    if (!xl->map.Deserialize(dict_file) ||
+        xl->map.Size() != xl->model.GetNumFeature()) {
+      delete xl;
+      return XLEARN_ERR_DICT;
+    }
+    xl->map.Freeze();
+    xl->has_map = true;
+  }
+  xl->norm = (flags & XLEARN_NO_NORM) == 0;
+  const std::string& loss_func = xl->model.GetLossFunction();
+  if ((flags & XLEARN_RAW_SCORE) != 0) {
+    xl->transform = kTransformRaw;
+  } else if (loss_func.compare("cross-entropy") == 0) {
+    xl->transform = kTransformSigmoid;
+  } else if (loss_func.compare("hinge") == 0) {
+    xl->transform = kTransformSign;
+  }
+  xl->num_feat = xl->model.GetNumFeature();
+  xl->num_field = xl->model.GetScoreFunction().compare("ffm") == 0 ?
+                  xl->model.GetNumField() : ~(index_t)0;
+  *handle = xl;
+  return XLEARN_OK;
+}
+
+void XLearnCloseModel(XLearnHandle handle) {
+  delete handle;
+}
+
+// The nodes of the features out of the model are dropped, and
+// the raw ids are re-indexed by the feature map. The nodes are
+// copied into the buffer only in this case
+static RowView valid_row(XLearnModel* xl,
+                         const XLearnNode* begin,
+                         const XLearnNode* end,
+                         std::vector<Node>* buffer) {
+  const Node* row_begin = reinterpret_cast<const Node*>(begin);
+  const Node* row_end = reinterpret_cast<const Node*>(end);
+  bool valid = !xl->has_map;
+  for (const Node* n = row_begin; valid && n < row_end; ++n) {
+    valid = n->feat_id < xl->num_feat && n->field_id < xl->num_field;
+  }
+  if (valid) { return RowView(row_begin, row_end); }
+  buffer->clear();
+  for (const Node* n = row_begin; n < row_end; ++n) {
+    Node node = *n;
+    if (xl->has_map) {
+      if (!xl->map.Map(n->feat_id, &node.feat_id)) { continue; }
+    }
+    if (node.feat_id >= xl->num_feat ||
+        node.field_id >= xl->num_field) { continue; }
+    buffer->push_back(node);
+  }
+  return RowView(buffer->data(), buffer->data() + buffer->size());
+}
+
+// The sum of x * x of the row, and the normalization of the
+// row is 1 / sum_sqr, which is the same as the parser
+static real_t sum_sqr(const XLearnNode* begin, const XLearnNode* end) {
+  real_t sum = 0;
+  for (const XLearnNode* n = begin; n < end; ++n) {
+    sum += n->value * n->value;
+  }
+  return sum;
+}
+
+// An empty row is not normalized
+static real_t row_norm(const XLearnModel* xl, real_t sum) {
+  return (xl->norm && sum > 0) ? 1.0f / sum : 1.0f;
+}
+
+// The probability, the class or the raw score of the n scores
+// in out, and the sigmoid is computed by the SIMD MathKernel
+static void transform(const XLearnModel* xl, float* out, uint64_t n) {
+  if (xl->transform == kTransformSigmoid) {
+    GetMathKernel().sigmoid(out, out, n);
+  } else if (xl->transform == kTransformSign) {
+    for (uint64_t i = 0; i < n; ++i) {
+      out[i] = out[i] > 0 ? 1.0f : -1.0f;
+    }
+  }
+}
+
+int XLearnScoreRows(XLearnHandle handle,
+                    const XLearnNode* nodes,
+                    const uint64_t* offset,
+                    uint64_t num_rows,
+                    float* out) {
+  if (handle == nullptr || offset == nullptr || out == nullptr ||
+      (nodes == nullptr && num_rows > 0 && offset[num_rows] > 0)) {
+    return XLEARN_ERR_ARGUMENT;
+  }
+  for (uint64_t i = 0; i < num_rows; ++i) {
+    if (offset[i+1] < offset[i]) { return XLEARN_ERR_ARGUMENT; }
+  }
+  Model& model = handle->model;
+  static thread_local std::vector<Node> buffer;
+  for (uint64_t i = 0; i < num_rows; ++i) {
+    const XLearnNode* begin = nodes + offset[i];
+    const XLearnNode* end = nodes + offset[i+1];
+    real_t norm = row_norm(handle, sum_sqr(begin, end));
+    real_t score = handle->score->CalcScore(
+                   valid_row(handle, begin, end, &buffer), model, norm);
+    out[i] = score;
+  }
+  transform(handle, out, num_rows);
+  return XLEARN_OK;
+}
+
+int XLearnScoreCandidates(XLearnHandle handle,
+                          const XLearnNode* context,
+                          uint64_t num_context,
+                          const XLearnNode* nodes,
+                          const uint64_t* offset,
+                          uint64_t num_items,
+                          float* out) {
+  if (handle == nullptr || offset == nullptr || out == nullptr ||
+      (context == nullptr && num_context > 0) ||
+      (nodes == nullptr && num_items > 0 && offset[num_items] > 0)) {
+    return XLEARN_ERR_ARGUMENT;
+  }
+  for (uint64_t i = 0; i < num_items; ++i) {
+    if (offset[i+1] < offset[i]) { return XLEARN_ERR_ARGUMENT; }
+  }
+  Model& model = handle->model;
+  // The context is kept in its own buffer for all the candidates
+  std::vector<Node> context_buffer;
+  RowView context_row = valid_row(handle, context, context + num_context,
+                                  &context_buffer);
+  real_t context_sqr = sum_sqr(context, context + num_context);
+  static thread_local std::vector<Node> buffer;
+  FMScore* fm_score = dynamic_cast<FMScore*>(handle->score);
+  if (fm_score != nullptr) {
+    static thread_local FMContext partial;
+    fm_score->CalcContext(context_row, model, &partial);
+    for (uint64_t i = 0; i < num_items; ++i) {
+      const XLearnNode* begin = nodes + offset[i];
+      const XLearnNode* end = nodes + offset[i+1];
+      real_t norm = row_norm(handle, context_sqr + sum_sqr(begin, end));
+      real_t score = fm_score->CalcCandidateScore(
+                     partial, valid_row(handle, begin, end, &buffer),
+                     model, norm);
+      out[i] = score;
+    }
+    transform(handle, out, num_items);
+    return XLEARN_OK;
+  }
+  FFMScore* ffm_score = dynamic_cast<FFMScore*>(handle->score);
+  if (ffm_score != nullptr) {
+    static thread_local FFMContext partial;
+    ffm_score->CalcContext(context_row, model, &partial);
+    for (uint64_t i = 0; i < num_items; ++i) {
+      const XLearnNode* begin = nodes + offset[i];
+      const XLearnNode* end = nodes + offset[i+1];
+      real_t norm = row_norm(handle, context_sqr + sum_sqr(begin, end));
+      real_t score = ffm_score->CalcCandidateScore(
+                     partial, valid_row(handle, begin, end, &buffer),
+                     model, norm);
+      out[i] = score;
+    }
+    transform(handle, out, num_items);
+    return XLEARN_OK;
+  }
+  // The linear score scores the concatenated rows
+  static thread_local std::vector<Node> row;
+  for (uint64_t i = 0; i < num_items; ++i) {
+    const XLearnNode* begin = nodes + offset[i];
+    const XLearnNode* end = nodes + offset[i+1];
+    real_t norm = row_norm(handle, context_sqr + sum_sqr(begin, end));
+    RowView item_row = valid_row(handle, begin, end, &buffer);
+    row.assign(context_row.begin(), context_row.end());
+    row.insert(row.end(), item_row.begin(), item_row.end());
+    real_t score = handle->score->CalcScore(
+                   RowView(row.data(), row.data() + row.size()),
+                   model, norm);
+    out[i] = score;
+  }
+  transform(handle, out, num_items);
+  return XLEARN_OK;
+}
+
+const char* XLearnScoreFunction(XLearnHandle handle) {
+  if (handle == nullptr) { return nullptr; }
+  return handle->model.GetScoreFunction().c_str();
+}
+
+const char* XLearnLossFunction(XLearnHandle handle) {
+  if (handle == nullptr) { return nullptr; }
+  return handle->model.GetLossFunction().c_str();
+}
+
+uint32_t XLearnNumFeature(XLearnHandle handle) {
+  if (handle == nullptr) { return 0; }
+  return handle->model.GetNumFeature();
+}
+
+uint32_t XLearnNumField(XLearnHandle handle) {
+  if (handle == nullptr) { return 0; }
+  return handle->model.GetNumField();
+}
@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the C API of xLearn for the online scoring.
+*/
+
+#ifndef XLEARN_C_API_C_API_H_
+#define XLEARN_C_API_C_API_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// The C API scores the rows in the memory of the calling service, which can
+// be embedded in C, C++ or Go (cgo) by linking the libxlearn_predict library
+// (together with the score, data and base libraries of xLearn).
+//
+// The model should be saved by 'xlearn_train --mmap-model', and it is mapped
+// in read-only mode, so opening a model is instant and the processes share
+// the same physical pages. If the model is trained with --remap, the feature
+// map (the model file + ".dict") is loaded together. A model handle holds
+// all its states, and it can be used by many threads at the same time.
+// There is no global state, and the API never exits the process or writes
+// any log, and the errors are returned as the codes:
+//
+//   XLearnHandle handle = NULL;
+//   if (XLearnOpenModel("/tmp/model.bin", 0, &handle) != XLEARN_OK) {
+//     ... error ...
+//   }
+//
+//   /* Two rows, each node is (field, feat, value) */
+//   XLearnNode nodes[] = {{0, 3, 1.0}, {1, 7, 1.0}, {0, 5, 0.5}};
+//   uint64_t offset[] = {0, 2, 3};
+//   float out[2];
+//   XLearnScoreRows(handle, nodes, offset, 2, out);
+//
+//   /* In ranking, the context (e.g., the user features) is shared
+//      by the candidates (e.g., the items) */
+//   XLearnScoreCandidates(handle, context, num_context,
+//                         items, item_offset, num_items, out);
+//
+//   XLearnCloseModel(handle);
+//
+// The score is the probability for the model of cross-entropy loss, the
+// class (-1 or 1) for hinge loss and the raw score for squared loss, which
+// is the same as xlearn_predict. The features out of the model (which are
+// not seen in the training) are ignored.
+//------------------------------------------------------------------------------
+
+/* One feature of a row */
+typedef struct XLearnNode {
+  uint32_t field;
+  uint32_t feat;
+  float value;
+} XLearnNode;
+
+/* Handle of an opened model */
+typedef struct XLearnModel* XLearnHandle;
+
+/* Error codes */
+#define XLEARN_OK             0
+#define XLEARN_ERR_ARGUMENT  -1   /* Illegal argument */
+#define XLEARN_ERR_OPEN      -2   /* Cannot open the model file */
+#define XLEARN_ERR_FORMAT    -3   /* Not a memory-mappable model */
+#define XLEARN_ERR_DICT      -4   /* Cannot load the feature map */
+#define XLEARN_ERR_DATA      -5   /* Illegal rows of the training */
+
+/* Flags of XLearnOpenModel() */
+#define XLEARN_NO_NORM    1   /* The model is trained with --no-norm */
+#define XLEARN_RAW_SCORE  2   /* Return the raw score of each row */
+
+// Open the memory-mappable model file, and the flags are the
+// XLEARN_* flags or 0. The handle is set if it returns XLEARN_OK
+int XLearnOpenModel(const char* filename, int flags, XLearnHandle* handle);
+
+// Close the model, and the handle cannot be used any more
+void XLearnCloseModel(XLearnHandle handle);
+
+// Score num_rows rows into out[0, num_rows). The nodes of the
+// i-th row are nodes[offset[i], offset[i+1]), so offset has
+// num_rows + 1 elements
+int XLearnScoreRows(XLearnHandle handle,
+                    const XLearnNode* nodes,
+                    const uint64_t* offset,
+                    uint64_t num_rows,
+                    float* out);
+
+// Score num_items candidates with the same context, and the row of
+// the i-th candidate is the context followed by the nodes of the
+// candidate nodes[offset[i], offset[i+1]). The partial score of the
+// context is computed once for fm and ffm, so the pairs inside the
+// context are not scored again for each candidate
+int XLearnScoreCandidates(XLearnHandle handle,
+                          const XLearnNode* context,
+                          uint64_t num_context,
+                          const XLearnNode* nodes,
+                          const uint64_t* offset,
+                          uint64_t num_items,
+                          float* out);
+
+// Information of the model. The strings are owned by the handle
+const char* XLearnScoreFunction(XLearnHandle handle);
+const char* XLearnLossFunction(XLearnHandle handle);
+uint32_t XLearnNumFeature(XLearnHandle handle);
+uint32_t XLearnNumField(XLearnHandle handle);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XLEARN_C_API_C_API_H_
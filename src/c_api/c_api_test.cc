@@ -0,0 +1,187 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests c_api.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "src/c_api/c_api.h"
+#include "src/base/file_util.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_function.h"
+
+namespace xLearn {
+
+const std::string kModelFile = "./test_c_api_model.bin";
+const index_t kNumFeat = 10;
+const index_t kNumField = 3;
+
+// Save a memory-mappable model with small weights
+void SaveModel(const std::string& score_func,
+               const std::string& loss_func) {
+  Model model;
+  model.Initialize(score_func, loss_func,
+                   kNumFeat, kNumField, 4);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 0.01 * (i % 7) - 0.02;
+  }
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = 0.02 * (i % 5) - 0.03;
+  }
+  model.GetParameter_b()[0] = 0.1;
+  model.SerializeMapped(kModelFile);
+}
+
+// Score the row by the Score of xLearn
+real_t ScoreRow(const std::vector<XLearnNode>& nodes, bool norm) {
+  Model model(kModelFile);
+  Score* score = CREATE_SCORE(model.GetScoreFunction().c_str());
+  score->Initialize(0, 0, &model);
+  real_t sum = 0;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    sum += nodes[i].value * nodes[i].value;
+  }
+  const Node* begin = reinterpret_cast<const Node*>(nodes.data());
+  real_t val = score->CalcScore(RowView(begin, begin + nodes.size()),
+                                model, norm ? 1.0f / sum : 1.0f);
+  delete score;
+  return val;
+}
+
+TEST(C_API_TEST, ScoreRows) {
+  const char* score_func[] = { "linear", "fm", "ffm" };
+  std::vector<XLearnNode> row_1 = {{0, 1, 1.0}, {1, 4, 0.5}, {2, 9, 2.0}};
+  std::vector<XLearnNode> row_2 = {{2, 3, 1.0}, {0, 7, 1.0}};
+  for (int t = 0; t < 3; ++t) {
+    SaveModel(score_func[t], "cross-entropy");
+    XLearnHandle handle = nullptr;
+    ASSERT_EQ(XLearnOpenModel(kModelFile.c_str(), 0, &handle), XLEARN_OK);
+    EXPECT_EQ(std::string(XLearnScoreFunction(handle)), score_func[t]);
+    EXPECT_EQ(std::string(XLearnLossFunction(handle)), "cross-entropy");
+    EXPECT_EQ(XLearnNumFeature(handle), kNumFeat);
+    // Two rows in one batch, and an empty row
+    std::vector<XLearnNode> nodes(row_1);
+    nodes.insert(nodes.end(), row_2.begin(), row_2.end());
+    uint64_t offset[] = {0, 3, 5, 5};
+    float out[3];
+    ASSERT_EQ(XLearnScoreRows(handle, nodes.data(), offset, 3, out),
+              XLEARN_OK);
+    EXPECT_FLOAT_EQ(out[0], 1.0 / (1.0 + exp(-ScoreRow(row_1, true))));
+    EXPECT_FLOAT_EQ(out[1], 1.0 / (1.0 + exp(-ScoreRow(row_2, true))));
+    EXPECT_FLOAT_EQ(out[2], 1.0 / (1.0 + exp(-0.1)));
+    EXPECT_NE(out[0], out[1]);
+    XLearnCloseModel(handle);
+    // The raw score without normalization, and the
+    // features out of the model are ignored
+    ASSERT_EQ(XLearnOpenModel(kModelFile.c_str(),
+                              XLEARN_NO_NORM | XLEARN_RAW_SCORE,
+                              &handle), XLEARN_OK);
+    nodes = row_1;
+    nodes.push_back({0, kNumFeat, 1.0});
+    nodes.push_back({kNumField, 2, 1.0});
+    uint64_t offset_2[] = {0, 5};
+    ASSERT_EQ(XLearnScoreRows(handle, nodes.data(), offset_2, 1, out),
+              XLEARN_OK);
+    if (t == 2) {
+      // The field of ffm should be in the model
+      EXPECT_FLOAT_EQ(out[0], ScoreRow(row_1, false));
+    } else {
+      nodes = row_1;
+      nodes.push_back({kNumField, 2, 1.0});
+      EXPECT_FLOAT_EQ(out[0], ScoreRow(nodes, false));
+    }
+    XLearnCloseModel(handle);
+  }
+  RemoveFile(kModelFile.c_str());
+}
+
+TEST(C_API_TEST, ScoreCandidates) {
+  const char* score_func[] = { "linear", "fm", "ffm" };
+  std::vector<XLearnNode> context = {{0, 1, 1.0}, {1, 4, 0.5}};
+  std::vector<XLearnNode> items = {{2, 9, 2.0}, {2, 3, 1.0},
+                                   {1, 7, 1.5}, {2, kNumFeat, 1.0}};
+  uint64_t offset[] = {0, 1, 3, 3, 4};
+  for (int t = 0; t < 3; ++t) {
+    SaveModel(score_func[t], "cross-entropy");
+    XLearnHandle handle = nullptr;
+    ASSERT_EQ(XLearnOpenModel(kModelFile.c_str(), 0, &handle), XLEARN_OK);
+    float out[4];
+    ASSERT_EQ(XLearnScoreCandidates(handle, context.data(), context.size(),
+                                    items.data(), offset, 4, out),
+              XLEARN_OK);
+    // The same as scoring the concatenated rows
+    for (int i = 0; i < 4; ++i) {
+      std::vector<XLearnNode> row(context);
+      row.insert(row.end(), items.begin() + offset[i],
+                 items.begin() + offset[i+1]);
+      float expected;
+      uint64_t row_offset[] = {0, row.size()};
+      ASSERT_EQ(XLearnScoreRows(handle, row.data(), row_offset,
+                                1, &expected), XLEARN_OK);
+      EXPECT_NEAR(out[i], expected, 1e-6);
+    }
+    EXPECT_NE(out[0], out[1]);
+    // Empty context
+    ASSERT_EQ(XLearnScoreCandidates(handle, nullptr, 0,
+                                    items.data(), offset, 4, out),
+              XLEARN_OK);
+    EXPECT_FLOAT_EQ(out[2], 1.0 / (1.0 + exp(-0.1)));
+    XLearnCloseModel(handle);
+  }
+  RemoveFile(kModelFile.c_str());
+}
+
+TEST(C_API_TEST, Errors) {
+  XLearnHandle handle = nullptr;
+  EXPECT_EQ(XLearnOpenModel(nullptr, 0, &handle), XLEARN_ERR_ARGUMENT);
+  EXPECT_EQ(XLearnOpenModel(kModelFile.c_str(), 0, &handle),
+            XLEARN_ERR_OPEN);
+  // Not a memory-mappable model
+  Model model;
+  model.Initialize("fm", "squared", kNumFeat, kNumField, 4);
+  model.Serialize(kModelFile);
+  EXPECT_EQ(XLearnOpenModel(kModelFile.c_str(), 0, &handle),
+            XLEARN_ERR_FORMAT);
+  EXPECT_TRUE(handle == nullptr);
+  // The squared loss returns the raw score, and the
+  // offset should not decrease
+  SaveModel("fm", "squared");
+  ASSERT_EQ(XLearnOpenModel(kModelFile.c_str(), 0, &handle), XLEARN_OK);
+  std::vector<XLearnNode> row = {{0, 1, 1.0}, {1, 4, 0.5}};
+  uint64_t offset[] = {0, 2, 1};
+  float out[2];
+  EXPECT_EQ(XLearnScoreRows(handle, row.data(), offset, 2, out),
+            XLEARN_ERR_ARGUMENT);
+  ASSERT_EQ(XLearnScoreRows(handle, row.data(), offset, 1, out),
+            XLEARN_OK);
+  EXPECT_FLOAT_EQ(out[0], ScoreRow(row, true));
+  XLearnCloseModel(handle);
+  RemoveFile(kModelFile.c_str());
+}
+
+} // namespace xLearn
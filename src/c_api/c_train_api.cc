@@ -0,0 +1,188 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the C API of the training.
+*/
+
+#include "src/c_api/c_train_api.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include "src/base/common.h"
+#include "src/base/resource.h"
+#include "src/base/thread_pool.h"
+#include "src/data/hyper_parameters.h"
+#include "src/data/model_parameters.h"
+#include "src/solver/train_api.h"
+
+using xLearn::DataSource;
+using xLearn::HyperParam;
+using xLearn::Model;
+using xLearn::RowData;
+using xLearn::ThreadPool;
+using xLearn::index_t;
+using xLearn::real_t;
+
+// The error of the last call of each thread
+static thread_local std::string last_error;
+
+static int set_error(int code, const std::string& message) {
+  last_error = message;
+  return code;
+}
+
+// Parse the integer or the real number of the whole string
+static bool parse_int(const char* str, int64_t* value) {
+  char* end = nullptr;
+  *value = strtoll(str, &end, 10);
+  return end != str && *end == '\0';
+}
+
+static bool parse_real(const char* str, real_t* value) {
+  char* end = nullptr;
+  *value = strtof(str, &end);
+  return end != str && *end == '\0';
+}
+
+// Set the parameter of the key, and return false
+// for the unknown key or the illegal value
+static bool set_param(const std::string& key, const char* value,
+                      HyperParam* param, int* nthread) {
+  int64_t n = 0;
+  if (key == "score") {
+    param->score_func = value;
+  } else if (key == "loss") {
+    param->loss_func = value;
+  } else if (key == "opt") {
+    param->opt_method = value;
+  } else if (key == "metric") {
+    param->metric = value;
+  } else if (key == "lr") {
+    return parse_real(value, &param->learning_rate);
+  } else if (key == "lambda") {
+    return parse_real(value, &param->regu_lambda);
+  } else if (key == "alpha") {
+    return parse_real(value, &param->alpha);
+  } else if (key == "beta") {
+    return parse_real(value, &param->beta);
+  } else if (key == "lambda_1") {
+    return parse_real(value, &param->lambda_1);
+  } else if (key == "lambda_2") {
+    return parse_real(value, &param->lambda_2);
+  } else if (key == "init") {
+    return parse_real(value, &param->model_scale);
+  } else if (!parse_int(value, &n) || n < 0 || n > (1LL << 31)) {
+    return false;
+  } else if (key == "k") {
+    param->num_K = n;
+  } else if (key == "epoch") {
+    param->num_epoch = n;
+  } else if (key == "sample_size") {
+    param->sample_size = n;
+  } else if (key == "stop_window") {
+    param->stop_window = n;
+  } else if (key == "seed") {
+    param->model_seed = n;
+  } else if (key == "nthread") {
+    *nthread = n;
+  } else if (key == "norm") {
+    param->norm = n != 0;
+  } else if (key == "early_stop") {
+    param->early_stop = n != 0;
+  } else if (key == "quiet") {
+    param->quiet = n != 0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static RowData row_data(const XLearnRows* rows) {
+  RowData data;
+  data.node = reinterpret_cast<const xLearn::Node*>(rows->nodes);
+  data.offset = reinterpret_cast<const uint64*>(rows->offset);
+  data.label = rows->label;
+  data.num_row = rows->num_rows;
+  return data;
+}
+
+int XLearnTrainRows(const XLearnRows* train,
+                    const XLearnRows* valid,
+                    const char* const* keys,
+                    const char* const* values,
+                    int num_params,
+                    const char* model_file) {
+  if (train == nullptr || model_file == nullptr || num_params < 0 ||
+      (num_params > 0 && (keys == nullptr || values == nullptr))) {
+    return set_error(XLEARN_ERR_ARGUMENT, "Illegal argument");
+  }
+  HyperParam param;
+  param.loss_func = "cross-entropy";
+  int nthread = 0;
+  for (int i = 0; i < num_params; ++i) {
+    if (keys[i] == nullptr || values[i] == nullptr ||
+        !set_param(keys[i], values[i], &param, &nthread)) {
+      return set_error(XLEARN_ERR_ARGUMENT,
+                       std::string("Illegal parameter: ") +
+                       (keys[i] != nullptr ? keys[i] : "NULL"));
+    }
+  }
+  // The row ids are index_t
+  if (train->num_rows >= (1ULL << 32) ||
+      (valid != nullptr && valid->num_rows >= (1ULL << 32))) {
+    return set_error(XLEARN_ERR_DATA, "Too many rows");
+  }
+  FILE* file = fopen(model_file, "wb");
+  if (file == nullptr) {
+    return set_error(XLEARN_ERR_OPEN,
+                     std::string("Cannot open the file ") + model_file);
+  }
+  fclose(file);
+  if (nthread <= 0) { nthread = xLearn::AvailableCpus(); }
+  ThreadPool pool(std::max(nthread, 1));
+  DataSource data;
+  RowData train_data = row_data(train);
+  RowData valid_data;
+  if (valid != nullptr) { valid_data = row_data(valid); }
+  std::string error;
+  int ret = xLearn::LoadRows(param, &pool, train_data,
+                             valid != nullptr ? &valid_data : nullptr,
+                             &data, &error);
+  if (ret == xLearn::kTrainOK) {
+    Model model;
+    ret = xLearn::Train(param, data, &pool, &model, nullptr, &error);
+    if (ret == xLearn::kTrainOK) {
+      model.SerializeMapped(model_file);
+      last_error.clear();
+      return XLEARN_OK;
+    }
+  }
+  return set_error(ret == xLearn::kTrainErrData ? XLEARN_ERR_DATA :
+                                                  XLEARN_ERR_ARGUMENT,
+                   error);
+}
+
+const char* XLearnLastError() {
+  return last_error.c_str();
+}
@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the C API of xLearn for the training.
+*/
+
+#ifndef XLEARN_C_API_C_TRAIN_API_H_
+#define XLEARN_C_API_C_TRAIN_API_H_
+
+#include <stdint.h>
+
+#include "src/c_api/c_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// The C API of the training trains a model on the rows in the memory of
+// the caller, e.g., the arrays of NumPy in the Python package. The rows are
+// in the CSR layout of XLearnNode (see c_api.h), which is the layout of the
+// rows of xLearn, so the nodes are used in place without any copy, and only
+// the labels are copied. The model is saved in the memory-mappable format,
+// which can be opened by XLearnOpenModel() to score the rows:
+//
+//   XLearnRows train = { nodes, offset, label, num_rows };
+//   const char* keys[] = { "score", "k", "epoch" };
+//   const char* values[] = { "fm", "8", "5" };
+//   if (XLearnTrainRows(&train, NULL, keys, values, 3,
+//                       "/tmp/model.bin") != XLEARN_OK) {
+//     printf("%s\n", XLearnLastError());
+//   }
+//
+// The parameters are the pairs of the keys and values in strings:
+//
+//   score       : "linear", "fm" or "ffm" ("linear" by default)
+//   loss        : "cross-entropy", "squared" or "hinge"
+//                 ("cross-entropy" by default)
+//   opt         : "adagrad", "ftrl" or "adagrad-lazy"
+//   metric      : e.g., "auc" or "auc,logloss"
+//   k, epoch, sample_size, nthread, seed, stop_window
+//   lr, lambda, alpha, beta, lambda_1, lambda_2, init
+//   norm, early_stop, quiet : "0" or "1"
+//
+// The training runs on its own threads (nthread, or all the CPUs), and the
+// rows of the validation set (valid, which can be NULL) are evaluated after
+// each epoch. Each call is independent, so the calls of different threads
+// can run at the same time, and the error of a call is kept for its thread.
+//------------------------------------------------------------------------------
+
+/* Rows of the training */
+typedef struct XLearnRows {
+  const XLearnNode* nodes;
+  const uint64_t* offset;   /* num_rows + 1 elements */
+  const float* label;
+  uint64_t num_rows;
+} XLearnRows;
+
+// Train the model on the rows and save it into model_file. It returns
+// XLEARN_ERR_ARGUMENT for the illegal parameters and XLEARN_ERR_DATA
+// for the illegal rows, and the message is given by XLearnLastError()
+int XLearnTrainRows(const XLearnRows* train,
+                    const XLearnRows* valid,
+                    const char* const* keys,
+                    const char* const* values,
+                    int num_params,
+                    const char* model_file);
+
+// The message of the last error of XLearnTrainRows() in this thread
+const char* XLearnLastError();
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XLEARN_C_API_C_TRAIN_API_H_
@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests c_train_api.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/c_api/c_api.h"
+#include "src/c_api/c_train_api.h"
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+const std::string kModelFile = "./test_c_train_api_model.bin";
+const int kNumRows = 2000;
+
+// The label is 1 if the row has the feature 0
+struct TestRows {
+  std::vector<XLearnNode> nodes;
+  std::vector<uint64_t> offset;
+  std::vector<float> label;
+  XLearnRows rows;
+
+  TestRows() {
+    offset.push_back(0);
+    for (int i = 0; i < kNumRows; ++i) {
+      bool positive = i % 2 == 0;
+      XLearnNode node = {(uint32_t)(i % 3), positive ? 0u : 1u, 1.0f};
+      nodes.push_back(node);
+      XLearnNode noise = {2, (uint32_t)(2 + i % 5), 0.5f};
+      nodes.push_back(noise);
+      offset.push_back(nodes.size());
+      label.push_back(positive ? 1 : 0);
+    }
+    rows.nodes = nodes.data();
+    rows.offset = offset.data();
+    rows.label = label.data();
+    rows.num_rows = kNumRows;
+  }
+};
+
+void Train(const char* score) {
+  TestRows train;
+  const char* keys[] = {"score", "k", "epoch", "nthread", "quiet"};
+  const char* values[] = {score, "4", "5", "2", "1"};
+  EXPECT_EQ(XLearnTrainRows(&train.rows, &train.rows, keys, values, 5,
+                            kModelFile.c_str()), XLEARN_OK);
+  XLearnHandle handle = NULL;
+  ASSERT_EQ(XLearnOpenModel(kModelFile.c_str(), 0, &handle), XLEARN_OK);
+  EXPECT_EQ(std::string(XLearnScoreFunction(handle)), score);
+  EXPECT_EQ(XLearnNumFeature(handle), 7);
+  std::vector<float> out(kNumRows);
+  EXPECT_EQ(XLearnScoreRows(handle, train.nodes.data(),
+                            train.offset.data(), kNumRows,
+                            out.data()), XLEARN_OK);
+  for (int i = 0; i < kNumRows; ++i) {
+    if (train.label[i] > 0) {
+      EXPECT_GT(out[i], 0.5);
+    } else {
+      EXPECT_LT(out[i], 0.5);
+    }
+  }
+  XLearnCloseModel(handle);
+  RemoveFile(kModelFile.c_str());
+}
+
+TEST(C_TRAIN_API_TEST, TrainRows) {
+  Train("linear");
+  Train("fm");
+  Train("ffm");
+}
+
+TEST(C_TRAIN_API_TEST, Errors) {
+  TestRows train;
+  const char* model = kModelFile.c_str();
+  EXPECT_EQ(XLearnTrainRows(NULL, NULL, NULL, NULL, 0, model),
+            XLEARN_ERR_ARGUMENT);
+  const char* keys[] = {"score"};
+  const char* bad_score[] = {"unknow"};
+  EXPECT_EQ(XLearnTrainRows(&train.rows, NULL, keys, bad_score, 1, model),
+            XLEARN_ERR_ARGUMENT);
+  EXPECT_NE(std::string(XLearnLastError()), "");
+  const char* bad_key[] = {"unknow"};
+  const char* value[] = {"1"};
+  EXPECT_EQ(XLearnTrainRows(&train.rows, NULL, bad_key, value, 1, model),
+            XLEARN_ERR_ARGUMENT);
+  const char* epoch[] = {"epoch"};
+  const char* bad_epoch[] = {"x"};
+  EXPECT_EQ(XLearnTrainRows(&train.rows, NULL, epoch, bad_epoch, 1, model),
+            XLEARN_ERR_ARGUMENT);
+  // The offsets are not in order
+  train.offset[10] = 100;
+  EXPECT_EQ(XLearnTrainRows(&train.rows, NULL, NULL, NULL, 0, model),
+            XLEARN_ERR_DATA);
+  RemoveFile(kModelFile.c_str());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,47 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of ModelSlot.
+*/
+
+#include "src/c_api/model_slot.h"
+
+#include <chrono>
+#include <thread>
+
+namespace xLearn {
+
+// The readers are the scoring of a batch, so the
+// writer polls them instead of spinning
+static const int kDrainPollUs = 50;
+
+void ModelSlot::Publish(XLearnHandle handle) {
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+  seq_.fetch_add(1);
+  XLearnHandle old = current_.exchange(handle);
+  version_.fetch_add(1);
+  seq_.fetch_add(1);
+  uint64 epoch = epoch_.fetch_add(1);
+  // The new readers count in the other epoch, and
+  // only the readers of the last epoch can see old
+  while (readers_[epoch & 1].load() > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(kDrainPollUs));
+  }
+  if (old != nullptr) { XLearnCloseModel(old); }
+}
+
+}  // namespace xLearn
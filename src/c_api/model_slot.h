@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the ModelSlot class, which swaps the opened
+model of the serving without blocking its readers.
+*/
+
+#ifndef XLEARN_C_API_MODEL_SLOT_H_
+#define XLEARN_C_API_MODEL_SLOT_H_
+
+#include <atomic>
+#include <mutex>
+
+#include "src/base/common.h"
+#include "src/c_api/c_api.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// ModelSlot holds the current model handle of the serving, which is read
+// by many threads and replaced by a new checkpoint at any time, in the
+// way of RCU. A reader pins the handle of current epoch for its scoring,
+// which costs two atomic adds and never waits for the writer:
+//
+//   ModelSlot slot;
+//   slot.Publish(handle);
+//   ...
+//   {
+//     ModelSlot::Pin pin(&slot);
+//     XLearnScoreRows(pin.get(), nodes, offset, num_rows, out);
+//   }
+//
+// Publish() stores the new handle and moves the readers to the next epoch,
+// and then waits until the readers of the last epoch (which may have the
+// old handle) are drained, and closes the old handle. So the new model is
+// opened and the old one is closed out of the path of the requests, and
+// the requests are never paused by a reload.
+//
+// A reader counts itself in the epoch that it reads, and then checks the
+// epoch again, so either the writer sees the reader, or the reader sees
+// the new epoch and counts itself in it (all the atomics are sequentially
+// consistent). The handle and its version are read between two equal even
+// values of a sequence, which is odd while the writer swaps them, so the
+// version of a Pin is always the version of its handle.
+//------------------------------------------------------------------------------
+class ModelSlot {
+ public:
+  ModelSlot() : current_(nullptr), epoch_(0), version_(0), seq_(0) {
+    readers_[0] = 0;
+    readers_[1] = 0;
+  }
+  ~ModelSlot() { Publish(nullptr); }
+
+  // The handle of current epoch, which is kept
+  // until the Pin is destructed
+  class Pin {
+   public:
+    explicit Pin(ModelSlot* slot) : slot_(slot) {
+      for (;;) {
+        uint64 epoch = slot_->epoch_.load();
+        index_ = epoch & 1;
+        slot_->readers_[index_].fetch_add(1);
+        if (slot_->epoch_.load() == epoch) { break; }
+        slot_->readers_[index_].fetch_sub(1);
+      }
+      for (;;) {
+        uint64 seq = slot_->seq_.load();
+        if (seq & 1) { continue; }
+        handle_ = slot_->current_.load();
+        version_ = slot_->version_.load();
+        if (slot_->seq_.load() == seq) { break; }
+      }
+    }
+    ~Pin() { slot_->readers_[index_].fetch_sub(1); }
+
+    inline XLearnHandle get() const { return handle_; }
+
+    // The version of the handle, e.g., the key of the
+    // scores of the handle in a cache
+    inline uint64 version() const { return version_; }
+
+   private:
+    ModelSlot* slot_;
+    int index_;
+    XLearnHandle handle_;
+    uint64 version_;
+
+    DISALLOW_COPY_AND_ASSIGN(Pin);
+  };
+
+  // Replace the handle (nullptr for none), and close the old
+  // handle after all of its readers are finished. The slot
+  // owns the handle after it is published
+  void Publish(XLearnHandle handle);
+
+  // Number of the published handles
+  inline uint64 Version() const { return version_.load(); }
+
+ protected:
+  std::atomic<XLearnHandle> current_;
+  std::atomic<uint64> epoch_;
+  std::atomic<int64> readers_[2];
+  std::atomic<uint64> version_;
+  std::atomic<uint64> seq_;
+  /* The writers publish in turn */
+  std::mutex writer_mutex_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ModelSlot);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_C_API_MODEL_SLOT_H_
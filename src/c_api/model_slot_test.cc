@@ -0,0 +1,148 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the ModelSlot class and the reload of ScoreServer.
+*/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/executor.h"
+#include "src/base/file_util.h"
+#include "src/c_api/model_slot.h"
+#include "src/c_api/score_server.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+const std::string kModelFile[2] = { "./test_model_slot_0.bin",
+                                    "./test_model_slot_1.bin" };
+
+// The linear models of the bias 0 and 1
+void SaveModels() {
+  for (int m = 0; m < 2; ++m) {
+    Model model;
+    model.Initialize("linear", "squared", 10, 0, 0);
+    real_t* w = model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) { w[i] = 0; }
+    model.GetParameter_b()[0] = m;
+    model.SerializeMapped(kModelFile[m]);
+  }
+}
+
+void RemoveModels() {
+  for (int m = 0; m < 2; ++m) { RemoveFile(kModelFile[m].c_str()); }
+}
+
+// The score of the empty row is the bias of the model
+float Bias(XLearnHandle handle) {
+  uint64_t offset[] = {0, 0};
+  float out = -1;
+  EXPECT_EQ(XLearnScoreRows(handle, nullptr, offset, 1, &out), XLEARN_OK);
+  return out;
+}
+
+TEST(ModelSlotTest, PublishWhileReading) {
+  SaveModels();
+  ModelSlot slot;
+  XLearnHandle handle = nullptr;
+  ASSERT_EQ(XLearnOpenModel(kModelFile[0].c_str(), 0, &handle), XLEARN_OK);
+  slot.Publish(handle);
+  EXPECT_EQ(slot.Version(), 1);
+  // The readers always see an opened model, the bias of a
+  // pinned model never changes, and the version of the pin
+  // is the version of its model (whose bias is version - 1
+  // modulo 2)
+  std::atomic<bool> stop(false);
+  std::vector<int> error(4, 0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t]() {
+      while (!stop.load()) {
+        ModelSlot::Pin pin(&slot);
+        float bias = Bias(pin.get());
+        if (bias != 0 && bias != 1) { error[t]++; }
+        if (bias != (pin.version() - 1) % 2) { error[t]++; }
+        std::this_thread::yield();
+        if (Bias(pin.get()) != bias) { error[t]++; }
+      }
+    });
+  }
+  const int kNumPublish = 50;
+  for (int i = 1; i <= kNumPublish; ++i) {
+    ASSERT_EQ(XLearnOpenModel(kModelFile[i % 2].c_str(), 0, &handle),
+              XLEARN_OK);
+    slot.Publish(handle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  stop = true;
+  for (int t = 0; t < 4; ++t) {
+    readers[t].join();
+    EXPECT_EQ(error[t], 0);
+  }
+  EXPECT_EQ(slot.Version(), kNumPublish + 1);
+  {
+    ModelSlot::Pin pin(&slot);
+    EXPECT_EQ(Bias(pin.get()), kNumPublish % 2);
+  }
+  RemoveModels();
+}
+
+TEST(ModelSlotTest, ReloadServer) {
+  SaveModels();
+  ScoreServer server;
+  server.SetBatch(16, 0);
+  ASSERT_EQ(server.Initialize(kModelFile[0], 0, Executor::Get(2)),
+            XLEARN_OK);
+  ASSERT_TRUE(server.Listen(0));
+  std::thread run(&ScoreServer::Run, &server);
+  ScoreClient client;
+  ASSERT_TRUE(client.Connect("127.0.0.1", server.Port(), 10));
+  uint64_t offset[] = {0, 0};
+  float out = -1;
+  ASSERT_EQ(client.Score(nullptr, offset, 1, &out), XLEARN_OK);
+  EXPECT_EQ(out, 0);
+  // The requests go on during the reloads
+  std::atomic<bool> stop(false);
+  std::thread reloader([&]() {
+    for (int i = 1; !stop.load(); ++i) {
+      EXPECT_EQ(server.Reload(kModelFile[i % 2]), XLEARN_OK);
+    }
+  });
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_EQ(client.Score(nullptr, offset, 1, &out), XLEARN_OK);
+    EXPECT_TRUE(out == 0 || out == 1);
+  }
+  stop = true;
+  reloader.join();
+  // The failed reload keeps the current model
+  uint64 version = server.ModelVersion();
+  EXPECT_NE(server.Reload("./no_such_model.bin"), XLEARN_OK);
+  EXPECT_EQ(server.ModelVersion(), version);
+  ASSERT_EQ(server.Reload(kModelFile[1]), XLEARN_OK);
+  ASSERT_EQ(client.Score(nullptr, offset, 1, &out), XLEARN_OK);
+  EXPECT_EQ(out, 1);
+  server.Stop();
+  run.join();
+  RemoveModels();
+}
+
+}  // namespace xLearn
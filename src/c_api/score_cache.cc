@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of ScoreCache.
+*/
+
+#include "src/c_api/score_cache.h"
+
+namespace xLearn {
+
+void ScoreCache::Initialize(uint64 capacity, uint32 num_shards) {
+  CHECK_GT(capacity, 0);
+  CHECK_GT(num_shards, 0);
+  int bits = 0;
+  while ((1u << bits) < num_shards) { ++bits; }
+  num_shards_ = 1u << bits;
+  // Each shard keeps at least one score
+  if (num_shards_ > capacity) {
+    while (bits > 0 && (1ull << bits) > capacity) { --bits; }
+    num_shards_ = 1u << bits;
+  }
+  shift_ = 64 - bits;
+  capacity_ = capacity;
+  shards_.reset(new Shard[num_shards_]);
+  for (uint32 i = 0; i < num_shards_; ++i) {
+    shards_[i].capacity = capacity / num_shards_ +
+                          (i < capacity % num_shards_ ? 1 : 0);
+    shards_[i].map.reserve(shards_[i].capacity);
+  }
+}
+
+bool ScoreCache::Lookup(uint64 key, float* score) {
+  Shard& s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto iter = s.map.find(key);
+  if (iter == s.map.end()) {
+    s.misses++;
+    return false;
+  }
+  s.lru.splice(s.lru.begin(), s.lru, iter->second);
+  *score = iter->second->second;
+  s.hits++;
+  return true;
+}
+
+void ScoreCache::Insert(uint64 key, float score) {
+  Shard& s = shard(key);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto iter = s.map.find(key);
+  if (iter != s.map.end()) {
+    iter->second->second = score;
+    s.lru.splice(s.lru.begin(), s.lru, iter->second);
+    return;
+  }
+  if (s.map.size() >= s.capacity) {
+    // The entry of the evicted key is reused
+    auto last = std::prev(s.lru.end());
+    s.map.erase(last->first);
+    last->first = key;
+    last->second = score;
+    s.lru.splice(s.lru.begin(), s.lru, last);
+  } else {
+    s.lru.emplace_front(key, score);
+  }
+  s.map[key] = s.lru.begin();
+}
+
+void ScoreCache::Clear() {
+  for (uint32 i = 0; i < num_shards_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    shards_[i].lru.clear();
+    shards_[i].map.clear();
+  }
+}
+
+uint64 ScoreCache::Hits() const {
+  uint64 sum = 0;
+  for (uint32 i = 0; i < num_shards_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    sum += shards_[i].hits;
+  }
+  return sum;
+}
+
+uint64 ScoreCache::Misses() const {
+  uint64 sum = 0;
+  for (uint32 i = 0; i < num_shards_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    sum += shards_[i].misses;
+  }
+  return sum;
+}
+
+double ScoreCache::HitRate() const {
+  uint64 hits = 0, total = 0;
+  for (uint32 i = 0; i < num_shards_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    hits += shards_[i].hits;
+    total += shards_[i].hits + shards_[i].misses;
+  }
+  return total > 0 ? (double)hits / total : 0;
+}
+
+uint64 ScoreCache::Size() const {
+  uint64 sum = 0;
+  for (uint32 i = 0; i < num_shards_; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    sum += shards_[i].map.size();
+  }
+  return sum;
+}
+
+}  // namespace xLearn
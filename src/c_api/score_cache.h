@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the ScoreCache class, which keeps the recent
+scores of the rows of the serving.
+*/
+
+#ifndef XLEARN_C_API_SCORE_CACHE_H_
+#define XLEARN_C_API_SCORE_CACHE_H_
+
+#include <string.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "src/base/common.h"
+#include "src/c_api/c_api.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The requests of the serving often repeat the same rows within seconds
+// (the retries, or the pages of the same query), and ScoreCache returns
+// their scores without scoring them again. A row is keyed by the 64-bit
+// hash of its nodes and the version of the model, so the scores of an old
+// model are never returned after a reload, and they are evicted as the
+// least recently used ones:
+//
+//   ScoreCache cache;
+//   cache.Initialize(1 << 20, 16);  /* max rows and number of shards */
+//
+//   uint64 key = ScoreCache::HashRow(nodes, len, version);
+//   float score;
+//   if (!cache.Lookup(key, &score)) {
+//     XLearnScoreRows(handle, nodes, offset, 1, &score);
+//     cache.Insert(key, score);
+//   }
+//
+// The keys are spread over the shards by their high bits, and each shard
+// is an LRU list of its own lock, so the threads of the scoring seldom
+// wait for each other. The rows of the same hash are taken as the same
+// row, which is one of 2^64 for two different rows.
+//------------------------------------------------------------------------------
+class ScoreCache {
+ public:
+  ScoreCache() { }
+  ~ScoreCache() { }
+
+  // Keep at most capacity scores in num_shards shards, which
+  // is rounded up to the power of 2
+  void Initialize(uint64 capacity, uint32 num_shards);
+
+  // The hash of the nodes of a row (the field, the feature and
+  // the bits of the value of each node, in order) and the
+  // version of the model
+  static inline uint64 HashRow(const XLearnNode* nodes,
+                               uint64 len,
+                               uint64 version) {
+    const uint64 m = 0xc6a4a7935bd1e995ULL;
+    uint64 h = (version + 1) * 0x9e3779b97f4a7c15ULL ^ (len * m);
+    for (uint64 i = 0; i < len; ++i) {
+      uint32 bits;
+      memcpy(&bits, &nodes[i].value, sizeof(bits));
+      uint64 words[2] = {
+        ((uint64)nodes[i].field << 32) | nodes[i].feat, bits
+      };
+      for (uint64 k : words) {
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
+      }
+    }
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return h;
+  }
+
+  // Return true and the score of the key if it is in the
+  // cache, which becomes the most recently used one
+  bool Lookup(uint64 key, float* score);
+
+  // Insert (or update) the score of the key, and evict the
+  // least recently used one of its full shard
+  void Insert(uint64 key, float score);
+
+  // Remove all the scores, and keep the statistics
+  void Clear();
+
+  // Number of the hits and the misses of Lookup(), and the
+  // rate of the hits (0 if there is no lookup)
+  uint64 Hits() const;
+  uint64 Misses() const;
+  double HitRate() const;
+
+  // Number of the scores in the cache
+  uint64 Size() const;
+
+  inline uint64 Capacity() const { return capacity_; }
+
+ protected:
+  /* An LRU list of the most recently used one at the front,
+  and the map of the keys to their entries of the list. A
+  shard is padded, so the locks of two shards are not in
+  the same cache line */
+  struct Shard {
+    std::mutex mutex;
+    std::list<std::pair<uint64, float>> lru;
+    std::unordered_map<uint64,
+      std::list<std::pair<uint64, float>>::iterator> map;
+    uint64 capacity = 0;
+    uint64 hits = 0;
+    uint64 misses = 0;
+    char padding[64];
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  uint32 num_shards_ = 0;
+  int shift_ = 64;
+  uint64 capacity_ = 0;
+
+  inline Shard& shard(uint64 key) const {
+    return shards_[num_shards_ > 1 ? key >> shift_ : 0];
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScoreCache);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_C_API_SCORE_CACHE_H_
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the ScoreCache class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include "src/c_api/score_cache.h"
+
+namespace xLearn {
+
+TEST(ScoreCacheTest, HashRow) {
+  std::vector<XLearnNode> row = { {0, 3, 1.0f}, {1, 7, 0.5f} };
+  uint64 key = ScoreCache::HashRow(row.data(), row.size(), 1);
+  EXPECT_EQ(ScoreCache::HashRow(row.data(), row.size(), 1), key);
+  // The version, the value, the field and the order of the nodes
+  EXPECT_NE(ScoreCache::HashRow(row.data(), row.size(), 2), key);
+  std::vector<XLearnNode> other = row;
+  other[1].value = 0.25f;
+  EXPECT_NE(ScoreCache::HashRow(other.data(), other.size(), 1), key);
+  other = row;
+  other[0].field = 2;
+  EXPECT_NE(ScoreCache::HashRow(other.data(), other.size(), 1), key);
+  other = { row[1], row[0] };
+  EXPECT_NE(ScoreCache::HashRow(other.data(), other.size(), 1), key);
+  EXPECT_NE(ScoreCache::HashRow(row.data(), 1, 1), key);
+  EXPECT_NE(ScoreCache::HashRow(nullptr, 0, 1),
+            ScoreCache::HashRow(nullptr, 0, 2));
+}
+
+// One shard is an exact LRU of its capacity
+TEST(ScoreCacheTest, LeastRecentlyUsed) {
+  ScoreCache cache;
+  cache.Initialize(3, 1);
+  float score = 0;
+  EXPECT_FALSE(cache.Lookup(1, &score));
+  cache.Insert(1, 0.1f);
+  cache.Insert(2, 0.2f);
+  cache.Insert(3, 0.3f);
+  EXPECT_EQ(cache.Size(), 3);
+  // The key 1 is used, and the key 2 is evicted
+  EXPECT_TRUE(cache.Lookup(1, &score));
+  EXPECT_FLOAT_EQ(score, 0.1f);
+  cache.Insert(4, 0.4f);
+  EXPECT_EQ(cache.Size(), 3);
+  EXPECT_FALSE(cache.Lookup(2, &score));
+  EXPECT_TRUE(cache.Lookup(3, &score));
+  EXPECT_FLOAT_EQ(score, 0.3f);
+  // Update the score of a key
+  cache.Insert(4, 0.5f);
+  EXPECT_TRUE(cache.Lookup(4, &score));
+  EXPECT_FLOAT_EQ(score, 0.5f);
+  EXPECT_EQ(cache.Hits(), 3);
+  EXPECT_EQ(cache.Misses(), 2);
+  EXPECT_DOUBLE_EQ(cache.HitRate(), 0.6);
+  cache.Clear();
+  EXPECT_EQ(cache.Size(), 0);
+  EXPECT_FALSE(cache.Lookup(4, &score));
+  EXPECT_EQ(cache.Hits(), 3);
+}
+
+// The shards are limited by the capacity, and the sum
+// of the capacities of the shards is the capacity
+TEST(ScoreCacheTest, Shards) {
+  ScoreCache small;
+  small.Initialize(2, 16);
+  for (uint64 k = 0; k < 100; ++k) {
+    small.Insert(k * 0x9e3779b97f4a7c15ULL, k);
+  }
+  EXPECT_EQ(small.Size(), 2);
+  ScoreCache cache;
+  cache.Initialize(1000, 10);
+  for (uint64 k = 0; k < 5000; ++k) {
+    cache.Insert(ScoreCache::HashRow(nullptr, 0, k), k);
+  }
+  EXPECT_LE(cache.Size(), 1000);
+  EXPECT_GT(cache.Size(), 900);
+}
+
+TEST(ScoreCacheTest, Concurrent) {
+  ScoreCache cache;
+  cache.Initialize(512, 8);
+  const int kNumThread = 8;
+  const uint64 kNumKey = 256;
+  std::vector<int> error(kNumThread, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThread; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int round = 0; round < 20; ++round) {
+        for (uint64 k = 0; k < kNumKey; ++k) {
+          uint64 key = ScoreCache::HashRow(nullptr, 0, k);
+          float score = 0;
+          if (cache.Lookup(key, &score)) {
+            if (score != k) { error[t]++; }
+          } else {
+            cache.Insert(key, k);
+          }
+        }
+      }
+    });
+  }
+  for (int t = 0; t < kNumThread; ++t) {
+    threads[t].join();
+    EXPECT_EQ(error[t], 0);
+  }
+  EXPECT_EQ(cache.Hits() + cache.Misses(), kNumThread * 20 * kNumKey);
+  EXPECT_GT(cache.HitRate(), 0.5);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,319 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of ScoreServer and ScoreClient.
+*/
+
+#include "src/c_api/score_server.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace xLearn {
+
+// The batch of fewer rows is scored by the batch thread
+// itself, without the dispatch of the pool
+static const uint64 kMinParallelRows = 64;
+
+ScoreServer::~ScoreServer() {
+  listener_.Close();
+}
+
+int ScoreServer::Initialize(const std::string& model_file,
+                            int flags,
+                            ThreadPool* pool) {
+  CHECK_NOTNULL(pool);
+  pool_ = pool;
+  flags_ = flags;
+  return Reload(model_file);
+}
+
+// The new model is opened before it is published, so the
+// batches keep the current model until it is ready
+int ScoreServer::Reload(const std::string& model_file) {
+  XLearnHandle handle = nullptr;
+  int status = XLearnOpenModel(model_file.c_str(), flags_, &handle);
+  if (status != XLEARN_OK) { return status; }
+  slot_.Publish(handle);
+  return XLEARN_OK;
+}
+
+bool ScoreServer::ListenUnix(const std::string& path) {
+  unix_path_ = path;
+  return listener_.ListenUnix(path);
+}
+
+void ScoreServer::Run() {
+  CHECK_GT(slot_.Version(), 0);
+  std::thread batcher(&ScoreServer::batch_thread, this);
+  for (;;) {
+    std::unique_ptr<Socket> conn(new Socket);
+    if (!listener_.Accept(conn.get())) { break; }
+    std::lock_guard<std::mutex> lock(conn_mutex_);
+    conns_.push_back(std::move(conn));
+    threads_.emplace_back(&ScoreServer::serve, this, conns_.back().get());
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  queue_cond_.notify_all();
+  // The connections in RecvAll() return
+  {
+    std::lock_guard<std::mutex> lock(conn_mutex_);
+    for (size_t i = 0; i < conns_.size(); ++i) {
+      conns_[i]->Shutdown();
+    }
+  }
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+  batcher.join();
+  threads_.clear();
+  conns_.clear();
+  if (!unix_path_.empty()) { unlink(unix_path_.c_str()); }
+}
+
+void ScoreServer::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  queue_cond_.notify_all();
+  listener_.Shutdown();
+}
+
+bool ScoreServer::recv_request(Socket* conn, Pending* pending) {
+  ServeRequest request;
+  if (!conn->RecvAll(&request, sizeof(request))) { return false; }
+  if (request.magic != kServeMagic ||
+      request.num_rows > kServeMaxRows ||
+      request.num_nodes > kServeMaxNodes) {
+    LOG(ERROR) << "Illegal request of " << request.num_rows
+               << " rows and " << request.num_nodes << " nodes";
+    return false;
+  }
+  static thread_local std::vector<uint32> length;
+  length.resize(request.num_rows);
+  pending->offset.resize(request.num_rows + 1);
+  pending->nodes.resize(request.num_nodes);
+  pending->out.resize(request.num_rows);
+  if (!conn->RecvAll(length.data(), length.size() * sizeof(uint32))) {
+    return false;
+  }
+  pending->offset[0] = 0;
+  for (uint64 i = 0; i < request.num_rows; ++i) {
+    pending->offset[i+1] = pending->offset[i] + length[i];
+  }
+  if (pending->offset[request.num_rows] != request.num_nodes) {
+    LOG(ERROR) << "The lengths of the rows do not match the "
+               << request.num_nodes << " nodes";
+    return false;
+  }
+  return conn->RecvAll(pending->nodes.data(),
+                       pending->nodes.size() * sizeof(XLearnNode));
+}
+
+void ScoreServer::serve(Socket* conn) {
+  Pending pending;
+  while (recv_request(conn, &pending)) {
+    pending.status = XLEARN_OK;
+    pending.done = false;
+    pending.arrival = std::chrono::steady_clock::now();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stop_) { break; }
+      queue_.push_back(&pending);
+      queue_rows_ += pending.out.size();
+      queue_cond_.notify_all();
+      done_cond_.wait(lock, [&pending]() { return pending.done; });
+    }
+    ServeReply reply;
+    reply.status = pending.status;
+    reply.reserved = 0;
+    reply.num_rows = reply.status == XLEARN_OK ? pending.out.size() : 0;
+    if (!conn->SendAll(&reply, sizeof(reply)) ||
+        !conn->SendAll(pending.out.data(),
+                       reply.num_rows * sizeof(float))) {
+      break;
+    }
+  }
+  std::lock_guard<std::mutex> lock(conn_mutex_);
+  conn->Close();
+}
+
+// The batch is closed when it has max_batch_ rows, or when
+// its first request has waited max_delay_us_, and the queue
+// is scored to the end after Stop()
+void ScoreServer::batch_thread() {
+  std::vector<Pending*> batch;
+  for (;;) {
+    batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_cond_.wait(lock, [this]() {
+        return !queue_.empty() || stop_;
+      });
+      if (queue_.empty()) { break; }
+      auto deadline = queue_.front()->arrival +
+                      std::chrono::microseconds(max_delay_us_);
+      while (!stop_ && queue_rows_ < max_batch_ &&
+             std::chrono::steady_clock::now() < deadline) {
+        queue_cond_.wait_until(lock, deadline);
+      }
+      uint64 rows = 0;
+      while (!queue_.empty()) {
+        uint64 num = queue_.front()->out.size();
+        if (!batch.empty() && rows + num > max_batch_) { break; }
+        batch.push_back(queue_.front());
+        queue_.pop_front();
+        queue_rows_ -= num;
+        rows += num;
+      }
+    }
+    score_batch(batch);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i]->done = true;
+      }
+    }
+    done_cond_.notify_all();
+  }
+}
+
+// The rows of the requests are not copied, and each range of
+// the threads is scored by XLearnScoreRows() on the part of
+// each request in the range. The whole batch is scored by
+// the model that it pins
+void ScoreServer::score_batch(const std::vector<Pending*>& batch) {
+  std::vector<uint64> first(batch.size() + 1, 0);
+  for (size_t r = 0; r < batch.size(); ++r) {
+    first[r+1] = first[r] + batch[r]->out.size();
+  }
+  uint64 num_rows = first.back();
+  ModelSlot::Pin pin(&slot_);
+  XLearnHandle handle = pin.get();
+  auto score = [&](size_t id, size_t start, size_t end) {
+    size_t r = std::upper_bound(first.begin(), first.end(), start) -
+               first.begin() - 1;
+    for (; r < batch.size() && first[r] < end; ++r) {
+      Pending* p = batch[r];
+      uint64 begin = std::max((uint64)start, first[r]) - first[r];
+      uint64 last = std::min((uint64)end, first[r+1]) - first[r];
+      if (begin >= last) { continue; }
+      int status = cache_ != nullptr ?
+        score_cached(handle, pin.version(), p, begin, last) :
+        XLearnScoreRows(handle, p->nodes.data(),
+                        p->offset.data() + begin,
+                        last - begin,
+                        p->out.data() + begin);
+      if (status != XLEARN_OK) { p->status = status; }
+    }
+  };
+  if (num_rows < kMinParallelRows || pool_->size() <= 1) {
+    score(0, 0, num_rows);
+  } else {
+    pool_->ParallelFor(0, num_rows, 0, score);
+  }
+  num_request_ += batch.size();
+  num_row_ += num_rows;
+  num_batch_++;
+}
+
+// The scores of the missed rows are inserted only if
+// their run is scored without error
+int ScoreServer::score_cached(XLearnHandle handle,
+                              uint64 version,
+                              Pending* p,
+                              uint64 begin,
+                              uint64 end) {
+  static thread_local std::vector<uint64> keys;
+  keys.resize(end - begin);
+  int result = XLEARN_OK;
+  uint64 i = begin;
+  while (i < end) {
+    // The run of the missed rows from i
+    uint64 last = i;
+    while (last < end) {
+      const uint64_t* offset = p->offset.data() + last;
+      uint64 key = ScoreCache::HashRow(p->nodes.data() + offset[0],
+                                       offset[1] - offset[0],
+                                       version);
+      keys[last - begin] = key;
+      if (cache_->Lookup(key, p->out.data() + last)) { break; }
+      ++last;
+    }
+    if (last > i) {
+      int status = XLearnScoreRows(handle, p->nodes.data(),
+                                   p->offset.data() + i,
+                                   last - i,
+                                   p->out.data() + i);
+      if (status == XLEARN_OK) {
+        for (uint64 r = i; r < last; ++r) {
+          cache_->Insert(keys[r - begin], p->out[r]);
+        }
+      } else {
+        result = status;
+      }
+    }
+    // The row of last is a hit
+    i = last + 1;
+  }
+  return result;
+}
+
+int ScoreClient::Score(const XLearnNode* nodes,
+                       const uint64_t* offset,
+                       uint64_t num_rows,
+                       float* out) {
+  if (offset == nullptr || (out == nullptr && num_rows > 0) ||
+      num_rows > kServeMaxRows) {
+    return XLEARN_ERR_ARGUMENT;
+  }
+  length_.resize(num_rows);
+  for (uint64_t i = 0; i < num_rows; ++i) {
+    if (offset[i+1] < offset[i]) { return XLEARN_ERR_ARGUMENT; }
+    length_[i] = offset[i+1] - offset[i];
+  }
+  ServeRequest request;
+  request.magic = kServeMagic;
+  request.reserved = 0;
+  request.num_rows = num_rows;
+  request.num_nodes = offset[num_rows] - offset[0];
+  if (request.num_nodes > kServeMaxNodes ||
+      (nodes == nullptr && request.num_nodes > 0)) {
+    return XLEARN_ERR_ARGUMENT;
+  }
+  ServeReply reply;
+  if (!conn_.SendAll(&request, sizeof(request)) ||
+      !conn_.SendAll(length_.data(), length_.size() * sizeof(uint32)) ||
+      !conn_.SendAll(nodes + offset[0],
+                     request.num_nodes * sizeof(XLearnNode)) ||
+      !conn_.RecvAll(&reply, sizeof(reply))) {
+    return XLEARN_ERR_ARGUMENT;
+  }
+  if (reply.status != XLEARN_OK) { return reply.status; }
+  if (reply.num_rows != num_rows ||
+      !conn_.RecvAll(out, num_rows * sizeof(float))) {
+    return XLEARN_ERR_ARGUMENT;
+  }
+  return XLEARN_OK;
+}
+
+}  // namespace xLearn
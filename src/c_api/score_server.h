@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the ScoreServer class, which scores the rows of the
+requests over a socket by the C API, and the ScoreClient of it.
+*/
+
+#ifndef XLEARN_C_API_SCORE_SERVER_H_
+#define XLEARN_C_API_SCORE_SERVER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/c_api/c_api.h"
+#include "src/c_api/model_slot.h"
+#include "src/c_api/score_cache.h"
+#include "src/distributed/socket.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Each request is a ServeRequest followed by the number of nodes of each
+// of its num_rows rows (uint32) and then all the nodes (XLearnNode), and
+// the reply is a ServeReply followed by num_rows scores (float) if its
+// status is XLEARN_OK. The requests of a connection are replied in order,
+// so a client sends the next request after the reply of the last one.
+//------------------------------------------------------------------------------
+const uint32 kServeMagic = 0x56524553;  /* "SERV" */
+
+// The limits of a request, and the larger
+// request closes the connection
+const uint64 kServeMaxRows = 1 << 20;
+const uint64 kServeMaxNodes = 1 << 26;
+
+struct ServeRequest {
+  uint32 magic;
+  uint32 reserved;
+  uint64 num_rows;
+  uint64 num_nodes;
+};
+
+struct ServeReply {
+  int32 status;
+  uint32 reserved;
+  uint64 num_rows;
+};
+
+//------------------------------------------------------------------------------
+// ScoreServer is a long-lived process of an opened model (the mmap'd model
+// of XLearnOpenModel()), which serves the requests of TCP or Unix socket
+// connections. Each connection has a thread that only receives and sends,
+// and its requests are put into a queue. A batch thread coalesces the
+// concurrent requests of the queue into a micro-batch, which is closed when
+// it has max_batch rows or when the oldest request has waited max_delay_us
+// microseconds, and scores it on the threads of the pool by the batch
+// entry of the C API (XLearnScoreRows()). So the scoring of many small
+// requests has no dispatch of the threads for each request:
+//
+//   ScoreServer server;
+//   server.SetBatch(256, 1000);  /* max rows and max delay (us) */
+//   server.Initialize("/tmp/model.bin", 0, Executor::Get(0));
+//   server.Listen(9090);  /* or ListenUnix("/tmp/xlearn.sock") */
+//   server.Run();  /* returns after Stop() */
+//
+//   ScoreClient client;
+//   client.Connect("127.0.0.1", 9090, 10);
+//   client.Score(nodes, offset, num_rows, out);
+//
+// The scores are the same as XLearnScoreRows() (see c_api.h). Reload()
+// opens a new checkpoint of the model and swaps it by the ModelSlot, so
+// the batches are never paused by the reload: each batch is scored by
+// the model that it pins, and the old model is closed after its batch.
+//
+// SetCache() keeps the scores of the recent rows in a ScoreCache, so the
+// repeated rows are not scored again. The rows are keyed by the version of
+// the pinned model, so a reload never returns the scores of the old one.
+//------------------------------------------------------------------------------
+class ScoreServer {
+ public:
+  ScoreServer() { }
+  ~ScoreServer();
+
+  // Set the max rows and the max delay (microseconds) of
+  // a micro-batch. The request larger than max_batch rows
+  // is scored as one batch
+  void SetBatch(uint32 max_batch, int max_delay_us) {
+    CHECK_GT(max_batch, 0);
+    CHECK_GE(max_delay_us, 0);
+    max_batch_ = max_batch;
+    max_delay_us_ = max_delay_us;
+  }
+
+  // Keep the scores of at most capacity recent rows, which
+  // is invoked before Run(). The cache is off by default
+  void SetCache(uint64 capacity, uint32 num_shards = kCacheShards) {
+    cache_.reset(new ScoreCache);
+    cache_->Initialize(capacity, num_shards);
+  }
+
+  // Open the model by XLearnOpenModel() with the flags, and
+  // the batches are scored by the pool. Return the error
+  // code of the C API
+  int Initialize(const std::string& model_file,
+                 int flags,
+                 ThreadPool* pool);
+
+  // Open the model file (a new checkpoint of the same path, or
+  // another path) with the flags of Initialize(), and swap it
+  // into the serving. It can be invoked by any thread, e.g.,
+  // at SIGHUP. Return the error code of the C API, and the
+  // current model is kept if it fails
+  int Reload(const std::string& model_file);
+
+  // Number of the models opened by Initialize() and Reload()
+  inline uint64 ModelVersion() const { return slot_.Version(); }
+
+  // Listen on the TCP port (0 for any free port), or on
+  // the Unix domain socket of the path
+  bool Listen(uint16 port) { return listener_.Listen(port); }
+  bool ListenUnix(const std::string& path);
+
+  // The port of the TCP listener
+  inline uint16 Port() const { return listener_.Port(); }
+
+  // Serve the connections until Stop()
+  void Run();
+
+  // Stop the Run() from another thread (or a signal
+  // handler thread), and close all the connections
+  void Stop();
+
+  // Number of the scored requests, rows and batches
+  inline uint64 NumRequests() const { return num_request_; }
+  inline uint64 NumRows() const { return num_row_; }
+  inline uint64 NumBatches() const { return num_batch_; }
+
+  // Number of the rows of the cache hits, and the rate of
+  // the hits of all the looked up rows (0 without cache)
+  inline uint64 NumCacheHits() const {
+    return cache_ != nullptr ? cache_->Hits() : 0;
+  }
+  inline double CacheHitRate() const {
+    return cache_ != nullptr ? cache_->HitRate() : 0;
+  }
+
+ protected:
+  /* A request in the queue, which is scored into out */
+  struct Pending {
+    std::vector<XLearnNode> nodes;
+    std::vector<uint64_t> offset;
+    std::vector<float> out;
+    int status = XLEARN_OK;
+    bool done = false;
+    std::chrono::steady_clock::time_point arrival;
+  };
+
+  /* The default shards of the cache */
+  static const uint32 kCacheShards = 64;
+
+  ModelSlot slot_;
+  std::unique_ptr<ScoreCache> cache_;
+  int flags_ = 0;
+  ThreadPool* pool_ = nullptr;
+  uint32 max_batch_ = 256;
+  int max_delay_us_ = 1000;
+  Socket listener_;
+  std::string unix_path_;
+  /* The queue of the requests, and the stop of the server */
+  std::mutex mutex_;
+  std::condition_variable queue_cond_;
+  std::condition_variable done_cond_;
+  std::deque<Pending*> queue_;
+  uint64 queue_rows_ = 0;
+  bool stop_ = false;
+  /* The connections and their threads */
+  std::mutex conn_mutex_;
+  std::vector<std::unique_ptr<Socket>> conns_;
+  std::vector<std::thread> threads_;
+  /* The statistics, which are written by the batch thread */
+  uint64 num_request_ = 0;
+  uint64 num_row_ = 0;
+  uint64 num_batch_ = 0;
+
+  // Receive the requests of the connection, and send
+  // their replies until it is closed
+  void serve(Socket* conn);
+
+  // Receive a request into the pending, and return
+  // false if it is broken or illegal
+  bool recv_request(Socket* conn, Pending* pending);
+
+  // Coalesce and score the requests of the queue until Stop()
+  void batch_thread();
+
+  // Score the rows of the requests as one batch
+  void score_batch(const std::vector<Pending*>& batch);
+
+  // Score the rows [begin, end) of the request by the cache,
+  // and the runs of the missed rows by XLearnScoreRows()
+  int score_cached(XLearnHandle handle,
+                   uint64 version,
+                   Pending* p,
+                   uint64 begin,
+                   uint64 end);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScoreServer);
+};
+
+//------------------------------------------------------------------------------
+// ScoreClient is a connection to the ScoreServer, whose requests are
+// sent one at a time. The rows are given as XLearnScoreRows().
+//------------------------------------------------------------------------------
+class ScoreClient {
+ public:
+  ScoreClient() { }
+  ~ScoreClient() { }
+
+  // Connect to the TCP or the Unix domain socket of
+  // the server, which is retried for timeout seconds
+  bool Connect(const std::string& host, uint16 port, int timeout) {
+    return conn_.Connect(host, port, timeout);
+  }
+  bool ConnectUnix(const std::string& path, int timeout) {
+    return conn_.ConnectUnix(path, timeout);
+  }
+
+  // Score num_rows rows into out, and return the error
+  // code of the server, or XLEARN_ERR_ARGUMENT if the
+  // connection is broken
+  int Score(const XLearnNode* nodes,
+            const uint64_t* offset,
+            uint64_t num_rows,
+            float* out);
+
+  void Close() { conn_.Close(); }
+
+ protected:
+  Socket conn_;
+  std::vector<uint32> length_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScoreClient);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_C_API_SCORE_SERVER_H_
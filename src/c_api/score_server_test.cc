@@ -0,0 +1,181 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the ScoreServer class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/executor.h"
+#include "src/base/file_util.h"
+#include "src/c_api/score_server.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+const std::string kModelFile = "./test_score_server_model.bin";
+const std::string kSocketFile = "./test_score_server.sock";
+const index_t kNumFeat = 50;
+const index_t kNumField = 4;
+
+void SaveModel() {
+  Model model;
+  model.Initialize("fm", "cross-entropy", kNumFeat, kNumField, 4);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 0.01 * (i % 7) - 0.02;
+  }
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = 0.02 * (i % 5) - 0.03;
+  }
+  model.GetParameter_b()[0] = 0.1;
+  model.SerializeMapped(kModelFile);
+}
+
+// The rows of the request of the client c, whose
+// row i has i % 5 nodes
+void MakeRows(int c, int num_rows, std::vector<XLearnNode>* nodes,
+              std::vector<uint64_t>* offset) {
+  nodes->clear();
+  offset->assign(1, 0);
+  for (int i = 0; i < num_rows; ++i) {
+    for (int j = 0; j < i % 5; ++j) {
+      nodes->push_back({(uint32_t)(j % kNumField),
+                        (uint32_t)((c * 7 + i * 3 + j * 11) % kNumFeat),
+                        1.0f - 0.1f * j});
+    }
+    offset->push_back(nodes->size());
+  }
+}
+
+// The clients send requests at the same time, and their
+// scores are the same as the C API
+void ServeClients(ScoreServer* server, bool unix_socket) {
+  XLearnHandle handle = nullptr;
+  ASSERT_EQ(XLearnOpenModel(kModelFile.c_str(), 0, &handle), XLEARN_OK);
+  std::thread run(&ScoreServer::Run, server);
+  const int kNumClient = 8;
+  const int kNumRequest = 20;
+  std::vector<int> error(kNumClient, 0);
+  std::vector<std::thread> clients;
+  for (int c = 0; c < kNumClient; ++c) {
+    clients.emplace_back([&, c]() {
+      ScoreClient client;
+      bool ok = unix_socket ? client.ConnectUnix(kSocketFile, 10) :
+                client.Connect("127.0.0.1", server->Port(), 10);
+      if (!ok) {
+        error[c]++;
+        return;
+      }
+      std::vector<XLearnNode> nodes;
+      std::vector<uint64_t> offset;
+      for (int r = 0; r < kNumRequest; ++r) {
+        int num_rows = 1 + (c + r) % 40;
+        MakeRows(c + r, num_rows, &nodes, &offset);
+        std::vector<float> out(num_rows), expect(num_rows);
+        XLearnScoreRows(handle, nodes.data(), offset.data(),
+                        num_rows, expect.data());
+        if (client.Score(nodes.data(), offset.data(), num_rows,
+                         out.data()) != XLEARN_OK || out != expect) {
+          error[c]++;
+        }
+      }
+    });
+  }
+  for (int c = 0; c < kNumClient; ++c) {
+    clients[c].join();
+    EXPECT_EQ(error[c], 0);
+  }
+  server->Stop();
+  run.join();
+  EXPECT_EQ(server->NumRequests(), kNumClient * kNumRequest);
+  EXPECT_LE(server->NumBatches(), server->NumRequests());
+  XLearnCloseModel(handle);
+}
+
+TEST(ScoreServerTest, ServeTCP) {
+  SaveModel();
+  ScoreServer server;
+  server.SetBatch(64, 2000);
+  ASSERT_EQ(server.Initialize(kModelFile, 0, Executor::Get(4)), XLEARN_OK);
+  ASSERT_TRUE(server.Listen(0));
+  ServeClients(&server, false);
+  RemoveFile(kModelFile.c_str());
+}
+
+TEST(ScoreServerTest, ServeUnixSocket) {
+  SaveModel();
+  ScoreServer server;
+  // No delay, and each batch has the requests in the queue
+  server.SetBatch(256, 0);
+  ASSERT_EQ(server.Initialize(kModelFile, 0, Executor::Get(2)), XLEARN_OK);
+  ASSERT_TRUE(server.ListenUnix(kSocketFile));
+  ServeClients(&server, true);
+  EXPECT_FALSE(FileExist(kSocketFile.c_str()));
+  RemoveFile(kModelFile.c_str());
+}
+
+// The requests repeat the rows of each other, and the cache
+// of a few rows has both the hits and the evictions
+TEST(ScoreServerTest, ServeCached) {
+  SaveModel();
+  ScoreServer server;
+  server.SetBatch(64, 2000);
+  server.SetCache(100, 4);
+  ASSERT_EQ(server.Initialize(kModelFile, 0, Executor::Get(4)), XLEARN_OK);
+  ASSERT_TRUE(server.Listen(0));
+  ServeClients(&server, false);
+  EXPECT_GT(server.NumCacheHits(), 0);
+  EXPECT_LT(server.NumCacheHits(), server.NumRows());
+  EXPECT_GT(server.CacheHitRate(), 0);
+  EXPECT_LT(server.CacheHitRate(), 1);
+  RemoveFile(kModelFile.c_str());
+}
+
+TEST(ScoreServerTest, IllegalRequest) {
+  SaveModel();
+  ScoreServer server;
+  ASSERT_EQ(server.Initialize(kModelFile, 0, Executor::Get(2)), XLEARN_OK);
+  ASSERT_TRUE(server.Listen(0));
+  std::thread run(&ScoreServer::Run, &server);
+  // The request of a wrong magic closes the connection
+  Socket conn;
+  ASSERT_TRUE(conn.Connect("127.0.0.1", server.Port(), 10));
+  ServeRequest request;
+  request.magic = 0;
+  request.reserved = 0;
+  request.num_rows = 0;
+  request.num_nodes = 0;
+  ASSERT_TRUE(conn.SendAll(&request, sizeof(request)));
+  ServeReply reply;
+  EXPECT_FALSE(conn.RecvAll(&reply, sizeof(reply)));
+  // The empty request is replied
+  ScoreClient client;
+  ASSERT_TRUE(client.Connect("127.0.0.1", server.Port(), 10));
+  uint64_t offset = 0;
+  EXPECT_EQ(client.Score(nullptr, &offset, 0, nullptr), XLEARN_OK);
+  server.Stop();
+  run.join();
+  RemoveFile(kModelFile.c_str());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the entry of the xlearn_serve tool, which serves the scoring
+requests of a model trained with --mmap-model over a TCP port or a Unix
+domain socket (see score_server.h for the protocol), until it receives
+SIGINT or SIGTERM. The SIGHUP reloads the model file, e.g., a new
+checkpoint renamed to its path, without pausing the requests:
+
+  xlearn_serve [ options ] model_file
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "src/base/common.h"
+#include "src/base/executor.h"
+#include "src/c_api/score_server.h"
+
+namespace {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_serve [ options ] model_file \n"
+"                                          \n"
+"  Serve the scoring requests of the model, which is saved by 'xlearn_train --mmap-model', over \n"
+"  a TCP port or a Unix domain socket. The concurrent requests are scored together in the \n"
+"  micro-batches, and the scores are the same as xlearn_predict. The SIGHUP reloads the model \n"
+"  file, e.g., a new checkpoint renamed to its path, and the old model is closed after its last \n"
+"  batch, so the requests are not paused. \n"
+"                                                                 \n"
+"OPTIONS: \n"
+"  -port <port>         :  The TCP port to listen on. \n"
+"                                                     \n"
+"  -unix <path>         :  The Unix domain socket to listen on, instead of the TCP port. \n"
+"                                                                                      \n"
+"  -batch <rows>        :  Max number of the rows of a micro-batch. Using 256 by default. \n"
+"                                                                                      \n"
+"  -delay <us>          :  Max time (microseconds) that a request waits for the other requests \n"
+"                          of its micro-batch. Using 1000 by default. \n"
+"                                                                    \n"
+"  -nthread <number>    :  Number of the threads of scoring. Using all the cores by default. \n"
+"                                                                                          \n"
+"  -cache <rows>        :  Keep the scores of the recent rows, so the repeated rows (e.g., the \n"
+"                          retries) are not scored again. The scores of an old model are not \n"
+"                          returned after the reload. Using no cache by default. \n"
+"                                                                                \n"
+"  --no-norm            :  The model is trained with --no-norm. \n"
+"                                                               \n"
+"  --raw                :  Return the raw scores instead of the probabilities or the classes. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct ServeOption {
+  int port = 0;
+  std::string unix_path;
+  int max_batch = 256;
+  int max_delay = 1000;
+  int nthread = 0;
+  int cache_rows = 0;
+  int flags = 0;
+  std::string model_file;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], ServeOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "-port" || arg == "-batch" ||
+        arg == "-delay" || arg == "-nthread" || arg == "-cache") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      int value = atoi(argv[++i]);
+      if (value < 0 ||
+          (value == 0 && arg != "-delay" && arg != "-cache") ||
+          (arg == "-port" && value > 65535)) {
+        printf("[Error] Illegal %s : '%s' \n", arg.c_str(), argv[i]);
+        return false;
+      }
+      if (arg == "-port") {
+        option->port = value;
+      } else if (arg == "-batch") {
+        option->max_batch = value;
+      } else if (arg == "-delay") {
+        option->max_delay = value;
+      } else if (arg == "-cache") {
+        option->cache_rows = value;
+      } else {
+        option->nthread = value;
+      }
+    } else if (arg == "-unix") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      option->unix_path = argv[++i];
+    } else if (arg == "--no-norm") {
+      option->flags |= XLEARN_NO_NORM;
+    } else if (arg == "--raw") {
+      option->flags |= XLEARN_RAW_SCORE;
+    } else if (!arg.empty() && arg[0] == '-') {
+      printf("[Error] Unknow option: %s \n", argv[i]);
+      return false;
+    } else if (option->model_file.empty()) {
+      option->model_file = arg;
+    } else {
+      return false;
+    }
+  }
+  if (option->port > 0 && !option->unix_path.empty()) {
+    printf("[Error] The -port and the -unix cannot be both used \n");
+    return false;
+  }
+  return !option->model_file.empty() &&
+         (option->port > 0 || !option->unix_path.empty());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  ServeOption option;
+  if (!parse_option(argc, argv, &option)) {
+    printf("%s", kUsage);
+    return 0;
+  }
+  Timer timer;
+  timer.tic();
+  // The signals are received by the thread of sigwait(), and
+  // all the other threads inherit the blocked mask
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  xLearn::ScoreServer server;
+  server.SetBatch(option.max_batch, option.max_delay);
+  if (option.cache_rows > 0) { server.SetCache(option.cache_rows); }
+  int status = server.Initialize(option.model_file, option.flags,
+                                 xLearn::Executor::Get(option.nthread));
+  if (status != XLEARN_OK) {
+    printf("[Error] Cannot open the model %s (error %d), which "
+           "should be saved by --mmap-model \n",
+           option.model_file.c_str(), status);
+    return 0;
+  }
+  bool listen = option.unix_path.empty() ?
+                server.Listen(option.port) :
+                server.ListenUnix(option.unix_path);
+  if (!listen) {
+    printf("[Error] Cannot listen on %s \n",
+           option.unix_path.empty() ? std::to_string(option.port).c_str() :
+                                      option.unix_path.c_str());
+    return 0;
+  }
+  std::thread waiter([&server, &signals, &option]() {
+    int sig = 0;
+    while (sigwait(&signals, &sig) == 0 && sig == SIGHUP) {
+      int status = server.Reload(option.model_file);
+      if (status == XLEARN_OK) {
+        printf("Reload the model %s (version %llu) \n",
+               option.model_file.c_str(),
+               (unsigned long long)server.ModelVersion());
+      } else {
+        printf("[Warning] Cannot reload the model %s (error %d), "
+               "and the current model is kept \n",
+               option.model_file.c_str(), status);
+      }
+      fflush(stdout);
+    }
+    server.Stop();
+  });
+  printf("Serve the model %s on %s ... \n", option.model_file.c_str(),
+         option.unix_path.empty() ?
+         ("port " + std::to_string(option.port)).c_str() :
+         option.unix_path.c_str());
+  fflush(stdout);
+  server.Run();
+  // The waiter returns if the Run() is not stopped by a signal
+  kill(getpid(), SIGTERM);
+  waiter.join();
+  printf("Finish serving %llu requests (%llu rows) in %llu batches. "
+         "Total time cost: %.2f sec\n",
+         (unsigned long long)server.NumRequests(),
+         (unsigned long long)server.NumRows(),
+         (unsigned long long)server.NumBatches(), timer.toc());
+  if (option.cache_rows > 0) {
+    printf("  Cache hits: %llu rows (%.2f%%) \n",
+           (unsigned long long)server.NumCacheHits(),
+           server.CacheHitRate() * 100);
+  }
+  return 0;
+}
@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of AdmissionFilter.
+*/
+
+#include "src/data/admission_filter.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+// The finalizer of MurmurHash3
+static inline uint64 mix_id(uint64 id) {
+  id ^= id >> 33;
+  id *= 0xff51afd7ed558ccdULL;
+  id ^= id >> 33;
+  id *= 0xc4ceb9fe1a85ec53ULL;
+  id ^= id >> 33;
+  return id;
+}
+
+void AdmissionFilter::Initialize(uint64 num_counter, int min_count) {
+  CHECK_GT(num_counter, 0);
+  CHECK_GE(min_count, 1);
+  CHECK_LE(min_count, 255);
+  uint64 size = 1;
+  while (size < num_counter) { size <<= 1; }
+  counter_.reset(new std::atomic<uint8>[size]);
+  for (uint64 i = 0; i < size; ++i) { counter_[i].store(0); }
+  mask_ = size - 1;
+  min_count_ = min_count;
+  frozen_ = false;
+  rejected_.store(0);
+  fingerprint_ = 0;
+}
+
+// The counters of the id are probed by the double hashing
+bool AdmissionFilter::Admit(uint64 id) {
+  CHECK(counter_ != nullptr);
+  uint64 h1 = mix_id(id);
+  uint64 h2 = mix_id(h1) | 1;
+  uint64 pos[kAdmissionHash];
+  uint8 count = 255;
+  for (int i = 0; i < kAdmissionHash; ++i) {
+    pos[i] = (h1 + i * h2) & mask_;
+    uint8 c = counter_[pos[i]].load(std::memory_order_relaxed);
+    if (c < count) { count = c; }
+  }
+  if (count >= min_count_) { return true; }
+  if (frozen_) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // Another thread may have increased the counter, and
+  // then this occurrence is not counted twice
+  for (int i = 0; i < kAdmissionHash; ++i) {
+    uint8 c = count;
+    counter_[pos[i]].compare_exchange_strong(c, count + 1,
+                                             std::memory_order_relaxed);
+  }
+  if (count + 1 >= min_count_) { return true; }
+  rejected_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+// FNV-1a of the counters
+void AdmissionFilter::Freeze() {
+  frozen_ = true;
+  uint64 hash = 0xcbf29ce484222325ULL ^ min_count_;
+  for (uint64 i = 0; i <= mask_ && counter_ != nullptr; ++i) {
+    hash = (hash ^ counter_[i].load()) * 0x100000001b3ULL;
+  }
+  fingerprint_ = hash;
+}
+
+void AdmissionFilter::Serialize(const std::string& filename) const {
+  CHECK_NE(filename.empty(), true);
+  CHECK(counter_ != nullptr);
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  uint64 size = mask_ + 1;
+  uint64 min_count = min_count_;
+  WriteDataToDisk(file, (char*)&kAdmissionMagic, sizeof(kAdmissionMagic));
+  WriteDataToDisk(file, (char*)&size, sizeof(size));
+  WriteDataToDisk(file, (char*)&min_count, sizeof(min_count));
+  // The counters are copied in pieces, since the
+  // parsing threads may still increase them
+  std::vector<uint8> buf(std::min(size, (uint64)1 << 20));
+  for (uint64 i = 0; i < size; i += buf.size()) {
+    uint64 len = std::min(size - i, (uint64)buf.size());
+    for (uint64 j = 0; j < len; ++j) {
+      buf[j] = counter_[i+j].load(std::memory_order_relaxed);
+    }
+    WriteDataToDisk(file, (char*)buf.data(), len);
+  }
+  Close(file);
+}
+
+bool AdmissionFilter::Deserialize(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 magic = 0;
+  uint64 size = 0;
+  uint64 min_count = 0;
+  ReadDataFromDisk(file, (char*)&magic, sizeof(magic));
+  if (magic == kAdmissionMagic) {
+    ReadDataFromDisk(file, (char*)&size, sizeof(size));
+    ReadDataFromDisk(file, (char*)&min_count, sizeof(min_count));
+  }
+  if (magic != kAdmissionMagic || size == 0 || (size & (size - 1)) ||
+      min_count == 0 || min_count > 255) {
+    LOG(ERROR) << "Not an admission filter file: " << filename;
+    Close(file);
+    return false;
+  }
+  this->Initialize(size, min_count);
+  std::vector<uint8> buf(std::min(size, (uint64)1 << 20));
+  for (uint64 i = 0; i < size; i += buf.size()) {
+    uint64 len = std::min(size - i, (uint64)buf.size());
+    ReadDataFromDisk(file, (char*)buf.data(), len);
+    for (uint64 j = 0; j < len; ++j) { counter_[i+j].store(buf[j]); }
+  }
+  Close(file);
+  this->Freeze();
+  return true;
+}
+
+}  // namespace xLearn
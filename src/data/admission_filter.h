@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the AdmissionFilter class, which admits a feature
+into the model only after it has been seen a number of times.
+*/
+
+#ifndef XLEARN_DATA_ADMISSION_FILTER_H_
+#define XLEARN_DATA_ADMISSION_FILTER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Magic number of the admission filter file
+const uint64 kAdmissionMagic = 0x3154494d44414cULL;  /* "LADMIT1" */
+
+// Number of the counters of each id
+const int kAdmissionHash = 4;
+
+//------------------------------------------------------------------------------
+// AdmissionFilter is the admission policy of the online training, where
+// the new long-tail ids arrive without end and each of them would claim
+// the parameters (and a latent block) of the model. A feature gets its
+// own parameters from its min_count-th occurrence, and the occurrences
+// before are mapped to one shared OOV feature by the Parser:
+//
+//   AdmissionFilter filter;
+//   filter.Initialize(1 << 24, 5);        /* 16M counters, 5 times */
+//   if (filter.Admit(raw_id)) { ... }     /* count it and test it */
+//   filter.Serialize("/tmp/model.admit");
+//
+// The occurrences are counted by a counting Bloom filter of one byte
+// counters: each raw id has kAdmissionHash counters, and its count is
+// the minimum of them, which is never less than the real count. Only
+// the minimal counters are increased (the conservative update), and the
+// counters saturate at min_count, so the memory is fixed however many
+// ids the stream has. A collision can admit an id early, but never
+// keeps an id out of the model.
+//
+// Admit() is called by the parsing threads at the same time. The
+// frozen filter (the one loaded by the prediction) only tests the ids,
+// so the ids that the training has not admitted are also the OOV
+// feature of the prediction.
+//------------------------------------------------------------------------------
+class AdmissionFilter {
+ public:
+  AdmissionFilter() : mask_(0), min_count_(0), frozen_(false),
+    rejected_(0), fingerprint_(0) { }
+  ~AdmissionFilter() { }
+
+  // The number of counters is rounded up to the power of 2,
+  // and min_count is in [1, 255]
+  void Initialize(uint64 num_counter, int min_count);
+
+  // Count one occurrence of the raw id unless the filter is frozen,
+  // and return true if the id has been seen min_count times
+  bool Admit(uint64 id);
+
+  // Stop counting the ids
+  void Freeze();
+  inline bool IsFrozen() const { return frozen_; }
+
+  inline int MinCount() const { return min_count_; }
+  inline uint64 NumCounter() const { return mask_ + 1; }
+
+  // Number of the occurrences that are not admitted
+  inline uint64 NumRejected() const { return rejected_.load(); }
+
+  // The hash of the frozen counters, which tells the binary
+  // cache of the ids mapped by this filter
+  inline uint64 Fingerprint() const { return fingerprint_; }
+
+  // Save and load the counters. The loaded filter is frozen
+  void Serialize(const std::string& filename) const;
+  bool Deserialize(const std::string& filename);
+
+ protected:
+  std::unique_ptr<std::atomic<uint8>[]> counter_;
+  uint64 mask_;
+  int min_count_;
+  bool frozen_;
+  std::atomic<uint64> rejected_;
+  uint64 fingerprint_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AdmissionFilter);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_ADMISSION_FILTER_H_
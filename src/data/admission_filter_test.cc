@@ -0,0 +1,101 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests admission_filter.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/data/admission_filter.h"
+
+namespace xLearn {
+
+const std::string kFilterFile = "./test_filter.admit";
+
+TEST(ADMISSION_FILTER_TEST, Admit) {
+  AdmissionFilter filter;
+  filter.Initialize(1000, 3);
+  EXPECT_EQ(filter.NumCounter(), 1024);
+  uint64 id = 12345678901ULL;
+  EXPECT_FALSE(filter.Admit(id));
+  EXPECT_FALSE(filter.Admit(id));
+  EXPECT_TRUE(filter.Admit(id));
+  EXPECT_TRUE(filter.Admit(id));
+  EXPECT_FALSE(filter.Admit(7));
+  EXPECT_EQ(filter.NumRejected(), 3);
+}
+
+// The counters are never less than the real counts, so the
+// frequent ids are always admitted, and only a few of the
+// ids seen once are admitted by the collisions
+TEST(ADMISSION_FILTER_TEST, Long_tail) {
+  AdmissionFilter filter;
+  filter.Initialize(1 << 16, 2);
+  for (uint64 id = 0; id < 1000; ++id) {
+    for (int k = 0; k < 2; ++k) { filter.Admit(id); }
+  }
+  int admitted = 0;
+  for (uint64 id = 1000; id < 3000; ++id) {
+    if (filter.Admit(id)) { admitted++; }
+  }
+  EXPECT_LT(admitted, 20);
+  for (uint64 id = 0; id < 1000; ++id) {
+    EXPECT_TRUE(filter.Admit(id));
+  }
+}
+
+TEST(ADMISSION_FILTER_TEST, Threads) {
+  AdmissionFilter filter;
+  filter.Initialize(1 << 16, 100);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.push_back(std::thread([&filter]() {
+      for (int k = 0; k < 100; ++k) { filter.Admit(42); }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t) { threads[t].join(); }
+  // The concurrent occurrences may be counted once
+  EXPECT_TRUE(filter.Admit(42));
+}
+
+TEST(ADMISSION_FILTER_TEST, Serialize) {
+  AdmissionFilter filter;
+  filter.Initialize(1 << 10, 2);
+  filter.Admit(1);
+  filter.Admit(1);
+  filter.Admit(2);
+  filter.Serialize(kFilterFile);
+  AdmissionFilter loaded;
+  EXPECT_TRUE(loaded.Deserialize(kFilterFile));
+  EXPECT_TRUE(loaded.IsFrozen());
+  EXPECT_EQ(loaded.MinCount(), 2);
+  EXPECT_EQ(loaded.NumCounter(), 1 << 10);
+  EXPECT_TRUE(loaded.Admit(1));
+  // The frozen filter does not count
+  EXPECT_FALSE(loaded.Admit(2));
+  EXPECT_FALSE(loaded.Admit(2));
+  EXPECT_NE(loaded.Fingerprint(), 0);
+  RemoveFile(kFilterFile.c_str());
+}
+
+}  // namespace xLearn
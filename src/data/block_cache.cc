@@ -0,0 +1,265 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of BlockCache.
+*/
+
+#include "src/data/block_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "src/base/compress.h"
+#include "src/base/file_util.h"
+#include "src/base/executor.h"
+
+namespace xLearn {
+
+// Serialize and compress each block of the matrix into data, and
+// return the number of nodes. The offsets start from 0 in data
+static uint64 compress_blocks(const DMatrix& matrix,
+                              index_t rows_per_block,
+                              std::vector<char>* data,
+                              std::vector<BlockIndex>* index) {
+  std::vector<char> raw;
+  DMatrix block;
+  block.SetCSR(true);
+  block.SetCompact(matrix.is_compact);
+  uint64 num_node = 0;
+  for (index_t begin = 0; begin < matrix.row_length;
+       begin += rows_per_block) {
+    index_t end = std::min(begin + rows_per_block, matrix.row_length);
+    block.ReuseMatrix(end - begin);
+    block.CopyRows(0, matrix, begin, end);
+    num_node += block.is_compact ? block.compact_data.size() :
+                                   block.csr_node.size();
+    raw.clear();
+    block.Serialize(&raw);
+    BlockIndex entry;
+    entry.offset = data->size();
+    entry.raw_size = raw.size();
+    entry.comp_size = Compress(raw.data(), raw.size(), data);
+    entry.num_row = end - begin;
+    index->push_back(entry);
+  }
+  return num_node;
+}
+
+// Serialize and compress each block, then write
+// the header, the block index and all the blocks
+void BlockCache::Write(const std::string& filename,
+                       const DMatrix& matrix,
+                       index_t rows_per_block) {
+  CHECK(!filename.empty());
+  CHECK_GT(rows_per_block, 0);
+  /*********************************************************
+   *  Step 1: Compress each block                          *
+   *********************************************************/
+  std::vector<char> data;
+  std::vector<BlockIndex> index;
+  uint64 num_node = compress_blocks(matrix, rows_per_block,
+                                    &data, &index);
+  /*********************************************************
+   *  Step 2: Write the header, the index and the blocks   *
+   *********************************************************/
+  BlockCacheHeader header;
+  header.hash_value_1 = matrix.hash_value_1;
+  header.hash_value_2 = matrix.hash_value_2;
+  header.magic = kBlockCacheMagic;
+  header.num_block = index.size();
+  header.num_row = matrix.row_length;
+  header.num_node = num_node;
+  header.stats = matrix.GetStats();
+  uint64 base = sizeof(header) + sizeof(BlockIndex) * index.size();
+  for (size_t i = 0; i < index.size(); ++i) {
+    index[i].offset += base;
+  }
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, (char*)&header, sizeof(header));
+  if (!index.empty()) {
+    WriteDataToDisk(file, (char*)index.data(),
+                    sizeof(BlockIndex) * index.size());
+  }
+  if (!data.empty()) {
+    WriteDataToDisk(file, data.data(), data.size());
+  }
+  ::Close(file);
+}
+
+// The index grows with the new blocks, so the former blocks
+// are moved and their offsets are shifted
+void BlockCache::Append(const std::string& filename,
+                        const DMatrix& matrix,
+                        index_t rows_per_block) {
+  CHECK(!filename.empty());
+  CHECK_GT(rows_per_block, 0);
+  BlockCache cache;
+  cache.Open(filename);
+  std::vector<BlockIndex> index = cache.Index();
+  std::vector<char> data;
+  std::vector<BlockIndex> new_index;
+  uint64 num_node = compress_blocks(matrix, rows_per_block,
+                                    &data, &new_index);
+  // The former blocks lie between the index and the end of file
+  uint64 old_base = sizeof(BlockCacheHeader) +
+                    sizeof(BlockIndex) * index.size();
+  uint64 old_size = cache.size_ - old_base;
+  BlockCacheHeader header = cache.Header();
+  header.hash_value_1 = matrix.hash_value_1;
+  header.hash_value_2 = matrix.hash_value_2;
+  header.num_block += new_index.size();
+  header.num_row += matrix.row_length;
+  header.num_node += num_node;
+  header.stats.Merge(matrix.GetStats());
+  uint64 base = sizeof(header) + sizeof(BlockIndex) * header.num_block;
+  for (size_t i = 0; i < index.size(); ++i) {
+    index[i].offset += base - old_base;
+  }
+  for (size_t i = 0; i < new_index.size(); ++i) {
+    new_index[i].offset += base + old_size;
+    index.push_back(new_index[i]);
+  }
+  std::string tmp_file = filename + ".tmp";
+  FILE* file = OpenFileOrDie(tmp_file.c_str(), "w");
+  WriteDataToDisk(file, (char*)&header, sizeof(header));
+  if (!index.empty()) {
+    WriteDataToDisk(file, (char*)index.data(),
+                    sizeof(BlockIndex) * index.size());
+  }
+  if (old_size > 0) {
+    WriteDataToDisk(file, cache.addr_ + old_base, old_size);
+  }
+  if (!data.empty()) {
+    WriteDataToDisk(file, data.data(), data.size());
+  }
+  ::Close(file);
+  cache.Close();
+  if (rename(tmp_file.c_str(), filename.c_str()) != 0) {
+    LOG(FATAL) << "Cannot rename " << tmp_file << " to " << filename;
+  }
+}
+
+// Map the cache file into memory and check the block index
+void BlockCache::Open(const std::string& filename) {
+  CHECK(!filename.empty());
+  Close();
+  size_ = MapFileToMemory(filename, &addr_);
+  CHECK_GE(size_, sizeof(BlockCacheHeader));
+  memcpy(&header_, addr_, sizeof(header_));
+  CHECK_EQ(header_.magic, kBlockCacheMagic);
+  CHECK_GE(size_, sizeof(header_) +
+                  sizeof(BlockIndex) * header_.num_block);
+  index_.resize(header_.num_block);
+  if (header_.num_block > 0) {
+    memcpy(index_.data(), addr_ + sizeof(header_),
+           sizeof(BlockIndex) * header_.num_block);
+  }
+  uint64 num_row = 0;
+  for (size_t i = 0; i < index_.size(); ++i) {
+    CHECK_LE(index_[i].offset + index_[i].comp_size, size_);
+    num_row += index_[i].num_row;
+  }
+  CHECK_EQ(num_row, header_.num_row);
+}
+
+// Unmap the cache file
+void BlockCache::Close() {
+  if (addr_ != nullptr) {
+    UnmapFile(addr_, size_);
+    addr_ = nullptr;
+    size_ = 0;
+  }
+  index_.clear();
+}
+
+// Decompress and deserialize the index-th block
+void BlockCache::ReadBlock(size_t index, DMatrix* block) const {
+  CHECK_NOTNULL(block);
+  CHECK_LT(index, index_.size());
+  const BlockIndex& entry = index_[index];
+  std::vector<char> raw(entry.raw_size);
+  if (!Decompress(addr_ + entry.offset, entry.comp_size,
+                  raw.data(), raw.size())) {
+    LOG(FATAL) << "Block " << index << " of the cache file is corrupted";
+  }
+  block->SetCSR(true);
+  block->Deserialize(raw.data(), raw.size());
+  CHECK_EQ(block->row_length, entry.num_row);
+}
+
+// Each thread decodes the blocks of [begin, end)
+static void decode_thread(const BlockCache* cache,
+                          std::vector<DMatrix>* blocks,
+                          size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    cache->ReadBlock(i, &(*blocks)[i]);
+  }
+}
+
+// Decode the blocks in multi-thread, and then stitch them
+void BlockCache::ReadAll(DMatrix* matrix, int thread_number,
+                         const std::vector<int>& cpus,
+                         ThreadPool* pool) const {
+  CHECK_NOTNULL(matrix);
+  CHECK_GT(thread_number, 0);
+  /*********************************************************
+   *  Step 1: Decode blocks in multi-thread                *
+   *********************************************************/
+  size_t num_block = index_.size();
+  std::vector<DMatrix> blocks(num_block);
+  if (num_block > 0) {
+    size_t num_thread = std::min((size_t)thread_number, num_block);
+    size_t step = (num_block + num_thread - 1) / num_thread;
+    num_thread = (num_block + step - 1) / step;
+    if (pool == nullptr) { pool = Executor::Get(thread_number, cpus); }
+    std::vector<std::future<void> > result(num_thread);
+    for (size_t t = 0; t < num_thread; ++t) {
+      result[t] = pool->enqueue(std::bind(decode_thread,
+                                          this,
+                                          &blocks,
+                                          t * step,
+                                          std::min((t + 1) * step,
+                                                   num_block)));
+    }
+    for (size_t t = 0; t < num_thread; ++t) {
+      result[t].get();
+    }
+  }
+  /*********************************************************
+   *  Step 2: Stitch the blocks into one matrix            *
+   *********************************************************/
+  matrix->Release();
+  matrix->SetCSR(true);
+  matrix->SetCompact(num_block > 0 && blocks[0].is_compact);
+  matrix->ResetMatrix(header_.num_row);
+  uint64 data_size = 0;
+  for (size_t i = 0; i < num_block; ++i) {
+    data_size += blocks[i].DataSize();
+  }
+  matrix->Reserve(data_size / (matrix->is_compact ? 2 : sizeof(Node)));
+  index_t row_id = 0;
+  for (size_t i = 0; i < num_block; ++i) {
+    matrix->CopyRows(row_id, blocks[i]);
+    row_id += blocks[i].row_length;
+    blocks[i].Release();
+  }
+  matrix->SetHash(header_.hash_value_1, header_.hash_value_2);
+}
+
+}  // namespace xLearn
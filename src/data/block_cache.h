@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the block-compressed binary cache of DMatrix.
+*/
+
+#ifndef XLEARN_DATA_BLOCK_CACHE_H_
+#define XLEARN_DATA_BLOCK_CACHE_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Magic number of the block-compressed cache file
+// The blocks are in the format of "XLBIN04" since "XLBINZ3"
+const uint64 kBlockCacheMagic = 0x335a4e4942584cULL;  /* "XLBINZ3" */
+
+// Header of the block-compressed cache file
+struct BlockCacheHeader {
+  uint64 hash_value_1;
+  uint64 hash_value_2;
+  uint64 magic;
+  uint64 num_block;
+  uint64 num_row;
+  uint64 num_node;  /* Number of bytes for compact matrix */
+  DataStats stats;  /* Statistics of the whole matrix */
+};
+
+// The index entry of each block
+struct BlockIndex {
+  uint64 offset;     /* Position of the block in file */
+  uint64 comp_size;  /* Size (byte) of the compressed block */
+  uint64 raw_size;   /* Size (byte) of the serialized DMatrix */
+  uint64 num_row;    /* Number of rows in this block */
+};
+
+//------------------------------------------------------------------------------
+// BlockCache is an optional binary cache format of DMatrix, which
+// is usually much smaller than the raw binary file. The rows are
+// split into fixed-size blocks. Each block is serialized as a DMatrix
+// and compressed independently. The file layout is:
+//
+//   [BlockCacheHeader][BlockIndex * num_block][block 0][block 1]...
+//
+// Because of the block index, a block can be read without touching
+// the other blocks, and the whole file can be decoded in parallel.
+// We can use it like this:
+//
+//   /* Write the matrix to cache file */
+//   BlockCache::Write("train.bin", matrix, 65536);
+//
+//   /* Read all the data in 4 threads */
+//   BlockCache cache;
+//   cache.Open("train.bin");
+//   cache.ReadAll(&matrix, 4);
+//
+//   /* Append the new rows to the cache file */
+//   BlockCache::Append("train.bin", new_matrix, 65536);
+//
+//   /* or random access to a block */
+//   DMatrix block;
+//   cache.ReadBlock(cache.NumBlocks() - 1, &block);
+//   cache.Close();
+//------------------------------------------------------------------------------
+class BlockCache {
+ public:
+  // Constructor and Destructor
+  BlockCache() : addr_(nullptr), size_(0) { }
+  ~BlockCache() { Close(); }
+
+  // Write the matrix to a block-compressed cache
+  // file, and each block has rows_per_block rows
+  static void Write(const std::string& filename,
+                    const DMatrix& matrix,
+                    index_t rows_per_block);
+
+  // Append the rows of the matrix to the cache file as new
+  // blocks. The former blocks are copied without decoding, and
+  // the hash values of the file are replaced by the ones of the
+  // matrix. The file is re-written by renaming a temporary file
+  static void Append(const std::string& filename,
+                     const DMatrix& matrix,
+                     index_t rows_per_block);
+
+  // Open the cache file and read the block index
+  void Open(const std::string& filename);
+
+  // Release the cache file
+  void Close();
+
+  // Read the index-th block into block matrix
+  void ReadBlock(size_t index, DMatrix* block) const;
+
+  // Decode all the blocks in parallel and stitch them
+  // into the matrix, which uses the CSR storage. The
+  // threads are pinned to the cpus if it is not empty.
+  // The pool of the caller is used if it is not nullptr
+  void ReadAll(DMatrix* matrix, int thread_number,
+               const std::vector<int>& cpus = std::vector<int>(),
+               ThreadPool* pool = nullptr) const;
+
+  // Return the header of current cache file
+  const BlockCacheHeader& Header() const { return header_; }
+
+  // Return the block index
+  const std::vector<BlockIndex>& Index() const { return index_; }
+
+  // Return the number of blocks
+  size_t NumBlocks() const { return index_.size(); }
+
+ protected:
+  /* Memory-mapped cache file */
+  char* addr_;
+  uint64 size_;
+  /* File header */
+  BlockCacheHeader header_;
+  /* Block index */
+  std::vector<BlockIndex> index_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BlockCache);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_BLOCK_CACHE_H_
@@ -0,0 +1,185 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests block_cache.h
+*/
+
+#include "gtest/gtest.h"
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/data/block_cache.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+const std::string kCacheFile = "/tmp/test_block_cache.bin";
+const index_t kNumRows = 1000;
+
+// Row i has (i % 5) nodes, so there are empty rows
+void InitMatrix(DMatrix* matrix, bool compact) {
+  matrix->SetCSR(true);
+  matrix->SetCompact(compact);
+  matrix->ResetMatrix(kNumRows);
+  for (index_t i = 0; i < kNumRows; ++i) {
+    matrix->InitRow(i);
+    for (index_t j = 0; j < i % 5; ++j) {
+      matrix->AddNode(i, i + j * 7, j % 2 ? 1.0 : 0.5, j);
+    }
+    matrix->Y[i] = i % 2;
+    matrix->norm[i] = 1.0 / (i + 1);
+  }
+  matrix->SetHash(1234, 5678);
+}
+
+// Decode the rows of matrix into a CSR matrix of Node
+void DecodeMatrix(const DMatrix& matrix, DMatrix* result) {
+  result->SetCSR(true);
+  result->ResetMatrix(matrix.row_length);
+  result->CopyRows(0, matrix);
+}
+
+void CheckSameRows(const DMatrix& matrix, index_t begin,
+                   const DMatrix& block) {
+  DMatrix mat_a, mat_b;
+  DecodeMatrix(block, &mat_a);
+  DecodeMatrix(matrix, &mat_b);
+  for (index_t i = 0; i < block.row_length; ++i) {
+    EXPECT_FLOAT_EQ(mat_a.Y[i], mat_b.Y[begin+i]);
+    EXPECT_FLOAT_EQ(mat_a.norm[i], mat_b.norm[begin+i]);
+    RowView row_a = mat_a.GetRow(i);
+    RowView row_b = mat_b.GetRow(begin+i);
+    ASSERT_EQ(row_a.size(), row_b.size());
+    for (size_t j = 0; j < row_a.size(); ++j) {
+      EXPECT_EQ(row_a.begin()[j].feat_id, row_b.begin()[j].feat_id);
+      EXPECT_EQ(row_a.begin()[j].field_id, row_b.begin()[j].field_id);
+      EXPECT_FLOAT_EQ(row_a.begin()[j].feat_val,
+                      row_b.begin()[j].feat_val);
+    }
+  }
+}
+
+// Return the size of a disk file
+uint64 FileSize(const std::string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  Close(file);
+  return size;
+}
+
+void CheckCache(bool compact) {
+  DMatrix matrix;
+  InitMatrix(&matrix, compact);
+  BlockCache::Write(kCacheFile, matrix, 64);
+  BlockCache cache;
+  cache.Open(kCacheFile);
+  EXPECT_EQ(cache.NumBlocks(), 16);
+  EXPECT_EQ(cache.Header().num_row, kNumRows);
+  EXPECT_EQ(cache.Header().hash_value_1, 1234);
+  EXPECT_EQ(cache.Header().hash_value_2, 5678);
+  // Random access to the last block
+  DMatrix block;
+  cache.ReadBlock(15, &block);
+  EXPECT_EQ(block.row_length, kNumRows - 15 * 64);
+  EXPECT_EQ(block.is_compact, compact);
+  CheckSameRows(matrix, 15 * 64, block);
+  // Decode all the blocks
+  for (int thread = 1; thread <= 32; thread *= 2) {
+    DMatrix result;
+    cache.ReadAll(&result, thread);
+    EXPECT_EQ(result.row_length, kNumRows);
+    EXPECT_EQ(result.is_compact, compact);
+    EXPECT_EQ(result.hash_value_1, 1234);
+    CheckSameRows(matrix, 0, result);
+  }
+  cache.Close();
+  RemoveFile(kCacheFile.c_str());
+}
+
+TEST(BLOCK_CACHE_TEST, Write_and_Read) {
+  CheckCache(false);
+}
+
+TEST(BLOCK_CACHE_TEST, Compact_Write_and_Read) {
+  CheckCache(true);
+}
+
+TEST(BLOCK_CACHE_TEST, Smaller_than_raw) {
+  DMatrix matrix;
+  InitMatrix(&matrix, false);
+  BlockCache::Write(kCacheFile, matrix, 64);
+  matrix.Serialize(kCacheFile + ".raw");
+  EXPECT_LT(FileSize(kCacheFile), FileSize(kCacheFile + ".raw"));
+  RemoveFile(kCacheFile.c_str());
+  RemoveFile((kCacheFile + ".raw").c_str());
+}
+
+TEST(BLOCK_CACHE_TEST, Append) {
+  for (int t = 0; t < 2; ++t) {
+    bool compact = t == 1;
+    DMatrix matrix;
+    InitMatrix(&matrix, compact);
+    // Write the head rows and append the tail rows
+    index_t split = 300;
+    DMatrix head, tail;
+    head.SetCSR(true);
+    head.SetCompact(compact);
+    head.ResetMatrix(split);
+    head.CopyRows(0, matrix, 0, split);
+    tail.SetCSR(true);
+    tail.SetCompact(compact);
+    tail.ResetMatrix(kNumRows - split);
+    tail.CopyRows(0, matrix, split, kNumRows);
+    head.SetHash(1, 2);
+    tail.SetHash(1234, 5678);
+    BlockCache::Write(kCacheFile, head, 64);
+    BlockCache::Append(kCacheFile, tail, 64);
+    BlockCache cache;
+    cache.Open(kCacheFile);
+    EXPECT_EQ(cache.NumBlocks(), 5 + 11);
+    EXPECT_EQ(cache.Header().num_row, kNumRows);
+    EXPECT_EQ(cache.Header().hash_value_1, 1234);
+    EXPECT_EQ(cache.Header().hash_value_2, 5678);
+    EXPECT_EQ(cache.Header().stats.num_row, kNumRows);
+    EXPECT_EQ(cache.Header().stats.num_node,
+              matrix.GetStats().num_node);
+    DMatrix result;
+    cache.ReadAll(&result, 4);
+    EXPECT_EQ(result.row_length, kNumRows);
+    CheckSameRows(matrix, 0, result);
+    cache.Close();
+    RemoveFile(kCacheFile.c_str());
+  }
+}
+
+TEST(BLOCK_CACHE_TEST, Empty_matrix) {
+  DMatrix matrix;
+  matrix.SetCSR(true);
+  matrix.ResetMatrix(0);
+  BlockCache::Write(kCacheFile, matrix, 64);
+  BlockCache cache;
+  cache.Open(kCacheFile);
+  EXPECT_EQ(cache.NumBlocks(), 0);
+  DMatrix result;
+  cache.ReadAll(&result, 4);
+  EXPECT_EQ(result.row_length, 0);
+  RemoveFile(kCacheFile.c_str());
+}
+
+}  // namespace xLearn
@@ -23,10 +23,12 @@ This file defines the basic data structures used by xLearn.
 #ifndef XLEARN_DATA_DATA_STRUCTURE_H_
 #define XLEARN_DATA_DATA_STRUCTURE_H_
 
+#include <algorithm>
 #include <vector>
 
 #include "src/base/common.h"
 #include "src/base/file_util.h"
+#include "src/base/huge_page.h"
 
 namespace xLearn {
 
@@ -37,7 +39,10 @@ namespace xLearn {
 typedef float real_t;
 
 //------------------------------------------------------------------------------
-// We use 32 bits unsigned int to store feature index
+// We use 32 bits unsigned int to store feature index. The 64-bit
+// ids of the input are hashed into it (-hash), and the offsets of
+// the latent factor, which has index * num_field * 2K floats for
+// FFM, are computed in 64 bits
 //------------------------------------------------------------------------------
 typedef uint32 index_t;
 
@@ -48,6 +53,94 @@ typedef uint32 index_t;
 const int kAlign = 4;
 const int kAlignByte = 16;
 
+//------------------------------------------------------------------------------
+// The layout of a latent block of FFM, which has aligned_k weights and
+// their aligned_k gradient caches (2 * aligned_k floats). The interleaved
+// layout keeps each kAlign weights next to their caches, so one 128-bit
+// chunk of weights and its caches are in the same cache line. The split
+// layout has the aligned_k contiguous weights followed by the caches,
+// which is the layout of the FM blocks, so the wide registers load the
+// weights without the shuffle of the chunks. The kernels are compiled
+// for each layout (see score_kernel.h)
+//
+// The split layouts of the reduced caches have the aligned_k weights
+// followed by the aligned_k caches in 16 or 8 bits, so the block is
+// 3/4 or 5/8 of the fp32 one. The cache of AdaGrad only sets the step
+// size, so its precision matters much less than the one of the weight
+//
+// The shared split layout has one cache for the whole latent vector,
+// which adds the mean squared gradient of its weights. The aligned_k
+// weights are followed by the cache and kAlign - 1 floats of padding,
+// so the block is aligned_k + kAlign floats rather than 2 * aligned_k
+//------------------------------------------------------------------------------
+enum LatentLayout {
+  kLayoutInterleaved = 0,
+  kLayoutSplit = 1,
+  kLayoutSplitFP16 = 2,
+  kLayoutSplitBF16 = 3,
+  kLayoutSplitLog8 = 4,
+  kLayoutSplitShared = 5
+};
+const int kNumLatentLayouts = 6;
+
+//------------------------------------------------------------------------------
+// The gradient cache c (c >= 1) of a reduced layout is stored as the
+// code of the bits of the float c, which is (bits - kBias) >> kShift,
+// and c is at most kMaxBits. The codes are bfloat16, fp16 (whose
+// exponent is rebiased) and 8 bits of 4 exponent bits and 4 mantissa
+// bits above 1.0, whose steps are 1/16 octave (log-quantized), and
+// each of them is decoded by a shift and an add in the registers
+//------------------------------------------------------------------------------
+template <LatentLayout L>
+struct LatentCacheCode {
+  static const index_t kBytes = 4;
+};
+
+template <>
+struct LatentCacheCode<kLayoutSplitFP16> {
+  static const index_t kBytes = 2;
+  static const int kShift = 13;
+  static const uint32 kBias = 0x38000000u;
+  static const uint32 kMaxBits = 0x477fe000u;  /* 65504 */
+};
+
+template <>
+struct LatentCacheCode<kLayoutSplitBF16> {
+  static const index_t kBytes = 2;
+  static const int kShift = 16;
+  static const uint32 kBias = 0;
+  static const uint32 kMaxBits = 0x7f7f0000u;
+};
+
+template <>
+struct LatentCacheCode<kLayoutSplitLog8> {
+  static const index_t kBytes = 1;
+  static const int kShift = 19;
+  static const uint32 kBias = 0x3f800000u;      /* 1.0 */
+  static const uint32 kMaxBits = 0x47780000u;  /* 63488 */
+};
+
+// Bytes of a gradient cache of the layout
+inline index_t LatentCacheBytes(LatentLayout layout) {
+  switch (layout) {
+    case kLayoutSplitFP16: return 2;
+    case kLayoutSplitBF16: return 2;
+    case kLayoutSplitLog8: return 1;
+    default: return 4;
+  }
+}
+
+// Number of floats of a latent block of aligned_k, and the
+// aligned_k of a block of align0 floats
+inline index_t LatentBlockSize(LatentLayout layout, index_t aligned_k) {
+  if (layout == kLayoutSplitShared) { return aligned_k + kAlign; }
+  return aligned_k + aligned_k * LatentCacheBytes(layout) / 4;
+}
+inline index_t LatentBlockK(LatentLayout layout, index_t align0) {
+  if (layout == kLayoutSplitShared) { return align0 - kAlign; }
+  return align0 * 4 / (4 + LatentCacheBytes(layout));
+}
+
 //------------------------------------------------------------------------------
 // Node is used to store information for each feature
 // For tasks like lr and fm, we just need to store the feature id
@@ -66,15 +159,298 @@ struct Node {
 //------------------------------------------------------------------------------
 typedef std::vector<Node> SparseRow;
 
+// The order of the nodes by field and then by feature
+inline bool NodeFieldLess(const Node& a, const Node& b) {
+  if (a.field_id != b.field_id) { return a.field_id < b.field_id; }
+  return a.feat_id < b.feat_id;
+}
+
+//------------------------------------------------------------------------------
+// RowView is a lightweight, read-only view of one row of data. It only
+// holds two pointers to a contiguous range of Node, so it can be built
+// on top of a SparseRow or on top of the contiguous CSR storage of the
+// DMatrix without any copy. The score functions and the loss functions
+// iterate the data through this view:
+//
+//    RowView row = matrix.GetRow(i);
+//    for (RowView::const_iterator iter = row.begin();
+//         iter != row.end(); ++iter) {
+//      ... iter->feat_id ...
+//    }
+//
+// The row of a matrix that has the dense block (see DMatrix) also has
+// dense_size() dense values, and dense()[j] is the value of feature j.
+// The nodes of such a row have the features >= dense_size()
+//
+// The row of a binary matrix (see DMatrix::DetectBinary()) is marked
+// by is_binary(), and its values are all 1.0, so the score functions
+// can use the kernels that never load them
+//------------------------------------------------------------------------------
+struct RowView {
+  typedef const Node* const_iterator;
+
+  RowView() : begin_(nullptr), end_(nullptr),
+              dense_(nullptr), dense_size_(0), binary_(false) { }
+  RowView(const Node* begin, const Node* end,
+          const real_t* dense = nullptr, index_t dense_size = 0)
+    : begin_(begin), end_(end), dense_(dense), dense_size_(dense_size),
+      binary_(false) { }
+  // Build a view on a SparseRow. A nullptr row
+  // is treated as an empty row
+  RowView(const SparseRow* row)
+    : dense_(nullptr), dense_size_(0), binary_(false) {
+    if (row == nullptr || row->empty()) {
+      begin_ = end_ = nullptr;
+    } else {
+      begin_ = row->data();
+      end_ = begin_ + row->size();
+    }
+  }
+
+  inline const_iterator begin() const { return begin_; }
+  inline const_iterator end() const { return end_; }
+  inline size_t size() const { return end_ - begin_; }
+  inline bool empty() const { return begin_ == end_; }
+  inline const Node& operator[](size_t i) const { return begin_[i]; }
+
+  // The dense values of features [0, dense_size())
+  inline const real_t* dense() const { return dense_; }
+  inline index_t dense_size() const { return dense_size_; }
+  inline bool has_dense() const { return dense_size_ > 0; }
+
+  // True if all the values of the row are 1.0
+  inline bool is_binary() const { return binary_; }
+
+  const Node* begin_;
+  const Node* end_;
+  const real_t* dense_;
+  index_t dense_size_;
+  bool binary_;
+};
+
+//------------------------------------------------------------------------------
+// The compact encoding of a row. Most of the nodes in real-world data
+// have a small field id and a binary (1.0) feature value, so each node
+// is encoded as a few bytes instead of the 12-byte Node:
+//
+//   tag varint  : (zigzag(feat_id - last_feat_id) << 1) | is_binary
+//   field varint: field_id (one byte for less than 128 fields)
+//   value       : 4-byte real_t, omitted if is_binary == 1
+//
+// The delta of feat_id is computed in a row, and the last_feat_id of the
+// first node is 0. The compact rows can not be read by the score functions
+// directly, and they are decoded into Node by DecodeCompactRow().
+//------------------------------------------------------------------------------
+// Append a varint to the buffer
+inline void EncodeVarint(uint64 value, std::vector<uint8>& buf) {
+  while (value >= 0x80) {
+    buf.push_back((uint8)(value | 0x80));
+    value >>= 7;
+  }
+  buf.push_back((uint8)value);
+}
+
+// Read a varint from the buffer and return the next position
+inline const uint8* DecodeVarint(const uint8* ptr, uint64* value) {
+  uint64 result = 0;
+  int shift = 0;
+  while (*ptr & 0x80) {
+    result |= (uint64)(*ptr & 0x7f) << shift;
+    shift += 7;
+    ptr++;
+  }
+  result |= (uint64)(*ptr) << shift;
+  *value = result;
+  return ptr + 1;
+}
+
+// Append one node to the compact buffer
+inline void EncodeCompactNode(const Node& node,
+                              index_t last_feat_id,
+                              std::vector<uint8>& buf) {
+  int64 delta = (int64)node.feat_id - (int64)last_feat_id;
+  uint64 zigzag = (uint64)((delta << 1) ^ (delta >> 63));
+  bool is_binary = (node.feat_val == 1.0);
+  EncodeVarint((zigzag << 1) | (is_binary ? 1 : 0), buf);
+  EncodeVarint(node.field_id, buf);
+  if (!is_binary) {
+    const uint8* val = reinterpret_cast<const uint8*>(&node.feat_val);
+    buf.insert(buf.end(), val, val + sizeof(real_t));
+  }
+}
+
+// Return the number of nodes of the compact row [begin, end)
+inline uint64 CountCompactNodes(const uint8* begin, const uint8* end) {
+  uint64 count = 0, tag = 0, field = 0;
+  while (begin < end) {
+    begin = DecodeVarint(begin, &tag);
+    begin = DecodeVarint(begin, &field);
+    if (!(tag & 1)) { begin += sizeof(real_t); }
+    count++;
+  }
+  return count;
+}
+
+// Decode the compact row [begin, end) and append the nodes
+inline void DecodeCompactRow(const uint8* begin,
+                             const uint8* end,
+                             std::vector<Node>& nodes) {
+  index_t last_feat_id = 0;
+  uint64 tag = 0, field = 0;
+  while (begin < end) {
+    Node node;
+    begin = DecodeVarint(begin, &tag);
+    begin = DecodeVarint(begin, &field);
+    uint64 zigzag = tag >> 1;
+    int64 delta = (int64)(zigzag >> 1) ^ -(int64)(zigzag & 1);
+    node.feat_id = (index_t)((int64)last_feat_id + delta);
+    node.field_id = (index_t)field;
+    if (tag & 1) {
+      node.feat_val = 1.0;
+    } else {
+      memcpy(&node.feat_val, begin, sizeof(real_t));
+      begin += sizeof(real_t);
+    }
+    nodes.push_back(node);
+    last_feat_id = node.feat_id;
+  }
+}
+
+//------------------------------------------------------------------------------
+// DataStats is the statistics of a dataset, which is computed when
+// the txt file is converted to the binary file and it is stored in
+// the header of binary file. The Solver uses it to initialize the
+// Model without a full pass over the data. The max_feat and max_field
+// are 0 for the dataset without any node.
+//------------------------------------------------------------------------------
+struct DataStats {
+  /* Number of rows */
+  uint64 num_row = 0;
+  /* Number of nodes (nnz) */
+  uint64 num_node = 0;
+  /* Max feature id and max field id */
+  uint64 max_feat = 0;
+  uint64 max_field = 0;
+  /* Number of rows that y > 0 */
+  uint64 num_positive = 0;
+  /* Sum, min and max of y */
+  double label_sum = 0;
+  double label_min = 0;
+  double label_max = 0;
+
+  // Add a row to the statistics
+  void AddRow(const RowView& row, real_t y) {
+    if (num_row == 0) {
+      label_min = label_max = y;
+    } else {
+      if (y < label_min) { label_min = y; }
+      if (y > label_max) { label_max = y; }
+    }
+    num_row++;
+    num_node += row.size() + row.dense_size();
+    if (y > 0) { num_positive++; }
+    label_sum += y;
+    if (row.dense_size() > max_feat + 1) { max_feat = row.dense_size() - 1; }
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      if (iter->feat_id > max_feat) { max_feat = iter->feat_id; }
+      if (iter->field_id > max_field) { max_field = iter->field_id; }
+    }
+  }
+
+  // Merge the statistics of another dataset
+  void Merge(const DataStats& other) {
+    if (other.num_row == 0) { return; }
+    if (num_row == 0) {
+      *this = other;
+      return;
+    }
+    num_row += other.num_row;
+    num_node += other.num_node;
+    if (other.max_feat > max_feat) { max_feat = other.max_feat; }
+    if (other.max_field > max_field) { max_field = other.max_field; }
+    num_positive += other.num_positive;
+    label_sum += other.label_sum;
+    if (other.label_min < label_min) { label_min = other.label_min; }
+    if (other.label_max > label_max) { label_max = other.label_max; }
+  }
+};
+
+//------------------------------------------------------------------------------
+// The binary file of DMatrix starts with the BinaryHeader, and it
+// is followed by the sections of Y, norm, row offset and nodes:
+//
+//   | BinaryHeader | Y | norm | offset (row_length+1) | Node (num_node) |
+//
+// The matrix of weighted rows has the section of weight after norm.
+// For the compact matrix, the last section stores the compact rows
+// and the row offset is the offset in bytes. The matrix that has the
+// dense block has the section of dense values (row_length * dense_width)
+// at the end.
+//
+// Each section is padded to 8 bytes. The two hash values are placed at
+// the begining of the file, so the Reader can check them quickly. The
+// magic number will be changed when the file format is changed, and
+// the old binary file will be re-generated from the txt file. The
+// header also stores the DataStats of the matrix since "XLBIN03", the
+// weight of the rows since "XLBIN04" and the dense block since "XLBIN05".
+//------------------------------------------------------------------------------
+const uint64 kBinaryMagic = 0x35304e4942584cULL;  /* "XLBIN05" */
+
+struct BinaryHeader {
+  uint64 hash_value_1;
+  uint64 hash_value_2;
+  uint64 magic;
+  uint64 row_length;
+  /* Number of Node, or number of bytes for compact rows */
+  uint64 num_node;
+  /* 1 for the compact encoding and 0 for Node */
+  uint64 is_compact;
+  /* 1 if the section of weight exists */
+  uint64 has_weight;
+  /* Number of dense values of each row */
+  uint64 dense_width;
+  /* Statistics of the matrix */
+  DataStats stats;
+};
+
+//------------------------------------------------------------------------------
+// The cost model of the rows, which is used to split a batch into the
+// chunks of the same cost. The cost of the score functions grows with
+// the number of nodes (nnz) of linear and FM, and with the square of it
+// for FFM. Each row costs 1 more for the loss and the update of bias.
+//------------------------------------------------------------------------------
+enum RowCost {
+  kRowCostNone = 0,       /* no cost is computed */
+  kRowCostLinear = 1,     /* nnz + 1 */
+  kRowCostQuadratic = 2   /* nnz * nnz + 1 */
+};
+
 //------------------------------------------------------------------------------
 // DMatrix (data matrix) is used to store a batch of the dataset.
 // It can be the whole data set used in in-memory training, or just a
 // working set in on-disk training, because for many large-scale ML
 // problems, we cannot load all the training data into memory at once.
 // So we can load a small batch of dataset in DMatrix at each samplling.
-// We can use the DMatrix like this:
+//
+// DMatrix has two kinds of storage. By default, each row is stored in a
+// separately allocated SparseRow. In the CSR mode, all the nodes are stored
+// in one contiguous array (csr_node) with a row-offset array (csr_offset),
+// and the i-th row is [csr_node[csr_offset[i]], csr_node[csr_offset[i+1]]).
+// The CSR mode avoids one heap allocation per row and makes the rows
+// adjacent in memory. Note that in CSR mode the rows must be filled in
+// order.
+//
+// The dense numeric features can be stored in the dense block instead
+// of the nodes, which has dense_width values of each row in one array
+// (row-major), and the value j of a row is the value of feature j. Each
+// dense value costs 4 bytes instead of a 12-byte Node, and the score
+// functions read the dense values and their parameters in order. The
+// nodes of the rows can still store the sparse features, whose ids
+// are >= dense_width. We can use the DMatrix like this:
 //
 //    DMatrix matrix;
+//    matrix.SetCSR(true);      /* Optional. Use CSR storage */
 //    matrix.ResetMatrix(10);   /* Init 10 rows */
 //    for (int i = 0; i < 10; ++i) {
 //      matrix.Y[i] = ...
@@ -84,13 +460,20 @@ typedef std::vector<Node> SparseRow;
 //    matrix.Serialize("/tmp/test.bin");
 //    DMatrix new_matrix;
 //    new_matrix.Deserialize("/tmp/test.bin");
+//    /* Or map the binary file as a read-only CSR matrix */
+//    new_matrix.MmapDeserialize("/tmp/test.bin");
 //
+//    /* The weight of a row is 1.0 unless it is set */
+//    matrix.SetWeight(3, 50.0);
+//    /* Optional. The first 4 features of each row are dense */
+//    matrix.SetDenseWidth(4);
+//    matrix.DenseRow(0)[2] = 0.5;
 //    /* We can access the matrix like this */
 //    for (int i = 0; i < matrix.row_length; ++i) {
 //      ... matrix.Y[i] ..   /* access y */
-//      SparseRow *row = matrix.row[i];
-//      for (SparseRow::iterator iter = row->begin();
-//           iter != row->end(); ++iter) {
+//      RowView row = matrix.GetRow(i);
+//      for (RowView::const_iterator iter = row.begin();
+//           iter != row.end(); ++iter) {
 //        ... iter->field_id ...   /* access field_id */
 //        ... iter->feat_id ...    /* access feat_id */
 //        ... iter->feat_val ...   /* access feat_val */
@@ -99,9 +482,62 @@ typedef std::vector<Node> SparseRow;
 //------------------------------------------------------------------------------
 struct DMatrix {
   // Constructor and Destructor
-  DMatrix() { }
+  DMatrix()
+    : hash_value_1(0),
+      hash_value_2(0),
+      row_length(0),
+      is_csr(false),
+      is_compact(false),
+      huge_pages(false),
+      dense_width(0),
+      is_binary(false),
+      csr_cur_row_(-1),
+      last_feat_id_(0),
+      mmap_addr_(nullptr),
+      mmap_size_(0),
+      mmap_node_(nullptr),
+      mmap_offset_(nullptr),
+      mmap_dense_(nullptr) { }
   ~DMatrix() { Release(); }
 
+  // Use the contiguous CSR storage or not. This flag
+  // will be kept by ResetMatrix() and Release()
+  void SetCSR(bool csr) {
+    CHECK_EQ(row_length, 0);
+    is_csr = csr;
+  }
+
+  // Use the compact encoding of rows or not. The compact matrix
+  // is always stored in CSR mode, and it is used as a data buffer
+  // because the rows need to be decoded by CopyRow() before we
+  // can use them. This flag will be kept by ResetMatrix() and Release()
+  void SetCompact(bool compact) {
+    CHECK_EQ(row_length, 0);
+    is_compact = compact;
+    if (compact) { is_csr = true; }
+  }
+
+  // Advise the transparent huge pages of the buffer of Reserve(),
+  // which reduces the TLB misses of a large matrix. This flag
+  // will be kept by ResetMatrix() and Release()
+  void SetHugePages(bool huge) { huge_pages = huge; }
+
+  // Store width dense values of each row in the dense block, and
+  // 0 (by default) means no dense block. The dense values of all
+  // the rows are set to 0. The width will be kept by ResetMatrix()
+  // and Release()
+  void SetDenseWidth(index_t width) {
+    CHECK(!read_only());
+    dense_width = width;
+    dense.assign((uint64)row_length * width, 0);
+  }
+
+  // Return the dense values of the row_id-th row
+  inline real_t* DenseRow(index_t row_id) {
+    CHECK(!read_only());
+    return dense.data() + (uint64)row_id * dense_width;
+  }
+
   // Reset memory for the DMatrix
   // This function will first release the original
   // memory of the DMatrix, and then re-allocate memory
@@ -111,28 +547,206 @@ struct DMatrix {
     CHECK_GE(length, 0);
     this->Release();
     row_length = length;
-    row.resize(length, nullptr);
+    row_cost.clear();
+    if (is_csr) {
+      csr_offset.resize(length+1, 0);
+    } else {
+      row.resize(length, nullptr);
+    }
     Y.resize(length, 0);
     // we set norm to 1.0 by default, which means
     // that we don't use normalization
     norm.resize(length, 1.0);
+    weight.clear();
+    dense.resize((uint64)length * dense_width, 0);
+    is_binary = false;
+  }
+
+  // Reset the DMatrix to a given length but keep the memory
+  // that has been allocated, which can be used when we fill the
+  // same matrix again and again, e.g., the working set in samplling.
+  // Y will be set to 0 and norm will be set to 1.0. The view of
+  // SetView() is dropped, and the own storage is used again
+  void ReuseMatrix(index_t length) {
+    CHECK(!IsMapped());
+    drop_view();
+    row_length = length;
+    row_cost.clear();
+    if (is_csr) {
+      csr_node.clear();
+      compact_data.clear();
+      csr_offset.assign(length+1, 0);
+      csr_cur_row_ = -1;
+    } else {
+      for (size_t i = length; i < row.size(); ++i) {
+        delete row[i];
+      }
+      row.resize(length, nullptr);
+      for (size_t i = 0; i < row.size(); ++i) {
+        if (row[i] != nullptr) { row[i]->clear(); }
+      }
+    }
+    Y.assign(length, 0);
+    norm.assign(length, 1.0);
+    weight.clear();
+    dense.assign((uint64)length * dense_width, 0);
+    is_binary = false;
   }
 
   // Release memory for DMatrix
   // Note that a typical alternative that forces a
   // reallocation is to use swap(), instead of using clear()
   void Release() {
-    row_length = 0;
     // Delete Y
     std::vector<real_t>().swap(Y);
-    for (int i = 0; i < row_length; ++i) {
+    for (size_t i = 0; i < row.size(); ++i) {
       // Delete Node
-      std::vector<Node>().swap(*row[i]);
+      delete row[i];
     }
     // Delete row
     std::vector<SparseRow*>().swap(row);
-    // Delete norm
+    // Delete CSR storage
+    std::vector<Node>().swap(csr_node);
+    std::vector<uint8>().swap(compact_data);
+    std::vector<uint64>().swap(csr_offset);
+    csr_cur_row_ = -1;
+    // Unmap the binary file
+    if (mmap_addr_ != nullptr) {
+      UnmapFile(mmap_addr_, mmap_size_);
+      mmap_addr_ = nullptr;
+      mmap_size_ = 0;
+    }
+    drop_view();
+    // Delete norm, weight and the dense block
     std::vector<real_t>().swap(norm);
+    std::vector<real_t>().swap(weight);
+    std::vector<real_t>().swap(dense);
+    std::vector<uint64>().swap(row_cost);
+    row_length = 0;
+    is_binary = false;
+  }
+
+  // Compute row_cost of all the rows by the cost model. The
+  // nnz of a compact row is estimated by its size in bytes,
+  // which is at least 2 bytes per node
+  void ComputeRowCost(RowCost cost) {
+    row_cost.clear();
+    if (cost == kRowCostNone) { return; }
+    row_cost.resize(row_length+1);
+    row_cost[0] = 0;
+    for (index_t i = 0; i < row_length; ++i) {
+      uint64 nnz = 0;
+      if (is_compact) {
+        nnz = (row_offset(i+1) - row_offset(i)) / 2;
+      } else if (is_csr) {
+        nnz = row_offset(i+1) - row_offset(i);
+      } else {
+        nnz = row[i] == nullptr ? 0 : row[i]->size();
+      }
+      nnz += dense_width;
+      uint64 c = cost == kRowCostQuadratic ? nnz * nnz + 1 : nnz + 1;
+      row_cost[i+1] = row_cost[i] + c;
+    }
+  }
+
+  // Return the number of nodes and dense values of the row_id-th
+  // row. The compact row is scanned without decoding the nodes
+  inline uint64 RowNNZ(index_t row_id) const {
+    if (is_compact) {
+      return CountCompactNodes(compact_base() + row_offset(row_id),
+                               compact_base() + row_offset(row_id+1)) +
+             dense_width;
+    }
+    if (mmap_addr_ != nullptr || is_csr) {
+      return GetRow(row_id).size() + dense_width;
+    }
+    return (row[row_id] == nullptr ? 0 : row[row_id]->size()) +
+           dense_width;
+  }
+
+  // Return the raw bytes of the row_id-th row, i.e., its nodes or
+  // its compact encoding, so that the equal rows have equal bytes
+  inline void RowData(index_t row_id, const char** data,
+                      uint64* size) const {
+    if (is_compact) {
+      *data = reinterpret_cast<const char*>(compact_base() +
+                                            row_offset(row_id));
+      *size = row_offset(row_id+1) - row_offset(row_id);
+      return;
+    }
+    if (!is_csr && mmap_addr_ == nullptr && row[row_id] == nullptr) {
+      *data = nullptr;
+      *size = 0;
+      return;
+    }
+    RowView view = GetRow(row_id);
+    *data = reinterpret_cast<const char*>(view.begin());
+    *size = view.size() * sizeof(Node);
+  }
+
+  // Return true if any row has a weight other than 1.0
+  inline bool HasWeight() const { return !weight.empty(); }
+
+  // Return the weight of the row_id-th row
+  inline real_t RowWeight(index_t row_id) const {
+    return weight.empty() ? 1.0 : weight[row_id];
+  }
+
+  // Set the weight of the row_id-th row. The weight of all the
+  // rows is allocated by the first weight other than 1.0
+  void SetWeight(index_t row_id, real_t w) {
+    CHECK_GT(row_length, row_id);
+    if (weight.empty()) {
+      if (w == 1.0) { return; }
+      weight.assign(row_length, 1.0);
+    }
+    weight[row_id] = w;
+  }
+
+  // Return true if row_cost has the cost of current rows
+  inline bool HasRowCost() const {
+    return !row_cost.empty() && row_cost.size() == row_length + 1;
+  }
+
+  // Reserve the node storage for num_node nodes in CSR mode,
+  // so that the parser can append all the nodes of the matrix
+  // into one buffer without any re-allocation, and the whole
+  // matrix is freed at once by Release(). For the compact matrix,
+  // we reserve the minimal size of the nodes (2 bytes per node)
+  void Reserve(uint64 num_node) {
+    CHECK(!read_only());
+    if (!is_csr) { return; }
+    if (is_compact) {
+      compact_data.reserve(num_node * 2);
+      if (huge_pages) {
+        AdviseHugePages(compact_data.data(), compact_data.capacity());
+      }
+    } else {
+      csr_node.reserve(num_node);
+      if (huge_pages) {
+        AdviseHugePages(csr_node.data(),
+                        csr_node.capacity() * sizeof(Node));
+      }
+    }
+  }
+
+  // Make sure that the row_id-th row exists, even if it is
+  // an empty row. In CSR mode, the rows must be initialized
+  // in order, and all the former rows will be closed
+  void InitRow(index_t row_id) {
+    CHECK_GT(row_length, row_id);
+    CHECK(!read_only());
+    if (is_csr) {
+      CHECK_GE((int64)row_id, csr_cur_row_);
+      uint64 size = is_compact ? compact_data.size() : csr_node.size();
+      while (csr_cur_row_ < (int64)row_id) {
+        csr_cur_row_++;
+        csr_offset[csr_cur_row_+1] = size;
+        last_feat_id_ = 0;
+      }
+    } else if (row[row_id] == nullptr) {
+      row[row_id] = new SparseRow;
+    }
   }
 
   // Add node to matrix
@@ -141,15 +755,263 @@ struct DMatrix {
   void AddNode(index_t row_id,  index_t feat_id,
                real_t feat_val, index_t field_id = 0) {
     CHECK_GT(row_length, row_id);
-    // Allocate memory for the first adding
-    if (row[row_id] == nullptr) {
-      row[row_id] = new SparseRow;
-    }
+    CHECK(!read_only());
     Node node;
     node.field_id = field_id;
     node.feat_id = feat_id;
     node.feat_val = feat_val;
-    row[row_id]->push_back(node);
+    if (is_csr) {
+      if ((int64)row_id != csr_cur_row_) {
+        InitRow(row_id);
+      }
+      if (is_compact) {
+        EncodeCompactNode(node, last_feat_id_, compact_data);
+        last_feat_id_ = feat_id;
+        csr_offset[row_id+1] = compact_data.size();
+      } else {
+        csr_node.push_back(node);
+        csr_offset[row_id+1] = csr_node.size();
+      }
+    } else {
+      // Allocate memory for the first adding
+      if (row[row_id] == nullptr) {
+        row[row_id] = new SparseRow;
+      }
+      row[row_id]->push_back(node);
+    }
+  }
+
+  // Get a read-only view of the row_id-th row, which is empty
+  // if it is not initialized (see InitRow()). The compact
+  // matrix cannot be accessed by GetRow()
+  inline RowView GetRow(index_t row_id) const {
+    CHECK(!is_compact);
+    RowView view;
+    if (mmap_node_ != nullptr) {
+      view = RowView(mmap_node_ + mmap_offset_[row_id],
+                     mmap_node_ + mmap_offset_[row_id+1]);
+    } else if (is_csr) {
+      const Node* base = csr_node.data();
+      view = RowView(base + row_offset(row_id),
+                     base + row_offset(row_id+1));
+    } else {
+      view = RowView(row[row_id]);
+    }
+    if (dense_width > 0) {
+      view.dense_ = dense_row(row_id);
+      view.dense_size_ = dense_width;
+    }
+    view.binary_ = is_binary;
+    return view;
+  }
+
+  // Copy one row from another matrix into the row_id-th row
+  // of current matrix, including the Y and the norm. The rows
+  // of a compact matrix will be decoded here
+  void CopyRow(index_t row_id, const DMatrix& src, index_t src_id) {
+    CHECK(!is_compact);
+    InitRow(row_id);
+    SparseRow& nodes = is_csr ? csr_node : *row[row_id];
+    if (!is_csr) { nodes.clear(); }
+    if (src.is_compact) {
+      const uint8* base = src.compact_base();
+      DecodeCompactRow(base + src.row_offset(src_id),
+                       base + src.row_offset(src_id+1),
+                       nodes);
+    } else {
+      RowView src_row = src.GetRow(src_id);
+      nodes.insert(nodes.end(), src_row.begin(), src_row.end());
+    }
+    if (is_csr) { csr_offset[row_id+1] = csr_node.size(); }
+    Y[row_id] = src.Y[src_id];
+    norm[row_id] = src.norm[src_id];
+    if (src.HasWeight() || HasWeight()) {
+      SetWeight(row_id, src.RowWeight(src_id));
+    }
+    copy_dense(row_id, src, src_id, 1);
+  }
+
+  // Copy all the rows of src into the rows of current matrix,
+  // starting from the row_id-th row. If both of the matrices use
+  // the same CSR storage, the nodes are copied in one shot, which
+  // is used to stitch the chunks of multi-thread parsing. Note that
+  // all of the copied rows are closed for AddNode()
+  void CopyRows(index_t row_id, const DMatrix& src) {
+    CopyRows(row_id, src, 0, src.row_length);
+  }
+
+  // Copy the rows [begin, end) of src to this matrix
+  // from the row_id-th row
+  void CopyRows(index_t row_id, const DMatrix& src,
+                index_t begin, index_t end) {
+    CHECK_LE(begin, end);
+    CHECK_LE(end, src.row_length);
+    index_t count = end - begin;
+    CHECK_GE(row_length, row_id + count);
+    if (count == 0) { return; }
+    if (is_csr && src.is_csr && is_compact == src.is_compact) {
+      InitRow(row_id);
+      uint64 base = 0;
+      uint64 len = src.row_offset(end) - src.row_offset(begin);
+      if (is_compact) {
+        base = compact_data.size();
+        const uint8* data = src.compact_base() + src.row_offset(begin);
+        compact_data.insert(compact_data.end(), data, data + len);
+      } else {
+        base = csr_node.size();
+        RowView first = src.GetRow(begin);
+        csr_node.insert(csr_node.end(), first.begin(), first.begin() + len);
+      }
+      for (index_t i = 0; i < count; ++i) {
+        csr_offset[row_id+i+1] =
+          base + src.row_offset(begin+i+1) - src.row_offset(begin);
+        Y[row_id+i] = src.Y[begin+i];
+        norm[row_id+i] = src.norm[begin+i];
+        if (src.HasWeight() || HasWeight()) {
+          SetWeight(row_id+i, src.RowWeight(begin+i));
+        }
+      }
+      csr_cur_row_ = (int64)(row_id + count) - 1;
+      last_feat_id_ = 0;
+      copy_dense(row_id, src, begin, count);
+    } else {
+      for (index_t i = 0; i < count; ++i) {
+        CopyRow(row_id+i, src, begin+i);
+      }
+    }
+  }
+
+  // Sort the nodes of each row by field and then by feature
+  // (see NodeFieldLess), so the nodes of the same field are
+  // adjacent. The compact rows are decoded and encoded again.
+  // Note that all of the rows are closed for AddNode()
+  void SortRows() {
+    CHECK(!read_only());
+    if (!is_csr) {
+      for (index_t i = 0; i < row_length; ++i) {
+        if (row[i] == nullptr) { continue; }
+        std::stable_sort(row[i]->begin(), row[i]->end(), NodeFieldLess);
+      }
+      return;
+    }
+    // The rows that are not initialized are empty
+    if (row_length > 0) { InitRow(row_length - 1); }
+    if (!is_compact) {
+      for (index_t i = 0; i < row_length; ++i) {
+        std::stable_sort(csr_node.begin() + csr_offset[i],
+                         csr_node.begin() + csr_offset[i+1],
+                         NodeFieldLess);
+      }
+      return;
+    }
+    std::vector<uint8> data;
+    data.reserve(compact_data.size());
+    std::vector<Node> nodes;
+    for (index_t i = 0; i < row_length; ++i) {
+      nodes.clear();
+      DecodeCompactRow(compact_data.data() + csr_offset[i],
+                       compact_data.data() + csr_offset[i+1],
+                       nodes);
+      std::stable_sort(nodes.begin(), nodes.end(), NodeFieldLess);
+      csr_offset[i] = data.size();
+      index_t last_feat_id = 0;
+      for (size_t k = 0; k < nodes.size(); ++k) {
+        EncodeCompactNode(nodes[k], last_feat_id, data);
+        last_feat_id = nodes[k].feat_id;
+      }
+    }
+    csr_offset[row_length] = data.size();
+    compact_data.swap(data);
+    last_feat_id_ = 0;
+  }
+
+  // Set is_binary if all the values of the nodes are 1.0 and there
+  // is no dense block, e.g., the one-hot features of CTR data. It is
+  // checked once when the data is loaded, and the rows of the matrix
+  // are then scored by the kernels that do not load the values. The
+  // flag is cleared when the rows are reset, and it is kept by
+  // SetView(). The compact rows are decoded for the check
+  void DetectBinary() {
+    is_binary = dense_width == 0;
+    std::vector<Node> nodes;
+    for (index_t i = 0; i < row_length && is_binary; ++i) {
+      if (is_compact) {
+        nodes.clear();
+        DecodeCompactRow(compact_base() + row_offset(i),
+                         compact_base() + row_offset(i+1),
+                         nodes);
+        for (size_t k = 0; k < nodes.size(); ++k) {
+          if (nodes[k].feat_val != 1.0) { is_binary = false; }
+        }
+        continue;
+      }
+      RowView view = GetRow(i);
+      for (RowView::const_iterator iter = view.begin();
+           iter != view.end(); ++iter) {
+        if (iter->feat_val != 1.0) {
+          is_binary = false;
+          break;
+        }
+      }
+    }
+  }
+
+  // Compute the statistics of current matrix
+  DataStats GetStats() const { return GetStats(0, row_length); }
+
+  // Compute the statistics of the rows [begin, end)
+  DataStats GetStats(index_t begin, index_t end) const {
+    CHECK_LE(begin, end);
+    CHECK_LE(end, row_length);
+    DataStats stats;
+    std::vector<Node> nodes;
+    for (index_t i = begin; i < end; ++i) {
+      if (is_compact) {
+        nodes.clear();
+        DecodeCompactRow(compact_base() + row_offset(i),
+                         compact_base() + row_offset(i+1),
+                         nodes);
+        stats.AddRow(RowView(nodes.data(), nodes.data() + nodes.size(),
+                             dense_row(i), dense_width),
+                     Y[i]);
+      } else {
+        stats.AddRow(GetRow(i), Y[i]);
+      }
+    }
+    return stats;
+  }
+
+  // Return the number of bytes of the node storage,
+  // which does not count the dense block
+  uint64 DataSize() const {
+    if (is_compact) { return row_offset(row_length); }
+    uint64 size = 0;
+    for (index_t i = 0; i < row_length; ++i) {
+      size += GetRow(i).size() * sizeof(Node);
+    }
+    return size;
+  }
+
+  // Return the number of bytes allocated by the matrix, i.e., the
+  // capacity of the node storage, the row pointers and offsets, y,
+  // norm, weight, the dense block and row_cost. The mapped file is
+  // counted by its size
+  uint64 MemorySize() const {
+    uint64 size = row.capacity() * sizeof(SparseRow*) +
+                  csr_node.capacity() * sizeof(Node) +
+                  compact_data.capacity() * sizeof(uint8) +
+                  csr_offset.capacity() * sizeof(uint64) +
+                  Y.capacity() * sizeof(real_t) +
+                  norm.capacity() * sizeof(real_t) +
+                  weight.capacity() * sizeof(real_t) +
+                  dense.capacity() * sizeof(real_t) +
+                  row_cost.capacity() * sizeof(uint64);
+    for (size_t i = 0; i < row.size(); ++i) {
+      if (row[i] != nullptr) {
+        size += sizeof(SparseRow) + row[i]->capacity() * sizeof(Node);
+      }
+    }
+    return size + mmap_size_;
   }
 
   // The hash value is used to identify the difference
@@ -163,56 +1025,198 @@ struct DMatrix {
   }
 
   // Serialize current DMatrix to disk file
+  // The two kinds of storage use the same file format, which
+  // is the CSR layout described by BinaryHeader. All of the
+  // sections are 8-byte aligned so the file can be mapped
+  // into memory directly by MmapDeserialize()
   void Serialize(const std::string& filename) {
     CHECK(!filename.empty());
-    CHECK_EQ(row_length, row.size());
-    CHECK_EQ(row_length, Y.size());
     FILE* file = OpenFileOrDie(filename.c_str(), "w");
-    // Write hash_value
-    WriteDataToDisk(file,
-      (char*)&hash_value_1, sizeof(hash_value_1));
-    WriteDataToDisk(file,
-      (char*)&hash_value_2, sizeof(hash_value_2));
-    // Write row_length
-    WriteDataToDisk(file,
-      (char*)&row_length, sizeof(row_length));
-    // Write row
-    for (int i = 0; i < row_length; ++i) {
-      WriteVectorToFile(file, *(row[i]));
-    }
-    // Write Y
-    WriteVectorToFile(file, Y);
-    // Write norm
-    WriteVectorToFile(file, norm);
+    Serialize(file);
     Close(file);
   }
 
+  // Serialize current DMatrix to the current position of an
+  // opened file, so that we can write many matrices (blocks)
+  // into one file. Only the first row_length Y, norm and weight
+  // are written
+  void Serialize(FILE* file) {
+    CHECK_NOTNULL(file);
+    FileWriter writer(file);
+    serialize(writer);
+  }
+
+  // Serialize the DMatrix and append it to the end of a
+  // memory buffer. The layout is the same as the binary file
+  void Serialize(std::vector<char>* buffer) {
+    CHECK_NOTNULL(buffer);
+    BufferWriter writer(buffer);
+    serialize(writer);
+  }
+
   // Deserialize the DMatrix from disk file
+  // In CSR mode, the nodes are read into the contiguous
+  // buffer directly without any per-row allocation. The
+  // compact binary file is always read as a compact matrix
   void Deserialize(const std::string& filename) {
     CHECK(!filename.empty());
-    this->Release();
     FILE* file = OpenFileOrDie(filename.c_str(), "r");
-    // Read hash_value
-    ReadDataFromDisk(file,
-      (char*)&hash_value_1, sizeof(hash_value_1));
-    ReadDataFromDisk(file,
-      (char*)&hash_value_2, sizeof(hash_value_2));
-    // Read row_length
-    ReadDataFromDisk(file,
-      (char*)&row_length, sizeof(row_length));
-    // Read row
-    row.resize(row_length);
-    for (int i = 0; i < row_length; ++i) {
-      row[i] = new SparseRow;
-      ReadVectorFromFile(file, *(row[i]));
-    }
-    // Read Y
-    ReadVectorFromFile(file, Y);
-    // Read norm
-    ReadVectorFromFile(file, norm);
+    Deserialize(file);
     Close(file);
   }
 
+  // Deserialize a DMatrix from the current position of an opened file
+  void Deserialize(FILE* file) {
+    CHECK_NOTNULL(file);
+    FileReader reader(file);
+    deserialize(reader);
+  }
+
+  // Deserialize a DMatrix from a memory buffer
+  // generated by Serialize(std::vector<char>*)
+  void Deserialize(const char* buffer, uint64 size) {
+    CHECK_NOTNULL(buffer);
+    BufferReader reader(buffer, size);
+    deserialize(reader);
+    CHECK_EQ(reader.remain(), 0);
+  }
+
+  // Map the binary file generated by Serialize() into memory
+  // and use it as a read-only CSR matrix. The nodes and the row
+  // offsets are used in place and they are shared with the page
+  // cache, so there is no per-row allocation and no copy. Only
+  // Y, norm and weight are copied, because they can be modified by user.
+  // The dense block is used in place, too.
+  // The mapping will be released by Release()
+  void MmapDeserialize(const std::string& filename) {
+    CHECK(!filename.empty());
+    this->Release();
+    char* addr = nullptr;
+    uint64 size = MapFileToMemory(filename, &addr);
+    CHECK_GE(size, sizeof(BinaryHeader));
+    const BinaryHeader* header =
+      reinterpret_cast<const BinaryHeader*>(addr);
+    CHECK_EQ(header->magic, kBinaryMagic);
+    hash_value_1 = header->hash_value_1;
+    hash_value_2 = header->hash_value_2;
+    row_length = header->row_length;
+    is_compact = (header->is_compact == 1);
+    // Locate each section
+    uint64 pos = sizeof(BinaryHeader);
+    const real_t* y_ptr = reinterpret_cast<const real_t*>(addr + pos);
+    pos += align_section(sizeof(real_t)*row_length);
+    const real_t* norm_ptr = reinterpret_cast<const real_t*>(addr + pos);
+    pos += align_section(sizeof(real_t)*row_length);
+    const real_t* weight_ptr = nullptr;
+    if (header->has_weight == 1) {
+      weight_ptr = reinterpret_cast<const real_t*>(addr + pos);
+      pos += align_section(sizeof(real_t)*row_length);
+    }
+    mmap_offset_ = reinterpret_cast<const uint64*>(addr + pos);
+    pos += align_section(sizeof(uint64)*(row_length+1));
+    mmap_node_ = reinterpret_cast<const Node*>(addr + pos);
+    pos += is_compact ? header->num_node :
+           sizeof(Node)*header->num_node;
+    dense_width = header->dense_width;
+    if (dense_width > 0) {
+      pos = align_section(pos);
+      mmap_dense_ = reinterpret_cast<const real_t*>(addr + pos);
+      pos += align_section(sizeof(real_t)*row_length*dense_width);
+    }
+    CHECK_EQ(pos, size);
+    Y.assign(y_ptr, y_ptr + row_length);
+    norm.assign(norm_ptr, norm_ptr + row_length);
+    if (weight_ptr != nullptr) {
+      weight.assign(weight_ptr, weight_ptr + row_length);
+    }
+    mmap_addr_ = addr;
+    mmap_size_ = size;
+    is_csr = true;
+  }
+
+  // Return the size (byte) of a serialized DMatrix by its header,
+  // which can be used to skip a DMatrix in a binary file
+  static uint64 BinarySize(const BinaryHeader& header) {
+    uint64 size = sizeof(BinaryHeader);
+    size += align_section(sizeof(real_t)*header.row_length) *
+            (header.has_weight == 1 ? 3 : 2);
+    size += align_section(sizeof(uint64)*(header.row_length+1));
+    size += header.is_compact ? header.num_node :
+            sizeof(Node)*header.num_node;
+    if (header.dense_width > 0) {
+      size = align_section(size);
+      size += align_section(sizeof(real_t)*header.row_length*
+                            header.dense_width);
+    }
+    return size;
+  }
+
+  // Make current matrix a read-only view of the rows [begin, end)
+  // of src, which is a CSR matrix but not a compact one. As the
+  // mapped file, the nodes and the dense values of src are used in
+  // place, and only Y, norm and weight are copied, so a batch of
+  // the contiguous rows is handed out without copying any node.
+  // The view is valid until src is changed, and it is dropped by
+  // ReuseMatrix() and Release()
+  void SetView(const DMatrix& src, index_t begin, index_t end) {
+    CHECK(is_csr && !is_compact);
+    CHECK(!IsMapped());
+    CHECK(src.is_csr && !src.is_compact);
+    CHECK_LE(begin, end);
+    CHECK_LE(end, src.row_length);
+    row_length = end - begin;
+    row_cost.clear();
+    csr_node.clear();
+    csr_offset.clear();
+    csr_cur_row_ = -1;
+    bool external = src.mmap_node_ != nullptr;
+    mmap_node_ = external ? src.mmap_node_ : src.csr_node.data();
+    mmap_offset_ = (external ? src.mmap_offset_ : src.csr_offset.data()) +
+                   begin;
+    dense_width = src.dense_width;
+    dense.clear();
+    mmap_dense_ = src.dense_row(begin);
+    is_binary = src.is_binary;
+    Y.assign(src.Y.begin() + begin, src.Y.begin() + end);
+    norm.assign(src.norm.begin() + begin, src.norm.begin() + end);
+    if (src.HasWeight()) {
+      weight.assign(src.weight.begin() + begin, src.weight.begin() + end);
+    } else {
+      weight.clear();
+    }
+  }
+
+  // Make current matrix a read-only CSR view of the nodes of the
+  // caller, e.g., the arrays of another language, and the i-th row
+  // is [node[offset[i]], node[offset[i+1]]). The nodes are used in
+  // place, and they should outlive the matrix. Y is set to 0 and
+  // norm is set to 1.0, which are the own storage of the matrix
+  void SetExternal(const Node* node, const uint64* offset,
+                   index_t length) {
+    CHECK(is_csr && !is_compact);
+    CHECK(!IsMapped());
+    CHECK_EQ(dense_width, 0);
+    CHECK_NOTNULL(node);
+    CHECK_NOTNULL(offset);
+    ResetMatrix(0);
+    csr_offset.clear();
+    row_length = length;
+    mmap_node_ = node;
+    mmap_offset_ = offset;
+    Y.assign(length, 0);
+    norm.assign(length, 1.0);
+  }
+
+  // Return true if current matrix is a read-only
+  // view of memory-mapped binary file
+  inline bool IsMapped() const { return mmap_addr_ != nullptr; }
+
+  // Return true if current matrix is a read-only
+  // view of another matrix (see SetView())
+  inline bool IsView() const {
+    return mmap_addr_ == nullptr && mmap_node_ != nullptr;
+  }
+
   /* The DMatrix has a hash value that is
   geneerated from the txt file.
   These two values are used to check whether
@@ -221,13 +1225,298 @@ struct DMatrix {
   uint64 hash_value_2;
   /* Row length of current matrix */
   index_t row_length;
-  /* Using pointer to implement zero-copy */
+  /* Using pointer to implement zero-copy
+  (only used when is_csr == false) */
   std::vector<SparseRow*> row;
+  /* True for using the contiguous CSR storage */
+  bool is_csr;
+  /* All the nodes of the matrix in CSR mode */
+  std::vector<Node> csr_node;
+  /* True for using the compact encoding of rows */
+  bool is_compact;
+  /* All the compact rows of the matrix */
+  std::vector<uint8> compact_data;
+  /* True for the huge pages of the buffer of Reserve() */
+  bool huge_pages;
+  /* Number of dense values of each row, and 0 for no dense block */
+  index_t dense_width;
+  /* The dense block, size = row_length * dense_width */
+  std::vector<real_t> dense;
+  /* True if all the values of the nodes are 1.0 (see DetectBinary()) */
+  bool is_binary;
+  /* Row offset in CSR mode, size = row_length + 1.
+  For the compact matrix, this is the offset in bytes */
+  std::vector<uint64> csr_offset;
   /* 0 or -1 for negative and +1 for positive
   example, and others for regression */
   std::vector<real_t> Y;
   /* Used for instance-wise normalization */
   std::vector<real_t> norm;
+  /* The weight of each row in the gradient and the loss,
+  which is empty if all the rows have weight 1.0 */
+  std::vector<real_t> weight;
+  /* The prefix sum of the cost of the rows, where row_cost[i]
+  is the total cost of the rows [0, i). It is computed by
+  ComputeRowCost() and cleared when the rows are reset */
+  std::vector<uint64> row_cost;
+
+ private:
+  /* The last row that has been initialized in CSR mode */
+  int64 csr_cur_row_;
+  /* The last feat_id in current compact row */
+  index_t last_feat_id_;
+  /* Memory-mapped binary file, used by MmapDeserialize(). The
+  nodes, offsets and dense values are also set by SetView() */
+  char* mmap_addr_;
+  uint64 mmap_size_;
+  const Node* mmap_node_;
+  const uint64* mmap_offset_;
+  const real_t* mmap_dense_;
+
+  // Return true if the rows are in the mapped file or in
+  // another matrix, which cannot be changed
+  inline bool read_only() const { return mmap_node_ != nullptr; }
+
+  // Use the own storage of the rows again
+  inline void drop_view() {
+    mmap_node_ = nullptr;
+    mmap_offset_ = nullptr;
+    mmap_dense_ = nullptr;
+  }
+
+  // Return the offset of row_id-th row in CSR mode. The offsets
+  // of the rows after the last initialized one are not set, and
+  // these rows are empty at the end of the nodes
+  inline uint64 row_offset(index_t row_id) const {
+    if (mmap_node_ != nullptr) { return mmap_offset_[row_id]; }
+    if ((int64)row_id > csr_cur_row_ + 1) {
+      return csr_offset[csr_cur_row_ + 1];
+    }
+    return csr_offset[row_id];
+  }
+
+  // Return the dense values of the row_id-th row
+  inline const real_t* dense_row(index_t row_id) const {
+    return (mmap_node_ != nullptr ? mmap_dense_ : dense.data()) +
+           (uint64)row_id * dense_width;
+  }
+
+  // Copy the dense values of the rows [src_id, src_id + count) of
+  // src to the rows from row_id. The matrix without the dense block
+  // gets the dense block of src
+  void copy_dense(index_t row_id, const DMatrix& src,
+                  index_t src_id, index_t count) {
+    if (src.dense_width == 0) {
+      if (dense_width > 0) {
+        std::fill(DenseRow(row_id), DenseRow(row_id + count), 0);
+      }
+      return;
+    }
+    if (dense_width == 0) { SetDenseWidth(src.dense_width); }
+    CHECK_EQ(dense_width, src.dense_width);
+    const real_t* data = src.dense_row(src_id);
+    std::copy(data, data + (uint64)count * dense_width, DenseRow(row_id));
+  }
+
+  // Return the base address of the compact rows
+  inline const uint8* compact_base() const {
+    return mmap_node_ != nullptr ?
+      reinterpret_cast<const uint8*>(mmap_node_) :
+      compact_data.data();
+  }
+
+  // Write the DMatrix to the given writer
+  template <typename Writer>
+  void serialize(Writer& writer) {
+    CHECK_LE(row_length, Y.size());
+    // Build the row offset
+    std::vector<uint64> offset(row_length+1, 0);
+    for (index_t i = 0; i < row_length; ++i) {
+      offset[i+1] = is_compact ? row_offset(i+1) :
+                    offset[i] + GetRow(i).size();
+    }
+    // Write header
+    BinaryHeader header;
+    header.hash_value_1 = hash_value_1;
+    header.hash_value_2 = hash_value_2;
+    header.magic = kBinaryMagic;
+    header.row_length = row_length;
+    header.num_node = offset[row_length];
+    header.is_compact = is_compact ? 1 : 0;
+    header.has_weight = HasWeight() ? 1 : 0;
+    header.dense_width = dense_width;
+    header.stats = GetStats();
+    writer.write((char*)&header, sizeof(header));
+    // Write Y and norm
+    write_section(writer, (char*)Y.data(), sizeof(real_t)*row_length);
+    write_section(writer, (char*)norm.data(), sizeof(real_t)*row_length);
+    if (HasWeight()) {
+      CHECK_LE(row_length, weight.size());
+      write_section(writer, (char*)weight.data(),
+                    sizeof(real_t)*row_length);
+    }
+    // Write row offset
+    write_section(writer, (char*)offset.data(),
+                  sizeof(uint64)*(row_length+1));
+    // Write row
+    if (is_compact) {
+      if (header.num_node > 0) {
+        writer.write((char*)compact_base(), header.num_node);
+      }
+    } else {
+      for (index_t i = 0; i < row_length; ++i) {
+        RowView view = GetRow(i);
+        if (!view.empty()) {
+          writer.write((char*)view.begin(),
+                          sizeof(Node)*view.size());
+        }
+      }
+    }
+    // Write the dense block after the padding of the rows
+    if (dense_width > 0) {
+      write_padding(writer, is_compact ? header.num_node :
+                    sizeof(Node)*header.num_node);
+      write_section(writer, (const char*)dense_row(0),
+                    sizeof(real_t)*row_length*dense_width);
+    }
+  }
+
+  // Read the DMatrix from the given reader
+  template <typename Reader>
+  void deserialize(Reader& reader) {
+    this->Release();
+    // Read header
+    BinaryHeader header;
+    reader.read((char*)&header, sizeof(header));
+    CHECK_EQ(header.magic, kBinaryMagic);
+    hash_value_1 = header.hash_value_1;
+    hash_value_2 = header.hash_value_2;
+    SetCompact(header.is_compact == 1);
+    dense_width = header.dense_width;
+    this->ResetMatrix(header.row_length);
+    // Read Y and norm
+    read_section(reader, (char*)Y.data(), sizeof(real_t)*row_length);
+    read_section(reader, (char*)norm.data(), sizeof(real_t)*row_length);
+    if (header.has_weight == 1) {
+      weight.resize(row_length);
+      read_section(reader, (char*)weight.data(),
+                   sizeof(real_t)*row_length);
+    }
+    // Read row offset
+    std::vector<uint64> offset(row_length+1, 0);
+    read_section(reader, (char*)offset.data(),
+                 sizeof(uint64)*(row_length+1));
+    CHECK_EQ(offset[row_length], header.num_node);
+    // Read row
+    if (is_compact) {
+      csr_offset.swap(offset);
+      compact_data.resize(header.num_node);
+      if (header.num_node > 0) {
+        reader.read((char*)compact_data.data(),
+                         header.num_node);
+      }
+      csr_cur_row_ = (int64)row_length - 1;
+    } else if (is_csr) {
+      csr_offset.swap(offset);
+      csr_node.resize(header.num_node);
+      if (header.num_node > 0) {
+        reader.read((char*)csr_node.data(),
+                         sizeof(Node)*header.num_node);
+      }
+      csr_cur_row_ = (int64)row_length - 1;
+    } else {
+      for (index_t i = 0; i < row_length; ++i) {
+        InitRow(i);
+        size_t len = offset[i+1] - offset[i];
+        if (len == 0) { continue; }
+        row[i]->resize(len);
+        reader.read((char*)row[i]->data(), sizeof(Node)*len);
+      }
+    }
+    // Read the dense block
+    if (dense_width > 0) {
+      read_padding(reader, is_compact ? header.num_node :
+                   sizeof(Node)*header.num_node);
+      read_section(reader, (char*)dense.data(),
+                   sizeof(real_t)*row_length*dense_width);
+    }
+  }
+
+  // Write the binary file to disk file
+  struct FileWriter {
+    explicit FileWriter(FILE* f) : file(f) { }
+    void write(const char* buf, uint64 len) {
+      WriteDataToDisk(file, buf, len);
+    }
+    FILE* file;
+  };
+
+  // Write the binary file to a memory buffer
+  struct BufferWriter {
+    explicit BufferWriter(std::vector<char>* b) : buffer(b) { }
+    void write(const char* buf, uint64 len) {
+      buffer->insert(buffer->end(), buf, buf + len);
+    }
+    std::vector<char>* buffer;
+  };
+
+  // Read the binary file from disk file
+  struct FileReader {
+    explicit FileReader(FILE* f) : file(f) { }
+    void read(char* buf, uint64 len) {
+      ReadDataFromDisk(file, buf, len);
+    }
+    FILE* file;
+  };
+
+  // Read the binary file from a memory buffer
+  struct BufferReader {
+    BufferReader(const char* b, uint64 size)
+      : cur(b), end(b + size) { }
+    void read(char* buf, uint64 len) {
+      CHECK_LE(len, remain());
+      memcpy(buf, cur, len);
+      cur += len;
+    }
+    uint64 remain() const { return end - cur; }
+    const char* cur;
+    const char* end;
+  };
+
+  // Each section of the binary file is 8-byte aligned
+  static inline uint64 align_section(uint64 len) {
+    return (len + 7) & ~(uint64)7;
+  }
+
+  // Write a section and its padding
+  template <typename Writer>
+  static void write_section(Writer& writer, const char* buf, uint64 len) {
+    if (len > 0) { writer.write(buf, len); }
+    write_padding(writer, len);
+  }
+
+  // Write the padding of a section of len bytes
+  template <typename Writer>
+  static void write_padding(Writer& writer, uint64 len) {
+    static const char padding[8] = { 0 };
+    uint64 pad = align_section(len) - len;
+    if (pad > 0) { writer.write(padding, pad); }
+  }
+
+  // Read a section and skip its padding
+  template <typename Reader>
+  static void read_section(Reader& reader, char* buf, uint64 len) {
+    if (len > 0) { reader.read(buf, len); }
+    read_padding(reader, len);
+  }
+
+  // Skip the padding of a section of len bytes
+  template <typename Reader>
+  static void read_padding(Reader& reader, uint64 len) {
+    char padding[8];
+    uint64 pad = align_section(len) - len;
+    if (pad > 0) { reader.read(padding, pad); }
+  }
 };
 
 }  // namespace xLearn
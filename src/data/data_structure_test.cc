@@ -71,4 +71,568 @@ TEST(DMATRIX_TEST, Serialize_and_Deserialize) {
   RemoveFile("/tmp/test.bin");
 }
 
+TEST(DMATRIX_TEST, CSR_AddNode_and_GetRow) {
+  DMatrix matrix;
+  matrix.SetCSR(true);
+  matrix.ResetMatrix(10);
+  EXPECT_EQ(matrix.row.empty(), true);
+  EXPECT_EQ(matrix.csr_offset.size(), 11);
+  for (int i = 0; i < 10; ++i) {
+    // Row i has i nodes, and the first row is empty
+    matrix.InitRow(i);
+    for (int j = 0; j < i; ++j) {
+      matrix.AddNode(i, j, 0.5, i);
+    }
+  }
+  EXPECT_EQ(matrix.csr_node.size(), 45);
+  for (int i = 0; i < 10; ++i) {
+    RowView row = matrix.GetRow(i);
+    EXPECT_EQ(row.size(), i);
+    int n = 0;
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      EXPECT_EQ(iter->field_id, i);
+      EXPECT_EQ(iter->feat_id, n);
+      EXPECT_FLOAT_EQ(iter->feat_val, 0.5);
+      n++;
+    }
+  }
+  matrix.Release();
+  EXPECT_EQ(matrix.csr_node.empty(), true);
+  EXPECT_EQ(matrix.csr_offset.empty(), true);
+  EXPECT_EQ(matrix.is_csr, true);
+}
+
+// The rows after the last initialized one are empty
+TEST(DMATRIX_TEST, CSR_Uninitialized_rows) {
+  DMatrix matrix;
+  matrix.SetCSR(true);
+  matrix.ResetMatrix(5);
+  EXPECT_EQ(matrix.GetRow(3).size(), 0);
+  matrix.AddNode(0, 1, 0.5);
+  matrix.AddNode(1, 2, 0.5);
+  matrix.AddNode(1, 3, 0.5);
+  EXPECT_EQ(matrix.GetRow(0).size(), 1);
+  EXPECT_EQ(matrix.GetRow(1).size(), 2);
+  for (int i = 2; i < 5; ++i) {
+    RowView row = matrix.GetRow(i);
+    EXPECT_EQ(row.size(), 0);
+    EXPECT_EQ(row.begin(), row.end());
+  }
+  matrix.Serialize("/tmp/test.bin");
+  DMatrix new_matrix;
+  new_matrix.SetCSR(true);
+  new_matrix.Deserialize("/tmp/test.bin");
+  EXPECT_EQ(new_matrix.row_length, 5);
+  EXPECT_EQ(new_matrix.csr_node.size(), 3);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(new_matrix.GetRow(i).size(), matrix.GetRow(i).size());
+  }
+  RemoveFile("/tmp/test.bin");
+  DMatrix copy;
+  copy.SetCSR(true);
+  copy.ResetMatrix(5);
+  copy.CopyRows(0, matrix);
+  EXPECT_EQ(copy.csr_node.size(), 3);
+  EXPECT_EQ(copy.GetRow(1).size(), 2);
+  EXPECT_EQ(copy.GetRow(4).size(), 0);
+}
+
+TEST(DMATRIX_TEST, CSR_Serialize_and_Deserialize) {
+  DMatrix matrix;
+  matrix.ResetMatrix(10);
+  for (int i = 0; i < 10; ++i) {
+    matrix.AddNode(i, i, 2.5, i);
+    matrix.AddNode(i, i+1, 1.5, i);
+    matrix.Y[i] = i;
+    matrix.norm[i] = 0.25;
+  }
+  matrix.SetHash(1234, 5678);
+  matrix.Serialize("/tmp/test.bin");
+  // Read the binary file into CSR storage
+  DMatrix csr_matrix;
+  csr_matrix.SetCSR(true);
+  csr_matrix.Deserialize("/tmp/test.bin");
+  EXPECT_EQ(csr_matrix.row_length, 10);
+  EXPECT_EQ(csr_matrix.hash_value_1, 1234);
+  EXPECT_EQ(csr_matrix.hash_value_2, 5678);
+  EXPECT_EQ(csr_matrix.csr_node.size(), 20);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(csr_matrix.Y[i], i);
+    EXPECT_EQ(csr_matrix.norm[i], 0.25);
+    RowView row = csr_matrix.GetRow(i);
+    EXPECT_EQ(row.size(), 2);
+    EXPECT_EQ(row[0].feat_id, i);
+    EXPECT_EQ(row[1].feat_id, i+1);
+    EXPECT_FLOAT_EQ(row[0].feat_val, 2.5);
+    EXPECT_FLOAT_EQ(row[1].feat_val, 1.5);
+  }
+  RemoveFile("/tmp/test.bin");
+}
+
+TEST(DMATRIX_TEST, MmapDeserialize) {
+  DMatrix matrix;
+  matrix.ResetMatrix(9);
+  for (int i = 0; i < 9; ++i) {
+    // Row 0 is an empty row
+    for (int j = 0; j < i; ++j) {
+      matrix.AddNode(i, j, 0.5, i);
+    }
+    matrix.Y[i] = i;
+    matrix.norm[i] = 0.25;
+  }
+  matrix.SetHash(1234, 5678);
+  matrix.Serialize("/tmp/test.bin");
+  DMatrix map_matrix;
+  map_matrix.MmapDeserialize("/tmp/test.bin");
+  EXPECT_EQ(map_matrix.IsMapped(), true);
+  EXPECT_EQ(map_matrix.row_length, 9);
+  EXPECT_EQ(map_matrix.hash_value_1, 1234);
+  EXPECT_EQ(map_matrix.hash_value_2, 5678);
+  // The nodes are not copied into the matrix
+  EXPECT_EQ(map_matrix.csr_node.empty(), true);
+  for (int i = 0; i < 9; ++i) {
+    EXPECT_EQ(map_matrix.Y[i], i);
+    EXPECT_EQ(map_matrix.norm[i], 0.25);
+    RowView row = map_matrix.GetRow(i);
+    EXPECT_EQ(row.size(), i);
+    for (int j = 0; j < i; ++j) {
+      EXPECT_EQ(row[j].field_id, i);
+      EXPECT_EQ(row[j].feat_id, j);
+      EXPECT_FLOAT_EQ(row[j].feat_val, 0.5);
+    }
+  }
+  // Copy rows from the mapped matrix
+  DMatrix dst;
+  dst.SetCSR(true);
+  dst.ResetMatrix(2);
+  dst.CopyRow(0, map_matrix, 8);
+  dst.CopyRow(1, map_matrix, 0);
+  EXPECT_EQ(dst.GetRow(0).size(), 8);
+  EXPECT_EQ(dst.GetRow(1).size(), 0);
+  EXPECT_FLOAT_EQ(dst.Y[0], 8);
+  map_matrix.Release();
+  EXPECT_EQ(map_matrix.IsMapped(), false);
+  RemoveFile("/tmp/test.bin");
+}
+
+void CheckCompact(const DMatrix& compact, const DMatrix& expect) {
+  DMatrix decode;
+  decode.SetCSR(true);
+  decode.ResetMatrix(expect.row_length);
+  for (int i = 0; i < expect.row_length; ++i) {
+    decode.CopyRow(i, compact, i);
+  }
+  for (int i = 0; i < expect.row_length; ++i) {
+    EXPECT_FLOAT_EQ(decode.Y[i], expect.Y[i]);
+    EXPECT_FLOAT_EQ(decode.norm[i], expect.norm[i]);
+    RowView row = decode.GetRow(i);
+    RowView expect_row = expect.GetRow(i);
+    ASSERT_EQ(row.size(), expect_row.size());
+    for (size_t j = 0; j < row.size(); ++j) {
+      EXPECT_EQ(row[j].field_id, expect_row[j].field_id);
+      EXPECT_EQ(row[j].feat_id, expect_row[j].feat_id);
+      EXPECT_FLOAT_EQ(row[j].feat_val, expect_row[j].feat_val);
+    }
+  }
+}
+
+TEST(DMATRIX_TEST, Compact_Encoding) {
+  DMatrix matrix, compact;
+  matrix.ResetMatrix(20);
+  compact.SetCompact(true);
+  compact.ResetMatrix(20);
+  for (int i = 0; i < 20; ++i) {
+    // Row 0 is an empty row
+    for (int j = 0; j < i; ++j) {
+      // Unsorted feat_id, large field_id and non-binary value
+      index_t feat_id = (j % 2 == 0) ? 1000000 + j : j;
+      index_t field_id = (j % 3 == 0) ? 300 + j : j;
+      real_t feat_val = (j % 4 == 0) ? 0.5 : 1.0;
+      matrix.AddNode(i, feat_id, feat_val, field_id);
+      compact.AddNode(i, feat_id, feat_val, field_id);
+    }
+    matrix.Y[i] = compact.Y[i] = i;
+    matrix.norm[i] = compact.norm[i] = 0.25;
+  }
+  EXPECT_EQ(compact.is_csr, true);
+  EXPECT_EQ(compact.csr_node.empty(), true);
+  EXPECT_LT(compact.DataSize(), matrix.DataSize());
+  CheckCompact(compact, matrix);
+  // Serialize and Deserialize
+  compact.SetHash(1234, 5678);
+  compact.Serialize("/tmp/test.bin");
+  DMatrix new_compact;
+  new_compact.Deserialize("/tmp/test.bin");
+  EXPECT_EQ(new_compact.is_compact, true);
+  EXPECT_EQ(new_compact.hash_value_1, 1234);
+  EXPECT_EQ(new_compact.hash_value_2, 5678);
+  CheckCompact(new_compact, matrix);
+  // Mmap
+  DMatrix map_compact;
+  map_compact.MmapDeserialize("/tmp/test.bin");
+  EXPECT_EQ(map_compact.is_compact, true);
+  EXPECT_EQ(map_compact.DataSize(), compact.DataSize());
+  CheckCompact(map_compact, matrix);
+  // The nodes of the rows and the allocated bytes
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(matrix.RowNNZ(i), i);
+    EXPECT_EQ(compact.RowNNZ(i), i);
+    EXPECT_EQ(map_compact.RowNNZ(i), i);
+  }
+  EXPECT_GE(matrix.MemorySize(), matrix.DataSize());
+  EXPECT_GE(compact.MemorySize(), compact.DataSize());
+  EXPECT_GE(map_compact.MemorySize(), map_compact.DataSize());
+  RemoveFile("/tmp/test.bin");
+}
+
+TEST(DMATRIX_TEST, Sort_rows) {
+  // Each row has the fields in descending order, and the
+  // same (field, feature) twice with different values
+  for (int mode = 0; mode < 3; ++mode) {
+    DMatrix matrix;
+    matrix.SetCSR(mode != 0);
+    matrix.SetCompact(mode == 2);
+    matrix.ResetMatrix(10);
+    for (index_t i = 0; i < 10; ++i) {
+      for (index_t j = 0; j < i; ++j) {
+        matrix.AddNode(i, 100 - j, 0.5 + j, (i - j) % 3);
+      }
+      if (i > 0) { matrix.AddNode(i, 100, 7.0, i % 3); }
+      matrix.Y[i] = i;
+      matrix.norm[i] = 0.5;
+    }
+    uint64 size = matrix.DataSize();
+    matrix.SortRows();
+    EXPECT_EQ(matrix.DataSize() > 0, true);
+    if (mode != 2) { EXPECT_EQ(matrix.DataSize(), size); }
+    DMatrix decode;
+    decode.SetCSR(true);
+    decode.ResetMatrix(matrix.row_length);
+    decode.CopyRows(0, matrix);
+    for (index_t i = 0; i < 10; ++i) {
+      RowView row = decode.GetRow(i);
+      ASSERT_EQ(row.size(), i > 0 ? i + 1 : 0);
+      for (size_t k = 1; k < row.size(); ++k) {
+        EXPECT_FALSE(NodeFieldLess(row[k], row[k-1]));
+      }
+      // The duplicates keep their order
+      for (size_t k = 1; k < row.size(); ++k) {
+        if (row[k].feat_id == row[k-1].feat_id &&
+            row[k].field_id == row[k-1].field_id) {
+          EXPECT_FLOAT_EQ(row[k-1].feat_val, 0.5);
+          EXPECT_FLOAT_EQ(row[k].feat_val, 7.0);
+        }
+      }
+      EXPECT_EQ(decode.Y[i], i);
+      EXPECT_FLOAT_EQ(decode.norm[i], 0.5);
+    }
+  }
+}
+
+TEST(DMATRIX_TEST, CSR_CopyRow_and_ReuseMatrix) {
+  DMatrix src;
+  src.ResetMatrix(4);
+  for (int i = 0; i < 4; ++i) {
+    src.AddNode(i, i, 1.0);
+    src.Y[i] = i;
+    src.norm[i] = 0.5;
+  }
+  DMatrix dst;
+  dst.SetCSR(true);
+  dst.ResetMatrix(4);
+  for (int n = 0; n < 2; ++n) {
+    dst.ReuseMatrix(4);
+    for (int i = 0; i < 4; ++i) {
+      dst.CopyRow(i, src, 3-i);
+    }
+    EXPECT_EQ(dst.csr_node.size(), 4);
+    for (int i = 0; i < 4; ++i) {
+      RowView row = dst.GetRow(i);
+      EXPECT_EQ(row.size(), 1);
+      EXPECT_EQ(row[0].feat_id, 3-i);
+      EXPECT_FLOAT_EQ(dst.Y[i], 3-i);
+      EXPECT_FLOAT_EQ(dst.norm[i], 0.5);
+    }
+  }
+}
+
+// The view uses the nodes and the dense values of the rows in place
+TEST(DMATRIX_TEST, CSR_SetView) {
+  DMatrix src;
+  src.SetCSR(true);
+  src.ResetMatrix(5);
+  src.SetDenseWidth(2);
+  for (int i = 0; i < 5; ++i) {
+    src.AddNode(i, 2 + i, 1.0);
+    src.AddNode(i, 10, 0.5);
+    src.DenseRow(i)[1] = i;
+    src.Y[i] = i;
+    src.norm[i] = 0.5;
+  }
+  src.SetWeight(2, 3.0);
+  src.Serialize("/tmp/test.bin");
+  DMatrix mmap_src;
+  mmap_src.MmapDeserialize("/tmp/test.bin");
+  DMatrix* list[] = { &src, &mmap_src };
+  for (int k = 0; k < 2; ++k) {
+    DMatrix view;
+    view.SetCSR(true);
+    view.ResetMatrix(4);
+    view.SetView(*list[k], 1, 4);
+    EXPECT_TRUE(view.IsView());
+    EXPECT_FALSE(view.IsMapped());
+    ASSERT_EQ(view.row_length, 3);
+    EXPECT_EQ(view.csr_node.size(), 0);
+    EXPECT_EQ(view.GetRow(0).begin(), list[k]->GetRow(1).begin());
+    for (int i = 0; i < 3; ++i) {
+      RowView row = view.GetRow(i);
+      ASSERT_EQ(row.size(), 2);
+      EXPECT_EQ(row[0].feat_id, 3 + i);
+      EXPECT_FLOAT_EQ(row.dense()[1], 1 + i);
+      EXPECT_FLOAT_EQ(view.Y[i], 1 + i);
+      EXPECT_FLOAT_EQ(view.norm[i], 0.5);
+      EXPECT_FLOAT_EQ(view.RowWeight(i), i == 1 ? 3.0 : 1.0);
+    }
+    view.ComputeRowCost(kRowCostLinear);
+    EXPECT_EQ(view.row_cost[3], 3 * 5);
+    // The view can be copied, and it is dropped by ReuseMatrix()
+    DMatrix copy;
+    copy.SetCSR(true);
+    copy.ResetMatrix(3);
+    copy.CopyRows(0, view);
+    EXPECT_EQ(copy.GetRow(2)[0].feat_id, 5);
+    view.ReuseMatrix(2);
+    EXPECT_FALSE(view.IsView());
+    view.CopyRow(0, *list[k], 4);
+    EXPECT_EQ(view.GetRow(0)[0].feat_id, 6);
+    EXPECT_EQ(view.csr_node.size(), 2);
+  }
+}
+
+TEST(DMATRIX_TEST, Stats_in_binary_header) {
+  DMatrix matrix;
+  matrix.SetCSR(true);
+  matrix.ResetMatrix(4);
+  for (int i = 0; i < 4; ++i) {
+    matrix.InitRow(i);
+    for (int j = 0; j < i; ++j) {
+      matrix.AddNode(i, i * 10 + j, 1.0, j);
+    }
+    matrix.Y[i] = i % 2 ? 1 : -1;
+  }
+  DataStats stats = matrix.GetStats();
+  EXPECT_EQ(stats.num_row, 4);
+  EXPECT_EQ(stats.num_node, 6);
+  EXPECT_EQ(stats.max_feat, 32);
+  EXPECT_EQ(stats.max_field, 2);
+  EXPECT_EQ(stats.num_positive, 2);
+  EXPECT_DOUBLE_EQ(stats.label_sum, 0);
+  EXPECT_DOUBLE_EQ(stats.label_min, -1);
+  EXPECT_DOUBLE_EQ(stats.label_max, 1);
+  // The compact matrix has the same statistics
+  DMatrix compact;
+  compact.SetCompact(true);
+  compact.ResetMatrix(4);
+  for (int i = 0; i < 4; ++i) {
+    compact.InitRow(i);
+    for (int j = 0; j < i; ++j) {
+      compact.AddNode(i, i * 10 + j, 1.0, j);
+    }
+  }
+  EXPECT_EQ(compact.GetStats().max_feat, 32);
+  EXPECT_EQ(compact.GetStats().num_node, 6);
+  // Read the statistics from header
+  matrix.Serialize("/tmp/test.bin");
+  FILE* file = OpenFileOrDie("/tmp/test.bin", "r");
+  BinaryHeader header;
+  ReadDataFromDisk(file, (char*)&header, sizeof(header));
+  Close(file);
+  EXPECT_EQ(header.magic, kBinaryMagic);
+  EXPECT_EQ(header.stats.num_row, 4);
+  EXPECT_EQ(header.stats.max_feat, 32);
+  // Merge
+  DataStats merged;
+  merged.Merge(stats);
+  merged.Merge(header.stats);
+  EXPECT_EQ(merged.num_row, 8);
+  EXPECT_EQ(merged.num_positive, 4);
+  EXPECT_DOUBLE_EQ(merged.label_min, -1);
+  RemoveFile("/tmp/test.bin");
+}
+
+TEST(DMATRIX_TEST, Row_cost) {
+  bool csr[] = { false, true };
+  for (int c = 0; c < 2; ++c) {
+    DMatrix matrix;
+    matrix.SetCSR(csr[c]);
+    matrix.ResetMatrix(4);
+    // Row i has i nodes
+    for (int i = 0; i < 4; ++i) {
+      matrix.InitRow(i);
+      for (int j = 0; j < i; ++j) {
+        matrix.AddNode(i, j, 1.0);
+      }
+    }
+    EXPECT_FALSE(matrix.HasRowCost());
+    matrix.ComputeRowCost(kRowCostLinear);
+    ASSERT_TRUE(matrix.HasRowCost());
+    EXPECT_EQ(matrix.row_cost[0], 0);
+    EXPECT_EQ(matrix.row_cost[1], 1);
+    EXPECT_EQ(matrix.row_cost[4], 1 + 2 + 3 + 4);
+    matrix.ComputeRowCost(kRowCostQuadratic);
+    EXPECT_EQ(matrix.row_cost[4], 1 + 2 + 5 + 10);
+    matrix.ComputeRowCost(kRowCostNone);
+    EXPECT_FALSE(matrix.HasRowCost());
+    // The cost is cleared with the rows
+    matrix.ComputeRowCost(kRowCostLinear);
+    matrix.ReuseMatrix(2);
+    EXPECT_FALSE(matrix.HasRowCost());
+  }
+}
+
+TEST(DMATRIX_TEST, Row_weight) {
+  DMatrix matrix;
+  matrix.ResetMatrix(4);
+  for (int i = 0; i < 4; ++i) {
+    matrix.AddNode(i, i, 1.0);
+    matrix.Y[i] = 1;
+    matrix.norm[i] = 1.0;
+  }
+  // A weight of 1 does not allocate the weights
+  matrix.SetWeight(0, 1.0);
+  EXPECT_FALSE(matrix.HasWeight());
+  matrix.SetWeight(2, 50.0);
+  ASSERT_TRUE(matrix.HasWeight());
+  EXPECT_FLOAT_EQ(matrix.RowWeight(0), 1.0);
+  EXPECT_FLOAT_EQ(matrix.RowWeight(2), 50.0);
+  matrix.Serialize("/tmp/test.bin");
+  bool csr[] = { false, true };
+  for (int c = 0; c < 2; ++c) {
+    DMatrix new_matrix;
+    new_matrix.SetCSR(csr[c]);
+    new_matrix.Deserialize("/tmp/test.bin");
+    ASSERT_TRUE(new_matrix.HasWeight());
+    EXPECT_FLOAT_EQ(new_matrix.RowWeight(1), 1.0);
+    EXPECT_FLOAT_EQ(new_matrix.RowWeight(2), 50.0);
+    // The weight follows the copied rows
+    DMatrix copy;
+    copy.SetCSR(csr[c]);
+    copy.ResetMatrix(2);
+    copy.CopyRow(0, new_matrix, 1);
+    copy.CopyRow(1, new_matrix, 2);
+    EXPECT_FLOAT_EQ(copy.RowWeight(0), 1.0);
+    EXPECT_FLOAT_EQ(copy.RowWeight(1), 50.0);
+  }
+  RemoveFile("/tmp/test.bin");
+  // The weights are cleared with the rows
+  matrix.ReuseMatrix(2);
+  EXPECT_FALSE(matrix.HasWeight());
+}
+
+TEST(DMATRIX_TEST, Dense_block) {
+  bool compact[] = { false, true };
+  for (int c = 0; c < 2; ++c) {
+    DMatrix matrix;
+    matrix.SetCompact(compact[c]);
+    matrix.ResetMatrix(3);
+    matrix.SetDenseWidth(4);
+    for (index_t i = 0; i < 3; ++i) {
+      for (index_t j = 0; j < 4; ++j) {
+        matrix.DenseRow(i)[j] = i * 4 + j;
+      }
+      // The sparse features follow the dense ones
+      matrix.AddNode(i, 4 + i, 1.0);
+      matrix.Y[i] = i;
+    }
+    EXPECT_EQ(matrix.RowNNZ(1), 5);
+    DataStats stats = matrix.GetStats();
+    EXPECT_EQ(stats.num_node, 15);
+    EXPECT_EQ(stats.max_feat, 6);
+    // Copy the rows into a matrix without the dense block
+    DMatrix copy;
+    copy.SetCSR(true);
+    copy.ResetMatrix(2);
+    copy.CopyRows(0, matrix, 1, 3);
+    ASSERT_EQ(copy.dense_width, 4);
+    RowView row = copy.GetRow(1);
+    EXPECT_EQ(row.size(), 1);
+    EXPECT_EQ(row[0].feat_id, 6);
+    ASSERT_EQ(row.dense_size(), 4);
+    EXPECT_FLOAT_EQ(row.dense()[3], 11);
+    // The width is kept by ResetMatrix()
+    copy.ResetMatrix(1);
+    EXPECT_EQ(copy.dense.size(), 4);
+    // Serialize, Deserialize and MmapDeserialize
+    matrix.Serialize("/tmp/test.bin");
+    DMatrix new_matrix;
+    new_matrix.Deserialize("/tmp/test.bin");
+    DMatrix mmap_matrix;
+    mmap_matrix.MmapDeserialize("/tmp/test.bin");
+    DMatrix* list[] = { &new_matrix, &mmap_matrix };
+    for (int k = 0; k < 2; ++k) {
+      EXPECT_EQ(list[k]->dense_width, 4);
+      EXPECT_EQ(list[k]->is_compact, compact[c]);
+      DMatrix decode;
+      decode.SetCSR(true);
+      decode.ResetMatrix(3);
+      decode.CopyRows(0, *list[k]);
+      for (index_t i = 0; i < 3; ++i) {
+        RowView view = decode.GetRow(i);
+        ASSERT_EQ(view.size(), 1);
+        EXPECT_EQ(view[0].feat_id, 4 + i);
+        for (index_t j = 0; j < 4; ++j) {
+          EXPECT_FLOAT_EQ(view.dense()[j], i * 4 + j);
+        }
+      }
+    }
+    FILE* file = OpenFileOrDie("/tmp/test.bin", "r");
+    uint64 size = GetFileSize(file);
+    BinaryHeader header;
+    ReadDataFromDisk(file, (char*)&header, sizeof(header));
+    Close(file);
+    EXPECT_EQ(DMatrix::BinarySize(header), size);
+    RemoveFile("/tmp/test.bin");
+  }
+}
+
+// The binary flag is checked on the CSR, the compact and the
+// non-CSR matrix, and it is cleared when the rows are reset
+TEST(DMATRIX_TEST, Detect_binary) {
+  for (int mode = 0; mode < 3; ++mode) {
+    DMatrix matrix;
+    if (mode == 1) { matrix.SetCSR(true); }
+    if (mode == 2) { matrix.SetCompact(true); }
+    matrix.ResetMatrix(3);
+    for (index_t i = 0; i < 3; ++i) {
+      matrix.AddNode(i, i, 1.0, i);
+      matrix.AddNode(i, i + 5, 1.0, i);
+    }
+    EXPECT_FALSE(matrix.is_binary);
+    matrix.DetectBinary();
+    EXPECT_TRUE(matrix.is_binary);
+    if (mode != 2) {
+      EXPECT_TRUE(matrix.GetRow(1).is_binary());
+      // The view keeps the flag
+      if (mode == 1) {
+        DMatrix view;
+        view.SetCSR(true);
+        view.SetView(matrix, 1, 3);
+        EXPECT_TRUE(view.GetRow(0).is_binary());
+      }
+    }
+    matrix.AddNode(2, 9, 0.5, 0);
+    matrix.DetectBinary();
+    EXPECT_FALSE(matrix.is_binary);
+    matrix.ResetMatrix(1);
+    matrix.AddNode(0, 1, 1.0);
+    EXPECT_FALSE(matrix.is_binary);
+    // The dense block is never binary
+    matrix.SetDenseWidth(2);
+    matrix.DetectBinary();
+    EXPECT_FALSE(matrix.is_binary);
+  }
+  EXPECT_FALSE(RowView().is_binary());
+}
+
 }  // namespace xLearn
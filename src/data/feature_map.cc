@@ -0,0 +1,177 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of FeatureMap.
+*/
+
+#include "src/data/feature_map.h"
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+// Add the new id at the end of the dense range
+bool FeatureMap::Map(index_t raw_id, index_t* dense_id) {
+  std::unordered_map<index_t, index_t>::const_iterator iter =
+    dense_id_.find(raw_id);
+  if (iter != dense_id_.end()) {
+    *dense_id = iter->second;
+    return true;
+  }
+  if (frozen_) {
+    *dense_id = oov_id_;
+    return oov_id_ != kNoOovId;
+  }
+  *dense_id = raw_id_.size();
+  dense_id_[raw_id] = *dense_id;
+  raw_id_.push_back(raw_id);
+  return true;
+}
+
+// The OOV id has no raw id, and its slot of raw_id_ is 0
+void FeatureMap::AddOov() {
+  CHECK_EQ(oov_id_, kNoOovId);
+  oov_id_ = raw_id_.size();
+  raw_id_.push_back(0);
+}
+
+// The compact row is decoded into the one-row matrix first
+static RowView get_row(const DMatrix& matrix, index_t i, DMatrix* decode) {
+  if (!matrix.is_compact) { return matrix.GetRow(i); }
+  decode->ReuseMatrix(1);
+  decode->CopyRow(0, matrix, i);
+  return decode->GetRow(0);
+}
+
+void FeatureMap::Count(const DMatrix& matrix) {
+  CHECK(counting_);
+  DMatrix decode;
+  decode.SetCSR(true);
+  for (index_t i = 0; i < matrix.row_length; ++i) {
+    RowView row = get_row(matrix, i, &decode);
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      uint64& count = count_[iter->feat_id];
+      if (count == 0) { first_seen_.push_back(iter->feat_id); }
+      count++;
+    }
+  }
+}
+
+// The stable sort keeps the order of first occurrence for ties,
+// and the rare ids are at the end of the order
+void FeatureMap::OrderByFrequency() {
+  CHECK(counting_);
+  frozen_ = false;
+  std::vector<index_t> order(first_seen_);
+  std::stable_sort(order.begin(), order.end(),
+    [this](index_t a, index_t b) { return count_[a] > count_[b]; });
+  num_rare_ = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (count_[order[i]] < min_count_) {
+      num_rare_ = order.size() - i;
+      break;
+    }
+    index_t id = 0;
+    Map(order[i], &id);
+  }
+  if (oov_ && num_rare_ > 0) { AddOov(); }
+  count_.clear();
+  first_seen_.clear();
+  counting_ = false;
+  frozen_ = true;
+}
+
+// The norm of each row is kept, which is computed from
+// all the nodes in the txt file
+void FeatureMap::Remap(const DMatrix& matrix, DMatrix* out) {
+  CHECK_NOTNULL(out);
+  CHECK(!counting_);
+  out->ResetMatrix(matrix.row_length);
+  DMatrix decode;
+  decode.SetCSR(true);
+  for (index_t i = 0; i < matrix.row_length; ++i) {
+    RowView row = get_row(matrix, i, &decode);
+    out->InitRow(i);
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      index_t id = 0;
+      if (Map(iter->feat_id, &id)) {
+        out->AddNode(i, id, iter->feat_val, iter->field_id);
+      }
+    }
+    out->Y[i] = matrix.Y[i];
+    out->norm[i] = matrix.norm[i];
+    if (matrix.HasWeight()) { out->SetWeight(i, matrix.RowWeight(i)); }
+  }
+}
+
+// File layout: magic, number of ids, the OOV id (only in the
+// file of kFeatureMapOovMagic), and the raw ids
+void FeatureMap::Serialize(const std::string& filename) const {
+  CHECK_NE(filename.empty(), true);
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  uint64 size = raw_id_.size();
+  const uint64& magic = oov_id_ == kNoOovId ? kFeatureMapMagic :
+                                              kFeatureMapOovMagic;
+  WriteDataToDisk(file, (char*)&magic, sizeof(magic));
+  WriteDataToDisk(file, (char*)&size, sizeof(size));
+  if (oov_id_ != kNoOovId) {
+    WriteDataToDisk(file, (char*)&oov_id_, sizeof(oov_id_));
+  }
+  if (size > 0) {
+    WriteDataToDisk(file, (char*)raw_id_.data(), size * sizeof(index_t));
+  }
+  Close(file);
+}
+
+bool FeatureMap::Deserialize(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 magic = 0;
+  ReadDataFromDisk(file, (char*)&magic, sizeof(magic));
+  if (magic != kFeatureMapMagic && magic != kFeatureMapOovMagic) {
+    LOG(ERROR) << "Not a feature map file: " << filename;
+    Close(file);
+    return false;
+  }
+  uint64 size = 0;
+  ReadDataFromDisk(file, (char*)&size, sizeof(size));
+  oov_id_ = kNoOovId;
+  if (magic == kFeatureMapOovMagic) {
+    ReadDataFromDisk(file, (char*)&oov_id_, sizeof(oov_id_));
+    CHECK_LT(oov_id_, size);
+  }
+  raw_id_.resize(size);
+  if (size > 0) {
+    ReadDataFromDisk(file, (char*)raw_id_.data(), size * sizeof(index_t));
+  }
+  Close(file);
+  dense_id_.clear();
+  dense_id_.reserve(size);
+  for (uint64 i = 0; i < size; ++i) {
+    if (i != oov_id_) { dense_id_[raw_id_[i]] = i; }
+  }
+  frozen_ = true;
+  return true;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,178 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the FeatureMap class, which re-indexes the
+sparse feature ids into a dense range.
+*/
+
+#ifndef XLEARN_DATA_FEATURE_MAP_H_
+#define XLEARN_DATA_FEATURE_MAP_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Magic number of the feature map file
+const uint64 kFeatureMapMagic = 0x31504d5441464cULL;  /* "LFATMP1" */
+// Magic number of the feature map file with the OOV id
+const uint64 kFeatureMapOovMagic = 0x32504d5441464cULL;  /* "LFATMP2" */
+
+// The map has no OOV id
+const index_t kNoOovId = ~0U;
+
+//------------------------------------------------------------------------------
+// FeatureMap maps the feature ids of the dataset, which could be drawn
+// from a huge space, to the dense ids [0, Size()), so that the model is
+// sized by the number of features that actually occur. The dense ids are
+// given in the order of first occurrence:
+//
+//   FeatureMap map;
+//   map.Remap(train_matrix, &dense_train);  /* add the new ids */
+//   map.Freeze();
+//   map.Remap(test_matrix, &dense_test);    /* drop the unknown ids */
+//   model.Initialize(score_func, loss_func, map.Size(), ...);
+//   map.Serialize("/tmp/model.dict");
+//
+// When the map is frozen, the nodes of unknown ids are dropped, because
+// they have no parameter in the model. The prediction task loads the
+// map stored alongside the model:
+//
+//   map.Deserialize("/tmp/model.dict");   /* frozen after loading */
+//
+// The dense ids can also be given in the order of descending frequency, so
+// that the latent vectors of the hottest features are contiguous in the
+// model and stay resident in cache and TLB on power-law data. In this mode
+// all the training data is counted before any row is re-indexed:
+//
+//   map.EnableFrequencyOrder();
+//   map.Count(train_matrix_1);
+//   map.Count(train_matrix_2);
+//   map.OrderByFrequency();                 /* frozen after ordering */
+//   map.Remap(train_matrix_1, &dense_train_1);
+//
+// The counting also filters the rare features, which hurt both the memory
+// and the generalization. The ids that occur less than the min count are
+// dropped by OrderByFrequency(), or mapped to one shared OOV (out of
+// vocabulary) id at the end of the dense range, which is also the id of
+// every unknown id of the frozen map:
+//
+//   map.EnableFrequencyOrder();
+//   map.SetMinCount(5, true);               /* with the OOV id */
+//   map.Count(train_matrix);
+//   map.OrderByFrequency();
+//------------------------------------------------------------------------------
+class FeatureMap {
+ public:
+  FeatureMap() : frozen_(false), counting_(false),
+    min_count_(0), oov_(false), oov_id_(kNoOovId), num_rare_(0) { }
+  ~FeatureMap() { }
+
+  // Get the dense id of the raw id. The new id is added unless
+  // the map is frozen, and the unknown id is the OOV id, or
+  // false is returned if the map has no OOV id
+  bool Map(index_t raw_id, index_t* dense_id);
+
+  // Stop adding the new ids
+  void Freeze() { frozen_ = true; }
+  inline bool IsFrozen() const { return frozen_; }
+
+  // Number of dense ids
+  inline index_t Size() const { return raw_id_.size(); }
+
+  // The raw id of the dense id, which is meaningless
+  // for the OOV id
+  inline index_t RawId(index_t dense_id) const {
+    CHECK_LT(dense_id, raw_id_.size());
+    return raw_id_[dense_id];
+  }
+
+  // The dense id shared by the rare and the unknown ids,
+  // or kNoOovId
+  inline index_t OovId() const { return oov_id_; }
+
+  // Add the OOV id at the end of the dense range
+  void AddOov();
+
+  // Count the occurrence of the ids before OrderByFrequency()
+  void EnableFrequencyOrder() {
+    CHECK_EQ(raw_id_.size(), 0);
+    counting_ = true;
+  }
+  inline bool IsCounting() const { return counting_; }
+
+  // The ids that are counted less than min_count are dropped
+  // by OrderByFrequency(), or mapped to the OOV id if oov is
+  // true. Invoke this method before OrderByFrequency()
+  void SetMinCount(uint64 min_count, bool oov) {
+    min_count_ = min_count;
+    oov_ = oov;
+  }
+
+  // Add the occurrence of each id in matrix
+  void Count(const DMatrix& matrix);
+
+  // Give the dense ids by descending count, and the ties are
+  // broken by the first occurrence. The map is frozen after that
+  void OrderByFrequency();
+
+  // Number of the rare ids filtered by OrderByFrequency()
+  inline uint64 NumRare() const { return num_rare_; }
+
+  // Copy the rows of matrix into out (which keeps the storage
+  // flags of out) with the dense feature ids
+  void Remap(const DMatrix& matrix, DMatrix* out);
+
+  // Write the raw ids in the order of dense ids (and the OOV
+  // id) to disk file, and read them back. The loaded map is
+  // frozen
+  void Serialize(const std::string& filename) const;
+  bool Deserialize(const std::string& filename);
+
+ protected:
+  /* Raw id -> dense id */
+  std::unordered_map<index_t, index_t> dense_id_;
+  /* Dense id -> raw id */
+  std::vector<index_t> raw_id_;
+  /* No new id is added if frozen_ is true */
+  bool frozen_;
+  /* True if the ids are counted for OrderByFrequency() */
+  bool counting_;
+  /* Raw id -> number of occurrence, and the raw ids
+  in the order of first occurrence */
+  std::unordered_map<index_t, uint64> count_;
+  std::vector<index_t> first_seen_;
+  /* The ids counted less than min_count_ are rare,
+  and they are mapped to the OOV id if oov_ is true */
+  uint64 min_count_;
+  bool oov_;
+  index_t oov_id_;
+  uint64 num_rare_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FeatureMap);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_FEATURE_MAP_H_
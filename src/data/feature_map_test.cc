@@ -0,0 +1,174 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests feature_map.h
+*/
+
+#include "gtest/gtest.h"
+
+#include "src/base/file_util.h"
+#include "src/data/feature_map.h"
+
+namespace xLearn {
+
+// Two rows of the sparse ids
+void InitMatrix(DMatrix* matrix) {
+  matrix->ResetMatrix(2);
+  matrix->AddNode(0, 1000000, 1.0, 1);
+  matrix->AddNode(0, 7, 2.0, 2);
+  matrix->AddNode(1, 7, 3.0);
+  matrix->AddNode(1, 2000000000, 4.0);
+  matrix->Y[0] = 1;
+  matrix->Y[1] = -1;
+  matrix->norm[1] = 0.5;
+}
+
+TEST(FEATURE_MAP_TEST, Remap) {
+  for (int compact = 0; compact < 2; ++compact) {
+    DMatrix matrix;
+    matrix.SetCompact(compact == 1);
+    InitMatrix(&matrix);
+    FeatureMap map;
+    DMatrix out;
+    out.SetCSR(true);
+    map.Remap(matrix, &out);
+    EXPECT_EQ(map.Size(), 3);
+    EXPECT_EQ(map.RawId(2), 2000000000);
+    ASSERT_EQ(out.row_length, 2);
+    RowView row = out.GetRow(0);
+    ASSERT_EQ(row.size(), 2);
+    EXPECT_EQ(row[0].feat_id, 0);
+    EXPECT_EQ(row[0].field_id, 1);
+    EXPECT_EQ(row[1].feat_id, 1);
+    EXPECT_FLOAT_EQ(row[1].feat_val, 2.0);
+    row = out.GetRow(1);
+    ASSERT_EQ(row.size(), 2);
+    EXPECT_EQ(row[0].feat_id, 1);
+    EXPECT_EQ(row[1].feat_id, 2);
+    EXPECT_FLOAT_EQ(out.Y[1], -1);
+    EXPECT_FLOAT_EQ(out.norm[1], 0.5);
+  }
+}
+
+TEST(FEATURE_MAP_TEST, Frozen) {
+  FeatureMap map;
+  index_t id = 0;
+  EXPECT_TRUE(map.Map(7, &id));
+  EXPECT_EQ(id, 0);
+  map.Freeze();
+  EXPECT_FALSE(map.Map(8, &id));
+  // The unknown ids are dropped
+  DMatrix matrix;
+  InitMatrix(&matrix);
+  DMatrix out;
+  map.Remap(matrix, &out);
+  EXPECT_EQ(map.Size(), 1);
+  EXPECT_EQ(out.GetRow(0).size(), 1);
+  EXPECT_EQ(out.GetRow(0)[0].feat_id, 0);
+  EXPECT_EQ(out.GetRow(1).size(), 1);
+}
+
+TEST(FEATURE_MAP_TEST, Serialize) {
+  FeatureMap map;
+  index_t id = 0;
+  map.Map(30, &id);
+  map.Map(10, &id);
+  map.Map(20, &id);
+  map.Serialize("./test_feature_map.dict");
+  FeatureMap new_map;
+  EXPECT_TRUE(new_map.Deserialize("./test_feature_map.dict"));
+  RemoveFile("./test_feature_map.dict");
+  EXPECT_TRUE(new_map.IsFrozen());
+  ASSERT_EQ(new_map.Size(), 3);
+  EXPECT_TRUE(new_map.Map(10, &id));
+  EXPECT_EQ(id, 1);
+  EXPECT_EQ(new_map.RawId(2), 20);
+}
+
+TEST(FEATURE_MAP_TEST, OrderByFrequency) {
+  for (int compact = 0; compact < 2; ++compact) {
+    DMatrix matrix;
+    matrix.SetCompact(compact == 1);
+    InitMatrix(&matrix);
+    FeatureMap map;
+    map.EnableFrequencyOrder();
+    EXPECT_TRUE(map.IsCounting());
+    map.Count(matrix);
+    map.Count(matrix);
+    EXPECT_EQ(map.Size(), 0);
+    map.OrderByFrequency();
+    EXPECT_FALSE(map.IsCounting());
+    EXPECT_TRUE(map.IsFrozen());
+    // The id 7 occurs twice in each matrix, and the ties
+    // are given in the order of first occurrence
+    ASSERT_EQ(map.Size(), 3);
+    EXPECT_EQ(map.RawId(0), 7);
+    EXPECT_EQ(map.RawId(1), 1000000);
+    EXPECT_EQ(map.RawId(2), 2000000000);
+    DMatrix out;
+    out.SetCSR(true);
+    map.Remap(matrix, &out);
+    RowView row = out.GetRow(0);
+    ASSERT_EQ(row.size(), 2);
+    EXPECT_EQ(row[0].feat_id, 1);
+    EXPECT_EQ(row[1].feat_id, 0);
+    EXPECT_FLOAT_EQ(row[1].feat_val, 2.0);
+  }
+}
+
+TEST(FEATURE_MAP_TEST, MinCount) {
+  // The id 7 occurs twice in the matrix, and
+  // the other ids occur once
+  DMatrix matrix;
+  InitMatrix(&matrix);
+  for (int oov = 0; oov < 2; ++oov) {
+    FeatureMap map;
+    map.EnableFrequencyOrder();
+    map.SetMinCount(2, oov == 1);
+    map.Count(matrix);
+    map.OrderByFrequency();
+    EXPECT_EQ(map.NumRare(), 2);
+    ASSERT_EQ(map.Size(), oov == 1 ? 2 : 1);
+    EXPECT_EQ(map.RawId(0), 7);
+    EXPECT_EQ(map.OovId(), oov == 1 ? 1 : kNoOovId);
+    DMatrix out;
+    out.SetCSR(true);
+    map.Remap(matrix, &out);
+    RowView row = out.GetRow(1);
+    ASSERT_EQ(row.size(), oov == 1 ? 2 : 1);
+    EXPECT_EQ(row[0].feat_id, 0);
+    if (oov == 1) { EXPECT_EQ(row[1].feat_id, 1); }
+    // The unknown id is the OOV id
+    index_t id = 0;
+    EXPECT_EQ(map.Map(12345, &id), oov == 1);
+    // The OOV id is kept by the file
+    map.Serialize("./test_feature_map.dict");
+    FeatureMap new_map;
+    EXPECT_TRUE(new_map.Deserialize("./test_feature_map.dict"));
+    RemoveFile("./test_feature_map.dict");
+    ASSERT_EQ(new_map.Size(), map.Size());
+    EXPECT_EQ(new_map.OovId(), map.OovId());
+    EXPECT_TRUE(new_map.Map(7, &id));
+    EXPECT_EQ(id, 0);
+    EXPECT_EQ(new_map.Map(1000000, &id), oov == 1);
+    if (oov == 1) { EXPECT_EQ(id, 1); }
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,192 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of FieldGroups.
+*/
+
+#include "src/data/field_groups.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+// Maximal number of the iterations of k-means
+static const int kMaxKmeansIter = 100;
+
+const index_t FieldGroups::kNoGroup;
+
+void FieldGroups::Set(index_t field, index_t group) {
+  CHECK_NE(group, kNoGroup);
+  if (field >= group_.size()) {
+    group_.resize((uint64)field + 1, kNoGroup);
+  }
+  group_[field] = group;
+  num_group_ = std::max(num_group_, group + 1);
+}
+
+index_t FieldGroups::NumField() const {
+  index_t count = 0;
+  for (size_t i = 0; i < group_.size(); ++i) {
+    if (group_[i] != kNoGroup) { count++; }
+  }
+  return count;
+}
+
+// The blank lines and the lines of '#' are skipped
+bool FieldGroups::Load(const std::string& filename) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) { return false; }
+  group_.clear();
+  num_group_ = 0;
+  char line[256];
+  bool legal = true;
+  while (legal && fgets(line, sizeof(line), file) != nullptr) {
+    char* p = line;
+    while (*p == ' ' || *p == '\t') { ++p; }
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) { continue; }
+    long long field = 0, group = 0;
+    if (sscanf(p, "%lld %lld", &field, &group) != 2 ||
+        field < 0 || group < 0 || field >= kNoGroup ||
+        group >= kNoGroup) {
+      legal = false;
+    } else {
+      Set(field, group);
+    }
+  }
+  fclose(file);
+  return legal;
+}
+
+void FieldGroups::Serialize(const std::string& filename) const {
+  CHECK_NE(filename.empty(), true);
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (size_t i = 0; i < group_.size(); ++i) {
+    if (group_[i] != kNoGroup) {
+      fprintf(file, "%u %u\n", (index_t)i, group_[i]);
+    }
+  }
+  Close(file);
+}
+
+// Squared distance of two points
+static double distance(const real_t* a, const real_t* b, index_t dim) {
+  double sum = 0;
+  for (index_t d = 0; d < dim; ++d) {
+    double diff = a[d] - b[d];
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+void FieldGroups::Learn(const std::vector<real_t>& points,
+                        index_t num_field,
+                        index_t dim,
+                        index_t num_group) {
+  CHECK_EQ(points.size(), (uint64)num_field * dim);
+  CHECK_GT(dim, 0);
+  CHECK_GT(num_group, 0);
+  group_.clear();
+  num_group_ = 0;
+  if (num_field == 0) { return; }
+  // The first center is the longest point, and the next one
+  // is the point farthest from the chosen centers
+  std::vector<real_t> zero(dim, 0);
+  std::vector<double> nearest(num_field);
+  for (index_t f = 0; f < num_field; ++f) {
+    nearest[f] = distance(&points[(uint64)f * dim], zero.data(), dim);
+  }
+  std::vector<real_t> centers;
+  for (index_t k = 0; k < std::min(num_group, num_field); ++k) {
+    index_t best = std::max_element(nearest.begin(), nearest.end()) -
+                   nearest.begin();
+    // The other points are the same as the centers
+    if (k > 0 && nearest[best] == 0) { break; }
+    const real_t* p = &points[(uint64)best * dim];
+    centers.insert(centers.end(), p, p + dim);
+    for (index_t f = 0; f < num_field; ++f) {
+      nearest[f] = std::min(nearest[f],
+                   distance(&points[(uint64)f * dim], p, dim));
+    }
+  }
+  index_t num_center = centers.size() / dim;
+  // Lloyd's iterations
+  std::vector<index_t> assign(num_field, kNoGroup);
+  for (int iter = 0; iter < kMaxKmeansIter; ++iter) {
+    bool changed = false;
+    for (index_t f = 0; f < num_field; ++f) {
+      index_t best = 0;
+      double best_dist = std::numeric_limits<double>::max();
+      for (index_t c = 0; c < num_center; ++c) {
+        double dist = distance(&points[(uint64)f * dim],
+                               &centers[(uint64)c * dim], dim);
+        if (dist < best_dist) {
+          best = c;
+          best_dist = dist;
+        }
+      }
+      if (assign[f] != best) {
+        assign[f] = best;
+        changed = true;
+      }
+    }
+    if (!changed) { break; }
+    std::vector<index_t> count(num_center, 0);
+    std::fill(centers.begin(), centers.end(), 0);
+    for (index_t f = 0; f < num_field; ++f) {
+      count[assign[f]]++;
+      for (index_t d = 0; d < dim; ++d) {
+        centers[(uint64)assign[f] * dim + d] += points[(uint64)f * dim + d];
+      }
+    }
+    for (index_t c = 0; c < num_center; ++c) {
+      for (index_t d = 0; d < dim && count[c] > 0; ++d) {
+        centers[(uint64)c * dim + d] /= count[c];
+      }
+    }
+  }
+  // The empty groups are dropped by the numbering
+  std::vector<index_t> number(num_center, kNoGroup);
+  for (index_t f = 0; f < num_field; ++f) {
+    if (number[assign[f]] == kNoGroup) {
+      number[assign[f]] = num_group_;
+    }
+    Set(f, number[assign[f]]);
+  }
+}
+
+// FNV-1a of the (field, group) pairs
+uint64 FieldGroups::Hash() const {
+  if (group_.empty()) { return 0; }
+  uint64 hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < group_.size(); ++i) {
+    if (group_[i] == kNoGroup) { continue; }
+    uint64 values[2] = { i, group_[i] };
+    for (int v = 0; v < 2; ++v) {
+      hash = (hash ^ values[v]) * 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
+}  // namespace xLearn
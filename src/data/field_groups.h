@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the FieldGroups class, which maps the fields of
+FFM to the groups that share one latent vector of each feature.
+*/
+
+#ifndef XLEARN_DATA_FIELD_GROUPS_H_
+#define XLEARN_DATA_FIELD_GROUPS_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// FFM gives each feature one latent vector V_i_f for every field f, so
+// the model grows with num_feature * num_field, which does not fit the
+// memory on the data of hundreds of fields. The field f only selects the
+// latent vector of the other node of a pair, so the fields of a group can
+// share one latent vector V_i_g of each feature by replacing the field id
+// with the group id at parsing time, and the model is allocated for the
+// groups instead of the fields. FieldGroups is the map, which is read
+// from a text file of "field group" per line, or learned by clustering
+// the latent vectors of the fields of a trained model:
+//
+//   FieldGroups groups;
+//   if (!groups.Load("/tmp/field_groups.txt")) { /* error */ }
+//   index_t group = groups.Group(field);
+//
+//   groups.Learn(points, num_field, dim, 8);  /* k-means of the fields */
+//   groups.Serialize("/tmp/field_groups.txt");
+//
+// The fields that are not in the map are in one more group, whose id is
+// NumGroup(). The empty map keeps every field in its own group.
+//------------------------------------------------------------------------------
+class FieldGroups {
+ public:
+  FieldGroups() : num_group_(0) { }
+  ~FieldGroups() { }
+
+  // Put the field in the group
+  void Set(index_t field, index_t group);
+
+  // The empty map keeps the fields
+  inline bool Empty() const { return group_.empty(); }
+  inline index_t Group(index_t field) const {
+    if (group_.empty()) { return field; }
+    if (field >= group_.size() || group_[field] == kNoGroup) {
+      return num_group_;
+    }
+    return group_[field];
+  }
+
+  // Number of the groups of the map, without
+  // the group of the other fields
+  inline index_t NumGroup() const { return num_group_; }
+
+  // Number of the fields of the map
+  index_t NumField() const;
+
+  // Read the map of the text file. Return false if the file
+  // cannot be read or has an illegal line
+  bool Load(const std::string& filename);
+
+  // Write the map in the format of Load()
+  void Serialize(const std::string& filename) const;
+
+  // Put the num_field points (num_field * dim) into num_group
+  // groups by k-means. Each first center is the point farthest
+  // from the former ones, so the result is deterministic, and
+  // the groups are numbered in the order of their first field
+  void Learn(const std::vector<real_t>& points,
+             index_t num_field,
+             index_t dim,
+             index_t num_group);
+
+  // Hash value of the map, and 0 for the empty map
+  uint64 Hash() const;
+
+ protected:
+  /* The field that is not in the map */
+  static const index_t kNoGroup = ~0U;
+  /* The group of each field */
+  std::vector<index_t> group_;
+  index_t num_group_;
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_FIELD_GROUPS_H_
@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests field_groups.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include "src/base/file_util.h"
+#include "src/data/field_groups.h"
+
+namespace xLearn {
+
+const char* kFile = "./test_field_groups.txt";
+
+void WriteText(const char* text) {
+  FILE* file = OpenFileOrDie(kFile, "w");
+  fputs(text, file);
+  Close(file);
+}
+
+TEST(FIELD_GROUPS_TEST, Empty) {
+  FieldGroups groups;
+  EXPECT_TRUE(groups.Empty());
+  EXPECT_EQ(groups.Group(7), 7);
+  EXPECT_EQ(groups.Hash(), 0);
+}
+
+TEST(FIELD_GROUPS_TEST, Load_and_Save) {
+  WriteText("# field group\n"
+            "0 1\n"
+            "\n"
+            "  3 0\n"
+            "2 1\n");
+  FieldGroups groups;
+  ASSERT_TRUE(groups.Load(kFile));
+  EXPECT_EQ(groups.NumField(), 3);
+  EXPECT_EQ(groups.NumGroup(), 2);
+  EXPECT_EQ(groups.Group(0), 1);
+  EXPECT_EQ(groups.Group(2), 1);
+  EXPECT_EQ(groups.Group(3), 0);
+  // The other fields are in one more group
+  EXPECT_EQ(groups.Group(1), 2);
+  EXPECT_EQ(groups.Group(100), 2);
+  groups.Serialize(kFile);
+  FieldGroups loaded;
+  ASSERT_TRUE(loaded.Load(kFile));
+  EXPECT_EQ(loaded.Hash(), groups.Hash());
+  for (index_t f = 0; f < 5; ++f) {
+    EXPECT_EQ(loaded.Group(f), groups.Group(f));
+  }
+  loaded.Set(1, 0);
+  EXPECT_NE(loaded.Hash(), groups.Hash());
+  WriteText("0 1\nfield 2\n");
+  EXPECT_FALSE(groups.Load(kFile));
+  RemoveFile(kFile);
+  EXPECT_FALSE(groups.Load(kFile));
+}
+
+TEST(FIELD_GROUPS_TEST, Learn) {
+  // Two clusters of the fields on a line
+  std::vector<real_t> points = { 0.0, 0.1, 5.0, 0.2, 5.1, 4.9 };
+  FieldGroups groups;
+  groups.Learn(points, 6, 1, 2);
+  EXPECT_EQ(groups.NumGroup(), 2);
+  EXPECT_EQ(groups.NumField(), 6);
+  EXPECT_EQ(groups.Group(0), 0);
+  EXPECT_EQ(groups.Group(1), 0);
+  EXPECT_EQ(groups.Group(3), 0);
+  EXPECT_EQ(groups.Group(2), 1);
+  EXPECT_EQ(groups.Group(4), 1);
+  EXPECT_EQ(groups.Group(5), 1);
+  // No more groups than the distinct points
+  points = { 1.0, 2.0, 1.0, 2.0 };
+  groups.Learn(points, 2, 2, 4);
+  EXPECT_EQ(groups.NumGroup(), 1);
+  points = { 1.0, 1.0, 2.0, 2.0 };
+  groups.Learn(points, 4, 1, 4);
+  EXPECT_EQ(groups.NumGroup(), 2);
+  EXPECT_EQ(groups.Group(1), 0);
+  EXPECT_EQ(groups.Group(2), 1);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of FieldK.
+*/
+
+#include "src/data/field_k.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace xLearn {
+
+// The keys are compacted when they are twice the unique ones
+static const uint64 kMinCompactSize = 1 << 20;
+
+void FieldK::Reset(index_t num_field, index_t num_K) {
+  CHECK_GT(num_K, 0);
+  k_.assign(num_field, num_K);
+}
+
+void FieldK::Set(index_t field, index_t k) {
+  CHECK_LT(field, k_.size());
+  CHECK_GT(k, 0);
+  k_[field] = k;
+}
+
+// The blank lines and the lines of '#' are skipped
+bool FieldK::Load(const std::string& filename,
+                  index_t num_field,
+                  index_t num_K) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) { return false; }
+  Reset(num_field, num_K);
+  char line[256];
+  bool legal = true;
+  while (legal && fgets(line, sizeof(line), file) != nullptr) {
+    char* p = line;
+    while (*p == ' ' || *p == '\t') { ++p; }
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) { continue; }
+    long long field = 0, k = 0;
+    if (sscanf(p, "%lld %lld", &field, &k) != 2 || field < 0 ||
+        k <= 0 || k > num_K) {
+      legal = false;
+    } else if (field < num_field) {
+      Set(field, k);
+    }
+  }
+  fclose(file);
+  return legal;
+}
+
+void FieldK::AddRow(const RowView& row) {
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    keys_.push_back(((uint64)iter->field_id << 32) | iter->feat_id);
+  }
+  if (keys_.size() >= std::max(2 * num_unique_, kMinCompactSize)) {
+    compact();
+  }
+}
+
+void FieldK::compact() {
+  std::sort(keys_.begin() + num_unique_, keys_.end());
+  std::inplace_merge(keys_.begin(), keys_.begin() + num_unique_,
+                     keys_.end());
+  keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+  num_unique_ = keys_.size();
+}
+
+// The fields that have no feature get the smallest K
+void FieldK::Learn(index_t num_field, index_t num_K) {
+  compact();
+  count_.assign(num_field, 0);
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    index_t field = keys_[i] >> 32;
+    if (field < num_field) { count_[field]++; }
+  }
+  std::vector<uint64>().swap(keys_);
+  num_unique_ = 0;
+  Reset(num_field, num_K);
+  for (index_t f = 0; f < num_field; ++f) {
+    index_t k = std::ceil(6.0 * std::pow((double)count_[f], 0.25) /
+                          kAlign) * kAlign;
+    k_[f] = std::min(std::max<index_t>(k, kAlign), num_K);
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,104 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the FieldK class, which is the size K of
+the latent vectors of each field of FFM.
+*/
+
+#ifndef XLEARN_DATA_FIELD_K_H_
+#define XLEARN_DATA_FIELD_K_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// FFM gives every latent vector the same K, while a field of a few
+// distinct features (e.g., the weekday) needs much fewer dimensions than
+// a field of millions of ids. FieldK is the K of the latent vectors
+// V_i_f of each field f, which is read from a text file of one "field K"
+// per line, e.g., "0 4", or chosen by the number of the distinct
+// features of each field in a pass over the data:
+//
+//   FieldK field_k;
+//   if (!field_k.Load("/tmp/field_k.txt", num_field, 32)) { /* error */ }
+//
+//   for (each row of the training set) { field_k.AddRow(row); }
+//   field_k.Learn(num_field, 32);
+//
+//   index_t k = field_k.Get(field);
+//
+// The fields that are not in the file have the largest K.
+//------------------------------------------------------------------------------
+class FieldK {
+ public:
+  FieldK() : num_unique_(0) { }
+  ~FieldK() { }
+
+  // Give all the num_field fields num_K
+  void Reset(index_t num_field, index_t num_K);
+
+  // Set the K of the field, which is in [1, num_K]
+  void Set(index_t field, index_t k);
+
+  inline index_t Get(index_t field) const { return k_[field]; }
+  inline const std::vector<index_t>& Values() const { return k_; }
+  inline index_t NumField() const { return k_.size(); }
+
+  // Read the K of the fields of the text file, and the fields that
+  // are not less than num_field are ignored. Return false if the
+  // file cannot be read, or it has an illegal line or a K that is
+  // not in [1, num_K]
+  bool Load(const std::string& filename,
+            index_t num_field,
+            index_t num_K);
+
+  // Count the distinct features of each field of the row
+  void AddRow(const RowView& row);
+
+  // Give each field the K of the rule of thumb 6 * n^(1/4) of its
+  // n distinct features of AddRow(), in [kAlign, num_K]
+  void Learn(index_t num_field, index_t num_K);
+
+  // Number of the distinct features of the field of Learn()
+  inline uint64 Cardinality(index_t field) const {
+    return field < count_.size() ? count_[field] : 0;
+  }
+
+ protected:
+  std::vector<index_t> k_;
+  /* The (field, feature) keys of AddRow(), whose first
+  num_unique_ ones are sorted and unique */
+  std::vector<uint64> keys_;
+  uint64 num_unique_;
+  /* The distinct features of each field */
+  std::vector<uint64> count_;
+
+  // Sort and merge the keys
+  void compact();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FieldK);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_FIELD_K_H_
@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests field_k.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/data/field_k.h"
+
+namespace xLearn {
+
+const char* kFile = "./test_field_k.txt";
+
+void WriteText(const char* text) {
+  FILE* file = OpenFileOrDie(kFile, "w");
+  fputs(text, file);
+  Close(file);
+}
+
+TEST(FIELD_K_TEST, Load) {
+  WriteText("# field K\n"
+            "0 4\n"
+            "\n"
+            "  2 6\n"
+            "9 8\n");
+  FieldK field_k;
+  ASSERT_TRUE(field_k.Load(kFile, 4, 16));
+  EXPECT_EQ(field_k.NumField(), 4);
+  EXPECT_EQ(field_k.Get(0), 4);
+  EXPECT_EQ(field_k.Get(1), 16);
+  EXPECT_EQ(field_k.Get(2), 6);
+  EXPECT_EQ(field_k.Get(3), 16);
+  // The K beyond the K of the model
+  WriteText("0 32\n");
+  EXPECT_FALSE(field_k.Load(kFile, 4, 16));
+  WriteText("0 0\n");
+  EXPECT_FALSE(field_k.Load(kFile, 4, 16));
+  WriteText("0\n");
+  EXPECT_FALSE(field_k.Load(kFile, 4, 16));
+  EXPECT_FALSE(field_k.Load("./no_such_field_k.txt", 4, 16));
+  RemoveFile(kFile);
+}
+
+TEST(FIELD_K_TEST, Learn) {
+  // Field 0 has 2 features, field 1 has 10000 and
+  // field 2 has none
+  std::vector<Node> nodes;
+  FieldK field_k;
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    for (index_t i = 0; i < 10000; ++i) {
+      nodes.clear();
+      nodes.push_back({0, i % 2, 1.0});
+      nodes.push_back({1, 2 + i, 1.0});
+      field_k.AddRow(RowView(nodes.data(), nodes.data() + nodes.size()));
+    }
+  }
+  field_k.Learn(3, 32);
+  EXPECT_EQ(field_k.Cardinality(0), 2);
+  EXPECT_EQ(field_k.Cardinality(1), 10000);
+  EXPECT_EQ(field_k.Cardinality(2), 0);
+  // 6 * 2^(1/4) = 7.1 and 6 * 10^1 = 60
+  EXPECT_EQ(field_k.Get(0), 8);
+  EXPECT_EQ(field_k.Get(1), 32);
+  EXPECT_EQ(field_k.Get(2), 4);
+}
+
+}  // namespace xLearn
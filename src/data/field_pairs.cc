@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of FieldPairMask.
+*/
+
+#include "src/data/field_pairs.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+void FieldPairMask::Reset(index_t num_field) {
+  num_field_ = num_field;
+  allowed_.assign((uint64)num_field * num_field, 0);
+}
+
+void FieldPairMask::Allow(index_t a, index_t b) {
+  CHECK_LT(a, num_field_);
+  CHECK_LT(b, num_field_);
+  allowed_[(uint64)a * num_field_ + b] = 1;
+  allowed_[(uint64)b * num_field_ + a] = 1;
+}
+
+uint64 FieldPairMask::NumPairs() const {
+  uint64 count = 0;
+  for (index_t a = 0; a < num_field_; ++a) {
+    for (index_t b = a; b < num_field_; ++b) {
+      count += allowed_[(uint64)a * num_field_ + b];
+    }
+  }
+  return count;
+}
+
+// The blank lines and the lines of '#' are skipped
+bool FieldPairMask::Load(const std::string& filename,
+                         index_t num_field) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) { return false; }
+  Reset(num_field);
+  char line[256];
+  bool legal = true;
+  while (legal && fgets(line, sizeof(line), file) != nullptr) {
+    char* p = line;
+    while (*p == ' ' || *p == '\t') { ++p; }
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) { continue; }
+    long long a = 0, b = 0;
+    if (sscanf(p, "%lld %lld", &a, &b) != 2 || a < 0 || b < 0) {
+      legal = false;
+    } else if (a < num_field && b < num_field) {
+      Allow(a, b);
+    }
+  }
+  fclose(file);
+  return legal;
+}
+
+void FieldPairMask::Serialize(const std::string& filename) const {
+  CHECK_NE(filename.empty(), true);
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (index_t a = 0; a < num_field_; ++a) {
+    for (index_t b = a; b < num_field_; ++b) {
+      if (allowed_[(uint64)a * num_field_ + b] != 0) {
+        fprintf(file, "%u %u\n", a, b);
+      }
+    }
+  }
+  Close(file);
+}
+
+void FieldPairMask::Learn(const std::vector<double>& strength,
+                          index_t num_field,
+                          real_t ratio) {
+  CHECK_EQ(strength.size(), (uint64)num_field * num_field);
+  CHECK_GT(ratio, 0);
+  std::vector<std::pair<double, uint64> > pairs;
+  for (index_t a = 0; a < num_field; ++a) {
+    for (index_t b = a; b < num_field; ++b) {
+      uint64 i = (uint64)a * num_field + b;
+      if (strength[i] > 0) {
+        pairs.push_back(std::make_pair(strength[i], i));
+      }
+    }
+  }
+  // The stable sort keeps the order of the fields for ties
+  std::stable_sort(pairs.begin(), pairs.end(),
+    [](const std::pair<double, uint64>& x,
+       const std::pair<double, uint64>& y) { return x.first > y.first; });
+  uint64 num_keep = std::ceil(pairs.size() * ratio);
+  num_keep = std::min<uint64>(std::max<uint64>(num_keep, 1), pairs.size());
+  Reset(num_field);
+  for (uint64 k = 0; k < num_keep; ++k) {
+    Allow(pairs[k].second / num_field, pairs[k].second % num_field);
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the FieldPairMask class, which is the whitelist
+of the field pairs that interact in FFM.
+*/
+
+#ifndef XLEARN_DATA_FIELD_PAIRS_H_
+#define XLEARN_DATA_FIELD_PAIRS_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// FFM scores every pair of nodes of a row, but many field pairs carry no
+// signal. FieldPairMask is the whitelist of the (unordered) field pairs
+// whose nodes interact, and the pairs of the other fields are neither
+// computed nor given a latent vector. The mask is read from a text file
+// of one pair per line, e.g., "0 3", or learned from the interaction
+// strength of each field pair of a trained model:
+//
+//   FieldPairMask mask;
+//   if (!mask.Load("/tmp/field_pairs.txt", num_field)) { /* error */ }
+//   if (mask.Allowed(field_i, field_j)) { /* the pair interacts */ }
+//
+//   mask.Learn(strength, num_field, 0.5);  /* the strongest half */
+//   mask.Serialize("/tmp/field_pairs.txt");
+//
+// The empty mask allows all the pairs.
+//------------------------------------------------------------------------------
+class FieldPairMask {
+ public:
+  FieldPairMask() : num_field_(0) { }
+  ~FieldPairMask() { }
+
+  // Allow none of the pairs of num_field fields
+  void Reset(index_t num_field);
+
+  // Allow the pair (a, b), which is the same as (b, a)
+  void Allow(index_t a, index_t b);
+
+  // The empty mask allows all the pairs, and the fields
+  // out of a non-empty mask have no pair
+  inline bool Empty() const { return num_field_ == 0; }
+  inline bool Allowed(index_t a, index_t b) const {
+    if (num_field_ == 0) { return true; }
+    if (a >= num_field_ || b >= num_field_) { return false; }
+    return allowed_[(uint64)a * num_field_ + b] != 0;
+  }
+
+  index_t NumField() const { return num_field_; }
+
+  // Number of the allowed (unordered) pairs
+  uint64 NumPairs() const;
+
+  // Read the pairs of the text file, and the fields that are
+  // not less than num_field are ignored. Return false if the
+  // file cannot be read or has an illegal line
+  bool Load(const std::string& filename, index_t num_field);
+
+  // Write the allowed pairs in the format of Load()
+  void Serialize(const std::string& filename) const;
+
+  // Allow the strongest pairs by strength[a * num_field + b]
+  // (a <= b), which are the ratio of the pairs of positive
+  // strength and at least one of them
+  void Learn(const std::vector<double>& strength,
+             index_t num_field,
+             real_t ratio);
+
+ protected:
+  index_t num_field_;
+  /* num_field_ * num_field_ flags of the symmetric pairs */
+  std::vector<uint8> allowed_;
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_FIELD_PAIRS_H_
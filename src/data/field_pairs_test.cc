@@ -0,0 +1,104 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests field_pairs.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include "src/base/file_util.h"
+#include "src/data/field_pairs.h"
+
+namespace xLearn {
+
+const char* kFile = "./test_field_pairs.txt";
+
+void WriteText(const char* text) {
+  FILE* file = OpenFileOrDie(kFile, "w");
+  fputs(text, file);
+  Close(file);
+}
+
+TEST(FIELD_PAIRS_TEST, Empty) {
+  FieldPairMask mask;
+  EXPECT_TRUE(mask.Empty());
+  EXPECT_TRUE(mask.Allowed(0, 100));
+  mask.Reset(3);
+  EXPECT_FALSE(mask.Empty());
+  EXPECT_FALSE(mask.Allowed(0, 1));
+  EXPECT_EQ(mask.NumPairs(), 0);
+}
+
+TEST(FIELD_PAIRS_TEST, Load_and_Save) {
+  WriteText("# field pairs\n"
+            "0 1\n"
+            "\n"
+            "  2 2\n"
+            "3 0\n"
+            "1 9\n");
+  FieldPairMask mask;
+  ASSERT_TRUE(mask.Load(kFile, 4));
+  EXPECT_EQ(mask.NumField(), 4);
+  EXPECT_EQ(mask.NumPairs(), 3);
+  EXPECT_TRUE(mask.Allowed(0, 1));
+  EXPECT_TRUE(mask.Allowed(1, 0));
+  EXPECT_TRUE(mask.Allowed(2, 2));
+  EXPECT_TRUE(mask.Allowed(0, 3));
+  EXPECT_FALSE(mask.Allowed(1, 2));
+  EXPECT_FALSE(mask.Allowed(0, 0));
+  // The field out of the mask
+  EXPECT_FALSE(mask.Allowed(1, 9));
+  mask.Serialize(kFile);
+  FieldPairMask loaded;
+  ASSERT_TRUE(loaded.Load(kFile, 4));
+  for (index_t a = 0; a < 4; ++a) {
+    for (index_t b = 0; b < 4; ++b) {
+      EXPECT_EQ(loaded.Allowed(a, b), mask.Allowed(a, b));
+    }
+  }
+  WriteText("0 1\nfield 2\n");
+  EXPECT_FALSE(mask.Load(kFile, 4));
+  RemoveFile(kFile);
+  EXPECT_FALSE(mask.Load(kFile, 4));
+}
+
+TEST(FIELD_PAIRS_TEST, Learn) {
+  // The strength of (a, b) for a <= b
+  std::vector<double> strength(9, 0);
+  strength[0 * 3 + 1] = 5.0;
+  strength[0 * 3 + 2] = 1.0;
+  strength[1 * 3 + 1] = 3.0;
+  strength[2 * 3 + 2] = 0.5;
+  FieldPairMask mask;
+  mask.Learn(strength, 3, 0.5);
+  EXPECT_EQ(mask.NumPairs(), 2);
+  EXPECT_TRUE(mask.Allowed(1, 0));
+  EXPECT_TRUE(mask.Allowed(1, 1));
+  EXPECT_FALSE(mask.Allowed(0, 2));
+  // At least one pair, and none of zero strength
+  mask.Learn(strength, 3, 0.01);
+  EXPECT_EQ(mask.NumPairs(), 1);
+  mask.Learn(strength, 3, 1.0);
+  EXPECT_EQ(mask.NumPairs(), 4);
+  EXPECT_FALSE(mask.Allowed(1, 2));
+}
+
+}  // namespace xLearn
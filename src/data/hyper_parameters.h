@@ -44,11 +44,29 @@ struct HyperParam {
   True for on-disk training, and false for
   in-memory training */
   bool on_disk = false;
+  /* Streaming prediction, which parses and predicts the
+  txt file chunk by chunk without the binary cache */
+  bool stream_predict = false;
+  /* Write the predictions as raw float32 values
+  rather than one value per line in text */
+  bool binary_output = false;
+  /* Only load the features that occur in the predict
+  file, which is counted in a first pass */
+  bool lazy_model = false;
+  /* The delta files of the model (comma-separated), which
+  are applied to the model in order before prediction */
+  std::string delta_files;
+  /* The other models (comma-separated) which score the
+  predict file in the same pass as the model */
+  std::string ensemble_files;
+  /* Write the mean of the predictions of all the models
+  of -ensemble rather than one output file per model */
+  bool blend_output = false;
   /* Don't print any evaluation information during
   the training, and just train the model */
   bool quiet = false;
   /* Score function. For now, it could
-  be 'linear', 'fm', or 'ffm' */
+  be 'linear', 'fm', 'ffm' or 'hofm' */
   std::string score_func = "linear";
   /* Loss function. For now, it could
   be 'cross-entropy', 'squared', or 'hinge' */
@@ -57,6 +75,9 @@ struct HyperParam {
   be 'acc', 'prec', 'recall', 'f1', 'auc',
   'mae', or 'mape' */
   std::string metric = "acc";
+  /* True for the exact AUC, which keeps and sorts all the
+  scores, rather than the streaming AUC of the buckets */
+  bool exact_auc = false;
 //------------------------------------------------------------------------------
 // Parameters for optimization method
 //------------------------------------------------------------------------------
@@ -64,8 +85,74 @@ struct HyperParam {
   real_t learning_rate = 0.2;
   /* lambda for regularize. xLearn uses L2-regular */
   real_t regu_lambda = 0.00002;
+  /* Optimization method of the linear term, which could
+  be 'adagrad', 'ftrl' (FTRL-Proximal) or 'adagrad-lazy'
+  (with the lazy L2 and L1 regular) */
+  std::string opt_method = "adagrad";
+  /* Hyper params of FTRL-Proximal, and lambda_1 and
+  lambda_2 are the L1 and L2 regular. lambda_1 is
+  also the L1 regular of adagrad-lazy */
+  real_t alpha = 0.3;
+  real_t beta = 1.0;
+  real_t lambda_1 = 0.00001;
+  real_t lambda_2 = 0.00002;
+  /* Precision of 1 / sqrt() in adagrad, which could be
+  'fast', 'newton' (one newton step) or 'exact' */
+  std::string sqrt_precision = "fast";
+  /* How the training threads share the model, which could
+  be 'hogwild' (no lock), 'local-bias' (private bias of each
+  thread) or 'replica' (private model of each thread) */
+  std::string thread_mode = "hogwild";
+  /* Number of rows of which the gradients of the linear
+  term and bias are accumulated before they are applied */
+  index_t batch_size = 1;
+  /* How the rows of each batch are assigned to the threads,
+  which could be 'static', 'balanced', 'dynamic' or 'steal'.
+  'auto' is 'dynamic' if grain > 0, otherwise 'static' */
+  std::string schedule = "auto";
+  /* Number of buffers in the prefetch ring of the
+  on-disk training */
+  int pipeline_depth = 2;
+  /* Number of the reads in flight of the blocks of the
+  on-disk training by io_uring, and 0 for the stdio reads */
+  int io_depth = 0;
+  /* True for reading the blocks of the on-disk
+  training with O_DIRECT, bypassing the page cache */
+  bool direct_io = false;
+  /* True for parsing the txt file in the first epoch of the
+  on-disk training and spilling it into the binary file */
+  bool spill_disk = false;
+  /* The budget (MB) of the memory of the data, and the training
+  switches to the on-disk reader if the estimated size of the
+  data is larger, or 0 for half of the memory limit of
+  the cgroup (see resource.h), or no budget without a limit */
+  int mem_budget_mb = 0;
+  /* Number of threads, and 0 means the number of CPUs of
+  affinity or AvailableCpus() (see resource.h) */
+  int thread_number = 0;
+  /* CPUs that the threads are pinned to (see affinity.h),
+  and the empty string means no pinning */
+  std::string affinity = "";
+  /* The NUMA placement of the model, which could be
+  'none', 'interleave' or 'partition' (see affinity.h) */
+  std::string numa_policy = "none";
+  /* The huge pages of the latent factor and the in-memory
+  data, which could be 'none', 'thp' or 'explicit' */
+  std::string huge_page = "none";
+  /* The file of the parameters of the model that is larger
+  than the memory, and the empty string means the memory */
+  std::string param_file;
+  /* Number of the shards of the feature ranges of the
+  model, each of which has its own pages */
+  int model_shards = 1;
+  /* Number of rows in each chunk that the threads fetch
+  from the batch, and 0 for the static partition (or the
+  automatic chunk by -schedule) */
+  index_t grain = 0;
   /* Hyper param for init model parameters */
   real_t model_scale = 0.66;
+  /* The seed of the random latent factor of the model */
+  uint64 model_seed = 2018;
   /* Number of epoch. This value could
   be changed in early-stop */
   int num_epoch = 10;
@@ -75,17 +162,142 @@ struct HyperParam {
   training, xlearn always samples the whole data set
   at each epoch */
   int sample_size = 20000;
+  /* True for tuning the sample_size of the in-memory
+  training by the throughput of the first epoch, which
+  starts around the sample_size */
+  bool auto_sample_size = false;
   /* True for using instance-wise
   normalization, and False for not */
   bool norm = true;
+  /* True for storing the in-memory data buffer
+  and the binary cache in compact encoding */
+  bool compact_data = false;
+  /* True for sorting the nodes of each row by field and
+  then by feature once at parsing, which is cached */
+  bool sort_nodes = false;
+  /* True for parsing the columns of the csv
+  file into the dense block of DMatrix */
+  bool dense_data = false;
+  /* True for writing the binary cache
+  in block-compressed format */
+  bool compress_cache = false;
+  /* True for validating the binary cache by the
+  hash of the whole txt file, besides its fingerprint */
+  bool full_hash_cache = false;
+  /* The shared directory of the binary caches, and
+  its size limit in MB (0 for no limit) */
+  std::string cache_dir;
+  int cache_mb = 0;
+  /* Number of blocks mixed in the shuffle buffer
+  of on-disk training, and 0 for no shuffle */
+  int shuffle_window = 4;
+  /* Number of rows of the blocks that are shuffled with
+  their rows shuffled within each block, instead of the full
+  shuffle or the shuffle window, and 0 for no block shuffle */
+  int shuffle_block = 0;
+  /* Number of buckets that the feature ids are hashed
+  into, and 0 for no hashing */
+  index_t hash_bucket = 0;
+  /* The rate of the negative rows of the training set that
+  are kept at loading time, and the kept ones are weighted by
+  1 / neg_sample in the gradient and the loss. 1 means all */
+  real_t neg_sample = 1.0;
+  /* Number of the heads of the stages of a funnel, which are
+  trained on the same rows in one pass. The head k is trained
+  on the label y >= k, and 1 means one model of the labels */
+  int num_heads = 1;
+  /* True for collapsing the duplicate rows of the training
+  set into one row per label, weighted by their number */
+  bool dedup_rows = false;
+  /* The decay of the weight of the rows of the older part
+  files of the training set, whose i-th of n parts (in the
+  order of the list, e.g., the days of a window) is weighted
+  by part_decay^(n-1-i). 1 means the same weight */
+  real_t part_decay = 1.0;
+  /* True for reading each epoch of the in-memory training
+  from a contiguous copy of the rows in the shuffled order,
+  which is written in the background during the last epoch */
+  bool shuffle_copy = false;
+  /* True for grouping the rows of each batch of the in-memory
+  training by their hot feature, so the threads of Hogwild
+  share fewer features (see Reader::SetGroupRows()) */
+  bool group_rows = false;
+  /* True for re-indexing the feature ids into a dense
+  range, whose map is stored with the model file */
+  bool remap_feature = false;
+  /* True for giving the dense ids in the order of
+  descending frequency, which implies remap_feature */
+  bool freq_order = false;
+  /* The features that occur less than min_count times in
+  the training set are dropped, which implies freq_order,
+  or mapped to one shared OOV feature if oov_feature */
+  int min_count = 0;
+  bool oov_feature = false;
+  /* Only allocate the latent vectors of FFM of the (feature,
+  field) pairs that occur in the training set */
+  bool sparse_latent = false;
+  /* The layout of the latent blocks of FFM in memory, which
+  is 'interleaved' (w and its cache in turns) or 'split' */
+  std::string latent_layout = "interleaved";
+  /* Storage of the adagrad caches of the FFM latent factor,
+  which is 'fp32', 'fp16', 'bf16' or 'log8' (8 bits of the
+  log-quantized cache). The reduced caches use the split
+  layout 'split-fp16', 'split-bf16' or 'split-log8' */
+  std::string cache_precision = "fp32";
+  /* Keep one adagrad cache per latent vector of FFM, which adds
+  the mean squared gradient of the vector (the 'split-shared'
+  layout), rather than one cache per weight */
+  bool shared_cache = false;
+  /* The text file of the field pairs of FFM that interact,
+  one pair per line, which implies sparse_latent */
+  std::string field_pairs_file;
+  /* The text file where the strongest field pairs of the
+  trained model are written, and the ratio of them kept */
+  std::string learn_field_pairs;
+  real_t field_pair_ratio = 0.5;
+  /* The text file of the K of the latent vectors of each field
+  of FFM, one "field K" per line, or "auto" for the K of the
+  number of the distinct features of each field */
+  std::string field_k;
+  /* The text file of the groups of the fields of FFM, one
+  "field group" per line, and the fields of a group share
+  one latent vector of each feature */
+  std::string field_groups_file;
+  /* The pairs of the fields of the hashed crosses generated
+  at parsing time, e.g., "0:1,0:2", or empty for no cross */
+  std::string cross_fields;
+  /* The text file where the groups of the fields clustered
+  from the trained model are written, and their number */
+  std::string learn_field_groups;
+  int num_field_groups = 8;
+  /* Number of feature pairs ahead whose latent vectors
+  are prefetched by the ffm kernel, and 0 for no prefetch */
+  int prefetch_distance = 0;
+  /* Storage of the latent factor in prediction, which
+  could be 'fp32', 'fp16' (IEEE half), 'bf16' (bfloat16)
+  or 'int8' (quantized with a scale for each latent vector) */
+  std::string latent_type = "fp32";
+  /* True for saving the model checkpoint without the
+  gradient caches, which can only be used by prediction */
+  bool weights_only_model = false;
+  /* True for saving the model in the memory-mappable format,
+  which is mapped by prediction in read-only mode */
+  bool mapped_model = false;
+  /* True for saving only the features that are updated
+  in training, which is used by prediction */
+  bool sparse_model = false;
+  /* True for saving the model and the checkpoints in the chunked
+  format, which is written and read by the threads and each chunk
+  has a CRC32C */
+  bool chunked_model = false;
 //------------------------------------------------------------------------------
 // Parameters for dataset
 //------------------------------------------------------------------------------
   /* Number of feature */
   index_t num_feature = 0;
   /* Number of total model parameters */
-  index_t num_param = 0;
-  /* Number of lateny factor for fm and ffm */
+  uint64 num_param = 0;
+  /* Number of lateny factor for fm, ffm and hofm */
   index_t num_K = 4;
   /* Number of field, used by ffm tasks */
   index_t num_field = 0;
@@ -100,10 +312,23 @@ struct HyperParam {
   std::string predict_file;
   /* Filename of model checkpoint */
   std::string model_file = "./xlearn_model";
+  /* Filename of the former model checkpoint, from which
+  the training is warm-started. This value can be empty */
+  std::string pre_model_file;
+  /* Filename of the simpler model (e.g., linear or fm for
+  ffm, or a smaller K) whose weights initialize the model.
+  This value can be empty */
+  std::string init_model_file;
   /* Filename of output result for prediction */
   std::string output_file = "./xlearn_out";
   /* Filename of log file */
   std::string log_file = "./xlearn_log";
+  /* Filename of the NDJSON metrics of the training,
+  and the empty string means no such file */
+  std::string metrics_file;
+  /* Filename of the Chrome trace of the phases and the
+  threads, and the empty string means no such file */
+  std::string trace_file;
 //------------------------------------------------------------------------------
 // Parameters for validation
 //------------------------------------------------------------------------------
@@ -112,9 +337,101 @@ struct HyperParam {
   bool cross_validation = false;
   /* Number of folds in cross-validation */
   int num_folds = 5;
+  /* Number of the folds trained at the same time in the
+  in-memory cross-validation, each by its share of the
+  threads. 1 trains the folds one by one */
+  int cv_jobs = 1;
   /* True for using early-stop, and
   False for not */
   bool early_stop = false;
+  /* Training is stopped if the test metric has not
+  been improved for stop_window validations */
+  int stop_window = 2;
+  /* Validate the model every valid_batches batches of
+  each epoch, and 0 means the end of each epoch only */
+  int valid_batches = 0;
+  /* Number of the background threads that validate a copy
+  of the model during the next epoch, and 0 means the
+  validation is done before the next epoch */
+  int async_valid = 0;
+  /* Save a checkpoint of the model to <model_file>.ckpt every
+  checkpoint_epoch epochs, and at the end of the epoch after
+  checkpoint_minute minutes. 0 means no such checkpoint */
+  int checkpoint_epoch = 0;
+  real_t checkpoint_minute = 0;
+  /* True for saving the delta of the features updated since
+  the last checkpoint instead of the checkpoint after the
+  first one, to <model_file>.ckpt.delta.<N> */
+  bool checkpoint_delta = false;
+  /* True for saving the state of the training to <model_file>.resume
+  at SIGTERM or SIGINT and stopping, and for continuing from the
+  state if it exists, i.e., the training on preemptible nodes */
+  bool resume = false;
+  /* The wall-clock budget of the training job in minutes, which
+  adapts the epochs to finish in it, and keeps the best model of
+  the test set. 0 means no budget */
+  real_t budget_minute = 0;
+  /* True for scoring and training the FFM model on the GPU
+  (ffm_score_gpu.h), which needs the build of XLEARN_CUDA */
+  bool use_gpu = false;
+  /* True for choosing the kernels of the score by timing them on
+  the first rows of the training set, which is cached by the CPU
+  model and the config (kernel_tuner.h) */
+  bool tune_kernel = false;
+  /* True for the online training, which makes one pass over
+  the unbounded stream of the training file (or the stdin),
+  and saves the checkpoints every checkpoint_epoch batches
+  or checkpoint_minute minutes during the pass */
+  bool online = false;
+  /* The online feature gets its parameters after it has been
+  seen admit_count times, and the occurrences before share
+  one OOV feature. 0 means no admission. The occurrences are
+  counted by admit_mb MB of counters (see AdmissionFilter) */
+  int admit_count = 0;
+  int admit_mb = 16;
+  /* The online features that are not updated for ttl_minute
+  minutes are evicted, and their parameters are reset. 0
+  means no eviction */
+  real_t ttl_minute = 0;
+  /* The capacity of the model of the online training without
+  hash_bucket, which grows as the new features arrive */
+  index_t max_feature = 1 << 26;
+  /* The train loss and metric of each epoch are evaluated on
+  a fixed random sample of this fraction of the train rows,
+  and 0 means the running loss of the update pass */
+  real_t train_sample = 0;
+  /* The rate of the train rows updated in each epoch after the
+  first, which are sampled by their loss and weighted by the
+  inverse of the probability, and 0 means all the rows */
+  real_t loss_sample = 0;
+//------------------------------------------------------------------------------
+// Parameters for distributed training
+//------------------------------------------------------------------------------
+  /* The parameter servers "host:port,host:port,...", and
+  the empty string means the local training */
+  std::string ps_servers;
+  /* The nodes "host:port,host:port,..." of the data-parallel
+  training, which average their models by ring allreduce */
+  std::string ring_nodes;
+  /* The model of the nodes is averaged every sync_batches
+  batches, and 0 means the end of each epoch only */
+  int sync_batches = 0;
+  /* The id of this worker (or node) in [0, num_workers),
+  and the worker 0 saves the model */
+  int worker_id = 0;
+  int num_workers = 1;
+  /* The max number of batches that the fastest worker
+  can be ahead of the slowest one */
+  int staleness = 0;
+  /* The quantization of the pushed deltas, which could
+  be 'fp32', 'fp16', or 'int8' */
+  std::string ps_quant = "fp32";
+  /* Each worker reads its shard of the training file */
+  bool shard_data = false;
+  /* The name of the model in the shared memory, which is
+  trained by the processes on the same host, and the empty
+  string means the model of this process */
+  std::string shm_name;
 };
 
 }  // namespace XLEARN
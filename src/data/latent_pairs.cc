@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of LatentPairs.
+*/
+
+#include "src/data/latent_pairs.h"
+
+namespace xLearn {
+
+// The collection is compacted when it doubles, and
+// at least so many pairs are collected before that
+static const uint64 kMinCompactSize = 1 << 20;
+
+void LatentPairs::SetFieldMask(const FieldPairMask& mask) {
+  CHECK(keys_.empty());
+  CHECK(start_.empty());
+  mask_ = mask;
+}
+
+// The field of V_i_f is the field of another node of the row,
+// so the field of node i itself needs another node of it
+void LatentPairs::AddRow(const RowView& row, index_t num_field) {
+  CHECK(start_.empty());
+  if (row.size() < 2) { return; }
+  std::vector<index_t> fields;
+  fields.reserve(row.size());
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    CHECK_LT(iter->field_id, num_field);
+    fields.push_back(iter->field_id);
+  }
+  std::sort(fields.begin(), fields.end());
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    uint64 feat = (uint64)iter->feat_id << 32;
+    for (size_t k = 0; k < fields.size(); ) {
+      size_t next = k + 1;
+      while (next < fields.size() && fields[next] == fields[k]) { ++next; }
+      if ((fields[k] != iter->field_id || next - k > 1) &&
+          mask_.Allowed(iter->field_id, fields[k])) {
+        keys_.push_back(feat | fields[k]);
+      }
+      k = next;
+    }
+  }
+  if (keys_.size() >= std::max(2 * num_unique_, kMinCompactSize)) {
+    compact();
+  }
+}
+
+// The new pairs are sorted and merged into the sorted ones
+void LatentPairs::compact() {
+  std::sort(keys_.begin() + num_unique_, keys_.end());
+  std::inplace_merge(keys_.begin(), keys_.begin() + num_unique_,
+                     keys_.end());
+  keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+  num_unique_ = keys_.size();
+}
+
+void LatentPairs::Build(index_t num_feat) {
+  CHECK(start_.empty());
+  compact();
+  start_.assign((uint64)num_feat + 1, 0);
+  field_.clear();
+  field_.reserve(keys_.size());
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    index_t feat = keys_[i] >> 32;
+    CHECK_LT(feat, num_feat);
+    start_[feat + 1]++;
+    field_.push_back(keys_[i] & 0xffffffffULL);
+  }
+  for (index_t i = 0; i < num_feat; ++i) {
+    start_[i + 1] += start_[i];
+  }
+  std::vector<uint64>().swap(keys_);
+  num_unique_ = 0;
+}
+
+index_t LatentPairs::FeatureOf(uint64 slot) const {
+  CHECK_LT(slot, Size());
+  return std::upper_bound(start_.begin(), start_.end(), slot) -
+         start_.begin() - 1;
+}
+
+}  // namespace xLearn
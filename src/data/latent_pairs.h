@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the LatentPairs class, which is the index of the
+(feature, field) pairs of the sparse latent factor of FFM.
+*/
+
+#ifndef XLEARN_DATA_LATENT_PAIRS_H_
+#define XLEARN_DATA_LATENT_PAIRS_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/field_pairs.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// In FFM, the latent vector V_i_f of feature i and field f is only used
+// if a feature of field f occurs in a row with i. On the data of many
+// fields, a feature only meets a few percent of the fields, so the model
+// only needs the latent vectors of the pairs that occur in the training
+// set. LatentPairs collects these pairs in a pass over the data, and
+// gives each pair a slot, which is its latent vector in the model:
+//
+//   LatentPairs pairs;
+//   for (each row of the training set) { pairs.AddRow(row, num_field); }
+//   pairs.Build(num_feature);
+//   uint64 slot = pairs.Find(feat, field);  /* or kNoLatentSlot */
+//
+// With a FieldPairMask, the pairs of the masked field pairs are not
+// collected, so they have no latent vector in the model either.
+//
+// The index is in the CSR format: the fields of each feature are sorted
+// and contiguous, and the slots of a feature are consecutive. So a lookup
+// only searches the few fields of one feature in one or two cache lines.
+//------------------------------------------------------------------------------
+
+// The pair is not in the index
+const uint64 kNoLatentSlot = ~0ULL;
+
+class LatentPairs {
+ public:
+  LatentPairs() : num_unique_(0) { }
+  ~LatentPairs() { }
+
+  // Only collect the pairs of the allowed field pairs.
+  // Invoke this method before AddRow()
+  void SetFieldMask(const FieldPairMask& mask);
+  inline const FieldPairMask& FieldMask() const { return mask_; }
+
+  // Add the pairs (feat_i, field_j) of the row for every i != j
+  void AddRow(const RowView& row, index_t num_field);
+
+  // Build the index of the features [0, num_feat) from the added
+  // pairs, and release the memory of the collection
+  void Build(index_t num_feat);
+
+  // Number of the features and the pairs (slots) of the index
+  inline index_t NumFeature() const {
+    return start_.empty() ? 0 : start_.size() - 1;
+  }
+  inline uint64 Size() const { return field_.size(); }
+
+  // The slot of the pair, or kNoLatentSlot
+  inline uint64 Find(index_t feat, index_t field) const {
+    if (feat >= NumFeature()) { return kNoLatentSlot; }
+    const index_t* first = field_.data() + start_[feat];
+    const index_t* last = field_.data() + start_[feat+1];
+    const index_t* iter = std::lower_bound(first, last, field);
+    if (iter == last || *iter != field) { return kNoLatentSlot; }
+    return iter - field_.data();
+  }
+
+  // The slots of feat are [Start(feat), Start(feat + 1)),
+  // and the field of each slot is Field(slot)
+  inline uint64 Start(index_t feat) const { return start_[feat]; }
+  inline index_t Field(uint64 slot) const { return field_[slot]; }
+
+  // The feature of the slot
+  index_t FeatureOf(uint64 slot) const;
+
+  // Bytes of the index
+  uint64 MemoryBytes() const {
+    return start_.capacity() * sizeof(uint64) +
+           field_.capacity() * sizeof(index_t);
+  }
+
+ protected:
+  /* The collected pairs (feat << 32 | field), and the
+  first num_unique_ of them are sorted and unique */
+  std::vector<uint64> keys_;
+  uint64 num_unique_;
+  /* The first slot of each feature (num_feat + 1) */
+  std::vector<uint64> start_;
+  /* The field of each slot */
+  std::vector<index_t> field_;
+  /* The allowed field pairs, empty for all */
+  FieldPairMask mask_;
+
+  // Sort and deduplicate the collected pairs
+  void compact();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LatentPairs);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_LATENT_PAIRS_H_
@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests latent_pairs.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <set>
+#include <utility>
+
+#include "src/data/latent_pairs.h"
+
+namespace xLearn {
+
+TEST(LATENT_PAIRS_TEST, Find) {
+  // Row 0: (feat 0, field 0), (feat 2, field 1), (feat 3, field 1)
+  // Row 1: (feat 2, field 2)
+  // Row 2: (feat 1, field 0), (feat 2, field 2)
+  SparseRow row_0(3), row_1(1), row_2(2);
+  row_0[0].feat_id = 0; row_0[0].field_id = 0;
+  row_0[1].feat_id = 2; row_0[1].field_id = 1;
+  row_0[2].feat_id = 3; row_0[2].field_id = 1;
+  row_1[0].feat_id = 2; row_1[0].field_id = 2;
+  row_2[0].feat_id = 1; row_2[0].field_id = 0;
+  row_2[1].feat_id = 2; row_2[1].field_id = 2;
+  LatentPairs pairs;
+  pairs.AddRow(&row_0, 3);
+  pairs.AddRow(&row_1, 3);
+  pairs.AddRow(&row_2, 3);
+  pairs.AddRow(&row_0, 3);
+  pairs.Build(5);
+  // Row 0 has two nodes of field 1, so feat 2 and 3 meet field 1 too
+  std::set<std::pair<index_t, index_t> > expect;
+  expect.insert(std::make_pair(0, 1));
+  expect.insert(std::make_pair(1, 2));
+  expect.insert(std::make_pair(2, 0));
+  expect.insert(std::make_pair(2, 1));
+  expect.insert(std::make_pair(3, 0));
+  expect.insert(std::make_pair(3, 1));
+  EXPECT_EQ(pairs.NumFeature(), 5);
+  EXPECT_EQ(pairs.Size(), expect.size());
+  std::set<uint64> slots;
+  for (index_t feat = 0; feat < 6; ++feat) {
+    for (index_t field = 0; field < 3; ++field) {
+      uint64 slot = pairs.Find(feat, field);
+      if (expect.count(std::make_pair(feat, field)) == 0) {
+        EXPECT_EQ(slot, kNoLatentSlot);
+        continue;
+      }
+      ASSERT_LT(slot, pairs.Size());
+      EXPECT_EQ(pairs.Field(slot), field);
+      EXPECT_EQ(pairs.FeatureOf(slot), feat);
+      EXPECT_GE(slot, pairs.Start(feat));
+      EXPECT_LT(slot, pairs.Start(feat + 1));
+      slots.insert(slot);
+    }
+  }
+  EXPECT_EQ(slots.size(), expect.size());
+  EXPECT_EQ(pairs.Start(4), pairs.Start(5));
+  EXPECT_GT(pairs.MemoryBytes(), 0);
+}
+
+// A feature meets its own field through another node of that field
+TEST(LATENT_PAIRS_TEST, Same_field) {
+  SparseRow row(3);
+  row[0].feat_id = 0; row[0].field_id = 0;
+  row[1].feat_id = 1; row[1].field_id = 0;
+  row[2].feat_id = 2; row[2].field_id = 1;
+  LatentPairs pairs;
+  pairs.AddRow(&row, 2);
+  pairs.Build(3);
+  EXPECT_NE(pairs.Find(0, 0), kNoLatentSlot);
+  EXPECT_NE(pairs.Find(1, 0), kNoLatentSlot);
+  EXPECT_NE(pairs.Find(2, 0), kNoLatentSlot);
+  EXPECT_EQ(pairs.Find(2, 1), kNoLatentSlot);
+  EXPECT_EQ(pairs.Size(), 5);
+}
+
+// The pairs of the masked field pairs are not collected
+TEST(LATENT_PAIRS_TEST, Field_mask) {
+  SparseRow row(3);
+  row[0].feat_id = 0; row[0].field_id = 0;
+  row[1].feat_id = 1; row[1].field_id = 1;
+  row[2].feat_id = 2; row[2].field_id = 2;
+  FieldPairMask mask;
+  mask.Reset(3);
+  mask.Allow(0, 1);
+  LatentPairs pairs;
+  pairs.SetFieldMask(mask);
+  pairs.AddRow(&row, 3);
+  pairs.Build(3);
+  EXPECT_EQ(pairs.Size(), 2);
+  EXPECT_NE(pairs.Find(0, 1), kNoLatentSlot);
+  EXPECT_NE(pairs.Find(1, 0), kNoLatentSlot);
+  EXPECT_EQ(pairs.Find(0, 2), kNoLatentSlot);
+  EXPECT_EQ(pairs.Find(2, 1), kNoLatentSlot);
+  EXPECT_TRUE(pairs.FieldMask().Allowed(1, 0));
+  EXPECT_FALSE(pairs.FieldMask().Allowed(1, 2));
+}
+
+// The collection is compacted many times on the way
+TEST(LATENT_PAIRS_TEST, Compact) {
+  const index_t kFeat = 1000;
+  const index_t kField = 8;
+  LatentPairs pairs;
+  SparseRow row(kField);
+  for (int n = 0; n < 50000; ++n) {
+    for (index_t f = 0; f < kField; ++f) {
+      row[f].feat_id = (n * 7 + f * 131) % kFeat;
+      row[f].field_id = f;
+    }
+    pairs.AddRow(&row, kField);
+  }
+  pairs.Build(kFeat);
+  uint64 count = 0;
+  for (index_t feat = 0; feat < kFeat; ++feat) {
+    for (index_t field = 0; field < kField; ++field) {
+      uint64 slot = pairs.Find(feat, field);
+      if (slot != kNoLatentSlot) {
+        ++count;
+        EXPECT_EQ(pairs.FeatureOf(slot), feat);
+      }
+    }
+  }
+  EXPECT_EQ(count, pairs.Size());
+  EXPECT_GT(count, 0);
+}
+
+}  // namespace xLearn
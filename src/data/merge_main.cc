@@ -0,0 +1,206 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the xlearn_merge tool, which averages the
+models trained on the shards of the data (or the members of an
+ensemble) into one model file:
+
+  xlearn_merge [ options ] model_file_1 model_file_2 ... output_file
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/resource.h"
+#include "src/base/split_string.h"
+#include "src/base/thread_pool.h"
+#include "src/data/model_merger.h"
+
+namespace {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_merge [ options ] model_file_1 model_file_2 ... output_file \n"
+"                                                                       \n"
+"  Average the models of the same score function, loss, features, fields, K and optimizer \n"
+"  into output_file, which has the format of the models (the checkpoint, the weights-only or \n"
+"  the memory-mappable model). The models are mapped instead of loaded, and the features \n"
+"  are merged in chunks by the threads. \n"
+"                                      \n"
+"OPTIONS: \n"
+"  -m <method>          :  'mean' for the (weighted) mean of every parameter, or 'adagrad' for \n"
+"                          the mean weighted by the squared gradients that each model has \n"
+"                          accumulated for each parameter, which needs the checkpoints (trained \n"
+"                          without --weights-only). Using 'mean' by default. \n"
+"                                                                          \n"
+"  -w <w_1,w_2,...>     :  The weights (> 0) of the models, e.g., the sizes of their shards. \n"
+"                          Using 1 for each model by default. \n"
+"                                                            \n"
+"  -nthread <N>         :  Number of the threads. Using all the available CPUs by default. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct MergeOption {
+  xLearn::MergeMethod method = xLearn::kMergeMean;
+  std::vector<xLearn::real_t> weights;
+  int thread_number = 0;
+  std::vector<std::string> file_list;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], MergeOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "-m" || arg == "-w" || arg == "-nthread") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      std::string value(argv[++i]);
+      if (arg == "-m") {
+        if (!xLearn::ParseMergeMethod(value, &option->method)) {
+          printf("[Error] Unknow merge method: %s \n", value.c_str());
+          return false;
+        }
+      } else if (arg == "-w") {
+        std::vector<std::string> items;
+        SplitStringUsing(value, ",", &items);
+        for (size_t k = 0; k < items.size(); ++k) {
+          xLearn::real_t w = atof(items[k].c_str());
+          if (w <= 0) {
+            printf("[Error] Illegal -w : '%s' \n", value.c_str());
+            return false;
+          }
+          option->weights.push_back(w);
+        }
+      } else {
+        option->thread_number = atoi(value.c_str());
+        if (option->thread_number <= 0) {
+          printf("[Error] Illegal -nthread : '%s' \n", value.c_str());
+          return false;
+        }
+      }
+    } else if (!arg.empty() && arg[0] == '-') {
+      printf("[Error] Unknow option: %s \n", argv[i]);
+      return false;
+    } else {
+      option->file_list.push_back(arg);
+    }
+  }
+  if (option->file_list.size() < 3) { return false; }
+  size_t num_model = option->file_list.size() - 1;
+  if (!option->weights.empty() && option->weights.size() != num_model) {
+    printf("[Error] The -w has %lu weights, but there are %lu "
+           "models \n", option->weights.size(), num_model);
+    return false;
+  }
+  for (size_t i = 0; i < num_model; ++i) {
+    if (!FileExist(option->file_list[i].c_str())) {
+      printf("[Error] Model file: %s does not exist \n",
+             option->file_list[i].c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// The models of the remapped features can only be merged if they
+// have the same feature map, which is copied to output_file.dict.
+// Return false if the maps are different
+bool copy_feature_map(const std::vector<std::string>& models,
+                      const std::string& out_file) {
+  std::string first = models[0] + ".dict";
+  bool has_map = FileExist(first.c_str());
+  uint64 hash = has_map ? HashFile(first) : 0;
+  for (size_t i = 1; i < models.size(); ++i) {
+    std::string dict = models[i] + ".dict";
+    if (FileExist(dict.c_str()) != has_map ||
+        (has_map && HashFile(dict) != hash)) {
+      printf("[Error] The models %s and %s have different feature "
+             "maps (.dict) \n", models[0].c_str(), models[i].c_str());
+      return false;
+    }
+  }
+  if (!has_map) { return true; }
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(first, &buf);
+  std::string dict = out_file + ".dict";
+  FILE* file = OpenFileOrDie(dict.c_str(), "w");
+  WriteDataToDisk(file, buf, size);
+  Close(file);
+  delete [] buf;
+  return true;
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// The parameters are merged in place of the mapped models, so the
+// memory of the tool does not grow with the number of the models
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  Timer timer;
+  timer.tic();
+
+  MergeOption option;
+  if (!parse_option(argc, argv, &option)) {
+    printf("%s", kUsage);
+    return 0;
+  }
+  std::vector<std::string> models(option.file_list.begin(),
+                                  option.file_list.end() - 1);
+  const std::string& out_file = option.file_list.back();
+  xLearn::ModelMerger merger;
+  for (size_t i = 0; i < models.size(); ++i) {
+    xLearn::real_t w = option.weights.empty() ? 1.0 : option.weights[i];
+    if (!merger.AddModel(models[i], w)) {
+      printf("[Error] %s \n", merger.Error().c_str());
+      return 0;
+    }
+  }
+  if (option.method == xLearn::kMergeAdaGrad && !merger.HasCaches()) {
+    printf("[Error] The -m adagrad needs the checkpoints that have "
+           "the gradient caches, but %s is a weights-only model \n",
+           models[0].c_str());
+    return 0;
+  }
+  if (!copy_feature_map(models, out_file)) { return 0; }
+  int num_threads = option.thread_number > 0 ?
+                    option.thread_number :
+                    (int)xLearn::AvailableCpus();
+  xLearn::ThreadPool pool(num_threads);
+  merger.Merge(out_file, option.method, &pool);
+
+  printf("Merge %lu models by %s \n"
+         "  Output file: %s \n"
+         "Total time cost: %.2f sec\n",
+         models.size(),
+         option.method == xLearn::kMergeAdaGrad ? "adagrad" : "mean",
+         out_file.c_str(), timer.toc());
+
+  return 0;
+}
@@ -0,0 +1,374 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of ModelMerger.
+*/
+
+#include "src/data/model_merger.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+// Each chunk of the merge has about so many floats
+static const uint64 kMergeChunkFloats = 1 << 18;
+
+const index_t ModelMerger::kNoCache;
+
+bool ParseMergeMethod(const std::string& name, MergeMethod* method) {
+  if (name == "mean") {
+    *method = kMergeMean;
+  } else if (name == "adagrad") {
+    *method = kMergeAdaGrad;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The float at the byte offset of the mapped file, which
+// is not aligned after the strings of the checkpoint
+static inline real_t load_float(const char* addr, uint64 pos) {
+  real_t x;
+  memcpy(&x, addr + pos, sizeof(x));
+  return x;
+}
+
+ModelMerger::~ModelMerger() {
+  for (size_t i = 0; i < models_.size(); ++i) {
+    UnmapFile(models_[i].addr, models_[i].size);
+  }
+}
+
+bool ModelMerger::AddModel(const std::string& filename, real_t weight) {
+  if (weight <= 0) {
+    error_ = StringPrintf("The weight of %s should be greater than 0",
+                          filename.c_str());
+    return false;
+  }
+  ModelFile model;
+  model.filename = filename;
+  model.weight = weight;
+  model.addr = nullptr;
+  model.size = TryMapFileToMemory(filename, &model.addr);
+  if (model.size == 0) {
+    error_ = StringPrintf("Cannot map the model file: %s",
+                          filename.c_str());
+    return false;
+  }
+  if (!parse(&model)) {
+    UnmapFile(model.addr, model.size);
+    return false;
+  }
+  if (!models_.empty()) {
+    const ModelFile& first = models_[0];
+    if (model.magic != first.magic ||
+        model.score_func != first.score_func ||
+        model.loss_func != first.loss_func ||
+        model.num_feat != first.num_feat ||
+        model.num_field != first.num_field ||
+        model.num_K != first.num_K ||
+        model.num_w != first.num_w ||
+        model.num_v != first.num_v ||
+        model.size != first.size) {
+      error_ = StringPrintf("The model %s does not match the model %s. "
+                            "They should have the same format, score "
+                            "function, loss, features, fields, K and "
+                            "optimizer", filename.c_str(),
+                            first.filename.c_str());
+      UnmapFile(model.addr, model.size);
+      return false;
+    }
+  }
+  models_.push_back(model);
+  return true;
+}
+
+bool ModelMerger::HasCaches() const {
+  return !models_.empty() && models_[0].magic == 0;
+}
+
+// The full checkpoint has no magic number (magic is 0), and its
+// w has the states of the optimizer after each weight. The latent
+// vectors of FFM are in the interleaved layout, and the ones of FM
+// and HOFM in the split layout (see Model::block_layout())
+bool ModelMerger::parse(ModelFile* model) {
+  const char* addr = model->addr;
+  uint64 size = model->size;
+  std::string bad = StringPrintf("Not a model file that can be "
+                                 "merged: %s", model->filename.c_str());
+  if (size < sizeof(uint64)) {
+    error_ = bad;
+    return false;
+  }
+  uint64 magic = 0;
+  memcpy(&magic, addr, sizeof(magic));
+  if (magic == kSparseMagic) {
+    error_ = StringPrintf("The sparse model file cannot be merged: %s",
+                          model->filename.c_str());
+    return false;
+  }
+  uint64 offset_w = 0, offset_b = 0, offset_v = 0;
+  if (magic == kMappedMagic) {
+    MappedModelHeader header;
+    if (size < sizeof(header)) {
+      error_ = bad;
+      return false;
+    }
+    memcpy(&header, addr, sizeof(header));
+    header.score_func[sizeof(header.score_func)-1] = 0;
+    header.loss_func[sizeof(header.loss_func)-1] = 0;
+    if (header.file_size != size) {
+      error_ = bad;
+      return false;
+    }
+    model->score_func = header.score_func;
+    model->loss_func = header.loss_func;
+    model->num_feat = header.num_feat;
+    model->num_field = header.num_field;
+    model->num_K = header.num_K;
+    model->num_w = header.num_w;
+    model->num_v = header.num_v;
+    offset_w = header.offset_w;
+    offset_b = header.offset_b;
+    offset_v = header.offset_v;
+    if (offset_w + model->num_w * sizeof(real_t) > offset_b ||
+        offset_b + 2 * sizeof(real_t) > offset_v ||
+        offset_v + model->num_v * sizeof(real_t) > size) {
+      error_ = bad;
+      return false;
+    }
+  } else {
+    // The strings and numbers of Model::serialize()
+    uint64 pos = magic == kWeightsMagic ? sizeof(magic) : 0;
+    if (magic != kWeightsMagic) { magic = 0; }
+    std::string* str[2] = { &model->score_func, &model->loss_func };
+    for (int i = 0; i < 2; ++i) {
+      size_t len = 0;
+      if (pos + sizeof(len) > size) { error_ = bad; return false; }
+      memcpy(&len, addr + pos, sizeof(len));
+      pos += sizeof(len);
+      if (len == 0 || len > 32 || pos + len > size) {
+        error_ = bad;
+        return false;
+      }
+      str[i]->assign(addr + pos, len);
+      pos += len;
+    }
+    bool has_v = model->score_func != "linear";
+    index_t num[5] = { 0, 0, 0, 0, 0 };
+    int count = has_v ? 5 : 4;
+    if (pos + count * sizeof(index_t) > size) {
+      error_ = bad;
+      return false;
+    }
+    memcpy(num, addr + pos, count * sizeof(index_t));
+    pos += count * sizeof(index_t);
+    model->num_feat = num[0];
+    model->num_field = num[1];
+    model->num_K = num[2];
+    model->num_w = num[3];
+    offset_w = pos;
+    offset_b = offset_w + model->num_w * sizeof(real_t);
+    offset_v = offset_b + 2 * sizeof(real_t);
+    // The file keeps the low 32 bits of the size of v, which is
+    // the rest of the file (see Model::deserialize_w_v_b())
+    model->num_v = offset_v <= size ?
+                   (size - offset_v) / sizeof(real_t) : 0;
+    if (model->num_feat == 0 || offset_v > size ||
+        (index_t)model->num_v != num[4] ||
+        offset_v + model->num_v * sizeof(real_t) != size) {
+      error_ = bad;
+      return false;
+    }
+  }
+  model->magic = magic;
+  // Build the sections
+  Section w, b, v;
+  w.offset = offset_w;
+  b.offset = offset_b;
+  v.offset = offset_v;
+  // The bias always has the cache of AdaGrad
+  b.num_unit = 1;
+  b.unit = 2;
+  b.cache = { 1, kNoCache };
+  b.init = 1.0;
+  if (magic != 0) {
+    // The weights-only model has no cache but the bias
+    w.num_unit = model->num_w;
+    w.unit = 1;
+    w.cache = { kNoCache };
+    w.init = 0;
+    v.num_unit = model->num_v;
+    v.unit = 1;
+    v.cache = { kNoCache };
+    v.init = 0;
+  } else {
+    // The cache of AdaGrad (stride 2) starts at 1.0, and the
+    // sum of squared gradients of FTRL and the lazy AdaGrad
+    // (stride 3) starts at 0. The other states follow it
+    index_t stride = model->num_w / model->num_feat;
+    if (stride < 2 || stride * model->num_feat != model->num_w) {
+      error_ = bad;
+      return false;
+    }
+    w.num_unit = model->num_feat;
+    w.unit = stride;
+    w.cache.assign(stride, 1);
+    w.cache[1] = kNoCache;
+    w.init = stride == 2 ? 1.0 : 0;
+    // Each weight d of the latent vector has its own cache
+    index_t aligned_k = (model->num_K + kAlign - 1) / kAlign * kAlign;
+    index_t half = model->score_func == "ffm" ? kAlign : aligned_k;
+    v.unit = 2 * half;
+    v.num_unit = half > 0 ? model->num_v / v.unit : 0;
+    if (v.num_unit * v.unit != model->num_v) {
+      error_ = bad;
+      return false;
+    }
+    v.cache.resize(v.unit);
+    for (index_t j = 0; j < v.unit; ++j) {
+      v.cache[j] = j < half ? j + half : kNoCache;
+    }
+    v.init = 1.0;
+  }
+  model->sections = { w, b, v };
+  return true;
+}
+
+// In kMergeAdaGrad, the model i of user weight u_i and the cache c_i
+// has the weight a_i = u_i * (c_i - init), which is the squared
+// gradients it accumulated, and the merged cache is init + sum(a_i).
+// The features that no model has updated get the weighted mean
+void ModelMerger::merge_units(const Section& sec, uint64 begin,
+                              uint64 end, MergeMethod method,
+                              real_t* buf) const {
+  size_t num_model = models_.size();
+  real_t total = 0;
+  for (size_t i = 0; i < num_model; ++i) {
+    total += models_[i].weight;
+  }
+  for (uint64 u = begin; u < end; ++u) {
+    uint64 base = sec.offset + u * sec.unit * sizeof(real_t);
+    for (index_t j = 0; j < sec.unit; ++j) {
+      uint64 pos = base + j * sizeof(real_t);
+      index_t c = sec.cache[j];
+      real_t sum = 0;
+      real_t norm = 0;
+      if (method == kMergeAdaGrad) {
+        for (size_t i = 0; i < num_model; ++i) {
+          const ModelFile& m = models_[i];
+          if (c == kNoCache) {
+            sum += m.weight *
+                   std::max(load_float(m.addr, pos) - sec.init, 0.0f);
+            continue;
+          }
+          real_t a = m.weight * std::max(load_float(m.addr, base +
+                     c * sizeof(real_t)) - sec.init, 0.0f);
+          sum += a * load_float(m.addr, pos);
+          norm += a;
+        }
+        if (c == kNoCache) {
+          *buf++ = sec.init + sum;
+          continue;
+        }
+      }
+      if (norm <= 0) {
+        sum = 0;
+        for (size_t i = 0; i < num_model; ++i) {
+          sum += models_[i].weight * load_float(models_[i].addr, pos);
+        }
+        norm = total;
+      }
+      *buf++ = sum / norm;
+    }
+  }
+}
+
+// The merged file is written to filename.tmp and renamed, so the
+// output can replace one of the mapped models
+void ModelMerger::Merge(const std::string& filename,
+                        MergeMethod method,
+                        ThreadPool* pool) {
+  CHECK(!models_.empty());
+  CHECK_NOTNULL(pool);
+  if (method == kMergeAdaGrad) { CHECK(HasCaches()); }
+  const ModelFile& first = models_[0];
+  std::string tmp = filename + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    LOG(FATAL) << "Cannot open file: " << tmp;
+  }
+  if (ftruncate(fd, first.size) == -1) {
+    LOG(FATAL) << "Error: invoke ftruncate() for file: " << tmp;
+  }
+  // The header, the paddings and the tail of the first model
+  uint64 last = 0;
+  for (size_t s = 0; s < first.sections.size(); ++s) {
+    const Section& sec = first.sections[s];
+    if (sec.offset > last) {
+      WriteDataAt(fd, first.addr + last, sec.offset - last, last);
+    }
+    last = sec.offset + sec.num_unit * sec.unit * sizeof(real_t);
+  }
+  if (first.size > last) {
+    WriteDataAt(fd, first.addr + last, first.size - last, last);
+  }
+  // The chunks of each section are merged by the workers
+  std::vector<std::vector<real_t>> bufs(pool->size());
+  for (size_t s = 0; s < first.sections.size(); ++s) {
+    const Section& sec = first.sections[s];
+    if (sec.num_unit == 0) { continue; }
+    uint64 chunk = std::max<uint64>(kMergeChunkFloats / sec.unit, 1);
+    uint64 num_chunk = (sec.num_unit + chunk - 1) / chunk;
+    pool->ParallelFor(0, num_chunk, 1,
+      [&](size_t id, size_t start, size_t end) {
+        std::vector<real_t>& buf = bufs[id];
+        buf.resize(chunk * sec.unit);
+        for (size_t k = start; k < end; ++k) {
+          uint64 begin = k * chunk;
+          uint64 stop = std::min(begin + chunk, sec.num_unit);
+          uint64 offset = sec.offset + begin * sec.unit * sizeof(real_t);
+          uint64 len = (stop - begin) * sec.unit * sizeof(real_t);
+          merge_units(sec, begin, stop, method, buf.data());
+          WriteDataAt(fd, (char*)buf.data(), len, offset);
+          for (size_t i = 0; i < models_.size(); ++i) {
+            ReleaseMappedPages(models_[i].addr + offset, len);
+          }
+        }
+      });
+  }
+  if (close(fd) == -1) {
+    LOG(FATAL) << "Error: invoke close() for file: " << tmp;
+  }
+  if (rename(tmp.c_str(), filename.c_str()) != 0) {
+    LOG(FATAL) << "Cannot rename " << tmp << " to " << filename;
+  }
+}
+
+}  // namespace xLearn
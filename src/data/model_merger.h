@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the ModelMerger class, which averages the model
+files of the same structure into one model file.
+*/
+
+#ifndef XLEARN_DATA_MODEL_MERGER_H_
+#define XLEARN_DATA_MODEL_MERGER_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// How the parameters of the models are averaged
+enum MergeMethod {
+  // The weighted mean of each float, including the states
+  kMergeMean = 0,
+  // Each weight is weighted by the squared gradients that its
+  // model has accumulated in the gradient cache, and the merged
+  // cache accumulates the squared gradients of all the models
+  kMergeAdaGrad = 1
+};
+
+// Parse the name of the method ("mean" or "adagrad")
+bool ParseMergeMethod(const std::string& name, MergeMethod* method);
+
+//------------------------------------------------------------------------------
+// ModelMerger averages the models trained on the different shards of
+// the data (or the members of an ensemble), which have the same score
+// function, loss, number of features and fields, K and optimizer:
+//
+//   ModelMerger merger;
+//   merger.AddModel("/tmp/model_0.bin", 1.0);
+//   merger.AddModel("/tmp/model_1.bin", 2.0);  /* or false */
+//   merger.Merge("/tmp/model.bin", kMergeMean, pool);
+//
+// The models are mapped in read-only mode and are never loaded. The
+// output file has the format and the size of the first model: its
+// header is copied, and the sections of w, b and v are merged by the
+// workers of the pool in chunks of the features (or latent vectors),
+// which are written at their offsets of the output file. The pages of
+// the models are released after each chunk, so the resident memory is
+// about one chunk per worker however large the models are.
+//
+// The full checkpoint, the weights-only file and the memory-mappable
+// file can be merged, but all the models should be in the same format.
+// kMergeAdaGrad needs the gradient caches of the full checkpoint, and
+// with the user weights, the squared gradients of each model are
+// scaled by its weight. The sparse model files cannot be merged, since
+// the features of them are different.
+//------------------------------------------------------------------------------
+class ModelMerger {
+ public:
+  ModelMerger() { }
+  ~ModelMerger();
+
+  // Map the model file, whose weight (> 0) is used by the weighted
+  // mean. Return false if it cannot be merged, e.g., it is not a model
+  // file or it does not match the former models, and Error() tells why
+  bool AddModel(const std::string& filename, real_t weight = 1.0);
+
+  // Write the merged model file, which replaces the existing one
+  void Merge(const std::string& filename,
+             MergeMethod method,
+             ThreadPool* pool);
+
+  // Number of the models
+  inline size_t NumModel() const { return models_.size(); }
+
+  // The reason of the last failed AddModel()
+  inline const std::string& Error() const { return error_; }
+
+  // The model files have the gradient caches
+  bool HasCaches() const;
+
+ protected:
+  // The sections of a model file. Each section is made of units of
+  // the same layout, and the j-th float of a unit is weighted by the
+  // squared gradients in its gradient cache, which is the cache[j]-th
+  // float of the unit, or it is a gradient cache itself (kNoCache)
+  struct Section {
+    uint64 offset;
+    uint64 num_unit;
+    index_t unit;
+    std::vector<index_t> cache;
+    // Initial value of the gradient caches
+    real_t init;
+  };
+
+  // A mapped model file
+  struct ModelFile {
+    std::string filename;
+    real_t weight;
+    char* addr;
+    uint64 size;
+    uint64 magic;
+    std::string score_func;
+    std::string loss_func;
+    uint64 num_feat;
+    uint64 num_field;
+    uint64 num_K;
+    uint64 num_w;
+    uint64 num_v;
+    std::vector<Section> sections;
+  };
+
+  static const index_t kNoCache = ~0U;
+
+  std::vector<ModelFile> models_;
+  std::string error_;
+
+  // Parse the header and the sections of the mapped file
+  bool parse(ModelFile* model);
+
+  // Merge the units [begin, end) of the section into buf
+  void merge_units(const Section& sec, uint64 begin, uint64 end,
+                   MergeMethod method, real_t* buf) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ModelMerger);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_MODEL_MERGER_H_
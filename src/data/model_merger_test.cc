@@ -0,0 +1,180 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests model_merger.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/data/model_merger.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+const std::string kModel_0 = "./test_merge_0.bin";
+const std::string kModel_1 = "./test_merge_1.bin";
+const std::string kOutput = "./test_merge_out.bin";
+
+// A fm model whose w of feature i is i * scale, and the
+// gradient caches of the odd features are 1 + i
+void InitModel(Model* model, uint64 seed, real_t scale) {
+  model->SetSeed(seed);
+  model->Initialize("fm", "squared", 1000, 0, 8);
+  real_t* w = model->GetParameter_w();
+  for (index_t i = 0; i < model->GetNumFeature(); ++i) {
+    w[i*2] = i * scale;
+    w[i*2+1] = i % 2 == 1 ? 1.0 + i : 1.0;
+  }
+  model->GetParameter_b()[0] = scale;
+}
+
+TEST(MergerTest, Merge_mean) {
+  Model model_0, model_1;
+  InitModel(&model_0, 1, 1.0);
+  InitModel(&model_1, 2, 2.0);
+  model_0.Serialize(kModel_0);
+  model_1.Serialize(kModel_1);
+  ThreadPool pool(3);
+  {
+    ModelMerger merger;
+    EXPECT_TRUE(merger.AddModel(kModel_0, 1.0));
+    EXPECT_TRUE(merger.AddModel(kModel_1, 3.0));
+    EXPECT_TRUE(merger.HasCaches());
+    merger.Merge(kOutput, kMergeMean, &pool);
+  }
+  Model merged(kOutput);
+  EXPECT_EQ(merged.GetNumFeature(), 1000);
+  const real_t* w = merged.GetParameter_w();
+  for (index_t i = 0; i < 1000; ++i) {
+    EXPECT_FLOAT_EQ(w[i*2], i * 1.75);
+    EXPECT_FLOAT_EQ(w[i*2+1], i % 2 == 1 ? 1.0 + i : 1.0);
+  }
+  EXPECT_FLOAT_EQ(merged.GetParameter_b()[0], 1.75);
+  const real_t* v = merged.GetParameter_v();
+  const real_t* v_0 = model_0.GetParameter_v();
+  const real_t* v_1 = model_1.GetParameter_v();
+  for (index_t i = 0; i < merged.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(v[i], (v_0[i] + 3 * v_1[i]) / 4);
+  }
+  RemoveFile(kOutput.c_str());
+}
+
+// The features that only one model has updated keep its
+// weights, and the caches sum the squared gradients
+TEST(MergerTest, Merge_adagrad) {
+  Model model_0, model_1;
+  InitModel(&model_0, 1, 1.0);
+  InitModel(&model_1, 2, 2.0);
+  real_t* w_1 = model_1.GetParameter_w();
+  for (index_t i = 0; i < 1000; i += 2) {
+    w_1[i*2+1] = 3.0;
+  }
+  // The cache of the weight d of FM is aligned_k floats after it
+  model_1.GetParameter_v()[8] = 5.0;
+  model_0.Serialize(kModel_0);
+  model_1.Serialize(kModel_1);
+  ThreadPool pool(2);
+  {
+    ModelMerger merger;
+    EXPECT_TRUE(merger.AddModel(kModel_0));
+    EXPECT_TRUE(merger.AddModel(kModel_1));
+    merger.Merge(kOutput, kMergeAdaGrad, &pool);
+  }
+  Model merged(kOutput);
+  const real_t* w = merged.GetParameter_w();
+  for (index_t i = 0; i < 1000; ++i) {
+    if (i % 2 == 0) {
+      EXPECT_FLOAT_EQ(w[i*2], i * 2.0);
+      EXPECT_FLOAT_EQ(w[i*2+1], 3.0);
+    } else {
+      /* Both models have the squared gradients i */
+      EXPECT_FLOAT_EQ(w[i*2], i * 1.5);
+      EXPECT_FLOAT_EQ(w[i*2+1], 1.0 + 2 * i);
+    }
+  }
+  // No model has updated the bias
+  EXPECT_FLOAT_EQ(merged.GetParameter_b()[0], 1.5);
+  EXPECT_FLOAT_EQ(merged.GetParameter_b()[1], 1.0);
+  const real_t* v = merged.GetParameter_v();
+  EXPECT_FLOAT_EQ(v[0], model_1.GetParameter_v()[0]);
+  EXPECT_FLOAT_EQ(v[8], 5.0);
+  EXPECT_FLOAT_EQ(v[1], (model_0.GetParameter_v()[1] +
+                         model_1.GetParameter_v()[1]) / 2);
+  RemoveFile(kOutput.c_str());
+}
+
+TEST(MergerTest, Merge_weights_only) {
+  Model model_0, model_1;
+  InitModel(&model_0, 1, 1.0);
+  InitModel(&model_1, 2, 3.0);
+  ThreadPool pool(2);
+  for (int mapped = 0; mapped < 2; ++mapped) {
+    if (mapped) {
+      model_0.SerializeMapped(kModel_0);
+      model_1.SerializeMapped(kModel_1);
+    } else {
+      model_0.Serialize(kModel_0, true);
+      model_1.Serialize(kModel_1, true);
+    }
+    {
+      ModelMerger merger;
+      EXPECT_TRUE(merger.AddModel(kModel_0));
+      EXPECT_TRUE(merger.AddModel(kModel_1));
+      EXPECT_FALSE(merger.HasCaches());
+      merger.Merge(kOutput, kMergeMean, &pool);
+    }
+    Model merged(kOutput);
+    EXPECT_TRUE(merged.IsWeightsOnly());
+    EXPECT_EQ(merged.IsMapped(), mapped == 1);
+    const real_t* w = merged.GetParameter_w();
+    for (index_t i = 0; i < 1000; ++i) {
+      EXPECT_FLOAT_EQ(w[i], i * 2.0);
+    }
+    EXPECT_FLOAT_EQ(merged.GetParameter_b()[0], 2.0);
+  }
+  RemoveFile(kOutput.c_str());
+}
+
+TEST(MergerTest, Mismatch) {
+  Model model_0, model_1;
+  InitModel(&model_0, 1, 1.0);
+  model_1.Initialize("fm", "squared", 999, 0, 8);
+  model_0.Serialize(kModel_0);
+  model_1.Serialize(kModel_1);
+  ModelMerger merger;
+  EXPECT_TRUE(merger.AddModel(kModel_0));
+  EXPECT_FALSE(merger.AddModel(kModel_1));
+  EXPECT_FALSE(merger.Error().empty());
+  // Different format
+  model_0.Serialize(kModel_1, true);
+  EXPECT_FALSE(merger.AddModel(kModel_1));
+  // The sparse model
+  model_0.SerializeSparse(kModel_1);
+  EXPECT_FALSE(merger.AddModel(kModel_1));
+  EXPECT_FALSE(merger.AddModel(kModel_0, 0));
+  EXPECT_EQ(merger.NumModel(), 1);
+  RemoveFile(kModel_0.c_str());
+  RemoveFile(kModel_1.c_str());
+}
+
+}  // namespace xLearn
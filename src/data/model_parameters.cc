@@ -23,12 +23,28 @@ This file is the implementation of the Model class.
 #include "src/data/model_parameters.h"
 
 #include <pmmintrin.h>  // for SSE
+#include <stddef.h>
+#include <string.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "src/base/affinity.h"
+#include "src/base/crc32c.h"
 #include "src/base/file_util.h"
+#include "src/base/half.h"
+#include "src/base/huge_page.h"
 #include "src/base/math.h"
+#include "src/base/resource.h"
 
 namespace xLearn {
 
+// Each thread of set_value() initializes at least so many
+// features (or latent vectors)
+static const uint64 kInitRowsPerThread = 1 << 16;
+
 //------------------------------------------------------------------------------
 // The Model class
 //------------------------------------------------------------------------------
@@ -39,13 +55,133 @@ void Model::Initialize(const std::string& score_func,
                   index_t num_feature,
                   index_t num_field,
                   index_t num_K,
-                  real_t scale) {
+                  real_t scale,
+                  index_t linear_stride) {
+  set_structure(score_func, loss_func, num_feature,
+                num_field, num_K, scale, linear_stride);
+  this->initial(true);
+}
+
+// The sections of w, b and v are in the page-aligned layout of
+// the memory-mappable file, including the gradient caches
+uint64 Model::SharedBytes(const std::string& score_func,
+                          index_t num_feature,
+                          index_t num_field,
+                          index_t num_K,
+                          index_t linear_stride) {
+  Model model;
+  model.set_structure(score_func, "shared", num_feature,
+                      num_field, num_K, 1.0, linear_stride);
+  return page_round((uint64)model.param_num_w_ * sizeof(real_t)) +
+         kMappedPageSize +
+         page_round((uint64)model.param_num_v_ * sizeof(real_t));
+}
+
+void Model::InitShared(const std::string& score_func,
+                       const std::string& loss_func,
+                       index_t num_feature,
+                       index_t num_field,
+                       index_t num_K,
+                       real_t scale,
+                       index_t linear_stride,
+                       char* addr,
+                       bool owner) {
+  CHECK_NOTNULL(addr);
+  // The size of SharedBytes() is the one of the same K
+  CHECK(field_k_.empty());
+  set_structure(score_func, loss_func, num_feature,
+                num_field, num_K, scale, linear_stride);
+  uint64 w_bytes = page_round((uint64)param_num_w_ * sizeof(real_t));
+  param_w_ = reinterpret_cast<real_t*>(addr);
+  param_b_ = reinterpret_cast<real_t*>(addr + w_bytes);
+  param_v_ = nullptr;
+  if (param_num_v_ > 0) {
+    param_v_ = reinterpret_cast<real_t*>(addr + w_bytes +
+                                         kMappedPageSize);
+  }
+  shared_ = true;
+  if (owner) {
+    PlaceMemory(addr, SharedBytes(score_func, num_feature, num_field,
+                                  num_K, linear_stride), numa_policy_);
+    set_value();
+  }
+}
+
+// The file is removed after it is mapped, so its blocks are
+// freed by the system when the process exits
+bool Model::InitFile(const std::string& score_func,
+                     const std::string& loss_func,
+                     index_t num_feature,
+                     index_t num_field,
+                     index_t num_K,
+                     real_t scale,
+                     index_t linear_stride,
+                     const std::string& filename) {
+  CHECK(file_addr_ == nullptr);
+  uint64 size = SharedBytes(score_func, num_feature, num_field,
+                            num_K, linear_stride);
+  int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) { return false; }
+  void* addr = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  unlink(filename.c_str());
+  if (addr == MAP_FAILED) { return false; }
+  // The features are accessed by random, and the readahead
+  // only loads the pages that are not used
+  madvise(addr, size, MADV_RANDOM);
+  file_addr_ = reinterpret_cast<char*>(addr);
+  file_size_ = size;
+  InitShared(score_func, loss_func, num_feature, num_field,
+             num_K, scale, linear_stride, file_addr_, true);
+  return true;
+}
+
+// The pages of v, or w for the linear model
+void Model::ResidentFractions(int num_parts,
+                              std::vector<real_t>* fractions) {
+  CHECK_GT(num_parts, 0);
+  CHECK_NOTNULL(fractions);
+  fractions->assign(num_parts, 0);
+  if (file_addr_ == nullptr) { return; }
+  char* begin = reinterpret_cast<char*>(param_w_);
+  uint64 size = (uint64)param_num_w_ * sizeof(real_t);
+  if (param_v_ != nullptr) {
+    begin = reinterpret_cast<char*>(param_v_);
+    size = (uint64)param_num_v_ * sizeof(real_t);
+  }
+  uint64 num_page = page_round(size) / kMappedPageSize;
+  std::vector<unsigned char> resident(num_page);
+  if (num_page == 0 ||
+      mincore(begin, num_page * kMappedPageSize, resident.data()) != 0) {
+    return;
+  }
+  for (int p = 0; p < num_parts; ++p) {
+    uint64 first = num_page * p / num_parts;
+    uint64 last = num_page * (p + 1) / num_parts;
+    uint64 count = 0;
+    for (uint64 i = first; i < last; ++i) { count += resident[i] & 1; }
+    (*fractions)[p] = last > first ? (real_t)count / (last - first) : 0;
+  }
+}
+
+void Model::set_structure(const std::string& score_func,
+                          const std::string& loss_func,
+                          index_t num_feature,
+                          index_t num_field,
+                          index_t num_K,
+                          real_t scale,
+                          index_t linear_stride) {
   CHECK(!score_func.empty());
   CHECK(!loss_func.empty());
   CHECK_GT(num_feature, 0);
   CHECK_GE(num_field, 0);
   CHECK_GE(num_K, 0);
   CHECK_GT(scale, 0);
+  CHECK_GE(linear_stride, 2);
   score_func_ = score_func;
   loss_func_ = loss_func;
   num_feat_ = num_feature;
@@ -53,50 +189,128 @@ void Model::Initialize(const std::string& score_func,
   num_K_ = num_K;
   scale_ = scale;
   // Calculate the number of model parameters
-  param_num_w_ = num_feature * 2;
+  linear_stride_ = linear_stride;
+  // The linear term is indexed by 32 bits, while the offsets
+  // of the latent factor are 64 bits
+  if ((uint64)num_feature * linear_stride > kUInt32Max) {
+    LOG(FATAL) << "Too many features for the linear term: "
+               << num_feature;
+  }
+  param_num_w_ = num_feature * linear_stride;
+  field_offset_.clear();
   if (score_func == "linear") {
     param_num_v_ = 0;
   } else if (score_func == "fm") {
-    param_num_v_ = num_feature *
+    param_num_v_ = (uint64)num_feature *
                    get_aligned_k() * 2;
+  } else if (score_func == "hofm") {
+    // The vectors of order 2 and order 3 of each feature
+    param_num_v_ = (uint64)num_feature *
+                   get_aligned_k() * 4;
+  } else if (score_func == "ffm" && !field_k_.empty()) {
+    // The blocks of the K of each field are interleaved
+    CHECK(latent_pairs_ == nullptr);
+    CHECK_EQ(latent_layout_, kLayoutInterleaved);
+    CHECK_EQ(field_k_.size(), num_field);
+    field_offset_.assign(num_field + 1, 0);
+    for (index_t f = 0; f < num_field; ++f) {
+      CHECK_GT(field_k_[f], 0);
+      field_k_[f] = std::min(get_aligned_k(), (field_k_[f] + kAlign - 1) /
+                                              kAlign * kAlign);
+      field_offset_[f + 1] = field_offset_[f] +
+        LatentBlockSize(kLayoutInterleaved, field_k_[f]);
+    }
+    param_num_v_ = (uint64)num_feature * field_offset_[num_field];
+  } else if (score_func == "ffm" && latent_pairs_ != nullptr) {
+    CHECK_EQ(latent_pairs_->NumFeature(), num_feature);
+    param_num_v_ = latent_pairs_->Size() *
+                   LatentBlockSize(latent_layout_, get_aligned_k());
   } else if (score_func == "ffm") {
-    param_num_v_ = num_feature *
-                   get_aligned_k() *
-                   num_field * 2;
+    param_num_v_ = (uint64)num_feature *
+                   LatentBlockSize(latent_layout_, get_aligned_k()) *
+                   num_field;
   } else {
     LOG(FATAL) << "Unknow score function: " << score_func;
   }
-  this->initial(true);
 }
 
 // To get the best performance for SSE, we need to
 // allocate memory for the model parameters in aligned way
 // For SSE, the align number should be 16 byte
 void Model::initial(bool set_val) {
-  try {
-    // Conventional malloc for linear term and bias
-    param_w_ = (real_t*)malloc(param_num_w_*sizeof(real_t));
-    param_b_ = (real_t*)malloc(2*sizeof(real_t));
-    if (score_func_.compare("fm") == 0 ||
-        score_func_.compare("ffm") == 0) {
-      // Aligned malloc for latent factor
+  // The pages are placed on the NUMA nodes before the first
+  // touch, so w and v start at the page boundary
 #ifdef _WIN32
-      param_v_ = _aligned_malloc(
-          param_num_v_ * sizeof(real_t),
-          kAlignByte);
+  bool numa = false;
 #else
-      posix_memalign(
-          (void**)&param_v_,
-          kAlignByte,
-          param_num_v_ * sizeof(real_t));
+  bool numa = numa_policy_.compare("none") != 0;
 #endif
-    } else {
-      param_v_ = nullptr;
-    }
-  } catch (std::bad_alloc&) {
-    LOG(FATAL) << "Cannot allocate enough memory for current  \
+  // The model of a replica or a copy, and the sparse
+  // latent factor are not sharded
+#ifdef _WIN32
+  bool sharded = false;
+  bool growable = false;
+#else
+  bool sharded = num_shards_ > 1 && replica_of_ == nullptr &&
+                 !weights_copy_ && latent_pairs_ == nullptr &&
+                 field_k_.empty();
+  bool growable = capacity_ > 0 && replica_of_ == nullptr &&
+                  !weights_copy_ && latent_pairs_ == nullptr &&
+                  field_k_.empty();
+#endif
+  if (growable) {
+    alloc_growable();
+  } else if (sharded) {
+    alloc_shards();
+  } else {
+    try {
+      // Conventional malloc for linear term and bias
+      if (numa) {
+        posix_memalign(
+            (void**)&param_w_,
+            kMappedPageSize,
+            param_num_w_ * sizeof(real_t));
+      } else {
+        param_w_ = (real_t*)malloc(param_num_w_*sizeof(real_t));
+      }
+      param_b_ = (real_t*)malloc(2*sizeof(real_t));
+      huge_used_ = "none";
+      if ((score_func_.compare("fm") == 0 ||
+           score_func_.compare("ffm") == 0 ||
+           score_func_.compare("hofm") == 0) &&
+          huge_policy_.compare("none") != 0 && param_num_v_ > 0) {
+        param_v_ = (real_t*)AllocHugePages(
+            param_num_v_ * sizeof(real_t), huge_policy_, &huge_used_,
+            numa ? kMappedPageSize : kAlignByte);
+      } else if (score_func_.compare("fm") == 0 ||
+                 score_func_.compare("ffm") == 0 ||
+                 score_func_.compare("hofm") == 0) {
+        // Aligned malloc for latent factor
+#ifdef _WIN32
+        param_v_ = _aligned_malloc(
+            param_num_v_ * sizeof(real_t),
+            kAlignByte);
+#else
+        posix_memalign(
+            (void**)&param_v_,
+            numa ? kMappedPageSize : kAlignByte,
+            param_num_v_ * sizeof(real_t));
+#endif
+      } else {
+        param_v_ = nullptr;
+      }
+    } catch (std::bad_alloc&) {
+      LOG(FATAL) << "Cannot allocate enough memory for current  \
                    model parameters. Parameter size: "
-               << GetNumParameter();
+                 << GetNumParameter();
+    }
+  }
+  // The segments of the growable model are placed when
+  // they are committed
+  if (numa && !growable) {
+    CHECK(PlaceMemory(param_w_, param_num_w_ * sizeof(real_t),
+                      numa_policy_));
+    PlaceMemory(param_v_, param_num_v_ * sizeof(real_t), numa_policy_);
   }
   // set value for model
   if (set_val) {
@@ -104,55 +318,336 @@ void Model::initial(bool set_val) {
   }
 }
 
-// Set value for model
+// The shards of w and v are mapped at their offsets of the address
+// ranges that are reserved without memory, so each shard has its own
+// pages and the features of all the shards are still contiguous
+void Model::alloc_shards() {
+#ifndef _WIN32
+  uint64 w_feat_bytes = (uint64)linear_stride_ * sizeof(real_t);
+  uint64 v_feat_bytes = (uint64)param_num_v_ / num_feat_ * sizeof(real_t);
+  // The shards start at the page boundary of both w and v, and
+  // the granule of the features is a power of two
+  uint64 granule = 1;
+  while (granule * w_feat_bytes % kMappedPageSize != 0 ||
+         granule * v_feat_bytes % kMappedPageSize != 0) {
+    granule *= 2;
+  }
+  uint64 shard_feat = (num_feat_ + num_shards_ - 1) / num_shards_;
+  shard_feat_ = (shard_feat + granule - 1) / granule * granule;
+  char* range[2] = { nullptr, nullptr };
+  uint64 range_bytes[2] = {
+    page_round((uint64)param_num_w_ * sizeof(real_t)),
+    page_round((uint64)param_num_v_ * sizeof(real_t))
+  };
+  for (int r = 0; r < 2; ++r) {
+    if (range_bytes[r] == 0) { continue; }
+    void* addr = mmap(nullptr, range_bytes[r], PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                      -1, 0);
+    if (addr == MAP_FAILED) {
+      LOG(FATAL) << "Cannot reserve the address range of the shards. "
+                 << "Parameter size: " << GetNumParameter();
+    }
+    range[r] = reinterpret_cast<char*>(addr);
+  }
+  param_w_ = reinterpret_cast<real_t*>(range[0]);
+  param_v_ = reinterpret_cast<real_t*>(range[1]);
+  param_b_ = (real_t*)malloc(2*sizeof(real_t));
+  huge_used_ = "none";
+  shards_.clear();
+  for (index_t first = 0; first < num_feat_; first += shard_feat_) {
+    ModelShard shard;
+    shard.first_feat = first;
+    shard.num_feat = std::min(shard_feat_, num_feat_ - first);
+    shard.w = param_w_ + (uint64)first * linear_stride_;
+    shard.v = param_v_ == nullptr ? nullptr : param_v_ +
+              (uint64)first * v_feat_bytes / sizeof(real_t);
+    // The last shard ends at the end of the range
+    bool last = first + shard.num_feat == num_feat_;
+    char* sections[2] = { reinterpret_cast<char*>(shard.w),
+                          reinterpret_cast<char*>(shard.v) };
+    uint64 feat_bytes[2] = { w_feat_bytes, v_feat_bytes };
+    for (int r = 0; r < 2; ++r) {
+      if (range[r] == nullptr) { continue; }
+      uint64 bytes = last ? range[r] + range_bytes[r] - sections[r] :
+                     (uint64)shard.num_feat * feat_bytes[r];
+      void* addr = mmap(sections[r], bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+      if (addr == MAP_FAILED) {
+        LOG(FATAL) << "Cannot allocate enough memory for the shard "
+                   << shards_.size() << " of the model parameters. "
+                   << "Parameter size: " << GetNumParameter();
+      }
+    }
+    // The latent factor of each shard has its own huge pages
+    if (shard.v != nullptr && huge_policy_.compare("none") != 0 &&
+        AdviseHugePages(shard.v, (uint64)shard.num_feat * v_feat_bytes)) {
+      huge_used_ = "thp";
+    }
+    shards_.push_back(shard);
+  }
+#endif
+}
+
+// The address ranges are reserved without memory as the ones of
+// the shards, and the segments are mapped in them one by one
+void Model::alloc_growable() {
+#ifndef _WIN32
+  if (capacity_ < num_feat_) {
+    LOG(FATAL) << "The capacity " << capacity_ << " is less than "
+               << "the features of the model: " << num_feat_;
+  }
+  if ((uint64)capacity_ * linear_stride_ > kUInt32Max) {
+    LOG(FATAL) << "Too many features for the linear term: "
+               << capacity_;
+  }
+  grow_v_feat_ = num_feat_ > 0 ? param_num_v_ / num_feat_ : 0;
+  uint64 range_bytes[2] = {
+    page_round((uint64)capacity_ * linear_stride_ * sizeof(real_t)),
+    page_round((uint64)capacity_ * grow_v_feat_ * sizeof(real_t))
+  };
+  char* range[2] = { nullptr, nullptr };
+  for (int r = 0; r < 2; ++r) {
+    if (range_bytes[r] == 0) { continue; }
+    void* addr = mmap(nullptr, range_bytes[r], PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                      -1, 0);
+    if (addr == MAP_FAILED) {
+      LOG(FATAL) << "Cannot reserve the address range of the model "
+                 << "of " << capacity_ << " features";
+    }
+    range[r] = reinterpret_cast<char*>(addr);
+  }
+  param_w_ = reinterpret_cast<real_t*>(range[0]);
+  param_v_ = reinterpret_cast<real_t*>(range[1]);
+  param_b_ = (real_t*)malloc(2*sizeof(real_t));
+  huge_used_ = "none";
+  committed_feat_ = 0;
+  commit_segments(std::max(num_feat_, (index_t)1));
+#endif
+}
+
+// The segments are whole pages, except the last one of the
+// capacity, which ends at the end of the range
+void Model::commit_segments(index_t num_feature) {
+#ifndef _WIN32
+  index_t end = std::min(capacity_, (num_feature + kGrowSegment - 1) /
+                                    kGrowSegment * kGrowSegment);
+  if (end <= committed_feat_) { return; }
+  uint64 feat_floats[2] = { (uint64)linear_stride_, grow_v_feat_ };
+  real_t* base[2] = { param_w_, param_v_ };
+  for (int r = 0; r < 2; ++r) {
+    if (base[r] == nullptr || feat_floats[r] == 0) { continue; }
+    real_t* first = base[r] + (uint64)committed_feat_ * feat_floats[r];
+    uint64 bytes = (uint64)(end - committed_feat_) * feat_floats[r] *
+                   sizeof(real_t);
+    if (end == capacity_) {
+      bytes = page_round((uint64)capacity_ * feat_floats[r] *
+                         sizeof(real_t)) -
+              (uint64)committed_feat_ * feat_floats[r] * sizeof(real_t);
+    }
+    void* addr = mmap(first, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (addr == MAP_FAILED) {
+      LOG(FATAL) << "Cannot allocate enough memory for the features "
+                 << committed_feat_ << " to " << end
+                 << " of the model parameters";
+    }
+    if (numa_policy_.compare("none") != 0) {
+      PlaceMemory(first, bytes, numa_policy_);
+    }
+    if (r == 1 && huge_policy_.compare("none") != 0 &&
+        AdviseHugePages(first, bytes)) {
+      huge_used_ = "thp";
+    }
+  }
+  committed_feat_ = end;
+#endif
+}
+
+void Model::release_growable() {
+#ifndef _WIN32
+  if (committed_feat_ == 0) { return; }
+  UnmapFile(reinterpret_cast<char*>(param_w_),
+            page_round((uint64)capacity_ * linear_stride_ *
+                       sizeof(real_t)));
+  if (param_v_ != nullptr) {
+    UnmapFile(reinterpret_cast<char*>(param_v_),
+              page_round((uint64)capacity_ * grow_v_feat_ *
+                         sizeof(real_t)));
+  }
+  committed_feat_ = 0;
+  param_w_ = nullptr;
+  param_v_ = nullptr;
+  huge_used_ = "none";
+#endif
+}
+
+bool Model::Grow(index_t num_feature) {
+  if (num_feature <= num_feat_) { return true; }
+  if (!IsGrowable() || num_feature > capacity_) { return false; }
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(!weights_only_);
+  // The flags and the stamps of the features are not grown
+  CHECK(dirty_ == nullptr);
+  CHECK(stamps_ == nullptr);
+  commit_segments(num_feature);
+  index_t first = num_feat_;
+  num_feat_ = num_feature;
+  param_num_w_ = num_feat_ * linear_stride_;
+  param_num_v_ = (uint64)num_feat_ * grow_v_feat_;
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t vec_feat = has_v ? vec_per_feature() : 0;
+  set_range(first, num_feat_, (uint64)first * vec_feat,
+            (uint64)num_feat_ * vec_feat);
+  return true;
+}
+
+void Model::release_shards() {
+#ifndef _WIN32
+  if (shards_.empty()) { return; }
+  UnmapFile(reinterpret_cast<char*>(param_w_),
+            page_round((uint64)param_num_w_ * sizeof(real_t)));
+  if (param_v_ != nullptr) {
+    UnmapFile(reinterpret_cast<char*>(param_v_),
+              page_round((uint64)param_num_v_ * sizeof(real_t)));
+  }
+  shards_.clear();
+  param_w_ = nullptr;
+  param_v_ = nullptr;
+  huge_used_ = "none";
+#endif
+}
+
+// Set value for model. Each latent weight is drawn from the
+// counter-based stream of the seed and its index, so the model
+// is the same for any number of threads
 void Model::set_value() {
-  // Use distribution to transform the random unsigned
-  // int generated by gen into a float in [(0.0, 1.0) * coef]
-  std::default_random_engine generator;
-  std::uniform_real_distribution<real_t> dis(0.0, 1.0);
-  /*********************************************************
-   *  Initialize linear and bias term                      *
-   *********************************************************/
-  for (index_t i = 0; i < param_num_w_; i += 2) {
-    param_w_[i] = 0;      /* model */
-    param_w_[i+1] = 1.0;  /* gradient cache */
+  uint64 num_vec = 0;
+  if (score_func_.compare("fm") == 0) {
+    num_vec = num_feat_;
+  } else if (score_func_.compare("hofm") == 0) {
+    num_vec = (uint64)num_feat_ * 2;
+  } else if (score_func_.compare("ffm") == 0) {
+    num_vec = latent_pairs_ != nullptr ? latent_pairs_->Size() :
+              (uint64)num_feat_ * num_field_;
+  }
+  // The small model is initialized by this thread
+  uint64 num_thread = std::max((uint64)1, std::min(
+      (uint64)AvailableCpus(),
+      std::max(num_vec, (uint64)num_feat_) / kInitRowsPerThread));
+  if (num_thread == 1) {
+    set_range(0, num_feat_, 0, num_vec);
+  } else {
+    std::vector<std::thread> threads;
+    for (uint64 t = 0; t < num_thread; ++t) {
+      threads.emplace_back(&Model::set_range, this,
+                           num_feat_ * t / num_thread,
+                           num_feat_ * (t + 1) / num_thread,
+                           num_vec * t / num_thread,
+                           num_vec * (t + 1) / num_thread);
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+      threads[t].join();
+    }
   }
   param_b_[0] = 0;    /* model */
   param_b_[1] = 1.0;  /* gradient cache */
+}
+
+// The uniform float in [0, 1) of the counter, which
+// is the splitmix64 hash of the seed and the counter
+static inline real_t counter_uniform(uint64 seed, uint64 counter) {
+  uint64 z = seed * 0xD1B54A32D192ED03ULL +
+             (counter + 1) * 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  return (z >> 40) * (1.0f / 16777216.0f);
+}
+
+// Copy the weights and the caches of the block src of aligned_k
+// to the block dst of another layout. The shared cache is the
+// mean of the caches, and it is the cache of each weight back
+static void copy_block(real_t* dst, LatentLayout to,
+                       const real_t* src, LatentLayout from,
+                       index_t aligned_k) {
+  real_t sum = 0;
+  for (index_t d = 0; d < aligned_k; ++d) {
+    dst[LatentWeightPos(to, d, aligned_k)] =
+      src[LatentWeightPos(from, d, aligned_k)];
+    real_t c = GetLatentCache(from, src, d, aligned_k);
+    if (to == kLayoutSplitShared) {
+      sum += c;
+    } else {
+      SetLatentCache(to, dst, d, aligned_k, c);
+    }
+  }
+  if (to == kLayoutSplitShared) {
+    SetLatentCache(to, dst, 0, aligned_k, sum / aligned_k);
+  }
+}
+
+// Move the block of aligned_k to the positions of another
+// layout of the same size, where buf is the space
+static void convert_block(real_t* block, index_t aligned_k,
+                          LatentLayout from, LatentLayout to,
+                          std::vector<real_t>* buf) {
+  CHECK_EQ(LatentBlockSize(from, aligned_k),
+           LatentBlockSize(to, aligned_k));
+  buf->assign(block, block + LatentBlockSize(from, aligned_k));
+  copy_block(block, to, buf->data(), from, aligned_k);
+}
+
+// The latent vectors of fm and ffm are initialized in the
+// layout of the ffm blocks (the interleaved one by default)
+void Model::set_range(index_t feat_begin, index_t feat_end,
+                      uint64 vec_begin, uint64 vec_end) {
   /*********************************************************
-   *  Initialize latent factor for fm                      *
+   *  Initialize linear term                               *
    *********************************************************/
-  if (score_func_.compare("fm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t coef = 1.0f / sqrt(num_K_) * scale_;
-    real_t* w = param_v_;
-    for (index_t j = 0; j < num_feat_; ++j) {
-      for (index_t d = 0; d < k_aligned; ) {
-        for (index_t s = 0; s < kAlign; s++, w++, d++) {
-          w[0] = (d < num_K_) ? coef * dis(generator) : 0.0;
-          w[kAlign] = 1.0;
-        }
-        w += kAlign;
-      }
+  // The gradient cache of AdaGrad starts at 1.0, and the
+  // states of FTRL (n and z) and lazy AdaGrad start at 0
+  for (uint64 i = (uint64)feat_begin * linear_stride_;
+       i < (uint64)feat_end * linear_stride_; i += linear_stride_) {
+    param_w_[i] = 0;  /* model */
+    for (index_t j = 1; j < linear_stride_; ++j) {
+      param_w_[i+j] = linear_stride_ == 2 ? 1.0 : 0;
     }
   }
   /*********************************************************
-   *  Initialize latent factor for ffm                     *
+   *  Initialize latent factor for fm and ffm              *
    *********************************************************/
-  else if (score_func_.compare("ffm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t* w = param_v_;
-    real_t coef = 1.0f / sqrt(num_K_) * scale_;
-    for (index_t j = 0; j < num_feat_; ++j) {
-      for (index_t f = 0; f < num_field_; ++f) {
-        for (index_t d = 0; d < k_aligned; ) {
-          for (index_t s = 0; s < kAlign; s++, w++, d++) {
-            w[0] = (d < num_K_) ? coef * dis(generator) : 0.0;
-            w[kAlign] = 1.0;
-          }
-          w += kAlign;
-        }
-      }
+  if (vec_end <= vec_begin) { return; }
+  index_t k_aligned = get_aligned_k();
+  real_t coef = 1.0f / sqrt(num_K_) * scale_;
+  // The slot of the sparse latent factor has the value of its
+  // pair in the dense model, and so do the first K weights of
+  // the vector of the K of its field
+  const LatentPairs* pairs = latent_pairs_.get();
+  index_t feat = pairs != nullptr ? pairs->FeatureOf(vec_begin) : 0;
+  // The FM blocks are also initialized in the interleaved layout,
+  // and the HOFM blocks in the split one which its kernels read
+  LatentLayout layout = score_func_.compare("hofm") == 0 ?
+                        kLayoutSplit : score_func_.compare("ffm") == 0 ?
+                        latent_layout_ : kLayoutInterleaved;
+  index_t align0 = LatentBlockSize(layout, k_aligned);
+  for (uint64 i = vec_begin; i < vec_end; ++i) {
+    real_t* w = param_v_ + i * align0;
+    uint64 vec = i;
+    index_t k = k_aligned;
+    if (pairs != nullptr) {
+      while (i >= pairs->Start(feat + 1)) { ++feat; }
+      vec = (uint64)feat * num_field_ + pairs->Field(i);
+    } else if (!field_offset_.empty()) {
+      w = latent_block(i);
+      k = latent_k(i);
+    }
+    uint64 counter = vec * k_aligned;
+    for (index_t d = 0; d < k; ++d) {
+      w[LatentWeightPos(layout, d, k)] = (d < num_K_) ?
+        coef * counter_uniform(init_seed_, counter + d) : 0.0;
+      SetLatentCache(layout, w, d, k, 1.0);
     }
   }
 }
@@ -167,10 +662,953 @@ Model::Model(const std::string& filename) {
   }
 }
 
+// Only the replica releases its private parameters, and the
+// parameters of the other models live until the process exits
+Model::~Model() {
+  if (file_addr_ != nullptr) {
+    UnmapFile(file_addr_, file_size_);
+    return;
+  }
+  if (mmap_addr_ != nullptr) {
+    UnmapFile(mmap_addr_, mmap_size_);
+    return;
+  }
+  if (replica_of_ == nullptr && !weights_copy_) { return; }
+  free(param_b_);
+  if (share_weights_) { return; }
+  free(param_w_);
+#ifdef _WIN32
+  _aligned_free(param_v_);
+#else
+  free(param_v_);
+#endif
+}
+
+// Make this model a replica of the model
+void Model::InitReplica(Model& model, bool share_weights) {
+  CHECK(replica_of_ == nullptr);
+  CHECK(model.replica_of_ == nullptr);
+  // Only the fp32 training model can be replicated, and
+  // the reduced caches cannot be averaged
+  CHECK_EQ(model.latent_type_, kLatentFP32);
+  CHECK(!model.weights_only_);
+  CHECK(share_weights || LatentCacheBytes(model.latent_layout_) == 4);
+  score_func_ = model.score_func_;
+  loss_func_ = model.loss_func_;
+  num_feat_ = model.num_feat_;
+  num_field_ = model.num_field_;
+  num_K_ = model.num_K_;
+  scale_ = model.scale_;
+  param_num_w_ = model.param_num_w_;
+  param_num_v_ = model.param_num_v_;
+  linear_stride_ = model.linear_stride_;
+  latent_pairs_ = model.latent_pairs_;
+  field_k_ = model.field_k_;
+  field_offset_ = model.field_offset_;
+  latent_layout_ = model.latent_layout_;
+  dirty_ = model.dirty_;
+  stamps_ = model.stamps_;
+  replica_of_ = &model;
+  share_weights_ = share_weights;
+  if (share_weights) {
+    param_w_ = model.param_w_;
+    param_v_ = model.param_v_;
+    param_b_ = (real_t*)malloc(2*sizeof(real_t));
+  } else {
+    this->initial(false);
+  }
+  this->PullReplica();
+}
+
+// Copy the private parameters from the model
+void Model::PullReplica() {
+  CHECK_NOTNULL(replica_of_);
+  memcpy(param_b_, replica_of_->param_b_, 2*sizeof(real_t));
+  if (share_weights_) { return; }
+  memcpy(param_w_, replica_of_->param_w_,
+         param_num_w_*sizeof(real_t));
+  if (param_v_ != nullptr) {
+    memcpy(param_v_, replica_of_->param_v_,
+           param_num_v_*sizeof(real_t));
+  }
+}
+
+// Merge the array [0, size) of the replicas into dst, which
+// is the average of them or dst + sum(src - dst)
+static void merge_array(real_t* dst, index_t size,
+                        const std::vector<real_t*>& src,
+                        bool average) {
+  real_t scale = 1.0 / src.size();
+  for (index_t i = 0; i < size; ++i) {
+    real_t sum = 0;
+    for (size_t r = 0; r < src.size(); ++r) {
+      sum += average ? src[r][i] : src[r][i] - dst[i];
+    }
+    dst[i] = average ? sum * scale : dst[i] + sum;
+  }
+}
+
+// The private bias of the shared model is updated by the disjoint
+// rows of the threads, so the updates of all the threads are added
+// to the bias as in Hogwild. The whole replicas are averaged
+void Model::MergeReplicas(const std::vector<Model*>& replicas) {
+  if (replicas.empty()) { return; }
+  std::vector<real_t*> b, w, v;
+  for (size_t r = 0; r < replicas.size(); ++r) {
+    CHECK_EQ(replicas[r]->replica_of_, this);
+    b.push_back(replicas[r]->param_b_);
+    w.push_back(replicas[r]->param_w_);
+    v.push_back(replicas[r]->param_v_);
+  }
+  bool average = !replicas[0]->share_weights_;
+  merge_array(param_b_, 2, b, average);
+  if (!average) { return; }
+  merge_array(param_w_, param_num_w_, w, true);
+  if (param_v_ != nullptr) {
+    merge_array(param_v_, param_num_v_, v, true);
+  }
+}
+
+// The snapshot is w, v and b in a row
+void Model::Snapshot(std::vector<real_t>* snapshot) const {
+  CHECK_NOTNULL(snapshot);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  snapshot->resize(param_num_w_ + param_num_v_ + 2);
+  real_t* p = snapshot->data();
+  memcpy(p, param_w_, param_num_w_ * sizeof(real_t));
+  p += param_num_w_;
+  if (param_num_v_ > 0) {
+    memcpy(p, param_v_, param_num_v_ * sizeof(real_t));
+    p += param_num_v_;
+  }
+  memcpy(p, param_b_, 2 * sizeof(real_t));
+}
+
+void Model::Restore(const std::vector<real_t>& snapshot) {
+  CHECK_EQ(snapshot.size(), param_num_w_ + param_num_v_ + 2);
+  const real_t* p = snapshot.data();
+  memcpy(param_w_, p, param_num_w_ * sizeof(real_t));
+  p += param_num_w_;
+  if (param_num_v_ > 0) {
+    memcpy(param_v_, p, param_num_v_ * sizeof(real_t));
+    p += param_num_v_;
+  }
+  memcpy(param_b_, p, 2 * sizeof(real_t));
+}
+
+// The copy has the layout of the weights-only file
+void Model::CopyWeights(const Model& model) {
+  CHECK(replica_of_ == nullptr);
+  CHECK(model.replica_of_ == nullptr);
+  CHECK_EQ(model.latent_type_, kLatentFP32);
+  bool has_v = model.score_func_.compare("linear") != 0;
+  index_t aligned_k = model.get_aligned_k();
+  uint64 num_vec = has_v ? model.num_latent_vec() : 0;
+  // The copy follows the features of the grown model
+  if (weights_copy_ && param_num_w_ != model.num_feat_) {
+    free(param_w_);
+    free(param_b_);
+#ifdef _WIN32
+    _aligned_free(param_v_);
+#else
+    free(param_v_);
+#endif
+    weights_copy_ = false;
+  }
+  if (!weights_copy_) {
+    score_func_ = model.score_func_;
+    loss_func_ = model.loss_func_;
+    num_feat_ = model.num_feat_;
+    num_field_ = model.num_field_;
+    num_K_ = model.num_K_;
+    scale_ = model.scale_;
+    param_num_w_ = model.num_feat_;
+    param_num_v_ = num_vec * aligned_k;
+    linear_stride_ = 1;
+    weights_only_ = true;
+    weights_copy_ = true;
+    this->initial(false);
+  }
+  CHECK_EQ(param_num_w_, model.num_feat_);
+  CHECK_EQ(param_num_v_, num_vec * aligned_k);
+  for (index_t i = 0; i < param_num_w_; ++i) {
+    param_w_[i] = model.param_w_[i * model.linear_stride_];
+  }
+  memcpy(param_b_, model.param_b_, 2 * sizeof(real_t));
+  for (uint64 i = 0; i < num_vec; ++i) {
+    model.latent_weights(i, param_v_ + i * aligned_k);
+  }
+}
+
+// The inverse of latent_weights() for each latent vector
+void Model::RestoreWeights(const Model& copy) {
+  CHECK(copy.weights_copy_);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(!weights_only_);
+  CHECK_EQ(copy.param_num_w_, num_feat_);
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t aligned_k = get_aligned_k();
+  uint64 num_vec = has_v ? num_latent_vec() : 0;
+  CHECK_EQ(copy.param_num_v_, num_vec * aligned_k);
+  for (index_t i = 0; i < num_feat_; ++i) {
+    param_w_[i * linear_stride_] = copy.param_w_[i];
+  }
+  memcpy(param_b_, copy.param_b_, 2 * sizeof(real_t));
+  LatentLayout layout = block_layout();
+  for (uint64 i = 0; i < num_vec; ++i) {
+    real_t* w = latent_block(i);
+    if (w == nullptr) { continue; }
+    const real_t* vec = copy.param_v_ + i * aligned_k;
+    index_t k = latent_k(i);
+    for (index_t d = 0; d < k; ++d) {
+      w[LatentWeightPos(layout, d, aligned_k)] = vec[d];
+    }
+  }
+}
+
+// In FM the latent vector of feat is the feat-th block (and
+// the blocks 2 * feat and 2 * feat + 1 in HOFM), and in FFM
+// the vector of (feat, field) is the block of index
+// feat * num_field + field. The FFM blocks are copied to
+// the layout of this model, whose block may be smaller
+void Model::WarmStart(const Model& pre) {
+  CHECK(replica_of_ == nullptr);
+  CHECK(!weights_only_);
+  // The weights-only model (e.g., the checkpoint) gives
+  // the weights of the same structure by InitFrom()
+  if (pre.weights_only_) {
+    CHECK_EQ(score_func_.compare(pre.score_func_), 0);
+    CHECK_EQ(num_K_, pre.num_K_);
+    CHECK_GE(num_feat_, pre.num_feat_);
+    InitFrom(pre);
+    return;
+  }
+  CHECK(!IsSparseLatent() && !pre.IsSparseLatent());
+  CHECK(!HasFieldK() && !pre.HasFieldK());
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK_EQ(pre.latent_type_, kLatentFP32);
+  CHECK_EQ(score_func_.compare(pre.score_func_), 0);
+  CHECK_EQ(num_K_, pre.num_K_);
+  CHECK_EQ(linear_stride_, pre.linear_stride_);
+  CHECK_GE(num_feat_, pre.num_feat_);
+  memcpy(param_w_, pre.param_w_,
+         pre.param_num_w_ * sizeof(real_t));
+  memcpy(param_b_, pre.param_b_, 2 * sizeof(real_t));
+  if (score_func_.compare("linear") == 0) { return; }
+  if (score_func_.compare("fm") == 0 ||
+      score_func_.compare("hofm") == 0) {
+    memcpy(param_v_, pre.param_v_,
+           pre.param_num_v_ * sizeof(real_t));
+    return;
+  }
+  CHECK_GE(num_field_, pre.num_field_);
+  index_t aligned_k = get_aligned_k();
+  index_t block = LatentBlockSize(latent_layout_, aligned_k);
+  index_t pre_block = LatentBlockSize(pre.latent_layout_, aligned_k);
+  for (index_t i = 0; i < pre.num_feat_; ++i) {
+    real_t* dst = param_v_ + (uint64)i * num_field_ * block;
+    const real_t* src = pre.param_v_ +
+                        (uint64)i * pre.num_field_ * pre_block;
+    if (pre.latent_layout_ == latent_layout_) {
+      memcpy(dst, src, pre.num_field_ * block * sizeof(real_t));
+      continue;
+    }
+    for (index_t f = 0; f < pre.num_field_; ++f) {
+      copy_block(dst + (uint64)f * block, latent_layout_,
+                 src + (uint64)f * pre_block, pre.latent_layout_,
+                 aligned_k);
+    }
+  }
+}
+
+bool Model::CanInitFrom(const Model& simple) const {
+  if (simple.IsSparse() || simple.IsSparseLatent() ||
+      simple.latent_type_ != kLatentFP32) {
+    return false;
+  }
+  if (simple.score_func_.compare("linear") == 0) { return true; }
+  if (simple.num_K_ > num_K_) { return false; }
+  if (simple.score_func_ == score_func_) { return true; }
+  return simple.score_func_.compare("fm") == 0 &&
+         score_func_.compare("ffm") == 0;
+}
+
+void Model::InitFrom(const Model& simple) {
+  CHECK(replica_of_ == nullptr);
+  CHECK(!weights_only_);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(CanInitFrom(simple));
+  index_t num_feat = std::min(num_feat_, simple.num_feat_);
+  for (index_t i = 0; i < num_feat; ++i) {
+    param_w_[(uint64)i * linear_stride_] =
+      simple.param_w_[(uint64)i * simple.linear_stride_];
+  }
+  param_b_[0] = simple.param_b_[0];
+  if (simple.score_func_.compare("linear") == 0) { return; }
+  index_t num_vec = vec_per_feature();
+  index_t simple_vec = simple.vec_per_feature();
+  std::vector<real_t> vec(get_aligned_k());
+  std::vector<real_t> simple_v(simple.get_aligned_k());
+  for (index_t i = 0; i < num_feat; ++i) {
+    for (index_t j = 0; j < num_vec; ++j) {
+      // The fm vector is the vector of every field
+      index_t src = simple_vec == 1 ? 0 : j;
+      if (src >= simple_vec) { break; }
+      uint64 id = (uint64)i * num_vec + j;
+      latent_weights(id, vec.data());
+      simple.latent_weights((uint64)i * simple_vec + src, simple_v.data());
+      for (index_t d = 0; d < simple.num_K_; ++d) { vec[d] = simple_v[d]; }
+      set_latent_weights(id, vec.data());
+    }
+  }
+}
+
+// The rules of magnitude and frequency are checked on
+// the weights of each feature and its latent vectors
+void Model::PruneFeatures(real_t w_threshold,
+                          real_t v_threshold,
+                          real_t g_threshold,
+                          std::vector<index_t>* kept) const {
+  CHECK_NOTNULL(kept);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(g_threshold <= 0 || !weights_only_);
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t aligned_k = get_aligned_k();
+  index_t num_vec = vec_per_feature();
+  std::vector<real_t> vec(aligned_k);
+  kept->clear();
+  for (index_t i = 0; i < num_feat_; ++i) {
+    const real_t* w = param_w_ + (uint64)i * linear_stride_;
+    if (g_threshold > 0) {
+      // The gradient cache of AdaGrad starts at 1.0
+      real_t g_sum = linear_stride_ == 2 ? w[1] - 1.0 : w[1];
+      if (g_sum < g_threshold) { continue; }
+    }
+    bool small = w_threshold > 0 && fabs(w[0]) < w_threshold;
+    if (small && has_v && v_threshold > 0) {
+      for (index_t j = 0; small && j < num_vec; ++j) {
+        latent_weights((uint64)i * num_vec + j, vec.data());
+        for (index_t d = 0; d < aligned_k; ++d) {
+          if (fabs(vec[d]) >= v_threshold) { small = false; }
+        }
+      }
+    }
+    if (!small) { kept->push_back(i); }
+  }
+}
+
+// The kept features are copied in the layout of CopyWeights()
+void Model::CompactFrom(const Model& model,
+                        const std::vector<index_t>& kept) {
+  CHECK(replica_of_ == nullptr);
+  CHECK(mmap_addr_ == nullptr);
+  CHECK(!weights_copy_);
+  CHECK_EQ(model.latent_type_, kLatentFP32);
+  CHECK_GT(kept.size(), 0);
+  bool has_v = model.score_func_.compare("linear") != 0;
+  index_t aligned_k = model.get_aligned_k();
+  index_t num_vec = model.vec_per_feature();
+  score_func_ = model.score_func_;
+  loss_func_ = model.loss_func_;
+  num_feat_ = kept.size();
+  num_field_ = model.num_field_;
+  num_K_ = model.num_K_;
+  scale_ = model.scale_;
+  param_num_w_ = num_feat_;
+  param_num_v_ = has_v ? (uint64)num_feat_ * num_vec * aligned_k : 0;
+  linear_stride_ = 1;
+  weights_only_ = true;
+  weights_copy_ = true;
+  this->initial(false);
+  memcpy(param_b_, model.param_b_, 2 * sizeof(real_t));
+  for (index_t i = 0; i < num_feat_; ++i) {
+    CHECK_LT(kept[i], model.num_feat_);
+    param_w_[i] = model.param_w_[(uint64)kept[i] * model.linear_stride_];
+    if (!has_v) { continue; }
+    for (index_t j = 0; j < num_vec; ++j) {
+      model.latent_weights((uint64)kept[i] * num_vec + j,
+                           param_v_ + ((uint64)i * num_vec + j) *
+                                      aligned_k);
+    }
+  }
+}
+
+// The eigenvalues and the eigenvectors of the n x n symmetric
+// matrix a by the cyclic Jacobi rotations, which is exact enough
+// for the small K of the latent factor. The i-th eigenvector is
+// the i-th column of vec, and a is destroyed
+static void symmetric_eigen(std::vector<double>* a, index_t n,
+                            std::vector<double>* value,
+                            std::vector<double>* vec) {
+  std::vector<double>& m = *a;
+  vec->assign((uint64)n * n, 0);
+  for (index_t i = 0; i < n; ++i) { (*vec)[i * n + i] = 1; }
+  for (int sweep = 0; sweep < 100; ++sweep) {
+    double off = 0, diag = 0;
+    for (index_t p = 0; p < n; ++p) {
+      diag += m[p * n + p] * m[p * n + p];
+      for (index_t q = p + 1; q < n; ++q) {
+        off += m[p * n + q] * m[p * n + q];
+      }
+    }
+    if (off <= 1e-24 * diag || off == 0) { break; }
+    for (index_t p = 0; p < n; ++p) {
+      for (index_t q = p + 1; q < n; ++q) {
+        double apq = m[p * n + q];
+        if (apq == 0) { continue; }
+        double theta = (m[q * n + q] - m[p * n + p]) / (2 * apq);
+        double t = (theta >= 0 ? 1.0 : -1.0) /
+                   (fabs(theta) + sqrt(theta * theta + 1));
+        double c = 1 / sqrt(t * t + 1);
+        double s = t * c;
+        for (index_t k = 0; k < n; ++k) {
+          double akp = m[k * n + p];
+          double akq = m[k * n + q];
+          m[k * n + p] = c * akp - s * akq;
+          m[k * n + q] = s * akp + c * akq;
+        }
+        for (index_t k = 0; k < n; ++k) {
+          double apk = m[p * n + k];
+          double aqk = m[q * n + k];
+          m[p * n + k] = c * apk - s * aqk;
+          m[q * n + k] = s * apk + c * aqk;
+        }
+        for (index_t k = 0; k < n; ++k) {
+          double vkp = (*vec)[k * n + p];
+          double vkq = (*vec)[k * n + q];
+          (*vec)[k * n + p] = c * vkp - s * vkq;
+          (*vec)[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  value->resize(n);
+  for (index_t i = 0; i < n; ++i) { (*value)[i] = m[i * n + i]; }
+}
+
+void Model::LatentBasis(std::vector<double>* energy,
+                        std::vector<double>* basis) const {
+  CHECK_NOTNULL(energy);
+  CHECK_NOTNULL(basis);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(score_func_.compare("fm") == 0 ||
+        score_func_.compare("ffm") == 0);
+  index_t k = num_K_;
+  uint64 num_vec = (uint64)num_feat_ * vec_per_feature();
+  std::vector<real_t> vec(get_aligned_k());
+  std::vector<double> cov((uint64)k * k, 0);
+  for (uint64 i = 0; i < num_vec; ++i) {
+    latent_weights(i, vec.data());
+    for (index_t a = 0; a < k; ++a) {
+      if (vec[a] == 0) { continue; }
+      for (index_t b = a; b < k; ++b) {
+        cov[a * k + b] += (double)vec[a] * vec[b];
+      }
+    }
+  }
+  for (index_t a = 0; a < k; ++a) {
+    for (index_t b = 0; b < a; ++b) { cov[a * k + b] = cov[b * k + a]; }
+  }
+  std::vector<double> value, column;
+  symmetric_eigen(&cov, k, &value, &column);
+  std::vector<index_t> order(k);
+  for (index_t i = 0; i < k; ++i) { order[i] = i; }
+  std::sort(order.begin(), order.end(), [&value](index_t a, index_t b) {
+    return value[a] > value[b];
+  });
+  energy->resize(k);
+  basis->resize((uint64)k * k);
+  for (index_t i = 0; i < k; ++i) {
+    (*energy)[i] = std::max(value[order[i]], 0.0);
+    for (index_t d = 0; d < k; ++d) {
+      (*basis)[i * k + d] = column[d * k + order[i]];
+    }
+  }
+}
+
+void Model::ReduceRankFrom(const Model& model,
+                           const std::vector<double>& basis,
+                           index_t rank) {
+  CHECK(replica_of_ == nullptr);
+  CHECK(mmap_addr_ == nullptr);
+  CHECK(!weights_copy_);
+  CHECK_EQ(model.latent_type_, kLatentFP32);
+  CHECK(model.score_func_.compare("fm") == 0 ||
+        model.score_func_.compare("ffm") == 0);
+  CHECK_GT(rank, 0);
+  CHECK_LE(rank, model.num_K_);
+  index_t k = model.num_K_;
+  CHECK_EQ(basis.size(), (uint64)k * k);
+  index_t num_vec = model.vec_per_feature();
+  score_func_ = model.score_func_;
+  loss_func_ = model.loss_func_;
+  num_feat_ = model.num_feat_;
+  num_field_ = model.num_field_;
+  num_K_ = rank;
+  scale_ = model.scale_;
+  index_t aligned_k = get_aligned_k();
+  param_num_w_ = num_feat_;
+  param_num_v_ = (uint64)num_feat_ * num_vec * aligned_k;
+  linear_stride_ = 1;
+  weights_only_ = true;
+  weights_copy_ = true;
+  this->initial(false);
+  memcpy(param_b_, model.param_b_, 2 * sizeof(real_t));
+  std::vector<real_t> vec(model.get_aligned_k());
+  for (index_t i = 0; i < num_feat_; ++i) {
+    param_w_[i] = model.param_w_[(uint64)i * model.linear_stride_];
+    for (index_t j = 0; j < num_vec; ++j) {
+      uint64 id = (uint64)i * num_vec + j;
+      model.latent_weights(id, vec.data());
+      real_t* out = param_v_ + id * aligned_k;
+      for (index_t r = 0; r < aligned_k; ++r) {
+        double sum = 0;
+        if (r < rank) {
+          for (index_t d = 0; d < k; ++d) {
+            sum += basis[r * k + d] * vec[d];
+          }
+        }
+        out[r] = sum;
+      }
+    }
+  }
+}
+
+void Model::Release() {
+  CHECK(replica_of_ == nullptr);
+  CHECK(mmap_addr_ == nullptr);
+  CHECK(!shared_);
+  release_shards();
+  release_growable();
+  free(param_w_);
+  free(param_b_);
+  // The latent factor of the huge pages
+  if (huge_used_.compare("none") != 0) {
+    FreeHugePages(param_v_, param_num_v_ * sizeof(real_t), huge_used_);
+    param_v_ = nullptr;
+    huge_used_ = "none";
+  }
+  // The latent factor of inference given by ConvertLatent()
+  void* latent[] = { param_v_, param_v_half_,
+                     param_v_int8_, param_v_scale_ };
+  for (size_t i = 0; i < sizeof(latent) / sizeof(latent[0]); ++i) {
+#ifdef _WIN32
+    _aligned_free(latent[i]);
+#else
+    free(latent[i]);
+#endif
+  }
+  param_v_half_ = nullptr;
+  param_v_int8_ = nullptr;
+  param_v_scale_ = nullptr;
+  latent_type_ = kLatentFP32;
+  param_w_ = nullptr;
+  param_b_ = nullptr;
+  param_v_ = nullptr;
+  param_num_w_ = 0;
+  param_num_v_ = 0;
+  weights_copy_ = false;
+  latent_pairs_.reset();
+  field_k_.clear();
+  field_offset_.clear();
+}
+
+// Aligned malloc for the latent factor of inference
+static void* aligned_alloc_or_die(uint64 size) {
+  void* p = nullptr;
+#ifdef _WIN32
+  p = _aligned_malloc(size, kAlignByte);
+#else
+  if (posix_memalign(&p, kAlignByte, size) != 0) { p = nullptr; }
+#endif
+  CHECK_NOTNULL(p);
+  return p;
+}
+
+// Number of latent vectors, which have aligned_k weights
+// and their caches (see LatentBlockSize()) or aligned_k weights
+uint64 Model::WeightBytes() const {
+  uint64 bytes = param_b_ != nullptr ? sizeof(real_t) : 0;
+  if (replica_of_ != nullptr && share_weights_) { return bytes; }
+  if (param_w_ != nullptr) { bytes += num_feat_ * sizeof(real_t); }
+  index_t aligned_k = get_aligned_k();
+  if (param_v_ != nullptr && IsSparseLatent()) {
+    bytes += latent_pairs_->Size() * aligned_k * sizeof(real_t) +
+             latent_pairs_->MemoryBytes();
+  } else if (param_v_ != nullptr && HasFieldK()) {
+    bytes += param_num_v_ / 2 * sizeof(real_t);
+  } else if (param_v_ != nullptr) {
+    bytes += num_latent_vec() * aligned_k * sizeof(real_t);
+  } else if (param_v_half_ != nullptr) {
+    bytes += num_latent_vec() * aligned_k * sizeof(uint16);
+  } else if (param_v_int8_ != nullptr) {
+    bytes += num_latent_vec() * (aligned_k * sizeof(int8) +
+                                 sizeof(real_t));
+  }
+  bytes += feature_ids_.size() * sizeof(index_t);
+  return bytes;
+}
+
+uint64 Model::StateBytes() const {
+  if (weights_only_) { return 0; }
+  uint64 bytes = param_b_ != nullptr ? sizeof(real_t) : 0;
+  if (replica_of_ != nullptr && share_weights_) { return bytes; }
+  if (param_w_ != nullptr) {
+    bytes += (uint64)(param_num_w_ - num_feat_) * sizeof(real_t);
+  }
+  if (param_v_ != nullptr && HasFieldK()) {
+    bytes += param_num_v_ / 2 * sizeof(real_t);
+  } else if (param_v_ != nullptr) {
+    LatentLayout layout = block_layout();
+    index_t aligned_k = get_aligned_k();
+    index_t block = LatentBlockSize(layout, aligned_k);
+    bytes += (uint64)param_num_v_ / block * (block - aligned_k) *
+             sizeof(real_t);
+  }
+  return bytes;
+}
+
+uint64 Model::num_latent_vec() const {
+  if (latent_pairs_ != nullptr || HasFieldK()) {
+    return (uint64)num_feat_ * num_field_;
+  }
+  index_t aligned_k = get_aligned_k();
+  return weights_only_ ? param_num_v_ / aligned_k
+                       : param_num_v_ / LatentBlockSize(block_layout(),
+                                                        aligned_k);
+}
+
+// The vector of (feat, field) in FFM is the (feat * num_field
+// + field)-th vector of the dense model
+real_t* Model::latent_block(uint64 i) const {
+  if (latent_pairs_ == nullptr && !HasFieldK()) {
+    return param_v_ + i * LatentBlockSize(block_layout(), get_aligned_k());
+  }
+  return GetLatentBlock(i / num_field_, i % num_field_);
+}
+
+// The weights of the block are at the positions of its layout
+void Model::latent_weights(uint64 i, real_t* vec) const {
+  index_t aligned_k = get_aligned_k();
+  if (weights_only_) {
+    memcpy(vec, param_v_ + i * aligned_k, aligned_k * sizeof(real_t));
+    return;
+  }
+  LatentLayout layout = block_layout();
+  const real_t* w = latent_block(i);
+  index_t k = w == nullptr ? 0 : latent_k(i);
+  for (index_t d = 0; d < aligned_k; ++d) {
+    vec[d] = d < k ? w[LatentWeightPos(layout, d, aligned_k)] : 0;
+  }
+}
+
+void Model::set_latent_weights(uint64 i, const real_t* vec) {
+  index_t aligned_k = get_aligned_k();
+  if (weights_only_) {
+    memcpy(param_v_ + i * aligned_k, vec, aligned_k * sizeof(real_t));
+    return;
+  }
+  LatentLayout layout = block_layout();
+  real_t* w = latent_block(i);
+  if (w == nullptr) { return; }
+  index_t k = latent_k(i);
+  for (index_t d = 0; d < k; ++d) {
+    w[LatentWeightPos(layout, d, aligned_k)] = vec[d];
+  }
+}
+
+index_t Model::latent_k(uint64 i) const {
+  if (!HasFieldK()) { return get_aligned_k(); }
+  return field_k_[i % num_field_];
+}
+
+index_t Model::vec_per_feature() const {
+  if (score_func_.compare("ffm") == 0) { return num_field_; }
+  return score_func_.compare("hofm") == 0 ? 2 : 1;
+}
+
+LatentLayout Model::block_layout() const {
+  return score_func_.compare("ffm") == 0 ? latent_layout_ : kLayoutSplit;
+}
+
+// The weights-only model has no cache, so its
+// blocks are the same in any layout
+void Model::SetLatentLayout(LatentLayout layout) {
+  if (layout == latent_layout_) { return; }
+  CHECK(field_k_.empty());
+  if (param_v_ != nullptr && !weights_only_ &&
+      score_func_.compare("ffm") == 0) {
+    CHECK_EQ(latent_type_, kLatentFP32);
+    CHECK(replica_of_ == nullptr);
+    index_t aligned_k = get_aligned_k();
+    index_t align0 = LatentBlockSize(latent_layout_, aligned_k);
+    std::vector<real_t> buf;
+    for (uint64 i = 0; i < param_num_v_; i += align0) {
+      convert_block(param_v_ + i, aligned_k, latent_layout_,
+                    layout, &buf);
+    }
+  }
+  latent_layout_ = layout;
+}
+
+bool ParseLatentLayout(const std::string& name, LatentLayout* layout) {
+  CHECK_NOTNULL(layout);
+  if (name.compare("interleaved") == 0) {
+    *layout = kLayoutInterleaved;
+  } else if (name.compare("split") == 0) {
+    *layout = kLayoutSplit;
+  } else if (name.compare("split-fp16") == 0) {
+    *layout = kLayoutSplitFP16;
+  } else if (name.compare("split-bf16") == 0) {
+    *layout = kLayoutSplitBF16;
+  } else if (name.compare("split-log8") == 0) {
+    *layout = kLayoutSplitLog8;
+  } else if (name.compare("split-shared") == 0) {
+    *layout = kLayoutSplitShared;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* LatentLayoutName(LatentLayout layout) {
+  switch (layout) {
+    case kLayoutSplit: return "split";
+    case kLayoutSplitFP16: return "split-fp16";
+    case kLayoutSplitBF16: return "split-bf16";
+    case kLayoutSplitLog8: return "split-log8";
+    case kLayoutSplitShared: return "split-shared";
+    default: return "interleaved";
+  }
+}
+
+// Convert the latent factor for inference. Only the weights
+// are kept. For int8, each latent vector is quantized
+// symmetrically with the scale max(|w|) / 127
+void Model::ConvertLatent(const std::string& type) {
+  if (type.compare("fp32") == 0) { return; }
+  LatentType latent = kLatentFP32;
+  if (type.compare("fp16") == 0) {
+    latent = kLatentFP16;
+  } else if (type.compare("bf16") == 0) {
+    latent = kLatentBF16;
+  } else if (type.compare("int8") == 0) {
+    latent = kLatentINT8;
+  } else {
+    LOG(FATAL) << "Unknow latent type: " << type;
+  }
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(!IsSparseLatent() && !HasFieldK());
+  // Linear model has no latent factor
+  if (score_func_.compare("linear") == 0) { return; }
+  index_t aligned_k = get_aligned_k();
+  uint64 num_vec = num_latent_vec();
+  if (latent == kLatentINT8) {
+    param_v_int8_ = static_cast<int8*>(
+      aligned_alloc_or_die(num_vec * aligned_k * sizeof(int8)));
+    param_v_scale_ = static_cast<real_t*>(
+      aligned_alloc_or_die(num_vec * sizeof(real_t)));
+  } else {
+    param_v_half_ = static_cast<uint16*>(
+      aligned_alloc_or_die(num_vec * aligned_k * sizeof(uint16)));
+  }
+  std::vector<real_t> vec(aligned_k);
+  for (uint64 i = 0; i < num_vec; ++i) {
+    latent_weights(i, vec.data());
+    if (latent == kLatentINT8) {
+      real_t max_abs = 0;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        max_abs = std::max(max_abs, (real_t)fabs(vec[d]));
+      }
+      real_t scale = max_abs / 127;
+      real_t inv = max_abs > 0 ? 127 / max_abs : 0;
+      int8* q = param_v_int8_ + i * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        q[d] = (int8)lrintf(vec[d] * inv);
+      }
+      param_v_scale_[i] = scale;
+    } else {
+      uint16* h = param_v_half_ + i * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        h[d] = latent == kLatentFP16 ? FloatToHalf(vec[d])
+                                     : FloatToBFloat16(vec[d]);
+      }
+    }
+  }
+  // The mapped weights are released by the destructor, and the
+  // shards and the growable model only keep w
+  if (IsGrowable()) {
+    UnmapFile(reinterpret_cast<char*>(param_v_),
+              page_round((uint64)capacity_ * grow_v_feat_ *
+                         sizeof(real_t)));
+    grow_v_feat_ = 0;
+    huge_used_ = "none";
+  } else if (!shards_.empty()) {
+    UnmapFile(reinterpret_cast<char*>(param_v_),
+              page_round((uint64)param_num_v_ * sizeof(real_t)));
+    for (size_t s = 0; s < shards_.size(); ++s) {
+      shards_[s].v = nullptr;
+    }
+    huge_used_ = "none";
+  } else if (huge_used_.compare("none") != 0) {
+    FreeHugePages(param_v_, param_num_v_ * sizeof(real_t), huge_used_);
+    huge_used_ = "none";
+  } else if (mmap_addr_ == nullptr) {
+#ifdef _WIN32
+    _aligned_free(param_v_);
+#else
+    free(param_v_);
+#endif
+  }
+  param_v_ = nullptr;
+  latent_type_ = latent;
+}
+
 // Serialize current model to a disk file
-void Model::Serialize(const std::string& filename) {
+void Model::Serialize(const std::string& filename,
+                      bool weights_only) {
   CHECK_NE(filename.empty(), true);
   FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  this->serialize(file, weights_only);
+  Close(file);
+}
+
+// A feature is touched if its linear weight has been updated,
+// which is done for every feature of the row in each update.
+// The weight starts at 0, and the squared gradients are added
+// to the state (the cache of AdaGrad starts at 1.0, and n of
+// FTRL and lazy AdaGrad starts at 0)
+void Model::TouchedFeatures(std::vector<index_t>* ids) const {
+  CHECK_NOTNULL(ids);
+  CHECK(!weights_only_);
+  ids->clear();
+  for (index_t i = 0; i < num_feat_; ++i) {
+    const real_t* w = param_w_ + (uint64)i * linear_stride_;
+    real_t init = linear_stride_ == 2 ? 1.0 : 0;
+    if (w[0] != 0 || w[1] != init) { ids->push_back(i); }
+  }
+}
+
+void Model::SerializeSparse(const std::string& filename) {
+  std::vector<index_t> ids;
+  TouchedFeatures(&ids);
+  SerializeSparse(filename, ids);
+}
+
+// The features are written by the weights-only
+// model of CompactFrom() after their ids
+void Model::SerializeSparse(const std::string& filename,
+                            const std::vector<index_t>& features) {
+  CHECK_NE(filename.empty(), true);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  std::vector<index_t> ids = features;
+  // The model file needs at least one feature
+  if (ids.empty()) { ids.push_back(0); }
+  Model compact;
+  compact.CompactFrom(*this, ids);
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  uint64 size = ids.size();
+  WriteDataToDisk(file, (char*)&kSparseMagic, sizeof(kSparseMagic));
+  WriteDataToDisk(file, (char*)&num_feat_, sizeof(num_feat_));
+  WriteDataToDisk(file, (char*)&size, sizeof(size));
+  WriteDataToDisk(file, (char*)ids.data(), size * sizeof(index_t));
+  compact.serialize(file, true);
+  Close(file);
+}
+
+void Model::TrackDirtyFeatures() {
+  CHECK(replica_of_ == nullptr);
+  dirty_.reset(new std::vector<uint8>(num_feat_, 0));
+}
+
+void Model::TakeDirtyFeatures(std::vector<index_t>* ids) {
+  CHECK_NOTNULL(ids);
+  CHECK(dirty_ != nullptr);
+  ids->clear();
+  std::vector<uint8>& dirty = *dirty_;
+  for (index_t i = 0; i < num_feat_; ++i) {
+    if (dirty[i] != 0) {
+      ids->push_back(i);
+      dirty[i] = 0;
+    }
+  }
+}
+
+void Model::TrackUpdateTime() {
+  CHECK(replica_of_ == nullptr);
+  stamps_.reset(new FeatureStamps());
+  stamps_->time.assign(num_feat_, 0);
+}
+
+// The feature is re-initialized as set_value() does. A training
+// thread that updates it at the same time races as Hogwild, and
+// it stamps the feature again
+index_t Model::EvictStale(uint32 ttl, index_t begin, index_t end) {
+  CHECK(stamps_ != nullptr);
+  CHECK(replica_of_ == nullptr);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(!weights_only_);
+  CHECK_LE(end, num_feat_);
+  std::vector<uint32>& time = stamps_->time;
+  uint32 now = stamps_->clock.load();
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t vec_feat = has_v ? vec_per_feature() : 0;
+  index_t num_evict = 0;
+  for (index_t i = begin; i < end; ++i) {
+    uint32 t = time[i];
+    if (t == 0 || now - t <= ttl) { continue; }
+    time[i] = 0;
+    uint64 vec_begin = (uint64)i * vec_feat;
+    uint64 vec_end = vec_begin + vec_feat;
+    if (latent_pairs_ != nullptr) {
+      vec_begin = latent_pairs_->Start(i);
+      vec_end = latent_pairs_->Start(i + 1);
+    }
+    set_range(i, i + 1, vec_begin, vec_end);
+    if (dirty_ != nullptr) { (*dirty_)[i] = 1; }
+    num_evict++;
+  }
+  return num_evict;
+}
+
+// The delta has the dense ids of the features, which are
+// the features of this model
+bool Model::ApplyDelta(const Model& delta) {
+  if (!delta.IsSparse() || IsSparse() || IsMapped() ||
+      latent_type_ != kLatentFP32 ||
+      delta.score_func_ != score_func_ ||
+      delta.dense_num_feat_ != num_feat_ ||
+      delta.num_field_ != num_field_ ||
+      delta.num_K_ != num_K_) {
+    return false;
+  }
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t aligned_k = get_aligned_k();
+  index_t num_vec = vec_per_feature();
+  param_b_[0] = delta.param_b_[0];
+  for (index_t i = 0; i < delta.num_feat_; ++i) {
+    index_t id = delta.feature_ids_[i];
+    param_w_[(uint64)id * linear_stride_] = delta.param_w_[i];
+    if (!has_v) { continue; }
+    for (index_t j = 0; j < num_vec; ++j) {
+      set_latent_weights((uint64)id * num_vec + j,
+                         delta.param_v_ + ((uint64)i * num_vec + j) *
+                                          aligned_k);
+    }
+  }
+  return true;
+}
+
+// Serialize current model to the file
+void Model::serialize(FILE* file, bool weights_only) {
+  // The latent factor of inference has no gradient cache
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(weights_only || !weights_only_);
+  // The ids of the sparse model would be lost
+  CHECK(!IsSparse());
+  if (weights_only) {
+    WriteDataToDisk(file, (char*)&kWeightsMagic, sizeof(kWeightsMagic));
+  }
   // Write score function
   WriteStringToFile(file, score_func_);
   // Write loss function
@@ -182,8 +1620,11 @@ void Model::Serialize(const std::string& filename) {
   // Write K
   WriteDataToDisk(file, (char*)&num_K_, sizeof(num_K_));
   // Write w
-  this->serialize_w_v_b(file);
-  Close(file);
+  if (weights_only) {
+    this->serialize_weights(file);
+  } else {
+    this->serialize_w_v_b(file);
+  }
 }
 
 // Deserialize model from a checkpoint file
@@ -191,6 +1632,38 @@ bool Model::Deserialize(const std::string& filename) {
   CHECK_NE(filename.empty(), true);
   FILE* file = OpenFileOrDie(filename.c_str(), "r");
   if (file == NULL) { return false; }
+  // Check the magic number of weights-only file
+  uint64 magic = 0;
+  ReadDataFromDisk(file, (char*)&magic, sizeof(magic));
+  if (magic == kMappedMagic) {
+    Close(file);
+    if (!this->MapFile(filename)) {
+      LOG(FATAL) << "The model file is truncated: " << filename;
+    }
+    return true;
+  }
+  if (magic == kChunkedMagic) {
+    Close(file);
+    return this->deserialize_chunked(filename);
+  }
+  // The ids of the sparse model, and the model of the
+  // touched features follows them
+  feature_ids_.clear();
+  dense_num_feat_ = 0;
+  if (magic == kSparseMagic) {
+    uint64 size = 0;
+    ReadDataFromDisk(file, (char*)&dense_num_feat_, sizeof(dense_num_feat_));
+    ReadDataFromDisk(file, (char*)&size, sizeof(size));
+    feature_ids_.resize(size);
+    ReadDataFromDisk(file, (char*)feature_ids_.data(),
+                     size * sizeof(index_t));
+    ReadDataFromDisk(file, (char*)&magic, sizeof(magic));
+    CHECK_EQ(magic, kWeightsMagic);
+  }
+  long start = ftell(file) - sizeof(magic);
+  weights_only_ = magic == kWeightsMagic;
+  if (!weights_only_) { fseek(file, start, SEEK_SET); }
+  if (!weights_only_) { fseek(file, 0, SEEK_SET); }
   // Read score function
   ReadStringFromFile(file, score_func_);
   // Read loss function
@@ -204,6 +1677,332 @@ bool Model::Deserialize(const std::string& filename) {
   // Read w
   this->deserialize_w_v_b(file);
   Close(file);
+  if (!feature_ids_.empty()) {
+    CHECK_EQ(feature_ids_.size(), num_feat_);
+    for (size_t i = 0; i < feature_ids_.size(); ++i) {
+      CHECK_LT(feature_ids_[i], dense_num_feat_);
+    }
+  }
+  return true;
+}
+
+// Write zeros until the position of file reaches pos
+static void write_padding(FILE* file, uint64 pos) {
+  uint64 cur = ftell(file);
+  CHECK_LE(cur, pos);
+  std::vector<char> zero(pos - cur, 0);
+  if (!zero.empty()) {
+    WriteDataToDisk(file, zero.data(), zero.size());
+  }
+}
+
+// The weights are written in the layout of the weights-only
+// model, and each section is padded to the page boundary
+void Model::SerializeMapped(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK_LT(score_func_.size(), 32);
+  CHECK_LT(loss_func_.size(), 32);
+  CHECK(!IsSparse());
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t aligned_k = get_aligned_k();
+  uint64 num_vec = has_v ? num_latent_vec() : 0;
+  MappedModelHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kMappedMagic;
+  strncpy(header.score_func, score_func_.c_str(), 31);
+  strncpy(header.loss_func, loss_func_.c_str(), 31);
+  header.num_feat = num_feat_;
+  header.num_field = num_field_;
+  header.num_K = num_K_;
+  header.num_w = num_feat_;
+  header.num_v = num_vec * aligned_k;
+  header.offset_w = page_round(sizeof(header));
+  header.offset_b = header.offset_w +
+                    page_round(header.num_w * sizeof(real_t));
+  header.offset_v = header.offset_b + kMappedPageSize;
+  header.file_size = header.offset_v +
+                     page_round(header.num_v * sizeof(real_t));
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, (char*)&header, sizeof(header));
+  // Write w
+  write_padding(file, header.offset_w);
+  std::vector<real_t> buf(num_feat_);
+  for (index_t i = 0; i < num_feat_; ++i) {
+    buf[i] = param_w_[i*linear_stride_];
+  }
+  WriteDataToDisk(file, (char*)buf.data(), sizeof(real_t)*num_feat_);
+  // Write b
+  write_padding(file, header.offset_b);
+  WriteDataToDisk(file, (char*)param_b_, sizeof(real_t)*2);
+  // Write v
+  write_padding(file, header.offset_v);
+  buf.resize(aligned_k);
+  for (uint64 i = 0; i < num_vec; ++i) {
+    latent_weights(i, buf.data());
+    WriteDataToDisk(file, (char*)buf.data(), sizeof(real_t)*aligned_k);
+  }
+  write_padding(file, header.file_size);
+  Close(file);
+}
+
+// The parameters point to the read-only mapped file
+bool Model::MapFile(const std::string& filename) {
+  CHECK(mmap_addr_ == nullptr);
+  char* addr = nullptr;
+  uint64 size = TryMapFileToMemory(filename, &addr);
+  if (size < sizeof(MappedModelHeader)) {
+    if (size > 0) { UnmapFile(addr, size); }
+    return false;
+  }
+  MappedModelHeader header;
+  memcpy(&header, addr, sizeof(header));
+  if (header.magic != kMappedMagic || header.file_size != size) {
+    UnmapFile(addr, size);
+    return false;
+  }
+  // The strings end with zero
+  header.score_func[sizeof(header.score_func)-1] = 0;
+  header.loss_func[sizeof(header.loss_func)-1] = 0;
+  mmap_addr_ = addr;
+  mmap_size_ = size;
+  score_func_ = std::string(header.score_func);
+  loss_func_ = std::string(header.loss_func);
+  num_feat_ = header.num_feat;
+  num_field_ = header.num_field;
+  num_K_ = header.num_K;
+  weights_only_ = true;
+  linear_stride_ = 1;
+  param_num_w_ = header.num_w;
+  param_num_v_ = header.num_v;
+  param_w_ = reinterpret_cast<real_t*>(addr + header.offset_w);
+  param_b_ = reinterpret_cast<real_t*>(addr + header.offset_b);
+  param_v_ = nullptr;
+  if (score_func_.compare("linear") != 0) {
+    param_v_ = reinterpret_cast<real_t*>(addr + header.offset_v);
+  }
+  return true;
+}
+
+// The threads take the chunks [0, num_chunk) one by one, and
+// fn(i) processes the chunk i
+template <typename F>
+static void for_each_chunk(size_t num_chunk, const F& fn) {
+  size_t num_thread = std::max((size_t)1, std::min(
+      AvailableCpus(), num_chunk));
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < num_chunk; i = next++) { fn(i); }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_thread; ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+}
+
+// The chunks of w and v hold the ranges of the features, and the
+// weights are written from the model without any copy if they are
+// in the layout of the file. The header is written at last, so the
+// file of an interrupted write has no magic number
+void Model::SerializeChunked(const std::string& filename,
+                             bool weights_only,
+                             uint64 chunk_bytes) {
+  CHECK_NE(filename.empty(), true);
+  CHECK_EQ(latent_type_, kLatentFP32);
+  CHECK(weights_only || !weights_only_);
+  CHECK(!IsSparse());
+  CHECK_LT(score_func_.size(), 32);
+  CHECK_LT(loss_func_.size(), 32);
+  CHECK_GT(chunk_bytes, 0);
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t aligned_k = get_aligned_k();
+  index_t vec_feat = has_v ? vec_per_feature() : 0;
+  // The floats of each feature in w and v of the file
+  uint64 feat_floats[3] = {
+    weights_only ? 1 : (uint64)linear_stride_, 0,
+    (uint64)vec_feat * (weights_only ? aligned_k : 2 * aligned_k)
+  };
+  bool direct_v = !IsSparseLatent() && !HasFieldK() &&
+                  (score_func_.compare("ffm") != 0 ||
+                   latent_layout_ == kLayoutInterleaved);
+  // The chunks of each section, and the features of each chunk
+  std::vector<ModelChunk> table;
+  std::vector<index_t> first_feat;
+  uint64 section_floats[3] = {
+    num_feat_ * feat_floats[0], 2, num_feat_ * feat_floats[2]
+  };
+  for (uint32 s = 0; s < 3; ++s) {
+    if (section_floats[s] == 0) { continue; }
+    uint64 step = s == 1 ? num_feat_ : std::max((uint64)1,
+                  chunk_bytes / (feat_floats[s] * sizeof(real_t)));
+    for (uint64 f = 0; f < num_feat_; f += step) {
+      uint64 end = std::min(f + step, (uint64)num_feat_);
+      ModelChunk chunk;
+      chunk.section = s;
+      chunk.size = s == 1 ? 2 * sizeof(real_t) :
+                   (end - f) * feat_floats[s] * sizeof(real_t);
+      chunk.offset = f * feat_floats[s] * sizeof(real_t);
+      chunk.crc = 0;
+      table.push_back(chunk);
+      first_feat.push_back(f);
+    }
+  }
+  ChunkedModelHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kChunkedMagic;
+  strncpy(header.score_func, score_func_.c_str(), 31);
+  strncpy(header.loss_func, loss_func_.c_str(), 31);
+  header.num_feat = num_feat_;
+  header.num_field = num_field_;
+  header.num_K = num_K_;
+  header.weights_only = weights_only;
+  header.num_w = section_floats[0];
+  header.num_v = section_floats[2];
+  header.num_chunk = table.size();
+  header.offset_data = page_round(sizeof(header) +
+                                  table.size() * sizeof(ModelChunk));
+  uint64 section_offset[3] = {
+    header.offset_data,
+    header.offset_data + header.num_w * sizeof(real_t),
+    header.offset_data + (header.num_w + 2) * sizeof(real_t)
+  };
+  header.file_size = section_offset[2] + header.num_v * sizeof(real_t);
+  for (size_t i = 0; i < table.size(); ++i) {
+    table[i].offset += section_offset[table[i].section];
+  }
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    LOG(FATAL) << "Cannot open file: " << filename;
+  }
+  if (ftruncate(fd, header.file_size) == -1) {
+    LOG(FATAL) << "Error: invoke ftruncate() for file: " << filename;
+  }
+  for_each_chunk(table.size(), [&](size_t i) {
+    ModelChunk& chunk = table[i];
+    uint64 f = first_feat[i];
+    uint64 floats = chunk.size / sizeof(real_t);
+    uint64 end = f + (chunk.section == 1 ? 0 :
+                      floats / feat_floats[chunk.section]);
+    std::vector<real_t> buf;
+    const real_t* data = buf.data();
+    if (chunk.section == 1) {
+      data = param_b_;
+    } else if (chunk.section == 0 && !weights_only) {
+      data = param_w_ + f * linear_stride_;
+    } else if (chunk.section == 2 && !weights_only && direct_v) {
+      data = param_v_ + f * feat_floats[2];
+    } else {
+      buf.resize(floats);
+      for (uint64 j = f; j < end; ++j) {
+        real_t* dst = buf.data() + (j - f) * feat_floats[chunk.section];
+        if (chunk.section == 0) {
+          dst[0] = param_w_[j * linear_stride_];
+        } else if (!weights_only) {
+          dense_latent_blocks(j, dst);
+        } else {
+          for (index_t k = 0; k < vec_feat; ++k) {
+            latent_weights(j * vec_feat + k, dst + k * aligned_k);
+          }
+        }
+      }
+      data = buf.data();
+    }
+    chunk.crc = Crc32c((const char*)data, chunk.size);
+    WriteDataAt(fd, (const char*)data, chunk.size, chunk.offset);
+  });
+  header.table_crc = Crc32c((const char*)table.data(),
+                            table.size() * sizeof(ModelChunk));
+  header.header_crc = Crc32c((const char*)&header,
+                             offsetof(ChunkedModelHeader, header_crc));
+  WriteDataAt(fd, (const char*)table.data(),
+              table.size() * sizeof(ModelChunk), sizeof(header));
+  WriteDataAt(fd, (const char*)&header, sizeof(header), 0);
+  if (close(fd) == -1) {
+    LOG(FATAL) << "Error: invoke close() for file: " << filename;
+  }
+}
+
+// The chunks are read into the model by pread() and checked in
+// place, which is in the layout of the file
+bool Model::deserialize_chunked(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(FATAL) << "Cannot open file: " << filename;
+  }
+  uint64 size = lseek(fd, 0, SEEK_END);
+  ChunkedModelHeader header;
+  std::vector<ModelChunk> table;
+  bool good = ReadDataAt(fd, (char*)&header, sizeof(header), 0) &&
+              header.header_crc == Crc32c((const char*)&header,
+                offsetof(ChunkedModelHeader, header_crc)) &&
+              header.file_size == size && header.num_feat > 0 &&
+              header.num_feat <= ~(index_t)0 &&
+              header.num_w % header.num_feat == 0;
+  if (good) {
+    table.resize(header.num_chunk);
+    uint64 bytes = table.size() * sizeof(ModelChunk);
+    good = ReadDataAt(fd, (char*)table.data(), bytes, sizeof(header)) &&
+           header.table_crc == Crc32c((const char*)table.data(), bytes);
+  }
+  if (!good) {
+    close(fd);
+    LOG(ERROR) << "The header of the model file is corrupted: "
+               << filename;
+    return false;
+  }
+  header.score_func[sizeof(header.score_func)-1] = 0;
+  header.loss_func[sizeof(header.loss_func)-1] = 0;
+  score_func_ = std::string(header.score_func);
+  loss_func_ = std::string(header.loss_func);
+  num_feat_ = header.num_feat;
+  num_field_ = header.num_field;
+  num_K_ = header.num_K;
+  weights_only_ = header.weights_only != 0;
+  feature_ids_.clear();
+  dense_num_feat_ = 0;
+  param_num_w_ = header.num_w;
+  param_num_v_ = header.num_v;
+  linear_stride_ = param_num_w_ / num_feat_;
+  latent_layout_ = kLayoutInterleaved;
+  this->initial(false);
+  real_t* section[3] = { param_w_, param_b_, param_v_ };
+  uint64 section_offset[3] = {
+    header.offset_data,
+    header.offset_data + header.num_w * sizeof(real_t),
+    header.offset_data + (header.num_w + 2) * sizeof(real_t)
+  };
+  uint64 section_bytes[3] = {
+    header.num_w * sizeof(real_t), 2 * sizeof(real_t),
+    header.num_v * sizeof(real_t)
+  };
+  std::atomic<size_t> num_bad(0);
+  for_each_chunk(table.size(), [&](size_t i) {
+    const ModelChunk& chunk = table[i];
+    uint32 s = chunk.section;
+    if (s > 2 || chunk.offset < section_offset[s] ||
+        chunk.offset + chunk.size > section_offset[s] + section_bytes[s] ||
+        (chunk.offset - section_offset[s]) % sizeof(real_t) != 0) {
+      num_bad++;
+      return;
+    }
+    char* dst = (char*)section[s] + (chunk.offset - section_offset[s]);
+    if (!ReadDataAt(fd, dst, chunk.size, chunk.offset) ||
+        Crc32c(dst, chunk.size) != chunk.crc) {
+      LOG(ERROR) << "The chunk " << i << " of the model file is "
+                 << "corrupted: " << filename;
+      num_bad++;
+    }
+  });
+  close(fd);
+  if (num_bad > 0) {
+    LOG(ERROR) << num_bad << " of " << table.size() << " chunks of "
+               << "the model file are corrupted: " << filename;
+    return false;
+  }
   return true;
 }
 
@@ -211,28 +2010,127 @@ bool Model::Deserialize(const std::string& filename) {
 void Model::serialize_w_v_b(FILE* file) {
   // Write size of w
   WriteDataToDisk(file, (char*)&param_num_w_, sizeof(param_num_w_));
-  // Write size of v
+  // Write size of v, which is the one of the dense model. The
+  // field has 32 bits, so only the low 32 bits of the size of
+  // the models over 16 GB are kept (see deserialize_w_v_b())
   if (score_func_.compare("linear") != 0) {
-    WriteDataToDisk(file, (char*)&param_num_v_, sizeof(param_num_v_));
+    index_t num_v = num_latent_vec() * 2 * get_aligned_k();
+    WriteDataToDisk(file, (char*)&num_v, sizeof(num_v));
   }
   // Write w
   WriteDataToDisk(file, (char*)param_w_, sizeof(real_t)*param_num_w_);
   // Write b
   WriteDataToDisk(file, (char*)param_b_, sizeof(real_t)*2);
   // Write v
-  if (score_func_.compare("linear") != 0) {
+  if (score_func_.compare("linear") == 0) { return; }
+  if (IsSparseLatent() || HasFieldK() ||
+      (score_func_.compare("ffm") == 0 &&
+       latent_layout_ != kLayoutInterleaved)) {
+    serialize_latent_blocks(file);
+  } else {
     WriteDataToDisk(file, (char*)param_v_, sizeof(real_t)*param_num_v_);
   }
 }
 
+// The blocks of FFM are written in the interleaved layout of the
+// dense model feature by feature
+void Model::serialize_latent_blocks(FILE* file) {
+  std::vector<real_t> buf((uint64)num_field_ * 2 * get_aligned_k());
+  for (index_t i = 0; i < num_feat_; ++i) {
+    dense_latent_blocks(i, buf.data());
+    WriteDataToDisk(file, (char*)buf.data(), sizeof(real_t)*buf.size());
+  }
+}
+
+// The vectors that are not in the sparse latent factor, and the
+// weights beyond the K of the field, have zero weights and the
+// initial gradient caches (1.0), and the reduced caches are decoded
+void Model::dense_latent_blocks(index_t feat, real_t* buf) const {
+  index_t aligned_k = get_aligned_k();
+  index_t align0 = 2 * aligned_k;
+  for (index_t f = 0; f < num_field_; ++f) {
+    real_t* dst = buf + (uint64)f * align0;
+    const real_t* src = GetLatentBlock(feat, f);
+    index_t k = GetFieldK(f);
+    if (src != nullptr && latent_layout_ == kLayoutInterleaved) {
+      memcpy(dst, src, 2 * k * sizeof(real_t));
+      for (index_t d = k; d < aligned_k; ++d) {
+        dst[LatentWeightPos(kLayoutInterleaved, d, aligned_k)] = 0;
+        dst[LatentCachePos(kLayoutInterleaved, d, aligned_k)] = 1.0;
+      }
+      continue;
+    }
+    for (index_t d = 0; d < aligned_k; ++d) {
+      index_t w = LatentWeightPos(kLayoutInterleaved, d, aligned_k);
+      index_t g = LatentCachePos(kLayoutInterleaved, d, aligned_k);
+      if (src == nullptr) {
+        dst[w] = 0;
+        dst[g] = 1.0;
+      } else {
+        dst[w] = src[LatentWeightPos(latent_layout_, d, aligned_k)];
+        dst[g] = GetLatentCache(latent_layout_, src, d, aligned_k);
+      }
+    }
+  }
+}
+
+// Serialize the weights to disk file, in the same format of
+// serialize_w_v_b(). The gradient cache of the bias is kept
+void Model::serialize_weights(FILE* file) {
+  bool has_v = score_func_.compare("linear") != 0;
+  index_t aligned_k = get_aligned_k();
+  uint64 num_vec = has_v ? num_latent_vec() : 0;
+  index_t num_w = num_feat_;
+  // The low 32 bits, as the one of serialize_w_v_b()
+  index_t num_v = num_vec * aligned_k;
+  // Write size of w and v
+  WriteDataToDisk(file, (char*)&num_w, sizeof(num_w));
+  if (has_v) {
+    WriteDataToDisk(file, (char*)&num_v, sizeof(num_v));
+  }
+  // Write w
+  std::vector<real_t> buf(num_w);
+  for (index_t i = 0; i < num_w; ++i) {
+    buf[i] = param_w_[i*linear_stride_];
+  }
+  WriteDataToDisk(file, (char*)buf.data(), sizeof(real_t)*num_w);
+  // Write b
+  WriteDataToDisk(file, (char*)param_b_, sizeof(real_t)*2);
+  // Write v
+  if (has_v) {
+    buf.resize(aligned_k);
+    for (uint64 i = 0; i < num_vec; ++i) {
+      latent_weights(i, buf.data());
+      WriteDataToDisk(file, (char*)buf.data(), sizeof(real_t)*aligned_k);
+    }
+  }
+}
+
 // Deserialize w,v,b from disk file
 void Model::deserialize_w_v_b(FILE* file) {
   // Read size of w
   ReadDataFromDisk(file, (char*)&param_num_w_, sizeof(param_num_w_));
-  // Read size of v
+  linear_stride_ = num_feat_ > 0 ? param_num_w_ / num_feat_ : 2;
+  // Read size of v, and the linear model has no v. The v is
+  // the rest of the file, whose size is only checked against
+  // the low 32 bits in the file, so the v over 16 GB is read
+  param_num_v_ = 0;
   if (score_func_.compare("linear") != 0) {
-    ReadDataFromDisk(file, (char*)&param_num_v_, sizeof(param_num_v_));
+    index_t num_v = 0;
+    ReadDataFromDisk(file, (char*)&num_v, sizeof(num_v));
+    uint64 pos = ftell(file);
+    fseek(file, 0, SEEK_END);
+    uint64 size = ftell(file);
+    fseek(file, pos, SEEK_SET);
+    uint64 head = pos + ((uint64)param_num_w_ + 2) * sizeof(real_t);
+    if (size < head ||
+        (index_t)((size - head) / sizeof(real_t)) != num_v) {
+      LOG(FATAL) << "The model file is truncated";
+    }
+    param_num_v_ = (size - head) / sizeof(real_t);
   }
+  // The blocks of the file are interleaved
+  latent_layout_ = kLayoutInterleaved;
   // Allocate memory. Don't set value here
   this->initial(false);
   // Read w
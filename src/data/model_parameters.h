@@ -23,15 +23,213 @@ This file defines the class of model parameters.
 #ifndef XLEARN_DATA_MODEL_PARAMETERS_H_
 #define XLEARN_DATA_MODEL_PARAMETERS_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <math.h>
 
 #include "src/base/common.h"
+#include "src/base/half.h"
 #include "src/data/data_structure.h"
+#include "src/data/latent_pairs.h"
 
 namespace xLearn {
 
+// Storage type of the latent factor. The fp32 latent factor stores
+// both the weights and the gradient caches, and it can be trained.
+// The fp16 and bf16 latent factor only stores the weights in 16
+// bits (aligned_k for each latent vector), and the int8 latent factor
+// stores the weights of each latent vector in int8 with one fp32
+// scale. They are used by inference
+enum LatentType {
+  kLatentFP32 = 0,
+  kLatentFP16 = 1,
+  kLatentBF16 = 2,
+  kLatentINT8 = 3
+};
+
+// Position of the weight d of a latent block (LatentBlockSize()
+// floats) in the layout, and the fp32 gradient cache of the
+// interleaved and split layouts is at LatentCachePos()
+inline index_t LatentWeightPos(LatentLayout layout, index_t d,
+                               index_t aligned_k) {
+  if (layout != kLayoutInterleaved) { return d; }
+  return (d / kAlign) * 2 * kAlign + d % kAlign;
+}
+inline index_t LatentCachePos(LatentLayout layout, index_t d,
+                              index_t aligned_k) {
+  if (layout == kLayoutSplit) { return aligned_k + d; }
+  return LatentWeightPos(layout, d, aligned_k) + kAlign;
+}
+
+// The code of the gradient cache c of a reduced layout (see
+// LatentCacheCode), which is rounded to the nearest
+template <LatentLayout L>
+inline uint32 EncodeLatentCache(real_t c) {
+  typedef LatentCacheCode<L> C;
+  uint32 bits = std::min(FloatBits(std::max(c, 1.0f)), C::kMaxBits);
+  return (bits - C::kBias + (1u << (C::kShift - 1))) >> C::kShift;
+}
+template <LatentLayout L>
+inline real_t DecodeLatentCache(uint32 code) {
+  typedef LatentCacheCode<L> C;
+  return BitsFloat((code << C::kShift) + C::kBias);
+}
+
+// The gradient cache d of the block in any layout, which is
+// the one cache of the block in the shared layout
+inline real_t GetLatentCache(LatentLayout layout, const real_t* block,
+                             index_t d, index_t aligned_k) {
+  const uint16* h = reinterpret_cast<const uint16*>(block + aligned_k);
+  const uint8* q = reinterpret_cast<const uint8*>(block + aligned_k);
+  switch (layout) {
+    case kLayoutSplitFP16:
+      return DecodeLatentCache<kLayoutSplitFP16>(h[d]);
+    case kLayoutSplitBF16:
+      return DecodeLatentCache<kLayoutSplitBF16>(h[d]);
+    case kLayoutSplitLog8:
+      return DecodeLatentCache<kLayoutSplitLog8>(q[d]);
+    case kLayoutSplitShared:
+      return block[aligned_k];
+    default:
+      return block[LatentCachePos(layout, d, aligned_k)];
+  }
+}
+inline void SetLatentCache(LatentLayout layout, real_t* block,
+                           index_t d, index_t aligned_k, real_t c) {
+  uint16* h = reinterpret_cast<uint16*>(block + aligned_k);
+  uint8* q = reinterpret_cast<uint8*>(block + aligned_k);
+  switch (layout) {
+    case kLayoutSplitFP16:
+      h[d] = EncodeLatentCache<kLayoutSplitFP16>(c);
+      break;
+    case kLayoutSplitBF16:
+      h[d] = EncodeLatentCache<kLayoutSplitBF16>(c);
+      break;
+    case kLayoutSplitLog8:
+      q[d] = EncodeLatentCache<kLayoutSplitLog8>(c);
+      break;
+    case kLayoutSplitShared:
+      block[aligned_k] = c;
+      for (index_t i = 1; i < kAlign; ++i) { block[aligned_k + i] = 0; }
+      break;
+    default:
+      block[LatentCachePos(layout, d, aligned_k)] = c;
+  }
+}
+
+// Parse the name of the layout ("interleaved", "split", or
+// "split-fp16", "split-bf16" and "split-log8" of the reduced caches,
+// or "split-shared" of one cache per latent vector)
+bool ParseLatentLayout(const std::string& name, LatentLayout* layout);
+
+// The name of the layout
+const char* LatentLayoutName(LatentLayout layout);
+
+//------------------------------------------------------------------------------
+// The formats of the model files
+//------------------------------------------------------------------------------
+
+// The weights-only model file starts with this magic number, and
+// the old checkpoint file starts with the length of a string
+const uint64 kWeightsMagic = 0x31574c444f4d4c58ULL;  // "XLMODLW1"
+
+// The sparse model file starts with this magic number, the number of
+// features of the dense model, the number of the touched features and
+// their ids, which are followed by the weights-only model file of the
+// touched features
+const uint64 kSparseMagic = 0x31534c444f4d4c58ULL;  // "XLMODLS1"
+
+//------------------------------------------------------------------------------
+// The memory-mappable model file starts with this header, and the
+// sections of w (num_w floats), b (2 floats) and v (num_v floats) begin
+// at the offsets, which are the multiple of kMappedPageSize. So the
+// weights are aligned for SIMD after mapping the file
+//------------------------------------------------------------------------------
+const uint64 kMappedMagic = 0x314d4c444f4d4c58ULL;  // "XLMODLM1"
+const uint64 kMappedPageSize = 4096;
+
+// The features of each committed segment of the growable model,
+// whose w and v are whole pages for any linear stride and K
+const index_t kGrowSegment = 1 << 16;
+
+struct MappedModelHeader {
+  uint64 magic;
+  char score_func[32];
+  char loss_func[32];
+  uint64 num_feat;
+  uint64 num_field;
+  uint64 num_K;
+  uint64 num_w;
+  uint64 num_v;
+  uint64 offset_w;
+  uint64 offset_b;
+  uint64 offset_v;
+  uint64 file_size;
+};
+
+//------------------------------------------------------------------------------
+// The chunked model file starts with this header and the table of
+// num_chunk chunks, and the sections of w (num_w floats), b (2 floats)
+// and v (num_v floats) are contiguous from the page after the table,
+// in the layout of the full (or weights-only) checkpoint. Each chunk
+// holds a range of the features of a section with its CRC32C, and
+// the header and the table have their CRC32C too
+//------------------------------------------------------------------------------
+const uint64 kChunkedMagic = 0x31434c444f4d4c58ULL;  // "XLMODLC1"
+const uint64 kModelChunkBytes = 64 << 20;
+
+struct ChunkedModelHeader {
+  uint64 magic;
+  char score_func[32];
+  char loss_func[32];
+  uint64 num_feat;
+  uint64 num_field;
+  uint64 num_K;
+  uint64 weights_only;
+  uint64 num_w;
+  uint64 num_v;
+  uint64 num_chunk;
+  uint64 offset_data;
+  uint64 file_size;
+  uint32 table_crc;
+  /* CRC32C of the bytes of the header before it */
+  uint32 header_crc;
+};
+
+struct ModelChunk {
+  uint64 offset;
+  uint64 size;
+  uint32 section;  /* 0 for w, 1 for b and 2 for v */
+  uint32 crc;
+};
+
+// Round up the size to the multiple of kMappedPageSize
+inline uint64 page_round(uint64 size) {
+  return (size + kMappedPageSize - 1) / kMappedPageSize * kMappedPageSize;
+}
+
+// One shard of the model, which holds the contiguous feature range
+// [first_feat, first_feat + num_feat) in its own pages. w and v
+// point to the linear term and the latent factor of first_feat
+struct ModelShard {
+  index_t first_feat;
+  index_t num_feat;
+  real_t* w;
+  real_t* v;
+};
+
+// The last update time of each feature (Model::TrackUpdateTime), in
+// the ticks of the clock that the owner advances, e.g., the seconds
+// since the training starts. The time 0 means the feature is not
+// updated since it is initialized, and the clock starts at 1
+struct FeatureStamps {
+  std::vector<uint32> time;
+  std::atomic<uint32> clock{1};
+};
+
 //------------------------------------------------------------------------------
 // The Model class is responsible for storing the global
 // model prameters. We can dump a checkpoint for current model
@@ -65,8 +263,8 @@ namespace xLearn {
 //
 //    /* We can also get the parameter of the latent factor */
 //    real_t* v = model.GetParameter_v();
-//    index_t v_len = model.GetNumParameter_v();
-//    for (index_t i = 0; i < v_len; ++i) {
+//    uint64 v_len = model.GetNumParameter_v();
+//    for (uint64 i = 0; i < v_len; ++i) {
 //      /* access v[i] ... */
 //    }
 //
@@ -75,31 +273,453 @@ namespace xLearn {
 //
 //    /* Also, we can load model from this file. */
 //    Model new_model("/tmp/model.txt");
+//
+//    /* For multi-thread training, each thread can train its own
+//       replica of the bias or the model, which is merged after
+//       the threads. */
+//    Model replica;
+//    replica.InitReplica(model, true);   /* private bias */
+//    ...
+//    model.MergeReplicas(replica_list);
+//
+//    /* The training can be resumed from a former model, whose
+//       features are copied into the initialized new model. */
+//    Model pre_model("/tmp/model.txt");
+//    model.WarmStart(pre_model);
+//    pre_model.Release();
+//
+//    /* Or the new model starts from the weights of a simpler model,
+//       e.g., the ffm model from a trained linear or fm model, or
+//       the model of a larger K from the one of a smaller K. */
+//    if (model.CanInitFrom(simple_model)) {
+//      model.InitFrom(simple_model);
+//    }
+//
+//    /* For prediction, we can save the model without the gradient
+//       caches, and the loaded model only has the weights. */
+//    model.Serialize("/tmp/model.bin", true);
+//
+//    /* Or in the memory-mappable format, which is mapped by
+//       the predictors without loading. */
+//    model.SerializeMapped("/tmp/model.bin");
+//
+//    /* Or in the chunked format, whose chunks are written and
+//       read in parallel and checked by their CRC32C. */
+//    model.SerializeChunked("/tmp/model.bin");
+//
+//    /* Several processes can train one model in the shared memory,
+//       which is initialized by one of them (see shared_model.h). */
+//    uint64 bytes = Model::SharedBytes("fm", num_feature, 0, 8, 2);
+//    char* addr = ... /* the shared memory of bytes */
+//    model.InitShared("fm", "squared", num_feature, 0, 8,
+//                     1.0, 2, addr, is_owner);
+//
+//    /* Or in a file for the model that is larger than the memory,
+//       whose pages are loaded when they are used. */
+//    model.InitFile("ffm", "cross-entropy", num_feature, num_field,
+//                   4, 0.66, 2, "/data/xlearn_param");
+//
+//    /* The pages of a large model can be placed on the NUMA nodes
+//       before they are initialized, e.g., one feature range of
+//       each node. */
+//    model.SetNumaPolicy("partition");
+//    model.Initialize("ffm", "cross-entropy", num_feature, num_field, 4);
+//
+//    /* Or split into the shards of the feature ranges, each of which
+//       has its own pages, while w and v are still contiguous. */
+//    model.SetShards(4);
+//    model.Initialize("ffm", "cross-entropy", num_feature, num_field, 4);
+//    ModelShard shard = model.GetShard(model.ShardOf(feat));
+//
+//    /* Or grow as the new feature ids arrive, up to the capacity,
+//       e.g., the online training without -hash. */
+//    model.SetCapacity(1 << 26);
+//    model.Initialize("fm", "cross-entropy", 1, 0, 8);
+//    model.Grow(max_feat_id + 1);
+//
+//    /* The latent factor of FFM can only have the (feature, field)
+//       pairs of the training set, whose blocks are found by the
+//       index (see latent_pairs.h). */
+//    model.SetLatentPairs(pairs);
+//    model.Initialize("ffm", "cross-entropy", num_feature, num_field, 4);
+//    real_t* block = model.GetLatentBlock(feat, field);  /* or nullptr */
+//
+//    /* The latent vectors V_i_f of FFM can have the K of their
+//       field f (see field_k.h), so the blocks of a feature have
+//       their own sizes, and a pair uses the smaller K of its two
+//       blocks. The model file is saved in the dense layout. */
+//    model.SetFieldK(field_k.Values());
+//    model.Initialize("ffm", "cross-entropy", num_feature, num_field, 32);
+//    real_t* block = model.GetLatentBlock(feat, field);
+//
+//    /* The blocks of FFM can have the split layout, whose weights
+//       are contiguous (see LatentLayout). */
+//    model.SetLatentLayout(kLayoutSplit);
+//    model.Initialize("ffm", "cross-entropy", num_feature, num_field, 4);
+//
+//    /* Or only the features that are touched in training. */
+//    model.SerializeSparse("/tmp/model.bin");
+//
+//    /* Or only the features that are updated since the last
+//       delta, which the predictor applies to its former model. */
+//    model.TrackDirtyFeatures();
+//    ... /* training */
+//    std::vector<index_t> ids;
+//    model.TakeDirtyFeatures(&ids);
+//    model.SerializeSparse("/tmp/model.delta", ids);
+//    ...
+//    Model delta("/tmp/model.delta");
+//    serving_model.ApplyDelta(delta);
+//
+//    /* Or the features that are not updated for a time-to-live
+//       are evicted, whose slots are re-initialized for the new
+//       features of the online training. */
+//    model.TrackUpdateTime();
+//    model.GetUpdateStamps()->clock.store(now);
+//    model.EvictStale(ttl, 0, model.GetNumFeature());
+//
+//    /* For serving, the features whose weights are all small
+//       can be pruned, and the kept features are renumbered into
+//       a compact weights-only model. */
+//    std::vector<index_t> kept;
+//    model.PruneFeatures(1e-4, 1e-3, 0, &kept);
+//    Model compact;
+//    compact.CompactFrom(model, kept);
+//
+//    /* The latent vectors of fm and ffm can be projected onto
+//       their principal directions, which gives a weights-only
+//       model of smaller K that is scored by the same kernels. */
+//    std::vector<double> energy, basis;
+//    model.LatentBasis(&energy, &basis);
+//    Model reduced;
+//    reduced.ReduceRankFrom(model, basis, 4);
+//
+//    /* For inference, the latent factor can be stored in 16 bits,
+//       which drops the gradient caches and uses 1/4 memory, or
+//       be quantized to int8, which uses about 1/8 memory. */
+//    new_model.ConvertLatent("bf16");
 //------------------------------------------------------------------------------
 class Model {
  public:
   // Default Constructor and Destructor
   Model() { }
-  ~Model() { }
+  ~Model();
 
   // Initialize model from a checkpoint file
   explicit Model(const std::string& filename);
 
   // Initialize model parameters to zero or using
-  // the Gaussian distribution
+  // the Gaussian distribution. Each weight of the linear
+  // term has linear_stride floats, including the states
+  // of the updater (updater.h)
   void Initialize(const std::string& score_func,
               const std::string& loss_func,
               index_t num_feature,
               index_t num_field,
               index_t num_K,
-              real_t scale = 1.0);
+              real_t scale = 1.0,
+              index_t linear_stride = 2);
+
+  // Initialize the model in the memory at addr, which has
+  // SharedBytes() bytes and is shared by the processes that train
+  // the same model (like the Hogwild threads). The parameters are
+  // only set by the owner, and the others use them as they are.
+  // The memory is not owned by the model and it cannot be released
+  void InitShared(const std::string& score_func,
+                  const std::string& loss_func,
+                  index_t num_feature,
+                  index_t num_field,
+                  index_t num_K,
+                  real_t scale,
+                  index_t linear_stride,
+                  char* addr,
+                  bool owner);
+
+  // Bytes of the memory of InitShared(), where the sections
+  // of w, b and v start at the page boundary
+  static uint64 SharedBytes(const std::string& score_func,
+                            index_t num_feature,
+                            index_t num_field,
+                            index_t num_K,
+                            index_t linear_stride);
+
+  // The parameters are in the memory of InitShared()
+  inline bool IsShared() const { return shared_; }
+
+  // Initialize the model in a file of SharedBytes() bytes, which is
+  // mapped and removed, so the system pages the parameters in and out
+  // for the model that is larger than the memory. The file is only the
+  // storage of training (the model is saved as usual), and it is
+  // unmapped by the destructor. Return false if the file cannot be
+  // created or mapped
+  bool InitFile(const std::string& score_func,
+                const std::string& loss_func,
+                index_t num_feature,
+                index_t num_field,
+                index_t num_K,
+                real_t scale,
+                index_t linear_stride,
+                const std::string& filename);
+
+  // The parameters are in the file of InitFile()
+  inline bool IsFileBacked() const { return file_addr_ != nullptr; }
+
+  // The fraction of the resident pages of each of num_parts feature
+  // ranges of the file of InitFile(), which shows the hot set of the
+  // model, e.g., the first ranges of the frequency-ordered features
+  void ResidentFractions(int num_parts, std::vector<real_t>* fractions);
+
+  // Place the pages of w and v on the NUMA nodes by the policy of
+  // PlaceMemory() (see affinity.h) when they are allocated by
+  // Initialize() or InitShared(), which is "none" by default
+  inline void SetNumaPolicy(const std::string& policy) {
+    numa_policy_ = policy;
+  }
+
+  // Back the latent factor of Initialize() with the huge pages of
+  // the policy (see huge_page.h), which is "none" by default. The
+  // policy may fall back, and HugePages() is the used one
+  inline void SetHugePages(const std::string& policy) {
+    huge_policy_ = policy;
+  }
+  inline const std::string& HugePages() const { return huge_used_; }
+
+  // Split the model of Initialize() into num_shards shards of the
+  // feature ranges, which is 1 by default. Each shard has its own
+  // pages of w and v, which are mapped at its offsets of the reserved
+  // address range, so w and v are contiguous as the unsharded model
+  // and the kernels use them as they are. The shards start at the
+  // page boundary, so the small model may have fewer shards
+  inline void SetShards(int num_shards) {
+    CHECK_GT(num_shards, 0);
+    num_shards_ = num_shards;
+  }
+
+  // Reserve the address ranges of w and v for the capacity of
+  // features in Initialize(), so the model can Grow() without
+  // moving them. The ranges are committed in the segments of
+  // kGrowSegment features, whose pages are allocated on first
+  // touch, and the kernels use w and v as they are. 0 (by
+  // default) is the fixed model, and the sharded model, the
+  // sparse latent factor and the replicas are not growable
+  inline void SetCapacity(index_t max_feature) {
+    capacity_ = max_feature;
+  }
+  inline index_t GetCapacity() const { return capacity_; }
+  inline bool IsGrowable() const { return committed_feat_ > 0; }
+
+  // Grow the model to num_feature features, whose parameters
+  // are initialized as the ones of Initialize(). Return false if
+  // num_feature is beyond the capacity. It is invoked by one
+  // thread while the scores do not use the model, e.g., between
+  // the batches, and the features that the scores use never move
+  bool Grow(index_t num_feature);
+
+  // Number of the shards of the model, which is 1 if it is not
+  // sharded (the whole model is one shard)
+  inline int GetNumShards() const {
+    return shards_.empty() ? 1 : (int)shards_.size();
+  }
+
+  // The shard of the feature, and the s-th shard. The linear term
+  // of feat is GetShard(s).w + (feat - first_feat) * linear stride
+  inline int ShardOf(index_t feat) const {
+    return shards_.empty() ? 0 : feat / shard_feat_;
+  }
+  inline ModelShard GetShard(int s) const {
+    if (shards_.empty()) {
+      ModelShard whole = { 0, num_feat_, param_w_, param_v_ };
+      return whole;
+    }
+    return shards_[s];
+  }
 
-  // Serialize model to a checkpoint file
-  void Serialize(const std::string& filename);
+  // Only allocate the latent vectors of the (feature, field) pairs
+  // of the index in the FFM model of Initialize(). The index has the
+  // features of the model, and it is shared by the replicas. The
+  // vector of each pair has the initial value of the dense model, and
+  // the other vectors are zero. The model file is saved in the dense
+  // layout, so the predictors load it as usual
+  inline void SetLatentPairs(std::shared_ptr<const LatentPairs> pairs) {
+    latent_pairs_ = pairs;
+  }
+
+  // The index of the sparse latent factor, or nullptr
+  inline bool IsSparseLatent() const { return latent_pairs_ != nullptr; }
+  inline const LatentPairs* GetLatentPairs() const {
+    return latent_pairs_.get();
+  }
+
+  // The block (LatentBlockSize() floats) of the latent vector of
+  // (feat, field) of the fp32 FFM model, or nullptr if the pair
+  // is not in the sparse latent factor
+  inline real_t* GetLatentBlock(index_t feat, index_t field) const {
+    if (!field_offset_.empty()) {
+      return param_v_ + (uint64)feat * field_offset_[num_field_] +
+             field_offset_[field];
+    }
+    index_t align0 = LatentBlockSize(latent_layout_, get_aligned_k());
+    if (latent_pairs_ == nullptr) {
+      return param_v_ + ((uint64)feat * num_field_ + field) * align0;
+    }
+    uint64 slot = latent_pairs_->Find(feat, field);
+    return slot == kNoLatentSlot ? nullptr : param_v_ + slot * align0;
+  }
 
-  // Deserialize model from a checkpoint file
+  // Give the latent vectors of FFM of each field the K of the field
+  // (at most the K of the model), which is set before Initialize().
+  // The block of (feat, field) has the interleaved layout of the
+  // aligned K of the field, and the blocks of a feature are next to
+  // each other. The pair (i, j) uses the first min(K_fj, K_fi)
+  // weights of V_i_fj and V_j_fi, so the weights beyond the K of a
+  // field are zero in the model file of the dense layout, and the
+  // predictors load it as usual. The empty field_k is the same K
+  // for all the fields
+  inline void SetFieldK(const std::vector<index_t>& field_k) {
+    field_k_ = field_k;
+  }
+
+  // The latent vectors have the K of their fields
+  inline bool HasFieldK() const { return !field_offset_.empty(); }
+
+  // The aligned K of the field of Initialize(), and the offsets of
+  // the blocks of each field in the blocks of a feature, whose
+  // last one (num_field) is the floats of a feature, or nullptr
+  inline index_t GetFieldK(index_t field) const {
+    return field_offset_.empty() ? get_aligned_k() : field_k_[field];
+  }
+  inline const index_t* GetFieldOffsets() const {
+    return field_offset_.empty() ? nullptr : field_offset_.data();
+  }
+
+  // The seed of the random latent factor of Initialize(),
+  // which gives the same model for any number of threads
+  inline void SetSeed(uint64 seed) { init_seed_ = seed; }
+
+  // The layout of the blocks of the FFM latent factor, which is
+  // kLayoutInterleaved by default. The blocks of an initialized
+  // model are converted in place, so the layouts of the reduced
+  // caches, whose blocks are smaller, are set before Initialize().
+  // The blocks are always saved in the interleaved layout with the
+  // fp32 caches, so the layout is not in the model file.
+  // The FM blocks always have the split layout
+  void SetLatentLayout(LatentLayout layout);
+  inline LatentLayout GetLatentLayout() const { return latent_layout_; }
+
+  // Serialize model to a checkpoint file. If weights_only is
+  // true, the gradient caches are not saved, and the file is
+  // about 1/2 size, which can only be used by prediction
+  void Serialize(const std::string& filename,
+                 bool weights_only = false);
+
+  // Serialize the weights of the features that are touched in
+  // training into a sparse model file, which has the ids of the
+  // features and the weights-only model of them. The features
+  // that are never updated (which keep the initial value) are
+  // not saved, and the model is renumbered when it is loaded
+  void SerializeSparse(const std::string& filename);
+
+  // Serialize the weights of the features ids (in ascending order)
+  // into a sparse model file, which is the delta of the model for
+  // ApplyDelta(), e.g., the features of TakeDirtyFeatures()
+  void SerializeSparse(const std::string& filename,
+                       const std::vector<index_t>& ids);
+
+  // Get the features that have been updated in training,
+  // which needs the gradient caches
+  void TouchedFeatures(std::vector<index_t>* ids) const;
+
+  // Flag the features whose linear weights are updated by the scores
+  // from now on (see Score::update_linear), one byte per feature, so
+  // the concurrent threads set the flags without losing any. The
+  // replicas flag the features of their model
+  void TrackDirtyFeatures();
+
+  // The flags of TrackDirtyFeatures(), or nullptr
+  inline uint8* GetDirtyFeatures() const {
+    return dirty_ != nullptr ? dirty_->data() : nullptr;
+  }
+
+  // Get the flagged features in ascending order and clear the
+  // flags, which is invoked while no thread updates the model
+  void TakeDirtyFeatures(std::vector<index_t>* ids);
+
+  // Stamp the features whose linear weights are updated by the
+  // scores from now on with the current tick of the clock (see
+  // FeatureStamps), which is shared by the replicas
+  void TrackUpdateTime();
+
+  // The stamps of TrackUpdateTime(), or nullptr
+  inline FeatureStamps* GetUpdateStamps() const {
+    return stamps_.get();
+  }
+
+  // Re-initialize the features in [begin, end) whose stamps are
+  // more than ttl ticks before the clock, so their slots (the
+  // hashed ids) start over for the new features. The evicted
+  // features are unstamped and flagged dirty. This runs while
+  // the threads train the model, like the Hogwild updates, and
+  // returns the number of the evicted features
+  index_t EvictStale(uint32 ttl, index_t begin, index_t end);
+
+  // Overwrite the weights of the features of the delta, which is a
+  // sparse model of SerializeSparse() from the model of the same
+  // structure, and the bias. The gradient caches of this model are
+  // not changed. Return false if the delta does not match this
+  // model, or this model is mapped, sparse or converted by
+  // ConvertLatent()
+  bool ApplyDelta(const Model& delta);
+
+  // Serialize the model into the chunked model file, whose sections
+  // are split into the chunks of about chunk_bytes, and each chunk is
+  // written by pwrite() at its offset with its CRC32C. The chunks are
+  // written and read by all the hardware threads, and Deserialize()
+  // fails if any chunk is corrupted
+  void SerializeChunked(const std::string& filename,
+                        bool weights_only = false,
+                        uint64 chunk_bytes = kModelChunkBytes);
+
+  // Serialize the weights into a memory-mappable model file,
+  // which has a header and the page-aligned sections of w, b
+  // and v in the layout of the weights-only model
+  void SerializeMapped(const std::string& filename);
+
+  // Deserialize model from a checkpoint file, which could be a
+  // weights-only file, a sparse file or a chunked file (false if
+  // it is corrupted). The memory-mappable file is mapped in
+  // read-only mode without any copy, so the model is loaded
+  // instantly and the processes share the same physical pages
   bool Deserialize(const std::string& filename);
 
+  // Map the memory-mappable model file in read-only mode.
+  // Return false without logging if it is not a complete
+  // memory-mappable file, so it can be used by the library
+  bool MapFile(const std::string& filename);
+
+  // The model is loaded from a sparse model file, and the i-th
+  // feature of this model is GetFeatureIds()[i] of the dense model
+  // with GetDenseNumFeature() features. The rows of the data should
+  // be renumbered (e.g., by a FeatureMap) before prediction
+  inline bool IsSparse() const { return !feature_ids_.empty(); }
+  inline const std::vector<index_t>& GetFeatureIds() const {
+    return feature_ids_;
+  }
+  inline index_t GetDenseNumFeature() const { return dense_num_feat_; }
+
+  // The weights are mapped from a memory-mappable file, and
+  // they cannot be changed. The model is also weights-only
+  inline bool IsMapped() const { return mmap_addr_ != nullptr; }
+
+  // The model only has the weights of w and v, and no gradient
+  // cache. In this case, w has num_feat weights, and each latent
+  // vector has aligned_k contiguous weights. It is loaded from a
+  // weights-only file and cannot be trained
+  inline bool IsWeightsOnly() const { return weights_only_; }
+
+  // w[GetLinearStride() * feat] is the weight of
+  // the linear term of feat
+  inline index_t GetLinearStride() const { return linear_stride_; }
+
   // Get the pointer of linear term
   inline real_t* GetParameter_w() { return param_w_; }
 
@@ -109,16 +729,143 @@ class Model {
   // Get the pointer of bias
   inline real_t* GetParameter_b() { return param_b_; }
 
+  // Convert the latent factor to "fp16", "bf16" or "int8" for inference,
+  // and release the fp32 latent factor. After that, the model
+  // cannot be trained or serialized. "fp32" does nothing
+  void ConvertLatent(const std::string& type);
+
+  // Get the storage type of latent factor
+  inline LatentType GetLatentType() const { return latent_type_; }
+
+  // Get the pointer of the 16-bit latent factor, which is
+  // nullptr if the latent factor is stored in fp32
+  inline const uint16* GetParameter_v_half() const {
+    return param_v_half_;
+  }
+
+  // Get the pointer of the int8 latent factor and the scale of
+  // each latent vector, where the weight is scale * int8. They
+  // are nullptr if the latent factor is not stored in int8
+  inline const int8* GetParameter_v_int8() const {
+    return param_v_int8_;
+  }
+  inline const real_t* GetParameter_v_scale() const {
+    return param_v_scale_;
+  }
+
   // Get the size of the linear term
   inline index_t GetNumParameter_w() { return param_num_w_; }
 
   // Get the size of the latent factor
   // For linear score this value equals zero
-  inline index_t GetNumParameter_v() { return param_num_v_; }
+  inline uint64 GetNumParameter_v() { return param_num_v_; }
 
   // Reset current model parameters
   void Reset() { set_value(); }
 
+  // Copy all the parameters and gradient caches (w, v and b)
+  // into the snapshot, which is restored by Restore(). This is
+  // used to keep the best model of early-stopping in memory
+  void Snapshot(std::vector<real_t>* snapshot) const;
+  void Restore(const std::vector<real_t>& snapshot);
+
+  // Make this model a weights-only copy of the model, which has
+  // no gradient cache and is about 1/2 size. The memory is reused
+  // by the next copy unless the model has grown. This is used to validate the model of an
+  // epoch in the background while the training goes on
+  void CopyWeights(const Model& model);
+
+  // Copy the weights of the weights-only copy back into this
+  // model. The gradient caches of this model are not changed
+  void RestoreWeights(const Model& copy);
+
+  // Warm-start this initialized model from the former model,
+  // which has the same score function, K and linear stride. The
+  // parameters and the gradient caches of the features and the
+  // fields of the former model are copied, and the new features
+  // and fields keep their initial value. So the model can grow.
+  // The former model can be weights-only, e.g., the checkpoint of
+  // the training, whose weights are copied and whose gradient
+  // caches are the initial ones of this model
+  void WarmStart(const Model& pre);
+
+  // Return true if this model can be initialized from the weights
+  // of the simpler model: a linear model for any model, an fm model
+  // for fm or ffm, or a model of the same score function, whose K is
+  // not larger than the K of this model
+  bool CanInitFrom(const Model& simple) const;
+
+  // Initialize this initialized model from the weights of the simpler
+  // model, which can be weights-only. The linear term and the bias are
+  // copied, and the fm vector of each feature is copied to its vector
+  // of every field of ffm, so the new model gives the same score. The
+  // first K weights of the latent vectors of a smaller K are copied,
+  // and the other weights, the new features and fields and all the
+  // gradient caches keep their initial value
+  void InitFrom(const Model& simple);
+
+  // Return the features to keep in serving, in ascending order.
+  // A feature is pruned if its |w| is less than w_threshold and
+  // every |v| of its latent vectors is less than v_threshold (if
+  // v_threshold > 0, otherwise only w is checked), or
+  // if the sum of the squared gradients of its linear weight is
+  // less than g_threshold, which is the proxy of the frequency
+  // of the feature in training (0 for the unseen features) and
+  // needs the gradient caches. Zero (or a negative) threshold
+  // disables its rule
+  void PruneFeatures(real_t w_threshold,
+                     real_t v_threshold,
+                     real_t g_threshold,
+                     std::vector<index_t>* kept) const;
+
+  // Make this model a weights-only copy of the kept features of
+  // the fp32 model, in which the i-th feature is kept[i] of the
+  // model. The bias and the fields are unchanged
+  void CompactFrom(const Model& model,
+                   const std::vector<index_t>& kept);
+
+  // The principal directions of all the latent vectors of the fp32
+  // model of fm or ffm, i.e., the eigenvectors of the K x K matrix
+  // sum( v * v^T ). The energy (the eigenvalues, whose sum is the
+  // sum of the squared latent weights) is in descending order, and
+  // the d-th weight of the i-th direction is basis[i * K + d]
+  void LatentBasis(std::vector<double>* energy,
+                   std::vector<double>* basis) const;
+
+  // Make this model a weights-only copy of the fp32 model of fm or
+  // ffm, whose latent vectors are projected onto the first rank
+  // directions of the basis of LatentBasis(), so its K is rank. The
+  // inner products of the latent vectors, which are the pairs of the
+  // score, lose the energy of the dropped directions only. The linear
+  // term, the bias and the fields are unchanged
+  void ReduceRankFrom(const Model& model,
+                      const std::vector<double>& basis,
+                      index_t rank);
+
+  // Release the parameters of this model (and the latent factor
+  // of ConvertLatent()), which is no longer used, e.g., the
+  // former model after WarmStart()
+  void Release();
+
+  // Make this model a replica of the model for one training
+  // thread. The replica has its own bias, and also its own linear
+  // term and latent factor if share_weights is false. The shared
+  // parameters are updated by all the threads (Hogwild). The
+  // private parameters are copied from the model
+  void InitReplica(Model& model, bool share_weights);
+
+  // Copy the private parameters of this replica from its model
+  void PullReplica();
+
+  // The model of this replica, or nullptr
+  inline const Model* GetReplicaOf() const { return replica_of_; }
+
+  // Merge the private parameters of the replicas into this
+  // model. The private bias of the replicas that share the
+  // weights is merged by adding the updates of all of them,
+  // and the whole replicas are averaged
+  void MergeReplicas(const std::vector<Model*>& replicas);
+
   // Get score function type
   inline std::string& GetScoreFunction() { return score_func_; }
 
@@ -135,18 +882,25 @@ class Model {
   inline index_t GetNumK() { return num_K_; }
 
   // Get the aligned size of K
-  inline index_t get_aligned_k() {
+  inline index_t get_aligned_k() const {
     return (index_t)ceil((real_t)num_K_/kAlign)*kAlign;
   }
 
   // Get the total size of model parameters
-  inline index_t GetNumParameter() {
-    return param_num_w_ + param_num_v_ + 2;
+  inline uint64 GetNumParameter() {
+    return (uint64)param_num_w_ + param_num_v_ + 2;
   }
 
+  // Bytes of the weights of w, v and b (in the storage type of
+  // the latent factor), and bytes of the gradient caches of the
+  // updater, which are 0 for the weights-only model. A replica
+  // that shares the weights only counts its own bias
+  uint64 WeightBytes() const;
+  uint64 StateBytes() const;
+
  protected:
   /* Score function: for now it could
-  be 'linear', 'fm', or 'ffm' */
+  be 'linear', 'fm', 'ffm' or 'hofm' */
   std::string  score_func_;
   /* Loss function: for now it could
   be 'squared', 'cross-entropy', 'hinge' */
@@ -156,19 +910,26 @@ class Model {
   and the gradient cache in param_w_, so
   param_num_w_ equals num_feat_ * 2 */
   index_t param_num_w_;
+  /* Number of floats of each linear weight, which is 2
+  for AdaGrad, 3 for FTRL and lazy AdaGrad, and 1 for the
+  weights-only model. param_num_w_ = num_feat_ * linear_stride_ */
+  index_t linear_stride_ = 2;
   /* Size of the latent factor. We store both the model
   parameter and the gradient cache for adagrad in param_v_
   For linear function, param_num_v = 0
   For fm, param_num_v_ = num_feat * num_K * 2
-  For ffm, param_num_v_ = num_feat * num_field * num_K * 2  */
-  index_t  param_num_v_;
+  For ffm, param_num_v_ = num_feat * num_field * the block size
+  of the layout (num_K * 2 for the fp32 caches), or num_feat *
+  the sum of 2 * K of the fields of SetFieldK(), which
+  can exceed 32 bits for the large FFM models */
+  uint64 param_num_v_;
   /* Number of feature
   (feature id is start from 0) */
   index_t  num_feat_;
   /* Number of field
   (used in ffm, field id is start from 0) */
   index_t  num_field_;
-  /* Number of K (used in fm and ffm)
+  /* Number of K (used in fm, ffm and hofm)
   Becasue we use SSE, so the real k should be aligned
   User can get the aligned K by using get_aligned_k() */
   index_t  num_K_;
@@ -180,17 +941,159 @@ class Model {
   real_t*  param_b_;
   /* Used for init model parameters */
   real_t scale_;
+  /* Storage type of the latent factor */
+  LatentType latent_type_ = kLatentFP32;
+  /* Storing the weights of latent factor in 16 bits
+  when latent_type_ is kLatentFP16 or kLatentBF16 */
+  uint16* param_v_half_ = nullptr;
+  /* True if w and v have no gradient cache */
+  bool weights_only_ = false;
+  /* Storing the weights of latent factor in int8, and
+  the scale of each latent vector, when latent_type_
+  is kLatentINT8 */
+  int8* param_v_int8_ = nullptr;
+  real_t* param_v_scale_ = nullptr;
+  /* The model of this replica, and the replica shares
+  w and v with it if share_weights_ is true */
+  Model* replica_of_ = nullptr;
+  bool share_weights_ = false;
+  /* True for the copy of CopyWeights(), which
+  owns its memory */
+  bool weights_copy_ = false;
+  /* The ids of the features of the sparse model in the dense
+  model, and the number of features of the dense model */
+  std::vector<index_t> feature_ids_;
+  index_t dense_num_feat_ = 0;
+  /* The memory-mappable model file mapped by Deserialize() */
+  char* mmap_addr_ = nullptr;
+  uint64 mmap_size_ = 0;
+  /* The parameters are in the memory of InitShared() */
+  bool shared_ = false;
+  /* The file of InitFile() */
+  char* file_addr_ = nullptr;
+  uint64 file_size_ = 0;
+  /* The NUMA placement of the pages of w and v */
+  std::string numa_policy_ = "none";
+  /* The huge pages of the latent factor, and the policy
+  that is used by the memory of param_v_ */
+  std::string huge_policy_ = "none";
+  std::string huge_used_ = "none";
+  /* The seed of the random latent factor */
+  uint64 init_seed_ = 2018;
+  /* The layout of the FFM latent blocks */
+  LatentLayout latent_layout_ = kLayoutInterleaved;
+  /* The shards of the feature ranges, each of which has
+  shard_feat_ features (except the last one) */
+  int num_shards_ = 1;
+  std::vector<ModelShard> shards_;
+  index_t shard_feat_ = 0;
+  /* The index of the sparse latent factor of FFM, in which
+  param_v_ has the blocks of its slots */
+  std::shared_ptr<const LatentPairs> latent_pairs_;
+  /* The K of the latent vectors of each field of FFM, which is
+  aligned by set_structure(), and the offsets of their blocks in
+  the blocks of a feature (empty for the same K) */
+  std::vector<index_t> field_k_;
+  std::vector<index_t> field_offset_;
+  /* The capacity of SetCapacity() in features, the features of
+  the committed segments (0 if the model is not growable), and
+  the floats of the latent factor of each feature */
+  index_t capacity_ = 0;
+  index_t committed_feat_ = 0;
+  uint64 grow_v_feat_ = 0;
+  /* The flags of the updated features of TrackDirtyFeatures(),
+  which are shared by the replicas */
+  std::shared_ptr<std::vector<uint8>> dirty_;
+  /* The update stamps of TrackUpdateTime(), which are shared
+  by the replicas */
+  std::shared_ptr<FeatureStamps> stamps_;
+
+  // Set the structure of the model and the
+  // number of parameters of w and v
+  void set_structure(const std::string& score_func,
+                     const std::string& loss_func,
+                     index_t num_feature,
+                     index_t num_field,
+                     index_t num_K,
+                     real_t scale,
+                     index_t linear_stride);
 
   // Initialize the value of model parameters
   // and gradient cache
   void initial(bool set_value = false);
 
-  // Reset the value of current model parameters
+  // Allocate w and v by the shards of num_shards_, and
+  // release them (b is not in the shards)
+  void alloc_shards();
+  void release_shards();
+
+  // Reserve w and v for capacity_ features, commit the segments
+  // of the first num_feature features, and release them
+  void alloc_growable();
+  void commit_segments(index_t num_feature);
+  void release_growable();
+
+  // Reset the value of current model parameters, which
+  // are set by the threads in parallel for a large model
   void set_value();
 
+  // Set the linear term of the features [feat_begin, feat_end)
+  // and the latent vectors [vec_begin, vec_end)
+  void set_range(index_t feat_begin, index_t feat_end,
+                 uint64 vec_begin, uint64 vec_end);
+
+  // Serialize the model to disk file
+  void serialize(FILE* file, bool weights_only);
+
   // Serialize w, v, b to disk file
   void serialize_w_v_b(FILE* file);
 
+  // Serialize the weights of w, v and b to disk file
+  void serialize_weights(FILE* file);
+
+  // Serialize the sparse latent factor or the blocks of the split
+  // layout in the interleaved layout of the dense model
+  void serialize_latent_blocks(FILE* file);
+
+  // The blocks of feat in the interleaved layout of the dense
+  // model, which are num_field * 2 * aligned_k floats
+  void dense_latent_blocks(index_t feat, real_t* buf) const;
+
+  // Load the model from the chunked model file, and return
+  // false if any chunk does not match its checksum
+  bool deserialize_chunked(const std::string& filename);
+
+  // The layout of the blocks, which is the split one for FM
+  // and HOFM
+  LatentLayout block_layout() const;
+
+  // Number of the latent vectors of a feature, which is 1 for
+  // FM, 2 for HOFM (order 2 and order 3) and num_field for FFM
+  index_t vec_per_feature() const;
+
+  // Number of latent vectors, which is the number of the
+  // dense model for the sparse latent factor
+  uint64 num_latent_vec() const;
+
+  // The block of the i-th latent vector of the dense model
+  // with the gradient caches, or nullptr if it is not in
+  // the sparse latent factor
+  real_t* latent_block(uint64 i) const;
+
+  // The aligned K of the i-th latent vector, which is the
+  // one of its field for the model of SetFieldK()
+  index_t latent_k(uint64 i) const;
+
+  // Copy the aligned_k weights of the i-th latent vector to vec,
+  // which are zero if it is not in the sparse latent factor
+  // or beyond the K of its field
+  void latent_weights(uint64 i, real_t* vec) const;
+
+  // Copy vec to the weights of the i-th latent vector, which is
+  // skipped if it is not in the sparse latent factor, and the
+  // weights beyond the K of its field are dropped
+  void set_latent_weights(uint64 i, const real_t* vec);
+
   // Deserialize w, v, b from disk file
   void deserialize_w_v_b(FILE* file);
 
@@ -22,9 +22,12 @@ This file tests model_parameters.h
 
 #include "gtest/gtest.h"
 
+#include <cmath>
 #include <string>
 #include <vector>
 
+#include "src/base/file_util.h"
+#include "src/base/huge_page.h"
 #include "src/data/model_parameters.h"
 #include "src/data/hyper_parameters.h"
 
@@ -128,6 +131,195 @@ TEST(MODEL_TEST, Init_lr) {
   EXPECT_EQ(v, nullptr);
 }
 
+// The latent vector of each feature only depends on the seed, so
+// the large model (by several threads) starts with the small one
+TEST(MODEL_TEST, Init_parallel) {
+  const index_t kSmall = 10;
+  const index_t kLarge = 1 << 18;
+  const char* score_funcs[] = { "fm", "ffm" };
+  for (int s = 0; s < 2; ++s) {
+    Model small, large, other;
+    small.Initialize(score_funcs[s], "squared", kSmall, 2, 4);
+    large.Initialize(score_funcs[s], "squared", kLarge, 2, 4);
+    other.SetSeed(7);
+    other.Initialize(score_funcs[s], "squared", kSmall, 2, 4);
+    index_t num_diff = 0;
+    for (index_t i = 0; i < small.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(small.GetParameter_v()[i],
+                      large.GetParameter_v()[i]);
+      num_diff += small.GetParameter_v()[i] != other.GetParameter_v()[i];
+    }
+    EXPECT_GT(num_diff, 0);
+    // The weights are in [0, 1 / sqrt(K)) and the caches are 1.0
+    real_t* v = large.GetParameter_v();
+    for (index_t i = 0; i < large.GetNumParameter_v(); i += 2 * kAlign) {
+      for (index_t d = 0; d < kAlign; ++d) {
+        ASSERT_GE(v[i+d], 0);
+        ASSERT_LT(v[i+d], 0.5);
+        ASSERT_FLOAT_EQ(v[i+kAlign+d], 1.0);
+      }
+    }
+    real_t* w = large.GetParameter_w();
+    for (index_t i = 0; i < large.GetNumParameter_w(); i += 2) {
+      ASSERT_FLOAT_EQ(w[i], 0);
+      ASSERT_FLOAT_EQ(w[i+1], 1.0);
+    }
+    small.Release();
+    large.Release();
+    other.Release();
+  }
+}
+
+// The placed model has the same values at the page boundary
+TEST(MODEL_TEST, Init_numa) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  const char* policies[] = { "interleave", "partition" };
+  for (int p = 0; p < 2; ++p) {
+    Model placed;
+    placed.SetNumaPolicy(policies[p]);
+    placed.Initialize(hyper_param.score_func,
+                      hyper_param.loss_func,
+                      hyper_param.num_feature,
+                      hyper_param.num_field,
+                      hyper_param.num_K);
+    EXPECT_EQ((uint64)placed.GetParameter_w() % 4096, 0);
+    EXPECT_EQ((uint64)placed.GetParameter_v() % 4096, 0);
+    ASSERT_EQ(placed.GetNumParameter_v(), model.GetNumParameter_v());
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(placed.GetParameter_w()[i], model.GetParameter_w()[i]);
+    }
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(placed.GetParameter_v()[i], model.GetParameter_v()[i]);
+    }
+    placed.Release();
+  }
+  model.Release();
+}
+
+// The latent factor of the huge pages (or the fallback) has
+// the same values, and it is freed by Release()
+TEST(MODEL_TEST, Init_huge_pages) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  EXPECT_EQ(model.HugePages(), "none");
+  const char* policies[] = { "thp", "explicit" };
+  for (int p = 0; p < 2; ++p) {
+    Model huge;
+    huge.SetHugePages(policies[p]);
+    huge.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K);
+    if (huge.HugePages() != "none") {
+      EXPECT_EQ((uint64)huge.GetParameter_v() % kHugePageSize, 0);
+    }
+    ASSERT_EQ(huge.GetNumParameter_v(), model.GetNumParameter_v());
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(huge.GetParameter_v()[i], model.GetParameter_v()[i]);
+    }
+    huge.Release();
+    EXPECT_EQ(huge.HugePages(), "none");
+  }
+  model.Release();
+}
+
+// The model in the file has the same values, and the file
+// is removed once it is mapped
+TEST(MODEL_TEST, Init_file) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  EXPECT_FALSE(model.IsFileBacked());
+  std::string filename = "/tmp/xlearn_test_param";
+  {
+    Model mapped;
+    ASSERT_TRUE(mapped.InitFile(hyper_param.score_func,
+                                hyper_param.loss_func,
+                                hyper_param.num_feature,
+                                hyper_param.num_field,
+                                hyper_param.num_K,
+                                1.0, 2, filename));
+    EXPECT_TRUE(mapped.IsFileBacked());
+    EXPECT_FALSE(FileExist(filename.c_str()));
+    ASSERT_EQ(mapped.GetNumParameter_v(), model.GetNumParameter_v());
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(mapped.GetParameter_w()[i], model.GetParameter_w()[i]);
+    }
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(mapped.GetParameter_v()[i], model.GetParameter_v()[i]);
+    }
+    // The pages are touched by the initialization
+    std::vector<real_t> fractions;
+    mapped.ResidentFractions(2, &fractions);
+    ASSERT_EQ(fractions.size(), 2);
+    EXPECT_GT(fractions[0] + fractions[1], 0);
+  }
+  Model other;
+  EXPECT_FALSE(other.InitFile(hyper_param.score_func,
+                              hyper_param.loss_func,
+                              hyper_param.num_feature,
+                              hyper_param.num_field,
+                              hyper_param.num_K,
+                              1.0, 2, "/no_such_dir/param"));
+  model.Release();
+}
+
+// The shards start at the page boundary and cover the features,
+// and the sharded model has the same values
+TEST(MODEL_TEST, Init_shards) {
+  const index_t kFeat = 5000;
+  const char* score_funcs[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model, sharded;
+    model.Initialize(score_funcs[f], "squared", kFeat, 3, 4, 1.0, 3);
+    EXPECT_EQ(model.GetNumShards(), 1);
+    sharded.SetShards(4);
+    sharded.Initialize(score_funcs[f], "squared", kFeat, 3, 4, 1.0, 3);
+    ASSERT_GT(sharded.GetNumShards(), 1);
+    ASSERT_LE(sharded.GetNumShards(), 4);
+    index_t next = 0;
+    for (int s = 0; s < sharded.GetNumShards(); ++s) {
+      ModelShard shard = sharded.GetShard(s);
+      EXPECT_EQ(shard.first_feat, next);
+      EXPECT_EQ(sharded.ShardOf(shard.first_feat), s);
+      EXPECT_EQ(sharded.ShardOf(shard.first_feat + shard.num_feat - 1), s);
+      EXPECT_EQ((uint64)shard.w % 4096, 0);
+      EXPECT_EQ(shard.w, sharded.GetParameter_w() + next * 3);
+      if (shard.v != nullptr) {
+        EXPECT_EQ((uint64)shard.v % 4096, 0);
+      }
+      next += shard.num_feat;
+    }
+    EXPECT_EQ(next, kFeat);
+    ASSERT_EQ(sharded.GetNumParameter_v(), model.GetNumParameter_v());
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      ASSERT_FLOAT_EQ(sharded.GetParameter_w()[i], model.GetParameter_w()[i]);
+    }
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      ASSERT_FLOAT_EQ(sharded.GetParameter_v()[i], model.GetParameter_v()[i]);
+    }
+    sharded.Release();
+    EXPECT_EQ(sharded.GetNumShards(), 1);
+    model.Release();
+  }
+}
+
 TEST(MODEL_TEST, Save_and_Load) {
   // Init model (set all parameters to zero)
   HyperParam hyper_param = Init();
@@ -177,4 +369,1134 @@ TEST(MODEL_TEST, Save_and_Load) {
   RemoveFile(hyper_param.model_file.c_str());
 }
 
+TEST(MODEL_TEST, Save_weights_only) {
+  HyperParam hyper_param = Init();
+  const char* score_func[] = { "ffm", "fm" };
+  for (int t = 0; t < 2; ++t) {
+    Model model;
+    model.Initialize(score_func[t],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    real_t* w = model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = i;
+    }
+    real_t* v = model.GetParameter_v();
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      v[i] = i;
+    }
+    model.Serialize(hyper_param.model_file, true);
+    Model new_model(hyper_param.model_file);
+    EXPECT_TRUE(new_model.IsWeightsOnly());
+    EXPECT_EQ(new_model.GetNumParameter_w(), hyper_param.num_feature);
+    EXPECT_EQ(new_model.GetNumParameter_v() * 2,
+              model.GetNumParameter_v());
+    EXPECT_EQ(hyper_param.num_K, new_model.GetNumK());
+    EXPECT_EQ(hyper_param.num_field, new_model.GetNumField());
+    real_t* new_w = new_model.GetParameter_w();
+    for (index_t i = 0; i < new_model.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(new_w[i], w[i*2]);
+    }
+    // In FFM, the weights are interleaved with the caches, and
+    // in FM the aligned_k weights of a feature are contiguous
+    index_t aligned_k = model.get_aligned_k();
+    real_t* new_v = new_model.GetParameter_v();
+    for (index_t i = 0; i < new_model.GetNumParameter_v(); ++i) {
+      index_t vec = i / aligned_k, d = i % aligned_k;
+      index_t j = t == 0 ? (d / kAlign) * 2 * kAlign + d % kAlign : d;
+      EXPECT_FLOAT_EQ(new_v[i], v[vec * 2 * aligned_k + j]);
+    }
+    // The weights-only model can be saved again
+    new_model.Serialize(hyper_param.model_file, true);
+    Model model_again(hyper_param.model_file);
+    EXPECT_TRUE(model_again.IsWeightsOnly());
+    EXPECT_FLOAT_EQ(model_again.GetParameter_v()[aligned_k + 1],
+                    new_v[aligned_k + 1]);
+    RemoveFile(hyper_param.model_file.c_str());
+  }
+}
+
+TEST(MODEL_TEST, Save_mapped) {
+  HyperParam hyper_param = Init();
+  std::string weights_file = hyper_param.model_file + ".weights";
+  const char* score_func[] = { "ffm", "fm", "linear" };
+  for (int t = 0; t < 3; ++t) {
+    Model model;
+    model.Initialize(score_func[t],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    real_t* w = model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = i;
+    }
+    real_t* v = model.GetParameter_v();
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      v[i] = i;
+    }
+    model.GetParameter_b()[0] = 2.5;
+    model.SerializeMapped(hyper_param.model_file);
+    model.Serialize(weights_file, true);
+    Model mapped_model(hyper_param.model_file);
+    Model weights_model(weights_file);
+    EXPECT_TRUE(mapped_model.IsMapped());
+    EXPECT_TRUE(mapped_model.IsWeightsOnly());
+    EXPECT_FALSE(weights_model.IsMapped());
+    EXPECT_EQ(mapped_model.GetScoreFunction(), score_func[t]);
+    EXPECT_EQ(mapped_model.GetNumK(), hyper_param.num_K);
+    EXPECT_EQ(mapped_model.GetNumField(), hyper_param.num_field);
+    EXPECT_FLOAT_EQ(mapped_model.GetParameter_b()[0], 2.5);
+    // The sections are aligned in the mapped file
+    EXPECT_EQ((uint64)mapped_model.GetParameter_w() % (kAlign * sizeof(real_t)), 0);
+    // The same weights as the weights-only model
+    ASSERT_EQ(mapped_model.GetNumParameter_w(),
+              weights_model.GetNumParameter_w());
+    for (index_t i = 0; i < mapped_model.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(mapped_model.GetParameter_w()[i],
+                      weights_model.GetParameter_w()[i]);
+    }
+    if (t < 2) {
+      EXPECT_EQ((uint64)mapped_model.GetParameter_v() % (kAlign * sizeof(real_t)), 0);
+      ASSERT_EQ(mapped_model.GetNumParameter_v(),
+                weights_model.GetNumParameter_v());
+      for (index_t i = 0; i < mapped_model.GetNumParameter_v(); ++i) {
+        EXPECT_FLOAT_EQ(mapped_model.GetParameter_v()[i],
+                        weights_model.GetParameter_v()[i]);
+      }
+    }
+    RemoveFile(hyper_param.model_file.c_str());
+    RemoveFile(weights_file.c_str());
+  }
+}
+
+TEST(MODEL_TEST, Warm_start) {
+  HyperParam hyper_param = Init();
+  Model pre_model;
+  pre_model.Initialize(hyper_param.score_func,
+                       hyper_param.loss_func,
+                       hyper_param.num_feature,
+                       hyper_param.num_field,
+                       hyper_param.num_K);
+  real_t* pre_w = pre_model.GetParameter_w();
+  for (index_t i = 0; i < pre_model.GetNumParameter_w(); ++i) {
+    pre_w[i] = 100 + i;
+  }
+  real_t* pre_v = pre_model.GetParameter_v();
+  for (index_t i = 0; i < pre_model.GetNumParameter_v(); ++i) {
+    pre_v[i] = 100 + i;
+  }
+  pre_model.GetParameter_b()[0] = 2.5;
+  // The new model has more features and fields
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature + 5,
+                   hyper_param.num_field + 2,
+                   hyper_param.num_K);
+  model.WarmStart(pre_model);
+  EXPECT_FLOAT_EQ(model.GetParameter_b()[0], 2.5);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(w[i], i < pre_model.GetNumParameter_w() ?
+                          pre_w[i] : (i % 2 == 0 ? 0 : 1));
+  }
+  index_t block = model.get_aligned_k() * 2;
+  index_t num_field = hyper_param.num_field + 2;
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < hyper_param.num_feature + 5; ++i) {
+    for (index_t f = 0; f < num_field; ++f) {
+      real_t* vec = v + (i * num_field + f) * block;
+      if (i < hyper_param.num_feature && f < hyper_param.num_field) {
+        real_t* pre_vec = pre_v + (i * hyper_param.num_field + f) * block;
+        for (index_t d = 0; d < block; ++d) {
+          EXPECT_FLOAT_EQ(vec[d], pre_vec[d]);
+        }
+      } else {
+        // The new ones keep the initial value, which is small
+        EXPECT_LT(vec[0], 1.0);
+      }
+    }
+  }
+  pre_model.Release();
+  EXPECT_EQ(pre_model.GetParameter_w(), nullptr);
+}
+
+// The training resumes from the weights-only checkpoint, whose
+// weights are copied, and the caches are the initial ones
+TEST(MODEL_TEST, Resume_checkpoint) {
+  HyperParam hyper_param = Init();
+  std::string score[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model;
+    model.Initialize(score[f],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    // The trained weights and caches
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      model.GetParameter_w()[i] = 100 + i;
+    }
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      model.GetParameter_v()[i] = 100 + i;
+    }
+    model.GetParameter_b()[0] = 2.5;
+    model.GetParameter_b()[1] = 7.5;
+    // The checkpoint of the trainer
+    Model ckpt;
+    ckpt.CopyWeights(model);
+    ckpt.Serialize(hyper_param.model_file, true);
+    Model pre_model(hyper_param.model_file);
+    EXPECT_TRUE(pre_model.IsWeightsOnly());
+    // The resumed model has more features
+    Model resumed;
+    resumed.Initialize(score[f],
+                       hyper_param.loss_func,
+                       hyper_param.num_feature + 3,
+                       hyper_param.num_field,
+                       hyper_param.num_K);
+    resumed.WarmStart(pre_model);
+    pre_model.Release();
+    Model weights;
+    weights.CopyWeights(resumed);
+    for (index_t i = 0; i < hyper_param.num_feature; ++i) {
+      EXPECT_FLOAT_EQ(weights.GetParameter_w()[i],
+                      ckpt.GetParameter_w()[i]);
+    }
+    EXPECT_FLOAT_EQ(weights.GetParameter_b()[0], 2.5);
+    // The vectors of the new features are after the former ones
+    for (index_t i = 0; i < ckpt.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(weights.GetParameter_v()[i],
+                      ckpt.GetParameter_v()[i]);
+    }
+    // The caches are the ones of a new model of the same weights
+    Model fresh;
+    fresh.Initialize(score[f],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature + 3,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    fresh.RestoreWeights(weights);
+    std::vector<real_t> resumed_all, fresh_all;
+    resumed.Snapshot(&resumed_all);
+    fresh.Snapshot(&fresh_all);
+    ASSERT_EQ(resumed_all.size(), fresh_all.size());
+    for (size_t i = 0; i < resumed_all.size(); ++i) {
+      EXPECT_FLOAT_EQ(resumed_all[i], fresh_all[i]);
+    }
+    EXPECT_NE(resumed.GetParameter_b()[1], 7.5);
+    RemoveFile(hyper_param.model_file.c_str());
+  }
+}
+
+// The split blocks have the values of the interleaved blocks
+// at their positions, and the model file is interleaved
+TEST(MODEL_TEST, Latent_layout) {
+  HyperParam hyper_param = Init();
+  hyper_param.num_K = 6;
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  real_t* v = model.GetParameter_v();
+  index_t num_v = model.GetNumParameter_v();
+  for (index_t i = 0; i < num_v; ++i) { v[i] = i; }
+  std::vector<real_t> interleaved(v, v + num_v);
+  model.Serialize(hyper_param.model_file);
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(hyper_param.model_file, &buf);
+  std::string expect_file(buf, size);
+  delete [] buf;
+  Model split;
+  split.SetLatentLayout(kLayoutSplit);
+  split.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  EXPECT_EQ(split.GetLatentLayout(), kLayoutSplit);
+  index_t aligned_k = split.get_aligned_k();
+  real_t* sv = split.GetParameter_v();
+  for (index_t b = 0; b < num_v; b += 2 * aligned_k) {
+    for (index_t d = 0; d < aligned_k; ++d) {
+      sv[b + LatentWeightPos(kLayoutSplit, d, aligned_k)] =
+        interleaved[b + LatentWeightPos(kLayoutInterleaved, d, aligned_k)];
+      sv[b + LatentCachePos(kLayoutSplit, d, aligned_k)] =
+        interleaved[b + LatentCachePos(kLayoutInterleaved, d, aligned_k)];
+    }
+  }
+  split.Serialize(hyper_param.model_file);
+  size = ReadFileToMemory(hyper_param.model_file, &buf);
+  EXPECT_TRUE(std::string(buf, size) == expect_file);
+  delete [] buf;
+  Model loaded(hyper_param.model_file);
+  EXPECT_EQ(loaded.GetLatentLayout(), kLayoutInterleaved);
+  // The blocks are converted in place and back
+  split.SetLatentLayout(kLayoutInterleaved);
+  for (index_t i = 0; i < num_v; ++i) {
+    EXPECT_FLOAT_EQ(sv[i], interleaved[i]);
+  }
+  model.SetLatentLayout(kLayoutSplit);
+  model.SetLatentLayout(kLayoutInterleaved);
+  for (index_t i = 0; i < num_v; ++i) {
+    EXPECT_FLOAT_EQ(v[i], interleaved[i]);
+  }
+  LatentLayout layout;
+  EXPECT_TRUE(ParseLatentLayout("split", &layout));
+  EXPECT_EQ(layout, kLayoutSplit);
+  EXPECT_STREQ(LatentLayoutName(layout), "split");
+  EXPECT_FALSE(ParseLatentLayout("field-major", &layout));
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The codes of the reduced caches are within the precision
+// of the code, and the model file is the one of the fp32 caches
+TEST(MODEL_TEST, Reduced_caches) {
+  for (real_t c = 1.0; c < 1e4; c *= 1.37) {
+    EXPECT_NEAR(DecodeLatentCache<kLayoutSplitFP16>(
+      EncodeLatentCache<kLayoutSplitFP16>(c)), c, c / 2048);
+    EXPECT_NEAR(DecodeLatentCache<kLayoutSplitBF16>(
+      EncodeLatentCache<kLayoutSplitBF16>(c)), c, c / 256);
+    EXPECT_NEAR(DecodeLatentCache<kLayoutSplitLog8>(
+      EncodeLatentCache<kLayoutSplitLog8>(c)), c, c / 32);
+  }
+  // The caches start at 1, and the large ones are clamped
+  EXPECT_FLOAT_EQ(DecodeLatentCache<kLayoutSplitLog8>(
+    EncodeLatentCache<kLayoutSplitLog8>(0.1)), 1.0);
+  EXPECT_GT(DecodeLatentCache<kLayoutSplitFP16>(
+    EncodeLatentCache<kLayoutSplitFP16>(1e30)), 6e4);
+  HyperParam hyper_param = Init();
+  hyper_param.num_K = 6;
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  index_t aligned_k = model.get_aligned_k();
+  uint64 num_block = model.GetNumParameter_v() / (2 * aligned_k);
+  real_t* v = model.GetParameter_v();
+  // The caches are powers of two, which all the codes keep
+  for (uint64 b = 0; b < num_block; ++b) {
+    for (index_t d = 0; d < aligned_k; ++d) {
+      v[b * 2 * aligned_k + LatentWeightPos(kLayoutInterleaved, d,
+                                            aligned_k)] = b + d * 0.01;
+      v[b * 2 * aligned_k + LatentCachePos(kLayoutInterleaved, d,
+                                           aligned_k)] = 1 << (d % 8);
+    }
+  }
+  model.Serialize(hyper_param.model_file);
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(hyper_param.model_file, &buf);
+  std::string expect_file(buf, size);
+  delete [] buf;
+  const LatentLayout layouts[] = { kLayoutSplitFP16, kLayoutSplitBF16,
+                                   kLayoutSplitLog8 };
+  for (int l = 0; l < 3; ++l) {
+    Model coded;
+    coded.SetLatentLayout(layouts[l]);
+    coded.Initialize(hyper_param.score_func,
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    EXPECT_EQ(coded.GetLatentLayout(), layouts[l]);
+    EXPECT_EQ(coded.get_aligned_k(), aligned_k);
+    index_t align0 = LatentBlockSize(layouts[l], aligned_k);
+    EXPECT_LT(align0, 2 * aligned_k);
+    EXPECT_EQ(coded.GetNumParameter_v(), num_block * align0);
+    real_t* cv = coded.GetParameter_v();
+    for (uint64 b = 0; b < num_block; ++b) {
+      for (index_t d = 0; d < aligned_k; ++d) {
+        EXPECT_FLOAT_EQ(GetLatentCache(layouts[l], cv + b * align0,
+                                       d, aligned_k), 1.0);
+      }
+    }
+    // The warm start converts the blocks of the fp32 caches
+    coded.WarmStart(model);
+    coded.Serialize(hyper_param.model_file);
+    size = ReadFileToMemory(hyper_param.model_file, &buf);
+    EXPECT_TRUE(std::string(buf, size) == expect_file)
+      << LatentLayoutName(layouts[l]);
+    delete [] buf;
+    LatentLayout layout;
+    EXPECT_TRUE(ParseLatentLayout(LatentLayoutName(layouts[l]), &layout));
+    EXPECT_EQ(layout, layouts[l]);
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The shared layout has one cache per block, which is the
+// mean of the caches of the warm-start model
+TEST(MODEL_TEST, Shared_cache) {
+  HyperParam hyper_param = Init();
+  Model pre_model;
+  pre_model.Initialize(hyper_param.score_func,
+                       hyper_param.loss_func,
+                       hyper_param.num_feature,
+                       hyper_param.num_field,
+                       hyper_param.num_K);
+  index_t aligned_k = pre_model.get_aligned_k();
+  uint64 num_block = pre_model.GetNumParameter_v() / (2 * aligned_k);
+  real_t* pre_v = pre_model.GetParameter_v();
+  for (uint64 b = 0; b < num_block; ++b) {
+    for (index_t d = 0; d < aligned_k; ++d) {
+      pre_v[b * 2 * aligned_k + LatentCachePos(kLayoutInterleaved, d,
+                                               aligned_k)] = d + 1;
+    }
+  }
+  Model model;
+  model.SetLatentLayout(kLayoutSplitShared);
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  index_t align0 = aligned_k + kAlign;
+  EXPECT_EQ(model.GetNumParameter_v(), num_block * align0);
+  real_t* v = model.GetParameter_v();
+  for (uint64 b = 0; b < num_block; ++b) {
+    EXPECT_FLOAT_EQ(v[b * align0 + aligned_k], 1.0);
+    EXPECT_FLOAT_EQ(v[b * align0 + aligned_k + 1], 0);
+  }
+  model.WarmStart(pre_model);
+  real_t mean = (aligned_k + 1) / 2.0;
+  for (uint64 b = 0; b < num_block; ++b) {
+    for (index_t d = 0; d < aligned_k; ++d) {
+      EXPECT_FLOAT_EQ(v[b * align0 + d], pre_v[b * 2 * aligned_k +
+        LatentWeightPos(kLayoutInterleaved, d, aligned_k)]);
+      EXPECT_FLOAT_EQ(GetLatentCache(kLayoutSplitShared, v + b * align0,
+                                     d, aligned_k), mean);
+    }
+  }
+  // The model file has the shared cache for each weight
+  model.Serialize(hyper_param.model_file);
+  Model loaded(hyper_param.model_file);
+  const real_t* lv = loaded.GetParameter_v();
+  for (uint64 b = 0; b < num_block; ++b) {
+    for (index_t d = 0; d < aligned_k; ++d) {
+      EXPECT_FLOAT_EQ(lv[b * 2 * aligned_k + LatentCachePos(
+        kLayoutInterleaved, d, aligned_k)], mean);
+    }
+  }
+  EXPECT_STREQ(LatentLayoutName(kLayoutSplitShared), "split-shared");
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The chunked file loads the same model as the old file,
+// and the corrupted chunk is detected
+TEST(MODEL_TEST, Save_chunked) {
+  HyperParam hyper_param = Init();
+  std::string old_file = hyper_param.model_file + ".old";
+  const char* score_func[] = { "ffm", "ffm", "fm", "hofm", "linear" };
+  for (int t = 0; t < 10; ++t) {
+    bool weights_only = t % 2 == 1;
+    Model model;
+    if (t / 2 == 1) { model.SetLatentLayout(kLayoutSplit); }
+    model.Initialize(score_func[t / 2],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    real_t* w = model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = i;
+    }
+    model.GetParameter_b()[0] = 2.5;
+    // Chunks of a few features
+    model.SerializeChunked(hyper_param.model_file, weights_only, 1000);
+    model.Serialize(old_file, weights_only);
+    Model chunked_model(hyper_param.model_file);
+    Model old_model(old_file);
+    EXPECT_EQ(chunked_model.IsWeightsOnly(), weights_only);
+    EXPECT_EQ(chunked_model.GetScoreFunction(), score_func[t / 2]);
+    EXPECT_EQ(chunked_model.GetNumField(), hyper_param.num_field);
+    EXPECT_FLOAT_EQ(chunked_model.GetParameter_b()[0], 2.5);
+    ASSERT_EQ(chunked_model.GetNumParameter_w(),
+              old_model.GetNumParameter_w());
+    for (index_t i = 0; i < old_model.GetNumParameter_w(); ++i) {
+      EXPECT_EQ(chunked_model.GetParameter_w()[i],
+                old_model.GetParameter_w()[i]);
+    }
+    ASSERT_EQ(chunked_model.GetNumParameter_v(),
+              old_model.GetNumParameter_v());
+    for (index_t i = 0; i < old_model.GetNumParameter_v(); ++i) {
+      EXPECT_EQ(chunked_model.GetParameter_v()[i],
+                old_model.GetParameter_v()[i]);
+    }
+  }
+  // Flip one bit of the last chunk or of the header
+  Model model;
+  model.Initialize("ffm", hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  for (int k = 0; k < 2; ++k) {
+    model.SerializeChunked(hyper_param.model_file, false, 1000);
+    FILE* file = OpenFileOrDie(hyper_param.model_file.c_str(), "r+");
+    uint64 pos = k == 0 ? GetFileSize(file) - 10 : 100;
+    fseek(file, pos, SEEK_SET);
+    char c = 0;
+    ReadDataFromDisk(file, &c, 1);
+    c ^= 4;
+    fseek(file, pos, SEEK_SET);
+    WriteDataToDisk(file, &c, 1);
+    Close(file);
+    Model corrupted;
+    EXPECT_FALSE(corrupted.Deserialize(hyper_param.model_file));
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+  RemoveFile(old_file.c_str());
+}
+
+TEST(MODEL_TEST, Replica) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  model.GetParameter_b()[0] = 1.0;
+  // The replicas of private bias share w and v
+  Model r1, r2;
+  r1.InitReplica(model, true);
+  r2.InitReplica(model, true);
+  EXPECT_EQ(r1.GetReplicaOf(), &model);
+  EXPECT_EQ(r1.GetParameter_w(), model.GetParameter_w());
+  EXPECT_EQ(r1.GetParameter_v(), model.GetParameter_v());
+  EXPECT_NE(r1.GetParameter_b(), model.GetParameter_b());
+  EXPECT_FLOAT_EQ(r1.GetParameter_b()[0], 1.0);
+  // The updates of the bias are added
+  r1.GetParameter_b()[0] = 1.5;
+  r2.GetParameter_b()[0] = 0.75;
+  std::vector<Model*> replicas;
+  replicas.push_back(&r1);
+  replicas.push_back(&r2);
+  model.MergeReplicas(replicas);
+  EXPECT_FLOAT_EQ(model.GetParameter_b()[0], 1.25);
+  r1.PullReplica();
+  EXPECT_FLOAT_EQ(r1.GetParameter_b()[0], 1.25);
+  // The whole replicas are averaged
+  Model r3, r4;
+  r3.InitReplica(model, false);
+  r4.InitReplica(model, false);
+  EXPECT_NE(r3.GetParameter_w(), model.GetParameter_w());
+  EXPECT_EQ(r3.GetNumParameter_v(), model.GetNumParameter_v());
+  EXPECT_FLOAT_EQ(r3.GetParameter_v()[5], model.GetParameter_v()[5]);
+  r3.GetParameter_w()[0] = 2.0;
+  r4.GetParameter_w()[0] = 4.0;
+  r3.GetParameter_v()[5] = 1.0;
+  r4.GetParameter_v()[5] = 0.0;
+  replicas.clear();
+  replicas.push_back(&r3);
+  replicas.push_back(&r4);
+  model.MergeReplicas(replicas);
+  EXPECT_FLOAT_EQ(model.GetParameter_w()[0], 3.0);
+  EXPECT_FLOAT_EQ(model.GetParameter_v()[5], 0.5);
+  EXPECT_FLOAT_EQ(model.GetParameter_b()[0], 1.25);
+}
+
+TEST(MODEL_TEST, Snapshot) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K);
+  model.GetParameter_w()[2] = 1.0;
+  model.GetParameter_v()[7] = 2.0;
+  model.GetParameter_b()[0] = 3.0;
+  std::vector<real_t> snapshot;
+  model.Snapshot(&snapshot);
+  EXPECT_EQ(snapshot.size(), model.GetNumParameter());
+  model.GetParameter_w()[2] = 0;
+  model.GetParameter_v()[7] = 0;
+  model.GetParameter_b()[0] = 0;
+  model.Restore(snapshot);
+  EXPECT_FLOAT_EQ(model.GetParameter_w()[2], 1.0);
+  EXPECT_FLOAT_EQ(model.GetParameter_v()[7], 2.0);
+  EXPECT_FLOAT_EQ(model.GetParameter_b()[0], 3.0);
+}
+
+TEST(MODEL_TEST, CopyWeights) {
+  HyperParam hyper_param = Init();
+  std::string score[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model;
+    model.Initialize(score[f],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    model.GetParameter_w()[2] = 1.0;
+    model.GetParameter_b()[0] = 3.0;
+    Model copy;
+    copy.CopyWeights(model);
+    EXPECT_TRUE(copy.IsWeightsOnly());
+    EXPECT_EQ(copy.GetLinearStride(), 1);
+    EXPECT_EQ(copy.GetNumParameter_w(), hyper_param.num_feature);
+    EXPECT_FLOAT_EQ(copy.GetParameter_w()[1], 1.0);
+    EXPECT_FLOAT_EQ(copy.GetParameter_b()[0], 3.0);
+    std::vector<real_t> weights(copy.GetParameter_v(),
+                                copy.GetParameter_v() +
+                                copy.GetNumParameter_v());
+    // The memory of the copy is reused
+    real_t* w = copy.GetParameter_w();
+    copy.CopyWeights(model);
+    EXPECT_EQ(copy.GetParameter_w(), w);
+    // Only the weights are restored
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      model.GetParameter_w()[i] = 0;
+    }
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      model.GetParameter_v()[i] = 0;
+    }
+    model.RestoreWeights(copy);
+    EXPECT_FLOAT_EQ(model.GetParameter_w()[2], 1.0);
+    EXPECT_FLOAT_EQ(model.GetParameter_w()[3], 0);
+    EXPECT_FLOAT_EQ(model.GetParameter_b()[0], 3.0);
+    Model again;
+    again.CopyWeights(model);
+    for (size_t i = 0; i < weights.size(); ++i) {
+      EXPECT_FLOAT_EQ(again.GetParameter_v()[i], weights[i]);
+    }
+  }
+}
+
+TEST(MODEL_TEST, MemoryBytes) {
+  HyperParam hyper_param = Init();
+  std::string score[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model;
+    model.Initialize(score[f],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    // Half of the parameters are the gradient caches
+    EXPECT_EQ(model.WeightBytes(), model.StateBytes());
+    EXPECT_EQ(model.WeightBytes() + model.StateBytes(),
+              model.GetNumParameter() * sizeof(real_t));
+    Model copy;
+    copy.CopyWeights(model);
+    EXPECT_EQ(copy.WeightBytes(), model.WeightBytes());
+    EXPECT_EQ(copy.StateBytes(), 0);
+  }
+}
+
+TEST(MODEL_TEST, Prune) {
+  HyperParam hyper_param = Init();
+  std::string score[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model;
+    model.Initialize(score[f],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    index_t aligned_k = model.get_aligned_k();
+    index_t num_vec = f == 2 ? hyper_param.num_field : 1;
+    // Feature 3 has large w, and feature 7 has a large latent
+    // weight. Only feature 5 is updated in training
+    real_t* w = model.GetParameter_w();
+    w[3 * 2] = 0.5;
+    w[5 * 2 + 1] = 1.5;
+    if (f > 0) {
+      model.GetParameter_v()[(7 * num_vec + num_vec - 1) *
+                             2 * aligned_k + 1] = 2.0;
+    }
+    model.GetParameter_b()[0] = 3.0;
+    std::vector<index_t> kept;
+    // The initial fm latent factor has the weights of 1.0
+    model.PruneFeatures(0.1, 1.5, 0, &kept);
+    std::vector<index_t> expect = { 3 };
+    if (f > 0) { expect.push_back(7); }
+    EXPECT_EQ(kept, expect);
+    // The latent weights are not checked without -v
+    model.PruneFeatures(0.1, 0, 0, &kept);
+    EXPECT_EQ(kept, std::vector<index_t>({ 3 }));
+    model.PruneFeatures(0, 0, 0.1, &kept);
+    EXPECT_EQ(kept, std::vector<index_t>({ 5 }));
+    model.PruneFeatures(0, 0, 0, &kept);
+    EXPECT_EQ(kept.size(), hyper_param.num_feature);
+    // The compact model of features 3 and 7
+    Model compact;
+    compact.CompactFrom(model, expect);
+    EXPECT_TRUE(compact.IsWeightsOnly());
+    EXPECT_EQ(compact.GetNumFeature(), expect.size());
+    EXPECT_EQ(compact.GetNumParameter_v(),
+              f > 0 ? expect.size() * num_vec * aligned_k : 0);
+    EXPECT_FLOAT_EQ(compact.GetParameter_w()[0], 0.5);
+    EXPECT_FLOAT_EQ(compact.GetParameter_b()[0], 3.0);
+    Model copy;
+    copy.CopyWeights(model);
+    for (size_t i = 0; f > 0 && i < expect.size(); ++i) {
+      const real_t* vec = copy.GetParameter_v() +
+                          expect[i] * num_vec * aligned_k;
+      for (index_t d = 0; d < num_vec * aligned_k; ++d) {
+        EXPECT_EQ(compact.GetParameter_v()[i * num_vec * aligned_k + d],
+                  vec[d]);
+      }
+    }
+    // Save and load the compact model
+    compact.Serialize(hyper_param.model_file, true);
+    Model loaded(hyper_param.model_file);
+    EXPECT_EQ(loaded.GetNumFeature(), expect.size());
+    EXPECT_FLOAT_EQ(loaded.GetParameter_w()[0], 0.5);
+    RemoveFile(hyper_param.model_file.c_str());
+  }
+}
+
+TEST(MODEL_TEST, Save_sparse) {
+  HyperParam hyper_param = Init();
+  std::string score[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model;
+    model.Initialize(score[f],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    // Features 2 and 6 are updated in training
+    real_t* w = model.GetParameter_w();
+    w[2 * 2] = 0.5;
+    w[6 * 2 + 1] = 1.5;
+    model.GetParameter_b()[0] = 3.0;
+    std::vector<index_t> ids;
+    model.TouchedFeatures(&ids);
+    EXPECT_EQ(ids, std::vector<index_t>({ 2, 6 }));
+    EXPECT_FALSE(model.IsSparse());
+    model.SerializeSparse(hyper_param.model_file);
+    Model loaded(hyper_param.model_file);
+    EXPECT_TRUE(loaded.IsSparse());
+    EXPECT_TRUE(loaded.IsWeightsOnly());
+    EXPECT_EQ(loaded.GetFeatureIds(), ids);
+    EXPECT_EQ(loaded.GetDenseNumFeature(), hyper_param.num_feature);
+    EXPECT_EQ(loaded.GetNumFeature(), 2);
+    EXPECT_FLOAT_EQ(loaded.GetParameter_w()[0], 0.5);
+    EXPECT_FLOAT_EQ(loaded.GetParameter_w()[1], 0);
+    EXPECT_FLOAT_EQ(loaded.GetParameter_b()[0], 3.0);
+    RemoveFile(hyper_param.model_file.c_str());
+  }
+}
+
+TEST(MODEL_TEST, Apply_delta) {
+  HyperParam hyper_param = Init();
+  std::string delta_file = hyper_param.model_file + ".delta";
+  std::string score[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model;
+    model.Initialize(score[f],
+                     hyper_param.loss_func,
+                     hyper_param.num_feature,
+                     hyper_param.num_field,
+                     hyper_param.num_K);
+    EXPECT_TRUE(model.GetDirtyFeatures() == nullptr);
+    model.TrackDirtyFeatures();
+    model.Serialize(hyper_param.model_file, true);
+    // All the weights change, but only features 2 and 6 are flagged
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      model.GetParameter_w()[i] += 0.5;
+    }
+    for (uint64 i = 0; i < model.GetNumParameter_v(); ++i) {
+      model.GetParameter_v()[i] += 0.25;
+    }
+    model.GetParameter_b()[0] = 3.0;
+    uint8* dirty = model.GetDirtyFeatures();
+    dirty[6] = 1;
+    dirty[2] = 1;
+    std::vector<index_t> ids;
+    model.TakeDirtyFeatures(&ids);
+    EXPECT_EQ(ids, std::vector<index_t>({ 2, 6 }));
+    EXPECT_EQ(dirty[2], 0);
+    model.SerializeSparse(delta_file, ids);
+    Model base(hyper_param.model_file);
+    Model expect(hyper_param.model_file);
+    Model copy;
+    copy.CopyWeights(model);
+    Model delta(delta_file);
+    EXPECT_TRUE(base.ApplyDelta(delta));
+    EXPECT_FLOAT_EQ(base.GetParameter_b()[0], 3.0);
+    uint64 vec = base.GetNumParameter_v() / hyper_param.num_feature;
+    for (index_t i = 0; i < hyper_param.num_feature; ++i) {
+      Model& src = (i == 2 || i == 6) ? copy : expect;
+      EXPECT_FLOAT_EQ(base.GetParameter_w()[i], src.GetParameter_w()[i]);
+      for (uint64 d = i * vec; d < (i + 1) * vec; ++d) {
+        EXPECT_FLOAT_EQ(base.GetParameter_v()[d],
+                        src.GetParameter_v()[d]);
+      }
+    }
+    // The delta of another structure does not match
+    if (f == 2) {
+      Model other;
+      other.Initialize("ffm", hyper_param.loss_func,
+                       hyper_param.num_feature,
+                       hyper_param.num_field + 1,
+                       hyper_param.num_K);
+      EXPECT_FALSE(other.ApplyDelta(delta));
+      EXPECT_FALSE(base.ApplyDelta(base));
+    }
+    RemoveFile(hyper_param.model_file.c_str());
+    RemoveFile(delta_file.c_str());
+  }
+}
+
+// The stale feature is reset to its initial parameters, and the
+// features updated in the time-to-live and the never updated
+// ones are kept
+TEST(MODEL_TEST, Evict_stale) {
+  HyperParam hyper_param = Init();
+  index_t num_feat = hyper_param.num_feature;
+  Model model;
+  model.Initialize("ffm", hyper_param.loss_func, num_feat,
+                   hyper_param.num_field, hyper_param.num_K);
+  EXPECT_TRUE(model.GetUpdateStamps() == nullptr);
+  model.TrackUpdateTime();
+  model.TrackDirtyFeatures();
+  // The initial parameters are the same for the same seed
+  Model init;
+  init.Initialize("ffm", hyper_param.loss_func, num_feat,
+                  hyper_param.num_field, hyper_param.num_K);
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    model.GetParameter_w()[i] += 0.5;
+  }
+  for (uint64 i = 0; i < model.GetNumParameter_v(); ++i) {
+    model.GetParameter_v()[i] += 0.25;
+  }
+  FeatureStamps* stamps = model.GetUpdateStamps();
+  stamps->time[2] = 1;
+  stamps->time[5] = 8;
+  stamps->clock.store(10);
+  EXPECT_EQ(model.EvictStale(5, 0, num_feat), 1);
+  EXPECT_EQ(stamps->time[2], 0);
+  EXPECT_EQ(stamps->time[5], 8);
+  EXPECT_EQ(model.GetDirtyFeatures()[2], 1);
+  EXPECT_EQ(model.GetDirtyFeatures()[5], 0);
+  index_t stride = model.GetLinearStride();
+  uint64 vec = model.GetNumParameter_v() / num_feat;
+  for (index_t i = 0; i < num_feat; ++i) {
+    if (i == 2) {
+      EXPECT_FLOAT_EQ(model.GetParameter_w()[i*stride], 0);
+      EXPECT_FLOAT_EQ(model.GetParameter_w()[i*stride+1], 1.0);
+    } else {
+      EXPECT_FLOAT_EQ(model.GetParameter_w()[i*stride],
+                      init.GetParameter_w()[i*stride] + 0.5);
+    }
+    for (uint64 d = i * vec; d < (i + 1) * vec; ++d) {
+      real_t expect = init.GetParameter_v()[d] + (i == 2 ? 0 : 0.25);
+      EXPECT_FLOAT_EQ(model.GetParameter_v()[d], expect);
+    }
+  }
+  // The evicted feature is not evicted again
+  EXPECT_EQ(model.EvictStale(5, 0, num_feat), 0);
+}
+
+// The grown model has the parameters of the model initialized
+// with all the features, and w and v do not move
+TEST(MODEL_TEST, Grow) {
+  HyperParam hyper_param = Init();
+  index_t num_grown = kGrowSegment + 100;
+  std::string score[] = { "linear", "fm", "ffm" };
+  for (int f = 0; f < 3; ++f) {
+    Model model;
+    model.SetCapacity(3 * kGrowSegment);
+    model.Initialize(score[f], hyper_param.loss_func, 10,
+                     hyper_param.num_field, hyper_param.num_K);
+    EXPECT_TRUE(model.IsGrowable());
+    real_t* w = model.GetParameter_w();
+    real_t* v = model.GetParameter_v();
+    Model copy;
+    copy.CopyWeights(model);
+    EXPECT_TRUE(model.Grow(5));
+    EXPECT_EQ(model.GetNumFeature(), 10);
+    EXPECT_TRUE(model.Grow(num_grown));
+    EXPECT_FALSE(model.Grow(3 * kGrowSegment + 1));
+    EXPECT_EQ(model.GetNumFeature(), num_grown);
+    EXPECT_TRUE(model.GetParameter_w() == w);
+    EXPECT_TRUE(model.GetParameter_v() == v);
+    Model fixed;
+    fixed.Initialize(score[f], hyper_param.loss_func, num_grown,
+                     hyper_param.num_field, hyper_param.num_K);
+    EXPECT_FALSE(fixed.IsGrowable());
+    ASSERT_EQ(model.GetNumParameter_w(), fixed.GetNumParameter_w());
+    ASSERT_EQ(model.GetNumParameter_v(), fixed.GetNumParameter_v());
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(model.GetParameter_w()[i],
+                      fixed.GetParameter_w()[i]);
+    }
+    for (uint64 i = 0; i < model.GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(model.GetParameter_v()[i],
+                      fixed.GetParameter_v()[i]);
+    }
+    // The copy follows the growth
+    copy.CopyWeights(model);
+    EXPECT_EQ(copy.GetNumFeature(), num_grown);
+    model.Release();
+  }
+}
+
+TEST(MODEL_TEST, Sparse_latent) {
+  HyperParam hyper_param = Init();
+  index_t num_feat = hyper_param.num_feature;
+  index_t num_field = hyper_param.num_field;
+  // Features 1 and 3 of the fields 0 and 2
+  SparseRow row(2);
+  row[0].feat_id = 1;
+  row[0].field_id = 0;
+  row[1].feat_id = 3;
+  row[1].field_id = 2;
+  std::shared_ptr<LatentPairs> pairs(new LatentPairs);
+  pairs->AddRow(&row, num_field);
+  pairs->Build(num_feat);
+  Model dense, sparse;
+  dense.Initialize("ffm", "squared", num_feat, num_field,
+                   hyper_param.num_K);
+  sparse.SetLatentPairs(pairs);
+  sparse.Initialize("ffm", "squared", num_feat, num_field,
+                    hyper_param.num_K);
+  EXPECT_FALSE(dense.IsSparseLatent());
+  EXPECT_TRUE(sparse.IsSparseLatent());
+  index_t align0 = hyper_param.num_K * 2;
+  EXPECT_EQ(sparse.GetNumParameter_v(), 2 * align0);
+  EXPECT_LT(sparse.WeightBytes(), dense.WeightBytes());
+  // The vectors of the observed pairs have the dense values
+  for (index_t i = 0; i < num_feat; ++i) {
+    for (index_t f = 0; f < num_field; ++f) {
+      real_t* block = sparse.GetLatentBlock(i, f);
+      bool observed = (i == 1 && f == 2) || (i == 3 && f == 0);
+      if (!observed) {
+        EXPECT_TRUE(block == nullptr);
+        continue;
+      }
+      ASSERT_TRUE(block != nullptr);
+      real_t* expect = dense.GetLatentBlock(i, f);
+      for (index_t d = 0; d < align0; ++d) {
+        EXPECT_FLOAT_EQ(block[d], expect[d]);
+      }
+    }
+  }
+  // The file has the dense layout
+  real_t* block = sparse.GetLatentBlock(3, 0);
+  for (index_t d = 0; d < align0; ++d) { block[d] = 0.25; }
+  sparse.Serialize(hyper_param.model_file);
+  Model loaded(hyper_param.model_file);
+  EXPECT_FALSE(loaded.IsSparseLatent());
+  EXPECT_EQ(loaded.GetNumParameter_v(), dense.GetNumParameter_v());
+  for (index_t i = 0; i < num_feat; ++i) {
+    for (index_t f = 0; f < num_field; ++f) {
+      const real_t* src = sparse.GetLatentBlock(i, f);
+      const real_t* dst = loaded.GetLatentBlock(i, f);
+      for (index_t d = 0; d < align0; ++d) {
+        bool cache = (d / kAlign) % 2 == 1;
+        real_t expect = src != nullptr ? src[d] : (cache ? 1.0 : 0);
+        EXPECT_FLOAT_EQ(dst[d], expect);
+      }
+    }
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The blocks of each field have the aligned K of the field, whose
+// weights are the first ones of the dense model, and the model file
+// has the dense layout of zero weights beyond the K of the field
+TEST(MODEL_TEST, Field_k) {
+  HyperParam hyper_param = Init();
+  index_t num_feat = hyper_param.num_feature;
+  index_t num_field = hyper_param.num_field;
+  std::vector<index_t> field_k(num_field, hyper_param.num_K);
+  field_k[0] = 4;
+  field_k[3] = 1;
+  Model dense, mixed;
+  dense.Initialize("ffm", "squared", num_feat, num_field,
+                   hyper_param.num_K);
+  mixed.SetFieldK(field_k);
+  mixed.Initialize("ffm", "squared", num_feat, num_field,
+                   hyper_param.num_K);
+  EXPECT_FALSE(dense.HasFieldK());
+  EXPECT_TRUE(mixed.HasFieldK());
+  EXPECT_EQ(mixed.GetFieldK(3), 4);
+  EXPECT_EQ(mixed.GetFieldK(5), 8);
+  index_t align0 = hyper_param.num_K * 2;
+  index_t floats = (num_field - 2) * align0 + 2 * 8;
+  EXPECT_EQ(mixed.GetFieldOffsets()[num_field], floats);
+  EXPECT_EQ(mixed.GetNumParameter_v(), (uint64)num_feat * floats);
+  EXPECT_LT(mixed.WeightBytes(), dense.WeightBytes());
+  for (index_t i = 0; i < num_feat; ++i) {
+    for (index_t f = 0; f < num_field; ++f) {
+      const real_t* block = mixed.GetLatentBlock(i, f);
+      const real_t* expect = dense.GetLatentBlock(i, f);
+      for (index_t d = 0; d < 2 * mixed.GetFieldK(f); ++d) {
+        EXPECT_FLOAT_EQ(block[d], expect[d]);
+      }
+    }
+  }
+  mixed.Serialize(hyper_param.model_file);
+  Model loaded(hyper_param.model_file);
+  EXPECT_FALSE(loaded.HasFieldK());
+  EXPECT_EQ(loaded.GetNumParameter_v(), dense.GetNumParameter_v());
+  for (index_t i = 0; i < num_feat; ++i) {
+    for (index_t f = 0; f < num_field; ++f) {
+      const real_t* src = mixed.GetLatentBlock(i, f);
+      const real_t* dst = loaded.GetLatentBlock(i, f);
+      index_t k2 = 2 * mixed.GetFieldK(f);
+      for (index_t d = 0; d < align0; ++d) {
+        bool cache = (d / kAlign) % 2 == 1;
+        real_t expect = d < k2 ? src[d] : (cache ? 1.0 : 0);
+        EXPECT_FLOAT_EQ(dst[d], expect);
+      }
+    }
+  }
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+// The latent vectors of rank 2 are kept by the projection
+// onto the first 2 directions, and so are their inner products
+TEST(MODEL_TEST, Reduce_rank) {
+  const index_t kNumFeat = 30;
+  const index_t kNumField = 3;
+  const index_t kK = 8;
+  Model model;
+  model.Initialize("ffm", "cross-entropy", kNumFeat, kNumField, kK);
+  model.GetParameter_b()[0] = 0.25;
+  index_t aligned_k = model.get_aligned_k();
+  real_t base[2][kK];
+  for (index_t d = 0; d < kK; ++d) {
+    base[0][d] = (d % 3) - 1.0;
+    base[1][d] = 0.1 * d;
+  }
+  for (index_t i = 0; i < kNumFeat; ++i) {
+    model.GetParameter_w()[i * 2] = 0.01 * i;
+    for (index_t f = 0; f < kNumField; ++f) {
+      real_t* block = model.GetLatentBlock(i, f);
+      real_t a = 0.1 * ((i + f) % 7), b = 0.2 * ((i * f) % 5) - 0.3;
+      for (index_t d = 0; d < kK; ++d) {
+        block[LatentWeightPos(model.GetLatentLayout(), d, aligned_k)] =
+          a * base[0][d] + b * base[1][d];
+      }
+    }
+  }
+  std::vector<double> energy, basis;
+  model.LatentBasis(&energy, &basis);
+  ASSERT_EQ(energy.size(), kK);
+  ASSERT_EQ(basis.size(), kK * kK);
+  EXPECT_GT(energy[1], 0);
+  for (index_t r = 2; r < kK; ++r) {
+    EXPECT_NEAR(energy[r] / energy[0], 0, 1e-6);
+  }
+  // The directions are orthonormal
+  for (index_t r = 0; r < kK; ++r) {
+    double dot = 0;
+    for (index_t d = 0; d < kK; ++d) { dot += basis[r*kK+d] * basis[d]; }
+    EXPECT_NEAR(dot, r == 0 ? 1.0 : 0.0, 1e-6);
+  }
+  Model reduced;
+  reduced.ReduceRankFrom(model, basis, 2);
+  EXPECT_TRUE(reduced.IsWeightsOnly());
+  EXPECT_EQ(reduced.GetNumK(), 2);
+  EXPECT_EQ(reduced.GetNumFeature(), kNumFeat);
+  EXPECT_EQ(reduced.GetNumField(), kNumField);
+  EXPECT_FLOAT_EQ(reduced.GetParameter_b()[0], 0.25);
+  EXPECT_FLOAT_EQ(reduced.GetParameter_w()[7], 0.07);
+  index_t reduced_k = reduced.get_aligned_k();
+  EXPECT_EQ(reduced.GetNumParameter_v(),
+            (uint64)kNumFeat * kNumField * reduced_k);
+  Model copy;
+  copy.CopyWeights(model);
+  uint64 num_vec = kNumFeat * kNumField;
+  for (uint64 i = 0; i < num_vec; i += 5) {
+    for (uint64 j = 0; j < num_vec; j += 3) {
+      real_t expect = 0, val = 0;
+      for (index_t d = 0; d < kK; ++d) {
+        expect += copy.GetParameter_v()[i * aligned_k + d] *
+                  copy.GetParameter_v()[j * aligned_k + d];
+      }
+      for (index_t d = 0; d < reduced_k; ++d) {
+        val += reduced.GetParameter_v()[i * reduced_k + d] *
+               reduced.GetParameter_v()[j * reduced_k + d];
+      }
+      EXPECT_NEAR(val, expect, 1e-4);
+    }
+  }
+}
+
+// The linear term of the linear model, the fm vector for every
+// field of ffm, and the first weights of a larger K
+TEST(MODEL_TEST, Init_from) {
+  const index_t kNumFeat = 20;
+  const index_t kNumField = 3;
+  Model linear;
+  linear.Initialize("linear", "cross-entropy", kNumFeat, 0, 0);
+  for (index_t i = 0; i < kNumFeat; ++i) {
+    linear.GetParameter_w()[i * 2] = 0.5 + i;
+  }
+  linear.GetParameter_b()[0] = 1.5;
+  Model fm;
+  fm.Initialize("fm", "cross-entropy", kNumFeat - 5, 0, 4);
+  index_t fm_k = fm.get_aligned_k();
+  for (index_t i = 0; i < kNumFeat - 5; ++i) {
+    fm.GetParameter_w()[i * 2] = -0.5 - i;
+    real_t* block = fm.GetParameter_v() +
+      i * LatentBlockSize(fm.GetLatentLayout(), fm_k);
+    for (index_t d = 0; d < 4; ++d) {
+      block[LatentWeightPos(fm.GetLatentLayout(), d, fm_k)] = 10 * i + d;
+    }
+  }
+  fm.GetParameter_b()[0] = -2.0;
+  Model ffm;
+  ffm.Initialize("ffm", "cross-entropy", kNumFeat, kNumField, 8);
+  EXPECT_TRUE(ffm.CanInitFrom(linear));
+  EXPECT_TRUE(ffm.CanInitFrom(fm));
+  EXPECT_FALSE(fm.CanInitFrom(ffm));
+  Model small;
+  small.Initialize("fm", "cross-entropy", kNumFeat, 0, 2);
+  EXPECT_FALSE(small.CanInitFrom(fm));
+  EXPECT_TRUE(small.CanInitFrom(linear));
+  // Linear to ffm
+  ffm.InitFrom(linear);
+  EXPECT_FLOAT_EQ(ffm.GetParameter_b()[0], 1.5);
+  for (index_t i = 0; i < kNumFeat; ++i) {
+    EXPECT_FLOAT_EQ(ffm.GetParameter_w()[i * 2], 0.5 + i);
+    // The cache keeps the initial value
+    EXPECT_FLOAT_EQ(ffm.GetParameter_w()[i * 2 + 1], 1.0);
+  }
+  // Fm to ffm of a larger K
+  index_t ffm_k = ffm.get_aligned_k();
+  LatentLayout layout = ffm.GetLatentLayout();
+  real_t last = ffm.GetLatentBlock(kNumFeat - 1, 1)[
+    LatentWeightPos(layout, 0, ffm_k)];
+  ffm.InitFrom(fm);
+  EXPECT_FLOAT_EQ(ffm.GetParameter_b()[0], -2.0);
+  for (index_t i = 0; i < kNumFeat; ++i) {
+    EXPECT_FLOAT_EQ(ffm.GetParameter_w()[i * 2],
+                    i < kNumFeat - 5 ? -0.5 - i : 0.5 + i);
+  }
+  for (index_t i = 0; i < kNumFeat - 5; ++i) {
+    for (index_t f = 0; f < kNumField; ++f) {
+      real_t* block = ffm.GetLatentBlock(i, f);
+      for (index_t d = 0; d < 4; ++d) {
+        EXPECT_FLOAT_EQ(block[LatentWeightPos(layout, d, ffm_k)],
+                        10 * i + d);
+      }
+      // The new dimensions keep the random initial value
+      for (index_t d = 4; d < 8; ++d) {
+        EXPECT_LT(std::abs(block[LatentWeightPos(layout, d, ffm_k)]), 1.0);
+      }
+    }
+  }
+  // The features beyond the simple model are not changed
+  EXPECT_FLOAT_EQ(ffm.GetLatentBlock(kNumFeat - 1, 1)[
+    LatentWeightPos(layout, 0, ffm_k)], last);
+  linear.Release();
+  fm.Release();
+  ffm.Release();
+  small.Release();
+}
+
 }   // namespace xLearn
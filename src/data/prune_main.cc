@@ -0,0 +1,187 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the xlearn_prune tool, which removes the
+features whose weights are all small (or which are rare in training)
+from a trained model, and writes a compact weights-only model for
+serving. The kept features are renumbered, and their original ids are
+written to the feature map <output_file>.dict, which is loaded by
+xlearn_predict (and the C API) with the model:
+
+  xlearn_prune [ options ] model_file output_file
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/data/feature_map.h"
+#include "src/data/model_parameters.h"
+
+namespace {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_prune [ options ] model_file output_file \n"
+"                                                    \n"
+"  Write the features of the model that are not pruned into a weights-only model, and write \n"
+"  their feature ids into the feature map output_file.dict, which is used by xlearn_predict. \n"
+"  A feature is pruned if |w| < -w and every latent weight |v| < -v, or if the sum of the \n"
+"  squared gradients of w < -g. \n"
+"                                                                                   \n"
+"OPTIONS: \n"
+"  -w <threshold>       :  Threshold of the linear weight. Using 0 (disabled) by default. \n"
+"                                                                                     \n"
+"  -v <threshold>       :  Threshold of the latent weights of fm and ffm. Using 0 by default, in \n"
+"                          which case only the linear weight is checked. \n"
+"                                                                       \n"
+"  -g <threshold>       :  Threshold of the sum of the squared gradients of w, which is 0 for the \n"
+"                          features unseen in training. It needs the full model (trained without \n"
+"                          --weights-only). Using 0 (disabled) by default. \n"
+"                                                                         \n"
+"  --mmap-model         :  Write the compact model in the memory-mappable format. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct PruneOption {
+  xLearn::real_t w_threshold = 0;
+  xLearn::real_t v_threshold = 0;
+  xLearn::real_t g_threshold = 0;
+  bool mmap_model = false;
+  std::vector<std::string> file_list;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], PruneOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "-w" || arg == "-v" || arg == "-g") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      xLearn::real_t value = atof(argv[++i]);
+      if (value < 0) {
+        printf("[Error] Illegal %s : '%s' \n", arg.c_str(), argv[i]);
+        return false;
+      }
+      if (arg == "-w") {
+        option->w_threshold = value;
+      } else if (arg == "-v") {
+        option->v_threshold = value;
+      } else {
+        option->g_threshold = value;
+      }
+    } else if (arg == "--mmap-model") {
+      option->mmap_model = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      printf("[Error] Unknow option: %s \n", argv[i]);
+      return false;
+    } else {
+      option->file_list.push_back(arg);
+    }
+  }
+  if (option->file_list.size() != 2) { return false; }
+  if (!FileExist(option->file_list[0].c_str())) {
+    printf("[Error] Model file: %s does not exist \n",
+           option->file_list[0].c_str());
+    return false;
+  }
+  return true;
+}
+
+// Size (MB) of the file
+double file_mb(const std::string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  Close(file);
+  return (double)size / MB;
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// The feature map of the trained model (if it is trained with --remap)
+// is composed with the pruning, so the new map gives the raw ids of
+// the dataset
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  Timer timer;
+  timer.tic();
+
+  PruneOption option;
+  if (!parse_option(argc, argv, &option)) {
+    printf("%s", kUsage);
+    return 0;
+  }
+  const std::string& model_file = option.file_list[0];
+  const std::string& out_file = option.file_list[1];
+  xLearn::Model model(model_file);
+  if (option.g_threshold > 0 && model.IsWeightsOnly()) {
+    printf("[Error] The -g needs the full model, but %s is "
+           "a weights-only model \n", model_file.c_str());
+    return 0;
+  }
+  xLearn::FeatureMap old_map;
+  std::string dict_file = model_file + ".dict";
+  bool has_map = FileExist(dict_file.c_str());
+  if (has_map) {
+    CHECK(old_map.Deserialize(dict_file));
+    CHECK_EQ(old_map.Size(), model.GetNumFeature());
+  }
+  std::vector<xLearn::index_t> kept;
+  model.PruneFeatures(option.w_threshold, option.v_threshold,
+                      option.g_threshold, &kept);
+  if (kept.empty()) {
+    printf("[Error] All the features are pruned. Please use "
+           "smaller thresholds \n");
+    return 0;
+  }
+  xLearn::Model compact;
+  compact.CompactFrom(model, kept);
+  if (option.mmap_model) {
+    compact.SerializeMapped(out_file);
+  } else {
+    compact.Serialize(out_file, true);
+  }
+  xLearn::FeatureMap new_map;
+  for (size_t i = 0; i < kept.size(); ++i) {
+    xLearn::index_t id = 0;
+    new_map.Map(has_map ? old_map.RawId(kept[i]) : kept[i], &id);
+  }
+  new_map.Freeze();
+  new_map.Serialize(out_file + ".dict");
+
+  printf("Keep %lu of %u features (%.2f%%) \n"
+         "  Model size: %.2f MB -> %.2f MB \n"
+         "  Output file: %s and %s.dict \n"
+         "Total time cost: %.2f sec\n",
+         kept.size(), model.GetNumFeature(),
+         kept.size() * 100.0 / model.GetNumFeature(),
+         file_mb(model_file), file_mb(out_file),
+         out_file.c_str(), out_file.c_str(), timer.toc());
+
+  return 0;
+}
@@ -0,0 +1,334 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of ParamServer.
+*/
+
+#include "src/distributed/param_server.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+namespace xLearn {
+
+static const char* kScoreName[] = { "linear", "fm", "ffm" };
+
+bool ParamServer::Initialize(uint16 port, int num_workers) {
+  CHECK_GT(num_workers, 0);
+  num_workers_ = num_workers;
+  hello_.clear();
+  clock_.assign(num_workers, 0);
+  return listener_.Listen(port);
+}
+
+void ParamServer::Run() {
+  std::vector<std::unique_ptr<Socket>> conns;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_workers_; ++i) {
+    conns.emplace_back(new Socket);
+    if (!listener_.Accept(conns.back().get())) { break; }
+    threads.emplace_back(&ParamServer::serve, this, conns.back().get());
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  listener_.Close();
+}
+
+void ParamServer::serve(Socket* conn) {
+  std::vector<char> in;
+  std::vector<index_t> ids;
+  std::vector<real_t> out;
+  int worker = -1;
+  PSHeader header;
+  bool ok = true;
+  while (ok && conn->RecvAll(&header, sizeof(header))) {
+    if (header.type != kPSHello && worker < 0) {
+      LOG(ERROR) << "The first message of the worker is not hello";
+      break;
+    }
+    switch (header.type) {
+      case kPSHello:
+        ok = worker < 0 && hello(conn, header, &worker);
+        break;
+      case kPSPull:
+        ok = pull(conn, header, &in, &ids, &out);
+        break;
+      case kPSPush:
+        ok = push(conn, header, &in, &ids, &out);
+        break;
+      case kPSClock:
+        ok = clock(conn, header, worker);
+        break;
+      case kPSBarrier:
+        ok = barrier(conn);
+        break;
+      default:
+        LOG(ERROR) << "Unknow message type: " << header.type;
+        ok = false;
+    }
+  }
+  // The lost worker never blocks the others
+  if (worker >= 0) {
+    std::lock_guard<std::mutex> lock(clock_mutex_);
+    clock_[worker] = kPSDoneClock;
+    clock_cond_.notify_all();
+  }
+  conn->Close();
+}
+
+bool ParamServer::hello(Socket* conn, const PSHeader& header,
+                        int* worker) {
+  PSHello msg;
+  if (header.bytes != sizeof(msg) ||
+      !conn->RecvAll(&msg, sizeof(msg))) {
+    return false;
+  }
+  std::unique_lock<std::mutex> lock(hello_mutex_);
+  if (msg.worker_id >= (uint32)num_workers_ ||
+      msg.num_workers != (uint32)num_workers_ ||
+      msg.server_id >= msg.num_servers ||
+      msg.score_func > 2 || msg.linear_stride < 2) {
+    LOG(ERROR) << "Illegal hello of the worker " << msg.worker_id;
+    return false;
+  }
+  for (size_t i = 0; i < hello_.size(); ++i) {
+    const PSHello& first = hello_[i];
+    if (first.worker_id == msg.worker_id ||
+        first.server_id != msg.server_id ||
+        first.num_servers != msg.num_servers ||
+        first.score_func != msg.score_func ||
+        first.num_K != msg.num_K ||
+        first.linear_stride != msg.linear_stride) {
+      LOG(ERROR) << "The hello of the worker " << msg.worker_id
+                 << " does not match the other workers";
+      return false;
+    }
+  }
+  *worker = msg.worker_id;
+  hello_.push_back(msg);
+  if (hello_.size() == (size_t)num_workers_) {
+    init_shard();
+    ready_ = true;
+    hello_cond_.notify_all();
+  }
+  hello_cond_.wait(lock, [this]() { return ready_; });
+  PSHelloReply reply;
+  reply.num_feature = 0;
+  reply.num_field = 0;
+  for (size_t i = 0; i < hello_.size(); ++i) {
+    reply.num_feature = std::max(reply.num_feature, hello_[i].num_feature);
+    reply.num_field = std::max(reply.num_field, hello_[i].num_field);
+  }
+  lock.unlock();
+  PSHeader head = { kPSHello, 0, 1, sizeof(reply) };
+  return conn->SendAll(&head, sizeof(head)) &&
+         conn->SendAll(&reply, sizeof(reply));
+}
+
+// The shard has the features s, s + S, s + 2S, ... of the
+// model, and at least one feature
+void ParamServer::init_shard() {
+  const PSHello& first = hello_[0];
+  index_t num_feature = 0;
+  index_t num_field = 0;
+  for (size_t i = 0; i < hello_.size(); ++i) {
+    num_feature = std::max(num_feature, hello_[i].num_feature);
+    num_field = std::max(num_field, hello_[i].num_field);
+  }
+  server_id_ = first.server_id;
+  num_servers_ = first.num_servers;
+  staleness_ = first.staleness;
+  index_t num_local = 1;
+  if (num_feature > server_id_) {
+    num_local = std::max((index_t)1,
+        (num_feature - server_id_ + num_servers_ - 1) / num_servers_);
+  }
+  shard_.Initialize(kScoreName[first.score_func],
+                    "ps",
+                    num_local,
+                    num_field,
+                    first.num_K,
+                    first.scale,
+                    first.linear_stride);
+  w_len_ = shard_.GetLinearStride();
+  v_len_ = shard_.GetNumParameter_v() / shard_.GetNumFeature();
+  LOG(INFO) << "Server " << server_id_ << " of " << num_servers_
+            << ": " << num_local << " features of " << num_feature
+            << ", " << num_field << " fields";
+}
+
+// Each id has one byte at least
+bool ParamServer::recv_ids(Socket* conn, const PSHeader& header,
+                           std::vector<char>* in,
+                           std::vector<index_t>* ids,
+                           uint64* used) {
+  if (header.count > header.bytes) { return false; }
+  in->resize(header.bytes);
+  if (!conn->RecvAll(in->data(), header.bytes)) { return false; }
+  ids->resize(header.count);
+  *used = DecodeIds(in->data(), header.bytes,
+                    header.count, ids->data());
+  if (*used == 0 && header.count > 0) {
+    LOG(ERROR) << "The ids of the message are broken";
+    return false;
+  }
+  return true;
+}
+
+bool ParamServer::pull(Socket* conn, const PSHeader& header,
+                       std::vector<char>* in, std::vector<index_t>* id_buf,
+                       std::vector<real_t>* out) {
+  uint64 used = 0;
+  if (!recv_ids(conn, header, in, id_buf, &used) ||
+      used != header.bytes) {
+    return false;
+  }
+  const index_t* ids = id_buf->data();
+  bool with_bias = (header.flags & kPSWithBias) != 0;
+  index_t row_len = w_len_ + v_len_;
+  out->resize(header.count * row_len + (with_bias ? 2 : 0));
+  real_t* dst = out->data();
+  real_t* w = shard_.GetParameter_w();
+  real_t* v = shard_.GetParameter_v();
+  for (uint64 i = 0; i < header.count; ++i) {
+    index_t local = ids[i] / num_servers_;
+    if (ids[i] % num_servers_ != server_id_ ||
+        local >= shard_.GetNumFeature()) {
+      LOG(ERROR) << "Pull the feature " << ids[i]
+                 << " which is not in the server " << server_id_;
+      return false;
+    }
+    memcpy(dst, w + (uint64)local * w_len_, w_len_ * sizeof(real_t));
+    if (v_len_ > 0) {
+      memcpy(dst + w_len_, v + (uint64)local * v_len_,
+             v_len_ * sizeof(real_t));
+    }
+    dst += row_len;
+  }
+  if (with_bias) {
+    memcpy(dst, shard_.GetParameter_b(), 2 * sizeof(real_t));
+  }
+  PSHeader head = { kPSPull, header.flags, header.count,
+                    out->size() * sizeof(real_t) };
+  return conn->SendAll(&head, sizeof(head)) &&
+         conn->SendAll(out->data(), head.bytes);
+}
+
+// The deltas are decoded before the lock
+bool ParamServer::push(Socket* conn, const PSHeader& header,
+                       std::vector<char>* in, std::vector<index_t>* id_buf,
+                       std::vector<real_t>* delta_buf) {
+  bool with_bias = (header.flags & kPSWithBias) != 0;
+  uint32 quant = header.flags >> kPSQuantShift;
+  if (quant > kWireInt8) {
+    LOG(ERROR) << "Unknow quantization of the push: " << quant;
+    return false;
+  }
+  index_t row_len = w_len_ + v_len_;
+  uint64 row_bytes = WireRowBytes((WireQuant)quant, row_len);
+  uint64 used = 0;
+  if (!recv_ids(conn, header, in, id_buf, &used)) { return false; }
+  if (header.bytes != used + header.count * row_bytes +
+                      (with_bias ? 2 * sizeof(real_t) : 0)) {
+    return false;
+  }
+  const index_t* ids = id_buf->data();
+  delta_buf->resize(header.count * row_len + (with_bias ? 2 : 0));
+  const char* src = in->data() + used;
+  for (uint64 i = 0; i < header.count; ++i) {
+    DecodeRow((WireQuant)quant, src, row_len,
+              delta_buf->data() + i * row_len);
+    src += row_bytes;
+  }
+  if (with_bias) {
+    memcpy(delta_buf->data() + header.count * row_len, src,
+           2 * sizeof(real_t));
+  }
+  const real_t* delta = delta_buf->data();
+  real_t* w = shard_.GetParameter_w();
+  real_t* v = shard_.GetParameter_v();
+  std::lock_guard<std::mutex> lock(push_mutex_);
+  for (uint64 i = 0; i < header.count; ++i) {
+    index_t local = ids[i] / num_servers_;
+    if (ids[i] % num_servers_ != server_id_ ||
+        local >= shard_.GetNumFeature()) {
+      LOG(ERROR) << "Push the feature " << ids[i]
+                 << " which is not in the server " << server_id_;
+      return false;
+    }
+    real_t* row = w + (uint64)local * w_len_;
+    for (index_t j = 0; j < w_len_; ++j) { row[j] += delta[j]; }
+    row = v + (uint64)local * v_len_;
+    for (index_t j = 0; j < v_len_; ++j) { row[j] += delta[w_len_+j]; }
+    delta += row_len;
+  }
+  if (with_bias) {
+    real_t* b = shard_.GetParameter_b();
+    b[0] += delta[0];
+    b[1] += delta[1];
+  }
+  return true;
+}
+
+// The worker at clock c waits for the slowest
+// worker, which is at least at clock c - staleness
+bool ParamServer::clock(Socket* conn, const PSHeader& header, int worker) {
+  if (server_id_ != 0 || header.bytes != 0) {
+    LOG(ERROR) << "The clock is only kept by the server 0";
+    return false;
+  }
+  uint64 c = header.count;
+  {
+    std::unique_lock<std::mutex> lock(clock_mutex_);
+    clock_[worker] = c;
+    clock_cond_.notify_all();
+    clock_cond_.wait(lock, [this, c]() {
+      if (c == kPSDoneClock) { return true; }
+      uint64 slowest = *std::min_element(clock_.begin(), clock_.end());
+      return slowest + staleness_ >= c;
+    });
+  }
+  PSHeader head = { kPSClock, 0, c, 0 };
+  return conn->SendAll(&head, sizeof(head));
+}
+
+bool ParamServer::barrier(Socket* conn) {
+  {
+    std::unique_lock<std::mutex> lock(clock_mutex_);
+    uint64 round = barrier_round_;
+    if (++num_barrier_ == num_workers_) {
+      num_barrier_ = 0;
+      barrier_round_++;
+      clock_cond_.notify_all();
+    } else {
+      clock_cond_.wait(lock, [this, round]() {
+        return barrier_round_ != round;
+      });
+    }
+  }
+  PSHeader head = { kPSBarrier, 0, 0, 0 };
+  return conn->SendAll(&head, sizeof(head));
+}
+
+}  // namespace xLearn
@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the parameter server, which stores one
+shard of the model and serves the pulls and pushes of the workers.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_PARAM_SERVER_H_
+#define XLEARN_DISTRIBUTED_PARAM_SERVER_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/model_parameters.h"
+#include "src/distributed/ps_message.h"
+#include "src/distributed/socket.h"
+#include "src/distributed/sparse_codec.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// ParamServer stores the features f of f % num_servers == server_id. Each
+// worker has one connection to each server, which is served by its own
+// thread, so the messages of a worker are handled in order. The pushes
+// add the deltas of the workers to the shard, and the pulls read the
+// shard without a lock (like the Hogwild threads). We can use it like:
+//
+//   ParamServer server;
+//   server.Initialize(9090, 4);  /* port and the number of workers */
+//   server.Run();  /* returns after all the workers are closed */
+//
+// The shard is allocated after the hello of all the workers, which
+// gives the structure of the model. The server 0 also keeps the
+// clocks of the workers for the bounded staleness (see ps_message.h).
+//------------------------------------------------------------------------------
+class ParamServer {
+ public:
+  ParamServer() { }
+  ~ParamServer() { }
+
+  // Listen on the port (0 for any free port)
+  bool Initialize(uint16 port, int num_workers);
+
+  // The port of the server
+  inline uint16 Port() const { return listener_.Port(); }
+
+  // Serve the workers until all of them are closed
+  void Run();
+
+  // The shard of the model, which is allocated by the hello
+  inline Model& Shard() { return shard_; }
+
+ protected:
+  Socket listener_;
+  int num_workers_ = 0;
+  /* The shard and its structure */
+  Model shard_;
+  uint32 server_id_ = 0;
+  uint32 num_servers_ = 1;
+  index_t w_len_ = 0;
+  index_t v_len_ = 0;
+  uint32 staleness_ = 0;
+  /* The hello of the workers */
+  std::mutex hello_mutex_;
+  std::condition_variable hello_cond_;
+  std::vector<PSHello> hello_;
+  bool ready_ = false;
+  /* The pushes of the workers are added in turn */
+  std::mutex push_mutex_;
+  /* The clocks of the workers and the barrier */
+  std::mutex clock_mutex_;
+  std::condition_variable clock_cond_;
+  std::vector<uint64> clock_;
+  int num_barrier_ = 0;
+  uint64 barrier_round_ = 0;
+
+  // Serve one worker until it is closed
+  void serve(Socket* conn);
+
+  // Handle the messages, and return false if the
+  // connection is broken or the message is illegal
+  bool hello(Socket* conn, const PSHeader& header, int* worker);
+  bool pull(Socket* conn, const PSHeader& header,
+            std::vector<char>* in, std::vector<index_t>* ids,
+            std::vector<real_t>* out);
+  bool push(Socket* conn, const PSHeader& header,
+            std::vector<char>* in, std::vector<index_t>* ids,
+            std::vector<real_t>* delta);
+  bool clock(Socket* conn, const PSHeader& header, int worker);
+  bool barrier(Socket* conn);
+
+  // Receive the payload of the header and decode its count
+  // ids, which are the first used bytes of the payload
+  bool recv_ids(Socket* conn, const PSHeader& header,
+                std::vector<char>* in, std::vector<index_t>* ids,
+                uint64* used);
+
+  // Allocate the shard by the hello of all the workers
+  void init_shard();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ParamServer);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_PARAM_SERVER_H_
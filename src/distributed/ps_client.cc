@@ -0,0 +1,279 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of PSClient.
+*/
+
+#include "src/distributed/ps_client.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace xLearn {
+
+// The number of features of each request of PullAll()
+static const index_t kPullAllChunk = 1 << 16;
+
+// The number of floats of a row of the model
+static inline index_t row_length(Model* model) {
+  index_t v_len = model->GetNumFeature() == 0 ? 0 :
+      model->GetNumParameter_v() / model->GetNumFeature();
+  return model->GetLinearStride() + v_len;
+}
+
+bool PSClient::Connect(const std::vector<std::string>& servers,
+                       const PSHello& hello,
+                       index_t* num_feature,
+                       index_t* num_field) {
+  CHECK(!servers.empty());
+  Close();
+  sent_bytes_ = 0;
+  residual_slot_.clear();
+  residual_.clear();
+  for (size_t s = 0; s < servers.size(); ++s) {
+    std::string host;
+    uint16 port = 0;
+    if (!ParseAddress(servers[s], &host, &port)) {
+      LOG(ERROR) << "Illegal address of the server: " << servers[s];
+      return false;
+    }
+    conns_.emplace_back(new Socket);
+    if (!conns_.back()->Connect(host, port, 60)) { return false; }
+  }
+  // The hello is replied after the hello of all the workers
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    PSHello msg = hello;
+    msg.server_id = s;
+    msg.num_servers = conns_.size();
+    PSHeader head = { kPSHello, 0, 1, sizeof(msg) };
+    if (!send(s, head, &msg)) { return false; }
+  }
+  *num_feature = 0;
+  *num_field = 0;
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    PSHeader head;
+    PSHelloReply reply;
+    if (!conns_[s]->RecvAll(&head, sizeof(head)) ||
+        head.type != kPSHello || head.bytes != sizeof(reply) ||
+        !conns_[s]->RecvAll(&reply, sizeof(reply))) {
+      LOG(ERROR) << "The server " << servers[s] << " refuses the hello";
+      return false;
+    }
+    *num_feature = std::max(*num_feature, reply.num_feature);
+    *num_field = std::max(*num_field, reply.num_field);
+  }
+  ids_.resize(conns_.size());
+  rows_.resize(conns_.size());
+  return true;
+}
+
+bool PSClient::send(size_t s, const PSHeader& head, const void* data) {
+  sent_bytes_ += sizeof(head) + head.bytes;
+  return conns_[s]->SendAll(&head, sizeof(head)) &&
+         (head.bytes == 0 || conns_[s]->SendAll(data, head.bytes));
+}
+
+// The ids are sorted for the delta encoding, and
+// rows_ follows the order of the sorted ids
+void PSClient::split_ids(const std::vector<index_t>& ids) {
+  size_t num_servers = conns_.size();
+  for (size_t s = 0; s < num_servers; ++s) {
+    ids_[s].clear();
+    rows_[s].clear();
+  }
+  for (size_t i = 0; i < ids.size(); ++i) {
+    size_t s = ids[i] % num_servers;
+    rows_[s].push_back(i);
+  }
+  for (size_t s = 0; s < num_servers; ++s) {
+    std::vector<index_t>& rows = rows_[s];
+    std::sort(rows.begin(), rows.end(), [&ids](index_t a, index_t b) {
+      return ids[a] < ids[b];
+    });
+    for (size_t j = 0; j < rows.size(); ++j) {
+      ids_[s].push_back(ids[rows[j]]);
+    }
+  }
+}
+
+bool PSClient::Pull(const std::vector<index_t>& ids, Model* model) {
+  CHECK_LE(ids.size(), model->GetNumFeature());
+  split_ids(ids);
+  pulled_.resize(ids.size() * row_length(model));
+  return pull_rows(model, true);
+}
+
+bool PSClient::PullAll(Model* model) {
+  index_t num_feature = model->GetNumFeature();
+  std::vector<index_t> ids;
+  for (index_t begin = 0; begin < num_feature; begin += kPullAllChunk) {
+    index_t end = std::min(num_feature, begin + kPullAllChunk);
+    ids.clear();
+    for (index_t f = begin; f < end; ++f) { ids.push_back(f); }
+    split_ids(ids);
+    for (size_t s = 0; s < rows_.size(); ++s) {
+      rows_[s] = ids_[s];
+    }
+    if (!pull_rows(model, false)) { return false; }
+  }
+  return true;
+}
+
+bool PSClient::pull_rows(Model* model, bool keep) {
+  index_t w_len = model->GetLinearStride();
+  index_t row_len = row_length(model);
+  // The bias is pulled from the server 0 with its features
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    if (s != 0 && ids_[s].empty()) { continue; }
+    buffer_.clear();
+    EncodeIds(ids_[s].data(), ids_[s].size(), &buffer_);
+    PSHeader head = { kPSPull, s == 0 ? kPSWithBias : 0,
+                      ids_[s].size(), buffer_.size() };
+    if (!send(s, head, buffer_.data())) { return false; }
+  }
+  real_t* w = model->GetParameter_w();
+  real_t* v = model->GetParameter_v();
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    if (s != 0 && ids_[s].empty()) { continue; }
+    PSHeader head;
+    uint64 bytes = (ids_[s].size() * row_len + (s == 0 ? 2 : 0)) *
+                   sizeof(real_t);
+    if (!conns_[s]->RecvAll(&head, sizeof(head)) ||
+        head.type != kPSPull || head.bytes != bytes) {
+      return false;
+    }
+    reply_.resize(bytes / sizeof(real_t));
+    if (!conns_[s]->RecvAll(reply_.data(), bytes)) { return false; }
+    const real_t* src = reply_.data();
+    for (size_t j = 0; j < ids_[s].size(); ++j) {
+      uint64 row = rows_[s][j];
+      memcpy(w + row * w_len, src, w_len * sizeof(real_t));
+      if (row_len > w_len) {
+        memcpy(v + row * (row_len - w_len), src + w_len,
+               (row_len - w_len) * sizeof(real_t));
+      }
+      if (keep) {
+        memcpy(pulled_.data() + row * row_len, src,
+               row_len * sizeof(real_t));
+      }
+      src += row_len;
+    }
+    if (s == 0) {
+      memcpy(model->GetParameter_b(), src, 2 * sizeof(real_t));
+      memcpy(pulled_b_, src, 2 * sizeof(real_t));
+    }
+  }
+  return true;
+}
+
+bool PSClient::Push(const std::vector<index_t>& ids, Model* model) {
+  CHECK_EQ(pulled_.size(), ids.size() * row_length(model));
+  split_ids(ids);
+  index_t w_len = model->GetLinearStride();
+  index_t row_len = row_length(model);
+  index_t v_len = row_len - w_len;
+  const real_t* w = model->GetParameter_w();
+  const real_t* v = model->GetParameter_v();
+  uint64 row_bytes = WireRowBytes(quant_, row_len);
+  delta_.resize(row_len);
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    if (s != 0 && ids_[s].empty()) { continue; }
+    size_t count = ids_[s].size();
+    bool with_bias = s == 0;
+    buffer_.clear();
+    EncodeIds(ids_[s].data(), count, &buffer_);
+    uint64 pos = buffer_.size();
+    buffer_.resize(pos + count * row_bytes +
+                   (with_bias ? 2 * sizeof(real_t) : 0));
+    for (size_t j = 0; j < count; ++j) {
+      uint64 row = rows_[s][j];
+      const real_t* old = pulled_.data() + row * row_len;
+      for (index_t k = 0; k < w_len; ++k) {
+        delta_[k] = w[row * w_len + k] - old[k];
+      }
+      for (index_t k = 0; k < v_len; ++k) {
+        delta_[w_len+k] = v[row * v_len + k] - old[w_len+k];
+      }
+      EncodeRow(quant_, delta_.data(), row_len,
+                residual(ids_[s][j], row_len), buffer_.data() + pos);
+      pos += row_bytes;
+    }
+    if (with_bias) {
+      const real_t* b = model->GetParameter_b();
+      real_t delta_b[2] = { b[0] - pulled_b_[0], b[1] - pulled_b_[1] };
+      memcpy(buffer_.data() + pos, delta_b, sizeof(delta_b));
+    }
+    uint32 flags = (with_bias ? kPSWithBias : 0) |
+                   ((uint32)quant_ << kPSQuantShift);
+    PSHeader head = { kPSPush, flags, count, buffer_.size() };
+    if (!send(s, head, buffer_.data())) { return false; }
+  }
+  return true;
+}
+
+// The rows of the residual are allocated at the first push
+// of the features, and the lossless pushes need no residual
+real_t* PSClient::residual(index_t id, index_t row_len) {
+  if (quant_ == kWireFp32) { return nullptr; }
+  auto iter = residual_slot_.find(id);
+  if (iter == residual_slot_.end()) {
+    iter = residual_slot_.insert(
+        std::make_pair(id, (uint64)residual_.size())).first;
+    residual_.resize(residual_.size() + row_len, 0);
+  }
+  return residual_.data() + iter->second;
+}
+
+bool PSClient::Clock(uint64 clock) {
+  CHECK(!conns_.empty());
+  PSHeader head = { kPSClock, 0, clock, 0 };
+  return send(0, head, nullptr) &&
+         conns_[0]->RecvAll(&head, sizeof(head)) &&
+         head.type == kPSClock;
+}
+
+bool PSClient::Barrier() {
+  return all_servers(kPSBarrier);
+}
+
+bool PSClient::all_servers(PSMessageType type) {
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    PSHeader head = { (uint32)type, 0, 0, 0 };
+    if (!send(s, head, nullptr)) { return false; }
+  }
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    PSHeader head;
+    if (!conns_[s]->RecvAll(&head, sizeof(head)) ||
+        head.type != (uint32)type) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PSClient::Close() {
+  for (size_t s = 0; s < conns_.size(); ++s) {
+    conns_[s]->Close();
+  }
+  conns_.clear();
+}
+
+}  // namespace xLearn
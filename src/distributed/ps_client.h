@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the client of the parameter servers,
+which is used by the workers.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_PS_CLIENT_H_
+#define XLEARN_DISTRIBUTED_PS_CLIENT_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/model_parameters.h"
+#include "src/distributed/ps_message.h"
+#include "src/distributed/socket.h"
+#include "src/distributed/sparse_codec.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// PSClient connects a worker to all the servers. The worker trains a
+// small local model, whose i-th feature is the feature ids[i] of the
+// global model. The rows of ids are pulled into the local model before
+// a batch, and the deltas of the rows are pushed after the batch, so
+// the states of the updater are summed on the servers like the weights:
+//
+//   PSClient client;
+//   PSHello hello;  /* the structure of the model */
+//   client.Connect(servers, hello, &num_feature, &num_field);
+//   for each batch:
+//     client.Clock(clock++);   /* the bounded staleness */
+//     client.Pull(ids, &local_model);
+//     ... CalcGrad() on the local model ...
+//     client.Push(ids, &local_model);
+//   client.Clock(kPSDoneClock);
+//   client.Barrier();          /* all the pushes are applied */
+//   client.PullAll(&model);    /* the whole global model */
+//
+// The requests are sent to all the servers before the replies
+// are received, so the servers work at the same time. The deltas
+// of Push() can be quantized (SetQuant), and the error of each
+// row is kept by the client and added to its next push.
+//------------------------------------------------------------------------------
+class PSClient {
+ public:
+  PSClient() { }
+  ~PSClient() { Close(); }
+
+  // Connect to the servers ("host:port") and say hello, which
+  // returns the number of features and fields of the global model
+  bool Connect(const std::vector<std::string>& servers,
+               const PSHello& hello,
+               index_t* num_feature,
+               index_t* num_field);
+
+  // Pull the global features ids[i] into the i-th rows of the
+  // model, and the bias. The pulled rows are kept for Push()
+  bool Pull(const std::vector<index_t>& ids, Model* model);
+
+  // Push the changes of the rows and the bias since Pull()
+  bool Push(const std::vector<index_t>& ids, Model* model);
+
+  // Pull the whole global model, which has all the features
+  bool PullAll(Model* model);
+
+  // Tell the server 0 the clock of this worker, which returns
+  // when the slowest worker is at most staleness clocks behind
+  bool Clock(uint64 clock);
+
+  // Wait for all the workers
+  bool Barrier();
+
+  void Close();
+
+  inline size_t NumServers() const { return conns_.size(); }
+
+  // The quantization of the pushed deltas, kWireFp32 by default
+  void SetQuant(WireQuant quant) { quant_ = quant; }
+
+  // Bytes sent to the servers since Connect()
+  inline uint64 SentBytes() const { return sent_bytes_; }
+
+ protected:
+  std::vector<std::unique_ptr<Socket>> conns_;
+  /* The rows of the last Pull() and the bias */
+  std::vector<real_t> pulled_;
+  real_t pulled_b_[2];
+  /* The ids of each server and their rows in the model */
+  std::vector<std::vector<index_t>> ids_;
+  std::vector<std::vector<index_t>> rows_;
+  std::vector<char> buffer_;
+  std::vector<real_t> reply_;
+  std::vector<real_t> delta_;
+  WireQuant quant_ = kWireFp32;
+  uint64 sent_bytes_ = 0;
+  /* The error of quantization of the pushed rows, where the
+  row of the global feature f starts at residual_slot_[f] */
+  std::unordered_map<index_t, uint64> residual_slot_;
+  std::vector<real_t> residual_;
+
+  // Send the header and the payload to the server s
+  bool send(size_t s, const PSHeader& head, const void* data);
+
+  // The residual row of the global feature id, or nullptr
+  // if the pushes are not quantized
+  real_t* residual(index_t id, index_t row_len);
+
+  // Pull the global features ids_[s] of the servers into
+  // the rows rows_[s] of the model. The rows are kept
+  // in pulled_ if keep is true
+  bool pull_rows(Model* model, bool keep);
+
+  // Split the ids by the servers, which are sorted
+  void split_ids(const std::vector<index_t>& ids);
+
+  // Send the message to all the servers and
+  // receive the replies of the message type
+  bool all_servers(PSMessageType type);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PSClient);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_PS_CLIENT_H_
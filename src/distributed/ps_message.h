@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the messages between the parameter
+servers and the workers.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_PS_MESSAGE_H_
+#define XLEARN_DISTRIBUTED_PS_MESSAGE_H_
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Each message is a PSHeader followed by its payload of bytes bytes.
+// The model is sharded by the feature id, and the feature f is stored
+// in the server f % num_servers as its (f / num_servers)-th row. A row
+// has the linear_stride floats of the linear term (the weight and the
+// states of the updater) and the floats of the latent factor of the
+// feature, and the bias is stored in the server 0. The ids of the pulls
+// and pushes are sorted and delta-encoded (see sparse_codec.h):
+//
+//   kPSHello:   PSHello -> PSHelloReply, after the hello of all workers
+//   kPSPull:    count ids -> count rows (and the bias if kPSWithBias)
+//   kPSPush:    count ids, count rows of deltas quantized by the
+//               WireQuant of the flags >> kPSQuantShift (and the bias
+//               delta in float if kPSWithBias), no reply
+//   kPSClock:   count is the clock of the worker, and the reply is sent
+//               when the slowest worker is at most staleness clocks
+//               behind (only the server 0)
+//   kPSBarrier: the reply is sent when all the workers have sent the
+//               barrier, so all of their pushes have been applied
+//------------------------------------------------------------------------------
+enum PSMessageType {
+  kPSHello = 1,
+  kPSPull = 2,
+  kPSPush = 3,
+  kPSClock = 4,
+  kPSBarrier = 5
+};
+
+// The message of the bias
+const uint32 kPSWithBias = 1;
+
+// The WireQuant of the pushed deltas in the flags
+const uint32 kPSQuantShift = 8;
+
+// The clock of the worker that finishes its
+// training, which never blocks the others
+const uint64 kPSDoneClock = 0xFFFFFFFF;
+
+struct PSHeader {
+  uint32 type;
+  uint32 flags;
+  uint64 count;
+  uint64 bytes;
+};
+
+// The worker gives the structure of the model, and the
+// number of features of its own data
+struct PSHello {
+  uint32 worker_id;
+  uint32 num_workers;
+  uint32 server_id;
+  uint32 num_servers;
+  uint32 score_func;  /* 0: linear, 1: fm, 2: ffm */
+  uint32 num_feature;
+  uint32 num_field;
+  uint32 num_K;
+  uint32 linear_stride;
+  uint32 staleness;
+  real_t scale;
+  uint32 reserved;
+};
+
+// The number of features and fields of the model,
+// which is the max of all the workers
+struct PSHelloReply {
+  uint32 num_feature;
+  uint32 num_field;
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_PS_MESSAGE_H_
@@ -0,0 +1,165 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the parameter server and its client.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/stringprintf.h"
+#include "src/distributed/param_server.h"
+#include "src/distributed/ps_client.h"
+
+namespace xLearn {
+
+const int kNumServers = 2;
+const int kNumWorkers = 2;
+const index_t kK = 4;
+
+PSHello test_hello(uint32 worker_id, uint32 num_feature) {
+  PSHello hello;
+  memset(&hello, 0, sizeof(hello));
+  hello.worker_id = worker_id;
+  hello.num_workers = kNumWorkers;
+  hello.score_func = 1;  /* fm */
+  hello.num_feature = num_feature;
+  hello.num_K = kK;
+  hello.linear_stride = 2;
+  hello.staleness = 0;
+  hello.scale = 1.0;
+  return hello;
+}
+
+TEST(PSTest, Socket) {
+  std::string host;
+  uint16 port = 0;
+  EXPECT_TRUE(ParseAddress("127.0.0.1:9090", &host, &port));
+  EXPECT_EQ(host, "127.0.0.1");
+  EXPECT_EQ(port, 9090);
+  EXPECT_FALSE(ParseAddress("127.0.0.1", &host, &port));
+  EXPECT_FALSE(ParseAddress("127.0.0.1:", &host, &port));
+  EXPECT_FALSE(ParseAddress("host:99999", &host, &port));
+  Socket server;
+  ASSERT_TRUE(server.Listen(0));
+  ASSERT_GT(server.Port(), 0);
+  std::thread client([&server]() {
+    Socket conn;
+    ASSERT_TRUE(conn.Connect("127.0.0.1", server.Port(), 1));
+    uint64 value = 12345;
+    EXPECT_TRUE(conn.SendAll(&value, sizeof(value)));
+  });
+  Socket conn;
+  ASSERT_TRUE(server.Accept(&conn));
+  uint64 value = 0;
+  EXPECT_TRUE(conn.RecvAll(&value, sizeof(value)));
+  EXPECT_EQ(value, 12345);
+  client.join();
+  // The peer is closed
+  EXPECT_FALSE(conn.RecvAll(&value, sizeof(value)));
+}
+
+// Each worker adds 1.0 to the weights of its features and 0.5 to
+// the bias, and the features 1 and 5 are shared by both workers.
+// The deltas are exact in each quantization
+void test_pull_push(WireQuant quant) {
+  std::vector<std::unique_ptr<ParamServer>> servers;
+  std::vector<std::thread> threads;
+  std::vector<std::string> address;
+  for (int s = 0; s < kNumServers; ++s) {
+    servers.emplace_back(new ParamServer);
+    ASSERT_TRUE(servers[s]->Initialize(0, kNumWorkers));
+    address.push_back(StringPrintf("127.0.0.1:%d", servers[s]->Port()));
+    threads.emplace_back(&ParamServer::Run, servers[s].get());
+  }
+  std::vector<std::vector<index_t>> worker_ids = { {1, 5, 8}, {5, 1, 2} };
+  Model global;
+  for (int w = 0; w < kNumWorkers; ++w) {
+    threads.emplace_back([&, w]() {
+      PSClient client;
+      index_t num_feature = 0;
+      index_t num_field = 0;
+      ASSERT_TRUE(client.Connect(address,
+                                 test_hello(w, w == 0 ? 10 : 7),
+                                 &num_feature, &num_field));
+      EXPECT_EQ(num_feature, 10);
+      EXPECT_EQ(client.NumServers(), kNumServers);
+      client.SetQuant(quant);
+      Model local;
+      local.Initialize("fm", "squared", 4, num_field, kK, 1.0, 2);
+      const std::vector<index_t>& ids = worker_ids[w];
+      ASSERT_TRUE(client.Clock(0));
+      ASSERT_TRUE(client.Pull(ids, &local));
+      real_t* param_w = local.GetParameter_w();
+      for (size_t i = 0; i < ids.size(); ++i) {
+        EXPECT_FLOAT_EQ(param_w[i*2+1], 1.0);
+        param_w[i*2] += 1.0;
+      }
+      local.GetParameter_b()[0] += 0.5;
+      ASSERT_TRUE(client.Push(ids, &local));
+      // With no staleness, both workers pass the clock 1
+      // after the clock 0 of both
+      ASSERT_TRUE(client.Clock(1));
+      ASSERT_TRUE(client.Clock(kPSDoneClock));
+      ASSERT_TRUE(client.Barrier());
+      if (w == 0) {
+        global.Initialize("fm", "squared", num_feature,
+                          num_field, kK, 1.0, 2);
+        ASSERT_TRUE(client.PullAll(&global));
+      }
+      client.Close();
+    });
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  // The feature f is in the server f % 2
+  EXPECT_EQ(servers[0]->Shard().GetNumFeature(), 5);
+  EXPECT_EQ(servers[1]->Shard().GetNumFeature(), 5);
+  real_t* param_w = global.GetParameter_w();
+  real_t expected[] = { 0, 2, 1, 0, 0, 2, 0, 0, 1, 0 };
+  for (index_t f = 0; f < 10; ++f) {
+    EXPECT_FLOAT_EQ(param_w[f*2], expected[f]);
+    EXPECT_FLOAT_EQ(param_w[f*2+1], 1.0);
+  }
+  EXPECT_FLOAT_EQ(global.GetParameter_b()[0], 1.0);
+  EXPECT_FLOAT_EQ(global.GetParameter_b()[1], 1.0);
+  // The latent factor is unchanged
+  real_t* v = servers[1]->Shard().GetParameter_v();
+  real_t* global_v = global.GetParameter_v();
+  index_t v_len = global.GetNumParameter_v() / 10;
+  for (index_t j = 0; j < v_len; ++j) {
+    EXPECT_FLOAT_EQ(global_v[v_len+j], v[j]);
+  }
+}
+
+TEST(PSTest, PullPush) {
+  test_pull_push(kWireFp32);
+  test_pull_push(kWireFp16);
+  test_pull_push(kWireInt8);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of PSWorker.
+*/
+
+#include "src/distributed/ps_worker.h"
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+void PSWorker::Initialize(Reader* reader,
+                          Loss* loss,
+                          Metric* metric,
+                          Model* model,
+                          PSClient* client,
+                          int epoch,
+                          bool quiet) {
+  CHECK_NOTNULL(reader);
+  CHECK_NOTNULL(loss);
+  CHECK_NOTNULL(metric);
+  CHECK_NOTNULL(model);
+  CHECK_NOTNULL(client);
+  CHECK_GT(epoch, 0);
+  reader_ = reader;
+  loss_ = loss;
+  metric_ = metric;
+  model_ = model;
+  client_ = client;
+  epoch_ = epoch;
+  quiet_ = quiet;
+}
+
+// The nodes of local_ are the copy of the batch, and the
+// feature ids are replaced by the local ids
+void PSWorker::remap(const DMatrix* matrix) {
+  local_.ReuseMatrix(matrix->row_length);
+  local_.CopyRows(0, *matrix);
+  ids_.clear();
+  local_id_.clear();
+  for (size_t i = 0; i < local_.csr_node.size(); ++i) {
+    Node& node = local_.csr_node[i];
+    auto it = local_id_.find(node.feat_id);
+    if (it == local_id_.end()) {
+      it = local_id_.emplace(node.feat_id, ids_.size()).first;
+      ids_.push_back(node.feat_id);
+    }
+    node.feat_id = it->second;
+  }
+  if (matrix->HasRowCost()) { local_.row_cost = matrix->row_cost; }
+}
+
+void PSWorker::reserve_model(index_t num_feature) {
+  if (num_feature <= model_->GetNumFeature()) { return; }
+  index_t size = std::max(num_feature, model_->GetNumFeature() * 2);
+  std::string score_func = model_->GetScoreFunction();
+  std::string loss_func = model_->GetLossFunction();
+  index_t num_field = model_->GetNumField();
+  index_t num_K = model_->GetNumK();
+  index_t stride = model_->GetLinearStride();
+  model_->Release();
+  model_->Initialize(score_func, loss_func, size,
+                     num_field, num_K, 1.0, stride);
+}
+
+bool PSWorker::Train() {
+  std::vector<real_t> pred;
+  for (int n = 0; n < epoch_; ++n) {
+    Timer timer;
+    timer.tic();
+    metric_->Reset();
+    double loss_val = 0;
+    double weight_sum = 0;
+    reader_->Reset();
+    uint64 sent_bytes = client_->SentBytes();
+    DMatrix* matrix = nullptr;
+    int tmp = 0;
+    while ((tmp = reader_->Samples(matrix)) > 0) {
+      remap(matrix);
+      reserve_model(std::max((index_t)1, (index_t)ids_.size()));
+      if (!client_->Clock(clock_++) ||
+          !client_->Pull(ids_, model_)) {
+        return false;
+      }
+      loss_->CalcGrad(&local_, *model_, &pred);
+      if (!client_->Push(ids_, model_)) { return false; }
+      const real_t* weight = local_.HasWeight() ?
+                             local_.weight.data() : nullptr;
+      loss_val += loss_->EvaluteMetric(pred, local_.Y, metric_, weight);
+      for (int j = 0; j < tmp; ++j) {
+        weight_sum += loss_->row_weight(local_.Y[j]) *
+                      local_.RowWeight(j);
+      }
+      num_rows_ += tmp;
+    }
+    if (!quiet_) {
+      real_t loss = weight_sum > 0 ? loss_val / weight_sum : 0;
+      printf("  Epoch %d: Train loss: %.5f, Train %s: %.5f, "
+             "Time: %.2f sec, Sent: %.2f MB \n", n + 1, loss,
+             metric_->type().c_str(), metric_->GetMetric(), timer.toc(),
+             (double)(client_->SentBytes() - sent_bytes) / MB);
+      LOG(INFO) << "Epoch " << n + 1 << ": train loss " << loss << ", "
+                << metric_->type() << " " << metric_->GetMetric();
+    }
+  }
+  // The pushes of all the workers are applied
+  // after the barrier of all the servers
+  return client_->Clock(kPSDoneClock) && client_->Barrier();
+}
+
+}  // namespace xLearn
@@ -0,0 +1,101 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the worker of the parameter-server training.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_PS_WORKER_H_
+#define XLEARN_DISTRIBUTED_PS_WORKER_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/distributed/ps_client.h"
+#include "src/loss/loss.h"
+#include "src/loss/metric.h"
+#include "src/reader/reader.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// PSWorker trains the shard of data of one worker. The features of each
+// batch are renumbered into a small local model, whose rows are pulled
+// from the servers, updated by the same Loss and Score of the local
+// training, and pushed back as deltas. The batch c is started when the
+// slowest worker has finished the batch c - staleness - 1:
+//
+//   PSWorker worker;
+//   worker.Initialize(reader, loss, metric, local_model, &client, 10);
+//   worker.Train();
+//------------------------------------------------------------------------------
+class PSWorker {
+ public:
+  PSWorker() { local_.SetCSR(true); }
+  ~PSWorker() { }
+
+  // The local model is grown as needed, and
+  // the client is connected to the servers
+  void Initialize(Reader* reader,
+                  Loss* loss,
+                  Metric* metric,
+                  Model* model,
+                  PSClient* client,
+                  int epoch,
+                  bool quiet = false);
+
+  // Train the epochs, and wait for all the workers. Return
+  // false if the connection of the servers is broken
+  bool Train();
+
+  // The number of rows of this worker in training
+  inline uint64 NumRows() const { return num_rows_; }
+
+ protected:
+  Reader* reader_ = nullptr;
+  Loss* loss_ = nullptr;
+  Metric* metric_ = nullptr;
+  Model* model_ = nullptr;
+  PSClient* client_ = nullptr;
+  int epoch_ = 0;
+  bool quiet_ = false;
+  uint64 clock_ = 0;
+  uint64 num_rows_ = 0;
+  /* The batch of the local feature ids */
+  DMatrix local_;
+  /* The global feature of the local features */
+  std::vector<index_t> ids_;
+  std::unordered_map<index_t, index_t> local_id_;
+
+  // Renumber the features of the batch into local_
+  void remap(const DMatrix* matrix);
+
+  // Make room for the features of the batch
+  void reserve_model(index_t num_feature);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PSWorker);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_PS_WORKER_H_
@@ -0,0 +1,166 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of RingAllReduce.
+*/
+
+#include "src/distributed/ring_allreduce.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace xLearn {
+
+bool RingAllReduce::Initialize(const std::vector<std::string>& nodes,
+                               int rank) {
+  CHECK(!nodes.empty());
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, (int)nodes.size());
+  Close();
+  rank_ = rank;
+  size_ = nodes.size();
+  if (size_ == 1) { return true; }
+  std::string host;
+  uint16 port = 0;
+  if (!ParseAddress(nodes[rank], &host, &port)) {
+    LOG(ERROR) << "Illegal address of the node: " << nodes[rank];
+    return false;
+  }
+  Socket listener;
+  if (!listener.Listen(port)) { return false; }
+  // The next node is connected while the former one is accepted
+  const std::string& next = nodes[(rank + 1) % size_];
+  bool connected = false;
+  std::thread connect([&]() {
+    std::string next_host;
+    uint16 next_port = 0;
+    if (!ParseAddress(next, &next_host, &next_port)) {
+      LOG(ERROR) << "Illegal address of the node: " << next;
+      return;
+    }
+    uint32 id = rank_;
+    connected = next_.Connect(next_host, next_port, 60) &&
+                next_.SendAll(&id, sizeof(id));
+  });
+  uint32 prev_id = 0;
+  bool accepted = listener.Accept(&prev_) &&
+                  prev_.RecvAll(&prev_id, sizeof(prev_id));
+  connect.join();
+  listener.Close();
+  if (accepted && prev_id != (uint32)((rank + size_ - 1) % size_)) {
+    LOG(ERROR) << "The node " << prev_id << " is not the former node "
+               << "of the node " << rank;
+    accepted = false;
+  }
+  return connected && accepted;
+}
+
+bool RingAllReduce::exchange(const void* send, uint64 send_bytes,
+                             void* recv, uint64 recv_bytes) {
+  bool sent = false;
+  std::thread sender([&]() {
+    sent = next_.SendAll(send, send_bytes);
+  });
+  bool received = prev_.RecvAll(recv, recv_bytes);
+  sender.join();
+  return sent && received;
+}
+
+bool RingAllReduce::AllReduce(real_t* data, uint64 size) {
+  if (size_ == 1 || size == 0) { return true; }
+  uint64 chunk = (size + size_ - 1) / size_;
+  auto begin = [&](int c) { return std::min(size, (uint64)c * chunk); };
+  auto end = [&](int c) { return std::min(size, (uint64)(c + 1) * chunk); };
+  // After the reduce-scatter, the chunk rank + 1
+  // of this node has the sum of all the nodes
+  for (int s = 0; s < size_ - 1; ++s) {
+    int send_c = (rank_ - s + size_) % size_;
+    int recv_c = (rank_ - s - 1 + size_) % size_;
+    recv_.resize(end(recv_c) - begin(recv_c));
+    if (!exchange(data + begin(send_c),
+                  (end(send_c) - begin(send_c)) * sizeof(real_t),
+                  recv_.data(), recv_.size() * sizeof(real_t))) {
+      return false;
+    }
+    real_t* dst = data + begin(recv_c);
+    for (uint64 i = 0; i < recv_.size(); ++i) { dst[i] += recv_[i]; }
+  }
+  for (int s = 0; s < size_ - 1; ++s) {
+    int send_c = (rank_ + 1 - s + size_) % size_;
+    int recv_c = (rank_ - s + size_) % size_;
+    if (!exchange(data + begin(send_c),
+                  (end(send_c) - begin(send_c)) * sizeof(real_t),
+                  data + begin(recv_c),
+                  (end(recv_c) - begin(recv_c)) * sizeof(real_t))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The max of a node reaches all the others in N - 1 steps
+bool RingAllReduce::AllMax(index_t* value) {
+  CHECK_NOTNULL(value);
+  for (int s = 0; s < size_ - 1; ++s) {
+    index_t recv = 0;
+    if (!exchange(value, sizeof(*value), &recv, sizeof(recv))) {
+      return false;
+    }
+    *value = std::max(*value, recv);
+  }
+  return true;
+}
+
+bool RingAllReduce::Average(Model* model, bool active, int* num_active) {
+  CHECK_NOTNULL(model);
+  CHECK_NOTNULL(num_active);
+  real_t* b = model->GetParameter_b();
+  small_.assign(3, 0);
+  small_[0] = b[0];
+  small_[1] = b[1];
+  small_[2] = active ? 1 : 0;
+  if (!AllReduce(model->GetParameter_w(), model->GetNumParameter_w()) ||
+      !AllReduce(model->GetParameter_v(), model->GetNumParameter_v()) ||
+      !AllReduce(small_.data(), small_.size())) {
+    return false;
+  }
+  real_t scale = 1.0 / size_;
+  real_t* w = model->GetParameter_w();
+  for (index_t i = 0; i < model->GetNumParameter_w(); ++i) {
+    w[i] *= scale;
+  }
+  real_t* v = model->GetParameter_v();
+  for (uint64 i = 0; i < model->GetNumParameter_v(); ++i) {
+    v[i] *= scale;
+  }
+  b[0] = small_[0] * scale;
+  b[1] = small_[1] * scale;
+  *num_active = (int)(small_[2] + 0.5);
+  return true;
+}
+
+void RingAllReduce::Close() {
+  next_.Close();
+  prev_.Close();
+}
+
+}  // namespace xLearn
@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the ring allreduce of the data-parallel training,
+which averages the full replicas of the model on the nodes.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_RING_ALLREDUCE_H_
+#define XLEARN_DISTRIBUTED_RING_ALLREDUCE_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/model_parameters.h"
+#include "src/distributed/socket.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// RingAllReduce connects the nodes "host:port,host:port,..." into a ring,
+// where each node sends to the next node and receives from the former
+// one. The data is split into one chunk per node, which is summed in
+// the reduce-scatter steps and then spread in the allgather steps, so
+// each node sends and receives 2 * (N - 1) / N of the data:
+//
+//   RingAllReduce ring;
+//   ring.Initialize(nodes, rank);  /* rank is the index of this node */
+//   ring.AllReduce(data, size);    /* data becomes the sum of the nodes */
+//   ring.AllMax(&num_feature);     /* the max of the nodes */
+//
+//   /* Average the model of all the nodes, including the states of the
+//      updater. The nodes without batches of the epoch take part in the
+//      average with active = false, until num_active is 0 */
+//   int num_active = 0;
+//   ring.Average(model, active, &num_active);
+//
+// All the nodes must call the same sequence of AllReduce().
+//------------------------------------------------------------------------------
+class RingAllReduce {
+ public:
+  RingAllReduce() { }
+  ~RingAllReduce() { Close(); }
+
+  // Listen on the port of nodes[rank] and connect to the
+  // next node, which is retried for 60 seconds
+  bool Initialize(const std::vector<std::string>& nodes, int rank);
+
+  // Sum the data of all the nodes in place
+  bool AllReduce(real_t* data, uint64 size);
+
+  // Set value to the max of all the nodes
+  bool AllMax(index_t* value);
+
+  // Average the parameters of the model of all the nodes, and
+  // num_active is the number of the nodes with active = true
+  bool Average(Model* model, bool active, int* num_active);
+
+  void Close();
+
+  inline int Rank() const { return rank_; }
+  inline int Size() const { return size_; }
+
+ protected:
+  int rank_ = 0;
+  int size_ = 1;
+  /* To the next node and from the former node */
+  Socket next_;
+  Socket prev_;
+  std::vector<real_t> recv_;
+  /* The bias and the number of active nodes */
+  std::vector<real_t> small_;
+
+  // Send the bytes to the next node while receiving
+  // the bytes of the former node
+  bool exchange(const void* send, uint64 send_bytes,
+                void* recv, uint64 recv_bytes);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RingAllReduce);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_RING_ALLREDUCE_H_
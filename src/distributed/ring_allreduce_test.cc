@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the ring_allreduce.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/stringprintf.h"
+#include "src/distributed/ring_allreduce.h"
+
+namespace xLearn {
+
+const int kNumNodes = 3;
+
+// The free ports of the system
+std::vector<std::string> test_nodes(int num) {
+  std::vector<std::string> nodes;
+  for (int i = 0; i < num; ++i) {
+    Socket socket;
+    EXPECT_TRUE(socket.Listen(0));
+    nodes.push_back(StringPrintf("127.0.0.1:%d", socket.Port()));
+  }
+  return nodes;
+}
+
+TEST(RingAllReduceTest, AllReduce) {
+  std::vector<std::string> nodes = test_nodes(kNumNodes);
+  std::vector<std::thread> threads;
+  for (int r = 0; r < kNumNodes; ++r) {
+    threads.emplace_back([&nodes, r]() {
+      RingAllReduce ring;
+      ASSERT_TRUE(ring.Initialize(nodes, r));
+      EXPECT_EQ(ring.Rank(), r);
+      EXPECT_EQ(ring.Size(), kNumNodes);
+      index_t max = r * 7 % 5;
+      ASSERT_TRUE(ring.AllMax(&max));
+      EXPECT_EQ(max, 4);
+      // The sizes are not divided by the number of nodes
+      for (uint64 size = 1; size <= 10; ++size) {
+        std::vector<real_t> data(size);
+        for (uint64 i = 0; i < size; ++i) { data[i] = r * 100 + i; }
+        ASSERT_TRUE(ring.AllReduce(data.data(), size));
+        for (uint64 i = 0; i < size; ++i) {
+          EXPECT_FLOAT_EQ(data[i], 300 + 3 * i);
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+}
+
+TEST(RingAllReduceTest, Average) {
+  std::vector<std::string> nodes = test_nodes(kNumNodes);
+  std::vector<Model> models(kNumNodes);
+  std::vector<std::thread> threads;
+  for (int r = 0; r < kNumNodes; ++r) {
+    models[r].Initialize("fm", "squared", 5, 0, 4, 1.0, 2);
+    real_t* w = models[r].GetParameter_w();
+    for (index_t i = 0; i < models[r].GetNumParameter_w(); ++i) {
+      w[i] = r;
+    }
+    models[r].GetParameter_b()[0] = r * 3;
+    threads.emplace_back([&nodes, &models, r]() {
+      RingAllReduce ring;
+      ASSERT_TRUE(ring.Initialize(nodes, r));
+      int num_active = 0;
+      ASSERT_TRUE(ring.Average(&models[r], r != 0, &num_active));
+      EXPECT_EQ(num_active, kNumNodes - 1);
+    });
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  Model local;
+  local.Initialize("fm", "squared", 5, 0, 4, 1.0, 2);
+  for (int r = 0; r < kNumNodes; ++r) {
+    real_t* w = models[r].GetParameter_w();
+    for (index_t i = 0; i < models[r].GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(w[i], 1.0);
+    }
+    EXPECT_FLOAT_EQ(models[r].GetParameter_b()[0], 3.0);
+    // The same initial latent factor is unchanged
+    real_t* v = models[r].GetParameter_v();
+    for (index_t i = 0; i < models[r].GetNumParameter_v(); ++i) {
+      EXPECT_FLOAT_EQ(v[i], local.GetParameter_v()[i]);
+    }
+  }
+}
+
+TEST(RingAllReduceTest, SingleNode) {
+  RingAllReduce ring;
+  ASSERT_TRUE(ring.Initialize(std::vector<std::string>(1, "x"), 0));
+  real_t data[2] = { 1, 2 };
+  ASSERT_TRUE(ring.AllReduce(data, 2));
+  EXPECT_FLOAT_EQ(data[0], 1);
+  EXPECT_FLOAT_EQ(data[1], 2);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the xlearn_server tool, which is one of
+the parameter servers of the distributed training. The model is
+sharded by the feature id, and the servers are given to each worker
+in the same order (the i-th server is the server i):
+
+  xlearn_server -port <port> -workers <N>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/distributed/param_server.h"
+
+namespace {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_server -port <port> -workers <N> \n"
+"                                               \n"
+"  Serve one shard of the model for the distributed training, and exit after all the workers \n"
+"  are finished. Each worker is started by xlearn_train with the options: \n"
+"                                                                         \n"
+"     -ps host_0:port_0,host_1:port_1,... -worker <id> -num_workers <N> \n"
+"                                                                        \n"
+"OPTIONS: \n"
+"  -port <port>         :  The port to listen on. \n"
+"                                                \n"
+"  -workers <N>         :  Number of the workers of the training. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct ServerOption {
+  int port = 0;
+  int num_workers = 0;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], ServerOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "-port" || arg == "-workers") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      int value = atoi(argv[++i]);
+      if (value <= 0 || (arg == "-port" && value > 65535)) {
+        printf("[Error] Illegal %s : '%s' \n", arg.c_str(), argv[i]);
+        return false;
+      }
+      if (arg == "-port") {
+        option->port = value;
+      } else {
+        option->num_workers = value;
+      }
+    } else {
+      printf("[Error] Unknow option: %s \n", argv[i]);
+      return false;
+    }
+  }
+  return option->port > 0 && option->num_workers > 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  ServerOption option;
+  if (!parse_option(argc, argv, &option)) {
+    printf("%s", kUsage);
+    return 0;
+  }
+  Timer timer;
+  timer.tic();
+  xLearn::ParamServer server;
+  if (!server.Initialize(option.port, option.num_workers)) {
+    printf("[Error] Cannot listen on the port %d \n", option.port);
+    return 0;
+  }
+  printf("Serve %d workers on the port %d ... \n",
+         option.num_workers, option.port);
+  server.Run();
+  printf("Finish serving. Total time cost: %.2f sec\n", timer.toc());
+  return 0;
+}
@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of SharedModel.
+*/
+
+#include "src/distributed/shared_model.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace xLearn {
+
+static const uint64 kShmMagic = 0x314d4853444c58ULL;  /* "XLDSHM1" */
+
+// The atomics of the shared memory must be lock-free
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "The shared model needs the lock-free atomics");
+
+//------------------------------------------------------------------------------
+// The control file, which is zero-filled when it is created. The flags
+// are set with the release order after the values that they guard
+//------------------------------------------------------------------------------
+struct ShmControl {
+  std::atomic<uint64> magic;
+  std::atomic<uint32> num_workers;
+  /* The max structure of the workers is agreed */
+  std::atomic<uint32> agreed;
+  std::atomic<uint32> num_feature;
+  std::atomic<uint32> num_field;
+  /* The model is initialized by the worker 0 */
+  std::atomic<uint32> ready;
+  std::atomic<uint64> model_bytes;
+  /* The flags and the structure of each worker */
+  std::atomic<uint32> appeared[kMaxShmWorkers];
+  std::atomic<uint32> joined[kMaxShmWorkers];
+  std::atomic<uint32> feature[kMaxShmWorkers];
+  std::atomic<uint32> field[kMaxShmWorkers];
+  std::atomic<uint32> done[kMaxShmWorkers];
+};
+
+// The interval of polling the flags
+static const int kPollMillis = 10;
+
+static inline void poll_sleep() {
+  std::this_thread::sleep_for(std::chrono::milliseconds(kPollMillis));
+}
+
+bool SharedModel::lock_worker(int worker) {
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = worker;
+  lock.l_len = 1;
+  return fcntl(fd_, F_SETLK, &lock) == 0;
+}
+
+// The locks of this process are not reported by F_GETLK
+bool SharedModel::is_alive(int worker) {
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = worker;
+  lock.l_len = 1;
+  if (fcntl(fd_, F_GETLK, &lock) != 0) { return false; }
+  return lock.l_type != F_UNLCK;
+}
+
+bool SharedModel::wait_for(const std::atomic<uint32>& flag, int worker) {
+  while (flag.load(std::memory_order_acquire) == 0) {
+    if (!is_alive(worker)) {
+      return flag.load(std::memory_order_acquire) != 0;
+    }
+    poll_sleep();
+  }
+  return true;
+}
+
+// The worker 0 removes the stale files of a former run, whose
+// byte 0 is not locked, and the others retry until they open
+// the control file locked by a live worker 0
+bool SharedModel::Initialize(const std::string& name, int worker,
+                             int num_workers, int timeout) {
+  CHECK(!name.empty());
+  CHECK_GT(num_workers, 0);
+  CHECK_LE(num_workers, kMaxShmWorkers);
+  CHECK_GE(worker, 0);
+  CHECK_LT(worker, num_workers);
+  Close();
+  ctl_file_ = "/dev/shm/xlearn_" + name + ".ctl";
+  model_file_ = "/dev/shm/xlearn_" + name + ".model";
+  worker_ = worker;
+  num_workers_ = num_workers;
+  timeout_ = timeout;
+  if (worker == 0) {
+    fd_ = open(ctl_file_.c_str(), O_RDWR);
+    if (fd_ >= 0) {
+      bool in_use = is_alive(0);
+      close(fd_);
+      fd_ = -1;
+      if (in_use) {
+        LOG(ERROR) << "The shared model " << name
+                   << " is used by another run";
+        return false;
+      }
+    }
+    unlink(ctl_file_.c_str());
+    unlink(model_file_.c_str());
+    fd_ = open(ctl_file_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd_ < 0 || !lock_worker(0) ||
+        ftruncate(fd_, sizeof(ShmControl)) != 0) {
+      LOG(ERROR) << "Cannot create " << ctl_file_ << ": "
+                 << strerror(errno);
+      return false;
+    }
+    void* addr = mmap(nullptr, sizeof(ShmControl),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+      LOG(ERROR) << "Cannot map " << ctl_file_ << ": " << strerror(errno);
+      return false;
+    }
+    control_ = reinterpret_cast<ShmControl*>(addr);
+    control_->num_workers.store(num_workers);
+    control_->appeared[0].store(1);
+    control_->magic.store(kShmMagic, std::memory_order_release);
+    return true;
+  }
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(timeout);
+  for (;;) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      LOG(ERROR) << "The worker 0 of the shared model " << name
+                 << " does not start in " << timeout << " seconds";
+      return false;
+    }
+    fd_ = open(ctl_file_.c_str(), O_RDWR);
+    if (fd_ < 0) { poll_sleep(); continue; }
+    struct stat st;
+    if (!is_alive(0) || fstat(fd_, &st) != 0 ||
+        st.st_size != sizeof(ShmControl)) {
+      // The stale file, or the file is being created
+      close(fd_);
+      fd_ = -1;
+      poll_sleep();
+      continue;
+    }
+    void* addr = mmap(nullptr, sizeof(ShmControl),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+      LOG(ERROR) << "Cannot map " << ctl_file_ << ": " << strerror(errno);
+      return false;
+    }
+    control_ = reinterpret_cast<ShmControl*>(addr);
+    while (control_->magic.load(std::memory_order_acquire) != kShmMagic &&
+           is_alive(0)) {
+      poll_sleep();
+    }
+    if (control_->magic.load(std::memory_order_acquire) == kShmMagic) {
+      break;
+    }
+    Close();
+  }
+  if (control_->num_workers.load() != (uint32)num_workers) {
+    LOG(ERROR) << "The shared model " << name << " has "
+               << control_->num_workers.load() << " workers, not "
+               << num_workers;
+    return false;
+  }
+  if (!lock_worker(worker)) {
+    LOG(ERROR) << "The worker " << worker << " of the shared model "
+               << name << " is already running";
+    return false;
+  }
+  control_->appeared[worker].store(1, std::memory_order_release);
+  return true;
+}
+
+// The worker 0 waits for each worker, which should appear in
+// timeout seconds and then be alive until it joins
+bool SharedModel::AllMax(index_t* num_feature, index_t* num_field) {
+  CHECK(IsOpen());
+  control_->feature[worker_].store(*num_feature);
+  control_->field[worker_].store(*num_field);
+  control_->joined[worker_].store(1, std::memory_order_release);
+  if (worker_ != 0) {
+    if (!wait_for(control_->agreed, 0)) {
+      LOG(ERROR) << "The worker 0 of the shared model is lost";
+      return false;
+    }
+    *num_feature = control_->num_feature.load();
+    *num_field = control_->num_field.load();
+    return true;
+  }
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(timeout_);
+  for (int k = 1; k < num_workers_; ++k) {
+    while (control_->joined[k].load(std::memory_order_acquire) == 0) {
+      bool appeared = control_->appeared[k].load() != 0;
+      if ((appeared && !is_alive(k)) ||
+          (!appeared && std::chrono::steady_clock::now() > deadline)) {
+        if (control_->joined[k].load(std::memory_order_acquire) != 0) {
+          break;
+        }
+        LOG(ERROR) << "The worker " << k << " of the shared model "
+                   << "does not join";
+        return false;
+      }
+      poll_sleep();
+    }
+    *num_feature = std::max(*num_feature,
+                            (index_t)control_->feature[k].load());
+    *num_field = std::max(*num_field,
+                          (index_t)control_->field[k].load());
+  }
+  control_->num_feature.store(*num_feature);
+  control_->num_field.store(*num_field);
+  control_->agreed.store(1, std::memory_order_release);
+  return true;
+}
+
+char* SharedModel::Map(uint64 bytes) {
+  CHECK(IsOpen());
+  CHECK(model_ == nullptr);
+  CHECK_GT(bytes, 0);
+  int fd = -1;
+  if (worker_ == 0) {
+    fd = open(model_file_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, bytes) != 0) {
+      LOG(ERROR) << "Cannot create " << model_file_ << ": "
+                 << strerror(errno);
+      if (fd >= 0) { close(fd); }
+      return nullptr;
+    }
+    control_->model_bytes.store(bytes);
+  } else {
+    if (!wait_for(control_->ready, 0)) {
+      LOG(ERROR) << "The worker 0 of the shared model is lost";
+      return nullptr;
+    }
+    if (control_->model_bytes.load() != bytes) {
+      LOG(ERROR) << "The shared model has " << control_->model_bytes.load()
+                 << " bytes, not " << bytes;
+      return nullptr;
+    }
+    fd = open(model_file_.c_str(), O_RDWR);
+    if (fd < 0) {
+      LOG(ERROR) << "Cannot open " << model_file_ << ": "
+                 << strerror(errno);
+      return nullptr;
+    }
+  }
+  // The mapping is kept after the file is closed
+  void* addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    LOG(ERROR) << "Cannot map " << model_file_ << ": " << strerror(errno);
+    return nullptr;
+  }
+  model_ = reinterpret_cast<char*>(addr);
+  model_bytes_ = bytes;
+  return model_;
+}
+
+void SharedModel::Publish() {
+  CHECK_EQ(worker_, 0);
+  CHECK(model_ != nullptr);
+  control_->ready.store(1, std::memory_order_release);
+}
+
+bool SharedModel::Finish() {
+  CHECK(IsOpen());
+  control_->done[worker_].store(1, std::memory_order_release);
+  if (worker_ != 0) { return true; }
+  bool all_done = true;
+  for (int k = 1; k < num_workers_; ++k) {
+    if (!wait_for(control_->done[k], k)) {
+      LOG(ERROR) << "The worker " << k << " of the shared model is lost";
+      all_done = false;
+    }
+  }
+  return all_done;
+}
+
+// Closing the file releases the lock of this process
+void SharedModel::Close() {
+  if (model_ != nullptr) {
+    munmap(model_, model_bytes_);
+    model_ = nullptr;
+  }
+  if (control_ != nullptr) {
+    munmap(control_, sizeof(ShmControl));
+    control_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+    if (worker_ == 0) {
+      unlink(ctl_file_.c_str());
+      unlink(model_file_.c_str());
+    }
+  }
+}
+
+}  // namespace xLearn
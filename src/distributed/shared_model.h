@@ -0,0 +1,122 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the shared memory of the model that is
+trained by several processes on the same host.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_SHARED_MODEL_H_
+#define XLEARN_DISTRIBUTED_SHARED_MODEL_H_
+
+#include <atomic>
+#include <string>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Max number of the processes of a shared model
+const int kMaxShmWorkers = 256;
+
+struct ShmControl;
+
+//------------------------------------------------------------------------------
+// SharedModel lets num_workers processes on one host train a single model
+// in a shared-memory segment, where each process has its own threads and
+// updates the shared parameters without locks (like the Hogwild threads).
+// The processes meet in the control file /dev/shm/xlearn_<name>.ctl, which
+// is created by the worker 0, and the model is /dev/shm/xlearn_<name>.model:
+//
+//   SharedModel shm;
+//   shm.Initialize(name, worker, num_workers);   /* before loading data */
+//   shm.AllMax(&num_feature, &num_field);        /* the structure */
+//   char* addr = shm.Map(bytes);       /* the worker 0 creates the model,
+//                                         and the others wait for it */
+//   if (worker == 0) {
+//     ... initialize the model at addr ...
+//     shm.Publish();
+//   }
+//   ... train the model at addr ...
+//   shm.Finish();   /* the worker 0 waits for all the processes */
+//   ... the worker 0 saves the model ...
+//   shm.Close();    /* the worker 0 removes the files */
+//
+// Each process holds a lock on its own byte of the control file, so the
+// processes find a lost process (or the stale files of a former run) by
+// the lock, which is released by the system when the process exits.
+//------------------------------------------------------------------------------
+class SharedModel {
+ public:
+  SharedModel() { }
+  ~SharedModel() { Close(); }
+
+  // Join the processes of the name. The worker 0 creates the control
+  // file, which the others wait for at most timeout seconds
+  bool Initialize(const std::string& name, int worker,
+                  int num_workers, int timeout = 60);
+
+  // Set the number of features and fields to the max of all the
+  // processes, which waits for the processes that are alive
+  bool AllMax(index_t* num_feature, index_t* num_field);
+
+  // Map the shared model of bytes bytes. The worker 0 creates it,
+  // and the others wait for Publish() of the worker 0. Return
+  // nullptr if the worker 0 is lost
+  char* Map(uint64 bytes);
+
+  // The model at the address of Map() is initialized
+  void Publish();
+
+  // This process finishes the training, and the worker 0 waits for
+  // the others. Return false if some process is lost
+  bool Finish();
+
+  // Unmap the model, and the worker 0 removes the files
+  void Close();
+
+  inline bool IsOpen() const { return control_ != nullptr; }
+
+ protected:
+  std::string ctl_file_;
+  std::string model_file_;
+  int worker_ = 0;
+  int num_workers_ = 1;
+  int timeout_ = 60;
+  int fd_ = -1;
+  ShmControl* control_ = nullptr;
+  char* model_ = nullptr;
+  uint64 model_bytes_ = 0;
+
+  // Lock the byte of the worker in the control file, and check
+  // whether the lock of a worker is held by another process
+  bool lock_worker(int worker);
+  bool is_alive(int worker);
+
+  // Wait until the flag is set, or the worker is lost
+  bool wait_for(const std::atomic<uint32>& flag, int worker);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SharedModel);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_SHARED_MODEL_H_
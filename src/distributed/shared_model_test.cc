@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the shared_model.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/stringprintf.h"
+#include "src/data/model_parameters.h"
+#include "src/distributed/shared_model.h"
+
+namespace xLearn {
+
+const int kNumWorkers = 3;
+const uint64 kBytes = 4096 * 3;
+
+// The worker k > 0 runs in a child process, since the locks of
+// the control file are held by the processes
+int run_worker(const std::string& name, int k) {
+  SharedModel shm;
+  if (!shm.Initialize(name, k, kNumWorkers, 10)) { return 1; }
+  index_t num_feature = 10 * (k + 1);
+  index_t num_field = k;
+  if (!shm.AllMax(&num_feature, &num_field)) { return 2; }
+  if (num_feature != 10 * kNumWorkers ||
+      num_field != kNumWorkers - 1) { return 3; }
+  char* addr = shm.Map(kBytes);
+  if (addr == nullptr) { return 4; }
+  for (uint64 i = kNumWorkers; i < kBytes; ++i) {
+    if (addr[i] != (char)(i % 101)) { return 5; }
+  }
+  addr[k] = (char)k;
+  if (!shm.Finish()) { return 6; }
+  return 0;
+}
+
+TEST(SharedModelTest, Workers) {
+  std::string name = StringPrintf("test_%d", getpid());
+  SharedModel shm;
+  ASSERT_TRUE(shm.Initialize(name, 0, kNumWorkers, 10));
+  std::vector<pid_t> children;
+  for (int k = 1; k < kNumWorkers; ++k) {
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) { _exit(run_worker(name, k)); }
+    children.push_back(pid);
+  }
+  index_t num_feature = 10;
+  index_t num_field = 0;
+  ASSERT_TRUE(shm.AllMax(&num_feature, &num_field));
+  EXPECT_EQ(num_feature, 10 * kNumWorkers);
+  EXPECT_EQ(num_field, kNumWorkers - 1);
+  char* addr = shm.Map(kBytes);
+  ASSERT_TRUE(addr != nullptr);
+  for (uint64 i = 0; i < kBytes; ++i) { addr[i] = (char)(i % 101); }
+  shm.Publish();
+  EXPECT_TRUE(shm.Finish());
+  for (int k = 1; k < kNumWorkers; ++k) {
+    EXPECT_EQ(addr[k], (char)k);
+  }
+  for (size_t i = 0; i < children.size(); ++i) {
+    int status = 0;
+    EXPECT_EQ(waitpid(children[i], &status, 0), children[i]);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+  }
+  shm.Close();
+  EXPECT_NE(access(("/dev/shm/xlearn_" + name + ".ctl").c_str(), F_OK), 0);
+}
+
+// The worker 0 finds the lost worker by its lock
+TEST(SharedModelTest, LostWorker) {
+  std::string name = StringPrintf("lost_%d", getpid());
+  SharedModel shm;
+  ASSERT_TRUE(shm.Initialize(name, 0, 2, 10));
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    SharedModel worker;
+    _exit(worker.Initialize(name, 1, 2, 10) ? 0 : 1);
+  }
+  int status = 0;
+  EXPECT_EQ(waitpid(pid, &status, 0), pid);
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+  index_t num_feature = 1;
+  index_t num_field = 1;
+  EXPECT_FALSE(shm.AllMax(&num_feature, &num_field));
+}
+
+// The model of InitShared() has the same values as Initialize()
+TEST(SharedModelTest, InitShared) {
+  uint64 bytes = Model::SharedBytes("ffm", 10, 3, 4, 2);
+  std::vector<char> buf(bytes + 4096);
+  char* addr = buf.data() + (4096 - (uint64)buf.data() % 4096) % 4096;
+  Model shared;
+  shared.InitShared("ffm", "cross-entropy", 10, 3, 4, 0.66, 2, addr, true);
+  EXPECT_TRUE(shared.IsShared());
+  Model model;
+  model.Initialize("ffm", "cross-entropy", 10, 3, 4, 0.66, 2);
+  EXPECT_EQ(shared.GetNumParameter_w(), model.GetNumParameter_w());
+  EXPECT_EQ(shared.GetNumParameter_v(), model.GetNumParameter_v());
+  EXPECT_GE(shared.GetParameter_w(), (real_t*)addr);
+  EXPECT_LE(shared.GetParameter_v() + shared.GetNumParameter_v(),
+            (real_t*)(addr + bytes));
+}
+
+}  // namespace xLearn
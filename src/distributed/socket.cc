@@ -0,0 +1,252 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of Socket.
+*/
+
+#include "src/distributed/socket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+namespace xLearn {
+
+bool Socket::Listen(uint16 port, int backlog) {
+  Close();
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Cannot create socket: " << strerror(errno);
+    return false;
+  }
+  int on = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(fd_, backlog) != 0) {
+    LOG(ERROR) << "Cannot listen on port " << port << ": "
+               << strerror(errno);
+    Close();
+    return false;
+  }
+  return true;
+}
+
+// The path should fit in sun_path with its '\0'
+static bool unix_address(const std::string& path, sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    LOG(ERROR) << "Illegal path of Unix socket: " << path;
+    return false;
+  }
+  memcpy(addr->sun_path, path.data(), path.size());
+  return true;
+}
+
+bool Socket::ListenUnix(const std::string& path, int backlog) {
+  Close();
+  sockaddr_un addr;
+  if (!unix_address(path, &addr)) { return false; }
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Cannot create socket: " << strerror(errno);
+    return false;
+  }
+  unlink(path.c_str());
+  if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(fd_, backlog) != 0) {
+    LOG(ERROR) << "Cannot listen on " << path << ": "
+               << strerror(errno);
+    Close();
+    return false;
+  }
+  return true;
+}
+
+uint16 Socket::Port() const {
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (fd_ < 0 || getsockname(fd_, (sockaddr*)&addr, &len) != 0) {
+    return 0;
+  }
+  return ntohs(addr.sin_port);
+}
+
+bool Socket::Accept(Socket* conn) {
+  CHECK_NOTNULL(conn);
+  conn->Close();
+  for (;;) {
+    int fd = accept(fd_, nullptr, nullptr);
+    if (fd >= 0) {
+      conn->fd_ = fd;
+      conn->set_no_delay();
+      return true;
+    }
+    // The listener of Shutdown() gives EINVAL
+    if (errno == EINVAL) { return false; }
+    if (errno != EINTR) {
+      LOG(ERROR) << "Cannot accept connection: " << strerror(errno);
+      return false;
+    }
+  }
+}
+
+// The numeric address is used as is, otherwise
+// the host name is resolved
+static bool resolve(const std::string& host, in_addr* addr) {
+  if (inet_pton(AF_INET, host.c_str(), addr) == 1) { return true; }
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = nullptr;
+  if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 ||
+      result == nullptr) {
+    return false;
+  }
+  *addr = ((sockaddr_in*)result->ai_addr)->sin_addr;
+  freeaddrinfo(result);
+  return true;
+}
+
+bool Socket::Connect(const std::string& host, uint16 port, int timeout) {
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (!resolve(host, &addr.sin_addr)) {
+    LOG(ERROR) << "Cannot resolve host: " << host;
+    return false;
+  }
+  for (int i = 0; ; ++i) {
+    Close();
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+      LOG(ERROR) << "Cannot create socket: " << strerror(errno);
+      return false;
+    }
+    if (connect(fd_, (sockaddr*)&addr, sizeof(addr)) == 0) {
+      set_no_delay();
+      return true;
+    }
+    if (i >= timeout) { break; }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+  LOG(ERROR) << "Cannot connect to " << host << ":" << port
+             << ": " << strerror(errno);
+  Close();
+  return false;
+}
+
+bool Socket::ConnectUnix(const std::string& path, int timeout) {
+  sockaddr_un addr;
+  if (!unix_address(path, &addr)) { return false; }
+  for (int i = 0; ; ++i) {
+    Close();
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+      LOG(ERROR) << "Cannot create socket: " << strerror(errno);
+      return false;
+    }
+    if (connect(fd_, (sockaddr*)&addr, sizeof(addr)) == 0) {
+      return true;
+    }
+    if (i >= timeout) { break; }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+  LOG(ERROR) << "Cannot connect to " << path << ": " << strerror(errno);
+  Close();
+  return false;
+}
+
+bool Socket::SendAll(const void* buf, uint64 size) {
+  const char* p = (const char*)buf;
+  while (size > 0) {
+    ssize_t n = send(fd_, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool Socket::RecvAll(void* buf, uint64 size) {
+  char* p = (char*)buf;
+  while (size > 0) {
+    ssize_t n = recv(fd_, p, size, 0);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+void Socket::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void Socket::Shutdown() {
+  if (fd_ >= 0) { shutdown(fd_, SHUT_RDWR); }
+}
+
+// It is not supported by the Unix domain socket, which
+// has no Nagle's algorithm
+void Socket::set_no_delay() {
+  int on = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+bool ParseAddress(const std::string& address,
+                  std::string* host,
+                  uint16* port) {
+  size_t pos = address.rfind(':');
+  if (pos == std::string::npos || pos == 0 ||
+      pos + 1 == address.size()) {
+    return false;
+  }
+  char* end = nullptr;
+  long value = strtol(address.c_str() + pos + 1, &end, 10);
+  if (*end != '\0' || value <= 0 || value > 65535) { return false; }
+  *host = address.substr(0, pos);
+  *port = (uint16)value;
+  return true;
+}
+
+}  // namespace xLearn
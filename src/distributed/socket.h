@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the blocking TCP socket used by the
+parameter server and its workers.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_SOCKET_H_
+#define XLEARN_DISTRIBUTED_SOCKET_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Socket is a blocking TCP connection or a listening socket. All the
+// messages are sent and received in whole, and a false return means
+// that the peer is closed or the connection is broken:
+//
+//   Socket server;
+//   server.Listen(9090);  /* or 0 for any free port, see Port() */
+//   Socket conn;
+//   server.Accept(&conn);
+//   conn.RecvAll(buf, size);
+//
+//   Socket client;
+//   client.Connect("127.0.0.1", 9090, 60);  /* retry for 60 sec */
+//   client.SendAll(buf, size);
+//
+// The Unix domain sockets (ListenUnix() and ConnectUnix()) are used in
+// the same way by the processes of one host.
+//------------------------------------------------------------------------------
+class Socket {
+ public:
+  Socket() : fd_(-1) { }
+  ~Socket() { Close(); }
+
+  // Listen on the port of all the interfaces, and the
+  // port 0 means any free port of the system
+  bool Listen(uint16 port, int backlog = 64);
+
+  // Listen on the Unix domain socket of the path, which
+  // replaces the stale socket file of the path
+  bool ListenUnix(const std::string& path, int backlog = 64);
+
+  // The port of the listening socket
+  uint16 Port() const;
+
+  // Accept a connection into conn
+  bool Accept(Socket* conn);
+
+  // Connect to the host (a name or an IPv4 address) and port,
+  // which is retried every second for timeout seconds, so the
+  // workers can be started before the servers
+  bool Connect(const std::string& host, uint16 port, int timeout);
+
+  // Connect to the Unix domain socket of the path, which is
+  // retried every second for timeout seconds
+  bool ConnectUnix(const std::string& path, int timeout);
+
+  // Send or receive exactly size bytes
+  bool SendAll(const void* buf, uint64 size);
+  bool RecvAll(void* buf, uint64 size);
+
+  void Close();
+
+  // Shut down the connection or the listening socket without
+  // closing it, so the Accept() and the RecvAll() blocked in
+  // the other threads return false
+  void Shutdown();
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+ private:
+  int fd_;
+
+  // Disable the Nagle's algorithm for the small messages
+  void set_no_delay();
+
+  DISALLOW_COPY_AND_ASSIGN(Socket);
+};
+
+// Split "host:port" into the host and the port.
+// Return false for the illegal address
+bool ParseAddress(const std::string& address,
+                  std::string* host,
+                  uint16* port);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_SOCKET_H_
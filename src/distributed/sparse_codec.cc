@@ -0,0 +1,197 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the wire format of sparse updates.
+*/
+
+#include "src/distributed/sparse_codec.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace xLearn {
+
+bool ParseWireQuant(const std::string& name, WireQuant* quant) {
+  if (name.compare("fp32") == 0) {
+    *quant = kWireFp32;
+  } else if (name.compare("fp16") == 0) {
+    *quant = kWireFp16;
+  } else if (name.compare("int8") == 0) {
+    *quant = kWireInt8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The varint has 7 bits per byte, and the high
+// bit tells that more bytes follow
+void EncodeIds(const index_t* ids, size_t count, std::vector<char>* out) {
+  index_t last = 0;
+  for (size_t i = 0; i < count; ++i) {
+    CHECK(i == 0 || ids[i] > last);
+    uint32 gap = ids[i] - last;
+    last = ids[i];
+    while (gap >= 0x80) {
+      out->push_back((char)((gap & 0x7F) | 0x80));
+      gap >>= 7;
+    }
+    out->push_back((char)gap);
+  }
+}
+
+uint64 DecodeIds(const char* data, uint64 size,
+                 uint64 count, index_t* ids) {
+  const uint8* p = reinterpret_cast<const uint8*>(data);
+  uint64 pos = 0;
+  uint64 last = 0;
+  for (uint64 i = 0; i < count; ++i) {
+    uint64 gap = 0;
+    for (int shift = 0; ; shift += 7) {
+      if (pos >= size || shift > 28) { return 0; }
+      uint8 byte = p[pos++];
+      gap |= (uint64)(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) { break; }
+    }
+    last += gap;
+    if ((i > 0 && gap == 0) || last > 0xFFFFFFFFULL) { return 0; }
+    ids[i] = (index_t)last;
+  }
+  return pos;
+}
+
+uint64 WireRowBytes(WireQuant quant, index_t len) {
+  switch (quant) {
+    case kWireFp16:
+      return (uint64)len * sizeof(uint16);
+    case kWireInt8:
+      return sizeof(real_t) + len;
+    default:
+      return (uint64)len * sizeof(real_t);
+  }
+}
+
+void EncodeRow(WireQuant quant, const real_t* row, index_t len,
+               real_t* residual, char* out) {
+  if (quant == kWireFp32) {
+    memcpy(out, row, len * sizeof(real_t));
+    return;
+  }
+  bool feedback = residual != nullptr;
+  if (quant == kWireFp16) {
+    for (index_t k = 0; k < len; ++k) {
+      real_t value = row[k] + (feedback ? residual[k] : 0);
+      uint16 half = FloatToHalf(value);
+      memcpy(out + k * sizeof(uint16), &half, sizeof(uint16));
+      if (feedback) { residual[k] = value - HalfToFloat(half); }
+    }
+    return;
+  }
+  // kWireInt8
+  real_t max_abs = 0;
+  for (index_t k = 0; k < len; ++k) {
+    real_t value = row[k] + (feedback ? residual[k] : 0);
+    max_abs = std::max(max_abs, (real_t)fabs(value));
+  }
+  real_t scale = max_abs / 127;
+  memcpy(out, &scale, sizeof(real_t));
+  int8* q = reinterpret_cast<int8*>(out + sizeof(real_t));
+  for (index_t k = 0; k < len; ++k) {
+    real_t value = row[k] + (feedback ? residual[k] : 0);
+    int level = scale > 0 ? (int)lrintf(value / scale) : 0;
+    level = std::max(-127, std::min(127, level));
+    q[k] = (int8)level;
+    if (feedback) { residual[k] = value - level * scale; }
+  }
+}
+
+void DecodeRow(WireQuant quant, const char* in, index_t len, real_t* row) {
+  if (quant == kWireFp32) {
+    memcpy(row, in, len * sizeof(real_t));
+  } else if (quant == kWireFp16) {
+    for (index_t k = 0; k < len; ++k) {
+      uint16 half;
+      memcpy(&half, in + k * sizeof(uint16), sizeof(uint16));
+      row[k] = HalfToFloat(half);
+    }
+  } else {
+    real_t scale;
+    memcpy(&scale, in, sizeof(real_t));
+    const int8* q = reinterpret_cast<const int8*>(in + sizeof(real_t));
+    for (index_t k = 0; k < len; ++k) {
+      row[k] = q[k] * scale;
+    }
+  }
+}
+
+// The float is 1-8-23 bits with the exponent bias 127, and the
+// half is 1-5-10 bits with the bias 15. The small values become
+// subnormal halfs, and the large ones become infinity
+uint16 FloatToHalf(real_t value) {
+  uint32 x;
+  memcpy(&x, &value, sizeof(x));
+  uint32 sign = (x >> 16) & 0x8000;
+  uint32 raw_exp = (x >> 23) & 0xFF;
+  uint32 mant = x & 0x7FFFFF;
+  if (raw_exp == 0xFF) {
+    // Infinity and NaN
+    return sign | 0x7C00 | (mant != 0 ? 0x200 : 0);
+  }
+  int exp = (int)raw_exp - 127 + 15;
+  if (exp >= 31) { return sign | 0x7C00; }
+  if (exp <= 0) {
+    if (exp < -10) { return sign; }
+    mant |= 0x800000;
+    int shift = 14 - exp;
+    uint32 half = mant >> shift;
+    uint32 rest = mant & ((1u << shift) - 1);
+    uint32 middle = 1u << (shift - 1);
+    if (rest > middle || (rest == middle && (half & 1))) { half++; }
+    return sign | half;
+  }
+  // The carry of the rounding may increase the exponent
+  uint32 half = ((uint32)exp << 10) | (mant >> 13);
+  uint32 rest = mant & 0x1FFF;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) { half++; }
+  return sign | half;
+}
+
+real_t HalfToFloat(uint16 half) {
+  uint32 sign = (uint32)(half & 0x8000) << 16;
+  uint32 exp = (half >> 10) & 0x1F;
+  uint32 mant = half & 0x3FF;
+  uint32 x = 0;
+  if (exp == 0) {
+    // Zero and the subnormal half, which is mant * 2^-24
+    real_t value = mant * (1.0f / 16777216.0f);
+    return sign != 0 ? -value : value;
+  } else if (exp == 31) {
+    x = sign | 0x7F800000 | (mant << 13);
+  } else {
+    x = sign | ((exp + 112) << 23) | (mant << 13);
+  }
+  real_t value;
+  memcpy(&value, &x, sizeof(value));
+  return value;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the wire format of the sparse updates that are
+exchanged between the workers and the parameter servers.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_SPARSE_CODEC_H_
+#define XLEARN_DISTRIBUTED_SPARSE_CODEC_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// A sparse update is a list of sorted feature ids and one row of values
+// for each id. The ids are delta-encoded, i.e., the gap to the former id
+// is written as a varint of 1 ~ 5 bytes, so the ids of a batch mostly
+// take 1 or 2 bytes instead of 4. The values of each row are quantized:
+//
+//   kWireFp32: 4 bytes per value, lossless
+//   kWireFp16: 2 bytes per value (IEEE half precision)
+//   kWireInt8: a float scale of the row (max |value| / 127) and
+//              1 byte per value
+//
+// The error of the quantization is fed back: the encoder adds the residual
+// of the row to its values and keeps the new residual, so the error is sent
+// in the next update of the row, and the sum of the decoded updates follows
+// the sum of the updates. We can use it like this:
+//
+//   std::vector<char> buf;
+//   EncodeIds(ids, count, &buf);
+//   size_t pos = buf.size();
+//   buf.resize(pos + count * WireRowBytes(quant, len));
+//   for (i = 0; i < count; ++i) {
+//     EncodeRow(quant, rows[i], len, residual[i], buf.data() + pos);
+//     pos += WireRowBytes(quant, len);
+//   }
+//------------------------------------------------------------------------------
+enum WireQuant {
+  kWireFp32 = 0,
+  kWireFp16 = 1,
+  kWireInt8 = 2
+};
+
+// Parse "fp32", "fp16" or "int8", and return false for the others
+bool ParseWireQuant(const std::string& name, WireQuant* quant);
+
+// Append the delta-encoded ids to out. The ids must be ascending
+void EncodeIds(const index_t* ids, size_t count, std::vector<char>* out);
+
+// Decode count ids from the size bytes of data, and return the number
+// of bytes that are read, or 0 if the data is broken
+uint64 DecodeIds(const char* data, uint64 size,
+                 uint64 count, index_t* ids);
+
+// Number of bytes of an encoded row of len values
+uint64 WireRowBytes(WireQuant quant, index_t len);
+
+// Encode the row plus the residual into out, and update the residual
+// by the error, which is skipped if residual is nullptr (or kWireFp32)
+void EncodeRow(WireQuant quant, const real_t* row, index_t len,
+               real_t* residual, char* out);
+
+// Decode the row of len values
+void DecodeRow(WireQuant quant, const char* in, index_t len, real_t* row);
+
+// IEEE half precision, rounding to the nearest even
+uint16 FloatToHalf(real_t value);
+real_t HalfToFloat(uint16 half);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_SPARSE_CODEC_H_
@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the sparse_codec.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+#include "src/distributed/sparse_codec.h"
+
+namespace xLearn {
+
+TEST(SparseCodecTest, Ids) {
+  std::vector<index_t> ids = { 0, 1, 127, 128, 16384, 3000000, 0xFFFFFFFF };
+  std::vector<char> buf;
+  EncodeIds(ids.data(), ids.size(), &buf);
+  // The gaps take 1 + 1 + 1 + 1 + 2 + 4 + 5 bytes
+  EXPECT_EQ(buf.size(), 15);
+  std::vector<index_t> out(ids.size());
+  EXPECT_EQ(DecodeIds(buf.data(), buf.size(), ids.size(), out.data()),
+            buf.size());
+  EXPECT_TRUE(out == ids);
+  // The truncated ids are broken
+  EXPECT_EQ(DecodeIds(buf.data(), buf.size() - 1,
+                      ids.size(), out.data()), 0);
+}
+
+TEST(SparseCodecTest, Half) {
+  EXPECT_EQ(FloatToHalf(0), 0);
+  EXPECT_EQ(FloatToHalf(1.0), 0x3C00);
+  EXPECT_EQ(FloatToHalf(-2.0), 0xC000);
+  EXPECT_EQ(FloatToHalf(65504), 0x7BFF);
+  EXPECT_EQ(FloatToHalf(1e6), 0x7C00);
+  // The smallest subnormal half
+  EXPECT_EQ(FloatToHalf(5.9604645e-8), 0x0001);
+  EXPECT_FLOAT_EQ(HalfToFloat(0x0001), 5.9604645e-8);
+  // Each half is converted back to itself
+  for (uint32 h = 0; h < 0x7C00; ++h) {
+    EXPECT_EQ(FloatToHalf(HalfToFloat(h)), h);
+    EXPECT_EQ(FloatToHalf(-HalfToFloat(h)), h | 0x8000);
+  }
+  // The relative error of the normal halfs
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<real_t> dist(-10, 10);
+  for (int i = 0; i < 10000; ++i) {
+    real_t value = dist(gen);
+    real_t half = HalfToFloat(FloatToHalf(value));
+    EXPECT_LE(fabs(half - value), fabs(value) / 2048 + 1e-7);
+  }
+}
+
+TEST(SparseCodecTest, ErrorFeedback) {
+  const index_t kLen = 20;
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<real_t> dist(-0.01, 0.01);
+  WireQuant quants[] = { kWireFp32, kWireFp16, kWireInt8 };
+  for (WireQuant quant : quants) {
+    std::vector<char> buf(WireRowBytes(quant, kLen));
+    std::vector<real_t> residual(kLen, 0);
+    std::vector<double> sum(kLen, 0), decoded_sum(kLen, 0);
+    std::vector<real_t> row(kLen), decoded(kLen);
+    for (int n = 0; n < 1000; ++n) {
+      for (index_t k = 0; k < kLen; ++k) {
+        // A small value beside a large one is lost by int8
+        row[k] = k == 0 ? 1.0 : dist(gen);
+        sum[k] += row[k];
+      }
+      EncodeRow(quant, row.data(), kLen, residual.data(), buf.data());
+      DecodeRow(quant, buf.data(), kLen, decoded.data());
+      for (index_t k = 0; k < kLen; ++k) {
+        decoded_sum[k] += decoded[k];
+      }
+    }
+    // The sum of the decoded rows differs from the sum of
+    // the rows by the last residual only
+    for (index_t k = 0; k < kLen; ++k) {
+      EXPECT_NEAR(decoded_sum[k] + residual[k], sum[k], 1e-3);
+      EXPECT_LE(fabs(residual[k]), 1.0 / 127);
+    }
+  }
+  EXPECT_EQ(WireRowBytes(kWireFp32, kLen), kLen * 4);
+  EXPECT_EQ(WireRowBytes(kWireFp16, kLen), kLen * 2);
+  EXPECT_EQ(WireRowBytes(kWireInt8, kLen), kLen + 4);
+}
+
+}  // namespace xLearn
@@ -21,64 +21,42 @@ This file is the implementation of CrossEntropyLoss class.
 
 #include "src/loss/cross_entropy_loss.h"
 
+#include "src/base/math_kernel.h"
+
 #include <thread>
 #include<atomic>
 
 namespace xLearn {
 
 // Given predictions (data samples) and labels, return
-// cross-entropy loss value
-real_t CrossEntropyLoss::Evalute(const std::vector<real_t>& pred,
-                                 const std::vector<real_t>& label) {
-  CHECK_NE(pred.empty(), true);
-  CHECK_NE(label.empty(), true);
-  real_t val = 0.0;
-  for (size_t i = 0; i < pred.size(); ++i) {
-    real_t y = label[i] > 0 ? 1.0 : -1.0;
-    val += log1p(exp(-y*pred[i]));
-  }
-  return val;
+// cross-entropy loss value, which is computed by the
+// SIMD exp() and log1p() of MathKernel
+real_t CrossEntropyLoss::Evalute(const real_t* pred,
+                                 const real_t* label,
+                                 size_t n) {
+  return GetMathKernel().log_loss(pred, label, n);
 }
 
-// Calculate gradient in one thread
-void cross_entropy_thread(const DMatrix* matrix,
-                        Model* model,
-                        Score* score_func,
-                        bool is_norm,
-                        index_t start,
-                        index_t end) {
-  CHECK_GT(end, start);
-  for (index_t i = start; i < end; ++i) {
-    SparseRow* row = matrix->row[i];
-    real_t norm = is_norm ? matrix->norm[i] : 1.0;
-    real_t score = score_func->CalcScore(row, *model, norm);
-    // partial gradient
-    real_t y = matrix->Y[i] > 0 ? 1.0 : -1.0;
-    real_t pg = -y/(1.0+(1.0/exp(-y*score)));
-    // real gradient and update
-    score_func->CalcGrad(row, *model, pg, norm);
+// The label (-1 or 1) and the partial
+// gradient of cross-entropy loss
+struct CrossEntropyPolicy {
+  static real_t Label(real_t y) { return y > 0 ? 1.0 : -1.0; }
+  static bool Grad(real_t score, real_t y, real_t* pg) {
+    *pg = -y/(1.0+(1.0/exp(-y*score)));
+    return true;
   }
-}
+};
 
 // Calculate gradient in multi-thread
 void CrossEntropyLoss::CalcGrad(const DMatrix* matrix,
-                                Model& model) {
-  CHECK_NOTNULL(matrix);
-  CHECK_GT(matrix->row_length, 0);
-  index_t row_len = matrix->row_length;
-  // multi-thread training
-  for (int i = 0; i < threadNumber_; ++i) {
-    index_t start = getStart(row_len, threadNumber_, i);
-    index_t end = getEnd(row_len, threadNumber_, i);
-    pool_->enqueue(std::bind(cross_entropy_thread,
-                             matrix,
-                             &model,
-                             score_func_,
-                             norm_,
-                             start,
-                             end));
-  }
-  pool_->Sync();
+                                Model& model,
+                                std::vector<real_t>* pred) {
+  calc_grad<CrossEntropyPolicy>(matrix, model, pred);
+}
+
+void CrossEntropyLoss::calc_rows(const RowBlock& block, Model* m,
+                                 real_t* score) {
+  grad_block<CrossEntropyPolicy>(block, m, score);
 }
 
 } // namespace xLearn
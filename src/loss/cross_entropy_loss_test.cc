@@ -25,6 +25,7 @@ This file tests the CrossEntropyLoss class.
 #include <vector>
 
 #include "src/loss/cross_entropy_loss.h"
+#include "src/score/linear_score.h"
 
 namespace xLearn {
 
@@ -56,4 +57,24 @@ TEST(CROSS_ENTROPY_LOSS, Evalute) {
   EXPECT_LT(val, 0.000001);
 }
 
+TEST(CROSS_ENTROPY_LOSS, Neg_Weight) {
+  std::vector<real_t> pred = {0.5, -0.3, 1.2, -2.0, 0.1};
+  std::vector<real_t> label = {1, 0, -1, 1, 0};
+  LinearScore score;
+  CrossEntropyLoss loss;
+  loss.Initialize(&score, true, 2);
+  real_t val = loss.EvaluteMetric(pred, label, nullptr);
+  EXPECT_NEAR(val, loss.Evalute(pred, label), 1e-5);
+  // The loss of each negative row is weighted
+  loss.SetNegWeight(3.0);
+  real_t expected = 0;
+  for (size_t i = 0; i < pred.size(); ++i) {
+    real_t weight = label[i] > 0 ? 1.0 : 3.0;
+    expected += weight * loss.Evalute(&pred[i], &label[i], 1);
+  }
+  EXPECT_NEAR(loss.EvaluteMetric(pred, label, nullptr), expected, 1e-5);
+  EXPECT_FLOAT_EQ(loss.row_weight(0), 3.0);
+  EXPECT_FLOAT_EQ(loss.row_weight(1), 1.0);
+}
+
 }  // namespace xLearn
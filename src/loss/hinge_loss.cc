@@ -24,12 +24,11 @@ This file is the implementation of HingeLoss class.
 namespace xLearn {
 
 // Given predictions and labels, return hinge loss value
-real_t HingeLoss::Evalute(const std::vector<real_t>& pred,
-                          const std::vector<real_t>& label) {
-  CHECK_EQ(pred.empty(), false);
-  CHECK_EQ(label.empty(), false);
+real_t HingeLoss::Evalute(const real_t* pred,
+                          const real_t* label,
+                          size_t n) {
   real_t val = 0.0;
-  for (size_t i = 0; i < pred.size(); ++i) {
+  for (size_t i = 0; i < n; ++i) {
     real_t y = label[i] > 0 ? 1.0 : -1.0;
     real_t tmp = pred[i] * y;
     if (tmp < 1.0) { val += (1.0-tmp); }
@@ -37,48 +36,29 @@ real_t HingeLoss::Evalute(const std::vector<real_t>& pred,
   return val;
 }
 
-// Calculate gradient in one thread
-void hinge_thread(const DMatrix* matrix,
-                  Model* model,
-                  Score* score_func,
-                  bool is_norm,
-                  index_t start,
-                  index_t end) {
-  CHECK_GT(end, start);
-  for (index_t i = start; i < end; ++i) {
-    SparseRow* row = matrix->row[i];
-    real_t norm = is_norm ? matrix->norm[i] : 1.0;
-    real_t score = score_func->CalcScore(row, *model, norm);
-    // partial gradient
-    real_t y = matrix->Y[i] > 0 ? 1.0 : -1.0;
+// The label (-1 or 1) and the partial gradient of hinge
+// loss, and the example is not updated if score*y >= 1
+struct HingePolicy {
+  static real_t Label(real_t y) { return y > 0 ? 1.0 : -1.0; }
+  static bool Grad(real_t score, real_t y, real_t* pg) {
     if (score*y < 1.0) {
-      // real gradient and update
-      real_t pg = -y;
-      // real gradient and update
-      score_func->CalcGrad(row, *model, pg, norm);
+      *pg = -y;
+      return true;
     }
+    return false;
   }
-}
+};
 
 // Calculate gradient in multi-thread
 void HingeLoss::CalcGrad(const DMatrix* matrix,
-                         Model& model) {
-  CHECK_NOTNULL(matrix);
-  CHECK_GT(matrix->row_length, 0);
-  index_t row_len = matrix->row_length;
-  // multi-thread training
-  for (int i = 0; i < threadNumber_; ++i) {
-    index_t start = getStart(row_len, threadNumber_, i);
-    index_t end = getEnd(row_len, threadNumber_, i);
-    pool_->enqueue(std::bind(hinge_thread,
-                             matrix,
-                             &model,
-                             score_func_,
-                             norm_,
-                             start,
-                             end));
-  }
-  pool_->Sync();
+                         Model& model,
+                         std::vector<real_t>* pred) {
+  calc_grad<HingePolicy>(matrix, model, pred);
+}
+
+void HingeLoss::calc_rows(const RowBlock& block, Model* m,
+                          real_t* score) {
+  grad_block<HingePolicy>(block, m, score);
 }
 
 } // namespace xLearn
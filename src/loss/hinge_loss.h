@@ -40,16 +40,24 @@ class HingeLoss : public Loss {
   ~HingeLoss() { }
 
   // Given predictions and labels, return hinge loss
-  real_t Evalute(const std::vector<real_t>& pred,
-                 const std::vector<real_t>& label);
+  using Loss::Evalute;
+  real_t Evalute(const real_t* pred,
+                 const real_t* label,
+                 size_t n);
 
   // Given data sample and current model, calculate gradient
-  // and update current model parameters
-  void CalcGrad(const DMatrix* data_matrix, Model& model);
+  // and update current model parameters, and return the
+  // score of each row in pred if it is not null
+  void CalcGrad(const DMatrix* data_matrix, Model& model,
+                std::vector<real_t>* pred = nullptr);
 
   // Return current loss type
   inline std::string loss_type() { return "hinge_loss"; }
 
+ protected:
+  // The rows of CalcGradMulti()
+  void calc_rows(const RowBlock& block, Model* m, real_t* score);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(HingeLoss);
 };
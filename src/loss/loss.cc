@@ -20,6 +20,10 @@ This file is the implementation of the base Loss class.
 */
 
 #include "src/loss/loss.h"
+
+#include <typeinfo>
+
+#include "src/base/stringprintf.h"
 #include "src/loss/squared_loss.h"
 #include "src/loss/hinge_loss.h"
 #include "src/loss/cross_entropy_loss.h"
@@ -34,6 +38,172 @@ REGISTER_LOSS("squared", SquaredLoss);
 REGISTER_LOSS("hinge", HingeLoss);
 REGISTER_LOSS("cross-entropy", CrossEntropyLoss);
 
+ScoreKind ScoreKindOf(const Score* score) {
+  if (score == nullptr) { return kScoreVirtual; }
+  const std::type_info& type = typeid(*score);
+  if (type == typeid(LinearScore)) { return kScoreLinear; }
+  if (type == typeid(FMScore) || type == typeid(FMScoreK4) ||
+      type == typeid(FMScoreK8) || type == typeid(FMScoreK16) ||
+      type == typeid(FMScoreK32)) {
+    return kScoreFM;
+  }
+  if (type == typeid(FFMScore) || type == typeid(FFMScoreK4) ||
+      type == typeid(FFMScoreK8) || type == typeid(FFMScoreK16) ||
+      type == typeid(FFMScoreK32)) {
+    return kScoreFFM;
+  }
+  return kScoreVirtual;
+}
+
+// Create the replicas for the model, or copy the
+// model to the replicas of it
+void Loss::begin_batch(Model& model) {
+  if (thread_mode_ == kThreadHogwild) { return; }
+  if (replica_.empty() || replica_[0]->GetReplicaOf() != &model) {
+    clear_replicas();
+    for (size_t i = 0; i < threadNumber_; ++i) {
+      Model* replica = new Model();
+      replica->InitReplica(model, thread_mode_ == kThreadLocalBias);
+      replica_.push_back(replica);
+    }
+    return;
+  }
+  for (size_t i = 0; i < replica_.size(); ++i) {
+    replica_[i]->PullReplica();
+  }
+}
+
+// Average the replicas into the model
+void Loss::end_batch(Model& model) {
+  if (thread_mode_ == kThreadHogwild) { return; }
+  model.MergeReplicas(replica_);
+}
+
+void Loss::CalcGradMulti(const DMatrix* matrix,
+                         const std::vector<Loss*>& losses,
+                         const std::vector<Model*>& models,
+                         std::vector<std::vector<real_t>>* preds) {
+  CHECK_NOTNULL(matrix);
+  CHECK_GT(matrix->row_length, 0);
+  CHECK_NE(losses.empty(), true);
+  CHECK_EQ(losses.size(), models.size());
+  size_t num = losses.size();
+  std::vector<real_t*> score(num, nullptr);
+  if (preds != nullptr) { preds->resize(num); }
+  for (size_t k = 0; k < num; ++k) {
+    CHECK_EQ(losses[k]->threadNumber_, losses[0]->threadNumber_);
+    if (preds != nullptr) {
+      (*preds)[k].resize(matrix->row_length);
+      score[k] = (*preds)[k].data();
+    }
+    losses[k]->begin_batch(*models[k]);
+  }
+  std::lock_guard<std::mutex> lock(losses[0]->loop_mutex_);
+  losses[0]->for_rows(matrix,
+    [&](size_t id, size_t start, size_t end) {
+      std::vector<Model*> m(num);
+      for (size_t k = 0; k < num; ++k) {
+        m[k] = losses[k]->thread_model(id, *models[k]);
+      }
+      // Each row is decoded once for all the models
+      RowBlock block;
+      for (size_t i = start; i < end; i += kMultiModelRows) {
+        block.Decode(matrix, i, std::min(i + kMultiModelRows, end));
+        for (size_t k = 0; k < num; ++k) {
+          losses[k]->calc_rows(block, m[k], score[k]);
+        }
+      }
+      // the last mini-batch of this thread
+      for (size_t k = 0; k < num; ++k) {
+        losses[k]->score_func_->FlushGrad();
+      }
+    });
+  for (size_t k = 0; k < num; ++k) {
+    losses[k]->end_batch(*models[k]);
+  }
+}
+
+void Loss::clear_replicas() {
+  for (size_t i = 0; i < replica_.size(); ++i) {
+    delete replica_[i];
+  }
+  replica_.clear();
+}
+
+void LoadStats::AddLoop(double wall_time,
+                        const std::vector<double>& begin,
+                        const std::vector<double>& end) {
+  wall += wall_time;
+  loops++;
+  double first_begin = wall_time, first_end = wall_time;
+  double last_end = 0, sum_end = 0;
+  size_t num = 0;
+  for (size_t i = 0; i < begin.size(); ++i) {
+    if (begin[i] < 0) { continue; }
+    first_begin = std::min(first_begin, begin[i]);
+    first_end = std::min(first_end, end[i]);
+    last_end = std::max(last_end, end[i]);
+    sum_end += end[i];
+    num++;
+  }
+  if (num == 0) { return; }
+  wakeup += first_begin;
+  tail += last_end - first_end;
+  double ratio = sum_end > 0 ? last_end * num / sum_end : 1.0;
+  straggler_sum += ratio;
+  straggler_max = std::max(straggler_max, ratio);
+}
+
+void LoadStats::Merge(const LoadStats& other) {
+  if (busy.size() < other.busy.size()) { busy.resize(other.busy.size()); }
+  for (size_t i = 0; i < other.busy.size(); ++i) {
+    busy[i] += other.busy[i];
+  }
+  wall += other.wall;
+  loops += other.loops;
+  wakeup += other.wakeup;
+  tail += other.tail;
+  straggler_sum += other.straggler_sum;
+  straggler_max = std::max(straggler_max, other.straggler_max);
+}
+
+std::string LoadStats::Report() const {
+  double sum_busy = 0, sum_idle = 0;
+  for (size_t i = 0; i < busy.size(); ++i) {
+    sum_busy += busy[i];
+    sum_idle += idle(i);
+  }
+  std::string res;
+  SStringPrintf(&res, "  Thread busy: %.3f sec, idle: %.3f sec "
+                "(%lu threads, %llu loops), imbalance: %.2f, "
+                "utilization: %.1f%%\n",
+                sum_busy, sum_idle, busy.size(),
+                (unsigned long long)loops, imbalance(),
+                utilization() * 100);
+  StringAppendF(&res, "  Straggler ratio (last / mean stop): "
+                "mean %.2f, max %.2f\n", straggler(), straggler_max);
+  StringAppendF(&res, "  Main thread in sync: %.3f sec (wake-up %.3f "
+                "sec, waiting for stragglers %.3f sec)\n",
+                wall, wakeup, tail);
+  return res;
+}
+
+uint64 Loss::MemorySize() const {
+  uint64 size = replica_.capacity() * sizeof(Model*) +
+                loss_partial_.capacity() * sizeof(double) +
+                (metric_partial_.capacity() - metric_partial_.size()) *
+                sizeof(MetricCounter) +
+                load_.busy.capacity() * sizeof(double);
+  for (size_t i = 0; i < metric_partial_.size(); ++i) {
+    size += metric_partial_[i].MemorySize();
+  }
+  for (size_t i = 0; i < replica_.size(); ++i) {
+    size += sizeof(Model) + replica_[i]->WeightBytes() +
+            replica_[i]->StateBytes();
+  }
+  return size;
+}
+
 // Predict in one thread
 void pred_thread(const DMatrix* matrix,
                  Model* model,
@@ -42,35 +212,145 @@ void pred_thread(const DMatrix* matrix,
                  bool is_norm,
                  index_t start,
                  index_t end) {
-  for (size_t i = start; i < end; ++i) {
-    SparseRow* row = matrix->row[i];
-    real_t norm = is_norm ? matrix->norm[i] : 1.0;
-    (*pred)[i] = score_func_->CalcScore(row, *model, norm);
-  }
+  if (end <= start) { return; }
+  score_func_->CalcScoreBatch(matrix, start, end, *model,
+                              is_norm, pred->data() + start);
 }
 
-// Predict in multi-thread
+// Predict in multi-thread, or in the thread of the caller
+// if another caller is running the loop of this Loss
 void Loss::Predict(const DMatrix* matrix,
                    Model& model,
                    std::vector<real_t>& pred) {
   CHECK_NOTNULL(matrix);
   CHECK_NE(pred.empty(), true);
   CHECK_EQ(pred.size(), matrix->row_length);
-  index_t row_len = matrix->row_length;
+  std::unique_lock<std::mutex> lock(loop_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    pred_thread(matrix, &model, &pred, score_func_,
+                norm_, 0, matrix->row_length);
+    return;
+  }
   // Predict in multi-thread
-  for (int i = 0; i < threadNumber_; ++i) {
-    index_t start = getStart(row_len, threadNumber_, i);
-    index_t end = getEnd(row_len, threadNumber_, i);
-    pool_->enqueue(std::bind(pred_thread,
-                             matrix,
-                             &model,
-                             &pred,
-                             score_func_,
-                             norm_,
-                             start,
-                             end));
-  }
-  pool_->Sync();
+  for_rows(matrix,
+    [&](size_t id, size_t start, size_t end) {
+      pred_thread(matrix, &model, &pred, score_func_,
+                  norm_, start, end);
+    });
+}
+
+// Reset the partial loss and metric counters
+// before the threads start
+static void reset_partial(std::vector<double>* loss,
+                          std::vector<MetricCounter>* counter) {
+  for (size_t i = 0; i < loss->size(); ++i) {
+    (*loss)[i] = 0;
+    (*counter)[i].Reset();
+  }
+}
+
+real_t Loss::merge_partial(Metric* metric) {
+  double loss_val = 0;
+  for (size_t i = 0; i < loss_partial_.size(); ++i) {
+    loss_val += loss_partial_[i];
+    if (metric != nullptr) { metric->Merge(metric_partial_[i]); }
+  }
+  return loss_val;
+}
+
+// Evaluate the loss and metric in multi-thread, or in the
+// thread of the caller as Predict()
+real_t Loss::EvaluteMetric(const std::vector<real_t>& pred,
+                           const std::vector<real_t>& label,
+                           Metric* metric,
+                           const real_t* weight) {
+  CHECK_NE(pred.empty(), true);
+  CHECK_GE(label.size(), pred.size());
+  std::vector<real_t> buf;
+  const real_t* y = task_labels(label.data(), pred.size(), &buf);
+  std::unique_lock<std::mutex> lock(loop_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    if (metric != nullptr) {
+      MetricCounter counter;
+      metric->Accumulate(y, pred.data(), pred.size(), &counter);
+      metric->Merge(counter);
+    }
+    return weighted_evalute(pred.data(), y, weight, pred.size(), true);
+  }
+  reset_partial(&loss_partial_, &metric_partial_);
+  pool_->ParallelFor(0, pred.size(), grain_,
+    [&](size_t id, size_t start, size_t end) {
+      loss_partial_[id] += weighted_evalute(
+          pred.data() + start, y + start,
+          weight != nullptr ? weight + start : nullptr,
+          end - start, true);
+      if (metric != nullptr) {
+        metric->Accumulate(y + start, pred.data() + start,
+                           end - start, &metric_partial_[id]);
+      }
+    }, schedule_);
+  return merge_partial(metric);
+}
+
+// The rows are evaluated one by one only if they are weighted
+real_t Loss::weighted_evalute(const real_t* pred,
+                              const real_t* label,
+                              const real_t* weight,
+                              size_t n,
+                              bool use_neg_weight) {
+  use_neg_weight = use_neg_weight && neg_weight_ != 1.0;
+  if (weight == nullptr && !use_neg_weight) {
+    return Evalute(pred, label, n);
+  }
+  double val = 0;
+  for (size_t i = 0; i < n; ++i) {
+    real_t w = weight != nullptr ? weight[i] : 1.0;
+    if (use_neg_weight) { w *= row_weight(label[i]); }
+    val += w * Evalute(pred + i, label + i, 1);
+  }
+  return val;
+}
+
+// Predict and evaluate in multi-thread
+real_t Loss::PredictEvalute(const DMatrix* matrix,
+                            Model& model,
+                            std::vector<real_t>& pred,
+                            Metric* metric) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NE(pred.empty(), true);
+  CHECK_EQ(pred.size(), matrix->row_length);
+  std::vector<real_t> buf;
+  const real_t* y = task_labels(matrix->Y.data(), matrix->row_length,
+                                &buf);
+  std::unique_lock<std::mutex> lock(loop_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    index_t n = matrix->row_length;
+    pred_thread(matrix, &model, &pred, score_func_, norm_, 0, n);
+    if (metric != nullptr) {
+      MetricCounter counter;
+      metric->Accumulate(y, pred.data(), n, &counter);
+      metric->Merge(counter);
+    }
+    return weighted_evalute(pred.data(), y,
+        matrix->HasWeight() ? matrix->weight.data() : nullptr,
+        n, false);
+  }
+  reset_partial(&loss_partial_, &metric_partial_);
+  for_rows(matrix,
+    [&](size_t id, size_t start, size_t end) {
+      pred_thread(matrix, &model, &pred, score_func_,
+                  norm_, start, end);
+      loss_partial_[id] += weighted_evalute(
+          pred.data() + start, y + start,
+          matrix->HasWeight() ? matrix->weight.data() + start : nullptr,
+          end - start, false);
+      if (metric != nullptr) {
+        metric->Accumulate(y + start,
+                           pred.data() + start,
+                           end - start, &metric_partial_[id]);
+      }
+    });
+  return merge_partial(metric);
 }
 
 } // xLearn
@@ -23,15 +23,24 @@ function or objective function.
 #ifndef XLEARN_LOSS_LOSS_H_
 #define XLEARN_LOSS_LOSS_H_
 
+#include <chrono>
+#include <mutex>
+#include <type_traits>
 #include <vector>
 #include <string>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
 #include "src/base/math.h"
-#include "src/base/thread_pool.h"
+#include "src/base/math_kernel.h"
+#include "src/base/executor.h"
+#include "src/base/trace.h"
 #include "src/data/model_parameters.h"
+#include "src/loss/metric.h"
 #include "src/score/score_function.h"
+#include "src/score/linear_score.h"
+#include "src/score/fm_score.h"
+#include "src/score/ffm_score.h"
 
 namespace xLearn {
 
@@ -69,33 +78,342 @@ namespace xLearn {
 //     loss_val += sq_loss->Evalute(pred, matrix->Y);
 //   }
 //   loss_val /= count;
+//
+// The loss and the metric of a batch can also be evaluated inside the
+// threads of Predict(), where each thread sums its own partial loss and
+// metric counters, which are merged after the threads:
+//
+//     loss_val += sq_loss->PredictEvalute(matrix, model, pred, metric);
+//
+// By default, all the threads update the shared model without
+// locks (Hogwild). Since the hot parameters such as the bias are
+// written by all the threads for every row, each thread can train
+// its own replica of the bias, or of the whole model for small
+// models, which is merged at the end of each CalcGrad() (the
+// updates of the bias are added, and the models are averaged):
+//
+//   sq_loss->SetThreadMode(kThreadLocalBias);
+//
+// The rows of each batch are statically partitioned among the threads
+// by default. Since the cost of FFM grows with the square of the row
+// length, the skewed rows can leave one thread finishing last, and the
+// threads can fetch the chunks of rows instead (see ThreadPool):
+//
+//   sq_loss->SetSchedule(kScheduleSteal);
+//   sq_loss->SetGrain(64);
+//
+// If the Reader computes the cost of the rows (DMatrix::row_cost), the
+// static ranges and the first ranges of work-stealing have the same cost
+// instead of the same number of rows. The busy time of each thread is
+// accumulated, which shows whether the batches are balanced:
+//
+//   sq_loss->ResetLoadStats();
+//   ... CalcGrad() ...
+//   LoadStats stats = sq_loss->GetLoadStats();
+//   /* stats.imbalance() == 1 for the perfect balance */
+//
+// Several models of the same rows, e.g., the linear and fm baselines of
+// different losses, can be trained in one pass, where each small block of
+// rows is scored and updated by all the losses in turn, so the rows are
+// read from the memory once for all the models:
+//
+//   Loss::CalcGradMulti(matrix, {ce_loss, sq_loss}, {&lr_model, &fm_model});
 //------------------------------------------------------------------------------
+enum ThreadMode {
+  kThreadHogwild = 0,    /* share the whole model */
+  kThreadLocalBias = 1,  /* private bias of each thread */
+  kThreadReplica = 2     /* private model of each thread */
+};
+
+// The busy time of the threads in the loops over the rows. In each loop
+// (one batch of CalcGrad() or Predict()), the offsets of the first start
+// and the last stop of the tasks of each thread are recorded from the
+// start of the loop, which give the wake-up latency of the pool, the time
+// waiting for the stragglers, and the straggler ratio of the loop, i.e.,
+// the last stop over the mean stop of the threads. The main thread waits
+// in the pool for the whole loop, so the wall time is its sync time
+struct LoadStats {
+  /* Busy time (sec) of each thread */
+  std::vector<double> busy;
+  /* Wall time (sec) of the loops */
+  double wall = 0;
+  /* Number of loops */
+  uint64 loops = 0;
+  /* Time (sec) from the start of the loops to the first
+  start of the threads, and from the first stop to the
+  last stop of the threads */
+  double wakeup = 0;
+  double tail = 0;
+  /* Sum and max of the straggler ratio of the loops */
+  double straggler_sum = 0;
+  double straggler_max = 0;
+
+  // Max busy time over the mean, where 1 is the perfect balance
+  double imbalance() const {
+    double sum = 0, max = 0;
+    for (size_t i = 0; i < busy.size(); ++i) {
+      sum += busy[i];
+      max = std::max(max, busy[i]);
+    }
+    return sum > 0 ? max * busy.size() / sum : 1.0;
+  }
+
+  // Busy time of all the threads over their wall time
+  double utilization() const {
+    double sum = 0;
+    for (size_t i = 0; i < busy.size(); ++i) { sum += busy[i]; }
+    return wall > 0 ? sum / (wall * busy.size()) : 0;
+  }
+
+  // Idle time of the i-th thread in the loops
+  double idle(size_t i) const { return std::max(wall - busy[i], 0.0); }
+
+  // Mean straggler ratio of the loops, where 1 means that
+  // all the threads stop at the same time
+  double straggler() const {
+    return loops > 0 ? straggler_sum / loops : 1.0;
+  }
+
+  // Add a loop of wall time, in which the i-th thread starts
+  // its first task at begin[i] and stops its last task at
+  // end[i], and begin[i] < 0 if it has no task
+  void AddLoop(double wall_time,
+               const std::vector<double>& begin,
+               const std::vector<double>& end);
+
+  // Add the loops of another LoadStats of the same threads
+  void Merge(const LoadStats& other);
+
+  // The report of the busy and idle time, the straggler
+  // and the sync time, in a few lines
+  std::string Report() const;
+};
+
+// The score functions whose training pass is called by the loss
+// without the virtual call of each row (see ScoreKindOf())
+enum ScoreKind {
+  kScoreVirtual = 0,  /* any score, by the virtual call */
+  kScoreLinear = 1,   /* LinearScore */
+  kScoreFM = 2,       /* FMScore and FMScoreK */
+  kScoreFFM = 3       /* FFMScore and FFMScoreK */
+};
+
+// The kind of the score, which is kScoreVirtual for the classes
+// that override the training pass, e.g., FFMScoreGPU and the
+// subclasses of the tests, and for nullptr
+ScoreKind ScoreKindOf(const Score* score);
+
+// The rows of a block of CalcGradMulti(), whose nodes stay
+// in the L1 cache while the block is updated by all the losses
+const size_t kMultiModelRows = 16;
+
+// A block of rows of CalcGradMulti(), which is decoded once from the
+// matrix, i.e., the view, the norm, the label and the weight of each
+// row, and then scored and updated by all the losses. Each loss maps
+// the label by its own threshold (see Loss::SetLabelThreshold)
+struct RowBlock {
+  /* The index of the first row, and the number of rows */
+  size_t start = 0;
+  size_t size = 0;
+  RowView row[kMultiModelRows];
+  real_t norm[kMultiModelRows];
+  real_t label[kMultiModelRows];
+  real_t weight[kMultiModelRows];
+
+  // Decode the rows [start, end) of the matrix
+  void Decode(const DMatrix* matrix, size_t start, size_t end) {
+    CHECK_LE(end - start, kMultiModelRows);
+    this->start = start;
+    size = end - start;
+    for (size_t n = 0; n < size; ++n) {
+      row[n] = matrix->GetRow(start + n);
+      norm[n] = matrix->norm[start + n];
+      label[n] = matrix->Y[start + n];
+      weight[n] = matrix->RowWeight(start + n);
+    }
+  }
+};
+
 class Loss {
  public:
   // Constructor and Desstructor
-  Loss() { };
-  virtual ~Loss() { }
+  Loss() : thread_mode_(kThreadHogwild),
+           schedule_(kScheduleStatic), grain_(0),
+           neg_weight_(1.0), label_threshold_(0) { };
+  virtual ~Loss() { clear_replicas(); }
+
+  // This function needs to be invoked before using this class.
+  // The thread_number 0 means the number of hardware threads,
+  // and the threads are pinned to the cpus if it is not empty.
+  // The threads come from the shared pool (see executor.h)
+  void Initialize(Score* score, bool norm = true,
+                  size_t thread_number = 0,
+                  const std::vector<int>& cpus = std::vector<int>()) {
+    score_func_ = score;
+    score_kind_ = ScoreKindOf(score);
+    norm_ = norm;
+    threadNumber_ = Executor::ThreadNumber(thread_number);
+    pool_ = Executor::Get(threadNumber_, cpus);
+    loss_partial_.resize(threadNumber_);
+    metric_partial_.resize(threadNumber_);
+    ResetLoadStats();
+  }
 
-  // This function needs to be invoked before using this class
-  void Initialize(Score* score, bool norm = true) {
+  // Use the threads of the pool of the caller, which
+  // should outlive the Loss, instead of the shared pool
+  void Initialize(Score* score, bool norm, ThreadPool* pool) {
+    CHECK_NOTNULL(pool);
     score_func_ = score;
+    score_kind_ = ScoreKindOf(score);
     norm_ = norm;
-    threadNumber_ = std::thread::hardware_concurrency();
-    pool_ = new ThreadPool(threadNumber_);
+    threadNumber_ = pool->size();
+    pool_ = pool;
+    loss_partial_.resize(threadNumber_);
+    metric_partial_.resize(threadNumber_);
+    ResetLoadStats();
+  }
+
+  // Set how the training threads share the model
+  void SetThreadMode(ThreadMode mode) {
+    clear_replicas();
+    thread_mode_ = mode;
+  }
+
+  // How the rows of each batch are assigned to the threads
+  void SetSchedule(Schedule schedule) { schedule_ = schedule; }
+
+  // Number of rows in each chunk of the dynamic and
+  // work-stealing schedule, and 0 means automatic
+  void SetGrain(index_t grain) { grain_ = grain; }
+
+  // The importance weight of the negative rows (y <= 0) in
+  // CalcGrad() and EvaluteMetric(), which is 1 / rate if the
+  // negatives are downsampled at the rate (see Reader)
+  void SetNegWeight(real_t weight) {
+    CHECK_GT(weight, 0);
+    neg_weight_ = weight;
+  }
+  inline real_t neg_weight() const { return neg_weight_; }
+
+  // The weight of a row of label y
+  inline real_t row_weight(real_t y) const {
+    return y > 0 ? 1.0 : neg_weight_;
+  }
+
+  // Train and evaluate on the label y >= threshold (1) or not (0)
+  // instead of y, e.g., the heads of the stages of a funnel whose
+  // rows have the labels 0 (no click), 1 (click) and 2 (conversion)
+  // train the CTR by the threshold 1 and the CTCVR by 2
+  void SetLabelThreshold(real_t threshold) {
+    CHECK_GT(threshold, 0);
+    label_threshold_ = threshold;
+  }
+  inline real_t label_threshold() const { return label_threshold_; }
+
+  // The label of the loss of a row of label y
+  inline real_t task_label(real_t y) const {
+    if (label_threshold_ <= 0) { return y; }
+    return y >= label_threshold_ ? 1.0 : 0.0;
   }
 
+  // The labels of the loss of n rows, which are the label itself
+  // if no threshold is set, and otherwise are written into buf
+  const real_t* task_labels(const real_t* label, size_t n,
+                            std::vector<real_t>* buf) const {
+    if (label_threshold_ <= 0) { return label; }
+    buf->resize(n);
+    for (size_t i = 0; i < n; ++i) { (*buf)[i] = task_label(label[i]); }
+    return buf->data();
+  }
+
+  // Name of the thread mode
+  std::string thread_mode_name() const {
+    if (thread_mode_ == kThreadLocalBias) { return "local-bias"; }
+    if (thread_mode_ == kThreadReplica) { return "replica"; }
+    return "hogwild";
+  }
+
+  // Number of the training threads
+  inline size_t num_threads() const { return threadNumber_; }
+
+  // The pool of the threads
+  ThreadPool* thread_pool() const { return pool_; }
+
+  // Reset the busy time of the threads
+  void ResetLoadStats() {
+    load_ = LoadStats();
+    load_.busy.assign(threadNumber_, 0);
+  }
+
+  // The busy time of the threads since ResetLoadStats()
+  inline const LoadStats& GetLoadStats() const { return load_; }
+
+  // Bytes of the replicas of the threads (which are created by
+  // the first gradient pass) and of the per-thread partial loss,
+  // metric and busy time
+  uint64 MemorySize() const;
+
   // Given predictions and labels, return loss value
-  virtual real_t Evalute(const std::vector<real_t>& pred,
-                         const std::vector<real_t>& label) = 0;
+  real_t Evalute(const std::vector<real_t>& pred,
+                 const std::vector<real_t>& label) {
+    CHECK_NE(pred.empty(), true);
+    CHECK_NE(label.empty(), true);
+    return Evalute(pred.data(), label.data(), pred.size());
+  }
+
+  // Given n predictions and labels, return loss value. This
+  // function is invoked by multiple threads at the same time
+  virtual real_t Evalute(const real_t* pred,
+                         const real_t* label,
+                         size_t n) = 0;
+
+  // Given predictions and labels, return the loss value, and the
+  // metric counters are accumulated by the threads and merged.
+  // The loss of each row is weighted by row_weight(), and by the
+  // weight of the row (see DMatrix::weight) if weight is not null
+  real_t EvaluteMetric(const std::vector<real_t>& pred,
+                       const std::vector<real_t>& label,
+                       Metric* metric,
+                       const real_t* weight = nullptr);
 
-  // Given data sample and current model, return predictions
+  // Given data sample and current model, return the loss value of
+  // the predictions, which are evaluated by the threads of Predict()
+  // together with the metric counters. The loss of each row is
+  // weighted by the weight of the row in the matrix. It can be
+  // invoked by many threads at the same time as Predict(), which
+  // can share the metric (see Metric::Merge())
+  real_t PredictEvalute(const DMatrix* data_matrix,
+                        Model& model,
+                        std::vector<real_t>& pred,
+                        Metric* metric);
+
+  // Given data sample and current model, return predictions. It
+  // can be invoked by many threads at the same time, e.g., the
+  // scoring streams of a serving process. One caller at a time
+  // runs the rows on the pool, and the others score their rows
+  // on their own threads instead of waiting for the pool
   virtual void Predict(const DMatrix* data_matrix,
                        Model& model,
                        std::vector<real_t>& pred);
 
   // Given data sample and current model, calculate gradient
-  // and update current model parameters
-  virtual void CalcGrad(const DMatrix* data_matrix, Model& model) = 0;
+  // and update current model parameters. If pred is not null,
+  // it gets the score of each row before its update, so the
+  // running loss and metric need no extra pass over the data
+  virtual void CalcGrad(const DMatrix* data_matrix, Model& model,
+                        std::vector<real_t>* pred = nullptr) = 0;
+
+  // CalcGrad() of the models of the losses in one pass over the matrix
+  // by the threads of the first loss, which have the same number of
+  // threads as the others. Each block of kMultiModelRows rows of a
+  // thread is updated by all the losses before the next block, and
+  // the busy time is accumulated by the first loss. The preds can be
+  // nullptr, and otherwise it gets the scores of each model
+  static void CalcGradMulti(const DMatrix* data_matrix,
+                            const std::vector<Loss*>& losses,
+                            const std::vector<Model*>& models,
+                            std::vector<std::vector<real_t>>* preds
+                              = nullptr);
 
   // Return a current loss type
   virtual inline std::string loss_type() = 0;
@@ -104,9 +422,7 @@ class Loss {
   void Sigmoid(const std::vector<real_t>& pred,
                 std::vector<real_t>& new_pred) {
     CHECK_EQ(pred.size(), new_pred.size());
-    for (size_t i = 0; i < pred.size(); ++i) {
-      new_pred[i] = sigmoid(pred[i]);
-    }
+    GetMathKernel().sigmoid(pred.data(), new_pred.data(), pred.size());
   }
 
   // if pred[i] >= 0, new_pred -> 1
@@ -126,14 +442,255 @@ class Loss {
   }
 
   /* The score function, including LinearScore,
-  FMScore, FFMScore, etc */
+  FMScore, FFMScore, etc, and its kind */
   Score* score_func_;
+  ScoreKind score_kind_ = kScoreVirtual;
   /* Use instance-wise normalization */
   bool norm_;
-  /* Thread pool for multi-thread training */
+  /* The shared thread pool for multi-thread training */
   ThreadPool* pool_;
   /* Number of thread in thread pool */
   size_t threadNumber_;
+  /* How the threads share the model, and the replica
+  of each thread if it is not kThreadHogwild */
+  ThreadMode thread_mode_;
+  std::vector<Model*> replica_;
+  /* Schedule of the rows, and the rows in each chunk */
+  Schedule schedule_;
+  index_t grain_;
+  /* The importance weight of the negative rows */
+  real_t neg_weight_;
+  /* The threshold of the labels (see SetLabelThreshold),
+  and 0 uses the labels as they are */
+  real_t label_threshold_;
+  /* The partial loss and metric counters of each
+  thread, which are allocated once in Initialize() */
+  std::vector<double> loss_partial_;
+  std::vector<MetricCounter> metric_partial_;
+  /* Busy time of the threads, and the first start and
+  the last stop of the threads in current loop */
+  LoadStats load_;
+  std::vector<double> task_begin_;
+  std::vector<double> task_end_;
+  /* The state of a loop over the rows, i.e., the partial loss
+  and metric, the busy time and the task offsets above, which
+  is held by the caller of for_rows() */
+  std::mutex loop_mutex_;
+  /* The labels and the weights of the rows of grad_batch() */
+  std::vector<real_t> batch_y_;
+  std::vector<real_t> batch_weight_;
+
+  // Run fn(thread_id, start, end) over the rows of the matrix by
+  // schedule_, which are split by the cost of the rows if the matrix
+  // has it, and accumulate the busy time of each thread. The tasks
+  // are the spans of the workers if the TraceLog is open. The
+  // caller holds loop_mutex_
+  template<class F>
+  void for_rows(const DMatrix* matrix, const F& fn) {
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double> seconds;
+    const uint64* cost = matrix->HasRowCost() ?
+                         matrix->row_cost.data() : nullptr;
+    task_begin_.assign(threadNumber_, -1.0);
+    task_end_.assign(threadNumber_, 0);
+    bool trace = TraceLog::Enabled();
+    clock::time_point wall_start = clock::now();
+    pool_->ParallelFor(0, matrix->row_length, grain_,
+      [&](size_t id, size_t start, size_t end) {
+        clock::time_point t = clock::now();
+        fn(id, start, end);
+        clock::time_point stop = clock::now();
+        load_.busy[id] += seconds(stop - t).count();
+        if (task_begin_[id] < 0) {
+          task_begin_[id] = seconds(t - wall_start).count();
+        }
+        task_end_[id] = seconds(stop - wall_start).count();
+        if (trace) {
+          TraceLog::Get().NameThread("worker", id);
+          TraceLog::Get().AddComplete("task", "worker", t, stop);
+        }
+      }, schedule_, cost);
+    load_.AddLoop(seconds(clock::now() - wall_start).count(),
+                  task_begin_, task_end_);
+  }
+
+  // Merge the partial loss and metric counters of the threads
+  real_t merge_partial(Metric* metric);
+
+  // The loss of the n rows, where the loss of each row is weighted
+  // by the weight if it is not null, and by row_weight() if the
+  // use_neg_weight is true
+  real_t weighted_evalute(const real_t* pred,
+                          const real_t* label,
+                          const real_t* weight,
+                          size_t n,
+                          bool use_neg_weight);
+
+  // Prepare the model of each thread before the
+  // threads of CalcGrad() start
+  void begin_batch(Model& model);
+
+  // Return the model trained by the i-th thread
+  inline Model* thread_model(int i, Model& model) {
+    return replica_.empty() ? &model : replica_[i];
+  }
+
+  // Merge the replicas into the model after the threads
+  void end_batch(Model& model);
+
+  // The training loop of all the losses, which scores and updates
+  // the rows of the matrix by the threads, and sets the score of
+  // each row to pred if it is not null. The Policy of a loss gives
+  // the label of a row and the partial gradient of a score:
+  //
+  //   struct SquaredPolicy {
+  //     static real_t Label(real_t y) { return y; }
+  //     static bool Grad(real_t score, real_t y, real_t* pg) {
+  //       *pg = score - y;
+  //       return true;
+  //     }
+  //   };
+  //
+  //   calc_grad<SquaredPolicy>(matrix, model, pred);
+  //
+  // The Policy is resolved at compile time, so the loss does not need
+  // its own thread function. The concrete type of the score is also
+  // resolved once for each range of rows of a thread (see ScoreKind),
+  // and the rows call its training pass without the virtual call
+  template<class Policy>
+  void calc_grad(const DMatrix* matrix, Model& model,
+                 std::vector<real_t>* pred) {
+    CHECK_NOTNULL(matrix);
+    CHECK_GT(matrix->row_length, 0);
+    real_t* score = nullptr;
+    if (pred != nullptr) {
+      pred->resize(matrix->row_length);
+      score = pred->data();
+    }
+    // The whole batch is trained by the score, e.g., on a GPU
+    if (score_func_->HasGradBatch() &&
+        grad_batch<Policy>(matrix, model, score)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(loop_mutex_);
+    begin_batch(model);
+    // multi-thread training
+    for_rows(matrix,
+      [&](size_t id, size_t start, size_t end) {
+        grad_rows<Policy>(matrix, start, end,
+                          thread_model(id, model), score);
+        // the last mini-batch of this thread
+        score_func_->FlushGrad();
+      });
+    end_batch(model);
+  }
+
+  // Score and update the rows [start, end) of the matrix on the
+  // model of a thread, which is the loop of calc_grad()
+  template<class Policy>
+  void grad_rows(const DMatrix* matrix, size_t start, size_t end,
+                 Model* m, real_t* score) {
+    switch (score_kind_) {
+      case kScoreLinear:
+        typed_rows<Policy, LinearScore>(matrix, start, end, m, score);
+        break;
+      case kScoreFM:
+        typed_rows<Policy, FMScore>(matrix, start, end, m, score);
+        break;
+      case kScoreFFM:
+        typed_rows<Policy, FFMScore>(matrix, start, end, m, score);
+        break;
+      default:
+        typed_rows<Policy, Score>(matrix, start, end, m, score);
+    }
+  }
+
+  template<class Policy, class S>
+  void typed_rows(const DMatrix* matrix, size_t start, size_t end,
+                  Model* m, real_t* score) {
+    S* s = static_cast<S*>(score_func_);
+    for (size_t i = start; i < end; ++i) {
+      real_t v = grad_row<Policy, S>(s, matrix->GetRow(i),
+                                     matrix->norm[i], matrix->Y[i],
+                                     matrix->RowWeight(i), m);
+      if (score != nullptr) { score[i] = v; }
+    }
+  }
+
+  // Score and update the decoded rows of a block of CalcGradMulti()
+  template<class Policy>
+  void grad_block(const RowBlock& block, Model* m, real_t* score) {
+    switch (score_kind_) {
+      case kScoreLinear:
+        typed_block<Policy, LinearScore>(block, m, score);
+        break;
+      case kScoreFM:
+        typed_block<Policy, FMScore>(block, m, score);
+        break;
+      case kScoreFFM:
+        typed_block<Policy, FFMScore>(block, m, score);
+        break;
+      default:
+        typed_block<Policy, Score>(block, m, score);
+    }
+  }
+
+  template<class Policy, class S>
+  void typed_block(const RowBlock& block, Model* m, real_t* score) {
+    S* s = static_cast<S*>(score_func_);
+    for (size_t n = 0; n < block.size; ++n) {
+      real_t v = grad_row<Policy, S>(s, block.row[n], block.norm[n],
+                                     block.label[n], block.weight[n], m);
+      if (score != nullptr) { score[block.start + n] = v; }
+    }
+  }
+
+  // Score and update one row of the label and the weight of the
+  // matrix, and return the score before the update. The training
+  // pass of the score S is called directly, unless S is Score
+  template<class Policy, class S>
+  inline real_t grad_row(S* s, const RowView& row, real_t norm,
+                         real_t y, real_t row_w, Model* m) {
+    real_t label = task_label(y);
+    real_t weight = row_weight(label) * row_w;
+    if (!norm_) { norm = 1.0; }
+    // score, partial gradient and update
+    if (std::is_same<S, Score>::value) {
+      return s->CalcScoreAndGrad(row, *m, Policy::Label(label),
+                                 Policy::Grad, norm, weight);
+    }
+    return s->S::CalcScoreAndGrad(row, *m, Policy::Label(label),
+                                  Policy::Grad, norm, weight);
+  }
+
+  // Train the matrix by one call of Score::CalcGradBatch(), where
+  // the labels and the weights of the rows are given by the Policy
+  template<class Policy>
+  bool grad_batch(const DMatrix* matrix, Model& model, real_t* score) {
+    size_t n = matrix->row_length;
+    batch_y_.resize(n);
+    batch_weight_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      real_t label = task_label(matrix->Y[i]);
+      batch_y_[i] = Policy::Label(label);
+      batch_weight_[i] = row_weight(label) *
+                         matrix->RowWeight(i);
+    }
+    return score_func_->CalcGradBatch(matrix, model, batch_y_.data(),
+                                      batch_weight_.data(), Policy::Grad,
+                                      norm_, score);
+  }
+
+  // grad_block() of the Policy of the loss, which is called by
+  // CalcGradMulti() for each block of rows. A loss that is not
+  // trained with the others needs not implement it
+  virtual void calc_rows(const RowBlock& block, Model* m, real_t* score) {
+    LOG(FATAL) << "The loss " << loss_type()
+               << " cannot be trained with other models";
+  }
+
+  // Release the replicas
+  void clear_replicas();
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Loss);
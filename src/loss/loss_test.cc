@@ -22,9 +22,12 @@ This file tests the Loss class.
 
 #include "gtest/gtest.h"
 
+#include <thread>
 #include <vector>
 
 #include "src/loss/loss.h"
+#include "src/loss/cross_entropy_loss.h"
+#include "src/loss/squared_loss.h"
 #include "src/base/common.h"
 #include "src/data/data_structure.h"
 #include "src/data/model_parameters.h"
@@ -40,11 +43,13 @@ class TestLoss : public Loss {
   TestLoss() { }
   ~TestLoss() { }
 
-  real_t Evalute(const std::vector<real_t>& pred,
-                 const std::vector<real_t>& label) { return 0.0; }
+  real_t Evalute(const real_t* pred,
+                 const real_t* label,
+                 size_t n) { return 0.0; }
 
   void CalcGrad(const DMatrix* data_matrix,
-                Model& model) { return; }
+                Model& model,
+                std::vector<real_t>* pred = nullptr) { return; }
 
   std::string loss_type() { return "test"; }
 
@@ -190,6 +195,111 @@ TEST_F(LossTest, Predict_FFM) {
   }
 }
 
+// The callers of the same Loss at the same time get the
+// same scores and loss as one caller
+TEST_F(LossTest, Predict_Concurrent) {
+  const index_t kRow = 2000;
+  Model model;
+  model.Initialize("ffm", "squared", 50, 4, 8);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 0.01 * (i % 11) - 0.05;
+  }
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = 0.02 * (i % 7) - 0.06;
+  }
+  DMatrix matrix;
+  matrix.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.Y[i] = i % 3;
+    matrix.row[i] = new SparseRow;
+    for (index_t j = 0; j < i % 9; ++j) {
+      matrix.AddNode(i, (i * 7 + j * 13) % 50, 1.0 - 0.1 * j, j % 4);
+    }
+  }
+  FFMScore score;
+  SquaredLoss loss;
+  loss.Initialize(&score, true, 4);
+  std::vector<real_t> expect(kRow);
+  loss.Predict(&matrix, model, expect);
+  Metric expect_metric;
+  expect_metric.Initialize("mae");
+  real_t expect_loss = loss.PredictEvalute(&matrix, model, expect,
+                                           &expect_metric);
+  const int kNumThread = 8;
+  const int kRound = 20;
+  std::vector<int> error(kNumThread, 0);
+  std::vector<std::thread> threads;
+  // The metric shared by all the callers, which
+  // gets the counters of every call
+  Metric shared;
+  shared.Initialize("mae,auc", true);
+  for (int t = 0; t < kNumThread; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<real_t> pred(kRow);
+      for (int r = 0; r < kRound; ++r) {
+        loss.Predict(&matrix, model, pred);
+        if (pred != expect) { error[t]++; }
+        Metric metric;
+        metric.Initialize("mae");
+        real_t val = loss.PredictEvalute(&matrix, model, pred, &metric);
+        if (std::abs(val - expect_loss) > 1e-3 * std::abs(expect_loss) ||
+            std::abs(metric.GetMetric() - expect_metric.GetMetric()) >
+            1e-5) {
+          error[t]++;
+        }
+        loss.PredictEvalute(&matrix, model, pred, &shared);
+        loss.EvaluteMetric(pred, matrix.Y, &shared);
+      }
+    });
+  }
+  for (int t = 0; t < kNumThread; ++t) {
+    threads[t].join();
+    EXPECT_EQ(error[t], 0);
+  }
+  const MetricCounter& count = shared.Counter();
+  index_t num = kNumThread * kRound * 2 * kRow;
+  EXPECT_EQ(count.counter, num);
+  EXPECT_EQ(count.pos_score.size() + count.neg_score.size(), num);
+  EXPECT_NEAR(shared.GetMetric(), expect_metric.GetMetric(), 1e-4);
+}
+
+// The callers of the same Loss and the same Metric at the
+// same time merge all their counters into the Metric
+TEST_F(LossTest, Evalute_Shared_Metric) {
+  const index_t kRow = 64;
+  std::vector<real_t> pred(kRow), label(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    pred[i] = 0.1 * (i % 10);
+    label[i] = i % 2;
+  }
+  FFMScore score;
+  SquaredLoss loss;
+  loss.Initialize(&score, true, 2);
+  Metric expect;
+  expect.Initialize("mae");
+  loss.EvaluteMetric(pred, label, &expect);
+  const int kNumThread = 16;
+  const int kRound = 5000;
+  Metric shared;
+  shared.Initialize("mae,auc", true);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThread; ++t) {
+    threads.emplace_back([&]() {
+      for (int r = 0; r < kRound; ++r) {
+        loss.EvaluteMetric(pred, label, &shared);
+      }
+    });
+  }
+  for (int t = 0; t < kNumThread; ++t) { threads[t].join(); }
+  const MetricCounter& count = shared.Counter();
+  index_t num = kNumThread * kRound * kRow;
+  EXPECT_EQ(count.counter, num);
+  EXPECT_EQ(count.pos_score.size() + count.neg_score.size(), num);
+  EXPECT_NEAR(shared.GetMetric(), expect.GetMetric(), 1e-4);
+}
+
 TEST_F(LossTest, Sigmoid_Test) {
   std::vector<real_t> pred(6);
   pred[0] = 0.5;
@@ -240,6 +350,261 @@ Loss* CreateLoss(const char* format_name) {
   return CREATE_LOSS(format_name);
 }
 
+// The models of CalcGradMulti() are the ones of CalcGrad() of
+// each loss, since each model is updated by the rows in order
+TEST_F(LossTest, CalcGrad_Multi) {
+  const index_t kRow = 100;
+  DMatrix matrix;
+  matrix.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.AddNode(i, i % 3, 1.0);
+    matrix.AddNode(i, 3 + i % 5, 0.5);
+    matrix.Y[i] = i % 2 == 0 ? 1 : 0;
+  }
+  ThreadPool pool(1);
+  Model model[4];
+  for (int i = 0; i < 4; ++i) {
+    model[i].SetSeed(1);
+    model[i].Initialize(i % 2 == 0 ? "linear" : "fm",
+                        i % 2 == 0 ? "cross-entropy" : "squared",
+                        8, 0, 4);
+  }
+  LinearScore linear[2];
+  FMScore fm[2];
+  CrossEntropyLoss ce_loss[2];
+  SquaredLoss sq_loss[2];
+  for (int i = 0; i < 2; ++i) {
+    linear[i].Initialize(0.1, 0, &model[i*2]);
+    fm[i].Initialize(0.1, 0, &model[i*2+1]);
+    ce_loss[i].Initialize(&linear[i], true, &pool);
+    sq_loss[i].Initialize(&fm[i], true, &pool);
+  }
+  std::vector<real_t> ce_pred, sq_pred;
+  std::vector<std::vector<real_t>> preds;
+  for (int n = 0; n < 3; ++n) {
+    ce_loss[0].CalcGrad(&matrix, model[0], &ce_pred);
+    sq_loss[0].CalcGrad(&matrix, model[1], &sq_pred);
+    Loss::CalcGradMulti(&matrix, {&ce_loss[1], &sq_loss[1]},
+                        {&model[2], &model[3]}, &preds);
+  }
+  ASSERT_EQ(preds.size(), 2);
+  for (index_t i = 0; i < kRow; ++i) {
+    EXPECT_FLOAT_EQ(preds[0][i], ce_pred[i]);
+    EXPECT_FLOAT_EQ(preds[1][i], sq_pred[i]);
+  }
+  for (int i = 0; i < 2; ++i) {
+    real_t* w = model[i].GetParameter_w();
+    real_t* multi_w = model[i+2].GetParameter_w();
+    for (index_t j = 0; j < model[i].GetNumParameter_w(); ++j) {
+      EXPECT_FLOAT_EQ(w[j], multi_w[j]);
+    }
+  }
+  real_t* v = model[1].GetParameter_v();
+  real_t* multi_v = model[3].GetParameter_v();
+  for (uint64 j = 0; j < model[1].GetNumParameter_v(); ++j) {
+    EXPECT_FLOAT_EQ(v[j], multi_v[j]);
+  }
+}
+
+// The labels 0, 1 and 2 of the stages of a funnel are mapped
+// to y >= threshold, and no threshold keeps them
+TEST_F(LossTest, Label_Threshold) {
+  CrossEntropyLoss loss;
+  EXPECT_EQ(loss.label_threshold(), 0);
+  EXPECT_EQ(loss.task_label(2), 2);
+  loss.SetLabelThreshold(2);
+  EXPECT_EQ(loss.task_label(0), 0);
+  EXPECT_EQ(loss.task_label(1), 0);
+  EXPECT_EQ(loss.task_label(2), 1);
+  EXPECT_EQ(loss.task_label(3), 1);
+  std::vector<real_t> label = { 0, 1, 2, 1 };
+  std::vector<real_t> buf;
+  const real_t* y = loss.task_labels(label.data(), label.size(), &buf);
+  EXPECT_EQ(y, buf.data());
+  EXPECT_EQ(buf, std::vector<real_t>({ 0, 0, 1, 0 }));
+  // The metric of the head is on its own labels
+  ThreadPool pool(2);
+  LinearScore score;
+  loss.Initialize(&score, false, &pool);
+  Metric metric;
+  metric.Initialize("acc");
+  std::vector<real_t> pred = { -1, -1, 1, -1 };
+  loss.EvaluteMetric(pred, label, &metric);
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 1.0);
+}
+
+// The heads of CalcGradMulti() with the label thresholds are the
+// models of CalcGrad() on the labels y >= 1 and y >= 2, where each
+// row is decoded once for both heads
+TEST_F(LossTest, CalcGrad_Multi_Heads) {
+  const index_t kRow = 100;
+  DMatrix matrix, click, convert;
+  matrix.ResetMatrix(kRow);
+  click.ResetMatrix(kRow);
+  convert.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    DMatrix* list[] = { &matrix, &click, &convert };
+    for (int k = 0; k < 3; ++k) {
+      list[k]->AddNode(i, i % 3, 1.0);
+      list[k]->AddNode(i, 3 + i % 5, 0.5);
+      list[k]->norm[i] = 0.8;
+    }
+    matrix.Y[i] = i % 2 == 0 ? 0 : (i % 3 == 0 ? 2 : 1);
+    click.Y[i] = matrix.Y[i] >= 1 ? 1 : 0;
+    convert.Y[i] = matrix.Y[i] >= 2 ? 1 : 0;
+  }
+  ThreadPool pool(1);
+  Model model[4];
+  LinearScore linear[4];
+  CrossEntropyLoss loss[4];
+  for (int i = 0; i < 4; ++i) {
+    model[i].SetSeed(1);
+    model[i].Initialize("linear", "cross-entropy", 8, 0, 4);
+    linear[i].Initialize(0.1, 0, &model[i]);
+    loss[i].Initialize(&linear[i], true, &pool);
+  }
+  loss[2].SetLabelThreshold(1);
+  loss[3].SetLabelThreshold(2);
+  std::vector<real_t> click_pred, convert_pred;
+  std::vector<std::vector<real_t>> preds;
+  for (int n = 0; n < 3; ++n) {
+    loss[0].CalcGrad(&click, model[0], &click_pred);
+    loss[1].CalcGrad(&convert, model[1], &convert_pred);
+    Loss::CalcGradMulti(&matrix, {&loss[2], &loss[3]},
+                        {&model[2], &model[3]}, &preds);
+  }
+  ASSERT_EQ(preds.size(), 2);
+  for (index_t i = 0; i < kRow; ++i) {
+    EXPECT_FLOAT_EQ(preds[0][i], click_pred[i]);
+    EXPECT_FLOAT_EQ(preds[1][i], convert_pred[i]);
+  }
+  for (int i = 0; i < 2; ++i) {
+    real_t* w = model[i].GetParameter_w();
+    real_t* head_w = model[i+2].GetParameter_w();
+    for (index_t j = 0; j < model[i].GetNumParameter_w(); ++j) {
+      EXPECT_FLOAT_EQ(w[j], head_w[j]);
+    }
+  }
+  // The two heads are not the same model
+  EXPECT_NE(model[2].GetParameter_w()[0], model[3].GetParameter_w()[0]);
+}
+
+// A score that trains the batch in one call, like the GPU
+// score, by the rows of the matrix in order
+class BatchScore : public LinearScore {
+ public:
+  BatchScore() : num_batch(0) { }
+
+  bool HasGradBatch() const { return true; }
+
+  bool CalcGradBatch(const DMatrix* matrix, Model& model,
+                     const real_t* y, const real_t* weight,
+                     PartialGrad pg_func, bool is_norm, real_t* out) {
+    for (index_t i = 0; i < matrix->row_length; ++i) {
+      real_t norm = is_norm ? matrix->norm[i] : 1.0;
+      real_t s = CalcScoreAndGrad(matrix->GetRow(i), model, y[i],
+                                  pg_func, norm, weight[i]);
+      if (out != nullptr) { out[i] = s; }
+    }
+    ++num_batch;
+    return true;
+  }
+
+  int num_batch;
+};
+
+// The batch of CalcGradBatch() is trained as the rows of
+// one thread, with the labels and weights of the loss
+TEST_F(LossTest, CalcGrad_Batch) {
+  const index_t kRow = 100;
+  DMatrix matrix;
+  matrix.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.AddNode(i, i % 3, 1.0);
+    matrix.AddNode(i, 3 + i % 5, 0.5);
+    matrix.Y[i] = i % 2 == 0 ? 1 : -1;
+    matrix.norm[i] = 0.8;
+  }
+  ThreadPool pool(1);
+  Model model[2];
+  for (int i = 0; i < 2; ++i) {
+    model[i].SetSeed(1);
+    model[i].Initialize("linear", "cross-entropy", 8, 0, 4);
+  }
+  LinearScore linear;
+  BatchScore batch;
+  linear.Initialize(0.1, 0, &model[0]);
+  batch.Initialize(0.1, 0, &model[1]);
+  CrossEntropyLoss loss[2];
+  loss[0].Initialize(&linear, true, &pool);
+  loss[1].Initialize(&batch, true, &pool);
+  std::vector<real_t> pred, batch_pred;
+  for (int n = 0; n < 3; ++n) {
+    loss[0].CalcGrad(&matrix, model[0], &pred);
+    loss[1].CalcGrad(&matrix, model[1], &batch_pred);
+  }
+  EXPECT_EQ(batch.num_batch, 3);
+  for (index_t i = 0; i < kRow; ++i) {
+    EXPECT_FLOAT_EQ(batch_pred[i], pred[i]);
+  }
+  real_t* w = model[0].GetParameter_w();
+  real_t* batch_w = model[1].GetParameter_w();
+  for (index_t j = 0; j < model[0].GetNumParameter_w(); ++j) {
+    EXPECT_FLOAT_EQ(batch_w[j], w[j]);
+  }
+}
+
+// A subclass of the score, which is trained by the virtual call
+class PlainFMScore : public FMScore { };
+
+// The training pass of the known scores is called directly, and
+// it trains the same model as the virtual call
+TEST_F(LossTest, Score_Kind) {
+  LinearScore linear;
+  FMScore fm;
+  FMScoreK8 fm_k8;
+  FFMScoreK16 ffm_k16;
+  PlainFMScore plain;
+  BatchScore batch;
+  EXPECT_EQ(ScoreKindOf(&linear), kScoreLinear);
+  EXPECT_EQ(ScoreKindOf(&fm), kScoreFM);
+  EXPECT_EQ(ScoreKindOf(&fm_k8), kScoreFM);
+  EXPECT_EQ(ScoreKindOf(&ffm_k16), kScoreFFM);
+  EXPECT_EQ(ScoreKindOf(&plain), kScoreVirtual);
+  EXPECT_EQ(ScoreKindOf(&batch), kScoreVirtual);
+  EXPECT_EQ(ScoreKindOf(nullptr), kScoreVirtual);
+  const index_t kRow = 100;
+  DMatrix matrix;
+  matrix.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.AddNode(i, i % 3, 1.0);
+    matrix.AddNode(i, 3 + i % 5, 0.5);
+    matrix.Y[i] = i % 2 == 0 ? 1 : 0;
+  }
+  ThreadPool pool(1);
+  Model model[2];
+  for (int i = 0; i < 2; ++i) {
+    model[i].SetSeed(1);
+    model[i].Initialize("fm", "cross-entropy", 8, 0, 4);
+  }
+  fm.Initialize(0.1, 0, &model[0]);
+  plain.Initialize(0.1, 0, &model[1]);
+  CrossEntropyLoss loss[2];
+  loss[0].Initialize(&fm, true, &pool);
+  loss[1].Initialize(&plain, true, &pool);
+  std::vector<real_t> pred, plain_pred;
+  for (int n = 0; n < 3; ++n) {
+    loss[0].CalcGrad(&matrix, model[0], &pred);
+    loss[1].CalcGrad(&matrix, model[1], &plain_pred);
+  }
+  EXPECT_EQ(pred, plain_pred);
+  real_t* v = model[0].GetParameter_v();
+  real_t* plain_v = model[1].GetParameter_v();
+  for (uint64 j = 0; j < model[0].GetNumParameter_v(); ++j) {
+    EXPECT_EQ(v[j], plain_v[j]);
+  }
+}
+
 TEST_F(LossTest, Create_Loss) {
   EXPECT_TRUE(CreateLoss("squared") != NULL);
   EXPECT_TRUE(CreateLoss("hinge") != NULL);
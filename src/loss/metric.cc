@@ -21,42 +21,282 @@ This file is the implementation of the Metric class.
 
 #include "src/loss/metric.h"
 
+#include <algorithm>
+
+#include "src/base/math_kernel.h"
+#include "src/base/split_string.h"
+
 namespace xLearn {
 
+// Return the absolute value
+static inline real_t abs_val(real_t a) { return a >= 0 ? a : -a; }
+
+// The bucket of the score in the streaming AUC, and
+// NaN is put into the first bucket
+static inline int auc_bucket(real_t score) {
+  static const real_t kScale = kAUCBuckets / (2 * kAUCRange);
+  if (!(score > -kAUCRange)) { return 0; }
+  if (!(score < kAUCRange)) { return kAUCBuckets - 1; }
+  int id = static_cast<int>((score + kAUCRange) * kScale);
+  return std::min(id, kAUCBuckets - 1);
+}
+
+// The arrays shorter than this are sorted by one thread
+static const size_t kMinParallelSort = 1 << 16;
+
+// Sort the parts of the array in the threads of the pool,
+// and then merge the neighbor parts in log(threads) rounds
+static void parallel_sort(std::vector<real_t>* data, ThreadPool* pool) {
+  size_t n = data->size();
+  size_t parts = pool == nullptr ? 1 : pool->size();
+  if (parts <= 1 || n < kMinParallelSort) {
+    std::sort(data->begin(), data->end());
+    return;
+  }
+  real_t* d = data->data();
+  std::vector<size_t> bound(parts + 1);
+  for (size_t i = 0; i <= parts; ++i) {
+    bound[i] = n * i / parts;
+  }
+  pool->ParallelFor(0, parts, 1,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) {
+        std::sort(d + bound[i], d + bound[i+1]);
+      }
+    });
+  for (size_t width = 1; width < parts; width *= 2) {
+    size_t num = (parts + 2 * width - 1) / (2 * width);
+    pool->ParallelFor(0, num, 1,
+      [&](size_t id, size_t start, size_t end) {
+        for (size_t j = start; j < end; ++j) {
+          size_t lo = 2 * j * width;
+          size_t mid = std::min(lo + width, parts);
+          size_t hi = std::min(lo + 2 * width, parts);
+          if (mid < hi) {
+            std::inplace_merge(d + bound[lo], d + bound[mid],
+                               d + bound[hi]);
+          }
+        }
+      });
+  }
+}
+
+// Return false if the name is not a metric
+static bool metric_type(const std::string& name, MetricType* type) {
+  if (name.compare("acc") == 0) {           // Accuracy
+    *type = kMetricAcc;
+  } else if (name.compare("prec") == 0) {   // Precision
+    *type = kMetricPrec;
+  } else if (name.compare("recall") == 0) {
+    *type = kMetricRecall;
+  } else if (name.compare("f1") == 0) {
+    *type = kMetricF1;
+  } else if (name.compare("auc") == 0) {
+    *type = kMetricAUC;
+  } else if (name.compare("logloss") == 0) {
+    *type = kMetricLogLoss;
+  } else if (name.compare("mae") == 0) {
+    *type = kMetricMAE;
+  } else if (name.compare("mape") == 0) {
+    *type = kMetricMAPE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Metric::IsMetric(const std::string& name) {
+  MetricType type;
+  return metric_type(name, &type);
+}
+
+void Metric::Initialize(const std::string& metric, bool exact_auc) {
+  exact_auc_ = exact_auc;
+  std::vector<std::string> names;
+  SplitStringUsing(metric, ",", &names);
+  metric_types_.clear();
+  for (size_t i = 0; i < names.size(); ++i) {
+    MetricType type;
+    if (!metric_type(names[i], &type)) {
+      LOG(FATAL) << "Unknow metric: " << names[i];
+    }
+    metric_types_.push_back(type);
+  }
+  CHECK(!metric_types_.empty());
+  metric_type_ = metric_types_[0];
+  need_confusion_ = false;
+  need_auc_ = false;
+  for (size_t i = 0; i < metric_types_.size(); ++i) {
+    MetricType type = metric_types_[i];
+    need_confusion_ |= (type == kMetricAcc || type == kMetricPrec ||
+                        type == kMetricRecall || type == kMetricF1);
+    need_auc_ |= (type == kMetricAUC);
+  }
+  Reset();
+}
+
+std::string Metric::type_name(MetricType type) {
+  switch (type) {
+    case kMetricAcc: return "accuracy";
+    case kMetricPrec: return "precision";
+    case kMetricRecall: return "recall";
+    case kMetricF1: return "F1";
+    case kMetricAUC: return "AUC";
+    case kMetricLogLoss: return "LogLoss";
+    case kMetricMAE: return "MAP";
+    case kMetricMAPE: return "MAPE";
+  }
+  LOG(ERROR) << "Unknow metric: " << type;
+  return "";
+}
+
+real_t Metric::value(MetricType type) const {
+  switch (type) {
+    case kMetricAcc: return Accuracy();
+    case kMetricPrec: return Precision();
+    case kMetricRecall: return Recall();
+    case kMetricF1: return F1();
+    case kMetricAUC: return AUC();
+    case kMetricLogLoss: return LogLoss();
+    case kMetricMAE: return MAE();
+    case kMetricMAPE: return MAPE();
+  }
+  LOG(ERROR) << "Unknow metric: " << type;
+  return 0;
+}
+
+// The counters needed by the metrics are decided once in
+// Initialize(), and each of them is accumulated in one loop
+void Metric::Accumulate(const real_t* Y, const real_t* pred,
+                        size_t n, MetricCounter* counter) const {
+  CHECK_NOTNULL(counter);
+  counter->counter += n;
+  for (size_t m = 0; m < metric_types_.size(); ++m) {
+    if (metric_types_[m] == kMetricMAE) {
+      double error = 0;
+      for (size_t i = 0; i < n; ++i) {
+        error += abs_val(Y[i] - pred[i]);
+      }
+      counter->abs_error += error;
+    } else if (metric_types_[m] == kMetricMAPE) {
+      double error = 0;
+      for (size_t i = 0; i < n; ++i) {
+        error += abs_val(Y[i] - pred[i]) / Y[i];
+      }
+      counter->rel_error += error;
+    } else if (metric_types_[m] == kMetricLogLoss) {
+      counter->log_loss += GetMathKernel().log_loss(pred, Y, n);
+    }
+  }
+  if (need_auc_ && exact_auc_) {
+    for (size_t i = 0; i < n; ++i) {
+      if (Y[i] == 1) {
+        counter->pos_score.push_back(pred[i]);
+      } else {
+        counter->neg_score.push_back(pred[i]);
+      }
+    }
+  } else if (need_auc_) {
+    counter->pos_bucket.resize(kAUCBuckets, 0);
+    counter->neg_bucket.resize(kAUCBuckets, 0);
+    uint64* pos = counter->pos_bucket.data();
+    uint64* neg = counter->neg_bucket.data();
+    for (size_t i = 0; i < n; ++i) {
+      int id = auc_bucket(pred[i]);
+      if (Y[i] == 1) {
+        pos[id]++;
+      } else {
+        neg[id]++;
+      }
+    }
+  }
+  if (!need_confusion_) { return; }
+  index_t true_pos = 0, false_pos = 0, true_neg = 0, false_neg = 0;
+  for (size_t i = 0; i < n; ++i) {
+    bool pos = (Y[i] == 1);
+    if (pred[i] >= 0) {  // for positive prediction
+      true_pos += pos;
+      false_pos += !pos;
+    } else {  // for negative prediction
+      false_neg += pos;
+      true_neg += !pos;
+    }
+  }
+  counter->true_pos += true_pos;
+  counter->false_pos += false_pos;
+  counter->true_neg += true_neg;
+  counter->false_neg += false_neg;
+}
+
 real_t Metric::Accuracy() const {
   real_t res = 0;
-  res = (true_pos_ * 1.0 + true_neg_) / counter_;
+  res = (count_.true_pos * 1.0 + count_.true_neg) / count_.counter;
   return res;
 }
 
 real_t Metric::Precision() const {
   real_t res = 0;
-  res = (true_pos_ * 1.0) / (true_pos_ + false_pos_);
+  res = (count_.true_pos * 1.0) / (count_.true_pos + count_.false_pos);
   return res;
 }
 
 real_t Metric::Recall() const {
   real_t res = 0;
-  res = (true_pos_ * 1.0) / (true_pos_ + false_neg_);
+  res = (count_.true_pos * 1.0) / (count_.true_pos + count_.false_neg);
   return res;
 }
 
 real_t Metric::F1() const {
   real_t res = 0;
-  res = (2.0 * true_pos_) / (counter_ + true_pos_ - true_neg_);
+  res = (2.0 * count_.true_pos) /
+        (count_.counter + count_.true_pos - count_.true_neg);
   return res;
 }
 
+// The probability that a positive example has a higher score
+// than a negative one, and the ties count half. It is 0.5 if
+// there is no positive or negative example
 real_t Metric::AUC() const {
-  return 0;
+  double area = 0, num_pos = 0, num_neg = 0;
+  if (exact_auc_) {
+    // Sort a copy, so GetMetric() can be called again
+    std::vector<real_t> pos = count_.pos_score;
+    std::vector<real_t> neg = count_.neg_score;
+    parallel_sort(&pos, pool_);
+    parallel_sort(&neg, pool_);
+    size_t lower = 0, upper = 0;
+    for (size_t i = 0; i < pos.size(); ++i) {
+      while (lower < neg.size() && neg[lower] < pos[i]) { lower++; }
+      if (upper < lower) { upper = lower; }
+      while (upper < neg.size() && neg[upper] <= pos[i]) { upper++; }
+      area += lower + 0.5 * (upper - lower);
+    }
+    num_pos = pos.size();
+    num_neg = neg.size();
+  } else {
+    const std::vector<uint64>& pos = count_.pos_bucket;
+    const std::vector<uint64>& neg = count_.neg_bucket;
+    for (size_t i = 0; i < pos.size(); ++i) {
+      area += pos[i] * (num_neg + 0.5 * neg[i]);
+      num_pos += pos[i];
+      num_neg += neg[i];
+    }
+  }
+  if (num_pos == 0 || num_neg == 0) { return 0.5; }
+  return area / (num_pos * num_neg);
+}
+
+// The mean cross-entropy loss of the raw scores
+real_t Metric::LogLoss() const {
+  return count_.log_loss / count_.counter;
 }
 
 real_t Metric::MAE() const {
-  return error_accum_ * 1.0 / counter_;
+  return count_.abs_error * 1.0 / count_.counter;
 }
 
 real_t Metric::MAPE() const {
-  return error_accum_ * 1.0 / counter_;;
+  return count_.rel_error * 1.0 / count_.counter;
 }
 
 }  // namespace xLearn
@@ -18,61 +18,194 @@
 Author: Chao Ma (mctt90@gmail.com)
 
 This file defines the Metric class, which can be used for
-Accuracy, Precision, Recall, F1, MAE, MAPE, etc.
+Accuracy, Precision, Recall, F1, AUC, LogLoss, MAE, MAPE, etc.
 */
 
 #ifndef XLEARN_LOSS_METRIC_H_
 #define XLEARN_LOSS_METRIC_H_
 
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/thread_pool.h"
 #include "src/data/data_structure.h"
 
 namespace xLearn {
 
+// The metric type is resolved from its name once in Initialize()
+enum MetricType {
+  kMetricAcc = 0,
+  kMetricPrec = 1,
+  kMetricRecall = 2,
+  kMetricF1 = 3,
+  kMetricAUC = 4,
+  kMetricMAE = 5,
+  kMetricMAPE = 6,
+  kMetricLogLoss = 7
+};
+
+// The streaming AUC puts the scores into kAUCBuckets buckets of
+// the same width over [-kAUCRange, kAUCRange], and the scores out
+// of the range are put into the first or the last bucket. The
+// scores are the raw outputs before sigmoid, so the width (about
+// 0.002) is much less than the gap of the scores that matters,
+// and the error of the AUC is usually less than 1e-4
+const int kAUCBuckets = 1 << 14;
+const real_t kAUCRange = 16.0;
+
+// The counters of the metric. Each thread can accumulate its
+// own counters, which are merged into the Metric at the end
+struct MetricCounter {
+  MetricCounter() { Reset(); }
+
+  // The buckets of AUC are zeroed but not released
+  void Reset() {
+    counter = 0;
+    true_pos = 0;
+    false_pos = 0;
+    true_neg = 0;
+    false_neg = 0;
+    abs_error = 0.0;
+    rel_error = 0.0;
+    log_loss = 0.0;
+    std::fill(pos_bucket.begin(), pos_bucket.end(), 0);
+    std::fill(neg_bucket.begin(), neg_bucket.end(), 0);
+    pos_score.clear();
+    neg_score.clear();
+  }
+
+  void Merge(const MetricCounter& other) {
+    counter += other.counter;
+    true_pos += other.true_pos;
+    false_pos += other.false_pos;
+    true_neg += other.true_neg;
+    false_neg += other.false_neg;
+    abs_error += other.abs_error;
+    rel_error += other.rel_error;
+    log_loss += other.log_loss;
+    if (other.counter == 0) { return; }
+    if (!other.pos_bucket.empty()) {
+      pos_bucket.resize(kAUCBuckets, 0);
+      neg_bucket.resize(kAUCBuckets, 0);
+      for (int i = 0; i < kAUCBuckets; ++i) {
+        pos_bucket[i] += other.pos_bucket[i];
+        neg_bucket[i] += other.neg_bucket[i];
+      }
+    }
+    pos_score.insert(pos_score.end(), other.pos_score.begin(),
+                     other.pos_score.end());
+    neg_score.insert(neg_score.end(), other.neg_score.begin(),
+                     other.neg_score.end());
+  }
+
+  // Bytes of the buckets and the scores of AUC
+  uint64 MemorySize() const {
+    return sizeof(MetricCounter) +
+           (pos_bucket.capacity() + neg_bucket.capacity()) *
+           sizeof(uint64) +
+           (pos_score.capacity() + neg_score.capacity()) *
+           sizeof(real_t);
+  }
+
+  /* The number of total example */
+  index_t counter;
+  /* The number of true positive */
+  index_t true_pos;
+  /* The number of false positive */
+  index_t false_pos;
+  /* The number of true negative */
+  index_t true_neg;
+  /* The number of false negative */
+  index_t false_neg;
+  /* Sum of the absolute error and the relative
+  absolute error for regression tasks */
+  double abs_error;
+  double rel_error;
+  /* Sum of the cross-entropy loss */
+  double log_loss;
+  /* Number of the positive and negative examples in
+  each bucket of the streaming AUC */
+  std::vector<uint64> pos_bucket;
+  std::vector<uint64> neg_bucket;
+  /* Scores of the positive and negative examples
+  of the exact AUC */
+  std::vector<real_t> pos_score;
+  std::vector<real_t> neg_score;
+};
+
+//------------------------------------------------------------------------------
+// The Metric accumulates the counters of the predictions batch by batch,
+// and then returns the metric value:
+//
+//   metric.Initialize("acc");
+//   metric.Accumulate(matrix->Y, pred);   /* for each batch */
+//   real_t acc = metric.GetMetric();
+//
+// Several metrics separated by ',' are computed in the same pass over the
+// predictions, and the first one is the metric of GetMetric(), type() and
+// larger_is_better(), e.g., the metric of early-stopping:
+//
+//   metric.Initialize("auc,logloss,acc");
+//   metric.Accumulate(matrix->Y, pred);
+//   real_t auc = metric.GetMetric();
+//   real_t logloss = metric.GetMetric(1);
+//
+// The multi-thread evaluation accumulates the counters of each thread by
+// the const method, and then merges them:
+//
+//   MetricCounter counter;                /* of each thread */
+//   metric.Accumulate(Y + start, pred + start, end - start, &counter);
+//   metric.Merge(counter);
+//
+// Merge() can be invoked by the callers of the same Metric at the same
+// time, e.g., the callers of Loss::PredictEvalute() that share it.
+//
+// By default, the AUC is computed from the buckets of the scores, which
+// take constant memory. The exact AUC keeps all the scores, and sorts
+// them by the threads of the pool in GetMetric():
+//
+//   metric.Initialize("auc", true);
+//   metric.SetThreadPool(pool);
+//------------------------------------------------------------------------------
 class Metric {
  public:
-  Metric() { }
+  Metric() : metric_type_(kMetricAcc),
+             metric_types_(1, kMetricAcc),
+             need_confusion_(true), need_auc_(false),
+             exact_auc_(false), pool_(nullptr) { }
   ~Metric() { }
 
-  // Call this function before we use the Metric class
-  void Initialize(const std::string& metric) {
-    if (metric.compare("acc") != 0 &&     // Accuracy
-        metric.compare("prec") != 0 &&    // Precision
-        metric.compare("recall") != 0 &&
-        metric.compare("f1") != 0 &&
-        metric.compare("auc") != 0 &&
-        metric.compare("mae") != 0 &&
-        metric.compare("mape") != 0) {
-      LOG(FATAL) << "Unknow metric: " << metric;
-    }
-    metric_type_ = metric;
-    counter_ = 0;
-    true_pos_ = 0;
-    false_pos_ = 0;
-    true_neg_ = 0;
-    false_neg_ = 0;
-    error_accum_ = 0.0;
+  // Call this function before we use the Metric class. The
+  // metric can be a list separated by ',', and the exact_auc
+  // is only used by 'auc'
+  void Initialize(const std::string& metric, bool exact_auc = false);
+
+  // Return true if the name is a metric, which can be 'acc',
+  // 'prec', 'recall', 'f1', 'auc', 'logloss', 'mae' or 'mape'
+  static bool IsMetric(const std::string& name);
+
+  // Number of the metrics
+  size_t NumMetrics() const { return metric_types_.size(); }
+
+  // The pool that sorts the scores of the exact AUC,
+  // which are sorted by one thread if it is nullptr
+  void SetThreadPool(ThreadPool* pool) { pool_ = pool; }
+
+  // Get metric type of the first metric, or the i-th one
+  std::string type() const { return type_name(metric_type_); }
+  std::string type(size_t i) const {
+    return type_name(metric_types_[i]);
   }
 
-  // Get metric type
-  std::string type() const {
-    if (metric_type_.compare("acc") == 0) {
-      return "accuracy";
-    } else if (metric_type_.compare("prec") == 0) {
-      return "precision";
-    } else if (metric_type_.compare("recall") == 0) {
-      return "recall";
-    } else if (metric_type_.compare("f1") == 0) {
-      return "F1";
-    } else if (metric_type_.compare("auc") == 0) {
-      return "AUC";
-    } else if (metric_type_.compare("mae") == 0) {
-      return "MAP";
-    } else if (metric_type_.compare("mape") == 0) {
-      return "MAPE";
-    }
-    LOG(ERROR) << "Unknow metric: " << metric_type_;
-    return 0;
+  // Return true if the larger metric is the better, which
+  // is false for the errors (logloss, mae and mape)
+  bool larger_is_better() const {
+    return metric_type_ != kMetricMAE &&
+           metric_type_ != kMetricMAPE &&
+           metric_type_ != kMetricLogLoss;
   }
 
   // Accumulate counters during the training
@@ -80,88 +213,70 @@ class Metric {
                   const std::vector<real_t>& pred) {
     CHECK_NE(pred.empty(), true);
     CHECK_NE(Y.empty(), true);
-    counter_ += pred.size();
-    for (size_t i = 0; i < pred.size(); ++i) {
-      if (metric_type_.compare("mae") == 0) {
-        error_accum_ += (abs(Y[i] - pred[i]));
-      } else if (metric_type_.compare("mape") == 0) {
-        error_accum_ += (abs(Y[i] - pred[i]) / Y[i]);
-      } else {
-        if (pred[i] >= 0) {  // for positive prediction
-          if (Y[i] == 1) {
-            ++true_pos_;
-          } else {
-            ++false_pos_;
-          }
-        } else {  // for negative prediction
-          if (Y[i] == 1) {
-            ++false_neg_;
-          } else {
-            ++true_neg_;
-          }
-        }
-      }
-    }
+    Accumulate(Y.data(), pred.data(), pred.size(), &count_);
   }
 
-  // Reset counters for the next epoch
-  void Reset() {
-    counter_ = 0;
-    true_pos_ = 0;
-    false_pos_ = 0;
-    true_neg_ = 0;
-    false_neg_ = 0;
-    error_accum_ = 0.0;
+  // Accumulate the n predictions into counter, which
+  // can be invoked by multiple threads
+  void Accumulate(const real_t* Y, const real_t* pred,
+                  size_t n, MetricCounter* counter) const;
+
+  // Merge the counters of a thread, which can be
+  // invoked by multiple threads
+  void Merge(const MetricCounter& counter) {
+    std::lock_guard<std::mutex> lock(merge_mutex_);
+    count_.Merge(counter);
   }
 
-  // Return metric value
-  real_t GetMetric() const {
-    if (metric_type_.compare("acc") == 0) {
-      return Accuracy();
-    } else if (metric_type_.compare("prec") == 0) {
-      return Precision();
-    } else if (metric_type_.compare("recall") == 0) {
-      return Recall();
-    } else if (metric_type_.compare("f1") == 0) {
-      return F1();
-    } else if (metric_type_.compare("AUC") == 0) {
-      return AUC();
-    } else if (metric_type_.compare("mae") == 0) {
-      return MAE();
-    } else if (metric_type_.compare("mape") == 0) {
-      return MAPE();
+  // Reset counters for the next epoch
+  void Reset() { count_.Reset(); }
+
+  // The accumulated counters, which can be saved and
+  // merged back after the metric is used by others
+  const MetricCounter& Counter() const { return count_; }
+
+  // Return metric value of the first metric, or the i-th one
+  real_t GetMetric() const { return value(metric_type_); }
+  real_t GetMetric(size_t i) const { return value(metric_types_[i]); }
+
+  // The values of all the metrics
+  std::vector<real_t> GetMetrics() const {
+    std::vector<real_t> res;
+    for (size_t i = 0; i < metric_types_.size(); ++i) {
+      res.push_back(value(metric_types_[i]));
     }
-    LOG(ERROR) << "Unknow metric: " << metric_type_;
-    return 0;
+    return res;
   }
 
 protected:
-  /* Can be 'acc', 'prec', 'recall', 'f1'
-     'mae', and 'mape' */
-  std::string metric_type_;
-  /* The number of total example */
-  index_t counter_;
-  /* The number of true positive */
-  index_t true_pos_;
-  /* The number of false positive */
-  index_t false_pos_;
-  /* The number of true negative */
-  index_t true_neg_;
-  /* The number of false negative */
-  index_t false_neg_;
-  /* Sum of error for regression tasks */
-  real_t error_accum_;
+  /* Can be 'acc', 'prec', 'recall', 'f1', 'auc',
+     'logloss', 'mae', and 'mape' */
+  MetricType metric_type_;
+  /* All the metrics, and the first one is metric_type_ */
+  std::vector<MetricType> metric_types_;
+  /* The counters needed by the metrics, which are
+  computed once for all the metrics */
+  bool need_confusion_;
+  bool need_auc_;
+  /* True for the exact AUC */
+  bool exact_auc_;
+  /* The pool of the exact AUC */
+  ThreadPool* pool_;
+  /* The accumulated counters, and the lock of Merge() */
+  MetricCounter count_;
+  std::mutex merge_mutex_;
   // A set of metric funtions
   real_t Accuracy() const;
   real_t Precision() const;
   real_t Recall() const;
   real_t F1() const;
   real_t AUC() const;
+  real_t LogLoss() const;
   real_t MAE() const;
   real_t MAPE() const;
 
-  // Return the absolute value
-  inline real_t abs(real_t a) { return a >= 0 ? a : -a; }
+  static std::string type_name(MetricType type);
+  real_t value(MetricType type) const;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Metric);
@@ -0,0 +1,184 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the Metric class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "src/loss/metric.h"
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// The AUC by comparing all the pairs of examples
+static double brute_force_auc(const std::vector<real_t>& Y,
+                              const std::vector<real_t>& pred) {
+  double area = 0, num_pos = 0, num_neg = 0;
+  for (size_t i = 0; i < Y.size(); ++i) {
+    if (Y[i] != 1) { continue; }
+    num_pos++;
+    for (size_t j = 0; j < Y.size(); ++j) {
+      if (Y[j] == 1) { continue; }
+      if (pred[i] > pred[j]) { area += 1; }
+      if (pred[i] == pred[j]) { area += 0.5; }
+    }
+  }
+  for (size_t i = 0; i < Y.size(); ++i) { num_neg += (Y[i] != 1); }
+  return area / (num_pos * num_neg);
+}
+
+TEST(METRIC_TEST, AUC_Small) {
+  std::vector<real_t> Y = {1, -1, 1, -1};
+  std::vector<real_t> pred = {0.8, 0.3, -0.5, -0.9};
+  for (int exact = 0; exact < 2; ++exact) {
+    Metric metric;
+    metric.Initialize("auc", exact == 1);
+    EXPECT_EQ(metric.type(), "AUC");
+    metric.Accumulate(Y, pred);
+    EXPECT_FLOAT_EQ(metric.GetMetric(), 0.75);
+    // The same result for the second call
+    EXPECT_FLOAT_EQ(metric.GetMetric(), 0.75);
+    metric.Reset();
+    EXPECT_FLOAT_EQ(metric.GetMetric(), 0.5);
+  }
+}
+
+TEST(METRIC_TEST, AUC_Ties) {
+  std::vector<real_t> Y = {1, 0, 1, 0};
+  std::vector<real_t> pred = {1.0, 1.0, 2.0, 2.0};
+  for (int exact = 0; exact < 2; ++exact) {
+    Metric metric;
+    metric.Initialize("auc", exact == 1);
+    metric.Accumulate(Y, pred);
+    EXPECT_FLOAT_EQ(metric.GetMetric(), 0.5);
+  }
+}
+
+TEST(METRIC_TEST, AUC_Merge_Threads) {
+  const size_t kNum = 200000;
+  std::mt19937 rng(7);
+  std::normal_distribution<real_t> noise(0, 1.5);
+  std::vector<real_t> Y(kNum), pred(kNum);
+  for (size_t i = 0; i < kNum; ++i) {
+    Y[i] = (rng() % 3 == 0) ? 1 : 0;
+    pred[i] = (Y[i] == 1 ? 0.8 : -0.4) + noise(rng);
+  }
+  ThreadPool pool(4);
+  Metric exact, bucket;
+  exact.Initialize("auc", true);
+  exact.SetThreadPool(&pool);
+  bucket.Initialize("auc");
+  // Four counters of the threads
+  const size_t kPart = kNum / 4;
+  for (size_t t = 0; t < 4; ++t) {
+    MetricCounter counter_exact, counter_bucket;
+    exact.Accumulate(Y.data() + t * kPart, pred.data() + t * kPart,
+                     kPart, &counter_exact);
+    bucket.Accumulate(Y.data() + t * kPart, pred.data() + t * kPart,
+                      kPart, &counter_bucket);
+    exact.Merge(counter_exact);
+    bucket.Merge(counter_bucket);
+  }
+  // Sort by one thread
+  Metric single;
+  single.Initialize("auc", true);
+  single.Accumulate(Y, pred);
+  real_t auc = single.GetMetric();
+  EXPECT_GT(auc, 0.6);
+  EXPECT_FLOAT_EQ(exact.GetMetric(), auc);
+  EXPECT_NEAR(bucket.GetMetric(), auc, 1e-4);
+  // Compare to the brute force on a small subset
+  std::vector<real_t> small_Y(Y.begin(), Y.begin() + 2000);
+  std::vector<real_t> small_pred(pred.begin(), pred.begin() + 2000);
+  Metric small;
+  small.Initialize("auc", true);
+  small.Accumulate(small_Y, small_pred);
+  EXPECT_NEAR(small.GetMetric(),
+              brute_force_auc(small_Y, small_pred), 1e-6);
+}
+
+TEST(METRIC_TEST, AUC_Out_Of_Range) {
+  std::vector<real_t> Y = {1, 0, 1, 0};
+  std::vector<real_t> pred = {100, -100, 50, 20};
+  Metric metric;
+  metric.Initialize("auc");
+  metric.Accumulate(Y, pred);
+  // 100, 50 and 20 are in the last bucket, which count half
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 0.75);
+  metric.Initialize("auc", true);
+  metric.Accumulate(Y, pred);
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 1.0);
+}
+
+TEST(METRIC_TEST, Accuracy) {
+  std::vector<real_t> Y = {1, -1, 1, -1};
+  std::vector<real_t> pred = {0.8, 0.3, -0.5, -0.9};
+  Metric metric;
+  metric.Initialize("acc");
+  metric.Accumulate(Y, pred);
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 0.5);
+}
+
+TEST(METRIC_TEST, LogLoss) {
+  std::vector<real_t> Y = {1, -1, 1, -1};
+  std::vector<real_t> pred = {0.8, 0.3, -0.5, -0.9};
+  Metric metric;
+  metric.Initialize("logloss");
+  metric.Accumulate(Y, pred);
+  double expected = 0;
+  for (size_t i = 0; i < Y.size(); ++i) {
+    expected += log1p(exp(-Y[i] * pred[i]));
+  }
+  expected /= Y.size();
+  EXPECT_NEAR(metric.GetMetric(), expected, 1e-5);
+  EXPECT_FALSE(metric.larger_is_better());
+  EXPECT_EQ(metric.type(), "LogLoss");
+}
+
+TEST(METRIC_TEST, Multi_Metrics) {
+  EXPECT_TRUE(Metric::IsMetric("logloss"));
+  EXPECT_FALSE(Metric::IsMetric("rmse"));
+  std::vector<real_t> Y = {1, -1, 1, -1};
+  std::vector<real_t> pred = {0.8, 0.3, -0.5, -0.9};
+  Metric metric;
+  metric.Initialize("auc,logloss,acc");
+  ASSERT_EQ(metric.NumMetrics(), 3);
+  EXPECT_EQ(metric.type(1), "LogLoss");
+  EXPECT_TRUE(metric.larger_is_better());
+  metric.Accumulate(Y, pred);
+  std::vector<real_t> vals = metric.GetMetrics();
+  ASSERT_EQ(vals.size(), 3);
+  // Each metric is the same as the metric computed alone
+  const char* names[] = {"auc", "logloss", "acc"};
+  for (size_t i = 0; i < vals.size(); ++i) {
+    Metric single;
+    single.Initialize(names[i]);
+    single.Accumulate(Y, pred);
+    EXPECT_FLOAT_EQ(vals[i], single.GetMetric());
+  }
+  EXPECT_FLOAT_EQ(metric.GetMetric(), vals[0]);
+}
+
+}  // namespace xLearn
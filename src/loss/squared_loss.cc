@@ -24,54 +24,37 @@ This file is the implementation of SquaredLoss class.
 namespace xLearn {
 
 // Given predictions and labels, return squared loss value
-real_t SquaredLoss::Evalute(const std::vector<real_t>& pred,
-                            const std::vector<real_t>& label) {
-  CHECK_EQ(pred.empty(), false);
+real_t SquaredLoss::Evalute(const real_t* pred,
+                            const real_t* label,
+                            size_t n) {
   real_t val = 0.0;
-  for (size_t i = 0; i < pred.size(); ++i) {
+  for (size_t i = 0; i < n; ++i) {
     real_t error = label[i] - pred[i];
     val += (error*error);
   }
   return val * 0.5;
 }
 
-// Calculate gradient in one thread
-void squared_thread(const DMatrix* matrix,
-                    Model* model,
-                    Score* score_func,
-                    bool is_norm,
-                    index_t start,
-                    index_t end) {
-  CHECK_GT(end, start);
-  for (size_t i = start; i < end; ++i) {
-    SparseRow* row = matrix->row[i];
-    real_t norm = is_norm ? matrix->norm[i] : 1.0;
-    real_t score = score_func->CalcScore(row, *model, norm);
-    // partial gradient: -error
-    real_t pg = score - matrix->Y[i];
-    // real gradient and update
-    score_func->CalcGrad(row, *model, pg, norm);
+// The label and the partial gradient of squared loss
+struct SquaredPolicy {
+  static real_t Label(real_t y) { return y; }
+  // -error
+  static bool Grad(real_t score, real_t y, real_t* pg) {
+    *pg = score - y;
+    return true;
   }
-}
+};
 
 // Calculate gradient in multi-thread
 void SquaredLoss::CalcGrad(const DMatrix* matrix,
-                           Model& model) {
-  CHECK_NOTNULL(matrix);
-  CHECK_GT(matrix->row_length, 0);
-  size_t row_len = matrix->row_length;
-  for (int i = 0; i < threadNumber_; ++i) {
-    size_t start = getStart(row_len, threadNumber_, i);
-    size_t end = getEnd(row_len, threadNumber_, i);
-    pool_->enqueue(std::bind(squared_thread,
-                             matrix,
-                             &model,
-                             score_func_,
-                             norm_,
-                             start,
-                             end));
-  }
-  pool_->Sync();
+                           Model& model,
+                           std::vector<real_t>* pred) {
+  calc_grad<SquaredPolicy>(matrix, model, pred);
+}
+
+void SquaredLoss::calc_rows(const RowBlock& block, Model* m,
+                            real_t* score) {
+  grad_block<SquaredPolicy>(block, m, score);
 }
 
 } // namespace xLearn
@@ -24,7 +24,11 @@ This file tests the SquaredLoss class.
 
 #include <vector>
 
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/linear_score.h"
 #include "src/loss/squared_loss.h"
+#include "src/loss/metric.h"
 
 namespace xLearn {
 
@@ -47,4 +51,166 @@ TEST(SQUARED_LOSS, Evalute) {
   EXPECT_FLOAT_EQ(val, 142.5);
 }
 
+TEST(SQUARED_LOSS, Thread_mode) {
+  // y = 2 + x_j, where each row has one of 4 features
+  const index_t kRow = 400;
+  DMatrix matrix;
+  matrix.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.AddNode(i, i % 4, 1.0);
+    matrix.Y[i] = 3.0;
+  }
+  ThreadMode mode[] = { kThreadHogwild, kThreadLocalBias, kThreadReplica };
+  for (int m = 0; m < 3; ++m) {
+    Model model;
+    model.Initialize("linear", "squared", 4, 0, 0);
+    LinearScore score;
+    score.Initialize(0.1, 0, &model);
+    SquaredLoss loss;
+    loss.Initialize(&score, false);
+    loss.SetThreadMode(mode[m]);
+    std::vector<real_t> pred(kRow);
+    loss.Predict(&matrix, model, pred);
+    real_t first = loss.Evalute(pred, matrix.Y);
+    for (int n = 0; n < 20; ++n) {
+      loss.CalcGrad(&matrix, model);
+    }
+    loss.Predict(&matrix, model, pred);
+    EXPECT_LT(loss.Evalute(pred, matrix.Y), first * 0.1);
+  }
+}
+
+// The scores returned by CalcGrad() are the ones before
+// the update of each row
+TEST(SQUARED_LOSS, Running_score) {
+  DMatrix matrix;
+  matrix.ResetMatrix(1);
+  matrix.AddNode(0, 1, 1.0);
+  matrix.Y[0] = 3.0;
+  Model model;
+  model.Initialize("linear", "squared", 4, 0, 0);
+  LinearScore score;
+  score.Initialize(0.1, 0, &model);
+  SquaredLoss loss;
+  loss.Initialize(&score, false);
+  std::vector<real_t> pred(1);
+  std::vector<real_t> running;
+  for (int n = 0; n < 3; ++n) {
+    loss.Predict(&matrix, model, pred);
+    loss.CalcGrad(&matrix, model, &running);
+    ASSERT_EQ(running.size(), 1);
+    EXPECT_FLOAT_EQ(running[0], pred[0]);
+  }
+  // The model has been updated
+  loss.Predict(&matrix, model, pred);
+  EXPECT_NE(running[0], pred[0]);
+}
+
+// The loss and metric evaluated by the threads of Predict()
+// are the same as the serial ones
+TEST(SQUARED_LOSS, Predict_evalute) {
+  const index_t kRow = 1000;
+  DMatrix matrix;
+  matrix.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.AddNode(i, i % 4, 1.0);
+    matrix.Y[i] = (i % 3 == 0) ? 1.0 : -1.0;
+  }
+  Model model;
+  model.Initialize("linear", "squared", 4, 0, 0);
+  LinearScore score;
+  score.Initialize(0.1, 0, &model);
+  SquaredLoss loss;
+  loss.Initialize(&score, false, 3);
+  for (int n = 0; n < 5; ++n) {
+    loss.CalcGrad(&matrix, model);
+  }
+  std::vector<real_t> pred(kRow);
+  loss.Predict(&matrix, model, pred);
+  real_t serial_loss = loss.Evalute(pred, matrix.Y);
+  Metric serial_metric;
+  serial_metric.Initialize("acc");
+  serial_metric.Accumulate(matrix.Y, pred);
+  Schedule schedule[] = { kScheduleStatic, kScheduleDynamic, kScheduleSteal };
+  for (int s = 0; s < 3; ++s) {
+    loss.SetSchedule(schedule[s]);
+    loss.SetGrain(s == 0 ? 0 : 7);
+    Metric metric;
+    metric.Initialize("acc");
+    std::vector<real_t> fused(kRow);
+    real_t val = loss.PredictEvalute(&matrix, model, fused, &metric);
+    EXPECT_NEAR(val, serial_loss, serial_loss * 1e-5);
+    EXPECT_FLOAT_EQ(metric.GetMetric(), serial_metric.GetMetric());
+    metric.Reset();
+    val = loss.EvaluteMetric(fused, matrix.Y, &metric);
+    EXPECT_NEAR(val, serial_loss, serial_loss * 1e-5);
+    EXPECT_FLOAT_EQ(metric.GetMetric(), serial_metric.GetMetric());
+  }
+}
+
+// The balanced ranges give the same model, and the
+// busy time of each thread is accumulated
+TEST(SQUARED_LOSS, Row_cost) {
+  const index_t kRow = 200;
+  DMatrix matrix;
+  matrix.ResetMatrix(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    // The first rows are much longer
+    index_t len = i < 20 ? 40 : 1;
+    for (index_t j = 0; j < len; ++j) {
+      matrix.AddNode(i, j, 0.1);
+    }
+    matrix.Y[i] = 1.0;
+  }
+  std::vector<real_t> pred[2];
+  for (int c = 0; c < 2; ++c) {
+    matrix.ComputeRowCost(c == 0 ? kRowCostNone : kRowCostLinear);
+    Model model;
+    model.Initialize("linear", "squared", 40, 0, 0);
+    LinearScore score;
+    score.Initialize(0.1, 0, &model);
+    SquaredLoss loss;
+    loss.Initialize(&score, false, 1);
+    loss.CalcGrad(&matrix, model);
+    const LoadStats& load = loss.GetLoadStats();
+    ASSERT_EQ(load.busy.size(), 1);
+    EXPECT_GT(load.wall, 0);
+    EXPECT_DOUBLE_EQ(load.imbalance(), 1.0);
+    EXPECT_EQ(load.loops, 1);
+    EXPECT_DOUBLE_EQ(load.straggler(), 1.0);
+    loss.ResetLoadStats();
+    EXPECT_EQ(loss.GetLoadStats().wall, 0);
+    EXPECT_EQ(loss.GetLoadStats().loops, 0);
+    pred[c].resize(kRow);
+    loss.Predict(&matrix, model, pred[c]);
+  }
+  for (index_t i = 0; i < kRow; ++i) {
+    EXPECT_FLOAT_EQ(pred[0][i], pred[1][i]);
+  }
+}
+
+TEST(SQUARED_LOSS, Load_Stats_Straggler) {
+  LoadStats load;
+  load.busy.assign(3, 0);
+  // The third thread has no task
+  std::vector<double> begin = {0.1, 0.2, -1.0};
+  std::vector<double> end = {1.0, 3.0, 0};
+  load.AddLoop(4.0, begin, end);
+  EXPECT_EQ(load.loops, 1);
+  EXPECT_DOUBLE_EQ(load.wall, 4.0);
+  EXPECT_DOUBLE_EQ(load.wakeup, 0.1);
+  EXPECT_DOUBLE_EQ(load.tail, 2.0);
+  EXPECT_DOUBLE_EQ(load.straggler(), 1.5);
+  LoadStats other;
+  other.busy.assign(3, 0);
+  end = {1.0, 1.0, 0};
+  other.AddLoop(2.0, begin, end);
+  load.Merge(other);
+  EXPECT_EQ(load.loops, 2);
+  EXPECT_DOUBLE_EQ(load.wall, 6.0);
+  EXPECT_DOUBLE_EQ(load.straggler(), 1.25);
+  EXPECT_DOUBLE_EQ(load.straggler_max, 1.5);
+  EXPECT_DOUBLE_EQ(load.idle(2), 6.0);
+}
+
 } // namespace xLearn
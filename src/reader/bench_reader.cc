@@ -0,0 +1,325 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the bench_reader tool, which measures where the
+startup time of training goes: Parse() of the LibsvmParser, FFMParser
+and CSVParser, Serialize() / Deserialize() / MmapDeserialize() of the
+DMatrix, and Initialize() of the InmemReader from the txt file (cold,
+which also writes the binary cache) and from the binary cache (warm):
+
+  bench_reader [ options ]
+
+The txt files are generated, or given by -i. All the files are read
+from the page cache, so it is the CPU cost rather than the disk.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/split_string.h"
+#include "src/base/stringprintf.h"
+#include "src/data/data_structure.h"
+#include "src/data/hyper_parameters.h"
+#include "src/reader/parser.h"
+#include "src/reader/reader.h"
+
+namespace xLearn {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     bench_reader [ options ] \n"
+"                               \n"
+"  Report the time, MB/sec (of the txt file or the binary file) and rows/sec of each stage of \n"
+"  loading the data, which is the best of the repeated runs. \n"
+"                                                             \n"
+"OPTIONS: \n"
+"  -format <format>     :  'libsvm', 'ffm', 'csv' or 'all'. Using 'all' by default. \n"
+"                                                                                  \n"
+"  -i <file>            :  Use the given txt file of -format instead of the generated one. \n"
+"                                                                                        \n"
+"  -rows <number>       :  Number of rows of the generated file. Using 200000 by default. \n"
+"                                                                                        \n"
+"  -nnz <number>        :  Number of nodes (or columns of csv) of a row. Using 40 by default. \n"
+"                                                                                           \n"
+"  -nthread <list>      :  Comma-separated numbers of threads of Parse(). Using '1,<number of \n"
+"                          hardware threads>' by default. \n"
+"                                                         \n"
+"  -repeat <number>     :  Number of runs of each stage. Using 3 by default. \n"
+"                                                                            \n"
+"  -o <prefix>          :  Prefix of the generated files. Using './xlearn_bench_reader' by default. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct BenchOption {
+  std::vector<std::string> format = { "libsvm", "ffm", "csv" };
+  std::string input_file;
+  index_t num_rows = 200000;
+  index_t nnz = 40;
+  std::vector<int> num_thread;
+  int repeat = 3;
+  std::string prefix = "./xlearn_bench_reader";
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], BenchOption* option) {
+  int hardware = std::max(1u, std::thread::hardware_concurrency());
+  option->num_thread = { 1 };
+  if (hardware > 1) { option->num_thread.push_back(hardware); }
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (i + 1 == argc) {
+      printf("[Error] The option %s needs a value \n", argv[i]);
+      return false;
+    }
+    std::string value(argv[++i]);
+    int number = atoi(value.c_str());
+    bool bo = true;
+    if (arg == "-format") {
+      if (value == "all") {
+        option->format = { "libsvm", "ffm", "csv" };
+      } else {
+        option->format = { value };
+        bo = value == "libsvm" || value == "ffm" || value == "csv";
+      }
+    } else if (arg == "-i") {
+      option->input_file = value;
+      bo = FileExist(value.c_str());
+    } else if (arg == "-rows") {
+      option->num_rows = number;
+      bo = number > 0;
+    } else if (arg == "-nnz") {
+      option->nnz = number;
+      bo = number > 0;
+    } else if (arg == "-nthread") {
+      std::vector<std::string> items;
+      SplitStringUsing(value, ",", &items);
+      option->num_thread.clear();
+      for (size_t j = 0; j < items.size(); ++j) {
+        option->num_thread.push_back(atoi(items[j].c_str()));
+        bo = bo && option->num_thread.back() > 0;
+      }
+      bo = bo && !items.empty();
+    } else if (arg == "-repeat") {
+      option->repeat = number;
+      bo = number > 0;
+    } else if (arg == "-o") {
+      option->prefix = value;
+    } else {
+      printf("[Error] Unknow option: %s \n", arg.c_str());
+      return false;
+    }
+    if (!bo) {
+      printf("[Error] Illegal %s : '%s' \n", arg.c_str(), value.c_str());
+      return false;
+    }
+  }
+  if (!option->input_file.empty() && option->format.size() != 1) {
+    printf("[Error] The -i needs the -format of the file \n");
+    return false;
+  }
+  return true;
+}
+
+// Write the txt file of nnz nodes per row. The libsvm and libffm rows
+// have the sorted random ids of a million features, and the csv rows
+// have nnz dense values followed by the label
+void write_txt(const std::string& filename, const std::string& format,
+               index_t num_rows, index_t nnz) {
+  std::mt19937 gen(2018);
+  std::uniform_int_distribution<index_t> feat(0, 999999);
+  std::uniform_real_distribution<real_t> value(0, 1);
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  std::vector<index_t> ids(nnz);
+  std::string line;
+  char buf[64];
+  for (index_t i = 0; i < num_rows; ++i) {
+    int label = gen() & 1;
+    line.clear();
+    if (format == "csv") {
+      for (index_t j = 0; j < nnz; ++j) {
+        snprintf(buf, sizeof(buf), "%.3f ", value(gen));
+        line += buf;
+      }
+      line += label ? "1\n" : "0\n";
+    } else {
+      line = label ? "1" : "0";
+      for (index_t j = 0; j < nnz; ++j) { ids[j] = feat(gen); }
+      std::sort(ids.begin(), ids.end());
+      for (index_t j = 0; j < nnz; ++j) {
+        if (format == "ffm") {
+          snprintf(buf, sizeof(buf), " %u:%u:1", j % 8, ids[j]);
+        } else {
+          snprintf(buf, sizeof(buf), " %u:1", ids[j]);
+        }
+        line += buf;
+      }
+      line += "\n";
+    }
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+}
+
+inline double now_sec() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Remove the file if it exists
+void remove_file(const std::string& filename) {
+  if (FileExist(filename.c_str())) { RemoveFile(filename.c_str()); }
+}
+
+// Print one line of the report
+void report(const std::string& format, const std::string& stage,
+            const std::string& threads, double sec,
+            uint64 bytes, index_t rows) {
+  printf("%-8s %-20s %8s %10.4f %10.1f %14.0f \n",
+         format.c_str(), stage.c_str(), threads.c_str(), sec,
+         sec > 0 ? bytes / sec / MB : 0, sec > 0 ? rows / sec : 0);
+  fflush(stdout);
+}
+
+// Size of the file
+uint64 file_size(const std::string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  Close(file);
+  return size;
+}
+
+// Measure the stages of one format
+void bench(const BenchOption& option, const std::string& format) {
+  std::string txt_file = option.input_file;
+  if (txt_file.empty()) {
+    txt_file = option.prefix + "." + format;
+    write_txt(txt_file, format, option.num_rows, option.nnz);
+  }
+  std::string bin_file = txt_file + ".bin";
+  uint64 txt_size = file_size(txt_file);
+  // Parse the txt file in the heap buffer
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(txt_file, &buffer);
+  DMatrix matrix;
+  for (size_t t = 0; t < option.num_thread.size(); ++t) {
+    // The parser of libffm is registered as "libffm"
+    Parser* parser = CREATE_PARSER(format == "ffm" ? "libffm" :
+                                   format.c_str());
+    CHECK_NOTNULL(parser);
+    parser->setLabel(true);
+    parser->setThreadNumber(option.num_thread[t]);
+    double best = 0;
+    for (int r = 0; r < option.repeat; ++r) {
+      matrix.Release();
+      matrix.SetCSR(true);
+      double start = now_sec();
+      parser->Parse(buffer, size, matrix);
+      double sec = now_sec() - start;
+      if (r == 0 || sec < best) { best = sec; }
+    }
+    report(format, "parse", StringPrintf("%d", option.num_thread[t]),
+           best, txt_size, matrix.row_length);
+    delete parser;
+  }
+  delete [] buffer;
+  index_t num_rows = matrix.row_length;
+  // The binary file of the DMatrix
+  double best_write = 0, best_read = 0, best_mmap = 0;
+  for (int r = 0; r < option.repeat; ++r) {
+    double start = now_sec();
+    matrix.Serialize(bin_file);
+    double write = now_sec() - start;
+    DMatrix loaded;
+    start = now_sec();
+    loaded.Deserialize(bin_file);
+    double read = now_sec() - start;
+    DMatrix mapped;
+    start = now_sec();
+    mapped.MmapDeserialize(bin_file);
+    double mmap = now_sec() - start;
+    if (r == 0 || write < best_write) { best_write = write; }
+    if (r == 0 || read < best_read) { best_read = read; }
+    if (r == 0 || mmap < best_mmap) { best_mmap = mmap; }
+  }
+  uint64 bin_size = file_size(bin_file);
+  report(format, "serialize", "1", best_write, bin_size, num_rows);
+  report(format, "deserialize", "1", best_read, bin_size, num_rows);
+  report(format, "mmap-deserialize", "1", best_mmap, bin_size, num_rows);
+  matrix.Release();
+  remove_file(bin_file);
+  // The in-memory Reader of training from the txt file (which
+  // writes the binary cache) and from the binary cache
+  HyperParam hyper_param;
+  int num_thread = option.num_thread.back();
+  double best_cold = 0, best_warm = 0;
+  for (int r = 0; r < option.repeat; ++r) {
+    remove_file(bin_file);
+    remove_file(bin_file + ".range");
+    for (int warm = 0; warm < 2; ++warm) {
+      Reader* reader = CREATE_READER("memory");
+      CHECK_NOTNULL(reader);
+      reader->SetThreadNumber(num_thread);
+      double start = now_sec();
+      reader->Initialize(txt_file, hyper_param.sample_size);
+      double sec = now_sec() - start;
+      delete reader;
+      double& best = warm ? best_warm : best_cold;
+      if (r == 0 || sec < best) { best = sec; }
+    }
+  }
+  std::string threads = StringPrintf("%d", num_thread);
+  report(format, "reader-cold (txt)", threads, best_cold,
+         txt_size, num_rows);
+  report(format, "reader-warm (.bin)", threads, best_warm,
+         bin_size, num_rows);
+  remove_file(bin_file);
+  remove_file(bin_file + ".range");
+  if (option.input_file.empty()) { remove_file(txt_file); }
+}
+
+}  // namespace xLearn
+
+//------------------------------------------------------------------------------
+// The Reader prints its own progress, so the lines of the report are
+// the ones that start with the format
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  xLearn::BenchOption option;
+  if (!xLearn::parse_option(argc, argv, &option)) {
+    printf("%s", xLearn::kUsage);
+    return 0;
+  }
+  printf("%-8s %-20s %8s %10s %10s %14s \n", "format", "stage",
+         "threads", "time(sec)", "MB/sec", "rows/sec");
+  for (size_t i = 0; i < option.format.size(); ++i) {
+    xLearn::bench(option, option.format[i]);
+  }
+  return 0;
+}
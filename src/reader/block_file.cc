@@ -0,0 +1,387 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of BlockFile.
+*/
+
+#include "src/reader/block_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef XLEARN_USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The io_uring by the raw system calls, so we don't depend on liburing.
+// Only the prefetch thread uses the ring, and there is at most one read
+// of each slot in flight, so the queues never overflow
+//------------------------------------------------------------------------------
+#if defined(XLEARN_USE_IO_URING) && defined(__NR_io_uring_setup)
+struct BlockFile::Uring {
+  int fd = -1;
+  void* sq_ring = MAP_FAILED;
+  void* cq_ring = MAP_FAILED;
+  uint64 sq_ring_size = 0;
+  uint64 cq_ring_size = 0;
+  io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+  uint64 sqes_size = 0;
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_mask = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned* cq_mask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+  /* The iovec of the read of each slot */
+  std::vector<struct iovec> iov;
+};
+
+static void close_uring(BlockFile::Uring* ring);
+
+// Return nullptr if the kernel does not support io_uring
+static BlockFile::Uring* open_uring(unsigned entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0) { return nullptr; }
+  BlockFile::Uring* ring = new BlockFile::Uring;
+  ring->fd = fd;
+  ring->iov.resize(entries);
+  ring->sq_ring_size = params.sq_off.array +
+                       params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = params.cq_off.cqes +
+                       params.cq_entries * sizeof(io_uring_cqe);
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  ring->sq_ring = mmap(nullptr, ring->sq_ring_size,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_SQ_RING);
+  ring->cq_ring = mmap(nullptr, ring->cq_ring_size,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_CQ_RING);
+  ring->sqes = (io_uring_sqe*)mmap(nullptr, ring->sqes_size,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE,
+                                   fd, IORING_OFF_SQES);
+  if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+      ring->sqes == MAP_FAILED) {
+    close_uring(ring);
+    return nullptr;
+  }
+  char* sq = (char*)ring->sq_ring;
+  char* cq = (char*)ring->cq_ring;
+  ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+  return ring;
+}
+
+static void close_uring(BlockFile::Uring* ring) {
+  if (ring == nullptr) { return; }
+  if (ring->sqes != MAP_FAILED) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring != MAP_FAILED) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != MAP_FAILED) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  close(ring->fd);
+  delete ring;
+}
+
+// Submit the read of len bytes at off into buf, which
+// is tagged by the id of its slot
+static void push_read(BlockFile::Uring* ring, int fd, unsigned id,
+                      char* buf, uint64 len, uint64 off) {
+  unsigned tail = *ring->sq_tail;
+  unsigned index = tail & *ring->sq_mask;
+  io_uring_sqe* sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  ring->iov[id].iov_base = buf;
+  ring->iov[id].iov_len = len;
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = fd;
+  sqe->addr = (uint64)&ring->iov[id];
+  sqe->len = 1;
+  sqe->off = off;
+  sqe->user_data = id;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  for (;;) {
+    int ret = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, nullptr, 0);
+    if (ret >= 0) { break; }
+    if (errno != EINTR && errno != EAGAIN) {
+      LOG(FATAL) << "Cannot submit the read: " << strerror(errno);
+    }
+  }
+}
+
+// Pop a completion, waiting for one if the queue is empty
+static void pop_completion(BlockFile::Uring* ring,
+                           unsigned* id, int64* res) {
+  for (;;) {
+    unsigned head = *ring->cq_head;
+    if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+      *id = (unsigned)cqe->user_data;
+      *res = cqe->res;
+      __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+      return;
+    }
+    int ret = syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+                      IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+      LOG(FATAL) << "Cannot wait for the read: " << strerror(errno);
+    }
+  }
+}
+#else
+struct BlockFile::Uring { };
+
+static BlockFile::Uring* open_uring(unsigned entries) { return nullptr; }
+
+static void close_uring(BlockFile::Uring* ring) { delete ring; }
+
+static void push_read(BlockFile::Uring* ring, int fd, unsigned id,
+                      char* buf, uint64 len, uint64 off) {
+  LOG(FATAL) << "The io_uring is not supported";
+}
+
+static void pop_completion(BlockFile::Uring* ring,
+                           unsigned* id, int64* res) {
+  LOG(FATAL) << "The io_uring is not supported";
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Implementation of BlockFile
+//------------------------------------------------------------------------------
+
+static inline uint64 align_down(uint64 x) {
+  return x / kDirectAlign * kDirectAlign;
+}
+
+static inline uint64 align_up(uint64 x) {
+  return (x + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+}
+
+BlockFile::BlockFile()
+  : fd_(-1), file_size_(0), direct_(false), drop_pages_(false),
+    buffer_size_(0), next_(0), submit_(0), uring_(nullptr) {  }
+
+BlockFile::~BlockFile() { Close(); }
+
+// The O_DIRECT is checked by reading the first page, since
+// some file systems only refuse it at reading time
+void BlockFile::Open(const std::string& filename, bool direct,
+                     int queue_depth, bool use_uring) {
+  CHECK_GT(queue_depth, 0);
+  Close();
+  direct_ = false;
+  drop_pages_ = false;
+#ifdef O_DIRECT
+  if (direct) {
+    fd_ = open(filename.c_str(), O_RDONLY | O_DIRECT);
+    if (fd_ >= 0) {
+      char* page = nullptr;
+      CHECK_EQ(posix_memalign((void**)&page, kDirectAlign,
+                              kDirectAlign), 0);
+      direct_ = pread(fd_, page, kDirectAlign, 0) >= 0;
+      free(page);
+      if (!direct_) {
+        close(fd_);
+        fd_ = -1;
+      }
+    }
+  }
+#endif
+  if (fd_ < 0) {
+    fd_ = open(filename.c_str(), O_RDONLY);
+    drop_pages_ = direct;
+  }
+  if (fd_ < 0) {
+    LOG(FATAL) << "Cannot open " << filename << ": " << strerror(errno);
+  }
+  struct stat st;
+  CHECK_EQ(fstat(fd_, &st), 0);
+  file_size_ = st.st_size;
+  slots_.assign(queue_depth, Slot());
+  if (use_uring) { uring_ = open_uring(queue_depth); }
+  pos_.clear();
+  size_.clear();
+  next_ = 0;
+  submit_ = 0;
+}
+
+void BlockFile::Close() {
+  if (fd_ < 0) { return; }
+  drain();
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    free(slots_[i].buf);
+  }
+  slots_.clear();
+  buffer_size_ = 0;
+  close_uring(uring_);
+  uring_ = nullptr;
+  close(fd_);
+  fd_ = -1;
+}
+
+void BlockFile::Start(const std::vector<uint64>& pos,
+                      const std::vector<uint64>& size) {
+  CHECK_GE(fd_, 0);
+  CHECK_EQ(pos.size(), size.size());
+  drain();
+  pos_ = pos;
+  size_ = size;
+  next_ = 0;
+  submit_ = 0;
+  while (submit_ < pos_.size() && submit_ < slots_.size()) {
+    submit(submit_++);
+  }
+}
+
+// The slot of the last block is free for the
+// block that is queue_depth blocks after it
+bool BlockFile::Next(const char** data, uint64* size) {
+  CHECK_NOTNULL(data);
+  CHECK_NOTNULL(size);
+  if (next_ > 0) {
+#ifdef POSIX_FADV_DONTNEED
+    if (drop_pages_) {
+      posix_fadvise(fd_, pos_[next_-1], size_[next_-1],
+                    POSIX_FADV_DONTNEED);
+    }
+#endif
+    while (submit_ < pos_.size() && submit_ < next_ + slots_.size()) {
+      submit(submit_++);
+    }
+  }
+  if (next_ >= pos_.size()) { return false; }
+  Slot& slot = slots_[next_ % slots_.size()];
+  wait(&slot);
+  *data = slot.buf + slot.offset;
+  *size = slot.size;
+  next_++;
+  return true;
+}
+
+// The O_DIRECT reads the aligned pages around the block
+void BlockFile::submit(size_t block) {
+  CHECK_LE(pos_[block] + size_[block], file_size_);
+  unsigned id = block % slots_.size();
+  Slot& slot = slots_[id];
+  CHECK(!slot.in_flight);
+  uint64 begin = direct_ ? align_down(pos_[block]) : pos_[block];
+  uint64 end = pos_[block] + size_[block];
+  if (direct_) { end = align_up(end); }
+  slot.read_pos = begin;
+  slot.read_size = end - begin;
+  slot.offset = pos_[block] - begin;
+  slot.size = size_[block];
+  slot.need = slot.offset + slot.size;
+  slot.done = 0;
+  if (slot.capacity < slot.read_size) {
+    free(slot.buf);
+    buffer_size_ -= slot.capacity;
+    slot.capacity = align_up(slot.read_size);
+    buffer_size_ += slot.capacity;
+    CHECK_EQ(posix_memalign((void**)&slot.buf, kDirectAlign,
+                            slot.capacity), 0);
+  }
+  slot.in_flight = true;
+  if (uring_ != nullptr) {
+    push_read(uring_, fd_, id, slot.buf, slot.read_size, slot.read_pos);
+  }
+}
+
+// The completions of the other slots are accounted while
+// waiting, and their short reads are submitted again
+void BlockFile::wait(Slot* slot) {
+  if (uring_ == nullptr) {
+    read_sync(slot);
+    return;
+  }
+  while (slot->in_flight) {
+    unsigned id = 0;
+    int64 res = 0;
+    pop_completion(uring_, &id, &res);
+    Slot& other = slots_[id];
+    if (complete(&other, res)) {
+      push_read(uring_, fd_, id, other.buf + other.done,
+                other.read_size - other.done,
+                other.read_pos + other.done);
+    }
+  }
+}
+
+// The reads of pread() are not started before wait()
+void BlockFile::drain() {
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    if (uring_ != nullptr) {
+      wait(&slots_[i]);
+    } else {
+      slots_[i].in_flight = false;
+    }
+  }
+}
+
+void BlockFile::read_sync(Slot* slot) {
+  while (slot->in_flight) {
+    ssize_t n = pread(fd_, slot->buf + slot->done,
+                      slot->read_size - slot->done,
+                      slot->read_pos + slot->done);
+    complete(slot, n < 0 ? -errno : n);
+  }
+}
+
+// The read is short at the end of file, which
+// can be beyond the block for O_DIRECT
+bool BlockFile::complete(Slot* slot, int64 n) {
+  if (n == -EINTR || n == -EAGAIN) { return true; }
+  if (n < 0) {
+    LOG(FATAL) << "Cannot read the block file: " << strerror(-n);
+  }
+  slot->done += n;
+  if (slot->done >= slot->need) {
+    slot->in_flight = false;
+    return false;
+  }
+  if (n == 0) {
+    LOG(FATAL) << "Unexpected end of the block file";
+  }
+  return true;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,152 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the BlockFile class that reads the blocks of a
+binary file with a queue of asynchronous reads.
+*/
+
+#ifndef XLEARN_READER_BLOCK_FILE_H_
+#define XLEARN_READER_BLOCK_FILE_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+// The alignment of the offset, the length and the buffer
+// of the reads of O_DIRECT, which is the page size
+const uint64 kDirectAlign = 4096;
+
+//------------------------------------------------------------------------------
+// BlockFile reads a list of byte ranges (blocks) of a file in the order of
+// the list, and it keeps up to queue_depth reads in flight ahead of the
+// block that is being used, so the decoding of a block is overlapped with
+// the reads of the next ones. It is used by the OndiskReader on NVMe:
+//
+//   BlockFile file;
+//   file.Open("train.txt.disk", true, 8);
+//   file.Start(pos, size);   /* the ranges of this epoch */
+//   const char* data = nullptr;
+//   uint64 size = 0;
+//   while (file.Next(&data, &size)) {
+//     /* use the size bytes of data */
+//   }
+//
+// The reads are submitted to io_uring if xLearn is built with the header
+// of io_uring (XLEARN_USE_IO_URING) and the kernel supports it. Otherwise,
+// the blocks are read by pread() one by one in Next().
+//
+// With the direct I/O, the file is opened with O_DIRECT, and each block is
+// read into an aligned buffer by the aligned reads around it, so a
+// multi-TB scan never fills the page cache of the host. If the file system
+// does not support O_DIRECT (e.g., tmpfs), the pages of each block are
+// dropped from the page cache by posix_fadvise() after it is used.
+//------------------------------------------------------------------------------
+class BlockFile {
+ public:
+  BlockFile();
+  ~BlockFile();
+
+  // Open the file with queue_depth buffers of the blocks. The
+  // io_uring is not used if use_uring is false
+  void Open(const std::string& filename, bool direct,
+            int queue_depth, bool use_uring = true);
+
+  // Wait for the reads in flight and close the file
+  void Close();
+
+  // Start to read the blocks [pos[i], pos[i] + size[i]) in the
+  // order of i, and the blocks of the last Start() are dropped
+  void Start(const std::vector<uint64>& pos,
+             const std::vector<uint64>& size);
+
+  // Return the next block, which is valid until the next call of
+  // Next() or Start(). Return false after the last block
+  bool Next(const char** data, uint64* size);
+
+  // True if the file is read by O_DIRECT and by io_uring
+  bool IsDirect() const { return direct_; }
+  bool IsUring() const { return uring_ != nullptr; }
+
+  // Bytes of the buffers of the blocks, which can be
+  // read by another thread
+  uint64 BufferSize() const { return buffer_size_.load(); }
+
+  // The ring of io_uring, which is defined in block_file.cc
+  struct Uring;
+
+ protected:
+  /* A block that is read into its buffer */
+  struct Slot {
+    char* buf = nullptr;
+    uint64 capacity = 0;
+    /* The aligned range that is read, and the bytes read */
+    uint64 read_pos = 0;
+    uint64 read_size = 0;
+    uint64 done = 0;
+    /* The block in the buffer, and the bytes to read */
+    uint64 offset = 0;
+    uint64 size = 0;
+    uint64 need = 0;
+    bool in_flight = false;
+  };
+  /* The opened file and its size */
+  int fd_;
+  uint64 file_size_;
+  /* Read with O_DIRECT, or drop the pages after use */
+  bool direct_;
+  bool drop_pages_;
+  /* The buffers of the blocks in flight */
+  std::vector<Slot> slots_;
+  std::atomic<uint64> buffer_size_;
+  /* The blocks of this epoch, the next block of Next()
+  and the next block to submit */
+  std::vector<uint64> pos_;
+  std::vector<uint64> size_;
+  size_t next_;
+  size_t submit_;
+  /* The ring of io_uring, or nullptr for pread() */
+  Uring* uring_;
+
+  // Read the block into the slot, or submit its read
+  void submit(size_t block);
+
+  // Wait until the slot has been read
+  void wait(Slot* slot);
+
+  // Wait for all the reads in flight
+  void drain();
+
+  // Read the rest of the slot by pread()
+  void read_sync(Slot* slot);
+
+  // Account the n bytes that are read into the slot, and
+  // return true if the rest of the slot should be read again
+  bool complete(Slot* slot, int64 n);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BlockFile);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_BLOCK_FILE_H_
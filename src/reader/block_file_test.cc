@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the BlockFile class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/reader/block_file.h"
+
+using std::string;
+using std::vector;
+
+namespace xLearn {
+
+const string kTestfilename = "./test_block_file";
+
+// The blocks are not aligned, and the last block
+// ends at the end of file
+void WriteBlocks(vector<char>* data, vector<uint64>* pos,
+                 vector<uint64>* size) {
+  const uint64 kSizes[] = { 100, 5000, 1, 8192, 4096, 3333, 77 };
+  pos->clear();
+  size->clear();
+  data->clear();
+  for (int i = 0; i < 7; ++i) {
+    pos->push_back(data->size());
+    size->push_back(kSizes[i]);
+    for (uint64 j = 0; j < kSizes[i]; ++j) {
+      data->push_back((char)(i * 31 + j * 7));
+    }
+  }
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  WriteDataToDisk(file, data->data(), data->size());
+  Close(file);
+}
+
+// The blocks are returned in the order of the list in each
+// way of reading, and an epoch can be stopped at any block
+TEST(BlockFileTest, Next) {
+  vector<char> data;
+  vector<uint64> pos, size;
+  WriteBlocks(&data, &pos, &size);
+  // Read the blocks in another order, and some twice
+  const int kOrder[] = { 3, 0, 6, 2, 5, 1, 4, 3, 6 };
+  vector<uint64> order_pos, order_size;
+  for (int i = 0; i < 9; ++i) {
+    order_pos.push_back(pos[kOrder[i]]);
+    order_size.push_back(size[kOrder[i]]);
+  }
+  for (int direct = 0; direct < 2; ++direct) {
+    for (int uring = 0; uring < 2; ++uring) {
+      for (int depth = 1; depth <= 4; depth += 3) {
+        BlockFile file;
+        file.Open(kTestfilename, direct == 1, depth, uring == 1);
+        if (uring == 0) { EXPECT_FALSE(file.IsUring()); }
+        if (direct == 0) { EXPECT_FALSE(file.IsDirect()); }
+        for (int epoch = 0; epoch < 3; ++epoch) {
+          file.Start(order_pos, order_size);
+          // The second epoch stops after two blocks
+          int num_block = epoch == 1 ? 2 : 9;
+          const char* block = nullptr;
+          uint64 block_size = 0;
+          for (int i = 0; i < num_block; ++i) {
+            ASSERT_TRUE(file.Next(&block, &block_size));
+            ASSERT_EQ(block_size, order_size[i]);
+            EXPECT_EQ(memcmp(block, data.data() + order_pos[i],
+                             block_size), 0);
+          }
+          if (epoch != 1) {
+            EXPECT_FALSE(file.Next(&block, &block_size));
+          }
+        }
+        EXPECT_GT(file.BufferSize(), 0);
+      }
+    }
+  }
+  RemoveFile(kTestfilename.c_str());
+}
+
+}  // namespace xLearn
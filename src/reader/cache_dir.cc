@@ -0,0 +1,152 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of CacheDir.
+*/
+
+#include "src/reader/cache_dir.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+// The temporary files contain this tag in their names
+static const char kTempTag[] = ".tmp.";
+
+CacheDir::CacheDir(const std::string& dir, uint64 max_bytes)
+  : dir_(dir), max_bytes_(max_bytes) {
+  CHECK(!dir.empty());
+  struct stat st;
+  if (mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+    LOG(FATAL) << "Cannot create the cache directory " << dir_
+               << ": " << strerror(errno);
+  }
+  if (stat(dir_.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    LOG(FATAL) << "The cache directory " << dir_
+               << " is not a directory";
+  }
+}
+
+// The key of a version of the file is read from its
+// <fingerprint>.key, or it is written there
+uint64 CacheDir::ContentKey(const std::string& filename) {
+  uint64 fingerprint = FingerprintFile(filename);
+  std::string index = dir_ + StringPrintf("/%016llx.key",
+                                          (unsigned long long)fingerprint);
+  uint64 key = 0;
+  FILE* file = fopen(index.c_str(), "rb");
+  if (file != nullptr) {
+    size_t size = fread(&key, 1, sizeof(key), file);
+    fclose(file);
+    if (size == sizeof(key)) {
+      Touch(index);
+      return key;
+    }
+  }
+  key = HashFile(filename, false);
+  std::string temp = TempPath(index);
+  file = OpenFileOrDie(temp.c_str(), "wb");
+  WriteDataToDisk(file, (char*)&key, sizeof(key));
+  Close(file);
+  Commit(temp, index);
+  return key;
+}
+
+std::string CacheDir::Path(uint64 key, uint64 magic) const {
+  return dir_ + StringPrintf("/%016llx.%016llx.bin",
+                             (unsigned long long)key,
+                             (unsigned long long)magic);
+}
+
+// The error is ignored, since a cache of a read-only
+// directory is still used without its mtime
+void CacheDir::Touch(const std::string& path) {
+  utimes(path.c_str(), nullptr);
+}
+
+// The files removed by another job are skipped
+void CacheDir::Evict(const std::string& keep) {
+  if (max_bytes_ == 0) { return; }
+  struct Entry {
+    std::string path;
+    uint64 size;
+    time_t mtime;
+  };
+  std::vector<Entry> entries;
+  uint64 total = 0;
+  DIR* dir = opendir(dir_.c_str());
+  if (dir == nullptr) { return; }
+  struct dirent* entry = nullptr;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') { continue; }
+    std::string path = dir_ + "/" + entry->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    total += st.st_size;
+    if (path == keep || path.find(kTempTag) != std::string::npos) {
+      continue;
+    }
+    Entry e;
+    e.path = path;
+    e.size = st.st_size;
+    e.mtime = st.st_mtime;
+    entries.push_back(e);
+  }
+  closedir(dir);
+  std::sort(entries.begin(), entries.end(),
+    [](const Entry& a, const Entry& b) {
+      return a.mtime < b.mtime;
+    });
+  for (size_t i = 0; i < entries.size() && total > max_bytes_; ++i) {
+    if (unlink(entries[i].path.c_str()) == 0 || errno == ENOENT) {
+      total -= entries[i].size;
+    }
+  }
+}
+
+// The jobs have their pids, and the threads of
+// a job have their numbers
+std::string CacheDir::TempPath(const std::string& path) {
+  static std::atomic<int> counter(0);
+  return path + StringPrintf("%s%d.%d", kTempTag, (int)getpid(),
+                             counter++);
+}
+
+void CacheDir::Commit(const std::string& temp, const std::string& path) {
+  if (rename(temp.c_str(), path.c_str()) != 0) {
+    LOG(FATAL) << "Cannot rename " << temp << " to " << path
+               << ": " << strerror(errno);
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the CacheDir class that keeps the binary caches
+of the txt files in a shared directory.
+*/
+
+#ifndef XLEARN_READER_CACHE_DIR_H_
+#define XLEARN_READER_CACHE_DIR_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// CacheDir keeps the binary caches of the txt files in one directory, which
+// is shared by the jobs of a host, instead of writing <file>.bin next to each
+// txt file. So the read-only data can be cached, and the same data read by
+// different paths (or copied) has only one cache.
+//
+// Each cache is named by the key of the content of its txt file and the
+// magic number of its format, i.e., <key>.<magic>.bin. The key is the hash
+// of the whole txt file, which is computed once for each version of the
+// file, and it is memoized by the fingerprint (see FingerprintFile()) in
+// a small <fingerprint>.key file:
+//
+//   CacheDir dir("/tmp/xlearn_cache", 10ULL << 30);
+//   uint64 key = dir.ContentKey("train.txt");
+//   std::string path = dir.Path(key, kBinaryMagic);
+//   if (FileExist(path.c_str())) {
+//     dir.Touch(path);
+//   } else {
+//     std::string temp = CacheDir::TempPath(path);
+//     /* write the cache into temp */
+//     CacheDir::Commit(temp, path);
+//     dir.Evict(path);
+//   }
+//
+// A cache is written into a temporary file and renamed to its path, so the
+// other jobs never see a partial cache, and the cache of the same key that
+// is written by two jobs at the same time is just replaced. The cache is
+// never changed after it is renamed, so it can be read (or mapped) while it
+// is evicted. The least recently used files are removed when the directory
+// is larger than max_bytes, where the use of a file is its mtime.
+//------------------------------------------------------------------------------
+class CacheDir {
+ public:
+  // The directory is created if it does not exist. The
+  // max_bytes 0 means no limit of the size
+  CacheDir(const std::string& dir, uint64 max_bytes);
+
+  // The key of the content of the txt file
+  uint64 ContentKey(const std::string& filename);
+
+  // Path of the cache of the key in the format of magic
+  std::string Path(uint64 key, uint64 magic) const;
+
+  // Mark the file as used now
+  void Touch(const std::string& path);
+
+  // Remove the least recently used files except the keep one,
+  // until the files are no larger than max_bytes. The files
+  // that are being written are never removed
+  void Evict(const std::string& keep);
+
+  // A unique temporary path for writing the file of the path
+  static std::string TempPath(const std::string& path);
+
+  // Rename the written temporary file to its path
+  static void Commit(const std::string& temp, const std::string& path);
+
+ protected:
+  std::string dir_;
+  uint64 max_bytes_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CacheDir);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_CACHE_DIR_H_
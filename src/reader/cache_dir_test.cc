@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the CacheDir class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/reader/cache_dir.h"
+
+using std::string;
+using std::vector;
+
+namespace xLearn {
+
+const string kTestDir = "./test_cache_dir";
+
+void write_file(const string& filename, const string& data) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, data.data(), data.size());
+  Close(file);
+}
+
+// Names of the files in the directory
+vector<string> list_dir(const string& dir) {
+  vector<string> names;
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) { return names; }
+  struct dirent* entry = nullptr;
+  while ((entry = readdir(d)) != nullptr) {
+    if (entry->d_name[0] != '.') { names.push_back(entry->d_name); }
+  }
+  closedir(d);
+  return names;
+}
+
+void remove_dir(const string& dir) {
+  for (const string& name : list_dir(dir)) {
+    RemoveFile((dir + "/" + name).c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+// Set the mtime of the file to the seconds ago
+void set_age(const string& filename, int seconds) {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  struct timeval times[2];
+  times[0].tv_sec = now.tv_sec - seconds;
+  times[0].tv_usec = 0;
+  times[1] = times[0];
+  utimes(filename.c_str(), times);
+}
+
+// The copies of the same content have the same key
+TEST(CacheDirTest, ContentKey) {
+  remove_dir(kTestDir);
+  CacheDir dir(kTestDir, 0);
+  write_file("./test_cache_a.txt", "1 1:0.5\n0 2:0.5\n");
+  write_file("./test_cache_b.txt", "1 1:0.5\n0 2:0.5\n");
+  write_file("./test_cache_c.txt", "0 1:0.5\n0 2:0.5\n");
+  uint64 key_a = dir.ContentKey("./test_cache_a.txt");
+  EXPECT_EQ(key_a, HashFile("./test_cache_a.txt", false));
+  EXPECT_EQ(dir.ContentKey("./test_cache_b.txt"), key_a);
+  EXPECT_NE(dir.ContentKey("./test_cache_c.txt"), key_a);
+  // The memoized key is used again
+  EXPECT_EQ(dir.ContentKey("./test_cache_a.txt"), key_a);
+  EXPECT_EQ(list_dir(kTestDir).size(), 3);
+  EXPECT_EQ(dir.Path(0x12, 0xab),
+            kTestDir + "/0000000000000012.00000000000000ab.bin");
+  RemoveFile("./test_cache_a.txt");
+  RemoveFile("./test_cache_b.txt");
+  RemoveFile("./test_cache_c.txt");
+  remove_dir(kTestDir);
+}
+
+TEST(CacheDirTest, Commit) {
+  remove_dir(kTestDir);
+  CacheDir dir(kTestDir, 0);
+  string path = dir.Path(1, 2);
+  string temp_1 = CacheDir::TempPath(path);
+  string temp_2 = CacheDir::TempPath(path);
+  EXPECT_NE(temp_1, temp_2);
+  write_file(temp_1, "first");
+  CacheDir::Commit(temp_1, path);
+  EXPECT_FALSE(FileExist(temp_1.c_str()));
+  // The same cache written by another job replaces it
+  write_file(temp_2, "second");
+  CacheDir::Commit(temp_2, path);
+  EXPECT_EQ(list_dir(kTestDir).size(), 1);
+  remove_dir(kTestDir);
+}
+
+// The least recently used files are removed
+TEST(CacheDirTest, Evict) {
+  remove_dir(kTestDir);
+  CacheDir dir(kTestDir, 3500);
+  string data(1000, 'x');
+  vector<string> paths;
+  for (int i = 0; i < 4; ++i) {
+    paths.push_back(dir.Path(i, 0));
+    write_file(paths[i], data);
+    set_age(paths[i], 100 - i * 10);
+  }
+  // The file being written is never removed
+  string temp = CacheDir::TempPath(dir.Path(9, 0));
+  write_file(temp, data);
+  set_age(temp, 1000);
+  // The oldest one is used again
+  dir.Touch(paths[0]);
+  dir.Evict(paths[3]);
+  EXPECT_TRUE(FileExist(paths[0].c_str()));
+  EXPECT_FALSE(FileExist(paths[1].c_str()));
+  EXPECT_FALSE(FileExist(paths[2].c_str()));
+  EXPECT_TRUE(FileExist(paths[3].c_str()));
+  EXPECT_TRUE(FileExist(temp.c_str()));
+  // No limit
+  CacheDir unlimited(kTestDir, 0);
+  unlimited.Evict("");
+  EXPECT_EQ(list_dir(kTestDir).size(), 3);
+  remove_dir(kTestDir);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,193 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the xlearn_convert tool, which converts the
+txt files (libsvm, libffm or csv, and also the gzip / zstd compressed
+ones) into the binary files of the in-memory training ahead of time.
+The options of the binary format should be the same as the training,
+otherwise the training re-generates the binary file:
+
+  xlearn_convert [ options ] file_1 file_2 ...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/resource.h"
+#include "src/base/thread_pool.h"
+#include "src/reader/input_stream.h"
+#include "src/reader/reader.h"
+
+namespace {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_convert [ options ] file_1 file_2 ... \n"
+"                                                 \n"
+"  Convert each txt file into the binary file <file>.bin of the in-memory training. \n"
+"  The file is skipped if its binary file has been generated. \n"
+"                                                             \n"
+"OPTIONS: \n"
+"  -nthread <N>         :  Number of files converted in parallel. Using the number of files or \n"
+"                          the available CPUs (the smaller one) by default. \n"
+"                                                                              \n"
+"  -hash <bucket>       :  Hash the feature ids into the given number of buckets (as training). \n"
+"                                                                                             \n"
+"  --compact            :  Write the binary file in compact encoding (as training). \n"
+"                                                                                  \n"
+"  --compress           :  Write the binary file in block-compressed format (as training). \n"
+"                                                                                       \n"
+"  --full-hash          :  Check the binary file by the hash of the whole txt file (as training). \n"
+"                                                                                             \n"
+"  -cache_dir <dir>     :  Write the binary files into the shared cache directory (as training). \n"
+"                                                                                             \n"
+"  -cache_mb <size>     :  Size limit of the -cache_dir in MB (as training). \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct ConvertOption {
+  int thread_number = 0;
+  xLearn::index_t hash_bucket = 0;
+  bool compact = false;
+  bool compress = false;
+  bool full_hash = false;
+  std::string cache_dir;
+  int cache_mb = 0;
+  std::vector<std::string> file_list;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], ConvertOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "-nthread" || arg == "-hash") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      int value = atoi(argv[++i]);
+      if (value <= 0) {
+        printf("[Error] Illegal %s : '%s' \n", arg.c_str(), argv[i]);
+        return false;
+      }
+      if (arg == "-nthread") {
+        option->thread_number = value;
+      } else {
+        option->hash_bucket = value;
+      }
+    } else if (arg == "-cache_dir" || arg == "-cache_mb") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      if (arg == "-cache_dir") {
+        option->cache_dir = argv[++i];
+      } else if ((option->cache_mb = atoi(argv[++i])) < 0) {
+        printf("[Error] Illegal %s : '%s' \n", arg.c_str(), argv[i]);
+        return false;
+      }
+    } else if (arg == "--compact") {
+      option->compact = true;
+    } else if (arg == "--compress") {
+      option->compress = true;
+    } else if (arg == "--full-hash") {
+      option->full_hash = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      printf("[Error] Unknow option: %s \n", argv[i]);
+      return false;
+    } else if (!FileExist(argv[i])) {
+      printf("[Error] The file %s does not exist \n", argv[i]);
+      return false;
+    } else {
+      option->file_list.push_back(arg);
+    }
+  }
+  return !option->file_list.empty();
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// The files are converted by the workers of a ThreadPool, and each
+// file is parsed by AvailableCpus() / workers threads
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  Timer timer;
+  timer.tic();
+
+  ConvertOption option;
+  if (!parse_option(argc, argv, &option)) {
+    printf("%s", kUsage);
+    return 0;
+  }
+  int num_hw = xLearn::AvailableCpus();
+  size_t num_files = option.file_list.size();
+  size_t num_workers = option.thread_number > 0 ?
+                       option.thread_number :
+                       std::min(num_files, (size_t)num_hw);
+  num_workers = std::min(num_workers, num_files);
+  int parse_threads = std::max(1, num_hw / (int)num_workers);
+  std::mutex print_mutex;
+  size_t num_converted = 0;
+  xLearn::ThreadPool pool(num_workers);
+  pool.ParallelFor(0, num_files, 1,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) {
+        const std::string& filename = option.file_list[i];
+        Timer file_timer;
+        file_timer.tic();
+        xLearn::InmemReader reader;
+        reader.SetCompact(option.compact);
+        reader.SetCompress(option.compress);
+        reader.SetHashBucket(option.hash_bucket);
+        reader.SetFullHash(option.full_hash);
+        if (!option.cache_dir.empty()) {
+          reader.SetCacheDir(option.cache_dir,
+                             (uint64)option.cache_mb << 20);
+        }
+        reader.SetThreadNumber(parse_threads);
+        bool converted = reader.Convert(filename);
+        std::lock_guard<std::mutex> lock(print_mutex);
+        if (converted) {
+          num_converted++;
+          std::string target = option.cache_dir.empty() ?
+                               filename + ".bin" : option.cache_dir;
+          printf("\n  Convert %s to %s: %.2f sec \n",
+                 filename.c_str(), target.c_str(), file_timer.toc());
+        } else {
+          printf("  Skip %s: the binary file has been generated \n",
+                 filename.c_str());
+        }
+      }
+  });
+
+  printf("Convert %lu of %lu files. Total time cost: %.2f sec\n",
+         num_converted, num_files, timer.toc());
+
+  return 0;
+}
@@ -31,6 +31,49 @@ This file is the implementation of the fileSpliter class.
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// Each block has about file_size / num_blocks bytes, and it is cut at
+// its last newline. The rest of the block is moved to the next block
+//------------------------------------------------------------------------------
+void FileSpliter::BlockOffsets(const char* data, uint64 size,
+                               int num_blocks,
+                               std::vector<uint64>* offsets) {
+  CHECK_GT(num_blocks, 0);
+  CHECK_NOTNULL(offsets);
+  uint64 average_block_size = size / num_blocks;
+  uint64 next_block_size = average_block_size +
+      size - (average_block_size * num_blocks);
+  uint64 offset = 0;
+  offsets->assign(1, 0);
+  for (int i = 0; i < num_blocks; ++i) {
+    uint64 real_block_size = next_block_size;
+    while (real_block_size > 0 &&
+           data[offset+real_block_size-1] != '\n') {
+      real_block_size--;
+    }
+    next_block_size =
+        average_block_size + (next_block_size - real_block_size);
+    offset += real_block_size;
+    offsets->push_back(offset);
+  }
+}
+
+void FileSpliter::Range(const std::string& filename, int num_blocks,
+                        int block, uint64* begin, uint64* end) {
+  CHECK_GE(block, 0);
+  CHECK_LT(block, num_blocks);
+  CHECK_NOTNULL(begin);
+  CHECK_NOTNULL(end);
+  // Only the pages around the ends of the blocks are read
+  char* buffer = nullptr;
+  uint64 file_size = MapFileToMemory(filename, &buffer);
+  std::vector<uint64> offsets;
+  BlockOffsets(buffer, file_size, num_blocks, &offsets);
+  UnmapFile(buffer, file_size);
+  *begin = offsets[block];
+  *end = offsets[block+1];
+}
+
 //------------------------------------------------------------------------------
 // Split file using mmap() on Unix-like systems.
 //------------------------------------------------------------------------------
@@ -41,20 +84,6 @@ void FileSpliter::split(const std::string& filename, int num_blocks) {
   FILE* file_ptr_read = OpenFileOrDie(filename.c_str(), "r");
   int file_desc_read = fileno(file_ptr_read);
   uint64 file_size = GetFileSize(file_ptr_read);
-  uint64 average_block_size = file_size / num_blocks;
-  uint64 next_block_size = average_block_size +
-      file_size - (average_block_size * num_blocks);
-  uint64 offset = 0;
-  // Output
-  FILE** file_ptr_write = new FILE* [num_blocks];
-  int* file_desc_write = new int [num_blocks];
-
-  for (int i = 0; i < num_blocks; ++i) {
-    std::string name = StringPrintf("%s_%d", filename.c_str(), i);
-    file_ptr_write[i] = OpenFileOrDie(name.c_str(), "w+");
-    file_desc_write[i] = fileno(file_ptr_write[i]);
-    ftruncate(file_desc_write[i], next_block_size + kMaxLineSize);
-  }
   char* map_ptr_read = (char*)mmap(NULL,
                                    file_size,
                                    PROT_READ,
@@ -62,27 +91,21 @@ void FileSpliter::split(const std::string& filename, int num_blocks) {
                                    file_desc_read,
                                    0);
   CHECK_NE(map_ptr_read, MAP_FAILED);
-
+  std::vector<uint64> offsets;
+  BlockOffsets(map_ptr_read, file_size, num_blocks, &offsets);
+  // Output
   for (int i = 0; i < num_blocks; ++i) {
-    char* map_ptr_write = (char *)mmap(NULL,
-                                       next_block_size,
-                                       PROT_WRITE,
-                                       MAP_SHARED,
-                                       file_desc_write[i],
-                                       0);
-    CHECK_NE(map_ptr_write, MAP_FAILED);
-    uint64 real_file_size = next_block_size;
-    memcpy(map_ptr_write, map_ptr_read+offset, real_file_size);
-    while (map_ptr_write[real_file_size-1] != '\n') {
-      real_file_size--;
+    std::string name = StringPrintf("%s_%d", filename.c_str(), i);
+    FILE* file_ptr_write = OpenFileOrDie(name.c_str(), "w");
+    uint64 block_size = offsets[i+1] - offsets[i];
+    if (block_size > 0) {
+      WriteDataToDisk(file_ptr_write, map_ptr_read + offsets[i],
+                      block_size);
     }
-    munmap(map_ptr_write, next_block_size);
-    ftruncate(file_desc_write[i], real_file_size);
-    next_block_size =
-        average_block_size + (next_block_size - real_file_size);
-    offset += real_file_size;
+    Close(file_ptr_write);
   }
   munmap(map_ptr_read, file_size);
+  Close(file_ptr_read);
 }
 
 } // namespace xLearn
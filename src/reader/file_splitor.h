@@ -26,6 +26,7 @@ our framework.
 #define XLEARN_READER_FILE_SPLITER_H_
 
 #include <string>
+#include <vector>
 
 #include "src/base/common.h"
 
@@ -41,6 +42,19 @@ class FileSpliter {
 
   void split(const std::string& filename, int num_blocks);
 
+  // Return the byte range [begin, end) of the block of split()
+  // without writing any file, so that each worker of the
+  // distributed training can read its own block of one file.
+  // The blocks are aligned to the newlines in the same way
+  static void Range(const std::string& filename, int num_blocks,
+                    int block, uint64* begin, uint64* end);
+
+  // The num_blocks + 1 offsets of the blocks of the data,
+  // where the i-th block is [offsets[i], offsets[i+1])
+  static void BlockOffsets(const char* data, uint64 size,
+                           int num_blocks,
+                           std::vector<uint64>* offsets);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(FileSpliter);
 };
@@ -80,4 +80,22 @@ TEST_F(SpliterTest, ReadTest) {
   }
 }
 
+// The ranges are the blocks of split() in the txt file
+TEST_F(SpliterTest, RangeTest) {
+  uint64 offset = 0;
+  for (int i = 0; i < kNumfolds; ++i) {
+    uint64 begin = 0, end = 0;
+    FileSpliter::Range(kTestfilename, kNumfolds, i, &begin, &end);
+    EXPECT_EQ(begin, offset);
+    string filename = StringPrintf("%s_%d", kTestfilename.c_str(), i);
+    FILE* file_ptr = OpenFileOrDie(filename.c_str(), "r");
+    EXPECT_EQ(end - begin, GetFileSize(file_ptr));
+    Close(file_ptr);
+    offset = end;
+  }
+  FILE* file_ptr = OpenFileOrDie(kTestfilename.c_str(), "r");
+  EXPECT_EQ(offset, GetFileSize(file_ptr));
+  Close(file_ptr);
+}
+
 } // namespace xLearn
@@ -0,0 +1,454 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of InputStream.
+*/
+
+#include "src/reader/input_stream.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+
+#ifdef XLEARN_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef XLEARN_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+// The compressed file is decompressed into blocks of 4 MB,
+// and the background thread keeps 4 blocks ahead
+static const uint64 kStreamBlockSize = 4 * 1024 * 1024;
+static const int kStreamDepth = 4;
+
+//------------------------------------------------------------------------------
+// Read the plain txt file by fread()
+//------------------------------------------------------------------------------
+class PlainStream : public InputStream {
+ public:
+  explicit PlainStream(const std::string& filename)
+    : own_(true), remain_(kMaxUInt64) {
+    file_ = OpenFileOrDie(filename.c_str(), "rb");
+  }
+  // Only read the bytes [begin, end) of the file
+  PlainStream(const std::string& filename, uint64 begin, uint64 end)
+    : own_(true), remain_(end - begin) {
+    CHECK_LE(begin, end);
+    file_ = OpenFileOrDie(filename.c_str(), "rb");
+    CHECK_EQ(fseeko(file_, begin, SEEK_SET), 0);
+  }
+  // The file (e.g., stdin) is not closed by the stream
+  explicit PlainStream(FILE* file)
+    : file_(file), own_(false), remain_(kMaxUInt64) {
+    CHECK_NOTNULL(file);
+  }
+  ~PlainStream() { if (own_) { Close(file_); } }
+
+  uint64 Read(char* buf, uint64 size) {
+    if (size > remain_) { size = remain_; }
+    uint64 len = fread(buf, 1, size, file_);
+    remain_ -= len;
+    return len;
+  }
+
+ protected:
+  FILE* file_;
+  bool own_;
+  /* The bytes left in the range */
+  uint64 remain_;
+  static const uint64 kMaxUInt64 = ~0ULL;
+};
+
+//------------------------------------------------------------------------------
+// Read the bytes that have arrived at the file descriptor by read(2).
+// The stream waits at most kOnlinePollMs for the new bytes at a time, so
+// it sees StopOnlineStreams() soon. A regular file is tailed at its end
+//------------------------------------------------------------------------------
+static const int kOnlinePollMs = 100;
+static std::atomic<bool> online_stop(false);
+
+class OnlineStream : public InputStream {
+ public:
+  explicit OnlineStream(const std::string& filename)
+    : own_(true), tail_(true) {
+    fd_ = open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      LOG(FATAL) << "Cannot open file: " << filename;
+    }
+    struct stat st;
+    CHECK_EQ(fstat(fd_, &st), 0);
+    tail_ = S_ISREG(st.st_mode);
+  }
+  // The stdin is not closed by the stream and never tailed
+  explicit OnlineStream(int fd) : fd_(fd), own_(false), tail_(false) { }
+  ~OnlineStream() { if (own_) { close(fd_); } }
+
+  uint64 Read(char* buf, uint64 size) {
+    while (!online_stop.load()) {
+      if (!tail_) {
+        struct pollfd pfd = { fd_, POLLIN, 0 };
+        int ready = poll(&pfd, 1, kOnlinePollMs);
+        if (ready == 0 || (ready < 0 && errno == EINTR)) { continue; }
+      }
+      ssize_t len = read(fd_, buf, size);
+      if (len > 0) { return len; }
+      if (len < 0 && errno == EINTR) { continue; }
+      if (len < 0) {
+        LOG(ERROR) << "Cannot read the online stream: " << strerror(errno);
+        return 0;
+      }
+      // The end of the pipe, or the end of the file for now
+      if (!tail_) { return 0; }
+      std::this_thread::sleep_for(
+        std::chrono::milliseconds(kOnlinePollMs));
+    }
+    return 0;
+  }
+
+ protected:
+  int fd_;
+  bool own_;
+  /* Wait for the appended bytes at the end of the file */
+  bool tail_;
+};
+
+#ifdef XLEARN_USE_ZLIB
+//------------------------------------------------------------------------------
+// Decompress the gzip file by zlib, and the concatenated
+// gzip members are read as one stream
+//------------------------------------------------------------------------------
+class GzipStream : public InputStream {
+ public:
+  explicit GzipStream(const std::string& filename) {
+    file_ = gzopen(filename.c_str(), "rb");
+    if (file_ == nullptr) {
+      LOG(FATAL) << "Cannot open file: " << filename;
+    }
+    gzbuffer(file_, 1024 * 1024);
+  }
+  ~GzipStream() { gzclose(file_); }
+
+  uint64 Read(char* buf, uint64 size) {
+    // gzread() reads at most INT_MAX bytes
+    int len = gzread(file_, buf, std::min(size, (uint64)(1 << 30)));
+    if (len < 0) {
+      int err = 0;
+      LOG(FATAL) << "Error: invoke gzread(): " << gzerror(file_, &err);
+    }
+    return len;
+  }
+
+ protected:
+  gzFile file_;
+};
+#endif
+
+#ifdef XLEARN_USE_ZSTD
+//------------------------------------------------------------------------------
+// Decompress the zstd file by the streaming API of libzstd,
+// and the concatenated frames are read as one stream
+//------------------------------------------------------------------------------
+class ZstdStream : public InputStream {
+ public:
+  explicit ZstdStream(const std::string& filename)
+    : in_buf_(ZSTD_DStreamInSize()) {
+    file_ = OpenFileOrDie(filename.c_str(), "rb");
+    stream_ = ZSTD_createDStream();
+    CHECK_NOTNULL(stream_);
+    ZSTD_initDStream(stream_);
+    input_.src = in_buf_.data();
+    input_.size = 0;
+    input_.pos = 0;
+  }
+  ~ZstdStream() {
+    ZSTD_freeDStream(stream_);
+    Close(file_);
+  }
+
+  uint64 Read(char* buf, uint64 size) {
+    ZSTD_outBuffer output = { buf, size, 0 };
+    while (output.pos < output.size) {
+      if (input_.pos == input_.size) {
+        input_.size = fread(in_buf_.data(), 1, in_buf_.size(), file_);
+        input_.pos = 0;
+        if (input_.size == 0) { break; }
+      }
+      size_t ret = ZSTD_decompressStream(stream_, &output, &input_);
+      if (ZSTD_isError(ret)) {
+        LOG(FATAL) << "Error: invoke ZSTD_decompressStream(): "
+                   << ZSTD_getErrorName(ret);
+      }
+    }
+    return output.pos;
+  }
+
+ protected:
+  FILE* file_;
+  ZSTD_DStream* stream_;
+  std::vector<char> in_buf_;
+  ZSTD_inBuffer input_;
+};
+#endif
+
+// The gzip file starts with 1f 8b, and
+// the zstd frame starts with 28 b5 2f fd
+Compression DetectCompression(const std::string& filename) {
+  if (IsStdin(filename)) { return kCompressNone; }
+  FILE* file = OpenFileOrDie(filename.c_str(), "rb");
+  unsigned char magic[4] = { 0, 0, 0, 0 };
+  size_t len = fread(magic, 1, sizeof(magic), file);
+  Close(file);
+  if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return kCompressGzip;
+  }
+  if (len == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+      magic[2] == 0x2f && magic[3] == 0xfd) {
+    return kCompressZstd;
+  }
+  return kCompressNone;
+}
+
+// The decoder is wrapped by the AsyncStream if async is true
+static InputStream* wrap(InputStream* stream, bool async) {
+  if (!async) { return stream; }
+  return new AsyncStream(stream, kStreamBlockSize, kStreamDepth);
+}
+
+InputStream* OpenInputStream(const std::string& filename, bool async) {
+  CHECK(!filename.empty());
+  if (IsStdin(filename)) {
+    LOG(FATAL) << "The stdin should be read by StdinStream()";
+  }
+  switch (DetectCompression(filename)) {
+    case kCompressGzip:
+#ifdef XLEARN_USE_ZLIB
+      return wrap(new GzipStream(filename), async);
+#else
+      LOG(FATAL) << "Cannot read the gzip file: " << filename
+                 << ". xLearn is built without zlib";
+#endif
+      break;
+    case kCompressZstd:
+#ifdef XLEARN_USE_ZSTD
+      return wrap(new ZstdStream(filename), async);
+#else
+      LOG(FATAL) << "Cannot read the zstd file: " << filename
+                 << ". xLearn is built without libzstd";
+#endif
+      break;
+    case kCompressNone:
+      break;
+  }
+  return new PlainStream(filename);
+}
+
+InputStream* OpenRangeStream(const std::string& filename,
+                             uint64 begin, uint64 end) {
+  CHECK(!IsStdin(filename));
+  if (IsCompressedFile(filename)) {
+    LOG(FATAL) << "Cannot read a range of the compressed file: "
+               << filename;
+  }
+  return new PlainStream(filename, begin, end);
+}
+
+void ReadFirstLine(InputStream* stream, std::string& line) {
+  CHECK_NOTNULL(stream);
+  line.clear();
+  char ch = 0;
+  while (stream->Read(&ch, 1) == 1 && ch != '\n') {
+    line.push_back(ch);
+    if (line.size() >= kMaxLineSize) {
+      LOG(FATAL) << "Encountered a too-long line. "
+                 << "Please check the data.";
+    }
+  }
+  // Handle the format in DOS and windows
+  if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+}
+
+//------------------------------------------------------------------------------
+// PeekStream
+//------------------------------------------------------------------------------
+void PeekStream::PeekLine(std::string& line) {
+  CHECK_EQ(offset_, 0);
+  if (!peeked_) {
+    char ch = 0;
+    while (source_->Read(&ch, 1) == 1) {
+      peek_.push_back(ch);
+      if (ch == '\n') { break; }
+      if (peek_.size() >= kMaxLineSize) {
+        LOG(FATAL) << "Encountered a too-long line. "
+                   << "Please check the data.";
+      }
+    }
+    peeked_ = true;
+  }
+  line = peek_;
+  // Handle the format in DOS and windows
+  if (!line.empty() && line.back() == '\n') { line.pop_back(); }
+  if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+}
+
+// The bytes of the first line are returned at first
+uint64 PeekStream::Read(char* buf, uint64 size) {
+  uint64 len = 0;
+  if (offset_ < peek_.size()) {
+    len = std::min(size, (uint64)(peek_.size() - offset_));
+    memcpy(buf, peek_.data() + offset_, len);
+    offset_ += len;
+  } else {
+    offset_ = peek_.size();
+  }
+  if (len == 0) {
+    len = source_->Read(buf, size);
+  }
+  return len;
+}
+
+static bool online_stdin = false;
+
+PeekStream* StdinStream() {
+  static PeekStream* stream = new PeekStream(
+    online_stdin ? (InputStream*)new OnlineStream(STDIN_FILENO) :
+    new AsyncStream(new PlainStream(stdin),
+                    kStreamBlockSize,
+                    kStreamDepth));
+  return stream;
+}
+
+InputStream* OpenOnlineStream(const std::string& filename) {
+  CHECK(!IsStdin(filename));
+  if (IsCompressedFile(filename)) {
+    LOG(FATAL) << "The compressed file cannot be read online: "
+               << filename;
+  }
+  return new OnlineStream(filename);
+}
+
+void SetOnlineStdin() { online_stdin = true; }
+
+void StopOnlineStreams() { online_stop.store(true); }
+
+//------------------------------------------------------------------------------
+// AsyncStream
+//------------------------------------------------------------------------------
+AsyncStream::AsyncStream(InputStream* source,
+                         uint64 block_size, int depth)
+  : source_(source), block_(depth), block_size_(depth, 0),
+    current_(-1), offset_(0), end_(false), stop_(false) {
+  CHECK_NOTNULL(source);
+  CHECK_GT(block_size, 0);
+  CHECK_GT(depth, 0);
+  for (int i = 0; i < depth; ++i) {
+    block_[i].resize(block_size);
+    free_.push_back(i);
+  }
+  thread_ = std::thread(&AsyncStream::run, this);
+}
+
+AsyncStream::~AsyncStream() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+  delete source_;
+}
+
+// Fill the free blocks until the end of source
+void AsyncStream::run() {
+  for (;;) {
+    int id = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return stop_ || !free_.empty(); });
+      if (stop_) { return; }
+      id = free_.front();
+      free_.pop_front();
+    }
+    // A block is filled unless it reaches the end
+    std::vector<char>& block = block_[id];
+    uint64 size = 0;
+    while (size < block.size()) {
+      uint64 len = source_->Read(block.data() + size,
+                                 block.size() - size);
+      if (len == 0) { break; }
+      size += len;
+    }
+    bool end = (size < block.size());
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      block_size_[id] = size;
+      if (size > 0) {
+        full_.push_back(id);
+      } else {
+        free_.push_back(id);
+      }
+      end_ = end;
+    }
+    cond_.notify_all();
+    if (end) { return; }
+  }
+}
+
+uint64 AsyncStream::Read(char* buf, uint64 size) {
+  uint64 read_size = 0;
+  while (read_size < size) {
+    if (current_ < 0) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return end_ || !full_.empty(); });
+      if (full_.empty()) { break; }
+      current_ = full_.front();
+      full_.pop_front();
+      offset_ = 0;
+    }
+    uint64 len = std::min(size - read_size,
+                          block_size_[current_] - offset_);
+    memcpy(buf + read_size, block_[current_].data() + offset_, len);
+    read_size += len;
+    offset_ += len;
+    // Return the block to the background thread
+    if (offset_ == block_size_[current_]) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        free_.push_back(current_);
+      }
+      cond_.notify_all();
+      current_ = -1;
+    }
+  }
+  return read_size;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,212 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the InputStream class that reads the bytes of
+a txt file, which may be compressed by gzip or zstd.
+*/
+
+#ifndef XLEARN_READER_INPUT_STREAM_H_
+#define XLEARN_READER_INPUT_STREAM_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "src/base/common.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// InputStream reads the bytes of a txt file from the head to the tail.
+// The training data can be written in gzip (.gz) or zstd (.zst) format,
+// which is detected by the magic number at the beginning of the file,
+// and the stream decompresses it on the fly, so we don't need to
+// decompress the file to local disk before training:
+//
+//   InputStream* stream = OpenInputStream("train.txt.gz");
+//   std::vector<char> buf(kBlockSize);
+//   uint64 size = 0;
+//   while ((size = stream->Read(buf.data(), buf.size())) > 0) {
+//     /* use the size bytes of buf */
+//   }
+//   delete stream;
+//
+// The gzip and zstd formats are supported if xLearn is built with
+// zlib (XLEARN_USE_ZLIB) and libzstd (XLEARN_USE_ZSTD).
+//------------------------------------------------------------------------------
+class InputStream {
+ public:
+  InputStream() {  }
+  virtual ~InputStream() {  }
+
+  // Read at most size bytes into buf and return the number
+  // of bytes, which is 0 only at the end of the file
+  virtual uint64 Read(char* buf, uint64 size) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InputStream);
+};
+
+// The txt file named "-" is read from the stdin, so the
+// data can be piped from another program into xLearn
+static const char kStdinFile[] = "-";
+
+inline bool IsStdin(const std::string& filename) {
+  return filename == kStdinFile;
+}
+
+// Format of the txt file
+enum Compression {
+  kCompressNone,
+  kCompressGzip,
+  kCompressZstd
+};
+
+// Detect the format of the file by its magic number,
+// and the stdin is always read as plain text
+Compression DetectCompression(const std::string& filename);
+
+// The file is compressed by gzip or zstd
+inline bool IsCompressedFile(const std::string& filename) {
+  return DetectCompression(filename) != kCompressNone;
+}
+
+// Open the file and return a new InputStream, which should be
+// deleted by the caller. If async is true, the compressed file
+// is decompressed in a background thread (see AsyncStream), so
+// the decoding is overlapped with the parsing. Program crashes
+// if the format is not supported by current build
+InputStream* OpenInputStream(const std::string& filename,
+                             bool async = true);
+
+// Open the bytes [begin, end) of the plain txt file, which
+// cannot be compressed, e.g., a block of FileSpliter::Range()
+InputStream* OpenRangeStream(const std::string& filename,
+                             uint64 begin, uint64 end);
+
+// Read the first line of the stream without the newline
+void ReadFirstLine(InputStream* stream, std::string& line);
+
+//------------------------------------------------------------------------------
+// The online stream is used by the long-running training on an unbounded
+// stream of data. Its Read() returns the bytes that have arrived instead
+// of filling the buffer, so the rows are trained soon after they are
+// written. A regular file is tailed as the log that is being appended,
+// whose end is never reached, and a pipe (or the stdin) ends when the
+// writer closes it, e.g., a socket read by another program:
+//
+//   nc -lk 9000 | xlearn_train - --online -hash 1000000 -ckpt_min 10
+//
+// All the online streams return the end (0) soon after the call of
+// StopOnlineStreams(), which is async-signal-safe, so the signal handler
+// of SIGTERM can finish the training and save the model.
+//------------------------------------------------------------------------------
+
+// Open the plain txt file as an online stream, which should be
+// deleted by the caller. Program crashes if it is compressed
+InputStream* OpenOnlineStream(const std::string& filename);
+
+// Read the stdin of StdinStream() as an online stream,
+// which is invoked before the first StdinStream()
+void SetOnlineStdin();
+
+// Ask all the online streams to end
+void StopOnlineStreams();
+
+//------------------------------------------------------------------------------
+// AsyncStream reads the source stream in a background thread, which
+// fills a ring of depth blocks of block_size bytes ahead of Read().
+// The source stream is owned by the AsyncStream.
+//------------------------------------------------------------------------------
+class AsyncStream : public InputStream {
+ public:
+  AsyncStream(InputStream* source, uint64 block_size, int depth);
+  ~AsyncStream();
+
+  uint64 Read(char* buf, uint64 size);
+
+ protected:
+  /* The stream read by the background thread */
+  InputStream* source_;
+  /* Ring of blocks and the valid bytes of each block */
+  std::vector<std::vector<char> > block_;
+  std::vector<uint64> block_size_;
+  /* The filled blocks in order and the free blocks */
+  std::deque<int> full_;
+  std::deque<int> free_;
+  /* The block being read and the read position in it */
+  int current_;
+  uint64 offset_;
+  /* The background thread reached the end of source */
+  bool end_;
+  /* Destructor asks the background thread to exit */
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+
+  // Main loop of the background thread
+  void run();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AsyncStream);
+};
+
+//------------------------------------------------------------------------------
+// PeekStream can read the first line of the source stream without
+// consuming it, which is used to detect the format of the stdin that
+// cannot be opened twice. The source stream is owned by the PeekStream.
+//------------------------------------------------------------------------------
+class PeekStream : public InputStream {
+ public:
+  explicit PeekStream(InputStream* source)
+    : source_(source), peeked_(false), offset_(0) {
+    CHECK_NOTNULL(source);
+  }
+  ~PeekStream() { delete source_; }
+
+  // Return the first line without the newline, and
+  // it is still returned by the next Read()
+  void PeekLine(std::string& line);
+
+  // The bytes of the first line are returned by themselves,
+  // so the online source is not waited for
+  uint64 Read(char* buf, uint64 size);
+
+ protected:
+  InputStream* source_;
+  /* The bytes of the first line and the read position */
+  std::string peek_;
+  bool peeked_;
+  uint64 offset_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PeekStream);
+};
+
+// The process-wide stream of the stdin, which is read
+// ahead in a background thread and is never deleted
+PeekStream* StdinStream();
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_INPUT_STREAM_H_
@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the InputStream class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#ifdef XLEARN_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/reader/input_stream.h"
+
+using std::string;
+
+namespace xLearn {
+
+const string kTestfilename = "./test_input_stream";
+const int kNumLines = 10000;
+
+string MakeData() {
+  string data;
+  for (int i = 0; i < kNumLines; ++i) {
+    data += StringPrintf("%d 1:%d 2:0.5\n", i % 2, i);
+  }
+  return data;
+}
+
+// Read all the data of the stream by a small buffer
+string ReadAll(InputStream* stream, uint64 buf_size) {
+  string data;
+  std::vector<char> buf(buf_size);
+  uint64 size = 0;
+  while ((size = stream->Read(buf.data(), buf.size())) > 0) {
+    data.append(buf.data(), size);
+  }
+  return data;
+}
+
+TEST(InputStreamTest, Read_plain) {
+  string data = MakeData();
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  WriteDataToDisk(file, (char*)data.data(), data.size());
+  Close(file);
+  EXPECT_EQ(DetectCompression(kTestfilename), kCompressNone);
+  InputStream* stream = OpenInputStream(kTestfilename);
+  EXPECT_EQ(ReadAll(stream, 1000), data);
+  delete stream;
+  stream = OpenInputStream(kTestfilename);
+  string line;
+  ReadFirstLine(stream, line);
+  EXPECT_EQ(line, "0 1:0 2:0.5");
+  delete stream;
+  RemoveFile(kTestfilename.c_str());
+}
+
+TEST(InputStreamTest, Async_stream) {
+  string data = MakeData();
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  WriteDataToDisk(file, (char*)data.data(), data.size());
+  Close(file);
+  // Blocks smaller and larger than the read buffer
+  for (uint64 block = 7; block < 100000; block *= 10) {
+    AsyncStream stream(OpenInputStream(kTestfilename, false), block, 3);
+    EXPECT_EQ(ReadAll(&stream, 1000), data);
+    EXPECT_EQ(stream.Read(nullptr, 0), 0);
+  }
+  // Destroy the stream before the end
+  {
+    AsyncStream stream(OpenInputStream(kTestfilename, false), 100, 2);
+    char buf[10];
+    EXPECT_EQ(stream.Read(buf, 10), 10);
+  }
+  RemoveFile(kTestfilename.c_str());
+}
+
+TEST(InputStreamTest, Peek_stream) {
+  string data = MakeData();
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  WriteDataToDisk(file, (char*)data.data(), data.size());
+  Close(file);
+  PeekStream stream(OpenInputStream(kTestfilename));
+  string line;
+  stream.PeekLine(line);
+  EXPECT_EQ(line, "0 1:0 2:0.5");
+  stream.PeekLine(line);
+  EXPECT_EQ(line, "0 1:0 2:0.5");
+  // The first line is not consumed
+  EXPECT_EQ(ReadAll(&stream, 5), data);
+  EXPECT_TRUE(IsStdin("-"));
+  EXPECT_EQ(DetectCompression("-"), kCompressNone);
+  RemoveFile(kTestfilename.c_str());
+}
+
+#ifdef XLEARN_USE_ZLIB
+TEST(InputStreamTest, Read_gzip) {
+  string data = MakeData();
+  string filename = kTestfilename + ".gz";
+  // Two gzip members are read as one stream
+  gzFile file = gzopen(filename.c_str(), "wb");
+  gzwrite(file, data.data(), data.size() / 2);
+  gzclose(file);
+  file = gzopen(filename.c_str(), "ab");
+  gzwrite(file, data.data() + data.size() / 2,
+          data.size() - data.size() / 2);
+  gzclose(file);
+  EXPECT_EQ(DetectCompression(filename), kCompressGzip);
+  EXPECT_TRUE(IsCompressedFile(filename));
+  InputStream* stream = OpenInputStream(filename);
+  EXPECT_EQ(ReadAll(stream, 4096), data);
+  delete stream;
+  stream = OpenInputStream(filename, false);
+  string line;
+  ReadFirstLine(stream, line);
+  EXPECT_EQ(line, "0 1:0 2:0.5");
+  delete stream;
+  RemoveFile(filename.c_str());
+}
+#endif
+
+}  // namespace xLearn
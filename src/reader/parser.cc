@@ -22,9 +22,15 @@ This file is the implementation of Parser.
 
 #include "src/reader/parser.h"
 
+#include "src/base/executor.h"
 #include "src/base/split_string.h"
 
+#include <ctype.h>
+#include <emmintrin.h>  // for SSE2
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
 
 namespace xLearn {
 
@@ -35,13 +41,273 @@ CLASS_REGISTER_IMPLEMENT_REGISTRY(xLearn_parser_registry, Parser);
 REGISTER_PARSER("libsvm", LibsvmParser);
 REGISTER_PARSER("libffm", FFMParser);
 REGISTER_PARSER("csv", CSVParser);
+REGISTER_PARSER("token", TokenParser);
+
+// Parse a chunk of buffer into a DMatrix in a thread,
+// and release the pages of the mapped chunk. The rows
+// of the chunk are sorted in the same thread
+void parse_thread(Parser* parser, char* buf, uint64 size,
+                  DMatrix* matrix, bool mapped, bool sort) {
+  parser->ParseChunk(buf, size, *matrix);
+  if (mapped) { ReleaseMappedPages(buf, size); }
+  if (sort) { matrix->SortRows(); }
+}
+
+// Parse the memory buffer in multi-thread. The buffer is split
+// into chunks at newline boundaries, and each chunk is parsed into
+// its own CSR matrix in parallel by the shared thread pool. At last,
+// all the chunks are copied into the final matrix in order.
+void Parser::Parse(char* buf, uint64 size, DMatrix& matrix) {
+  CHECK_NOTNULL(buf);
+  CHECK_GT(size, 0);
+  /*********************************************************
+   *  Step 1: Split buffer into chunks                     *
+   *********************************************************/
+  std::vector<uint64> chunk_pos;
+  split_buffer(buf, size, chunk_pos);
+  int num_chunk = chunk_pos.size() - 1;
+  if (num_chunk == 1) {
+    parse_thread(this, buf, size, &matrix, mapped_input_, sort_rows_);
+    return;
+  }
+  /*********************************************************
+   *  Step 2: Parse each chunk in multi-thread             *
+   *********************************************************/
+  std::vector<DMatrix> chunk_matrix(num_chunk);
+  {
+    // Only wait for the chunks, since the pool is shared
+    ThreadPool* pool = pool_ != nullptr ? pool_ :
+                       Executor::Get(thread_number_, cpus_);
+    std::vector<std::future<void> > result(num_chunk);
+    for (int i = 0; i < num_chunk; ++i) {
+      chunk_matrix[i].SetCSR(true);
+      chunk_matrix[i].SetCompact(matrix.is_compact);
+      result[i] = pool->enqueue(std::bind(parse_thread,
+                                          this,
+                                          buf + chunk_pos[i],
+                                          chunk_pos[i+1] - chunk_pos[i],
+                                          &chunk_matrix[i],
+                                          mapped_input_,
+                                          sort_rows_));
+    }
+    for (int i = 0; i < num_chunk; ++i) {
+      result[i].get();
+    }
+  }
+  /*********************************************************
+   *  Step 3: Stitch the chunks into one matrix            *
+   *********************************************************/
+  index_t line_num = 0;
+  uint64 data_size = 0;
+  uint64 scratch_size = 0;
+  for (int i = 0; i < num_chunk; ++i) {
+    line_num += chunk_matrix[i].row_length;
+    data_size += chunk_matrix[i].DataSize();
+    scratch_size += chunk_matrix[i].MemorySize();
+  }
+  uint64 peak = scratch_size_.load();
+  while (peak < scratch_size &&
+         !scratch_size_.compare_exchange_weak(peak, scratch_size)) { }
+  matrix.ResetMatrix(line_num);
+  matrix.Reserve(data_size / (matrix.is_compact ? 2 : sizeof(Node)));
+  index_t row_id = 0;
+  for (int i = 0; i < num_chunk; ++i) {
+    matrix.CopyRows(row_id, chunk_matrix[i]);
+    row_id += chunk_matrix[i].row_length;
+    chunk_matrix[i].Release();
+  }
+}
+
+// Split the buffer into chunks at newline boundaries. Each
+// chunk has at least kMinChunkSize bytes, and the mapped buffer
+// has at most max_chunk_size_ bytes in each chunk. The chunk_pos
+// stores the begin position of each chunk and the end of buffer
+void Parser::split_buffer(char* buf, uint64 size,
+                          std::vector<uint64>& chunk_pos) {
+  uint64 num_chunk = size / kMinChunkSize;
+  if (num_chunk > thread_number_) { num_chunk = thread_number_; }
+  if (mapped_input_) {
+    num_chunk = std::max(num_chunk,
+      (size + max_chunk_size_ - 1) / max_chunk_size_);
+  }
+  if (num_chunk < 1) { num_chunk = 1; }
+  uint64 chunk_size = size / num_chunk;
+  chunk_pos.clear();
+  chunk_pos.push_back(0);
+  for (uint64 i = 1; i < num_chunk; ++i) {
+    uint64 pos = std::max(i * chunk_size, chunk_pos.back());
+    // Move to the begining of next line
+    while (pos < size && buf[pos-1] != '\n') { pos++; }
+    if (pos >= size) { break; }
+    if (pos > chunk_pos.back()) { chunk_pos.push_back(pos); }
+  }
+  chunk_pos.push_back(size);
+}
+
+//------------------------------------------------------------------------------
+// In-place tokenizer used by all the parsers. We don't copy each line
+// into a line buffer and we don't use strtok(), atoi() or atof(). Instead,
+// the numbers are parsed in place from the memory buffer, so every byte
+// of the buffer is touched only once and the parsers are reentrant.
+//------------------------------------------------------------------------------
+
+// Count a character in [buf, buf+size) using SSE2
+inline uint64 count_char_sse(const char* buf, uint64 size, char ch) {
+  uint64 num = 0;
+  uint64 i = 0;
+  __m128i target = _mm_set1_epi8(ch);
+  for (; i + 16 <= size; i += 16) {
+    __m128i data = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(buf + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, target));
+    num += __builtin_popcount(mask);
+  }
+  for (; i < size; ++i) {
+    if (buf[i] == ch) num++;
+  }
+  return num;
+}
+
+inline bool is_digit(char ch) {
+  return ch >= '0' && ch <= '9';
+}
+
+inline bool is_blank(char ch) {
+  return ch == ' ' || ch == '\t';
+}
+
+// Skip the blank characters and return the new position
+inline char* skip_blank(char* pos, char* end) {
+  while (pos < end && is_blank(*pos)) { pos++; }
+  return pos;
+}
+
+// Find the end of current line [pos, end) and return the
+// begining of next line. The line_end does not include
+// the "\n" and the "\r" of the DOS and windows format
+inline char* find_line_end(char* pos, char* end, char** line_end) {
+  char* next = reinterpret_cast<char*>(memchr(pos, '\n', end - pos));
+  if (next == nullptr) {
+    *line_end = end;
+    next = end;
+  } else {
+    *line_end = next;
+    next++;
+  }
+  if (*line_end > pos && *(*line_end - 1) == '\r') {
+    (*line_end)--;
+  }
+  return next;
+}
+
+// Parse an unsigned integer and return the new position
+inline char* parse_uint(char* pos, char* end, index_t* value) {
+  index_t result = 0;
+  while (pos < end && is_digit(*pos)) {
+    result = result * 10 + (*pos - '0');
+    pos++;
+  }
+  *value = result;
+  return pos;
+}
+
+// Parse a 64-bit unsigned integer and return the new position
+inline char* parse_uint64(char* pos, char* end, uint64* value) {
+  uint64 result = 0;
+  while (pos < end && is_digit(*pos)) {
+    result = result * 10 + (*pos - '0');
+    pos++;
+  }
+  *value = result;
+  return pos;
+}
+
+// Using strtod() for the numbers that cannot be handled by parse_real()
+inline char* parse_real_slow(char* pos, char* end, real_t* value) {
+  char token[kMaxTokenSize];
+  uint64 len = 0;
+  while (pos + len < end && len < kMaxTokenSize - 1 &&
+         !is_blank(pos[len]) && pos[len] != ':' &&
+         pos[len] != '\n' && pos[len] != '\r') {
+    token[len] = pos[len];
+    len++;
+  }
+  token[len] = '\0';
+  char* token_end = nullptr;
+  *value = strtod(token, &token_end);
+  return pos + (token_end - token);
+}
+
+// Parse a real number like "-1.25e-3" and return the new position
+inline char* parse_real(char* pos, char* end, real_t* value) {
+  static const double kPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22
+  };
+  char* begin = pos;
+  bool negative = false;
+  if (pos < end && (*pos == '-' || *pos == '+')) {
+    negative = (*pos == '-');
+    pos++;
+  }
+  uint64 mantissa = 0;
+  int num_digit = 0;
+  int exp10 = 0;
+  while (pos < end && is_digit(*pos)) {
+    mantissa = mantissa * 10 + (*pos - '0');
+    num_digit++;
+    pos++;
+  }
+  if (pos < end && *pos == '.') {
+    pos++;
+    while (pos < end && is_digit(*pos)) {
+      mantissa = mantissa * 10 + (*pos - '0');
+      num_digit++;
+      exp10--;
+      pos++;
+    }
+  }
+  if (pos < end && (*pos == 'e' || *pos == 'E')) {
+    pos++;
+    bool exp_negative = false;
+    if (pos < end && (*pos == '-' || *pos == '+')) {
+      exp_negative = (*pos == '-');
+      pos++;
+    }
+    index_t exp_value = 0;
+    pos = parse_uint(pos, end, &exp_value);
+    exp10 += exp_negative ? -(int)exp_value : (int)exp_value;
+  }
+  // Too many digits, "inf", "nan", etc.
+  if (num_digit == 0 || num_digit > 18 || exp10 > 22 || exp10 < -22) {
+    return parse_real_slow(begin, end, value);
+  }
+  double result = (double)mantissa;
+  if (exp10 < 0) {
+    result /= kPow10[-exp10];
+  } else {
+    result *= kPow10[exp10];
+  }
+  *value = negative ? -result : result;
+  return pos;
+}
+
+// Parse the optional weight after the label, e.g., the "@50"
+// of "1@50", and return the new position
+inline char* parse_weight(char* pos, char* end,
+                          DMatrix& matrix, index_t row_id) {
+  if (pos < end && *pos == kWeightSeparator) {
+    real_t weight = 1.0;
+    pos = parse_real(pos+1, end, &weight);
+    matrix.SetWeight(row_id, weight);
+  }
+  return pos;
+}
 
 // How many lines are there in current memory buffer
 index_t Parser::get_line_number(char* buf, uint64 buf_size) {
-  index_t num = 0;
-  for (uint64 i = 0; i < buf_size; ++i) {
-    if (buf[i] == '\n') num++;
-  }
+  index_t num = count_char_sse(buf, buf_size, '\n');
   // The last line may doesn't contain the '\n'
   // and we need +1 here
   if (buf[buf_size-1] == '\n') {
@@ -50,78 +316,100 @@ index_t Parser::get_line_number(char* buf, uint64 buf_size) {
   return num + 1;
 }
 
-// Get one line from memory buffer
-uint64 Parser::get_line_from_buffer(char* line,
-                               char* buf,
-                               uint64 pos,
-                               uint64 size) {
-  if (pos >= size) { return 0; }
-  uint64 end_pos = pos;
-  while (end_pos < size && buf[end_pos] != '\n') { end_pos++; }
-  uint64 read_size = end_pos - pos + 1;
-  if (read_size > kMaxLineSize) {
-    LOG(FATAL) << "Encountered a too-long line.    \
-                   Please check the data.";
-  }
-  memcpy(line, buf+pos, read_size);
-  line[read_size - 1] = '\0';
-  if (read_size > 1 && line[read_size - 2] == '\r') {
-    // Handle some txt format in windows or DOS.
-    line[read_size - 2] = '\0';
-  }
-  return read_size;
+// Count a character in current memory buffer
+uint64 Parser::count_char(char* buf, uint64 buf_size, char ch) {
+  return count_char_sse(buf, buf_size, ch);
 }
 
 //------------------------------------------------------------------------------
 // LibsvmParser parses the following data format:
 // [y1 idx:value idx:value ...]
 // [y2 idx:value idx:value ...]
+// The label can be followed by the weight of the row, like [y1@w1 ...]
 //------------------------------------------------------------------------------
-void LibsvmParser::Parse(char* buf, uint64 size, DMatrix& matrix) {
+void LibsvmParser::ParseChunk(char* buf, uint64 size, DMatrix& matrix) {
   CHECK_NOTNULL(buf);
   CHECK_GT(size, 0);
   index_t line_num = get_line_number(buf, size);
   matrix.ResetMatrix(line_num);
-  static char* line_buf = new char[kMaxLineSize];
+  // Each node has one ':'
+  matrix.Reserve(count_char(buf, size, ':'));
   // Parse every line
-  uint64 pos = 0;
+  char* pos = buf;
+  char* end = buf + size;
   for (index_t i = 0; i < line_num; ++i) {
-    pos += get_line_from_buffer(line_buf, buf, pos, size);
-    matrix.row[i] = new SparseRow();
+    char* line_end = nullptr;
+    char* next = find_line_end(pos, end, &line_end);
+    matrix.InitRow(i);
+    pos = skip_blank(pos, line_end);
     // Add Y
     if (has_label_) {  // for training task
-      char *y_char = strtok(line_buf, " \t");
-      matrix.Y[i] = atof(y_char);
+      pos = parse_real(pos, line_end, &matrix.Y[i]);
+      pos = parse_weight(pos, line_end, matrix, i);
     } else {  // for predict task
       matrix.Y[i] = -2;
     }
     // Add features
     real_t norm = 0.0;
-    // The first element
-    if (!has_label_) {
-      char *idx_char = strtok(line_buf, ":");
-      char *value_char = strtok(nullptr, " \t");
-      if (idx_char != nullptr && *idx_char != '\n') {
-        index_t idx = atoi(idx_char);
-        real_t value = atof(value_char);
-        matrix.AddNode(i, idx, value);
-        norm += value*value;
-      }
-    }
-    // The remain elements
     for (;;) {
-      char *idx_char = strtok(nullptr, ":");
-      char *value_char = strtok(nullptr, " \t");
-      if (idx_char == nullptr || *idx_char == '\n') {
-        break;
+      pos = skip_blank(pos, line_end);
+      if (pos >= line_end) { break; }
+      uint64 idx = 0;
+      real_t value = 0;
+      pos = parse_uint64(pos, line_end, &idx);
+      if (pos >= line_end || *pos != ':') {
+        LOG(FATAL) << "Unknow libsvm format in line: " << i;
       }
-      index_t idx = atoi(idx_char);
-      real_t value = atof(value_char);
-      matrix.AddNode(i, idx, value);
+      pos = parse_real(pos+1, line_end, &value);
+      matrix.AddNode(i, feature_id(idx), value);
       norm += value*value;
     }
     norm = 1.0f / norm;
     matrix.norm[i] = norm;
+    pos = next;
+  }
+}
+
+bool ParseCrosses(const std::string& spec, std::vector<FieldCross>* crosses) {
+  CHECK_NOTNULL(crosses);
+  crosses->clear();
+  std::vector<std::string> pairs;
+  SplitStringUsing(spec, ",", &pairs);
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    std::vector<std::string> fields;
+    SplitStringUsing(pairs[i], ":", &fields);
+    if (fields.size() != 2) { return false; }
+    FieldCross cross;
+    char* end = nullptr;
+    cross.first = strtoul(fields[0].c_str(), &end, 10);
+    if (!isdigit(fields[0][0]) || *end != '\0') { return false; }
+    cross.second = strtoul(fields[1].c_str(), &end, 10);
+    if (!isdigit(fields[1][0]) || *end != '\0') { return false; }
+    crosses->push_back(cross);
+  }
+  return !crosses->empty();
+}
+
+// The features of a pair of the same field are crossed once
+// for each two of them, and never with themselves
+void Parser::add_crosses(const std::vector<RawFeature>& feats,
+                         index_t row, DMatrix& matrix,
+                         real_t* norm) const {
+  CHECK_GT(hash_bucket_, 0);
+  for (index_t c = 0; c < crosses_.size(); ++c) {
+    const FieldCross& cross = crosses_[c];
+    index_t field = field_id(cross.first);
+    for (size_t a = 0; a < feats.size(); ++a) {
+      if (feats[a].field != cross.first) { continue; }
+      size_t b = cross.first == cross.second ? a + 1 : 0;
+      for (; b < feats.size(); ++b) {
+        if (feats[b].field != cross.second) { continue; }
+        uint64 id = HashCross(c, feats[a].id, feats[b].id);
+        real_t value = feats[a].value * feats[b].value;
+        matrix.AddNode(row, feature_id(id), value, field);
+        *norm += value*value;
+      }
+    }
   }
 }
 
@@ -129,56 +417,120 @@ void LibsvmParser::Parse(char* buf, uint64 size, DMatrix& matrix) {
 // FFMParser parses the following data format:
 // [y1 field:idx:value field:idx:value ...]
 // [y2 field:idx:value field:idx:value ...]
+// The label can be followed by the weight of the row, like [y1@w1 ...]
 //------------------------------------------------------------------------------
-void FFMParser::Parse(char* buf, uint64 size, DMatrix& matrix) {
+void FFMParser::ParseChunk(char* buf, uint64 size, DMatrix& matrix) {
   CHECK_NOTNULL(buf);
   CHECK_GT(size, 0);
   index_t line_num = get_line_number(buf, size);
   matrix.ResetMatrix(line_num);
-  static char* line_buf = new char[kMaxLineSize];
+  // Each node has two ':'
+  matrix.Reserve(count_char(buf, size, ':') / 2 +
+                 (uint64)line_num * crosses_.size());
+  // The raw features of the row for the crosses
+  std::vector<RawFeature> feats;
   // Parse every line
-  uint64 pos = 0;
+  char* pos = buf;
+  char* end = buf + size;
   for (index_t i = 0; i < line_num; ++i) {
-    pos += get_line_from_buffer(line_buf, buf, pos, size);
-    matrix.row[i] = new SparseRow();
+    char* line_end = nullptr;
+    char* next = find_line_end(pos, end, &line_end);
+    matrix.InitRow(i);
+    pos = skip_blank(pos, line_end);
     // Add Y
     if (has_label_) {  // for training task
-      char *y_char = strtok(line_buf, " \t");
-      matrix.Y[i] = atof(y_char);
+      pos = parse_real(pos, line_end, &matrix.Y[i]);
+      pos = parse_weight(pos, line_end, matrix, i);
     } else {  // for predict task
       matrix.Y[i] = -2;
     }
     // Add features
     real_t norm = 0.0;
-    // The first element
-    if (!has_label_) {
-      char *field_char = strtok(line_buf, ":");
-      char *idx_char = strtok(nullptr, ":");
-      char *value_char = strtok(nullptr, " \t");
-      if (idx_char != nullptr && *idx_char != '\n') {
-        index_t idx = atoi(idx_char);
-        real_t value = atof(value_char);
-        index_t field_id = atoi(field_char);
-        matrix.AddNode(i, idx, value, field_id);
-        norm += value*value;
+    for (;;) {
+      pos = skip_blank(pos, line_end);
+      if (pos >= line_end) { break; }
+      index_t field = 0;
+      uint64 idx = 0;
+      real_t value = 0;
+      pos = parse_uint(pos, line_end, &field);
+      if (pos >= line_end || *pos != ':') {
+        LOG(FATAL) << "Unknow libffm format in line: " << i;
+      }
+      pos = parse_uint64(pos+1, line_end, &idx);
+      if (pos >= line_end || *pos != ':') {
+        LOG(FATAL) << "Unknow libffm format in line: " << i;
       }
+      pos = parse_real(pos+1, line_end, &value);
+      matrix.AddNode(i, feature_id(idx), value, field_id(field));
+      norm += value*value;
+      if (!crosses_.empty()) { feats.push_back({field, idx, value}); }
+    }
+    if (!crosses_.empty()) {
+      add_crosses(feats, i, matrix, &norm);
+      feats.clear();
+    }
+    norm = 1.0f / norm;
+    matrix.norm[i] = norm;
+    pos = next;
+  }
+}
+
+//------------------------------------------------------------------------------
+// TokenParser parses the following data format:
+// [y1 field=token field=token ...]
+// [y2 field=token field=token ...]
+// The label can be followed by the weight of the row, like [y1@w1 ...]
+//------------------------------------------------------------------------------
+void TokenParser::ParseChunk(char* buf, uint64 size, DMatrix& matrix) {
+  CHECK_NOTNULL(buf);
+  CHECK_GT(size, 0);
+  CHECK_GT(hash_bucket_, 0);
+  index_t line_num = get_line_number(buf, size);
+  matrix.ResetMatrix(line_num);
+  // Each node has one '=', besides the ones in the tokens
+  matrix.Reserve(count_char(buf, size, '=') +
+                 (uint64)line_num * crosses_.size());
+  // The raw features of the row for the crosses
+  std::vector<RawFeature> feats;
+  // Parse every line
+  char* pos = buf;
+  char* end = buf + size;
+  for (index_t i = 0; i < line_num; ++i) {
+    char* line_end = nullptr;
+    char* next = find_line_end(pos, end, &line_end);
+    matrix.InitRow(i);
+    pos = skip_blank(pos, line_end);
+    // Add Y
+    if (has_label_) {  // for training task
+      pos = parse_real(pos, line_end, &matrix.Y[i]);
+      pos = parse_weight(pos, line_end, matrix, i);
+    } else {  // for predict task
+      matrix.Y[i] = -2;
     }
-    // The remain elements
+    // Add features
+    real_t norm = 0.0;
     for (;;) {
-      char *field_char = strtok(nullptr, ":");
-      char *idx_char = strtok(nullptr, ":");
-      char *value_char = strtok(nullptr, " \t");
-      if (field_char == nullptr || *field_char == '\n') {
-        break;
+      pos = skip_blank(pos, line_end);
+      if (pos >= line_end) { break; }
+      index_t field = 0;
+      pos = parse_uint(pos, line_end, &field);
+      if (pos >= line_end || *pos != '=') {
+        LOG(FATAL) << "Unknow token format in line: " << i;
       }
-      index_t idx = atoi(idx_char);
-      real_t value = atof(value_char);
-      index_t field_id = atoi(field_char);
-      matrix.AddNode(i, idx, value, field_id);
-      norm += value*value;
+      char* token = ++pos;
+      while (pos < line_end && !is_blank(*pos)) { pos++; }
+      uint64 id = HashToken(field, token, pos - token);
+      matrix.AddNode(i, feature_id(id), 1.0, field_id(field));
+      norm += 1.0;
+      if (!crosses_.empty()) { feats.push_back({field, id, 1.0}); }
+    }
+    if (!crosses_.empty()) {
+      add_crosses(feats, i, matrix, &norm);
+      feats.clear();
     }
     norm = 1.0f / norm;
     matrix.norm[i] = norm;
+    pos = next;
   }
 }
 
@@ -186,37 +538,73 @@ void FFMParser::Parse(char* buf, uint64 size, DMatrix& matrix) {
 // CSVParser parses the following data format:
 // [feat_1 feat_2 feat_3 ... feat_n y1]
 // [feat_1 feat_2 feat_3 ... feat_n y2]
-// Note that the CSV file will always contain label y
+// Note that the CSV file will always contain label y, which can be
+// followed by the weight of the row, like [... feat_n y1@w1]
 //------------------------------------------------------------------------------
-void CSVParser::Parse(char* buf, uint64 size, DMatrix& matrix) {
+void CSVParser::ParseChunk(char* buf, uint64 size, DMatrix& matrix) {
   CHECK_NOTNULL(buf);
   CHECK_GT(size, 0);
   index_t line_num = get_line_number(buf, size);
   matrix.ResetMatrix(line_num);
-  static char* line_buf = new char[kMaxLineSize];
+  // The number of separators is the upper bound of the number
+  // of nodes, because the label and the zero values are skipped
+  if (!dense_) {
+    matrix.Reserve(count_char(buf, size, ' ') +
+                   count_char(buf, size, '\t'));
+  }
   // Parse every line
-  uint64 pos = 0;
-  std::vector<std::string> str_vec;
+  char* pos = buf;
+  char* end = buf + size;
+  std::vector<real_t> value_vec;
   for (index_t i = 0; i < line_num; ++i) {
-    pos += get_line_from_buffer(line_buf, buf, pos, size);
-    matrix.row[i] = new SparseRow();
-    str_vec.clear();
-    SplitStringUsing(line_buf, " \t", &str_vec);
-    int size = str_vec.size();
+    char* line_end = nullptr;
+    char* next = find_line_end(pos, end, &line_end);
+    matrix.InitRow(i);
+    value_vec.clear();
+    for (;;) {
+      pos = skip_blank(pos, line_end);
+      if (pos >= line_end) { break; }
+      real_t value = 0;
+      char* begin = pos;
+      pos = parse_real(pos, line_end, &value);
+      // The header or a word is not a number, and it
+      // would never move the position
+      if (pos == begin) {
+        LOG(FATAL) << "Unknow value in line: " << i
+                   << " of the csv file, which has no header";
+      }
+      value_vec.push_back(value);
+      // The weight of the last value, i.e., the label
+      pos = parse_weight(pos, line_end, matrix, i);
+    }
+    int num_value = value_vec.size();
+    CHECK_GT(num_value, 0);
     // Add Y
-    matrix.Y[i] = atof(str_vec[size-1].c_str());
+    matrix.Y[i] = value_vec[num_value-1];
     // Add features
     real_t norm = 0.0;
-    for (int j = 0; j < size-1; ++j) {
-      index_t idx = j;
-      real_t value = atof(str_vec[j].c_str());
-      // skip zero
-      if (value < kVerySmallNumber) { continue; }
-      matrix.AddNode(i, idx, value);
-      norm += value*value;
+    if (dense_) {
+      // The width is given by the first line
+      if (i == 0) { matrix.SetDenseWidth(num_value-1); }
+      CHECK_EQ(matrix.dense_width, (index_t)(num_value-1));
+      real_t* dense = matrix.DenseRow(i);
+      for (int j = 0; j < num_value-1; ++j) {
+        dense[j] = value_vec[j];
+        norm += value_vec[j]*value_vec[j];
+      }
+    } else {
+      for (int j = 0; j < num_value-1; ++j) {
+        index_t idx = j;
+        real_t value = value_vec[j];
+        // skip zero
+        if (value < kVerySmallNumber) { continue; }
+        matrix.AddNode(i, idx, value);
+        norm += value*value;
+      }
     }
     norm = 1.0f / norm;
     matrix.norm[i] = norm;
+    pos = next;
   }
 }
 
@@ -24,12 +24,22 @@ to the DMatrix.
 #ifndef XLEARN_READER_PARSER_H_
 #define XLEARN_READER_PARSER_H_
 
+#include <string.h>
+
+#include <atomic>
+#include <initializer_list>
 #include <vector>
 #include <string>
+#include <thread>
+#include <utility>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
+#include "src/base/resource.h"
+#include "src/base/thread_pool.h"
+#include "src/data/admission_filter.h"
 #include "src/data/data_structure.h"
+#include "src/data/field_groups.h"
 
 namespace xLearn {
 
@@ -54,10 +64,132 @@ namespace xLearn {
 //   uint64 size = ReadFileToMemory(filename, buffer);
 //   DMatrix matrix;
 //   parser->Parse(buffer, size, matrix);
+//
+// A large file can be mapped by MapFileToMemory() instead. With
+// setMappedInput(true), the pages of the parsed chunks are released,
+// so the whole txt file is never resident in memory.
+//
+// The Parse() method splits the buffer into chunks at newline boundaries
+// and parses the chunks in multi-thread. Each real Parser only needs to
+// implement the ParseChunk() method, which must be thread-safe. The Parse()
+// of a configured parser can be invoked by many threads at the same time,
+// e.g., the streams of a serving process, since the state of parsing is on
+// the stack of each chunk.
+//
+// The feature ids of libsvm and libffm can be hashed into a fixed number
+// of buckets (the hashing trick), so the model size does not depend on
+// the largest feature id. The ids are parsed as 64-bit integers and hashed
+// once at loading time:
+//
+//   parser->setHashBucket(1 << 20);  // feature id in [0, 2^20)
+//
+// The rows of libffm and of the tokens can have the hashed crosses of
+// the pairs of their fields, which are generated at parsing time, so
+// the txt file keeps the raw features only (see setCrosses()):
+//
+//   parser->setCrosses({{0, 1}, {0, 2}});  // user x item, user x ad
+//
+// The label of a row can be followed by its weight, e.g., "1@50 3:0.5",
+// so one row of the aggregated data stands for 50 identical rows. The
+// weight is 1.0 by default (see DMatrix::SetWeight()).
 //------------------------------------------------------------------------------
+
+// A chunk of buffer must be larger than 1 MB
+// then it can be parsed in a new thread
+static const uint64 kMinChunkSize = 1024 * 1024;
+
+// A chunk of the mapped buffer is at most 64 MB, so
+// its pages can be released soon after parsing
+static const uint64 kMaxChunkSize = 64 * 1024 * 1024;
+
+// Maximal length of a number token
+static const uint64 kMaxTokenSize = 64;
+
+// The separator of the label and the weight of a row,
+// e.g., "1@50" is the label 1 with the weight 50
+static const char kWeightSeparator = '@';
+
+// Hash a feature id into [0, num_bucket). The bits of id
+// are mixed by the finalizer of MurmurHash3, so that the
+// adjacent ids are spread over the buckets
+inline index_t HashFeature(uint64 id, index_t num_bucket) {
+  id ^= id >> 33;
+  id *= 0xff51afd7ed558ccdULL;
+  id ^= id >> 33;
+  id *= 0xc4ceb9fe1a85ec53ULL;
+  id ^= id >> 33;
+  return static_cast<index_t>(id % num_bucket);
+}
+
+// The 64-bit hash of the string token of the field, which reads
+// the token 8 bytes at a time (see MurmurHash64A). The field is
+// the seed, so the same string of two fields are two features
+inline uint64 HashToken(index_t field, const char* token, uint64 len) {
+  const uint64 m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64 h = (field * 0x9e3779b97f4a7c15ULL) ^ (len * m);
+  const char* end = token + (len & ~7ULL);
+  for (const char* p = token; p != end; p += 8) {
+    uint64 k;
+    memcpy(&k, p, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  uint64 tail = 0;
+  switch (len & 7) {
+    case 7: tail ^= uint64(uint8(end[6])) << 48;
+    case 6: tail ^= uint64(uint8(end[5])) << 40;
+    case 5: tail ^= uint64(uint8(end[4])) << 32;
+    case 4: tail ^= uint64(uint8(end[3])) << 24;
+    case 3: tail ^= uint64(uint8(end[2])) << 16;
+    case 2: tail ^= uint64(uint8(end[1])) << 8;
+    case 1: tail ^= uint64(uint8(end[0]));
+            h ^= tail;
+            h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+// The 64-bit id of the cross of the ids of two features, which
+// are mixed in order by the finalizer of MurmurHash3. The index
+// of the pair of fields is the seed, so the same ids of two
+// pairs are two features
+inline uint64 HashCross(index_t cross, uint64 id_1, uint64 id_2) {
+  uint64 h = (cross + 1) * 0x9e3779b97f4a7c15ULL;
+  for (uint64 id : { id_1, id_2 }) {
+    h ^= id;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+  }
+  return h;
+}
+
+// A pair of the fields (of the file) whose features are crossed
+typedef std::pair<index_t, index_t> FieldCross;
+
+// Parse the pairs of the fields like "0:1,0:2", and return
+// false for the illegal ones
+bool ParseCrosses(const std::string& spec, std::vector<FieldCross>* crosses);
+
 class Parser {
  public:
-  Parser() { }
+  Parser() : has_label_(false),
+    thread_number_(AvailableCpus()),
+    hash_bucket_(0), admission_(nullptr), oov_id_(0),
+    sort_rows_(false), dense_(false),
+    mapped_input_(false),
+    max_chunk_size_(kMaxChunkSize), scratch_size_(0) {
+    if (thread_number_ == 0) { thread_number_ = 1; }
+  }
   virtual ~Parser() {  }
 
   // This dataset has label y
@@ -65,21 +197,169 @@ class Parser {
     has_label_ = label;
   }
 
-  virtual void Parse(char* buf, uint64 size, DMatrix& matrix) = 0;
+  // Maximal number of threads used by Parse()
+  // Using the number of hardware threads by default
+  inline void setThreadNumber(int thread_number) {
+    CHECK_GT(thread_number, 0);
+    thread_number_ = thread_number;
+  }
+
+  // Pin the parsing threads to the cpus (see affinity.h),
+  // and the threads are not pinned by default
+  inline void setAffinity(const std::vector<int>& cpus) {
+    cpus_ = cpus;
+  }
+
+  // Parse the chunks by the pool of the caller instead of the
+  // shared pool (see executor.h), and nullptr means the shared one
+  inline void setThreadPool(ThreadPool* pool) { pool_ = pool; }
+
+  // Hash the feature ids into num_bucket buckets, and
+  // 0 (by default) means no hashing
+  inline void setHashBucket(index_t num_bucket) {
+    hash_bucket_ = num_bucket;
+  }
+
+  // Map the hashed ids that the filter has not admitted (see
+  // AdmissionFilter) to the shared oov_id, which is counted
+  // by the ids before the hashing. nullptr means no filter
+  inline void setAdmission(AdmissionFilter* filter, index_t oov_id) {
+    admission_ = filter;
+    oov_id_ = oov_id;
+  }
+
+  // Sort the nodes of each parsed row by field and then by
+  // feature (see DMatrix::SortRows()), so that the score
+  // functions load the latent vectors of the same field in
+  // a row. The rows are kept in the file order by default
+  inline void setSortRows(bool sort) {
+    sort_rows_ = sort;
+  }
+
+  // Replace the field ids of the file with their groups (see
+  // FieldGroups), and the empty map keeps the field ids
+  inline void setFieldGroups(const FieldGroups& groups) {
+    field_groups_ = groups;
+  }
+
+  // Add the cross of each pair of the features of each pair of
+  // the fields to the row, whose id is HashCross() of their ids
+  // in the file, whose value is the product of their values and
+  // whose field is the first field of the pair. It needs the
+  // hashing, and it is only supported by the formats of fields,
+  // i.e., libffm and the tokens. The empty list (by default)
+  // adds no cross
+  inline void setCrosses(const std::vector<FieldCross>& crosses) {
+    crosses_ = crosses;
+  }
+
+  // Store the numeric columns in the dense block of the DMatrix
+  // (see DMatrix::SetDenseWidth()) instead of the nodes, which
+  // is only supported by the CSVParser
+  inline void setDense(bool dense) {
+    dense_ = dense;
+  }
+
+  // The buffer of Parse() is mapped from the txt file by
+  // MapFileToMemory(). Then the buffer is split into chunks
+  // of at most max_chunk_size bytes, and the pages of each
+  // chunk are released once it is parsed (see
+  // ReleaseMappedPages()), so the resident memory of the
+  // txt file is bounded. Don't set it for a heap buffer
+  inline void setMappedInput(bool mapped,
+                             uint64 max_chunk_size = kMaxChunkSize) {
+    CHECK_GT(max_chunk_size, 0);
+    mapped_input_ = mapped;
+    max_chunk_size_ = max_chunk_size;
+  }
+
+  // The feature id of the id in the file. The model is indexed
+  // by 32 bits, so the larger ids need the hashing, instead of
+  // being truncated into the ids of the other features
+  inline index_t feature_id(uint64 id) const {
+    if (hash_bucket_ == 0) {
+      if (id > kUInt32Max) {
+        LOG(FATAL) << "The feature id " << id << " exceeds 32 bits, "
+                   << "please hash the ids by -hash <num_bucket>";
+      }
+      return static_cast<index_t>(id);
+    }
+    if (admission_ != nullptr && !admission_->Admit(id)) {
+      return oov_id_;
+    }
+    return HashFeature(id, hash_bucket_);
+  }
+
+  // The field id of the field in the file
+  inline index_t field_id(index_t field) const {
+    return field_groups_.Group(field);
+  }
+
+  // Parse the whole buffer into matrix in multi-thread
+  void Parse(char* buf, uint64 size, DMatrix& matrix);
+
+  // Peak bytes of the chunks parsed by the threads in one
+  // Parse(), which are stitched into the matrix and released
+  inline uint64 ScratchSize() const { return scratch_size_.load(); }
+
+  // Parse a chunk of buffer into matrix. The chunk must
+  // end with a complete line
+  virtual void ParseChunk(char* buf, uint64 size, DMatrix& matrix) = 0;
 
  protected:
    // Get how many lines in current memory buffer
    index_t get_line_number(char* buf, uint64 size);
 
-   // Get one line from memory buffer
-   uint64 get_line_from_buffer(char* line,
-                         char* buf,
-                         uint64 pos,
-                         uint64 size);
+   // Count a character in current memory buffer, which is used
+   // to estimate the number of nodes before parsing, so that the
+   // DMatrix can reserve all the node storage at once
+   uint64 count_char(char* buf, uint64 size, char ch);
+
+   // Split buffer into chunks at newline boundaries
+   void split_buffer(char* buf, uint64 size,
+                     std::vector<uint64>& chunk_pos);
+
+   // A feature of the row before the hashing, which is kept
+   // for the crosses of the row
+   struct RawFeature {
+     index_t field;
+     uint64 id;
+     real_t value;
+   };
+
+   // Add the crosses of the raw features of the row to the
+   // matrix, and their squared values to the norm
+   void add_crosses(const std::vector<RawFeature>& feats,
+                    index_t row, DMatrix& matrix, real_t* norm) const;
 
    /* True for training task and
    False for prediction task */
    bool has_label_;
+   /* Maximal number of threads for parsing */
+   uint64 thread_number_;
+   /* CPUs of the parsing threads */
+   std::vector<int> cpus_;
+   /* The pool of the caller, or nullptr */
+   ThreadPool* pool_ = nullptr;
+   /* Number of buckets of the feature hashing */
+   index_t hash_bucket_;
+   /* The admission of the hashed ids, and their OOV id */
+   AdmissionFilter* admission_;
+   index_t oov_id_;
+   /* Sort the nodes of each row by field */
+   bool sort_rows_;
+   /* The groups of the fields */
+   FieldGroups field_groups_;
+   /* The pairs of the fields of the crosses */
+   std::vector<FieldCross> crosses_;
+   /* Parse the columns into the dense block */
+   bool dense_;
+   /* The buffer is mapped from file */
+   bool mapped_input_;
+   uint64 max_chunk_size_;
+   /* Peak bytes of the parsed chunks, which is
+   updated by the concurrent Parse() */
+   std::atomic<uint64> scratch_size_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Parser);
@@ -95,7 +375,7 @@ class LibsvmParser : public Parser {
   LibsvmParser() { }
   ~LibsvmParser() {  }
 
-  void Parse(char* buf, uint64 size, DMatrix& matrix);
+  void ParseChunk(char* buf, uint64 size, DMatrix& matrix);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(LibsvmParser);
@@ -111,23 +391,45 @@ class FFMParser : public Parser {
   FFMParser() { }
   ~FFMParser() {  }
 
-  void Parse(char* buf, uint64 size, DMatrix& matrix);
+  void ParseChunk(char* buf, uint64 size, DMatrix& matrix);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(FFMParser);
 };
 
+//------------------------------------------------------------------------------
+// TokenParser parses the raw categorical data of string tokens:
+// [y1 field=token field=token ...]
+// [y2 field=token field=token ...]
+// Each token is hashed with its field (see HashToken()) into the
+// buckets of setHashBucket(), which must be set, and the value of
+// each node is 1. The token is the string before the next blank,
+// so it can have any other character, e.g., "3=www.a.com:80"
+//------------------------------------------------------------------------------
+class TokenParser : public Parser {
+ public:
+  TokenParser() { }
+  ~TokenParser() {  }
+
+  void ParseChunk(char* buf, uint64 size, DMatrix& matrix);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TokenParser);
+};
+
 //------------------------------------------------------------------------------
 // CSVParser parses the following data format:
 // [feat_1 feat_2 feat_3 ... feat_n y1]
 // [feat_1 feat_2 feat_3 ... feat_n y2]
+// With setDense(true), the n columns of each line are stored in the
+// dense block of width n, and all the lines must have n columns
 //------------------------------------------------------------------------------
 class CSVParser : public Parser {
  public:
   CSVParser() { }
   ~CSVParser() { }
 
-  void Parse(char* buf, uint64 size, DMatrix& matrix);
+  void ParseChunk(char* buf, uint64 size, DMatrix& matrix);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(CSVParser);
@@ -23,10 +23,12 @@ This file tests parser.h
 #include "gtest/gtest.h"
 
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "src/reader/parser.h"
 #include "src/data/data_structure.h"
+#include "src/base/stringprintf.h"
 
 namespace xLearn {
 
@@ -197,6 +199,483 @@ TEST(PARSER_TEST, Parse_csv) {
   RemoveFile(filename.c_str());
 }
 
+// The header and the non-numeric values stop the parsing
+// instead of never moving the position
+TEST(PARSER_TEST, Parse_csv_non_numeric) {
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  const char* kLines[] = {
+    "f0 f1 f2 label\n0.1 0.2 0.3 1\n",
+    "0.1 a 0.3 1\n",
+    "0.1 0.2 0.3 b\n"
+  };
+  for (int n = 0; n < 3; ++n) {
+    std::string str(kLines[n]);
+    DMatrix matrix;
+    CSVParser parser;
+    parser.setLabel(true);
+    EXPECT_DEATH(parser.Parse(&str[0], str.size(), matrix),
+                 "Unknow value");
+  }
+}
+
+// Parse the data into the CSR storage, and all the nodes
+// should be reserved once before parsing
+void ParseCSR(Parser* parser, const std::string& str, bool has_label) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < kNum_lines; ++i) {
+    WriteDataToDisk(file, str.data(), str.size());
+  }
+  Close(file);
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buffer);
+  DMatrix matrix;
+  matrix.SetCSR(true);
+  parser->setLabel(has_label);
+  parser->Parse(buffer, size, matrix);
+  EXPECT_EQ(matrix.row_length, kNum_lines);
+  EXPECT_EQ(matrix.csr_node.size(), kNum_lines * 5);
+  EXPECT_EQ(matrix.csr_node.capacity(), kNum_lines * 5);
+  for (index_t i = 0; i < matrix.row_length; ++i) {
+    RowView row = matrix.GetRow(i);
+    EXPECT_EQ(row.size(), 5);
+    for (int n = 0; n < 5; ++n) {
+      EXPECT_EQ(row[n].feat_id, n);
+    }
+  }
+  delete [] buffer;
+  RemoveFile(filename.c_str());
+}
+
+TEST(PARSER_TEST, Parse_into_CSR) {
+  LibsvmParser libsvm_parser;
+  ParseCSR(&libsvm_parser, kStr, true);
+  ParseCSR(&libsvm_parser, kStrNoy, false);
+  FFMParser ffm_parser;
+  ParseCSR(&ffm_parser, kStrFFM, true);
+  ParseCSR(&ffm_parser, kStrFFMNoy, false);
+  CSVParser csv_parser;
+  ParseCSR(&csv_parser, kStrCSV, true);
+}
+
+TEST(PARSER_TEST, Parse_number) {
+  // Different format of numbers, blanks and DOS line ending
+  std::string str = "-1  3:1e-3\t5:-2.5 7:+4 9:12345678901234567890 \r\n"
+                    "+1 0:0.000001e2 1:100 2:1.5E+3\n"
+                    "0 4:0.123456789123456789";
+  char* buffer = new char[str.size()];
+  memcpy(buffer, str.data(), str.size());
+  DMatrix matrix;
+  LibsvmParser parser;
+  parser.setLabel(true);
+  parser.Parse(buffer, str.size(), matrix);
+  EXPECT_EQ(matrix.row_length, 3);
+  EXPECT_FLOAT_EQ(matrix.Y[0], -1);
+  EXPECT_FLOAT_EQ(matrix.Y[1], 1);
+  EXPECT_FLOAT_EQ(matrix.Y[2], 0);
+  RowView row = matrix.GetRow(0);
+  ASSERT_EQ(row.size(), 4);
+  EXPECT_EQ(row[0].feat_id, 3);
+  EXPECT_FLOAT_EQ(row[0].feat_val, 1e-3);
+  EXPECT_EQ(row[1].feat_id, 5);
+  EXPECT_FLOAT_EQ(row[1].feat_val, -2.5);
+  EXPECT_EQ(row[2].feat_id, 7);
+  EXPECT_FLOAT_EQ(row[2].feat_val, 4);
+  EXPECT_EQ(row[3].feat_id, 9);
+  EXPECT_FLOAT_EQ(row[3].feat_val, 12345678901234567890.0);
+  row = matrix.GetRow(1);
+  ASSERT_EQ(row.size(), 3);
+  EXPECT_FLOAT_EQ(row[0].feat_val, 1e-4);
+  EXPECT_FLOAT_EQ(row[1].feat_val, 100);
+  EXPECT_FLOAT_EQ(row[2].feat_val, 1500);
+  row = matrix.GetRow(2);
+  ASSERT_EQ(row.size(), 1);
+  EXPECT_EQ(row[0].feat_id, 4);
+  EXPECT_FLOAT_EQ(row[0].feat_val, 0.123456789123456789);
+  delete [] buffer;
+}
+
+TEST(PARSER_TEST, Parse_weight) {
+  // The weight of a row follows its label after '@'
+  std::string str = "1@50 1:1 2:1\n"
+                    "0 1:1\n"
+                    "-1@0.5 3:1\n";
+  char* buffer = new char[str.size()];
+  memcpy(buffer, str.data(), str.size());
+  DMatrix matrix;
+  LibsvmParser parser;
+  parser.setLabel(true);
+  parser.Parse(buffer, str.size(), matrix);
+  ASSERT_EQ(matrix.row_length, 3);
+  ASSERT_TRUE(matrix.HasWeight());
+  EXPECT_FLOAT_EQ(matrix.Y[0], 1);
+  EXPECT_FLOAT_EQ(matrix.Y[2], -1);
+  EXPECT_FLOAT_EQ(matrix.RowWeight(0), 50);
+  EXPECT_FLOAT_EQ(matrix.RowWeight(1), 1);
+  EXPECT_FLOAT_EQ(matrix.RowWeight(2), 0.5);
+  EXPECT_EQ(matrix.GetRow(0).size(), 2);
+  delete [] buffer;
+  // The label of a CSV row is its last value
+  str = "0.5 0.5 1@2\n";
+  buffer = new char[str.size()];
+  memcpy(buffer, str.data(), str.size());
+  CSVParser csv_parser;
+  csv_parser.setLabel(true);
+  csv_parser.Parse(buffer, str.size(), matrix);
+  ASSERT_EQ(matrix.row_length, 1);
+  EXPECT_FLOAT_EQ(matrix.Y[0], 1);
+  EXPECT_FLOAT_EQ(matrix.RowWeight(0), 2);
+  EXPECT_EQ(matrix.GetRow(0).size(), 2);
+  delete [] buffer;
+}
+
+TEST(PARSER_TEST, Parse_dense_csv) {
+  std::string str = "0.5 0 -1 1\n"
+                    "2 0.25 0 0\n";
+  char* buffer = new char[str.size()];
+  memcpy(buffer, str.data(), str.size());
+  CSVParser parser;
+  parser.setDense(true);
+  DMatrix matrix;
+  matrix.SetCSR(true);
+  parser.Parse(buffer, str.size(), matrix);
+  ASSERT_EQ(matrix.row_length, 2);
+  ASSERT_EQ(matrix.dense_width, 3);
+  EXPECT_TRUE(matrix.csr_node.empty());
+  EXPECT_FLOAT_EQ(matrix.Y[0], 1);
+  EXPECT_FLOAT_EQ(matrix.Y[1], 0);
+  // All the values are kept, including 0 and the negative ones
+  RowView row = matrix.GetRow(0);
+  EXPECT_EQ(row.size(), 0);
+  ASSERT_EQ(row.dense_size(), 3);
+  EXPECT_FLOAT_EQ(row.dense()[0], 0.5);
+  EXPECT_FLOAT_EQ(row.dense()[1], 0);
+  EXPECT_FLOAT_EQ(row.dense()[2], -1);
+  EXPECT_FLOAT_EQ(matrix.GetRow(1).dense()[1], 0.25);
+  EXPECT_FLOAT_EQ(matrix.norm[0], 1.0 / 1.25);
+  delete [] buffer;
+  // The chunks of multi-thread parsing are stitched
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < kNum_lines; ++i) {
+    std::string line = StringPrintf("%d %d 0.5 %d\n", i, i % 3, i % 2);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  uint64 size = ReadFileToMemory(filename, &buffer);
+  parser.setThreadNumber(3);
+  DMatrix multi;
+  multi.SetCSR(true);
+  parser.Parse(buffer, size, multi);
+  ASSERT_EQ(multi.row_length, kNum_lines);
+  ASSERT_EQ(multi.dense_width, 3);
+  for (index_t i = 0; i < kNum_lines; i += 997) {
+    RowView view = multi.GetRow(i);
+    EXPECT_FLOAT_EQ(view.dense()[0], i);
+    EXPECT_FLOAT_EQ(view.dense()[1], i % 3);
+    EXPECT_FLOAT_EQ(multi.Y[i], i % 2);
+  }
+  delete [] buffer;
+  RemoveFile(filename.c_str());
+}
+
+TEST(PARSER_TEST, Parse_hash) {
+  // The ids larger than 32 bits are hashed without overflow
+  std::string str = "1 3:1 12345678901:2\n"
+                    "0 1:0:1 2:12345678901:2\n";
+  std::string libsvm = str.substr(0, str.find('\n') + 1);
+  std::string ffm = str.substr(libsvm.size());
+  const index_t kBucket = 1000;
+  char* buffer = new char[str.size()];
+  memcpy(buffer, libsvm.data(), libsvm.size());
+  DMatrix matrix;
+  LibsvmParser parser;
+  parser.setLabel(true);
+  parser.setHashBucket(kBucket);
+  parser.Parse(buffer, libsvm.size(), matrix);
+  RowView row = matrix.GetRow(0);
+  ASSERT_EQ(row.size(), 2);
+  EXPECT_EQ(row[0].feat_id, HashFeature(3, kBucket));
+  EXPECT_EQ(row[1].feat_id, HashFeature(12345678901ULL, kBucket));
+  EXPECT_LT(row[1].feat_id, kBucket);
+  EXPECT_FLOAT_EQ(row[1].feat_val, 2);
+  memcpy(buffer, ffm.data(), ffm.size());
+  DMatrix ffm_matrix;
+  FFMParser ffm_parser;
+  ffm_parser.setLabel(true);
+  ffm_parser.setHashBucket(kBucket);
+  ffm_parser.Parse(buffer, ffm.size(), ffm_matrix);
+  row = ffm_matrix.GetRow(0);
+  ASSERT_EQ(row.size(), 2);
+  EXPECT_EQ(row[0].field_id, 1);
+  EXPECT_EQ(row[0].feat_id, HashFeature(0, kBucket));
+  EXPECT_EQ(row[1].field_id, 2);
+  EXPECT_EQ(row[1].feat_id, HashFeature(12345678901ULL, kBucket));
+  delete [] buffer;
+}
+
+// The ids are mapped to the OOV id until their second occurrence
+TEST(PARSER_TEST, Parse_admission) {
+  std::string str = "1 3:1 12345678901:2\n"
+                    "0 3:1 5:1\n";
+  const index_t kBucket = 1000;
+  char* buffer = new char[str.size()];
+  memcpy(buffer, str.data(), str.size());
+  AdmissionFilter filter;
+  filter.Initialize(1 << 10, 2);
+  DMatrix matrix;
+  LibsvmParser parser;
+  parser.setLabel(true);
+  parser.setThreadNumber(1);
+  parser.setHashBucket(kBucket);
+  parser.setAdmission(&filter, kBucket);
+  parser.Parse(buffer, str.size(), matrix);
+  RowView row = matrix.GetRow(0);
+  ASSERT_EQ(row.size(), 2);
+  EXPECT_EQ(row[0].feat_id, kBucket);
+  EXPECT_EQ(row[1].feat_id, kBucket);
+  row = matrix.GetRow(1);
+  ASSERT_EQ(row.size(), 2);
+  EXPECT_EQ(row[0].feat_id, HashFeature(3, kBucket));
+  EXPECT_EQ(row[1].feat_id, kBucket);
+  EXPECT_EQ(filter.NumRejected(), 3);
+  delete [] buffer;
+}
+
+TEST(PARSER_TEST, Parse_token) {
+  std::string str = "1@2 0=user_42 1=www.a.com:80\n"
+                    "0  1=user_42\t0=a_token_longer_than_16\r\n";
+  const index_t kBucket = 1000;
+  char* buffer = new char[str.size()];
+  memcpy(buffer, str.data(), str.size());
+  DMatrix matrix;
+  TokenParser parser;
+  parser.setLabel(true);
+  parser.setHashBucket(kBucket);
+  parser.Parse(buffer, str.size(), matrix);
+  ASSERT_EQ(matrix.row_length, 2);
+  EXPECT_FLOAT_EQ(matrix.Y[0], 1);
+  EXPECT_FLOAT_EQ(matrix.RowWeight(0), 2);
+  EXPECT_FLOAT_EQ(matrix.norm[0], 0.5);
+  RowView row = matrix.GetRow(0);
+  ASSERT_EQ(row.size(), 2);
+  EXPECT_EQ(row[0].field_id, 0);
+  EXPECT_EQ(row[0].feat_id,
+            HashFeature(HashToken(0, "user_42", 7), kBucket));
+  EXPECT_FLOAT_EQ(row[0].feat_val, 1);
+  EXPECT_EQ(row[1].field_id, 1);
+  EXPECT_EQ(row[1].feat_id,
+            HashFeature(HashToken(1, "www.a.com:80", 12), kBucket));
+  row = matrix.GetRow(1);
+  ASSERT_EQ(row.size(), 2);
+  EXPECT_EQ(row[0].field_id, 1);
+  EXPECT_EQ(row[1].feat_id,
+            HashFeature(HashToken(0, "a_token_longer_than_16", 22),
+                        kBucket));
+  // The same token of another field is another feature
+  EXPECT_NE(HashToken(0, "user_42", 7), HashToken(1, "user_42", 7));
+  EXPECT_NE(HashToken(0, "user_42", 7), HashToken(0, "user_43", 7));
+  delete [] buffer;
+}
+
+// The crosses of the pairs of fields follow the raw features
+TEST(PARSER_TEST, Parse_crosses) {
+  std::string str = "1 0:3:1 1:7:2 1:8:0.5 2:9:1\n"
+                    "0 1:7:1 2:9:1\n";
+  const index_t kBucket = 1000;
+  char* buffer = new char[str.size()];
+  memcpy(buffer, str.data(), str.size());
+  std::vector<FieldCross> crosses;
+  EXPECT_FALSE(ParseCrosses("0:1,2", &crosses));
+  EXPECT_FALSE(ParseCrosses("0:x", &crosses));
+  EXPECT_FALSE(ParseCrosses("", &crosses));
+  ASSERT_TRUE(ParseCrosses("0:1,1:1", &crosses));
+  ASSERT_EQ(crosses.size(), 2);
+  EXPECT_EQ(crosses[1].first, 1);
+  EXPECT_EQ(crosses[1].second, 1);
+  DMatrix matrix;
+  FFMParser parser;
+  parser.setLabel(true);
+  parser.setHashBucket(kBucket);
+  parser.setCrosses(crosses);
+  parser.Parse(buffer, str.size(), matrix);
+  ASSERT_EQ(matrix.row_length, 2);
+  // 0x1 has two crosses, and 1x1 has one of the two features
+  RowView row = matrix.GetRow(0);
+  ASSERT_EQ(row.size(), 7);
+  EXPECT_EQ(row[4].field_id, 0);
+  EXPECT_EQ(row[4].feat_id, HashFeature(HashCross(0, 3, 7), kBucket));
+  EXPECT_FLOAT_EQ(row[4].feat_val, 2);
+  EXPECT_EQ(row[5].feat_id, HashFeature(HashCross(0, 3, 8), kBucket));
+  EXPECT_FLOAT_EQ(row[5].feat_val, 0.5);
+  EXPECT_EQ(row[6].field_id, 1);
+  EXPECT_EQ(row[6].feat_id, HashFeature(HashCross(1, 7, 8), kBucket));
+  EXPECT_FLOAT_EQ(row[6].feat_val, 1);
+  EXPECT_FLOAT_EQ(matrix.norm[0], 1.0 / (1 + 4 + 0.25 + 1 + 4 + 0.25 + 1));
+  // No feature of field 0 and one of field 1
+  EXPECT_EQ(matrix.GetRow(1).size(), 2);
+  // The crosses depend on the order of the ids and the pair
+  EXPECT_NE(HashCross(0, 3, 7), HashCross(0, 7, 3));
+  EXPECT_NE(HashCross(0, 3, 7), HashCross(1, 3, 7));
+  delete [] buffer;
+}
+
+// Compare two matrices row by row
+void CheckSameMatrix(const DMatrix& a, const DMatrix& b) {
+  ASSERT_EQ(a.row_length, b.row_length);
+  for (index_t i = 0; i < a.row_length; ++i) {
+    EXPECT_FLOAT_EQ(a.Y[i], b.Y[i]);
+    EXPECT_FLOAT_EQ(a.norm[i], b.norm[i]);
+    RowView row_a = a.GetRow(i);
+    RowView row_b = b.GetRow(i);
+    ASSERT_EQ(row_a.size(), row_b.size());
+    for (size_t j = 0; j < row_a.size(); ++j) {
+      EXPECT_EQ(row_a[j].field_id, row_b[j].field_id);
+      EXPECT_EQ(row_a[j].feat_id, row_b[j].feat_id);
+      EXPECT_FLOAT_EQ(row_a[j].feat_val, row_b[j].feat_val);
+    }
+  }
+}
+
+TEST(PARSER_TEST, Parse_in_multi_thread) {
+  // Rows with different length
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < kNum_lines; ++i) {
+    std::string line = StringPrintf("%d", i % 2);
+    for (int j = 0; j < i % 7 + 1; ++j) {
+      line += StringPrintf(" %d:%d:%d", j, i+j, j);
+    }
+    line += "\n";
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buffer);
+  FFMParser parser;
+  parser.setLabel(true);
+  // Single thread
+  DMatrix expect;
+  expect.SetCSR(true);
+  parser.setThreadNumber(1);
+  parser.Parse(buffer, size, expect);
+  EXPECT_EQ(expect.row_length, kNum_lines);
+  // Multi-thread
+  parser.setThreadNumber(3);
+  DMatrix csr_matrix;
+  csr_matrix.SetCSR(true);
+  parser.Parse(buffer, size, csr_matrix);
+  CheckSameMatrix(csr_matrix, expect);
+  EXPECT_EQ(csr_matrix.csr_node.size(), expect.csr_node.size());
+  DMatrix matrix;
+  parser.Parse(buffer, size, matrix);
+  CheckSameMatrix(matrix, expect);
+  // Compact matrix
+  DMatrix compact;
+  compact.SetCompact(true);
+  parser.Parse(buffer, size, compact);
+  DMatrix decode;
+  decode.SetCSR(true);
+  decode.ResetMatrix(compact.row_length);
+  decode.CopyRows(0, compact);
+  CheckSameMatrix(decode, expect);
+  // The callers of the same parser at the same time, and
+  // each of them has its own buffer
+  std::vector<DMatrix> matrices(4);
+  std::vector<std::string> buffers(4, std::string(buffer, size));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      matrices[t].SetCSR(true);
+      parser.Parse(&buffers[t][0], size, matrices[t]);
+    });
+  }
+  for (int t = 0; t < 4; ++t) {
+    threads[t].join();
+    CheckSameMatrix(matrices[t], expect);
+  }
+  delete [] buffer;
+  RemoveFile(filename.c_str());
+}
+
+TEST(PARSER_TEST, Parse_sorted_rows) {
+  // The fields of each row are in descending order
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < kNum_lines; ++i) {
+    std::string line = StringPrintf("%d", i % 2);
+    for (int j = i % 7; j >= 0; --j) {
+      line += StringPrintf(" %d:%d:%d", j, i+j, j+1);
+    }
+    line += "\n";
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buffer);
+  FFMParser parser;
+  parser.setLabel(true);
+  DMatrix expect;
+  expect.SetCSR(true);
+  parser.Parse(buffer, size, expect);
+  expect.SortRows();
+  parser.setSortRows(true);
+  for (int n = 0; n < 2; ++n) {
+    parser.setThreadNumber(n == 0 ? 1 : 3);
+    DMatrix matrix;
+    matrix.SetCSR(true);
+    parser.Parse(buffer, size, matrix);
+    CheckSameMatrix(matrix, expect);
+    DMatrix compact;
+    compact.SetCompact(true);
+    parser.Parse(buffer, size, compact);
+    DMatrix decode;
+    decode.SetCSR(true);
+    decode.ResetMatrix(compact.row_length);
+    decode.CopyRows(0, compact);
+    CheckSameMatrix(decode, expect);
+  }
+  RowView row = expect.GetRow(6);
+  ASSERT_EQ(row.size(), 7);
+  for (index_t j = 0; j < 7; ++j) {
+    EXPECT_EQ(row[j].field_id, j);
+  }
+  delete [] buffer;
+  RemoveFile(filename.c_str());
+}
+
+TEST(PARSER_TEST, Parse_mapped_file) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < kNum_lines; ++i) {
+    std::string line = StringPrintf("%d", i % 2);
+    for (int j = 0; j < i % 7 + 1; ++j) {
+      line += StringPrintf(" %d:%d:%d", j, i+j, j);
+    }
+    line += "\n";
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buffer);
+  FFMParser parser;
+  parser.setLabel(true);
+  parser.setThreadNumber(1);
+  DMatrix expect;
+  expect.SetCSR(true);
+  parser.Parse(buffer, size, expect);
+  delete [] buffer;
+  // Small chunks, and all the pages are released after parsing
+  for (int thread = 1; thread <= 3; ++thread) {
+    char* addr = nullptr;
+    uint64 len = MapFileToMemory(filename, &addr);
+    EXPECT_EQ(len, size);
+    parser.setThreadNumber(thread);
+    parser.setMappedInput(true, 100000);
+    DMatrix matrix;
+    matrix.SetCSR(true);
+    parser.Parse(addr, len, matrix);
+    CheckSameMatrix(matrix, expect);
+    UnmapFile(addr, len);
+  }
+  RemoveFile(filename.c_str());
+}
+
 Parser* CreateParser(const char* format_name) {
   return CREATE_PARSER(format_name);
 }
@@ -205,6 +684,7 @@ TEST(PARSER_TEST, CreateParser) {
   EXPECT_TRUE(CreateParser("libsvm") != NULL);
   EXPECT_TRUE(CreateParser("libffm") != NULL);
   EXPECT_TRUE(CreateParser("csv") != NULL);
+  EXPECT_TRUE(CreateParser("token") != NULL);
   EXPECT_TRUE(CreateParser("") == NULL);
   EXPECT_TRUE(CreateParser("unknow_name") == NULL);
 }
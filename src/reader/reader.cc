@@ -23,10 +23,23 @@ This file is the implementation of Reader.
 #include "src/reader/reader.h"
 
 #include <string.h>
-#include <algorithm> // for random_shuffle
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <random>
+#include <sstream>
 
+#include "src/base/executor.h"
 #include "src/base/file_util.h"
+#include "src/base/phase_timer.h"
+#include "src/base/resource.h"
 #include "src/base/split_string.h"
+#include "src/base/stringprintf.h"
+#include "src/base/trace.h"
+#include "src/data/block_cache.h"
+#include "src/reader/cache_dir.h"
+#include "src/reader/file_splitor.h"
+#include "src/reader/input_stream.h"
 
 namespace xLearn {
 
@@ -36,94 +49,1028 @@ namespace xLearn {
 CLASS_REGISTER_IMPLEMENT_REGISTRY(xLearn_reader_registry, Reader);
 REGISTER_READER("memory", InmemReader);
 REGISTER_READER("disk", OndiskReader);
+REGISTER_READER("stream", StreamReader);
 
-// Check current file format
-// Return 'libsvm', 'libffm', or 'csv'
-std::string Reader::check_file_format() {
-  FILE* file = OpenFileOrDie(filename_.c_str(), "r");
-  // get the first line of data
+// The seed of the negative sampling
+static const uint32 kNegSampleSeed = 1024;
+static const uint64 kDedupMagic = 0x5055444544584cULL;  /* "XLDEDUP" */
+
+// Shuffle the whole blocks of block_rows positions of the order,
+// and then the rows within each block. The last partial block keeps
+// its place, so each block of positions always holds the rows of one
+// block of the initial order, and the order can be shuffled again
+static void shuffle_blocks(std::vector<index_t>* order, index_t block_rows,
+                           std::mt19937* rng) {
+  CHECK_GT(block_rows, 0);
+  size_t num_block = order->size() / block_rows;
+  std::vector<index_t> blocks(num_block);
+  for (size_t i = 0; i < num_block; ++i) { blocks[i] = i; }
+  std::shuffle(blocks.begin(), blocks.end(), *rng);
+  std::vector<index_t> shuffled(order->size());
+  for (size_t i = 0; i < num_block; ++i) {
+    std::copy(order->begin() + (size_t)blocks[i] * block_rows,
+              order->begin() + ((size_t)blocks[i] + 1) * block_rows,
+              shuffled.begin() + i * block_rows);
+  }
+  std::copy(order->begin() + num_block * block_rows, order->end(),
+            shuffled.begin() + num_block * block_rows);
+  for (size_t i = 0; i < shuffled.size(); i += block_rows) {
+    size_t end = std::min(i + block_rows, shuffled.size());
+    std::shuffle(shuffled.begin() + i, shuffled.begin() + end, *rng);
+  }
+  order->swap(shuffled);
+}
+
+// The rows of the parallel shuffle are scattered from this number of
+// parts into this number of buckets, which do not depend on the
+// threads, so the order of a seed is the same for any threads
+static const size_t kShuffleParts = 64;
+// The smaller orders are shuffled by one thread
+static const size_t kMinParallelShuffle = 1 << 14;
+
+// The generator of each part and bucket is seeded by the
+// seed of the epoch mixed with its index (splitmix64)
+static inline uint64 mix_seed(uint64 seed, uint64 index) {
+  uint64 z = seed + (index + 1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Run fn(0), ..., fn(num - 1) as the I/O tasks of the pool, which
+// run after the loops of the trainer, and wait for all of them
+static void run_tasks(ThreadPool* pool, size_t num,
+                      const std::function<void(size_t)>& fn) {
+  std::vector<std::future<void>> res;
+  res.reserve(num);
+  for (size_t i = 0; i < num; ++i) {
+    res.push_back(pool->enqueue_priority(kPriorityIO, fn, i));
+  }
+  for (size_t i = 0; i < num; ++i) { res[i].get(); }
+}
+
+// Shuffle src into dst by the threads of the pool: each part of src
+// sends each of its rows to a random bucket by the generator of the
+// part, the rows are scattered into the buckets (their offsets are
+// the prefix sums of the counts of the parts), and then each bucket
+// is shuffled by its own generator. The buckets of the rows are
+// independent and uniform, so dst is a uniform permutation
+static void parallel_shuffle(const std::vector<index_t>& src,
+                             std::vector<index_t>* dst,
+                             uint64 seed,
+                             ThreadPool* pool) {
+  size_t num = src.size();
+  dst->assign(src.begin(), src.end());
+  if (num < kMinParallelShuffle) {
+    std::mt19937_64 rng(seed);
+    std::shuffle(dst->begin(), dst->end(), rng);
+    return;
+  }
+  const size_t P = kShuffleParts;
+  auto part_begin = [num, P](size_t p) { return num * p / P; };
+  // The bucket of each row is the top 6 bits of a draw
+  std::vector<uint8> bucket(num);
+  std::vector<size_t> offset(P * P, 0);
+  run_tasks(pool, P, [&](size_t p) {
+    std::mt19937_64 rng(mix_seed(seed, p));
+    size_t* count = offset.data() + p * P;
+    for (size_t i = part_begin(p); i < part_begin(p + 1); ++i) {
+      bucket[i] = rng() >> 58;
+      count[bucket[i]]++;
+    }
+  });
+  // The rows of the bucket b are in the order of the parts
+  size_t total = 0;
+  std::vector<size_t> bucket_begin(P + 1, 0);
+  for (size_t b = 0; b < P; ++b) {
+    bucket_begin[b] = total;
+    for (size_t p = 0; p < P; ++p) {
+      size_t count = offset[p * P + b];
+      offset[p * P + b] = total;
+      total += count;
+    }
+  }
+  bucket_begin[P] = total;
+  run_tasks(pool, P, [&](size_t p) {
+    size_t* next = offset.data() + p * P;
+    for (size_t i = part_begin(p); i < part_begin(p + 1); ++i) {
+      (*dst)[next[bucket[i]]++] = src[i];
+    }
+  });
+  run_tasks(pool, P, [&](size_t b) {
+    std::mt19937_64 rng(mix_seed(seed, P + b));
+    std::shuffle(dst->begin() + bucket_begin[b],
+                 dst->begin() + bucket_begin[b + 1], rng);
+  });
+}
+
+// The first line of the file, which may be compressed or be
+// read from the stdin. The online file waits for its first line
+static std::string first_line(const std::string& filename, bool online) {
   std::string data_line;
-  GetLine(file, data_line);
-  Close(file);
+  if (IsStdin(filename)) {
+    StdinStream()->PeekLine(data_line);
+  } else {
+    InputStream* stream = online ? OpenOnlineStream(filename) :
+                          OpenInputStream(filename, false);
+    ReadFirstLine(stream, data_line);
+    delete stream;
+  }
+  return data_line;
+}
+
+bool Reader::DetectFormat(const std::string& line,
+                          index_t hash_bucket,
+                          std::string* format,
+                          bool* has_label,
+                          std::string* error) {
   std::vector<std::string> str_list;
-  SplitStringUsing(data_line, " \t", &str_list);
+  SplitStringUsing(line, " \t", &str_list);
+  if (str_list.empty()) {
+    *error = "The first line is empty";
+    return false;
+  }
   // has y?
-  size_t found = str_list[0].find(":");
-  if (found != std::string::npos) {  // find ":", no label
-    has_label_ = false;
+  if (str_list[0].find(":") != std::string::npos ||
+      str_list[0].find("=") != std::string::npos) {
+    *has_label = false;  // find ":" or "=", no label
   } else {
-    has_label_ = true;
+    *has_label = true;
+  }
+  // The string tokens are hashed into the buckets
+  if (str_list[0].find("=") != std::string::npos ||
+      (str_list.size() > 1 &&
+       str_list[1].find("=") != std::string::npos)) {
+    if (hash_bucket == 0) {
+      *error = "The string tokens need the -hash option";
+      return false;
+    }
+    *format = "token";
+    return true;
   }
   // file format
   int count = 0;
-  for (int i = 0; i < str_list[1].size(); ++i) {
-    if (str_list[1][i] == ':') {
-      count++;
+  if (str_list.size() > 1) {
+    for (int i = 0; i < str_list[1].size(); ++i) {
+      if (str_list[1][i] == ':') {
+        count++;
+      }
     }
   }
   if (count == 1) {
-    return "libsvm";
+    *format = "libsvm";
   } else if (count == 2) {
-    return "libffm";
-  } else if (count == 0){
-    return "csv";
+    *format = "libffm";
+  } else if (count == 0) {
+    *format = "csv";
+  } else {
+    *error = "Unknow file format";
+    return false;
+  }
+  return true;
+}
+
+bool Reader::CheckFile(const std::string& filename,
+                       index_t hash_bucket,
+                       bool dense,
+                       std::string* error) {
+  if (!IsStdin(filename) && !FileExist(filename.c_str())) {
+    *error = "Cannot open the file " + filename;
+    return false;
+  }
+  std::string data_line = first_line(filename, false);
+  if (data_line.empty()) {
+    *error = "The file " + filename + " is empty";
+    return false;
+  }
+  std::string format;
+  bool has_label = false;
+  if (!DetectFormat(data_line, hash_bucket, &format, &has_label, error)) {
+    *error += ": " + filename;
+    return false;
+  }
+  if (dense && format != "csv") {
+    *error = "Only the csv file can be parsed into the dense block: " +
+             filename;
+    return false;
+  }
+  return true;
+}
+
+// Check current file format
+// Return 'libsvm', 'libffm', 'csv' or 'token'
+std::string Reader::check_file_format() {
+  std::string data_line = first_line(filename_, online_);
+  if (data_line.empty()) {
+    printf("[Error] The file %s is empty \n", filename_.c_str());
+    exit(0);
+  }
+  std::string format, error;
+  if (!DetectFormat(data_line, hash_bucket_, &format,
+                    &has_label_, &error)) {
+    printf("[Error] %s: %s \n", error.c_str(), filename_.c_str());
+    exit(0);
+  }
+  return format;
+}
+
+// All the options of parsing are set here
+void Reader::init_parser() {
+  std::string format = check_file_format();
+  if (dense_ && format != "csv") {
+    printf("[Error] Only the csv file can be parsed into "
+           "the dense block: %s \n", filename_.c_str());
+    exit(0);
+  }
+  if (!crosses_.empty() && format != "libffm" && format != "token") {
+    printf("[Error] Only the libffm and the token files have the "
+           "fields of the crosses: %s \n", filename_.c_str());
+    exit(0);
+  }
+  parser_ = CreateParser(format.c_str());
+  if (has_label_) parser_->setLabel(true);
+  else parser_->setLabel(false);
+  parser_->setHashBucket(hash_bucket_);
+  parser_->setAdmission(admission_, admission_oov_);
+  parser_->setSortRows(sort_rows_);
+  parser_->setFieldGroups(field_groups_);
+  parser_->setCrosses(crosses_);
+  parser_->setDense(dense_);
+  parser_->setThreadNumber(thread_number());
+  parser_->setAffinity(cpus_);
+  parser_->setThreadPool(pool_);
+}
+
+// Read 64 MB txt data from the file at each time, or
+// 1/64 of the memory (at least 8 MB) in a small container
+static const uint64 kTextChunkSize = 64 * 1024 * 1024;
+static const uint64 kMinTextChunkSize = 8 * 1024 * 1024;
+
+static uint64 text_chunk_size() {
+  uint64 memory = AvailableMemory();
+  if (memory == 0) { return kTextChunkSize; }
+  return std::max(kMinTextChunkSize,
+                  std::min(kTextChunkSize, memory / 64));
+}
+
+// The chunk is cut at the last newline, and the
+// rest of the data is moved to the next chunk. The shard
+// of a plain txt file is read in its byte range, and the
+// shard of a stream keeps every num_shards_-th row
+uint64 Reader::parse_stream(bool compact,
+                    const std::function<bool(const DMatrix&)>& fn) {
+  // The buffer is not mapped from the file
+  parser_->setMappedInput(false);
+  bool is_stdin = IsStdin(filename_);
+  bool use_range = num_shards_ > 1 && !is_stdin && !online_ &&
+                   !IsCompressedFile(filename_);
+  bool interleave = num_shards_ > 1 && !use_range;
+  InputStream* stream = nullptr;
+  if (is_stdin) {
+    stream = StdinStream();
+  } else if (online_) {
+    stream = OpenOnlineStream(filename_);
+  } else if (use_range) {
+    uint64 begin = 0, end = 0;
+    FileSpliter::Range(filename_, num_shards_, shard_, &begin, &end);
+    stream = OpenRangeStream(filename_, begin, end);
+  } else {
+    stream = OpenInputStream(filename_);
+  }
+  const uint64 chunk_size = text_chunk_size();
+  std::vector<char> buffer(chunk_size);
+  stream_buffer_size_ = buffer.size();
+  uint64 remain = 0;
+  uint64 total_size = 0;
+  DMatrix chunk;
+  chunk.SetCSR(true);
+  chunk.SetCompact(compact);
+  // The rows of the shard of each chunk
+  DMatrix shard;
+  shard.SetCSR(true);
+  shard.SetCompact(compact);
+  uint64 row_num = 0;
+  for (;;) {
+    // Fill the buffer unless it reaches the end of file. The
+    // online rows are parsed once a line has arrived
+    uint64 size = remain;
+    bool end_of_file = false;
+    {
+      ScopedTrace read_trace("read chunk", "reader");
+      while (size < chunk_size) {
+        uint64 len = stream->Read(buffer.data() + size,
+                                  chunk_size - size);
+        if (len == 0) {
+          end_of_file = true;
+          break;
+        }
+        size += len;
+        if (online_ &&
+            memchr(buffer.data() + size - len, '\n', len) != nullptr) {
+          break;
+        }
+      }
+    }
+    total_size += size - remain;
+    if (size == 0) { break; }
+    // Cut the chunk at the last newline
+    uint64 end = size;
+    if (!end_of_file) {
+      while (end > 0 && buffer[end-1] != '\n') { end--; }
+      if (end == 0) {
+        LOG(FATAL) << "Encountered a too-long line. "
+                   << "Please check the data.";
+      }
+    }
+    {
+      ScopedTrace parse_trace("parse chunk", "parser");
+      parser_->Parse(buffer.data(), end, chunk);
+    }
+    if (interleave) {
+      index_t num_row = 0;
+      for (index_t i = 0; i < chunk.row_length; ++i) {
+        num_row += (row_num + i) % num_shards_ == (uint64)shard_;
+      }
+      shard.ReuseMatrix(num_row);
+      index_t row_id = 0;
+      for (index_t i = 0; i < chunk.row_length; ++i) {
+        if ((row_num + i) % num_shards_ == (uint64)shard_) {
+          shard.CopyRows(row_id++, chunk, i, i + 1);
+        }
+      }
+      row_num += chunk.row_length;
+    }
+    if (!fn(interleave ? shard : chunk)) { break; }
+    remain = size - end;
+    memmove(buffer.data(), buffer.data() + end, remain);
+    if (end_of_file) { break; }
+  }
+  if (!is_stdin) { delete stream; }
+  return total_size;
+}
+
+int Reader::thread_number() const {
+  if (thread_number_ > 0) { return thread_number_; }
+  return AvailableCpus();
+}
+
+// The cache of the hashed features has other hash values
+static uint64 mix_bucket(uint64 hash, index_t num_bucket) {
+  if (num_bucket > 0) {
+    hash ^= (num_bucket + 0x9e3779b97f4a7c15ULL) * 0xff51afd7ed558ccdULL;
+  }
+  return hash;
+}
+
+// The cache of the sorted rows has other hash values too
+static uint64 mix_sort(uint64 hash, bool sort_rows) {
+  if (sort_rows) {
+    hash = (hash ^ 0x736f7274726f7773ULL) * 0xc4ceb9fe1a85ec53ULL;
+  }
+  return hash;
+}
+
+// And the cache of the field groups
+static uint64 mix_groups(uint64 hash, const FieldGroups& groups) {
+  if (!groups.Empty()) {
+    hash = (hash ^ groups.Hash()) * 0xff51afd7ed558ccdULL;
+  }
+  return hash;
+}
+
+// And the cache of the crosses
+static uint64 mix_crosses(uint64 hash,
+                          const std::vector<FieldCross>& crosses) {
+  for (size_t c = 0; c < crosses.size(); ++c) {
+    hash = (hash ^ HashCross(c, crosses[c].first, crosses[c].second)) *
+           0xff51afd7ed558ccdULL;
+  }
+  return hash;
+}
+
+// And the cache of the ids mapped by the admission filter
+static uint64 mix_admission(uint64 hash, const AdmissionFilter* filter) {
+  if (filter != nullptr) {
+    hash = (hash ^ filter->Fingerprint()) * 0xff51afd7ed558ccdULL;
+  }
+  return hash;
+}
+
+// And the cache of the dense block
+static uint64 mix_dense(uint64 hash, bool dense) {
+  if (dense) {
+    hash = (hash ^ 0x64656e7365626c6bULL) * 0xc4ceb9fe1a85ec53ULL;
+  }
+  return hash;
+}
+
+uint64 Reader::file_hash_1() {
+  if (hash_file_1_ != filename_) {
+    uint64 key = 0;
+    if (cache_dir_.empty()) {
+      key = FingerprintFile(filename_);
+    } else {
+      key = CacheDir(cache_dir_, cache_bytes_).ContentKey(filename_);
+    }
+    hash_1_ = mix_sort(mix_bucket(key, hash_bucket_), sort_rows_);
+    hash_1_ = mix_dense(mix_groups(hash_1_, field_groups_), dense_);
+    hash_1_ = mix_admission(hash_1_, admission_);
+    hash_1_ = mix_crosses(hash_1_, crosses_);
+    hash_file_1_ = filename_;
+  }
+  return hash_1_;
+}
+
+uint64 Reader::file_hash_2() {
+  if (!full_hash_) { return 0; }
+  if (hash_file_2_ != filename_) {
+    hash_2_ = mix_sort(mix_bucket(HashFile(filename_, false), hash_bucket_),
+                       sort_rows_);
+    hash_2_ = mix_dense(mix_groups(hash_2_, field_groups_), dense_);
+    hash_2_ = mix_admission(hash_2_, admission_);
+    hash_2_ = mix_crosses(hash_2_, crosses_);
+    hash_file_2_ = filename_;
   }
-  printf("[Error] Unknow file format \n");
-  exit(0);
+  return hash_2_;
+}
+
+// Check whether the cache_file is generated from current txt file
+// We use double check here. We first check the fingerprint of
+// the file, then check the all file if full_hash_ is set. At
+// last, we check the version of the cache file.
+bool Reader::check_cache(const std::string& cache_file, uint64 magic) {
+  // If the cache file does not exists, return false
+  if (!FileExist(cache_file.c_str())) { return false; }
+  FILE* file = OpenFileOrDie(cache_file.c_str(), "r");
+  // Check the first hash value
+  uint64 hash_1 = 0;
+  ReadDataFromDisk(file, (char*)&hash_1, sizeof(hash_1));
+  if (hash_1 != file_hash_1()) {
+    Close(file);
+    return false;
+  }
+  // Check the second hash value
+  uint64 hash_2 = 0;
+  ReadDataFromDisk(file, (char*)&hash_2, sizeof(hash_2));
+  if (full_hash_ && hash_2 != file_hash_2()) {
+    Close(file);
+    return false;
+  }
+  // Check the version of cache file
+  uint64 cache_magic = 0;
+  ReadDataFromDisk(file, (char*)&cache_magic, sizeof(cache_magic));
+  Close(file);
+  return cache_magic == magic;
 }
 
 //------------------------------------------------------------------------------
 // Implementation of InmemReader
 //------------------------------------------------------------------------------
 
+// Number of rows in each block of the block-compressed cache
+static const index_t kCacheBlockRows = 64 * 1024;
+
+// The range of the txt file covered by its binary file, which
+// is stored in <file>.bin.range. The hash_value_1 is the one of
+// the binary file, so the record is ignored if the binary file
+// is re-generated without it
+const uint64 kRangeMagic = 0x31474e4152584cULL;  /* "XLRANG1" */
+
+struct CacheRange {
+  uint64 magic;
+  uint64 hash_value_1;
+  uint64 text_size;
+  uint64 prefix_hash;
+};
+
+
 // Pre-load all the data into memory buffer (data_buf)
 // Note that this funtion will first check whether we can use
-// the binary file. If not, reader will generate one automatically
+// the binary file. If not, reader will generate one automatically.
+// The data of stdin is parsed without the binary file
 void InmemReader::Initialize(const std::string& filename,
                              int num_samples) {
   CHECK_NE(filename.empty(), true)
   CHECK_GT(num_samples, 0);
   filename_ = filename;
   num_samples_ = num_samples;
+  drop_copies();
+  data_buf_.SetHugePages(huge_pages_);
+  if (IsStdin(filename_)) {
+    // The stdin can be read only once, so it is
+    // parsed without the binary file
+    printf("Read the text data from stdin \n");
+    init_from_txt();
+    stats_ = data_buf_.GetStats();
+  } else {
+    init_from_file();
+  }
+  if (neg_sample_ < 1.0) { downsample_negatives(); }
+  if (dedup_) { dedup_rows(); }
+  if (row_weight_ != 1.0) { scale_weights(); }
+  if (feature_map_ != nullptr) {
+    if (feature_map_->IsCounting()) {
+      feature_map_->Count(data_buf_);
+    } else {
+      RemapFeatures();
+    }
+  }
+  if (group_chunks_ > 1) { group_rows(); }
+  data_buf_.DetectBinary();
+}
+
+// The rows of the caller are used in place, so the options
+// that change the rows (e.g., SetDedup()) are not used
+void InmemReader::InitializeRows(const Node* node,
+                                 const uint64* offset,
+                                 const real_t* label,
+                                 index_t length,
+                                 int num_samples) {
+  CHECK_NOTNULL(label);
+  CHECK_GT(num_samples, 0);
+  filename_ = "<memory>";
+  num_samples_ = num_samples;
+  drop_copies();
+  data_samples_.SetCSR(true);
+  data_samples_.ResetMatrix(num_samples_);
+  data_buf_.Release();
+  data_buf_.SetCompact(false);
+  data_buf_.SetCSR(true);
+  data_buf_.SetExternal(node, offset, length);
+  for (index_t i = 0; i < length; ++i) {
+    data_buf_.Y[i] = label[i];
+    real_t sum = 0;
+    for (uint64 j = offset[i]; j < offset[i+1]; ++j) {
+      sum += node[j].feat_val * node[j].feat_val;
+    }
+    data_buf_.norm[i] = 1.0f / sum;
+  }
+  stats_ = data_buf_.GetStats();
+  order_.resize(length);
+  for (index_t i = 0; i < length; ++i) { order_[i] = i; }
+  pos_ = 0;
+  if (group_chunks_ > 1) { group_rows(); }
+  data_buf_.DetectBinary();
+}
+
+// Check whether we can use the binary file of the txt file
+void InmemReader::init_from_file() {
   printf("First check if the text file (%s) has been already "
-         "converted to binary format \n", filename.c_str());
+         "converted to binary format \n", filename_.c_str());
   // HashBinary() will read the first two hash value
   // and then check it whether equal to the hash value generated
   // by HashFile() function from current txt file
-  if (hash_binary(filename_)) {
+  if (hash_binary()) {
     printf("Binary file found. Skip converting text to binary \n");
-    filename_ += ".bin";
+    filename_ = cache_file();
     init_from_binary();
+    if (num_shards_ > 1) {
+      keep_shard();
+    } else {
+      read_stats(filename_);
+    }
+    return;
+  }
+  if (num_shards_ > 1) {
+    // The shard is parsed without any binary file
+    printf("Binary file NOT found. Parse the shard %d of %d "
+           "of the text file \n", shard_, num_shards_);
+    init_from_txt();
+    stats_ = data_buf_.GetStats();
+    return;
+  }
+  uint64 text_size = 0;
+  if (check_append(&text_size)) {
+    printf("Binary file covers the first %llu bytes of the text file. "
+           "Parse the appended data only \n",
+           (unsigned long long)text_size);
+    init_from_append(text_size);
   } else {
     printf("Binary file NOT found. Convert text "
            "file to binary file \n");
     init_from_txt();
   }
+  read_stats(cache_file());
 }
 
-// Check wheter current path has a binary file
-// We use double check here. We first check a the hash value
-// of a small data block, then check the all file.
-bool InmemReader::hash_binary(const std::string& filename) {
+// The dense rows replace data_buf_, which may be a view of
+// the mapped binary file, and the statistics are re-computed
+void InmemReader::RemapFeatures() {
+  CHECK_NOTNULL(feature_map_);
+  drop_copies();
+  DMatrix dense;
+  dense.SetCSR(true);
+  dense.SetCompact(compact_);
+  feature_map_->Remap(data_buf_, &dense);
+  data_buf_.Release();
+  data_buf_.SetCSR(true);
+  data_buf_.SetCompact(compact_);
+  data_buf_.ResetMatrix(dense.row_length);
+  data_buf_.CopyRows(0, dense);
+  data_buf_.DetectBinary();
+  stats_ = data_buf_.GetStats();
+  printf("  Re-index the features into %d dense ids \n",
+         feature_map_->Size());
+}
+
+// The hot feature of a row is the most frequent of its features in
+// [2, num_row / group_chunks_] rows, and the features in more rows
+// are shared by all the threads anyway. A row without such a feature
+// is in group 0. The counts are by the hashed ids of the features
+void InmemReader::group_rows() {
+  const DMatrix& data = data_buf_;
+  index_t num_row = data.row_length;
+  uint32 max_count = num_row / group_chunks_;
+  std::vector<uint32> count;
+  std::vector<Node> nodes;
+  // The nodes of the row, which are decoded if it is compact
+  auto get_row = [&](index_t i) -> RowView {
+    if (!data.is_compact) { return data.GetRow(i); }
+    const char* bytes = nullptr;
+    uint64 size = 0;
+    data.RowData(i, &bytes, &size);
+    nodes.clear();
+    DecodeCompactRow((const uint8*)bytes, (const uint8*)bytes + size,
+                     nodes);
+    return RowView(nodes.data(), nodes.data() + nodes.size());
+  };
+  for (index_t i = 0; i < num_row; ++i) {
+    for (const Node& node : get_row(i)) {
+      if (node.feat_id >= count.size()) {
+        count.resize(node.feat_id + 1, 0);
+      }
+      count[node.feat_id]++;
+    }
+  }
+  row_group_.assign(num_row, 0);
+  index_t num_grouped = 0;
+  for (index_t i = 0; i < num_row; ++i) {
+    uint32 hot_count = 1;
+    index_t hot = 0;
+    for (const Node& node : get_row(i)) {
+      uint32 c = count[node.feat_id];
+      if (c > hot_count && c <= max_count) {
+        hot_count = c;
+        hot = node.feat_id;
+      }
+    }
+    if (hot_count > 1) {
+      // The top bits of the Fibonacci hash, where
+      // 0 is left for the rows without a group
+      row_group_[i] = std::max((hot * 2654435761U) >> 24, 1U);
+      num_grouped++;
+    }
+  }
+  LOG(INFO) << "Group " << num_grouped << " of " << num_row
+            << " rows by their hot features for "
+            << group_chunks_ << " threads";
+}
+
+// The kept rows replace data_buf_ as in RemapFeatures(). The
+// coin of each negative row is drawn by a fixed seed, so the
+// same rows are kept in each run
+void InmemReader::downsample_negatives() {
+  std::mt19937 generator(kNegSampleSeed);
+  std::bernoulli_distribution coin(neg_sample_);
+  index_t num_row = data_buf_.row_length;
+  std::vector<bool> keep(num_row);
+  index_t num_kept = 0;
+  for (index_t i = 0; i < num_row; ++i) {
+    keep[i] = data_buf_.Y[i] > 0 || coin(generator);
+    num_kept += keep[i];
+  }
+  DMatrix kept;
+  kept.SetCSR(true);
+  kept.SetCompact(data_buf_.is_compact);
+  kept.ResetMatrix(num_kept);
+  // The runs of kept rows are copied in one shot
+  index_t row_id = 0;
+  for (index_t i = 0; i < num_row;) {
+    if (!keep[i]) { ++i; continue; }
+    index_t end = i;
+    while (end < num_row && keep[end]) { ++end; }
+    kept.CopyRows(row_id, data_buf_, i, end);
+    row_id += end - i;
+    i = end;
+  }
+  data_buf_.Release();
+  data_buf_.SetCSR(true);
+  data_buf_.SetCompact(kept.is_compact);
+  data_buf_.ResetMatrix(kept.row_length);
+  data_buf_.CopyRows(0, kept);
+  order_.resize(data_buf_.row_length);
+  for (index_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  pos_ = 0;
+  stats_ = data_buf_.GetStats();
+  printf("  Keep %d of %d rows by the negative sampling rate %g \n",
+         num_kept, num_row, neg_sample_);
+  LOG(INFO) << "Negative sampling keeps " << num_kept << " of "
+            << num_row << " rows, rate: " << neg_sample_;
+}
+
+// The weights are allocated by the first row, and the
+// weights of the dedup are scaled as well
+void InmemReader::scale_weights() {
+  for (index_t i = 0; i < data_buf_.row_length; ++i) {
+    data_buf_.SetWeight(i, data_buf_.RowWeight(i) * row_weight_);
+  }
+}
+
+// The rows [n*shard/num_shards, n*(shard+1)/num_shards) replace
+// data_buf_, which is a view of the mapped binary file of all the
+// n rows, so a worker only keeps its shard in memory
+void InmemReader::keep_shard() {
+  index_t num_row = data_buf_.row_length;
+  index_t begin = (uint64)num_row * shard_ / num_shards_;
+  index_t end = (uint64)num_row * (shard_ + 1) / num_shards_;
+  DMatrix kept;
+  kept.SetCSR(true);
+  kept.SetCompact(data_buf_.is_compact);
+  kept.ResetMatrix(end - begin);
+  kept.CopyRows(0, data_buf_, begin, end);
+  data_buf_.Release();
+  data_buf_.SetCSR(true);
+  data_buf_.SetCompact(kept.is_compact);
+  data_buf_.ResetMatrix(kept.row_length);
+  data_buf_.CopyRows(0, kept);
+  order_.resize(data_buf_.row_length);
+  for (index_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  pos_ = 0;
+  stats_ = data_buf_.GetStats();
+  printf("  Keep the rows [%d, %d) of %d rows of the shard %d \n",
+         begin, end, num_row, shard_);
+}
+
+// The rows are hashed by their bytes and label in parallel, and
+// sorted by the hash, so only the rows of equal hash are compared.
+// Each group of equal rows is kept as its first row, in the order
+// of the data buffer, with the sum of the weights of the group
+void InmemReader::dedup_rows() {
+  index_t num_row = data_buf_.row_length;
+  if (num_row == 0) { return; }
+  std::vector<uint64> hash(num_row);
+  ThreadPool* pool = pool_ != nullptr ? pool_ :
+                     Executor::Get(thread_number_, cpus_);
+  pool->ParallelFor(0, num_row, 0,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) {
+        const char* data = nullptr;
+        uint64 size = 0;
+        data_buf_.RowData(i, &data, &size);
+        real_t y = data_buf_.Y[i];
+        uint64 h = HashBuffer(kDedupMagic,
+                              reinterpret_cast<const char*>(&y),
+                              sizeof(y));
+        hash[i] = HashBuffer(h, data, size);
+      }
+    });
+  std::vector<index_t> sorted(num_row);
+  for (index_t i = 0; i < num_row; ++i) { sorted[i] = i; }
+  std::sort(sorted.begin(), sorted.end(),
+    [&hash](index_t a, index_t b) {
+      return hash[a] != hash[b] ? hash[a] < hash[b] : a < b;
+    });
+  // first[i] is the first row that equals the i-th row,
+  // whose weight sums the weights of the equal rows
+  std::vector<index_t> first(num_row);
+  std::vector<double> weight(num_row, 0);
+  for (index_t s = 0; s < num_row;) {
+    index_t e = s + 1;
+    while (e < num_row && hash[sorted[e]] == hash[sorted[s]]) { ++e; }
+    for (index_t j = s; j < e; ++j) {
+      index_t i = sorted[j];
+      const char* data = nullptr;
+      uint64 size = 0;
+      data_buf_.RowData(i, &data, &size);
+      first[i] = i;
+      // The collisions of hash are resolved by the bytes
+      for (index_t k = s; k < j; ++k) {
+        index_t r = sorted[k];
+        if (first[r] != r) { continue; }
+        const char* rdata = nullptr;
+        uint64 rsize = 0;
+        data_buf_.RowData(r, &rdata, &rsize);
+        if (data_buf_.Y[r] == data_buf_.Y[i] && rsize == size &&
+            memcmp(rdata, data, size) == 0) {
+          first[i] = r;
+          break;
+        }
+      }
+      weight[first[i]] += data_buf_.RowWeight(i);
+    }
+    s = e;
+  }
+  index_t num_kept = 0;
+  for (index_t i = 0; i < num_row; ++i) {
+    num_kept += first[i] == i;
+  }
+  if (num_kept == num_row) {
+    printf("  No duplicate row is found in %d rows \n", num_row);
+    return;
+  }
+  DMatrix kept;
+  kept.SetCSR(true);
+  kept.SetCompact(data_buf_.is_compact);
+  kept.ResetMatrix(num_kept);
+  index_t row_id = 0;
+  for (index_t i = 0; i < num_row;) {
+    if (first[i] != i) { ++i; continue; }
+    index_t end = i;
+    while (end < num_row && first[end] == end) { ++end; }
+    kept.CopyRows(row_id, data_buf_, i, end);
+    for (index_t k = i; k < end; ++k) {
+      kept.SetWeight(row_id + k - i, weight[k]);
+    }
+    row_id += end - i;
+    i = end;
+  }
+  data_buf_.Release();
+  data_buf_.SetCSR(true);
+  data_buf_.SetCompact(kept.is_compact);
+  data_buf_.ResetMatrix(kept.row_length);
+  data_buf_.CopyRows(0, kept);
+  order_.resize(data_buf_.row_length);
+  for (index_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  pos_ = 0;
+  stats_ = data_buf_.GetStats();
+  printf("  Collapse %d rows into %d unique rows \n",
+         num_row, num_kept);
+  LOG(INFO) << "Dedup collapses " << num_row << " rows into "
+            << num_kept << " unique rows";
+}
+
+// The data is parsed and serialized as in Initialize(),
+// which finds the binary file in the training
+bool InmemReader::Convert(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  CHECK(!IsStdin(filename));
+  filename_ = filename;
+  num_samples_ = 1;
+  if (hash_binary()) { return false; }
+  uint64 text_size = 0;
+  if (check_append(&text_size)) {
+    init_from_append(text_size);
+  } else {
+    init_from_txt();
+  }
+  data_buf_.Release();
+  order_.clear();
+  return true;
+}
+
+// The bytes of each row besides its nodes, i.e., Y, norm,
+// the offset and the order of samplling
+static const uint64 kRowBytes = 2 * sizeof(real_t) +
+                                sizeof(uint64) + sizeof(index_t);
+// The average bytes of a node of the compact encoding
+static const uint64 kCompactNodeBytes = 4;
+// The first bytes of the txt file that are counted
+static const uint64 kEstimateSample = 4 * 1024 * 1024;
+
+// The stats in the header of the binary file or of the
+// block cache, or false if the file is neither of them
+static bool header_stats(const std::string& filename, DataStats* stats) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  BinaryHeader header;
+  uint64 len = ReadDataFromDisk(file, (char*)&header,
+                                std::min(size, (uint64)sizeof(header)));
+  bool found = false;
+  if (len == sizeof(header) && header.magic == kBinaryMagic) {
+    *stats = header.stats;
+    found = true;
+  } else if (len >= sizeof(BlockCacheHeader) &&
+             header.magic == kBlockCacheMagic) {
+    BlockCacheHeader cache_header;
+    fseek(file, 0, SEEK_SET);
+    ReadDataFromDisk(file, (char*)&cache_header, sizeof(cache_header));
+    *stats = cache_header.stats;
+    found = true;
+  }
+  Close(file);
+  return found;
+}
+
+// True if the size of the binary file or of the block cache is
+// the one given by its header and index, and false if the file is
+// truncated, e.g., the writer is killed, or it has another magic
+static bool cache_intact(const std::string& filename, uint64 magic) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  bool intact = false;
+  if (magic == kBinaryMagic && size >= sizeof(BinaryHeader)) {
+    BinaryHeader header;
+    ReadDataFromDisk(file, (char*)&header, sizeof(header));
+    intact = header.magic == magic &&
+             DMatrix::BinarySize(header) == size;
+  } else if (magic == kBlockCacheMagic &&
+             size >= sizeof(BlockCacheHeader)) {
+    BlockCacheHeader header;
+    ReadDataFromDisk(file, (char*)&header, sizeof(header));
+    intact = header.magic == magic &&
+             header.num_block <= (size - sizeof(header)) /
+                                 sizeof(BlockIndex);
+    std::vector<BlockIndex> index(intact ? header.num_block : 0);
+    if (!index.empty()) {
+      ReadDataFromDisk(file, (char*)index.data(),
+                       sizeof(BlockIndex) * index.size());
+    }
+    uint64 num_row = 0;
+    for (size_t i = 0; i < index.size(); ++i) {
+      if (index[i].offset + index[i].comp_size > size) { intact = false; }
+      num_row += index[i].num_row;
+    }
+    intact = intact && num_row == header.num_row;
+  }
+  Close(file);
+  return intact;
+}
+
+bool InmemReader::EstimateMemory(const std::string& filename,
+                                 bool compact,
+                                 uint64* bytes) {
+  CHECK_NOTNULL(bytes);
+  if (IsStdin(filename) || IsCompressedFile(filename)) { return false; }
+  uint64 node_bytes = compact ? kCompactNodeBytes : sizeof(Node);
+  DataStats stats;
   std::string bin_file = filename + ".bin";
-  // If the ".bin" file does not exists, return false
-  if (!FileExist(bin_file.c_str())) { return false; }
-  FILE* file = OpenFileOrDie(bin_file.c_str(), "r");
-  // Check the first hash value
-  uint64 hash_1 = 0;
-  ReadDataFromDisk(file, (char*)&hash_1, sizeof(hash_1));
-  if (hash_1 != HashFile(filename, true)) {
-    Close(file);
-    return false;
+  if (header_stats(filename, &stats) ||
+      (FileExist(bin_file.c_str()) && header_stats(bin_file, &stats))) {
+    *bytes = stats.num_row * kRowBytes + stats.num_node * node_bytes;
+    return true;
   }
-  // Check the second hash value
-  uint64 hash_2 = 0;
-  ReadDataFromDisk(file, (char*)&hash_2, sizeof(hash_2));
-  if (hash_2 != HashFile(filename, false)) {
-    Close(file);
+  // Each line is a row, and the tokens of a row are its
+  // label and its nodes
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  std::vector<char> buffer(std::min(size, kEstimateSample));
+  uint64 len = ReadDataFromDisk(file, buffer.data(), buffer.size());
+  Close(file);
+  if (len < size) {
+    // Drop the last partial line
+    while (len > 0 && buffer[len-1] != '\n') { len--; }
+  }
+  uint64 num_line = 0, num_token = 0, line_token = 0;
+  bool in_token = false;
+  for (uint64 i = 0; i <= len; ++i) {
+    char c = i < len ? buffer[i] : '\n';
+    if (c != ' ' && c != '\t' && c != ',' && c != '\r' && c != '\n') {
+      if (!in_token) { line_token++; }
+      in_token = true;
+      continue;
+    }
+    in_token = false;
+    // The empty lines are not rows
+    if (c == '\n' && line_token > 0) {
+      num_line++;
+      num_token += line_token;
+      line_token = 0;
+    }
+  }
+  if (num_line == 0) {
+    *bytes = 0;
+    return true;
+  }
+  double scale = (double)size / len;
+  double num_row = num_line * scale;
+  double num_node = (num_token - num_line) * scale;
+  // The parsed chunks and the rows of the buffer are both
+  // in memory at the end of parsing
+  *bytes = 2 * (uint64)(num_row * kRowBytes + num_node * node_bytes);
+  return true;
+}
+
+// The cache of the directory is named by the content key
+// and the magic number of current format
+std::string InmemReader::cache_file() {
+  if (cache_dir_.empty()) { return filename_ + ".bin"; }
+  return CacheDir(cache_dir_, cache_bytes_).Path(
+      file_hash_1(), compress_ ? kBlockCacheMagic : kBinaryMagic);
+}
+
+// Check wheter current path has a binary file
+bool InmemReader::hash_binary() {
+  // The cache is re-generated if it is not written
+  // in the format of current option
+  std::string bin_file = cache_file();
+  uint64 magic = compress_ ? kBlockCacheMagic : kBinaryMagic;
+  if (!check_cache(bin_file, magic)) { return false; }
+  // The truncated cache is stale, and it is re-generated
+  if (!cache_intact(bin_file, magic)) {
+    printf("[Warning] The binary file %s is truncated, and it "
+           "is converted again \n", bin_file.c_str());
+    LOG(WARNING) << "The binary file " << bin_file << " is truncated";
     return false;
   }
-  Close(file);
+  if (!cache_dir_.empty()) {
+    CacheDir(cache_dir_, cache_bytes_).Touch(bin_file);
+  }
   return true;
 }
 
@@ -132,11 +1079,22 @@ void InmemReader::init_from_binary() {
   /*********************************************************
    *  Step 1: Init data_samples_                           *
    *********************************************************/
+  data_samples_.SetCSR(true);
   data_samples_.ResetMatrix(num_samples_);
   /*********************************************************
    *  Step 2: Init data_buf_                               *
    *********************************************************/
-  data_buf_.Deserialize(filename_);
+  // Map the binary file into memory. The data_buf_ is a
+  // read-only view of the file and we don't copy any row.
+  // The block-compressed cache is decoded in multi-thread
+  ScopedPhase phase("load cache");
+  if (compress_) {
+    BlockCache cache;
+    cache.Open(filename_);
+    cache.ReadAll(&data_buf_, thread_number(), cpus_, pool_);
+  } else {
+    data_buf_.MmapDeserialize(filename_);
+  }
   /*********************************************************
    *  Step 3: Init order_                                  *
    *********************************************************/
@@ -151,22 +1109,41 @@ void InmemReader::init_from_txt() {
   /*********************************************************
    *  Step 1: Init data_samples_                           *
    *********************************************************/
+  data_samples_.SetCSR(true);
   data_samples_.ResetMatrix(num_samples_);
   /*********************************************************
    *  Step 2: Init parser_                                 *
    *********************************************************/
-  parser_ = CreateParser(check_file_format().c_str());
-  if (has_label_) parser_->setLabel(true);
-  else parser_->setLabel(false);
+  init_parser();
   /*********************************************************
    *  Step 3: Init data_buf_                               *
    *********************************************************/
-  char* buffer = nullptr;
-  uint64 file_size = ReadFileToMemory(filename_, &buffer);
-  printf("%s", PrintSize(file_size).c_str());
-  parser_->Parse(buffer, file_size, data_buf_);
-  data_buf_.SetHash(HashFile(filename_, true),
-                    HashFile(filename_, false));
+  data_buf_.SetCSR(true);
+  data_buf_.SetCompact(compact_);
+  // Only the plain txt file can be appended. The shard
+  // is read by its stream (see parse_stream())
+  uint64 text_size = 0;
+  ScopedPhase parse("parse");
+  if (IsStdin(filename_) || IsCompressedFile(filename_) ||
+      num_shards_ > 1) {
+    printf("%s", PrintSize(read_stream()).c_str());
+  } else {
+    // The txt file is mapped and read once in order, and
+    // the parsed pages are released, so the peak memory
+    // is about the parsed data instead of the txt file
+    char* buffer = nullptr;
+    uint64 file_size = MapFileToMemory(filename_, &buffer);
+    AdviseMemory(buffer, file_size, MADV_SEQUENTIAL);
+    printf("%s", PrintSize(file_size).c_str());
+    parser_->setMappedInput(true);
+    parser_->Parse(buffer, file_size, data_buf_);
+    UnmapFile(buffer, file_size);
+    text_size = file_size;
+  }
+  if (!IsStdin(filename_)) {
+    data_buf_.SetHash(file_hash_1(), file_hash_2());
+  }
+  parse_time_ = parse.Stop();
   /*********************************************************
    *  Step 4: order_                                       *
    *********************************************************/
@@ -177,61 +1154,1242 @@ void InmemReader::init_from_txt() {
   /*********************************************************
    *  Step 5: Deserialize in-memory buffer to disk file    *
    *********************************************************/
-  std::string bin_file = filename_ + ".bin";
+  // The shard is only a part of the txt file
+  if (IsStdin(filename_) || num_shards_ > 1) { return; }
+  std::string bin_file = cache_file();
+  ScopedPhase cache("write cache");
   this->serialize_buffer(bin_file);
+  if (text_size > 0 && cache_dir_.empty()) { write_range(text_size); }
+  cache_time_ = cache.Stop();
+}
+
+bool InmemReader::check_append(uint64* text_size) {
+  CHECK_NOTNULL(text_size);
+  if (full_hash_ || !cache_dir_.empty() ||
+      IsCompressedFile(filename_)) {
+    return false;
+  }
+  std::string bin_file = filename_ + ".bin";
+  std::string range_file = bin_file + ".range";
+  if (!FileExist(bin_file.c_str()) ||
+      !FileExist(range_file.c_str())) {
+    return false;
+  }
+  CacheRange range;
+  FILE* file = OpenFileOrDie(range_file.c_str(), "r");
+  ReadDataFromDisk(file, (char*)&range, sizeof(range));
+  Close(file);
+  if (range.magic != kRangeMagic) { return false; }
+  // The hash values and the magic number of binary file
+  uint64 head[3];
+  file = OpenFileOrDie(bin_file.c_str(), "r");
+  ReadDataFromDisk(file, (char*)head, sizeof(head));
+  Close(file);
+  if (head[0] != range.hash_value_1 ||
+      head[2] != (compress_ ? kBlockCacheMagic : kBinaryMagic) ||
+      !cache_intact(bin_file, head[2])) {
+    return false;
+  }
+  // The covered head is not changed, and the
+  // appended data starts at a new line
+  file = OpenFileOrDie(filename_.c_str(), "r");
+  uint64 file_size = GetFileSize(file);
+  char last = 0;
+  if (file_size > range.text_size && range.text_size > 0 &&
+      fseek(file, range.text_size - 1, SEEK_SET) == 0) {
+    ReadDataFromDisk(file, &last, 1);
+  }
+  Close(file);
+  if (last != '\n') { return false; }
+  uint64 prefix_hash = mix_bucket(FingerprintPrefix(filename_,
+                                  range.text_size), hash_bucket_);
+  if (prefix_hash != range.prefix_hash) { return false; }
+  *text_size = range.text_size;
+  return true;
+}
+
+// The raw binary file is re-written from the whole data buffer,
+// and the block-compressed one appends the blocks of the tail
+void InmemReader::init_from_append(uint64 text_size) {
+  data_samples_.SetCSR(true);
+  data_samples_.ResetMatrix(num_samples_);
+  init_parser();
+  std::string bin_file = filename_ + ".bin";
+  /*********************************************************
+   *  Step 1: Load the rows of binary file                 *
+   *********************************************************/
+  DMatrix head;
+  if (compress_) {
+    BlockCache cache;
+    cache.Open(bin_file);
+    cache.ReadAll(&head, thread_number(), cpus_, pool_);
+  } else {
+    head.MmapDeserialize(bin_file);
+  }
+  /*********************************************************
+   *  Step 2: Parse the appended data                      *
+   *********************************************************/
+  DMatrix tail;
+  tail.SetCSR(true);
+  tail.SetCompact(head.is_compact);
+  char* buffer = nullptr;
+  uint64 file_size = MapFileToMemory(filename_, &buffer);
+  printf("%s", PrintSize(file_size - text_size).c_str());
+  parser_->setMappedInput(true);
+  parser_->Parse(buffer + text_size, file_size - text_size, tail);
+  UnmapFile(buffer, file_size);
+  tail.SetHash(file_hash_1(), file_hash_2());
+  /*********************************************************
+   *  Step 3: Init data_buf_ and order_                    *
+   *********************************************************/
+  data_buf_.Release();
+  data_buf_.SetCSR(true);
+  data_buf_.SetCompact(head.is_compact);
+  data_buf_.ResetMatrix(head.row_length + tail.row_length);
+  data_buf_.Reserve((head.DataSize() + tail.DataSize()) /
+                    (head.is_compact ? 2 : sizeof(Node)));
+  data_buf_.CopyRows(0, head);
+  data_buf_.CopyRows(head.row_length, tail);
+  data_buf_.SetHash(file_hash_1(), file_hash_2());
+  head.Release();
+  order_.resize(data_buf_.row_length);
+  for (int i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
   /*********************************************************
-   *  Step 6: Finalize                                     *
+   *  Step 4: Update the binary file                       *
    *********************************************************/
-  delete [] buffer;
+  if (compress_) {
+    BlockCache::Append(bin_file, tail, kCacheBlockRows);
+  } else {
+    data_buf_.Serialize(bin_file);
+  }
+  write_range(file_size);
+}
+
+void InmemReader::write_range(uint64 text_size) {
+  CacheRange range;
+  range.magic = kRangeMagic;
+  range.hash_value_1 = file_hash_1();
+  range.text_size = text_size;
+  range.prefix_hash = mix_bucket(FingerprintPrefix(filename_, text_size),
+                                 hash_bucket_);
+  std::string range_file = filename_ + ".bin.range";
+  FILE* file = OpenFileOrDie(range_file.c_str(), "w");
+  WriteDataToDisk(file, (char*)&range, sizeof(range));
+  Close(file);
+}
+
+// The compressed file (or stdin) is decompressed and parsed
+// chunk by chunk, and all the chunks are copied into data_buf_
+uint64 InmemReader::read_stream() {
+  std::vector<DMatrix*> chunk_list;
+  index_t line_num = 0;
+  uint64 data_size = 0;
+  uint64 file_size = parse_stream(compact_, [&](const DMatrix& chunk) {
+    DMatrix* copy = new DMatrix();
+    copy->SetCSR(true);
+    copy->SetCompact(compact_);
+    copy->ResetMatrix(chunk.row_length);
+    copy->CopyRows(0, chunk);
+    line_num += chunk.row_length;
+    data_size += chunk.DataSize();
+    chunk_list.push_back(copy);
+    return true;
+  });
+  data_buf_.ResetMatrix(line_num);
+  data_buf_.Reserve(data_size / (compact_ ? 2 : sizeof(Node)));
+  index_t row_id = 0;
+  for (size_t i = 0; i < chunk_list.size(); ++i) {
+    data_buf_.CopyRows(row_id, *chunk_list[i]);
+    row_id += chunk_list[i]->row_length;
+    delete chunk_list[i];
+  }
+  return file_size;
+}
+
+// Return true if the count ids from pos are the contiguous
+// rows of the data buffer
+static bool contiguous_ids(const std::vector<index_t>& ids,
+                           size_t pos, size_t count) {
+  for (size_t i = 1; i < count; ++i) {
+    if (ids[pos+i] != ids[pos] + i) { return false; }
+  }
+  return true;
 }
 
 // Smaple data from memory buffer.
+// The sampled rows are copied into the contiguous CSR
+// storage of data_samples_, so that the rows of one batch
+// are adjacent in memory. The compact rows of data_buf_
+// will be decoded during the copy. If the rows of the batch
+// are already adjacent in the buffer, i.e., the rows of the
+// shuffled copy or of the unshuffled order_, data_samples_
+// is a view of them instead (see DMatrix::SetView())
 int InmemReader::Samples(DMatrix* &matrix, bool shuffle) {
+  // The first epoch reads the rows in order_, while the
+  // copy of the second epoch is written
+  if (shuffle_copy_ && shuffle && copy_ids_[cur_copy_].empty() &&
+      !copier_.joinable()) {
+    start_copy();
+  }
+  const std::vector<index_t>& ids = copy_ids_[cur_copy_].empty() ?
+                                    order_ : copy_ids_[cur_copy_];
+  const DMatrix& data = copy_ids_[cur_copy_].empty() ?
+                        buffer() : copy_buf_[cur_copy_];
+  bool in_copy = &ids != &order_;
+  size_t count = std::min((size_t)num_samples_,
+                          ids.size() - std::min((size_t)pos_, ids.size()));
+  const std::vector<uint8>& groups = row_groups();
+  if (count > 0 && row_prob_.empty() && !data.is_compact &&
+      groups.empty() && (in_copy || contiguous_ids(ids, pos_, count))) {
+    index_t begin = in_copy ? pos_ : ids[pos_];
+    data_samples_.SetView(data, begin, begin + count);
+    sample_ids_.assign(ids.begin() + pos_, ids.begin() + pos_ + count);
+    pos_ += count;
+    prepare_order(shuffle);
+    data_samples_.ComputeRowCost(row_cost_);
+    matrix = &data_samples_;
+    return count;
+  }
   int num_line = 0;
-  for (int i = 0; i < num_samples_; ++i) {
-    if (pos_ >= data_buf_.row_length) {
+  data_samples_.ReuseMatrix(num_samples_);
+  sample_ids_.resize(num_samples_);
+  batch_src_.resize(num_samples_);
+  batch_ids_.resize(num_samples_);
+  std::uniform_real_distribution<real_t> coin(0, 1);
+  while (num_line < num_samples_) {
+    if (pos_ >= ids.size()) {
       // End of the data buffer
-      if (i == 0 && shuffle) {
-        random_shuffle(order_.begin(), order_.end());
+      if (num_line == 0 && shuffle) {
+        if (shuffle_copy_) {
+          wait_copy();
+          cur_copy_ = 1 - cur_copy_;
+          start_copy();
+        } else {
+          // The next order is usually shuffled during the
+          // last batch (see prepare_order())
+          if (!shuffler_.joinable()) { start_shuffle(); }
+          wait_shuffle();
+          order_.swap(next_order_);
+          shuffle_rng_ = next_rng_;
+        }
         matrix = nullptr;
         return 0;
       }
       break;
     }
-    // Copy data between different DMatrix.
-    data_samples_.row[i] = data_buf_.row[order_[pos_]];
-    data_samples_.Y[i] = data_buf_.Y[order_[pos_]];
-    data_samples_.norm[i] = data_buf_.norm[order_[pos_]];
-    pos_++;
+    index_t pos = pos_++;
+    index_t id = ids[pos];
+    if (!row_prob_.empty() && coin(row_coin_) >= row_prob_[id]) {
+      continue;
+    }
+    // The rows of the shuffled copy are read in sequence
+    batch_src_[num_line] = in_copy ? pos : id;
+    batch_ids_[num_line] = id;
     num_line++;
   }
+  // The rows of a group are adjacent in the batch, in their
+  // sampled order (a counting sort by the group), and the
+  // sample_ids_ keeps the order until the rows are copied
+  if (!groups.empty()) {
+    index_t start[257] = { 0 };
+    for (int i = 0; i < num_line; ++i) {
+      start[groups[batch_ids_[i]] + 1]++;
+    }
+    for (int g = 0; g < 256; ++g) { start[g+1] += start[g]; }
+    for (int i = 0; i < num_line; ++i) {
+      sample_ids_[start[groups[batch_ids_[i]]]++] = i;
+    }
+  } else {
+    for (int i = 0; i < num_line; ++i) { sample_ids_[i] = i; }
+  }
+  // Copy data between different DMatrix
+  for (int i = 0; i < num_line; ++i) {
+    index_t k = sample_ids_[i];
+    data_samples_.CopyRow(i, data, batch_src_[k]);
+    if (!row_prob_.empty()) {
+      index_t id = batch_ids_[k];
+      data_samples_.SetWeight(i, data_samples_.RowWeight(i) /
+                                 row_prob_[id]);
+    }
+  }
+  for (int i = 0; i < num_line; ++i) {
+    sample_ids_[i] = batch_ids_[sample_ids_[i]];
+  }
   data_samples_.row_length = num_line;
+  data_samples_.is_binary = data.is_binary;
+  prepare_order(shuffle);
+  data_samples_.ComputeRowCost(row_cost_);
   matrix = &data_samples_;
   return num_line;
 }
 
+// The last batch of the epoch starts the shuffle of
+// the next order, while the batch is being trained
+void InmemReader::prepare_order(bool shuffle) {
+  if (shuffle && !shuffle_copy_ && pos_ >= order_.size() &&
+      !shuffler_.joinable()) {
+    start_shuffle();
+  }
+}
+
+// The shuffler_ only reads order_ and writes next_order_ and
+// next_rng_, and shuffle_rng_ is advanced after the swap, so the
+// state saved during the shuffle is the state before it
+void InmemReader::start_shuffle() {
+  next_rng_ = shuffle_rng_;
+  ThreadPool* pool = pool_ != nullptr ? pool_ :
+                     Executor::Get(thread_number_, cpus_);
+  shuffler_ = std::thread([this, pool]() {
+    if (shuffle_block_ > 0) {
+      next_order_ = order_;
+      shuffle_blocks(&next_order_, shuffle_block_, &next_rng_);
+    } else {
+      uint64 seed = next_rng_();
+      seed = (seed << 32) | next_rng_();
+      parallel_shuffle(order_, &next_order_, seed, pool);
+    }
+  });
+}
+
+void InmemReader::wait_shuffle() {
+  if (shuffler_.joinable()) { shuffler_.join(); }
+}
+
 // Return to the begining of the data buffer.
 void InmemReader::Reset() { pos_ = 0; }
 
-// Serialize DMatrix to a binary file
+// The state is the position, the number of rows and the order,
+// followed by the generator of the shuffle in its text form
+bool InmemReader::SaveState(std::string* state) const {
+  CHECK_NOTNULL(state);
+  if (shuffle_copy_ || !row_prob_.empty()) { return false; }
+  std::ostringstream os;
+  uint64 size = order_.size();
+  os.write((const char*)&pos_, sizeof(pos_));
+  os.write((const char*)&size, sizeof(size));
+  os.write((const char*)order_.data(), size * sizeof(index_t));
+  os << shuffle_rng_;
+  *state = os.str();
+  return true;
+}
+
+bool InmemReader::LoadState(const std::string& state) {
+  if (shuffle_copy_ || !row_prob_.empty()) { return false; }
+  std::istringstream is(state);
+  index_t pos = 0;
+  uint64 size = 0;
+  is.read((char*)&pos, sizeof(pos));
+  is.read((char*)&size, sizeof(size));
+  if (!is || size != order_.size() || pos > size) { return false; }
+  std::vector<index_t> order(size);
+  is.read((char*)order.data(), size * sizeof(index_t));
+  std::mt19937 rng;
+  is >> rng;
+  if (!is) { return false; }
+  // The next order of the current order is dropped
+  wait_shuffle();
+  // The order is a permutation of the same rows
+  std::vector<index_t> sorted(order);
+  std::vector<index_t> rows(order_);
+  std::sort(sorted.begin(), sorted.end());
+  std::sort(rows.begin(), rows.end());
+  if (sorted != rows) { return false; }
+  order_.swap(order);
+  pos_ = pos;
+  shuffle_rng_ = rng;
+  return true;
+}
+
+// The copy reuses the memory of the copy of two epochs
+// ago, and the rows are copied in one shot each
+void InmemReader::start_copy() {
+  int next = 1 - cur_copy_;
+  copy_ids_[next] = order_;
+  std::mt19937 rng(rand());
+  copier_ = std::thread([this, next, rng]() mutable {
+    const DMatrix& src = buffer();
+    DMatrix& copy = copy_buf_[next];
+    std::vector<index_t>& ids = copy_ids_[next];
+    if (shuffle_block_ > 0) {
+      shuffle_blocks(&ids, shuffle_block_, &rng);
+    } else {
+      std::shuffle(ids.begin(), ids.end(), rng);
+    }
+    if (copy.row_length == 0) {
+      copy.SetCSR(true);
+      copy.SetCompact(src.is_compact);
+      copy.SetDenseWidth(src.dense_width);
+    }
+    copy.ReuseMatrix(ids.size());
+    for (index_t i = 0; i < ids.size(); ++i) {
+      copy.CopyRows(i, src, ids[i], ids[i] + 1);
+    }
+    copy.is_binary = src.is_binary;
+  });
+}
+
+void InmemReader::wait_copy() {
+  if (copier_.joinable()) { copier_.join(); }
+}
+
+void InmemReader::drop_copies() {
+  wait_copy();
+  wait_shuffle();
+  for (int i = 0; i < 2; ++i) {
+    copy_buf_[i].Release();
+    copy_ids_[i].clear();
+  }
+  cur_copy_ = 0;
+}
+
+// The fold only keeps the order of its rows, and the
+// statistics are computed from the rows of the source
+void FoldReader::Initialize(const std::string& filename,
+                            int num_samples) {
+  CHECK_NE(filename.empty(), true)
+  CHECK_GT(num_samples, 0);
+  filename_ = filename;
+  num_samples_ = num_samples;
+  data_samples_.SetCSR(true);
+  data_samples_.ResetMatrix(num_samples_);
+  const DMatrix& data = source_->Data();
+  index_t begin = (uint64)data.row_length * fold_ / num_folds_;
+  index_t end = (uint64)data.row_length * (fold_ + 1) / num_folds_;
+  order_.resize(end - begin);
+  for (index_t i = 0; i < order_.size(); ++i) {
+    order_[i] = begin + i;
+  }
+  stats_ = data.GetStats(begin, end);
+  pos_ = 0;
+}
+
+// Serialize DMatrix to a binary file, which is written into a
+// temporary file first, so another job (or a crash) never sees
+// a partial binary file
 void InmemReader::serialize_buffer(const std::string& filename) {
-  data_buf_.Serialize(filename);
+  std::string temp = CacheDir::TempPath(filename);
+  if (compress_) {
+    BlockCache::Write(temp, data_buf_, kCacheBlockRows);
+  } else {
+    data_buf_.Serialize(temp);
+  }
+  CacheDir::Commit(temp, filename);
+  if (!cache_dir_.empty()) {
+    CacheDir(cache_dir_, cache_bytes_).Evict(filename);
+  }
+}
+
+// The statistics are stored in the header of both the
+// raw binary file and the block-compressed binary file
+void InmemReader::read_stats(const std::string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  if (compress_) {
+    BlockCacheHeader header;
+    ReadDataFromDisk(file, (char*)&header, sizeof(header));
+    CHECK_EQ(header.magic, kBlockCacheMagic);
+    stats_ = header.stats;
+  } else {
+    BinaryHeader header;
+    ReadDataFromDisk(file, (char*)&header, sizeof(header));
+    CHECK_EQ(header.magic, kBinaryMagic);
+    stats_ = header.stats;
+  }
+  Close(file);
 }
 
 //------------------------------------------------------------------------------
 // Implementation of OndiskReader.
 //------------------------------------------------------------------------------
 
+// The binary file of OndiskReader starts with two hash values of the txt
+// file, the magic number, num_samples and the statistics of the dataset,
+// followed by the DMatrix blocks
+const uint64 kDiskMagic = 0x334b534944584cULL;  /* "XLDISK3" */
+
+struct DiskHeader {
+  uint64 hash_value_1;
+  uint64 hash_value_2;
+  uint64 magic;
+  uint64 num_samples;
+  DataStats stats;
+};
+
+OndiskReader::~OndiskReader() {
+  stop_prefetch();
+  if (file_ != nullptr) {
+    Close(file_);
+  }
+  delete block_file_;
+}
+
+// Convert the txt file into a binary file if the binary
+// file does not exist, and then start the prefetch thread
 void OndiskReader::Initialize(const std::string& filename,
                               int num_samples) {
+  CHECK_NE(filename.empty(), true)
+  CHECK_GT(num_samples, 0);
+  filename_ = filename;
+  num_samples_ = num_samples;
+  disk_file_ = filename_ + ".disk";
+  // The binary file is always next to the txt file
+  cache_dir_.clear();
+  if (feature_map_ != nullptr) {
+    LOG(FATAL) << "The re-indexing of features is not "
+               << "supported by on-disk training";
+  }
+  printf("First check if the text file (%s) has been already "
+         "converted to binary format \n", filename.c_str());
+  bool found = check_disk(disk_file_);
+  // The blocks of the shard are selected from the binary
+  // file of the whole txt file, or only the shard is converted
+  bool whole = found;
+  if (!found && num_shards_ > 1) {
+    disk_file_ = filename_ + StringPrintf(".disk.%dof%d",
+                                          shard_, num_shards_);
+    found = check_disk(disk_file_);
+  }
+  spilling_ = false;
+  if (found) {
+    printf("Binary file found. Skip converting text to binary \n");
+  } else if (spill_) {
+    printf("Binary file NOT found. Parse the text file in the first "
+           "epoch and spill it to binary file \n");
+    // The hash values are computed before the prefetch thread
+    file_hash_1();
+    file_hash_2();
+    init_parser();
+    stats_ = DataStats();
+    spilling_ = true;
+    Reset();
+    return;
+  } else {
+    printf("Binary file NOT found. Convert text "
+           "file to binary file \n");
+    convert_to_binary();
+  }
+  open_disk();
+  if (whole && num_shards_ > 1) {
+    // The statistics are of the whole txt file
+    size_t num_block = block_pos_.size();
+    size_t begin = num_block * shard_ / num_shards_;
+    size_t end = num_block * (shard_ + 1) / num_shards_;
+    std::vector<uint64>(block_pos_.begin() + begin,
+                        block_pos_.begin() + end).swap(block_pos_);
+    std::vector<index_t>(block_rows_.begin() + begin,
+                         block_rows_.begin() + end).swap(block_rows_);
+    std::vector<uint64>(block_size_.begin() + begin,
+                        block_size_.begin() + end).swap(block_size_);
+    block_order_.resize(block_pos_.size());
+    for (size_t i = 0; i < block_order_.size(); ++i) {
+      block_order_[i] = i;
+    }
+    printf("  Use the blocks [%zu, %zu) of %zu blocks of the "
+           "shard %d \n", begin, end, num_block, shard_);
+  }
+  Reset();
+}
+
+// The binary file of the spill is opened after the first epoch
+void OndiskReader::open_disk() {
+  if (file_ != nullptr) { Close(file_); }
+  file_ = OpenFileOrDie(disk_file_.c_str(), "r");
+  file_size_ = GetFileSize(file_);
+  data_begin_ = sizeof(DiskHeader);
+  build_block_index();
+  if (io_depth_ > 0 || direct_io_) {
+    stop_prefetch();
+    if (block_file_ == nullptr) { block_file_ = new BlockFile; }
+    block_file_->Open(disk_file_, direct_io_, std::max(io_depth_, 1));
+    printf("  Read the blocks by %s with %d reads in flight%s \n",
+           block_file_->IsUring() ? "io_uring" : "pread",
+           std::max(io_depth_, 1),
+           block_file_->IsDirect() ? " and O_DIRECT" : "");
+    if (direct_io_ && !block_file_->IsDirect()) {
+      printf("[Warning] The O_DIRECT is not supported by the file "
+             "system, and the pages of each block are dropped "
+             "after it is read \n");
+    }
+  }
+}
+
+// The block size of the binary file should be num_samples, and
+// the blocks should fill the file, which is written again if it
+// is truncated, e.g., the writer is killed
+bool OndiskReader::check_disk(const std::string& disk_file) {
+  if (!check_cache(disk_file, kDiskMagic)) { return false; }
+  FILE* file = OpenFileOrDie(disk_file.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  DiskHeader header;
+  ReadDataFromDisk(file, (char*)&header, sizeof(header));
+  uint64 pos = sizeof(header);
+  while (pos < size) {
+    BinaryHeader block;
+    fseek(file, pos, SEEK_SET);
+    if (ReadDataFromDisk(file, (char*)&block, sizeof(block)) !=
+        sizeof(block) || block.magic != kBinaryMagic) {
+      break;
+    }
+    pos += DMatrix::BinarySize(block);
+  }
+  Close(file);
+  if (pos != size) {
+    printf("[Warning] The binary file %s is truncated, and it "
+           "is converted again \n", disk_file.c_str());
+    LOG(WARNING) << "The binary file " << disk_file << " is truncated";
+    return false;
+  }
+  stats_ = header.stats;
+  return header.num_samples == (uint64)num_samples_;
+}
+
+// Scan the headers of all the blocks in binary file
+void OndiskReader::build_block_index() {
+  block_pos_.clear();
+  block_rows_.clear();
+  block_size_.clear();
+  uint64 pos = data_begin_;
+  while (pos < file_size_) {
+    fseek(file_, pos, SEEK_SET);
+    BinaryHeader header;
+    ReadDataFromDisk(file_, (char*)&header, sizeof(header));
+    CHECK_EQ(header.magic, kBinaryMagic);
+    block_pos_.push_back(pos);
+    block_rows_.push_back(header.row_length);
+    block_size_.push_back(DMatrix::BinarySize(header));
+    pos += block_size_.back();
+  }
+  CHECK_EQ(pos, file_size_);
+  block_order_.resize(block_pos_.size());
+  for (size_t i = 0; i < block_order_.size(); ++i) {
+    block_order_[i] = i;
+  }
+}
+
+// Parse the txt file chunk by chunk and write it to the binary
+// file in blocks of num_samples rows, so that we never load the
+// whole txt file into memory
+void OndiskReader::convert_to_binary() {
+  /*********************************************************
+   *  Step 1: Init parser_                                 *
+   *********************************************************/
+  init_parser();
+  /*********************************************************
+   *  Step 2: Write header                                 *
+   *********************************************************/
+  FILE* bin_file = OpenFileOrDie(disk_file_.c_str(), "w");
+  // The statistics are filled after all the blocks are written
+  DiskHeader header;
+  header.hash_value_1 = file_hash_1();
+  header.hash_value_2 = file_hash_2();
+  header.magic = kDiskMagic;
+  header.num_samples = num_samples_;
+  WriteDataToDisk(bin_file, (char*)&header, sizeof(header));
+  DataStats stats;
+  /*********************************************************
+   *  Step 3: Parse txt file and write blocks              *
+   *********************************************************/
+  DMatrix block;
+  block.SetCSR(true);
+  block.ResetMatrix(num_samples_);
+  index_t block_rows = 0;
+  parse_stream(false, [&](const DMatrix& chunk) {
+    stats.Merge(chunk.GetStats());
+    for (index_t i = 0; i < chunk.row_length; ++i) {
+      block.CopyRow(block_rows++, chunk, i);
+      if (block_rows == num_samples_) {
+        block.Serialize(bin_file);
+        block.ReuseMatrix(num_samples_);
+        block_rows = 0;
+      }
+    }
+    return true;
+  });
+  // The last block
+  if (block_rows > 0) {
+    block.row_length = block_rows;
+    block.Serialize(bin_file);
+  }
+  /*********************************************************
+   *  Step 4: Write the statistics to header               *
+   *********************************************************/
+  header.stats = stats;
+  stats_ = stats;
+  fseek(bin_file, 0, SEEK_SET);
+  WriteDataToDisk(bin_file, (char*)&header, sizeof(header));
+  Close(bin_file);
+}
+
+// Wait for the load_id-th buffer to be free
+bool OndiskReader::wait_for_free(int load_id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (stop_ || !ready_[load_id]) { return !stop_; }
+  // The prefetch stalls on the trainer
+  ScopedTrace trace("wait for free buffer", "reader");
+  cond_.wait(lock, [this, load_id] {
+    return stop_ || !ready_[load_id];
+  });
+  return !stop_;
+}
+
+// The load_id-th buffer has been loaded, and its
+// rows are checked for the binary kernels
+void OndiskReader::set_ready(int load_id) {
+  buffer_[load_id].DetectBinary();
+  {
+    uint64 bytes = buffer_[load_id].MemorySize();
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_[load_id] = true;
+    buffer_bytes_[load_id] = std::max(buffer_bytes_[load_id], bytes);
+  }
+  cond_.notify_all();
+}
+
+// Read blocks into the double buffer in a background thread
+// An empty buffer will be loaded at the end of file
+void OndiskReader::prefetch() {
+  TraceLog::Get().NameThread("prefetch");
+  if (spilling_) {
+    prefetch_spill();
+    return;
+  }
+  if (block_file_ != nullptr) {
+    std::vector<uint64> pos(block_order_.size());
+    std::vector<uint64> size(block_order_.size());
+    for (size_t i = 0; i < block_order_.size(); ++i) {
+      pos[i] = block_pos_[block_order_[i]];
+      size[i] = block_size_[block_order_[i]];
+    }
+    block_file_->Start(pos, size);
+  }
+  if (shuffle_block_ > 0) {
+    prefetch_block(true);
+  } else if (shuffle_window_ > 0) {
+    prefetch_shuffle();
+  } else {
+    prefetch_block(false);
+  }
+}
+
+// The blocks are written in the order of txt file as the
+// convert_to_binary(), and the binary file is renamed after
+// the last block, before the end of file is returned
+void OndiskReader::prefetch_spill() {
+  std::string temp = CacheDir::TempPath(disk_file_);
+  FILE* bin_file = OpenFileOrDie(temp.c_str(), "w");
+  DiskHeader header;
+  header.hash_value_1 = file_hash_1();
+  header.hash_value_2 = file_hash_2();
+  header.magic = kDiskMagic;
+  header.num_samples = num_samples_;
+  WriteDataToDisk(bin_file, (char*)&header, sizeof(header));
+  DataStats stats;
+  bool shuffle_rows = shuffle_window_ > 0 || shuffle_block_ > 0;
+  int load_id = 0;
+  index_t row_id = 0;
+  bool stopped = false;
+  DMatrix block;
+  block.SetCSR(true);
+  std::vector<index_t> order;
+  // Spill the block of row_id rows, and return it in the buffer
+  auto flush = [&]() {
+    DMatrix& matrix = buffer_[load_id];
+    DMatrix& rows = shuffle_rows ? block : matrix;
+    rows.row_length = row_id;
+    rows.Serialize(bin_file);
+    if (shuffle_rows) {
+      order.resize(row_id);
+      for (index_t j = 0; j < row_id; ++j) { order[j] = j; }
+      std::shuffle(order.begin(), order.end(), random_engine_);
+      matrix.ReuseMatrix(row_id);
+      for (index_t j = 0; j < row_id; ++j) {
+        matrix.CopyRow(j, block, order[j]);
+      }
+    }
+    matrix.ComputeRowCost(row_cost_);
+    set_ready(load_id);
+    load_id = next_id(load_id);
+    row_id = 0;
+  };
+  parse_stream(false, [&](const DMatrix& chunk) {
+    stats.Merge(chunk.GetStats());
+    for (index_t i = 0; i < chunk.row_length; ++i) {
+      DMatrix& rows = shuffle_rows ? block : buffer_[load_id];
+      if (row_id == 0) {
+        if (!wait_for_free(load_id)) {
+          stopped = true;
+          return false;
+        }
+        rows.ReuseMatrix(num_samples_);
+      }
+      rows.CopyRow(row_id++, chunk, i);
+      if (row_id == num_samples_) { flush(); }
+    }
+    return true;
+  });
+  if (stopped) {
+    Close(bin_file);
+    RemoveFile(temp.c_str());
+    return;
+  }
+  // The last block
+  if (row_id > 0) { flush(); }
+  header.stats = stats;
+  fseek(bin_file, 0, SEEK_SET);
+  WriteDataToDisk(bin_file, (char*)&header, sizeof(header));
+  Close(bin_file);
+  CacheDir::Commit(temp, disk_file_);
+  stats_ = stats;
+  spill_done_ = true;
+  if (!wait_for_free(load_id)) { return; }
+  buffer_[load_id].Release();
+  set_ready(load_id);
+}
+
+// The BlockFile returns the blocks in the order of block_order_
+void OndiskReader::read_block(index_t id, DMatrix* matrix) {
+  if (block_file_ == nullptr) {
+    fseek(file_, block_pos_[id], SEEK_SET);
+    matrix->Deserialize(file_);
+    return;
+  }
+  const char* data = nullptr;
+  uint64 size = 0;
+  CHECK(block_file_->Next(&data, &size));
+  CHECK_EQ(size, block_size_[id]);
+  matrix->Deserialize(data, size);
+}
+
+// Read the blocks in order without any copy, or copy the
+// rows of each block in random order if shuffle_rows
+void OndiskReader::prefetch_block(bool shuffle_rows) {
+  int load_id = 0;
+  DMatrix block;
+  block.SetCSR(true);
+  std::vector<index_t> order;
+  for (size_t i = 0; i < block_order_.size(); ++i) {
+    if (!wait_for_free(load_id)) { return; }
+    // Read next block without holding the lock
+    {
+      ScopedTrace trace("read block", "reader");
+      DMatrix& matrix = buffer_[load_id];
+      if (shuffle_rows) {
+        read_block(block_order_[i], &block);
+        order.resize(block.row_length);
+        for (index_t j = 0; j < order.size(); ++j) { order[j] = j; }
+        std::shuffle(order.begin(), order.end(), random_engine_);
+        matrix.ReuseMatrix(block.row_length);
+        for (index_t j = 0; j < order.size(); ++j) {
+          matrix.CopyRow(j, block, order[j]);
+        }
+      } else {
+        read_block(block_order_[i], &matrix);
+      }
+      matrix.ComputeRowCost(row_cost_);
+    }
+    set_ready(load_id);
+    load_id = next_id(load_id);
+  }
+  if (!wait_for_free(load_id)) { return; }
+  buffer_[load_id].Release();
+  set_ready(load_id);
+}
+
+// Read shuffle_window_ blocks into the shuffle buffer, and
+// then return the rows of the shuffle buffer in random order.
+// The rows that cannot fill a whole batch are carried to the
+// next shuffle buffer, so only the last batch can be smaller
+void OndiskReader::prefetch_shuffle() {
+  int load_id = 0;
+  DMatrix window, block, carry;
+  window.SetCSR(true);
+  block.SetCSR(true);
+  carry.SetCSR(true);
+  std::vector<index_t> order;
+  for (size_t i = 0; i < block_order_.size(); i += shuffle_window_) {
+    /*********************************************************
+     *  Step 1: Load blocks into shuffle buffer              *
+     *********************************************************/
+    size_t end = std::min(i + shuffle_window_, block_order_.size());
+    bool last_window = (end == block_order_.size());
+    index_t num_rows = carry.row_length;
+    for (size_t j = i; j < end; ++j) {
+      num_rows += block_rows_[block_order_[j]];
+    }
+    ScopedTrace trace("read shuffle window", "reader");
+    window.ResetMatrix(num_rows);
+    window.CopyRows(0, carry);
+    index_t row_id = carry.row_length;
+    for (size_t j = i; j < end; ++j) {
+      read_block(block_order_[j], &block);
+      window.CopyRows(row_id, block);
+      row_id += block.row_length;
+    }
+    order.resize(num_rows);
+    for (index_t j = 0; j < num_rows; ++j) {
+      order[j] = j;
+    }
+    std::shuffle(order.begin(), order.end(), random_engine_);
+    /*********************************************************
+     *  Step 2: Copy rows to the double buffer               *
+     *********************************************************/
+    index_t j = 0;
+    for (; j < num_rows; j += num_samples_) {
+      index_t num = std::min((index_t)num_samples_, num_rows - j);
+      if (num < num_samples_ && !last_window) { break; }
+      if (!wait_for_free(load_id)) { return; }
+      DMatrix& matrix = buffer_[load_id];
+      matrix.ReuseMatrix(num);
+      for (index_t k = 0; k < num; ++k) {
+        matrix.CopyRow(k, window, order[j+k]);
+      }
+      matrix.ComputeRowCost(row_cost_);
+      set_ready(load_id);
+      load_id = next_id(load_id);
+    }
+    // Carry the remaining rows
+    index_t num_carry = j < num_rows ? num_rows - j : 0;
+    carry.ResetMatrix(num_carry);
+    for (index_t k = 0; k < num_carry; ++k) {
+      carry.CopyRow(k, window, order[j+k]);
+    }
+  }
+  if (!wait_for_free(load_id)) { return; }
+  buffer_[load_id].Release();
+  set_ready(load_id);
+}
+
+// Start the prefetch thread from the first block
+void OndiskReader::start_prefetch() {
+  stop_ = false;
+  if (buffer_.size() != (size_t)pipeline_depth_) {
+    std::vector<DMatrix>(pipeline_depth_).swap(buffer_);
+    for (size_t i = 0; i < buffer_.size(); ++i) {
+      buffer_[i].SetCSR(true);
+    }
+    buffer_bytes_.assign(buffer_.size(), 0);
+  }
+  ready_.assign(buffer_.size(), false);
+  use_id_ = 0;
+  is_using_ = false;
+  prefetch_thread_ = std::thread(&OndiskReader::prefetch, this);
+}
+
+// Stop the prefetch thread
+void OndiskReader::stop_prefetch() {
+  if (!prefetch_thread_.joinable()) { return; }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  prefetch_thread_.join();
 }
 
 // Sample data from disk file.
+// Return the block that has been loaded by the prefetch thread,
+// and release the block that returned by last call, which is
+// the one before use_id_ in the ring
 int OndiskReader::Samples(DMatrix* &matrix, bool shuffle) {
-  return 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (is_using_) {
+    // The trainer has finished the last block
+    ready_[(use_id_ + buffer_.size() - 1) % buffer_.size()] = false;
+    is_using_ = false;
+    cond_.notify_all();
+  }
+  if (!ready_[use_id_]) {
+    // The trainer stalls on the prefetch
+    ScopedTrace trace("wait for prefetch", "reader");
+    cond_.wait(lock, [this] { return ready_[use_id_]; });
+  }
+  matrix = &buffer_[use_id_];
+  int num_line = buffer_[use_id_].row_length;
+  if (num_line == 0) {
+    // End of the file. Keep returning 0 until Reset()
+    return 0;
+  }
+  is_using_ = true;
+  use_id_ = next_id(use_id_);
+  return num_line;
 }
 
 // Return to the begining of the file.
-void OndiskReader::Reset() {}
+// The order of blocks is shuffled in shuffle mode
+uint64 OndiskReader::BufferSize() const {
+  uint64 size = (block_pos_.capacity() + block_size_.capacity()) *
+                sizeof(uint64) +
+                (block_rows_.capacity() + block_order_.capacity()) *
+                sizeof(index_t);
+  if (block_file_ != nullptr) { size += block_file_->BufferSize(); }
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < buffer_bytes_.size(); ++i) {
+    size += buffer_bytes_[i];
+  }
+  return size;
+}
+
+// The next epoch of the spill reads the binary file if the
+// first epoch has been spilled, or it spills again
+void OndiskReader::Reset() {
+  stop_prefetch();
+  if (spilling_ && spill_done_) {
+    spilling_ = false;
+    open_disk();
+    printf("  The first epoch has been spilled to binary file "
+           "(%zu blocks) \n", block_pos_.size());
+  }
+  spill_done_ = false;
+  if (shuffle_window_ > 0 || shuffle_block_ > 0) {
+    std::shuffle(block_order_.begin(), block_order_.end(),
+                 random_engine_);
+  }
+  start_prefetch();
+}
+
+// The prefetch thread should stop before the members
+// of StreamReader are destroyed
+StreamReader::~StreamReader() {
+  stop_prefetch();
+}
+
+// The txt file is parsed by the prefetch thread, which
+// starts at the first Reset()
+void StreamReader::Initialize(const std::string& filename,
+                              int num_samples) {
+  CHECK_NE(filename.empty(), true)
+  CHECK_GT(num_samples, 0);
+  filename_ = filename;
+  num_samples_ = num_samples;
+  if (feature_map_ != nullptr && feature_map_->IsCounting()) {
+    LOG(FATAL) << "The counting of features is not "
+               << "supported by streaming reader";
+  }
+  // Keep the order of file
+  shuffle_window_ = 0;
+  shuffle_block_ = 0;
+  spill_ = false;
+  printf("Parse the text file (%s) in streaming mode \n",
+         filename.c_str());
+  init_parser();
+}
+
+// The first Reset() after Initialize() or the last Reset()
+// keeps the running prefetch thread
+void StreamReader::Reset() {
+  if (prefetch_thread_.joinable() && !started_) { return; }
+  if (prefetch_thread_.joinable() && IsStdin(filename_)) {
+    LOG(FATAL) << "The stdin can be read only once";
+  }
+  stop_prefetch();
+  started_ = false;
+  start_prefetch();
+}
+
+// The scores of the last batch are done, so the
+// model does not change under them when it grows
+int StreamReader::Samples(DMatrix* &matrix, bool shuffle) {
+  started_ = true;
+  int num_line = OndiskReader::Samples(matrix, shuffle);
+  if (num_line > 0 && grow_) {
+    grow_(buffer_feat_[matrix - buffer_.data()]);
+  }
+  return num_line;
+}
+
+bool StreamReader::out_of_limits(const RowView& row) const {
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    if ((max_feat_ > 0 && iter->feat_id >= max_feat_) ||
+        (max_field_ > 0 && iter->field_id >= max_field_)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Cut the rows of each chunk into the batches of num_samples
+// rows, and the online rows of each chunk are returned without
+// waiting for the next chunk. The parsing stops if the prefetch
+// thread is stopped
+void StreamReader::prefetch() {
+  TraceLog::Get().NameThread("stream parser");
+  int load_id = 0;
+  index_t row_id = 0;
+  DMatrix dense;
+  dense.SetCSR(true);
+  bool stopped = false;
+  bool limited = max_feat_ > 0 || max_field_ > 0;
+  buffer_feat_.assign(buffer_.size(), 0);
+  parse_stream(false, [&](const DMatrix& chunk) {
+    const DMatrix* rows = &chunk;
+    if (feature_map_ != nullptr) {
+      feature_map_->Remap(chunk, &dense);
+      rows = &dense;
+    }
+    for (index_t i = 0; i < rows->row_length; ++i) {
+      if (limited && out_of_limits(rows->GetRow(i))) {
+        if (dropped_rows_.fetch_add(1) == 0) {
+          LOG(WARNING) << "Drop the rows whose features or "
+                       << "fields are out of the model";
+        }
+        continue;
+      }
+      if (row_id == 0) {
+        if (!wait_for_free(load_id)) {
+          stopped = true;
+          return false;
+        }
+        buffer_[load_id].ReuseMatrix(num_samples_);
+        buffer_feat_[load_id] = 0;
+      }
+      if (grow_) {
+        RowView row = rows->GetRow(i);
+        index_t& num_feat = buffer_feat_[load_id];
+        num_feat = std::max(num_feat, row.dense_size());
+        for (RowView::const_iterator iter = row.begin();
+             iter != row.end(); ++iter) {
+          num_feat = std::max(num_feat, iter->feat_id + 1);
+        }
+      }
+      buffer_[load_id].CopyRow(row_id++, *rows, i);
+      if (row_id == num_samples_) {
+        buffer_[load_id].ComputeRowCost(row_cost_);
+        set_ready(load_id);
+        load_id = next_id(load_id);
+        row_id = 0;
+      }
+    }
+    if (online_ && row_id > 0) {
+      buffer_[load_id].row_length = row_id;
+      buffer_[load_id].ComputeRowCost(row_cost_);
+      set_ready(load_id);
+      load_id = next_id(load_id);
+      row_id = 0;
+    }
+    return true;
+  });
+  if (stopped) { return; }
+  // The last batch
+  if (row_id > 0) {
+    buffer_[load_id].row_length = row_id;
+    buffer_[load_id].ComputeRowCost(row_cost_);
+    set_ready(load_id);
+    load_id = next_id(load_id);
+  }
+  if (!wait_for_free(load_id)) { return; }
+  buffer_[load_id].Release();
+  set_ready(load_id);
+}
+
+//------------------------------------------------------------------------------
+// Implementation of MultiReader
+//------------------------------------------------------------------------------
+
+MultiReader::~MultiReader() {
+  for (size_t i = 0; i < parts_.size(); ++i) {
+    delete parts_[i];
+  }
+}
+
+// The loaders take the parts in order, so the small
+// parts do not wait behind a large one
+void MultiReader::Initialize(const std::string& filename,
+                             int num_samples) {
+  CHECK_NE(filename.empty(), true);
+  CHECK_GT(num_samples, 0);
+  filename_ = filename;
+  num_samples_ = num_samples;
+  std::atomic<size_t> next(0);
+  auto load = [&]() {
+    TraceLog::Get().NameThread("part loader");
+    for (size_t i = next++; i < parts_.size(); i = next++) {
+      parts_[i]->Initialize(files_[i], num_samples);
+    }
+  };
+  std::vector<std::thread> loaders;
+  int num_loader = std::min(num_loader_, (int)parts_.size());
+  for (int i = 1; i < num_loader; ++i) {
+    loaders.push_back(std::thread(load));
+  }
+  load();
+  for (size_t i = 0; i < loaders.size(); ++i) { loaders[i].join(); }
+  stats_ = DataStats();
+  parse_time_ = 0;
+  cache_time_ = 0;
+  first_row_.assign(parts_.size() + 1, 0);
+  for (size_t i = 0; i < parts_.size(); ++i) {
+    const DataStats& stats = parts_[i]->Stats();
+    stats_.Merge(stats);
+    parse_time_ += parts_[i]->ParseTime();
+    cache_time_ += parts_[i]->CacheTime();
+    first_row_[i+1] = first_row_[i] + stats.num_row;
+  }
+  cur_ = 0;
+}
+
+int MultiReader::Samples(DMatrix* &matrix, bool shuffle) {
+  while (cur_ < parts_.size()) {
+    int num_line = parts_[cur_]->Samples(matrix, shuffle);
+    if (num_line > 0) {
+      last_rows_ = num_line;
+      return num_line;
+    }
+    if (++cur_ < parts_.size()) { parts_[cur_]->Reset(); }
+  }
+  return 0;
+}
+
+void MultiReader::Reset() {
+  cur_ = 0;
+  parts_[0]->Reset();
+}
+
+void MultiReader::SetRowProb(const std::vector<real_t>& prob) {
+  for (size_t i = 0; i < parts_.size(); ++i) {
+    if (prob.empty()) {
+      parts_[i]->SetRowProb(prob);
+      continue;
+    }
+    CHECK_EQ(prob.size(), first_row_.back());
+    parts_[i]->SetRowProb(std::vector<real_t>(
+        prob.begin() + first_row_[i], prob.begin() + first_row_[i+1]));
+  }
+}
+
+// The rows of the last Samples() are in the current part
+const index_t* MultiReader::SampleIds() const {
+  CHECK_LT(cur_, parts_.size());
+  const index_t* ids = parts_[cur_]->SampleIds();
+  ids_.resize(last_rows_);
+  for (int i = 0; i < last_rows_; ++i) {
+    ids_[i] = ids[i] + first_row_[cur_];
+  }
+  return ids_.data();
+}
+
+void MultiReader::RemapFeatures() {
+  for (size_t i = 0; i < parts_.size(); ++i) {
+    parts_[i]->RemapFeatures();
+  }
+}
+
+uint64 MultiReader::BufferSize() const {
+  uint64 size = 0;
+  for (size_t i = 0; i < parts_.size(); ++i) {
+    size += parts_[i]->BufferSize();
+  }
+  return size;
+}
+
+// All the parts are in memory, or none of them
+bool MultiReader::SetBatchSize(int num_samples) {
+  for (size_t i = 0; i < parts_.size(); ++i) {
+    if (!parts_[i]->SetBatchSize(num_samples)) { return false; }
+  }
+  num_samples_ = num_samples;
+  return true;
+}
 
 }  // namespace xLearn
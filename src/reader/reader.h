@@ -24,13 +24,21 @@ reading data from data source.
 #ifndef XLEARN_READER_READER_H_
 #define XLEARN_READER_READER_H_
 
+#include <atomic>
 #include <string>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <functional>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
 #include "src/base/scoped_ptr.h"
 #include "src/data/data_structure.h"
+#include "src/data/feature_map.h"
+#include "src/reader/block_file.h"
 #include "src/reader/parser.h"
 
 namespace xLearn {
@@ -71,9 +79,34 @@ namespace xLearn {
 //------------------------------------------------------------------------------
 class Reader {
  public:
-  Reader() {  }
+  Reader() : compact_(false), compress_(false),
+             shuffle_window_(0), hash_bucket_(0),
+             thread_number_(0), pipeline_depth_(2),
+             row_cost_(kRowCostNone), full_hash_(false),
+             hash_1_(0), hash_2_(0), feature_map_(nullptr),
+             neg_sample_(1.0), dedup_(false), row_weight_(1.0),
+             shard_(0), num_shards_(1), huge_pages_(false),
+             shuffle_copy_(false), shuffle_block_(0),
+             sort_rows_(false), dense_(false) {  }
   virtual ~Reader() {  }
 
+  // Detect the format of the first line of a txt file, i.e.,
+  // "libsvm", "libffm", "csv" or "token", and whether it has the
+  // label. Return false with the error if it cannot be parsed
+  static bool DetectFormat(const std::string& line,
+                           index_t hash_bucket,
+                           std::string* format,
+                           bool* has_label,
+                           std::string* error);
+
+  // Return false with the error if the txt file cannot be read
+  // by the options, which exits the program in Initialize(). The
+  // library of training checks the files here (see train_api.h)
+  static bool CheckFile(const std::string& filename,
+                        index_t hash_bucket,
+                        bool dense,
+                        std::string* error);
+
   // We need to invoke the Initialize() function before
   // we start to sample data
   virtual void Initialize(const std::string& filename,
@@ -87,6 +120,288 @@ class Reader {
   // Return to the begining of the data.
   virtual void Reset() = 0;
 
+  // Store the data buffer in compact encoding, which
+  // saves memory for the data with small field id
+  // and binary feature value. Invoke this method
+  // before Initialize()
+  void SetCompact(bool compact) { compact_ = compact; }
+
+  // Write the binary cache in block-compressed format,
+  // which is decoded in parallel at loading time. Invoke
+  // this method before Initialize()
+  void SetCompress(bool compress) { compress_ = compress; }
+
+  // Number of blocks that are mixed in the shuffle buffer
+  // of on-disk samplling. 0 means no shuffle. Invoke this
+  // method before Initialize()
+  void SetShuffleWindow(int window) {
+    CHECK_GE(window, 0);
+    shuffle_window_ = window;
+  }
+
+  // Hash the feature ids of the txt file into num_bucket
+  // buckets (see Parser). 0 means no hashing. The binary
+  // cache is re-generated if it has another num_bucket.
+  // Invoke this method before Initialize()
+  void SetHashBucket(index_t num_bucket) { hash_bucket_ = num_bucket; }
+
+  // Map the hashed ids that the filter has not admitted to the
+  // oov_id (see Parser). The binary cache of a frozen filter is
+  // re-generated if the filter changes. Invoke this method
+  // before Initialize()
+  void SetAdmission(AdmissionFilter* filter, index_t oov_id) {
+    admission_ = filter;
+    admission_oov_ = oov_id;
+  }
+
+  // Sort the nodes of each row by field and then by feature
+  // once at parsing time (see Parser), so the sorted rows are
+  // stored in the binary cache. The cache is re-generated if
+  // it is sorted in the other way. Invoke this method before
+  // Initialize()
+  void SetSortRows(bool sort) { sort_rows_ = sort; }
+
+  // Replace the field ids with their groups at parsing time
+  // (see FieldGroups), so the binary cache keeps the groups,
+  // and it is re-generated for another map. Invoke this
+  // method before Initialize()
+  void SetFieldGroups(const FieldGroups& groups) { field_groups_ = groups; }
+
+  // Add the hashed crosses of the pairs of the fields to the
+  // rows at parsing time (see Parser::setCrosses()), so the
+  // binary cache keeps the crosses, and it is re-generated for
+  // other pairs. Invoke this method before Initialize()
+  void SetCrosses(const std::vector<FieldCross>& crosses) {
+    crosses_ = crosses;
+  }
+
+  // Parse the columns of the csv file into the dense block of
+  // DMatrix (see Parser::setDense()), and the cache is
+  // re-generated if it is parsed in the other way. Invoke this
+  // method before Initialize()
+  void SetDense(bool dense) { dense_ = dense; }
+
+  // Validate the binary cache by the hash of the whole txt
+  // file, besides its fingerprint (see FingerprintFile()).
+  // By default, the cache is checked by the fingerprint only,
+  // which never reads the whole txt file. Invoke this method
+  // before Initialize()
+  void SetFullHash(bool full_hash) { full_hash_ = full_hash; }
+
+  // Keep the binary cache in the shared directory (see CacheDir)
+  // instead of <file>.bin, where the cache is found by the hash
+  // of the content of the txt file, and the least recently used
+  // caches are removed when the directory is larger than
+  // max_bytes (0 means no limit). Only the in-memory Reader
+  // uses it. Invoke this method before Initialize()
+  void SetCacheDir(const std::string& dir, uint64 max_bytes) {
+    cache_dir_ = dir;
+    cache_bytes_ = max_bytes;
+  }
+
+  // Read the txt file (or the stdin) as an online stream (see
+  // OpenOnlineStream()), whose rows are parsed as soon as they
+  // arrive instead of the chunks of 64 MB, for the long-running
+  // training. Only the streaming Reader supports it, and this
+  // method should be invoked before Initialize()
+  void SetOnline(bool online) { online_ = online; }
+
+  // Maximal number of threads for parsing the txt file and
+  // decoding the block-compressed cache, and 0 (by default)
+  // means the number of hardware threads. The threads are
+  // pinned to the cpus if it is not empty (see affinity.h).
+  // Invoke these methods before Initialize()
+  void SetThreadNumber(int thread_number) {
+    CHECK_GE(thread_number, 0);
+    thread_number_ = thread_number;
+  }
+  void SetAffinity(const std::vector<int>& cpus) { cpus_ = cpus; }
+
+  // Parse and decode by the threads of the pool of the caller,
+  // which should outlive the Reader, instead of the shared pool
+  // (see executor.h). Invoke this method before Initialize()
+  void SetThreadPool(ThreadPool* pool) { pool_ = pool; }
+
+  // Number of buffers in the ring between the prefetch thread
+  // and the trainer, which is used by the on-disk Reader. The
+  // prefetch thread can load depth - 1 batches ahead of the
+  // trainer. Using 2 (double buffering) by default
+  void SetPipelineDepth(int depth) {
+    CHECK_GE(depth, 2);
+    pipeline_depth_ = depth;
+  }
+
+  // Read the blocks of the binary file of the on-disk Reader by
+  // the queue of depth asynchronous reads of io_uring (see
+  // BlockFile), and with O_DIRECT if direct, which bypasses the
+  // page cache. 0 (by default) means the buffered stdio reads,
+  // unless direct, which uses a queue of one read. Invoke this
+  // method before Initialize()
+  void SetBlockIO(int depth, bool direct) {
+    CHECK_GE(depth, 0);
+    io_depth_ = depth;
+    direct_io_ = direct;
+  }
+
+  // Parse the txt file in the first epoch of the on-disk Reader
+  // and spill the parsed blocks into its binary file, instead of
+  // converting the whole txt file in Initialize(). The statistics
+  // are known after the first epoch. Invoke this method before
+  // Initialize()
+  void SetSpill(bool spill) { spill_ = spill; }
+
+  // Compute the cost of the rows of each batch returned by
+  // Samples() (see DMatrix::row_cost), so the Loss can split
+  // the batch into the chunks of the same cost. The on-disk
+  // Reader computes it in the prefetch thread
+  void SetRowCost(RowCost cost) { row_cost_ = cost; }
+
+  // Re-index the feature ids into the dense ids of the map
+  // (see FeatureMap) after loading, and the new ids are added
+  // to the map unless it is frozen. The binary cache keeps
+  // the raw ids. Only the in-memory Reader supports it, and
+  // this method should be invoked before Initialize().
+  // If the map is counting, Initialize() only counts the ids,
+  // and RemapFeatures() should be invoked after ordering
+  void SetFeatureMap(FeatureMap* map) { feature_map_ = map; }
+
+  // Keep a random rate (0, 1] of the negative rows (y <= 0) and
+  // all the positive rows at loading time, so the buffer and the
+  // epoch shrink with the rate. The binary cache keeps all the
+  // rows. Only the in-memory Reader supports it, and this method
+  // should be invoked before Initialize()
+  void SetNegSample(real_t rate) {
+    CHECK_GT(rate, 0);
+    CHECK_LE(rate, 1);
+    neg_sample_ = rate;
+  }
+
+  // Collapse the rows that have the same features and label into
+  // one row at loading time, whose weight is the sum of their
+  // weights, so a feature row is kept at most once per label.
+  // The binary cache keeps all the rows. Only the in-memory
+  // Reader supports it, and this method should be invoked
+  // before Initialize()
+  void SetDedup(bool dedup) { dedup_ = dedup; }
+
+  // Multiply the weight of each row by w at loading time, e.g.,
+  // the decayed weight of an older part of a dataset (see
+  // MultiReader). The binary cache keeps the weights of the txt
+  // file, so it is reused for any w. Only the in-memory Reader
+  // supports it, and this method should be invoked before
+  // Initialize()
+  void SetRowWeight(real_t w) {
+    CHECK_GT(w, 0);
+    row_weight_ = w;
+  }
+
+  // Advise the transparent huge pages of the large data buffer
+  // (see huge_page.h). Only the in-memory Reader uses it, and
+  // this method should be invoked before Initialize()
+  void SetHugePages(bool huge) { huge_pages_ = huge; }
+
+  // Write the rows of the in-memory buffer in the shuffled order
+  // of the next epoch into a contiguous copy in a background
+  // thread, so each epoch reads its rows in sequence instead of
+  // jumping over the buffer. It costs two more copies of the
+  // rows. Only the in-memory Reader uses it, and this method
+  // should be invoked before Initialize()
+  void SetShuffleCopy(bool copy) { shuffle_copy_ = copy; }
+
+  // Shuffle the blocks of block_rows contiguous rows and then the
+  // rows within each block, instead of all the rows, so each epoch
+  // reads the buffer one block at a time. The on-disk Reader uses
+  // the blocks of its binary file (num_samples rows each) in place
+  // of the shuffle window, whatever the block_rows is. 0 (by default)
+  // means the full shuffle. Invoke this method before Initialize()
+  void SetShuffleBlock(index_t block_rows) { shuffle_block_ = block_rows; }
+
+  // Group the rows of each batch by the hashed id of their hot
+  // feature, so the rows that update the same hot feature are in
+  // the same one of the num_chunks ranges of the threads, which
+  // write fewer shared cache lines of the Hogwild model. The hot
+  // feature of a row is its most frequent one that is shared by
+  // the rows but is in no more than 1 / num_chunks of them, which
+  // is found in one pass when the data is loaded. Only the
+  // in-memory Reader uses it. Invoke this method before Initialize()
+  void SetGroupRows(int num_chunks) { group_chunks_ = num_chunks; }
+
+  // Only read the shard-th of num_shards shards of the data, so
+  // each worker of the distributed training reads its own part of
+  // one shared file instead of a file split ahead. A plain txt file
+  // is read in the newline-aligned byte range of the shard (see
+  // FileSpliter::Range()), and a compressed file keeps every
+  // num_shards-th row. If the binary cache of the whole file is
+  // found, its contiguous rows (or blocks) of the shard are used.
+  // The in-memory Reader never writes the cache of a shard. Invoke
+  // this method before Initialize()
+  void SetShard(int shard, int num_shards) {
+    CHECK_GT(num_shards, 0);
+    CHECK_GE(shard, 0);
+    CHECK_LT(shard, num_shards);
+    shard_ = shard;
+    num_shards_ = num_shards;
+  }
+
+  // Keep the i-th row of the buffer with the probability prob[i]
+  // in each epoch, and weight the kept row by 1 / prob[i], so the
+  // gradient of the epoch is unbiased. The empty prob keeps all the
+  // rows. Only the in-memory Reader supports it
+  virtual void SetRowProb(const std::vector<real_t>& prob) {
+    LOG(FATAL) << "The sampling of rows is not supported";
+  }
+
+  // The ids in the buffer of the rows of the last Samples(),
+  // which are the order of the rows of the in-memory Reader
+  virtual const index_t* SampleIds() const {
+    LOG(FATAL) << "The ids of rows are not supported";
+    return nullptr;
+  }
+
+  // Change the number of rows of each Samples() after
+  // Initialize(), e.g., by the tuning of the batch size (see
+  // BatchTuner). Return false if the Reader cannot change it,
+  // i.e., the on-disk Reader whose blocks are in its binary file
+  virtual bool SetBatchSize(int num_samples) { return false; }
+
+  // Save the position of the current pass, the order of the rows
+  // and the state of the shuffle into the state, so the Reader of
+  // the same data continues at the same row in the same order after
+  // LoadState(), e.g., a preempted training (see Trainer::SetResume).
+  // Return false if the Reader cannot save it or the state does not
+  // match the data. Only the in-memory Reader supports it
+  virtual bool SaveState(std::string* state) const { return false; }
+  virtual bool LoadState(const std::string& state) { return false; }
+
+  // Re-index the loaded data by the feature map
+  virtual void RemapFeatures() {
+    LOG(FATAL) << "The re-indexing of features is not supported";
+  }
+
+  // Return the statistics of the dataset, which is read
+  // from the header of binary file in Initialize(), so
+  // we don't need an extra pass over the data
+  const DataStats& Stats() const { return stats_; }
+
+  // Time (sec) of parsing the txt file and of writing the binary
+  // cache in Initialize(), which are 0 if the cache is loaded
+  real_t ParseTime() const { return parse_time_; }
+  real_t CacheTime() const { return cache_time_; }
+
+  // Bytes of the data buffer, i.e., all the loaded rows of the
+  // in-memory Reader or the ring of buffers of the on-disk Reader
+  virtual uint64 BufferSize() const { return 0; }
+
+  // Bytes of the matrix of the samples returned by Samples()
+  uint64 SampleSize() const { return data_samples_.MemorySize(); }
+
+  // Peak bytes of the scratch of parsing the txt file, i.e.,
+  // the chunks of the Parser and the buffer of the txt stream
+  uint64 ScratchSize() const {
+    return (parser_ != nullptr ? parser_->ScratchSize() : 0) +
+           stream_buffer_size_;
+  }
+
  protected:
   /* Indicate the input file */
   std::string filename_;
@@ -95,13 +410,84 @@ class Reader {
   /* Data sample */
   DMatrix data_samples_;
   /* Parse txt file to binary data */
-  Parser* parser_;
+  Parser* parser_ = nullptr;
   /* If this data has label y? */
   bool has_label_;
+  /* Use compact encoding for data buffer */
+  bool compact_;
+  /* Use block-compressed binary cache */
+  bool compress_;
+  /* Number of blocks in shuffle buffer */
+  int shuffle_window_;
+  /* Number of buckets of the feature hashing */
+  index_t hash_bucket_;
+  /* The admission of the hashed ids, and their OOV id */
+  AdmissionFilter* admission_ = nullptr;
+  index_t admission_oov_ = 0;
+  /* Number of threads and their CPUs */
+  int thread_number_;
+  std::vector<int> cpus_;
+  /* The pool of the caller, or nullptr for the shared pool */
+  ThreadPool* pool_ = nullptr;
+  /* Number of buffers of the prefetch ring */
+  int pipeline_depth_;
+  /* The reads in flight of the binary blocks, and O_DIRECT */
+  int io_depth_ = 0;
+  bool direct_io_ = false;
+  /* Spill the first epoch into the binary file */
+  bool spill_ = false;
+  /* Cost model of the rows of each batch */
+  RowCost row_cost_;
+  /* Check the cache by the hash of the whole txt file */
+  bool full_hash_;
+  /* The shared cache directory and its size limit */
+  std::string cache_dir_;
+  uint64 cache_bytes_ = 0;
+  /* Hash values of the txt file, computed only once */
+  std::string hash_file_1_;
+  std::string hash_file_2_;
+  uint64 hash_1_;
+  uint64 hash_2_;
+  /* Dense ids of the features, not owned by the Reader */
+  FeatureMap* feature_map_;
+  /* The rate of the negative rows that are kept */
+  real_t neg_sample_;
+  /* Collapse the duplicate rows at loading time */
+  bool dedup_;
+  /* The weight that multiplies each row */
+  real_t row_weight_;
+  /* The shard of the data that is read */
+  int shard_;
+  int num_shards_;
+  /* The huge pages of the data buffer */
+  bool huge_pages_;
+  /* Read each epoch from a shuffled copy of the rows */
+  bool shuffle_copy_;
+  /* Number of rows of the blocks of the block shuffle */
+  index_t shuffle_block_;
+  /* Number of the thread ranges of the row groups, or 0 */
+  int group_chunks_ = 0;
+  /* Sort the nodes of each row by field */
+  bool sort_rows_;
+  /* The groups of the fields */
+  FieldGroups field_groups_;
+  /* The pairs of the fields of the hashed crosses */
+  std::vector<FieldCross> crosses_;
+  /* Parse the csv file into the dense block */
+  bool dense_;
+  /* Statistics of the dataset */
+  DataStats stats_;
+  /* Time of parsing the txt file and of writing the cache */
+  real_t parse_time_ = 0;
+  real_t cache_time_ = 0;
+  /* Size of the buffer of the txt stream, if it is parsed */
+  uint64 stream_buffer_size_ = 0;
+  /* Parse the rows of the online stream as they arrive */
+  bool online_ = false;
 
-  // Check current file format and return
-  // "libsvm", "ffm", or "csv". Program crashes for
-  // unknow format
+  // Check current file format and return "libsvm",
+  // "libffm", "csv" or "token". The program exits for
+  // unknow format (see CheckFile())
   std::string check_file_format();
 
   // Create parser for different file format
@@ -109,6 +495,39 @@ class Reader {
     return CREATE_PARSER(format_name);
   }
 
+  // Create the parser_ for the format of input file
+  void init_parser();
+
+  // Parse the txt file chunk by chunk from the InputStream,
+  // which may decompress the file in a background thread,
+  // and invoke fn on the rows of each chunk, so we never load
+  // the whole txt file into memory. The parsing stops if fn
+  // returns false. Return the number of bytes of the
+  // (decompressed) txt file that have been read. Only the
+  // rows of the shard are parsed (see SetShard())
+  uint64 parse_stream(bool compact,
+                      const std::function<bool(const DMatrix&)>& fn);
+
+  // Number of threads for parsing and decoding
+  int thread_number() const;
+
+  // Hash values of the txt file that are stored in the cache
+  // file, which also depend on the hash_bucket_, the
+  // sort_rows_, the field_groups_, the crosses_ and the dense_.
+  // The first one
+  // is the fingerprint (see FingerprintFile()), or the content
+  // key with the cache_dir_ (see CacheDir), and the second
+  // one is the hash of the whole file (see HashFile()) with
+  // the full_hash_, or 0 otherwise
+  uint64 file_hash_1();
+  uint64 file_hash_2();
+
+  // Check whether the cache_file is generated from current
+  // txt file. The cache file starts with two hash values of the
+  // txt file and a magic number of the cache format. The second
+  // hash value is only checked with the full_hash_
+  bool check_cache(const std::string& cache_file, uint64 magic);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Reader);
 };
@@ -118,32 +537,179 @@ class Reader {
 // For in-memory smaplling, the Reader will automatically convert
 // txt data to binary data, and use this binary data in the next time.
 // Reader will randomly shuffle the data during samplling.
+//
+// The binary file of a plain txt file has a small record of the range
+// of the txt file it covers (<file>.bin.range), which is the size and a
+// fingerprint of the covered head (see FingerprintPrefix()). If the txt
+// file is an append-only log and it has grown since then, the Reader
+// loads the binary file, parses the appended tail only and updates the
+// binary file, instead of parsing the whole txt file again.
 //------------------------------------------------------------------------------
 class InmemReader : public Reader {
  public:
-  InmemReader() { pos_ = 0; }
-  ~InmemReader() { }
+  InmemReader() : pos_(0), shuffle_rng_(rand()), cur_copy_(0) { }
+  ~InmemReader() { wait_copy(); wait_shuffle(); }
 
   // Pre-load all the data into memory buffer
   virtual void Initialize(const std::string& filename,
                           int num_samples);
 
+  // Use the rows in the memory of the caller instead of a file,
+  // i.e., the CSR nodes and offsets of length rows and their
+  // labels (see DMatrix::SetExternal()). The nodes are not copied
+  // and they should outlive the Reader, and the labels are copied
+  void InitializeRows(const Node* node, const uint64* offset,
+                      const real_t* label, index_t length,
+                      int num_samples);
+
   // Sample data from memory buffer
   virtual int Samples(DMatrix* &matrix, bool shuffle = true);
 
   // Return to the begining of the data
   virtual void Reset();
 
+  // Re-index the feature ids of data buffer by the feature map
+  virtual void RemapFeatures();
+
+  // Keep each row with its probability in each epoch
+  virtual void SetRowProb(const std::vector<real_t>& prob) {
+    CHECK(prob.empty() || prob.size() == buffer().row_length);
+    row_prob_ = prob;
+  }
+
+  // The ids of the rows of the last Samples()
+  virtual const index_t* SampleIds() const { return sample_ids_.data(); }
+
+  virtual bool SetBatchSize(int num_samples) {
+    CHECK_GT(num_samples, 0);
+    num_samples_ = num_samples;
+    return true;
+  }
+
+  // The state of the order and the shuffle, which is not
+  // supported by the shuffled copies and the row sampling
+  virtual bool SaveState(std::string* state) const;
+  virtual bool LoadState(const std::string& state);
+
+  // Bytes of the loaded rows and of the order of samplling
+  virtual uint64 BufferSize() const {
+    uint64 size = data_buf_.MemorySize() +
+                  order_.capacity() * sizeof(index_t) +
+                  next_order_.capacity() * sizeof(index_t) +
+                  row_prob_.capacity() * sizeof(real_t);
+    // The next copy is not counted while it is being written
+    for (int i = 0; i < 2; ++i) {
+      if (i != cur_copy_ && copier_.joinable()) { continue; }
+      size += copy_buf_[i].MemorySize() +
+              copy_ids_[i].capacity() * sizeof(index_t);
+    }
+    return size;
+  }
+
+  // The rows loaded into memory, which are shared by the
+  // FoldReader of cross-validation
+  const DMatrix& Data() const { return data_buf_; }
+
+  // The groups of the rows of Data() (see SetGroupRows())
+  const std::vector<uint8>& RowGroups() const { return row_group_; }
+
+  // Convert the txt file into the binary file (filename.bin)
+  // ahead of the training, in the format of the options of
+  // the Reader, and release the parsed data. Return false if
+  // the binary file of current txt file already exists
+  bool Convert(const std::string& filename);
+
+  // Estimate the bytes of memory that the InmemReader takes to
+  // load the file, by the stats in the header of its binary
+  // file, or by the lines and the tokens of the first bytes of
+  // the txt file, which are extrapolated to the file size. The
+  // peak of parsing the txt file is counted. Return false if
+  // the size is unknown, i.e., the stdin or a compressed file
+  static bool EstimateMemory(const std::string& filename,
+                             bool compact,
+                             uint64* bytes);
+
  protected:
   /* We load all the data into this buffer */
   DMatrix data_buf_;
   /* Position for samplling */
   index_t pos_;
-  /* For shuffle */
+  /* For shuffle, and the generator of the shuffle
+  of each epoch, which is seeded by rand() */
   std::vector<index_t> order_;
+  std::mt19937 shuffle_rng_;
+  /* The order of the next epoch and the generator after its
+  shuffle, which are written by the shuffler_ thread during
+  the last batch of the epoch (see start_shuffle()) */
+  std::vector<index_t> next_order_;
+  std::mt19937 next_rng_;
+  std::thread shuffler_;
+  /* The probability of keeping each row, and the
+  coin of the rows, or empty for all the rows */
+  std::vector<real_t> row_prob_;
+  std::mt19937 row_coin_;
+  /* The ids of the rows of the last Samples() */
+  std::vector<index_t> sample_ids_;
+  /* The shuffled copies of the rows (see SetShuffleCopy()) and
+  the ids of their rows in the buffer(). The epoch reads the
+  cur_copy_-th copy while the copier_ writes the other one */
+  DMatrix copy_buf_[2];
+  std::vector<index_t> copy_ids_[2];
+  int cur_copy_;
+  std::thread copier_;
+
+  /* The hashed hot feature of each row in the buffer() (see
+  SetGroupRows()), or empty, and the rows of a batch before
+  they are grouped, i.e., their rows in the data and the ids */
+  std::vector<uint8> row_group_;
+  std::vector<index_t> batch_src_;
+  std::vector<index_t> batch_ids_;
+
+  // The buffer that the rows in order_ are sampled from
+  virtual const DMatrix& buffer() const { return data_buf_; }
+
+  // The groups of the rows of the buffer()
+  virtual const std::vector<uint8>& row_groups() const {
+    return row_group_;
+  }
+
+  // Find the group of each row of data_buf_
+  void group_rows();
+
+  // Shuffle the rows in order_ and copy them into the
+  // next copy in the copier_ thread
+  void start_copy();
+
+  // Wait for the copier_ thread
+  void wait_copy();
+
+  // Start the shuffle of the next order after the last
+  // batch of the epoch has been sampled
+  void prepare_order(bool shuffle);
+
+  // Shuffle order_ into next_order_ in the shuffler_ thread,
+  // whose parts are shuffled by the threads of the pool with
+  // the generators seeded by shuffle_rng_, so the order does
+  // not depend on the number of threads
+  void start_shuffle();
+
+  // Wait for the shuffler_ thread
+  void wait_shuffle();
+
+  // Release the copies, which are out of date after
+  // the data buffer is changed
+  void drop_copies();
+
+  // Path of the binary file of current txt file, which is
+  // in the cache_dir_ if it is set
+  std::string cache_file();
 
   // Check wheter current path has a binary file
-  bool hash_binary(const std::string& filename);
+  bool hash_binary();
+
+  // Initialize Reader from the binary file if it is
+  // generated from current txt file, or from txt file
+  void init_from_file();
 
   // Initialize Reader from binary file
   void init_from_binary();
@@ -151,24 +717,162 @@ class InmemReader : public Reader {
   // Initialize Reader from txt file
   void init_from_txt();
 
+  // Check whether the binary file covers the first text_size
+  // bytes of current txt file, which has been appended since
+  // then. It is never used with the full_hash_ or the
+  // cache_dir_, whose cache is of the whole content
+  bool check_append(uint64* text_size);
+
+  // Initialize Reader from the binary file and the appended
+  // data after text_size, and update the binary file
+  void init_from_append(uint64 text_size);
+
+  // Record that the binary file covers the first text_size
+  // bytes of current txt file
+  void write_range(uint64 text_size);
+
+  // Read the compressed txt file or the stdin into
+  // data_buf_ and return the size of the txt data
+  uint64 read_stream();
+
   // Serialize in-memory buffer to disk file
   void serialize_buffer(const std::string& filename);
 
+  // Read the statistics from the header of binary file
+  void read_stats(const std::string& filename);
+
+  // Keep neg_sample_ of the negative rows of data_buf_
+  void downsample_negatives();
+
+  // Collapse the duplicate rows of data_buf_ into weighted rows
+  void dedup_rows();
+
+  // Multiply the weight of each row of data_buf_ by row_weight_
+  void scale_weights();
+
+  // Keep the contiguous rows of the shard of data_buf_
+  void keep_shard();
+
  private:
   DISALLOW_COPY_AND_ASSIGN(InmemReader);
 };
 
+//------------------------------------------------------------------------------
+// Samplling a fold of the in-memory data for cross-validation.
+// The dataset is loaded only once by an InmemReader, and each
+// FoldReader samples the rows of one fold from its data buffer,
+// so we don't need to split the txt file into num_folds files
+// and parse them one by one. We can use it like this:
+//
+//   InmemReader data;
+//   data.Initialize(filename, num_samples);
+//   for (int i = 0; i < num_folds; ++i) {
+//     Reader* fold = new FoldReader(&data, num_folds, i);
+//     fold->Initialize(filename, num_samples);
+//   }
+//
+// The i-th fold has the contiguous rows [n*i/num_folds,
+// n*(i+1)/num_folds) of the n rows. The source Reader is not
+// owned and should outlive the folds. The rows are shuffled
+// in each fold, like the InmemReader.
+//------------------------------------------------------------------------------
+class FoldReader : public InmemReader {
+ public:
+  FoldReader(const InmemReader* source, int num_folds, int fold)
+    : source_(source), num_folds_(num_folds), fold_(fold) {
+    CHECK_NOTNULL(source);
+    CHECK_GT(num_folds, 0);
+    CHECK_GE(fold, 0);
+    CHECK_LT(fold, num_folds);
+  }
+  ~FoldReader() { }
+
+  // The rows of the fold are selected from the source Reader,
+  // which is already initialized from the filename
+  virtual void Initialize(const std::string& filename,
+                          int num_samples);
+
+  // The features are re-indexed by the source Reader
+  virtual void RemapFeatures() {
+    LOG(FATAL) << "The fold is re-indexed by its source Reader";
+  }
+
+ protected:
+  /* The Reader of the whole dataset */
+  const InmemReader* source_;
+  /* Number of folds and the index of current fold */
+  int num_folds_;
+  int fold_;
+
+  virtual const DMatrix& buffer() const { return source_->Data(); }
+
+  virtual const std::vector<uint8>& row_groups() const {
+    return source_->RowGroups();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FoldReader);
+};
+
 //------------------------------------------------------------------------------
 // Samplling data from disk file.
 // OndiskReader is used to train very big data, which cannot be
 // loaded into main memory of current single machine.
-// We use multi-thread to support data pipeline reading for
-// better performance
+//
+// In Initialize(), the txt file is parsed block by block and converted
+// into a binary file (filename + ".disk"), which is a sequence of DMatrix
+// blocks and each block has num_samples rows. The binary file is re-used
+// if it is generated from the same txt file with the same num_samples.
+//
+// We use a prefetch thread to support data pipeline reading: the prefetch
+// thread reads the next blocks into a ring of buffers while the trainer is
+// using the current buffer, so the I/O and decoding are hidden behind the
+// computation. The ring has 2 buffers (double buffering) by default, and a
+// deeper ring (SetPipelineDepth) absorbs the jitter of I/O. The DMatrix
+// returned by Samples() is valid until the next call of Samples() or
+// Reset().
+//
+// If the shuffle window (SetShuffleWindow) is W > 0, the order of blocks
+// is shuffled at each Reset(), and the prefetch thread loads W blocks into
+// a shuffle buffer and returns the rows of the buffer in random order. So
+// we get a good randomization for SGD with sequential I/O and bounded
+// memory (W * num_samples rows). The block shuffle (SetShuffleBlock) also
+// shuffles the order of blocks, but it only shuffles the rows within each
+// block, so each block is read and copied once without the shuffle buffer.
+// Otherwise, the blocks are returned in the order of file without any copy.
+// The shuffle argument of Samples() is ignored, and the order only depends
+// on the shuffle window and the block shuffle.
+//
+// The blocks are read by the stdio by default, or by the BlockFile with a
+// queue of reads of io_uring and the O_DIRECT (SetBlockIO), which keeps
+// the NVMe busy and the page cache clean during the scan of a huge file.
+//
+// A shard of the data (SetShard) uses the contiguous blocks of the shard
+// if the binary file of the whole txt file is found. Otherwise, only the
+// shard is converted, into filename + ".disk.<shard>of<num_shards>".
+//
+// With the spill (SetSpill), the binary file is not converted ahead of the
+// training. The prefetch thread of the first epoch parses the txt file as
+// the StreamReader, and it writes each block into a temporary binary file
+// before the block is returned, so the parsing is overlapped with the
+// training. The binary file is renamed at the end of the first epoch, and
+// the next epochs read it. If the first epoch is stopped before the end
+// of file, the temporary file is removed and the next epoch spills again.
+// The rows of each block of the first epoch are shuffled with the shuffle
+// window or the block shuffle, while the binary file is in the order of
+// txt file.
 //------------------------------------------------------------------------------
 class OndiskReader : public Reader {
  public:
-  OndiskReader() {  }
-  ~OndiskReader() { }
+  OndiskReader()
+    : file_(nullptr),
+      block_file_(nullptr),
+      data_begin_(0),
+      file_size_(0),
+      use_id_(0),
+      is_using_(false),
+      stop_(false) {  }
+  ~OndiskReader();
 
   virtual void Initialize(const std::string& filename,
                           int num_samples);
@@ -179,10 +883,251 @@ class OndiskReader : public Reader {
   // Return to the begining of the file
   virtual void Reset();
 
+  // Peak bytes of the ring of buffers and of the index of blocks
+  virtual uint64 BufferSize() const;
+
+ protected:
+  /* Path of the binary file */
+  std::string disk_file_;
+  /* The opened binary file, and its BlockFile of SetBlockIO() */
+  FILE* file_;
+  BlockFile* block_file_;
+  /* Position of the first block */
+  uint64 data_begin_;
+  /* Size of the binary file */
+  uint64 file_size_;
+  /* Position, number of rows and bytes of each block */
+  std::vector<uint64> block_pos_;
+  std::vector<index_t> block_rows_;
+  std::vector<uint64> block_size_;
+  /* The order of blocks in current epoch */
+  std::vector<index_t> block_order_;
+  /* Random engine for shuffle */
+  std::default_random_engine random_engine_;
+  /* Ring of buffers */
+  std::vector<DMatrix> buffer_;
+  /* True if the buffer has been loaded. A loaded
+  buffer with row_length == 0 means the end of file */
+  std::vector<char> ready_;
+  /* Peak bytes of each buffer, updated in set_ready() */
+  std::vector<uint64> buffer_bytes_;
+  /* The buffer that will be returned by next Samples() */
+  int use_id_;
+  /* True if the trainer is using a buffer */
+  bool is_using_;
+  /* Stop the prefetch thread */
+  bool stop_;
+  /* Prefetch thread */
+  std::thread prefetch_thread_;
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  /* True if the binary file is being spilled, and
+  true after the prefetch thread has spilled it */
+  bool spilling_ = false;
+  bool spill_done_ = false;
+
+  // Check whether the binary file is generated from current
+  // txt file with current num_samples, and read its statistics
+  bool check_disk(const std::string& disk_file);
+
+  // Convert the txt file into the binary file
+  void convert_to_binary();
+
+  // Open the binary file and the BlockFile of SetBlockIO()
+  void open_disk();
+
+  // Parse the txt file into the ring of buffers, and spill
+  // the blocks into the binary file
+  void prefetch_spill();
+
+  // Build the index of blocks in binary file
+  void build_block_index();
+
+  // Prefetch blocks in a background thread
+  virtual void prefetch();
+
+  // Read the id-th block into the matrix. The blocks are read in
+  // the order of block_order_ after the prefetch thread starts
+  void read_block(index_t id, DMatrix* matrix);
+
+  // Load blocks in order (with the rows shuffled within each
+  // block if shuffle_rows) or in shuffle buffer
+  void prefetch_block(bool shuffle_rows);
+  void prefetch_shuffle();
+
+  // Wait for the load_id-th buffer to be free in prefetch
+  // thread. Return false if the thread should stop
+  bool wait_for_free(int load_id);
+
+  // The load_id-th buffer has been loaded
+  void set_ready(int load_id);
+
+  // The next buffer in the ring
+  inline int next_id(int id) const {
+    return (id + 1) % buffer_.size();
+  }
+
+  // Start and stop the prefetch thread
+  void start_prefetch();
+  void stop_prefetch();
+
  private:
   DISALLOW_COPY_AND_ASSIGN(OndiskReader);
 };
 
+//------------------------------------------------------------------------------
+// Sampling data from the txt file in streaming mode, which is used by the
+// one-shot prediction of a very large file.
+//
+// The prefetch thread of OndiskReader parses the txt file (or the stdin)
+// chunk by chunk and cuts the rows into batches of num_samples rows in the
+// order of file, so the memory is bounded by one chunk of txt data and the
+// ring of buffers, and no binary cache is written. The features are
+// re-indexed chunk by chunk if the feature map is set, which should be
+// frozen. The statistics of the dataset are not known.
+//
+// The first Reset() keeps the txt file that has not been read, so the
+// stdin is parsed only once:
+//
+//   StreamReader reader;
+//   reader.Initialize("/tmp/test.txt", 1000);
+//   reader.Reset();
+//   while (reader.Samples(matrix) > 0) { ... }
+//
+// It is also the Reader of the online training (SetOnline), where the
+// rows that have arrived are returned by Samples() without waiting for
+// a full batch, and the rows out of the model are dropped (SetLimits),
+// or the model grows to the features of each batch (SetGrowth).
+//------------------------------------------------------------------------------
+class StreamReader : public OndiskReader {
+ public:
+  StreamReader() : started_(false) {  }
+  ~StreamReader();
+
+  virtual void Initialize(const std::string& filename,
+                          int num_samples);
+
+  // Drop the rows that have a feature id >= num_feat or a field
+  // id >= num_field, which are the fixed size (or the capacity) of
+  // the model of the online training. 0 means no limit. Invoke
+  // this method before Reset()
+  void SetLimits(index_t num_feat, index_t num_field) {
+    max_feat_ = num_feat;
+    max_field_ = num_field;
+  }
+
+  // Invoke grow(num_feat) in Samples() before each batch is
+  // returned, where num_feat is max feature id of the batch + 1,
+  // so the model grows with the stream (see Model::Grow)
+  void SetGrowth(const std::function<void(index_t)>& grow) {
+    grow_ = grow;
+  }
+
+  // Number of the rows dropped by the limits
+  uint64 DroppedRows() const { return dropped_rows_.load(); }
+
+  // Sample data in the order of file
+  virtual int Samples(DMatrix* &matrix, bool shuffle = true);
+
+  // Parse the txt file from the begining
+  virtual void Reset();
+
+ protected:
+  /* True if Samples() has been invoked since the
+  prefetch thread starts */
+  bool started_;
+  /* Limits of the ids of SetLimits(), and the dropped rows */
+  index_t max_feat_ = 0;
+  index_t max_field_ = 0;
+  std::atomic<uint64> dropped_rows_{0};
+  /* The growth of SetGrowth(), and the number of
+  features of each buffer for it */
+  std::function<void(index_t)> grow_;
+  std::vector<index_t> buffer_feat_;
+
+  // The row is out of the limits
+  bool out_of_limits(const RowView& row) const;
+
+  // Parse the txt file into the ring of buffers
+  virtual void prefetch();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StreamReader);
+};
+
+//------------------------------------------------------------------------------
+// Samplling one logical dataset of several txt files, e.g., the part files
+// of a directory (see ExpandFileList()), without concatenating them. Each
+// part file has its own Reader, which is configured by the caller and owned
+// by the MultiReader, and its own binary cache. The parts are initialized by
+// num_loader threads at the same time, so the part files are read and
+// parsed concurrently:
+//
+//   std::vector<Reader*> parts = { ... };  /* one for each file */
+//   MultiReader reader(parts, files, 4);
+//   reader.Initialize("/data/train/", 1000);
+//   reader.Reset();
+//   while (reader.Samples(matrix) > 0) { ... }
+//
+// Samples() returns the batches of the parts one after another, and each
+// part is reset when the one before it ends. The statistics are merged,
+// and the rows of the i-th part follow the rows of the parts before it in
+// SetRowProb() and SampleIds().
+//
+// For the sliding window of the daily parts, only the new day is parsed
+// and the caches of the other days are reused, and the rows of the older
+// days can be weighted down by SetRowWeight() of their Readers.
+//------------------------------------------------------------------------------
+class MultiReader : public Reader {
+ public:
+  MultiReader(const std::vector<Reader*>& parts,
+              const std::vector<std::string>& files,
+              int num_loader)
+    : parts_(parts), files_(files), num_loader_(num_loader),
+      cur_(0), last_rows_(0) {
+    CHECK(!parts.empty());
+    CHECK_EQ(parts.size(), files.size());
+    CHECK_GT(num_loader, 0);
+  }
+  ~MultiReader();
+
+  // Initialize the parts from their files, and the
+  // filename is the list of files of the dataset
+  virtual void Initialize(const std::string& filename,
+                          int num_samples);
+
+  // Sample data from the current part
+  virtual int Samples(DMatrix* &matrix, bool shuffle = true);
+
+  // Return to the begining of the first part
+  virtual void Reset();
+
+  virtual void SetRowProb(const std::vector<real_t>& prob);
+  virtual const index_t* SampleIds() const;
+  virtual void RemapFeatures();
+  virtual uint64 BufferSize() const;
+  virtual bool SetBatchSize(int num_samples);
+
+  // Number of the part files
+  inline size_t NumParts() const { return parts_.size(); }
+
+ protected:
+  /* The Readers of the part files */
+  std::vector<Reader*> parts_;
+  std::vector<std::string> files_;
+  int num_loader_;
+  /* The part of the next Samples(), the rows of the last
+  Samples(), and the first row of each part */
+  size_t cur_;
+  int last_rows_;
+  std::vector<index_t> first_row_;
+  /* The ids of SampleIds() of the current part */
+  mutable std::vector<index_t> ids_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MultiReader);
+};
+
 //------------------------------------------------------------------------------
 // Class register
 //------------------------------------------------------------------------------
@@ -22,11 +22,18 @@ This file tests the Reader class.
 
 #include "gtest/gtest.h"
 
+#include <unistd.h>
+
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <map>
 
+#include "src/reader/cache_dir.h"
 #include "src/reader/reader.h"
+#include "src/reader/input_stream.h"
 #include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
 
 using std::vector;
 using std::string;
@@ -96,6 +103,12 @@ void delete_file() {
   RemoveFile(csv_file.c_str());
   RemoveFile(lr_no_file.c_str());
   RemoveFile(ffm_no_file.c_str());
+  // range of the txt file covered by bin file
+  RemoveFile((lr_file + ".range").c_str());
+  RemoveFile((ffm_file + ".range").c_str());
+  RemoveFile((csv_file + ".range").c_str());
+  RemoveFile((lr_no_file + ".range").c_str());
+  RemoveFile((ffm_no_file + ".range").c_str());
 }
 
 void CheckLR(const DMatrix* matrix, bool has_label) {
@@ -108,10 +121,10 @@ void CheckLR(const DMatrix* matrix, bool has_label) {
   }
   EXPECT_FLOAT_EQ(matrix->norm[0], 22.03274);
   for (int i = 0; i < matrix->row_length; ++i) {
-    SparseRow *row = matrix->row[i];
+    RowView row = matrix->GetRow(i);
     int n = 0;
-    for (SparseRow::iterator iter = row->begin();
-         iter != row->end(); ++iter) {
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
       EXPECT_EQ(iter->field_id, 0);
       EXPECT_EQ(iter->feat_id, 1);
       EXPECT_FLOAT_EQ(iter->feat_val, 0.123);
@@ -131,10 +144,10 @@ void CheckFFM(const DMatrix* matrix, bool has_label) {
   }
   EXPECT_FLOAT_EQ(matrix->norm[0], 22.03274);
   for (int i = 0; i < matrix->row_length; ++i) {
-    SparseRow *row = matrix->row[i];
+    RowView row = matrix->GetRow(i);
     int n = 0;
-    for (SparseRow::iterator iter = row->begin();
-         iter != row->end(); ++iter) {
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
       EXPECT_EQ(iter->field_id, 1);
       EXPECT_EQ(iter->feat_id, 1);
       EXPECT_FLOAT_EQ(iter->feat_val, 0.123);
@@ -149,10 +162,10 @@ void CheckCSV(const DMatrix* matrix) {
   EXPECT_EQ(matrix->Y[0], 0);
   EXPECT_FLOAT_EQ(matrix->norm[0], 22.03274);
   for (int i = 0; i < matrix->row_length; ++i) {
-    SparseRow *row = matrix->row[i];
+    RowView row = matrix->GetRow(i);
     int n = 0;
-    for (SparseRow::iterator iter = row->begin();
-         iter != row->end(); ++iter) {
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
       EXPECT_EQ(iter->feat_id, n);
       EXPECT_FLOAT_EQ(iter->feat_val, 0.123);
       n++;
@@ -161,9 +174,39 @@ void CheckCSV(const DMatrix* matrix) {
   }
 }
 
-void read_from_memory(const std::string& filename, int task_id) {
+// The statistics are read from the header of binary file
+void CheckStats(const DataStats& stats, int task_id) {
+  EXPECT_EQ(stats.num_row, kNumLines);
+  EXPECT_EQ(stats.num_node, kNumLines * 3);
+  switch (task_id) {
+    case 0:  // LR
+      EXPECT_EQ(stats.max_feat, 1);
+      EXPECT_EQ(stats.num_positive, 0);
+      EXPECT_DOUBLE_EQ(stats.label_max, 0);
+      break;
+    case 1:  // FFM
+      EXPECT_EQ(stats.max_feat, 1);
+      EXPECT_EQ(stats.max_field, 1);
+      EXPECT_EQ(stats.num_positive, kNumLines);
+      EXPECT_DOUBLE_EQ(stats.label_sum, kNumLines);
+      EXPECT_DOUBLE_EQ(stats.label_min, 1);
+      EXPECT_DOUBLE_EQ(stats.label_max, 1);
+      break;
+    case 2:  // CSV
+      EXPECT_EQ(stats.max_feat, 2);
+      break;
+    default:
+      break;
+  }
+}
+
+void read_from_memory(const std::string& filename, int task_id,
+                      bool compact = false, bool compress = false) {
   InmemReader reader;
+  reader.SetCompact(compact);
+  reader.SetCompress(compress);
   reader.Initialize(filename, kNumSamples);
+  CheckStats(reader.Stats(), task_id);
   DMatrix* matrix = nullptr;
   for (int i = 0; i < iteration_num; ++i) {
     int record_num = reader.Samples(matrix);
@@ -228,15 +271,1304 @@ TEST(ReaderTest, ReadFromBinary) {
   delete_file();
 }
 
-//TEST_F(ReaderTest, SampleFromDisk) { }
+TEST(ReaderTest, SampleFromCompactMemory) {
+  WriteFile();
+  string lr_file = kTestfilename + "_LR.txt";
+  string ffm_file = kTestfilename + "_ffm.txt";
+  string csv_file = kTestfilename + "_csv.txt";
+  string lr_no_file = kTestfilename + "_LR_no.txt";
+  string ffm_no_file = kTestfilename + "_ffm_no.txt";
+  // Convert txt to the compact binary file
+  read_from_memory(lr_file, 0, true);
+  read_from_memory(ffm_file, 1, true);
+  read_from_memory(csv_file, 2, true);
+  read_from_memory(lr_no_file, 3, true);
+  read_from_memory(ffm_no_file, 4, true);
+  // Read from the compact binary file
+  read_from_memory(lr_file, 0);
+  read_from_memory(ffm_file, 1);
+  read_from_memory(csv_file, 2);
+  read_from_memory(lr_no_file, 3);
+  read_from_memory(ffm_no_file, 4);
+  delete_file();
+}
+
+TEST(ReaderTest, SampleFromCompressedCache) {
+  WriteFile();
+  string lr_file = kTestfilename + "_LR.txt";
+  string ffm_file = kTestfilename + "_ffm.txt";
+  string csv_file = kTestfilename + "_csv.txt";
+  string lr_no_file = kTestfilename + "_LR_no.txt";
+  string ffm_no_file = kTestfilename + "_ffm_no.txt";
+  // Convert txt to the block-compressed binary file,
+  // and then read from the block-compressed binary file
+  for (int i = 0; i < 2; ++i) {
+    read_from_memory(lr_file, 0, false, true);
+    read_from_memory(ffm_file, 1, false, true);
+    read_from_memory(csv_file, 2, false, true);
+    read_from_memory(lr_no_file, 3, false, true);
+    read_from_memory(ffm_no_file, 4, true, true);
+  }
+  delete_file();
+}
+
+TEST(ReaderTest, ConvertAheadOfTraining) {
+  WriteFile();
+  string lr_file = kTestfilename + "_LR.txt";
+  string ffm_file = kTestfilename + "_ffm.txt";
+  // The binary file is generated once
+  for (int i = 0; i < 2; ++i) {
+    InmemReader lr_reader;
+    EXPECT_EQ(lr_reader.Convert(lr_file), i == 0);
+    InmemReader ffm_reader;
+    ffm_reader.SetCompress(true);
+    EXPECT_EQ(ffm_reader.Convert(ffm_file), i == 0);
+  }
+  EXPECT_TRUE(FileExist((lr_file + ".bin").c_str()));
+  // The training reads the binary file
+  read_from_memory(lr_file, 0);
+  read_from_memory(ffm_file, 1, false, true);
+  // The other files have no binary file
+  read_from_memory(kTestfilename + "_csv.txt", 2);
+  read_from_memory(kTestfilename + "_LR_no.txt", 3);
+  read_from_memory(kTestfilename + "_ffm_no.txt", 4);
+  delete_file();
+}
+
+TEST(ReaderTest, EstimateMemory) {
+  WriteFile();
+  string lr_file = kTestfilename + "_LR.txt";
+  string ffm_file = kTestfilename + "_ffm.txt";
+  uint64 row_bytes = 2 * sizeof(real_t) + sizeof(uint64) + sizeof(index_t);
+  uint64 exact = kNumLines * row_bytes + kNumLines * 3 * sizeof(Node);
+  // The txt file counts the peak of parsing
+  uint64 bytes = 0;
+  EXPECT_TRUE(InmemReader::EstimateMemory(lr_file, false, &bytes));
+  EXPECT_EQ(bytes, 2 * exact);
+  EXPECT_TRUE(InmemReader::EstimateMemory(ffm_file, true, &bytes));
+  EXPECT_LT(bytes, 2 * exact);
+  // The binary file and the block cache give the exact stats
+  InmemReader lr_reader;
+  lr_reader.Convert(lr_file);
+  InmemReader ffm_reader;
+  ffm_reader.SetCompress(true);
+  ffm_reader.Convert(ffm_file);
+  EXPECT_TRUE(InmemReader::EstimateMemory(lr_file, false, &bytes));
+  EXPECT_EQ(bytes, exact);
+  EXPECT_TRUE(InmemReader::EstimateMemory(lr_file + ".bin", false, &bytes));
+  EXPECT_EQ(bytes, exact);
+  EXPECT_TRUE(InmemReader::EstimateMemory(ffm_file, false, &bytes));
+  EXPECT_EQ(bytes, exact);
+  EXPECT_FALSE(InmemReader::EstimateMemory("-", false, &bytes));
+  RemoveFile((lr_file + ".bin").c_str());
+  RemoveFile((ffm_file + ".bin").c_str());
+  RemoveFile((lr_file + ".bin.range").c_str());
+  RemoveFile((ffm_file + ".bin.range").c_str());
+  RemoveFile(lr_file.c_str());
+  RemoveFile(ffm_file.c_str());
+  RemoveFile((kTestfilename + "_csv.txt").c_str());
+  RemoveFile((kTestfilename + "_LR_no.txt").c_str());
+  RemoveFile((kTestfilename + "_ffm_no.txt").c_str());
+}
+
+// Append rows to the txt file
+void append_data(const std::string& filename,
+                 const std::string& data, index_t num_lines) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "a");
+  for (index_t i = 0; i < num_lines; ++i) {
+    WriteDataToDisk(file, (char*)data.data(), data.size());
+  }
+  Close(file);
+}
+
+TEST(ReaderTest, AppendToBinary) {
+  for (int t = 0; t < 2; ++t) {
+    bool compress = t == 1;
+    string filename = kTestfilename + "_append.txt";
+    string range_file = filename + ".bin.range";
+    FILE* file = OpenFileOrDie(filename.c_str(), "w");
+    Close(file);
+    append_data(filename, kStrFFM, 1000);
+    {
+      InmemReader reader;
+      reader.SetCompress(compress);
+      reader.Initialize(filename, kNumSamples);
+      EXPECT_EQ(reader.Stats().num_row, 1000);
+      EXPECT_TRUE(FileExist(range_file.c_str()));
+    }
+    // Only the appended rows are parsed, which have
+    // another label and feature
+    append_data(filename, "0 2:5:1.0\n", 500);
+    for (int i = 0; i < 2; ++i) {
+      InmemReader reader;
+      reader.SetCompress(compress);
+      reader.Initialize(filename, kNumSamples);
+      EXPECT_EQ(reader.Stats().num_row, 1500);
+      EXPECT_EQ(reader.Stats().num_positive, 1000);
+      EXPECT_EQ(reader.Stats().max_feat, 5);
+      EXPECT_EQ(reader.Stats().max_field, 2);
+      EXPECT_EQ(reader.Data().row_length, 1500);
+      EXPECT_EQ(reader.Data().GetRow(1499).size(), 1);
+      EXPECT_EQ(reader.Data().GetRow(0).size(), 3);
+    }
+    // The rewritten head is parsed with the whole file
+    file = OpenFileOrDie(filename.c_str(), "w");
+    Close(file);
+    append_data(filename, "0 3:9:1.0\n", 2000);
+    {
+      InmemReader reader;
+      reader.SetCompress(compress);
+      reader.Initialize(filename, kNumSamples);
+      EXPECT_EQ(reader.Stats().num_row, 2000);
+      EXPECT_EQ(reader.Stats().num_positive, 0);
+      EXPECT_EQ(reader.Stats().max_feat, 9);
+    }
+    RemoveFile(filename.c_str());
+    RemoveFile((filename + ".bin").c_str());
+    RemoveFile(range_file.c_str());
+  }
+}
+
+// The truncated cache, e.g., of a killed writer, is stale,
+// and it is converted again from the txt file
+TEST(ReaderTest, TruncatedCache) {
+  string filename = kTestfilename + "_truncated.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  Close(file);
+  append_data(filename, kStrFFM, 1000);
+  for (int t = 0; t < 3; ++t) {
+    // The binary file, the block cache, and the file of OndiskReader
+    string cache_file = filename + (t == 2 ? ".disk" : ".bin");
+    uint64 size = 0;
+    for (int i = 0; i < 3; ++i) {
+      if (i == 1) {
+        EXPECT_EQ(truncate(cache_file.c_str(), size / 2), 0);
+      }
+      if (t < 2) {
+        InmemReader reader;
+        reader.SetCompress(t == 1);
+        reader.Initialize(filename, kNumSamples);
+        EXPECT_EQ(reader.Stats().num_row, 1000);
+        EXPECT_EQ(reader.Data().row_length, 1000);
+      } else {
+        OndiskReader reader;
+        reader.Initialize(filename, kNumSamples);
+        DMatrix* matrix = nullptr;
+        index_t num_row = 0;
+        for (int n = 0; n < 2; ++n) {
+          reader.Reset();
+          while (reader.Samples(matrix)) { num_row += matrix->row_length; }
+        }
+        EXPECT_EQ(num_row, 2000);
+      }
+      file = OpenFileOrDie(cache_file.c_str(), "r");
+      uint64 new_size = GetFileSize(file);
+      Close(file);
+      // The same cache is written again
+      if (i == 0) { size = new_size; }
+      EXPECT_EQ(new_size, size);
+    }
+    RemoveFile(cache_file.c_str());
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+// The copies of the txt file share the cache of the directory,
+// which is found without parsing
+TEST(ReaderTest, CacheDir) {
+  const string cache_dir = kTestfilename + "_cache";
+  for (int t = 0; t < 2; ++t) {
+    bool compress = t == 1;
+    string file_a = kTestfilename + "_copy_a.txt";
+    string file_b = kTestfilename + "_copy_b.txt";
+    write_data(file_a, kStrFFM);
+    write_data(file_b, kStrFFM);
+    {
+      InmemReader reader;
+      reader.SetCompress(compress);
+      reader.SetCacheDir(cache_dir, 0);
+      reader.Initialize(file_a, kNumSamples);
+      EXPECT_GT(reader.ParseTime(), 0);
+      EXPECT_EQ(reader.Stats().num_row, kNumLines);
+    }
+    {
+      InmemReader reader;
+      reader.SetCompress(compress);
+      reader.SetCacheDir(cache_dir, 0);
+      reader.Initialize(file_b, kNumSamples);
+      EXPECT_EQ(reader.ParseTime(), 0);
+      EXPECT_EQ(reader.Stats().num_row, kNumLines);
+      DMatrix* matrix = nullptr;
+      EXPECT_EQ(reader.Samples(matrix), kNumSamples);
+      CheckFFM(matrix, true);
+    }
+    // No cache is written next to the txt files
+    EXPECT_FALSE(FileExist((file_a + ".bin").c_str()));
+    EXPECT_FALSE(FileExist((file_b + ".bin").c_str()));
+    // The cache of the same content is not converted again
+    InmemReader reader;
+    reader.SetCompress(compress);
+    reader.SetCacheDir(cache_dir, 0);
+    EXPECT_FALSE(reader.Convert(file_a));
+    RemoveFile(file_a.c_str());
+    RemoveFile(file_b.c_str());
+  }
+  // Remove all the caches by the limit of one byte
+  CacheDir(cache_dir, 1).Evict("");
+  rmdir(cache_dir.c_str());
+}
+
+void read_from_disk(const std::string& filename, int task_id,
+                    int num_samples, int shuffle_window = 0,
+                    int pipeline_depth = 2, int io_depth = 0,
+                    bool direct_io = false) {
+  OndiskReader reader;
+  reader.SetShuffleWindow(shuffle_window);
+  reader.SetPipelineDepth(pipeline_depth);
+  reader.SetBlockIO(io_depth, direct_io);
+  reader.Initialize(filename, num_samples);
+  CheckStats(reader.Stats(), task_id);
+  DMatrix* matrix = nullptr;
+  // Two epochs
+  for (int n = 0; n < 2; ++n) {
+    index_t count = 0;
+    for (;;) {
+      int record_num = reader.Samples(matrix);
+      if (record_num == 0) { break; }
+      count += record_num;
+      if (count < kNumLines) {
+        EXPECT_EQ(record_num, num_samples);
+      }
+      // The Check*() functions only accept kNumSamples rows
+      if (num_samples != kNumSamples) { continue; }
+      switch (task_id) {
+        case 0:
+          CheckLR(matrix, true);
+          break;
+        case 1:
+          CheckFFM(matrix, true);
+          break;
+        case 2:
+          CheckCSV(matrix);
+          break;
+        case 3:
+          CheckLR(matrix, false);
+          break;
+        case 4:
+          CheckFFM(matrix, false);
+          break;
+      }
+    }
+    EXPECT_EQ(count, kNumLines);
+    // Keep returning 0 at the end of file
+    EXPECT_EQ(reader.Samples(matrix), 0);
+    reader.Reset();
+  }
+}
+
+TEST(ReaderTest, SampleFromDisk) {
+  WriteFile();
+  string lr_file = kTestfilename + "_LR.txt";
+  string ffm_file = kTestfilename + "_ffm.txt";
+  string csv_file = kTestfilename + "_csv.txt";
+  string lr_no_file = kTestfilename + "_LR_no.txt";
+  string ffm_no_file = kTestfilename + "_ffm_no.txt";
+  // Convert txt to binary file
+  read_from_disk(lr_file, 0, kNumSamples);
+  read_from_disk(ffm_file, 1, kNumSamples);
+  read_from_disk(csv_file, 2, kNumSamples);
+  read_from_disk(lr_no_file, 3, kNumSamples);
+  read_from_disk(ffm_no_file, 4, kNumSamples);
+  // Read from binary file
+  read_from_disk(lr_file, 0, kNumSamples);
+  read_from_disk(ffm_file, 1, kNumSamples);
+  // The last block is smaller than num_samples
+  read_from_disk(lr_file, 0, 3000);
+  read_from_disk(ffm_no_file, 4, 3000);
+  // Shuffle
+  read_from_disk(lr_file, 0, kNumSamples, 3);
+  read_from_disk(ffm_file, 1, kNumSamples, 3);
+  read_from_disk(ffm_no_file, 4, 3000, 2);
+  // Deeper prefetch ring
+  read_from_disk(lr_file, 0, kNumSamples, 0, 4);
+  read_from_disk(ffm_no_file, 4, 3000, 0, 3);
+  read_from_disk(ffm_file, 1, kNumSamples, 3, 5);
+  // Read the blocks by the queue of reads and O_DIRECT
+  read_from_disk(lr_file, 0, kNumSamples, 0, 2, 4);
+  read_from_disk(ffm_no_file, 4, 3000, 2, 3, 2, true);
+  read_from_disk(ffm_file, 1, kNumSamples, 3, 2, 0, true);
+  // delete file
+  RemoveFile((lr_file + ".disk").c_str());
+  RemoveFile((ffm_file + ".disk").c_str());
+  RemoveFile((csv_file + ".disk").c_str());
+  RemoveFile((lr_no_file + ".disk").c_str());
+  RemoveFile((ffm_no_file + ".disk").c_str());
+  RemoveFile(lr_file.c_str());
+  RemoveFile(ffm_file.c_str());
+  RemoveFile(csv_file.c_str());
+  RemoveFile(lr_no_file.c_str());
+  RemoveFile(ffm_no_file.c_str());
+}
+
+// The first epoch parses the txt file and spills it, and the
+// next epochs read the binary file
+TEST(ReaderTest, SpillFromDisk) {
+  string filename = kTestfilename + "_spill.txt";
+  string disk_file = filename + ".disk";
+  write_data(filename, kStrFFM);
+  for (int shuffle = 0; shuffle < 2; ++shuffle) {
+    if (FileExist(disk_file.c_str())) { RemoveFile(disk_file.c_str()); }
+    OndiskReader reader;
+    reader.SetSpill(true);
+    reader.SetShuffleWindow(shuffle == 1 ? 3 : 0);
+    reader.Initialize(filename, kNumSamples);
+    EXPECT_EQ(reader.Stats().num_row, 0);
+    DMatrix* matrix = nullptr;
+    // The epoch that is stopped is not spilled
+    reader.Reset();
+    EXPECT_EQ(reader.Samples(matrix), kNumSamples);
+    reader.Reset();
+    EXPECT_FALSE(FileExist(disk_file.c_str()));
+    for (int n = 0; n < 3; ++n) {
+      index_t count = 0;
+      int record_num = 0;
+      while ((record_num = reader.Samples(matrix)) > 0) {
+        EXPECT_EQ(record_num, kNumSamples);
+        CheckFFM(matrix, true);
+        count += record_num;
+      }
+      EXPECT_EQ(count, kNumLines);
+      EXPECT_TRUE(FileExist(disk_file.c_str()));
+      CheckStats(reader.Stats(), 1);
+      reader.Reset();
+    }
+  }
+  // The spilled binary file is used as the converted one
+  read_from_disk(filename, 1, kNumSamples);
+  RemoveFile(filename.c_str());
+  RemoveFile(disk_file.c_str());
+}
+
+TEST(ReaderTest, ShuffleFromDisk) {
+  // Use line number as label
+  std::string filename = kTestfilename + "_shuffle.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kNum = 1000;
+  for (index_t i = 0; i < kNum; ++i) {
+    std::string line = StringPrintf("%d 1:0.5\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  OndiskReader reader;
+  reader.SetShuffleWindow(3);
+  reader.Initialize(filename, 100);
+  std::vector<index_t> last_order;
+  for (int n = 0; n < 2; ++n) {
+    DMatrix* matrix = nullptr;
+    std::vector<index_t> order;
+    while (reader.Samples(matrix)) {
+      for (index_t i = 0; i < matrix->row_length; ++i) {
+        order.push_back((index_t)matrix->Y[i]);
+      }
+    }
+    ASSERT_EQ(order.size(), kNum);
+    // The order is shuffled
+    bool in_order = true;
+    for (index_t i = 0; i < kNum; ++i) {
+      if (order[i] != i) { in_order = false; }
+    }
+    EXPECT_EQ(in_order, false);
+    EXPECT_NE(order, last_order);
+    last_order = order;
+    // Each row is returned once
+    std::sort(order.begin(), order.end());
+    for (index_t i = 0; i < kNum; ++i) {
+      EXPECT_EQ(order[i], i);
+    }
+    reader.Reset();
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".disk").c_str());
+}
+
+TEST(ReaderTest, SampleFromStream) {
+  // Use line number as label
+  std::string filename = kTestfilename + "_stream.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kNum = 1000;
+  for (index_t i = 0; i < kNum; ++i) {
+    std::string line = StringPrintf("%d 1:0.5\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  StreamReader reader;
+  reader.Initialize(filename, 300);
+  DMatrix* matrix = nullptr;
+  for (int n = 0; n < 2; ++n) {
+    reader.Reset();
+    // Stop in the middle of the file
+    if (n == 1) {
+      EXPECT_EQ(reader.Samples(matrix), 300);
+      reader.Reset();
+    }
+    std::vector<index_t> order;
+    int record_num = 0;
+    while ((record_num = reader.Samples(matrix)) > 0) {
+      EXPECT_EQ(record_num, order.size() < 900 ? 300 : 100);
+      for (index_t i = 0; i < matrix->row_length; ++i) {
+        order.push_back((index_t)matrix->Y[i]);
+      }
+    }
+    // The rows are in the order of file
+    ASSERT_EQ(order.size(), kNum);
+    for (index_t i = 0; i < kNum; ++i) {
+      EXPECT_EQ(order[i], i);
+    }
+    EXPECT_EQ(reader.Samples(matrix), 0);
+  }
+  // No binary cache
+  EXPECT_FALSE(FileExist((filename + ".bin").c_str()));
+  EXPECT_FALSE(FileExist((filename + ".disk").c_str()));
+  RemoveFile(filename.c_str());
+}
 
 Reader* CreateReader(const char* format_name) {
   return CREATE_READER(format_name);
 }
 
+TEST(ReaderTest, SampleFromFold) {
+  // The label of each row is its row id
+  string filename = kTestfilename + "_fold.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 1001;
+  for (int i = 0; i < kNumRows; ++i) {
+    string line = StringPrintf("%d 1:0.5 %d:1\n", i, i % 7 + 2);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  InmemReader data;
+  data.Initialize(filename, kNumSamples);
+  const int kNumFolds = 3;
+  std::vector<int> count(kNumRows, 0);
+  DataStats stats;
+  for (int i = 0; i < kNumFolds; ++i) {
+    FoldReader fold(&data, kNumFolds, i);
+    fold.Initialize(filename, kNumSamples);
+    stats.Merge(fold.Stats());
+    int begin = kNumRows * i / kNumFolds;
+    int end = kNumRows * (i + 1) / kNumFolds;
+    EXPECT_EQ(fold.Stats().num_row, end - begin);
+    DMatrix* matrix = nullptr;
+    while (fold.Samples(matrix) > 0) {
+      for (index_t j = 0; j < matrix->row_length; ++j) {
+        int row = static_cast<int>(matrix->Y[j]);
+        EXPECT_GE(row, begin);
+        EXPECT_LT(row, end);
+        EXPECT_EQ(matrix->GetRow(j).size(), 2);
+        count[row]++;
+      }
+    }
+  }
+  // Each row is sampled by one fold
+  for (int i = 0; i < kNumRows; ++i) {
+    EXPECT_EQ(count[i], 1);
+  }
+  EXPECT_EQ(stats.num_row, data.Stats().num_row);
+  EXPECT_EQ(stats.num_node, data.Stats().num_node);
+  EXPECT_EQ(stats.max_feat, data.Stats().max_feat);
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+TEST(ReaderTest, NegativeSampling) {
+  // Every 10th row is positive, and the feature id of
+  // each row is its row id
+  string filename = kTestfilename + "_neg.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 10000;
+  for (int i = 0; i < kNumRows; ++i) {
+    string line = StringPrintf("%d %d:1\n", i % 10 == 0 ? 1 : 0, i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  for (int round = 0; round < 2; ++round) {
+    // The second round reads the binary cache
+    InmemReader reader;
+    reader.SetNegSample(0.2);
+    reader.Initialize(filename, kNumSamples);
+    int num_pos = 0, num_neg = 0;
+    std::vector<int> count(kNumRows, 0);
+    DMatrix* matrix = nullptr;
+    while (reader.Samples(matrix) > 0) {
+      for (index_t j = 0; j < matrix->row_length; ++j) {
+        int row = matrix->GetRow(j).begin()->feat_id;
+        EXPECT_EQ(matrix->Y[j] > 0, row % 10 == 0);
+        count[row]++;
+        if (matrix->Y[j] > 0) { num_pos++; } else { num_neg++; }
+      }
+    }
+    // All the positives are kept, and about 20% of the negatives
+    EXPECT_EQ(num_pos, kNumRows / 10);
+    EXPECT_NEAR(num_neg, kNumRows * 0.9 * 0.2, 200);
+    EXPECT_EQ(reader.Stats().num_row, num_pos + num_neg);
+    EXPECT_EQ(reader.Stats().num_positive, num_pos);
+    for (int i = 0; i < kNumRows; ++i) {
+      EXPECT_LE(count[i], 1);
+    }
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+TEST(ReaderTest, Dedup) {
+  // The feature id of row i is i % 100 and the label is
+  // i % 3 == 0, so there are 100 * 2 unique rows at most
+  string filename = kTestfilename + "_dedup.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 10000;
+  std::map<std::pair<int, int>, real_t> expected;
+  for (int i = 0; i < kNumRows; ++i) {
+    int y = i % 3 == 0 ? 1 : 0;
+    // A weighted row is summed by its weight
+    string line = i == 7 ?
+      StringPrintf("%d@3 %d:1\n", y, i % 100) :
+      StringPrintf("%d %d:1\n", y, i % 100);
+    expected[std::make_pair(i % 100, y)] += i == 7 ? 3 : 1;
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  for (int round = 0; round < 3; ++round) {
+    // The second round reads the binary cache, and
+    // the third round uses the compact encoding
+    InmemReader reader;
+    reader.SetDedup(true);
+    reader.SetCompact(round == 2);
+    reader.Initialize(filename, kNumSamples);
+    std::map<std::pair<int, int>, real_t> weight;
+    DMatrix* matrix = nullptr;
+    int num_row = 0;
+    while (reader.Samples(matrix) > 0) {
+      for (index_t j = 0; j < matrix->row_length; ++j) {
+        int feat = matrix->GetRow(j).begin()->feat_id;
+        auto key = std::make_pair(feat, (int)matrix->Y[j]);
+        EXPECT_EQ(weight.count(key), 0);
+        weight[key] = matrix->RowWeight(j);
+        num_row++;
+      }
+    }
+    EXPECT_EQ(num_row, expected.size());
+    EXPECT_EQ(reader.Stats().num_row, expected.size());
+    EXPECT_TRUE(weight == expected);
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+// The cache of the sorted rows is not used by the reader of
+// the unsorted rows, and vice versa
+TEST(ReaderTest, SortedCache) {
+  string filename = kTestfilename + "_sorted.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < 1000; ++i) {
+    string line = StringPrintf("1 2:%d:1 1:%d:1 0:%d:1\n", i, i + 1, i + 2);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  bool sort[] = { true, true, false, true };
+  for (int round = 0; round < 4; ++round) {
+    InmemReader reader;
+    reader.SetSortRows(sort[round]);
+    reader.Initialize(filename, kNumSamples);
+    DMatrix* matrix = nullptr;
+    int num_row = 0;
+    while (reader.Samples(matrix) > 0) {
+      for (index_t j = 0; j < matrix->row_length; ++j) {
+        RowView row = matrix->GetRow(j);
+        ASSERT_EQ(row.size(), 3);
+        EXPECT_EQ(row[0].field_id, sort[round] ? 0 : 2);
+        EXPECT_EQ(row[2].field_id, sort[round] ? 2 : 0);
+        num_row++;
+      }
+    }
+    EXPECT_EQ(num_row, 1000);
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+TEST(ReaderTest, TokenFile) {
+  string filename = kTestfilename + "_token.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < 1000; ++i) {
+    string line = StringPrintf("%d 0=user_%d 1=site_%d.com\n",
+                               i % 2, i, i % 10);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  const index_t kBucket = 100;
+  InmemReader reader;
+  reader.SetHashBucket(kBucket);
+  reader.Initialize(filename, kNumSamples);
+  DMatrix* matrix = nullptr;
+  int num_row = 0;
+  while (reader.Samples(matrix) > 0) {
+    for (index_t j = 0; j < matrix->row_length; ++j) {
+      RowView row = matrix->GetRow(j);
+      ASSERT_EQ(row.size(), 2);
+      EXPECT_EQ(row[1].field_id, 1);
+      EXPECT_LT(row[1].feat_id, kBucket);
+      num_row++;
+    }
+  }
+  EXPECT_EQ(num_row, 1000);
+  EXPECT_EQ(reader.Stats().num_positive, 500);
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+TEST(ReaderTest, FieldGroupsCache) {
+  string filename = kTestfilename + "_groups.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (int i = 0; i < 1000; ++i) {
+    string line = StringPrintf("1 0:%d:1 1:%d:1 2:%d:1\n", i, i + 1, i + 2);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  // The fields 0 and 1 are in the group 0, and
+  // the field 2 is in the group of the others
+  FieldGroups groups;
+  groups.Set(0, 0);
+  groups.Set(1, 0);
+  bool grouped[] = { false, true, true, false };
+  for (int round = 0; round < 4; ++round) {
+    InmemReader reader;
+    reader.SetFieldGroups(grouped[round] ? groups : FieldGroups());
+    reader.Initialize(filename, kNumSamples);
+    DMatrix* matrix = nullptr;
+    int num_row = 0;
+    while (reader.Samples(matrix) > 0) {
+      for (index_t j = 0; j < matrix->row_length; ++j) {
+        RowView row = matrix->GetRow(j);
+        ASSERT_EQ(row.size(), 3);
+        EXPECT_EQ(row[0].field_id, 0);
+        EXPECT_EQ(row[1].field_id, grouped[round] ? 0 : 1);
+        EXPECT_EQ(row[2].field_id, grouped[round] ? 1 : 2);
+        num_row++;
+      }
+    }
+    EXPECT_EQ(num_row, 1000);
+    EXPECT_EQ(reader.Stats().max_field, grouped[round] ? 1 : 2);
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+// Read the feature ids of all the rows of the reader
+void read_row_ids(Reader* reader, std::vector<int>* count) {
+  DMatrix* matrix = nullptr;
+  reader->Reset();
+  while (reader->Samples(matrix) > 0) {
+    for (index_t j = 0; j < matrix->row_length; ++j) {
+      (*count)[matrix->GetRow(j).begin()->feat_id]++;
+    }
+  }
+}
+
+TEST(ReaderTest, Shard) {
+  // The feature id of each row is its row id
+  string filename = kTestfilename + "_shard.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 10000;
+  const int kNumShards = 3;
+  for (int i = 0; i < kNumRows; ++i) {
+    string line = StringPrintf("%d %d:1\n", i % 2, i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  for (int round = 0; round < 2; ++round) {
+    // The first round parses the byte ranges of the txt
+    // file, and the second round reads the binary cache
+    std::vector<int> count(kNumRows, 0);
+    for (int k = 0; k < kNumShards; ++k) {
+      InmemReader reader;
+      reader.SetShard(k, kNumShards);
+      reader.Initialize(filename, kNumSamples);
+      // The byte ranges have about the same number of rows
+      EXPECT_GT(reader.Stats().num_row, kNumRows / kNumShards - 200);
+      EXPECT_LT(reader.Stats().num_row, kNumRows / kNumShards + 200);
+      read_row_ids(&reader, &count);
+    }
+    for (int i = 0; i < kNumRows; ++i) {
+      EXPECT_EQ(count[i], 1);
+    }
+    // The shard never writes the binary cache
+    EXPECT_EQ(FileExist((filename + ".bin").c_str()), round == 1);
+    if (round == 0) {
+      InmemReader reader;
+      reader.Initialize(filename, kNumSamples);
+    }
+  }
+  for (int round = 0; round < 2; ++round) {
+    // The first round converts the shards, and the second
+    // round reads the blocks of the whole binary file
+    std::vector<int> count(kNumRows, 0);
+    for (int k = 0; k < kNumShards; ++k) {
+      OndiskReader reader;
+      reader.SetShard(k, kNumShards);
+      reader.Initialize(filename, kNumSamples);
+      read_row_ids(&reader, &count);
+      string shard_file = filename +
+        StringPrintf(".disk.%dof%d", k, kNumShards);
+      EXPECT_EQ(FileExist(shard_file.c_str()), round == 0);
+      if (round == 0) { RemoveFile(shard_file.c_str()); }
+    }
+    for (int i = 0; i < kNumRows; ++i) {
+      EXPECT_EQ(count[i], 1);
+    }
+    if (round == 0) {
+      OndiskReader reader;
+      reader.Initialize(filename, kNumSamples);
+    }
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+  RemoveFile((filename + ".disk").c_str());
+}
+
+TEST(ReaderTest, RowProb) {
+  // The feature id of each row is its row id
+  string filename = kTestfilename + "_prob.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 10000;
+  for (int i = 0; i < kNumRows; ++i) {
+    string line = StringPrintf("%d %d:1\n", i % 2, i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  InmemReader reader;
+  reader.Initialize(filename, kNumSamples);
+  // The even rows are all kept, and a quarter of the odd rows
+  std::vector<real_t> prob(kNumRows);
+  for (int i = 0; i < kNumRows; ++i) { prob[i] = i % 2 ? 0.25 : 1; }
+  reader.SetRowProb(prob);
+  int num_even = 0, num_odd = 0;
+  DMatrix* matrix = nullptr;
+  while (reader.Samples(matrix) > 0) {
+    for (index_t j = 0; j < matrix->row_length; ++j) {
+      index_t row = matrix->GetRow(j).begin()->feat_id;
+      EXPECT_EQ(reader.SampleIds()[j], row);
+      EXPECT_FLOAT_EQ(matrix->RowWeight(j), 1.0 / prob[row]);
+      if (row % 2) { num_odd++; } else { num_even++; }
+    }
+  }
+  EXPECT_EQ(num_even, kNumRows / 2);
+  EXPECT_NEAR(num_odd, kNumRows / 2 * 0.25, 150);
+  // The empty probability keeps all the rows
+  reader.SetRowProb(std::vector<real_t>());
+  reader.Reset();
+  int num_row = 0;
+  while (reader.Samples(matrix) > 0) {
+    EXPECT_FALSE(matrix->HasWeight());
+    num_row += matrix->row_length;
+  }
+  EXPECT_EQ(num_row, kNumRows);
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+// The batch size is changed inside an epoch, and the epoch
+// still has all the rows once
+TEST(ReaderTest, SetBatchSize) {
+  // The feature id of each row is its row id
+  string filename = kTestfilename + "_batch.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 1000;
+  for (int i = 0; i < kNumRows; ++i) {
+    string line = StringPrintf("%d %d:1\n", i % 2, i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  InmemReader reader;
+  reader.Initialize(filename, 100);
+  std::vector<int> count(kNumRows, 0);
+  DMatrix* matrix = nullptr;
+  EXPECT_EQ(reader.Samples(matrix), 100);
+  EXPECT_TRUE(reader.SetBatchSize(30));
+  EXPECT_EQ(reader.Samples(matrix), 30);
+  EXPECT_TRUE(reader.SetBatchSize(500));
+  EXPECT_EQ(reader.Samples(matrix), 500);
+  reader.Reset();
+  int num_row = 0;
+  index_t rows = 0;
+  while ((rows = reader.Samples(matrix)) > 0) {
+    EXPECT_LE(rows, 500);
+    for (index_t j = 0; j < rows; ++j) {
+      count[matrix->GetRow(j).begin()->feat_id]++;
+    }
+    num_row += rows;
+  }
+  EXPECT_EQ(num_row, kNumRows);
+  for (int i = 0; i < kNumRows; ++i) { EXPECT_EQ(count[i], 1); }
+  // The blocks of the binary file of the on-disk Reader are fixed
+  OndiskReader disk_reader;
+  EXPECT_FALSE(disk_reader.SetBatchSize(30));
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+// The rows of a batch that share their hot feature are adjacent,
+// and each epoch still has all the rows once
+TEST(ReaderTest, GroupRows) {
+  // Feature 1 is in all the rows, 10 ~ 13 are the hot features,
+  // and 1000 + i is the row id of the i-th row
+  string filename = kTestfilename + "_group.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 1000;
+  for (int i = 0; i < kNumRows; ++i) {
+    string line = StringPrintf("%d 1:1 %d:1 %d:1\n", i % 2,
+                               10 + i % 4, 1000 + i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  for (int compact = 0; compact < 2; ++compact) {
+    InmemReader reader;
+    reader.SetCompact(compact);
+    reader.SetGroupRows(2);
+    reader.Initialize(filename, 100);
+    EXPECT_EQ(reader.RowGroups().size(), kNumRows);
+    std::vector<int> count(kNumRows, 0);
+    DMatrix* matrix = nullptr;
+    index_t rows = 0;
+    while ((rows = reader.Samples(matrix)) > 0) {
+      std::vector<int> hot;
+      for (index_t j = 0; j < rows; ++j) {
+        index_t id = reader.SampleIds()[j];
+        count[id]++;
+        // The nodes are in the order of the txt file
+        std::vector<Node> nodes;
+        const char* data = nullptr;
+        uint64 size = 0;
+        matrix->RowData(j, &data, &size);
+        if (matrix->is_compact) {
+          DecodeCompactRow((const uint8*)data,
+                           (const uint8*)data + size, nodes);
+        } else {
+          nodes.assign((const Node*)data, (const Node*)(data + size));
+        }
+        ASSERT_EQ(nodes.size(), 3);
+        EXPECT_EQ(nodes[2].feat_id, 1000 + id);
+        EXPECT_EQ(nodes[1].feat_id, 10 + id % 4);
+        if (hot.empty() || hot.back() != nodes[1].feat_id) {
+          hot.push_back(nodes[1].feat_id);
+        }
+      }
+      // One run of each hot feature
+      std::sort(hot.begin(), hot.end());
+      EXPECT_TRUE(std::unique(hot.begin(), hot.end()) == hot.end());
+    }
+    for (int i = 0; i < kNumRows; ++i) { EXPECT_EQ(count[i], 1); }
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+// Each epoch of the shuffled copy has all the rows in another
+// order, and the ids of the rows are still their ids in the file
+TEST(ReaderTest, ShuffleCopy) {
+  // The feature id of each row is its row id
+  string filename = kTestfilename + "_copy.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const int kNumRows = 10000;
+  for (int i = 0; i < kNumRows; ++i) {
+    string line = StringPrintf("%d %d:%d\n", i % 2, i, i % 7);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  for (int round = 0; round < 2; ++round) {
+    // The second round uses the compact encoding
+    InmemReader reader;
+    reader.SetShuffleCopy(true);
+    reader.SetCompact(round == 1);
+    reader.Initialize(filename, kNumSamples);
+    std::vector<index_t> last;
+    for (int epoch = 0; epoch < 4; ++epoch) {
+      std::vector<index_t> rows;
+      std::vector<int> count(kNumRows, 0);
+      DMatrix* matrix = nullptr;
+      reader.Reset();
+      while (reader.Samples(matrix) > 0) {
+        // The rows of the copy are not copied again, while the
+        // compact rows are decoded
+        EXPECT_EQ(matrix->IsView(), !reader.Data().is_compact);
+        for (index_t j = 0; j < matrix->row_length; ++j) {
+          RowView row = matrix->GetRow(j);
+          index_t id = row.begin()->feat_id;
+          EXPECT_EQ(reader.SampleIds()[j], id);
+          EXPECT_EQ(matrix->Y[j], id % 2);
+          EXPECT_FLOAT_EQ(row.begin()->feat_val, id % 7);
+          count[id]++;
+          rows.push_back(id);
+        }
+      }
+      for (int i = 0; i < kNumRows; ++i) { EXPECT_EQ(count[i], 1); }
+      EXPECT_TRUE(rows != last);
+      last = rows;
+    }
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+}
+
+// Each block of rows is returned together, and the blocks and
+// the rows within each block are shuffled in each epoch
+TEST(ReaderTest, ShuffleBlock) {
+  // Use line number as label
+  std::string filename = kTestfilename + "_block.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kNum = 1000;
+  const index_t kBlock = 64;
+  for (index_t i = 0; i < kNum; ++i) {
+    std::string line = StringPrintf("%d 1:0.5\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  // The blocks of the in-memory buffer have kBlock rows, and
+  // the first epoch is in the order of file
+  InmemReader mem;
+  mem.SetShuffleBlock(kBlock);
+  mem.Initialize(filename, 100);
+  // The blocks of the binary file have 100 rows
+  OndiskReader disk;
+  disk.SetShuffleBlock(kBlock);
+  disk.Initialize(filename, 100);
+  Reader* readers[2] = { &mem, &disk };
+  index_t block_rows[2] = { kBlock, 100 };
+  for (int r = 0; r < 2; ++r) {
+    Reader& reader = *readers[r];
+    std::vector<index_t> last_order;
+    for (int n = 0; n < 3; ++n) {
+      DMatrix* matrix = nullptr;
+      std::vector<index_t> order;
+      reader.Reset();
+      while (reader.Samples(matrix)) {
+        for (index_t i = 0; i < matrix->row_length; ++i) {
+          order.push_back((index_t)matrix->Y[i]);
+        }
+      }
+      ASSERT_EQ(order.size(), kNum);
+      EXPECT_NE(order, last_order);
+      last_order = order;
+      // The rows of each block are returned together
+      // and the last partial block keeps its place
+      for (index_t i = 0; i < kNum; ++i) {
+        index_t first = order[i - i % block_rows[r]];
+        EXPECT_EQ(order[i] / block_rows[r], first / block_rows[r]);
+        if (i / block_rows[r] == kNum / block_rows[r]) {
+          EXPECT_EQ(order[i] / block_rows[r], kNum / block_rows[r]);
+        }
+      }
+      // Each row is returned once
+      std::sort(order.begin(), order.end());
+      for (index_t i = 0; i < kNum; ++i) {
+        EXPECT_EQ(order[i], i);
+      }
+    }
+  }
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+  RemoveFile((filename + ".disk").c_str());
+}
+
+// The order of each epoch is shuffled by the parts of the parallel
+// shuffle, and it is the same for the same seed of any threads
+TEST(ReaderTest, ParallelShuffle) {
+  const index_t kNum = 50000;
+  std::vector<Node> node(kNum);
+  std::vector<uint64> offset(kNum + 1, 0);
+  std::vector<real_t> label(kNum, 1);
+  for (index_t i = 0; i < kNum; ++i) {
+    node[i].feat_id = i;
+    node[i].feat_val = 1;
+    offset[i + 1] = i + 1;
+  }
+  std::vector<index_t> orders[2];
+  for (int r = 0; r < 2; ++r) {
+    srand(11);
+    InmemReader reader;
+    reader.SetThreadNumber(r == 0 ? 1 : 4);
+    reader.InitializeRows(node.data(), offset.data(), label.data(),
+                          kNum, 1000);
+    std::vector<index_t> last;
+    for (int epoch = 0; epoch < 3; ++epoch) {
+      std::vector<index_t> rows;
+      DMatrix* matrix = nullptr;
+      reader.Reset();
+      while (reader.Samples(matrix)) {
+        for (index_t i = 0; i < matrix->row_length; ++i) {
+          EXPECT_EQ(matrix->GetRow(i).begin()->feat_id,
+                    reader.SampleIds()[i]);
+          rows.push_back(reader.SampleIds()[i]);
+        }
+      }
+      ASSERT_EQ(rows.size(), kNum);
+      EXPECT_NE(rows, last);
+      last = rows;
+      orders[r].insert(orders[r].end(), rows.begin(), rows.end());
+      // Each row is returned once
+      std::sort(rows.begin(), rows.end());
+      for (index_t i = 0; i < kNum; ++i) { EXPECT_EQ(rows[i], i); }
+    }
+  }
+  EXPECT_EQ(orders[0], orders[1]);
+}
+
+// The rows of the reader that loads the state in the middle of
+// an epoch follow the rows of the reader that saved it, including
+// the shuffles of the next epochs
+TEST(ReaderTest, SaveState) {
+  // Use line number as label
+  std::string filename = kTestfilename + "_state.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  const index_t kNum = 1000;
+  for (index_t i = 0; i < kNum; ++i) {
+    std::string line = StringPrintf("%d 1:0.5\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  file = OpenFileOrDie((filename + ".half").c_str(), "w");
+  for (index_t i = 0; i < kNum / 2; ++i) {
+    std::string line = StringPrintf("%d 1:0.5\n", i);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  // Read all the rows of the epochs from the current position
+  auto read_rows = [](Reader* reader, int epochs) {
+    std::vector<index_t> rows;
+    DMatrix* matrix = nullptr;
+    for (int n = 0; n < epochs; ++n) {
+      while (reader->Samples(matrix)) {
+        for (index_t i = 0; i < matrix->row_length; ++i) {
+          rows.push_back((index_t)matrix->Y[i]);
+        }
+      }
+      reader->Reset();
+    }
+    return rows;
+  };
+  for (int block = 0; block < 2; ++block) {
+    InmemReader reader;
+    reader.SetShuffleBlock(block * 64);
+    reader.Initialize(filename, 100);
+    read_rows(&reader, 2);
+    DMatrix* matrix = nullptr;
+    for (int i = 0; i < 3; ++i) { reader.Samples(matrix); }
+    std::string state;
+    ASSERT_TRUE(reader.SaveState(&state));
+    std::vector<index_t> expected = read_rows(&reader, 3);
+    InmemReader resumed;
+    resumed.SetShuffleBlock(block * 64);
+    resumed.Initialize(filename, 100);
+    ASSERT_TRUE(resumed.LoadState(state));
+    std::vector<index_t> rows = read_rows(&resumed, 3);
+    EXPECT_EQ(rows.size(), kNum * 3 - 300);
+    EXPECT_EQ(rows, expected);
+    // The state of another data is not loaded
+    InmemReader other;
+    other.Initialize(filename + ".half", 100);
+    EXPECT_FALSE(other.LoadState(state));
+    EXPECT_FALSE(other.LoadState("bad"));
+  }
+  // The shuffled copy is not supported
+  InmemReader copy;
+  copy.SetShuffleCopy(true);
+  copy.Initialize(filename, 100);
+  std::string state;
+  EXPECT_FALSE(copy.SaveState(&state));
+  RemoveFile(filename.c_str());
+  RemoveFile((filename + ".bin").c_str());
+  RemoveFile((filename + ".bin.range").c_str());
+  RemoveFile((filename + ".half").c_str());
+  RemoveFile((filename + ".half.bin").c_str());
+  RemoveFile((filename + ".half.bin.range").c_str());
+}
+
+// The online file is tailed until StopOnlineStreams(),
+// so this test stops all the online streams at last
+TEST(ReaderTest, SampleOnline) {
+  std::string filename = kTestfilename + "_online.txt";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  // Every 10-th row has a feature out of the limit
+  for (index_t i = 0; i < 100; ++i) {
+    std::string line = StringPrintf("%d %d:0.5\n", i,
+                                    i % 10 == 9 ? 50 : 1);
+    WriteDataToDisk(file, line.data(), line.size());
+  }
+  Close(file);
+  StreamReader reader;
+  reader.SetOnline(true);
+  reader.Initialize(filename, 300);
+  reader.SetLimits(10, 0);
+  reader.Reset();
+  // The rows that have arrived are not a full batch
+  DMatrix* matrix = nullptr;
+  EXPECT_EQ(reader.Samples(matrix), 90);
+  EXPECT_EQ(matrix->Y[9], 10);
+  EXPECT_EQ(reader.DroppedRows(), 10);
+  // The appended rows are read from the end of file
+  file = OpenFileOrDie(filename.c_str(), "a");
+  std::string tail = "100 2:0.5\n101 3:0.5\n";
+  WriteDataToDisk(file, tail.data(), tail.size());
+  Close(file);
+  EXPECT_EQ(reader.Samples(matrix), 2);
+  EXPECT_EQ(matrix->Y[1], 101);
+  StopOnlineStreams();
+  EXPECT_EQ(reader.Samples(matrix), 0);
+  RemoveFile(filename.c_str());
+}
+
+// The feature id of each row is its row id in the dataset
+// of the parts, whose rows follow the parts before them
+TEST(ReaderTest, MultiReader) {
+  const int kNumPart = 3;
+  const int kPartRows = 1000;
+  std::vector<std::string> files;
+  std::vector<Reader*> parts;
+  for (int p = 0; p < kNumPart; ++p) {
+    std::string filename = StringPrintf("%s_part%d.txt",
+                                        kTestfilename.c_str(), p);
+    FILE* file = OpenFileOrDie(filename.c_str(), "w");
+    for (int i = 0; i < kPartRows; ++i) {
+      string line = StringPrintf("%d %d:1\n", i % 2, p * kPartRows + i);
+      WriteDataToDisk(file, line.data(), line.size());
+    }
+    Close(file);
+    files.push_back(filename);
+    parts.push_back(new InmemReader);
+  }
+  MultiReader reader(parts, files, 2);
+  reader.Initialize(kTestfilename + "_part*.txt", kNumSamples);
+  EXPECT_EQ(reader.NumParts(), kNumPart);
+  EXPECT_EQ(reader.Stats().num_row, kNumPart * kPartRows);
+  EXPECT_EQ(reader.Stats().max_feat, kNumPart * kPartRows - 1);
+  // The odd rows are dropped
+  std::vector<real_t> prob(kNumPart * kPartRows);
+  for (size_t i = 0; i < prob.size(); ++i) { prob[i] = i % 2 ? 0 : 1; }
+  reader.SetRowProb(prob);
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    std::vector<int> seen(kNumPart * kPartRows, 0);
+    reader.Reset();
+    DMatrix* matrix = nullptr;
+    while (reader.Samples(matrix) > 0) {
+      for (index_t j = 0; j < matrix->row_length; ++j) {
+        index_t row = matrix->GetRow(j).begin()->feat_id;
+        EXPECT_EQ(reader.SampleIds()[j], row);
+        seen[row]++;
+      }
+    }
+    for (size_t i = 0; i < seen.size(); ++i) {
+      EXPECT_EQ(seen[i], i % 2 ? 0 : 1);
+    }
+  }
+  for (int p = 0; p < kNumPart; ++p) {
+    RemoveFile(files[p].c_str());
+    RemoveFile((files[p] + ".bin").c_str());
+    RemoveFile((files[p] + ".bin.range").c_str());
+  }
+}
+
+// The rows of each part are weighted by the weight of its
+// Reader, and the binary caches keep the weights of the txt files
+TEST(ReaderTest, MultiReaderWeight) {
+  const int kNumPart = 3;
+  const int kPartRows = 100;
+  const real_t kWeight[kNumPart] = {0.25, 0.5, 1.0};
+  std::vector<std::string> files;
+  for (int p = 0; p < kNumPart; ++p) {
+    std::string filename = StringPrintf("%s_day%d.txt",
+                                        kTestfilename.c_str(), p);
+    FILE* file = OpenFileOrDie(filename.c_str(), "w");
+    for (int i = 0; i < kPartRows; ++i) {
+      // A weighted row keeps its weight
+      string line = i == 7 ?
+        StringPrintf("%d@2 %d:1\n", i % 2, p * kPartRows + i) :
+        StringPrintf("%d %d:1\n", i % 2, p * kPartRows + i);
+      WriteDataToDisk(file, line.data(), line.size());
+    }
+    Close(file);
+    files.push_back(filename);
+  }
+  // The second round reads the binary caches
+  for (int round = 0; round < 2; ++round) {
+    std::vector<Reader*> parts;
+    for (int p = 0; p < kNumPart; ++p) {
+      parts.push_back(new InmemReader);
+      parts[p]->SetRowWeight(kWeight[p]);
+    }
+    MultiReader reader(parts, files, 2);
+    reader.Initialize(kTestfilename + "_day*.txt", kNumSamples);
+    reader.Reset();
+    DMatrix* matrix = nullptr;
+    int num_row = 0;
+    while (reader.Samples(matrix, false) > 0) {
+      for (index_t j = 0; j < matrix->row_length; ++j) {
+        index_t feat = matrix->GetRow(j).begin()->feat_id;
+        real_t expect = kWeight[feat / kPartRows] *
+                        (feat % kPartRows == 7 ? 2 : 1);
+        EXPECT_FLOAT_EQ(matrix->RowWeight(j), expect);
+        num_row++;
+      }
+    }
+    EXPECT_EQ(num_row, kNumPart * kPartRows);
+  }
+  for (int p = 0; p < kNumPart; ++p) {
+    RemoveFile(files[p].c_str());
+    RemoveFile((files[p] + ".bin").c_str());
+    RemoveFile((files[p] + ".bin.range").c_str());
+  }
+}
+
+// The errors are returned instead of exiting the program
+TEST(ReaderTest, CheckFile) {
+  std::string format, error;
+  bool has_label = false;
+  EXPECT_TRUE(Reader::DetectFormat(kStr, 0, &format, &has_label, &error));
+  EXPECT_EQ(format, "libsvm");
+  EXPECT_TRUE(has_label);
+  EXPECT_TRUE(Reader::DetectFormat(kStrFFMNoy, 0, &format,
+                                   &has_label, &error));
+  EXPECT_EQ(format, "libffm");
+  EXPECT_FALSE(has_label);
+  EXPECT_TRUE(Reader::DetectFormat(kStrCSV, 0, &format, &has_label, &error));
+  EXPECT_EQ(format, "csv");
+  string filename = kTestfilename + "_check.txt";
+  EXPECT_FALSE(Reader::CheckFile(filename, 0, false, &error));
+  write_data(filename, kStr);
+  EXPECT_TRUE(Reader::CheckFile(filename, 0, false, &error));
+  // Only the csv file is dense
+  EXPECT_FALSE(Reader::CheckFile(filename, 0, true, &error));
+  EXPECT_FALSE(error.empty());
+  write_data(filename, "");
+  EXPECT_FALSE(Reader::CheckFile(filename, 0, false, &error));
+  RemoveFile(filename.c_str());
+}
+
 TEST(READER_TEST, CreateReader) {
   EXPECT_TRUE(CreateReader("memory") != NULL);
   EXPECT_TRUE(CreateReader("disk") != NULL);
+  EXPECT_TRUE(CreateReader("stream") != NULL);
   EXPECT_TRUE(CreateReader("") == NULL);
   EXPECT_TRUE(CreateReader("unknow_name") == NULL);
 }
@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the bench_predict tool, which measures the
+latency of scoring one row, and the throughput of scoring the rows in
+batches, by the real Score kernels on synthetic models and rows:
+
+  bench_predict [ options ]
+
+Each line of the report is one setting of the score function, the
+number of nodes of a row (nnz), the K and the number of fields.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/stringprintf.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/bench_util.h"
+#include "src/score/score_function.h"
+
+namespace xLearn {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     bench_predict [ options ] \n"
+"                                \n"
+"  Report the p50 and p99 latency of scoring one row, and the rows per second of scoring \n"
+"  one row at a time and of scoring the rows in batches (as xlearn_predict does). \n"
+"                                                                               \n"
+"OPTIONS: \n"
+"  -s <score_func>      :  'linear', 'fm', 'ffm' or 'all'. Using 'all' by default. \n"
+"                                                                                \n"
+"  -nnz <list>          :  Comma-separated numbers of nodes of a row. Using '16,64,256' by default. \n"
+"                                                                                \n"
+"  -k <list>            :  Comma-separated K of fm and ffm. Using '4,16,32' by default. \n"
+"                                                                                \n"
+"  -f <list>            :  Comma-separated numbers of fields of ffm. Using '8,24' by default. \n"
+"                                                                                \n"
+"  -feat <number>       :  Number of features of the model. Using 50000 by default. \n"
+"                                                                                \n"
+"  -n <number>          :  Number of rows scored in each measurement. Using 20000 by default. \n"
+"                                                                                \n"
+"  -b <number>          :  Number of rows of each batch. Using 256 by default. \n"
+"                                                                                \n"
+"  -v <latent_type>     :  Storage of the latent factor, which could be 'fp32', 'fp16', 'bf16' \n"
+"                          or 'int8'. Using 'fp32' by default. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+// Number of distinct rows, which are scored in turn
+const index_t kNumRows = 4096;
+
+struct BenchOption {
+  std::vector<std::string> score_func = { "linear", "fm", "ffm" };
+  std::vector<index_t> nnz = { 16, 64, 256 };
+  std::vector<index_t> num_K = { 4, 16, 32 };
+  std::vector<index_t> num_field = { 8, 24 };
+  index_t num_feature = 50000;
+  index_t num_scored = 20000;
+  index_t batch_size = 256;
+  std::string latent_type = "fp32";
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], BenchOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (i + 1 == argc) {
+      printf("[Error] The option %s needs a value \n", argv[i]);
+      return false;
+    }
+    std::string value(argv[++i]);
+    bool bo = true;
+    if (arg == "-s") {
+      if (value == "all") {
+        option->score_func = { "linear", "fm", "ffm" };
+      } else if (value == "linear" || value == "fm" || value == "ffm") {
+        option->score_func = { value };
+      } else {
+        bo = false;
+      }
+    } else if (arg == "-nnz") {
+      bo = ParseBenchList(value, &option->nnz);
+    } else if (arg == "-k") {
+      bo = ParseBenchList(value, &option->num_K);
+    } else if (arg == "-f") {
+      bo = ParseBenchList(value, &option->num_field);
+    } else if (arg == "-feat") {
+      option->num_feature = atoi(value.c_str());
+      bo = atoi(value.c_str()) > 0;
+    } else if (arg == "-n") {
+      option->num_scored = atoi(value.c_str());
+      bo = atoi(value.c_str()) > 0;
+    } else if (arg == "-b") {
+      option->batch_size = atoi(value.c_str());
+      bo = atoi(value.c_str()) > 0;
+    } else if (arg == "-v") {
+      option->latent_type = value;
+      bo = value == "fp32" || value == "fp16" ||
+           value == "bf16" || value == "int8";
+    } else {
+      printf("[Error] Unknow option: %s \n", arg.c_str());
+      return false;
+    }
+    if (!bo) {
+      printf("[Error] Illegal %s : '%s' \n", arg.c_str(), value.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Measure one setting and print one line of the report
+void bench(const BenchOption& option, const std::string& score_func,
+           index_t nnz, index_t num_K, index_t num_field) {
+  static std::mt19937 gen(2018);
+  Model model;
+  model.Initialize(score_func, "cross-entropy", option.num_feature,
+                   num_field, num_K);
+  model.ConvertLatent(option.latent_type);
+  Score* score = CreateBenchScore(model);
+  DMatrix matrix;
+  MakeBenchRows(kNumRows, nnz, option.num_feature,
+                num_field, &gen, &matrix);
+  // Warm up the model in cache as far as it fits
+  volatile real_t sink = 0;
+  for (index_t i = 0; i < kNumRows; ++i) {
+    sink = sink + score->CalcScore(matrix.GetRow(i), model,
+                                   matrix.norm[i]);
+  }
+  // Single row, and each row is timed
+  std::vector<double> latency(option.num_scored);
+  double start = BenchNowUs();
+  for (index_t n = 0; n < option.num_scored; ++n) {
+    index_t i = n % kNumRows;
+    double begin = BenchNowUs();
+    sink = sink + score->CalcScore(matrix.GetRow(i), model,
+                                   matrix.norm[i]);
+    latency[n] = BenchNowUs() - begin;
+  }
+  double single_sec = (BenchNowUs() - start) / 1e6;
+  // Batches of consecutive rows
+  std::vector<real_t> out(option.batch_size);
+  index_t num_batched = 0;
+  start = BenchNowUs();
+  while (num_batched < option.num_scored) {
+    index_t begin = num_batched % kNumRows;
+    index_t end = std::min(begin + option.batch_size, kNumRows);
+    score->CalcScoreBatch(&matrix, begin, end, model, true, out.data());
+    sink = sink + out[0];
+    num_batched += end - begin;
+  }
+  double batch_sec = (BenchNowUs() - start) / 1e6;
+  std::sort(latency.begin(), latency.end());
+  size_t p99 = std::min(latency.size() - 1,
+                        (size_t)(latency.size() * 0.99));
+  printf("%-8s %6u %4s %6s %10.2f %10.2f %14.0f %14.0f \n",
+         score_func.c_str(), nnz,
+         score_func == "linear" ? "-" : StringPrintf("%u", num_K).c_str(),
+         score_func == "ffm" ? StringPrintf("%u", num_field).c_str() : "-",
+         latency[latency.size() / 2], latency[p99],
+         option.num_scored / single_sec, num_batched / batch_sec);
+  fflush(stdout);
+  delete score;
+  model.Release();
+}
+
+}  // namespace xLearn
+
+//------------------------------------------------------------------------------
+// The latency includes the overhead of reading the clock, which is about
+// tens of nanoseconds. The rows per second of single rows are measured
+// in the same loop, so the batch path shows what the prefetching and the
+// hoisted setup of CalcScoreBatch() save
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  xLearn::BenchOption option;
+  if (!xLearn::parse_option(argc, argv, &option)) {
+    printf("%s", xLearn::kUsage);
+    return 0;
+  }
+  printf("Features: %u, latent type: %s, rows: %u, batch size: %u \n",
+         option.num_feature, option.latent_type.c_str(),
+         option.num_scored, option.batch_size);
+  printf("%-8s %6s %4s %6s %10s %10s %14s %14s \n",
+         "score", "nnz", "K", "field", "p50(us)", "p99(us)",
+         "rows/s(single)", "rows/s(batch)");
+  for (size_t s = 0; s < option.score_func.size(); ++s) {
+    const std::string& score_func = option.score_func[s];
+    std::vector<xLearn::index_t> one = { 1 };
+    const std::vector<xLearn::index_t>& num_K =
+      score_func == "linear" ? one : option.num_K;
+    const std::vector<xLearn::index_t>& num_field =
+      score_func == "ffm" ? option.num_field : one;
+    for (size_t i = 0; i < option.nnz.size(); ++i) {
+      for (size_t k = 0; k < num_K.size(); ++k) {
+        for (size_t f = 0; f < num_field.size(); ++f) {
+          xLearn::bench(option, score_func, option.nnz[i],
+                num_K[k], num_field[f]);
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,292 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the bench_score tool, which times CalcScore()
+and CalcGrad() of LinearScore, FMScore and FFMScore over the settings
+of nnz, K, the number of fields and the size of model, and writes one
+CSV line for each setting:
+
+  bench_score [ options ] > result.csv
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/bench_util.h"
+#include "src/score/score_function.h"
+
+namespace xLearn {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     bench_score [ options ] \n"
+"                              \n"
+"  Write the CSV of score,op,nnz,k,field,memory,model_kb,ns_row,ns_pair,gflops,layout for each \n"
+"  setting, where op is 'score' (CalcScore) or 'grad' (CalcGrad). The model size of the \n"
+"  'l2' memory fits the L2 cache, and the 'dram' one is much larger than the last level \n"
+"  cache. The pairs are the nodes of linear, and the feature pairs of fm and ffm. The \n"
+"  gflops is given by the nominal floating-point operations of the row. \n"
+"                                                                      \n"
+"OPTIONS: \n"
+"  -s <score_func>      :  'linear', 'fm', 'ffm' or 'all'. Using 'all' by default. \n"
+"                                                                                \n"
+"  -op <op>             :  'score', 'grad' or 'all'. Using 'all' by default. \n"
+"                                                                                \n"
+"  -nnz <list>          :  Comma-separated numbers of nodes of a row. Using '16,64,256' by default. \n"
+"                                                                                \n"
+"  -k <list>            :  Comma-separated K of fm and ffm. Using '4,16,32' by default. \n"
+"                                                                                \n"
+"  -f <list>            :  Comma-separated numbers of fields of ffm. Using '8,24' by default. \n"
+"                                                                                \n"
+"  -mem <memory>        :  'l2', 'dram' or 'all'. Using 'all' by default. \n"
+"                                                                                \n"
+"  -l2 <size>           :  Model size (KB) of the 'l2' memory. Using 256 by default. \n"
+"                                                                                \n"
+"  -dram <size>         :  Model size (MB) of the 'dram' memory. Using 256 by default. \n"
+"                                                                                \n"
+"  -n <number>          :  Number of rows in each measurement. Using 20000 by default. \n"
+"                                                                                \n"
+"  -layout <layout>     :  Latent block layout of ffm, 'interleaved', 'split', 'split-fp16', \n"
+"                          'split-bf16', 'split-log8', 'split-shared' or 'all'. 'split-fp16', \n"
+"                          'split-bf16' and 'split-log8' store the adagrad caches in 16 or 8 \n"
+"                          bits, and 'split-shared' keeps one cache per latent vector. Using \n"
+"                          'interleaved' by default. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+// The rows of the 'l2' memory are few, so they are
+// resident in L2 cache together with the model
+const index_t kNumRowsL2 = 16;
+const index_t kNumRowsDRAM = 4096;
+
+struct BenchOption {
+  std::vector<std::string> score_func = { "linear", "fm", "ffm" };
+  std::vector<std::string> op = { "score", "grad" };
+  std::vector<std::string> memory = { "l2", "dram" };
+  std::vector<index_t> nnz = { 16, 64, 256 };
+  std::vector<index_t> num_K = { 4, 16, 32 };
+  std::vector<index_t> num_field = { 8, 24 };
+  std::vector<std::string> layout = { "interleaved" };
+  index_t l2_kb = 256;
+  index_t dram_mb = 256;
+  index_t num_rows = 20000;
+};
+
+// Parse the option of one value or 'all'
+bool parse_choice(const std::string& value,
+                  const std::vector<std::string>& all,
+                  std::vector<std::string>* list) {
+  if (value == "all") {
+    *list = all;
+    return true;
+  }
+  if (std::find(all.begin(), all.end(), value) == all.end()) {
+    return false;
+  }
+  *list = { value };
+  return true;
+}
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], BenchOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (i + 1 == argc) {
+      printf("[Error] The option %s needs a value \n", argv[i]);
+      return false;
+    }
+    std::string value(argv[++i]);
+    bool bo = true;
+    if (arg == "-s") {
+      bo = parse_choice(value, { "linear", "fm", "ffm" },
+                        &option->score_func);
+    } else if (arg == "-op") {
+      bo = parse_choice(value, { "score", "grad" }, &option->op);
+    } else if (arg == "-mem") {
+      bo = parse_choice(value, { "l2", "dram" }, &option->memory);
+    } else if (arg == "-nnz") {
+      bo = ParseBenchList(value, &option->nnz);
+    } else if (arg == "-k") {
+      bo = ParseBenchList(value, &option->num_K);
+    } else if (arg == "-f") {
+      bo = ParseBenchList(value, &option->num_field);
+    } else if (arg == "-l2") {
+      option->l2_kb = atoi(value.c_str());
+      bo = atoi(value.c_str()) > 0;
+    } else if (arg == "-dram") {
+      option->dram_mb = atoi(value.c_str());
+      bo = atoi(value.c_str()) > 0;
+    } else if (arg == "-layout") {
+      bo = parse_choice(value, { "interleaved", "split", "split-fp16",
+                                   "split-bf16", "split-log8",
+                                   "split-shared" },
+                        &option->layout);
+    } else if (arg == "-n") {
+      option->num_rows = atoi(value.c_str());
+      bo = atoi(value.c_str()) > 0;
+    } else {
+      printf("[Error] Unknow option: %s \n", arg.c_str());
+      return false;
+    }
+    if (!bo) {
+      printf("[Error] Illegal %s : '%s' \n", arg.c_str(), value.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Number of pairs of one row, which is the unit of the work
+inline double num_pairs(const std::string& score_func, index_t nnz) {
+  if (score_func == "linear") { return nnz; }
+  return std::max(1.0, nnz * (nnz - 1) / 2.0);
+}
+
+// The nominal floating-point operations of one row. The linear term
+// takes a multiply-add per node in the score, and the adagrad update
+// of the weight and its cache takes about 4 more in the gradient. fm
+// takes the sum and the squared sum of v * x in the score, and the
+// update of each element of the latent vectors in the gradient. ffm
+// takes a dot product for each feature pair in the score, and the
+// update of both latent vectors of the pair in the gradient
+inline double nominal_flops(const std::string& score_func,
+                            const std::string& op,
+                            index_t nnz, index_t k) {
+  bool grad = op == "grad";
+  double flops = (grad ? 6.0 : 2.0) * nnz;
+  if (score_func == "fm") {
+    flops += (grad ? 8.0 : 4.0) * k * nnz;
+  } else if (score_func == "ffm") {
+    flops += (grad ? 12.0 : 2.0) * k * num_pairs(score_func, nnz);
+  }
+  return flops;
+}
+
+// Measure one setting and write one CSV line
+void bench(const BenchOption& option, const std::string& score_func,
+           const std::string& memory, index_t nnz,
+           index_t num_K, index_t num_field, LatentLayout layout) {
+  static std::mt19937 gen(2018);
+  // Size of the model parameters of one feature (without bias)
+  Model probe;
+  probe.Initialize(score_func, "cross-entropy", 1, num_field, num_K);
+  uint64 feature_bytes = (probe.GetNumParameter() - 2) *
+                         sizeof(real_t);
+  probe.Release();
+  uint64 model_bytes = memory == "l2" ?
+                       (uint64)option.l2_kb * 1024 :
+                       (uint64)option.dram_mb * 1024 * 1024;
+  index_t num_feature = std::max((uint64)1, model_bytes / feature_bytes);
+  index_t num_rows = memory == "l2" ? kNumRowsL2 : kNumRowsDRAM;
+  Model model;
+  model.SetLatentLayout(layout);
+  model.Initialize(score_func, "cross-entropy", num_feature,
+                   num_field, num_K);
+  Score* score = CreateBenchScore(model);
+  DMatrix matrix;
+  MakeBenchRows(num_rows, nnz, num_feature, num_field, &gen, &matrix);
+  volatile real_t sink = 0;
+  for (size_t o = 0; o < option.op.size(); ++o) {
+    bool grad = option.op[o] == "grad";
+    // Warm up the model in cache as far as it fits
+    for (index_t i = 0; i < num_rows; ++i) {
+      sink = sink + score->CalcScore(matrix.GetRow(i), model,
+                                     matrix.norm[i]);
+    }
+    double start = BenchNowUs();
+    for (index_t n = 0; n < option.num_rows; ++n) {
+      index_t i = n % num_rows;
+      if (grad) {
+        // The small gradients of both signs keep the model stable
+        real_t pg = (n & 1) ? 1e-3 : -1e-3;
+        score->CalcGrad(matrix.GetRow(i), model, pg, matrix.norm[i]);
+      } else {
+        sink = sink + score->CalcScore(matrix.GetRow(i), model,
+                                       matrix.norm[i]);
+      }
+    }
+    double ns_row = (BenchNowUs() - start) * 1e3 / option.num_rows;
+    printf("%s,%s,%u,%u,%u,%s,%.0f,%.2f,%.4f,%.3f,%s\n",
+           score_func.c_str(), option.op[o].c_str(), nnz,
+           score_func == "linear" ? 0 : num_K,
+           score_func == "ffm" ? num_field : 0,
+           memory.c_str(), model.GetNumParameter() *
+           sizeof(real_t) / 1024.0, ns_row,
+           ns_row / num_pairs(score_func, nnz),
+           nominal_flops(score_func, option.op[o], nnz, num_K) / ns_row,
+           score_func == "ffm" ? LatentLayoutName(layout) : "none");
+    fflush(stdout);
+  }
+  delete score;
+  model.Release();
+}
+
+}  // namespace xLearn
+
+//------------------------------------------------------------------------------
+// Each setting is measured on its own model, so the gradients of a
+// setting never change the model of another one
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  xLearn::BenchOption option;
+  if (!xLearn::parse_option(argc, argv, &option)) {
+    printf("%s", xLearn::kUsage);
+    return 0;
+  }
+  printf("score,op,nnz,k,field,memory,model_kb,"
+         "ns_row,ns_pair,gflops,layout\n");
+  for (size_t s = 0; s < option.score_func.size(); ++s) {
+    const std::string& score_func = option.score_func[s];
+    std::vector<xLearn::index_t> one = { 1 };
+    const std::vector<xLearn::index_t>& num_K =
+      score_func == "linear" ? one : option.num_K;
+    const std::vector<xLearn::index_t>& num_field =
+      score_func == "ffm" ? option.num_field : one;
+    // The layout only changes the latent blocks of ffm
+    std::vector<std::string> interleaved = { "interleaved" };
+    const std::vector<std::string>& layout =
+      score_func == "ffm" ? option.layout : interleaved;
+    for (size_t m = 0; m < option.memory.size(); ++m) {
+      for (size_t i = 0; i < option.nnz.size(); ++i) {
+        for (size_t k = 0; k < num_K.size(); ++k) {
+          for (size_t f = 0; f < num_field.size(); ++f) {
+            for (size_t l = 0; l < layout.size(); ++l) {
+              xLearn::LatentLayout latent;
+              xLearn::ParseLatentLayout(layout[l], &latent);
+              xLearn::bench(option, score_func, option.memory[m],
+                            option.nnz[i], num_K[k], num_field[f],
+                            latent);
+            }
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
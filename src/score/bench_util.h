@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the helper functions shared by the benchmarks of
+the score functions (bench_predict.cc and bench_score.cc).
+*/
+
+#ifndef XLEARN_SCORE_BENCH_UTIL_H_
+#define XLEARN_SCORE_BENCH_UTIL_H_
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/split_string.h"
+#include "src/base/stringprintf.h"
+#include "src/data/data_structure.h"
+#include "src/data/hyper_parameters.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_function.h"
+
+namespace xLearn {
+
+// Parse the comma-separated positive numbers
+inline bool ParseBenchList(const std::string& str,
+                           std::vector<index_t>* list) {
+  std::vector<std::string> items;
+  SplitStringUsing(str, ",", &items);
+  list->clear();
+  for (size_t i = 0; i < items.size(); ++i) {
+    int value = atoi(items[i].c_str());
+    if (value <= 0) { return false; }
+    list->push_back(value);
+  }
+  return !list->empty();
+}
+
+// Create the score specialized on the aligned K if there is
+// one, which is the same as xlearn_train and xlearn_predict
+inline Score* CreateBenchScore(Model& model) {
+  const std::string& score_func = model.GetScoreFunction();
+  Score* score = nullptr;
+  if (score_func != "linear") {
+    std::string name = StringPrintf("%s_k%d", score_func.c_str(),
+                                    model.get_aligned_k());
+    score = CREATE_SCORE(name.c_str());
+  }
+  if (score == nullptr) {
+    score = CREATE_SCORE(score_func.c_str());
+  }
+  CHECK_NOTNULL(score);
+  HyperParam hyper_param;
+  score->Initialize(hyper_param.learning_rate,
+                    hyper_param.regu_lambda,
+                    &model);
+  score->SetPrefetchDistance(hyper_param.prefetch_distance);
+  return score;
+}
+
+// num_rows random rows of nnz nodes in the CSR matrix, and
+// the norm of each row is 1 / nnz
+inline void MakeBenchRows(index_t num_rows, index_t nnz,
+                          index_t num_feature, index_t num_field,
+                          std::mt19937* gen, DMatrix* matrix) {
+  std::uniform_int_distribution<index_t> feat(0, num_feature - 1);
+  std::uniform_int_distribution<index_t> field(0, num_field - 1);
+  matrix->Release();
+  matrix->SetCSR(true);
+  matrix->ResetMatrix(num_rows);
+  for (index_t i = 0; i < num_rows; ++i) {
+    for (index_t j = 0; j < nnz; ++j) {
+      matrix->AddNode(i, feat(*gen), 1.0, field(*gen));
+    }
+    matrix->norm[i] = 1.0 / nnz;
+  }
+}
+
+// Current time (microseconds) of the steady clock
+inline double BenchNowUs() {
+  return std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_BENCH_UTIL_H_
@@ -0,0 +1,288 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the CUDA kernels of the FFM
+latent factor and the FFMGpu class.
+*/
+
+#include "src/score/ffm_gpu_kernel.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include <cuda_runtime.h>
+
+namespace xLearn {
+
+// Abort on the error of a CUDA call
+#define CUDA_CHECK(call) {                                  \
+    cudaError_t err = (call);                               \
+    if (err != cudaSuccess) {                               \
+      LOG(ERROR) << "CUDA error " << __FILE__ << ":"        \
+                 << __LINE__ << " " << #call << ": "        \
+                 << cudaGetErrorString(err);                \
+      abort();                                              \
+    }                                                       \
+  }
+
+// Each row is scored and updated by one block of threads
+static const int kThreads = 128;
+
+// The weight d of a block in the interleaved layout
+__device__ inline index_t weight_pos(index_t d, index_t align) {
+  return (d / align) * 2 * align + d % align;
+}
+
+// The pairs (i, j) of i < j of a row of n nodes are the cells of
+// the n x n grid above the diagonal, which are strided over the
+// threads of the block, so a short row still keeps them busy
+__global__ void ffm_score_kernel(const Node* nodes,
+                                 const uint64* offset,
+                                 const real_t* norm,
+                                 GpuLatent lat,
+                                 real_t* out) {
+  __shared__ real_t partial[kThreads];
+  uint64 row = blockIdx.x;
+  const Node* begin = nodes + offset[row];
+  uint64 n = offset[row+1] - offset[row];
+  real_t sum = 0;
+  for (uint64 t = threadIdx.x; t < n * n; t += blockDim.x) {
+    uint64 i = t / n;
+    uint64 j = t % n;
+    if (j <= i) { continue; }
+    Node a = begin[i];
+    Node b = begin[j];
+    const real_t* w1 = lat.v + (uint64)a.feat_id * lat.align1 +
+                       b.field_id * lat.align0;
+    const real_t* w2 = lat.v + (uint64)b.feat_id * lat.align1 +
+                       a.field_id * lat.align0;
+    real_t dot = 0;
+    for (index_t d = 0; d < lat.aligned_k; ++d) {
+      index_t p = weight_pos(d, lat.align);
+      dot += w1[p] * w2[p];
+    }
+    sum += dot * a.feat_val * b.feat_val;
+  }
+  partial[threadIdx.x] = sum;
+  __syncthreads();
+  for (int s = blockDim.x / 2; s > 0; s >>= 1) {
+    if (threadIdx.x < s) {
+      partial[threadIdx.x] += partial[threadIdx.x + s];
+    }
+    __syncthreads();
+  }
+  if (threadIdx.x == 0) { out[row] = partial[0] * norm[row]; }
+}
+
+// One adagrad step on the blocks of each pair, as the CPU kernel
+// (ffm_update()). The pairs of a row share their blocks, and the
+// blocks are shared by the rows, which are updated without locks
+// as the threads of the CPU do
+__global__ void ffm_grad_kernel(const Node* nodes,
+                                const uint64* offset,
+                                const real_t* norm,
+                                const real_t* pg,
+                                GpuLatent lat,
+                                real_t learning_rate,
+                                real_t regu_lambda) {
+  uint64 row = blockIdx.x;
+  real_t g = pg[row] * norm[row];
+  if (g == 0) { return; }
+  const Node* begin = nodes + offset[row];
+  uint64 n = offset[row+1] - offset[row];
+  for (uint64 t = threadIdx.x; t < n * n; t += blockDim.x) {
+    uint64 i = t / n;
+    uint64 j = t % n;
+    if (j <= i) { continue; }
+    Node a = begin[i];
+    Node b = begin[j];
+    real_t* w1 = lat.v + (uint64)a.feat_id * lat.align1 +
+                 b.field_id * lat.align0;
+    real_t* w2 = lat.v + (uint64)b.feat_id * lat.align1 +
+                 a.field_id * lat.align0;
+    real_t pgv = a.feat_val * b.feat_val * g;
+    for (index_t d = 0; d < lat.aligned_k; ++d) {
+      index_t p = weight_pos(d, lat.align);
+      index_t c = p + lat.align;
+      real_t x1 = w1[p];
+      real_t x2 = w2[p];
+      real_t g1 = regu_lambda * x1 + pgv * x2;
+      real_t g2 = regu_lambda * x2 + pgv * x1;
+      real_t c1 = w1[c] + g1 * g1;
+      real_t c2 = w2[c] + g2 * g2;
+      w1[p] = x1 - learning_rate * g1 * rsqrtf(c1);
+      w2[p] = x2 - learning_rate * g2 * rsqrtf(c2);
+      w1[c] = c1;
+      w2[c] = c2;
+    }
+  }
+}
+
+FFMGpu::FFMGpu()
+  : stream_(nullptr), host_nodes_(nullptr), host_offset_(nullptr),
+    host_norm_(nullptr), host_pg_(nullptr), host_out_(nullptr),
+    dev_nodes_(nullptr), dev_offset_(nullptr), dev_norm_(nullptr),
+    dev_pg_(nullptr), dev_out_(nullptr), cap_row_(0), cap_node_(0),
+    mapped_(nullptr), dev_v_(nullptr) {
+  CUDA_CHECK(cudaSetDeviceFlags(cudaDeviceMapHost));
+  cudaStream_t stream;
+  CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+  stream_ = stream;
+}
+
+FFMGpu::~FFMGpu() {
+  Release();
+  free_buffers();
+  cudaStreamDestroy(static_cast<cudaStream_t>(stream_));
+}
+
+std::string FFMGpu::DeviceName() {
+  int device = 0;
+  cudaDeviceProp prop;
+  if (cudaGetDevice(&device) != cudaSuccess ||
+      cudaGetDeviceProperties(&prop, device) != cudaSuccess) {
+    return "";
+  }
+  return prop.name;
+}
+
+real_t* FFMGpu::MapHost(real_t* v, uint64 num_v) {
+  if (mapped_ != v) {
+    Release();
+    CUDA_CHECK(cudaHostRegister(v, num_v * sizeof(real_t),
+                                cudaHostRegisterMapped));
+    mapped_ = v;
+  }
+  void* dev = nullptr;
+  CUDA_CHECK(cudaHostGetDevicePointer(&dev, v, 0));
+  return static_cast<real_t*>(dev);
+}
+
+real_t* FFMGpu::Upload(const real_t* v, uint64 num_v) {
+  Release();
+  size_t free_bytes = 0, total_bytes = 0;
+  CUDA_CHECK(cudaMemGetInfo(&free_bytes, &total_bytes));
+  uint64 bytes = num_v * sizeof(real_t);
+  if (bytes > free_bytes ||
+      cudaMalloc(reinterpret_cast<void**>(&dev_v_), bytes) != cudaSuccess) {
+    cudaGetLastError();
+    dev_v_ = nullptr;
+    return nullptr;
+  }
+  CUDA_CHECK(cudaMemcpy(dev_v_, v, bytes, cudaMemcpyHostToDevice));
+  return dev_v_;
+}
+
+void FFMGpu::Release() {
+  Sync();
+  // The model may have been freed before the score, and
+  // then the registration has gone with its pages
+  if (mapped_ != nullptr) {
+    cudaHostUnregister(mapped_);
+    cudaGetLastError();
+    mapped_ = nullptr;
+  }
+  if (dev_v_ != nullptr) {
+    cudaFree(dev_v_);
+    dev_v_ = nullptr;
+  }
+}
+
+void FFMGpu::free_buffers() {
+  cudaFreeHost(host_nodes_);
+  cudaFreeHost(host_offset_);
+  cudaFreeHost(host_norm_);
+  cudaFreeHost(host_pg_);
+  cudaFreeHost(host_out_);
+  cudaFree(dev_nodes_);
+  cudaFree(dev_offset_);
+  cudaFree(dev_norm_);
+  cudaFree(dev_pg_);
+  cudaFree(dev_out_);
+  host_nodes_ = dev_nodes_ = nullptr;
+  host_offset_ = dev_offset_ = nullptr;
+  host_norm_ = host_pg_ = host_out_ = nullptr;
+  dev_norm_ = dev_pg_ = dev_out_ = nullptr;
+  cap_row_ = cap_node_ = 0;
+}
+
+// The buffers only grow, by a half more than needed
+void FFMGpu::Reserve(uint64 num_row, uint64 num_node) {
+  if (num_row <= cap_row_ && num_node <= cap_node_) { return; }
+  Sync();
+  uint64 rows = std::max(cap_row_, num_row + num_row / 2);
+  uint64 nodes = std::max(cap_node_, num_node + num_node / 2);
+  free_buffers();
+  CUDA_CHECK(cudaMallocHost(&host_nodes_, nodes * sizeof(Node)));
+  CUDA_CHECK(cudaMallocHost(&host_offset_, (rows + 1) * sizeof(uint64)));
+  CUDA_CHECK(cudaMallocHost(&host_norm_, rows * sizeof(real_t)));
+  CUDA_CHECK(cudaMallocHost(&host_pg_, rows * sizeof(real_t)));
+  CUDA_CHECK(cudaMallocHost(&host_out_, rows * sizeof(real_t)));
+  CUDA_CHECK(cudaMalloc(&dev_nodes_, nodes * sizeof(Node)));
+  CUDA_CHECK(cudaMalloc(&dev_offset_, (rows + 1) * sizeof(uint64)));
+  CUDA_CHECK(cudaMalloc(&dev_norm_, rows * sizeof(real_t)));
+  CUDA_CHECK(cudaMalloc(&dev_pg_, rows * sizeof(real_t)));
+  CUDA_CHECK(cudaMalloc(&dev_out_, rows * sizeof(real_t)));
+  cap_row_ = rows;
+  cap_node_ = nodes;
+}
+
+void FFMGpu::ScoreBatch(const GpuLatent& latent, uint64 num_row,
+                        uint64 num_node, real_t* out) {
+  CHECK_LE(num_row, cap_row_);
+  CHECK_LE(num_node, cap_node_);
+  if (num_row == 0) { return; }
+  cudaStream_t stream = static_cast<cudaStream_t>(stream_);
+  CUDA_CHECK(cudaMemcpyAsync(dev_nodes_, host_nodes_,
+                             num_node * sizeof(Node),
+                             cudaMemcpyHostToDevice, stream));
+  CUDA_CHECK(cudaMemcpyAsync(dev_offset_, host_offset_,
+                             (num_row + 1) * sizeof(uint64),
+                             cudaMemcpyHostToDevice, stream));
+  CUDA_CHECK(cudaMemcpyAsync(dev_norm_, host_norm_,
+                             num_row * sizeof(real_t),
+                             cudaMemcpyHostToDevice, stream));
+  ffm_score_kernel<<<num_row, kThreads, 0, stream>>>(
+    dev_nodes_, dev_offset_, dev_norm_, latent, dev_out_);
+  CUDA_CHECK(cudaGetLastError());
+  CUDA_CHECK(cudaMemcpyAsync(host_out_, dev_out_,
+                             num_row * sizeof(real_t),
+                             cudaMemcpyDeviceToHost, stream));
+  CUDA_CHECK(cudaStreamSynchronize(stream));
+  memcpy(out, host_out_, num_row * sizeof(real_t));
+}
+
+void FFMGpu::GradBatch(const GpuLatent& latent, uint64 num_row,
+                       real_t learning_rate, real_t regu_lambda) {
+  CHECK_LE(num_row, cap_row_);
+  if (num_row == 0) { return; }
+  cudaStream_t stream = static_cast<cudaStream_t>(stream_);
+  CUDA_CHECK(cudaMemcpyAsync(dev_pg_, host_pg_,
+                             num_row * sizeof(real_t),
+                             cudaMemcpyHostToDevice, stream));
+  ffm_grad_kernel<<<num_row, kThreads, 0, stream>>>(
+    dev_nodes_, dev_offset_, dev_norm_, dev_pg_, latent,
+    learning_rate, regu_lambda);
+  CUDA_CHECK(cudaGetLastError());
+}
+
+void FFMGpu::Sync() {
+  if (stream_ == nullptr) { return; }
+  CUDA_CHECK(cudaStreamSynchronize(static_cast<cudaStream_t>(stream_)));
+}
+
+}  // namespace xLearn
@@ -0,0 +1,135 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the host interface of the CUDA kernels of the
+FFM latent factor (ffm_gpu_kernel.cu), which is only built with
+XLEARN_CUDA. It has no CUDA types, so the score is compiled by
+the host compiler.
+*/
+
+#ifndef XLEARN_SCORE_FFM_GPU_KERNEL_H_
+#define XLEARN_SCORE_FFM_GPU_KERNEL_H_
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The latent factor of FFM on the device, in the interleaved layout of
+// the fp32 model: the weight d of a block is at (d / align) * 2 * align
+// + d % align, and its adagrad cache is align floats after it (see
+// LatentWeightPos() and LatentCachePos())
+//------------------------------------------------------------------------------
+struct GpuLatent {
+  /* The device address of the latent factor */
+  real_t* v = nullptr;
+  index_t aligned_k = 0;
+  /* Stride of a block and of a feature */
+  index_t align0 = 0;
+  index_t align1 = 0;
+  /* Width of a SIMD chunk of the interleaved layout */
+  index_t align = kAlign;
+};
+
+//------------------------------------------------------------------------------
+// FFMGpu runs the batches of rows on one CUDA stream. The rows of a
+// batch are packed into the pinned buffers of Nodes(), Offsets() and
+// Norms() by the host, and then
+//
+//   gpu.ScoreBatch(latent, num_row, num_node, latent_score);
+//   ... the host sets the partial gradient of each row in Grads() ...
+//   gpu.GradBatch(latent, num_row, learning_rate, regu_lambda);
+//   gpu.Sync();
+//
+// ScoreBatch() waits for the scores, and GradBatch() is asynchronous,
+// so the host packs the next batch while the last one is updated. The
+// latent factor is either the mapped pinned memory of the host model
+// (MapHost()), which is updated in place, or a copy in device memory
+// (Upload()), which is only scored.
+//------------------------------------------------------------------------------
+class FFMGpu {
+ public:
+  FFMGpu();
+  ~FFMGpu();
+
+  // Return the device address of the host latent factor v of
+  // num_v floats, which is registered as mapped pinned memory
+  // until Release() or another v is mapped
+  real_t* MapHost(real_t* v, uint64 num_v);
+
+  // Copy the latent factor v of num_v floats into device memory,
+  // and return its device address, or nullptr if it does not fit
+  real_t* Upload(const real_t* v, uint64 num_v);
+
+  // Unregister the mapped memory and free the device copy
+  void Release();
+
+  // The pinned staging buffers of a batch, which hold at least
+  // num_node nodes, and num_row + 1 offsets and num_row norms,
+  // partial gradients and scores
+  void Reserve(uint64 num_row, uint64 num_node);
+  Node* Nodes() { return host_nodes_; }
+  uint64* Offsets() { return host_offset_; }
+  real_t* Norms() { return host_norm_; }
+  real_t* Grads() { return host_pg_; }
+
+  // Copy the batch to the device and write the latent term of
+  // each row into out, which waits for the kernel
+  void ScoreBatch(const GpuLatent& latent, uint64 num_row,
+                  uint64 num_node, real_t* out);
+
+  // Update the latent factor by the partial gradients of Grads()
+  // of the rows of the last ScoreBatch(), which is asynchronous
+  void GradBatch(const GpuLatent& latent, uint64 num_row,
+                 real_t learning_rate, real_t regu_lambda);
+
+  // Wait for the kernels of the stream
+  void Sync();
+
+  // The name of the device, or "" if there is no device
+  static std::string DeviceName();
+
+ private:
+  void* stream_;
+  /* Pinned host buffers and device buffers of the batch */
+  Node* host_nodes_;
+  uint64* host_offset_;
+  real_t* host_norm_;
+  real_t* host_pg_;
+  real_t* host_out_;
+  Node* dev_nodes_;
+  uint64* dev_offset_;
+  real_t* dev_norm_;
+  real_t* dev_pg_;
+  real_t* dev_out_;
+  uint64 cap_row_;
+  uint64 cap_node_;
+  /* The host memory of MapHost(), and the device copy of Upload() */
+  real_t* mapped_;
+  real_t* dev_v_;
+
+  void free_buffers();
+
+  DISALLOW_COPY_AND_ASSIGN(FFMGpu);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_FFM_GPU_KERNEL_H_
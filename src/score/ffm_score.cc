@@ -19,146 +19,402 @@ Author: Chao Ma (mctt90@gmail.com)
 This file is the implementation of FFMScore class.
 */
 
-#include <pmmintrin.h>  // for SSE
-
 #include "src/score/ffm_score.h"
 #include "src/base/math.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace xLearn {
 
+// The fused pass stages at most kMaxStagedPairs pairs of one row.
+// The blocks of longer rows do not fit in cache anyway, and they
+// use the unfused CalcScore() and CalcGrad() instead
+static const index_t kMaxStagedPairs = 64 * 1024;
+
+// Each thread has its own staging buffer of the pairs, which
+// only grows and is reused by all the rows
+static std::vector<FFMPair>& staged_pairs(uint64 num_pair) {
+  static thread_local std::vector<FFMPair> pairs;
+  if (pairs.size() < num_pair) { pairs.resize(num_pair); }
+  return pairs;
+}
+
+// The pairs whose V_i_fj or V_j_fi is not in the index have
+// zero latent vectors in the sparse latent factor, e.g., the
+// pairs that only occur in the test set, so they are skipped.
+// The pairs of the masked field pairs are skipped before lookup
+index_t FFMScore::sparse_pairs(const RowView& row,
+                               const RowView* cross,
+                               const KernelContext& ctx,
+                               real_t norm,
+                               FFMPair** pairs) const {
+  uint64 num_node = row.size();
+  uint64 max_pair = cross != nullptr ? num_node * cross->size() :
+                    (num_node > 1 ? num_node * (num_node - 1) / 2 : 0);
+  std::vector<FFMPair>& buf = staged_pairs(max_pair);
+  const FieldPairMask& mask = ctx.pairs->FieldMask();
+  bool masked = !mask.Empty();
+  index_t num_pair = 0;
+  for (const Node* iter_i = row.begin(); iter_i != row.end(); ++iter_i) {
+    const Node* begin_j = cross != nullptr ? cross->begin() : iter_i + 1;
+    const Node* end_j = cross != nullptr ? cross->end() : row.end();
+    for (const Node* iter_j = begin_j; iter_j != end_j; ++iter_j) {
+      if (masked && !mask.Allowed(iter_i->field_id, iter_j->field_id)) {
+        continue;
+      }
+      uint64 slot1 = ctx.pairs->Find(iter_i->feat_id, iter_j->field_id);
+      uint64 slot2 = ctx.pairs->Find(iter_j->feat_id, iter_i->field_id);
+      if (slot1 == kNoLatentSlot || slot2 == kNoLatentSlot) { continue; }
+      FFMPair& pair = buf[num_pair++];
+      pair.w1 = ctx.v + slot1 * ctx.align0;
+      pair.w2 = ctx.v + slot2 * ctx.align0;
+      pair.val = iter_i->feat_val * iter_j->feat_val * norm;
+    }
+  }
+  *pairs = buf.data();
+  return num_pair;
+}
+
+// The block of (feat, field) is at feat * align1 plus the offset
+// of the field, and the pairs of the same two fields have the
+// same k, so the kernel scores most of them in tiles
+index_t FFMScore::mixed_pairs(const RowView& row,
+                              const RowView* cross,
+                              const KernelContext& ctx,
+                              real_t norm,
+                              FFMPair** pairs) const {
+  uint64 num_node = row.size();
+  uint64 max_pair = cross != nullptr ? num_node * cross->size() :
+                    (num_node > 1 ? num_node * (num_node - 1) / 2 : 0);
+  std::vector<FFMPair>& buf = staged_pairs(max_pair);
+  const index_t* offset = ctx.field_offset;
+  index_t num_pair = 0;
+  for (const Node* iter_i = row.begin(); iter_i != row.end(); ++iter_i) {
+    const Node* begin_j = cross != nullptr ? cross->begin() : iter_i + 1;
+    const Node* end_j = cross != nullptr ? cross->end() : row.end();
+    index_t f1 = iter_i->field_id;
+    index_t k1 = (offset[f1 + 1] - offset[f1]) / 2;
+    real_t* v1 = ctx.v + (uint64)iter_i->feat_id * ctx.align1;
+    for (const Node* iter_j = begin_j; iter_j != end_j; ++iter_j) {
+      index_t f2 = iter_j->field_id;
+      index_t k2 = (offset[f2 + 1] - offset[f2]) / 2;
+      FFMPair& pair = buf[num_pair++];
+      pair.w1 = v1 + offset[f2];
+      pair.w2 = ctx.v + (uint64)iter_j->feat_id * ctx.align1 + offset[f1];
+      pair.val = iter_i->feat_val * iter_j->feat_val * norm;
+      pair.k = std::min(k1, k2);
+    }
+  }
+  *pairs = buf.data();
+  return num_pair;
+}
+
+// Linear and bias term of the score
+real_t FFMScore::linear_score(const RowView& row,
+                              const KernelContext& ctx,
+                              real_t norm) const {
+  real_t sum_w = 0;
+  real_t sqrt_norm = sqrt(norm);
+  real_t *w = ctx.w;
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    sum_w += (iter->feat_val * w[iter->feat_id*ctx.w_stride] * sqrt_norm);
+  }
+  // bias
+  sum_w += ctx.b[0];
+  return sum_w;
+}
+
+// Update the linear and bias term by the updater
+void FFMScore::linear_grad(const RowView& row,
+                           const KernelContext& ctx,
+                           real_t pg, real_t norm) {
+  CHECK_EQ(ctx.w_stride, updater().LinearStride());
+  update_linear(row, ctx.w, ctx.b, pg, sqrt(norm), ctx.dirty,
+                ctx.stamps);
+}
+
+bool FFMScore::SelectKernel(const std::string& name) {
+  const ScoreKernel* kernels[kNumLatentLayouts];
+  for (int l = 0; l < kNumLatentLayouts; ++l) {
+    kernels[l] = FindScoreKernel(name, kernels_[l]->aligned_k,
+                                 (LatentLayout)l);
+    if (kernels[l] == nullptr) { return false; }
+  }
+  for (int l = 0; l < kNumLatentLayouts; ++l) {
+    kernels_[l] = kernels[l];
+  }
+  return true;
+}
+
 // y = sum( (V_i_fj*V_j_fi)(x_i * x_j) )
-// Using SSE for speedup vector operation
-real_t FFMScore::CalcScore(const SparseRow* row,
+// The latent factor is computed by the SIMD kernel
+real_t FFMScore::CalcScore(const RowView& row,
                            Model& model,
                            real_t norm) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
   /*********************************************************
    *  linear and bias term                                 *
    *********************************************************/
-  real_t sum_w = 0;
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    sum_w += (iter->feat_val * w[iter->feat_id*2] * sqrt_norm);
-  }
-  // bias
-  w = model.GetParameter_b();
-  sum_w += w[0];
+  real_t sum_w = linear_score(row, ctx, norm);
   /*********************************************************
    *  latent factor                                        *
    *********************************************************/
-  static index_t align0 = 2 * model.get_aligned_k();
-  static index_t align1 = model.GetNumField() * align0;
-  static int align = kAlign * 2;
-  w = model.GetParameter_v();
-  __m128 XMMt = _mm_setzero_ps();
-  for (SparseRow::const_iterator iter_i = row->begin();
-       iter_i != row->end(); ++iter_i) {
-    index_t j1 = iter_i->feat_id;
-    index_t f1 = iter_i->field_id;
-    real_t v1 = iter_i->feat_val;
-    for (SparseRow::const_iterator iter_j = iter_i+1;
-         iter_j != row->end(); ++iter_j) {
-      index_t j2 = iter_j->feat_id;
-      index_t f2 = iter_j->field_id;
-      real_t v2 = iter_j->feat_val;
-      real_t* w1_base = w + j1*align1 + f2*align0;
-      real_t* w2_base = w + j2*align1 + f1*align0;
-      __m128 XMMv = _mm_set1_ps(v1*v2*norm);
-      for (index_t d = 0; d < align0; d += align) {
-        __m128 XMMw1 = _mm_load_ps(w1_base + d);
-        __m128 XMMw2 = _mm_load_ps(w2_base + d);
-        XMMt = _mm_add_ps(XMMt,
-               _mm_mul_ps(
-               _mm_mul_ps(XMMw1, XMMw2), XMMv));
-      }
-    }
-  }
-  real_t sum_v = 0;
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  _mm_store_ss(&sum_v, XMMt);
+  real_t sum_v = latent_score(row, ctx, norm);
 
   return sum_v + sum_w;
 }
 
+// The latent term by the kernel of each latent type
+real_t FFMScore::latent_score(const RowView& row,
+                              const KernelContext& ctx,
+                              real_t norm) const {
+  const ScoreKernel& kernel = this->kernel(ctx);
+  if (ctx.pairs != nullptr) {
+    FFMPair* pairs = nullptr;
+    index_t num_pair = sparse_pairs(row, nullptr, ctx, norm, &pairs);
+    return kernel.ffm_score_pairs(pairs, num_pair, ctx.align0);
+  }
+  if (ctx.field_offset != nullptr) {
+    FFMPair* pairs = nullptr;
+    index_t num_pair = mixed_pairs(row, nullptr, ctx, norm, &pairs);
+    return kernel.ffm_score_mixed(pairs, num_pair);
+  }
+  if (ctx.latent == kLatentINT8) {
+    return kernel.ffm_score_int8(row.begin(), row.end(), ctx.vq,
+                                   ctx.vscale, ctx.aligned_k,
+                                   ctx.num_field, norm);
+  } else if (ctx.latent != kLatentFP32) {
+    return kernel.ffm_score_half(row.begin(), row.end(), ctx.vh,
+                                   ctx.aligned_k, ctx.half_align1,
+                                   norm, ctx.bf16);
+  } else if (ctx.weights_only) {
+    return kernel.ffm_score_w(row.begin(), row.end(), ctx.v,
+                                ctx.aligned_k, ctx.half_align1, norm);
+  } else if (row.is_binary()) {
+    return kernel.ffm_score_binary(row.begin(), row.end(), ctx.v,
+                                   ctx.align0, ctx.align1, norm,
+                                   prefetch_distance_);
+  }
+  return kernel.ffm_score(row.begin(), row.end(), ctx.v,
+                            ctx.align0, ctx.align1, norm,
+                            prefetch_distance_);
+}
+
+// The cross pairs by the kernel of each latent type
+real_t FFMScore::cross_score(const RowView& row,
+                             const RowView& cross,
+                             const KernelContext& ctx,
+                             real_t norm) const {
+  const ScoreKernel& kernel = this->kernel(ctx);
+  if (ctx.pairs != nullptr) {
+    FFMPair* pairs = nullptr;
+    index_t num_pair = sparse_pairs(row, &cross, ctx, norm, &pairs);
+    return kernel.ffm_score_pairs(pairs, num_pair, ctx.align0);
+  }
+  if (ctx.field_offset != nullptr) {
+    FFMPair* pairs = nullptr;
+    index_t num_pair = mixed_pairs(row, &cross, ctx, norm, &pairs);
+    return kernel.ffm_score_mixed(pairs, num_pair);
+  }
+  if (ctx.latent == kLatentINT8) {
+    return kernel.ffm_cross_int8(row.begin(), row.end(),
+                                   cross.begin(), cross.end(), ctx.vq,
+                                   ctx.vscale, ctx.aligned_k,
+                                   ctx.num_field, norm);
+  } else if (ctx.latent != kLatentFP32) {
+    return kernel.ffm_cross_half(row.begin(), row.end(),
+                                   cross.begin(), cross.end(), ctx.vh,
+                                   ctx.aligned_k, ctx.half_align1,
+                                   norm, ctx.bf16);
+  } else if (ctx.weights_only) {
+    return kernel.ffm_cross_w(row.begin(), row.end(),
+                                cross.begin(), cross.end(), ctx.v,
+                                ctx.aligned_k, ctx.half_align1, norm);
+  }
+  return kernel.ffm_cross(row.begin(), row.end(),
+                            cross.begin(), cross.end(), ctx.v,
+                            ctx.align0, ctx.align1, norm);
+}
+
+// The terms of the context are computed without the normalization.
+// Every pair of the kernel is multiplied by norm, so the latent term
+// of the whole row is norm * (pair_c + pair_i + cross(c, i))
+void FFMScore::CalcContext(const RowView& context,
+                           Model& model,
+                           FFMContext* partial) {
+  CHECK_NOTNULL(partial);
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  partial->linear = 0;
+  for (RowView::const_iterator iter = context.begin();
+       iter != context.end(); ++iter) {
+    partial->linear += iter->feat_val * ctx.w[iter->feat_id*ctx.w_stride];
+  }
+  partial->pair = latent_score(context, ctx, 1.0);
+  partial->nodes.assign(context.begin(), context.end());
+}
+
+// Only the pairs that have a candidate feature are visited. The
+// context is the outer loop of the cross pairs, so the base of
+// the blocks of each context feature is computed once per candidate
+real_t FFMScore::CalcCandidateScore(const FFMContext& partial,
+                                    const RowView& item,
+                                    Model& model,
+                                    real_t norm) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  RowView context(partial.nodes.data(),
+                  partial.nodes.data() + partial.nodes.size());
+  real_t sum_w = partial.linear * sqrt(norm) +
+                 linear_score(item, ctx, norm);
+  real_t sum_v = partial.pair +
+                 latent_score(item, ctx, 1.0) +
+                 cross_score(context, item, ctx, 1.0);
+  return sum_w + sum_v * norm;
+}
+
 // Calculate gradient and update current model
-// Using the SSE for speedup vector operation
-void FFMScore::CalcGrad(const SparseRow* row,
+// The latent factor is updated by the SIMD kernel
+void FFMScore::CalcGrad(const RowView& row,
                         Model& model,
                         real_t pg,
                         real_t norm) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  // The latent factor of inference cannot be trained
+  CHECK(!ctx.is_inference());
   /*********************************************************
    *  linear and bias term                                 *
    *********************************************************/
-  real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    real_t &wl = w[iter->feat_id*2];
-    real_t &wlg = w[iter->feat_id*2+1];
-    real_t g = regu_lambda_*wl+pg*iter->feat_val*sqrt_norm;
-    wlg += g*g;
-    wl -= learning_rate_ * g * InvSqrt(wlg);
-  }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t g = pg;
-  wbg += g*g;
-  wb -= learning_rate_ * g * InvSqrt(wbg);
+  linear_grad(row, ctx, pg, norm);
   /*********************************************************
    *  latent factor                                        *
    *********************************************************/
-  static index_t align0 = 2 * model.get_aligned_k();
-  static index_t align1 = model.GetNumField() * align0;
-  static int align = kAlign * 2;
-  w = model.GetParameter_v();
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMlr = _mm_set1_ps(learning_rate_);
-  __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  for (SparseRow::const_iterator iter_i = row->begin();
-       iter_i != row->end(); ++iter_i) {
-    index_t j1 = iter_i->feat_id;
-    index_t f1 = iter_i->field_id;
-    real_t v1 = iter_i->feat_val;
-    for (SparseRow::const_iterator iter_j = iter_i+1;
-         iter_j != row->end(); ++iter_j) {
-      index_t j2 = iter_j->feat_id;
-      index_t f2 = iter_j->field_id;
-      real_t v2 = iter_j->feat_val;
-      real_t* w1_base = w + j1*align1 + f2*align0;
-      real_t* w2_base = w + j2*align1 + f1*align0;
-      __m128 XMMv = _mm_set1_ps(v1*v2*norm);
-      __m128 XMMpgv = _mm_mul_ps(XMMv, XMMpg);
-      for (index_t d = 0; d < align0; d += align) {
-        real_t *w1 = w1_base + d;
-        real_t *w2 = w2_base + d;
-        real_t *wg1 = w1 + kAlign;
-        real_t *wg2 = w1 + kAlign;
-        __m128 XMMw1 = _mm_load_ps(w1);
-        __m128 XMMw2 = _mm_load_ps(w2);
-        __m128 XMMwg1 = _mm_load_ps(wg1);
-        __m128 XMMwg2 = _mm_load_ps(wg2);
-        __m128 XMMg1 = _mm_add_ps(
-                       _mm_mul_ps(XMMlamb, XMMw1),
-                       _mm_mul_ps(XMMpgv, XMMw2));
-        __m128 XMMg2 = _mm_add_ps(
-                       _mm_mul_ps(XMMlamb, XMMw2),
-                       _mm_mul_ps(XMMpgv, XMMw1));
-        XMMwg1 = _mm_add_ps(XMMwg1, _mm_mul_ps(XMMg1, XMMg1));
-        XMMwg2 = _mm_add_ps(XMMwg2, _mm_mul_ps(XMMg2, XMMg2));
-        XMMw1 = _mm_sub_ps(XMMw1, _mm_mul_ps(XMMlr,
-                _mm_mul_ps(_mm_rsqrt_ps(XMMwg1), XMMg1)));
-        XMMw2 = _mm_sub_ps(XMMw2, _mm_mul_ps(XMMlr,
-                _mm_mul_ps(_mm_rsqrt_ps(XMMwg2), XMMg2)));
-        _mm_store_ps(w1, XMMw1);
-        _mm_store_ps(w2, XMMw2);
-        _mm_store_ps(wg1, XMMwg1);
-        _mm_store_ps(wg2, XMMwg2);
+  const ScoreKernel& kernel = this->kernel(ctx);
+  if (ctx.pairs != nullptr) {
+    FFMPair* pairs = nullptr;
+    index_t num_pair = sparse_pairs(row, nullptr, ctx, norm, &pairs);
+    kernel.ffm_grad_staged(pairs, num_pair, ctx.align0,
+                             pg, learning_rate_, regu_lambda_,
+                             sqrt_precision_);
+    return;
+  }
+  if (ctx.field_offset != nullptr) {
+    FFMPair* pairs = nullptr;
+    index_t num_pair = mixed_pairs(row, nullptr, ctx, norm, &pairs);
+    kernel.ffm_grad_mixed(pairs, num_pair, pg, learning_rate_,
+                          regu_lambda_, sqrt_precision_);
+    return;
+  }
+  if (row.is_binary()) {
+    kernel.ffm_grad_binary(row.begin(), row.end(), ctx.v,
+                           ctx.align0, ctx.align1,
+                           norm, pg, learning_rate_, regu_lambda_,
+                           prefetch_distance_, sqrt_precision_);
+    return;
+  }
+  kernel.ffm_grad(row.begin(), row.end(), ctx.v,
+                    ctx.align0, ctx.align1,
+                    norm, pg, learning_rate_, regu_lambda_,
+                    prefetch_distance_, sqrt_precision_);
+}
+
+// Calculate the score and update the model in one pass
+real_t FFMScore::CalcScoreAndGrad(const RowView& row,
+                                  Model& model,
+                                  real_t y,
+                                  PartialGrad pg_func,
+                                  real_t norm,
+                                  real_t weight) {
+  uint64 num_node = row.size();
+  uint64 num_pair = num_node > 1 ? num_node * (num_node - 1) / 2 : 0;
+  if (num_pair > kMaxStagedPairs) {
+    return Score::CalcScoreAndGrad(row, model, y, pg_func, norm, weight);
+  }
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  // The latent factor of inference cannot be trained
+  CHECK(!ctx.is_inference());
+  const ScoreKernel& kernel = this->kernel(ctx);
+  /*********************************************************
+   *  Step 1: score and stage the pairs                    *
+   *********************************************************/
+  real_t score = linear_score(row, ctx, norm);
+  FFMPair* pairs = nullptr;
+  if (ctx.pairs != nullptr) {
+    num_pair = sparse_pairs(row, nullptr, ctx, norm, &pairs);
+    score += kernel.ffm_score_pairs(pairs, num_pair, ctx.align0);
+  } else if (ctx.field_offset != nullptr) {
+    num_pair = mixed_pairs(row, nullptr, ctx, norm, &pairs);
+    score += kernel.ffm_score_mixed(pairs, num_pair);
+  } else {
+    pairs = staged_pairs(num_pair).data();
+    auto staged = row.is_binary() ? kernel.ffm_score_staged_binary :
+                                    kernel.ffm_score_staged;
+    score += staged(row.begin(), row.end(), ctx.v,
+                    ctx.align0, ctx.align1, norm,
+                    prefetch_distance_, pairs);
+  }
+  /*********************************************************
+   *  Step 2: update the model from the staged pairs       *
+   *********************************************************/
+  real_t pg = 0;
+  if (pg_func(score, y, &pg)) {
+    pg *= weight;
+    linear_grad(row, ctx, pg, norm);
+    if (ctx.field_offset != nullptr) {
+      kernel.ffm_grad_mixed(pairs, num_pair, pg, learning_rate_,
+                            regu_lambda_, sqrt_precision_);
+    } else {
+      kernel.ffm_grad_staged(pairs, num_pair, ctx.align0,
+                               pg, learning_rate_, regu_lambda_,
+                               sqrt_precision_);
+    }
+  }
+  return score;
+}
+
+// Score the rows [begin, end) of matrix. For the next row,
+// we prefetch the linear weights and the blocks V_j_f0 of the
+// pairs (0, j), which are the first pairs scored in the row
+void FFMScore::CalcScoreBatch(const DMatrix* matrix,
+                              index_t begin,
+                              index_t end,
+                              Model& model,
+                              bool is_norm,
+                              real_t* out) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  // The sparse latent factor and the blocks of the K of
+  // each field are scored by CalcScore()
+  if (ctx.is_inference() || ctx.pairs != nullptr ||
+      ctx.field_offset != nullptr) {
+    Score::CalcScoreBatch(matrix, begin, end, model, is_norm, out);
+    return;
+  }
+  const ScoreKernel& kernel = this->kernel(ctx);
+  auto score = matrix->is_binary ? kernel.ffm_score_binary :
+                                   kernel.ffm_score;
+  for (index_t i = begin; i < end; ++i) {
+    RowView row = matrix->GetRow(i);
+    if (i + 1 < end) {
+      RowView next = matrix->GetRow(i+1);
+      prefetch_row(next, ctx.w, ctx.w_stride);
+      if (next.size() > 1) {
+        const Node* first = next.begin();
+        prefetch_row(RowView(first + 1, next.end()),
+                     ctx.v + first->field_id * ctx.align0,
+                     ctx.align1);
       }
     }
+    real_t norm = is_norm ? matrix->norm[i] : 1.0;
+    out[i-begin] = linear_score(row, ctx, norm) +
+                   score(row.begin(), row.end(), ctx.v,
+                         ctx.align0, ctx.align1, norm,
+                         prefetch_distance_);
   }
 }
 
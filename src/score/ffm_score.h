@@ -23,39 +23,191 @@ machine) class.
 #ifndef XLEARN_LOSS_FFM_SCORE_H_
 #define XLEARN_LOSS_FFM_SCORE_H_
 
+#include <vector>
+
 #include "src/base/common.h"
 #include "src/score/score_function.h"
+#include "src/score/score_kernel.h"
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// The partial score of the context features in ranking, which are shared
+// by all the candidates of a request. The terms are computed without the
+// normalization, which depends on the whole row.
+//------------------------------------------------------------------------------
+struct FFMContext {
+  /* sum( w_i * x_i ) of the context */
+  real_t linear = 0;
+  /* sum( (V_i_fj*V_j_fi)(x_i * x_j) ) of the context pairs */
+  real_t pair = 0;
+  /* The context features, whose blocks are paired with
+  the features of each candidate */
+  std::vector<Node> nodes;
+};
+
 //------------------------------------------------------------------------------
 // FFMScore is used to implemente field-aware factorization machines,
 // in which the socre function is:
 //   y = sum( (V_i_fj*V_j_fi)(x_i * x_j) )
+//
+// In ranking, the row of each candidate is the context followed by the
+// candidate. The context pairs are the same for all the candidates, so
+// they are scored once by CalcContext(), and CalcCandidateScore() only
+// scores the context-candidate pairs and the candidate pairs:
+//
+//   FFMContext ctx;
+//   score->CalcContext(context_row, model, &ctx);
+//   for (...) {
+//     real_t s = score->CalcCandidateScore(ctx, item_row, model, norm);
+//   }
+//
+// The norm is the one of the whole row, which gives the same score as
+// CalcScore() on the concatenated row.
 //------------------------------------------------------------------------------
 class FFMScore : public Score {
 public:
  // Constructor and Desstructor
- FFMScore() { }
+ FFMScore() {
+   for (int l = 0; l < kNumLatentLayouts; ++l) {
+     kernels_[l] = &GetScoreKernel(0, (LatentLayout)l);
+   }
+ }
  ~FFMScore() { }
 
+ // Use the kernels of the instruction set name for all the
+ // layouts, which keep the aligned K of the specialized kernel
+ bool SelectKernel(const std::string& name);
+
  // Given one exmaple and current model, and
  // return the ffm score
- real_t CalcScore(const SparseRow* row,
+ real_t CalcScore(const RowView& row,
                   Model& model,
                   real_t norm = 1.0);
 
  // Calculate gradient and update current
  // model parameters
- void CalcGrad(const SparseRow* row,
+ void CalcGrad(const RowView& row,
                Model& model,
                real_t pg,
                real_t norm = 1.0);
 
+ // Score a range of rows with the context of the model
+ // prepared once, and the parameters of the next row
+ // are prefetched while current row is scored
+ void CalcScoreBatch(const DMatrix* matrix,
+                     index_t begin,
+                     index_t end,
+                     Model& model,
+                     bool is_norm,
+                     real_t* out);
+
+ // The fused training pass. The pairs of the row are staged
+ // in a per-thread buffer in the score, and then updated
+ // from the buffer while their blocks are still in cache
+ real_t CalcScoreAndGrad(const RowView& row,
+                         Model& model,
+                         real_t y,
+                         PartialGrad pg_func,
+                         real_t norm = 1.0,
+                         real_t weight = 1.0);
+
+ // Compute the partial score of the context features
+ void CalcContext(const RowView& context,
+                  Model& model,
+                  FFMContext* partial);
+
+ // Return the score of the context followed by the
+ // candidate, and norm is the one of the whole row
+ real_t CalcCandidateScore(const FFMContext& partial,
+                           const RowView& item,
+                           Model& model,
+                           real_t norm = 1.0);
+
+ protected:
+  /* SIMD kernels of the latent factor of each layout
+  of the blocks (see LatentLayout) */
+  const ScoreKernel* kernels_[kNumLatentLayouts];
+
+  // The latent term of the row by the kernel
+  // of the latent type of the model
+  real_t latent_score(const RowView& row,
+                      const KernelContext& ctx,
+                      real_t norm) const;
+
+  // The latent term of the pairs between row and cross
+  real_t cross_score(const RowView& row,
+                     const RowView& cross,
+                     const KernelContext& ctx,
+                     real_t norm) const;
+
+  // Stage the pairs of the row, or the pairs between row and
+  // cross if cross is not nullptr, whose field pairs are allowed
+  // and whose blocks are found in the sparse latent factor. The
+  // pairs are in the per-thread buffer, and return the number of them
+  index_t sparse_pairs(const RowView& row,
+                       const RowView* cross,
+                       const KernelContext& ctx,
+                       real_t norm,
+                       FFMPair** pairs) const;
+
+  // Stage the pairs of the row, or the pairs between row and
+  // cross, of the model of the K of each field, whose k is
+  // the smaller aligned K of the fields of the two blocks
+  index_t mixed_pairs(const RowView& row,
+                      const RowView* cross,
+                      const KernelContext& ctx,
+                      real_t norm,
+                      FFMPair** pairs) const;
+
+  // Linear and bias term of the score
+  real_t linear_score(const RowView& row,
+                      const KernelContext& ctx,
+                      real_t norm) const;
+
+  // Update the linear and bias term
+  void linear_grad(const RowView& row,
+                   const KernelContext& ctx,
+                   real_t pg, real_t norm);
+
+  // The kernel of the layout of the model. The
+  // specialized kernel only works for its own K
+  inline const ScoreKernel& kernel(const KernelContext& ctx) const {
+    const ScoreKernel* kernel = kernels_[ctx.layout];
+    CHECK(kernel->aligned_k == 0 ||
+          kernel->aligned_k == ctx.aligned_k);
+    return *kernel;
+  }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(FFMScore);
 };
 
+//------------------------------------------------------------------------------
+// FFMScoreK is the FFM score whose kernel is specialized on the
+// aligned K at compile time. They are registered as "ffm_k4",
+// "ffm_k8", "ffm_k16" and "ffm_k32", and the Solver will use them
+// if the aligned K of the model is one of them.
+//------------------------------------------------------------------------------
+template <index_t K>
+class FFMScoreK : public FFMScore {
+ public:
+  FFMScoreK() {
+    for (int l = 0; l < kNumLatentLayouts; ++l) {
+      kernels_[l] = &GetScoreKernel(K, (LatentLayout)l);
+    }
+  }
+  ~FFMScoreK() { }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FFMScoreK);
+};
+
+typedef FFMScoreK<4> FFMScoreK4;
+typedef FFMScoreK<8> FFMScoreK8;
+typedef FFMScoreK<16> FFMScoreK16;
+typedef FFMScoreK<32> FFMScoreK32;
+
 }  // namespace xLearn
 
 #endif  // XLEARN_LOSS_FFM_SCORE_H_
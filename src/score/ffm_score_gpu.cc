@@ -0,0 +1,199 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of FFMScoreGPU class.
+*/
+
+#include "src/score/ffm_score_gpu.h"
+
+#include <algorithm>
+
+namespace xLearn {
+
+// The rows of a batch are sent to the GPU in chunks, which
+// bounds the staging buffers and overlaps the packing of a
+// chunk with the update of the last one
+static const index_t kGpuChunkRows = 16 * 1024;
+
+// Return true if a row of [begin, end) has dense values,
+// which the GPU kernels do not read
+static bool has_dense(const DMatrix* matrix, index_t begin,
+                      index_t end) {
+  for (index_t i = begin; i < end; ++i) {
+    if (matrix->GetRow(i).has_dense()) { return true; }
+  }
+  return false;
+}
+
+FFMScoreGPU::FFMScoreGPU()
+  : gpu_(new FFMGpu), host_v_(nullptr), dev_v_(nullptr),
+    mapped_(false), stale_(false) {
+  LOG(INFO) << "Score the latent factor of ffm on the GPU: "
+            << FFMGpu::DeviceName();
+}
+
+FFMScoreGPU::~FFMScoreGPU() { }
+
+bool FFMScoreGPU::device_latent(Model& model,
+                                const KernelContext& ctx,
+                                bool train,
+                                GpuLatent* latent) {
+  if (ctx.is_inference() || ctx.pairs != nullptr ||
+      ctx.layout != kLayoutInterleaved ||
+      model.GetNumShards() > 1 || model.IsGrowable()) {
+    return false;
+  }
+  uint64 num_v = model.GetNumParameter_v();
+  if (train) {
+    if (host_v_ != ctx.v || !mapped_) {
+      dev_v_ = gpu_->MapHost(ctx.v, num_v);
+      host_v_ = ctx.v;
+      mapped_ = true;
+    }
+  } else if (host_v_ != ctx.v || (!mapped_ && stale_)) {
+    // The model that is only scored is copied to the
+    // device, or mapped if the device has no room
+    dev_v_ = gpu_->Upload(ctx.v, num_v);
+    mapped_ = dev_v_ == nullptr;
+    if (mapped_) {
+      LOG(INFO) << "The latent factor does not fit in the device, "
+                   "and it is read from the host memory.";
+      dev_v_ = gpu_->MapHost(ctx.v, num_v);
+    }
+    host_v_ = ctx.v;
+  }
+  stale_ = false;
+  latent->v = dev_v_;
+  latent->aligned_k = ctx.aligned_k;
+  latent->align0 = ctx.align0;
+  latent->align1 = ctx.align1;
+  return true;
+}
+
+uint64 FFMScoreGPU::pack_rows(const DMatrix* matrix, index_t begin,
+                              index_t end, bool is_norm) {
+  uint64 num_node = 0;
+  for (index_t i = begin; i < end; ++i) {
+    num_node += matrix->GetRow(i).size();
+  }
+  gpu_->Reserve(end - begin, num_node);
+  Node* nodes = gpu_->Nodes();
+  uint64* offset = gpu_->Offsets();
+  real_t* norm = gpu_->Norms();
+  offset[0] = 0;
+  for (index_t i = begin; i < end; ++i) {
+    RowView row = matrix->GetRow(i);
+    std::copy(row.begin(), row.end(), nodes + offset[i-begin]);
+    offset[i-begin+1] = offset[i-begin] + row.size();
+    norm[i-begin] = is_norm ? matrix->norm[i] : 1.0;
+  }
+  return num_node;
+}
+
+void FFMScoreGPU::CalcScoreBatch(const DMatrix* matrix,
+                                 index_t begin,
+                                 index_t end,
+                                 Model& model,
+                                 bool is_norm,
+                                 real_t* out) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  std::unique_lock<std::mutex> lock(mutex_);
+  GpuLatent latent;
+  if (has_dense(matrix, begin, end) ||
+      !device_latent(model, ctx, false, &latent)) {
+    lock.unlock();
+    FFMScore::CalcScoreBatch(matrix, begin, end, model, is_norm, out);
+    return;
+  }
+  for (index_t b = begin; b < end; b += kGpuChunkRows) {
+    index_t e = std::min(end, b + kGpuChunkRows);
+    uint64 num_node = pack_rows(matrix, b, e, is_norm);
+    latent_.resize(e - b);
+    gpu_->ScoreBatch(latent, e - b, num_node, latent_.data());
+    for (index_t i = b; i < e; ++i) {
+      real_t norm = is_norm ? matrix->norm[i] : 1.0;
+      out[i-begin] = linear_score(matrix->GetRow(i), ctx, norm) +
+                     latent_[i-b];
+    }
+  }
+}
+
+bool FFMScoreGPU::CalcGradBatch(const DMatrix* matrix,
+                                Model& model,
+                                const real_t* y,
+                                const real_t* weight,
+                                PartialGrad pg_func,
+                                bool is_norm,
+                                real_t* out) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_t num_row = matrix->row_length;
+  GpuLatent latent;
+  if (has_dense(matrix, 0, num_row) ||
+      !device_latent(model, ctx, true, &latent)) {
+    return false;
+  }
+  for (index_t b = 0; b < num_row; b += kGpuChunkRows) {
+    index_t e = std::min(num_row, b + kGpuChunkRows);
+    // The last chunk is still updated on the device
+    uint64 num_node = pack_rows(matrix, b, e, is_norm);
+    latent_.resize(e - b);
+    gpu_->ScoreBatch(latent, e - b, num_node, latent_.data());
+    real_t* grads = gpu_->Grads();
+    for (index_t i = b; i < e; ++i) {
+      RowView row = matrix->GetRow(i);
+      real_t norm = is_norm ? matrix->norm[i] : 1.0;
+      real_t score = linear_score(row, ctx, norm) + latent_[i-b];
+      if (out != nullptr) { out[i] = score; }
+      real_t pg = 0;
+      if (pg_func(score, y[i], &pg)) {
+        pg *= weight[i];
+        linear_grad(row, ctx, pg, norm);
+      } else {
+        pg = 0;
+      }
+      grads[i-b] = pg;
+    }
+    gpu_->GradBatch(latent, e - b, learning_rate_, regu_lambda_);
+  }
+  FlushGrad();
+  gpu_->Sync();
+  return true;
+}
+
+void FFMScoreGPU::CalcGrad(const RowView& row,
+                           Model& model,
+                           real_t pg,
+                           real_t norm) {
+  stale_ = true;
+  FFMScore::CalcGrad(row, model, pg, norm);
+}
+
+real_t FFMScoreGPU::CalcScoreAndGrad(const RowView& row,
+                                     Model& model,
+                                     real_t y,
+                                     PartialGrad pg_func,
+                                     real_t norm,
+                                     real_t weight) {
+  stale_ = true;
+  return FFMScore::CalcScoreAndGrad(row, model, y, pg_func,
+                                    norm, weight);
+}
+
+}  // namespace xLearn
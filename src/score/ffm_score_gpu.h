@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the FFMScoreGPU class, which is only built
+with XLEARN_CUDA.
+*/
+
+#ifndef XLEARN_SCORE_FFM_SCORE_GPU_H_
+#define XLEARN_SCORE_FFM_SCORE_GPU_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/score/ffm_score.h"
+#include "src/score/ffm_gpu_kernel.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// FFMScoreGPU computes the latent term of FFM on the GPU by the kernels
+// of ffm_gpu_kernel.cu, and the linear term and bias on the CPU. It is
+// registered as "ffm_gpu", which is used by the Solver with --gpu.
+//
+// In training, the loss gives the whole batch to CalcGradBatch(). The
+// rows are sent in chunks of kGpuChunkRows: the GPU scores the pairs of
+// each row, the CPU adds the linear term and computes the partial
+// gradients, and then the GPU updates the pairs while the CPU packs the
+// next chunk. The latent factor stays in the host model, whose memory is
+// mapped into the device, so the checkpoints, the validation and the
+// early stopping see the model as usual. The updates of a chunk use the
+// scores of the model before the chunk, as the threads of the CPU do.
+//
+// In prediction, CalcScoreBatch() scores the rows on a copy of the latent
+// factor in device memory, which is uploaded once, or on the mapped host
+// memory if the copy does not fit. The model of the CPU kernels is used
+// for the layouts that the GPU kernels do not have: the 16-bit and int8
+// latent factor, the weights-only model, the sparse latent factor, the
+// split layouts and the sharded or growable model.
+//------------------------------------------------------------------------------
+class FFMScoreGPU : public FFMScore {
+ public:
+  FFMScoreGPU();
+  ~FFMScoreGPU();
+
+  // Score the rows [begin, end) on the GPU
+  void CalcScoreBatch(const DMatrix* matrix,
+                      index_t begin,
+                      index_t end,
+                      Model& model,
+                      bool is_norm,
+                      real_t* out);
+
+  bool HasGradBatch() const { return true; }
+
+  // Score and update the rows of the matrix on the GPU
+  bool CalcGradBatch(const DMatrix* matrix,
+                     Model& model,
+                     const real_t* y,
+                     const real_t* weight,
+                     PartialGrad pg_func,
+                     bool is_norm,
+                     real_t* out);
+
+  // The rows that the CPU updates make the
+  // device copy of the latent factor stale
+  void CalcGrad(const RowView& row,
+                Model& model,
+                real_t pg,
+                real_t norm = 1.0);
+
+  real_t CalcScoreAndGrad(const RowView& row,
+                          Model& model,
+                          real_t y,
+                          PartialGrad pg_func,
+                          real_t norm = 1.0,
+                          real_t weight = 1.0);
+
+ protected:
+  /* The stream and the buffers of the device, which are
+  used by one thread at a time */
+  std::unique_ptr<FFMGpu> gpu_;
+  std::mutex mutex_;
+  /* The host latent factor of the device copy or the mapped
+  memory, its device address, and true for the mapped memory */
+  const real_t* host_v_;
+  real_t* dev_v_;
+  bool mapped_;
+  /* The device copy is stale since the CPU updated v */
+  std::atomic<bool> stale_;
+  /* The latent term of the rows of a chunk */
+  std::vector<real_t> latent_;
+
+  // Set the latent factor of the model on the device, which is
+  // the mapped host memory for training. Return false if the
+  // GPU kernels have no such layout of the model
+  bool device_latent(Model& model, const KernelContext& ctx,
+                     bool train, GpuLatent* latent);
+
+  // Pack the rows [begin, end) of the matrix into the staging
+  // buffers of gpu_, and return the number of their nodes
+  uint64 pack_rows(const DMatrix* matrix, index_t begin,
+                   index_t end, bool is_norm);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FFMScoreGPU);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_FFM_SCORE_GPU_H_
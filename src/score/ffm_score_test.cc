@@ -22,7 +22,15 @@ This file tests the FFMScore class.
 
 #include "gtest/gtest.h"
 
+#include <math.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/file_util.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 
@@ -76,6 +84,391 @@ TEST_F(FFMScoreTest, calc_score) {
   real_t val = score.CalcScore(&row, model);
   // 6 + 8*4*3 = 102
   EXPECT_FLOAT_EQ(val, 102);
+  // The kernel specialized on K = 8
+  FFMScoreK8 score_k8;
+  val = score_k8.CalcScore(&row, model);
+  EXPECT_FLOAT_EQ(val, 102);
+}
+
+// Init a FFM model with all the parameters = 1.0
+void InitModel(Model& model, index_t num_field, index_t num_K) {
+  model.Initialize(param.score_func,
+                   param.loss_func,
+                   param.num_feature,
+                   num_field,
+                   num_K);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 1.0;
+  }
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = 1.0;
+  }
+  model.GetParameter_b()[0] = 0.0;
+}
+
+TEST_F(FFMScoreTest, two_models) {
+  SparseRow row(param.num_feature);
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 2.0;
+    row[i].field_id = i;
+  }
+  // Two models with different K and number of fields
+  Model model_a, model_b;
+  InitModel(model_a, 3, 8);
+  InitModel(model_b, 5, 4);
+  FFMScore score_a, score_b;
+  score_a.Initialize(0.1, 0, &model_a);
+  score_b.Initialize(0.1, 0, &model_b);
+  for (int i = 0; i < 2; ++i) {
+    // 6 + 8*4*3 = 102
+    EXPECT_FLOAT_EQ(score_a.CalcScore(&row, model_a), 102);
+    // 6 + 4*4*3 = 54
+    EXPECT_FLOAT_EQ(score_b.CalcScore(&row, model_b), 54);
+  }
+  // Use one Score for the two models
+  FFMScore score;
+  EXPECT_FLOAT_EQ(score.CalcScore(&row, model_a), 102);
+  EXPECT_FLOAT_EQ(score.CalcScore(&row, model_b), 54);
 }
 
+// Partial gradient of squared loss
+bool squared_pg(real_t score, real_t y, real_t* pg) {
+  *pg = score - y;
+  return true;
+}
+
+TEST_F(FFMScoreTest, fused_grad) {
+  SparseRow row(param.num_feature);
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 0.5 + i;
+    row[i].field_id = i;
+  }
+  Model model_a, model_b;
+  InitModel(model_a, 3, 8);
+  InitModel(model_b, 3, 8);
+  FFMScore score_a, score_b;
+  score_a.Initialize(0.1, 0.01, &model_a);
+  score_b.Initialize(0.1, 0.01, &model_b);
+  real_t y = 1.0;
+  for (int i = 0; i < 3; ++i) {
+    real_t val = score_a.CalcScore(&row, model_a, 0.5);
+    score_a.CalcGrad(&row, model_a, val - y, 0.5);
+    EXPECT_FLOAT_EQ(score_b.CalcScoreAndGrad(&row, model_b, y,
+                                             squared_pg, 0.5), val);
+  }
+  real_t* v_a = model_a.GetParameter_v();
+  real_t* v_b = model_b.GetParameter_v();
+  for (index_t i = 0; i < model_a.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(v_a[i], v_b[i]);
+  }
+  real_t* w_a = model_a.GetParameter_w();
+  real_t* w_b = model_b.GetParameter_w();
+  for (index_t i = 0; i < model_a.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(w_a[i], w_b[i]);
+  }
+}
+
+TEST_F(FFMScoreTest, calc_score_batch) {
+  Model model;
+  InitModel(model, 3, 8);
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = 0.01 * (i % 17);
+  }
+  // The rows have 0 ~ 3 nodes
+  DMatrix matrix;
+  matrix.ResetMatrix(8);
+  for (index_t i = 0; i < 8; ++i) {
+    for (index_t j = 0; j < i % 4; ++j) {
+      matrix.AddNode(i, j, 0.5 + i, (i + j) % 3);
+    }
+    matrix.norm[i] = 0.5;
+  }
+  FFMScore score;
+  score.Initialize(0.1, 0, &model);
+  for (int n = 0; n < 2; ++n) {
+    bool is_norm = n == 1;
+    std::vector<real_t> out(6);
+    score.CalcScoreBatch(&matrix, 1, 7, model, is_norm, out.data());
+    for (index_t i = 1; i < 7; ++i) {
+      real_t norm = is_norm ? 0.5 : 1.0;
+      EXPECT_FLOAT_EQ(out[i-1],
+                      score.CalcScore(matrix.GetRow(i), model, norm));
+    }
+  }
+}
+
+TEST_F(FFMScoreTest, inference_latent) {
+  SparseRow row(param.num_feature);
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 2.0;
+    row[i].field_id = i;
+  }
+  const char* type[] = { "fp16", "bf16", "int8" };
+  for (int t = 0; t < 3; ++t) {
+    Model model;
+    InitModel(model, 3, 8);
+    FFMScore score;
+    score.Initialize(0.1, 0, &model);
+    model.ConvertLatent(type[t]);
+    EXPECT_TRUE(model.GetParameter_v() == nullptr);
+    EXPECT_TRUE(model.GetParameter_v_half() != nullptr ||
+                model.GetParameter_v_int8() != nullptr);
+    // The context is prepared again after the latent factor
+    // is converted, and all the weights are exact after the
+    // conversion
+    EXPECT_FLOAT_EQ(score.CalcScore(&row, model), 102);
+  }
+}
+
+TEST_F(FFMScoreTest, weights_only) {
+  Model model;
+  InitModel(model, 3, 8);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 0.01 * i;
+  }
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = 0.001 * (i % 97);
+  }
+  model.Serialize("./ffm_weights.bin", true);
+  Model new_model("./ffm_weights.bin");
+  RemoveFile("./ffm_weights.bin");
+  EXPECT_TRUE(new_model.IsWeightsOnly());
+  DMatrix matrix;
+  matrix.ResetMatrix(4);
+  for (index_t i = 0; i < 4; ++i) {
+    for (index_t j = 0; j < param.num_feature; ++j) {
+      matrix.AddNode(i, j, 0.5 + i + j, (i + j) % 3);
+    }
+  }
+  FFMScore score;
+  score.Initialize(0.1, 0, &new_model);
+  std::vector<real_t> out(4);
+  score.CalcScoreBatch(&matrix, 0, 4, new_model, false, out.data());
+  for (index_t i = 0; i < 4; ++i) {
+    real_t expected = score.CalcScore(matrix.GetRow(i), model);
+    EXPECT_NEAR(score.CalcScore(matrix.GetRow(i), new_model),
+                expected, 1e-4);
+    EXPECT_NEAR(out[i], expected, 1e-4);
+  }
+}
+
+TEST_F(FFMScoreTest, candidate_score) {
+  const index_t kNumFeat = 50;
+  const index_t kNumField = 4;
+  const char* latent[] = { "fp32", "weights", "fp16", "bf16", "int8" };
+  for (int t = 0; t < 5; ++t) {
+    for (index_t num_K = 8; num_K <= 20; num_K += 12) {
+      Model train_model;
+      train_model.Initialize(param.score_func, param.loss_func,
+                             kNumFeat, kNumField, num_K);
+      real_t* w = train_model.GetParameter_w();
+      for (index_t i = 0; i < train_model.GetNumParameter_w(); ++i) {
+        w[i] = 0.01 * (i % 13) - 0.05;
+      }
+      real_t* v = train_model.GetParameter_v();
+      for (index_t i = 0; i < train_model.GetNumParameter_v(); ++i) {
+        v[i] = 0.01 * (i % 97) - 0.4;
+      }
+      train_model.GetParameter_b()[0] = 0.3;
+      // The inference models
+      Model* model = &train_model;
+      if (t > 0) {
+        train_model.Serialize("./ffm_candidate.bin", t == 1);
+        model = new Model("./ffm_candidate.bin");
+        RemoveFile("./ffm_candidate.bin");
+        if (t > 1) { model->ConvertLatent(latent[t]); }
+      }
+      SparseRow context;
+      for (index_t i = 0; i < 7; ++i) {
+        context.push_back({i % 2, i * 3, 0.5f + 0.1f * i});
+      }
+      FFMScore generic;
+      FFMScoreK8 specialized;
+      Score* score_list[] = { &generic, &specialized };
+      FFMContext partial;
+      for (int k = 0; k < (num_K == 8 ? 2 : 1); ++k) {
+        FFMScore* score = static_cast<FFMScore*>(score_list[k]);
+        score->Initialize(0.1, 0, model);
+        score->CalcContext(&context, *model, &partial);
+        for (index_t c = 0; c < 10; ++c) {
+          SparseRow item;
+          for (index_t i = 0; i <= c % 4; ++i) {
+            item.push_back({2 + (c + i) % 2, 30 + c + i * 2,
+                            1.0f - 0.1f * i});
+          }
+          SparseRow row(context);
+          row.insert(row.end(), item.begin(), item.end());
+          real_t norm = c % 2 ? 0.3 : 1.0;
+          real_t expect = score->CalcScore(&row, *model, norm);
+          EXPECT_NEAR(score->CalcCandidateScore(partial, &item,
+                                                *model, norm),
+                      expect, 1e-5 * std::max(1.0f, fabsf(expect)));
+        }
+        // The context only
+        SparseRow empty;
+        EXPECT_NEAR(score->CalcCandidateScore(partial, &empty, *model),
+                    score->CalcScore(&context, *model), 1e-4);
+      }
+      if (model != &train_model) { delete model; }
+    }
+  }
+}
+
+// Each feature is in its own field, so the index has no
+// (feat_i, field_i). On the rows of the index, the sparse latent factor
+// has the same scores and updates of the dense one
+TEST_F(FFMScoreTest, sparse_latent) {
+  DMatrix matrix;
+  matrix.ResetMatrix(4);
+  for (index_t i = 0; i < 4; ++i) {
+    for (index_t j = 0; j < 2 + i % 2; ++j) {
+      matrix.AddNode(i, (i + j) % 3, 0.5 + i + j, (i + j) % 3);
+    }
+    matrix.norm[i] = 0.5;
+  }
+  std::shared_ptr<LatentPairs> pairs(new LatentPairs);
+  for (index_t i = 0; i < 4; ++i) {
+    pairs->AddRow(matrix.GetRow(i), param.num_field);
+  }
+  pairs->Build(param.num_feature);
+  EXPECT_LT(pairs->Size(), param.num_feature * param.num_field);
+  Model dense, sparse, fused;
+  dense.Initialize("ffm", "squared", param.num_feature,
+                   param.num_field, param.num_K);
+  sparse.SetLatentPairs(pairs);
+  sparse.Initialize("ffm", "squared", param.num_feature,
+                    param.num_field, param.num_K);
+  fused.SetLatentPairs(pairs);
+  fused.Initialize("ffm", "squared", param.num_feature,
+                   param.num_field, param.num_K);
+  FFMScore score_d, score_s, score_f;
+  score_d.Initialize(0.1, 0.01, &dense);
+  score_s.Initialize(0.1, 0.01, &sparse);
+  score_f.Initialize(0.1, 0.01, &fused);
+  real_t y = 1.0;
+  for (int n = 0; n < 3; ++n) {
+    for (index_t i = 0; i < 4; ++i) {
+      RowView row = matrix.GetRow(i);
+      real_t val = score_d.CalcScore(row, dense, 0.5);
+      EXPECT_FLOAT_EQ(score_s.CalcScore(row, sparse, 0.5), val);
+      EXPECT_FLOAT_EQ(score_f.CalcScoreAndGrad(row, fused, y,
+                                               squared_pg, 0.5), val);
+      score_d.CalcGrad(row, dense, val - y, 0.5);
+      score_s.CalcGrad(row, sparse, val - y, 0.5);
+    }
+  }
+  std::vector<real_t> out(4);
+  score_s.CalcScoreBatch(&matrix, 0, 4, sparse, true, out.data());
+  for (index_t i = 0; i < 4; ++i) {
+    EXPECT_FLOAT_EQ(out[i], score_d.CalcScore(matrix.GetRow(i), dense,
+                                              0.5));
+  }
+  index_t align0 = 2 * param.num_K;
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    for (index_t f = 0; f < param.num_field; ++f) {
+      const real_t* a = dense.GetLatentBlock(i, f);
+      const real_t* b = sparse.GetLatentBlock(i, f);
+      const real_t* c = fused.GetLatentBlock(i, f);
+      if (b == nullptr) { continue; }
+      for (index_t d = 0; d < align0; ++d) {
+        EXPECT_FLOAT_EQ(a[d], b[d]);
+        EXPECT_FLOAT_EQ(a[d], c[d]);
+      }
+    }
+  }
+}
+
+// The masked field pairs add nothing to the score
+TEST_F(FFMScoreTest, field_pair_mask) {
+  SparseRow row(param.num_feature);
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 2.0;
+    row[i].field_id = i;
+  }
+  FieldPairMask mask;
+  mask.Reset(param.num_field);
+  mask.Allow(0, 2);
+  std::shared_ptr<LatentPairs> pairs(new LatentPairs);
+  pairs->SetFieldMask(mask);
+  pairs->AddRow(&row, param.num_field);
+  pairs->Build(param.num_feature);
+  EXPECT_EQ(pairs->Size(), 2);
+  Model model;
+  model.SetLatentPairs(pairs);
+  InitModel(model, 3, 8);
+  FFMScore score;
+  score.Initialize(0.1, 0, &model);
+  // 6 + 8*4 of the pair (0, 2)
+  EXPECT_FLOAT_EQ(score.CalcScore(&row, model), 38);
+  EXPECT_FLOAT_EQ(score.CalcScoreAndGrad(&row, model, 1.0,
+                                         squared_pg, 1.0), 38);
+  // Only the allowed pair is updated
+  EXPECT_NE(model.GetLatentBlock(0, 2)[0], 1.0);
+  EXPECT_NE(model.GetLatentBlock(2, 0)[0], 1.0);
+}
+
+// The model of the K of each field has the scores of its dense
+// model file, whose weights beyond the K are zero, and the fused
+// update is the same as the unfused one
+TEST_F(FFMScoreTest, field_k) {
+  DMatrix matrix;
+  matrix.ResetMatrix(4);
+  for (index_t i = 0; i < 4; ++i) {
+    for (index_t j = 0; j < 3; ++j) {
+      matrix.AddNode(i, (i + j) % 3, 0.5 + i + j, j);
+    }
+    matrix.norm[i] = 0.5;
+  }
+  std::vector<index_t> field_k = {4, 8, 3};
+  Model mixed, fused;
+  mixed.SetFieldK(field_k);
+  mixed.Initialize("ffm", "squared", param.num_feature,
+                   param.num_field, param.num_K);
+  fused.SetFieldK(field_k);
+  fused.Initialize("ffm", "squared", param.num_feature,
+                   param.num_field, param.num_K);
+  FFMScore score_m, score_f, score_d;
+  score_m.Initialize(0.1, 0.01, &mixed);
+  score_f.Initialize(0.1, 0.01, &fused);
+  real_t y = 1.0;
+  for (int n = 0; n < 3; ++n) {
+    for (index_t i = 0; i < 4; ++i) {
+      RowView row = matrix.GetRow(i);
+      real_t val = score_m.CalcScore(row, mixed, 0.5);
+      EXPECT_FLOAT_EQ(score_f.CalcScoreAndGrad(row, fused, y,
+                                               squared_pg, 0.5), val);
+      score_m.CalcGrad(row, mixed, val - y, 0.5);
+    }
+  }
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    for (index_t f = 0; f < param.num_field; ++f) {
+      const real_t* a = mixed.GetLatentBlock(i, f);
+      const real_t* b = fused.GetLatentBlock(i, f);
+      for (index_t d = 0; d < 2 * mixed.GetFieldK(f); ++d) {
+        EXPECT_FLOAT_EQ(a[d], b[d]);
+      }
+    }
+  }
+  std::string file = "./test_field_k.model";
+  mixed.Serialize(file);
+  Model dense(file);
+  RemoveFile(file.c_str());
+  EXPECT_FALSE(dense.HasFieldK());
+  score_d.Initialize(0.1, 0.01, &dense);
+  std::vector<real_t> out(4);
+  score_m.CalcScoreBatch(&matrix, 0, 4, mixed, true, out.data());
+  for (index_t i = 0; i < 4; ++i) {
+    RowView row = matrix.GetRow(i);
+    EXPECT_FLOAT_EQ(out[i], score_d.CalcScore(row, dense, 0.5));
+  }
+}
 } // namespace xLearn
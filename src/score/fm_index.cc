@@ -0,0 +1,291 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of FMIndex.
+*/
+
+#include "src/score/fm_index.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <queue>
+#include <random>
+
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+static inline real_t dot(const real_t* a, const real_t* b, index_t n) {
+  real_t sum = 0;
+  for (index_t d = 0; d < n; ++d) { sum += a[d] * b[d]; }
+  return sum;
+}
+
+// The higher score first, and then the smaller item
+static inline bool better(const Candidate& a, const Candidate& b) {
+  return a.score > b.score || (a.score == b.score && a.item < b.item);
+}
+
+void FMIndex::Build(const DMatrix& items,
+                    Model& model,
+                    index_t num_list,
+                    ThreadPool* pool,
+                    int num_iter,
+                    uint64 seed) {
+  CHECK_EQ(model.GetScoreFunction(), "fm");
+  CHECK_GT(num_iter, 0);
+  index_t num_item = items.row_length;
+  dim_ = model.get_aligned_k() + 1;
+  bias_ = model.GetParameter_b()[0];
+  score_.Initialize(0, 0, &model);
+  // The vector of each item
+  std::vector<real_t> vec((uint64)num_item * dim_);
+  auto compute = [&](size_t id, size_t start, size_t end) {
+    FMContext partial;
+    for (size_t i = start; i < end; ++i) {
+      score_.CalcContext(items.GetRow(i), model, &partial);
+      real_t* x = vec.data() + i * dim_;
+      std::copy(partial.sum.begin(), partial.sum.end(), x);
+      x[dim_-1] = partial.linear + partial.pair;
+    }
+  };
+  if (pool != nullptr) {
+    pool->ParallelFor(0, num_item, 0, compute);
+  } else {
+    compute(0, 0, num_item);
+  }
+  if (num_list == 0) { num_list = sqrt(num_item); }
+  num_list = std::max(std::min(num_list, num_item), (index_t)1);
+  std::vector<index_t> assign;
+  kmeans(vec, num_list, pool, num_iter, seed, &assign);
+  // The items of each list are stored together,
+  // in the order of the item ids
+  list_offset_.assign(num_list + 1, 0);
+  for (index_t i = 0; i < num_item; ++i) { list_offset_[assign[i]+1]++; }
+  for (index_t l = 0; l < num_list; ++l) {
+    list_offset_[l+1] += list_offset_[l];
+  }
+  std::vector<index_t> next(list_offset_.begin(), list_offset_.end() - 1);
+  item_.resize(num_item);
+  vec_.resize(vec.size());
+  for (index_t i = 0; i < num_item; ++i) {
+    index_t pos = next[assign[i]]++;
+    item_[pos] = i;
+    std::copy(vec.begin() + (uint64)i * dim_,
+              vec.begin() + (uint64)(i + 1) * dim_,
+              vec_.begin() + (uint64)pos * dim_);
+  }
+  LOG(INFO) << "FM index of " << num_item << " items in "
+            << num_list << " lists";
+}
+
+// The k-means of the euclidean distance, whose initial
+// centroids are num_list random vectors
+void FMIndex::kmeans(const std::vector<real_t>& vec,
+                     index_t num_list,
+                     ThreadPool* pool,
+                     int num_iter,
+                     uint64 seed,
+                     std::vector<index_t>* assign) {
+  index_t num_item = vec.size() / dim_;
+  assign->assign(num_item, 0);
+  centroid_.assign((uint64)num_list * dim_, 0);
+  if (num_item == 0) { return; }
+  std::mt19937_64 rng(seed);
+  std::vector<index_t> order(num_item);
+  for (index_t i = 0; i < num_item; ++i) { order[i] = i; }
+  std::shuffle(order.begin(), order.end(), rng);
+  for (index_t l = 0; l < num_list; ++l) {
+    std::copy(vec.begin() + (uint64)order[l] * dim_,
+              vec.begin() + (uint64)(order[l] + 1) * dim_,
+              centroid_.begin() + (uint64)l * dim_);
+  }
+  std::vector<real_t> square(num_list);
+  std::vector<double> sum((uint64)num_list * dim_);
+  std::vector<index_t> count(num_list);
+  for (int iter = 0; iter < num_iter; ++iter) {
+    for (index_t l = 0; l < num_list; ++l) {
+      const real_t* c = centroid_.data() + (uint64)l * dim_;
+      square[l] = dot(c, c, dim_);
+    }
+    // |x - c|^2 = |x|^2 - 2 * x * c + |c|^2
+    std::vector<index_t> changed(pool != nullptr ? pool->size() : 1, 0);
+    auto nearest = [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) {
+        const real_t* x = vec.data() + i * dim_;
+        index_t best = 0;
+        real_t best_dist = 0;
+        for (index_t l = 0; l < num_list; ++l) {
+          real_t dist = square[l] -
+                        2 * dot(x, centroid_.data() + (uint64)l * dim_, dim_);
+          if (l == 0 || dist < best_dist) {
+            best = l;
+            best_dist = dist;
+          }
+        }
+        if ((*assign)[i] != best) {
+          (*assign)[i] = best;
+          changed[id]++;
+        }
+      }
+    };
+    if (pool != nullptr) {
+      pool->ParallelFor(0, num_item, 0, nearest);
+    } else {
+      nearest(0, 0, num_item);
+    }
+    index_t num_changed = 0;
+    for (size_t t = 0; t < changed.size(); ++t) { num_changed += changed[t]; }
+    if (iter > 0 && num_changed == 0) { break; }
+    // The sums are in the order of the items, so the
+    // centroids do not depend on the threads
+    std::fill(sum.begin(), sum.end(), 0);
+    std::fill(count.begin(), count.end(), 0);
+    for (index_t i = 0; i < num_item; ++i) {
+      index_t l = (*assign)[i];
+      const real_t* x = vec.data() + (uint64)i * dim_;
+      double* s = sum.data() + (uint64)l * dim_;
+      for (index_t d = 0; d < dim_; ++d) { s[d] += x[d]; }
+      count[l]++;
+    }
+    for (index_t l = 0; l < num_list; ++l) {
+      real_t* c = centroid_.data() + (uint64)l * dim_;
+      if (count[l] == 0) {
+        // The empty list takes a random vector
+        index_t i = rng() % num_item;
+        std::copy(vec.begin() + (uint64)i * dim_,
+                  vec.begin() + (uint64)(i + 1) * dim_, c);
+        continue;
+      }
+      const double* s = sum.data() + (uint64)l * dim_;
+      for (index_t d = 0; d < dim_; ++d) { c[d] = s[d] / count[l]; }
+    }
+  }
+}
+
+void FMIndex::Search(const FMContext& user,
+                     index_t top_k,
+                     index_t num_probe,
+                     std::vector<Candidate>* top) const {
+  CHECK_NOTNULL(top);
+  CHECK_EQ(user.sum.size() + 1, dim_);
+  top->clear();
+  index_t num_list = NumLists();
+  if (top_k == 0 || num_list == 0) { return; }
+  std::vector<real_t> query(user.sum);
+  query.push_back(1.0);
+  // The lists of the largest inner products with the user
+  std::vector<Candidate> list(num_list);
+  for (index_t l = 0; l < num_list; ++l) {
+    list[l].item = l;
+    list[l].score = dot(query.data(), centroid_.data() + (uint64)l * dim_,
+                        dim_);
+  }
+  num_probe = std::max(std::min(num_probe, num_list), (index_t)1);
+  std::partial_sort(list.begin(), list.begin() + num_probe,
+                    list.end(), better);
+  // The heap keeps the top_k candidates, whose top is the worst
+  std::priority_queue<Candidate, std::vector<Candidate>,
+                      bool(*)(const Candidate&, const Candidate&)>
+    heap(better);
+  for (index_t p = 0; p < num_probe; ++p) {
+    index_t l = list[p].item;
+    for (index_t pos = list_offset_[l]; pos < list_offset_[l+1]; ++pos) {
+      Candidate c;
+      c.item = item_[pos];
+      c.score = dot(query.data(), vec_.data() + (uint64)pos * dim_, dim_);
+      if (heap.size() < top_k) {
+        heap.push(c);
+      } else if (better(c, heap.top())) {
+        heap.pop();
+        heap.push(c);
+      }
+    }
+  }
+  real_t base = bias_ + user.linear + user.pair;
+  top->resize(heap.size());
+  for (size_t n = heap.size(); n-- > 0; ) {
+    (*top)[n] = heap.top();
+    (*top)[n].score += base;
+    heap.pop();
+  }
+}
+
+void FMIndex::Query(const RowView& user,
+                    Model& model,
+                    index_t top_k,
+                    index_t num_probe,
+                    std::vector<Candidate>* top) {
+  CHECK_EQ(model.get_aligned_k() + 1, dim_);
+  static thread_local FMContext partial;
+  score_.CalcContext(user, model, &partial);
+  Search(partial, top_k, num_probe, top);
+}
+
+void FMIndex::Serialize(const std::string& filename) const {
+  CHECK_NE(filename.empty(), true);
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  uint64 num_list = NumLists();
+  uint64 num_item = NumItems();
+  WriteDataToDisk(file, (char*)&kFMIndexMagic, sizeof(kFMIndexMagic));
+  WriteDataToDisk(file, (char*)&dim_, sizeof(dim_));
+  WriteDataToDisk(file, (char*)&bias_, sizeof(bias_));
+  WriteDataToDisk(file, (char*)&num_list, sizeof(num_list));
+  WriteDataToDisk(file, (char*)&num_item, sizeof(num_item));
+  WriteDataToDisk(file, (char*)centroid_.data(),
+                  centroid_.size() * sizeof(real_t));
+  WriteDataToDisk(file, (char*)list_offset_.data(),
+                  list_offset_.size() * sizeof(index_t));
+  WriteDataToDisk(file, (char*)item_.data(),
+                  item_.size() * sizeof(index_t));
+  WriteDataToDisk(file, (char*)vec_.data(), vec_.size() * sizeof(real_t));
+  Close(file);
+}
+
+bool FMIndex::Deserialize(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 magic = 0;
+  ReadDataFromDisk(file, (char*)&magic, sizeof(magic));
+  if (magic != kFMIndexMagic) {
+    LOG(ERROR) << "Not an FM index file: " << filename;
+    Close(file);
+    return false;
+  }
+  uint64 num_list = 0, num_item = 0;
+  ReadDataFromDisk(file, (char*)&dim_, sizeof(dim_));
+  ReadDataFromDisk(file, (char*)&bias_, sizeof(bias_));
+  ReadDataFromDisk(file, (char*)&num_list, sizeof(num_list));
+  ReadDataFromDisk(file, (char*)&num_item, sizeof(num_item));
+  centroid_.resize(num_list * dim_);
+  list_offset_.resize(num_list + 1);
+  item_.resize(num_item);
+  vec_.resize(num_item * dim_);
+  ReadDataFromDisk(file, (char*)centroid_.data(),
+                   centroid_.size() * sizeof(real_t));
+  ReadDataFromDisk(file, (char*)list_offset_.data(),
+                   list_offset_.size() * sizeof(index_t));
+  ReadDataFromDisk(file, (char*)item_.data(),
+                   item_.size() * sizeof(index_t));
+  ReadDataFromDisk(file, (char*)vec_.data(), vec_.size() * sizeof(real_t));
+  Close(file);
+  CHECK_EQ(list_offset_[num_list], num_item);
+  return true;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the FMIndex class, the inverted-file index
+of the retrieval of the top-k items of FM.
+*/
+
+#ifndef XLEARN_SCORE_FM_INDEX_H_
+#define XLEARN_SCORE_FM_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/fm_score.h"
+
+namespace xLearn {
+
+const uint64 kFMIndexMagic = 0x31584449444d46ULL;  /* "FMDIDX1" */
+
+// An item of the retrieval and its score
+struct Candidate {
+  index_t item;
+  real_t score;
+};
+
+//------------------------------------------------------------------------------
+// FMIndex retrieves the items of the top FM scores for a user, without
+// scoring all the items. The row of a (user, item) pair is the user
+// features followed by the item features, and its score without the
+// normalization (see FMContext) is:
+//
+//   b + user.linear + user.pair + item.linear + item.pair
+//     + user.sum * item.sum
+//
+// so the ranking of the items for one user is the inner product of
+// [user.sum, 1] and [item.sum, item.linear + item.pair]. Build() computes
+// the vector of each item by FMScore::CalcContext(), and clusters them by
+// k-means into num_list lists (the inverted file). Search() only scores
+// the items of the num_probe lists whose centroids have the largest inner
+// products with the user, so it visits about num_probe / num_list of the
+// items, and num_probe = num_list gives the exact top-k:
+//
+//   FMIndex index;
+//   index.Build(item_matrix, model, 1024, pool);
+//   index.Serialize("/tmp/items.index");
+//   ...
+//   std::vector<Candidate> top;
+//   index.Query(&user_row, model, 100, 16, &top);
+//
+// The scores are the raw scores of the model (before the sigmoid). They
+// are the scores of the concatenated rows of the models trained without
+// the instance normalization (--no-norm), whose score of a row does not
+// depend on the length of the whole row.
+//------------------------------------------------------------------------------
+class FMIndex {
+ public:
+  FMIndex() { }
+  ~FMIndex() { }
+
+  // Build the index of the item rows on the fm model. The
+  // item is the row id in items, and the num_list 0 uses
+  // sqrt(number of items) lists. The k-means is computed
+  // by the pool if it is not nullptr
+  void Build(const DMatrix& items,
+             Model& model,
+             index_t num_list,
+             ThreadPool* pool = nullptr,
+             int num_iter = 10,
+             uint64 seed = 0);
+
+  // The top_k items of the user (the sum of CalcContext() of
+  // the user row), in descending order of the scores
+  void Search(const FMContext& user,
+              index_t top_k,
+              index_t num_probe,
+              std::vector<Candidate>* top) const;
+
+  // Build the user vector of the row by FMScore, and search
+  // the top_k items of it
+  void Query(const RowView& user,
+             Model& model,
+             index_t top_k,
+             index_t num_probe,
+             std::vector<Candidate>* top);
+
+  // Serialize the index to the file, and load it
+  void Serialize(const std::string& filename) const;
+  bool Deserialize(const std::string& filename);
+
+  inline index_t NumItems() const { return item_.size(); }
+  inline index_t NumLists() const { return list_offset_.size() - 1; }
+  // The aligned K of the model of the index
+  inline index_t AlignedK() const { return dim_ - 1; }
+
+ protected:
+  /* The vector of each item has dim_ = aligned_k + 1 floats:
+  item.sum and then item.linear + item.pair */
+  index_t dim_ = 0;
+  /* The bias b of the model */
+  real_t bias_ = 0;
+  /* The centroid of each list */
+  std::vector<real_t> centroid_;
+  /* The items of list l are [list_offset_[l], list_offset_[l+1])
+  in item_ and vec_ */
+  std::vector<index_t> list_offset_ = std::vector<index_t>(1, 0);
+  std::vector<index_t> item_;
+  std::vector<real_t> vec_;
+  /* The score of the user rows */
+  FMScore score_;
+
+  // Cluster the vectors into num_list lists, and
+  // return the list of each vector
+  void kmeans(const std::vector<real_t>& vec,
+              index_t num_list,
+              ThreadPool* pool,
+              int num_iter,
+              uint64 seed,
+              std::vector<index_t>* assign);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FMIndex);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_FM_INDEX_H_
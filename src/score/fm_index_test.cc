@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the FMIndex class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "src/base/common.h"
+#include "src/base/executor.h"
+#include "src/base/file_util.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+
+#include "src/score/fm_index.h"
+#include "src/score/fm_score.h"
+
+namespace xLearn {
+
+const index_t kNumFeat = 200;
+const index_t kNumItem = 500;
+
+// The user features are [0, 100), and the item features
+// are [100, 200)
+class FMIndexTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    model.Initialize("fm", "cross-entropy", kNumFeat, 0, 8);
+    real_t* w = model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = 0.01 * (i % 13) - 0.05;
+    }
+    real_t* v = model.GetParameter_v();
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      v[i] = 0.01 * ((i * 7) % 97) - 0.4;
+    }
+    model.GetParameter_b()[0] = 0.3;
+    items.ResetMatrix(kNumItem);
+    for (index_t i = 0; i < kNumItem; ++i) {
+      for (index_t j = 0; j <= i % 3; ++j) {
+        items.AddNode(i, 100 + (i * 7 + j * 31) % 100, 1.0 - 0.2 * j);
+      }
+    }
+  }
+
+  // The user row of the user u
+  SparseRow user_row(index_t u) {
+    SparseRow user;
+    for (index_t j = 0; j < 5; ++j) {
+      user.push_back({0, (u * 11 + j * 17) % 100, 0.5f + 0.1f * j});
+    }
+    return user;
+  }
+
+  // The score of the user followed by the item
+  real_t row_score(const SparseRow& user, index_t i) {
+    SparseRow row(user);
+    RowView item = items.GetRow(i);
+    row.insert(row.end(), item.begin(), item.end());
+    FMScore score;
+    score.Initialize(0, 0, &model);
+    return score.CalcScore(&row, model);
+  }
+
+  Model model;
+  DMatrix items;
+};
+
+TEST_F(FMIndexTest, exact_search) {
+  FMIndex index;
+  index.Build(items, model, 16, Executor::Get(2));
+  EXPECT_EQ(index.NumItems(), kNumItem);
+  EXPECT_EQ(index.NumLists(), 16);
+  EXPECT_EQ(index.AlignedK(), model.get_aligned_k());
+  for (index_t u = 0; u < 10; ++u) {
+    SparseRow user = user_row(u);
+    // Probing all the lists gives the exact top-k
+    std::vector<Candidate> top;
+    index.Query(&user, model, 10, 16, &top);
+    ASSERT_EQ(top.size(), 10);
+    std::vector<real_t> expect(kNumItem);
+    for (index_t i = 0; i < kNumItem; ++i) {
+      expect[i] = row_score(user, i);
+    }
+    std::vector<real_t> sorted(expect);
+    std::sort(sorted.begin(), sorted.end(), std::greater<real_t>());
+    for (size_t n = 0; n < top.size(); ++n) {
+      EXPECT_NEAR(top[n].score, expect[top[n].item], 1e-4);
+      EXPECT_NEAR(top[n].score, sorted[n], 1e-4);
+      if (n > 0) { EXPECT_GE(top[n-1].score, top[n].score); }
+    }
+  }
+}
+
+TEST_F(FMIndexTest, probe_and_serialize) {
+  FMIndex index;
+  index.Build(items, model, 16);
+  index.Serialize("./fm_index.bin");
+  FMIndex loaded;
+  EXPECT_TRUE(loaded.Deserialize("./fm_index.bin"));
+  RemoveFile("./fm_index.bin");
+  EXPECT_EQ(loaded.NumItems(), kNumItem);
+  EXPECT_EQ(loaded.NumLists(), 16);
+  for (index_t u = 0; u < 10; ++u) {
+    SparseRow user = user_row(u);
+    std::vector<Candidate> top, exact, copy;
+    index.Query(&user, model, 20, 4, &top);
+    index.Query(&user, model, 20, 16, &exact);
+    loaded.Query(&user, model, 20, 4, &copy);
+    ASSERT_EQ(top.size(), 20);
+    ASSERT_EQ(copy.size(), 20);
+    // The items of fewer lists are scored exactly, and
+    // they cannot be better than the exact top-k
+    for (size_t n = 0; n < top.size(); ++n) {
+      EXPECT_NEAR(top[n].score, row_score(user, top[n].item), 1e-4);
+      EXPECT_LE(top[n].score, exact[n].score + 1e-5);
+      EXPECT_EQ(copy[n].item, top[n].item);
+      EXPECT_EQ(copy[n].score, top[n].score);
+    }
+  }
+  // Fewer items than top_k
+  SparseRow user = user_row(0);
+  std::vector<Candidate> top;
+  index.Query(&user, model, kNumItem + 10, 16, &top);
+  EXPECT_EQ(top.size(), kNumItem);
+}
+
+}  // namespace xLearn
@@ -19,144 +19,264 @@ Author: Chao Ma (mctt90@gmail.com)
 This file is the implementation of FMScore class.
 */
 
-#include <pmmintrin.h>  // for SSE
-
 #include "src/score/fm_score.h"
 #include "src/base/math.h"
 
 namespace xLearn {
 
+bool FMScore::SelectKernel(const std::string& name) {
+  const ScoreKernel* kernel = FindScoreKernel(name, kernel_->aligned_k);
+  if (kernel == nullptr) { return false; }
+  kernel_ = kernel;
+  return true;
+}
+
 // y = sum( (V_i*V_j)(x_i * x_j) )
-real_t FMScore::CalcScore(const SparseRow* row,
+real_t FMScore::CalcScore(const RowView& row,
                           Model& model,
                           real_t norm) {
   /*********************************************************
    *  linear and bias term                                 *
    *********************************************************/
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
   real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
+  real_t *w = ctx.w;
   real_t t = 0;
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    t += (iter->feat_val * w[iter->feat_id*2] * sqrt_norm);
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    t += (iter->feat_val * w[iter->feat_id*ctx.w_stride] * sqrt_norm);
+  }
+  if (row.has_dense()) {
+    t += kernel_->dense_linear_score(row.dense(), row.dense_size(),
+                                     w, ctx.w_stride) * sqrt_norm;
   }
   // bias
-  w = model.GetParameter_b();
+  w = ctx.b;
   t += w[0];
   /*********************************************************
    *  latent factor                                        *
    *********************************************************/
-  static index_t aligned_k = model.get_aligned_k();
-  static index_t align0 = model.get_aligned_k() * 2;
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 const XMMw = _mm_load_ps(w+d);
-      XMMs = _mm_add_ps(XMMs, _mm_mul_ps(XMMw, XMMv));
-      _mm_store_ps(s+d, XMMs);
+  // sum( V_i * x_i ) is computed in the scratch
+  // buffer of current thread by the kernel
+  real_t* sv = ThreadScratch(ctx.aligned_k);
+  real_t t_all = latent_score(row, ctx, norm, sv);
+  t_all += t;
+  return t_all;
+}
+
+// The latent term by the kernel of each latent type. Only the
+// fp32 latent factor of training has the kernels of the dense
+// block and of the binary row
+real_t FMScore::latent_score(const RowView& row,
+                             const KernelContext& ctx,
+                             real_t norm,
+                             real_t* s) const {
+  check_kernel(ctx);
+  if (row.has_dense()) {
+    if (ctx.latent == kLatentFP32 && !ctx.weights_only) {
+      return kernel_->fm_score_dense(row.begin(), row.end(),
+                                     row.dense(), row.dense_size(),
+                                     ctx.v, ctx.aligned_k, norm, s);
     }
+    return latent_score(expand_dense(row), ctx, norm, s);
   }
-  __m128 XMMt = _mm_set1_ps(0.0f);
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 XMMw = _mm_load_ps(w+d);
-      __m128 XMMwv = _mm_mul_ps(XMMw, XMMv);
-      XMMt = _mm_add_ps(XMMt,
-         _mm_mul_ps(XMMwv, _mm_sub_ps(XMMs, XMMwv)));
-    }
+  if (ctx.latent == kLatentINT8) {
+    return kernel_->fm_score_int8(row.begin(), row.end(), ctx.vq,
+                                  ctx.vscale, ctx.aligned_k, norm, s);
+  } else if (ctx.latent != kLatentFP32) {
+    return kernel_->fm_score_half(row.begin(), row.end(), ctx.vh,
+                                  ctx.aligned_k, norm, s, ctx.bf16);
+  } else if (ctx.weights_only) {
+    return kernel_->fm_score_w(row.begin(), row.end(), ctx.v,
+                               ctx.aligned_k, norm, s);
+  } else if (row.is_binary()) {
+    return kernel_->fm_score_binary(row.begin(), row.end(), ctx.v,
+                                    ctx.aligned_k, norm, s);
   }
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  XMMt = _mm_hadd_ps(XMMt, XMMt);
-  real_t t_all;
-  _mm_store_ss(&t_all, XMMt);
-  t_all *= 0.5;
-  t_all += t;
-  return t_all;
+  return kernel_->fm_score(row.begin(), row.end(), ctx.v,
+                           ctx.aligned_k, norm, s);
+}
+
+// The terms of the context are computed without the normalization.
+// The kernel multiplies each x by norm, so the pair term of the
+// whole row is norm * norm * (pair_c + pair_i + sum_c * sum_i)
+void FMScore::CalcContext(const RowView& row,
+                          Model& model,
+                          FMContext* partial) {
+  CHECK_NOTNULL(partial);
+  RowView context = row.has_dense() ? expand_dense(row) : row;
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  partial->linear = 0;
+  for (RowView::const_iterator iter = context.begin();
+       iter != context.end(); ++iter) {
+    partial->linear += iter->feat_val * ctx.w[iter->feat_id*ctx.w_stride];
+  }
+  real_t* sv = ThreadScratch(ctx.aligned_k);
+  partial->pair = latent_score(context, ctx, 1.0, sv);
+  partial->sum.assign(sv, sv + ctx.aligned_k);
+}
+
+// Only the candidate features are visited
+real_t FMScore::CalcCandidateScore(const FMContext& partial,
+                                   const RowView& row,
+                                   Model& model,
+                                   real_t norm) {
+  RowView item = row.has_dense() ? expand_dense(row) : row;
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  CHECK_EQ(partial.sum.size(), ctx.aligned_k);
+  real_t linear = partial.linear;
+  for (RowView::const_iterator iter = item.begin();
+       iter != item.end(); ++iter) {
+    linear += iter->feat_val * ctx.w[iter->feat_id*ctx.w_stride];
+  }
+  real_t* sv = ThreadScratch(ctx.aligned_k);
+  real_t pair = partial.pair + latent_score(item, ctx, 1.0, sv);
+  for (index_t d = 0; d < ctx.aligned_k; ++d) {
+    pair += partial.sum[d] * sv[d];
+  }
+  return linear * sqrt(norm) + ctx.b[0] + pair * norm * norm;
 }
 
 // Calculate gradient and update current
 // model parameters
-void FMScore::CalcGrad(const SparseRow* row,
+void FMScore::CalcGrad(const RowView& row,
                        Model& model,
                        real_t pg,
                        real_t norm) {
   /*********************************************************
    *  linear and bias term                                 *
    *********************************************************/
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  // The latent factor of inference cannot be trained
+  CHECK(!ctx.is_inference());
+  CHECK_EQ(ctx.w_stride, updater().LinearStride());
+  update_linear(row, ctx.w, ctx.b, pg, sqrt(norm), ctx.dirty,
+                ctx.stamps);
+  /*********************************************************
+   *  latent factor                                        *
+   *********************************************************/
+  real_t* sv = ThreadScratch(ctx.aligned_k);
+  check_kernel(ctx);
+  if (row.has_dense()) {
+    kernel_->fm_grad_dense(row.begin(), row.end(), row.dense(),
+                           row.dense_size(), ctx.v, ctx.aligned_k,
+                           norm, pg, learning_rate_, regu_lambda_,
+                           sv, sqrt_precision_);
+    return;
+  }
+  if (row.is_binary()) {
+    kernel_->fm_grad_binary(row.begin(), row.end(), ctx.v,
+                            ctx.aligned_k, norm, pg, learning_rate_,
+                            regu_lambda_, sv, sqrt_precision_);
+    return;
+  }
+  kernel_->fm_grad(row.begin(), row.end(), ctx.v,
+                   ctx.aligned_k, norm, pg, learning_rate_,
+                   regu_lambda_, sv, sqrt_precision_);
+}
+
+// The score visits the latent vectors of the row to build the
+// sum s, and the update visits them again, but CalcGrad() would
+// build the same s in one more visit before the update
+real_t FMScore::CalcScoreAndGrad(const RowView& row,
+                                 Model& model,
+                                 real_t y,
+                                 PartialGrad pg_func,
+                                 real_t norm,
+                                 real_t weight) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  // The latent factor of inference cannot be trained
+  CHECK(!ctx.is_inference());
+  CHECK_EQ(ctx.w_stride, updater().LinearStride());
+  check_kernel(ctx);
+  /*********************************************************
+   *  Step 1: score and keep the sum vector                *
+   *********************************************************/
+  // The terms are added in the order of CalcScore()
   real_t sqrt_norm = sqrt(norm);
-  real_t *w = model.GetParameter_w();
-  for (SparseRow::const_iterator iter = row->begin();
-      iter != row->end(); ++iter) {
-    real_t &wl = w[iter->feat_id*2];
-    real_t &wlg = w[iter->feat_id*2+1];
-    real_t g = regu_lambda_*wl+pg*iter->feat_val*sqrt_norm;
-    wlg += g*g;
-    wl -= learning_rate_ * g * InvSqrt(wlg);
+  real_t t = 0;
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    t += (iter->feat_val * ctx.w[iter->feat_id*ctx.w_stride] * sqrt_norm);
   }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t g = pg;
-  wbg += g*g;
-  wb -= learning_rate_ * g * InvSqrt(wbg);
+  if (row.has_dense()) {
+    t += kernel_->dense_linear_score(row.dense(), row.dense_size(),
+                                     ctx.w, ctx.w_stride) * sqrt_norm;
+  }
+  t += ctx.b[0];
+  real_t* sv = ThreadScratch(ctx.aligned_k);
+  real_t score = row.is_binary() ?
+    kernel_->fm_score_binary(row.begin(), row.end(), ctx.v,
+                             ctx.aligned_k, norm, sv) :
+    kernel_->fm_score_dense(row.begin(), row.end(),
+                            row.dense(), row.dense_size(),
+                            ctx.v, ctx.aligned_k, norm, sv);
+  score += t;
   /*********************************************************
-   *  latent factor                                        *
+   *  Step 2: update the model from the sum vector         *
    *********************************************************/
-  static index_t aligned_k = model.get_aligned_k();
-  static index_t align0 = model.get_aligned_k() * 2;
-  __m128 XMMpg = _mm_set1_ps(pg);
-  __m128 XMMlr = _mm_set1_ps(learning_rate_);
-  __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    for (index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 const XMMw = _mm_load_ps(w+d);
-      XMMs = _mm_add_ps(XMMs, _mm_mul_ps(XMMw, XMMv));
-      _mm_store_ps(s+d, XMMs);
-    }
+  real_t pg = 0;
+  if (pg_func(score, y, &pg)) {
+    pg *= weight;
+    update_linear(row, ctx.w, ctx.b, pg, sqrt_norm, ctx.dirty,
+                  ctx.stamps);
+    kernel_->fm_grad_sum(row.begin(), row.end(), row.dense(),
+                         row.dense_size(), ctx.v, ctx.aligned_k, norm,
+                         pg, learning_rate_, regu_lambda_, sv,
+                         sqrt_precision_);
   }
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t j1 = iter->feat_id;
-    real_t v1 = iter->feat_val;
-    real_t *w = model.GetParameter_v() + j1 * align0;
-    __m128 XMMv = _mm_set1_ps(v1*norm);
-    __m128 XMMpgv = _mm_mul_ps(XMMpg, XMMv);
-    for(index_t d = 0; d < aligned_k; d += kAlign) {
-      __m128 XMMs = _mm_load_ps(s+d);
-      __m128 XMMw = _mm_load_ps(w+d);
-      __m128 XMMwg = _mm_load_ps(w+aligned_k+d);
-      __m128 XMMg = _mm_add_ps(_mm_mul_ps(XMMlamb, XMMw),
-      _mm_mul_ps(XMMpgv, _mm_sub_ps(XMMs,
-        _mm_mul_ps(XMMw, XMMv))));
-      XMMwg = _mm_add_ps(XMMwg, _mm_mul_ps(XMMg, XMMg));
-      XMMw = _mm_sub_ps(XMMw,
-             _mm_mul_ps(XMMlr,
-             _mm_mul_ps(_mm_rsqrt_ps(XMMwg), XMMg)));
-      _mm_store_ps(w+d, XMMw);
-      _mm_store_ps(w+aligned_k+d, XMMwg);
+  return score;
+}
+
+// Score the rows [begin, end) of matrix
+void FMScore::CalcScoreBatch(const DMatrix* matrix,
+                             index_t begin,
+                             index_t end,
+                             Model& model,
+                             bool is_norm,
+                             real_t* out) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  if (ctx.is_inference()) {
+    Score::CalcScoreBatch(matrix, begin, end, model, is_norm, out);
+    return;
+  }
+  check_kernel(ctx);
+  real_t* sv = ThreadScratch(ctx.aligned_k);
+  const real_t b = ctx.b[0];
+  for (index_t i = begin; i < end; ++i) {
+    RowView row = matrix->GetRow(i);
+    if (i + 1 < end) {
+      RowView next = matrix->GetRow(i+1);
+      prefetch_row(next, ctx.w, ctx.w_stride);
+      prefetch_row(next, ctx.v, ctx.aligned_k * 2);
+    }
+    real_t norm = is_norm ? matrix->norm[i] : 1.0;
+    real_t sqrt_norm = sqrt(norm);
+    real_t t = b;
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      t += (iter->feat_val * ctx.w[iter->feat_id*ctx.w_stride] * sqrt_norm);
+    }
+    if (row.has_dense()) {
+      t += kernel_->dense_linear_score(row.dense(), row.dense_size(),
+                                       ctx.w, ctx.w_stride) * sqrt_norm;
+      t += kernel_->fm_score_dense(row.begin(), row.end(), row.dense(),
+                                   row.dense_size(), ctx.v,
+                                   ctx.aligned_k, norm, sv);
+    } else if (row.is_binary()) {
+      t += kernel_->fm_score_binary(row.begin(), row.end(), ctx.v,
+                                    ctx.aligned_k, norm, sv);
+    } else {
+      t += kernel_->fm_score(row.begin(), row.end(), ctx.v,
+                             ctx.aligned_k, norm, sv);
     }
+    out[i-begin] = t;
   }
 }
 
@@ -22,38 +22,145 @@ This file defines the FMrScore (factorization machine) class.
 #ifndef XLEARN_LOSS_FM_SCORE_H_
 #define XLEARN_LOSS_FM_SCORE_H_
 
+#include <vector>
+
 #include "src/base/common.h"
 #include "src/score/score_function.h"
+#include "src/score/score_kernel.h"
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// The partial score of the context features in ranking, which are shared
+// by all the candidates of a request. All the terms are computed without
+// the normalization, which depends on the whole row.
+//------------------------------------------------------------------------------
+struct FMContext {
+  /* sum( w_i * x_i ) of the context */
+  real_t linear = 0;
+  /* 0.5 * sum( (V_i*V_j)(x_i * x_j) ) of the context pairs */
+  real_t pair = 0;
+  /* sum( V_i * x_i ) of the context, which has aligned_k floats */
+  std::vector<real_t> sum;
+};
+
 //------------------------------------------------------------------------------
 // FMScore is used to implemente factorization machines, in which
 // the socre function is y = sum( (V_i*V_j)(x_i * x_j) )
+//
+// In ranking, one context (e.g., the user features) is scored with many
+// candidates (e.g., the item features), and the row of each candidate is
+// the context followed by the candidate. The terms of the context are
+// computed once, and the pair term of the row is split into the context
+// pairs, the candidate pairs, and sum_c( V_c * x_c ) * sum_i( V_i * x_i ),
+// so each candidate is scored in O(item_nnz * K):
+//
+//   FMContext ctx;
+//   score->CalcContext(context_row, model, &ctx);
+//   for (...) {
+//     real_t s = score->CalcCandidateScore(ctx, item_row, model, norm);
+//   }
+//
+// The norm is the one of the whole row, which gives the same score as
+// CalcScore() on the concatenated row.
 //------------------------------------------------------------------------------
 class FMScore : public Score {
  public:
   // Constructor and Desstructor
-  FMScore() { }
+  FMScore() : kernel_(&GetScoreKernel()) { }
   ~FMScore() { }
 
+  // Use the kernel of the instruction set name, which
+  // keeps the aligned K of the specialized kernel
+  bool SelectKernel(const std::string& name);
+
   // Given one exmaple and current model, and
   // return the score
-  real_t CalcScore(const SparseRow* row,
+  real_t CalcScore(const RowView& row,
                    Model& model,
                    real_t norm = 1.0);
 
   // Calculate gradient and update current
   // model parameters
-  void CalcGrad(const SparseRow* row,
+  void CalcGrad(const RowView& row,
                 Model& model,
                 real_t pg,
                 real_t norm = 1.0);
 
+  // The fused training pass. The sum( V_i * x_i ) of the
+  // score is kept in the scratch buffer of the thread, and
+  // the latent factor is updated from it
+  real_t CalcScoreAndGrad(const RowView& row,
+                          Model& model,
+                          real_t y,
+                          PartialGrad pg_func,
+                          real_t norm = 1.0,
+                          real_t weight = 1.0);
+
+  // Score a range of rows with the context of the model
+  // prepared once, and the parameters of the next row
+  // are prefetched while current row is scored
+  void CalcScoreBatch(const DMatrix* matrix,
+                      index_t begin,
+                      index_t end,
+                      Model& model,
+                      bool is_norm,
+                      real_t* out);
+
+  // Compute the partial score of the context features
+  void CalcContext(const RowView& context,
+                   Model& model,
+                   FMContext* partial);
+
+  // Return the score of the context followed by the
+  // candidate, and norm is the one of the whole row
+  real_t CalcCandidateScore(const FMContext& partial,
+                            const RowView& item,
+                            Model& model,
+                            real_t norm = 1.0);
+
+ protected:
+  /* SIMD kernel of the latent factor */
+  const ScoreKernel* kernel_;
+
+  // The latent term of the row by the kernel of the latent
+  // type of the model, and sum( V_i * x_i ) is stored in s
+  real_t latent_score(const RowView& row,
+                      const KernelContext& ctx,
+                      real_t norm,
+                      real_t* s) const;
+
+  // The specialized kernel only works for its own K
+  inline void check_kernel(const KernelContext& ctx) const {
+    CHECK(kernel_->aligned_k == 0 ||
+          kernel_->aligned_k == ctx.aligned_k);
+  }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(FMScore);
 };
 
+//------------------------------------------------------------------------------
+// FMScoreK is the FM score whose kernel is specialized on the
+// aligned K at compile time. They are registered as "fm_k4",
+// "fm_k8", "fm_k16" and "fm_k32", and the Solver will use them
+// if the aligned K of the model is one of them.
+//------------------------------------------------------------------------------
+template <index_t K>
+class FMScoreK : public FMScore {
+ public:
+  FMScoreK() { kernel_ = &GetScoreKernel(K); }
+  ~FMScoreK() { }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FMScoreK);
+};
+
+typedef FMScoreK<4> FMScoreK4;
+typedef FMScoreK<8> FMScoreK8;
+typedef FMScoreK<16> FMScoreK16;
+typedef FMScoreK<32> FMScoreK32;
+
 } // namespace xLearn
 
 #endif // XLEARN_LOSS_FM_SCORE_H_
@@ -22,7 +22,11 @@ This file tests the FMScore class.
 
 #include "gtest/gtest.h"
 
+#include <math.h>
+#include <algorithm>
+
 #include "src/base/common.h"
+#include "src/base/file_util.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 
@@ -74,6 +78,237 @@ TEST_F(FMScoreTest, calc_score) {
   real_t val = score.CalcScore(&row, model);
   // 6 + 20*4*3 = 246
   EXPECT_FLOAT_EQ(val, 246);
+  // Score the same row in a batch
+  DMatrix matrix;
+  matrix.ResetMatrix(3);
+  for (index_t i = 0; i < 3; ++i) {
+    for (index_t j = 0; j < param.num_feature; ++j) {
+      matrix.AddNode(i, j, 2.0);
+    }
+  }
+  std::vector<real_t> out(3);
+  score.CalcScoreBatch(&matrix, 0, 3, model, false, out.data());
+  for (index_t i = 0; i < 3; ++i) {
+    EXPECT_FLOAT_EQ(out[i], 246);
+  }
+}
+
+TEST_F(FMScoreTest, weights_only) {
+  Model model;
+  model.Initialize(param.score_func,
+                   param.loss_func,
+                   param.num_feature,
+                   param.num_field,
+                   param.num_K);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 0.01 * i;
+  }
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = 0.001 * (i % 97);
+  }
+  model.Serialize("./fm_weights.bin", true);
+  Model new_model("./fm_weights.bin");
+  RemoveFile("./fm_weights.bin");
+  EXPECT_TRUE(new_model.IsWeightsOnly());
+  SparseRow row(param.num_feature);
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 0.5 + i;
+  }
+  FMScore score;
+  EXPECT_NEAR(score.CalcScore(&row, new_model),
+              score.CalcScore(&row, model), 1e-4);
+}
+
+TEST_F(FMScoreTest, candidate_score) {
+  const index_t kNumFeat = 50;
+  const char* latent[] = { "fp32", "weights", "fp16", "bf16", "int8" };
+  for (int t = 0; t < 5; ++t) {
+    for (index_t num_K = 8; num_K <= 20; num_K += 12) {
+      Model train_model;
+      train_model.Initialize(param.score_func, param.loss_func,
+                             kNumFeat, param.num_field, num_K);
+      real_t* w = train_model.GetParameter_w();
+      for (index_t i = 0; i < train_model.GetNumParameter_w(); ++i) {
+        w[i] = 0.01 * (i % 13) - 0.05;
+      }
+      real_t* v = train_model.GetParameter_v();
+      for (index_t i = 0; i < train_model.GetNumParameter_v(); ++i) {
+        v[i] = 0.01 * (i % 97) - 0.4;
+      }
+      train_model.GetParameter_b()[0] = 0.3;
+      // The inference models
+      Model* model = &train_model;
+      if (t > 0) {
+        train_model.Serialize("./fm_candidate.bin", t == 1);
+        model = new Model("./fm_candidate.bin");
+        RemoveFile("./fm_candidate.bin");
+        if (t > 1) { model->ConvertLatent(latent[t]); }
+      }
+      SparseRow context;
+      for (index_t i = 0; i < 7; ++i) {
+        context.push_back({0, i * 3, 0.5f + 0.1f * i});
+      }
+      FMScore generic;
+      FMScoreK8 specialized;
+      Score* score_list[] = { &generic, &specialized };
+      FMContext partial;
+      for (int k = 0; k < (num_K == 8 ? 2 : 1); ++k) {
+        FMScore* score = static_cast<FMScore*>(score_list[k]);
+        score->Initialize(0.1, 0, model);
+        score->CalcContext(&context, *model, &partial);
+        for (index_t c = 0; c < 10; ++c) {
+          SparseRow item;
+          for (index_t i = 0; i <= c % 4; ++i) {
+            item.push_back({0, 30 + c + i * 2, 1.0f - 0.1f * i});
+          }
+          SparseRow row(context);
+          row.insert(row.end(), item.begin(), item.end());
+          real_t norm = c % 2 ? 0.3 : 1.0;
+          real_t expect = score->CalcScore(&row, *model, norm);
+          EXPECT_NEAR(score->CalcCandidateScore(partial, &item,
+                                                *model, norm),
+                      expect, 1e-5 * std::max(1.0f, fabsf(expect)));
+        }
+        // The context only
+        SparseRow empty;
+        EXPECT_NEAR(score->CalcCandidateScore(partial, &empty, *model),
+                    score->CalcScore(&context, *model), 1e-4);
+      }
+      if (model != &train_model) { delete model; }
+    }
+  }
+}
+
+TEST_F(FMScoreTest, dense_block) {
+  // The dense values of the first 19 features and one sparse
+  // feature, which are the same as the nodes of all of them
+  const index_t kWidth = 19;
+  const index_t kNumFeat = 40;
+  DMatrix matrix, sparse;
+  matrix.ResetMatrix(2);
+  matrix.SetDenseWidth(kWidth);
+  sparse.ResetMatrix(2);
+  for (index_t i = 0; i < 2; ++i) {
+    for (index_t j = 0; j < kWidth; ++j) {
+      real_t x = (j % 4 == i) ? 0 : 0.1 * j - 0.5 * i;
+      matrix.DenseRow(i)[j] = x;
+      if (x != 0) { sparse.AddNode(i, j, x); }
+    }
+    matrix.AddNode(i, 30 + i, 2.0);
+    sparse.AddNode(i, 30 + i, 2.0);
+  }
+  Model model, ref_model;
+  model.Initialize(param.score_func, param.loss_func,
+                   kNumFeat, param.num_field, param.num_K);
+  ref_model.Initialize(param.score_func, param.loss_func,
+                       kNumFeat, param.num_field, param.num_K);
+  real_t* w = model.GetParameter_w();
+  real_t* ref_w = ref_model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = ref_w[i] = 0.01 * (i % 13);
+  }
+  // The latent weights, and the caches of AdaGrad are kept
+  index_t aligned_k = model.get_aligned_k();
+  real_t* v = model.GetParameter_v();
+  real_t* ref_v = ref_model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    if (i % (2 * aligned_k) < aligned_k) {
+      v[i] = ref_v[i] = 0.01 * (i % 97) - 0.4;
+    }
+  }
+  FMScore score, ref_score;
+  score.Initialize(param.learning_rate, param.regu_lambda, &model);
+  ref_score.Initialize(param.learning_rate, param.regu_lambda, &ref_model);
+  std::vector<real_t> out(2);
+  score.CalcScoreBatch(&matrix, 0, 2, model, false, out.data());
+  for (index_t i = 0; i < 2; ++i) {
+    real_t expect = ref_score.CalcScore(sparse.GetRow(i), ref_model, 0.5);
+    EXPECT_NEAR(score.CalcScore(matrix.GetRow(i), model, 0.5),
+                expect, 1e-4);
+    expect = ref_score.CalcScore(sparse.GetRow(i), ref_model);
+    EXPECT_NEAR(out[i], expect, 1e-4);
+  }
+  // The same update as the nodes
+  for (index_t i = 0; i < 2; ++i) {
+    score.CalcGrad(matrix.GetRow(i), model, 0.5, 0.5);
+    ref_score.CalcGrad(sparse.GetRow(i), ref_model, 0.5, 0.5);
+  }
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    EXPECT_NEAR(w[i], ref_w[i], 1e-5);
+  }
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    EXPECT_NEAR(v[i], ref_v[i], 1e-5);
+  }
+  // The weights-only model scores the expanded nodes
+  model.Serialize("./fm_dense.bin", true);
+  Model new_model("./fm_dense.bin");
+  RemoveFile("./fm_dense.bin");
+  for (index_t i = 0; i < 2; ++i) {
+    EXPECT_NEAR(score.CalcScore(matrix.GetRow(i), new_model),
+                score.CalcScore(sparse.GetRow(i), model), 1e-4);
+  }
+}
+
+// The partial gradient of the squared loss
+static bool squared_grad(real_t score, real_t y, real_t* pg) {
+  *pg = score - y;
+  return true;
+}
+
+TEST_F(FMScoreTest, fused_grad) {
+  // Rows of the nodes, and rows of a dense block
+  const index_t kNumFeat = 30;
+  DMatrix matrix;
+  matrix.ResetMatrix(6);
+  matrix.SetDenseWidth(5);
+  for (index_t i = 0; i < 6; ++i) {
+    for (index_t j = 0; j < 5 && i >= 3; ++j) {
+      matrix.DenseRow(i)[j] = 0.2 * j - 0.1 * i;
+    }
+    for (index_t j = 0; j < 4; ++j) {
+      matrix.AddNode(i, 5 + (i * 7 + j * 3) % 25, 0.3 * (j + 1));
+    }
+  }
+  Model model, ref_model;
+  model.Initialize(param.score_func, param.loss_func,
+                   kNumFeat, param.num_field, param.num_K);
+  ref_model.Initialize(param.score_func, param.loss_func,
+                       kNumFeat, param.num_field, param.num_K);
+  real_t* v = model.GetParameter_v();
+  real_t* ref_v = ref_model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = ref_v[i];
+  }
+  FMScore score, ref_score;
+  score.Initialize(param.learning_rate, 0.01, &model);
+  ref_score.Initialize(param.learning_rate, 0.01, &ref_model);
+  // The fused pass gives the score and update of the
+  // score followed by the gradient
+  for (int epoch = 0; epoch < 3; ++epoch) {
+    for (index_t i = 0; i < matrix.row_length; ++i) {
+      real_t y = i % 2 ? 1.0 : -1.0;
+      real_t val = score.CalcScoreAndGrad(matrix.GetRow(i), model, y,
+                                          squared_grad, 0.5, 2.0);
+      real_t expect = ref_score.CalcScore(matrix.GetRow(i),
+                                          ref_model, 0.5);
+      EXPECT_FLOAT_EQ(val, expect);
+      ref_score.CalcGrad(matrix.GetRow(i), ref_model,
+                         (expect - y) * 2.0, 0.5);
+    }
+  }
+  real_t* w = model.GetParameter_w();
+  real_t* ref_w = ref_model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(w[i], ref_w[i]);
+  }
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(v[i], ref_v[i]);
+  }
+  EXPECT_FLOAT_EQ(model.GetParameter_b()[0],
+                  ref_model.GetParameter_b()[0]);
 }
 
 } // namespace xLearn
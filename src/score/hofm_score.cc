@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of HOFMScore class.
+*/
+
+#include "src/score/hofm_score.h"
+#include "src/base/math.h"
+
+namespace xLearn {
+
+bool HOFMScore::SelectKernel(const std::string& name) {
+  const ScoreKernel* kernel = FindScoreKernel(name, kernel_->aligned_k);
+  if (kernel == nullptr) { return false; }
+  kernel_ = kernel;
+  return true;
+}
+
+// y = sum( (P_i*P_j)(x_i * x_j) ) + sum( <Q_i, Q_j, Q_l>(x_i * x_j * x_l) )
+// The dense block has no kernel of HOFM, so its values are the nodes
+real_t HOFMScore::CalcScore(const RowView& row,
+                            Model& model,
+                            real_t norm) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  // The inference model only has fp32 weights (see Solver)
+  CHECK_EQ(ctx.latent, kLatentFP32);
+  check_kernel(ctx);
+  RowView nodes = row.has_dense() ? expand_dense(row) : row;
+  /*********************************************************
+   *  linear and bias term                                 *
+   *********************************************************/
+  real_t sqrt_norm = sqrt(norm);
+  real_t t = 0;
+  for (RowView::const_iterator iter = nodes.begin();
+       iter != nodes.end(); ++iter) {
+    t += iter->feat_val * ctx.w[iter->feat_id*ctx.w_stride];
+  }
+  t = t * sqrt_norm + ctx.b[0];
+  /*********************************************************
+   *  latent factor                                        *
+   *********************************************************/
+  // The weights-only model has no gradient cache
+  index_t stride = (ctx.weights_only ? 2 : 4) * ctx.aligned_k;
+  real_t* s = ThreadScratch(5 * ctx.aligned_k);
+  return t + kernel_->hofm_score(nodes.begin(), nodes.end(), ctx.v,
+                                 ctx.aligned_k, stride, norm, s);
+}
+
+// Calculate gradient and update current
+// model parameters
+void HOFMScore::CalcGrad(const RowView& row,
+                         Model& model,
+                         real_t pg,
+                         real_t norm) {
+  KernelContext tmp;
+  const KernelContext& ctx = get_context(model, &tmp);
+  // The latent factor of inference cannot be trained
+  CHECK(!ctx.is_inference());
+  CHECK_EQ(ctx.w_stride, updater().LinearStride());
+  check_kernel(ctx);
+  RowView nodes = row.has_dense() ? expand_dense(row) : row;
+  /*********************************************************
+   *  linear and bias term                                 *
+   *********************************************************/
+  update_linear(nodes, ctx.w, ctx.b, pg, sqrt(norm), ctx.dirty,
+                ctx.stamps);
+  /*********************************************************
+   *  latent factor                                        *
+   *********************************************************/
+  real_t* s = ThreadScratch(5 * ctx.aligned_k);
+  kernel_->hofm_grad(nodes.begin(), nodes.end(), ctx.v,
+                     ctx.aligned_k, norm, pg, learning_rate_,
+                     regu_lambda_, s, sqrt_precision_);
+}
+
+} // namespace xLearn
@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file defines the HOFMScore (higher-order factorization machine) class.
+*/
+
+#ifndef XLEARN_LOSS_HOFM_SCORE_H_
+#define XLEARN_LOSS_HOFM_SCORE_H_
+
+#include "src/base/common.h"
+#include "src/score/score_function.h"
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// HOFMScore is used to implement the higher-order factorization machines
+// of order 3, in which the score function is
+//
+//   y = sum( (P_i*P_j)(x_i * x_j) ) +
+//       sum( <Q_i, Q_j, Q_l>(x_i * x_j * x_l) ),  i < j < l
+//
+// where <Q_i, Q_j, Q_l> = sum_d( Q_i_d * Q_j_d * Q_l_d ). Each feature has
+// the vector P_i of the pairs and Q_i of the triples, so the model is
+// twice as large as the FM model. The triples are not enumerated: the
+// ANOVA kernel of each order is given by the power sums of the row (see
+// hofm_score() of the kernel), so a row is scored in O(nnz * K) as FM.
+// Each x is multiplied by norm in the latent term, as FMScore.
+//------------------------------------------------------------------------------
+class HOFMScore : public Score {
+ public:
+  // Constructor and Desstructor
+  HOFMScore() : kernel_(&GetScoreKernel()) { }
+  ~HOFMScore() { }
+
+  // Use the kernel of the instruction set name, which
+  // keeps the aligned K of the specialized kernel
+  bool SelectKernel(const std::string& name);
+
+  // Given one exmaple and current model, and
+  // return the score
+  real_t CalcScore(const RowView& row,
+                   Model& model,
+                   real_t norm = 1.0);
+
+  // Calculate gradient and update current
+  // model parameters
+  void CalcGrad(const RowView& row,
+                Model& model,
+                real_t pg,
+                real_t norm = 1.0);
+
+ protected:
+  /* SIMD kernel of the latent factor */
+  const ScoreKernel* kernel_;
+
+  // The specialized kernel only works for its own K
+  inline void check_kernel(const KernelContext& ctx) const {
+    CHECK(kernel_->aligned_k == 0 ||
+          kernel_->aligned_k == ctx.aligned_k);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HOFMScore);
+};
+
+//------------------------------------------------------------------------------
+// HOFMScoreK is the HOFM score whose kernel is specialized on the
+// aligned K at compile time, which is registered as "hofm_k4", etc.
+//------------------------------------------------------------------------------
+template <index_t K>
+class HOFMScoreK : public HOFMScore {
+ public:
+  HOFMScoreK() { kernel_ = &GetScoreKernel(K); }
+  ~HOFMScoreK() { }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HOFMScoreK);
+};
+
+typedef HOFMScoreK<4> HOFMScoreK4;
+typedef HOFMScoreK<8> HOFMScoreK8;
+typedef HOFMScoreK<16> HOFMScoreK16;
+typedef HOFMScoreK<32> HOFMScoreK32;
+
+} // namespace xLearn
+
+#endif // XLEARN_LOSS_HOFM_SCORE_H_
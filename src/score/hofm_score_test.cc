@@ -0,0 +1,195 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the HOFMScore class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+
+#include "src/score/score_function.h"
+#include "src/score/hofm_score.h"
+
+namespace xLearn {
+
+const index_t kNumFeat = 30;
+const index_t kNumNode = 9;
+
+// The model whose weights are in [-0.5, 0.5), and whose
+// gradient caches are in [1, 2). The padding of K is zero
+void RandomModel(Model* model, index_t num_K) {
+  model->Initialize("hofm", "squared", kNumFeat, 0, num_K);
+  real_t* w = model->GetParameter_w();
+  for (index_t i = 0; i < model->GetNumParameter_w(); ++i) {
+    w[i] = (i % 2 == 0) ? (real_t)rand() / RAND_MAX - 0.5 : 1.0;
+  }
+  model->GetParameter_b()[0] = 0.3;
+  index_t aligned_k = model->get_aligned_k();
+  real_t* v = model->GetParameter_v();
+  for (index_t i = 0; i < model->GetNumParameter_v(); ++i) {
+    bool cache = (i / aligned_k) % 2 == 1;
+    v[i] = (real_t)rand() / RAND_MAX + (cache ? 1.0 : -0.5);
+    if (!cache && i % aligned_k >= num_K) { v[i] = 0; }
+  }
+}
+
+// The row of the unique features
+SparseRow RandomRow() {
+  SparseRow row(kNumNode);
+  for (index_t i = 0; i < kNumNode; ++i) {
+    row[i].feat_id = i * 3 + rand() % 3;
+    row[i].field_id = 0;
+    row[i].feat_val = (real_t)rand() / RAND_MAX + 0.5;
+  }
+  return row;
+}
+
+// P_i and Q_i of the feature in the model of the caches
+const real_t* P(Model& model, index_t feat) {
+  return model.GetParameter_v() + feat * 4 * model.get_aligned_k();
+}
+const real_t* Q(Model& model, index_t feat) {
+  return P(model, feat) + 2 * model.get_aligned_k();
+}
+
+// The pairs and the triples of the row one by one
+real_t NaiveScore(const SparseRow& row, Model& model,
+                  real_t norm) {
+  real_t sum = model.GetParameter_b()[0];
+  std::vector<real_t> x(row.size());
+  for (size_t i = 0; i < row.size(); ++i) {
+    x[i] = row[i].feat_val * norm;
+    sum += row[i].feat_val * sqrt(norm) *
+           model.GetParameter_w()[row[i].feat_id * 2];
+  }
+  for (index_t d = 0; d < model.GetNumK(); ++d) {
+    for (size_t i = 0; i < row.size(); ++i) {
+      for (size_t j = i + 1; j < row.size(); ++j) {
+        sum += P(model, row[i].feat_id)[d] * x[i] *
+               P(model, row[j].feat_id)[d] * x[j];
+        for (size_t l = j + 1; l < row.size(); ++l) {
+          sum += Q(model, row[i].feat_id)[d] * x[i] *
+                 Q(model, row[j].feat_id)[d] * x[j] *
+                 Q(model, row[l].feat_id)[d] * x[l];
+        }
+      }
+    }
+  }
+  return sum;
+}
+
+TEST(HOFMScoreTest, calc_score) {
+  srand(3);
+  for (index_t num_K = 3; num_K <= 20; num_K += 5) {
+    Model model;
+    RandomModel(&model, num_K);
+    SparseRow row = RandomRow();
+    HOFMScore score;
+    HOFMScoreK8 score_k8;
+    for (real_t norm = 0.5; norm <= 1.0; norm += 0.5) {
+      real_t expect = NaiveScore(row, model, norm);
+      EXPECT_NEAR(score.CalcScore(&row, model, norm), expect,
+                  1e-4 * fabs(expect) + 1e-5);
+      if (model.get_aligned_k() == 8) {
+        EXPECT_NEAR(score_k8.CalcScore(&row, model, norm), expect,
+                    1e-4 * fabs(expect) + 1e-5);
+      }
+    }
+  }
+}
+
+// Each vector takes one adagrad step of its naive gradient
+TEST(HOFMScoreTest, calc_grad) {
+  srand(5);
+  const real_t kLearningRate = 0.1;
+  const real_t kLambda = 0.01;
+  const real_t kPg = 0.7;
+  const real_t kNorm = 0.5;
+  for (index_t num_K = 4; num_K <= 20; num_K += 16) {
+    Model model;
+    RandomModel(&model, num_K);
+    index_t aligned_k = model.get_aligned_k();
+    SparseRow row = RandomRow();
+    std::vector<real_t> expect(model.GetParameter_v(),
+                               model.GetParameter_v() +
+                               model.GetNumParameter_v());
+    std::vector<real_t> x(row.size());
+    for (size_t i = 0; i < row.size(); ++i) {
+      x[i] = row[i].feat_val * kNorm;
+    }
+    for (size_t i = 0; i < row.size(); ++i) {
+      real_t* p = expect.data() + row[i].feat_id * 4 * aligned_k;
+      real_t* q = p + 2 * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        // The pairs and the triples that have node i
+        real_t grad_p = 0;
+        real_t grad_q = 0;
+        for (size_t j = 0; j < row.size(); ++j) {
+          if (j == i) { continue; }
+          grad_p += P(model, row[j].feat_id)[d] * x[j];
+          for (size_t l = j + 1; l < row.size(); ++l) {
+            if (l == i) { continue; }
+            grad_q += Q(model, row[j].feat_id)[d] * x[j] *
+                      Q(model, row[l].feat_id)[d] * x[l];
+          }
+        }
+        real_t g = kPg * x[i] * grad_p + kLambda * p[d];
+        p[aligned_k + d] += g * g;
+        p[d] -= kLearningRate * g / sqrt(p[aligned_k + d]);
+        g = kPg * x[i] * grad_q + kLambda * q[d];
+        q[aligned_k + d] += g * g;
+        q[d] -= kLearningRate * g / sqrt(q[aligned_k + d]);
+      }
+    }
+    HOFMScore score;
+    score.Initialize(kLearningRate, kLambda, &model);
+    score.SetSqrtPrecision(kSqrtExact);
+    score.CalcGrad(&row, model, kPg, kNorm);
+    real_t* v = model.GetParameter_v();
+    for (size_t i = 0; i < expect.size(); ++i) {
+      EXPECT_NEAR(v[i], expect[i], 1e-4 * fabs(expect[i]) + 1e-5);
+    }
+  }
+}
+
+TEST(HOFMScoreTest, weights_only) {
+  srand(7);
+  Model model;
+  RandomModel(&model, 12);
+  model.Serialize("./hofm_weights.bin", true);
+  Model new_model("./hofm_weights.bin");
+  RemoveFile("./hofm_weights.bin");
+  EXPECT_TRUE(new_model.IsWeightsOnly());
+  EXPECT_EQ(new_model.GetScoreFunction(), "hofm");
+  SparseRow row = RandomRow();
+  HOFMScore score;
+  real_t expect = score.CalcScore(&row, model, 0.5);
+  EXPECT_NEAR(score.CalcScore(&row, new_model, 0.5), expect,
+              1e-4 * fabs(expect));
+}
+
+} // namespace xLearn
@@ -0,0 +1,290 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of KernelTuner class.
+*/
+
+#include "src/score/kernel_tuner.h"
+
+#include <cpuid.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+
+#include "src/base/split_string.h"
+#include "src/base/stringprintf.h"
+#include "src/score/score_function.h"
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+// The prefetch distances tried for ffm, in feature pairs
+static const index_t kTunePrefetch[] = { 0, 4, 16 };
+
+// The partial gradient of 0, with which the fused pass
+// runs the whole update but does not change the model
+static bool zero_grad(real_t score, real_t y, real_t* pg) {
+  *pg = 0;
+  return true;
+}
+
+std::string KernelChoice::ToString() const {
+  return StringPrintf("%s %s %d", score.c_str(), isa.c_str(),
+                      (int)prefetch);
+}
+
+bool KernelChoice::FromString(const std::string& str) {
+  std::vector<std::string> items;
+  SplitStringUsing(str, " ", &items);
+  if (items.size() != 3) { return false; }
+  int value = atoi(items[2].c_str());
+  if (value < 0) { return false; }
+  score = items[0];
+  isa = items[1];
+  prefetch = value;
+  return true;
+}
+
+KernelTuner::KernelTuner(const std::string& score_func, Model* model,
+                         SqrtPrecision precision)
+  : score_func_(score_func), model_(model), precision_(precision),
+    fixed_prefetch_(-1) {
+  CHECK_NOTNULL(model);
+}
+
+bool KernelTuner::Eligible() const {
+  return model_->GetLatentType() == kLatentFP32 &&
+         !model_->IsWeightsOnly() &&
+         model_->GetLatentPairs() == nullptr &&
+         model_->GetLinearStride() == 2 &&
+         (score_func_ == "linear" || score_func_ == "fm" ||
+          score_func_ == "ffm" || score_func_ == "hofm");
+}
+
+std::vector<KernelChoice> KernelTuner::Candidates() const {
+  std::vector<std::string> scores(1, score_func_);
+  if (score_func_ != "linear" &&
+      IsSpecializedK(model_->get_aligned_k())) {
+    scores.push_back(StringPrintf("%s_k%d", score_func_.c_str(),
+                                  model_->get_aligned_k()));
+  }
+  std::vector<index_t> prefetch(1, 0);
+  if (score_func_ == "ffm") {
+    prefetch.assign(kTunePrefetch, kTunePrefetch +
+                    sizeof(kTunePrefetch) / sizeof(kTunePrefetch[0]));
+  }
+  if (fixed_prefetch_ >= 0) {
+    prefetch.assign(1, (index_t)fixed_prefetch_);
+  }
+  std::vector<const ScoreKernel*> kernels = SupportedScoreKernels();
+  std::vector<KernelChoice> list;
+  for (size_t s = 0; s < scores.size(); ++s) {
+    for (size_t i = 0; i < kernels.size(); ++i) {
+      if (!fixed_isa_.empty() && fixed_isa_ != kernels[i]->name) {
+        continue;
+      }
+      for (size_t p = 0; p < prefetch.size(); ++p) {
+        KernelChoice choice;
+        choice.score = scores[s];
+        choice.isa = kernels[i]->name;
+        choice.prefetch = prefetch[p];
+        list.push_back(choice);
+      }
+    }
+  }
+  return list;
+}
+
+KernelChoice KernelTuner::Tune(const DMatrix& rows, int min_passes,
+                               double min_seconds) {
+  CHECK(Eligible());
+  CHECK_GT(rows.row_length, 0);
+  std::vector<KernelChoice> list = Candidates();
+  CHECK(!list.empty());
+  results_.clear();
+  int best = -1;
+  for (size_t i = 0; i < list.size(); ++i) {
+    list[i].usec_per_row = time_variant(list[i], rows,
+                                        min_passes, min_seconds);
+    results_.push_back(list[i]);
+    if (best < 0 || list[i].usec_per_row < list[best].usec_per_row) {
+      best = i;
+    }
+  }
+  return list[best];
+}
+
+double KernelTuner::time_variant(const KernelChoice& choice,
+                                 const DMatrix& rows,
+                                 int min_passes, double min_seconds) {
+  std::unique_ptr<Score> score(CREATE_SCORE(choice.score.c_str()));
+  CHECK_NOTNULL(score.get());
+  score->Initialize(0, 0, model_);
+  score->SetSqrtPrecision(precision_);
+  score->SetPrefetchDistance(choice.prefetch);
+  CHECK(score->SelectKernel(choice.isa));
+  typedef std::chrono::steady_clock Clock;
+  double best = 0, total = 0;
+  real_t sum = 0;
+  // The first pass warms up the caches and is not measured
+  for (int pass = -1; pass < min_passes || total < min_seconds;
+       ++pass) {
+    Clock::time_point begin = Clock::now();
+    for (index_t i = 0; i < rows.row_length; ++i) {
+      sum += score->CalcScoreAndGrad(rows.GetRow(i), *model_, 1.0,
+                                     zero_grad, rows.norm[i]);
+    }
+    double seconds = std::chrono::duration<double>(
+                       Clock::now() - begin).count();
+    if (pass < 0) { continue; }
+    total += seconds;
+    if (pass == 0 || seconds < best) { best = seconds; }
+  }
+  score->FlushGrad();
+  // The scores are summed so the passes are not optimized away
+  LOG(INFO) << "Kernel " << choice.ToString() << ": "
+            << best * 1e6 / rows.row_length << " us/row, "
+            << "sum of scores " << sum;
+  return best * 1e6 / rows.row_length;
+}
+
+std::string KernelTuner::CacheKey(const DMatrix& rows) const {
+  uint64 nnz = 0;
+  for (index_t i = 0; i < rows.row_length; ++i) {
+    nnz += rows.GetRow(i).size();
+  }
+  index_t avg = rows.row_length > 0 ? nnz / rows.row_length : 0;
+  index_t bucket = 1;
+  while (bucket < avg) { bucket <<= 1; }
+  return StringPrintf("%s|%s|k%d|%s|f%d|nnz%d",
+                      CpuName().c_str(), score_func_.c_str(),
+                      (int)model_->get_aligned_k(),
+                      LatentLayoutName(model_->GetLatentLayout()),
+                      (int)model_->GetNumField(), (int)bucket);
+}
+
+// Each line of the cache is "<key>\t<choice>"
+bool KernelTuner::LoadCache(const std::string& filename,
+                            const std::string& key,
+                            KernelChoice* choice) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) { return false; }
+  bool found = false;
+  char line[1024];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    std::string str(line);
+    while (!str.empty() && (str.back() == '\n' || str.back() == '\r')) {
+      str.pop_back();
+    }
+    size_t tab = str.find('\t');
+    if (tab == std::string::npos || str.compare(0, tab, key) != 0 ||
+        tab != key.size()) {
+      continue;
+    }
+    // The last line of the key wins
+    KernelChoice tmp;
+    if (tmp.FromString(str.substr(tab + 1))) {
+      *choice = tmp;
+      found = true;
+    }
+  }
+  fclose(file);
+  return found;
+}
+
+// The file is replaced by rename(), so the concurrent jobs
+// never read a partial file
+bool KernelTuner::SaveCache(const std::string& filename,
+                            const std::string& key,
+                            const KernelChoice& choice) {
+  std::vector<std::string> lines;
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file != nullptr) {
+    char line[1024];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+      std::string str(line);
+      if (str.compare(0, key.size() + 1, key + "\t") == 0) {
+        continue;
+      }
+      if (!str.empty() && str.back() != '\n') { str += '\n'; }
+      lines.push_back(str);
+    }
+    fclose(file);
+  }
+  lines.push_back(key + "\t" + choice.ToString() + "\n");
+  std::string tmp = StringPrintf("%s.tmp.%d", filename.c_str(),
+                                 (int)getpid());
+  file = fopen(tmp.c_str(), "w");
+  if (file == nullptr) { return false; }
+  bool ok = true;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    ok &= fputs(lines[i].c_str(), file) >= 0;
+  }
+  ok &= fclose(file) == 0;
+  if (!ok || rename(tmp.c_str(), filename.c_str()) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string KernelTuner::DefaultCacheFile() {
+  const char* env = getenv("XLEARN_TUNE_CACHE");
+  if (env != nullptr) { return env; }
+  const char* home = getenv("HOME");
+  if (home == nullptr || home[0] == '\0') { return ""; }
+  std::string dir = std::string(home) + "/.cache";
+  const char* subdirs[] = { "", "/xlearn" };
+  for (int i = 0; i < 2; ++i) {
+    dir += subdirs[i];
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+      return "";
+    }
+  }
+  return dir + "/kernels";
+}
+
+std::string KernelTuner::CpuName() {
+  unsigned int regs[12];
+  unsigned int max_leaf = __get_cpuid_max(0x80000000, nullptr);
+  if (max_leaf < 0x80000004) { return "unknown-cpu"; }
+  for (unsigned int i = 0; i < 3; ++i) {
+    __get_cpuid(0x80000002 + i, &regs[i*4], &regs[i*4+1],
+                &regs[i*4+2], &regs[i*4+3]);
+  }
+  std::string name(reinterpret_cast<const char*>(regs),
+                   sizeof(regs));
+  name = name.c_str();
+  // The brand string is padded by spaces, and the
+  // separators of the cache cannot be in it
+  std::string out;
+  for (size_t i = 0; i < name.size(); ++i) {
+    char c = name[i] == '\t' || name[i] == '|' ? ' ' : name[i];
+    if (c == ' ' && (out.empty() || out.back() == ' ')) { continue; }
+    out += c;
+  }
+  while (!out.empty() && out.back() == ' ') { out.pop_back(); }
+  return out.empty() ? "unknown-cpu" : out;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,155 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the KernelTuner class that chooses the kernels
+of the score function by timing them on the training data.
+*/
+
+#ifndef XLEARN_SCORE_KERNEL_TUNER_H_
+#define XLEARN_SCORE_KERNEL_TUNER_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+// One variant of the kernels of a score function
+struct KernelChoice {
+  /* The registered score, e.g., "ffm" or the
+  specialized "ffm_k8" */
+  std::string score;
+  /* Instruction set of the kernels */
+  std::string isa;
+  /* Prefetch distance in feature pairs */
+  index_t prefetch = 0;
+  /* Measured time of a row in microseconds */
+  double usec_per_row = 0;
+
+  // "ffm_k8 avx2 4", which is also the format of the cache
+  std::string ToString() const;
+
+  // Parse the string of ToString()
+  bool FromString(const std::string& str);
+};
+
+//------------------------------------------------------------------------------
+// KernelTuner chooses the fastest kernels of the score function for the
+// model and the data of a training job. The best variant depends on the
+// CPU, the K of the model, the number of fields and the nnz of the rows,
+// so it is measured instead of being picked by hand for each cluster.
+//
+// The variants are the instruction sets of current CPU (SupportedScore-
+// Kernels()), the kernels specialized on the aligned K or the generic
+// ones, and the prefetch distances of ffm. Each one is a new Score of the
+// real model, which runs the fused pass of the training on a sample of
+// the rows with the partial gradient, the learning rate and the lambda
+// of 0, so the model is updated by nothing. The fastest pass of each
+// variant is compared:
+//
+//   KernelTuner tuner("ffm", &model, kSqrtFast);
+//   KernelChoice best;
+//   std::string key = tuner.CacheKey(sample);
+//   if (!KernelTuner::LoadCache(file, key, &best)) {
+//     best = tuner.Tune(sample);
+//     KernelTuner::SaveCache(file, key, best);
+//   }
+//   score = CREATE_SCORE(best.score.c_str());
+//   score->SelectKernel(best.isa);
+//   score->SetPrefetchDistance(best.prefetch);
+//
+// The choice is cached by the CPU model and the config of the job, so the
+// jobs of the same config on the same CPU model skip the tuning.
+//------------------------------------------------------------------------------
+class KernelTuner {
+ public:
+  KernelTuner(const std::string& score_func, Model* model,
+              SqrtPrecision precision);
+
+  // Only try the instruction set name, e.g., the one given
+  // by XLEARN_KERNEL
+  void FixIsa(const std::string& name) { fixed_isa_ = name; }
+
+  // Only try the prefetch distance, e.g., the one given by -p
+  void FixPrefetch(index_t prefetch) { fixed_prefetch_ = prefetch; }
+
+  // True if the kernels of the model can be timed, i.e., the
+  // fp32 latent factor of a dense model that can be trained,
+  // and the linear term of AdaGrad. The states of FTRL and
+  // the lazy AdaGrad would be moved by the zero update
+  bool Eligible() const;
+
+  // The variants to time, whose usec_per_row is 0
+  std::vector<KernelChoice> Candidates() const;
+
+  // Time each variant on the rows and return the fastest one.
+  // Each variant makes at least min_passes passes over the
+  // rows and runs for at least min_seconds
+  KernelChoice Tune(const DMatrix& rows, int min_passes = 3,
+                    double min_seconds = 0.02);
+
+  // The measured variants of the last Tune()
+  const std::vector<KernelChoice>& Results() const { return results_; }
+
+  // The key of the cache, which has the CPU model, the score, the
+  // shape of the model and the nnz of the rows rounded to a power
+  // of 2, e.g., "Intel(R) Xeon(R) ...|ffm|k16|interleaved|f24|nnz32"
+  std::string CacheKey(const DMatrix& rows) const;
+
+  // Find the choice of the key in the cache file
+  static bool LoadCache(const std::string& filename,
+                        const std::string& key,
+                        KernelChoice* choice);
+
+  // Add or replace the choice of the key in the cache file.
+  // Return false if the file cannot be written
+  static bool SaveCache(const std::string& filename,
+                        const std::string& key,
+                        const KernelChoice& choice);
+
+  // $XLEARN_TUNE_CACHE, or ~/.cache/xlearn/kernels by default,
+  // whose directories are created. Return "" if there is none
+  static std::string DefaultCacheFile();
+
+  // The brand string of current CPU
+  static std::string CpuName();
+
+ protected:
+  std::string score_func_;
+  Model* model_;
+  SqrtPrecision precision_;
+  std::string fixed_isa_;
+  /* The prefetch distance to try, or -1 for all */
+  int fixed_prefetch_;
+  std::vector<KernelChoice> results_;
+
+  // Microseconds of a row of the fastest pass of the variant
+  double time_variant(const KernelChoice& choice,
+                      const DMatrix& rows,
+                      int min_passes, double min_seconds);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(KernelTuner);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_KERNEL_TUNER_H_
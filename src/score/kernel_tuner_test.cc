@@ -0,0 +1,171 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the KernelTuner class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+
+#include "src/score/ffm_score.h"
+#include "src/score/kernel_tuner.h"
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+const index_t kNumFeature = 100;
+const index_t kNumField = 6;
+
+// Rows of 6 nodes, one of each field
+void InitRows(DMatrix* matrix, index_t num_row) {
+  matrix->ResetMatrix(num_row);
+  for (index_t i = 0; i < num_row; ++i) {
+    for (index_t f = 0; f < kNumField; ++f) {
+      matrix->AddNode(i, (i * 7 + f * 13) % kNumFeature, 0.5, f);
+    }
+    matrix->norm[i] = 0.4;
+  }
+}
+
+TEST(KernelTunerTest, Candidates) {
+  Model model;
+  model.Initialize("ffm", "cross-entropy", kNumFeature, kNumField, 8);
+  KernelTuner tuner("ffm", &model, kSqrtFast);
+  EXPECT_TRUE(tuner.Eligible());
+  // The generic and the specialized scores of each
+  // instruction set, and 3 prefetch distances
+  size_t num_isa = SupportedScoreKernels().size();
+  std::vector<KernelChoice> list = tuner.Candidates();
+  EXPECT_EQ(list.size(), 2 * num_isa * 3);
+  EXPECT_EQ(list[0].score, "ffm");
+  EXPECT_EQ(list.back().score, "ffm_k8");
+  tuner.FixIsa("sse");
+  tuner.FixPrefetch(4);
+  list = tuner.Candidates();
+  ASSERT_EQ(list.size(), 2);
+  for (size_t i = 0; i < list.size(); ++i) {
+    EXPECT_EQ(list[i].isa, "sse");
+    EXPECT_EQ(list[i].prefetch, 4);
+  }
+  // The linear score has no specialized kernel and no prefetch
+  Model linear;
+  linear.Initialize("linear", "squared", kNumFeature, 0, 0);
+  KernelTuner linear_tuner("linear", &linear, kSqrtFast);
+  EXPECT_EQ(linear_tuner.Candidates().size(), num_isa);
+  // FTRL keeps the states that a zero update moves
+  Model ftrl;
+  ftrl.Initialize("fm", "squared", kNumFeature, 0, 8, 1.0, 3);
+  KernelTuner ftrl_tuner("fm", &ftrl, kSqrtFast);
+  EXPECT_FALSE(ftrl_tuner.Eligible());
+}
+
+TEST(KernelTunerTest, Tune_keeps_model) {
+  const char* score_func[] = { "linear", "fm", "ffm", "hofm" };
+  for (int s = 0; s < 4; ++s) {
+    Model model;
+    model.Initialize(score_func[s], "cross-entropy", kNumFeature,
+                     kNumField, 8);
+    std::vector<real_t> w(model.GetParameter_w(),
+                          model.GetParameter_w() +
+                          model.GetNumParameter_w());
+    std::vector<real_t> v(model.GetParameter_v(),
+                          model.GetParameter_v() +
+                          model.GetNumParameter_v());
+    real_t b = model.GetParameter_b()[0];
+    DMatrix rows;
+    InitRows(&rows, 50);
+    KernelTuner tuner(score_func[s], &model, kSqrtFast);
+    KernelChoice best = tuner.Tune(rows, 2, 0);
+    EXPECT_EQ(tuner.Results().size(), tuner.Candidates().size());
+    EXPECT_GT(best.usec_per_row, 0);
+    for (size_t i = 0; i < tuner.Results().size(); ++i) {
+      EXPECT_GE(tuner.Results()[i].usec_per_row, best.usec_per_row);
+    }
+    EXPECT_EQ(memcmp(w.data(), model.GetParameter_w(),
+                     w.size() * sizeof(real_t)), 0);
+    EXPECT_EQ(memcmp(v.data(), model.GetParameter_v(),
+                     v.size() * sizeof(real_t)), 0);
+    EXPECT_EQ(b, model.GetParameter_b()[0]);
+  }
+}
+
+TEST(KernelTunerTest, SelectKernel) {
+  Model model;
+  model.Initialize("ffm", "cross-entropy", kNumFeature, kNumField, 8);
+  DMatrix rows;
+  InitRows(&rows, 3);
+  FFMScoreK8 score;
+  score.Initialize(0.1, 0, &model);
+  real_t expected = score.CalcScore(rows.GetRow(0), model, 0.4);
+  std::vector<const ScoreKernel*> list = SupportedScoreKernels();
+  for (size_t i = 0; i < list.size(); ++i) {
+    EXPECT_TRUE(score.SelectKernel(list[i]->name));
+    EXPECT_NEAR(score.CalcScore(rows.GetRow(0), model, 0.4),
+                expected, 1e-5);
+  }
+  EXPECT_FALSE(score.SelectKernel("unknown"));
+  EXPECT_TRUE(FindScoreKernel("unknown") == nullptr);
+  EXPECT_EQ(FindScoreKernel("sse", 8)->aligned_k, 8);
+}
+
+TEST(KernelTunerTest, Cache) {
+  std::string filename = "./kernel_tuner_cache.txt";
+  remove(filename.c_str());
+  KernelChoice choice;
+  EXPECT_FALSE(KernelTuner::LoadCache(filename, "cpu|ffm", &choice));
+  KernelChoice a;
+  a.score = "ffm_k8";
+  a.isa = "avx2";
+  a.prefetch = 4;
+  KernelChoice b;
+  b.score = "fm";
+  b.isa = "sse";
+  EXPECT_TRUE(KernelTuner::SaveCache(filename, "cpu|ffm", a));
+  EXPECT_TRUE(KernelTuner::SaveCache(filename, "cpu|fm", b));
+  EXPECT_TRUE(KernelTuner::LoadCache(filename, "cpu|ffm", &choice));
+  EXPECT_EQ(choice.ToString(), "ffm_k8 avx2 4");
+  EXPECT_FALSE(KernelTuner::LoadCache(filename, "cpu|ff", &choice));
+  // The choice of a key is replaced
+  a.prefetch = 16;
+  EXPECT_TRUE(KernelTuner::SaveCache(filename, "cpu|ffm", a));
+  EXPECT_TRUE(KernelTuner::LoadCache(filename, "cpu|ffm", &choice));
+  EXPECT_EQ(choice.prefetch, 16);
+  EXPECT_TRUE(KernelTuner::LoadCache(filename, "cpu|fm", &choice));
+  EXPECT_EQ(choice.ToString(), "fm sse 0");
+  RemoveFile(filename.c_str());
+  // The key has the CPU and the shape of the model
+  Model model;
+  model.Initialize("ffm", "cross-entropy", kNumFeature, kNumField, 8);
+  DMatrix rows;
+  InitRows(&rows, 3);
+  KernelTuner tuner("ffm", &model, kSqrtFast);
+  std::string key = tuner.CacheKey(rows);
+  EXPECT_EQ(key, KernelTuner::CpuName() +
+                 "|ffm|k8|interleaved|f6|nnz8");
+  EXPECT_EQ(key.find('\t'), std::string::npos);
+}
+
+}  // namespace xLearn
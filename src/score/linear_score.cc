@@ -24,45 +24,83 @@ This file is the implementation of LinearScore class.
 
 namespace xLearn {
 
+bool LinearScore::SelectKernel(const std::string& name) {
+  const ScoreKernel* kernel = FindScoreKernel(name, kernel_->aligned_k);
+  if (kernel == nullptr) { return false; }
+  kernel_ = kernel;
+  return true;
+}
+
 // y = wTx (bias is added in w and x automitically)
-real_t LinearScore::CalcScore(const SparseRow* row,
+// The linear term is computed by the SIMD kernel
+real_t LinearScore::CalcScore(const RowView& row,
                               Model& model,
                               real_t norm) {
   real_t* w = model.GetParameter_w();
-  real_t score = 0.0;
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    index_t idx = iter->feat_id * 2;
-    score += w[idx] * iter->feat_val;
-  }
+  index_t stride = model.GetLinearStride();
+  real_t score = linear_term(row, w, stride);
   // bias
   score += model.GetParameter_b()[0];
   return score;
 }
 
+// The nodes and the dense values of the row
+real_t LinearScore::linear_term(const RowView& row,
+                                const real_t* w,
+                                index_t stride) const {
+  real_t score = stride == 2 ?
+    kernel_->linear_score(row.begin(), row.end(), w) :
+    kernel_->linear_score_stride(row.begin(), row.end(), w, stride);
+  if (row.has_dense()) {
+    score += kernel_->dense_linear_score(row.dense(), row.dense_size(),
+                                         w, stride);
+  }
+  return score;
+}
+
 // Calculate gradient and update current model
-void LinearScore::CalcGrad(const SparseRow* row,
+void LinearScore::CalcGrad(const RowView& row,
                            Model& model,
                            real_t pg,
                            real_t norm) {
-  real_t* w = model.GetParameter_w();
-  for (SparseRow::const_iterator iter = row->begin();
-       iter != row->end(); ++iter) {
-    real_t gradient = pg * iter->feat_val;
-    index_t idx_g = iter->feat_id * 2;
-    index_t idx_c = idx_g + 1;
-    gradient += regu_lambda_ * w[idx_g];
-    w[idx_c] += (gradient * gradient);
-    w[idx_g] -= (learning_rate_ * gradient *
-                 InvSqrt(w[idx_c]));
+  // The weights-only model has no gradient cache
+  CHECK(!model.IsWeightsOnly());
+  CHECK_EQ(model.GetLinearStride(), updater().LinearStride());
+  update_linear(row, model.GetParameter_w(),
+                model.GetParameter_b(), pg, 1.0,
+                model.GetDirtyFeatures(),
+                model.GetUpdateStamps());
+}
+
+real_t LinearScore::CalcScoreAndGrad(const RowView& row,
+                                     Model& model,
+                                     real_t y,
+                                     PartialGrad pg_func,
+                                     real_t norm,
+                                     real_t weight) {
+  real_t score = LinearScore::CalcScore(row, model, norm);
+  real_t pg = 0;
+  if (pg_func(score, y, &pg)) {
+    LinearScore::CalcGrad(row, model, pg * weight, norm);
+  }
+  return score;
+}
+
+// Score the rows [begin, end) of matrix
+void LinearScore::CalcScoreBatch(const DMatrix* matrix,
+                                 index_t begin,
+                                 index_t end,
+                                 Model& model,
+                                 bool is_norm,
+                                 real_t* out) {
+  const real_t* w = model.GetParameter_w();
+  const real_t b = model.GetParameter_b()[0];
+  const index_t stride = model.GetLinearStride();
+  for (index_t i = begin; i < end; ++i) {
+    RowView row = matrix->GetRow(i);
+    if (i + 1 < end) { prefetch_row(matrix->GetRow(i+1), w, stride); }
+    out[i-begin] = linear_term(row, w, stride) + b;
   }
-  // bias
-  w = model.GetParameter_b();
-  real_t &wb = w[0];
-  real_t &wbg = w[1];
-  real_t g = pg;
-  wbg += g*g;
-  wb -= learning_rate_ * g * InvSqrt(wbg);
 }
 
 } // namespace xLearn
@@ -25,6 +25,7 @@ This file defines the LinearScore class.
 #include "src/base/common.h"
 #include "src/data/model_parameters.h"
 #include "src/score/score_function.h"
+#include "src/score/score_kernel.h"
 
 namespace xLearn {
 
@@ -35,23 +36,54 @@ namespace xLearn {
 class LinearScore : public Score {
  public:
   // Constructor and Desstructor
-  LinearScore() { }
+  LinearScore() : kernel_(&GetScoreKernel()) { }
   ~LinearScore() { }
 
+  // Use the kernel of the instruction set name, which
+  // keeps the aligned K of the specialized kernel
+  bool SelectKernel(const std::string& name);
+
   // Given one exmaple and current model, and
   // return the linear score wTx
-  real_t CalcScore(const SparseRow* row,
+  real_t CalcScore(const RowView& row,
                    Model& model,
                    real_t norm = 1.0);
 
   // Calculate gradient and update current
   // model parameters
-  void CalcGrad(const SparseRow* row,
+  void CalcGrad(const RowView& row,
                 Model& model,
                 real_t pg,
                 real_t norm = 1.0);
 
+  // CalcScore() and CalcGrad() of this class without the
+  // virtual calls, which is the training pass of the loss
+  real_t CalcScoreAndGrad(const RowView& row,
+                          Model& model,
+                          real_t y,
+                          PartialGrad pg_func,
+                          real_t norm = 1.0,
+                          real_t weight = 1.0);
+
+  // Score a range of rows with the context of the model
+  // prepared once, and the parameters of the next row
+  // are prefetched while current row is scored
+  void CalcScoreBatch(const DMatrix* matrix,
+                      index_t begin,
+                      index_t end,
+                      Model& model,
+                      bool is_norm,
+                      real_t* out);
+
  private:
+  /* SIMD kernel of the linear term */
+  const ScoreKernel* kernel_;
+
+  // w^T x of the row, whose weights have the given stride
+  real_t linear_term(const RowView& row,
+                     const real_t* w,
+                     index_t stride) const;
+
   DISALLOW_COPY_AND_ASSIGN(LinearScore);
 };
 
@@ -23,11 +23,13 @@ This file tests the LinearScore class.
 #include "gtest/gtest.h"
 
 #include "src/base/common.h"
+#include "src/base/file_util.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 
 #include "src/score/score_function.h"
 #include "src/score/linear_score.h"
+#include "src/score/updater.h"
 
 namespace xLearn {
 
@@ -69,4 +71,122 @@ TEST_F(LinearScoreTest, calc_score) {
   EXPECT_FLOAT_EQ(val, 600.0);
 }
 
+TEST_F(LinearScoreTest, weights_only) {
+  Model model;
+  model.Initialize(param.score_func,
+                param.loss_func,
+                param.num_feature,
+                0, 0);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = i;
+  }
+  model.GetParameter_b()[0] = 1.0;
+  model.Serialize("./linear_weights.bin", true);
+  Model new_model("./linear_weights.bin");
+  RemoveFile("./linear_weights.bin");
+  EXPECT_TRUE(new_model.IsWeightsOnly());
+  // The long row uses the gather of the kernel
+  SparseRow row(kLength);
+  for (index_t i = 0; i < kLength; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 2.0;
+  }
+  LinearScore score;
+  EXPECT_FLOAT_EQ(score.CalcScore(&row, new_model),
+                  score.CalcScore(&row, model));
+}
+
+TEST_F(LinearScoreTest, batch_grad) {
+  Model model, ref_model;
+  model.Initialize(param.score_func, param.loss_func,
+                   param.num_feature, 0, 0);
+  ref_model.Initialize(param.score_func, param.loss_func,
+                       param.num_feature, 0, 0);
+  // Two rows with the shared feature 1
+  SparseRow row_1(2), row_2(2), merged(3);
+  row_1[0].feat_id = 0; row_1[0].feat_val = 1.0;
+  row_1[1].feat_id = 1; row_1[1].feat_val = 2.0;
+  row_2[0].feat_id = 1; row_2[0].feat_val = 3.0;
+  row_2[1].feat_id = 2; row_2[1].feat_val = 4.0;
+  merged[0].feat_id = 0; merged[0].feat_val = 1.0;
+  merged[1].feat_id = 1; merged[1].feat_val = 5.0;
+  merged[2].feat_id = 2; merged[2].feat_val = 4.0;
+  LinearScore score, ref_score;
+  score.Initialize(param.learning_rate, param.regu_lambda, &model);
+  ref_score.Initialize(param.learning_rate, param.regu_lambda, &ref_model);
+  score.SetBatchSize(4);
+  score.CalcGrad(&row_1, model, 0.5);
+  score.CalcGrad(&row_2, model, 0.5);
+  // Nothing is applied before the batch is flushed
+  real_t* w = model.GetParameter_w();
+  EXPECT_FLOAT_EQ(w[2], 0.0);
+  EXPECT_FLOAT_EQ(model.GetParameter_b()[0], 0.0);
+  score.FlushGrad();
+  // The gradient of each feature is applied once
+  ref_score.CalcGrad(&merged, ref_model, 0.5);
+  real_t* ref_w = ref_model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(w[i], ref_w[i]);
+  }
+  EXPECT_NE(model.GetParameter_b()[0], 0.0);
+}
+
+TEST_F(LinearScoreTest, dense_block) {
+  // The dense values of the first 37 features and one sparse
+  // feature, which are the same as the nodes of all of them
+  const index_t kWidth = 37;
+  DMatrix matrix, sparse;
+  matrix.ResetMatrix(2);
+  matrix.SetDenseWidth(kWidth);
+  sparse.ResetMatrix(2);
+  for (index_t i = 0; i < 2; ++i) {
+    for (index_t j = 0; j < kWidth; ++j) {
+      real_t x = (j % 5 == i) ? 0 : 0.1 * j + i;
+      matrix.DenseRow(i)[j] = x;
+      if (x != 0) { sparse.AddNode(i, j, x); }
+    }
+    matrix.AddNode(i, 50 + i, 2.0);
+    sparse.AddNode(i, 50 + i, 2.0);
+  }
+  const char* opt[] = { "adagrad", "ftrl" };
+  for (int o = 0; o < 2; ++o) {
+    Updater* updater = CREATE_UPDATER(opt[o]);
+    UpdaterParam up;
+    up.learning_rate = param.learning_rate;
+    updater->Initialize(up);
+    Model model, ref_model;
+    model.Initialize(param.score_func, param.loss_func,
+                     param.num_feature, 0, 0, 0.66,
+                     updater->LinearStride());
+    ref_model.Initialize(param.score_func, param.loss_func,
+                         param.num_feature, 0, 0, 0.66,
+                         updater->LinearStride());
+    real_t* w = model.GetParameter_w();
+    real_t* ref_w = ref_model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = ref_w[i] = 0.01 * (i % 7);
+    }
+    LinearScore score;
+    score.Initialize(param.learning_rate, param.regu_lambda, &model);
+    score.SetUpdater(updater);
+    std::vector<real_t> out(2);
+    score.CalcScoreBatch(&matrix, 0, 2, model, false, out.data());
+    for (index_t i = 0; i < 2; ++i) {
+      real_t expect = score.CalcScore(sparse.GetRow(i), ref_model);
+      EXPECT_NEAR(score.CalcScore(matrix.GetRow(i), model), expect, 1e-5);
+      EXPECT_NEAR(out[i], expect, 1e-5);
+    }
+    // The same update as the nodes
+    for (index_t i = 0; i < 2; ++i) {
+      score.CalcGrad(matrix.GetRow(i), model, 0.5);
+      score.CalcGrad(sparse.GetRow(i), ref_model, 0.5);
+    }
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(w[i], ref_w[i]);
+    }
+    delete updater;
+  }
+}
+
 } // namespace xLearn
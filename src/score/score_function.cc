@@ -23,9 +23,179 @@ This file is the implementation of the base Score class.
 #include "src/score/linear_score.h"
 #include "src/score/fm_score.h"
 #include "src/score/ffm_score.h"
+#include "src/score/hofm_score.h"
+#include "src/score/score_kernel.h"
+#ifdef XLEARN_USE_CUDA
+#include "src/score/ffm_score_gpu.h"
+#endif
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
 
 namespace xLearn {
 
+// The scratch buffer of one thread, which is
+// released when the thread exits
+struct ScratchBuffer {
+  ScratchBuffer() : data(nullptr), size(0) { }
+  ~ScratchBuffer() { release(); }
+
+  void release() {
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+    data = nullptr;
+    size = 0;
+  }
+
+  real_t* data;
+  size_t size;
+};
+
+real_t* ThreadScratch(size_t size) {
+  static thread_local ScratchBuffer buffer;
+  if (buffer.size < size) {
+    buffer.release();
+    void* p = nullptr;
+#ifdef _WIN32
+    p = _aligned_malloc(size * sizeof(real_t), kScratchAlignByte);
+#else
+    if (posix_memalign(&p, kScratchAlignByte,
+                       size * sizeof(real_t)) != 0) {
+      p = nullptr;
+    }
+#endif
+    CHECK_NOTNULL(p);
+    buffer.data = static_cast<real_t*>(p);
+    buffer.size = size;
+  }
+  return buffer.data;
+}
+
+// Sort the nodes by feat_id and merge the nodes of the same feature
+index_t SparseGrad::Merge() {
+  if (grad.empty()) { return 0; }
+  std::sort(grad.begin(), grad.end(),
+            [](const Node& a, const Node& b) {
+              return a.feat_id < b.feat_id;
+            });
+  index_t num = 0;
+  for (size_t i = 1; i < grad.size(); ++i) {
+    if (grad[i].feat_id == grad[num].feat_id) {
+      grad[num].feat_val += grad[i].feat_val;
+    } else {
+      grad[++num] = grad[i];
+    }
+  }
+  grad.resize(num + 1);
+  return num + 1;
+}
+
+// The AdaGrad of the linear term is vectorized over the merged
+// nodes of a mini-batch
+void Score::update_w(const Node* begin, const Node* end,
+                     real_t* w, real_t pg) const {
+  static const ScoreKernel& kernel = GetScoreKernel();
+  const Updater& up = updater();
+  if (up.Type() == kUpdaterAdaGrad) {
+    const UpdaterParam& param = up.Param();
+    kernel.linear_grad(begin, end, w, pg, param.learning_rate,
+                       param.regu_lambda, param.sqrt_precision);
+  } else {
+    up.UpdateLinear(begin, end, w, pg);
+  }
+}
+
+// The mini-batch of the calling thread
+static SparseGrad& thread_batch() {
+  static thread_local SparseGrad batch;
+  return batch;
+}
+
+// Apply the merged gradients of the batch
+void Score::apply_batch(SparseGrad* batch) const {
+  if (batch->num_row == 0) { return; }
+  index_t num = batch->Merge();
+  update_w(batch->grad.data(), batch->grad.data() + num, batch->w, 1.0);
+  updater().UpdateBias(batch->b, batch->grad_b);
+  batch->Clear();
+}
+
+// The buffer of the expanded row of the calling thread
+RowView Score::expand_dense(const RowView& row) {
+  static thread_local std::vector<Node> nodes;
+  nodes.clear();
+  Node node;
+  node.field_id = 0;
+  for (index_t j = 0; j < row.dense_size(); ++j) {
+    if (row.dense()[j] == 0) { continue; }
+    node.feat_id = j;
+    node.feat_val = row.dense()[j];
+    nodes.push_back(node);
+  }
+  nodes.insert(nodes.end(), row.begin(), row.end());
+  return RowView(nodes.data(), nodes.data() + nodes.size());
+}
+
+// Update the linear term and bias of the row
+void Score::update_linear(const RowView& row, real_t* w, real_t* b,
+                          real_t pg, real_t scale,
+                          uint8* dirty,
+                          FeatureStamps* stamps) const {
+  if (row.has_dense()) {
+    update_linear(expand_dense(row), w, b, pg, scale, dirty, stamps);
+    return;
+  }
+  if (dirty != nullptr) {
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      dirty[iter->feat_id] = 1;
+    }
+  }
+  if (stamps != nullptr) {
+    uint32 now = stamps->clock.load(std::memory_order_relaxed);
+    uint32* time = stamps->time.data();
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      time[iter->feat_id] = now;
+    }
+  }
+  // The raw row can have the same feature twice (e.g., the
+  // hashed features), so it is updated node by node
+  if (batch_size_ <= 1) {
+    updater().UpdateLinear(row.begin(), row.end(), w, pg * scale);
+    updater().UpdateBias(b, pg);
+    return;
+  }
+  SparseGrad& batch = thread_batch();
+  // The batch of another score or model is applied first
+  if (batch.score != this || batch.w != w) {
+    if (batch.num_row > 0) { batch.score->apply_batch(&batch); }
+    batch.score = this;
+    batch.w = w;
+    batch.b = b;
+  }
+  real_t g = pg * scale;
+  for (RowView::const_iterator iter = row.begin();
+       iter != row.end(); ++iter) {
+    Node node = *iter;
+    node.feat_val *= g;
+    batch.grad.push_back(node);
+  }
+  batch.grad_b += pg;
+  if (++batch.num_row >= batch_size_) { apply_batch(&batch); }
+}
+
+// Apply the batch of the calling thread
+void Score::FlushGrad() const {
+  SparseGrad& batch = thread_batch();
+  if (batch.score == this) { apply_batch(&batch); }
+}
+
 //------------------------------------------------------------------------------
 // Class register
 //------------------------------------------------------------------------------
@@ -33,5 +203,23 @@ CLASS_REGISTER_IMPLEMENT_REGISTRY(xLearn_score_registry, Score);
 REGISTER_SCORE("linear", LinearScore);
 REGISTER_SCORE("fm", FMScore);
 REGISTER_SCORE("ffm", FFMScore);
+REGISTER_SCORE("hofm", HOFMScore);
+// Specialized on the aligned K
+REGISTER_SCORE("fm_k4", FMScoreK4);
+REGISTER_SCORE("fm_k8", FMScoreK8);
+REGISTER_SCORE("fm_k16", FMScoreK16);
+REGISTER_SCORE("fm_k32", FMScoreK32);
+REGISTER_SCORE("ffm_k4", FFMScoreK4);
+REGISTER_SCORE("ffm_k8", FFMScoreK8);
+REGISTER_SCORE("ffm_k16", FFMScoreK16);
+REGISTER_SCORE("ffm_k32", FFMScoreK32);
+REGISTER_SCORE("hofm_k4", HOFMScoreK4);
+REGISTER_SCORE("hofm_k8", HOFMScoreK8);
+REGISTER_SCORE("hofm_k16", HOFMScoreK16);
+REGISTER_SCORE("hofm_k32", HOFMScoreK32);
+#ifdef XLEARN_USE_CUDA
+// The latent factor of ffm on the GPU
+REGISTER_SCORE("ffm_gpu", FFMScoreGPU);
+#endif
 
 }  // namespace xLearn
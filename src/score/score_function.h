@@ -24,15 +24,182 @@ FM score, FFM score, and etc.
 #define XLEARN_LOSS_SCORE_FUNCTION_H_
 
 #include <vector>
+#include <xmmintrin.h>  // for _mm_prefetch
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 #include "src/data/model_parameters.h"
+#include "src/score/updater.h"
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// KernelContext holds the strides and the base pointers of one model,
+// which are used by the hot loops of the score functions. It is prepared
+// once in Score::Initialize(), so each Score object works on its own
+// model and we don't re-derive the strides for each row. Different
+// Score objects can be used on different models (e.g., with different
+// K or different number of fields) at the same time.
+//------------------------------------------------------------------------------
+struct KernelContext {
+  KernelContext()
+    : model(nullptr), w(nullptr), b(nullptr), v(nullptr),
+      vh(nullptr), vq(nullptr), vscale(nullptr),
+      latent(kLatentFP32), bf16(false), weights_only(false),
+      w_stride(2), aligned_k(0), align0(0),
+      align1(0), num_field(0), half_align1(0),
+      layout(kLayoutInterleaved), pairs(nullptr),
+      field_offset(nullptr), dirty(nullptr), stamps(nullptr) { }
+
+  // Compute the context of the model
+  void Prepare(Model& model) {
+    this->model = &model;
+    w = model.GetParameter_w();
+    b = model.GetParameter_b();
+    v = model.GetParameter_v();
+    vh = model.GetParameter_v_half();
+    vq = model.GetParameter_v_int8();
+    vscale = model.GetParameter_v_scale();
+    latent = model.GetLatentType();
+    bf16 = latent == kLatentBF16;
+    weights_only = model.IsWeightsOnly();
+    w_stride = model.GetLinearStride();
+    aligned_k = model.get_aligned_k();
+    layout = model.GetLatentLayout();
+    align0 = LatentBlockSize(layout, aligned_k);
+    align1 = model.GetNumField() * align0;
+    num_field = model.GetNumField();
+    half_align1 = num_field * aligned_k;
+    pairs = model.GetLatentPairs();
+    field_offset = model.GetFieldOffsets();
+    if (field_offset != nullptr) { align1 = field_offset[num_field]; }
+    dirty = model.GetDirtyFeatures();
+    stamps = model.GetUpdateStamps();
+  }
+
+  // Return true if the context is prepared for the model,
+  // and the parameters of the model are not re-allocated
+  inline bool IsPreparedFor(Model& model) const {
+    return this->model == &model &&
+           w == model.GetParameter_w() &&
+           v == model.GetParameter_v() &&
+           vh == model.GetParameter_v_half() &&
+           vq == model.GetParameter_v_int8() &&
+           dirty == model.GetDirtyFeatures() &&
+           stamps == model.GetUpdateStamps();
+  }
+
+  /* The model of this context */
+  const Model* model;
+  /* Base pointers of linear term, bias and latent factor */
+  real_t* w;
+  real_t* b;
+  real_t* v;
+  /* The 16-bit latent factor of an inference model, which is
+  used instead of v if it is not nullptr */
+  const uint16* vh;
+  /* The int8 latent factor and the scale of each latent
+  vector of an inference model */
+  const int8* vq;
+  const real_t* vscale;
+  /* Storage type of the latent factor, and bf16 is true
+  for bfloat16 */
+  LatentType latent;
+  bool bf16;
+  /* The model has no gradient cache, in which v has the
+  layout of vh */
+  bool weights_only;
+  /* w[w_stride * feat] is the weight of feat, which is 1 for
+  the weights-only model, and 2 or 3 for the states of the
+  updater (AdaGrad or FTRL) */
+  index_t w_stride;
+  /* Aligned K of latent factor */
+  index_t aligned_k;
+  /* Stride of a latent vector, 2 * aligned_k for the
+  weights and the fp32 gradient caches (LatentBlockSize()) */
+  index_t align0;
+  /* Stride of a feature in FFM, num_field * align0, or
+  the floats of the blocks of the K of each field */
+  index_t align1;
+  /* Number of field */
+  index_t num_field;
+  /* Stride of a feature in the 16-bit FFM latent
+  factor, num_field * aligned_k */
+  index_t half_align1;
+  /* The layout of the FFM blocks */
+  LatentLayout layout;
+  /* The index of the sparse latent factor of FFM, in
+  which v has the blocks of its slots, or nullptr */
+  const LatentPairs* pairs;
+  /* The offsets of the blocks of each field in the blocks of
+  a feature of the FFM model of the K of each field (see
+  Model::SetFieldK), whose block of field f has the aligned K
+  (field_offset[f+1] - field_offset[f]) / 2, or nullptr */
+  const index_t* field_offset;
+  /* The flags of the updated features of the model
+  (Model::TrackDirtyFeatures), or nullptr */
+  uint8* dirty;
+  /* The update stamps of the features of the model
+  (Model::TrackUpdateTime), or nullptr */
+  FeatureStamps* stamps;
+
+  // The latent factor is converted for inference (16 bits
+  // or int8), or the model is weights-only, which cannot
+  // be trained
+  inline bool is_inference() const {
+    return latent != kLatentFP32 || weights_only;
+  }
+};
+
+// Return a scratch buffer of the calling thread, which has at least
+// size floats and is aligned to kScratchAlignByte. The buffer only
+// grows and is reused by all the rows of the thread, so the hot path
+// of scoring does not allocate memory. It is valid until the next
+// call of ThreadScratch() in the same thread
+const int kScratchAlignByte = 64;
+real_t* ThreadScratch(size_t size);
+
+class Score;
+
+// The gradient of the linear term and bias of a mini-batch, which is
+// accumulated by one thread. Each node is (feat_id, gradient), and
+// the nodes of the same feature are merged when the batch is applied
+struct SparseGrad {
+  SparseGrad() : score(nullptr), w(nullptr), b(nullptr),
+                 grad_b(0), num_row(0) { }
+
+  // Clear the batch
+  void Clear() {
+    score = nullptr;
+    w = nullptr;
+    b = nullptr;
+    grad.clear();
+    grad_b = 0;
+    num_row = 0;
+  }
+
+  // Sort the nodes by feat_id and merge the nodes of the same
+  // feature, which returns the number of the unique features
+  index_t Merge();
+
+  /* The score and the parameters of this batch */
+  const Score* score;
+  real_t* w;
+  real_t* b;
+  /* Gradients of the linear term and bias */
+  std::vector<Node> grad;
+  real_t grad_b;
+  /* Number of rows in this batch */
+  index_t num_row;
+};
+
+// Partial gradient of a loss function. Given the score and the label
+// y of one example, set the partial gradient to pg. Return false if
+// the model does not need to be updated by this example
+typedef bool (*PartialGrad)(real_t score, real_t y, real_t* pg);
+
 //------------------------------------------------------------------------------
 // Score is an abstract class, which can be implemented by different
 // score functions such as LinearScore (liner_score.h), FMScore (fm_score.h)
@@ -40,39 +207,235 @@ namespace xLearn {
 // pass its pointer to a Loss class like this:
 //
 //  Score* score = new FMScore();
+//  score->Initialize(learning_rate, regu_lambda, &model);
 //  score->CalcScore(row, model);
 //  score->CalcGrad(row, model, pg);
 //
-// In general, the CalcGrad() will be used in loss function.
+// In general, the CalcGrad() will be used in loss function. In
+// training, the loss function can also use the fused pass:
+//
+//  score->CalcScoreAndGrad(row, model, y, pg_func);
+//
+// and the prediction can score a range of rows in one call:
+//
+//  score->CalcScoreBatch(matrix, begin, end, model, is_norm, out);
+//
+// which can be overridden by the score function to reuse the
+// memory it touched in the score for the update.
+//
+// The linear term is updated by AdaGrad by default, and
+// another updater (updater.h) can be used by:
+//
+//  score->SetUpdater(updater);
+//
+// In the mini-batch mode, the gradients of the linear term and bias
+// of batch_size rows are accumulated by each thread, and applied once
+// for each touched feature. The latent factor is still updated
+// by each row. Each training thread should flush its last batch:
+//
+//  score->SetBatchSize(batch_size);
+//  ... score->CalcGrad(row, model, pg) ...
+//  score->FlushGrad();
 //------------------------------------------------------------------------------
 class Score {
  public:
   // Constructor and Desstructor
-  Score() { }
+  Score() : prefetch_distance_(0), updater_(nullptr), batch_size_(1),
+            sqrt_precision_(kSqrtFast) { }
   virtual ~Score() { }
 
-  // Invoke this function before we use this class
+  // Invoke this function before we use this class.
+  // The kernel context of the model is prepared here
   virtual void Initialize(real_t learning_rate,
-                          real_t regu_lambda) {
+                          real_t regu_lambda,
+                          Model* model = nullptr) {
     learning_rate_ = learning_rate;
     regu_lambda_ = regu_lambda;
+    UpdaterParam param;
+    param.learning_rate = learning_rate;
+    param.regu_lambda = regu_lambda;
+    param.sqrt_precision = sqrt_precision_;
+    adagrad_.Initialize(param);
+    if (model != nullptr) { context_.Prepare(*model); }
+  }
+
+  // Precision of the 1 / sqrt() of adagrad (math.h), which
+  // is kSqrtFast by default
+  void SetSqrtPrecision(SqrtPrecision precision) {
+    sqrt_precision_ = precision;
+    UpdaterParam param = adagrad_.Param();
+    param.sqrt_precision = precision;
+    adagrad_.Initialize(param);
+  }
+
+  // Update the linear term by the given updater instead
+  // of AdaGrad. The updater is not owned by the score
+  void SetUpdater(const Updater* updater) {
+    updater_ = updater;
+  }
+
+  // Accumulate the gradients of the linear term and bias of
+  // batch_size rows before they are applied. 1 (by default)
+  // applies the gradients of each row
+  void SetBatchSize(index_t batch_size) {
+    CHECK_GT(batch_size, 0);
+    batch_size_ = batch_size;
+  }
+
+  // Apply the accumulated gradients of the calling thread
+  void FlushGrad() const;
+
+  // Set how many feature pairs ahead we prefetch the
+  // latent vectors. 0 means no software prefetch
+  void SetPrefetchDistance(index_t distance) {
+    prefetch_distance_ = distance;
+  }
+
+  // Use the SIMD kernels of the instruction set name ("sse",
+  // "avx2" or "avx512") instead of the best ones of current
+  // CPU, e.g., the ones chosen by KernelTuner. Return false
+  // if the CPU or the score function has no such kernel
+  virtual bool SelectKernel(const std::string& name) {
+    return false;
   }
 
   // Given one exmaple and current model, and
   // return the score
-  virtual real_t CalcScore(const SparseRow* row,
+  virtual real_t CalcScore(const RowView& row,
                            Model& model,
                            real_t norm = 1.0) = 0;
 
   // Calculate gradient and update current
   // model parameters
-  virtual void CalcGrad(const SparseRow* row,
+  virtual void CalcGrad(const RowView& row,
                         Model& model,
                         real_t pg,
                         real_t norm = 1.0) = 0;
+
+  // Calculate the score and then update the model by the
+  // partial gradient pg_func(score, y), which is scaled by
+  // the importance weight of the row. Return the score
+  virtual real_t CalcScoreAndGrad(const RowView& row,
+                                  Model& model,
+                                  real_t y,
+                                  PartialGrad pg_func,
+                                  real_t norm = 1.0,
+                                  real_t weight = 1.0) {
+    real_t score = CalcScore(row, model, norm);
+    real_t pg = 0;
+    if (pg_func(score, y, &pg)) {
+      CalcGrad(row, model, pg * weight, norm);
+    }
+    return score;
+  }
+
+  // Score the rows [begin, end) of matrix into out[0, end-begin).
+  // The norm of the matrix is used if is_norm is true. The score
+  // functions override it to hoist the per-model setup out of the
+  // row loop and to prefetch the parameters of the next row
+  virtual void CalcScoreBatch(const DMatrix* matrix,
+                              index_t begin,
+                              index_t end,
+                              Model& model,
+                              bool is_norm,
+                              real_t* out) {
+    for (index_t i = begin; i < end; ++i) {
+      real_t norm = is_norm ? matrix->norm[i] : 1.0;
+      out[i-begin] = CalcScore(matrix->GetRow(i), model, norm);
+    }
+  }
+
+  // Return true if the score trains a whole batch in one call of
+  // CalcGradBatch(), e.g., on a GPU, instead of the rows of the
+  // threads of the loss
+  virtual bool HasGradBatch() const { return false; }
+
+  // Score and update all the rows of the matrix, where y[i] and
+  // weight[i] are the label and the importance weight of row i,
+  // and set the score of row i to out[i] if out is not nullptr.
+  // Return false if the batch cannot be trained in one call, and
+  // then the loss trains it row by row as usual
+  virtual bool CalcGradBatch(const DMatrix* matrix,
+                             Model& model,
+                             const real_t* y,
+                             const real_t* weight,
+                             PartialGrad pg_func,
+                             bool is_norm,
+                             real_t* out) {
+    return false;
+  }
+
  protected:
   real_t learning_rate_;
   real_t regu_lambda_;
+  /* Kernel context of the model given by Initialize() */
+  KernelContext context_;
+  /* Prefetch distance (in feature pairs) of the kernel */
+  index_t prefetch_distance_;
+  /* Updater of the linear term given by SetUpdater(),
+  and adagrad_ is used if it is nullptr */
+  const Updater* updater_;
+  AdaGradUpdater adagrad_;
+
+  /* Number of rows in a mini-batch */
+  index_t batch_size_;
+  /* Precision of 1 / sqrt() in adagrad */
+  SqrtPrecision sqrt_precision_;
+
+  // Return the updater of the linear term
+  inline const Updater& updater() const {
+    return updater_ != nullptr ? *updater_ : adagrad_;
+  }
+
+  // Update the linear term of the nodes by pg * feat_val, by the
+  // SIMD kernel of AdaGrad or the loop of the other updaters. The
+  // nodes are the ones merged by SparseGrad::Merge(), whose
+  // feature ids are unique, and the raw rows use UpdateLinear()
+  void update_w(const Node* begin, const Node* end,
+                real_t* w, real_t pg) const;
+
+  // Update the linear term and bias by the partial gradient pg
+  // of the row, where the gradient of the linear term is scaled
+  // by scale. The update is deferred to the end of the batch
+  // in the mini-batch mode. The features of the row are flagged
+  // in dirty and stamped in stamps if they are not nullptr
+  void update_linear(const RowView& row, real_t* w, real_t* b,
+                     real_t pg, real_t scale, uint8* dirty,
+                     FeatureStamps* stamps) const;
+
+  // Apply the mini-batch to the model and clear it
+  void apply_batch(SparseGrad* batch) const;
+
+  // Return the row whose dense values are the nodes of features
+  // [0, dense_size()) followed by its nodes, where the zero values
+  // are skipped. The nodes are in a buffer of the calling thread,
+  // which is valid until the next call. It is used by the paths
+  // that have no kernel of the dense block, e.g., the updaters
+  static RowView expand_dense(const RowView& row);
+
+  // Return the prepared context if it is prepared for the
+  // model. Otherwise, prepare a temporary context in tmp,
+  // which happens when the Score is not initialized with
+  // this model. This method is thread-safe.
+  inline const KernelContext& get_context(Model& model,
+                                          KernelContext* tmp) const {
+    if (context_.IsPreparedFor(model)) { return context_; }
+    tmp->Prepare(model);
+    return *tmp;
+  }
+
+  // Prefetch the first cache line of base + feat_id * stride
+  // for each node of the row, which is used by the batch
+  // scoring for the row after current row
+  static inline void prefetch_row(const RowView& row,
+                                  const real_t* base,
+                                  index_t stride) {
+    for (RowView::const_iterator iter = row.begin();
+         iter != row.end(); ++iter) {
+      _mm_prefetch(reinterpret_cast<const char*>(
+        base + (uint64)iter->feat_id * stride), _MM_HINT_T0);
+    }
+  }
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Score);
@@ -22,6 +22,9 @@ This file tests the Score class.
 
 #include "gtest/gtest.h"
 
+#include <stdint.h>
+#include <thread>
+
 #include "src/score/score_function.h"
 
 namespace xLearn {
@@ -38,4 +41,20 @@ TEST(SCORE_TEST, Create_Score) {
   EXPECT_TRUE(CreateScore("unknow_name") == NULL);
 }
 
+TEST(SCORE_TEST, Thread_Scratch) {
+  real_t* a = ThreadScratch(8);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % kScratchAlignByte, 0);
+  // Reused if it is large enough
+  EXPECT_EQ(ThreadScratch(4), a);
+  real_t* b = ThreadScratch(1024);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(b) % kScratchAlignByte, 0);
+  for (int i = 0; i < 1024; ++i) { b[i] = i; }
+  EXPECT_EQ(ThreadScratch(1024), b);
+  // Each thread has its own buffer
+  real_t* other = nullptr;
+  std::thread t([&other]() { other = ThreadScratch(1024); });
+  t.join();
+  EXPECT_NE(other, b);
+}
+
 }  // namespace xLearn
@@ -0,0 +1,104 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of the SSE kernel
+and the runtime selection of ScoreKernel.
+*/
+
+#include "src/score/score_kernel.h"
+
+#include <stdlib.h>  // for getenv()
+#include <string.h>  // for strcmp()
+
+#include "src/score/score_kernel_impl.h"
+
+namespace xLearn {
+
+const ScoreKernel& SSEScoreKernel(index_t aligned_k,
+                                  LatentLayout layout) {
+  return get_kernel<SSEReg>("sse", aligned_k, layout);
+}
+
+bool IsSpecializedK(index_t aligned_k) {
+  for (int i = 0; i < kNumSpecializedK; ++i) {
+    if (kSpecializedK[i] == aligned_k) { return true; }
+  }
+  return false;
+}
+
+// The CPU supports AVX2, FMA and F16C
+static bool support_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") &&
+         __builtin_cpu_supports("fma") &&
+         __builtin_cpu_supports("f16c");
+}
+
+// The CPU supports AVX-512F, AVX-512CD and FMA
+static bool support_avx512() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512cd") &&
+         __builtin_cpu_supports("fma");
+}
+
+std::vector<const ScoreKernel*> SupportedScoreKernels(index_t aligned_k,
+                                                      LatentLayout layout) {
+  std::vector<const ScoreKernel*> list;
+  list.push_back(&SSEScoreKernel(aligned_k, layout));
+  if (support_avx2()) {
+    list.push_back(&AVX2ScoreKernel(aligned_k, layout));
+  }
+  if (support_avx512()) {
+    list.push_back(&AVX512ScoreKernel(aligned_k, layout));
+  }
+  return list;
+}
+
+// Select the index of widest kernel in SupportedScoreKernels(),
+// or the kernel given by XLEARN_KERNEL
+static size_t select_kernel() {
+  std::vector<const ScoreKernel*> list = SupportedScoreKernels(0);
+  const char* name = getenv("XLEARN_KERNEL");
+  if (name != nullptr) {
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (strcmp(list[i]->name, name) == 0) { return i; }
+    }
+    LOG(WARNING) << "Kernel " << name << " is not supported "
+                 << "by current CPU. Use " << list.back()->name;
+  }
+  return list.size() - 1;
+}
+
+const ScoreKernel& GetScoreKernel(index_t aligned_k, LatentLayout layout) {
+  static const size_t index = select_kernel();
+  return *SupportedScoreKernels(aligned_k, layout)[index];
+}
+
+const ScoreKernel* FindScoreKernel(const std::string& name,
+                                   index_t aligned_k,
+                                   LatentLayout layout) {
+  std::vector<const ScoreKernel*> list =
+    SupportedScoreKernels(aligned_k, layout);
+  for (size_t i = 0; i < list.size(); ++i) {
+    if (name.compare(list[i]->name) == 0) { return list[i]; }
+  }
+  return nullptr;
+}
+
+}  // namespace xLearn
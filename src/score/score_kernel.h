@@ -0,0 +1,355 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file defines the SIMD kernels of the latent factor
+term in FM and FFM, which are selected at runtime.
+*/
+
+#ifndef XLEARN_SCORE_SCORE_KERNEL_H_
+#define XLEARN_SCORE_SCORE_KERNEL_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// ScoreKernel is a table of the inner loops of FMScore, FFMScore and
+// HOFMScore.
+// We build one table for each instruction set (SSE, AVX2 + FMA and
+// AVX-512), and each table is compiled in its own file with its own
+// compiler flags. The best table is selected from CPUID on the first
+// call of GetScoreKernel(), so one binary can run at full speed on
+// different CPUs. SSE is always the fallback:
+//
+//   const ScoreKernel& kernel = GetScoreKernel();
+//   real_t sum = kernel.ffm_score(row.begin(), row.end(), v,
+//                                 align0, align1, norm, 0);
+//
+// For the common aligned K (kSpecializedK), we also build kernels that
+// are specialized on K at compile time, whose loops are fully unrolled
+// and whose accumulators are kept in registers:
+//
+//   const ScoreKernel& kernel = GetScoreKernel(model.get_aligned_k());
+//
+// The environment variable XLEARN_KERNEL ("sse", "avx2" or "avx512")
+// can be used to force a kernel, if it is supported by current CPU.
+//
+// Memory layout of the latent factors:
+//   FM:  for each feature, aligned_k weights followed by aligned_k
+//        gradient caches.
+//   HOFM: for each feature, the FM layout of P_i followed by the
+//        FM layout of Q_i.
+//   FFM: for each (feature, field), align0 = 2 * aligned_k floats,
+//        in which kAlign weights and kAlign gradient caches are
+//        interleaved, or aligned_k weights are followed by their
+//        caches in the split layout (see LatentLayout). The split
+//        layouts of the reduced caches have the smaller blocks of
+//        LatentBlockSize(), whose caches are decoded and encoded in
+//        the registers by the update, and the shared split layout
+//        has one cache per block. Each table is built for one
+//        layout:
+//
+//          GetScoreKernel(model.get_aligned_k(), kLayoutSplit);
+//
+//        The sparse latent factor (latent_pairs.h) has the blocks of
+//        the observed pairs only, whose addresses are resolved by the
+//        caller into FFMPair. The blocks of the K of each field
+//        (Model::SetFieldK) are interleaved blocks of their own K,
+//        and the pair of two fields uses the first aligned K of
+//        the smaller one, which is the same chunks of any block.
+// The kernels only use raw pointers, because they are compiled with
+// different instruction sets and must not share any inline function.
+//------------------------------------------------------------------------------
+
+// A feature pair of FFM staged by ffm_score_staged()
+struct FFMPair {
+  /* Block of V_i_fj */
+  real_t* w1;
+  /* Block of V_j_fi */
+  real_t* w2;
+  /* x_i * x_j * norm */
+  real_t val;
+  /* The aligned K of the pair of ffm_score_mixed() */
+  index_t k;
+};
+
+struct ScoreKernel {
+  /* Name of the instruction set */
+  const char* name;
+  /* The aligned K of the specialized kernel,
+  and 0 for the generic kernel */
+  index_t aligned_k;
+  /* The layout of the FFM blocks of the fp32 kernels
+  of FFM (ffm_score() to ffm_score_pairs() and ffm_cross()) */
+  LatentLayout layout;
+
+  // sum( (V_i_fj*V_j_fi)(x_i * x_j) ) * norm. The latent
+  // vectors of the pair that is prefetch pairs ahead are
+  // prefetched into cache, and 0 means no prefetch
+  real_t (*ffm_score)(const Node* begin, const Node* end,
+                      const real_t* v, index_t align0,
+                      index_t align1, real_t norm,
+                      index_t prefetch);
+
+  // Update the latent factors of FFM by adagrad, whose
+  // 1 / sqrt() has the given precision (math.h)
+  void (*ffm_grad)(const Node* begin, const Node* end,
+                   real_t* v, index_t align0, index_t align1,
+                   real_t norm, real_t pg, real_t learning_rate,
+                   real_t regu_lambda, index_t prefetch,
+                   SqrtPrecision precision);
+
+  // The same as ffm_score(), and each of the (n-1)*n/2 pairs
+  // of the row is staged in pairs for ffm_grad_staged()
+  real_t (*ffm_score_staged)(const Node* begin, const Node* end,
+                             real_t* v, index_t align0,
+                             index_t align1, real_t norm,
+                             index_t prefetch, FFMPair* pairs);
+
+  // Update the pairs staged by ffm_score_staged(), which is
+  // the same as ffm_grad() but needs no address calculation
+  void (*ffm_grad_staged)(const FFMPair* pairs, index_t num_pair,
+                          index_t align0, real_t pg,
+                          real_t learning_rate, real_t regu_lambda,
+                          SqrtPrecision precision);
+
+  // ffm_score(), ffm_grad() and ffm_score_staged() of a binary
+  // row, whose values are all 1.0 (see RowView::is_binary()).
+  // The values are not loaded, and the sum of (V_i_fj*V_j_fi)
+  // is multiplied by norm once
+  real_t (*ffm_score_binary)(const Node* begin, const Node* end,
+                             const real_t* v, index_t align0,
+                             index_t align1, real_t norm,
+                             index_t prefetch);
+  void (*ffm_grad_binary)(const Node* begin, const Node* end,
+                          real_t* v, index_t align0, index_t align1,
+                          real_t norm, real_t pg, real_t learning_rate,
+                          real_t regu_lambda, index_t prefetch,
+                          SqrtPrecision precision);
+  real_t (*ffm_score_staged_binary)(const Node* begin, const Node* end,
+                                    real_t* v, index_t align0,
+                                    index_t align1, real_t norm,
+                                    index_t prefetch, FFMPair* pairs);
+
+  // sum( (w1*w2) * val ) of the pairs, whose blocks are resolved
+  // by the caller, e.g., from the sparse latent factor of FFM.
+  // The pairs can be updated by ffm_grad_staged() after it
+  real_t (*ffm_score_pairs)(const FFMPair* pairs, index_t num_pair,
+                            index_t align0);
+
+  // ffm_score_pairs() and ffm_grad_staged() of the pairs of mixed
+  // K, whose interleaved blocks are only read and updated in the
+  // first k weights of each pair. The pairs of the same k are
+  // scored in tiles. They are the same in the table of any layout
+  // and specialized K
+  real_t (*ffm_score_mixed)(const FFMPair* pairs, index_t num_pair);
+  void (*ffm_grad_mixed)(const FFMPair* pairs, index_t num_pair,
+                         real_t pg, real_t learning_rate,
+                         real_t regu_lambda, SqrtPrecision precision);
+
+  // ffm_score() and fm_score() on the 16-bit latent factor
+  // (fp16, or bf16 if bf16 is true) of an inference model,
+  // whose latent vectors have aligned_k weights and no cache,
+  // and align1 is num_field * aligned_k
+  real_t (*ffm_score_half)(const Node* begin, const Node* end,
+                           const uint16* v, index_t aligned_k,
+                           index_t align1, real_t norm, bool bf16);
+  real_t (*fm_score_half)(const Node* begin, const Node* end,
+                          const uint16* v, index_t aligned_k,
+                          real_t norm, real_t* s, bool bf16);
+
+  // ffm_score() and fm_score() on the fp32 latent factor of a
+  // weights-only model, which has the layout of the 16-bit one
+  real_t (*ffm_score_w)(const Node* begin, const Node* end,
+                        const real_t* v, index_t aligned_k,
+                        index_t align1, real_t norm);
+  real_t (*fm_score_w)(const Node* begin, const Node* end,
+                       const real_t* v, index_t aligned_k,
+                       real_t norm, real_t* s);
+
+  // ffm_score() and fm_score() on the int8 latent factor of an
+  // inference model. Each latent vector has aligned_k int8 and
+  // one scale, and in FFM the vector of (feature, field) is the
+  // (feat_id * num_field + field_id)-th vector
+  real_t (*ffm_score_int8)(const Node* begin, const Node* end,
+                           const int8* v, const real_t* scale,
+                           index_t aligned_k, index_t num_field,
+                           real_t norm);
+  real_t (*fm_score_int8)(const Node* begin, const Node* end,
+                          const int8* v, const real_t* scale,
+                          index_t aligned_k, real_t norm, real_t* s);
+
+  // The cross pairs of two rows: sum( (V_i_fj*V_j_fi)(x_i * x_j) )
+  // * norm, in which i is in [begin, end) and j is in [cross_begin,
+  // cross_end). The score of the concatenated row is the score of
+  // each row plus the cross pairs, so the pairs inside a context
+  // that is shared by many candidates are scored only once. They
+  // are the same as ffm_score(), ffm_score_half(), ffm_score_w()
+  // and ffm_score_int8() on each layout of the latent factor
+  real_t (*ffm_cross)(const Node* begin, const Node* end,
+                      const Node* cross_begin, const Node* cross_end,
+                      const real_t* v, index_t align0,
+                      index_t align1, real_t norm);
+  real_t (*ffm_cross_half)(const Node* begin, const Node* end,
+                           const Node* cross_begin,
+                           const Node* cross_end,
+                           const uint16* v, index_t aligned_k,
+                           index_t align1, real_t norm, bool bf16);
+  real_t (*ffm_cross_w)(const Node* begin, const Node* end,
+                        const Node* cross_begin, const Node* cross_end,
+                        const real_t* v, index_t aligned_k,
+                        index_t align1, real_t norm);
+  real_t (*ffm_cross_int8)(const Node* begin, const Node* end,
+                           const Node* cross_begin,
+                           const Node* cross_end,
+                           const int8* v, const real_t* scale,
+                           index_t aligned_k, index_t num_field,
+                           real_t norm);
+
+  // w^T x of the linear term, in which the weight and the
+  // gradient cache of each feature are adjacent in w
+  real_t (*linear_score)(const Node* begin, const Node* end,
+                         const real_t* w);
+
+  // w^T x of the weights of any stride, such as 1 for the
+  // weights-only model and 3 for the states of FTRL
+  real_t (*linear_score_stride)(const Node* begin, const Node* end,
+                                const real_t* w, index_t stride);
+
+  // w^T x of the n dense values x of the features [0, n),
+  // whose weights need no index (see DMatrix::SetDenseWidth())
+  real_t (*dense_linear_score)(const real_t* x, index_t n,
+                               const real_t* w, index_t stride);
+
+  // Update the linear term by adagrad
+  void (*linear_grad)(const Node* begin, const Node* end,
+                      real_t* w, real_t pg, real_t learning_rate,
+                      real_t regu_lambda, SqrtPrecision precision);
+
+  // 0.5 * sum( (V_i*V_j)(x_i * x_j) ) * norm. The sum of
+  // V_i * x_i is stored in s, which has aligned_k floats
+  real_t (*fm_score)(const Node* begin, const Node* end,
+                     const real_t* v, index_t aligned_k,
+                     real_t norm, real_t* s);
+
+  // Update the latent factors of FM by adagrad. The s
+  // is a buffer that has aligned_k floats
+  void (*fm_grad)(const Node* begin, const Node* end,
+                  real_t* v, index_t aligned_k, real_t norm,
+                  real_t pg, real_t learning_rate,
+                  real_t regu_lambda, real_t* s,
+                  SqrtPrecision precision);
+
+  // fm_score() and fm_grad() of a binary row, in which the sum
+  // of V_i is multiplied by norm once
+  real_t (*fm_score_binary)(const Node* begin, const Node* end,
+                            const real_t* v, index_t aligned_k,
+                            real_t norm, real_t* s);
+  void (*fm_grad_binary)(const Node* begin, const Node* end,
+                         real_t* v, index_t aligned_k, real_t norm,
+                         real_t pg, real_t learning_rate,
+                         real_t regu_lambda, real_t* s,
+                         SqrtPrecision precision);
+
+  // fm_score() and fm_grad() on the row that has n dense values
+  // x of the features [0, n) besides the nodes. The latent
+  // vectors of the dense values are read in order
+  real_t (*fm_score_dense)(const Node* begin, const Node* end,
+                           const real_t* x, index_t n,
+                           const real_t* v, index_t aligned_k,
+                           real_t norm, real_t* s);
+  void (*fm_grad_dense)(const Node* begin, const Node* end,
+                        const real_t* x, index_t n,
+                        real_t* v, index_t aligned_k, real_t norm,
+                        real_t pg, real_t learning_rate,
+                        real_t regu_lambda, real_t* s,
+                        SqrtPrecision precision);
+
+  // fm_grad_dense() by the sum s of V_i * x_i that fm_score_dense()
+  // gave on the same row and latent factor, so the fused train step
+  // of FM does not compute it again
+  void (*fm_grad_sum)(const Node* begin, const Node* end,
+                      const real_t* x, index_t n,
+                      real_t* v, index_t aligned_k, real_t norm,
+                      real_t pg, real_t learning_rate,
+                      real_t regu_lambda, const real_t* s,
+                      SqrtPrecision precision);
+
+  // The latent term of HOFM of order 3, (A2 + A3) * norm, where
+  // each x is multiplied by norm. Each feature has stride floats,
+  // whose first half starts with P_i (order 2) and second half
+  // starts with Q_i (order 3), e.g., 4 * aligned_k with the caches
+  // and 2 * aligned_k in a weights-only model. The s is a buffer
+  // that has 5 * aligned_k floats
+  real_t (*hofm_score)(const Node* begin, const Node* end,
+                       const real_t* v, index_t aligned_k,
+                       index_t stride, real_t norm, real_t* s);
+
+  // Update the vectors of HOFM by adagrad, in which each feature
+  // has P_i, its caches, Q_i and its caches of aligned_k floats
+  void (*hofm_grad)(const Node* begin, const Node* end,
+                    real_t* v, index_t aligned_k, real_t norm,
+                    real_t pg, real_t learning_rate,
+                    real_t regu_lambda, real_t* s,
+                    SqrtPrecision precision);
+};
+
+// The linear kernel uses gather for the rows that have at least
+// kMinGatherRow nodes, and the scalar loop for the shorter rows
+const index_t kMinGatherRow = 32;
+
+// The aligned K that have specialized kernels
+const index_t kSpecializedK[] = { 4, 8, 16, 32 };
+const int kNumSpecializedK = 4;
+
+// Return true if aligned_k has specialized kernels
+bool IsSpecializedK(index_t aligned_k);
+
+// Kernel tables of each instruction set for the layout of the FFM
+// blocks. Return the generic kernel if aligned_k has no specialized
+// kernel
+const ScoreKernel& SSEScoreKernel(
+  index_t aligned_k = 0, LatentLayout layout = kLayoutInterleaved);
+const ScoreKernel& AVX2ScoreKernel(
+  index_t aligned_k = 0, LatentLayout layout = kLayoutInterleaved);
+const ScoreKernel& AVX512ScoreKernel(
+  index_t aligned_k = 0, LatentLayout layout = kLayoutInterleaved);
+
+// Return all the kernels supported by current CPU,
+// and the first one is the SSE kernel
+std::vector<const ScoreKernel*> SupportedScoreKernels(
+  index_t aligned_k = 0, LatentLayout layout = kLayoutInterleaved);
+
+// Return the best kernel of current CPU
+const ScoreKernel& GetScoreKernel(
+  index_t aligned_k = 0, LatentLayout layout = kLayoutInterleaved);
+
+// Return the kernel of the instruction set name ("sse", "avx2"
+// or "avx512"), or nullptr if current CPU does not support it
+const ScoreKernel* FindScoreKernel(
+  const std::string& name, index_t aligned_k = 0,
+  LatentLayout layout = kLayoutInterleaved);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_SCORE_KERNEL_H_
@@ -0,0 +1,170 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of the AVX2 and FMA kernel.
+It is compiled with the AVX2 and FMA instructions, and it is
+only used when the CPU supports them.
+*/
+
+#include <immintrin.h>  // for AVX2
+
+#include "src/score/score_kernel.h"
+#include "src/score/score_kernel_impl.h"
+
+namespace xLearn {
+namespace {
+
+// 256-bit register, which holds two chunks of FFM
+struct AVX2Reg {
+  typedef __m256 reg;
+  static const index_t kWidth = 8;
+  static inline reg zero() { return _mm256_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm256_set1_ps(x); }
+  static inline reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+  static inline reg madd(reg a, reg b, reg c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  static inline reg nmadd(reg a, reg b, reg c) {
+    return _mm256_fnmadd_ps(a, b, c);
+  }
+  static inline reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+  static inline reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+  static inline reg rsqrt(reg a) { return _mm256_rsqrt_ps(a); }
+  static inline reg load(const real_t* p) { return _mm256_loadu_ps(p); }
+  static inline void store(real_t* p, reg a) { _mm256_storeu_ps(p, a); }
+  static inline reg load_chunks(const real_t* p) {
+    return _mm256_insertf128_ps(
+      _mm256_castps128_ps256(_mm_loadu_ps(p)),
+      _mm_loadu_ps(p + 2 * kAlign), 1);
+  }
+  static inline void store_chunks(real_t* p, reg a) {
+    _mm_storeu_ps(p, _mm256_castps256_ps128(a));
+    _mm_storeu_ps(p + 2 * kAlign, _mm256_extractf128_ps(a, 1));
+  }
+  static const bool kGather = true;
+  static inline reg gather2(const real_t* p, const int32* idx) {
+    return _mm256_i32gather_ps(
+      p, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx)), 8);
+  }
+  static inline reg gather1(const real_t* p, const int32* idx) {
+    return _mm256_i32gather_ps(
+      p, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx)), 4);
+  }
+  // Each pair of lanes is at most 4 lanes apart in one of
+  // the two directions, so 4 rotations compare all of them
+  static inline bool unique(const int32* idx) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx));
+    __m256i eq = _mm256_setzero_si256();
+    for (int r = 1; r <= 4; ++r) {
+      __m256i rot = _mm256_setr_epi32(r, (r + 1) & 7, (r + 2) & 7,
+                                      (r + 3) & 7, (r + 4) & 7,
+                                      (r + 5) & 7, (r + 6) & 7,
+                                      (r + 7) & 7);
+      eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(
+        x, _mm256_permutevar8x32_epi32(x, rot)));
+    }
+    return _mm256_testz_si256(eq, eq);
+  }
+  static inline reg load_fp16(const uint16* p) {
+    return _mm256_cvtph_ps(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  }
+  static inline reg load_bf16(const uint16* p) {
+    __m256i h = _mm256_cvtepu16_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(h, 16));
+  }
+  static inline reg load_i8(const int8* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+  }
+  // 16 int8 in each step, and the rest by SSE
+  static inline int32 dot_i8(const int8* a, const int8* b, index_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    index_t d = 0;
+    for (; d + 16 <= n; d += 16) {
+      __m256i x = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + d)));
+      __m256i y = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + d)));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+    }
+    __m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                 _mm256_extracti128_si256(acc, 1));
+    acc4 = _mm_hadd_epi32(acc4, acc4);
+    acc4 = _mm_hadd_epi32(acc4, acc4);
+    return _mm_cvtsi128_si32(acc4) + SSEReg::dot_i8(a + d, b + d, n - d);
+  }
+  template <int kShift>
+  static inline reg decode_bits(__m256i x, uint32 bias) {
+    x = _mm256_add_epi32(_mm256_slli_epi32(x, kShift),
+                         _mm256_set1_epi32(bias));
+    return _mm256_castsi256_ps(x);
+  }
+  // The codes are packed to 16 bits by the two halves
+  template <int kShift>
+  static inline __m128i encode_bits(reg c, reg r, uint32 bias,
+                                    uint32 max_bits) {
+    c = _mm256_min_ps(c, _mm256_castsi256_ps(_mm256_set1_epi32(max_bits)));
+    __m256i x = _mm256_sub_epi32(_mm256_castps_si256(c),
+                                 _mm256_set1_epi32(bias));
+    __m256i low = _mm256_and_si256(_mm256_castps_si256(r),
+                                   _mm256_set1_epi32((1 << kShift) - 1));
+    x = _mm256_srli_epi32(_mm256_add_epi32(x, low), kShift);
+    return _mm_packs_epi32(_mm256_castsi256_si128(x),
+                           _mm256_extracti128_si256(x, 1));
+  }
+  template <int kShift>
+  static inline reg load_code16(const uint16* p, uint32 bias) {
+    return decode_bits<kShift>(_mm256_cvtepu16_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))), bias);
+  }
+  template <int kShift>
+  static inline reg load_code8(const uint8* p, uint32 bias) {
+    return decode_bits<kShift>(_mm256_cvtepu8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))), bias);
+  }
+  template <int kShift>
+  static inline void store_code16(uint16* p, reg c, reg r,
+                                  uint32 bias, uint32 max_bits) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+                     encode_bits<kShift>(c, r, bias, max_bits));
+  }
+  template <int kShift>
+  static inline void store_code8(uint8* p, reg c, reg r,
+                                 uint32 bias, uint32 max_bits) {
+    __m128i x = encode_bits<kShift>(c, r, bias, max_bits);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p),
+                     _mm_packus_epi16(x, x));
+  }
+  static inline real_t reduce(reg a) {
+    return SSEReg::reduce(_mm_add_ps(_mm256_castps256_ps128(a),
+                                     _mm256_extractf128_ps(a, 1)));
+  }
+};
+
+}  // namespace
+
+const ScoreKernel& AVX2ScoreKernel(index_t aligned_k,
+                                   LatentLayout layout) {
+  return get_kernel<AVX2Reg>("avx2", aligned_k, layout);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,155 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of the AVX-512F and FMA kernel.
+It is compiled with the AVX-512F, AVX-512CD and FMA instructions, and it is
+only used when the CPU supports them.
+*/
+
+#include <immintrin.h>  // for AVX512
+
+#include "src/score/score_kernel.h"
+#include "src/score/score_kernel_impl.h"
+
+namespace xLearn {
+namespace {
+
+// 512-bit register, which holds four chunks of FFM
+struct AVX512Reg {
+  typedef __m512 reg;
+  static const index_t kWidth = 16;
+  static inline reg zero() { return _mm512_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm512_set1_ps(x); }
+  static inline reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+  static inline reg madd(reg a, reg b, reg c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+  static inline reg nmadd(reg a, reg b, reg c) {
+    return _mm512_fnmadd_ps(a, b, c);
+  }
+  static inline reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+  static inline reg sqrt(reg a) { return _mm512_sqrt_ps(a); }
+  static inline reg rsqrt(reg a) { return _mm512_rsqrt14_ps(a); }
+  static inline reg load(const real_t* p) { return _mm512_loadu_ps(p); }
+  static inline void store(real_t* p, reg a) { _mm512_storeu_ps(p, a); }
+  static inline reg load_chunks(const real_t* p) {
+    reg a = _mm512_castps128_ps512(_mm_loadu_ps(p));
+    a = _mm512_insertf32x4(a, _mm_loadu_ps(p + 2 * kAlign), 1);
+    a = _mm512_insertf32x4(a, _mm_loadu_ps(p + 4 * kAlign), 2);
+    a = _mm512_insertf32x4(a, _mm_loadu_ps(p + 6 * kAlign), 3);
+    return a;
+  }
+  static inline void store_chunks(real_t* p, reg a) {
+    _mm_storeu_ps(p, _mm512_castps512_ps128(a));
+    _mm_storeu_ps(p + 2 * kAlign, _mm512_extractf32x4_ps(a, 1));
+    _mm_storeu_ps(p + 4 * kAlign, _mm512_extractf32x4_ps(a, 2));
+    _mm_storeu_ps(p + 6 * kAlign, _mm512_extractf32x4_ps(a, 3));
+  }
+  static const bool kGather = true;
+  static inline reg gather2(const real_t* p, const int32* idx) {
+    return _mm512_i32gather_ps(_mm512_loadu_si512(idx), p, 8);
+  }
+  static inline reg gather1(const real_t* p, const int32* idx) {
+    return _mm512_i32gather_ps(_mm512_loadu_si512(idx), p, 4);
+  }
+  // The conflict detection of AVX-512CD
+  static inline bool unique(const int32* idx) {
+    __m512i c = _mm512_conflict_epi32(_mm512_loadu_si512(idx));
+    return _mm512_test_epi32_mask(c, c) == 0;
+  }
+  static inline reg load_fp16(const uint16* p) {
+    return _mm512_cvtph_ps(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+  }
+  static inline reg load_bf16(const uint16* p) {
+    __m512i h = _mm512_cvtepu16_epi32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+    return _mm512_castsi512_ps(_mm512_slli_epi32(h, 16));
+  }
+  static inline reg load_i8(const int8* p) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+  }
+  // 16 int8 in each step, and the rest by SSE. AVX-512F has
+  // no 16-bit madd, so the int8 are extended to int32
+  static inline int32 dot_i8(const int8* a, const int8* b, index_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    index_t d = 0;
+    for (; d + 16 <= n; d += 16) {
+      __m512i x = _mm512_cvtepi8_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + d)));
+      __m512i y = _mm512_cvtepi8_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + d)));
+      acc = _mm512_add_epi32(acc, _mm512_mullo_epi32(x, y));
+    }
+    return _mm512_reduce_add_epi32(acc) +
+           SSEReg::dot_i8(a + d, b + d, n - d);
+  }
+  template <int kShift>
+  static inline reg decode_bits(__m512i x, uint32 bias) {
+    x = _mm512_add_epi32(_mm512_slli_epi32(x, kShift),
+                         _mm512_set1_epi32(bias));
+    return _mm512_castsi512_ps(x);
+  }
+  template <int kShift>
+  static inline __m512i encode_bits(reg c, reg r, uint32 bias,
+                                    uint32 max_bits) {
+    c = _mm512_min_ps(c, _mm512_castsi512_ps(_mm512_set1_epi32(max_bits)));
+    __m512i x = _mm512_sub_epi32(_mm512_castps_si512(c),
+                                 _mm512_set1_epi32(bias));
+    __m512i low = _mm512_and_si512(_mm512_castps_si512(r),
+                                   _mm512_set1_epi32((1 << kShift) - 1));
+    return _mm512_srli_epi32(_mm512_add_epi32(x, low), kShift);
+  }
+  template <int kShift>
+  static inline reg load_code16(const uint16* p, uint32 bias) {
+    return decode_bits<kShift>(_mm512_cvtepu16_epi32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))), bias);
+  }
+  template <int kShift>
+  static inline reg load_code8(const uint8* p, uint32 bias) {
+    return decode_bits<kShift>(_mm512_cvtepu8_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))), bias);
+  }
+  template <int kShift>
+  static inline void store_code16(uint16* p, reg c, reg r,
+                                  uint32 bias, uint32 max_bits) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p),
+      _mm512_cvtepi32_epi16(encode_bits<kShift>(c, r, bias, max_bits)));
+  }
+  template <int kShift>
+  static inline void store_code8(uint8* p, reg c, reg r,
+                                 uint32 bias, uint32 max_bits) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+      _mm512_cvtepi32_epi8(encode_bits<kShift>(c, r, bias, max_bits)));
+  }
+  static inline real_t reduce(reg a) {
+    return _mm512_reduce_add_ps(a);
+  }
+};
+
+}  // namespace
+
+const ScoreKernel& AVX512ScoreKernel(index_t aligned_k,
+                                     LatentLayout layout) {
+  return get_kernel<AVX512Reg>("avx512", aligned_k, layout);
+}
+
+}  // namespace xLearn
@@ -0,0 +1,1936 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file contains the generic implementation of the SIMD kernels
+of FM and FFM. It is only included by score_kernel*.cc, and each of
+them instantiates the kernels with its own register type.
+*/
+
+#ifndef XLEARN_SCORE_SCORE_KERNEL_IMPL_H_
+#define XLEARN_SCORE_SCORE_KERNEL_IMPL_H_
+
+#include <pmmintrin.h>  // for SSE
+
+#include "src/base/common.h"
+#include "src/base/half.h"
+#include "src/base/math.h"
+#include "src/data/data_structure.h"
+
+// The helpers of the inner loops are always inlined, since the
+// many kernels of a file exhaust the inlining budget of the compiler
+// and the tile of accumulators would be spilled to memory
+#ifdef _MSC_VER
+#define KERNEL_INLINE __forceinline
+#else
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace xLearn {
+// Everything here has internal linkage, so that the code
+// compiled with different instruction sets won't be mixed
+namespace {
+
+//------------------------------------------------------------------------------
+// A register type V provides:
+//   V::reg, V::kWidth (number of floats in a register),
+//   zero(), set1(), add(), sub(), mul(), div(), sqrt(), rsqrt(), reduce(),
+//   madd(a, b, c) = a * b + c, nmadd(a, b, c) = c - a * b,
+//   load() and store() for contiguous floats, and load_chunks() and
+//   store_chunks() for kWidth / kAlign chunks of kAlign floats, whose
+//   stride is 2 * kAlign (the interleaved layout of FFM), and
+//   gather2(p, idx) for p[2 * idx[l]] and gather1(p, idx) for
+//   p[idx[l]] of each lane l, where kGather
+//   is false if it is not a hardware gather, unique(idx) for
+//   whether the kWidth lanes of idx have no equal ids, load_fp16() and
+//   load_bf16() for kWidth contiguous 16-bit floats, load_i8() for
+//   kWidth int8 as floats, and dot_i8(a, b, n) for the int32 dot
+//   product of n int8 (n is a multiple of kAlign), and
+//   load_code16() / load_code8() and store_code16() / store_code8()
+//   for kWidth codes of the reduced gradient caches (LatentCacheCode),
+//   which are encoded with the low kShift bits of r as the rounding
+//   bits.
+// The 128-bit SSE register is used for the tail of each loop.
+//------------------------------------------------------------------------------
+struct SSEReg {
+  typedef __m128 reg;
+  static const index_t kWidth = 4;
+  static inline reg zero() { return _mm_setzero_ps(); }
+  static inline reg set1(real_t x) { return _mm_set1_ps(x); }
+  static inline reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+  static inline reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+  static inline reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+  static inline reg madd(reg a, reg b, reg c) {
+    return _mm_add_ps(c, _mm_mul_ps(a, b));
+  }
+  static inline reg nmadd(reg a, reg b, reg c) {
+    return _mm_sub_ps(c, _mm_mul_ps(a, b));
+  }
+  static inline reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+  static inline reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+  static inline reg rsqrt(reg a) { return _mm_rsqrt_ps(a); }
+  static inline reg load(const real_t* p) { return _mm_loadu_ps(p); }
+  static inline void store(real_t* p, reg a) { _mm_storeu_ps(p, a); }
+  static inline reg load_chunks(const real_t* p) { return _mm_loadu_ps(p); }
+  static inline void store_chunks(real_t* p, reg a) { _mm_storeu_ps(p, a); }
+  static const bool kGather = false;
+  static inline reg gather2(const real_t* p, const int32* idx) {
+    return _mm_set_ps(p[2*idx[3]], p[2*idx[2]], p[2*idx[1]], p[2*idx[0]]);
+  }
+  static inline reg gather1(const real_t* p, const int32* idx) {
+    return _mm_set_ps(p[idx[3]], p[idx[2]], p[idx[1]], p[idx[0]]);
+  }
+  static inline bool unique(const int32* idx) {
+    return idx[0] != idx[1] && idx[0] != idx[2] && idx[0] != idx[3] &&
+           idx[1] != idx[2] && idx[1] != idx[3] && idx[2] != idx[3];
+  }
+  static inline reg load_fp16(const uint16* p) {
+    return _mm_set_ps(HalfToFloat(p[3]), HalfToFloat(p[2]),
+                      HalfToFloat(p[1]), HalfToFloat(p[0]));
+  }
+  static inline reg load_bf16(const uint16* p) {
+    __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), h));
+  }
+  // Sign-extend the low 8 int8 of x to int16
+  static inline __m128i i8_to_i16(__m128i x) {
+    return _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+  }
+  static inline reg load_i8(const int8* p) {
+    int32 bits;
+    memcpy(&bits, p, sizeof(bits));
+    __m128i x = i8_to_i16(_mm_cvtsi32_si128(bits));
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+  }
+  static inline int32 dot_i8(const int8* a, const int8* b, index_t n) {
+    __m128i acc = _mm_setzero_si128();
+    index_t d = 0;
+    for (; d + 8 <= n; d += 8) {
+      __m128i x = i8_to_i16(_mm_loadl_epi64(
+        reinterpret_cast<const __m128i*>(a + d)));
+      __m128i y = i8_to_i16(_mm_loadl_epi64(
+        reinterpret_cast<const __m128i*>(b + d)));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(x, y));
+    }
+    int32 lane[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lane), acc);
+    int32 sum = lane[0] + lane[1] + lane[2] + lane[3];
+    for (; d < n; ++d) { sum += (int32)a[d] * b[d]; }
+    return sum;
+  }
+  // The floats of the bits (code << kShift) + bias
+  template <int kShift>
+  static inline reg decode_bits(__m128i x, uint32 bias) {
+    x = _mm_add_epi32(_mm_slli_epi32(x, kShift), _mm_set1_epi32(bias));
+    return _mm_castsi128_ps(x);
+  }
+  // The codes of the floats c >= 1, which are less than 0x8000
+  template <int kShift>
+  static inline __m128i encode_bits(reg c, reg r, uint32 bias,
+                                    uint32 max_bits) {
+    c = _mm_min_ps(c, _mm_castsi128_ps(_mm_set1_epi32(max_bits)));
+    __m128i x = _mm_sub_epi32(_mm_castps_si128(c), _mm_set1_epi32(bias));
+    __m128i low = _mm_and_si128(_mm_castps_si128(r),
+                                _mm_set1_epi32((1 << kShift) - 1));
+    return _mm_srli_epi32(_mm_add_epi32(x, low), kShift);
+  }
+  template <int kShift>
+  static inline reg load_code16(const uint16* p, uint32 bias) {
+    __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return decode_bits<kShift>(
+      _mm_unpacklo_epi16(x, _mm_setzero_si128()), bias);
+  }
+  template <int kShift>
+  static inline reg load_code8(const uint8* p, uint32 bias) {
+    int32 bits;
+    memcpy(&bits, p, sizeof(bits));
+    __m128i x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bits),
+                                  _mm_setzero_si128());
+    return decode_bits<kShift>(
+      _mm_unpacklo_epi16(x, _mm_setzero_si128()), bias);
+  }
+  template <int kShift>
+  static inline void store_code16(uint16* p, reg c, reg r,
+                                  uint32 bias, uint32 max_bits) {
+    __m128i x = encode_bits<kShift>(c, r, bias, max_bits);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p),
+                     _mm_packs_epi32(x, x));
+  }
+  template <int kShift>
+  static inline void store_code8(uint8* p, reg c, reg r,
+                                 uint32 bias, uint32 max_bits) {
+    __m128i x = encode_bits<kShift>(c, r, bias, max_bits);
+    x = _mm_packs_epi32(x, x);
+    int32 bits = _mm_cvtsi128_si32(_mm_packus_epi16(x, x));
+    memcpy(p, &bits, sizeof(bits));
+  }
+  static inline real_t reduce(reg a) {
+    real_t sum = 0;
+    a = _mm_hadd_ps(a, a);
+    a = _mm_hadd_ps(a, a);
+    _mm_store_ss(&sum, a);
+    return sum;
+  }
+};
+
+// 1 / sqrt(a) of the precision P (see SqrtPrecision in math.h)
+template <typename V, SqrtPrecision P>
+inline typename V::reg inv_sqrt(typename V::reg a) {
+  if (P == kSqrtExact) { return V::div(V::set1(1.0f), V::sqrt(a)); }
+  typename V::reg y = V::rsqrt(a);
+  if (P == kSqrtNewton) {
+    // y * (1.5 - 0.5 * a * y * y)
+    typename V::reg ay = V::mul(V::mul(V::set1(0.5f), a), y);
+    y = V::mul(y, V::nmadd(ay, y, V::set1(1.5f)));
+  }
+  return y;
+}
+
+//------------------------------------------------------------------------------
+// The FFM kernels are compiled for each layout L of the blocks (see
+// LatentLayout). Block<V, L> walks the aligned_k weights of a block by
+// the registers of V: the step at position d in [0, end(aligned_k))
+// has kWidth weights, which are at weight(w, d), and their caches,
+// which are at cache(w, d, aligned_k). The steps are kStep apart.
+//------------------------------------------------------------------------------
+template <typename V, LatentLayout L>
+struct Block;
+
+// Each kAlign weights are followed by their kAlign caches, so the
+// kWidth weights of a step are the chunks of 2 * kWidth floats
+template <typename V>
+struct Block<V, kLayoutInterleaved> {
+  typedef typename V::reg reg;
+  static const index_t kStep = 2 * V::kWidth;
+  static inline index_t end(index_t aligned_k) { return 2 * aligned_k; }
+  static inline reg weight(const real_t* w, index_t d) {
+    return V::load_chunks(w + d);
+  }
+  static inline reg cache(const real_t* w, index_t d, index_t aligned_k) {
+    return V::load_chunks(w + d + kAlign);
+  }
+  static inline void store(real_t* w, index_t d, index_t aligned_k,
+                           reg a, reg g) {
+    V::store_chunks(w + d, a);
+    V::store_chunks(w + d + kAlign, g);
+  }
+};
+
+// The aligned_k weights are contiguous, and so are the caches
+template <typename V>
+struct Block<V, kLayoutSplit> {
+  typedef typename V::reg reg;
+  static const index_t kStep = V::kWidth;
+  static inline index_t end(index_t aligned_k) { return aligned_k; }
+  static inline reg weight(const real_t* w, index_t d) {
+    return V::load(w + d);
+  }
+  static inline reg cache(const real_t* w, index_t d, index_t aligned_k) {
+    return V::load(w + aligned_k + d);
+  }
+  static inline void store(real_t* w, index_t d, index_t aligned_k,
+                           reg a, reg g) {
+    V::store(w + d, a);
+    V::store(w + aligned_k + d, g);
+  }
+};
+
+// The caches of the reduced split layout L are the codes of kBytes
+// bytes after the aligned_k weights (see LatentCacheCode)
+template <typename V, LatentLayout L,
+          index_t kBytes = LatentCacheCode<L>::kBytes>
+struct CodedCache;
+
+template <typename V, LatentLayout L>
+struct CodedCache<V, L, 2> {
+  typedef LatentCacheCode<L> C;
+  static inline typename V::reg load(const real_t* w, index_t d,
+                                     index_t aligned_k) {
+    return V::template load_code16<C::kShift>(
+      reinterpret_cast<const uint16*>(w + aligned_k) + d, C::kBias);
+  }
+  static inline void store(real_t* w, index_t d, index_t aligned_k,
+                           typename V::reg g, typename V::reg r) {
+    V::template store_code16<C::kShift>(
+      reinterpret_cast<uint16*>(w + aligned_k) + d, g, r,
+      C::kBias, C::kMaxBits);
+  }
+};
+
+template <typename V, LatentLayout L>
+struct CodedCache<V, L, 1> {
+  typedef LatentCacheCode<L> C;
+  static inline typename V::reg load(const real_t* w, index_t d,
+                                     index_t aligned_k) {
+    return V::template load_code8<C::kShift>(
+      reinterpret_cast<const uint8*>(w + aligned_k) + d, C::kBias);
+  }
+  static inline void store(real_t* w, index_t d, index_t aligned_k,
+                           typename V::reg g, typename V::reg r) {
+    V::template store_code8<C::kShift>(
+      reinterpret_cast<uint8*>(w + aligned_k) + d, g, r,
+      C::kBias, C::kMaxBits);
+  }
+};
+
+// The split layout of the reduced caches. The new cache is rounded
+// with the low bits of the new weight as the random bits, so the
+// squared gradients that are smaller than a step of the code are
+// still added in expectation (stochastic rounding) rather than lost
+template <typename V, LatentLayout L>
+struct CodedBlock {
+  typedef typename V::reg reg;
+  static const index_t kStep = V::kWidth;
+  static inline index_t end(index_t aligned_k) { return aligned_k; }
+  static inline reg weight(const real_t* w, index_t d) {
+    return V::load(w + d);
+  }
+  static inline reg cache(const real_t* w, index_t d, index_t aligned_k) {
+    return CodedCache<V, L>::load(w, d, aligned_k);
+  }
+  static inline void store(real_t* w, index_t d, index_t aligned_k,
+                           reg a, reg g) {
+    V::store(w + d, a);
+    CodedCache<V, L>::store(w, d, aligned_k, g, a);
+  }
+};
+
+template <typename V>
+struct Block<V, kLayoutSplitFP16> : CodedBlock<V, kLayoutSplitFP16> { };
+template <typename V>
+struct Block<V, kLayoutSplitBF16> : CodedBlock<V, kLayoutSplitBF16> { };
+template <typename V>
+struct Block<V, kLayoutSplitLog8> : CodedBlock<V, kLayoutSplitLog8> { };
+
+// The shared split layout, whose one cache is after the aligned_k
+// weights, so the steps only read the weights (see SharedUpdate)
+template <typename V>
+struct Block<V, kLayoutSplitShared> {
+  typedef typename V::reg reg;
+  static const index_t kStep = V::kWidth;
+  static inline index_t end(index_t aligned_k) { return aligned_k; }
+  static inline reg weight(const real_t* w, index_t d) {
+    return V::load(w + d);
+  }
+};
+
+// The steps of V cover [0, wide) of a block, and the 128-bit
+// steps of SSEReg cover the rest [wide, end)
+template <typename V, LatentLayout L>
+inline index_t block_wide(index_t aligned_k) {
+  typedef Block<V, L> B;
+  return B::end(aligned_k) / B::kStep * B::kStep;
+}
+
+// One adagrad step at the position d of a pair of FFM latent vectors
+template <typename V, SqrtPrecision P, LatentLayout L>
+KERNEL_INLINE void ffm_update(real_t* w1, real_t* w2, index_t d,
+                              index_t aligned_k,
+                              typename V::reg pgv,
+                              typename V::reg lr,
+                              typename V::reg lamb) {
+  typedef Block<V, L> B;
+  typename V::reg a = B::weight(w1, d);
+  typename V::reg b = B::weight(w2, d);
+  typename V::reg ga = B::cache(w1, d, aligned_k);
+  typename V::reg gb = B::cache(w2, d, aligned_k);
+  typename V::reg g1 = V::madd(lamb, a, V::mul(pgv, b));
+  typename V::reg g2 = V::madd(lamb, b, V::mul(pgv, a));
+  ga = V::madd(g1, g1, ga);
+  gb = V::madd(g2, g2, gb);
+  a = V::nmadd(lr, V::mul(inv_sqrt<V, P>(ga), g1), a);
+  b = V::nmadd(lr, V::mul(inv_sqrt<V, P>(gb), g2), b);
+  B::store(w1, d, aligned_k, a, ga);
+  B::store(w2, d, aligned_k, b, gb);
+}
+
+// Prefetch the cache lines of [p, p + len) floats
+inline void prefetch_block(const real_t* p, index_t len) {
+  const uintptr_t line = 64;
+  uintptr_t addr = reinterpret_cast<uintptr_t>(p) & ~(line - 1);
+  uintptr_t end = reinterpret_cast<uintptr_t>(p + len);
+  for (; addr < end; addr += line) {
+    _mm_prefetch(reinterpret_cast<const char*>(addr), _MM_HINT_T0);
+  }
+}
+
+// The latent vectors of FFM are at random locations of a big model,
+// so we prefetch the two blocks of the pair that is dist pairs ahead
+// of the current pair (iter_i, iter_j). If the pair is out of current
+// row i, we move to the pairs of the next row i + 1.
+KERNEL_INLINE void ffm_prefetch(const Node* iter_i, const Node* iter_j,
+                                const Node* end, index_t dist,
+                                const real_t* v, index_t align0,
+                                index_t align1) {
+  const Node* ahead = iter_j + dist;
+  if (ahead >= end) {
+    ahead = iter_i + 2 + (ahead - end);
+    iter_i = iter_i + 1;
+    if (ahead >= end) { return; }
+  }
+  prefetch_block(v + (uint64)iter_i->feat_id*align1 +
+                 ahead->field_id*align0, align0);
+  prefetch_block(v + (uint64)ahead->feat_id*align1 +
+                 iter_i->field_id*align0, align0);
+}
+
+// The pairs of FFM are scored in tiles of kPairTile pairs. Each pair
+// of a tile has its own accumulators, so the multiply-add chains of
+// the pairs are independent and the short inner loops of small K
+// (one or two registers) overlap, rather than waiting for each other.
+const int kPairTile = 4;
+
+// acc[t] += (w1[t]*w2[t]) * val[t] for the T pairs of a tile, where
+// the steps of the blocks before wide are in V and the rest in SSEReg.
+// The pairs of a binary row have no val, and acc[t] += w1[t]*w2[t]
+template <typename V, int T, LatentLayout L, bool kBinary>
+KERNEL_INLINE void ffm_dot_tile(const real_t* const* w1,
+                                const real_t* const* w2,
+                                const real_t* val, index_t aligned_k,
+                                index_t wide, typename V::reg* acc,
+                                SSEReg::reg* tail) {
+  typedef Block<V, L> B;
+  typedef Block<SSEReg, L> B4;
+  typename V::reg xv[T];
+  if (!kBinary) {
+    for (int t = 0; t < T; ++t) { xv[t] = V::set1(val[t]); }
+  }
+  index_t d = 0;
+  for (; d < wide; d += B::kStep) {
+    for (int t = 0; t < T; ++t) {
+      if (kBinary) {
+        acc[t] = V::madd(B::weight(w1[t], d), B::weight(w2[t], d), acc[t]);
+      } else {
+        acc[t] = V::madd(V::mul(B::weight(w1[t], d),
+                                B::weight(w2[t], d)), xv[t], acc[t]);
+      }
+    }
+  }
+  index_t end = B::end(aligned_k);
+  if (d < end) {
+    SSEReg::reg xv4[T];
+    if (!kBinary) {
+      for (int t = 0; t < T; ++t) { xv4[t] = SSEReg::set1(val[t]); }
+    }
+    for (; d < end; d += B4::kStep) {
+      for (int t = 0; t < T; ++t) {
+        if (kBinary) {
+          tail[t] = SSEReg::madd(B4::weight(w1[t], d),
+                                 B4::weight(w2[t], d), tail[t]);
+        } else {
+          tail[t] = SSEReg::madd(SSEReg::mul(B4::weight(w1[t], d),
+                                             B4::weight(w2[t], d)),
+                                 xv4[t], tail[t]);
+        }
+      }
+    }
+  }
+}
+
+// The blocks and x_i * x_j * norm of the pair (iter_i, iter_j),
+// which are also staged in pairs if kStage is true. The values
+// of a binary row are not loaded, and x_i * x_j * norm is norm
+template <bool kStage, bool kCross, bool kBinary>
+KERNEL_INLINE void ffm_stage_pair(const Node* iter_i, const Node* iter_j,
+                                  const Node* end, const real_t* v,
+                                  index_t align0, index_t align1,
+                                  real_t norm, index_t prefetch,
+                                  const real_t** w1, const real_t** w2,
+                                  real_t* val, FFMPair** pairs) {
+  if (!kCross && prefetch > 0) {
+    ffm_prefetch(iter_i, iter_j, end, prefetch, v, align0, align1);
+  }
+  *w1 = v + (uint64)iter_i->feat_id*align1 + iter_j->field_id*align0;
+  *w2 = v + (uint64)iter_j->feat_id*align1 + iter_i->field_id*align0;
+  *val = kBinary ? norm : iter_i->feat_val * iter_j->feat_val * norm;
+  if (kStage) {
+    (*pairs)->w1 = const_cast<real_t*>(*w1);
+    (*pairs)->w2 = const_cast<real_t*>(*w2);
+    (*pairs)->val = *val;
+    ++*pairs;
+  }
+}
+
+// sum( (V_i_fj*V_j_fi)(x_i * x_j) ) * norm
+// If K > 0, the kernel is specialized on aligned_k == K, so
+// the inner loops have constant trip count and they will be
+// fully unrolled by the compiler.
+// If kStage is true, the two blocks and x_i * x_j * norm of each
+// pair are also written to pairs, which are used by ffm_grad_staged()
+// If kCross is true, the pairs are (i, j) for i in [begin, end) and
+// j in [cross_begin, cross_end), rather than i < j of one row.
+// If kBinary is true, all the values of the row are 1.0, and the
+// sum of (V_i_fj*V_j_fi) is multiplied by norm once at the end
+template <typename V, index_t K, bool kStage, bool kCross, bool kBinary,
+          LatentLayout L>
+real_t ffm_score_impl(const Node* begin, const Node* end,
+                      const Node* cross_begin, const Node* cross_end,
+                      const real_t* v, index_t align0,
+                      index_t align1, real_t norm,
+                      index_t prefetch, FFMPair* pairs) {
+  if (K > 0) { align0 = LatentBlockSize(L, K); }
+  const index_t aligned_k = LatentBlockK(L, align0);
+  const index_t wide = block_wide<V, L>(aligned_k);
+  typename V::reg acc[kPairTile];
+  SSEReg::reg tail[kPairTile];
+  for (int t = 0; t < kPairTile; ++t) {
+    acc[t] = V::zero();
+    tail[t] = SSEReg::zero();
+  }
+  const real_t* w1[kPairTile];
+  const real_t* w2[kPairTile];
+  real_t val[kPairTile];
+  for (const Node* iter_i = begin; iter_i != end; ++iter_i) {
+    const Node* end_j = kCross ? cross_end : end;
+    const Node* iter_j = kCross ? cross_begin : iter_i+1;
+    // The full tiles, and then the last pairs of node i one by one
+    for (; end_j - iter_j >= kPairTile; iter_j += kPairTile) {
+      for (int t = 0; t < kPairTile; ++t) {
+        ffm_stage_pair<kStage, kCross, kBinary>(
+          iter_i, iter_j + t, end, v, align0, align1, norm, prefetch,
+          &w1[t], &w2[t], &val[t], &pairs);
+      }
+      ffm_dot_tile<V, kPairTile, L, kBinary>(w1, w2, val, aligned_k,
+                                             wide, acc, tail);
+    }
+    for (; iter_j != end_j; ++iter_j) {
+      ffm_stage_pair<kStage, kCross, kBinary>(
+        iter_i, iter_j, end, v, align0, align1, norm, prefetch,
+        &w1[0], &w2[0], &val[0], &pairs);
+      ffm_dot_tile<V, 1, L, kBinary>(w1, w2, val, aligned_k, wide,
+                                     acc, tail);
+    }
+  }
+  for (int t = 1; t < kPairTile; ++t) {
+    acc[0] = V::add(acc[0], acc[t]);
+    tail[0] = SSEReg::add(tail[0], tail[t]);
+  }
+  real_t sum = V::reduce(acc[0]) + SSEReg::reduce(tail[0]);
+  return kBinary ? sum * norm : sum;
+}
+
+template <typename V, index_t K, LatentLayout L>
+real_t ffm_score(const Node* begin, const Node* end,
+                 const real_t* v, index_t align0,
+                 index_t align1, real_t norm,
+                 index_t prefetch) {
+  return ffm_score_impl<V, K, false, false, false, L>(
+    begin, end, nullptr, nullptr, v, align0, align1,
+    norm, prefetch, nullptr);
+}
+
+// ffm_score() of the binary row
+template <typename V, index_t K, LatentLayout L>
+real_t ffm_score_binary(const Node* begin, const Node* end,
+                        const real_t* v, index_t align0,
+                        index_t align1, real_t norm,
+                        index_t prefetch) {
+  return ffm_score_impl<V, K, false, false, true, L>(
+    begin, end, nullptr, nullptr, v, align0, align1,
+    norm, prefetch, nullptr);
+}
+
+template <typename V, index_t K, LatentLayout L>
+real_t ffm_score_staged(const Node* begin, const Node* end,
+                        real_t* v, index_t align0,
+                        index_t align1, real_t norm,
+                        index_t prefetch, FFMPair* pairs) {
+  return ffm_score_impl<V, K, true, false, false, L>(
+    begin, end, nullptr, nullptr, v, align0, align1,
+    norm, prefetch, pairs);
+}
+
+// ffm_score_staged() of the binary row
+template <typename V, index_t K, LatentLayout L>
+real_t ffm_score_staged_binary(const Node* begin, const Node* end,
+                               real_t* v, index_t align0,
+                               index_t align1, real_t norm,
+                               index_t prefetch, FFMPair* pairs) {
+  return ffm_score_impl<V, K, true, false, true, L>(
+    begin, end, nullptr, nullptr, v, align0, align1,
+    norm, prefetch, pairs);
+}
+
+template <typename V, index_t K, LatentLayout L>
+real_t ffm_cross(const Node* begin, const Node* end,
+                 const Node* cross_begin, const Node* cross_end,
+                 const real_t* v, index_t align0,
+                 index_t align1, real_t norm) {
+  return ffm_score_impl<V, K, false, true, false, L>(
+    begin, end, cross_begin, cross_end, v, align0, align1,
+    norm, 0, nullptr);
+}
+
+// sum( (w1*w2) * val ) of the pairs, whose blocks are resolved
+// by the caller (e.g., from the sparse latent factor). The tiles
+// are the ones of ffm_score_impl()
+template <typename V, index_t K, LatentLayout L>
+real_t ffm_score_pairs(const FFMPair* pairs, index_t num_pair,
+                       index_t align0) {
+  if (K > 0) { align0 = LatentBlockSize(L, K); }
+  const index_t aligned_k = LatentBlockK(L, align0);
+  const index_t wide = block_wide<V, L>(aligned_k);
+  typename V::reg acc[kPairTile];
+  SSEReg::reg tail[kPairTile];
+  for (int t = 0; t < kPairTile; ++t) {
+    acc[t] = V::zero();
+    tail[t] = SSEReg::zero();
+  }
+  const real_t* w1[kPairTile];
+  const real_t* w2[kPairTile];
+  real_t val[kPairTile];
+  const FFMPair* p = pairs;
+  const FFMPair* last = pairs + num_pair;
+  for (; last - p >= kPairTile; p += kPairTile) {
+    for (int t = 0; t < kPairTile; ++t) {
+      w1[t] = p[t].w1;
+      w2[t] = p[t].w2;
+      val[t] = p[t].val;
+    }
+    ffm_dot_tile<V, kPairTile, L, false>(w1, w2, val, aligned_k, wide,
+                                         acc, tail);
+  }
+  for (; p != last; ++p) {
+    w1[0] = p->w1;
+    w2[0] = p->w2;
+    val[0] = p->val;
+    ffm_dot_tile<V, 1, L, false>(w1, w2, val, aligned_k, wide, acc, tail);
+  }
+  for (int t = 1; t < kPairTile; ++t) {
+    acc[0] = V::add(acc[0], acc[t]);
+    tail[0] = SSEReg::add(tail[0], tail[t]);
+  }
+  return V::reduce(acc[0]) + SSEReg::reduce(tail[0]);
+}
+
+// ffm_score_pairs() of the interleaved blocks of mixed K, in which
+// the tile of kPairTile pairs is used if they have the same k
+template <typename V>
+real_t ffm_score_mixed(const FFMPair* pairs, index_t num_pair) {
+  const LatentLayout L = kLayoutInterleaved;
+  typename V::reg acc[kPairTile];
+  SSEReg::reg tail[kPairTile];
+  for (int t = 0; t < kPairTile; ++t) {
+    acc[t] = V::zero();
+    tail[t] = SSEReg::zero();
+  }
+  const real_t* w1[kPairTile];
+  const real_t* w2[kPairTile];
+  real_t val[kPairTile];
+  const FFMPair* p = pairs;
+  const FFMPair* last = pairs + num_pair;
+  while (p != last) {
+    index_t k = p->k;
+    index_t wide = block_wide<V, L>(k);
+    int same = 1;
+    while (same < kPairTile && p + same != last && p[same].k == k) {
+      ++same;
+    }
+    if (same == kPairTile) {
+      for (int t = 0; t < kPairTile; ++t) {
+        w1[t] = p[t].w1;
+        w2[t] = p[t].w2;
+        val[t] = p[t].val;
+      }
+      ffm_dot_tile<V, kPairTile, L, false>(w1, w2, val, k, wide,
+                                           acc, tail);
+      p += kPairTile;
+    } else {
+      w1[0] = p->w1;
+      w2[0] = p->w2;
+      val[0] = p->val;
+      ffm_dot_tile<V, 1, L, false>(w1, w2, val, k, wide, acc, tail);
+      ++p;
+    }
+  }
+  for (int t = 1; t < kPairTile; ++t) {
+    acc[0] = V::add(acc[0], acc[t]);
+    tail[0] = SSEReg::add(tail[0], tail[t]);
+  }
+  return V::reduce(acc[0]) + SSEReg::reduce(tail[0]);
+}
+
+// One adagrad step on the blocks of a pair, whose partial
+// gradient is pgv
+template <typename V, SqrtPrecision P, LatentLayout L>
+struct PairUpdate {
+  static KERNEL_INLINE void apply(real_t* w1, real_t* w2, real_t pgv,
+                                  index_t aligned_k, index_t wide,
+                                  typename V::reg lr,
+                                  typename V::reg lamb,
+                                  SSEReg::reg lr4, SSEReg::reg lamb4) {
+    typename V::reg xpgv = V::set1(pgv);
+    index_t d = 0;
+    for (; d < wide; d += Block<V, L>::kStep) {
+      ffm_update<V, P, L>(w1, w2, d, aligned_k, xpgv, lr, lamb);
+    }
+    index_t end = Block<V, L>::end(aligned_k);
+    if (d < end) {
+      SSEReg::reg xpgv4 = SSEReg::set1(pgv);
+      for (; d < end; d += Block<SSEReg, L>::kStep) {
+        ffm_update<SSEReg, P, L>(w1, w2, d, aligned_k, xpgv4, lr4, lamb4);
+      }
+    }
+  }
+};
+
+// The gradients of the step d of the shared layout
+template <typename R>
+KERNEL_INLINE void shared_grad(const real_t* w1, const real_t* w2,
+                               index_t d, typename R::reg pgv,
+                               typename R::reg lamb,
+                               typename R::reg* g1, typename R::reg* g2) {
+  typename R::reg a = R::load(w1 + d);
+  typename R::reg b = R::load(w2 + d);
+  *g1 = R::madd(lamb, a, R::mul(pgv, b));
+  *g2 = R::madd(lamb, b, R::mul(pgv, a));
+}
+
+// The shared layout adds the mean squared gradient of the block to
+// its one cache, so the gradients of a pair are computed twice: for
+// the sums of squares, and for the steps of the new caches
+template <typename V, SqrtPrecision P>
+struct PairUpdate<V, P, kLayoutSplitShared> {
+  static KERNEL_INLINE void apply(real_t* w1, real_t* w2, real_t pgv,
+                                  index_t aligned_k, index_t wide,
+                                  typename V::reg lr,
+                                  typename V::reg lamb,
+                                  SSEReg::reg lr4, SSEReg::reg lamb4) {
+    typedef typename V::reg reg;
+    reg xpgv = V::set1(pgv);
+    SSEReg::reg xpgv4 = SSEReg::set1(pgv);
+    reg g1, g2;
+    SSEReg::reg h1, h2;
+    reg s1 = V::zero();
+    reg s2 = V::zero();
+    SSEReg::reg t1 = SSEReg::zero();
+    SSEReg::reg t2 = SSEReg::zero();
+    index_t d = 0;
+    for (; d < wide; d += V::kWidth) {
+      shared_grad<V>(w1, w2, d, xpgv, lamb, &g1, &g2);
+      s1 = V::madd(g1, g1, s1);
+      s2 = V::madd(g2, g2, s2);
+    }
+    for (; d < aligned_k; d += kAlign) {
+      shared_grad<SSEReg>(w1, w2, d, xpgv4, lamb4, &h1, &h2);
+      t1 = SSEReg::madd(h1, h1, t1);
+      t2 = SSEReg::madd(h2, h2, t2);
+    }
+    real_t inv_k = 1.0f / aligned_k;
+    real_t c1 = w1[aligned_k] +
+                (V::reduce(s1) + SSEReg::reduce(t1)) * inv_k;
+    real_t c2 = w2[aligned_k] +
+                (V::reduce(s2) + SSEReg::reduce(t2)) * inv_k;
+    SSEReg::reg r = inv_sqrt<SSEReg, P>(_mm_setr_ps(c1, c2, 1.0f, 1.0f));
+    real_t r1 = _mm_cvtss_f32(r);
+    real_t r2 = _mm_cvtss_f32(_mm_shuffle_ps(r, r, 1));
+    reg e1 = V::mul(lr, V::set1(r1));
+    reg e2 = V::mul(lr, V::set1(r2));
+    for (d = 0; d < wide; d += V::kWidth) {
+      shared_grad<V>(w1, w2, d, xpgv, lamb, &g1, &g2);
+      reg a = V::nmadd(e1, g1, V::load(w1 + d));
+      reg b = V::nmadd(e2, g2, V::load(w2 + d));
+      V::store(w1 + d, a);
+      V::store(w2 + d, b);
+    }
+    SSEReg::reg f1 = SSEReg::mul(lr4, SSEReg::set1(r1));
+    SSEReg::reg f2 = SSEReg::mul(lr4, SSEReg::set1(r2));
+    for (; d < aligned_k; d += kAlign) {
+      shared_grad<SSEReg>(w1, w2, d, xpgv4, lamb4, &h1, &h2);
+      SSEReg::reg a = SSEReg::nmadd(f1, h1, SSEReg::load(w1 + d));
+      SSEReg::reg b = SSEReg::nmadd(f2, h2, SSEReg::load(w2 + d));
+      SSEReg::store(w1 + d, a);
+      SSEReg::store(w2 + d, b);
+    }
+    w1[aligned_k] = c1;
+    w2[aligned_k] = c2;
+  }
+};
+
+// Update the latent factors of FFM. The partial gradient of
+// each pair of a binary row (kBinary) is norm * pg
+template <typename V, index_t K, SqrtPrecision P, LatentLayout L,
+          bool kBinary>
+void ffm_grad_impl(const Node* begin, const Node* end,
+                   real_t* v, index_t align0, index_t align1,
+                   real_t norm, real_t pg, real_t learning_rate,
+                   real_t regu_lambda, index_t prefetch) {
+  if (K > 0) { align0 = LatentBlockSize(L, K); }
+  const index_t aligned_k = LatentBlockK(L, align0);
+  const index_t wide = block_wide<V, L>(aligned_k);
+  typename V::reg lr = V::set1(learning_rate);
+  typename V::reg lamb = V::set1(regu_lambda);
+  SSEReg::reg lr4 = SSEReg::set1(learning_rate);
+  SSEReg::reg lamb4 = SSEReg::set1(regu_lambda);
+  for (const Node* iter_i = begin; iter_i != end; ++iter_i) {
+    index_t j1 = iter_i->feat_id;
+    index_t f1 = iter_i->field_id;
+    real_t v1 = kBinary ? 1.0 : iter_i->feat_val;
+    for (const Node* iter_j = iter_i+1; iter_j != end; ++iter_j) {
+      if (prefetch > 0) {
+        ffm_prefetch(iter_i, iter_j, end, prefetch, v, align0, align1);
+      }
+      real_t* w1 = v + (uint64)j1*align1 + iter_j->field_id*align0;
+      real_t* w2 = v + (uint64)iter_j->feat_id*align1 + f1*align0;
+      real_t pgv = kBinary ? norm * pg :
+                             v1 * iter_j->feat_val * norm * pg;
+      PairUpdate<V, P, L>::apply(w1, w2, pgv, aligned_k, wide,
+                                 lr, lamb, lr4, lamb4);
+    }
+  }
+}
+
+template <typename V, index_t K, LatentLayout L, bool kBinary>
+void ffm_grad_row(const Node* begin, const Node* end,
+                  real_t* v, index_t align0, index_t align1,
+                  real_t norm, real_t pg, real_t learning_rate,
+                  real_t regu_lambda, index_t prefetch,
+                  SqrtPrecision precision) {
+  switch (precision) {
+    case kSqrtNewton:
+      ffm_grad_impl<V, K, kSqrtNewton, L, kBinary>(begin, end, v,
+        align0, align1, norm, pg, learning_rate, regu_lambda, prefetch);
+      break;
+    case kSqrtExact:
+      ffm_grad_impl<V, K, kSqrtExact, L, kBinary>(begin, end, v,
+        align0, align1, norm, pg, learning_rate, regu_lambda, prefetch);
+      break;
+    default:
+      ffm_grad_impl<V, K, kSqrtFast, L, kBinary>(begin, end, v,
+        align0, align1, norm, pg, learning_rate, regu_lambda, prefetch);
+  }
+}
+
+template <typename V, index_t K, LatentLayout L>
+void ffm_grad(const Node* begin, const Node* end,
+              real_t* v, index_t align0, index_t align1,
+              real_t norm, real_t pg, real_t learning_rate,
+              real_t regu_lambda, index_t prefetch,
+              SqrtPrecision precision) {
+  ffm_grad_row<V, K, L, false>(begin, end, v, align0, align1, norm, pg,
+                               learning_rate, regu_lambda, prefetch,
+                               precision);
+}
+
+// ffm_grad() of the binary row
+template <typename V, index_t K, LatentLayout L>
+void ffm_grad_binary(const Node* begin, const Node* end,
+                     real_t* v, index_t align0, index_t align1,
+                     real_t norm, real_t pg, real_t learning_rate,
+                     real_t regu_lambda, index_t prefetch,
+                     SqrtPrecision precision) {
+  ffm_grad_row<V, K, L, true>(begin, end, v, align0, align1, norm, pg,
+                              learning_rate, regu_lambda, prefetch,
+                              precision);
+}
+
+// Update the pairs staged by ffm_score_staged(). The blocks
+// are read just now, so most of them are still in cache
+template <typename V, index_t K, SqrtPrecision P, LatentLayout L>
+void ffm_grad_staged_impl(const FFMPair* pairs, index_t num_pair,
+                          index_t align0, real_t pg,
+                          real_t learning_rate, real_t regu_lambda) {
+  if (K > 0) { align0 = LatentBlockSize(L, K); }
+  const index_t aligned_k = LatentBlockK(L, align0);
+  const index_t wide = block_wide<V, L>(aligned_k);
+  typename V::reg lr = V::set1(learning_rate);
+  typename V::reg lamb = V::set1(regu_lambda);
+  SSEReg::reg lr4 = SSEReg::set1(learning_rate);
+  SSEReg::reg lamb4 = SSEReg::set1(regu_lambda);
+  for (const FFMPair* p = pairs; p != pairs + num_pair; ++p) {
+    PairUpdate<V, P, L>::apply(p->w1, p->w2, p->val * pg, aligned_k,
+                               wide, lr, lamb, lr4, lamb4);
+  }
+}
+
+template <typename V, index_t K, LatentLayout L>
+void ffm_grad_staged(const FFMPair* pairs, index_t num_pair,
+                     index_t align0, real_t pg,
+                     real_t learning_rate, real_t regu_lambda,
+                     SqrtPrecision precision) {
+  switch (precision) {
+    case kSqrtNewton:
+      ffm_grad_staged_impl<V, K, kSqrtNewton, L>(pairs, num_pair, align0,
+        pg, learning_rate, regu_lambda);
+      break;
+    case kSqrtExact:
+      ffm_grad_staged_impl<V, K, kSqrtExact, L>(pairs, num_pair, align0,
+        pg, learning_rate, regu_lambda);
+      break;
+    default:
+      ffm_grad_staged_impl<V, K, kSqrtFast, L>(pairs, num_pair, align0,
+        pg, learning_rate, regu_lambda);
+  }
+}
+
+// ffm_grad_staged() of the interleaved blocks of mixed K
+template <typename V, SqrtPrecision P>
+void ffm_grad_mixed_impl(const FFMPair* pairs, index_t num_pair,
+                         real_t pg, real_t learning_rate,
+                         real_t regu_lambda) {
+  const LatentLayout L = kLayoutInterleaved;
+  typename V::reg lr = V::set1(learning_rate);
+  typename V::reg lamb = V::set1(regu_lambda);
+  SSEReg::reg lr4 = SSEReg::set1(learning_rate);
+  SSEReg::reg lamb4 = SSEReg::set1(regu_lambda);
+  for (const FFMPair* p = pairs; p != pairs + num_pair; ++p) {
+    PairUpdate<V, P, L>::apply(p->w1, p->w2, p->val * pg, p->k,
+                               block_wide<V, L>(p->k),
+                               lr, lamb, lr4, lamb4);
+  }
+}
+
+template <typename V>
+void ffm_grad_mixed(const FFMPair* pairs, index_t num_pair,
+                    real_t pg, real_t learning_rate,
+                    real_t regu_lambda, SqrtPrecision precision) {
+  switch (precision) {
+    case kSqrtNewton:
+      ffm_grad_mixed_impl<V, kSqrtNewton>(pairs, num_pair, pg,
+        learning_rate, regu_lambda);
+      break;
+    case kSqrtExact:
+      ffm_grad_mixed_impl<V, kSqrtExact>(pairs, num_pair, pg,
+        learning_rate, regu_lambda);
+      break;
+    default:
+      ffm_grad_mixed_impl<V, kSqrtFast>(pairs, num_pair, pg,
+        learning_rate, regu_lambda);
+  }
+}
+
+// s += V_i * val on the latent vector w of FM
+template <typename V>
+inline void fm_add(const real_t* w, real_t val, index_t aligned_k,
+                   real_t* s) {
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  typename V::reg xv = V::set1(val);
+  index_t d = 0;
+  for (; d < wide; d += V::kWidth) {
+    V::store(s + d, V::madd(V::load(w + d), xv, V::load(s + d)));
+  }
+  for (; d < aligned_k; d += kAlign) {
+    SSEReg::reg xv4 = SSEReg::set1(val);
+    SSEReg::store(s + d, SSEReg::madd(SSEReg::load(w + d), xv4,
+                                      SSEReg::load(s + d)));
+  }
+}
+
+// acc += (V_i * val) * (s - V_i * val) on the latent vector w
+template <typename V>
+inline void fm_pair(const real_t* w, real_t val, index_t aligned_k,
+                    const real_t* s, typename V::reg* acc,
+                    SSEReg::reg* tail) {
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  typename V::reg xv = V::set1(val);
+  index_t d = 0;
+  for (; d < wide; d += V::kWidth) {
+    typename V::reg wv = V::mul(V::load(w + d), xv);
+    *acc = V::madd(wv, V::sub(V::load(s + d), wv), *acc);
+  }
+  for (; d < aligned_k; d += kAlign) {
+    SSEReg::reg xv4 = SSEReg::set1(val);
+    SSEReg::reg wv = SSEReg::mul(SSEReg::load(w + d), xv4);
+    *tail = SSEReg::madd(wv, SSEReg::sub(SSEReg::load(s + d), wv), *tail);
+  }
+}
+
+// s = sum( V_i * x_i ) * norm of the nodes and the n dense
+// values x, where the dense value j is the value of feature j
+template <typename V, index_t K>
+void fm_sum(const Node* begin, const Node* end,
+            const real_t* x, index_t n,
+            const real_t* v, index_t aligned_k,
+            real_t norm, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t align0 = 2 * aligned_k;
+  for (index_t d = 0; d < aligned_k; ++d) { s[d] = 0; }
+  for (index_t j = 0; j < n; ++j) {
+    fm_add<V>(v + j * align0, x[j] * norm, aligned_k, s);
+  }
+  for (const Node* iter = begin; iter != end; ++iter) {
+    fm_add<V>(v + (uint64)iter->feat_id * align0, iter->feat_val * norm,
+              aligned_k, s);
+  }
+}
+
+// 0.5 * sum( (V_i*V_j)(x_i * x_j) ) * norm
+template <typename V, index_t K>
+real_t fm_score_dense(const Node* begin, const Node* end,
+                      const real_t* x, index_t n,
+                      const real_t* v, index_t aligned_k,
+                      real_t norm, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t align0 = 2 * aligned_k;
+  fm_sum<V, K>(begin, end, x, n, v, aligned_k, norm, s);
+  typename V::reg acc = V::zero();
+  SSEReg::reg tail = SSEReg::zero();
+  for (index_t j = 0; j < n; ++j) {
+    fm_pair<V>(v + j * align0, x[j] * norm, aligned_k, s, &acc, &tail);
+  }
+  for (const Node* iter = begin; iter != end; ++iter) {
+    fm_pair<V>(v + (uint64)iter->feat_id * align0, iter->feat_val * norm,
+               aligned_k, s, &acc, &tail);
+  }
+  return 0.5 * (V::reduce(acc) + SSEReg::reduce(tail));
+}
+
+template <typename V, index_t K>
+real_t fm_score(const Node* begin, const Node* end,
+                const real_t* v, index_t aligned_k,
+                real_t norm, real_t* s) {
+  return fm_score_dense<V, K>(begin, end, nullptr, 0, v,
+                              aligned_k, norm, s);
+}
+
+// s += V_i and acc += V_i * (s - V_i) on the latent vector w,
+// which are fm_add() and fm_pair() of the value 1.0
+template <typename V>
+inline void fm_add_one(const real_t* w, index_t aligned_k, real_t* s) {
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  index_t d = 0;
+  for (; d < wide; d += V::kWidth) {
+    V::store(s + d, V::add(V::load(w + d), V::load(s + d)));
+  }
+  for (; d < aligned_k; d += kAlign) {
+    SSEReg::store(s + d, SSEReg::add(SSEReg::load(w + d),
+                                     SSEReg::load(s + d)));
+  }
+}
+
+template <typename V>
+inline void fm_pair_one(const real_t* w, index_t aligned_k,
+                        const real_t* s, typename V::reg* acc,
+                        SSEReg::reg* tail) {
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  index_t d = 0;
+  for (; d < wide; d += V::kWidth) {
+    typename V::reg wv = V::load(w + d);
+    *acc = V::madd(wv, V::sub(V::load(s + d), wv), *acc);
+  }
+  for (; d < aligned_k; d += kAlign) {
+    SSEReg::reg wv = SSEReg::load(w + d);
+    *tail = SSEReg::madd(wv, SSEReg::sub(SSEReg::load(s + d), wv), *tail);
+  }
+}
+
+// s = sum( V_i ) of the binary row, without the norm
+template <typename V, index_t K>
+void fm_sum_one(const Node* begin, const Node* end,
+                const real_t* v, index_t aligned_k, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t align0 = 2 * aligned_k;
+  for (index_t d = 0; d < aligned_k; ++d) { s[d] = 0; }
+  for (const Node* iter = begin; iter != end; ++iter) {
+    fm_add_one<V>(v + (uint64)iter->feat_id * align0, aligned_k, s);
+  }
+}
+
+// s *= norm
+template <typename V>
+inline void fm_scale(real_t* s, real_t norm, index_t aligned_k) {
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  typename V::reg xv = V::set1(norm);
+  index_t d = 0;
+  for (; d < wide; d += V::kWidth) {
+    V::store(s + d, V::mul(V::load(s + d), xv));
+  }
+  for (; d < aligned_k; d += kAlign) {
+    SSEReg::store(s + d, SSEReg::mul(SSEReg::load(s + d),
+                                     SSEReg::set1(norm)));
+  }
+}
+
+// fm_score() of the binary row. The sum and the pairs are computed
+// without the values, and then the sum is multiplied by norm and the
+// pairs by norm * norm once, so s is the same as fm_score()
+template <typename V, index_t K>
+real_t fm_score_binary(const Node* begin, const Node* end,
+                       const real_t* v, index_t aligned_k,
+                       real_t norm, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t align0 = 2 * aligned_k;
+  fm_sum_one<V, K>(begin, end, v, aligned_k, s);
+  typename V::reg acc = V::zero();
+  SSEReg::reg tail = SSEReg::zero();
+  for (const Node* iter = begin; iter != end; ++iter) {
+    fm_pair_one<V>(v + (uint64)iter->feat_id * align0, aligned_k,
+                   s, &acc, &tail);
+  }
+  fm_scale<V>(s, norm, aligned_k);
+  return 0.5 * (V::reduce(acc) + SSEReg::reduce(tail)) * norm * norm;
+}
+
+// One adagrad step on a FM latent vector
+template <typename V, SqrtPrecision P>
+inline void fm_update(real_t* w, real_t* wg, const real_t* s,
+                      typename V::reg xv, typename V::reg pgv,
+                      typename V::reg lr, typename V::reg lamb) {
+  typename V::reg a = V::load(w);
+  typename V::reg ga = V::load(wg);
+  typename V::reg g = V::madd(lamb, a,
+                      V::mul(pgv, V::nmadd(a, xv, V::load(s))));
+  ga = V::madd(g, g, ga);
+  a = V::nmadd(lr, V::mul(inv_sqrt<V, P>(ga), g), a);
+  V::store(w, a);
+  V::store(wg, ga);
+}
+
+// Update the latent vector w of FM, and the
+// gradient cache of w is aligned_k floats after it
+template <typename V, SqrtPrecision P>
+inline void fm_update_vector(real_t* w, real_t val, real_t pg,
+                             index_t aligned_k, const real_t* s,
+                             real_t learning_rate, real_t regu_lambda) {
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  typename V::reg xv = V::set1(val);
+  typename V::reg pgv = V::set1(val * pg);
+  typename V::reg lr = V::set1(learning_rate);
+  typename V::reg lamb = V::set1(regu_lambda);
+  index_t d = 0;
+  for (; d < wide; d += V::kWidth) {
+    fm_update<V, P>(w + d, w + aligned_k + d, s + d, xv, pgv, lr, lamb);
+  }
+  for (; d < aligned_k; d += kAlign) {
+    SSEReg::reg xv4 = SSEReg::set1(val);
+    SSEReg::reg pgv4 = SSEReg::set1(val * pg);
+    SSEReg::reg lr4 = SSEReg::set1(learning_rate);
+    SSEReg::reg lamb4 = SSEReg::set1(regu_lambda);
+    fm_update<SSEReg, P>(w + d, w + aligned_k + d, s + d,
+                         xv4, pgv4, lr4, lamb4);
+  }
+}
+
+// Update the latent factors of FM by the sum s of the row.
+// The zero dense values are skipped as the nodes that are
+// not stored, and the values of a binary row are not loaded
+template <typename V, index_t K, SqrtPrecision P, bool kBinary = false>
+void fm_update_row(const Node* begin, const Node* end,
+                   const real_t* x, index_t n,
+                   real_t* v, index_t aligned_k, real_t norm,
+                   real_t pg, real_t learning_rate,
+                   real_t regu_lambda, const real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t align0 = 2 * aligned_k;
+  for (index_t j = 0; j < n; ++j) {
+    if (x[j] == 0) { continue; }
+    fm_update_vector<V, P>(v + j * align0, x[j] * norm, pg, aligned_k,
+                           s, learning_rate, regu_lambda);
+  }
+  for (const Node* iter = begin; iter != end; ++iter) {
+    fm_update_vector<V, P>(v + (uint64)iter->feat_id * align0,
+                           kBinary ? norm : iter->feat_val * norm,
+                           pg, aligned_k,
+                           s, learning_rate, regu_lambda);
+  }
+}
+
+template <typename V, index_t K, SqrtPrecision P>
+void fm_grad_impl(const Node* begin, const Node* end,
+                  const real_t* x, index_t n,
+                  real_t* v, index_t aligned_k, real_t norm,
+                  real_t pg, real_t learning_rate,
+                  real_t regu_lambda, real_t* s) {
+  fm_sum<V, K>(begin, end, x, n, v, aligned_k, norm, s);
+  fm_update_row<V, K, P>(begin, end, x, n, v, aligned_k, norm, pg,
+                         learning_rate, regu_lambda, s);
+}
+
+template <typename V, index_t K>
+void fm_grad_dense(const Node* begin, const Node* end,
+                   const real_t* x, index_t n,
+                   real_t* v, index_t aligned_k, real_t norm,
+                   real_t pg, real_t learning_rate,
+                   real_t regu_lambda, real_t* s,
+                   SqrtPrecision precision) {
+  switch (precision) {
+    case kSqrtNewton:
+      fm_grad_impl<V, K, kSqrtNewton>(begin, end, x, n, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+      break;
+    case kSqrtExact:
+      fm_grad_impl<V, K, kSqrtExact>(begin, end, x, n, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+      break;
+    default:
+      fm_grad_impl<V, K, kSqrtFast>(begin, end, x, n, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+  }
+}
+
+// fm_grad_dense() by the s of fm_score_dense(), which
+// is not computed again
+template <typename V, index_t K>
+void fm_grad_sum(const Node* begin, const Node* end,
+                 const real_t* x, index_t n,
+                 real_t* v, index_t aligned_k, real_t norm,
+                 real_t pg, real_t learning_rate,
+                 real_t regu_lambda, const real_t* s,
+                 SqrtPrecision precision) {
+  switch (precision) {
+    case kSqrtNewton:
+      fm_update_row<V, K, kSqrtNewton>(begin, end, x, n, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+      break;
+    case kSqrtExact:
+      fm_update_row<V, K, kSqrtExact>(begin, end, x, n, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+      break;
+    default:
+      fm_update_row<V, K, kSqrtFast>(begin, end, x, n, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+  }
+}
+
+template <typename V, index_t K>
+void fm_grad(const Node* begin, const Node* end,
+             real_t* v, index_t aligned_k, real_t norm,
+             real_t pg, real_t learning_rate,
+             real_t regu_lambda, real_t* s,
+             SqrtPrecision precision) {
+  fm_grad_dense<V, K>(begin, end, nullptr, 0, v, aligned_k, norm, pg,
+                      learning_rate, regu_lambda, s, precision);
+}
+
+// fm_grad() of the binary row
+template <typename V, index_t K>
+void fm_grad_binary(const Node* begin, const Node* end,
+                    real_t* v, index_t aligned_k, real_t norm,
+                    real_t pg, real_t learning_rate,
+                    real_t regu_lambda, real_t* s,
+                    SqrtPrecision precision) {
+  fm_sum_one<V, K>(begin, end, v, aligned_k, s);
+  fm_scale<V>(s, norm, K > 0 ? K : aligned_k);
+  switch (precision) {
+    case kSqrtNewton:
+      fm_update_row<V, K, kSqrtNewton, true>(begin, end, nullptr, 0, v,
+        aligned_k, norm, pg, learning_rate, regu_lambda, s);
+      break;
+    case kSqrtExact:
+      fm_update_row<V, K, kSqrtExact, true>(begin, end, nullptr, 0, v,
+        aligned_k, norm, pg, learning_rate, regu_lambda, s);
+      break;
+    default:
+      fm_update_row<V, K, kSqrtFast, true>(begin, end, nullptr, 0, v,
+        aligned_k, norm, pg, learning_rate, regu_lambda, s);
+  }
+}
+
+//------------------------------------------------------------------------------
+// HOFM of order 3 has the vectors P_i (order 2) and Q_i (order 3) of
+// each feature. The ANOVA kernels are given by the power sums of each
+// dimension, with a = P_i * x_i and b = Q_i * x_i:
+//   A2 = (S1^2 - S2) / 2, A3 = (T1^3 - 3 * T1 * T2 + 2 * T3) / 6,
+// where S_m = sum( a^m ) and T_m = sum( b^m ). So the row is scored
+// in one pass over its nodes, which is O(nnz * K) as FM. The sums are
+// in s = [S1, S2, T1, T2, T3], and Q_i is stride / 2 floats after P_i,
+// where stride is the floats of a feature.
+//------------------------------------------------------------------------------
+
+// Add the powers of a and b of the feature at the position d
+template <typename R>
+inline void hofm_add_step(const real_t* p, const real_t* q,
+                          typename R::reg xv, index_t d,
+                          index_t aligned_k, real_t* s) {
+  typename R::reg a = R::mul(R::load(p + d), xv);
+  typename R::reg b = R::mul(R::load(q + d), xv);
+  typename R::reg bb = R::mul(b, b);
+  real_t* s1 = s + d;
+  real_t* s2 = s1 + aligned_k;
+  real_t* t1 = s2 + aligned_k;
+  real_t* t2 = t1 + aligned_k;
+  real_t* t3 = t2 + aligned_k;
+  R::store(s1, R::add(R::load(s1), a));
+  R::store(s2, R::madd(a, a, R::load(s2)));
+  R::store(t1, R::add(R::load(t1), b));
+  R::store(t2, R::add(R::load(t2), bb));
+  R::store(t3, R::madd(bb, b, R::load(t3)));
+}
+
+// s = the power sums of the row * norm
+template <typename V, index_t K>
+void hofm_sum(const Node* begin, const Node* end,
+              const real_t* v, index_t aligned_k,
+              index_t stride, real_t norm, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  for (index_t d = 0; d < 5 * aligned_k; ++d) { s[d] = 0; }
+  for (const Node* iter = begin; iter != end; ++iter) {
+    const real_t* p = v + (uint64)iter->feat_id * stride;
+    const real_t* q = p + stride / 2;
+    real_t val = iter->feat_val * norm;
+    typename V::reg xv = V::set1(val);
+    index_t d = 0;
+    for (; d < wide; d += V::kWidth) {
+      hofm_add_step<V>(p, q, xv, d, aligned_k, s);
+    }
+    if (d < aligned_k) {
+      SSEReg::reg xv4 = SSEReg::set1(val);
+      for (; d < aligned_k; d += kAlign) {
+        hofm_add_step<SSEReg>(p, q, xv4, d, aligned_k, s);
+      }
+    }
+  }
+}
+
+// acc += 3 * (S1^2 - S2) + T1 * (T1^2 - 3 * T2) + 2 * T3
+template <typename R>
+inline void hofm_anova_step(const real_t* s, index_t d,
+                            index_t aligned_k, typename R::reg* acc) {
+  const real_t* s1 = s + d;
+  typename R::reg x1 = R::load(s1);
+  typename R::reg x2 = R::load(s1 + aligned_k);
+  typename R::reg y1 = R::load(s1 + 2 * aligned_k);
+  typename R::reg y2 = R::load(s1 + 3 * aligned_k);
+  typename R::reg y3 = R::load(s1 + 4 * aligned_k);
+  typename R::reg three = R::set1(3.0f);
+  typename R::reg a2 = R::mul(three, R::sub(R::mul(x1, x1), x2));
+  typename R::reg a3 = R::mul(y1, R::nmadd(three, y2, R::mul(y1, y1)));
+  *acc = R::add(*acc, R::add(a2, R::madd(R::set1(2.0f), y3, a3)));
+}
+
+// (A2 + A3) * norm of the row, in which each x is multiplied by
+// norm. The s is a buffer that has 5 * aligned_k floats
+template <typename V, index_t K>
+real_t hofm_score(const Node* begin, const Node* end,
+                  const real_t* v, index_t aligned_k,
+                  index_t stride, real_t norm, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  hofm_sum<V, K>(begin, end, v, aligned_k, stride, norm, s);
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  typename V::reg acc = V::zero();
+  SSEReg::reg tail = SSEReg::zero();
+  index_t d = 0;
+  for (; d < wide; d += V::kWidth) {
+    hofm_anova_step<V>(s, d, aligned_k, &acc);
+  }
+  for (; d < aligned_k; d += kAlign) {
+    hofm_anova_step<SSEReg>(s, d, aligned_k, &tail);
+  }
+  return (V::reduce(acc) + SSEReg::reduce(tail)) / 6;
+}
+
+// One adagrad step at the position d of the vectors of a feature.
+// The gradient of P_i is x_i * (S1 - a), and the gradient of Q_i is
+// x_i * (E2 - b * (T1 - b)), where E2 = (T1^2 - T2) / 2 is in the
+// place of T2 of s (see hofm_grad_impl())
+template <typename R, SqrtPrecision P>
+inline void hofm_update(real_t* p, real_t* q, const real_t* s,
+                        index_t d, index_t aligned_k,
+                        typename R::reg xv, typename R::reg pgv,
+                        typename R::reg lr, typename R::reg lamb) {
+  fm_update<R, P>(p + d, p + aligned_k + d, s + d, xv, pgv, lr, lamb);
+  typename R::reg c = R::load(q + d);
+  typename R::reg gc = R::load(q + aligned_k + d);
+  typename R::reg b = R::mul(c, xv);
+  typename R::reg t1 = R::load(s + 2 * aligned_k + d);
+  typename R::reg e2 = R::load(s + 3 * aligned_k + d);
+  typename R::reg g = R::madd(lamb, c,
+                      R::mul(pgv, R::nmadd(b, R::sub(t1, b), e2)));
+  gc = R::madd(g, g, gc);
+  c = R::nmadd(lr, R::mul(inv_sqrt<R, P>(gc), g), c);
+  R::store(q + d, c);
+  R::store(q + aligned_k + d, gc);
+}
+
+// Update the vectors of HOFM by adagrad, in which the stride
+// of a feature is 4 * aligned_k (P_i, its caches, Q_i and its
+// caches). All the gradients are given by the sums of the row
+// before the update, as fm_grad_impl()
+template <typename V, index_t K, SqrtPrecision P>
+void hofm_grad_impl(const Node* begin, const Node* end,
+                    real_t* v, index_t aligned_k, real_t norm,
+                    real_t pg, real_t learning_rate,
+                    real_t regu_lambda, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t stride = 4 * aligned_k;
+  hofm_sum<V, K>(begin, end, v, aligned_k, stride, norm, s);
+  real_t* t1 = s + 2 * aligned_k;
+  real_t* t2 = s + 3 * aligned_k;
+  for (index_t d = 0; d < aligned_k; ++d) {
+    t2[d] = 0.5f * (t1[d] * t1[d] - t2[d]);
+  }
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  typename V::reg lr = V::set1(learning_rate);
+  typename V::reg lamb = V::set1(regu_lambda);
+  SSEReg::reg lr4 = SSEReg::set1(learning_rate);
+  SSEReg::reg lamb4 = SSEReg::set1(regu_lambda);
+  for (const Node* iter = begin; iter != end; ++iter) {
+    real_t* p = v + (uint64)iter->feat_id * stride;
+    real_t* q = p + 2 * aligned_k;
+    real_t val = iter->feat_val * norm;
+    typename V::reg xv = V::set1(val);
+    typename V::reg pgv = V::set1(val * pg);
+    index_t d = 0;
+    for (; d < wide; d += V::kWidth) {
+      hofm_update<V, P>(p, q, s, d, aligned_k, xv, pgv, lr, lamb);
+    }
+    if (d < aligned_k) {
+      SSEReg::reg xv4 = SSEReg::set1(val);
+      SSEReg::reg pgv4 = SSEReg::set1(val * pg);
+      for (; d < aligned_k; d += kAlign) {
+        hofm_update<SSEReg, P>(p, q, s, d, aligned_k, xv4, pgv4,
+                               lr4, lamb4);
+      }
+    }
+  }
+}
+
+template <typename V, index_t K>
+void hofm_grad(const Node* begin, const Node* end,
+               real_t* v, index_t aligned_k, real_t norm,
+               real_t pg, real_t learning_rate,
+               real_t regu_lambda, real_t* s,
+               SqrtPrecision precision) {
+  switch (precision) {
+    case kSqrtNewton:
+      hofm_grad_impl<V, K, kSqrtNewton>(begin, end, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+      break;
+    case kSqrtExact:
+      hofm_grad_impl<V, K, kSqrtExact>(begin, end, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+      break;
+    default:
+      hofm_grad_impl<V, K, kSqrtFast>(begin, end, v, aligned_k,
+        norm, pg, learning_rate, regu_lambda, s);
+  }
+}
+
+// Loaders of the packed latent factor (the weights only), whose
+// load<V>(p) returns kWidth of V weights as floats
+struct LoadF32 {
+  typedef real_t type;
+  template <typename V>
+  static inline typename V::reg load(const real_t* p) { return V::load(p); }
+};
+
+struct LoadFP16 {
+  typedef uint16 type;
+  template <typename V>
+  static inline typename V::reg load(const uint16* p) {
+    return V::load_fp16(p);
+  }
+};
+
+struct LoadBF16 {
+  typedef uint16 type;
+  template <typename V>
+  static inline typename V::reg load(const uint16* p) {
+    return V::load_bf16(p);
+  }
+};
+
+// ffm_score() on the packed latent factor, in which each latent
+// vector has aligned_k contiguous weights and align1 is the stride
+// of a feature (num_field * aligned_k). The kCross is the same as
+// ffm_score_impl()
+template <typename V, index_t K, typename L, bool kCross>
+real_t ffm_score_packed(const Node* begin, const Node* end,
+                        const Node* cross_begin, const Node* cross_end,
+                        const typename L::type* v, index_t aligned_k,
+                        index_t align1, real_t norm) {
+  if (K > 0) { aligned_k = K; }
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  typename V::reg acc = V::zero();
+  SSEReg::reg tail = SSEReg::zero();
+  for (const Node* iter_i = begin; iter_i != end; ++iter_i) {
+    index_t j1 = iter_i->feat_id;
+    index_t f1 = iter_i->field_id;
+    real_t v1 = iter_i->feat_val;
+    const Node* end_j = kCross ? cross_end : end;
+    for (const Node* iter_j = kCross ? cross_begin : iter_i+1;
+         iter_j != end_j; ++iter_j) {
+      const typename L::type* w1 = v + (uint64)j1*align1 +
+                                   iter_j->field_id*aligned_k;
+      const typename L::type* w2 = v + (uint64)iter_j->feat_id*align1 +
+                                   f1*aligned_k;
+      real_t val = v1 * iter_j->feat_val * norm;
+      typename V::reg xv = V::set1(val);
+      index_t d = 0;
+      for (; d < wide; d += V::kWidth) {
+        acc = V::madd(V::mul(L::template load<V>(w1 + d),
+                             L::template load<V>(w2 + d)), xv, acc);
+      }
+      if (d < aligned_k) {
+        SSEReg::reg xv4 = SSEReg::set1(val);
+        for (; d < aligned_k; d += kAlign) {
+          tail = SSEReg::madd(
+            SSEReg::mul(L::template load<SSEReg>(w1 + d),
+                        L::template load<SSEReg>(w2 + d)), xv4, tail);
+        }
+      }
+    }
+  }
+  return V::reduce(acc) + SSEReg::reduce(tail);
+}
+
+template <typename V, index_t K>
+real_t ffm_score_half(const Node* begin, const Node* end,
+                      const uint16* v, index_t aligned_k,
+                      index_t align1, real_t norm, bool bf16) {
+  return bf16 ?
+    ffm_score_packed<V, K, LoadBF16, false>(begin, end, nullptr, nullptr,
+                                            v, aligned_k, align1, norm) :
+    ffm_score_packed<V, K, LoadFP16, false>(begin, end, nullptr, nullptr,
+                                            v, aligned_k, align1, norm);
+}
+
+template <typename V, index_t K>
+real_t ffm_score_w(const Node* begin, const Node* end,
+                   const real_t* v, index_t aligned_k,
+                   index_t align1, real_t norm) {
+  return ffm_score_packed<V, K, LoadF32, false>(begin, end, nullptr,
+                                                nullptr, v, aligned_k,
+                                                align1, norm);
+}
+
+template <typename V, index_t K>
+real_t ffm_cross_half(const Node* begin, const Node* end,
+                      const Node* cross_begin, const Node* cross_end,
+                      const uint16* v, index_t aligned_k,
+                      index_t align1, real_t norm, bool bf16) {
+  return bf16 ?
+    ffm_score_packed<V, K, LoadBF16, true>(begin, end, cross_begin,
+                                           cross_end, v, aligned_k,
+                                           align1, norm) :
+    ffm_score_packed<V, K, LoadFP16, true>(begin, end, cross_begin,
+                                           cross_end, v, aligned_k,
+                                           align1, norm);
+}
+
+template <typename V, index_t K>
+real_t ffm_cross_w(const Node* begin, const Node* end,
+                   const Node* cross_begin, const Node* cross_end,
+                   const real_t* v, index_t aligned_k,
+                   index_t align1, real_t norm) {
+  return ffm_score_packed<V, K, LoadF32, true>(begin, end, cross_begin,
+                                               cross_end, v, aligned_k,
+                                               align1, norm);
+}
+
+// fm_score() on the packed latent factor, in which each
+// feature has aligned_k contiguous weights
+template <typename V, index_t K, typename L>
+real_t fm_score_packed(const Node* begin, const Node* end,
+                       const typename L::type* v, index_t aligned_k,
+                       real_t norm, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  for (index_t d = 0; d < aligned_k; ++d) { s[d] = 0; }
+  for (const Node* iter = begin; iter != end; ++iter) {
+    const typename L::type* w = v + (uint64)iter->feat_id * aligned_k;
+    typename V::reg xv = V::set1(iter->feat_val * norm);
+    index_t d = 0;
+    for (; d < wide; d += V::kWidth) {
+      V::store(s + d, V::madd(L::template load<V>(w + d), xv,
+                              V::load(s + d)));
+    }
+    for (; d < aligned_k; d += kAlign) {
+      SSEReg::reg xv4 = SSEReg::set1(iter->feat_val * norm);
+      SSEReg::store(s + d, SSEReg::madd(L::template load<SSEReg>(w + d),
+                                        xv4, SSEReg::load(s + d)));
+    }
+  }
+  typename V::reg acc = V::zero();
+  SSEReg::reg tail = SSEReg::zero();
+  for (const Node* iter = begin; iter != end; ++iter) {
+    const typename L::type* w = v + (uint64)iter->feat_id * aligned_k;
+    typename V::reg xv = V::set1(iter->feat_val * norm);
+    index_t d = 0;
+    for (; d < wide; d += V::kWidth) {
+      typename V::reg wv = V::mul(L::template load<V>(w + d), xv);
+      acc = V::madd(wv, V::sub(V::load(s + d), wv), acc);
+    }
+    for (; d < aligned_k; d += kAlign) {
+      SSEReg::reg xv4 = SSEReg::set1(iter->feat_val * norm);
+      SSEReg::reg wv = SSEReg::mul(L::template load<SSEReg>(w + d), xv4);
+      tail = SSEReg::madd(wv, SSEReg::sub(SSEReg::load(s + d), wv), tail);
+    }
+  }
+  return 0.5 * (V::reduce(acc) + SSEReg::reduce(tail));
+}
+
+template <typename V, index_t K>
+real_t fm_score_half(const Node* begin, const Node* end,
+                     const uint16* v, index_t aligned_k,
+                     real_t norm, real_t* s, bool bf16) {
+  return bf16 ?
+    fm_score_packed<V, K, LoadBF16>(begin, end, v, aligned_k, norm, s) :
+    fm_score_packed<V, K, LoadFP16>(begin, end, v, aligned_k, norm, s);
+}
+
+template <typename V, index_t K>
+real_t fm_score_w(const Node* begin, const Node* end,
+                  const real_t* v, index_t aligned_k,
+                  real_t norm, real_t* s) {
+  return fm_score_packed<V, K, LoadF32>(begin, end, v, aligned_k, norm, s);
+}
+
+// ffm_score() on the int8 latent factor. The latent vector of
+// (feature, field) is at (feat_id * num_field + field_id) * aligned_k,
+// and its weights are scale[feat_id * num_field + field_id] * int8.
+// The dot product of each pair is computed in int32, and the
+// kCross is the same as ffm_score_impl()
+template <typename V, index_t K, bool kCross>
+real_t ffm_score_int8_impl(const Node* begin, const Node* end,
+                           const Node* cross_begin,
+                           const Node* cross_end,
+                           const int8* v, const real_t* scale,
+                           index_t aligned_k, index_t num_field,
+                           real_t norm) {
+  if (K > 0) { aligned_k = K; }
+  real_t sum = 0;
+  for (const Node* iter_i = begin; iter_i != end; ++iter_i) {
+    index_t j1 = iter_i->feat_id;
+    index_t f1 = iter_i->field_id;
+    real_t v1 = iter_i->feat_val;
+    const Node* end_j = kCross ? cross_end : end;
+    for (const Node* iter_j = kCross ? cross_begin : iter_i+1;
+         iter_j != end_j; ++iter_j) {
+      uint64 i1 = (uint64)j1 * num_field + iter_j->field_id;
+      uint64 i2 = (uint64)iter_j->feat_id * num_field + f1;
+      int32 dot = V::dot_i8(v + i1 * aligned_k,
+                            v + i2 * aligned_k, aligned_k);
+      sum += dot * scale[i1] * scale[i2] * v1 * iter_j->feat_val * norm;
+    }
+  }
+  return sum;
+}
+
+template <typename V, index_t K>
+real_t ffm_score_int8(const Node* begin, const Node* end,
+                      const int8* v, const real_t* scale,
+                      index_t aligned_k, index_t num_field,
+                      real_t norm) {
+  return ffm_score_int8_impl<V, K, false>(begin, end, nullptr, nullptr,
+                                          v, scale, aligned_k,
+                                          num_field, norm);
+}
+
+template <typename V, index_t K>
+real_t ffm_cross_int8(const Node* begin, const Node* end,
+                      const Node* cross_begin, const Node* cross_end,
+                      const int8* v, const real_t* scale,
+                      index_t aligned_k, index_t num_field,
+                      real_t norm) {
+  return ffm_score_int8_impl<V, K, true>(begin, end, cross_begin,
+                                         cross_end, v, scale, aligned_k,
+                                         num_field, norm);
+}
+
+// fm_score() on the int8 latent factor, in which the weights of
+// a feature are scale[feat_id] * int8, and they are converted to
+// float in registers
+template <typename V, index_t K>
+real_t fm_score_int8(const Node* begin, const Node* end,
+                     const int8* v, const real_t* scale,
+                     index_t aligned_k, real_t norm, real_t* s) {
+  if (K > 0) { aligned_k = K; }
+  const index_t wide = aligned_k / V::kWidth * V::kWidth;
+  for (index_t d = 0; d < aligned_k; ++d) { s[d] = 0; }
+  for (const Node* iter = begin; iter != end; ++iter) {
+    const int8* w = v + (uint64)iter->feat_id * aligned_k;
+    real_t val = iter->feat_val * norm * scale[iter->feat_id];
+    typename V::reg xv = V::set1(val);
+    index_t d = 0;
+    for (; d < wide; d += V::kWidth) {
+      V::store(s + d, V::madd(V::load_i8(w + d), xv, V::load(s + d)));
+    }
+    for (; d < aligned_k; d += kAlign) {
+      SSEReg::reg xv4 = SSEReg::set1(val);
+      SSEReg::store(s + d, SSEReg::madd(SSEReg::load_i8(w + d), xv4,
+                                        SSEReg::load(s + d)));
+    }
+  }
+  typename V::reg acc = V::zero();
+  SSEReg::reg tail = SSEReg::zero();
+  for (const Node* iter = begin; iter != end; ++iter) {
+    const int8* w = v + (uint64)iter->feat_id * aligned_k;
+    real_t val = iter->feat_val * norm * scale[iter->feat_id];
+    typename V::reg xv = V::set1(val);
+    index_t d = 0;
+    for (; d < wide; d += V::kWidth) {
+      typename V::reg wv = V::mul(V::load_i8(w + d), xv);
+      acc = V::madd(wv, V::sub(V::load(s + d), wv), acc);
+    }
+    for (; d < aligned_k; d += kAlign) {
+      SSEReg::reg xv4 = SSEReg::set1(val);
+      SSEReg::reg wv = SSEReg::mul(SSEReg::load_i8(w + d), xv4);
+      tail = SSEReg::madd(wv, SSEReg::sub(SSEReg::load(s + d), wv), tail);
+    }
+  }
+  return 0.5 * (V::reduce(acc) + SSEReg::reduce(tail));
+}
+
+// w^T x of the linear term, where w[stride * feat_id] is the weight
+// of feat_id. The weights of kWidth nodes are loaded by one gather,
+// which is gather2() for the stride 2 of AdaGrad (kStride2 is true),
+// and gather1() on the scaled ids for the others. The short rows and
+// the CPU without hardware gather use the scalar loop
+template <typename V, bool kStride2>
+real_t linear_score_impl(const Node* begin, const Node* end,
+                         const real_t* w, index_t stride) {
+  if (kStride2) { stride = 2; }
+  real_t sum = 0;
+  const Node* iter = begin;
+  const index_t num = end - begin;
+  if (V::kGather && num >= kMinGatherRow) {
+    const Node* wide = begin + num / V::kWidth * V::kWidth;
+    int32 idx[V::kWidth];
+    real_t val[V::kWidth];
+    typename V::reg acc = V::zero();
+    for (; iter != wide; iter += V::kWidth) {
+      for (index_t l = 0; l < V::kWidth; ++l) {
+        idx[l] = kStride2 ? iter[l].feat_id : iter[l].feat_id * stride;
+        val[l] = iter[l].feat_val;
+      }
+      typename V::reg wv = kStride2 ? V::gather2(w, idx) :
+                                      V::gather1(w, idx);
+      acc = V::madd(wv, V::load(val), acc);
+    }
+    sum = V::reduce(acc);
+  }
+  for (; iter != end; ++iter) {
+    sum += w[iter->feat_id * stride] * iter->feat_val;
+  }
+  return sum;
+}
+
+template <typename V>
+real_t linear_score(const Node* begin, const Node* end,
+                    const real_t* w) {
+  return linear_score_impl<V, true>(begin, end, w, 2);
+}
+
+template <typename V>
+real_t linear_score_stride(const Node* begin, const Node* end,
+                           const real_t* w, index_t stride) {
+  return linear_score_impl<V, false>(begin, end, w, stride);
+}
+
+// w^T x of the n dense values x, where w[stride * j] is the weight
+// of feature j. The values are loaded in order, and the weights are
+// loaded in order for stride 1, or by one gather of the fixed offsets
+template <typename V>
+real_t dense_linear_score(const real_t* x, index_t n,
+                          const real_t* w, index_t stride) {
+  real_t sum = 0;
+  index_t j = 0;
+  const index_t wide = n / V::kWidth * V::kWidth;
+  if (stride == 1 || V::kGather) {
+    int32 idx[V::kWidth];
+    typename V::reg acc = V::zero();
+    for (; j < wide; j += V::kWidth) {
+      typename V::reg wv;
+      if (stride == 1) {
+        wv = V::load(w + j);
+      } else {
+        for (index_t l = 0; l < V::kWidth; ++l) {
+          idx[l] = (j + l) * stride;
+        }
+        wv = V::gather1(w, idx);
+      }
+      acc = V::madd(wv, V::load(x + j), acc);
+    }
+    sum = V::reduce(acc);
+  }
+  for (; j < n; ++j) {
+    sum += w[j * stride] * x[j];
+  }
+  return sum;
+}
+
+// One adagrad step of the linear weight of the node
+template <SqrtPrecision P>
+inline void linear_step(const Node* node, real_t* w, real_t pg,
+                        real_t learning_rate, real_t regu_lambda) {
+  real_t& wl = w[node->feat_id * 2];
+  real_t& wg = w[node->feat_id * 2 + 1];
+  real_t g = pg * node->feat_val + regu_lambda * wl;
+  wg += g * g;
+  wl -= learning_rate * g * InvSqrt(wg, P);
+}
+
+// Update the linear term by adagrad, where w[2 * feat_id + 1] is
+// the gradient cache of feat_id. The kWidth nodes are updated
+// together, and the ones that have the same feature id twice
+// (e.g., the hashed features or the crosses) are updated by the
+// scalar loop, so no update is lost by the stale gather
+template <typename V, SqrtPrecision P>
+void linear_grad_impl(const Node* begin, const Node* end, real_t* w,
+                      real_t pg, real_t learning_rate,
+                      real_t regu_lambda) {
+  const Node* iter = begin;
+  const index_t num = end - begin;
+  if (V::kGather && num >= kMinGatherRow) {
+    const Node* wide = begin + num / V::kWidth * V::kWidth;
+    int32 idx[V::kWidth];
+    real_t val[V::kWidth];
+    typename V::reg pgv = V::set1(pg);
+    typename V::reg lr = V::set1(learning_rate);
+    typename V::reg lamb = V::set1(regu_lambda);
+    for (; iter != wide; iter += V::kWidth) {
+      for (index_t l = 0; l < V::kWidth; ++l) {
+        idx[l] = iter[l].feat_id;
+        val[l] = iter[l].feat_val;
+      }
+      if (!V::unique(idx)) {
+        for (index_t l = 0; l < V::kWidth; ++l) {
+          linear_step<P>(iter + l, w, pg, learning_rate, regu_lambda);
+        }
+        continue;
+      }
+      typename V::reg wl = V::gather2(w, idx);
+      typename V::reg wg = V::gather2(w + 1, idx);
+      typename V::reg g = V::madd(lamb, wl, V::mul(pgv, V::load(val)));
+      wg = V::madd(g, g, wg);
+      wl = V::nmadd(lr, V::mul(inv_sqrt<V, P>(wg), g), wl);
+      // No scatter in AVX2, so we store the lanes one by one
+      V::store(val, wl);
+      for (index_t l = 0; l < V::kWidth; ++l) {
+        w[idx[l] * 2] = val[l];
+      }
+      V::store(val, wg);
+      for (index_t l = 0; l < V::kWidth; ++l) {
+        w[idx[l] * 2 + 1] = val[l];
+      }
+    }
+  }
+  for (; iter != end; ++iter) {
+    linear_step<P>(iter, w, pg, learning_rate, regu_lambda);
+  }
+}
+
+template <typename V>
+void linear_grad(const Node* begin, const Node* end, real_t* w,
+                 real_t pg, real_t learning_rate,
+                 real_t regu_lambda, SqrtPrecision precision) {
+  switch (precision) {
+    case kSqrtNewton:
+      linear_grad_impl<V, kSqrtNewton>(begin, end, w, pg,
+        learning_rate, regu_lambda);
+      break;
+    case kSqrtExact:
+      linear_grad_impl<V, kSqrtExact>(begin, end, w, pg,
+        learning_rate, regu_lambda);
+      break;
+    default:
+      linear_grad_impl<V, kSqrtFast>(begin, end, w, pg,
+        learning_rate, regu_lambda);
+  }
+}
+
+// Build the kernel table of register type V, K == 0 for the
+// generic kernel, and the layout L of the FFM blocks
+template <typename V, index_t K, LatentLayout L>
+ScoreKernel make_kernel(const char* name) {
+  ScoreKernel kernel;
+  kernel.name = name;
+  kernel.aligned_k = K;
+  kernel.layout = L;
+  kernel.ffm_score = ffm_score<V, K, L>;
+  kernel.ffm_grad = ffm_grad<V, K, L>;
+  kernel.ffm_score_staged = ffm_score_staged<V, K, L>;
+  kernel.ffm_score_binary = ffm_score_binary<V, K, L>;
+  kernel.ffm_grad_binary = ffm_grad_binary<V, K, L>;
+  kernel.ffm_score_staged_binary = ffm_score_staged_binary<V, K, L>;
+  kernel.ffm_grad_staged = ffm_grad_staged<V, K, L>;
+  kernel.ffm_score_pairs = ffm_score_pairs<V, K, L>;
+  kernel.ffm_score_mixed = ffm_score_mixed<V>;
+  kernel.ffm_grad_mixed = ffm_grad_mixed<V>;
+  kernel.fm_score = fm_score<V, K>;
+  kernel.fm_grad = fm_grad<V, K>;
+  kernel.fm_score_binary = fm_score_binary<V, K>;
+  kernel.fm_grad_binary = fm_grad_binary<V, K>;
+  kernel.fm_score_dense = fm_score_dense<V, K>;
+  kernel.fm_grad_dense = fm_grad_dense<V, K>;
+  kernel.fm_grad_sum = fm_grad_sum<V, K>;
+  kernel.hofm_score = hofm_score<V, K>;
+  kernel.hofm_grad = hofm_grad<V, K>;
+  kernel.ffm_score_half = ffm_score_half<V, K>;
+  kernel.fm_score_half = fm_score_half<V, K>;
+  kernel.ffm_score_w = ffm_score_w<V, K>;
+  kernel.fm_score_w = fm_score_w<V, K>;
+  kernel.ffm_score_int8 = ffm_score_int8<V, K>;
+  kernel.ffm_cross = ffm_cross<V, K, L>;
+  kernel.ffm_cross_half = ffm_cross_half<V, K>;
+  kernel.ffm_cross_w = ffm_cross_w<V, K>;
+  kernel.ffm_cross_int8 = ffm_cross_int8<V, K>;
+  kernel.fm_score_int8 = fm_score_int8<V, K>;
+  kernel.linear_score = linear_score<V>;
+  kernel.linear_score_stride = linear_score_stride<V>;
+  kernel.dense_linear_score = dense_linear_score<V>;
+  kernel.linear_grad = linear_grad<V>;
+  return kernel;
+}
+
+// Return the kernel of register type V that is specialized on
+// aligned_k, or the generic kernel if aligned_k is not in
+// kSpecializedK (the list below has the same K), for the layout
+// of the FFM blocks. We use plain array rather than std::vector
+// here, so that no inline function of STL is compiled with the
+// wide instruction sets and shared with other files
+template <typename V>
+const ScoreKernel& get_kernel(const char* name, index_t aligned_k,
+                              LatentLayout layout) {
+  static const ScoreKernel list[] = {
+    make_kernel<V, 0, kLayoutInterleaved>(name),
+    make_kernel<V, 4, kLayoutInterleaved>(name),
+    make_kernel<V, 8, kLayoutInterleaved>(name),
+    make_kernel<V, 16, kLayoutInterleaved>(name),
+    make_kernel<V, 32, kLayoutInterleaved>(name),
+    make_kernel<V, 0, kLayoutSplit>(name),
+    make_kernel<V, 4, kLayoutSplit>(name),
+    make_kernel<V, 8, kLayoutSplit>(name),
+    make_kernel<V, 16, kLayoutSplit>(name),
+    make_kernel<V, 32, kLayoutSplit>(name),
+    make_kernel<V, 0, kLayoutSplitFP16>(name),
+    make_kernel<V, 4, kLayoutSplitFP16>(name),
+    make_kernel<V, 8, kLayoutSplitFP16>(name),
+    make_kernel<V, 16, kLayoutSplitFP16>(name),
+    make_kernel<V, 32, kLayoutSplitFP16>(name),
+    make_kernel<V, 0, kLayoutSplitBF16>(name),
+    make_kernel<V, 4, kLayoutSplitBF16>(name),
+    make_kernel<V, 8, kLayoutSplitBF16>(name),
+    make_kernel<V, 16, kLayoutSplitBF16>(name),
+    make_kernel<V, 32, kLayoutSplitBF16>(name),
+    make_kernel<V, 0, kLayoutSplitLog8>(name),
+    make_kernel<V, 4, kLayoutSplitLog8>(name),
+    make_kernel<V, 8, kLayoutSplitLog8>(name),
+    make_kernel<V, 16, kLayoutSplitLog8>(name),
+    make_kernel<V, 32, kLayoutSplitLog8>(name),
+    make_kernel<V, 0, kLayoutSplitShared>(name),
+    make_kernel<V, 4, kLayoutSplitShared>(name),
+    make_kernel<V, 8, kLayoutSplitShared>(name),
+    make_kernel<V, 16, kLayoutSplitShared>(name),
+    make_kernel<V, 32, kLayoutSplitShared>(name)
+  };
+  static const int size = sizeof(list) / sizeof(list[0]);
+  const ScoreKernel* generic = nullptr;
+  for (int i = 0; i < size; ++i) {
+    if (list[i].layout != layout) { continue; }
+    if (list[i].aligned_k == aligned_k) { return list[i]; }
+    if (list[i].aligned_k == 0) { generic = &list[i]; }
+  }
+  return *generic;
+}
+
+}  // namespace
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_SCORE_KERNEL_IMPL_H_
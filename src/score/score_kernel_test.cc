@@ -0,0 +1,926 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file tests the SIMD kernels of FM and FFM.
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/half.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_kernel.h"
+
+namespace xLearn {
+
+const index_t kNumFeat = 20;
+const index_t kNumField = 5;
+const index_t kNumNode = 12;
+
+real_t random_val() { return (real_t)rand() / RAND_MAX; }
+
+// The row contains the same feature twice
+std::vector<Node> random_row() {
+  std::vector<Node> row(kNumNode);
+  for (index_t i = 0; i < kNumNode; ++i) {
+    row[i].feat_id = rand() % kNumFeat;
+    row[i].field_id = rand() % kNumField;
+    row[i].feat_val = random_val();
+  }
+  row[1] = row[0];
+  return row;
+}
+
+// The gradient caches are positive
+std::vector<real_t> random_param(index_t size) {
+  std::vector<real_t> param(size);
+  for (index_t i = 0; i < size; ++i) {
+    param[i] = random_val() + 0.5;
+  }
+  return param;
+}
+
+void ExpectNear(const std::vector<real_t>& a,
+                const std::vector<real_t>& b,
+                real_t eps = 1e-3) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_NEAR(a[i], b[i], eps * std::max(1.0f, fabsf(a[i])));
+  }
+}
+
+// Naive FFM score on the interleaved layout
+real_t naive_ffm_score(const std::vector<Node>& row,
+                       const real_t* v, index_t aligned_k,
+                       real_t norm) {
+  index_t align0 = 2 * aligned_k;
+  index_t align1 = kNumField * align0;
+  real_t sum = 0;
+  for (size_t i = 0; i < row.size(); ++i) {
+    for (size_t j = i + 1; j < row.size(); ++j) {
+      const real_t* w1 = v + row[i].feat_id*align1 + row[j].field_id*align0;
+      const real_t* w2 = v + row[j].feat_id*align1 + row[i].field_id*align0;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        index_t pos = d / kAlign * 2 * kAlign + d % kAlign;
+        sum += w1[pos] * w2[pos] * row[i].feat_val *
+               row[j].feat_val * norm;
+      }
+    }
+  }
+  return sum;
+}
+
+// Naive FM score
+real_t naive_fm_score(const std::vector<Node>& row,
+                      const real_t* v, index_t aligned_k,
+                      real_t norm) {
+  real_t sum = 0;
+  for (size_t i = 0; i < row.size(); ++i) {
+    for (size_t j = i + 1; j < row.size(); ++j) {
+      const real_t* w1 = v + row[i].feat_id * 2 * aligned_k;
+      const real_t* w2 = v + row[j].feat_id * 2 * aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        sum += w1[d] * w2[d] * row[i].feat_val *
+               row[j].feat_val * norm * norm;
+      }
+    }
+  }
+  return sum;
+}
+
+// The generic kernels and the specialized kernels of aligned_k
+std::vector<const ScoreKernel*> KernelList(index_t aligned_k) {
+  std::vector<const ScoreKernel*> list = SupportedScoreKernels();
+  if (IsSpecializedK(aligned_k)) {
+    std::vector<const ScoreKernel*> spec = SupportedScoreKernels(aligned_k);
+    for (size_t i = 0; i < spec.size(); ++i) {
+      EXPECT_EQ(spec[i]->aligned_k, aligned_k);
+      list.push_back(spec[i]);
+    }
+  }
+  return list;
+}
+
+TEST(SCORE_KERNEL_TEST, Select) {
+  std::vector<const ScoreKernel*> list = SupportedScoreKernels();
+  ASSERT_GE(list.size(), 1);
+  EXPECT_EQ(list[0], &SSEScoreKernel());
+  bool found = false;
+  for (size_t i = 0; i < list.size(); ++i) {
+    if (list[i] == &GetScoreKernel()) { found = true; }
+  }
+  EXPECT_TRUE(found);
+  // Specialized kernels
+  for (int i = 0; i < kNumSpecializedK; ++i) {
+    EXPECT_TRUE(IsSpecializedK(kSpecializedK[i]));
+    EXPECT_EQ(GetScoreKernel(kSpecializedK[i]).aligned_k, kSpecializedK[i]);
+  }
+  EXPECT_FALSE(IsSpecializedK(12));
+  EXPECT_EQ(GetScoreKernel(12).aligned_k, 0);
+  EXPECT_EQ(GetScoreKernel().aligned_k, 0);
+}
+
+TEST(SCORE_KERNEL_TEST, FFM) {
+  srand(0);
+  // Test the aligned K with and without the tail of wide loop
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list = KernelList(aligned_k);
+    index_t align0 = 2 * aligned_k;
+    index_t align1 = kNumField * align0;
+    std::vector<real_t> param = random_param(kNumFeat * align1);
+    std::vector<Node> row = random_row();
+    real_t norm = 0.5;
+    real_t expect = naive_ffm_score(row, param.data(), aligned_k, norm);
+    std::vector<real_t> expect_param;
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->ffm_score(row.data(), row.data() + row.size(),
+                                      param.data(), align0, align1, norm, 0);
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      std::vector<real_t> new_param = param;
+      list[k]->ffm_grad(row.data(), row.data() + row.size(),
+                        new_param.data(), align0, align1,
+                        norm, 0.3, 0.1, 0.01, 0, kSqrtFast);
+      if (k == 0) {
+        expect_param = new_param;
+      } else {
+        ExpectNear(new_param, expect_param);
+      }
+      // Prefetch does not change the result
+      for (index_t dist = 1; dist <= row.size() + 1; dist += 3) {
+        EXPECT_EQ(val, list[k]->ffm_score(row.data(),
+                                          row.data() + row.size(),
+                                          param.data(), align0, align1,
+                                          norm, dist));
+        std::vector<real_t> prefetch_param = param;
+        list[k]->ffm_grad(row.data(), row.data() + row.size(),
+                          prefetch_param.data(), align0, align1,
+                          norm, 0.3, 0.1, 0.01, dist, kSqrtFast);
+        EXPECT_EQ(prefetch_param, new_param);
+      }
+    }
+  }
+}
+
+// The pairs resolved by the caller give the score of ffm_score()
+TEST(SCORE_KERNEL_TEST, Pairs) {
+  srand(7);
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list = KernelList(aligned_k);
+    index_t align0 = 2 * aligned_k;
+    index_t align1 = kNumField * align0;
+    std::vector<real_t> param = random_param(kNumFeat * align1);
+    std::vector<Node> row = random_row();
+    real_t norm = 0.5;
+    std::vector<FFMPair> pairs;
+    for (size_t i = 0; i < row.size(); ++i) {
+      for (size_t j = i + 1; j < row.size(); ++j) {
+        FFMPair pair;
+        pair.w1 = param.data() + row[i].feat_id * align1 +
+                  row[j].field_id * align0;
+        pair.w2 = param.data() + row[j].feat_id * align1 +
+                  row[i].field_id * align0;
+        pair.val = row[i].feat_val * row[j].feat_val * norm;
+        pairs.push_back(pair);
+      }
+    }
+    real_t expect = naive_ffm_score(row, param.data(), aligned_k, norm);
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->ffm_score_pairs(pairs.data(), pairs.size(),
+                                            align0);
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      EXPECT_EQ(list[k]->ffm_score_pairs(pairs.data(), 0, align0), 0);
+      // The pairs are staged in the order of the row
+      std::vector<FFMPair> staged(pairs.size());
+      val = list[k]->ffm_score_staged(row.data(), row.data() + row.size(),
+                                      param.data(), align0, align1,
+                                      norm, 0, staged.data());
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      for (size_t p = 0; p < pairs.size(); ++p) {
+        EXPECT_EQ(staged[p].w1, pairs[p].w1);
+        EXPECT_EQ(staged[p].w2, pairs[p].w2);
+        EXPECT_FLOAT_EQ(staged[p].val, pairs[p].val);
+      }
+    }
+  }
+}
+
+// The pairs of mixed K give the score of their first k weights,
+// and the update of each pair by ffm_grad_staged() of its k
+TEST(SCORE_KERNEL_TEST, Mixed) {
+  srand(11);
+  const index_t field_k[kNumField] = {4, 8, 12, 4, 36};
+  std::vector<index_t> offset(kNumField + 1, 0);
+  for (index_t f = 0; f < kNumField; ++f) {
+    offset[f + 1] = offset[f] + 2 * field_k[f];
+  }
+  index_t align1 = offset[kNumField];
+  std::vector<real_t> param = random_param(kNumFeat * align1);
+  std::vector<Node> row = random_row();
+  real_t norm = 0.5;
+  std::vector<FFMPair> pairs;
+  real_t expect = 0;
+  for (size_t i = 0; i < row.size(); ++i) {
+    for (size_t j = i + 1; j < row.size(); ++j) {
+      FFMPair pair;
+      pair.w1 = param.data() + row[i].feat_id * align1 +
+                offset[row[j].field_id];
+      pair.w2 = param.data() + row[j].feat_id * align1 +
+                offset[row[i].field_id];
+      pair.val = row[i].feat_val * row[j].feat_val * norm;
+      pair.k = std::min(field_k[row[i].field_id],
+                        field_k[row[j].field_id]);
+      pairs.push_back(pair);
+      for (index_t d = 0; d < pair.k; ++d) {
+        index_t pos = d / kAlign * 2 * kAlign + d % kAlign;
+        expect += pair.w1[pos] * pair.w2[pos] * pair.val;
+      }
+    }
+  }
+  std::vector<const ScoreKernel*> list = SupportedScoreKernels();
+  for (size_t k = 0; k < list.size(); ++k) {
+    real_t val = list[k]->ffm_score_mixed(pairs.data(), pairs.size());
+    EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+    EXPECT_EQ(list[k]->ffm_score_mixed(pairs.data(), 0), 0);
+    // The pairs of the copies of param
+    std::vector<real_t> mixed = param, staged = param;
+    std::vector<FFMPair> pairs_m = pairs, pairs_s = pairs;
+    for (size_t p = 0; p < pairs.size(); ++p) {
+      pairs_m[p].w1 = mixed.data() + (pairs[p].w1 - param.data());
+      pairs_m[p].w2 = mixed.data() + (pairs[p].w2 - param.data());
+      pairs_s[p].w1 = staged.data() + (pairs[p].w1 - param.data());
+      pairs_s[p].w2 = staged.data() + (pairs[p].w2 - param.data());
+    }
+    list[k]->ffm_grad_mixed(pairs_m.data(), pairs_m.size(), 0.3, 0.1,
+                            0.01, kSqrtExact);
+    for (size_t p = 0; p < pairs_s.size(); ++p) {
+      list[k]->ffm_grad_staged(&pairs_s[p], 1, 2 * pairs_s[p].k, 0.3,
+                               0.1, 0.01, kSqrtExact);
+    }
+    ExpectNear(mixed, staged, 1e-5);
+  }
+}
+
+// Move the weights and the caches of each block of param
+// from the interleaved layout to the layout
+std::vector<real_t> to_layout(const std::vector<real_t>& param,
+                              index_t aligned_k, LatentLayout layout) {
+  std::vector<real_t> out(param.size());
+  for (size_t b = 0; b < param.size(); b += 2 * aligned_k) {
+    for (index_t d = 0; d < aligned_k; ++d) {
+      out[b + LatentWeightPos(layout, d, aligned_k)] =
+        param[b + LatentWeightPos(kLayoutInterleaved, d, aligned_k)];
+      out[b + LatentCachePos(layout, d, aligned_k)] =
+        param[b + LatentCachePos(kLayoutInterleaved, d, aligned_k)];
+    }
+  }
+  return out;
+}
+
+// The kernels of the split layout give the score and the
+// update of the interleaved kernels on the moved blocks
+TEST(SCORE_KERNEL_TEST, SplitLayout) {
+  srand(11);
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list =
+      SupportedScoreKernels(0, kLayoutSplit);
+    if (IsSpecializedK(aligned_k)) {
+      std::vector<const ScoreKernel*> spec =
+        SupportedScoreKernels(aligned_k, kLayoutSplit);
+      list.insert(list.end(), spec.begin(), spec.end());
+    }
+    index_t align0 = 2 * aligned_k;
+    index_t align1 = kNumField * align0;
+    std::vector<real_t> param = random_param(kNumFeat * align1);
+    std::vector<real_t> split = to_layout(param, aligned_k, kLayoutSplit);
+    std::vector<Node> row = random_row();
+    real_t norm = 0.5;
+    real_t expect = naive_ffm_score(row, param.data(), aligned_k, norm);
+    std::vector<real_t> expect_param = param;
+    SSEScoreKernel().ffm_grad(row.data(), row.data() + row.size(),
+                              expect_param.data(), align0, align1,
+                              norm, 0.3, 0.1, 0.01, 0, kSqrtFast);
+    expect_param = to_layout(expect_param, aligned_k, kLayoutSplit);
+    for (size_t k = 0; k < list.size(); ++k) {
+      EXPECT_EQ(list[k]->layout, kLayoutSplit);
+      real_t val = list[k]->ffm_score(row.data(), row.data() + row.size(),
+                                      split.data(), align0, align1,
+                                      norm, 0);
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      std::vector<real_t> new_param = split;
+      list[k]->ffm_grad(row.data(), row.data() + row.size(),
+                        new_param.data(), align0, align1,
+                        norm, 0.3, 0.1, 0.01, 0, kSqrtFast);
+      ExpectNear(new_param, expect_param);
+      // The staged pairs are updated in the same way
+      std::vector<FFMPair> staged(row.size() * (row.size() - 1) / 2);
+      std::vector<real_t> staged_param = split;
+      val = list[k]->ffm_score_staged(row.data(), row.data() + row.size(),
+                                      staged_param.data(), align0, align1,
+                                      norm, 0, staged.data());
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      list[k]->ffm_grad_staged(staged.data(), staged.size(), align0,
+                               0.3, 0.1, 0.01, kSqrtFast);
+      ExpectNear(staged_param, expect_param);
+    }
+  }
+}
+
+// The interleaved blocks in the layout of the reduced caches,
+// and the reverse with the decoded caches
+std::vector<real_t> to_coded(const std::vector<real_t>& param,
+                             index_t aligned_k, LatentLayout layout) {
+  index_t align0 = LatentBlockSize(layout, aligned_k);
+  uint64 num_block = param.size() / (2 * aligned_k);
+  std::vector<real_t> out(num_block * align0);
+  for (uint64 b = 0; b < num_block; ++b) {
+    const real_t* src = param.data() + b * 2 * aligned_k;
+    real_t* dst = out.data() + b * align0;
+    for (index_t d = 0; d < aligned_k; ++d) {
+      dst[d] = src[LatentWeightPos(kLayoutInterleaved, d, aligned_k)];
+      SetLatentCache(layout, dst, d, aligned_k,
+        src[LatentCachePos(kLayoutInterleaved, d, aligned_k)]);
+    }
+  }
+  return out;
+}
+
+std::vector<real_t> from_coded(const std::vector<real_t>& coded,
+                               index_t aligned_k, LatentLayout layout) {
+  index_t align0 = LatentBlockSize(layout, aligned_k);
+  uint64 num_block = coded.size() / align0;
+  std::vector<real_t> out(num_block * 2 * aligned_k);
+  for (uint64 b = 0; b < num_block; ++b) {
+    const real_t* src = coded.data() + b * align0;
+    real_t* dst = out.data() + b * 2 * aligned_k;
+    for (index_t d = 0; d < aligned_k; ++d) {
+      dst[LatentWeightPos(kLayoutInterleaved, d, aligned_k)] = src[d];
+      dst[LatentCachePos(kLayoutInterleaved, d, aligned_k)] =
+        GetLatentCache(layout, src, d, aligned_k);
+    }
+  }
+  return out;
+}
+
+// The kernels of the reduced caches give the score and the update
+// of the fp32 kernels, and the caches are within a step of the code
+TEST(SCORE_KERNEL_TEST, ReducedCaches) {
+  srand(13);
+  const LatentLayout layouts[] = { kLayoutSplitFP16, kLayoutSplitBF16,
+                                   kLayoutSplitLog8 };
+  const real_t cache_eps[] = { 1.1e-3, 8e-3, 0.065 };
+  for (int l = 0; l < 3; ++l) {
+    LatentLayout layout = layouts[l];
+    for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+      std::vector<const ScoreKernel*> list =
+        SupportedScoreKernels(0, layout);
+      if (IsSpecializedK(aligned_k)) {
+        std::vector<const ScoreKernel*> spec =
+          SupportedScoreKernels(aligned_k, layout);
+        list.insert(list.end(), spec.begin(), spec.end());
+      }
+      index_t align0 = LatentBlockSize(layout, aligned_k);
+      index_t align1 = kNumField * align0;
+      // The caches of the reference are the decoded ones
+      std::vector<real_t> param = random_param(kNumFeat * kNumField *
+                                               2 * aligned_k);
+      for (size_t i = 0; i < param.size(); ++i) { param[i] += 0.5; }
+      std::vector<real_t> coded = to_coded(param, aligned_k, layout);
+      param = from_coded(coded, aligned_k, layout);
+      // Each block is updated once in a row of distinct fields,
+      // so the caches are within one step of the code
+      std::vector<Node> row = random_row();
+      row.resize(kNumField);
+      for (index_t i = 0; i < kNumField; ++i) {
+        row[i].feat_id = i * 3 + l;
+        row[i].field_id = (i + aligned_k) % kNumField;
+      }
+      real_t norm = 0.5;
+      real_t expect = naive_ffm_score(row, param.data(), aligned_k, norm);
+      std::vector<real_t> expect_param = param;
+      SSEScoreKernel().ffm_grad(row.data(), row.data() + row.size(),
+                                expect_param.data(), 2 * aligned_k,
+                                kNumField * 2 * aligned_k,
+                                norm, 0.3, 0.1, 0.01, 0, kSqrtExact);
+      for (size_t k = 0; k < list.size(); ++k) {
+        EXPECT_EQ(list[k]->layout, layout);
+        real_t val = list[k]->ffm_score(row.data(), row.data() + row.size(),
+                                        coded.data(), align0, align1,
+                                        norm, 0);
+        EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+        std::vector<real_t> new_coded = coded;
+        list[k]->ffm_grad(row.data(), row.data() + row.size(),
+                          new_coded.data(), align0, align1,
+                          norm, 0.3, 0.1, 0.01, 0, kSqrtExact);
+        std::vector<real_t> new_param =
+          from_coded(new_coded, aligned_k, layout);
+        for (size_t i = 0; i < new_param.size(); ++i) {
+          bool cache = i / kAlign % 2 == 1;
+          EXPECT_NEAR(new_param[i], expect_param[i],
+                      (cache ? cache_eps[l] : 1e-3) *
+                      fabs(expect_param[i])) << list[k]->name;
+        }
+        // The staged pairs are updated in the same way
+        std::vector<FFMPair> staged(row.size() * (row.size() - 1) / 2);
+        new_coded = coded;
+        list[k]->ffm_score_staged(row.data(), row.data() + row.size(),
+                                  new_coded.data(), align0, align1,
+                                  norm, 0, staged.data());
+        list[k]->ffm_grad_staged(staged.data(), staged.size(), align0,
+                                 0.3, 0.1, 0.01, kSqrtExact);
+        ExpectNear(from_coded(new_coded, aligned_k, layout), new_param,
+                   1e-6);
+      }
+    }
+  }
+}
+
+// The squared gradients that are smaller than a step of the code
+// are added by the stochastic rounding rather than lost
+TEST(SCORE_KERNEL_TEST, ReducedCachesRounding) {
+  srand(17);
+  const index_t aligned_k = 16;
+  std::vector<Node> row(2);
+  row[0].feat_id = 0;
+  row[0].field_id = 1;
+  row[0].feat_val = 1.0;
+  row[1].feat_id = 1;
+  row[1].field_id = 0;
+  row[1].feat_val = 1.0;
+  const LatentLayout layouts[] = { kLayoutSplitBF16, kLayoutSplitLog8 };
+  for (int l = 0; l < 2; ++l) {
+    LatentLayout layout = layouts[l];
+    std::vector<real_t> param(2 * kNumField * 2 * aligned_k);
+    for (size_t i = 0; i < param.size(); ++i) {
+      param[i] = i / kAlign % 2 == 1 ? 1.0 : random_val() * 0.4 - 0.2;
+    }
+    std::vector<real_t> coded = to_coded(param, aligned_k, layout);
+    index_t align0 = LatentBlockSize(layout, aligned_k);
+    const ScoreKernel& kernel = GetScoreKernel(0, layout);
+    // The squared gradient of a step is about 1/1000 of the cache
+    for (int t = 0; t < 2000; ++t) {
+      real_t pg = random_val() * 0.4 - 0.2;
+      SSEScoreKernel().ffm_grad(row.data(), row.data() + 2, param.data(),
+                                2 * aligned_k, kNumField * 2 * aligned_k,
+                                1.0, pg, 0.01, 0, 0, kSqrtExact);
+      kernel.ffm_grad(row.data(), row.data() + 2, coded.data(), align0,
+                      kNumField * align0, 1.0, pg, 0.01, 0, 0,
+                      kSqrtExact);
+    }
+    std::vector<real_t> result = from_coded(coded, aligned_k, layout);
+    double expect_sum = 0;
+    double sum = 0;
+    for (size_t i = 0; i < param.size(); ++i) {
+      if (i / kAlign % 2 == 0) { continue; }
+      expect_sum += param[i] - 1.0;
+      sum += result[i] - 1.0;
+    }
+    // The rounding to the nearest code would keep the caches at 1,
+    // and the random rounding only gives the growth on average
+    EXPECT_GT(expect_sum, 0);
+    EXPECT_NEAR(sum, expect_sum, 0.25 * expect_sum) << kernel.name;
+  }
+}
+
+// Naive update of the shared layout, where the cache of a block
+// adds the mean squared gradient of its aligned_k weights
+void naive_shared_grad(const std::vector<Node>& row, real_t* v,
+                       index_t aligned_k, real_t norm, real_t pg,
+                       real_t lr, real_t lamb) {
+  index_t align0 = aligned_k + kAlign;
+  index_t align1 = kNumField * align0;
+  std::vector<real_t> g1(aligned_k), g2(aligned_k);
+  for (size_t i = 0; i < row.size(); ++i) {
+    for (size_t j = i + 1; j < row.size(); ++j) {
+      real_t* w1 = v + row[i].feat_id * align1 + row[j].field_id * align0;
+      real_t* w2 = v + row[j].feat_id * align1 + row[i].field_id * align0;
+      real_t pgv = row[i].feat_val * row[j].feat_val * norm * pg;
+      real_t s1 = 0, s2 = 0;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        g1[d] = lamb * w1[d] + pgv * w2[d];
+        g2[d] = lamb * w2[d] + pgv * w1[d];
+        s1 += g1[d] * g1[d];
+        s2 += g2[d] * g2[d];
+      }
+      real_t c1 = w1[aligned_k] + s1 / aligned_k;
+      real_t c2 = w2[aligned_k] + s2 / aligned_k;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        real_t a = w1[d] - lr * g1[d] / sqrt(c1);
+        real_t b = w2[d] - lr * g2[d] / sqrt(c2);
+        w1[d] = a;
+        w2[d] = b;
+      }
+      w1[aligned_k] = c1;
+      w2[aligned_k] = c2;
+    }
+  }
+}
+
+// The kernels of the shared layout give the score of the weights,
+// and the update of one cache per block
+TEST(SCORE_KERNEL_TEST, SharedCache) {
+  srand(19);
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list =
+      SupportedScoreKernels(0, kLayoutSplitShared);
+    if (IsSpecializedK(aligned_k)) {
+      std::vector<const ScoreKernel*> spec =
+        SupportedScoreKernels(aligned_k, kLayoutSplitShared);
+      list.insert(list.end(), spec.begin(), spec.end());
+    }
+    index_t align0 = LatentBlockSize(kLayoutSplitShared, aligned_k);
+    EXPECT_EQ(align0, aligned_k + kAlign);
+    index_t align1 = kNumField * align0;
+    std::vector<real_t> param = random_param(kNumFeat * kNumField *
+                                             2 * aligned_k);
+    std::vector<real_t> shared(kNumFeat * align1);
+    for (index_t b = 0; b < kNumFeat * kNumField; ++b) {
+      for (index_t d = 0; d < aligned_k; ++d) {
+        shared[b * align0 + d] = param[b * 2 * aligned_k +
+          LatentWeightPos(kLayoutInterleaved, d, aligned_k)];
+      }
+      shared[b * align0 + aligned_k] = 1.0 + random_val();
+    }
+    std::vector<Node> row = random_row();
+    real_t norm = 0.5;
+    real_t expect = naive_ffm_score(row, param.data(), aligned_k, norm);
+    std::vector<real_t> expect_param = shared;
+    naive_shared_grad(row, expect_param.data(), aligned_k, norm,
+                      0.3, 0.1, 0.01);
+    for (size_t k = 0; k < list.size(); ++k) {
+      EXPECT_EQ(list[k]->layout, kLayoutSplitShared);
+      real_t val = list[k]->ffm_score(row.data(), row.data() + row.size(),
+                                      shared.data(), align0, align1,
+                                      norm, 0);
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      std::vector<real_t> new_param = shared;
+      list[k]->ffm_grad(row.data(), row.data() + row.size(),
+                        new_param.data(), align0, align1,
+                        norm, 0.3, 0.1, 0.01, 0, kSqrtFast);
+      ExpectNear(new_param, expect_param);
+      // The staged pairs are updated in the same way
+      std::vector<FFMPair> staged(row.size() * (row.size() - 1) / 2);
+      std::vector<real_t> staged_param = shared;
+      val = list[k]->ffm_score_staged(row.data(), row.data() + row.size(),
+                                      staged_param.data(), align0, align1,
+                                      norm, 0, staged.data());
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      list[k]->ffm_grad_staged(staged.data(), staged.size(), align0,
+                               0.3, 0.1, 0.01, kSqrtFast);
+      ExpectNear(staged_param, expect_param);
+    }
+  }
+}
+
+TEST(SCORE_KERNEL_TEST, FM) {
+  srand(1);
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list = KernelList(aligned_k);
+    std::vector<real_t> param = random_param(kNumFeat * 2 * aligned_k);
+    std::vector<Node> row = random_row();
+    std::vector<real_t> s(aligned_k);
+    real_t norm = 0.5;
+    real_t expect = naive_fm_score(row, param.data(), aligned_k, norm);
+    std::vector<real_t> expect_param;
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->fm_score(row.data(), row.data() + row.size(),
+                                     param.data(), aligned_k, norm,
+                                     s.data());
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      std::vector<real_t> new_param = param;
+      list[k]->fm_grad(row.data(), row.data() + row.size(),
+                       new_param.data(), aligned_k, norm,
+                       0.3, 0.1, 0.01, s.data(), kSqrtFast);
+      if (k == 0) {
+        expect_param = new_param;
+      } else {
+        ExpectNear(new_param, expect_param);
+      }
+    }
+  }
+}
+
+// The linear kernel assumes unique features in one row
+std::vector<Node> random_linear_row(index_t num_node, index_t num_feat) {
+  std::vector<index_t> ids(num_feat);
+  for (index_t i = 0; i < num_feat; ++i) { ids[i] = i; }
+  std::random_shuffle(ids.begin(), ids.end());
+  std::vector<Node> row(num_node);
+  for (index_t i = 0; i < num_node; ++i) {
+    row[i].feat_id = ids[i];
+    row[i].field_id = 0;
+    row[i].feat_val = random_val();
+  }
+  return row;
+}
+
+TEST(SCORE_KERNEL_TEST, Linear) {
+  srand(2);
+  const index_t num_feat = 200;
+  std::vector<const ScoreKernel*> list = KernelList(0);
+  // Short rows use the scalar loop, and the long rows use
+  // gather with and without the tail
+  for (index_t num_node = 1; num_node <= 100; num_node += 7) {
+    std::vector<real_t> param = random_param(num_feat * 2);
+    std::vector<Node> row = random_linear_row(num_node, num_feat);
+    real_t expect = 0;
+    for (size_t i = 0; i < row.size(); ++i) {
+      expect += param[row[i].feat_id * 2] * row[i].feat_val;
+    }
+    std::vector<real_t> expect_param = param;
+    for (size_t i = 0; i < row.size(); ++i) {
+      real_t& wl = expect_param[row[i].feat_id * 2];
+      real_t& wg = expect_param[row[i].feat_id * 2 + 1];
+      real_t g = 0.3 * row[i].feat_val + 0.01 * wl;
+      wg += g * g;
+      wl -= 0.1 * g / sqrt(wg);
+    }
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->linear_score(row.data(),
+                                         row.data() + row.size(),
+                                         param.data());
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      std::vector<real_t> new_param = param;
+      list[k]->linear_grad(row.data(), row.data() + row.size(),
+                           new_param.data(), 0.3, 0.1, 0.01, kSqrtFast);
+      ExpectNear(new_param, expect_param);
+      // The refined 1 / sqrt() is near the exact one
+      new_param = param;
+      list[k]->linear_grad(row.data(), row.data() + row.size(),
+                           new_param.data(), 0.3, 0.1, 0.01, kSqrtNewton);
+      ExpectNear(new_param, expect_param, 1e-5);
+      new_param = param;
+      list[k]->linear_grad(row.data(), row.data() + row.size(),
+                           new_param.data(), 0.3, 0.1, 0.01, kSqrtExact);
+      ExpectNear(new_param, expect_param, 1e-6);
+    }
+  }
+}
+
+// The rows of the same feature id twice in the lanes of one
+// gather, e.g., the hashed features, lose no update
+TEST(SCORE_KERNEL_TEST, LinearDuplicate) {
+  srand(5);
+  const index_t num_feat = 200;
+  std::vector<const ScoreKernel*> list = KernelList(0);
+  for (int round = 0; round < 4; ++round) {
+    std::vector<Node> row = random_linear_row(40, num_feat);
+    if (round == 0) {
+      row[1].feat_id = row[0].feat_id;
+    } else if (round == 1) {
+      row[7].feat_id = row[3].feat_id;
+      row[20].feat_id = row[31].feat_id;
+    } else if (round == 2) {
+      row[15].feat_id = row[0].feat_id;
+    } else {
+      for (size_t i = 0; i < row.size(); ++i) { row[i].feat_id = 0; }
+    }
+    std::vector<real_t> param = random_param(num_feat * 2);
+    std::vector<real_t> expect_param = param;
+    for (size_t i = 0; i < row.size(); ++i) {
+      real_t& wl = expect_param[row[i].feat_id * 2];
+      real_t& wg = expect_param[row[i].feat_id * 2 + 1];
+      real_t g = 0.3 * row[i].feat_val + 0.01 * wl;
+      wg += g * g;
+      wl -= 0.1 * g / sqrt(wg);
+    }
+    for (size_t k = 0; k < list.size(); ++k) {
+      std::vector<real_t> new_param = param;
+      list[k]->linear_grad(row.data(), row.data() + row.size(),
+                           new_param.data(), 0.3, 0.1, 0.01, kSqrtExact);
+      ExpectNear(new_param, expect_param, 1e-6);
+    }
+  }
+}
+
+// The weights of model (num_vec latent vectors) in 16 bits. The
+// weights of param are rounded to bfloat16, which are also exact
+// in fp16, so the 16-bit kernels have the same result as fp32
+std::vector<uint16> half_param(std::vector<real_t>* param,
+                               index_t num_vec, index_t aligned_k,
+                               bool is_ffm, bool bf16) {
+  std::vector<uint16> half(num_vec * aligned_k);
+  for (index_t i = 0; i < num_vec; ++i) {
+    for (index_t d = 0; d < aligned_k; ++d) {
+      index_t pos = is_ffm ? d / kAlign * 2 * kAlign + d % kAlign : d;
+      real_t& w = (*param)[i * 2 * aligned_k + pos];
+      w = BFloat16ToFloat(FloatToBFloat16(w));
+      half[i * aligned_k + d] = bf16 ? FloatToBFloat16(w) : FloatToHalf(w);
+    }
+  }
+  return half;
+}
+
+TEST(SCORE_KERNEL_TEST, Half) {
+  srand(3);
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list = KernelList(aligned_k);
+    std::vector<Node> row = random_row();
+    std::vector<real_t> s(aligned_k);
+    real_t norm = 0.5;
+    for (int bf16 = 0; bf16 < 2; ++bf16) {
+      // FFM
+      std::vector<real_t> param = random_param(kNumFeat * kNumField *
+                                               2 * aligned_k);
+      std::vector<uint16> half = half_param(&param, kNumFeat * kNumField,
+                                            aligned_k, true, bf16);
+      real_t expect = naive_ffm_score(row, param.data(), aligned_k, norm);
+      for (size_t k = 0; k < list.size(); ++k) {
+        real_t val = list[k]->ffm_score_half(row.data(),
+                                             row.data() + row.size(),
+                                             half.data(), aligned_k,
+                                             kNumField * aligned_k,
+                                             norm, bf16);
+        EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      }
+      // FM
+      param = random_param(kNumFeat * 2 * aligned_k);
+      half = half_param(&param, kNumFeat, aligned_k, false, bf16);
+      expect = naive_fm_score(row, param.data(), aligned_k, norm);
+      for (size_t k = 0; k < list.size(); ++k) {
+        real_t val = list[k]->fm_score_half(row.data(),
+                                            row.data() + row.size(),
+                                            half.data(), aligned_k,
+                                            norm, s.data(), bf16);
+        EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      }
+    }
+  }
+}
+
+// The cross pairs are the pairs of the concatenated
+// row that are not inside one of the two parts
+TEST(SCORE_KERNEL_TEST, Cross) {
+  srand(5);
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list = KernelList(aligned_k);
+    index_t align0 = 2 * aligned_k;
+    index_t align1 = kNumField * align0;
+    std::vector<real_t> param = random_param(kNumFeat * align1);
+    std::vector<Node> row = random_row();
+    std::vector<Node> a(row.begin(), row.begin() + 5);
+    std::vector<Node> b(row.begin() + 5, row.end());
+    real_t norm = 0.5;
+    real_t expect = naive_ffm_score(row, param.data(), aligned_k, norm) -
+                    naive_ffm_score(a, param.data(), aligned_k, norm) -
+                    naive_ffm_score(b, param.data(), aligned_k, norm);
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->ffm_cross(a.data(), a.data() + a.size(),
+                                      b.data(), b.data() + b.size(),
+                                      param.data(), align0, align1, norm);
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+      EXPECT_EQ(list[k]->ffm_cross(a.data(), a.data() + a.size(),
+                                   b.data(), b.data(), param.data(),
+                                   align0, align1, norm), 0);
+    }
+    // The 16-bit latent factor
+    std::vector<uint16> half = half_param(&param, kNumFeat * kNumField,
+                                          aligned_k, true, true);
+    expect = naive_ffm_score(row, param.data(), aligned_k, norm) -
+             naive_ffm_score(a, param.data(), aligned_k, norm) -
+             naive_ffm_score(b, param.data(), aligned_k, norm);
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->ffm_cross_half(a.data(), a.data() + a.size(),
+                                           b.data(), b.data() + b.size(),
+                                           half.data(), aligned_k,
+                                           kNumField * aligned_k,
+                                           norm, true);
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+    }
+  }
+}
+
+TEST(SCORE_KERNEL_TEST, Int8) {
+  srand(4);
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<const ScoreKernel*> list = KernelList(aligned_k);
+    std::vector<Node> row = random_row();
+    std::vector<real_t> s(aligned_k);
+    real_t norm = 0.5;
+    // The int8 latent factor, the scales and the same weights in fp32
+    index_t num_vec = kNumFeat * kNumField;
+    std::vector<int8> q(num_vec * aligned_k);
+    std::vector<real_t> scale(num_vec);
+    std::vector<real_t> ffm_param(num_vec * 2 * aligned_k, 0);
+    std::vector<real_t> fm_param(kNumFeat * 2 * aligned_k, 0);
+    for (index_t i = 0; i < num_vec; ++i) {
+      scale[i] = random_val() / 127;
+      for (index_t d = 0; d < aligned_k; ++d) {
+        q[i * aligned_k + d] = (int8)(rand() % 255 - 127);
+        real_t w = scale[i] * q[i * aligned_k + d];
+        ffm_param[i * 2 * aligned_k + d / kAlign * 2 * kAlign +
+                  d % kAlign] = w;
+        if (i < kNumFeat) { fm_param[i * 2 * aligned_k + d] = w; }
+      }
+    }
+    real_t expect = naive_ffm_score(row, ffm_param.data(),
+                                    aligned_k, norm);
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->ffm_score_int8(row.data(),
+                                           row.data() + row.size(),
+                                           q.data(), scale.data(),
+                                           aligned_k, kNumField, norm);
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect)) << list[k]->name;
+    }
+    expect = naive_fm_score(row, fm_param.data(), aligned_k, norm);
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t val = list[k]->fm_score_int8(row.data(),
+                                          row.data() + row.size(),
+                                          q.data(), scale.data(),
+                                          aligned_k, norm, s.data());
+      EXPECT_NEAR(val, expect, 1e-4 * fabs(expect) + 1e-5)
+        << list[k]->name;
+    }
+  }
+}
+
+// The kernels of the binary row give the score and the update
+// of the fp32 kernels on the same row, in each layout of FFM
+TEST(SCORE_KERNEL_TEST, Binary) {
+  srand(17);
+  LatentLayout layouts[] = { kLayoutInterleaved, kLayoutSplit };
+  for (index_t aligned_k = 4; aligned_k <= 36; aligned_k += 4) {
+    std::vector<Node> row = random_row();
+    for (size_t i = 0; i < row.size(); ++i) { row[i].feat_val = 1.0; }
+    const Node* begin = row.data();
+    const Node* end = row.data() + row.size();
+    real_t norm = 1.0 / row.size();
+    for (int l = 0; l < 2; ++l) {
+      std::vector<const ScoreKernel*> list =
+        SupportedScoreKernels(0, layouts[l]);
+      if (IsSpecializedK(aligned_k)) {
+        std::vector<const ScoreKernel*> spec =
+          SupportedScoreKernels(aligned_k, layouts[l]);
+        list.insert(list.end(), spec.begin(), spec.end());
+      }
+      index_t align0 = 2 * aligned_k;
+      index_t align1 = kNumField * align0;
+      std::vector<real_t> param = random_param(kNumFeat * align1);
+      for (size_t k = 0; k < list.size(); ++k) {
+        const ScoreKernel* kernel = list[k];
+        real_t expect = kernel->ffm_score(begin, end, param.data(),
+                                          align0, align1, norm, 0);
+        real_t val = kernel->ffm_score_binary(begin, end, param.data(),
+                                              align0, align1, norm, 2);
+        EXPECT_NEAR(val, expect, 1e-5 * fabs(expect)) << kernel->name;
+        std::vector<real_t> expect_param = param;
+        kernel->ffm_grad(begin, end, expect_param.data(), align0,
+                         align1, norm, 0.3, 0.1, 0.01, 0, kSqrtFast);
+        std::vector<real_t> new_param = param;
+        kernel->ffm_grad_binary(begin, end, new_param.data(), align0,
+                                align1, norm, 0.3, 0.1, 0.01, 0,
+                                kSqrtFast);
+        ExpectNear(new_param, expect_param, 1e-5);
+        // The staged pairs of the binary row have val = norm
+        std::vector<FFMPair> staged(row.size() * (row.size() - 1) / 2);
+        val = kernel->ffm_score_staged_binary(begin, end, param.data(),
+                                              align0, align1, norm, 0,
+                                              staged.data());
+        EXPECT_NEAR(val, expect, 1e-5 * fabs(expect)) << kernel->name;
+        EXPECT_EQ(staged.back().val, norm);
+      }
+    }
+    // FM, whose sum s is the same as fm_score()
+    std::vector<const ScoreKernel*> list = KernelList(aligned_k);
+    std::vector<real_t> param = random_param(kNumFeat * 2 * aligned_k);
+    std::vector<real_t> s(aligned_k), s_binary(aligned_k);
+    for (size_t k = 0; k < list.size(); ++k) {
+      real_t expect = list[k]->fm_score(begin, end, param.data(),
+                                        aligned_k, norm, s.data());
+      real_t val = list[k]->fm_score_binary(begin, end, param.data(),
+                                            aligned_k, norm,
+                                            s_binary.data());
+      EXPECT_NEAR(val, expect, 1e-5 * fabs(expect)) << list[k]->name;
+      ExpectNear(s_binary, s, 1e-5);
+      std::vector<real_t> expect_param = param;
+      list[k]->fm_grad(begin, end, expect_param.data(), aligned_k, norm,
+                       0.3, 0.1, 0.01, s.data(), kSqrtFast);
+      std::vector<real_t> new_param = param;
+      list[k]->fm_grad_binary(begin, end, new_param.data(), aligned_k,
+                              norm, 0.3, 0.1, 0.01, s.data(), kSqrtFast);
+      ExpectNear(new_param, expect_param, 1e-5);
+    }
+  }
+}
+
+}  // namespace xLearn
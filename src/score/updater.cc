@@ -0,0 +1,34 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file is the implementation of the Updater class.
+*/
+
+#include "src/score/updater.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Class register
+//------------------------------------------------------------------------------
+CLASS_REGISTER_IMPLEMENT_REGISTRY(xLearn_updater_registry, Updater);
+REGISTER_UPDATER("adagrad", AdaGradUpdater);
+REGISTER_UPDATER("ftrl", FTRLUpdater);
+REGISTER_UPDATER("adagrad-lazy", LazyAdaGradUpdater);
+
+}  // namespace xLearn
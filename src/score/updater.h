@@ -0,0 +1,321 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file defines the Updater class, which updates the
+linear term of the model by the partial gradient.
+*/
+
+#ifndef XLEARN_SCORE_UPDATER_H_
+#define XLEARN_SCORE_UPDATER_H_
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+#include "src/base/class_register.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Hyper-parameters of the updaters. The AdaGrad uses the
+// learning_rate and regu_lambda, and the FTRL-Proximal uses
+// alpha, beta and the L1/L2 regular lambda_1 and lambda_2.
+// The lazy AdaGrad uses regu_lambda and lambda_1, and both
+// AdaGrads use the 1 / sqrt() of sqrt_precision
+struct UpdaterParam {
+  real_t learning_rate = 0.2;
+  real_t regu_lambda = 0.00002;
+  real_t alpha = 0.3;
+  real_t beta = 1.0;
+  real_t lambda_1 = 0.00001;
+  real_t lambda_2 = 0.00002;
+  SqrtPrecision sqrt_precision = kSqrtFast;
+};
+
+enum UpdaterType {
+  kUpdaterAdaGrad = 0,
+  kUpdaterFTRL = 1,
+  kUpdaterLazyAdaGrad = 2
+};
+
+//------------------------------------------------------------------------------
+// The update policies are inlined into the loop of the updater at
+// compile time. Each policy updates one weight w[0] by the gradient
+// g of the loss at the given step (the number of updated rows), and
+// its kStride - 1 states follow the weight. The lazy policies (kLazy
+// is true) defer the regular of the steps in which the feature is
+// absent, and Flush() applies the deferred regular up to the step.
+//------------------------------------------------------------------------------
+
+// AdaGrad with L2 regular, where w[1] is the gradient
+// cache, which starts at 1.0
+struct AdaGradPolicy {
+  static const index_t kStride = 2;
+  static const bool kLazy = false;
+
+  static inline void Flush(real_t* w, uint32 step,
+                           const UpdaterParam& param) { }
+
+  static inline void Update(real_t* w, real_t g, uint32 step,
+                            const UpdaterParam& param) {
+    g += param.regu_lambda * w[0];
+    w[1] += g * g;
+    w[0] -= param.learning_rate * g *
+            InvSqrt(w[1], param.sqrt_precision);
+  }
+};
+
+// FTRL-Proximal (McMahan et al. 2013), where w[1] is the sum of
+// the squared gradients n and w[2] is z, which start at 0. The
+// weight is exactly 0 if |z| <= lambda_1, which gives the sparse
+// linear term
+struct FTRLPolicy {
+  static const index_t kStride = 3;
+  // The weight is computed from z and n in closed form when the
+  // feature is touched, so the regular is lazy by nature
+  static const bool kLazy = false;
+
+  static inline void Flush(real_t* w, uint32 step,
+                           const UpdaterParam& param) { }
+
+  static inline void Update(real_t* w, real_t g, uint32 step,
+                            const UpdaterParam& param) {
+    real_t n = w[1] + g * g;
+    real_t sqrt_n = std::sqrt(n);
+    real_t sigma = (sqrt_n - std::sqrt(w[1])) / param.alpha;
+    w[2] += g - sigma * w[0];
+    w[1] = n;
+    real_t z = w[2];
+    if (std::abs(z) <= param.lambda_1) {
+      w[0] = 0;
+    } else {
+      w[0] = -(z - std::copysign(param.lambda_1, z)) /
+             ((param.beta + sqrt_n) / param.alpha + param.lambda_2);
+    }
+  }
+};
+
+// AdaGrad with the lazy (just-in-time) L2 and L1 regular, where
+// w[1] is the sum of squared gradients n (the cache is 1 + n) and
+// w[2] holds the bits of the uint32 step in which the weight was
+// last regularized, which start at 0. When the feature is touched
+// at step t after step s, the regular of the t - s steps is applied
+// at once with the learning rate frozen at lr / sqrt(1 + n):
+//
+//   w = w * (1 - eta * regu_lambda)^(t - s)
+//   w = sign(w) * max(0, |w| - (t - s) * eta * lambda_1)
+//
+// so the cost of a row is O(nnz) however strong the regular is
+struct LazyAdaGradPolicy {
+  static const index_t kStride = 3;
+  static const bool kLazy = true;
+
+  static inline uint32 last_step(const real_t* w) {
+    uint32 s;
+    memcpy(&s, w + 2, sizeof(s));
+    return s;
+  }
+
+  static inline void set_last_step(real_t* w, uint32 s) {
+    memcpy(w + 2, &s, sizeof(s));
+  }
+
+  static inline void Flush(real_t* w, uint32 step,
+                           const UpdaterParam& param) {
+    uint32 last = last_step(w);
+    if (step <= last) { return; }
+    set_last_step(w, step);
+    if (w[0] == 0) { return; }
+    real_t num = static_cast<real_t>(step - last);
+    real_t eta = param.learning_rate *
+                 InvSqrt(1.0 + w[1], param.sqrt_precision);
+    real_t decay = 1.0 - eta * param.regu_lambda;
+    if (decay <= 0) {
+      w[0] = 0;
+      return;
+    }
+    w[0] *= (step - last == 1) ? decay : std::pow(decay, num);
+    real_t shrink = num * eta * param.lambda_1;
+    if (std::abs(w[0]) <= shrink) {
+      w[0] = 0;
+    } else {
+      w[0] -= std::copysign(shrink, w[0]);
+    }
+  }
+
+  static inline void Update(real_t* w, real_t g, uint32 step,
+                            const UpdaterParam& param) {
+    Flush(w, step, param);
+    w[1] += g * g;
+    w[0] -= param.learning_rate * g *
+            InvSqrt(1.0 + w[1], param.sqrt_precision);
+  }
+};
+
+// Update the linear term of the nodes [begin, end) at
+// the step, where w[P::kStride * feat_id] is the weight
+// of feat_id
+template <typename P>
+inline void update_linear(const Node* begin, const Node* end,
+                          real_t* w, real_t pg, uint32 step,
+                          const UpdaterParam& param) {
+  for (const Node* iter = begin; iter != end; ++iter) {
+    P::Update(w + iter->feat_id * P::kStride,
+              pg * iter->feat_val, step, param);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Updater is the optimization method of the linear term, which is
+// used by the score functions like this:
+//
+//  Updater* updater = CREATE_UPDATER("ftrl");
+//  updater->Initialize(param);
+//  score->SetUpdater(updater);
+//
+// Since the states of the method follow each weight, the model of
+// the linear term should be initialized with the stride of the
+// updater:
+//
+//  model.Initialize(score_func, loss_func, num_feat,
+//                   num_field, num_K, scale,
+//                   updater->LinearStride());
+//
+// The bias always uses AdaGrad, and the latent factor of fm and ffm
+// uses the AdaGrad of the SIMD kernels. The lazy updaters defer the
+// regular, so the deferred regular should be flushed to the model
+// after training:
+//
+//  updater->Flush(model.GetParameter_w(), model.GetNumFeature());
+//------------------------------------------------------------------------------
+class Updater {
+ public:
+  // Constructor and Desstructor
+  Updater() { }
+  virtual ~Updater() { }
+
+  // Invoke this function before we use this class
+  void Initialize(const UpdaterParam& param) { param_ = param; }
+
+  // Type of the optimization method
+  virtual UpdaterType Type() const = 0;
+
+  // Number of floats of each weight of the linear
+  // term, including the weight and its states
+  virtual index_t LinearStride() const = 0;
+
+  // Update the linear term of the nodes [begin, end)
+  // by the partial gradient pg * feat_val
+  virtual void UpdateLinear(const Node* begin,
+                            const Node* end,
+                            real_t* w,
+                            real_t pg) const = 0;
+
+  // Apply the deferred regular to all the num_feat
+  // weights of the linear term
+  virtual void Flush(real_t* w, index_t num_feat) const { }
+
+  // The state of the updater besides the model, i.e., the
+  // step of the lazy updaters, which is saved and restored
+  // by the resumed training (see Trainer::SetResume)
+  virtual uint32 Step() const { return 0; }
+  virtual void SetStep(uint32 step) { }
+
+  // Update the bias b[0] by AdaGrad, and b[1] is the cache
+  inline void UpdateBias(real_t* b, real_t pg) const {
+    b[1] += pg * pg;
+    b[0] -= param_.learning_rate * pg *
+            InvSqrt(b[1], param_.sqrt_precision);
+  }
+
+  inline const UpdaterParam& Param() const { return param_; }
+
+ protected:
+  UpdaterParam param_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Updater);
+};
+
+// The updater of policy P. The step is only counted
+// by the lazy policies, which count each updated row
+template <typename P, UpdaterType kType>
+class PolicyUpdater : public Updater {
+ public:
+  PolicyUpdater() : step_(0) { }
+  ~PolicyUpdater() { }
+
+  UpdaterType Type() const { return kType; }
+
+  index_t LinearStride() const { return P::kStride; }
+
+  void UpdateLinear(const Node* begin,
+                    const Node* end,
+                    real_t* w,
+                    real_t pg) const {
+    uint32 step = P::kLazy ?
+      step_.fetch_add(1, std::memory_order_relaxed) + 1 : 0;
+    update_linear<P>(begin, end, w, pg, step, param_);
+  }
+
+  void Flush(real_t* w, index_t num_feat) const {
+    if (!P::kLazy) { return; }
+    uint32 step = step_.load(std::memory_order_relaxed);
+    for (index_t i = 0; i < num_feat; ++i) {
+      P::Flush(w + i * P::kStride, step, param_);
+    }
+  }
+
+  uint32 Step() const { return step_.load(std::memory_order_relaxed); }
+
+  void SetStep(uint32 step) { step_.store(step); }
+
+ private:
+  /* Number of the updated rows */
+  mutable std::atomic<uint32> step_;
+
+  DISALLOW_COPY_AND_ASSIGN(PolicyUpdater);
+};
+
+typedef PolicyUpdater<AdaGradPolicy, kUpdaterAdaGrad> AdaGradUpdater;
+typedef PolicyUpdater<FTRLPolicy, kUpdaterFTRL> FTRLUpdater;
+typedef PolicyUpdater<LazyAdaGradPolicy,
+                      kUpdaterLazyAdaGrad> LazyAdaGradUpdater;
+
+//------------------------------------------------------------------------------
+// Class register
+//------------------------------------------------------------------------------
+CLASS_REGISTER_DEFINE_REGISTRY(xLearn_updater_registry, Updater);
+
+#define REGISTER_UPDATER(format_name, updater_name)         \
+  CLASS_REGISTER_OBJECT_CREATOR(                            \
+      xLearn_updater_registry,                              \
+      Updater,                                              \
+      format_name,                                          \
+      updater_name)
+
+#define CREATE_UPDATER(format_name)                         \
+  CLASS_REGISTER_CREATE_OBJECT(                             \
+      xLearn_updater_registry,                              \
+      format_name)
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_UPDATER_H_
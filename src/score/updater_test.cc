@@ -0,0 +1,188 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+This file tests the Updater class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+
+#include "src/score/updater.h"
+#include "src/score/linear_score.h"
+
+namespace xLearn {
+
+TEST(UPDATER_TEST, Create) {
+  Updater* adagrad = CREATE_UPDATER("adagrad");
+  Updater* ftrl = CREATE_UPDATER("ftrl");
+  ASSERT_TRUE(adagrad != nullptr);
+  ASSERT_TRUE(ftrl != nullptr);
+  EXPECT_EQ(adagrad->Type(), kUpdaterAdaGrad);
+  EXPECT_EQ(adagrad->LinearStride(), 2);
+  EXPECT_EQ(ftrl->Type(), kUpdaterFTRL);
+  EXPECT_EQ(ftrl->LinearStride(), 3);
+  EXPECT_TRUE(CREATE_UPDATER("sgd") == nullptr);
+  delete adagrad;
+  delete ftrl;
+}
+
+TEST(UPDATER_TEST, AdaGrad) {
+  UpdaterParam param;
+  param.learning_rate = 0.1;
+  param.regu_lambda = 0.5;
+  real_t w[2] = { 2.0, 1.0 };
+  AdaGradPolicy::Update(w, 1.0, 0, param);
+  // g = 1.0 + 0.5 * 2.0 = 2.0, cache = 1.0 + 4.0
+  EXPECT_FLOAT_EQ(w[1], 5.0);
+  EXPECT_NEAR(w[0], 2.0 - 0.1 * 2.0 / std::sqrt(5.0), 1e-3);
+}
+
+TEST(UPDATER_TEST, FTRL) {
+  UpdaterParam param;
+  param.alpha = 0.5;
+  param.beta = 1.0;
+  param.lambda_1 = 1.0;
+  param.lambda_2 = 0.5;
+  real_t w[3] = { 0, 0, 0 };
+  // |z| = 0.5 <= lambda_1, and the weight stays 0
+  FTRLPolicy::Update(w, 0.5, 0, param);
+  EXPECT_FLOAT_EQ(w[0], 0);
+  EXPECT_FLOAT_EQ(w[1], 0.25);
+  EXPECT_FLOAT_EQ(w[2], 0.5);
+  // n = 0.25 + 4 = 4.25, sigma = (sqrt(4.25) - 0.5) / 0.5,
+  // z = 0.5 + 2 - sigma * 0
+  FTRLPolicy::Update(w, 2.0, 0, param);
+  real_t n = 4.25;
+  EXPECT_FLOAT_EQ(w[1], n);
+  EXPECT_FLOAT_EQ(w[2], 2.5);
+  real_t expected = -(2.5 - 1.0) /
+                    ((1.0 + std::sqrt(n)) / 0.5 + 0.5);
+  EXPECT_FLOAT_EQ(w[0], expected);
+}
+
+TEST(UPDATER_TEST, LazyAdaGrad) {
+  UpdaterParam param;
+  param.learning_rate = 0.1;
+  param.regu_lambda = 0.5;
+  param.lambda_1 = 0;
+  real_t w[3] = { 0, 0, 0 };
+  LazyAdaGradPolicy::Update(w, -1.0, 1, param);
+  real_t w0 = 0.1 * InvSqrt(2.0);
+  EXPECT_NEAR(w[0], w0, 1e-3);
+  EXPECT_FLOAT_EQ(w[1], 1.0);
+  EXPECT_EQ(LazyAdaGradPolicy::last_step(w), 1);
+  // The L2 of steps 2 .. 4 is applied at step 4
+  // with the learning rate 0.1 / sqrt(2)
+  LazyAdaGradPolicy::Flush(w, 4, param);
+  real_t decay = 1.0 - 0.1 * InvSqrt(2.0) * 0.5;
+  EXPECT_NEAR(w[0], w0 * decay * decay * decay, 1e-4);
+  EXPECT_EQ(LazyAdaGradPolicy::last_step(w), 4);
+  // Flush again at the same step does nothing
+  real_t w1 = w[0];
+  LazyAdaGradPolicy::Flush(w, 4, param);
+  EXPECT_FLOAT_EQ(w[0], w1);
+  // The strong L1 cuts the weight to 0
+  param.lambda_1 = 100;
+  LazyAdaGradPolicy::Flush(w, 5, param);
+  EXPECT_FLOAT_EQ(w[0], 0);
+}
+
+TEST(UPDATER_TEST, LazyAdaGrad_flush) {
+  const index_t kLength = 8;
+  Model model;
+  model.Initialize("linear", "squared", kLength, 0, 0, 1.0, 3);
+  Updater* lazy = CREATE_UPDATER("adagrad-lazy");
+  ASSERT_TRUE(lazy != nullptr);
+  EXPECT_EQ(lazy->Type(), kUpdaterLazyAdaGrad);
+  UpdaterParam param;
+  param.learning_rate = 0.1;
+  param.regu_lambda = 0.1;
+  param.lambda_1 = 0;
+  lazy->Initialize(param);
+  LinearScore score;
+  score.Initialize(0.1, 0.1, &model);
+  score.SetUpdater(lazy);
+  // Feature 0 is touched by the first row only, and
+  // feature 1 by all the rows
+  SparseRow first(2), other(1);
+  first[0].feat_id = 0;
+  first[0].feat_val = 1.0;
+  first[1].feat_id = 1;
+  first[1].feat_val = 1.0;
+  other[0].feat_id = 1;
+  other[0].feat_val = 1.0;
+  score.CalcGrad(&first, model, -1.0);
+  real_t* w = model.GetParameter_w();
+  real_t w0 = w[0];
+  for (int n = 0; n < 9; ++n) {
+    score.CalcGrad(&other, model, -1.0);
+  }
+  // The decay of feature 0 is deferred until flush
+  EXPECT_FLOAT_EQ(w[0], w0);
+  lazy->Flush(w, kLength);
+  real_t decay = 1.0 - 0.1 * InvSqrt(2.0) * 0.1;
+  EXPECT_NEAR(w[0], w0 * std::pow(decay, 9), 1e-5);
+  EXPECT_EQ(LazyAdaGradPolicy::last_step(w + 3), 10);
+  delete lazy;
+}
+
+TEST(UPDATER_TEST, FTRL_linear_score) {
+  const index_t kLength = 100;
+  Model model;
+  model.Initialize("linear", "squared", kLength, 0, 0, 1.0, 3);
+  EXPECT_EQ(model.GetLinearStride(), 3);
+  EXPECT_EQ(model.GetNumParameter_w(), kLength * 3);
+  Updater* ftrl = CREATE_UPDATER("ftrl");
+  UpdaterParam param;
+  param.lambda_1 = 0.5;
+  ftrl->Initialize(param);
+  LinearScore score;
+  score.Initialize(0.1, 0, &model);
+  score.SetUpdater(ftrl);
+  // The even features have large gradients, and the
+  // small gradients of the odd features are cut by L1
+  SparseRow row(kLength);
+  for (index_t i = 0; i < kLength; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = (i % 2 == 0) ? 1.0 : 0.1;
+  }
+  for (int n = 0; n < 3; ++n) {
+    score.CalcGrad(&row, model, 1.0);
+  }
+  real_t* w = model.GetParameter_w();
+  real_t sum = 0;
+  for (index_t i = 0; i < kLength; ++i) {
+    if (i % 2 == 0) {
+      EXPECT_LT(w[i*3], 0);
+    } else {
+      EXPECT_FLOAT_EQ(w[i*3], 0);
+    }
+    sum += w[i*3] * row[i].feat_val;
+  }
+  // The long row uses the gather of stride 3
+  EXPECT_NEAR(score.CalcScore(&row, model),
+              sum + model.GetParameter_b()[0], 1e-4);
+  delete ftrl;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,111 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of BatchSolver.
+*/
+
+#include "src/solver/batch_solver.h"
+
+#include <math.h>
+
+namespace xLearn {
+
+void BatchSolver::Initialize(std::vector<Reader*>& reader_list,
+                             Model* model,
+                             const Loss* loss,
+                             const std::string& loss_func,
+                             bool is_norm,
+                             real_t regu_lambda,
+                             ThreadPool* pool) {
+  CHECK_NOTNULL(model);
+  CHECK_NOTNULL(loss);
+  CHECK_NOTNULL(pool);
+  CHECK(loss_func == "squared" || loss_func == "cross-entropy");
+  CHECK_EQ(model->GetLinearStride(), 2);
+  model_ = model;
+  squared_ = loss_func == "squared";
+  regu_lambda_ = regu_lambda;
+  pool_ = pool;
+  // The rows are counted, and then copied into one matrix
+  index_t num_row = 0;
+  DMatrix* matrix = nullptr;
+  for (size_t i = 0; i < reader_list.size(); ++i) {
+    reader_list[i]->Reset();
+    index_t tmp = 0;
+    while ((tmp = reader_list[i]->Samples(matrix, false)) > 0) {
+      num_row += tmp;
+    }
+  }
+  rows_.SetCSR(true);
+  rows_.ResetMatrix(num_row);
+  index_t pos = 0;
+  for (size_t i = 0; i < reader_list.size(); ++i) {
+    reader_list[i]->Reset();
+    index_t tmp = 0;
+    while ((tmp = reader_list[i]->Samples(matrix, false)) > 0) {
+      for (index_t j = 0; j < tmp; ++j) {
+        rows_.CopyRow(pos++, *matrix, j);
+      }
+    }
+    reader_list[i]->Reset();
+  }
+  CHECK_EQ(pos, num_row);
+  if (!is_norm) { rows_.norm.assign(num_row, 1.0); }
+  weight_.resize(num_row);
+  label_.resize(num_row);
+  for (index_t i = 0; i < num_row; ++i) {
+    weight_[i] = loss->row_weight(rows_.Y[i]) * rows_.RowWeight(i);
+    label_[i] = squared_ ? rows_.Y[i] : (rows_.Y[i] > 0 ? 1.0 : -1.0);
+  }
+  // The transposed index: count the nodes of each feature,
+  // and then fill them in the order of the rows
+  index_t num_feat = model->GetNumFeature();
+  offset_.assign(num_feat + 1, 0);
+  for (index_t i = 0; i < num_row; ++i) {
+    RowView row = rows_.GetRow(i);
+    for (index_t j = 0; j < row.dense_size(); ++j) {
+      if (row.dense()[j] != 0) { offset_[j+1]++; }
+    }
+    for (const Node* iter = row.begin(); iter != row.end(); ++iter) {
+      CHECK_LT(iter->feat_id, num_feat);
+      offset_[iter->feat_id+1]++;
+    }
+  }
+  for (index_t j = 0; j < num_feat; ++j) {
+    offset_[j+1] += offset_[j];
+  }
+  entry_.resize(offset_[num_feat]);
+  std::vector<uint64> next(offset_.begin(), offset_.end() - 1);
+  for (index_t i = 0; i < num_row; ++i) {
+    RowView row = rows_.GetRow(i);
+    real_t norm = rows_.norm[i];
+    real_t sqrt_norm = sqrt(norm);
+    for (index_t j = 0; j < row.dense_size(); ++j) {
+      real_t x = row.dense()[j];
+      if (x != 0) { entry_[next[j]++] = { i, x * sqrt_norm, x * norm }; }
+    }
+    for (const Node* iter = row.begin(); iter != row.end(); ++iter) {
+      real_t x = iter->feat_val;
+      entry_[next[iter->feat_id]++] = { i, x * sqrt_norm, x * norm };
+    }
+  }
+  score_.assign(num_row, 0);
+  LOG(INFO) << "Batch solver of " << num_row << " rows and "
+            << entry_.size() << " nodes";
+}
+
+}  // namespace xLearn
@@ -0,0 +1,111 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the BatchSolver class, the base of the solvers
+that train on all the rows in memory (-opt als and lbfgs).
+*/
+
+#ifndef XLEARN_SOLVER_BATCH_SOLVER_H_
+#define XLEARN_SOLVER_BATCH_SOLVER_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/loss.h"
+#include "src/reader/reader.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// BatchSolver is the base of the full-batch solvers, which replace the SGD
+// of the Loss in Trainer (see SetBatchSolver() of trainer.h). Initialize()
+// copies all the training rows once into rows_, and builds the transposed
+// (feature-major) index of their nodes, so each epoch can visit the rows
+// of a feature without reading the data again. Each solver implements
+// Epoch(), which moves the model and leaves the score of each row in
+// score_ for the train loss of the epoch:
+//
+//   CoordDescent cd;
+//   cd.Initialize(reader_list, &model, loss, "squared", true, 0.1, pool);
+//   for (int n = 0; n < epoch; ++n) {
+//     cd.Epoch();
+//     loss->EvaluteMetric(cd.Scores(), cd.Rows().Y, metric, weight);
+//   }
+//
+// The solvers only train the linear and fm models of the squared and
+// cross-entropy loss, whose model keeps the layout of AdaGrad.
+//------------------------------------------------------------------------------
+class BatchSolver {
+ public:
+  BatchSolver() { }
+  virtual ~BatchSolver() { }
+
+  // Copy all the rows of the readers and build the transposed
+  // index. The loss_func is "squared" or "cross-entropy", and
+  // the loss gives the weight of the negative rows
+  virtual void Initialize(std::vector<Reader*>& reader_list,
+                          Model* model,
+                          const Loss* loss,
+                          const std::string& loss_func,
+                          bool is_norm,
+                          real_t regu_lambda,
+                          ThreadPool* pool);
+
+  // Train the model by one epoch, and return the number of rows
+  virtual index_t Epoch() = 0;
+
+  // The training rows, and the score of each row
+  // after the last Epoch()
+  const DMatrix& Rows() const { return rows_; }
+  const std::vector<real_t>& Scores() const { return score_; }
+
+ protected:
+  // A node of the transposed index: the row, and the value
+  // of the linear term and of the latent term of the node
+  struct Entry {
+    index_t row;
+    real_t x_w;
+    real_t x_v;
+  };
+
+  Model* model_ = nullptr;
+  bool squared_ = true;
+  real_t regu_lambda_ = 0;
+  ThreadPool* pool_ = nullptr;
+  DMatrix rows_;
+  /* The weight of each row */
+  std::vector<real_t> weight_;
+  /* The label of each row for the loss, and +1 or -1
+  for the cross-entropy */
+  std::vector<real_t> label_;
+  /* The entries of feature j are [offset_[j], offset_[j+1]) */
+  std::vector<uint64> offset_;
+  std::vector<Entry> entry_;
+  /* The score of each row */
+  std::vector<real_t> score_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BatchSolver);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_BATCH_SOLVER_H_
@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of BatchTuner.
+*/
+
+#include "src/solver/batch_tuner.h"
+
+#include <algorithm>
+
+namespace xLearn {
+
+// The larger candidates are skipped once the rows/sec
+// is below this ratio of the best one
+static const double kSlowdown = 0.8;
+
+BatchTuner::BatchTuner(int base, uint64 max_bytes, int trials)
+  : base_(base), max_bytes_(max_bytes), trials_(trials),
+    cur_(0), batches_(0), rows_(0), seconds_(0),
+    total_rows_(0), total_bytes_(0), best_(-1), done_(false) {
+  CHECK_GT(base, 0);
+  CHECK_GT(trials, 0);
+  for (int shift = 3; shift > 0; --shift) {
+    if ((base >> shift) > 0) { sizes_.push_back(base >> shift); }
+  }
+  for (int i = 0; i <= 2; ++i) { sizes_.push_back(base << i); }
+  speed_.assign(sizes_.size(), 0);
+}
+
+int BatchTuner::Size() const {
+  if (!done_) { return sizes_[cur_]; }
+  return best_ < 0 ? base_ : sizes_[best_];
+}
+
+void BatchTuner::Record(index_t rows, double seconds, uint64 bytes) {
+  if (done_ || rows < sizes_[cur_]) { return; }
+  total_rows_ += rows;
+  total_bytes_ += bytes;
+  // The first batch of a size grows the buffers
+  if (batches_++ == 0) { return; }
+  rows_ += rows;
+  seconds_ += seconds;
+  if (batches_ > trials_) { next_candidate(); }
+}
+
+void BatchTuner::next_candidate() {
+  speed_[cur_] = seconds_ > 0 ? rows_ / seconds_ : 0;
+  if (best_ < 0 || speed_[cur_] > speed_[best_]) { best_ = cur_; }
+  bool slow = speed_[cur_] < kSlowdown * speed_[best_];
+  batches_ = 0;
+  rows_ = 0;
+  seconds_ = 0;
+  ++cur_;
+  if (slow || cur_ >= sizes_.size() ||
+      RowBytes() * sizes_[cur_] > max_bytes_) {
+    done_ = true;
+  }
+}
+
+void BatchTuner::Finish() {
+  // The candidate being measured is used if it has
+  // a measured batch after the warm-up one
+  if (!done_ && batches_ > 1) {
+    next_candidate();
+  }
+  done_ = true;
+}
+
+}  // namespace xLearn
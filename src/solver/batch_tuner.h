@@ -0,0 +1,116 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the BatchTuner class that chooses the number of
+rows of each batch (sample_size) by the measured throughput.
+*/
+
+#ifndef XLEARN_SOLVER_BATCH_TUNER_H_
+#define XLEARN_SOLVER_BATCH_TUNER_H_
+
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// BatchTuner chooses the batch size of the gradient pass, whose best value
+// depends on the nnz of the rows, the K of the model, the score function and
+// the number of threads. The small batches pay the dispatch of the thread
+// pool too often, while the large ones copy more rows and miss the cache.
+//
+// The candidates are the sizes from base / 8 to base * 4. Each one is used
+// for a few batches of the first epoch, whose first batch is a warm-up, and
+// the size of the most rows/sec is chosen. A candidate is not tried if its
+// batch would be larger than max_bytes, by the bytes of the rows measured so
+// far, and the larger candidates are not tried once the rows/sec drops well
+// below the best one:
+//
+//   BatchTuner tuner(20000, 64 << 20);
+//   while (!tuner.Done()) {
+//     reader->SetBatchSize(tuner.Size());
+//     /* train a batch of rows of bytes in seconds */
+//     tuner.Record(rows, seconds, bytes);
+//   }
+//   reader->SetBatchSize(tuner.Size());   /* the best one */
+//
+// The batches are the real ones of the training, so the tuning costs no
+// extra pass over the data.
+//------------------------------------------------------------------------------
+class BatchTuner {
+ public:
+  // The trials batches of each candidate are measured
+  // after its warm-up batch
+  BatchTuner(int base, uint64 max_bytes, int trials = 3);
+
+  // The size of the next batch while tuning, and the
+  // chosen size after the tuning
+  int Size() const;
+
+  // True if the size is chosen
+  bool Done() const { return done_; }
+
+  // Record a batch of the current size. The short batch
+  // at the end of the data is not measured
+  void Record(index_t rows, double seconds, uint64 bytes);
+
+  // Choose the best of the measured candidates, e.g., at the
+  // end of the first epoch of a small dataset. The base size
+  // is kept if no candidate has been measured
+  void Finish();
+
+  // Rows/sec of the chosen size, or 0
+  double RowsPerSec() const { return best_ < 0 ? 0 : speed_[best_]; }
+
+  // Bytes of a row of the measured batches
+  double RowBytes() const {
+    return total_rows_ > 0 ? (double)total_bytes_ / total_rows_ : 0;
+  }
+
+ protected:
+  int base_;
+  uint64 max_bytes_;
+  int trials_;
+  /* The candidate sizes and their rows/sec */
+  std::vector<int> sizes_;
+  std::vector<double> speed_;
+  /* The current candidate, and its batches, rows and seconds */
+  size_t cur_;
+  int batches_;
+  uint64 rows_;
+  double seconds_;
+  /* The rows and bytes of all the measured batches */
+  uint64 total_rows_;
+  uint64 total_bytes_;
+  /* The best candidate, or -1 */
+  int best_;
+  bool done_;
+
+  // Move to the next candidate, or finish
+  void next_candidate();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BatchTuner);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_BATCH_TUNER_H_
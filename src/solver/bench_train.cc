@@ -0,0 +1,322 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the bench_train tool, which generates a
+synthetic libsvm or libffm dataset with power-law feature frequency,
+and then runs the full training path of the Solver on it, reporting
+the time of parsing and of building the binary cache, the rows per
+second of each epoch and the peak RSS:
+
+  bench_train [ options ] [ -- xlearn_train options ]
+
+The options after "--" are given to the Solver as xlearn_train does,
+e.g., bench_train -rows 1000000 -- -s 2 -e 5 -nthread 8
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/solver/solver.h"
+
+namespace xLearn {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     bench_train [ options ] [ -- xlearn_train options ] \n"
+"                                                          \n"
+"  Generate a synthetic dataset and train on it by the Solver. The label of a row is given by \n"
+"  a hidden linear model, so the training converges as on the real data. \n"
+"                                                                          \n"
+"OPTIONS: \n"
+"  -rows <number>       :  Number of rows. Using 100000 by default. \n"
+"                                                                   \n"
+"  -nnz <number>        :  Mean number of nodes of a row. Using 40 by default. \n"
+"                                                                              \n"
+"  -nnz_dist <dist>     :  Distribution of the nodes of a row, which could be 'fixed', 'uniform' \n"
+"                          (in [1, 2 * nnz - 1]) or 'poisson'. Using 'poisson' by default. \n"
+"                                                                                         \n"
+"  -feat <number>       :  Number of features. Using 1000000 by default. \n"
+"                                                                       \n"
+"  -field <number>      :  Number of fields. The dataset is in libffm format if it is greater \n"
+"                          than 0, and in libsvm format otherwise. Using 0 by default. \n"
+"                                                                                     \n"
+"  -zipf <exponent>     :  Exponent of the power-law frequency of the features, where the \n"
+"                          feature of rank r occurs in proportion to 1 / r^exponent. 0 \n"
+"                          gives the uniform frequency. Using 1.0 by default. \n"
+"                                                                            \n"
+"  -seed <number>       :  Random seed. Using 2018 by default. \n"
+"                                                             \n"
+"  -o <file>            :  Path of the dataset. Using './xlearn_bench.txt' by default. \n"
+"                                                                                      \n"
+"  --keep               :  Keep the dataset and its binary cache after the training. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct BenchOption {
+  index_t num_rows = 100000;
+  index_t nnz = 40;
+  std::string nnz_dist = "poisson";
+  index_t num_feature = 1000000;
+  index_t num_field = 0;
+  double zipf = 1.0;
+  int seed = 2018;
+  std::string data_file = "./xlearn_bench.txt";
+  bool keep = false;
+  std::vector<std::string> train_args;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], BenchOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--") {
+      option->train_args.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    if (arg == "--keep") {
+      option->keep = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      printf("[Error] The option %s needs a value \n", argv[i]);
+      return false;
+    }
+    std::string value(argv[++i]);
+    int number = atoi(value.c_str());
+    bool bo = true;
+    if (arg == "-rows") {
+      option->num_rows = number;
+      bo = number > 0;
+    } else if (arg == "-nnz") {
+      option->nnz = number;
+      bo = number > 0;
+    } else if (arg == "-nnz_dist") {
+      option->nnz_dist = value;
+      bo = value == "fixed" || value == "uniform" || value == "poisson";
+    } else if (arg == "-feat") {
+      option->num_feature = number;
+      bo = number > 0;
+    } else if (arg == "-field") {
+      option->num_field = number;
+      bo = number >= 0;
+    } else if (arg == "-zipf") {
+      option->zipf = atof(value.c_str());
+      bo = option->zipf >= 0;
+    } else if (arg == "-seed") {
+      option->seed = number;
+    } else if (arg == "-o") {
+      option->data_file = value;
+    } else {
+      printf("[Error] Unknow option: %s \n", arg.c_str());
+      return false;
+    }
+    if (!bo) {
+      printf("[Error] Illegal %s : '%s' \n", arg.c_str(), value.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// The features are drawn by their rank from the power-law distribution,
+// and the ranks are shuffled into the feature ids, so the hot features
+// are spread over the id space as the hashed ids of real data. The field
+// of a feature is fixed, and the label is given by a hidden linear model
+//------------------------------------------------------------------------------
+class DataGenerator {
+ public:
+  explicit DataGenerator(const BenchOption& option)
+    : option_(option), gen_(option.seed) {
+    index_t num_feature = option.num_feature;
+    cdf_.resize(num_feature);
+    double sum = 0;
+    for (index_t r = 0; r < num_feature; ++r) {
+      sum += 1.0 / pow(r + 1.0, option.zipf);
+      cdf_[r] = sum;
+    }
+    for (index_t r = 0; r < num_feature; ++r) { cdf_[r] /= sum; }
+    id_.resize(num_feature);
+    for (index_t r = 0; r < num_feature; ++r) { id_[r] = r; }
+    std::shuffle(id_.begin(), id_.end(), gen_);
+    std::normal_distribution<real_t> normal(0, 1);
+    weight_.resize(num_feature);
+    for (index_t r = 0; r < num_feature; ++r) {
+      weight_[r] = normal(gen_);
+    }
+  }
+
+  // Write the dataset and return the number of nodes
+  uint64 Write(const std::string& filename) {
+    FILE* file = OpenFileOrDie(filename.c_str(), "w");
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::uniform_int_distribution<index_t> uniform_nnz(
+      1, 2 * option_.nnz - 1);
+    std::poisson_distribution<index_t> poisson(option_.nnz);
+    std::vector<index_t> row;
+    std::string line;
+    char buf[64];
+    uint64 num_node = 0;
+    for (index_t i = 0; i < option_.num_rows; ++i) {
+      index_t nnz = option_.nnz;
+      if (option_.nnz_dist == "uniform") {
+        nnz = uniform_nnz(gen_);
+      } else if (option_.nnz_dist == "poisson") {
+        nnz = std::max((index_t)1, poisson(gen_));
+      }
+      row.clear();
+      for (index_t j = 0; j < nnz; ++j) {
+        index_t r = std::lower_bound(cdf_.begin(), cdf_.end(),
+                                     uniform(gen_)) - cdf_.begin();
+        row.push_back(std::min(r, option_.num_feature - 1));
+      }
+      std::sort(row.begin(), row.end());
+      row.erase(std::unique(row.begin(), row.end()), row.end());
+      real_t score = 0;
+      for (size_t j = 0; j < row.size(); ++j) {
+        score += weight_[row[j]];
+      }
+      line = score > 0 ? "1" : "0";
+      for (size_t j = 0; j < row.size(); ++j) {
+        index_t id = id_[row[j]];
+        if (option_.num_field > 0) {
+          snprintf(buf, sizeof(buf), " %u:%u:1",
+                   id % option_.num_field, id);
+        } else {
+          snprintf(buf, sizeof(buf), " %u:1", id);
+        }
+        line += buf;
+      }
+      line += "\n";
+      WriteDataToDisk(file, line.data(), line.size());
+      num_node += row.size();
+    }
+    Close(file);
+    return num_node;
+  }
+
+ protected:
+  const BenchOption& option_;
+  std::mt19937 gen_;
+  /* Cumulative distribution of the ranks */
+  std::vector<double> cdf_;
+  /* Feature id of each rank */
+  std::vector<index_t> id_;
+  /* Hidden linear model of each rank */
+  std::vector<real_t> weight_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DataGenerator);
+};
+
+// Remove the file if it exists
+void remove_file(const std::string& filename) {
+  if (FileExist(filename.c_str())) { RemoveFile(filename.c_str()); }
+}
+
+// Peak resident set size (MB) of current process
+double peak_rss_mb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+}  // namespace xLearn
+
+//------------------------------------------------------------------------------
+// The binary cache of the dataset is removed before the training, so the
+// Solver always parses the txt file and builds the cache. The model is
+// not saved unless -m is given to the Solver
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  xLearn::BenchOption option;
+  if (!xLearn::parse_option(argc, argv, &option)) {
+    printf("%s", xLearn::kUsage);
+    return 0;
+  }
+  Timer timer;
+  timer.tic();
+  uint64 num_node = 0;
+  {
+    xLearn::DataGenerator generator(option);
+    num_node = generator.Write(option.data_file);
+  }
+  real_t gen_time = timer.toc();
+  std::string bin_file = option.data_file + ".bin";
+  xLearn::remove_file(bin_file);
+  xLearn::remove_file(bin_file + ".range");
+  // The same arguments as xlearn_train
+  std::vector<std::string> args = { "bench_train", option.data_file };
+  args.insert(args.end(), option.train_args.begin(),
+              option.train_args.end());
+  if (std::find(args.begin(), args.end(), "-m") == args.end()) {
+    args.push_back("-m");
+    args.push_back("none");
+  }
+  std::vector<char*> train_argv;
+  for (size_t i = 0; i < args.size(); ++i) {
+    train_argv.push_back(&args[i][0]);
+  }
+  xLearn::Solver solver;
+  solver.SetTrain();
+  solver.Initialize(train_argv.size(), train_argv.data());
+  solver.StartWork();
+  solver.FinalizeWork();
+  const xLearn::TrainStats& stats = solver.GetTrainStats();
+
+  FILE* file = OpenFileOrDie(option.data_file.c_str(), "r");
+  uint64 text_size = GetFileSize(file);
+  Close(file);
+  printf("----------------------------------------------------------\n"
+         "Benchmark of training \n"
+         "  Dataset: %u rows, %.1f nodes per row, %u features, "
+         "%u fields, zipf %.2f \n"
+         "  Text file: %.2f MB, generated in %.2f sec \n"
+         "  Parse time: %.2f sec (%.2f MB/sec) \n"
+         "  Cache-build time: %.2f sec \n",
+         option.num_rows, (double)num_node / option.num_rows,
+         option.num_feature, option.num_field, option.zipf,
+         (double)text_size / MB, gen_time, stats.parse_time,
+         stats.parse_time > 0 ? text_size / MB / stats.parse_time : 0,
+         stats.cache_time);
+  for (size_t i = 0; i < stats.epoch_time.size(); ++i) {
+    real_t time = stats.epoch_time[i];
+    printf("  Epoch %lu: %u rows in %.2f sec, %.0f rows/sec \n",
+           i, stats.epoch_rows[i], time,
+           time > 0 ? stats.epoch_rows[i] / time : 0);
+  }
+  printf("  Peak RSS: %.1f MB \n", xLearn::peak_rss_mb());
+  if (!option.keep) {
+    xLearn::remove_file(option.data_file);
+    xLearn::remove_file(bin_file);
+    xLearn::remove_file(bin_file + ".range");
+  }
+  return 0;
+}
@@ -28,9 +28,22 @@ This file is the implementation of the Checker class.
 #include "src/solver/checker.h"
 #include "src/base/levenshtein_distance.h"
 #include "src/base/file_util.h"
+#include "src/base/affinity.h"
+#include "src/base/huge_page.h"
+#include "src/base/resource.h"
+#include "src/base/split_string.h"
+#include "src/data/model_parameters.h"
+#include "src/distributed/shared_model.h"
+#include "src/loss/metric.h"
+#include "src/reader/input_stream.h"
+#include "src/reader/parser.h"
+#include "src/reader/reader.h"
 
 namespace xLearn {
 
+// The max number of the heads of -heads
+static const int kMaxHeads = 8;
+
 // Option help menu
 std::string Checker::option_help() const {
   if (is_train_) {
@@ -39,6 +52,14 @@ std::string Checker::option_help() const {
 "USAGE: \n"
 "     xlearn_train [ train_file_path ] [ OPTIONS ] \n"
 "                                                   \n"
+"     The train_file_path '-' reads the training data from stdin, e.g., \n"
+"     featgen | xlearn_train - [ OPTIONS ] \n"
+"                                                   \n"
+"     The train_file_path (and -t) can also be a comma-separated list, a \n"
+"     directory or a glob of the part files of one dataset, which are loaded \n"
+"     in parallel, each with its own cache, e.g., \n"
+"     xlearn_train '/data/train/part-*' [ OPTIONS ] \n"
+"                                                   \n"
 "OPTIONS: \n"
 "  -s <type> : Type of machine learning model (default 0) \n"
 "     for classification task \n"
@@ -46,15 +67,23 @@ std::string Checker::option_help() const {
 "         1 -- linear support vectors machine (SVM) \n"
 "         2 -- factorization machines (FM) \n"
 "         3 -- field-aware factorization machines (FFM) \n"
+"         7 -- higher-order factorization machines of order 3 (HOFM) \n"
 "     for regression task \n"
 "         4 -- linear regression (LR) \n"
 "         5 -- factorization machines (FM) \n"
 "         6 -- field-aware factorization machines (FFM) \n"
+"         8 -- higher-order factorization machines of order 3 (HOFM) \n"
 "                                                                            \n"
-"  -x <metric>          :  The metric can be 'acc', 'prec', 'recall', 'f1', 'auc' (for classification), \n"
-"                          and 'mae', 'mape' (for regression). Using 'acc' - Accuracy by default. \n "
+"  -x <metric>          :  The metric can be 'acc', 'prec', 'recall', 'f1', 'auc', 'logloss' (for \n"
+"                          classification), and 'mae', 'mape' (for regression). Using 'acc' - Accuracy \n"
+"                          by default. A list like 'auc,logloss,acc' computes all of them in the same \n"
+"                          pass, and the first one is used by early-stopping. \n"
 "                          If we set this flag to 'none', xlearn will not print any metric info. \n"
 "                                                                                              \n"
+"  --exact-auc          :  Compute the exact AUC by sorting all the scores in multi-thread, rather \n"
+"                          than the streaming AUC of 16384 buckets of the scores, which uses constant \n"
+"                          memory and is usually within 1e-4 of the exact one. \n"
+"                                                                                              \n"
 "  -t <test_file_path>  :  Path of the test data file. This option will be empty by default, \n"
 "                          and in this way, the xLearn will not perform validation. \n"
 "                                                                                              \n"
@@ -62,9 +91,20 @@ std::string Checker::option_help() const {
 "                          If we set this value to 'none', the xLearn will not dump the model \n"
 "                          checkpoint during the training. \n"
 "                                                              \n"
+"  -pre <model_file>    :  Warm-start the training from a former model checkpoint, including the \n"
+"                          gradient caches. The model grows if the new data has more features or \n"
+"                          fields. It needs the same -s, -k and -opt options. A weights-only model \n"
+"                          (e.g., the checkpoint of -ckpt) gives the weights with new gradient caches. \n"
+"                                                                                      \n"
+"  -init <model_file>   :  Initialize the model from the weights of a simpler model (which can be \n"
+"                          weights-only): a linear model gives the linear term and the bias of any \n"
+"                          model, an fm model gives the vector of each field of ffm, and a model \n"
+"                          of a smaller -k gives the first weights of the latent vectors. The \n"
+"                          gradient caches start from scratch. \n"
+"                                                                                      \n"
 "  -l <log_file_path>   :  Path of the log file. Using '/tmp/xlearn_log/' by default. \n"
 "                                                                                  \n"
-"  -k <number_of_K>     :  Number of the latent factor for fm and ffm tasks. \n"
+"  -k <number_of_K>     :  Number of the latent factor for fm, ffm and hofm tasks. \n"
 "                          Using 4 by default. Note that if we set k less than 4 in ffm task, we \n"
 "                          will also get the same size of model. This is because we use SSE and \n"
 "                          the memory should be aligned. \n"
@@ -74,20 +114,408 @@ std::string Checker::option_help() const {
 "  -b <lambda_for_regu> :  Lambda for regular. Using 0.00002 by default. We can close the \n"
 "                          regular by setting this value to 0.0 \n"
 "                                                                   \n"
+"  -opt <opt_method>    :  Optimization method of the linear term, which can be 'adagrad', 'ftrl' \n"
+"                          (FTRL-Proximal, which gives sparse weights) or 'adagrad-lazy' (adagrad \n"
+"                          with the L2 (-b) and L1 (-lambda_1) regular applied lazily to the \n"
+"                          features of each row). Using 'adagrad' by default. \n"
+"                          The latent factor of fm, ffm and hofm is always updated by adagrad. \n"
+"                          The 'als' trains the whole linear or fm model (-s 0, 2 or 5) by  \n"
+"                          coordinate descent (alternating least squares) on all the rows in \n"
+"                          memory, with no learning rate. The 'lbfgs' trains the whole linear \n"
+"                          model (-s 0) by L-BFGS, or by OWL-QN for the sparse weights of \n"
+"                          -lambda_1, on all the rows in memory. \n"
+"                                                                                        \n"
+"  -thread_mode <mode>  :  How the training threads share the model, which can be 'hogwild' (all \n"
+"                          the threads update the model without lock), 'local-bias' (each thread \n"
+"                          updates its own bias, which is merged after each batch) or 'replica' \n"
+"                          (each thread trains its own copy of the model, which is averaged after \n"
+"                          each batch, for small models). Using 'hogwild' by default. \n"
+"                                                                                       \n"
+"  -batch_size <size>   :  Number of rows of which the gradients of the linear term and bias are \n"
+"                          accumulated by each thread and applied once for each feature. \n"
+"                          Using 1 (update by each row) by default. \n"
+"                                                                                       \n"
+"  -grain <rows>        :  Number of rows in each chunk that the threads fetch from the batch \n"
+"                          (dynamic schedule). Using 0 (each thread gets an equal contiguous \n"
+"                          range) by default. \n"
+"                                                                                       \n"
+"  -schedule <sched>    :  How the rows of each batch are assigned to the threads, which can be \n"
+"                          'static' (an equal contiguous range of each thread), 'balanced' (a \n"
+"                          contiguous range of the same cost, nnz for linear and fm, and nnz^2 \n"
+"                          for ffm), 'dynamic' (chunks of -grain rows from a shared counter) or \n"
+"                          'steal' (chunks from its own balanced range, and then from the ranges \n"
+"                          of the other threads, for skewed row lengths). Using 'dynamic' if \n"
+"                          -grain is set, otherwise 'static'. \n"
+"                                                                                       \n"
+"  -alpha <alpha>       :  Hyper param alpha of ftrl. Using 0.3 by default. \n"
+"                                                                           \n"
+"  -beta <beta>         :  Hyper param beta of ftrl. Using 1.0 by default. \n"
+"                                                                          \n"
+"  -lambda_1 <lambda_1> :  L1 regular of ftrl, adagrad-lazy and lbfgs. Using 0.00001 by default. \n"
+"                                                                         \n"
+"  -lambda_2 <lambda_2> :  L2 regular of ftrl. Using 0.00002 by default. \n"
+"                                                                         \n"
+"  -sqrt <precision>    :  Precision of the 1/sqrt() of adagrad, which can be 'fast' (approximate), \n"
+"                          'newton' (approximate with one newton step) or 'exact'. \n"
+"                          Using 'fast' by default. \n"
+"                                                                         \n"
 "  -u <model_scale>     :  Hyper param used for init model parameters. Using 0.66 by default. \n"
 "                                                                             \n"
+"  -seed <number>       :  Random seed of the initial model, which is the same for any number of \n"
+"                          threads. Using 2018 by default. \n"
+"                                                                             \n"
 "  -e <epoch_number>    :  Number of epoch for training. Using 10 by default. \n"
 "                                                                              \n"
+"  -sample_size <rows>  :  Number of rows of each batch of training, or 'auto' for choosing it by \n"
+"                          the rows/sec of the first batches of the in-memory training, within \n"
+"                          a bounded memory of each batch. Using 20000 by default. \n"
+"                                                                              \n"
 "  -f <fold_number>     :  Number of folds for cross-validation. Using 5 by default. \n"
 "                                                                                   \n"
+"  -cv_jobs <number>    :  Number of the folds of the in-memory cross-validation that are trained at \n"
+"                          the same time, each by its share of the threads and by its own model. \n"
+"                          Using 1 (the folds one by one) by default. \n"
+"                                                                   \n"
+"  -w <shuffle_window>  :  Number of blocks mixed in the shuffle buffer of on-disk training. \n"
+"                          Using 4 by default. We can close the shuffle by setting this value to 0. \n"
+"                                                                                            \n"
+"  -shuffle_block <rows> :  Shuffle the blocks of contiguous rows, and the rows within each block, \n"
+"                          instead of all the rows, so each epoch reads the data one block at a \n"
+"                          time. The on-disk training uses the blocks of its binary file in place \n"
+"                          of the shuffle window. Using 0 (the full shuffle) by default. \n"
+"                                                                                            \n"
+"  -pipe <depth>        :  Number of buffers in the ring between the prefetch thread and the \n"
+"                          trainer of on-disk training, so that up to depth - 1 blocks are read \n"
+"                          and decoded ahead of the computation. Using 2 by default. \n"
+"                                                                                            \n"
+"  -io_depth <depth>    :  Number of the reads of the blocks of on-disk training kept in flight \n"
+"                          by io_uring, which falls back to pread() if the kernel does not \n"
+"                          support it. Using 0 (the buffered reads) by default. \n"
+"                                                                                            \n"
+"  --direct-io          :  Read the blocks of on-disk training with O_DIRECT, so the scan of a \n"
+"                          huge file does not fill the page cache of the host. \n"
+"                                                                                            \n"
+"  --spill              :  Parse the txt file in the first epoch of on-disk training and spill it \n"
+"                          into the binary file, which is read by the next epochs, instead of \n"
+"                          converting the txt file before the training. It needs the model size \n"
+"                          before parsing, i.e., the -hash without ffm. \n"
+"                                                                                            \n"
+"  -mem_budget <MB>     :  The memory budget of the data. The size of the parsed data is estimated \n"
+"                          from the file size (or the header of its binary file), and the training \n"
+"                          switches to --disk (with --spill for -hash without ffm) if it is larger \n"
+"                          than the budget. Using half of the memory limit of the cgroup in a \n"
+"                          container, or no budget, by default. \n"
+"                                                                                            \n"
+"  -hash <bucket>       :  Hash the feature ids into the given number of buckets, so that the \n"
+"                          model size is fixed however large the feature ids are. The same value \n"
+"                          should be used in prediction. Using 0 (no hashing) by default. \n"
+"                          The raw categorical data of 'y field=token field=token ...' (e.g., \n"
+"                          '1 0=user_42 1=www.a.com') is hashed at parsing time, which needs it. \n"
+"                                                                                            \n"
+"  -cross <pairs>       :  Add the hashed crosses of the features of the pairs of fields, e.g., \n"
+"                          '0:1,0:2', to the rows of the libffm or token file at parsing time, \n"
+"                          so the txt file keeps the raw features. It needs -hash, and the pairs \n"
+"                          are stored alongside the model file for prediction. \n"
+"                                                                                            \n"
+"  -neg_sample <rate>   :  Keep the given rate (0, 1] of the negative rows of the training set \n"
+"                          at loading time, e.g., 0.1 for the CTR data. The kept negatives are \n"
+"                          weighted by 1 / rate in the gradient and the train loss, so that the \n"
+"                          predictions stay calibrated. Using 1 (no sampling) by default. \n"
+"                                                                                            \n"
+"  -part_decay <rate>   :  Weight the rows of the older part files of the training set (the list, \n"
+"                          the directory or the glob of the parts, e.g., one file per day in the \n"
+"                          order of the days) by the rate (0, 1] per part, so the i-th of n parts \n"
+"                          has the weight rate^(n-1-i). Each part keeps its own binary cache, so \n"
+"                          only the new parts of a sliding window are parsed. Using 1 by default. \n"
+"                                                                                            \n"
+"  -heads <n>           :  Train n heads of the stages of a funnel on the same rows in one pass, \n"
+"                          e.g., 2 for the CTR and the CTCVR of the labels 0 (no click), 1 (click) \n"
+"                          and 2 (conversion). The head k is trained on the label y >= k, and is \n"
+"                          saved to <model_file> for k = 1 and to <model_file>.head<k> for the \n"
+"                          others. Using 1 (one model of the labels) by default. \n"
+"                                                                                            \n"
+"  -p <prefetch_distance> :  Number of feature pairs ahead whose latent vectors are prefetched \n"
+"                          by the ffm kernel. Using 0 (no prefetch) by default. \n"
+"                                                                               \n"
+"  --gpu                :  Train the latent factor of ffm on the GPU in batches of rows, whose \n"
+"                          parameters stay in the pinned memory of the host. It needs xLearn built \n"
+"                          by cmake -DXLEARN_CUDA=ON, and the default latent layout. \n"
+"                                                                               \n"
+"  --tune-kernel        :  Time the kernel variants of the score (instruction set, specialized K \n"
+"                          and -p) on the first rows of the training set, and train with the \n"
+"                          fastest one. The choice is cached by the CPU model and the config in \n"
+"                          $XLEARN_TUNE_CACHE or ~/.cache/xlearn/kernels. XLEARN_KERNEL and a \n"
+"                          given -p are kept. \n"
+"                                                                               \n"
+"  -nthread <number>    :  Number of threads for training and parsing. Using \n"
+"                          the number of CPUs of -affinity, or the CPUs of the process (bounded by \n"
+"                          the CPU quota of its cgroup in a container) by default. \n"
+"                                                                               \n"
+"  -affinity <cpus>     :  Pin the threads to the CPUs, which can be a CPU list like '0-3,8', \n"
+"                          'physical' (one hardware thread of each core), 'node:<n>' (the CPUs \n"
+"                          of NUMA node n) or 'node:<n>:physical'. No pinning by default. \n"
+"                                                                               \n"
+"  -numa <policy>       :  Place the pages of the model on the NUMA nodes before they are initialized: \n"
+"                          'interleave' (the pages are interleaved over the nodes), 'partition' (one \n"
+"                          contiguous feature range of each node) or 'none' (the first touch of the \n"
+"                          main thread). Using 'none' by default. \n"
+"                                                                               \n"
+"  -hugepage <policy>   :  Back the latent factor of the model and the in-memory data by 2 MB huge \n"
+"                          pages: 'thp' (the transparent huge pages by madvise), 'explicit' (the \n"
+"                          reserved huge pages of vm.nr_hugepages, or 'thp' if there are not enough \n"
+"                          pages) or 'none'. Using 'none' by default. \n"
+"                                                                               \n"
+"  -param_file <path>   :  Keep the parameters of the model in a memory-mapped file at the path for \n"
+"                          the model that is larger than the memory, whose pages are loaded by the \n"
+"                          system when they are used. Using --freq-order keeps the hot features in \n"
+"                          the contiguous pages. The file is removed once it is mapped, so its \n"
+"                          space is freed when xLearn exits. \n"
+"                                                                               \n"
+"  -model_shards <n>    :  Split the model into the shards of the feature ranges, each of which has \n"
+"                          its own pages (and huge pages of -hugepage). Using 1 (no shard) by default. \n"
+"                                                                               \n"
 "  --disk               :  Open on-disk training for limited memory. \n"
 "                                                                    \n"
+"  --remap              :  Re-index the feature ids that occur in the training set into a dense \n"
+"                          range, so that the model is sized by the number of such features. The \n"
+"                          map is stored in <model_file>.dict and used by prediction. \n"
+"                                                                    \n"
+"  --freq-order         :  Re-index the feature ids (as --remap) in the order of descending \n"
+"                          frequency in the training set, so that the latent vectors of the \n"
+"                          hottest features are contiguous in memory. \n"
+"                                                                    \n"
+"  -min_count <n>       :  Drop the features that occur less than n times in the training set, \n"
+"                          which are counted at loading time, so the model only has the other \n"
+"                          features. Implies --freq-order. Using 0 (no filter) by default. \n"
+"                                                                    \n"
+"  --oov                :  Map the features dropped by -min_count and the unknown features of \n"
+"                          prediction to one shared OOV (out of vocabulary) feature. \n"
+"                                                                    \n"
+"  --sparse-latent      :  Only allocate the latent vectors of FFM of the (feature, field) pairs \n"
+"                          that occur in the training set, which are found in a pass over the \n"
+"                          data. The model file has the dense layout. \n"
+"                                                                    \n"
+"  --latent-layout <layout> :  The layout of the latent blocks of FFM in memory. 'interleaved' \n"
+"                          puts each SIMD chunk of weights next to its optimizer cache, and \n"
+"                          'split' puts all the weights of a block before the caches, so the \n"
+"                          score only reads the weights. The model file is always interleaved. \n"
+"                          Using 'interleaved' by default. \n"
+"                                                                    \n"
+"  --cache-precision <type> :  Store the adagrad caches of the latent factor of FFM in 'fp32', \n"
+"                          'fp16', 'bf16' or 'log8' (8-bit log-quantized), which are decoded in \n"
+"                          the registers of the update. The reduced caches use the split layout \n"
+"                          and shrink the latent factor to 3/4 (16 bits) or 5/8 (8 bits). The \n"
+"                          model file has the fp32 caches. Using 'fp32' by default. \n"
+"                                                                    \n"
+"  --shared-cache       :  Keep one adagrad cache per latent vector of FFM, which adds the mean \n"
+"                          squared gradient of the vector, rather than one cache per weight. \n"
+"                          The block of a vector shrinks from 2*k to k+4 floats. \n"
+"                                                                    \n"
+"  -field_pairs <file>  :  Only the field pairs of the text file interact in FFM, one pair per line, \n"
+"                          e.g., '0 3'. The other pairs are neither computed nor allocated, which \n"
+"                          implies --sparse-latent. \n"
+"                                                                    \n"
+"  -learn_field_pairs <file> :  Write the strongest field pairs of the trained FFM model to the file \n"
+"                          for -field_pairs, ranked by the sum of |<V_i_fj, V_j_fi> * x_i * x_j| \n"
+"                          over the training set, e.g., after one epoch (-e 1). \n"
+"                                                                    \n"
+"  -field_pair_ratio <ratio> :  The ratio (0, 1] of the observed field pairs kept by \n"
+"                          -learn_field_pairs. Using 0.5 by default. \n"
+"                                                                    \n"
+"  -field_k <file|auto> :  The K of the latent vectors of each field in FFM, one 'field K' per \n"
+"                          line, e.g., '3 4', and the other fields have the K of -k. 'auto' gives \n"
+"                          each field 6 * n^(1/4) of its n distinct features in the training set, \n"
+"                          at most -k. A pair of fields uses the smaller K of the two. The model \n"
+"                          file has the dense layout of -k. \n"
+"                                                                    \n"
+"  -field_groups <file> :  The fields of a group share one latent vector of each feature in FFM, \n"
+"                          one 'field group' per line, e.g., '5 0', and the other fields are in \n"
+"                          one more group. The model grows with the groups instead of the fields, \n"
+"                          and the groups are stored alongside the model file for prediction. \n"
+"                                                                    \n"
+"  -learn_field_groups <file> :  Write the groups of the fields of the trained FFM model to the \n"
+"                          file for -field_groups, which are clustered by the latent vectors \n"
+"                          of the fields, e.g., after one epoch (-e 1). \n"
+"                                                                    \n"
+"  -num_field_groups <n> :  Number of the groups of -learn_field_groups. Using 8 by default. \n"
+"                                                                    \n"
+"  --dedup              :  Collapse the rows of the training set that have the same features \n"
+"                          and label into one row weighted by their number, so each epoch only \n"
+"                          processes the unique rows. \n"
+"                                                                    \n"
+"  --shuffle-copy       :  Write the rows of the training set in the shuffled order of the next \n"
+"                          epoch into a contiguous copy in the background, so each epoch reads \n"
+"                          its rows in sequence. It costs two more copies of the training set. \n"
+"                                                                    \n"
+"  --group-rows         :  Place the rows of each batch of the training set that share a hot \n"
+"                          feature into the rows of the same thread, so the threads of 'hogwild' \n"
+"                          write fewer shared parameters. The hot feature of each row is found \n"
+"                          once when the data is loaded. \n"
+"                                                                    \n"
 "  --cv                 :  Open cross-validation in training tasks. \n"
 "                                                                   \n"
-"  --es                 :  Open early-stopping in training. \n"
+"  --es                 :  Open early-stopping in training. The best model on the test set is \n"
+"                          kept in memory and restored at the end of training. \n"
 "                                                           \n"
+"  -sw <stop_window>    :  Early-stopping stops the training if the test metric has not been \n"
+"                          improved for stop_window validations (epochs, or -valid_batches \n"
+"                          batches). Using 2 by default. \n"
+"                                                                               \n"
+"  -valid_batches <N>   :  Also validate the model every N batches of each epoch, and early-stopping \n"
+"                          can stop and restore the model at such a batch. Using 0 (the end of each \n"
+"                          epoch only) by default. \n"
+"                                                                               \n"
+"  -async-valid <N>     :  Validate a copy of the model weights by N background threads, and \n"
+"                          the next epoch starts at once. Early-stopping uses the result after \n"
+"                          the next epoch. Using 0 (validate before the next epoch) by default. \n"
+"                                                                                            \n"
+"  -ckpt <N>            :  Save a weights-only checkpoint of the model to <model_file>.ckpt every \n"
+"                          N epochs. The weights are copied at the end of the epoch and written \n"
+"                          in the background, and -pre resumes the training from it with new \n"
+"                          gradient caches. Using 0 (no checkpoint) by default. \n"
+"                                                                            \n"
+"  -ckpt_min <minutes>  :  Save the checkpoint (as -ckpt) at the end of the first epoch after the \n"
+"                          given minutes since the last checkpoint. Using 0 (never) by default. \n"
+"                                                                                           \n"
+"  --delta-ckpt         :  Save the checkpoints after the first one as the deltas of the features \n"
+"                          updated since the last checkpoint, to <model_file>.ckpt.delta.<N>, \n"
+"                          which xlearn_predict applies to the first checkpoint (-delta). \n"
+"                                                                                           \n"
+"  --resume             :  Save the state of the training to <model_file>.resume at SIGTERM or \n"
+"                          SIGINT after the current batch, e.g., on a preemptible node, and exit \n"
+"                          with 143. The next run of the same command continues from the state \n"
+"                          at the same row, and removes it at the end. Only the in-memory training \n"
+"                          without --cv, --shuffle-copy, -async-valid, -loss_sample, -sample_size \n"
+"                          auto, --sparse-latent, -ps, -ring or -shm is supported. \n"
+"                                                                                           \n"
+"  -budget_min <minutes> :  Finish the training job in the wall-clock minutes. The next epoch is \n"
+"                          started only if the time left holds a part of it by the time of the \n"
+"                          last epoch, and the last epoch stops in time for its validation, so \n"
+"                          it may train on a part of the data. The model of the best test metric \n"
+"                          is kept, as --es does. Using 0 (no budget) by default. \n"
+"                                                                                           \n"
+"  --online             :  Train the model continuously on an unbounded stream: the stdin ('-'), \n"
+"                          e.g., a socket piped by another program, or a txt file that is tailed \n"
+"                          as it grows. The rows are trained soon after they arrive, in one pass, \n"
+"                          and -ckpt <N> saves the checkpoint every N batches (with -ckpt_min and \n"
+"                          --delta-ckpt as usual). The pass ends at the end of the stdin, or at \n"
+"                          SIGTERM or SIGINT, and then the model is saved. The ffm model needs \n"
+"                          -pre or -field_groups for its fields. The model of -hash has a fixed \n"
+"                          size, and without -hash it grows as the new feature ids arrive, up to \n"
+"                          -max_feat. The rows out of the features or fields are dropped. \n"
+"                                                                                           \n"
+"  -max_feat <N>        :  Max number of features of the growing model of --online without -hash, \n"
+"                          whose address space is reserved and the memory is allocated as the \n"
+"                          model grows. Using 67108864 (2^26) by default. \n"
+"                                                                                           \n"
+"  -admit <n>           :  Give a feature of the --online training its own parameters only after \n"
+"                          it has been seen n times, and map the occurrences before to one shared \n"
+"                          OOV feature, so the long-tail ids of the stream do not claim the model. \n"
+"                          The counts are stored in <model_file>.admit and used by prediction. \n"
+"                          Using 0 (every feature is admitted) by default. \n"
+"                                                                                           \n"
+"  -admit_mb <MB>       :  Memory of the counters of -admit, whose collisions can admit a feature \n"
+"                          early. Using 16 MB by default. \n"
+"                                                                                           \n"
+"  -ttl_min <minutes>   :  Evict the features of the --online training that are not updated for \n"
+"                          this time-to-live, e.g., 1440 for one day, and reset their parameters, \n"
+"                          so the hashed slots of the stale ids are reused by the new ones. The \n"
+"                          features are swept in the background. Using 0 (no eviction) by default. \n"
+"                                                                                           \n"
+"  -train_sample <frac> :  Evaluate the train loss and metric of each epoch on a fixed random sample \n"
+"                          of this fraction (0 ~ 1] of the train rows, e.g., 0.01, and show the \n"
+"                          standard error of the loss. Using 0 (the running loss of the update \n"
+"                          pass) by default. \n"
+"                                                                                           \n"
+"  -loss_sample <rate>  :  Update about this rate (0 ~ 1] of the train rows in each epoch after the \n"
+"                          first, which are sampled by their recent loss and weighted by the inverse \n"
+"                          of the probability. Using 0 (all the rows) by default. \n"
+"                                                                                           \n"
+"  -ps <servers>        :  Train as a worker of the parameter servers 'host:port,host:port,...' (see \n"
+"                          xlearn_server), which store the model sharded by the feature id. Each \n"
+"                          worker trains its own shard of the data, and the worker 0 saves the model. \n"
+"                                                                                           \n"
+"  -ring <nodes>        :  Train as a node of the data-parallel training 'host:port,host:port,...', \n"
+"                          where each node trains a full model on its own shard of the data, and \n"
+"                          the models are averaged by ring allreduce. The node 0 saves the model. \n"
+"                                                                                           \n"
+"  -sync_batches <N>    :  Average the models of -ring every N batches, besides the end of each \n"
+"                          epoch. Using 0 (the end of each epoch only) by default. \n"
+"                                                                                           \n"
+"  -worker <id>         :  The id of this worker of -ps (or the node of -ring, or the process of -shm) \n"
+"                          in [0, num_workers). \n"
+"                          Using 0 by default. \n"
+"                                                                                           \n"
+"  -num_workers <N>     :  Number of the workers of -ps (or the processes of -shm). Using 1 by default. \n"
+"                                                                                           \n"
+"  -staleness <N>       :  A worker of -ps waits before its batch if it is more than N batches ahead \n"
+"                          of the slowest worker. Using 0 (synchronous batches) by default. \n"
+"                                                                                           \n"
+"  -ps_quant <type>     :  Quantization of the deltas pushed by -ps: 'fp32', 'fp16' or 'int8' (a scale \n"
+"                          per row). The error is added to the next push of the row. Using 'fp32' \n"
+"                          (lossless) by default. \n"
+"                                                                                           \n"
+"  -shm <name>          :  Train as a process of the model in the shared memory of this host, where \n"
+"                          -num_workers processes (-worker 0 ~ N-1) update the model without locks, \n"
+"                          and each process has its own threads. The process 0 initializes and saves \n"
+"                          the model. \n"
+"                                                                                           \n"
+"  --shard              :  Each worker of -ps (or node of -ring, or process of -shm) reads its own \n"
+"                          shard of the shared training file, i.e., a newline-aligned byte range of \n"
+"                          the txt file or the contiguous rows of its binary cache, instead of a file \n"
+"                          split ahead. \n"
+"                                                                                           \n"
 "  --no-norm            :  Close instance-wise normalization.  \n"
 "                                                              \n"
+"  --compact            :  Store the in-memory data and the binary cache in compact encoding, \n"
+"                          which saves memory for the data with binary feature values. \n"
+"                                                                                      \n"
+"  --sort-nodes         :  Sort the nodes of each row by field and then by feature once when the \n"
+"                          text file is parsed, which is kept in the binary cache. So the ffm \n"
+"                          score loads the latent vectors of the same field together. \n"
+"                                                                                      \n"
+"  --dense              :  Store the columns of the csv file in a dense block instead of the \n"
+"                          nodes, which needs 1/3 memory and no feature index in the linear \n"
+"                          and fm score. All the lines must have the same number of columns. \n"
+"                                                                                      \n"
+"  --compress           :  Write the binary cache of in-memory training in block-compressed \n"
+"                          format, which reads fewer bytes from disk. \n"
+"                                                                     \n"
+"  --full-hash          :  Validate the binary cache by the hash of the whole txt file. By default, \n"
+"                          the cache is validated by the size, mtime, inode and a few sampled \n"
+"                          blocks of the txt file, which never reads the whole file. \n"
+"                                                                                    \n"
+"  -cache_dir <dir>     :  Keep the binary caches of in-memory training in the shared directory \n"
+"                          instead of <file>.bin, named by the hash of the content of the txt \n"
+"                          file. So the read-only data is cached, and the copies of the same \n"
+"                          data share one cache. \n"
+"                                                \n"
+"  -cache_mb <size>     :  Remove the least recently used caches when the -cache_dir is larger \n"
+"                          than the given MB. Using 0 (no limit) by default. \n"
+"                                                                           \n"
+"  --weights-only       :  Save the model checkpoint without the gradient caches, which is about \n"
+"                          1/2 size and can only be used by prediction. \n"
+"                                                                        \n"
+"  --mmap-model         :  Save the model in the page-aligned memory-mappable format, which is \n"
+"                          mapped by xlearn_predict in read-only mode, so the prediction starts \n"
+"                          instantly and the predictors share the same physical pages. \n"
+"                                                                                      \n"
+"  --sparse-model       :  Save only the weights of the features that are updated in training, \n"
+"                          which is much smaller for a large number of features, and the model \n"
+"                          can only be used by prediction. \n"
+"                                                                                      \n"
+"  --chunked-model      :  Save the model and the checkpoints in the chunked format, which is \n"
+"                          written and loaded by all the threads, and each chunk has a CRC32C \n"
+"                          checksum, so a corrupted model file fails to load. \n"
+"                                                                                      \n"
+"  -metrics <file_path> :  Write the metrics of the training to the file in NDJSON (one JSON \n"
+"                          object per line): the hyper-parameters, the memory, and the loss, \n"
+"                          metric, time, throughput and thread load of each epoch. \n"
+"                                                                                      \n"
+"  -trace <file_path>   :  Write the timeline of the phases, the worker tasks and the reader, \n"
+"                          validation and checkpoint threads to the file in the Chrome trace \n"
+"                          format, which can be opened by chrome://tracing or Perfetto. \n"
+"                                                                                      \n"
 "  --quiet              :  Don't print any evaluation information during the training. \n"
 "                          Just train the model quietly. \n"
 "----------------------------------------------------------------------------------------------\n"
@@ -98,6 +526,9 @@ std::string Checker::option_help() const {
 "USAGE: \n"
 "     xlearn_predict [ predict_file_path ] [ options ] \n"
 "                                                     \n"
+"     The predict_file_path '-' reads the predict data from stdin, e.g., \n"
+"     featgen | xlearn_predict - --stream [ options ] \n"
+"                                                     \n"
 "OPTIONS: \n"
 "  -m <model_file_path>  :  Path of the trained model file. \n"
 "                           Using './xlearn_model' by default. \n"
@@ -108,6 +539,60 @@ std::string Checker::option_help() const {
 "  -l <log_file_path>    :  Path of the log file. Using './xlearn_log' by default. \n"
 "                           If we set this value to 'none', the xLearn will not output \n"
 "                           any log information during the prediction. \n"
+"                                                                          \n"
+"  -p <prefetch_distance> :  Number of feature pairs ahead whose latent vectors are prefetched \n"
+"                           by the ffm kernel. Using 0 (no prefetch) by default. \n"
+"                                                                               \n"
+"  --gpu                 :  Score the latent factor of the ffm model on the GPU, which holds a copy \n"
+"                           of the fp32 latent factor. It needs xLearn built by cmake -DXLEARN_CUDA=ON. \n"
+"                                                                               \n"
+"  -hash <bucket>        :  Number of buckets of the feature hashing, which should be the same \n"
+"                           as the one in training. Using 0 (no hashing) by default. \n"
+"                                                                               \n"
+"  -nthread <number>     :  Number of threads for prediction and parsing. Using \n"
+"                           the number of CPUs of -affinity, or the CPUs of the process (bounded by \n"
+"                           the CPU quota of its cgroup in a container) by default. \n"
+"                                                                               \n"
+"  -affinity <cpus>      :  Pin the threads to the CPUs, which can be a CPU list like '0-3,8', \n"
+"                           'physical' (one hardware thread of each core), 'node:<n>' (the CPUs \n"
+"                           of NUMA node n) or 'node:<n>:physical'. No pinning by default. \n"
+"                                                                               \n"
+"  -v <latent_type>      :  Storage of the latent factor of fm and ffm in prediction, which \n"
+"                           could be 'fp32', 'fp16', 'bf16' or 'int8'. The 16-bit types use 1/4 \n"
+"                           memory of the latent factor, and 'int8' uses about 1/8. \n"
+"                           Using 'fp32' by default. \n"
+"                                                                               \n"
+"  --stream              :  Parse and predict the predict file chunk by chunk with bounded memory, \n"
+"                           and never write the binary cache, which is used by the one-shot \n"
+"                           prediction of a very large file. The order of output is kept. \n"
+"                                                                               \n"
+"  --binary-out          :  Write the predictions as raw float32 values (in the byte order of \n"
+"                           current machine) rather than one value per line in text. \n"
+"                                                                               \n"
+"  --dense               :  Store the columns of the csv file in a dense block (see xlearn_train), \n"
+"                           which can be used by any linear and fm model. \n"
+"                                                                               \n"
+"  --lazy-model          :  Only load the features that occur in the predict file, which are \n"
+"                           counted in a first pass. This saves the memory of a large model for \n"
+"                           a small predict file, and pages of the memory-mappable model file \n"
+"                           of other features are never read. \n"
+"                                                                               \n"
+"  -delta <file_list>    :  Apply the delta files of xlearn_train --delta-ckpt to the model in \n"
+"                           the given order (separated by ','), e.g., model.ckpt.delta.1,\n"
+"                           model.ckpt.delta.2. The model cannot be memory-mappable or sparse. \n"
+"                                                                               \n"
+"  -ensemble <file_list> :  Score the predict file by these models (separated by ',') in the same \n"
+"                           pass as the model of -m, so the file is parsed once. The predictions \n"
+"                           of the i-th model are written to <output_file>.i. The models share \n"
+"                           the parsing of the -m model (its -hash, feature map, field groups \n"
+"                           and crosses), and they should have its number of features. \n"
+"                                                                               \n"
+"  --blend               :  Write the mean of the predictions of the -m model and the models of \n"
+"                           -ensemble to the output file, instead of one file per model. \n"
+"                                                                               \n"
+"  -trace <file_path>    :  Write the timeline of the phases, the worker tasks and the reader \n"
+"                           threads to the file in the Chrome trace format, which can be \n"
+"                           opened by chrome://tracing or Perfetto. \n"
 "----------------------------------------------------------------------------------------------\n"
     );
   }
@@ -127,24 +612,130 @@ void Checker::Initialize(bool is_train, int argc, char* argv[]) {
   if (is_train_) {
     menu_.push_back(std::string("-s"));
     menu_.push_back(std::string("-x"));
+    menu_.push_back(std::string("--exact-auc"));
     menu_.push_back(std::string("-t"));
     menu_.push_back(std::string("-m"));
+    menu_.push_back(std::string("-pre"));
+    menu_.push_back(std::string("-init"));
     menu_.push_back(std::string("-l"));
     menu_.push_back(std::string("-k"));
     menu_.push_back(std::string("-r"));
     menu_.push_back(std::string("-b"));
+    menu_.push_back(std::string("-opt"));
+    menu_.push_back(std::string("-thread_mode"));
+    menu_.push_back(std::string("-batch_size"));
+    menu_.push_back(std::string("-grain"));
+    menu_.push_back(std::string("-schedule"));
+    menu_.push_back(std::string("-alpha"));
+    menu_.push_back(std::string("-beta"));
+    menu_.push_back(std::string("-lambda_1"));
+    menu_.push_back(std::string("-lambda_2"));
+    menu_.push_back(std::string("-sqrt"));
     menu_.push_back(std::string("-u"));
+    menu_.push_back(std::string("-seed"));
     menu_.push_back(std::string("-e"));
+    menu_.push_back(std::string("-sample_size"));
     menu_.push_back(std::string("-f"));
+    menu_.push_back(std::string("-cv_jobs"));
+    menu_.push_back(std::string("-w"));
+    menu_.push_back(std::string("-shuffle_block"));
+    menu_.push_back(std::string("-pipe"));
+    menu_.push_back(std::string("-io_depth"));
+    menu_.push_back(std::string("--direct-io"));
+    menu_.push_back(std::string("--spill"));
+    menu_.push_back(std::string("-mem_budget"));
+    menu_.push_back(std::string("-hash"));
+    menu_.push_back(std::string("-cross"));
+    menu_.push_back(std::string("-neg_sample"));
+    menu_.push_back(std::string("-part_decay"));
+    menu_.push_back(std::string("-heads"));
+    menu_.push_back(std::string("-p"));
+    menu_.push_back(std::string("--gpu"));
+    menu_.push_back(std::string("--tune-kernel"));
+    menu_.push_back(std::string("-nthread"));
+    menu_.push_back(std::string("-affinity"));
+    menu_.push_back(std::string("-numa"));
+    menu_.push_back(std::string("-hugepage"));
+    menu_.push_back(std::string("-param_file"));
+    menu_.push_back(std::string("-model_shards"));
     menu_.push_back(std::string("--disk"));
+    menu_.push_back(std::string("--remap"));
+    menu_.push_back(std::string("--freq-order"));
+    menu_.push_back(std::string("-min_count"));
+    menu_.push_back(std::string("--oov"));
+    menu_.push_back(std::string("--sparse-latent"));
+    menu_.push_back(std::string("--latent-layout"));
+    menu_.push_back(std::string("--cache-precision"));
+    menu_.push_back(std::string("--shared-cache"));
+    menu_.push_back(std::string("-field_pairs"));
+    menu_.push_back(std::string("-learn_field_pairs"));
+    menu_.push_back(std::string("-field_pair_ratio"));
+    menu_.push_back(std::string("-field_k"));
+    menu_.push_back(std::string("-field_groups"));
+    menu_.push_back(std::string("-learn_field_groups"));
+    menu_.push_back(std::string("-num_field_groups"));
+    menu_.push_back(std::string("--dedup"));
+    menu_.push_back(std::string("--shuffle-copy"));
+    menu_.push_back(std::string("--group-rows"));
     menu_.push_back(std::string("--cv"));
     menu_.push_back(std::string("--es"));
+    menu_.push_back(std::string("-sw"));
+    menu_.push_back(std::string("-async-valid"));
+    menu_.push_back(std::string("-valid_batches"));
+    menu_.push_back(std::string("-ckpt"));
+    menu_.push_back(std::string("-ckpt_min"));
+    menu_.push_back(std::string("--delta-ckpt"));
+    menu_.push_back(std::string("--resume"));
+    menu_.push_back(std::string("-budget_min"));
+    menu_.push_back(std::string("--online"));
+    menu_.push_back(std::string("-admit"));
+    menu_.push_back(std::string("-admit_mb"));
+    menu_.push_back(std::string("-ttl_min"));
+    menu_.push_back(std::string("-max_feat"));
+    menu_.push_back(std::string("-train_sample"));
+    menu_.push_back(std::string("-loss_sample"));
+    menu_.push_back(std::string("-ps"));
+    menu_.push_back(std::string("-ring"));
+    menu_.push_back(std::string("-sync_batches"));
+    menu_.push_back(std::string("-worker"));
+    menu_.push_back(std::string("-num_workers"));
+    menu_.push_back(std::string("-staleness"));
+    menu_.push_back(std::string("-ps_quant"));
+    menu_.push_back(std::string("-shm"));
+    menu_.push_back(std::string("--shard"));
     menu_.push_back(std::string("--no-norm"));
+    menu_.push_back(std::string("--compact"));
+    menu_.push_back(std::string("--sort-nodes"));
+    menu_.push_back(std::string("--dense"));
+    menu_.push_back(std::string("--compress"));
+    menu_.push_back(std::string("--full-hash"));
+    menu_.push_back(std::string("-cache_dir"));
+    menu_.push_back(std::string("-cache_mb"));
+    menu_.push_back(std::string("--weights-only"));
+    menu_.push_back(std::string("--mmap-model"));
+    menu_.push_back(std::string("--sparse-model"));
+    menu_.push_back(std::string("--chunked-model"));
+    menu_.push_back(std::string("-metrics"));
+    menu_.push_back(std::string("-trace"));
     menu_.push_back(std::string("--quiet"));
   } else {  // for Predict
     menu_.push_back(std::string("-m"));
     menu_.push_back(std::string("-o"));
     menu_.push_back(std::string("-l"));
+    menu_.push_back(std::string("-p"));
+    menu_.push_back(std::string("--gpu"));
+    menu_.push_back(std::string("-hash"));
+    menu_.push_back(std::string("-nthread"));
+    menu_.push_back(std::string("-affinity"));
+    menu_.push_back(std::string("-v"));
+    menu_.push_back(std::string("--stream"));
+    menu_.push_back(std::string("--binary-out"));
+    menu_.push_back(std::string("--dense"));
+    menu_.push_back(std::string("--lazy-model"));
+    menu_.push_back(std::string("-delta"));
+    menu_.push_back(std::string("-ensemble"));
+    menu_.push_back(std::string("--blend"));
+    menu_.push_back(std::string("-trace"));
   }
   // Get the user input
   for (int i = 0; i < argc; ++i) {
@@ -176,12 +767,45 @@ bool Checker::Check(HyperParam& hyper_param) {
 }
 
 // Check options for training tasks
+// The txt file, or the list, the directory or the glob of
+// the part files (see ExpandFileList()), which all exist
+static bool data_exist(const std::string& spec, size_t* num_file) {
+  *num_file = 1;
+  if (IsStdin(spec)) { return true; }
+  std::vector<std::string> files;
+  if (!ExpandFileList(spec, &files)) { return false; }
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!FileExist(files[i].c_str())) { return false; }
+  }
+  *num_file = files.size();
+  return true;
+}
+
+// The estimated bytes of the in-memory data of the txt file
+// or of the part files (see InmemReader::EstimateMemory())
+static bool estimate_data(const std::string& spec,
+                          bool compact,
+                          uint64* bytes) {
+  *bytes = 0;
+  std::vector<std::string> files;
+  if (IsStdin(spec) || !ExpandFileList(spec, &files)) { return false; }
+  for (size_t i = 0; i < files.size(); ++i) {
+    uint64 size = 0;
+    if (!InmemReader::EstimateMemory(files[i], compact, &size)) {
+      return false;
+    }
+    *bytes += size;
+  }
+  return true;
+}
+
 bool Checker::check_train_options(HyperParam& hyper_param) {
   bool bo = true;
   /*********************************************************
    *  Check the path of train file                         *
    *********************************************************/
-  if (FileExist(args_[1].c_str())) {
+  size_t num_train_file = 1;
+  if (data_exist(args_[1], &num_train_file)) {
     hyper_param.train_set_file = std::string(args_[1]);
   } else {
     printf("[Error] Training data file: %s does not exist \n",
@@ -196,17 +820,19 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
   for (int i = 0; i < list.size(); ) {
     if (list[i].compare("-s") == 0) {
       int value = atoi(list[i+1].c_str());
-      if (value < 0 || value > 6) {
-        printf("[Error] -s can only be [0 - 6] : \n"
+      if (value < 0 || value > 8) {
+        printf("[Error] -s can only be [0 - 8] : \n"
                "  for classification task \n"
                "    0 -- logistic regression (LR) \n"
                "    1 -- linear support vectors machine (SVM) \n"
                "    2 -- factorization machines (FM) \n"
                "    3 -- field-aware factorization machines (FFM) \n"
+               "    7 -- higher-order factorization machines (HOFM) \n"
                "  for regression task \n"
                "    4 -- linear regression (LR) \n"
                "    5 -- factorization machines (FM) \n"
-               "    6 -- field-aware factorization machines (FFM) \n");
+               "    6 -- field-aware factorization machines (FFM) \n"
+               "    8 -- higher-order factorization machines (HOFM) \n");
         bo = false;
       } else {
         if (value == 0) {
@@ -230,27 +856,40 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         } else if (value == 6) {
           hyper_param.loss_func = "squared";
           hyper_param.score_func = "ffm";
+        } else if (value == 7) {
+          hyper_param.loss_func = "cross-entropy";
+          hyper_param.score_func = "hofm";
+        } else if (value == 8) {
+          hyper_param.loss_func = "squared";
+          hyper_param.score_func = "hofm";
         }
       }
       i += 2;
     } else if (list[i].compare("-x") == 0) {
-      if (list[i+1].compare("acc") != 0 &&
-          list[i+1].compare("prec") != 0 &&
-          list[i+1].compare("recall") != 0 &&
-          list[i+1].compare("f1") != 0 &&
-          list[i+1].compare("auc") != 0 &&
-          list[i+1].compare("mae") != 0 &&
-          list[i+1].compare("mape") != 0) {
-        printf("[Error] Unknow metric : %s \n"
-               " -x can only be 'acc', 'prec', 'recall', "
-               "'f1', 'mae', or 'mape' \n", list[i+1].c_str());
-        bo = false;
-      } else {
+      std::vector<std::string> names;
+      SplitStringUsing(list[i+1], ",", &names);
+      bool known = !names.empty();
+      for (size_t j = 0; j < names.size(); ++j) {
+        if (!Metric::IsMetric(names[j])) {
+          printf("[Error] Unknow metric : %s \n"
+                 " -x can only be 'acc', 'prec', 'recall', 'f1', "
+                 "'auc', 'logloss', 'mae', or 'mape', or a list of "
+                 "them separated by ',' \n", names[j].c_str());
+          known = false;
+        }
+      }
+      if (names.empty()) {
+        printf("[Error] Empty metric : %s \n", list[i+1].c_str());
+      }
+      if (known) {
         hyper_param.metric = list[i+1];
+      } else {
+        bo = false;
       }
       i += 2;
     } else if (list[i].compare("-t") == 0) {
-      if (FileExist(list[i+1].c_str())) {
+      size_t num_test_file = 1;
+      if (data_exist(list[i+1], &num_test_file)) {
         hyper_param.test_set_file = list[i+1];
       } else {
         printf("[Error] Test set file: %s dose not exists \n",
@@ -261,6 +900,24 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
     } else if (list[i].compare("-m") == 0) {
       hyper_param.model_file = list[i+1];
       i += 2;
+    } else if (list[i].compare("-pre") == 0) {
+      if (FileExist(list[i+1].c_str())) {
+        hyper_param.pre_model_file = list[i+1];
+      } else {
+        printf("[Error] Model file: %s dose not exists \n",
+               list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
+    } else if (list[i].compare("-init") == 0) {
+      if (FileExist(list[i+1].c_str())) {
+        hyper_param.init_model_file = list[i+1];
+      } else {
+        printf("[Error] Model file: %s dose not exists \n",
+               list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
     } else if (list[i].compare("-l") == 0) {
       hyper_param.log_file = list[i+1];
       i += 2;
@@ -297,6 +954,126 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.regu_lambda = value;
       }
       i += 2;
+    } else if (list[i].compare("-opt") == 0) {
+      if (list[i+1].compare("adagrad") != 0 &&
+          list[i+1].compare("ftrl") != 0 &&
+          list[i+1].compare("adagrad-lazy") != 0 &&
+          list[i+1].compare("als") != 0 &&
+          list[i+1].compare("lbfgs") != 0) {
+        printf("[Error] Unknow optimization method : %s \n"
+               " -opt can only be 'adagrad', 'ftrl', "
+               "'adagrad-lazy', 'als' or 'lbfgs' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.opt_method = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-thread_mode") == 0) {
+      if (list[i+1].compare("hogwild") != 0 &&
+          list[i+1].compare("local-bias") != 0 &&
+          list[i+1].compare("replica") != 0) {
+        printf("[Error] Unknow thread mode : %s \n"
+               " -thread_mode can only be 'hogwild', "
+               "'local-bias' or 'replica' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.thread_mode = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-batch_size") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 1) {
+        printf("[Error] Illegal -batch_size : '%i' \n"
+               " -batch_size must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.batch_size = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-grain") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -grain : '%i' \n"
+               " -grain must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.grain = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-schedule") == 0) {
+      if (list[i+1].compare("static") != 0 &&
+          list[i+1].compare("balanced") != 0 &&
+          list[i+1].compare("dynamic") != 0 &&
+          list[i+1].compare("steal") != 0) {
+        printf("[Error] Unknow schedule : %s \n"
+               " -schedule can only be 'static', 'balanced', "
+               "'dynamic' or 'steal' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.schedule = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-alpha") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0) {
+        printf("[Error] Illegal -alpha : '%f' \n"
+               " -alpha must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.alpha = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-beta") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -beta : '%f' \n"
+               " -beta must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.beta = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-lambda_1") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -lambda_1 : '%f' \n"
+               " -lambda_1 must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.lambda_1 = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-lambda_2") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -lambda_2 : '%f' \n"
+               " -lambda_2 must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.lambda_2 = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-sqrt") == 0) {
+      if (list[i+1].compare("fast") != 0 &&
+          list[i+1].compare("newton") != 0 &&
+          list[i+1].compare("exact") != 0) {
+        printf("[Error] Unknow sqrt precision : %s \n"
+               " -sqrt can only be 'fast', 'newton' or 'exact' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.sqrt_precision = list[i+1];
+      }
+      i += 2;
     } else if (list[i].compare("-u") == 0) {
       real_t value = atof(list[i+1].c_str());
       if (value <= 0) {
@@ -308,6 +1085,17 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.model_scale = value;
       }
       i += 2;
+    } else if (list[i].compare("-seed") == 0) {
+      long long value = atoll(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -seed : '%lld' \n"
+               " -seed must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.model_seed = value;
+      }
+      i += 2;
     } else if (list[i].compare("-e") == 0) {
       int value = atoi(list[i+1].c_str());
       if (value < 0) {
@@ -319,6 +1107,22 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.num_epoch = value;
       }
       i += 2;
+    } else if (list[i].compare("-sample_size") == 0) {
+      if (list[i+1].compare("auto") == 0) {
+        hyper_param.auto_sample_size = true;
+      } else {
+        int value = atoi(list[i+1].c_str());
+        if (value <= 0) {
+          printf("[Error] Illegal -sample_size : '%s' \n"
+                 " -sample_size must be greater than zero or 'auto' \n",
+                 list[i+1].c_str());
+          bo = false;
+        } else {
+          hyper_param.sample_size = value;
+          hyper_param.auto_sample_size = false;
+        }
+      }
+      i += 2;
     } else if (list[i].compare("-f") == 0) {
       int value = atoi(list[i+1].c_str());
       if (value < 0) {
@@ -330,122 +1134,1491 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
         hyper_param.num_folds = value;
       }
       i += 2;
-    } else if (list[i].compare("--disk") == 0) {
-      hyper_param.early_stop = true;
-      i += 1;
-    } else if (list[i].compare("--cv") == 0) {
-      hyper_param.cross_validation = true;
+    } else if (list[i].compare("-cv_jobs") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        printf("[Error] Illegal -cv_jobs : '%i' \n"
+               " -cv_jobs must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.cv_jobs = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-w") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -w : '%i' \n"
+               " -w must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.shuffle_window = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-shuffle_block") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -shuffle_block : '%i' \n"
+               " -shuffle_block must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.shuffle_block = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-pipe") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 2) {
+        printf("[Error] Illegal -pipe : '%i' \n"
+               " -pipe must be greater than or equal to 2 \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.pipeline_depth = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-io_depth") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -io_depth : '%i' \n"
+               " -io_depth must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.io_depth = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--direct-io") == 0) {
+      hyper_param.direct_io = true;
       i += 1;
-    } else if (list[i].compare("--es") == 0) {
-      hyper_param.early_stop = true;
+    } else if (list[i].compare("--spill") == 0) {
+      hyper_param.spill_disk = true;
       i += 1;
-    } else if (list[i].compare("--no-norm") == 0) {
-      hyper_param.norm = false;
+    } else if (list[i].compare("-mem_budget") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        printf("[Error] Illegal -mem_budget : '%i' \n"
+               " -mem_budget must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.mem_budget_mb = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-hash") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -hash : '%i' \n"
+               " -hash must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.hash_bucket = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-cross") == 0) {
+      std::vector<FieldCross> crosses;
+      if (ParseCrosses(list[i+1], &crosses)) {
+        hyper_param.cross_fields = list[i+1];
+      } else {
+        printf("[Error] Illegal -cross : '%s' \n"
+               " -cross must be the pairs of fields like '0:1,0:2' \n",
+               list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
+    } else if (list[i].compare("-neg_sample") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        printf("[Error] Illegal -neg_sample : '%f' \n"
+               " -neg_sample must be in (0, 1] \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.neg_sample = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-part_decay") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        printf("[Error] Illegal -part_decay : '%f' \n"
+               " -part_decay must be in (0, 1] \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.part_decay = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-heads") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 1 || value > kMaxHeads) {
+        printf("[Error] Illegal -heads : '%i' \n"
+               " -heads must be in [1, %d] \n",
+               value, kMaxHeads);
+        bo = false;
+      } else {
+        hyper_param.num_heads = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-p") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -p : '%i' \n"
+               " -p must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.prefetch_distance = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--gpu") == 0) {
+      hyper_param.use_gpu = true;
       i += 1;
-    } else if (list[i].compare("--quiet") == 0) {
-      hyper_param.quiet = true;
+    } else if (list[i].compare("--tune-kernel") == 0) {
+      hyper_param.tune_kernel = true;
       i += 1;
-    } else {  // no match
-      std::string similar_str;
-      ss.FindSimilar(list[i], menu_, similar_str);
-      printf("[Error] Unknow argument '%s'\n"
-             "  Do you mean '%s' ?\n",
-             list[i].c_str(),
-             similar_str.c_str());
-      bo = false;
-      if (list[i][1] == '-') {  // "--" options
-        i += 1;
-      } else {  // "-" options
-        i += 2;
+    } else if (list[i].compare("-nthread") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -nthread : '%i' \n"
+               " -nthread must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.thread_number = value;
       }
-    }
-  }
-  if (!bo) { return false; }
-  /*********************************************************
-   *  Check some warnings and conflict                     *
-   *********************************************************/
-  if (hyper_param.cross_validation &&
-     !hyper_param.test_set_file.empty()) {
-    printf("[Warning] -c (cross-validation) has be set, and "
-           "xLearn will ignore the test file: %s \n",
-           hyper_param.test_set_file.c_str());
-    hyper_param.test_set_file.clear();
-  }
-  if (hyper_param.early_stop &&
-      hyper_param.test_set_file.empty() &&
-     !hyper_param.cross_validation) {
-    printf("[Error] To use early-stop, you need to "
-           "assign a test set via '-t' option, or using "
-           "cross-validation. \n");
-    exit(0);
-  }
-  if (hyper_param.cross_validation &&
+      i += 2;
+    } else if (list[i].compare("-affinity") == 0) {
+      std::vector<int> cpus;
+      if (!GetAffinityCpus(list[i+1], &cpus)) {
+        printf("[Error] Illegal -affinity : %s \n"
+               " -affinity can be a CPU list like '0-3,8', 'physical', "
+               "'node:<n>' or 'node:<n>:physical' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.affinity = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-numa") == 0) {
+      if (list[i+1].compare("none") != 0 &&
+          list[i+1].compare("interleave") != 0 &&
+          list[i+1].compare("partition") != 0) {
+        printf("[Error] Unknow NUMA policy : %s \n"
+               " -numa can only be 'none', 'interleave' or 'partition' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.numa_policy = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-hugepage") == 0) {
+      if (!IsHugePagePolicy(list[i+1])) {
+        printf("[Error] Unknow huge page policy : %s \n"
+               " -hugepage can only be 'none', 'thp' or 'explicit' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.huge_page = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-param_file") == 0) {
+      hyper_param.param_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-model_shards") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 1) {
+        printf("[Error] Illegal -model_shards : '%i' \n"
+               " -model_shards must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.model_shards = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--remap") == 0) {
+      hyper_param.remap_feature = true;
+      i += 1;
+    } else if (list[i].compare("--freq-order") == 0) {
+      hyper_param.remap_feature = true;
+      hyper_param.freq_order = true;
+      i += 1;
+    } else if (list[i].compare("-min_count") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -min_count : '%i' \n"
+               " -min_count must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.min_count = value;
+        // The features are counted for the dense ids
+        if (value > 1) {
+          hyper_param.remap_feature = true;
+          hyper_param.freq_order = true;
+        }
+      }
+      i += 2;
+    } else if (list[i].compare("--oov") == 0) {
+      hyper_param.oov_feature = true;
+      i += 1;
+    } else if (list[i].compare("--sparse-latent") == 0) {
+      hyper_param.sparse_latent = true;
+      i += 1;
+    } else if (list[i].compare("--latent-layout") == 0) {
+      LatentLayout layout;
+      if (ParseLatentLayout(list[i+1], &layout)) {
+        hyper_param.latent_layout = list[i+1];
+      } else {
+        printf("[Error] Unknown latent layout: %s \n",
+               list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
+    } else if (list[i].compare("--cache-precision") == 0) {
+      if (list[i+1].compare("fp32") == 0 ||
+          list[i+1].compare("fp16") == 0 ||
+          list[i+1].compare("bf16") == 0 ||
+          list[i+1].compare("log8") == 0) {
+        hyper_param.cache_precision = list[i+1];
+      } else {
+        printf("[Error] --cache-precision can only be 'fp32', 'fp16', "
+               "'bf16' or 'log8': %s \n", list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
+    } else if (list[i].compare("--shared-cache") == 0) {
+      hyper_param.shared_cache = true;
+      i += 1;
+    } else if (list[i].compare("-field_pairs") == 0) {
+      if (FileExist(list[i+1].c_str())) {
+        hyper_param.field_pairs_file = list[i+1];
+      } else {
+        printf("[Error] Field pairs file: %s dose not exists \n",
+               list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
+    } else if (list[i].compare("-learn_field_pairs") == 0) {
+      hyper_param.learn_field_pairs = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-field_pair_ratio") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        printf("[Error] Illegal -field_pair_ratio : '%f' \n"
+               " -field_pair_ratio must be in (0, 1] \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.field_pair_ratio = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-field_k") == 0) {
+      if (list[i+1].compare("auto") == 0 ||
+          FileExist(list[i+1].c_str())) {
+        hyper_param.field_k = list[i+1];
+      } else {
+        printf("[Error] Field K file: %s dose not exists \n",
+               list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
+    } else if (list[i].compare("-field_groups") == 0) {
+      if (FileExist(list[i+1].c_str())) {
+        hyper_param.field_groups_file = list[i+1];
+      } else {
+        printf("[Error] Field groups file: %s dose not exists \n",
+               list[i+1].c_str());
+        bo = false;
+      }
+      i += 2;
+    } else if (list[i].compare("-learn_field_groups") == 0) {
+      hyper_param.learn_field_groups = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-num_field_groups") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        printf("[Error] Illegal -num_field_groups : '%i' \n"
+               " -num_field_groups must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.num_field_groups = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--dedup") == 0) {
+      hyper_param.dedup_rows = true;
+      i += 1;
+    } else if (list[i].compare("--shuffle-copy") == 0) {
+      hyper_param.shuffle_copy = true;
+      i += 1;
+    } else if (list[i].compare("--group-rows") == 0) {
+      hyper_param.group_rows = true;
+      i += 1;
+    } else if (list[i].compare("--disk") == 0) {
+      hyper_param.on_disk = true;
+      i += 1;
+    } else if (list[i].compare("--cv") == 0) {
+      hyper_param.cross_validation = true;
+      i += 1;
+    } else if (list[i].compare("--es") == 0) {
+      hyper_param.early_stop = true;
+      i += 1;
+    } else if (list[i].compare("-sw") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        printf("[Error] Illegal -sw : '%i' \n"
+               " -sw must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.stop_window = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-async-valid") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -async-valid : '%i' \n"
+               " -async-valid must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.async_valid = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-valid_batches") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -valid_batches : '%i' \n"
+               " -valid_batches must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.valid_batches = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ckpt") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -ckpt : '%i' \n"
+               " -ckpt must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.checkpoint_epoch = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ckpt_min") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -ckpt_min : '%f' \n"
+               " -ckpt_min must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.checkpoint_minute = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--delta-ckpt") == 0) {
+      hyper_param.checkpoint_delta = true;
+      i += 1;
+    } else if (list[i].compare("--resume") == 0) {
+      hyper_param.resume = true;
+      i += 1;
+    } else if (list[i].compare("-budget_min") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -budget_min : '%f' \n"
+               " -budget_min must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.budget_minute = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--online") == 0) {
+      hyper_param.online = true;
+      i += 1;
+    } else if (list[i].compare("-admit") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0 || value > 255) {
+        printf("[Error] Illegal -admit : '%i' \n"
+               " -admit must be in [0, 255] \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.admit_count = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-admit_mb") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        printf("[Error] Illegal -admit_mb : '%i' \n"
+               " -admit_mb must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.admit_mb = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ttl_min") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -ttl_min : '%f' \n"
+               " -ttl_min must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.ttl_minute = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-max_feat") == 0) {
+      long long value = atoll(list[i+1].c_str());
+      if (value <= 0 || value > kUInt32Max / 2) {
+        printf("[Error] Illegal -max_feat : '%lld' \n"
+               " -max_feat must be in [1, %llu] \n",
+               value, (unsigned long long)(kUInt32Max / 2));
+        bo = false;
+      } else {
+        hyper_param.max_feature = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-train_sample") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0 || value > 1) {
+        printf("[Error] Illegal -train_sample : '%f' \n"
+               " -train_sample must be in [0, 1] \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.train_sample = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-loss_sample") == 0) {
+      real_t value = atof(list[i+1].c_str());
+      if (value < 0 || value > 1) {
+        printf("[Error] Illegal -loss_sample : '%f' \n"
+               " -loss_sample must be in [0, 1] \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.loss_sample = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--shard") == 0) {
+      hyper_param.shard_data = true;
+      i += 1;
+    } else if (list[i].compare("-ps") == 0) {
+      hyper_param.ps_servers = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-ring") == 0) {
+      hyper_param.ring_nodes = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-shm") == 0) {
+      hyper_param.shm_name = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-sync_batches") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -sync_batches : '%i' \n"
+               " -sync_batches must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.sync_batches = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-worker") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -worker : '%i' \n"
+               " -worker must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.worker_id = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-num_workers") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        printf("[Error] Illegal -num_workers : '%i' \n"
+               " -num_workers must be greater than zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.num_workers = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-staleness") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -staleness : '%i' \n"
+               " -staleness must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.staleness = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ps_quant") == 0) {
+      if (list[i+1].compare("fp32") != 0 &&
+          list[i+1].compare("fp16") != 0 &&
+          list[i+1].compare("int8") != 0) {
+        printf("[Error] Unknow quantization : %s \n"
+               " -ps_quant can only be 'fp32', 'fp16' or 'int8' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.ps_quant = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("--no-norm") == 0) {
+      hyper_param.norm = false;
+      i += 1;
+    } else if (list[i].compare("--compact") == 0) {
+      hyper_param.compact_data = true;
+      i += 1;
+    } else if (list[i].compare("--sort-nodes") == 0) {
+      hyper_param.sort_nodes = true;
+      i += 1;
+    } else if (list[i].compare("--dense") == 0) {
+      hyper_param.dense_data = true;
+      i += 1;
+    } else if (list[i].compare("--compress") == 0) {
+      hyper_param.compress_cache = true;
+      i += 1;
+    } else if (list[i].compare("--full-hash") == 0) {
+      hyper_param.full_hash_cache = true;
+      i += 1;
+    } else if (list[i].compare("-cache_dir") == 0) {
+      hyper_param.cache_dir = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-cache_mb") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -cache_mb : '%i' \n"
+               " -cache_mb must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.cache_mb = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--weights-only") == 0) {
+      hyper_param.weights_only_model = true;
+      i += 1;
+    } else if (list[i].compare("--mmap-model") == 0) {
+      hyper_param.mapped_model = true;
+      i += 1;
+    } else if (list[i].compare("--sparse-model") == 0) {
+      hyper_param.sparse_model = true;
+      i += 1;
+    } else if (list[i].compare("--chunked-model") == 0) {
+      hyper_param.chunked_model = true;
+      i += 1;
+    } else if (list[i].compare("-metrics") == 0) {
+      hyper_param.metrics_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-trace") == 0) {
+      hyper_param.trace_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("--exact-auc") == 0) {
+      hyper_param.exact_auc = true;
+      i += 1;
+    } else if (list[i].compare("--quiet") == 0) {
+      hyper_param.quiet = true;
+      i += 1;
+    } else {  // no match
+      std::string similar_str;
+      ss.FindSimilar(list[i], menu_, similar_str);
+      printf("[Error] Unknow argument '%s'\n"
+             "  Do you mean '%s' ?\n",
+             list[i].c_str(),
+             similar_str.c_str());
+      bo = false;
+      if (list[i][1] == '-') {  // "--" options
+        i += 1;
+      } else {  // "-" options
+        i += 2;
+      }
+    }
+  }
+  if (!bo) { return false; }
+  /*********************************************************
+   *  Check some warnings and conflict                     *
+   *********************************************************/
+  if (hyper_param.cross_validation &&
+     !hyper_param.test_set_file.empty()) {
+    printf("[Warning] -c (cross-validation) has be set, and "
+           "xLearn will ignore the test file: %s \n",
+           hyper_param.test_set_file.c_str());
+    hyper_param.test_set_file.clear();
+  }
+  if (IsStdin(hyper_param.train_set_file) && hyper_param.on_disk) {
+    printf("[Error] The data from stdin cannot be used by the "
+           "on-disk training. \n");
+    exit(0);
+  }
+  // The budget chooses the reader before the options
+  // that depend on --disk are checked. In a container of
+  // a memory limit, the default budget is half of the limit
+  int budget_mb = hyper_param.mem_budget_mb;
+  bool default_budget = false;
+  if (budget_mb == 0 && !hyper_param.on_disk) {
+    budget_mb = CgroupMemoryLimit() / 2 >> 20;
+    default_budget = budget_mb > 0;
+  }
+  if (budget_mb > 0 && !hyper_param.on_disk) {
+    uint64 train_bytes = 0, test_bytes = 0;
+    uint64 budget = (uint64)budget_mb << 20;
+    if (!estimate_data(hyper_param.train_set_file,
+                       hyper_param.compact_data, &train_bytes) ||
+        (!hyper_param.test_set_file.empty() &&
+         !estimate_data(hyper_param.test_set_file,
+                        hyper_param.compact_data, &test_bytes))) {
+      if (!default_budget) {
+        printf("[Warning] The size of the stdin or the compressed data "
+               "is unknown, and the -mem_budget is ignored. \n");
+      }
+    } else if (train_bytes + test_bytes <= budget) {
+      if (!default_budget) {
+        printf("The data takes about %.1f MB of the %d MB "
+               "budget, and it is loaded into memory. \n",
+               (train_bytes + test_bytes) / 1048576.0, budget_mb);
+      }
+    } else if (hyper_param.online || hyper_param.remap_feature ||
+               hyper_param.resume || hyper_param.cv_jobs > 1) {
+      printf("[Warning] The data takes about %.1f MB, which is larger "
+             "than the %d MB budget%s, but --online, --remap, --resume "
+             "and -cv_jobs need the in-memory training. \n",
+             (train_bytes + test_bytes) / 1048576.0, budget_mb,
+             default_budget ? " (half of the memory limit)" : "");
+    } else {
+      hyper_param.on_disk = true;
+      hyper_param.spill_disk = hyper_param.hash_bucket > 0 &&
+          hyper_param.score_func.compare("ffm") != 0;
+      printf("[Warning] The data takes about %.1f MB, which is larger "
+             "than the %d MB budget%s, and xLearn switches to the on-disk "
+             "training%s. \n",
+             (train_bytes + test_bytes) / 1048576.0, budget_mb,
+             default_budget ? " (half of the memory limit)" : "",
+             hyper_param.spill_disk ? " (--spill)" : "");
+    }
+  }
+  if (hyper_param.sparse_model && hyper_param.mapped_model) {
+    printf("[Error] --sparse-model cannot be used with "
+           "--mmap-model. \n");
+    exit(0);
+  }
+  if (hyper_param.chunked_model &&
+     (hyper_param.sparse_model || hyper_param.mapped_model)) {
+    printf("[Error] --chunked-model cannot be used with "
+           "--sparse-model or --mmap-model. \n");
+    exit(0);
+  }
+  if (hyper_param.oov_feature && hyper_param.min_count <= 1) {
+    printf("[Warning] The --oov is only used with -min_count "
+           "(greater than 1), and it is ignored. \n");
+    hyper_param.oov_feature = false;
+  }
+  if (hyper_param.remap_feature && hyper_param.on_disk) {
+    printf("[Error] --remap cannot be used by the "
+           "on-disk training. \n");
+    exit(0);
+  }
+  if (hyper_param.early_stop &&
+      hyper_param.test_set_file.empty() &&
+     !hyper_param.cross_validation) {
+    printf("[Error] To use early-stop, you need to "
+           "assign a test set via '-t' option, or using "
+           "cross-validation. \n");
+    exit(0);
+  }
+  if (hyper_param.valid_batches > 0 &&
+      hyper_param.test_set_file.empty() &&
+     !hyper_param.cross_validation) {
+    printf("[Warning] The -valid_batches needs a test set "
+           "via '-t' option, and it is ignored. \n");
+    hyper_param.valid_batches = 0;
+  }
+  if (hyper_param.cross_validation &&
       !hyper_param.model_file.empty()) {
     printf("[Warning] Training in cross-validation and will "
            "not dump the final model checkpoint. \n");
     hyper_param.model_file.clear();
   }
+  if (!hyper_param.pre_model_file.empty() &&
+      (hyper_param.cross_validation || hyper_param.remap_feature)) {
+    printf("[Error] Cannot warm-start the training in "
+           "cross-validation, or with the re-indexed features. \n");
+    exit(0);
+  }
+  if (!hyper_param.init_model_file.empty() &&
+      (!hyper_param.pre_model_file.empty() ||
+       hyper_param.cross_validation || hyper_param.remap_feature)) {
+    printf("[Error] The -init cannot be used with -pre, in "
+           "cross-validation, or with the re-indexed features. \n");
+    exit(0);
+  }
+  if ((hyper_param.checkpoint_epoch > 0 ||
+       hyper_param.checkpoint_minute > 0) &&
+      (hyper_param.model_file.empty() ||
+       hyper_param.model_file.compare("none") == 0)) {
+    printf("[Warning] No model file is saved, and the options "
+           "-ckpt and -ckpt_min are ignored. \n");
+    hyper_param.checkpoint_epoch = 0;
+    hyper_param.checkpoint_minute = 0;
+  }
+  if (hyper_param.checkpoint_delta &&
+      hyper_param.checkpoint_epoch == 0 &&
+      hyper_param.checkpoint_minute == 0) {
+    printf("[Warning] The --delta-ckpt needs the checkpoints "
+           "of -ckpt or -ckpt_min, and it is ignored. \n");
+    hyper_param.checkpoint_delta = false;
+  }
+  // The deferred regular of adagrad-lazy changes all the
+  // weights when it is applied before each checkpoint
+  if (hyper_param.checkpoint_delta &&
+      hyper_param.opt_method.compare("adagrad-lazy") == 0) {
+    printf("[Warning] The deferred regular of adagrad-lazy updates "
+           "all the features, and --delta-ckpt is ignored. \n");
+    hyper_param.checkpoint_delta = false;
+  }
+  if (hyper_param.thread_mode.compare("replica") == 0 &&
+      hyper_param.opt_method.compare("adagrad-lazy") == 0) {
+    printf("[Error] The steps of adagrad-lazy cannot be "
+           "averaged in the 'replica' thread mode. \n");
+    exit(0);
+  }
+  // The state is the position of the single in-memory Reader,
+  // and the model is restored by warm-start
+  if (hyper_param.resume &&
+      (hyper_param.on_disk || hyper_param.online ||
+       hyper_param.cross_validation || hyper_param.shuffle_copy ||
+       hyper_param.async_valid > 0 || hyper_param.loss_sample > 0 ||
+       hyper_param.auto_sample_size || hyper_param.sparse_latent ||
+       !hyper_param.ps_servers.empty() ||
+       !hyper_param.ring_nodes.empty() ||
+       !hyper_param.shm_name.empty())) {
+    printf("[Error] The --resume cannot be used with --disk, --online, "
+           "--cv, --shuffle-copy, -async-valid, -loss_sample, "
+           "-sample_size auto, --sparse-latent, -ps, -ring or -shm. \n");
+    exit(0);
+  }
+  if (hyper_param.resume &&
+      (hyper_param.model_file.empty() ||
+       hyper_param.model_file.compare("none") == 0)) {
+    printf("[Error] The --resume saves the state next to the model "
+           "file, which cannot be 'none'. \n");
+    exit(0);
+  }
+  // The parallel folds have their own models and Readers,
+  // which are only built for the in-memory folds
+  if (hyper_param.cv_jobs > 1) {
+    if (!hyper_param.cross_validation) {
+      printf("[Warning] The -cv_jobs is only used by the "
+             "cross-validation, and it is ignored. \n");
+      hyper_param.cv_jobs = 1;
+    } else if (hyper_param.on_disk || hyper_param.budget_minute > 0 ||
+               hyper_param.use_gpu ||
+               hyper_param.opt_method.compare("als") == 0 ||
+               hyper_param.opt_method.compare("lbfgs") == 0) {
+      printf("[Error] The -cv_jobs cannot be used with --disk, "
+             "-budget_min, --gpu, or -opt als or lbfgs. \n");
+      exit(0);
+    }
+  }
   if (hyper_param.cross_validation &&
       hyper_param.quiet) {
     printf("[Warning] Cannot use -quiet option in "
            "cross-validation. \n");
     hyper_param.quiet = false;
   }
-  if (hyper_param.loss_func.compare("cross-entropy") == 0 ||
-      hyper_param.loss_func.compare("hinge") == 0) {
-    // for classification
-    if (hyper_param.metric.compare("mae") == 0 ||
-        hyper_param.metric.compare("mape") == 0) {
-      printf("[Error] The -x: %s metric can only be used "
-             "in regression tasks. \n",
-             hyper_param.metric.c_str());
+  // The heads are trained by the pass of the model of the first
+  // head (see Trainer::AddModel), which is the only one that is
+  // checkpointed, distributed or sampled
+  if (hyper_param.num_heads > 1) {
+    if (hyper_param.loss_func.compare("cross-entropy") != 0) {
+      printf("[Error] The -heads can only be used "
+             "in classification tasks. \n");
+      exit(0);
+    }
+    if (hyper_param.neg_sample < 1.0 || hyper_param.online ||
+        hyper_param.cross_validation || hyper_param.resume ||
+        hyper_param.checkpoint_epoch > 0 ||
+        hyper_param.checkpoint_minute > 0 ||
+        hyper_param.train_sample > 0 || hyper_param.loss_sample > 0 ||
+        hyper_param.use_gpu || hyper_param.model_shards > 1 ||
+        hyper_param.sparse_latent ||
+        hyper_param.opt_method.compare("als") == 0 ||
+        hyper_param.opt_method.compare("lbfgs") == 0 ||
+        !hyper_param.ps_servers.empty() ||
+        !hyper_param.ring_nodes.empty() ||
+        !hyper_param.shm_name.empty()) {
+      printf("[Error] The -heads cannot be used with -neg_sample, "
+             "--online, --cv, --resume, -ckpt, -ckpt_min, "
+             "-train_sample, -loss_sample, --gpu, -model_shards, "
+             "--sparse-latent, -opt als or lbfgs, -ps, -ring or "
+             "-shm. \n");
       exit(0);
     }
-  } else if (hyper_param.loss_func.compare("squared") == 0) {
-    // for regression
-    if (hyper_param.metric.compare("acc") == 0 ||
-        hyper_param.metric.compare("prec") == 0 ||
-        hyper_param.metric.compare("recall") == 0 ||
-        hyper_param.metric.compare("f1") == 0) {
-      printf("[Error] The -x: %s metric can only be used "
-             "in classification tasks. \n",
-              hyper_param.metric.c_str());
+  }
+  if (hyper_param.neg_sample < 1.0) {
+    if (hyper_param.loss_func.compare("squared") == 0) {
+      printf("[Error] The -neg_sample can only be used "
+             "in classification tasks. \n");
       exit(0);
     }
+    if (hyper_param.on_disk || hyper_param.cross_validation) {
+      printf("[Warning] The -neg_sample is only used by the "
+             "in-memory training without cross-validation, "
+             "and it is ignored. \n");
+      hyper_param.neg_sample = 1.0;
+    }
+  }
+  if (hyper_param.dedup_rows &&
+      (hyper_param.on_disk || hyper_param.cross_validation)) {
+    printf("[Warning] The --dedup is only used by the "
+           "in-memory training without cross-validation, "
+           "and it is ignored. \n");
+    hyper_param.dedup_rows = false;
+  }
+  if (hyper_param.part_decay < 1.0 &&
+      (hyper_param.on_disk || hyper_param.cross_validation ||
+       hyper_param.online)) {
+    printf("[Warning] The -part_decay is only used by the "
+           "in-memory training without cross-validation, "
+           "and it is ignored. \n");
+    hyper_param.part_decay = 1.0;
+  }
+  if (hyper_param.shuffle_copy &&
+      (hyper_param.on_disk || hyper_param.cross_validation ||
+       hyper_param.online)) {
+    printf("[Warning] The --shuffle-copy is only used by the "
+           "in-memory training without cross-validation, "
+           "and it is ignored. \n");
+    hyper_param.shuffle_copy = false;
+  }
+  if (hyper_param.group_rows &&
+      (hyper_param.on_disk || hyper_param.online ||
+       hyper_param.thread_mode.compare("replica") == 0)) {
+    printf("[Warning] The --group-rows is only used by the "
+           "in-memory training whose threads share the model, "
+           "and it is ignored. \n");
+    hyper_param.group_rows = false;
+  }
+  if ((hyper_param.io_depth > 0 || hyper_param.direct_io) &&
+      !hyper_param.on_disk) {
+    printf("[Warning] The -io_depth and the --direct-io are only "
+           "used by the on-disk training, and they are ignored. \n");
+    hyper_param.io_depth = 0;
+    hyper_param.direct_io = false;
+  }
+  // The model is created before the first epoch, which
+  // knows the number of features and fields
+  if (hyper_param.spill_disk &&
+      (!hyper_param.on_disk || hyper_param.hash_bucket == 0 ||
+       hyper_param.score_func.compare("ffm") == 0)) {
+    printf("[Warning] The --spill is only used by the on-disk "
+           "training with -hash and without ffm, and it is "
+           "ignored. \n");
+    hyper_param.spill_disk = false;
+  }
+  if (!hyper_param.cache_dir.empty() && hyper_param.on_disk) {
+    printf("[Warning] The -cache_dir is only used by the in-memory "
+           "training, and the binary file of on-disk training is "
+           "still written next to the txt file. \n");
+  }
+  if (hyper_param.auto_sample_size &&
+      (hyper_param.on_disk || !hyper_param.ring_nodes.empty())) {
+    printf("[Warning] The -sample_size auto is only used by the "
+           "in-memory training without -ring, and the sample_size "
+           "%d is used. \n", hyper_param.sample_size);
+    hyper_param.auto_sample_size = false;
+  }
+  if (hyper_param.loss_sample > 0 &&
+      (hyper_param.on_disk || hyper_param.cross_validation)) {
+    printf("[Warning] The -loss_sample is only used by the "
+           "in-memory training without cross-validation, "
+           "and it is ignored. \n");
+    hyper_param.loss_sample = 0;
+  }
+  if (!hyper_param.ps_servers.empty() &&
+      !check_ps_options(hyper_param)) {
+    exit(0);
+  }
+  if (!hyper_param.ring_nodes.empty() &&
+      !check_ring_options(hyper_param)) {
+    exit(0);
+  }
+  if (!hyper_param.shm_name.empty() &&
+      !check_shm_options(hyper_param)) {
+    exit(0);
+  }
+  if (!hyper_param.param_file.empty()) {
+    if (!hyper_param.ps_servers.empty() ||
+        !hyper_param.shm_name.empty()) {
+      printf("[Error] The -param_file cannot be used with -ps "
+             "or -shm. \n");
+      exit(0);
+    }
+    if (hyper_param.huge_page.compare("none") != 0) {
+      printf("[Warning] The pages of -param_file are not huge "
+             "pages, and -hugepage is ignored. \n");
+      hyper_param.huge_page = "none";
+    }
+  }
+  if (!hyper_param.field_pairs_file.empty() ||
+      !hyper_param.learn_field_pairs.empty()) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      printf("[Warning] The -field_pairs and -learn_field_pairs are only "
+             "used by ffm, and they are ignored. \n");
+      hyper_param.field_pairs_file.clear();
+      hyper_param.learn_field_pairs.clear();
+    } else if (!hyper_param.learn_field_pairs.empty() &&
+               (!hyper_param.ps_servers.empty() ||
+                hyper_param.cross_validation)) {
+      printf("[Error] The -learn_field_pairs cannot be used with "
+             "-ps or --cv. \n");
+      exit(0);
+    }
+    // The masked pairs have no latent vector
+    if (!hyper_param.field_pairs_file.empty()) {
+      hyper_param.sparse_latent = true;
+    }
+  }
+  if (!hyper_param.field_groups_file.empty() ||
+      !hyper_param.learn_field_groups.empty()) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      printf("[Warning] The -field_groups and -learn_field_groups are only "
+             "used by ffm, and they are ignored. \n");
+      hyper_param.field_groups_file.clear();
+      hyper_param.learn_field_groups.clear();
+    } else if (!hyper_param.learn_field_groups.empty() &&
+               (!hyper_param.field_groups_file.empty() ||
+                !hyper_param.ps_servers.empty() ||
+                hyper_param.cross_validation)) {
+      printf("[Error] The -learn_field_groups cannot be used with "
+             "-field_groups, -ps or --cv. \n");
+      exit(0);
+    }
+  }
+  // The crosses are hashed into the buckets of the features
+  if (!hyper_param.cross_fields.empty() && hyper_param.hash_bucket == 0) {
+    printf("[Error] The -cross needs the hashing of -hash. \n");
+    exit(0);
+  }
+  // The dense block has the features [0, width) of the csv file
+  if (hyper_param.dense_data &&
+      (hyper_param.score_func.compare("ffm") == 0 ||
+       hyper_param.remap_feature ||
+       hyper_param.dedup_rows ||
+       hyper_param.hash_bucket > 0 ||
+       !hyper_param.ps_servers.empty())) {
+    printf("[Error] The --dense cannot be used with ffm, --remap "
+           "(or --freq-order, -min_count), --dedup, -hash or -ps. \n");
+    exit(0);
+  }
+  if (hyper_param.sparse_latent) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      printf("[Warning] The --sparse-latent is only used by ffm, "
+             "and it is ignored. \n");
+      hyper_param.sparse_latent = false;
+    } else if (!hyper_param.ps_servers.empty() ||
+               !hyper_param.ring_nodes.empty() ||
+               !hyper_param.shm_name.empty() ||
+               !hyper_param.param_file.empty() ||
+               !hyper_param.pre_model_file.empty() ||
+               hyper_param.cross_validation ||
+               hyper_param.model_shards > 1) {
+      printf("[Error] The --sparse-latent (or -field_pairs) cannot be "
+             "used with -ps, -ring, -shm, -param_file, -pre, --cv or "
+             "-model_shards. \n");
+      exit(0);
+    }
+  }
+  // The blocks of the K of each field are the fp32 interleaved
+  // ones of a model in the memory of this process, and the pass
+  // that counts the features reads the whole training set
+  if (!hyper_param.field_k.empty()) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      printf("[Warning] The -field_k is only used by ffm, "
+             "and it is ignored. \n");
+      hyper_param.field_k.clear();
+    } else if (hyper_param.sparse_latent ||
+               hyper_param.latent_layout.compare("interleaved") != 0 ||
+               hyper_param.cache_precision.compare("fp32") != 0 ||
+               hyper_param.shared_cache ||
+               !hyper_param.ps_servers.empty() ||
+               !hyper_param.ring_nodes.empty() ||
+               !hyper_param.shm_name.empty() ||
+               !hyper_param.param_file.empty() ||
+               !hyper_param.pre_model_file.empty() ||
+               hyper_param.cross_validation ||
+               hyper_param.resume ||
+               hyper_param.online ||
+               hyper_param.use_gpu ||
+               hyper_param.tune_kernel ||
+               hyper_param.model_shards > 1) {
+      printf("[Error] The -field_k cannot be used with --sparse-latent "
+             "(or -field_pairs), --latent-layout, --cache-precision, "
+             "--shared-cache, -ps, -ring, -shm, -param_file, -pre, "
+             "--cv, --resume, --online, --gpu, --tune-kernel or "
+             "-model_shards. \n");
+      exit(0);
+    }
+  }
+  // The reduced caches and the shared cache have their own
+  // split layouts, and the one fp32 cache needs no precision
+  if (hyper_param.shared_cache &&
+      hyper_param.score_func.compare("ffm") != 0) {
+    printf("[Warning] The --shared-cache is only used by ffm, "
+           "and it is ignored. \n");
+    hyper_param.shared_cache = false;
+  }
+  if (hyper_param.cache_precision.compare("fp32") != 0) {
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      printf("[Warning] The --cache-precision is only used by ffm, "
+             "and it is ignored. \n");
+      hyper_param.cache_precision = "fp32";
+    } else if (hyper_param.shared_cache) {
+      printf("[Warning] The --cache-precision is not used by the "
+             "--shared-cache, and it is ignored. \n");
+      hyper_param.cache_precision = "fp32";
+    } else {
+      hyper_param.latent_layout = "split-" + hyper_param.cache_precision;
+    }
+  }
+  if (hyper_param.shared_cache) {
+    hyper_param.latent_layout = "split-shared";
+  }
+  // The shared and mapped parameters keep the interleaved blocks,
+  // and the reduced caches cannot be averaged by the replicas
+  // or the ring
+  if (hyper_param.latent_layout.compare("interleaved") != 0) {
+    LatentLayout layout = kLayoutInterleaved;
+    ParseLatentLayout(hyper_param.latent_layout, &layout);
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      printf("[Warning] The --latent-layout is only used by ffm, "
+             "and it is ignored. \n");
+      hyper_param.latent_layout = "interleaved";
+    } else if (!hyper_param.ps_servers.empty() ||
+               !hyper_param.shm_name.empty() ||
+               !hyper_param.param_file.empty()) {
+      printf("[Error] The --latent-layout cannot be used with "
+             "-ps, -shm or -param_file. \n");
+      exit(0);
+    } else if (LatentCacheBytes(layout) != 4 &&
+               (hyper_param.thread_mode.compare("replica") == 0 ||
+                !hyper_param.ring_nodes.empty())) {
+      printf("[Error] The --cache-precision cannot be used with -ring "
+             "or the 'replica' thread mode. \n");
+      exit(0);
+    }
+  }
+  // The GPU kernels read the interleaved blocks of one
+  // dense latent factor, whose address never moves
+  if (hyper_param.use_gpu) {
+#ifndef XLEARN_USE_CUDA
+    printf("[Error] The --gpu needs xLearn built by "
+           "cmake -DXLEARN_CUDA=ON. \n");
+    exit(0);
+#endif
+    if (hyper_param.score_func.compare("ffm") != 0) {
+      printf("[Error] The --gpu can only be used by ffm. \n");
+      exit(0);
+    }
+    if (hyper_param.latent_layout.compare("interleaved") != 0 ||
+        hyper_param.sparse_latent || hyper_param.online ||
+        hyper_param.model_shards > 1 ||
+        !hyper_param.ps_servers.empty() ||
+        !hyper_param.shm_name.empty()) {
+      printf("[Error] The --gpu cannot be used with --latent-layout, "
+             "--cache-precision, --shared-cache, --sparse-latent, "
+             "--online, -model_shards, -ps or -shm. \n");
+      exit(0);
+    }
+  }
+  // The tuning reads the first rows again on the whole model,
+  // and the GPU has no kernels of the CPU
+  if (hyper_param.tune_kernel &&
+      (hyper_param.online || hyper_param.use_gpu ||
+       !hyper_param.ps_servers.empty())) {
+    printf("[Error] The --tune-kernel cannot be used with "
+           "--online, --gpu or -ps. \n");
+    exit(0);
+  }
+  // The full-batch solvers (coordinate descent and L-BFGS) train
+  // on all the rows of the training set in memory
+  if (hyper_param.opt_method.compare("als") == 0 ||
+      hyper_param.opt_method.compare("lbfgs") == 0) {
+    const char* opt = hyper_param.opt_method.c_str();
+    if (hyper_param.opt_method.compare("lbfgs") == 0 &&
+        hyper_param.score_func.compare("linear") != 0) {
+      printf("[Error] The -opt lbfgs only trains the linear model. \n");
+      exit(0);
+    }
+    if ((hyper_param.score_func.compare("linear") != 0 &&
+         hyper_param.score_func.compare("fm") != 0) ||
+        (hyper_param.loss_func.compare("squared") != 0 &&
+         hyper_param.loss_func.compare("cross-entropy") != 0)) {
+      printf("[Error] The -opt %s only trains the linear and fm models "
+             "of the squared and cross-entropy loss. \n", opt);
+      exit(0);
+    }
+    if (hyper_param.online || hyper_param.cross_validation ||
+        hyper_param.resume || hyper_param.auto_sample_size ||
+        hyper_param.valid_batches > 0 || hyper_param.use_gpu ||
+        hyper_param.tune_kernel || hyper_param.model_shards > 1 ||
+        !hyper_param.ps_servers.empty() ||
+        !hyper_param.ring_nodes.empty() ||
+        !hyper_param.shm_name.empty()) {
+      printf("[Error] The -opt %s cannot be used with --online, --cv, "
+             "--resume, -sample_size auto, -valid_batches, --gpu, "
+             "--tune-kernel, -model_shards, -ps, -ring or -shm. \n", opt);
+      exit(0);
+    }
+  }
+  // The parameter servers only have the linear, fm and ffm models
+  if (hyper_param.score_func.compare("hofm") == 0 &&
+      !hyper_param.ps_servers.empty()) {
+    printf("[Error] The hofm (-s 7 or 8) cannot be used with -ps. \n");
+    exit(0);
+  }
+  if (hyper_param.model_shards > 1 &&
+      (!hyper_param.ps_servers.empty() || !hyper_param.shm_name.empty() ||
+       !hyper_param.param_file.empty())) {
+    printf("[Warning] The -model_shards is not used by the -ps, -shm or "
+           "-param_file training, and it is ignored. \n");
+    hyper_param.model_shards = 1;
+  }
+  if (hyper_param.shard_data && hyper_param.ps_servers.empty() &&
+      hyper_param.ring_nodes.empty() && hyper_param.shm_name.empty()) {
+    printf("[Warning] The --shard is only used by the -ps, -ring "
+           "or -shm training, and it is ignored. \n");
+    hyper_param.shard_data = false;
+  }
+  // The parts are one dataset, which is not split into the
+  // folds and is not an online stream
+  if (num_train_file > 1 &&
+      (hyper_param.cross_validation || hyper_param.online)) {
+    printf("[Error] The training set of %lu files cannot be used "
+           "with --cv or --online. \n", num_train_file);
+    return false;
+  }
+  if (hyper_param.online && !check_online_options(hyper_param)) {
+    exit(0);
+  }
+  if (hyper_param.admit_count > 1 && !hyper_param.online) {
+    printf("[Warning] The -admit is only used by the --online "
+           "training, and it is ignored. \n");
+    hyper_param.admit_count = 0;
+  }
+  if (hyper_param.ttl_minute > 0 && !hyper_param.online) {
+    printf("[Warning] The -ttl_min is only used by the --online "
+           "training, and it is ignored. \n");
+    hyper_param.ttl_minute = 0;
+  }
+  // The private weights of the replicas would bring
+  // the evicted features back at the merge
+  if (hyper_param.ttl_minute > 0 &&
+      hyper_param.thread_mode.compare("replica") == 0) {
+    printf("[Error] The -ttl_min cannot be used with the "
+           "'replica' thread mode. \n");
+    exit(0);
+  }
+  std::vector<std::string> metrics;
+  SplitStringUsing(hyper_param.metric, ",", &metrics);
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    const std::string& metric = metrics[i];
+    if (hyper_param.loss_func.compare("cross-entropy") == 0 ||
+        hyper_param.loss_func.compare("hinge") == 0) {
+      // for classification
+      if (metric.compare("mae") == 0 ||
+          metric.compare("mape") == 0) {
+        printf("[Error] The -x: %s metric can only be used "
+               "in regression tasks. \n",
+               metric.c_str());
+        exit(0);
+      }
+    } else if (hyper_param.loss_func.compare("squared") == 0) {
+      // for regression
+      if (metric.compare("acc") == 0 ||
+          metric.compare("prec") == 0 ||
+          metric.compare("recall") == 0 ||
+          metric.compare("f1") == 0 ||
+          metric.compare("logloss") == 0) {
+        printf("[Error] The -x: %s metric can only be used "
+               "in classification tasks. \n",
+                metric.c_str());
+        exit(0);
+      }
+    }
   }
 
   return true;
 }
 
+// A worker only trains its own data, and the model of the
+// servers is a plain model without any map of the features
+bool Checker::check_ps_options(HyperParam& hyper_param) {
+  std::vector<std::string> servers;
+  SplitStringUsing(hyper_param.ps_servers, ",", &servers);
+  if (servers.empty()) {
+    printf("[Error] Illegal -ps : '%s' \n",
+           hyper_param.ps_servers.c_str());
+    return false;
+  }
+  if (hyper_param.worker_id >= hyper_param.num_workers) {
+    printf("[Error] The -worker %d must be less than "
+           "-num_workers %d \n",
+           hyper_param.worker_id, hyper_param.num_workers);
+    return false;
+  }
+  if (hyper_param.cross_validation ||
+      hyper_param.remap_feature ||
+      !hyper_param.pre_model_file.empty() ||
+      !hyper_param.init_model_file.empty()) {
+    printf("[Error] The -ps training cannot be used with --cv, "
+           "--remap, --freq-order, -pre or -init. \n");
+    return false;
+  }
+  if (hyper_param.opt_method.compare("adagrad-lazy") == 0) {
+    printf("[Error] The steps of adagrad-lazy cannot be "
+           "summed by the parameter servers. \n");
+    return false;
+  }
+  if (!hyper_param.test_set_file.empty() || hyper_param.early_stop ||
+      hyper_param.valid_batches > 0 || hyper_param.async_valid > 0) {
+    printf("[Warning] The -ps training has no validation, and "
+           "-t, --es, -valid_batches and -async-valid are ignored. \n");
+    hyper_param.test_set_file.clear();
+    hyper_param.early_stop = false;
+    hyper_param.valid_batches = 0;
+    hyper_param.async_valid = 0;
+  }
+  if (hyper_param.train_sample > 0 || hyper_param.loss_sample > 0 ||
+      hyper_param.checkpoint_epoch > 0 ||
+      hyper_param.checkpoint_minute > 0) {
+    printf("[Warning] The -ps training ignores the options "
+           "-train_sample, -loss_sample, -ckpt and -ckpt_min. \n");
+    hyper_param.train_sample = 0;
+    hyper_param.loss_sample = 0;
+    hyper_param.checkpoint_epoch = 0;
+    hyper_param.checkpoint_minute = 0;
+  }
+  if (hyper_param.thread_mode.compare("hogwild") != 0) {
+    printf("[Warning] The -ps training only uses the 'hogwild' "
+           "thread mode. \n");
+    hyper_param.thread_mode = "hogwild";
+  }
+  return true;
+}
+
+// The nodes should start from the same model and train the
+// same epochs, and the features of the nodes are the same ids
+bool Checker::check_ring_options(HyperParam& hyper_param) {
+  std::vector<std::string> nodes;
+  SplitStringUsing(hyper_param.ring_nodes, ",", &nodes);
+  if (nodes.empty()) {
+    printf("[Error] Illegal -ring : '%s' \n",
+           hyper_param.ring_nodes.c_str());
+    return false;
+  }
+  hyper_param.num_workers = nodes.size();
+  if (hyper_param.worker_id >= hyper_param.num_workers) {
+    printf("[Error] The -worker %d must be less than the number "
+           "of the nodes of -ring (%d) \n",
+           hyper_param.worker_id, hyper_param.num_workers);
+    return false;
+  }
+  if (!hyper_param.ps_servers.empty() ||
+      hyper_param.cross_validation ||
+      hyper_param.remap_feature) {
+    printf("[Error] The -ring training cannot be used with -ps, "
+           "--cv, --remap or --freq-order. \n");
+    return false;
+  }
+  if (hyper_param.opt_method.compare("adagrad-lazy") == 0) {
+    printf("[Error] The steps of adagrad-lazy cannot be "
+           "averaged by the nodes of -ring. \n");
+    return false;
+  }
+  if (hyper_param.early_stop || hyper_param.valid_batches > 0) {
+    printf("[Warning] The nodes of -ring train the same epochs, "
+           "and --es and -valid_batches are ignored. \n");
+    hyper_param.early_stop = false;
+    hyper_param.valid_batches = 0;
+  }
+  if (hyper_param.worker_id != 0 &&
+      (hyper_param.checkpoint_epoch > 0 ||
+       hyper_param.checkpoint_minute > 0)) {
+    printf("[Warning] Only the node 0 of -ring saves the "
+           "checkpoint, and -ckpt and -ckpt_min are ignored. \n");
+    hyper_param.checkpoint_epoch = 0;
+    hyper_param.checkpoint_minute = 0;
+  }
+  if (hyper_param.checkpoint_delta) {
+    printf("[Warning] The updates of the other nodes of -ring are "
+           "not tracked, and --delta-ckpt is ignored. \n");
+    hyper_param.checkpoint_delta = false;
+  }
+  return true;
+}
+
+// The online training makes one pass over the stream, whose
+// statistics are not known, so the model has a fixed structure
+// and nothing is done by another pass over the data
+bool Checker::check_online_options(HyperParam& hyper_param) {
+  if (!hyper_param.ps_servers.empty() ||
+      !hyper_param.ring_nodes.empty() ||
+      !hyper_param.shm_name.empty() ||
+      hyper_param.cross_validation ||
+      hyper_param.on_disk ||
+      hyper_param.remap_feature ||
+      hyper_param.sparse_latent ||
+      !hyper_param.learn_field_pairs.empty() ||
+      !hyper_param.learn_field_groups.empty()) {
+    printf("[Error] The --online training cannot be used with -ps, "
+           "-ring, -shm, --cv, --disk, --remap (or --freq-order, "
+           "-min_count), --sparse-latent (or -field_pairs), "
+           "-learn_field_pairs or -learn_field_groups. \n");
+    return false;
+  }
+  // The growing model has no fixed slots for the OOV feature
+  // and the eviction, and no fixed features for the deltas
+  if (hyper_param.hash_bucket == 0 &&
+      (hyper_param.admit_count > 1 || hyper_param.ttl_minute > 0 ||
+       hyper_param.checkpoint_delta || !hyper_param.param_file.empty() ||
+       hyper_param.model_shards > 1 ||
+       hyper_param.thread_mode.compare("hogwild") != 0)) {
+    printf("[Error] The growing model of the --online training "
+           "without -hash cannot be used with -admit, -ttl_min, "
+           "--delta-ckpt, -param_file, -model_shards or the thread "
+           "mode other than 'hogwild'. \n");
+    return false;
+  }
+  if (hyper_param.score_func.compare("ffm") == 0 &&
+      hyper_param.pre_model_file.empty() &&
+      hyper_param.field_groups_file.empty()) {
+    printf("[Error] The ffm model of the --online training needs "
+           "-pre or -field_groups for the number of fields. \n");
+    return false;
+  }
+  if (IsCompressedFile(hyper_param.train_set_file)) {
+    printf("[Error] The compressed file cannot be read by the "
+           "--online training. \n");
+    return false;
+  }
+  if (!hyper_param.test_set_file.empty() || hyper_param.early_stop ||
+      hyper_param.valid_batches > 0 || hyper_param.async_valid > 0 ||
+      hyper_param.train_sample > 0 || hyper_param.loss_sample > 0 ||
+      hyper_param.neg_sample < 1.0 || hyper_param.dedup_rows) {
+    printf("[Warning] The --online training has no validation and no "
+           "sampling, and -t, --es, -valid_batches, -async-valid, "
+           "-train_sample, -loss_sample, -neg_sample and --dedup "
+           "are ignored. \n");
+    hyper_param.test_set_file.clear();
+    hyper_param.early_stop = false;
+    hyper_param.valid_batches = 0;
+    hyper_param.async_valid = 0;
+    hyper_param.train_sample = 0;
+    hyper_param.loss_sample = 0;
+    hyper_param.neg_sample = 1.0;
+    hyper_param.dedup_rows = false;
+  }
+  hyper_param.num_epoch = 1;
+  return true;
+}
+
+// The processes update the same model, which is initialized
+// by the process 0 and has the features of all the processes
+bool Checker::check_shm_options(HyperParam& hyper_param) {
+  if (hyper_param.shm_name.find('/') != std::string::npos) {
+    printf("[Error] Illegal -shm : '%s' \n"
+           " The name of -shm cannot have '/' \n",
+           hyper_param.shm_name.c_str());
+    return false;
+  }
+  if (hyper_param.num_workers > kMaxShmWorkers) {
+    printf("[Error] The -num_workers %d of -shm must be less than "
+           "or equal to %d \n",
+           hyper_param.num_workers, kMaxShmWorkers);
+    return false;
+  }
+  if (hyper_param.worker_id >= hyper_param.num_workers) {
+    printf("[Error] The -worker %d must be less than "
+           "-num_workers %d \n",
+           hyper_param.worker_id, hyper_param.num_workers);
+    return false;
+  }
+  if (!hyper_param.ps_servers.empty() ||
+      !hyper_param.ring_nodes.empty() ||
+      hyper_param.cross_validation ||
+      hyper_param.remap_feature) {
+    printf("[Error] The -shm training cannot be used with -ps, "
+           "-ring, --cv, --remap or --freq-order. \n");
+    return false;
+  }
+  if (hyper_param.opt_method.compare("adagrad-lazy") == 0) {
+    printf("[Error] The deferred steps of adagrad-lazy cannot be "
+           "shared by the processes of -shm. \n");
+    return false;
+  }
+  if (hyper_param.early_stop || hyper_param.valid_batches > 0) {
+    printf("[Warning] The processes of -shm train the same epochs, "
+           "and --es and -valid_batches are ignored. \n");
+    hyper_param.early_stop = false;
+    hyper_param.valid_batches = 0;
+  }
+  if (hyper_param.worker_id != 0 &&
+      (hyper_param.checkpoint_epoch > 0 ||
+       hyper_param.checkpoint_minute > 0)) {
+    printf("[Warning] Only the process 0 of -shm saves the "
+           "checkpoint, and -ckpt and -ckpt_min are ignored. \n");
+    hyper_param.checkpoint_epoch = 0;
+    hyper_param.checkpoint_minute = 0;
+  }
+  if (hyper_param.checkpoint_delta) {
+    printf("[Warning] The updates of the other processes of -shm are "
+           "not tracked, and --delta-ckpt is ignored. \n");
+    hyper_param.checkpoint_delta = false;
+  }
+  if (hyper_param.thread_mode.compare("hogwild") != 0) {
+    printf("[Warning] The -shm training only uses the 'hogwild' "
+           "thread mode. \n");
+    hyper_param.thread_mode = "hogwild";
+  }
+  return true;
+}
+
 // Check options for inference tasks
 bool Checker::check_inference_options(HyperParam& hyper_param) {
   bool bo = true;
   /*********************************************************
    *  Check the path of predict file                       *
    *********************************************************/
-  if (FileExist(args_[1].c_str())) {
+  if (IsStdin(args_[1]) || FileExist(args_[1].c_str())) {
     hyper_param.predict_file = std::string(args_[1]);
   } else {
     printf("[Error] Predict data file: %s does not exist \n",
            args_[1].c_str());
     return false;
   }
-  /*********************************************************
-   *  Check the number of args                             *
-   *********************************************************/
-  StringList list(args_.begin()+2, args_.end());
-  if (list.size() % 2 != 0) {
-    printf("[Error] Every options should have a value \n");
-    for (int i = 0; i < list.size(); i+=2) {
-      printf("  %s : %s\n", list[i].c_str(), list[i+1].c_str());
-    }
-    return false;
-  }
   /*********************************************************
    *  Check each input argument                            *
    *********************************************************/
+  StringList list(args_.begin()+2, args_.end());
   StrSimilar ss;
-  for (int i = 0; i < list.size(); i+=2) {
+  for (int i = 0; i < list.size(); ) {
+    // The "-" options should have a value
+    if (list[i][1] != '-' && i + 1 >= list.size()) {
+      printf("[Error] The option %s should have a value \n",
+             list[i].c_str());
+      return false;
+    }
     if (list[i].compare("-m") == 0) {
       if (FileExist(list[i+1].c_str())) {
         hyper_param.model_file = list[i+1];
@@ -454,10 +2627,107 @@ bool Checker::check_inference_options(HyperParam& hyper_param) {
                list[i+1].c_str());
         bo = false;
       }
+      i += 2;
     } else if (list[i].compare("-o") == 0) {
       hyper_param.output_file = list[i+1];
+      i += 2;
     } else if (list[i].compare("-l") == 0) {
       hyper_param.log_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-p") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -p : '%i' \n"
+               " -p must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.prefetch_distance = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--gpu") == 0) {
+      hyper_param.use_gpu = true;
+      i += 1;
+    } else if (list[i].compare("-hash") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -hash : '%i' \n"
+               " -hash must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.hash_bucket = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-nthread") == 0) {
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        printf("[Error] Illegal -nthread : '%i' \n"
+               " -nthread must be greater than or equal to zero \n",
+               value);
+        bo = false;
+      } else {
+        hyper_param.thread_number = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-affinity") == 0) {
+      std::vector<int> cpus;
+      if (!GetAffinityCpus(list[i+1], &cpus)) {
+        printf("[Error] Illegal -affinity : %s \n"
+               " -affinity can be a CPU list like '0-3,8', 'physical', "
+               "'node:<n>' or 'node:<n>:physical' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.affinity = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("-v") == 0) {
+      if (list[i+1].compare("fp32") != 0 &&
+          list[i+1].compare("fp16") != 0 &&
+          list[i+1].compare("bf16") != 0 &&
+          list[i+1].compare("int8") != 0) {
+        printf("[Error] Unknow latent type: %s \n"
+               " -v can only be 'fp32', 'fp16', 'bf16' or 'int8' \n",
+               list[i+1].c_str());
+        bo = false;
+      } else {
+        hyper_param.latent_type = list[i+1];
+      }
+      i += 2;
+    } else if (list[i].compare("--stream") == 0) {
+      hyper_param.stream_predict = true;
+      i += 1;
+    } else if (list[i].compare("--binary-out") == 0) {
+      hyper_param.binary_output = true;
+      i += 1;
+    } else if (list[i].compare("--dense") == 0) {
+      hyper_param.dense_data = true;
+      i += 1;
+    } else if (list[i].compare("--lazy-model") == 0) {
+      hyper_param.lazy_model = true;
+      i += 1;
+    } else if (list[i].compare("-delta") == 0) {
+      hyper_param.delta_files = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-ensemble") == 0) {
+      std::vector<std::string> files;
+      SplitStringUsing(list[i+1], ",", &files);
+      for (size_t j = 0; j < files.size(); ++j) {
+        if (!FileExist(files[j].c_str())) {
+          printf("[Error] Model file: %s does not exist \n",
+                 files[j].c_str());
+          bo = false;
+        }
+      }
+      hyper_param.ensemble_files = list[i+1];
+      i += 2;
+    } else if (list[i].compare("--blend") == 0) {
+      hyper_param.blend_output = true;
+      i += 1;
+    } else if (list[i].compare("-trace") == 0) {
+      hyper_param.trace_file = list[i+1];
+      i += 2;
     } else {  // no match
       std::string similar_str;
       ss.FindSimilar(list[i], menu_, similar_str);
@@ -466,8 +2736,38 @@ bool Checker::check_inference_options(HyperParam& hyper_param) {
              list[i].c_str(),
              similar_str.c_str());
       bo = false;
+      if (list[i][1] == '-') {  // "--" options
+        i += 1;
+      } else {  // "-" options
+        i += 2;
+      }
     }
   }
+  if (hyper_param.lazy_model && hyper_param.stream_predict) {
+    printf("[Error] --lazy-model cannot be used with --stream. \n");
+    return false;
+  }
+  if (hyper_param.lazy_model && !hyper_param.ensemble_files.empty()) {
+    printf("[Error] --lazy-model cannot be used with -ensemble. \n");
+    return false;
+  }
+  if (hyper_param.blend_output && hyper_param.ensemble_files.empty()) {
+    printf("[Error] --blend needs the models of -ensemble. \n");
+    return false;
+  }
+  if (hyper_param.dense_data &&
+      (hyper_param.lazy_model || hyper_param.hash_bucket > 0)) {
+    printf("[Error] --dense cannot be used with --lazy-model "
+           "or -hash. \n");
+    return false;
+  }
+#ifndef XLEARN_USE_CUDA
+  if (hyper_param.use_gpu) {
+    printf("[Error] The --gpu needs xLearn built by "
+           "cmake -DXLEARN_CUDA=ON. \n");
+    return false;
+  }
+#endif
   if (!bo) { return false; }
 
   return true;
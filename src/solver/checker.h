@@ -60,6 +60,15 @@ class Checker {
   // Check options for train and predict
   bool check_train_options(HyperParam& hyper_param);
   bool check_inference_options(HyperParam& hyper_param);
+  // Check the options of a worker of the parameter servers,
+  // and the options that are not used by it are ignored
+  bool check_ps_options(HyperParam& hyper_param);
+  // Check the options of a node of the ring allreduce
+  bool check_ring_options(HyperParam& hyper_param);
+  // Check the options of a process of the shared model
+  bool check_shm_options(HyperParam& hyper_param);
+  // Check the options of the online training
+  bool check_online_options(HyperParam& hyper_param);
 
   DISALLOW_COPY_AND_ASSIGN(Checker);
 };
@@ -0,0 +1,312 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the entry of the xlearn_compress tool, which projects the
+latent vectors of a trained fm or ffm model onto their main directions,
+and writes a weights-only model of a smaller K for serving. The inner
+products of the vectors are kept up to the dropped energy, and the new
+model is scored by the kernels of its K, with the loss and the metric
+of both models on a test set:
+
+  xlearn_compress [ options ] model_file output_file
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/base/thread_pool.h"
+#include "src/data/feature_map.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/loss.h"
+#include "src/loss/metric.h"
+#include "src/reader/reader.h"
+#include "src/score/score_function.h"
+
+namespace {
+
+// Rows of each batch of the test
+const int kSampleSize = 20000;
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_compress [ options ] model_file output_file \n"
+"                                                       \n"
+"  Project the latent vectors of the fm or ffm model onto the first directions of their \n"
+"  principal components, and write a weights-only model whose K is the number of the kept \n"
+"  directions. The model is not trained again. \n"
+"                                             \n"
+"OPTIONS: \n"
+"  -r <rank>            :  Number of the kept directions, i.e., the new K. \n"
+"                                                                        \n"
+"  -e <energy>          :  Keep the fewest directions whose energy (the sum of the squared \n"
+"                          projections) is at least this fraction of the total, which is used \n"
+"                          without -r. Using 0.99 by default. \n"
+"                                                            \n"
+"  -t <test_file>       :  Report the loss and the metric of both models on the test file. \n"
+"                                                                                   \n"
+"  -nthread <number>    :  Number of the threads of the test. Using 4 by default. \n"
+"                                                                           \n"
+"  --no-norm            :  The model is trained with --no-norm. \n"
+"                                                             \n"
+"  --mmap-model         :  Write the compressed model in the memory-mappable format. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct CompressOption {
+  xLearn::index_t rank = 0;
+  double energy = 0.99;
+  std::string test_file;
+  int nthread = 4;
+  bool norm = true;
+  bool mmap_model = false;
+  std::vector<std::string> file_list;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], CompressOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "-r" || arg == "-e" || arg == "-t" || arg == "-nthread") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      std::string value(argv[++i]);
+      if (arg == "-t") {
+        option->test_file = value;
+      } else if (arg == "-r") {
+        int rank = atoi(value.c_str());
+        if (rank <= 0) {
+          printf("[Error] Illegal -r : '%s' \n", value.c_str());
+          return false;
+        }
+        option->rank = rank;
+      } else if (arg == "-e") {
+        option->energy = atof(value.c_str());
+        if (option->energy <= 0 || option->energy > 1) {
+          printf("[Error] Illegal -e : '%s' \n", value.c_str());
+          return false;
+        }
+      } else {
+        option->nthread = atoi(value.c_str());
+        if (option->nthread <= 0) {
+          printf("[Error] Illegal -nthread : '%s' \n", value.c_str());
+          return false;
+        }
+      }
+    } else if (arg == "--no-norm") {
+      option->norm = false;
+    } else if (arg == "--mmap-model") {
+      option->mmap_model = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      printf("[Error] Unknow option: %s \n", argv[i]);
+      return false;
+    } else {
+      option->file_list.push_back(arg);
+    }
+  }
+  if (option->file_list.size() != 2) { return false; }
+  if (!FileExist(option->file_list[0].c_str())) {
+    printf("[Error] Model file: %s does not exist \n",
+           option->file_list[0].c_str());
+    return false;
+  }
+  if (!option->test_file.empty() &&
+      !FileExist(option->test_file.c_str())) {
+    printf("[Error] Test file: %s does not exist \n",
+           option->test_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Size (MB) of the file
+double file_mb(const std::string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  uint64 size = GetFileSize(file);
+  Close(file);
+  return (double)size / MB;
+}
+
+}  // namespace
+
+namespace xLearn {
+
+// The same kernels as the C API
+Score* create_score(Model& model) {
+  std::string name = StringPrintf("%s_k%d",
+                                  model.GetScoreFunction().c_str(),
+                                  model.get_aligned_k());
+  Score* score = CREATE_SCORE(name.c_str());
+  if (score == nullptr) {
+    score = CREATE_SCORE(model.GetScoreFunction().c_str());
+  }
+  return score;
+}
+
+struct TestResult {
+  double loss = 0;
+  real_t metric = 0;
+};
+
+// The loss and the metric of the model on all the rows of the reader
+TestResult test_model(Model& model,
+                      Reader* reader,
+                      const std::string& metric_name,
+                      bool norm,
+                      ThreadPool* pool) {
+  Score* score = create_score(model);
+  CHECK_NOTNULL(score);
+  score->Initialize(0, 0, &model);
+  Loss* loss = CREATE_LOSS(model.GetLossFunction().c_str());
+  CHECK_NOTNULL(loss);
+  loss->Initialize(score, norm, pool);
+  Metric metric;
+  metric.Initialize(metric_name);
+  metric.SetThreadPool(pool);
+  DMatrix* matrix = nullptr;
+  std::vector<real_t> pred;
+  double loss_sum = 0;
+  uint64 num_rows = 0;
+  reader->Reset();
+  for (;;) {
+    index_t tmp = reader->Samples(matrix, false);
+    if (tmp == 0) { break; }
+    if (tmp != pred.size()) { pred.resize(tmp); }
+    num_rows += tmp;
+    loss_sum += loss->PredictEvalute(matrix, model, pred, &metric);
+  }
+  TestResult result;
+  result.loss = num_rows > 0 ? loss_sum / num_rows : 0;
+  result.metric = metric.GetMetric();
+  delete loss;
+  delete score;
+  return result;
+}
+
+// The in-memory reader of the test file
+Reader* create_test_reader(const std::string& filename, FeatureMap* map) {
+  Reader* reader = CREATE_READER("memory");
+  CHECK_NOTNULL(reader);
+  if (map != nullptr) { reader->SetFeatureMap(map); }
+  reader->Initialize(filename, kSampleSize);
+  return reader;
+}
+
+}  // namespace xLearn
+
+//------------------------------------------------------------------------------
+// The directions are the eigenvectors of the sum of v * v^T over all the
+// latent vectors (of all the fields of ffm), so one projection is shared
+// by all the features and each pair costs the dot product of the new K.
+// The feature map of the model is written with the new model
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  Timer timer;
+  timer.tic();
+
+  CompressOption option;
+  if (!parse_option(argc, argv, &option)) {
+    printf("%s", kUsage);
+    return 0;
+  }
+  const std::string& model_file = option.file_list[0];
+  const std::string& out_file = option.file_list[1];
+  xLearn::Model model(model_file);
+  const std::string& score_func = model.GetScoreFunction();
+  if (score_func.compare("fm") != 0 && score_func.compare("ffm") != 0) {
+    printf("[Error] xlearn_compress needs the fm or ffm model, but "
+           "%s is a %s model \n", model_file.c_str(), score_func.c_str());
+    return 0;
+  }
+  if (model.IsSparse() || model.IsSparseLatent() ||
+      model.GetLatentType() != xLearn::kLatentFP32) {
+    printf("[Error] xlearn_compress needs the dense model of the "
+           "fp32 latent weights \n");
+    return 0;
+  }
+  xLearn::index_t num_K = model.GetNumK();
+  if (option.rank > num_K) {
+    printf("[Error] The -r %u is larger than the K %u of the model \n",
+           option.rank, num_K);
+    return 0;
+  }
+  std::vector<double> energy, basis;
+  model.LatentBasis(&energy, &basis);
+  double total = 0;
+  for (size_t r = 0; r < energy.size(); ++r) { total += energy[r]; }
+  xLearn::index_t rank = option.rank;
+  if (rank == 0) {
+    double sum = 0;
+    while (rank < num_K &&
+           (rank == 0 || sum < option.energy * total)) {
+      sum += energy[rank++];
+    }
+  }
+  double kept = 0;
+  for (xLearn::index_t r = 0; r < rank; ++r) { kept += energy[r]; }
+  xLearn::Model reduced;
+  reduced.ReduceRankFrom(model, basis, rank);
+  if (option.mmap_model) {
+    reduced.SerializeMapped(out_file);
+  } else {
+    reduced.Serialize(out_file, true);
+  }
+  std::string dict_file = model_file + ".dict";
+  xLearn::FeatureMap map;
+  bool has_map = FileExist(dict_file.c_str());
+  if (has_map) {
+    CHECK(map.Deserialize(dict_file));
+    CHECK_EQ(map.Size(), model.GetNumFeature());
+    map.Freeze();
+    map.Serialize(out_file + ".dict");
+  }
+
+  printf("Keep %u of %u directions (%.4f%% of the energy) \n"
+         "  Model size: %.2f MB -> %.2f MB \n"
+         "  Output file: %s \n",
+         rank, num_K, total > 0 ? kept * 100.0 / total : 100.0,
+         file_mb(model_file), file_mb(out_file), out_file.c_str());
+
+  if (!option.test_file.empty()) {
+    xLearn::ThreadPool pool(option.nthread);
+    xLearn::Reader* reader = xLearn::create_test_reader(
+        option.test_file, has_map ? &map : nullptr);
+    std::string metric_name =
+      model.GetLossFunction().compare("squared") == 0 ? "mae" : "auc";
+    xLearn::TestResult before =
+      xLearn::test_model(model, reader, metric_name, option.norm, &pool);
+    xLearn::TestResult after =
+      xLearn::test_model(reduced, reader, metric_name, option.norm, &pool);
+    printf("  Test loss: %.6f -> %.6f (%+.6f) \n"
+           "  Test %s: %.6f -> %.6f (%+.6f) \n",
+           before.loss, after.loss, after.loss - before.loss,
+           metric_name.c_str(), before.metric, after.metric,
+           after.metric - before.metric);
+    delete reader;
+  }
+  printf("Total time cost: %.2f sec\n", timer.toc());
+
+  return 0;
+}
@@ -0,0 +1,319 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of CoordDescent.
+*/
+
+#include "src/solver/coord_descent.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace xLearn {
+
+// The cross-entropy is bounded by this curvature
+static const real_t kLogisticCurvature = 0.25;
+
+// The objective of the parallel sweep can be larger by the
+// rounding of the floats than the one of the former model
+static const double kObjectiveTolerance = 1e-6;
+
+// Add delta to the cache that other threads may move
+static inline void atomic_add(real_t* addr, real_t delta) {
+  uint32* bits = reinterpret_cast<uint32*>(addr);
+  uint32 old_bits = __atomic_load_n(bits, __ATOMIC_RELAXED);
+  for (;;) {
+    real_t value;
+    memcpy(&value, &old_bits, sizeof(value));
+    value += delta;
+    uint32 new_bits;
+    memcpy(&new_bits, &value, sizeof(value));
+    if (__atomic_compare_exchange_n(bits, &old_bits, new_bits, true,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+}
+
+// Read the cache that other threads may move
+static inline real_t atomic_load(const real_t* addr) {
+  uint32 bits = __atomic_load_n(reinterpret_cast<const uint32*>(addr),
+                                __ATOMIC_RELAXED);
+  real_t value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void CoordDescent::Initialize(std::vector<Reader*>& reader_list,
+                              Model* model,
+                              const Loss* loss,
+                              const std::string& loss_func,
+                              bool is_norm,
+                              real_t regu_lambda,
+                              ThreadPool* pool) {
+  BatchSolver::Initialize(reader_list, model, loss, loss_func,
+                          is_norm, regu_lambda, pool);
+  num_K_ = model->GetScoreFunction() == "fm" ? model->GetNumK() : 0;
+  q_.assign((uint64)rows_.row_length * num_K_, 0);
+}
+
+// The score is the one of LinearScore and FMScore: the linear
+// term of x * sqrt(norm) and the latent term of x * norm
+void CoordDescent::compute_cache() {
+  const real_t* w = model_->GetParameter_w();
+  const real_t* v = model_->GetParameter_v();
+  real_t b = model_->GetParameter_b()[0];
+  index_t align0 = 2 * model_->get_aligned_k();
+  pool_->ParallelFor(0, rows_.row_length, 0,
+    [&](size_t id, size_t start, size_t end) {
+      std::vector<real_t> square(num_K_);
+      for (size_t i = start; i < end; ++i) {
+        score_[i] = b;
+        real_t* q = q_.data() + i * num_K_;
+        std::fill(q, q + num_K_, 0);
+        std::fill(square.begin(), square.end(), 0);
+        RowView row = rows_.GetRow(i);
+        real_t norm = rows_.norm[i];
+        real_t sqrt_norm = sqrt(norm);
+        auto add = [&](index_t feat, real_t x) {
+          score_[i] += w[feat * 2] * x * sqrt_norm;
+          if (num_K_ == 0) { return; }
+          const real_t* vj = v + (uint64)feat * align0;
+          for (index_t f = 0; f < num_K_; ++f) {
+            real_t t = vj[f] * x * norm;
+            q[f] += t;
+            square[f] += t * t;
+          }
+        };
+        for (index_t j = 0; j < row.dense_size(); ++j) {
+          if (row.dense()[j] != 0) { add(j, row.dense()[j]); }
+        }
+        for (const Node* iter = row.begin(); iter != row.end(); ++iter) {
+          add(iter->feat_id, iter->feat_val);
+        }
+        for (index_t f = 0; f < num_K_; ++f) {
+          score_[i] += 0.5 * (q[f] * q[f] - square[f]);
+        }
+      }
+    });
+}
+
+inline void CoordDescent::derivative(index_t i, real_t* g,
+                                     real_t* s) const {
+  real_t score = atomic_load(&score_[i]);
+  if (squared_) {
+    *g = (score - label_[i]) * weight_[i];
+    *s = weight_[i];
+  } else {
+    real_t y = label_[i];
+    *g = -y / (1.0 + exp(y * score)) * weight_[i];
+    *s = kLogisticCurvature * weight_[i];
+  }
+}
+
+// The bias is not regularized, as in the SGD
+void CoordDescent::solve_bias() {
+  index_t num_row = rows_.row_length;
+  std::vector<double> sum_g(pool_->size(), 0);
+  std::vector<double> sum_s(pool_->size(), 0);
+  pool_->ParallelFor(0, num_row, 0,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) {
+        real_t g, s;
+        derivative(i, &g, &s);
+        sum_g[id] += g;
+        sum_s[id] += s;
+      }
+    });
+  double g = 0, s = 0;
+  for (size_t t = 0; t < sum_g.size(); ++t) {
+    g += sum_g[t];
+    s += sum_s[t];
+  }
+  if (s <= 0) { return; }
+  real_t delta = -g / s;
+  model_->GetParameter_b()[0] += delta;
+  pool_->ParallelFor(0, num_row, 0,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) { score_[i] += delta; }
+    });
+}
+
+// log(1 + exp(-z)) without the overflow of exp()
+static inline double log_loss(double z) {
+  return z > 0 ? log1p(exp(-z)) : -z + log1p(exp(z));
+}
+
+double CoordDescent::loss_sum() const {
+  std::vector<double> sum(pool_->size(), 0);
+  pool_->ParallelFor(0, rows_.row_length, 0,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t i = start; i < end; ++i) {
+        double d = score_[i] - label_[i];
+        sum[id] += weight_[i] * (squared_ ?
+                                 0.5 * d * d :
+                                 log_loss(label_[i] * score_[i]));
+      }
+    });
+  double loss = 0;
+  for (size_t t = 0; t < sum.size(); ++t) { loss += sum[t]; }
+  return loss;
+}
+
+void CoordDescent::sweep(const std::function<void(index_t)>& step,
+                         const std::function<double()>& regular,
+                         const std::function<void()>& save,
+                         const std::function<void()>& restore) {
+  index_t num_feat = model_->GetNumFeature();
+  if (pool_->size() <= 1) {
+    for (index_t j = 0; j < num_feat; ++j) { step(j); }
+    return;
+  }
+  double before = loss_sum() + regular();
+  save();
+  pool_->ParallelFor(0, num_feat, 64,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t j = start; j < end; ++j) { step(j); }
+    });
+  double after = loss_sum() + regular();
+  if (after <= before + kObjectiveTolerance * fabs(before)) { return; }
+  LOG(INFO) << "The parallel steps move the objective from " << before
+            << " to " << after << ", and they are taken by one thread";
+  restore();
+  for (index_t j = 0; j < num_feat; ++j) { step(j); }
+}
+
+void CoordDescent::solve_linear() {
+  real_t* w = model_->GetParameter_w();
+  index_t num_feat = model_->GetNumFeature();
+  real_t lambda = regu_lambda_ * rows_.row_length;
+  auto step = [&](index_t j) {
+    if (offset_[j] == offset_[j+1]) { return; }
+    double num = 0, den = 0;
+    for (uint64 e = offset_[j]; e < offset_[j+1]; ++e) {
+      const Entry& entry = entry_[e];
+      real_t g, s;
+      derivative(entry.row, &g, &s);
+      num += g * entry.x_w;
+      den += s * entry.x_w * entry.x_w;
+    }
+    num += lambda * w[j*2];
+    den += lambda;
+    if (den <= 0) { return; }
+    real_t delta = -num / den;
+    w[j*2] += delta;
+    for (uint64 e = offset_[j]; e < offset_[j+1]; ++e) {
+      atomic_add(&score_[entry_[e].row], delta * entry_[e].x_w);
+    }
+  };
+  auto regular = [&]() -> double {
+    double sum = 0;
+    for (index_t j = 0; j < num_feat; ++j) { sum += w[j*2] * w[j*2]; }
+    return 0.5 * lambda * sum;
+  };
+  std::vector<real_t> old_w, old_score;
+  auto save = [&]() {
+    old_w.resize(num_feat);
+    for (index_t j = 0; j < num_feat; ++j) { old_w[j] = w[j*2]; }
+    old_score = score_;
+  };
+  auto restore = [&]() {
+    for (index_t j = 0; j < num_feat; ++j) { w[j*2] = old_w[j]; }
+    score_.swap(old_score);
+  };
+  sweep(step, regular, save, restore);
+}
+
+// The score of row i is linear in v_jf, whose derivative is
+// h_i = x_j * (q_if - v_jf * x_j), unless feature j has more
+// than one node in the row
+void CoordDescent::solve_latent(index_t f) {
+  real_t* v = model_->GetParameter_v();
+  index_t num_feat = model_->GetNumFeature();
+  index_t num_row = rows_.row_length;
+  index_t align0 = 2 * model_->get_aligned_k();
+  real_t lambda = regu_lambda_ * num_row;
+  auto step = [&](index_t j) {
+    if (offset_[j] == offset_[j+1]) { return; }
+    real_t& v_jf = v[(uint64)j * align0 + f];
+    double num = 0, den = 0;
+    for (uint64 e = offset_[j]; e < offset_[j+1]; ++e) {
+      const Entry& entry = entry_[e];
+      real_t q = atomic_load(&q_[(uint64)entry.row * num_K_ + f]);
+      real_t h = entry.x_v * (q - v_jf * entry.x_v);
+      real_t g, s;
+      derivative(entry.row, &g, &s);
+      num += g * h;
+      den += s * h * h;
+    }
+    num += lambda * v_jf;
+    den += lambda;
+    if (den <= 0) { return; }
+    real_t delta = -num / den;
+    // h_i is computed again, since q_if is moved by the others
+    for (uint64 e = offset_[j]; e < offset_[j+1]; ++e) {
+      const Entry& entry = entry_[e];
+      real_t* q = &q_[(uint64)entry.row * num_K_ + f];
+      real_t h = entry.x_v * (atomic_load(q) - v_jf * entry.x_v);
+      atomic_add(&score_[entry.row], delta * h);
+      atomic_add(q, delta * entry.x_v);
+    }
+    v_jf += delta;
+  };
+  auto regular = [&]() -> double {
+    double sum = 0;
+    for (index_t j = 0; j < num_feat; ++j) {
+      real_t v_jf = v[(uint64)j * align0 + f];
+      sum += v_jf * v_jf;
+    }
+    return 0.5 * lambda * sum;
+  };
+  std::vector<real_t> old_v, old_q, old_score;
+  auto save = [&]() {
+    old_v.resize(num_feat);
+    for (index_t j = 0; j < num_feat; ++j) {
+      old_v[j] = v[(uint64)j * align0 + f];
+    }
+    old_q.resize(num_row);
+    for (index_t i = 0; i < num_row; ++i) {
+      old_q[i] = q_[(uint64)i * num_K_ + f];
+    }
+    old_score = score_;
+  };
+  auto restore = [&]() {
+    for (index_t j = 0; j < num_feat; ++j) {
+      v[(uint64)j * align0 + f] = old_v[j];
+    }
+    for (index_t i = 0; i < num_row; ++i) {
+      q_[(uint64)i * num_K_ + f] = old_q[i];
+    }
+    score_.swap(old_score);
+  };
+  sweep(step, regular, save, restore);
+}
+
+index_t CoordDescent::Epoch() {
+  compute_cache();
+  solve_bias();
+  solve_linear();
+  for (index_t f = 0; f < num_K_; ++f) { solve_latent(f); }
+  return rows_.row_length;
+}
+
+}  // namespace xLearn
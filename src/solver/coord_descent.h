@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the CoordDescent class, which trains the linear
+and fm models by coordinate descent (-opt als).
+*/
+
+#ifndef XLEARN_SOLVER_COORD_DESCENT_H_
+#define XLEARN_SOLVER_COORD_DESCENT_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "src/solver/batch_solver.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// CoordDescent is the alternating least squares (ALS) of libFM, which is
+// an alternative of the SGD of the Loss for the linear and fm models of
+// the moderate number of features. Each epoch visits every parameter
+// once, the bias, each w_j, and then each v_jf for f in [0, K), and
+// solves it exactly with the others fixed:
+//
+//   theta = theta - (sum_i g_i * h_i + N * lambda * theta) /
+//                   (sum_i s_i * h_i^2 + N * lambda)
+//
+// where h_i is the derivative of the score of row i by theta, g_i and s_i
+// are the first and second derivatives of its loss by the score, and the
+// sums only run over the rows of the feature. The squared loss has s_i =
+// 1, so each step is the least squares solution. The cross-entropy uses
+// the bound s_i = 1/4 of its curvature, so each step never increases the
+// loss. The lambda is -b, on the same scale as the regular of SGD.
+//
+// The steps only need the rows of each feature, which the transposed
+// index of BatchSolver gives. The score of each row and q_if = sum_j
+// v_jf * x_j are cached and moved by each step. The features are solved
+// in parallel by the threads of the pool, whose moves of the shared
+// caches are atomic, and the caches are computed again from the model at
+// the start of each epoch. The parallel steps of the features that share
+// rows do not see each other, and the correlated features can overshoot
+// together, so the sweep over the features is taken again by one thread
+// from the former model if the objective goes up.
+//------------------------------------------------------------------------------
+class CoordDescent : public BatchSolver {
+ public:
+  CoordDescent() { }
+  ~CoordDescent() { }
+
+  void Initialize(std::vector<Reader*>& reader_list,
+                  Model* model,
+                  const Loss* loss,
+                  const std::string& loss_func,
+                  bool is_norm,
+                  real_t regu_lambda,
+                  ThreadPool* pool);
+
+  // Solve each parameter once, and return the number of rows
+  index_t Epoch();
+
+ protected:
+  index_t num_K_ = 0;
+  /* The q_if of row i and factor f at q_[i * num_K_ + f] */
+  std::vector<real_t> q_;
+
+  // Compute score_ and q_ from the model
+  void compute_cache();
+
+  // The first and second derivatives of the loss of row i
+  // by its score, which are scaled by its weight
+  inline void derivative(index_t i, real_t* g, real_t* s) const;
+
+  // The loss of the scores of all the rows, which are
+  // weighted as derivative()
+  double loss_sum() const;
+
+  // Run step(j) for each feature j by the threads. The model and the
+  // caches are kept by save(), and if the loss and the regular() of
+  // the solved parameters go up, they are moved back by restore()
+  // and the steps run again in one thread
+  void sweep(const std::function<void(index_t)>& step,
+             const std::function<double()>& regular,
+             const std::function<void()>& save,
+             const std::function<void()>& restore);
+
+  // Solve the bias, each w_j, and each v_jf of the factor f
+  void solve_bias();
+  void solve_linear();
+  void solve_latent(index_t f);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CoordDescent);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_COORD_DESCENT_H_
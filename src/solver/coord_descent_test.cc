@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests coord_descent.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/thread_pool.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/squared_loss.h"
+#include "src/reader/reader.h"
+#include "src/solver/coord_descent.h"
+
+namespace xLearn {
+
+const index_t kNumRow = 20000;
+const index_t kNumFeat = 512;
+// The features of a row are in different blocks of the threads
+const index_t kNumCopy = 8;
+const index_t kBlock = kNumFeat / kNumCopy;
+
+// The squared loss of the scores
+static double squared_loss(const std::vector<real_t>& score,
+                           const std::vector<real_t>& label) {
+  double loss = 0;
+  for (size_t i = 0; i < score.size(); ++i) {
+    loss += 0.5 * (score[i] - label[i]) * (score[i] - label[i]);
+  }
+  return loss;
+}
+
+// Each row has kNumCopy features of the same value, which are
+// solved by different threads, and the label is their sum
+static void train(const std::string& score_func,
+                  size_t num_thread,
+                  std::vector<double>* epoch_loss) {
+  std::vector<Node> node;
+  std::vector<uint64> offset(1, 0);
+  std::vector<real_t> label;
+  for (index_t i = 0; i < kNumRow; ++i) {
+    real_t x = 0.5 + 0.1 * (i % 7);
+    for (index_t c = 0; c < kNumCopy; ++c) {
+      node.push_back({ 0, c * kBlock + i % kBlock, x });
+    }
+    offset.push_back(node.size());
+    label.push_back(kNumCopy * x + 0.1 * (i % 3));
+  }
+  InmemReader reader;
+  reader.InitializeRows(node.data(), offset.data(), label.data(),
+                        kNumRow, kNumRow);
+  std::vector<Reader*> reader_list(1, &reader);
+  Model model;
+  model.Initialize(score_func, "squared", kNumFeat, 0, 4);
+  SquaredLoss loss;
+  ThreadPool pool(num_thread);
+  CoordDescent cd;
+  cd.Initialize(reader_list, &model, &loss, "squared", false, 0, &pool);
+  epoch_loss->clear();
+  for (int n = 0; n < 5; ++n) {
+    cd.Epoch();
+    epoch_loss->push_back(squared_loss(cd.Scores(), cd.Rows().Y));
+  }
+}
+
+// The parallel steps of the correlated features never move the loss
+// up, and they reach the loss of the steps of one thread
+TEST(COORD_DESCENT_TEST, Correlated_features) {
+  std::string score_func[] = { "linear", "fm" };
+  for (int s = 0; s < 2; ++s) {
+    std::vector<double> one, parallel;
+    train(score_func[s], 1, &one);
+    train(score_func[s], 8, &parallel);
+    for (size_t n = 1; n < parallel.size(); ++n) {
+      EXPECT_LE(parallel[n], parallel[n-1] * (1 + 1e-4));
+    }
+    EXPECT_LE(parallel.back(), one.back() * 1.05 + 1e-3);
+  }
+}
+
+}  // namespace xLearn
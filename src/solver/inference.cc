@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the Predictor class.
+*/
+
+#include "src/solver/inference.h"
+
+#include "src/base/math_kernel.h"
+
+namespace xLearn {
+
+// Predict all the rows of the reader
+index_t Predictor::Predict() {
+  size_t num_model = models_.size();
+  batch_.assign(kNumBatch, std::vector<std::vector<real_t>>(num_model));
+  free_.clear();
+  queue_.clear();
+  for (int i = 0; i < kNumBatch; ++i) { free_.push_back(i); }
+  finish_ = false;
+  std::vector<std::unique_ptr<OutputWriter>> output(blend_ ? 1 : num_model);
+  for (size_t m = 0; m < output.size(); ++m) {
+    output[m].reset(new OutputWriter);
+    output[m]->Open(out_files_[m], binary_output_);
+  }
+  std::thread writer(&Predictor::write_thread, this, &output);
+  DMatrix* matrix = nullptr;
+  index_t count = 0;
+  reader_->Reset();
+  for (;;) {
+    // Keep the original order of the rows
+    index_t tmp = reader_->Samples(matrix, false);
+    if (tmp == 0) { break; }
+    int id = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return !free_.empty(); });
+      id = free_.back();
+      free_.pop_back();
+    }
+    // The models score the batch in turn, and
+    // each of them uses all the threads
+    std::vector<std::vector<real_t>>& pred = batch_[id];
+    for (size_t m = 0; m < num_model; ++m) {
+      pred[m].resize(tmp);
+      losses_[m]->Predict(matrix, *models_[m], pred[m]);
+      transform(losses_[m], pred[m]);
+    }
+    if (blend_) {
+      for (size_t m = 1; m < num_model; ++m) {
+        for (index_t i = 0; i < tmp; ++i) { pred[0][i] += pred[m][i]; }
+      }
+      real_t scale = 1.0 / num_model;
+      for (index_t i = 0; i < tmp; ++i) { pred[0][i] *= scale; }
+    }
+    count += tmp;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(id);
+    }
+    cond_.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finish_ = true;
+  }
+  cond_.notify_all();
+  writer.join();
+  for (size_t m = 0; m < output.size(); ++m) { output[m]->Close(); }
+  return count;
+}
+
+// The batches are written in the order of the queue
+void Predictor::write_thread(
+    std::vector<std::unique_ptr<OutputWriter>>* writers) {
+  for (;;) {
+    int id = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return !queue_.empty() || finish_; });
+      if (queue_.empty()) { break; }
+      id = queue_.front();
+      queue_.pop_front();
+    }
+    const std::vector<std::vector<real_t>>& pred = batch_[id];
+    for (size_t m = 0; m < writers->size(); ++m) {
+      (*writers)[m]->Write(pred[m].data(), pred[m].size());
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(id);
+    }
+    cond_.notify_all();
+  }
+}
+
+// The probability for cross-entropy, and the
+// class for hinge. The squared loss is unchanged
+void Predictor::transform(Loss* loss, std::vector<real_t>& pred) {
+  std::string loss_type = loss->loss_type();
+  if (loss_type.compare("log_loss") == 0) {
+    GetMathKernel().sigmoid(pred.data(), pred.data(), pred.size());
+  } else if (loss_type.compare("hinge_loss") == 0) {
+    for (size_t i = 0; i < pred.size(); ++i) {
+      pred[i] = pred[i] > 0 ? 1.0 : -1.0;
+    }
+  }
+}
+
+} // namespace xLearn
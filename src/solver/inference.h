@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the Predictor class.
+*/
+
+#ifndef XLEARN_SOLVER_INFERENCE_H_
+#define XLEARN_SOLVER_INFERENCE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/output_writer.h"
+#include "src/reader/reader.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/loss.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Predictor is the inference engine of xLearn. The batches of the reader
+// are scored by the threads of the Loss, and the scores are transformed by
+// the loss type: the probability (sigmoid) for cross-entropy, the class
+// (-1 or 1) for hinge, and the raw score for squared.
+//
+// The results are written to the output file by a writer thread through
+// the OutputWriter, in text or in raw float32, so the scoring of the next
+// batch does not wait for the formatting and the disk. The predictions of at most kNumBatch batches
+// are in flight:
+//
+//   Predictor pdc;
+//   pdc.Initialize(reader, model, loss, "/tmp/out.txt");
+//   index_t n = pdc.Predict();
+//
+// More models can score the same batches, so the input is parsed once for
+// all of them. Each model has its own output file, or the mean of their
+// predictions is written to the output file of Initialize() by SetBlend():
+//
+//   pdc.Initialize(reader, model, loss, "/tmp/out.txt");
+//   pdc.AddModel(model_2, loss_2, "/tmp/out.txt.1");
+//   index_t n = pdc.Predict();
+//------------------------------------------------------------------------------
+class Predictor {
+ public:
+  Predictor() { }
+  ~Predictor() { }
+
+  // Invoke this function before we use this class
+  void Initialize(Reader* reader,
+                  Model* model,
+                  Loss* loss,
+                  const std::string& out_file,
+                  bool binary_output = false) {
+    CHECK_NOTNULL(reader);
+    reader_ = reader;
+    models_.clear();
+    losses_.clear();
+    out_files_.clear();
+    AddModel(model, loss, out_file);
+    binary_output_ = binary_output;
+  }
+
+  // Score the batches by one more model, whose loss
+  // should use the threads of the first one
+  void AddModel(Model* model, Loss* loss, const std::string& out_file) {
+    CHECK_NOTNULL(model);
+    CHECK_NOTNULL(loss);
+    CHECK_NE(out_file.empty(), true);
+    models_.push_back(model);
+    losses_.push_back(loss);
+    out_files_.push_back(out_file);
+  }
+
+  // Write the mean of the predictions of all the
+  // models instead of one output file per model
+  void SetBlend(bool blend) { blend_ = blend; }
+
+  // Predict all the rows of the reader, and
+  // return the number of the predicted rows
+  index_t Predict();
+
+ protected:
+  Reader* reader_;
+  std::vector<Model*> models_;
+  std::vector<Loss*> losses_;
+  std::vector<std::string> out_files_;
+  bool binary_output_ = false;
+  bool blend_ = false;
+
+  /* Number of the batches in flight */
+  static const int kNumBatch = 4;
+
+  /* The predictions of each model of each batch, which are
+  in the free list, or in the queue of the writer thread */
+  std::vector<std::vector<std::vector<real_t>>> batch_;
+  std::vector<int> free_;
+  std::deque<int> queue_;
+  /* The end of the predictions */
+  bool finish_ = false;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+
+  // Write the batches of the queue to the output
+  // files until finish_ is set
+  void write_thread(std::vector<std::unique_ptr<OutputWriter>>* writers);
+
+  // Transform the scores by the loss type
+  void transform(Loss* loss, std::vector<real_t>& pred);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Predictor);
+};
+
+} // namespace xLearn
+
+#endif  // XLEARN_SOLVER_INFERENCE_H_
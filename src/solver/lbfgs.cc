@@ -0,0 +1,291 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of LBFGS.
+*/
+
+#include "src/solver/lbfgs.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace xLearn {
+
+// The rows of each block of the sums
+static const index_t kBlockRows = 4096;
+// The sufficient decrease of the line search
+static const double kArmijo = 1e-4;
+// The trials of the line search, whose step is halved
+static const int kMaxTrial = 30;
+// The training converges at |pg| <= kTolerance * max(1, |x|)
+static const double kTolerance = 1e-6;
+
+static inline double dot(const std::vector<double>& a,
+                         const std::vector<double>& b) {
+  double sum = 0;
+  for (size_t j = 0; j < a.size(); ++j) { sum += a[j] * b[j]; }
+  return sum;
+}
+
+void LBFGS::Initialize(std::vector<Reader*>& reader_list,
+                       Model* model,
+                       const Loss* loss,
+                       const std::string& loss_func,
+                       bool is_norm,
+                       real_t regu_lambda,
+                       ThreadPool* pool) {
+  CHECK_EQ(model->GetScoreFunction(), "linear");
+  BatchSolver::Initialize(reader_list, model, loss, loss_func,
+                          is_norm, regu_lambda, pool);
+  // The objective is the mean over the rows
+  CHECK_GT(rows_.row_length, 0);
+  index_t num_block = (rows_.row_length + kBlockRows - 1) / kBlockRows;
+  deriv_.assign(rows_.row_length, 0);
+  block_loss_.assign(num_block, 0);
+  block_deriv_.assign(num_block, 0);
+  index_t num_feat = model->GetNumFeature();
+  const real_t* w = model->GetParameter_w();
+  x_.resize(num_feat + 1);
+  x_[0] = model->GetParameter_b()[0];
+  for (index_t j = 0; j < num_feat; ++j) { x_[j+1] = w[j*2]; }
+  s_list_.clear();
+  y_list_.clear();
+  rho_list_.clear();
+  started_ = false;
+  converged_ = false;
+}
+
+double LBFGS::evaluate(const std::vector<double>& x) {
+  index_t num_row = rows_.row_length;
+  pool_->ParallelFor(0, block_loss_.size(), 1,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t k = start; k < end; ++k) {
+        double sum_loss = 0, sum_deriv = 0;
+        index_t last = std::min((index_t)((k + 1) * kBlockRows), num_row);
+        for (index_t i = k * kBlockRows; i < last; ++i) {
+          RowView row = rows_.GetRow(i);
+          double score = 0;
+          for (index_t j = 0; j < row.dense_size(); ++j) {
+            score += x[j+1] * row.dense()[j];
+          }
+          for (const Node* iter = row.begin(); iter != row.end(); ++iter) {
+            score += x[iter->feat_id+1] * iter->feat_val;
+          }
+          score = x[0] + score * sqrt(rows_.norm[i]);
+          score_[i] = score;
+          double y = label_[i];
+          double c = weight_[i];
+          if (squared_) {
+            sum_loss += 0.5 * (score - y) * (score - y) * c;
+            deriv_[i] = (score - y) * c;
+          } else {
+            double z = y * score;
+            sum_loss += (z > 0 ? log1p(exp(-z)) : -z + log1p(exp(z))) * c;
+            deriv_[i] = -y / (1.0 + exp(z)) * c;
+          }
+          sum_deriv += deriv_[i];
+        }
+        block_loss_[k] = sum_loss;
+        block_deriv_[k] = sum_deriv;
+      }
+    });
+  double sum = 0;
+  for (size_t k = 0; k < block_loss_.size(); ++k) {
+    sum += block_loss_[k];
+  }
+  double w_square = 0;
+  for (size_t j = 1; j < x.size(); ++j) { w_square += x[j] * x[j]; }
+  return sum / num_row + 0.5 * regu_lambda_ * w_square;
+}
+
+void LBFGS::gradient(const std::vector<double>& x,
+                     std::vector<double>* grad) {
+  index_t num_row = rows_.row_length;
+  grad->resize(x.size());
+  double bias = 0;
+  for (size_t k = 0; k < block_deriv_.size(); ++k) {
+    bias += block_deriv_[k];
+  }
+  (*grad)[0] = bias / num_row;
+  pool_->ParallelFor(0, x.size() - 1, 64,
+    [&](size_t id, size_t start, size_t end) {
+      for (size_t j = start; j < end; ++j) {
+        double sum = 0;
+        for (uint64 e = offset_[j]; e < offset_[j+1]; ++e) {
+          sum += deriv_[entry_[e].row] * entry_[e].x_w;
+        }
+        (*grad)[j+1] = sum / num_row + regu_lambda_ * x[j+1];
+      }
+    });
+}
+
+// The pseudo-gradient takes the one-sided derivative of
+// |w_j| that decreases F, or 0 at a minimum of w_j = 0
+void LBFGS::pseudo_gradient(std::vector<double>* pg) const {
+  *pg = grad_;
+  if (lambda_1_ == 0) { return; }
+  for (size_t j = 1; j < x_.size(); ++j) {
+    double g = grad_[j];
+    if (x_[j] > 0) {
+      (*pg)[j] = g + lambda_1_;
+    } else if (x_[j] < 0) {
+      (*pg)[j] = g - lambda_1_;
+    } else if (g + lambda_1_ < 0) {
+      (*pg)[j] = g + lambda_1_;
+    } else if (g - lambda_1_ > 0) {
+      (*pg)[j] = g - lambda_1_;
+    } else {
+      (*pg)[j] = 0;
+    }
+  }
+}
+
+void LBFGS::direction(const std::vector<double>& pg,
+                      std::vector<double>* dir) const {
+  std::vector<double> q = pg;
+  size_t k = s_list_.size();
+  std::vector<double> alpha(k);
+  for (size_t n = k; n-- > 0; ) {
+    alpha[n] = rho_list_[n] * dot(s_list_[n], q);
+    const std::vector<double>& y = y_list_[n];
+    for (size_t j = 0; j < q.size(); ++j) { q[j] -= alpha[n] * y[j]; }
+  }
+  // The initial Hessian is scaled by the last pair
+  if (k > 0) {
+    double gamma = dot(s_list_[k-1], y_list_[k-1]) /
+                   dot(y_list_[k-1], y_list_[k-1]);
+    for (size_t j = 0; j < q.size(); ++j) { q[j] *= gamma; }
+  }
+  for (size_t n = 0; n < k; ++n) {
+    double beta = rho_list_[n] * dot(y_list_[n], q);
+    const std::vector<double>& s = s_list_[n];
+    for (size_t j = 0; j < q.size(); ++j) {
+      q[j] += (alpha[n] - beta) * s[j];
+    }
+  }
+  dir->resize(q.size());
+  for (size_t j = 0; j < q.size(); ++j) { (*dir)[j] = -q[j]; }
+}
+
+double LBFGS::l1_norm(const std::vector<double>& x) const {
+  if (lambda_1_ == 0) { return 0; }
+  double sum = 0;
+  for (size_t j = 1; j < x.size(); ++j) { sum += fabs(x[j]); }
+  return lambda_1_ * sum;
+}
+
+void LBFGS::save_model() {
+  real_t* w = model_->GetParameter_w();
+  model_->GetParameter_b()[0] = x_[0];
+  for (size_t j = 1; j < x_.size(); ++j) { w[(j-1)*2] = x_[j]; }
+}
+
+index_t LBFGS::Epoch() {
+  if (!started_) {
+    objective_ = evaluate(x_) + l1_norm(x_);
+    gradient(x_, &grad_);
+    started_ = true;
+  }
+  if (converged_) { return rows_.row_length; }
+  std::vector<double> pg;
+  pseudo_gradient(&pg);
+  double pg_norm = sqrt(dot(pg, pg));
+  if (pg_norm <= kTolerance * std::max(1.0, sqrt(dot(x_, x_)))) {
+    LOG(INFO) << "L-BFGS converges at objective " << objective_;
+    converged_ = true;
+    return rows_.row_length;
+  }
+  std::vector<double> dir;
+  direction(pg, &dir);
+  // OWL-QN keeps the direction in the orthant of -pg
+  if (lambda_1_ > 0) {
+    for (size_t j = 1; j < dir.size(); ++j) {
+      if (dir[j] * pg[j] >= 0) { dir[j] = 0; }
+    }
+  }
+  if (dot(dir, pg) >= 0) {
+    // The history gives no descent, and is dropped
+    s_list_.clear();
+    y_list_.clear();
+    rho_list_.clear();
+    for (size_t j = 0; j < dir.size(); ++j) { dir[j] = -pg[j]; }
+  }
+  // The orthant of the trial points
+  std::vector<double> orthant(x_.size(), 0);
+  for (size_t j = 1; j < x_.size(); ++j) {
+    orthant[j] = x_[j] != 0 ? x_[j] : -pg[j];
+  }
+  double step = s_list_.empty() ? 1.0 / pg_norm : 1.0;
+  std::vector<double> x_new(x_.size());
+  double obj_new = 0;
+  bool accepted = false;
+  for (int trial = 0; trial < kMaxTrial; ++trial) {
+    double decrease = 0;
+    for (size_t j = 0; j < x_.size(); ++j) {
+      x_new[j] = x_[j] + step * dir[j];
+      if (lambda_1_ > 0 && j > 0 && x_new[j] * orthant[j] <= 0) {
+        x_new[j] = 0;
+      }
+      decrease += pg[j] * (x_new[j] - x_[j]);
+    }
+    obj_new = evaluate(x_new) + l1_norm(x_new);
+    if (obj_new <= objective_ + kArmijo * decrease) {
+      accepted = true;
+      break;
+    }
+    step *= 0.5;
+  }
+  if (!accepted) {
+    // The objective cannot decrease in its precision, so the
+    // model is kept, and the scores are computed again
+    LOG(INFO) << "The line search of L-BFGS finds no decrease at "
+              << "objective " << objective_;
+    evaluate(x_);
+    converged_ = true;
+    return rows_.row_length;
+  }
+  std::vector<double> grad_new;
+  gradient(x_new, &grad_new);
+  std::vector<double> s(x_.size()), y(x_.size());
+  for (size_t j = 0; j < x_.size(); ++j) {
+    s[j] = x_new[j] - x_[j];
+    y[j] = grad_new[j] - grad_[j];
+  }
+  double sy = dot(s, y);
+  if (sy > 1e-10) {
+    s_list_.push_back(s);
+    y_list_.push_back(y);
+    rho_list_.push_back(1.0 / sy);
+    if (s_list_.size() > (size_t)memory_) {
+      s_list_.pop_front();
+      y_list_.pop_front();
+      rho_list_.pop_front();
+    }
+  }
+  x_.swap(x_new);
+  grad_.swap(grad_new);
+  objective_ = obj_new;
+  save_model();
+  index_t nonzero = 0;
+  for (size_t j = 1; j < x_.size(); ++j) { nonzero += x_[j] != 0; }
+  LOG(INFO) << "L-BFGS objective " << objective_ << ", step " << step
+            << ", nonzero weights " << nonzero;
+  return rows_.row_length;
+}
+
+}  // namespace xLearn
@@ -0,0 +1,138 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the LBFGS class, which trains the linear
+model by L-BFGS and OWL-QN (-opt lbfgs).
+*/
+
+#ifndef XLEARN_SOLVER_LBFGS_H_
+#define XLEARN_SOLVER_LBFGS_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "src/solver/batch_solver.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// LBFGS is the full-batch quasi-Newton solver of the linear model, which
+// minimizes the objective of all the rows in memory:
+//
+//   F(w) = sum_i c_i * loss(y_i, score_i) / N + lambda/2 * |w|^2
+//          + lambda_1 * |w|_1
+//
+// where c_i is the weight of row i, N is the number of rows, lambda is -b
+// and lambda_1 is -lambda_1. The bias is not regularized, as in the SGD.
+// Each epoch is one iteration: the direction is given by the last m pairs
+// of steps and gradient changes (the two-loop recursion of L-BFGS), and
+// a backtracking line search takes the first step of sufficient decrease.
+// The L1 term is handled by OWL-QN: the pseudo-gradient replaces the
+// gradient, the direction is kept in its orthant, and each trial point is
+// projected on the orthant of the current one, so the weights reach zero
+// and give a sparse model.
+//
+// The epochs after the convergence keep the model, whose validation and
+// early-stopping are the same as the other epochs.
+//
+// The loss and the score of each row are computed by the threads of the
+// pool on fixed blocks of rows, and the gradient of each feature on its
+// rows of the transposed index, so the sums are in the same order for
+// any number of threads and the training is deterministic.
+//------------------------------------------------------------------------------
+class LBFGS : public BatchSolver {
+ public:
+  LBFGS() { }
+  ~LBFGS() { }
+
+  // Set the L1 regular, which is 0 (plain L-BFGS) by default
+  void SetL1(real_t lambda_1) {
+    CHECK_GE(lambda_1, 0);
+    lambda_1_ = lambda_1;
+  }
+
+  // Set the number of pairs in the history
+  void SetMemory(int memory) {
+    CHECK_GT(memory, 0);
+    memory_ = memory;
+  }
+
+  void Initialize(std::vector<Reader*>& reader_list,
+                  Model* model,
+                  const Loss* loss,
+                  const std::string& loss_func,
+                  bool is_norm,
+                  real_t regu_lambda,
+                  ThreadPool* pool);
+
+  // Run one iteration, and return the number of rows
+  index_t Epoch();
+
+  // The objective F of the current model
+  double Objective() const { return objective_; }
+
+ protected:
+  real_t lambda_1_ = 0;
+  int memory_ = 10;
+  /* The parameters are x_[0] for the bias and x_[j+1] for
+  w_j, and grad_ is the gradient of the smooth part */
+  std::vector<double> x_;
+  std::vector<double> grad_;
+  double objective_ = 0;
+  bool started_ = false;
+  /* The later epochs keep the model */
+  bool converged_ = false;
+  /* The history of the steps s_k and gradient changes y_k,
+  and rho_k = 1 / (s_k * y_k) */
+  std::deque<std::vector<double>> s_list_;
+  std::deque<std::vector<double>> y_list_;
+  std::deque<double> rho_list_;
+  /* The derivative of the loss of each row by its score,
+  which is scaled by the weight of the row */
+  std::vector<double> deriv_;
+  /* The sums of the loss and of deriv_ of each block of rows */
+  std::vector<double> block_loss_;
+  std::vector<double> block_deriv_;
+
+  // Compute score_ and deriv_ at x, and return the
+  // smooth part of F
+  double evaluate(const std::vector<double>& x);
+
+  // The gradient of the smooth part of F at the x of the
+  // last evaluate()
+  void gradient(const std::vector<double>& x,
+                std::vector<double>* grad);
+
+  // The pseudo-gradient of OWL-QN, which is the gradient
+  // if lambda_1_ is 0
+  void pseudo_gradient(std::vector<double>* pg) const;
+
+  // The direction -H * pg of the two-loop recursion
+  void direction(const std::vector<double>& pg,
+                 std::vector<double>* dir) const;
+
+  // The L1 term of x
+  double l1_norm(const std::vector<double>& x) const;
+
+  // Copy x_ into the model
+  void save_model();
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_LBFGS_H_
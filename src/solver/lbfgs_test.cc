@@ -0,0 +1,173 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests lbfgs.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/thread_pool.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/cross_entropy_loss.h"
+#include "src/loss/squared_loss.h"
+#include "src/reader/reader.h"
+#include "src/solver/lbfgs.h"
+
+namespace xLearn {
+
+const int kEpoch = 100;
+
+// The rows of the test, in the layout of InmemReader
+struct Rows {
+  std::vector<Node> node;
+  std::vector<uint64> offset;
+  std::vector<real_t> label;
+  Rows() : offset(1, 0) { }
+  void AddRow(const std::vector<real_t>& x, real_t y) {
+    for (size_t j = 0; j < x.size(); ++j) {
+      if (x[j] != 0) { node.push_back({ 0, (index_t)j, x[j] }); }
+    }
+    offset.push_back(node.size());
+    label.push_back(y);
+  }
+};
+
+// Train the linear model by kEpoch iterations
+static void train(const Rows& rows, const std::string& loss_func,
+                  index_t num_feat, real_t lambda_1, size_t num_thread,
+                  Model* model, std::vector<real_t>* score) {
+  index_t num_row = rows.label.size();
+  InmemReader reader;
+  reader.InitializeRows(rows.node.data(), rows.offset.data(),
+                        rows.label.data(), num_row, num_row);
+  std::vector<Reader*> reader_list(1, &reader);
+  model->Initialize("linear", loss_func, num_feat, 0, 0);
+  SquaredLoss squared;
+  CrossEntropyLoss cross_entropy;
+  const Loss* loss = &squared;
+  if (loss_func == "cross-entropy") { loss = &cross_entropy; }
+  ThreadPool pool(num_thread);
+  LBFGS lbfgs;
+  lbfgs.SetL1(lambda_1);
+  lbfgs.Initialize(reader_list, model, loss, loss_func, false, 0, &pool);
+  for (int n = 0; n < kEpoch; ++n) {
+    lbfgs.Epoch();
+  }
+  *score = lbfgs.Scores();
+}
+
+// The labels are a linear function of the features, so
+// the model reaches them with an objective of 0
+TEST(LBFGS_TEST, Squared_optimum) {
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<real_t> dist(-1, 1);
+  Rows rows;
+  for (int i = 0; i < 500; ++i) {
+    std::vector<real_t> x = { dist(gen), dist(gen), dist(gen) };
+    rows.AddRow(x, 0.5 + 2 * x[0] - x[1] + 0.25 * x[2]);
+  }
+  Model model;
+  std::vector<real_t> score;
+  train(rows, "squared", 3, 0, 1, &model, &score);
+  real_t* w = model.GetParameter_w();
+  EXPECT_NEAR(model.GetParameter_b()[0], 0.5, 1e-4);
+  EXPECT_NEAR(w[0], 2.0, 1e-4);
+  EXPECT_NEAR(w[2], -1.0, 1e-4);
+  EXPECT_NEAR(w[4], 0.25, 1e-4);
+}
+
+// The rows of feature 0 have 3/4 of positive labels and the rows
+// of feature 1 have 1/5, so the optimum of the cross-entropy
+// gives them the scores of log(p / (1-p))
+TEST(LBFGS_TEST, Cross_entropy_optimum) {
+  Rows rows;
+  for (int i = 0; i < 400; ++i) {
+    rows.AddRow({ 1, 0 }, i % 4 != 0 ? 1 : 0);
+    rows.AddRow({ 0, 1 }, i % 5 == 0 ? 1 : 0);
+  }
+  Model model;
+  std::vector<real_t> score;
+  train(rows, "cross-entropy", 2, 0, 1, &model, &score);
+  EXPECT_NEAR(score[0], log(0.75 / 0.25), 1e-3);
+  EXPECT_NEAR(score[1], log(0.2 / 0.8), 1e-3);
+}
+
+// Only the first two of the ten features move the labels, and the
+// L1 regular of OWL-QN gives the others exact zero weights
+TEST(LBFGS_TEST, OWLQN_sparse_weights) {
+  const index_t num_feat = 10;
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<real_t> dist(-1, 1);
+  Rows rows;
+  for (int i = 0; i < 2000; ++i) {
+    std::vector<real_t> x(num_feat);
+    for (index_t j = 0; j < num_feat; ++j) { x[j] = dist(gen); }
+    rows.AddRow(x, 2 * x[0] - 1.5 * x[1] + 0.1 * dist(gen));
+  }
+  Model l2_model, l1_model;
+  std::vector<real_t> score;
+  train(rows, "squared", num_feat, 0, 1, &l2_model, &score);
+  train(rows, "squared", num_feat, 0.05, 1, &l1_model, &score);
+  real_t* l2_w = l2_model.GetParameter_w();
+  real_t* l1_w = l1_model.GetParameter_w();
+  EXPECT_NE(l1_w[0], 0);
+  EXPECT_NE(l1_w[2], 0);
+  for (index_t j = 2; j < num_feat; ++j) {
+    EXPECT_NE(l2_w[j*2], 0);
+    EXPECT_EQ(l1_w[j*2], 0);
+  }
+}
+
+// The sums are in the same order for any number of threads,
+// so the models are the same in every bit
+TEST(LBFGS_TEST, Same_model_of_threads) {
+  const index_t num_feat = 256;
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<real_t> dist(-1, 1);
+  std::uniform_int_distribution<index_t> feat(0, num_feat - 1);
+  Rows rows;
+  // More than one block of the rows
+  for (int i = 0; i < 20000; ++i) {
+    std::vector<real_t> x(num_feat, 0);
+    real_t sum = 0;
+    for (int n = 0; n < 8; ++n) {
+      index_t j = feat(gen);
+      x[j] = dist(gen);
+      sum += (j % 3 == 0 ? 1 : -1) * x[j];
+    }
+    rows.AddRow(x, sum + 0.5 * dist(gen) > 0 ? 1 : 0);
+  }
+  Model one, four;
+  std::vector<real_t> one_score, four_score;
+  train(rows, "cross-entropy", num_feat, 0.001, 1, &one, &one_score);
+  train(rows, "cross-entropy", num_feat, 0.001, 4, &four, &four_score);
+  EXPECT_EQ(one.GetParameter_b()[0], four.GetParameter_b()[0]);
+  for (index_t j = 0; j < num_feat; ++j) {
+    EXPECT_EQ(one.GetParameter_w()[j*2], four.GetParameter_w()[j*2]);
+  }
+  for (size_t i = 0; i < one_score.size(); ++i) {
+    EXPECT_EQ(one_score[i], four_score[i]);
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,163 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of metrics_log.h
+*/
+
+#include "src/solver/metrics_log.h"
+
+namespace xLearn {
+
+bool MetricsLog::Open(const std::string& filename) {
+  Close();
+  file_ = fopen(filename.c_str(), "w");
+  return file_ != nullptr;
+}
+
+void MetricsLog::Write(const JsonObject& record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == nullptr) { return; }
+  std::string line = record.ToString() + "\n";
+  fwrite(line.data(), 1, line.size(), file_);
+  fflush(file_);
+}
+
+void MetricsLog::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ != nullptr) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+JsonObject HyperParamRecord(const HyperParam& param) {
+  JsonObject record;
+  record.AddString("type", "hyper_param")
+        .AddString("score_func", param.score_func)
+        .AddString("loss_func", param.loss_func)
+        .AddString("metric", param.metric)
+        .AddBool("exact_auc", param.exact_auc)
+        .AddReal("learning_rate", param.learning_rate)
+        .AddReal("regu_lambda", param.regu_lambda)
+        .AddString("opt_method", param.opt_method)
+        .AddReal("alpha", param.alpha)
+        .AddReal("beta", param.beta)
+        .AddReal("lambda_1", param.lambda_1)
+        .AddReal("lambda_2", param.lambda_2)
+        .AddString("sqrt_precision", param.sqrt_precision)
+        .AddString("thread_mode", param.thread_mode)
+        .AddInt("batch_size", param.batch_size)
+        .AddString("schedule", param.schedule)
+        .AddInt("grain", param.grain)
+        .AddInt("thread_number", param.thread_number)
+        .AddString("affinity", param.affinity)
+        .AddString("numa_policy", param.numa_policy)
+        .AddString("huge_page", param.huge_page)
+        .AddString("param_file", param.param_file)
+        .AddInt("model_shards", param.model_shards)
+        .AddBool("sparse_latent", param.sparse_latent)
+        .AddString("latent_layout", param.latent_layout)
+        .AddString("cache_precision", param.cache_precision)
+        .AddBool("shared_cache", param.shared_cache)
+        .AddString("field_pairs", param.field_pairs_file)
+        .AddString("learn_field_pairs", param.learn_field_pairs)
+        .AddReal("field_pair_ratio", param.field_pair_ratio)
+        .AddString("field_k", param.field_k)
+        .AddString("field_groups", param.field_groups_file)
+        .AddString("learn_field_groups", param.learn_field_groups)
+        .AddInt("num_field_groups", param.num_field_groups)
+        .AddInt("pipeline_depth", param.pipeline_depth)
+        .AddInt("io_depth", param.io_depth)
+        .AddBool("direct_io", param.direct_io)
+        .AddBool("spill_disk", param.spill_disk)
+        .AddReal("model_scale", param.model_scale)
+        .AddInt("model_seed", param.model_seed)
+        .AddInt("num_epoch", param.num_epoch)
+        .AddInt("sample_size", param.sample_size)
+        .AddBool("auto_sample_size", param.auto_sample_size)
+        .AddBool("norm", param.norm)
+        .AddBool("on_disk", param.on_disk)
+        .AddBool("compact_data", param.compact_data)
+        .AddBool("sort_nodes", param.sort_nodes)
+        .AddBool("dense_data", param.dense_data)
+        .AddBool("compress_cache", param.compress_cache)
+        .AddBool("full_hash_cache", param.full_hash_cache)
+        .AddString("cache_dir", param.cache_dir)
+        .AddInt("cache_mb", param.cache_mb)
+        .AddInt("shuffle_window", param.shuffle_window)
+        .AddInt("shuffle_block", param.shuffle_block)
+        .AddInt("hash_bucket", param.hash_bucket)
+        .AddReal("neg_sample", param.neg_sample)
+        .AddBool("dedup_rows", param.dedup_rows)
+        .AddReal("part_decay", param.part_decay)
+        .AddBool("shuffle_copy", param.shuffle_copy)
+        .AddBool("group_rows", param.group_rows)
+        .AddBool("remap_feature", param.remap_feature)
+        .AddBool("freq_order", param.freq_order)
+        .AddInt("min_count", param.min_count)
+        .AddBool("oov_feature", param.oov_feature)
+        .AddInt("prefetch_distance", param.prefetch_distance)
+        .AddBool("weights_only_model", param.weights_only_model)
+        .AddBool("mapped_model", param.mapped_model)
+        .AddBool("sparse_model", param.sparse_model)
+        .AddBool("chunked_model", param.chunked_model)
+        .AddInt("num_feature", param.num_feature)
+        .AddInt("num_param", param.num_param)
+        .AddInt("num_K", param.num_K)
+        .AddInt("num_field", param.num_field)
+        .AddString("train_set_file", param.train_set_file)
+        .AddString("test_set_file", param.test_set_file)
+        .AddString("model_file", param.model_file)
+        .AddString("pre_model_file", param.pre_model_file)
+        .AddString("log_file", param.log_file)
+        .AddString("metrics_file", param.metrics_file)
+        .AddBool("cross_validation", param.cross_validation)
+        .AddInt("num_folds", param.num_folds)
+        .AddBool("early_stop", param.early_stop)
+        .AddInt("stop_window", param.stop_window)
+        .AddInt("valid_batches", param.valid_batches)
+        .AddInt("async_valid", param.async_valid)
+        .AddInt("checkpoint_epoch", param.checkpoint_epoch)
+        .AddReal("checkpoint_minute", param.checkpoint_minute)
+        .AddBool("checkpoint_delta", param.checkpoint_delta)
+        .AddBool("resume", param.resume)
+        .AddReal("budget_minute", param.budget_minute)
+        .AddBool("use_gpu", param.use_gpu)
+        .AddBool("tune_kernel", param.tune_kernel)
+        .AddBool("online", param.online)
+        .AddInt("admit_count", param.admit_count)
+        .AddReal("ttl_minute", param.ttl_minute)
+        .AddInt("max_feature", param.max_feature)
+        .AddReal("train_sample", param.train_sample)
+        .AddReal("loss_sample", param.loss_sample)
+        .AddString("ps_servers", param.ps_servers)
+        .AddString("ring_nodes", param.ring_nodes)
+        .AddInt("sync_batches", param.sync_batches)
+        .AddInt("worker_id", param.worker_id)
+        .AddInt("num_workers", param.num_workers)
+        .AddInt("staleness", param.staleness)
+        .AddString("ps_quant", param.ps_quant)
+        .AddBool("shard_data", param.shard_data)
+        .AddString("shm_name", param.shm_name)
+        .AddBool("quiet", param.quiet);
+  return record;
+}
+
+}  // namespace xLearn
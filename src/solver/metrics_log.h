@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the MetricsLog class, which writes the
+machine-readable metrics of a training run.
+*/
+
+#ifndef XLEARN_SOLVER_METRICS_LOG_H_
+#define XLEARN_SOLVER_METRICS_LOG_H_
+
+#include <stdio.h>
+
+#include <mutex>
+#include <string>
+
+#include "src/base/common.h"
+#include "src/base/json_writer.h"
+#include "src/data/hyper_parameters.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// MetricsLog writes the metrics of a training run to an NDJSON file, i.e.,
+// one JSON object per line, and each line is flushed at once so that the
+// file can be followed during the training. Each record has a "type":
+//
+//   "hyper_param" : the hyper-parameters after checking the arguments
+//   "memory"      : the bytes of the subsystems (see MemoryStats)
+//   "epoch"       : the loss, metric, time, throughput and thread load
+//                   of an epoch
+//   "summary"     : the wall-clock time of the phases and the totals
+//
+// The epochs of the asynchronous validation are written by its thread,
+// so Write() can be called by several threads:
+//
+//   MetricsLog log;
+//   if (log.Open("/tmp/metrics.json")) {
+//     JsonObject record;
+//     record.AddString("type", "epoch").AddInt("epoch", 0);
+//     log.Write(record);
+//   }
+//------------------------------------------------------------------------------
+class MetricsLog {
+ public:
+  MetricsLog() : file_(nullptr) { }
+  ~MetricsLog() { Close(); }
+
+  // Create (or truncate) the file. Return false if
+  // it cannot be opened
+  bool Open(const std::string& filename);
+
+  // True if the file is opened
+  inline bool IsOpen() const { return file_ != nullptr; }
+
+  // Write the record as one line
+  void Write(const JsonObject& record);
+
+  // Close the file, which is also done by the destructor
+  void Close();
+
+ protected:
+  FILE* file_;
+  std::mutex mutex_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MetricsLog);
+};
+
+// The "hyper_param" record of the hyper-parameters
+JsonObject HyperParamRecord(const HyperParam& param);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_METRICS_LOG_H_
@@ -28,8 +28,8 @@ This file is the entry for prediction of the xLearn.
 //------------------------------------------------------------------------------
 
 int main(int argc, char* argv[]) {
-  clock_t start, end;
-  start = clock();
+  Timer timer;
+  timer.tic();
 
   xLearn::Solver solver;
   solver.SetPredict();
@@ -37,9 +37,8 @@ int main(int argc, char* argv[]) {
   solver.StartWork();
   solver.FinalizeWork();
 
-  end = clock();
   printf("Total time: %.2f sec",
-         (float)(end-start) / CLOCKS_PER_SEC);
+         timer.toc());
 
   return 0;
 }
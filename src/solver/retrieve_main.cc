@@ -0,0 +1,247 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the entry of the xlearn_retrieve tool, which retrieves the
+top-k items of each user by the FMIndex of an fm model. The index of the
+items (one row of item features per line, in the libsvm format without
+the label) is built once:
+
+  xlearn_retrieve --build [ options ] model_file item_file index_file
+
+and then the items of each user row of the user file are retrieved, and
+written as "item:score" (the item is the line of the item file, from 0):
+
+  xlearn_retrieve [ options ] model_file index_file user_file output_file
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/executor.h"
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/data/data_structure.h"
+#include "src/data/feature_map.h"
+#include "src/data/model_parameters.h"
+#include "src/reader/parser.h"
+#include "src/score/fm_index.h"
+
+namespace {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_retrieve --build [ options ] model_file item_file index_file \n"
+"     xlearn_retrieve [ options ] model_file index_file user_file output_file \n"
+"                                                                          \n"
+"  Build the index of the items of an fm model, or retrieve the items of the top scores of each \n"
+"  user. The item file and the user file have one row of features per line, in the libsvm \n"
+"  format without the label. The scores are the raw scores of the user row followed by the item \n"
+"  row, which are exact for the models trained with --no-norm. \n"
+"                                                               \n"
+"OPTIONS: \n"
+"  -lists <number>      :  Number of the lists of the index. Using sqrt(number of items) by default. \n"
+"                                                                                                  \n"
+"  -top <number>        :  Number of the retrieved items of each user. Using 10 by default. \n"
+"                                                                                        \n"
+"  -probe <number>      :  Number of the lists searched for each user, and the search is exact \n"
+"                          if it is the number of the lists. Using 8 by default. \n"
+"                                                                           \n"
+"  -nthread <number>    :  Number of the threads. Using all the cores by default. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+struct RetrieveOption {
+  bool build = false;
+  xLearn::index_t num_list = 0;
+  xLearn::index_t top_k = 10;
+  xLearn::index_t num_probe = 8;
+  int nthread = 0;
+  std::vector<std::string> file_list;
+};
+
+// Return false for the illegal options
+bool parse_option(int argc, char* argv[], RetrieveOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--build") {
+      option->build = true;
+    } else if (arg == "-lists" || arg == "-top" ||
+               arg == "-probe" || arg == "-nthread") {
+      if (i + 1 == argc) {
+        printf("[Error] The option %s needs a value \n", argv[i]);
+        return false;
+      }
+      int value = atoi(argv[++i]);
+      if (value <= 0) {
+        printf("[Error] Illegal %s : '%s' \n", arg.c_str(), argv[i]);
+        return false;
+      }
+      if (arg == "-lists") {
+        option->num_list = value;
+      } else if (arg == "-top") {
+        option->top_k = value;
+      } else if (arg == "-probe") {
+        option->num_probe = value;
+      } else {
+        option->nthread = value;
+      }
+    } else if (!arg.empty() && arg[0] == '-') {
+      printf("[Error] Unknow option: %s \n", argv[i]);
+      return false;
+    } else {
+      option->file_list.push_back(arg);
+    }
+  }
+  if (option->file_list.size() != (option->build ? 3 : 4)) {
+    return false;
+  }
+  for (size_t i = 0; i + 1 < option->file_list.size(); ++i) {
+    if (!FileExist(option->file_list[i].c_str())) {
+      printf("[Error] File: %s does not exist \n",
+             option->file_list[i].c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parse the rows of the file, whose features are mapped by the
+// feature map of the model (if it is trained with --remap), and
+// the features out of the model are dropped
+void load_rows(const std::string& filename,
+               xLearn::Model& model,
+               xLearn::FeatureMap* map,
+               int nthread,
+               xLearn::DMatrix* matrix) {
+  xLearn::LibsvmParser parser;
+  parser.setLabel(false);
+  if (nthread > 0) { parser.setThreadNumber(nthread); }
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buffer);
+  xLearn::DMatrix parsed;
+  parser.Parse(buffer, size, parsed);
+  delete [] buffer;
+  xLearn::DMatrix* rows = &parsed;
+  xLearn::DMatrix mapped;
+  if (map != nullptr) {
+    map->Remap(parsed, &mapped);
+    rows = &mapped;
+  }
+  matrix->ResetMatrix(rows->row_length);
+  for (xLearn::index_t i = 0; i < rows->row_length; ++i) {
+    xLearn::RowView row = rows->GetRow(i);
+    for (const xLearn::Node* n = row.begin(); n != row.end(); ++n) {
+      if (n->feat_id < model.GetNumFeature()) {
+        matrix->AddNode(i, n->feat_id, n->feat_val);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// The item vectors are built by the same model as the user vectors,
+// so the index is rebuilt after the model is trained again
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  Timer timer;
+  timer.tic();
+
+  RetrieveOption option;
+  if (!parse_option(argc, argv, &option)) {
+    printf("%s", kUsage);
+    return 0;
+  }
+  const std::string& model_file = option.file_list[0];
+  xLearn::Model model(model_file);
+  if (model.GetScoreFunction() != "fm" || model.IsSparse()) {
+    printf("[Error] The index needs a dense fm model, but %s is "
+           "not \n", model_file.c_str());
+    return 0;
+  }
+  xLearn::FeatureMap map;
+  std::string dict_file = model_file + ".dict";
+  bool has_map = FileExist(dict_file.c_str());
+  if (has_map) { CHECK(map.Deserialize(dict_file)); }
+  xLearn::ThreadPool* pool = xLearn::Executor::Get(option.nthread);
+  xLearn::FMIndex index;
+
+  if (option.build) {
+    xLearn::DMatrix items;
+    load_rows(option.file_list[1], model, has_map ? &map : nullptr,
+              option.nthread, &items);
+    index.Build(items, model, option.num_list, pool);
+    index.Serialize(option.file_list[2]);
+    printf("Build the index of %u items in %u lists \n"
+           "  Index file: %s \n"
+           "Total time cost: %.2f sec\n",
+           index.NumItems(), index.NumLists(),
+           option.file_list[2].c_str(), timer.toc());
+    return 0;
+  }
+
+  if (!index.Deserialize(option.file_list[1])) {
+    printf("[Error] %s is not an index file \n",
+           option.file_list[1].c_str());
+    return 0;
+  }
+  if (index.AlignedK() != model.get_aligned_k()) {
+    printf("[Error] The index %s is not built on the model %s \n",
+           option.file_list[1].c_str(), model_file.c_str());
+    return 0;
+  }
+  xLearn::DMatrix users;
+  load_rows(option.file_list[2], model, has_map ? &map : nullptr,
+            option.nthread, &users);
+  // Each thread writes the lines of its users
+  std::vector<std::string> lines(users.row_length);
+  pool->ParallelFor(0, users.row_length, 0,
+    [&](size_t id, size_t start, size_t end) {
+      std::vector<xLearn::Candidate> top;
+      for (size_t i = start; i < end; ++i) {
+        index.Query(users.GetRow(i), model, option.top_k,
+                    option.num_probe, &top);
+        std::string& line = lines[i];
+        for (size_t n = 0; n < top.size(); ++n) {
+          if (n > 0) { line += " "; }
+          StringAppendF(&line, "%u:%g", top[n].item, top[n].score);
+        }
+        line += "\n";
+      }
+    });
+  FILE* file = OpenFileOrDie(option.file_list[3].c_str(), "w");
+  for (size_t i = 0; i < lines.size(); ++i) {
+    WriteDataToDisk(file, lines[i].data(), lines[i].size());
+  }
+  Close(file);
+  printf("Retrieve the top %u of %u items for %llu users "
+         "(%u of %u lists) \n"
+         "  Output file: %s \n"
+         "Total time cost: %.2f sec\n",
+         option.top_k, index.NumItems(),
+         (unsigned long long)users.row_length,
+         std::min(option.num_probe, index.NumLists()), index.NumLists(),
+         option.file_list[3].c_str(), timer.toc());
+
+  return 0;
+}
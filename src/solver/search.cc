@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of search.h
+*/
+
+#include "src/solver/search.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "src/base/split_string.h"
+
+namespace xLearn {
+
+// Parse the non-negative number, and return false for the illegal one
+static bool parse_number(const std::string& value, real_t* number) {
+  char* end = nullptr;
+  double x = strtod(value.c_str(), &end);
+  if (end == value.c_str() || *end != '\0' || x < 0) { return false; }
+  *number = static_cast<real_t>(x);
+  return true;
+}
+
+// Parse the non-negative integer, and return false for the
+// illegal one, e.g., 2.5, 1e3 or the overflow of int
+static bool parse_number(const std::string& value, int* number) {
+  char* end = nullptr;
+  errno = 0;
+  long x = strtol(value.c_str(), &end, 10);
+  if (end == value.c_str() || *end != '\0' || errno == ERANGE ||
+      x < 0 || x > INT_MAX) {
+    return false;
+  }
+  *number = static_cast<int>(x);
+  return true;
+}
+
+// Parse the list of the numbers, and return false for the illegal one
+template <typename T>
+static bool parse_list(const std::string& value, std::vector<T>* list) {
+  std::vector<std::string> items;
+  SplitStringUsing(value, ",", &items);
+  list->clear();
+  for (size_t i = 0; i < items.size(); ++i) {
+    T number;
+    if (!parse_number(items[i], &number)) { return false; }
+    list->push_back(number);
+  }
+  return !list->empty();
+}
+
+bool ParseSearchOption(int argc, char* argv[], SearchOption* option) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--") {
+      option->train_args.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    if (arg == "--no-kill") {
+      option->kill = false;
+      continue;
+    }
+    if (i + 1 == argc) {
+      printf("[Error] The option %s needs a value \n", argv[i]);
+      return false;
+    }
+    std::string value(argv[++i]);
+    bool bo = true;
+    if (arg == "-r") {
+      bo = parse_list(value, &option->lr);
+    } else if (arg == "-b") {
+      bo = parse_list(value, &option->lambda);
+    } else if (arg == "-k") {
+      bo = parse_list(value, &option->k) &&
+           *std::min_element(option->k.begin(), option->k.end()) > 0;
+    } else if (arg == "-jobs") {
+      bo = parse_number(value, &option->jobs) && option->jobs > 0;
+    } else if (arg == "-grace") {
+      bo = parse_number(value, &option->grace);
+    } else {
+      printf("[Error] Unknow option: %s \n", argv[i-1]);
+      return false;
+    }
+    if (!bo) {
+      printf("[Error] Illegal value of %s: %s \n",
+             argv[i-1], value.c_str());
+      return false;
+    }
+  }
+  if (option->train_args.empty()) {
+    printf("[Error] The xlearn_train options are needed after -- \n");
+    return false;
+  }
+  return true;
+}
+
+bool SearchBoard::Report(Config* config, int epoch, real_t metric) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  config->curve.push_back(metric);
+  if (best_.size() <= (size_t)epoch) { best_.resize(epoch + 1); }
+  real_t best = best_so_far(config->curve);
+  best_[epoch].push_back(best);
+  if (!kill_ || epoch < grace_) { return false; }
+  // The other configs at this epoch, at least 2 of them
+  std::vector<real_t> others = best_[epoch];
+  others.erase(std::find(others.begin(), others.end(), best));
+  if (others.size() < 2) { return false; }
+  std::sort(others.begin(), others.end());
+  size_t half = others.size() / 2;
+  real_t median = others.size() % 2 == 1 ? others[half] :
+                  (others[half - 1] + others[half]) / 2;
+  config->killed = larger_ ? best < median : best > median;
+  return config->killed;
+}
+
+real_t SearchBoard::best_so_far(const std::vector<real_t>& curve) const {
+  return larger_ ? *std::max_element(curve.begin(), curve.end()) :
+                   *std::min_element(curve.begin(), curve.end());
+}
+
+}  // namespace xLearn
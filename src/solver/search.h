@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the options, the configs and the board of the median
+stopping rule of the xlearn_search tool (see search_main.cc).
+*/
+
+#ifndef XLEARN_SOLVER_SEARCH_H_
+#define XLEARN_SOLVER_SEARCH_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+
+namespace xLearn {
+
+// The options of xlearn_search, whose train_args
+// are the xlearn_train options after --
+struct SearchOption {
+  std::vector<real_t> lr;
+  std::vector<real_t> lambda;
+  std::vector<int> k;
+  int jobs = 0;
+  int grace = 1;
+  bool kill = true;
+  std::vector<std::string> train_args;
+};
+
+// Parse the command line of xlearn_search, and return false for
+// the illegal options, e.g., the -k, -jobs and -grace values that
+// are not integers, and the -k and -jobs values that are not positive
+bool ParseSearchOption(int argc, char* argv[], SearchOption* option);
+
+// A config of the grid and its result
+struct Config {
+  real_t lr = 0;
+  real_t lambda = 0;
+  int k = 0;
+  /* The test metric of each epoch */
+  std::vector<real_t> curve;
+  /* The test metric of the trained model */
+  real_t metric = 0;
+  int best_epoch = -1;
+  real_t time = 0;
+  bool killed = false;
+  std::string error;
+};
+
+//------------------------------------------------------------------------------
+// The board of the median stopping rule. Each config reports the test
+// metric of each epoch, and it is killed at epoch n (after the grace
+// epochs) if its best metric so far is worse than the median of the best
+// ones of the other configs that have reached epoch n. The configs run at
+// the same time, so a config is compared with the ones ahead of it, and
+// the first ones are never killed.
+//------------------------------------------------------------------------------
+class SearchBoard {
+ public:
+  SearchBoard(bool larger_is_better, int grace, bool kill)
+    : larger_(larger_is_better), grace_(grace), kill_(kill) { }
+
+  // Record the metric of the epoch of the config,
+  // and return true if the config is killed
+  bool Report(Config* config, int epoch, real_t metric);
+
+ private:
+  bool larger_;
+  int grace_;
+  bool kill_;
+  std::mutex mutex_;
+  /* The best metrics so far of the configs at each epoch */
+  std::vector<std::vector<real_t>> best_;
+
+  real_t best_so_far(const std::vector<real_t>& curve) const;
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_SEARCH_H_
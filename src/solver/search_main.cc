@@ -0,0 +1,274 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the xlearn_search tool, which searches the
+hyper-parameters on one parsed dataset. The training set and the test
+set are parsed once, and the configs of the grid are trained at the same
+time on the views of the same rows (see ShareData in train_api.h), each
+by its own part of the threads:
+
+  xlearn_search [ options ] -- xlearn_train options
+
+e.g., xlearn_search -r 0.1,0.2 -b 0.00002,0.0002 -jobs 4 --
+      train.txt -v test.txt -s 2 -e 10 -nthread 16
+
+A config is killed after an epoch if its best test metric so far is worse
+than the median of the best ones of the other configs at the same epoch
+(the median stopping rule), so the threads go to the promising ones. The
+results are reported in one table, and the model of the best config is
+saved into the -m file of the xlearn_train options.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/resource.h"
+#include "src/base/stringprintf.h"
+#include "src/base/thread_pool.h"
+#include "src/loss/metric.h"
+#include "src/solver/checker.h"
+#include "src/solver/search.h"
+#include "src/solver/train_api.h"
+
+namespace xLearn {
+
+const char* kUsage =
+"----------------------------------------------------------------------------------------------\n"
+"USAGE: \n"
+"     xlearn_search [ options ] -- xlearn_train options \n"
+"                                                        \n"
+"  Parse the data once and train the configs of the grid at the same time. The xlearn_train \n"
+"  options give the data (the test set -v is needed) and the other hyper-parameters. \n"
+"                                                                                     \n"
+"OPTIONS: \n"
+"  -r <list>            :  Learning rates, e.g., 0.1,0.2. Using the -r of xlearn_train by default. \n"
+"                                                                                                 \n"
+"  -b <list>            :  Lambdas of the regular. Using the -b of xlearn_train by default. \n"
+"                                                                                          \n"
+"  -k <list>            :  Numbers of the latent factors. Using the -k of xlearn_train by default. \n"
+"                                                                                                 \n"
+"  -jobs <number>       :  Number of the configs trained at the same time, which share the \n"
+"                          -nthread threads. Using the number of the configs by default. \n"
+"                                                                                       \n"
+"  -grace <number>      :  A config is not killed in its first epochs. Using 1 by default. \n"
+"                                                                                      \n"
+"  --no-kill            :  Train all the configs for all the epochs. \n"
+"----------------------------------------------------------------------------------------------\n";
+
+}  // namespace xLearn
+
+int main(int argc, char* argv[]) {
+  xLearn::SearchOption option;
+  if (!xLearn::ParseSearchOption(argc, argv, &option)) {
+    printf("%s", xLearn::kUsage);
+    return 0;
+  }
+  // The same arguments as xlearn_train
+  std::vector<std::string> args = { "xlearn_search" };
+  args.insert(args.end(), option.train_args.begin(),
+              option.train_args.end());
+  std::vector<char*> train_argv;
+  for (size_t i = 0; i < args.size(); ++i) {
+    train_argv.push_back(&args[i][0]);
+  }
+  xLearn::HyperParam param;
+  param.is_train = true;
+  try {
+    xLearn::Checker checker;
+    checker.Initialize(true, train_argv.size(), train_argv.data());
+    if (!checker.Check(param)) {
+      printf("Arguments error \n");
+      return 0;
+    }
+  } catch (std::invalid_argument &e) {
+    printf("%s\n", e.what());
+    return 1;
+  }
+  if (param.test_set_file.empty()) {
+    printf("[Error] The search needs the test set (-v) \n");
+    return 0;
+  }
+  InitializeLogger(
+    StringPrintf("%s.%u_search.INFO", param.log_file.c_str(), getpid()),
+    StringPrintf("%s.%u_search.WARN", param.log_file.c_str(), getpid()),
+    StringPrintf("%s.%u_search.ERROR", param.log_file.c_str(), getpid()));
+  EnableAsyncLogging();
+  // The grid, whose missing lists are the values of the param
+  if (option.lr.empty()) { option.lr.push_back(param.learning_rate); }
+  if (option.lambda.empty()) { option.lambda.push_back(param.regu_lambda); }
+  if (option.k.empty()) { option.k.push_back(param.num_K); }
+  std::vector<xLearn::Config> configs;
+  for (size_t i = 0; i < option.lr.size(); ++i) {
+    for (size_t j = 0; j < option.lambda.size(); ++j) {
+      for (size_t l = 0; l < option.k.size(); ++l) {
+        xLearn::Config config;
+        config.lr = option.lr[i];
+        config.lambda = option.lambda[j];
+        config.k = option.k[l];
+        configs.push_back(config);
+      }
+    }
+  }
+  // The thread budget of each job
+  int nthread = param.thread_number > 0 ?
+                param.thread_number : (int)xLearn::AvailableCpus();
+  nthread = std::max(nthread, 1);
+  int jobs = option.jobs > 0 ? option.jobs : (int)configs.size();
+  jobs = std::min(jobs, (int)configs.size());
+  jobs = std::min(jobs, nthread);
+  int job_threads = nthread / jobs;
+  // Parse the data once by all the threads
+  printf("Read problem ... \n");
+  Timer timer;
+  timer.tic();
+  Timer parse_timer;
+  parse_timer.tic();
+  xLearn::DataSource data;
+  std::string error;
+  {
+    xLearn::ThreadPool pool(nthread);
+    if (xLearn::Load(param, &pool, &data, &error) != xLearn::kTrainOK) {
+      printf("[Error] %s \n", error.c_str());
+      return 1;
+    }
+  }
+  printf("  Parsed in %.2f sec. Search %lu configs by %d jobs "
+         "of %d threads \n", parse_timer.toc(), configs.size(),
+         jobs, job_threads);
+  xLearn::Metric metric;
+  metric.Initialize(param.metric);
+  xLearn::SearchBoard board(metric.larger_is_better(),
+                            option.grace, option.kill);
+  // The model of the best finished config
+  std::mutex best_mutex;
+  std::unique_ptr<xLearn::Model> best_model;
+  int best_config = -1;
+  std::mutex print_mutex;
+  std::atomic<size_t> next(0);
+  auto job = [&]() {
+    xLearn::ThreadPool pool(job_threads);
+    for (size_t c = next++; c < configs.size(); c = next++) {
+      xLearn::Config& config = configs[c];
+      xLearn::HyperParam config_param = param;
+      config_param.learning_rate = config.lr;
+      config_param.regu_lambda = config.lambda;
+      config_param.num_K = config.k;
+      config_param.quiet = true;
+      config_param.thread_number = job_threads;
+      Timer config_timer;
+      config_timer.tic();
+      xLearn::DataSource view;
+      std::unique_ptr<xLearn::Model> model(new xLearn::Model());
+      auto on_epoch = [&](int epoch, const xLearn::MetricInfo& te_info) {
+        bool killed = board.Report(&config, epoch, te_info.metric_val);
+        std::lock_guard<std::mutex> lock(print_mutex);
+        printf("  [config %lu] epoch %d, Test %s: %.5f%s \n", c, epoch,
+               metric.type().c_str(), te_info.metric_val,
+               killed ? ", killed" : "");
+        return killed;
+      };
+      int ret = xLearn::ShareData(config_param, &pool, data,
+                                  &view, &config.error);
+      if (ret == xLearn::kTrainOK) {
+        ret = xLearn::Train(config_param, view, &pool, model.get(),
+                            nullptr, &config.error, on_epoch);
+      }
+      config.time = config_timer.toc();
+      if (ret != xLearn::kTrainOK || config.curve.empty()) {
+        if (config.error.empty()) { config.error = "No test metric"; }
+        continue;
+      }
+      // The model of early-stopping is the best epoch,
+      // and the model of the last epoch otherwise
+      const std::vector<real_t>& curve = config.curve;
+      config.best_epoch = curve.size() - 1;
+      if (param.early_stop) {
+        for (size_t n = 0; n < curve.size(); ++n) {
+          bool better = metric.larger_is_better() ?
+                        curve[n] > curve[config.best_epoch] :
+                        curve[n] < curve[config.best_epoch];
+          if (better) { config.best_epoch = n; }
+        }
+      }
+      config.metric = curve[config.best_epoch];
+      if (config.killed) { continue; }
+      std::lock_guard<std::mutex> lock(best_mutex);
+      bool better = best_config < 0 ||
+                    (metric.larger_is_better() ?
+                     config.metric > configs[best_config].metric :
+                     config.metric < configs[best_config].metric);
+      if (better) {
+        best_config = c;
+        best_model = std::move(model);
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs; ++i) { threads.emplace_back(job); }
+  for (size_t i = 0; i < threads.size(); ++i) { threads[i].join(); }
+  // The table of the results, the best one first
+  std::vector<size_t> rank(configs.size());
+  for (size_t i = 0; i < rank.size(); ++i) { rank[i] = i; }
+  std::stable_sort(rank.begin(), rank.end(), [&](size_t a, size_t b) {
+    const xLearn::Config& x = configs[a];
+    const xLearn::Config& y = configs[b];
+    if (x.error.empty() != y.error.empty()) { return x.error.empty(); }
+    if (x.killed != y.killed) { return !x.killed; }
+    return metric.larger_is_better() ? x.metric > y.metric :
+                                       x.metric < y.metric;
+  });
+  printf("----------------------------------------------------------"
+         "----------------------------\n"
+         "| %6s | %10s | %10s | %4s | %6s | %10s | %8s | %7s |\n",
+         "config", "lr", "lambda", "k", "epochs",
+         metric.type().c_str(), "time", "status");
+  for (size_t i = 0; i < rank.size(); ++i) {
+    const xLearn::Config& config = configs[rank[i]];
+    if (!config.error.empty()) {
+      printf("| %6lu | %10g | %10g | %4d | [Error] %s \n", rank[i],
+             config.lr, config.lambda, config.k, config.error.c_str());
+      continue;
+    }
+    printf("| %6lu | %10g | %10g | %4d | %6lu | %10.5f | %8.2f | %7s |\n",
+           rank[i], config.lr, config.lambda, config.k,
+           config.curve.size(), config.metric, config.time,
+           config.killed ? "killed" :
+           (int)rank[i] == best_config ? "best" : "done");
+  }
+  printf("----------------------------------------------------------"
+         "----------------------------\n"
+         "  Total time: %.2f sec \n", timer.toc());
+  if (best_model != nullptr && param.model_file != "none") {
+    best_model->Serialize(param.model_file);
+    printf("  The model of config %d is saved into %s \n",
+           best_config, param.model_file.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests search.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/solver/search.h"
+
+namespace xLearn {
+
+// Parse the options of xlearn_search before the xlearn_train ones
+static bool parse(std::vector<std::string> args, SearchOption* option) {
+  args.insert(args.begin(), "xlearn_search");
+  args.push_back("--");
+  args.push_back("train.txt");
+  std::vector<char*> argv;
+  for (size_t i = 0; i < args.size(); ++i) {
+    argv.push_back(const_cast<char*>(args[i].c_str()));
+  }
+  return ParseSearchOption(argv.size(), argv.data(), option);
+}
+
+TEST(SEARCH_TEST, Parse_option) {
+  SearchOption option;
+  EXPECT_TRUE(parse({ "-r", "0.1,0.2", "-k", "4,8", "-jobs", "3",
+                      "-grace", "0" }, &option));
+  EXPECT_EQ(option.lr.size(), 2);
+  EXPECT_EQ(option.k, std::vector<int>({ 4, 8 }));
+  EXPECT_EQ(option.jobs, 3);
+  EXPECT_EQ(option.grace, 0);
+  ASSERT_EQ(option.train_args.size(), 1);
+  EXPECT_EQ(option.train_args[0], "train.txt");
+}
+
+TEST(SEARCH_TEST, Illegal_option) {
+  SearchOption option;
+  // The k is a positive integer
+  EXPECT_FALSE(parse({ "-k", "2.5" }, &option));
+  EXPECT_FALSE(parse({ "-k", "4,0" }, &option));
+  EXPECT_FALSE(parse({ "-k", "-4" }, &option));
+  EXPECT_FALSE(parse({ "-k", "99999999999" }, &option));
+  // The jobs is a positive integer, and the grace is not negative
+  EXPECT_FALSE(parse({ "-jobs", "0" }, &option));
+  EXPECT_FALSE(parse({ "-jobs", "two" }, &option));
+  EXPECT_FALSE(parse({ "-jobs", "2x" }, &option));
+  EXPECT_FALSE(parse({ "-grace", "-1" }, &option));
+  EXPECT_FALSE(parse({ "-grace", "1.5" }, &option));
+  EXPECT_FALSE(parse({ "-r", "-0.1" }, &option));
+  EXPECT_FALSE(parse({ "-s", "1" }, &option));
+}
+
+// The metric is smaller for the better configs. Config 3 is worse
+// than the median of the others after the grace epoch, and killed
+TEST(SEARCH_TEST, Median_stopping) {
+  SearchBoard board(false, 1, true);
+  Config config[4];
+  // No config is killed in the grace epoch
+  EXPECT_FALSE(board.Report(&config[0], 0, 0.5));
+  EXPECT_FALSE(board.Report(&config[1], 0, 0.6));
+  EXPECT_FALSE(board.Report(&config[2], 0, 0.7));
+  EXPECT_FALSE(board.Report(&config[3], 0, 0.9));
+  // The first two ones at the epoch are not compared
+  EXPECT_FALSE(board.Report(&config[0], 1, 0.9));
+  EXPECT_FALSE(board.Report(&config[1], 1, 0.4));
+  // The best so far of config 0 is 0.5, and the median is 0.45
+  EXPECT_FALSE(board.Report(&config[2], 1, 0.42));
+  EXPECT_TRUE(board.Report(&config[3], 1, 0.8));
+  EXPECT_TRUE(config[3].killed);
+  EXPECT_FALSE(config[2].killed);
+  EXPECT_EQ(config[3].curve, std::vector<real_t>({ 0.9, 0.8 }));
+}
+
+// The metric is larger for the better configs, and no
+// config is killed if the killing is disabled
+TEST(SEARCH_TEST, Larger_is_better) {
+  SearchBoard board(true, 0, true);
+  SearchBoard no_kill(true, 0, false);
+  Config config[3], same[3];
+  const real_t metric[3] = { 0.8, 0.7, 0.6 };
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(board.Report(&config[i], 0, metric[i]), i == 2);
+    EXPECT_FALSE(no_kill.Report(&same[i], 0, metric[i]));
+  }
+}
+
+}  // namespace xLearn
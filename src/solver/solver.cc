@@ -21,17 +21,37 @@ This file is the implementation of the Solver class.
 
 #include "src/solver/solver.h"
 
+#include <signal.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <functional>
+#include <utility>
 #include <stdexcept>
+#include <thread>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
+#include "src/base/affinity.h"
+#include "src/base/executor.h"
+#include "src/base/file_util.h"
+#include "src/base/phase_timer.h"
+#include "src/base/resource.h"
 #include "src/base/stringprintf.h"
 #include "src/base/split_string.h"
+#include "src/base/trace.h"
+#include "src/data/field_k.h"
+#include "src/distributed/ps_worker.h"
+#include "src/reader/input_stream.h"
+#include "src/score/score_kernel.h"
+#include "src/solver/coord_descent.h"
+#include "src/solver/lbfgs.h"
 
 namespace xLearn {
 
@@ -39,7 +59,7 @@ namespace xLearn {
 //         _
 //        | |
 //   __  _| |     ___  __ _ _ __ _ __
-//   \ \/ / |    / _ \/ _` | '__| '_ \
+//   \ \/ / |    / _ \/ _` | '__| '_ \ .
 //    >  <| |___|  __/ (_| | |  | | | |
 //   /_/\_\______\___|\__,_|_|  |_| |_|
 //
@@ -66,18 +86,29 @@ void Solver::print_logo() const {
 
 // Initialize Solver
 void Solver::Initialize(int argc, char* argv[]) {
+  // The phases of the former task in this process
+  PhaseTimer::Get().Reset();
   //  Print logo
   print_logo();
   // Check and parse command line arguments
   checker(argc, argv);
   // Initialize log file
   init_log();
+  // Timeline of the threads
+  init_trace();
+  // Number of threads and CPU affinity
+  init_threads();
   // Init train or predict
   if (hyper_param_.is_train) {
     init_train();
   } else {
     init_predict();
   }
+  show_memory();
+  if (metrics_log_.IsOpen()) {
+    metrics_log_.Write(HyperParamRecord(hyper_param_));
+    metrics_log_.Write(memory_record());
+  }
 }
 
 // Check and parse command line arguments
@@ -105,20 +136,91 @@ void Solver::init_log() {
   InitializeLogger(StringPrintf("%s.INFO", prefix.c_str()),
                 StringPrintf("%s.WARN", prefix.c_str()),
                 StringPrintf("%s.ERROR", prefix.c_str()));
+  // The messages of the training threads
+  // are written by the background thread
+  EnableAsyncLogging();
+}
+
+// The spans of the phases and the threads are recorded
+// from here to FinalizeWork()
+void Solver::init_trace() {
+  if (hyper_param_.trace_file.empty()) { return; }
+  if (!TraceLog::Get().Open(hyper_param_.trace_file)) {
+    printf("[Error] Cannot open the trace file: %s \n",
+           hyper_param_.trace_file.c_str());
+    exit(0);
+  }
+  LOG(INFO) << "Write the trace to " << hyper_param_.trace_file;
+}
+
+// The threads of Loss and Reader use the same CPUs,
+// and the number of CPUs is the default thread number
+void Solver::init_threads() {
+  cpus_.clear();
+  if (!hyper_param_.affinity.empty()) {
+    CHECK(GetAffinityCpus(hyper_param_.affinity, &cpus_));
+  }
+  thread_number_ = hyper_param_.thread_number;
+  if (thread_number_ == 0) {
+    thread_number_ = cpus_.empty() ?
+      AvailableCpus() : cpus_.size();
+  }
+  if (thread_number_ == 0) { thread_number_ = 1; }
+  LOG(INFO) << "Number of thread: " << thread_number_
+            << ", number of pinned cpu: " << cpus_.size();
+}
+
+// Invoke init(i) for each i in [0, num) by num loaders at the
+// same time. The parsing of each loader runs in the shared pool
+// (see Executor), so the loaders add only num threads that
+// mostly wait for the pool
+static void parallel_init(int num, const std::function<void(int)>& init) {
+  std::vector<std::thread> loaders;
+  for (int i = 1; i < num; ++i) {
+    loaders.push_back(std::thread([&init, i]() {
+      TraceLog::Get().NameThread("reader loader");
+      init(i);
+    }));
+  }
+  init(0);
+  for (size_t i = 0; i < loaders.size(); ++i) { loaders[i].join(); }
 }
 
 // Initialize training task
 void Solver::init_train() {
+  if (!hyper_param_.metrics_file.empty() &&
+      !metrics_log_.Open(hyper_param_.metrics_file)) {
+    printf("[Error] Cannot open the metrics file: %s \n",
+           hyper_param_.metrics_file.c_str());
+    exit(0);
+  }
+  // The processes of the shared model meet before the data
+  // is loaded, so the lost processes are found early
+  if (!hyper_param_.shm_name.empty() &&
+      !shm_.Initialize(hyper_param_.shm_name,
+                       hyper_param_.worker_id,
+                       hyper_param_.num_workers)) {
+    printf("[Error] Cannot join the shared model: %s \n",
+           hyper_param_.shm_name.c_str());
+    exit(0);
+  }
   /*********************************************************
    *  Init Reader                                          *
    *********************************************************/
-  clock_t start, end;
-  start = clock();
+  ScopedPhase read("read");
   printf("Read problem ... \n");
   LOG(INFO) << "Start to init Reader";
-  // Split file if use -c
-  if (hyper_param_.cross_validation) {
+  // Split file if use -c. The in-memory folds are
+  // the views of the training set (see FoldReader)
+  bool split_file = hyper_param_.cross_validation &&
+                    hyper_param_.on_disk;
+  if (split_file) {
     CHECK_GT(hyper_param_.num_folds, 0);
+    if (IsCompressedFile(hyper_param_.train_set_file)) {
+      printf("[Error] The compressed file cannot be split for "
+             "the on-disk cross-validation. \n");
+      exit(0);
+    }
     splitor_.split(hyper_param_.train_set_file,
                    hyper_param_.num_folds);
     LOG(INFO) << "Split file into "
@@ -128,7 +230,7 @@ void Solver::init_train() {
   // Get number of Reader and path of Reader
   int num_reader = 0;
   std::vector<std::string> file_list;
-  if (hyper_param_.cross_validation) {
+  if (split_file) {
     num_reader += hyper_param_.num_folds;
     for (int i = 0; i < hyper_param_.num_folds; ++i) {
       std::string filename = StringPrintf("%s_%d",
@@ -136,7 +238,7 @@ void Solver::init_train() {
                         i);
       file_list.push_back(filename);
     }
-  } else { // do not use cross-validation
+  } else { // in-memory cross-validation reads one file
     num_reader++;
     CHECK_NE(hyper_param_.train_set_file.empty(), true);
     file_list.push_back(hyper_param_.train_set_file);
@@ -147,9 +249,103 @@ void Solver::init_train() {
   }
   LOG(INFO) << "Number of Reader: " << num_reader;
   reader_.resize(num_reader, NULL);
-  // Create Reader
+  // The training sets are counted before re-indexing
+  if (hyper_param_.freq_order) {
+    feature_map_.EnableFrequencyOrder();
+    feature_map_.SetMinCount(hyper_param_.min_count,
+                             hyper_param_.oov_feature);
+  }
+  int num_counted = 0;
+  // The fields are replaced with their groups at parsing
+  if (!hyper_param_.field_groups_file.empty()) {
+    if (!field_groups_.Load(hyper_param_.field_groups_file)) {
+      printf("[Error] Cannot read the field groups of %s \n",
+             hyper_param_.field_groups_file.c_str());
+      exit(0);
+    }
+    printf("  Field groups: %d fields in %d groups \n",
+           field_groups_.NumField(), field_groups_.NumGroup());
+    LOG(INFO) << "Field groups: " << field_groups_.NumField()
+              << " fields in " << field_groups_.NumGroup() << " groups";
+  }
+  // The crosses are added to the rows at parsing
+  if (!hyper_param_.cross_fields.empty()) {
+    CHECK(ParseCrosses(hyper_param_.cross_fields, &crosses_));
+    printf("  Crosses: %d pairs of fields \n", (int)crosses_.size());
+  }
+  // The online stdin is read as the rows arrive
+  if (hyper_param_.online && IsStdin(hyper_param_.train_set_file)) {
+    SetOnlineStdin();
+  }
+  // The features that are not admitted share the feature
+  // after the hashed ones
+  if (hyper_param_.admit_count > 1) {
+    admission_.Initialize((uint64)hyper_param_.admit_mb << 20,
+                          hyper_param_.admit_count);
+  }
+  // The options of the i-th Reader (or of each of its parts)
+  auto setup_reader = [&](Reader* reader, int i, int num_thread) {
+    reader->SetOnline(hyper_param_.online);
+    reader->SetCompact(hyper_param_.compact_data);
+    reader->SetSortRows(hyper_param_.sort_nodes);
+    reader->SetFieldGroups(field_groups_);
+    reader->SetCrosses(crosses_);
+    reader->SetDense(hyper_param_.dense_data);
+    reader->SetCompress(hyper_param_.compress_cache);
+    reader->SetShuffleWindow(hyper_param_.shuffle_window);
+    reader->SetShuffleBlock(hyper_param_.shuffle_block);
+    reader->SetPipelineDepth(hyper_param_.pipeline_depth);
+    reader->SetBlockIO(hyper_param_.io_depth, hyper_param_.direct_io);
+    reader->SetSpill(hyper_param_.spill_disk);
+    reader->SetHashBucket(hyper_param_.hash_bucket);
+    if (hyper_param_.admit_count > 1) {
+      reader->SetAdmission(&admission_, hyper_param_.hash_bucket);
+    }
+    reader->SetFullHash(hyper_param_.full_hash_cache);
+    if (!hyper_param_.cache_dir.empty()) {
+      reader->SetCacheDir(hyper_param_.cache_dir,
+                          (uint64)hyper_param_.cache_mb << 20);
+    }
+    reader->SetThreadNumber(num_thread);
+    reader->SetAffinity(cpus_);
+    reader->SetRowCost(row_cost());
+    // Only the training set is sampled
+    if (i == 0 && hyper_param_.neg_sample < 1.0) {
+      reader->SetNegSample(hyper_param_.neg_sample);
+    }
+    if (i == 0 && hyper_param_.dedup_rows) {
+      reader->SetDedup(true);
+    }
+    if (i == 0 && hyper_param_.shuffle_copy) {
+      reader->SetShuffleCopy(true);
+    }
+    // The batches are split among the threads of the loss
+    if (i == 0 && hyper_param_.group_rows) {
+      reader->SetGroupRows(thread_number_);
+    }
+    reader->SetHugePages(hyper_param_.huge_page.compare("none") != 0);
+    if (i == 0 && hyper_param_.shard_data) {
+      reader->SetShard(hyper_param_.worker_id,
+                       hyper_param_.num_workers);
+    }
+    if (hyper_param_.remap_feature) {
+      reader->SetFeatureMap(&feature_map_);
+    }
+  };
+  // The Readers are initialized at the same time by the loaders,
+  // and their parsing shares the pool of thread_number_ threads.
+  // The feature map of the re-indexing is filled by one Reader
+  // after another, and the cache of a file read by two Readers
+  // would be written by both, so they are initialized in order
+  bool concurrent = !hyper_param_.remap_feature && num_reader > 1;
   for (int i = 0; i < num_reader; ++i) {
-    reader_[i] = create_reader();
+    if (IsStdin(file_list[i]) ||
+        std::count(file_list.begin(), file_list.end(),
+                   file_list[i]) > 1) {
+      concurrent = false;
+    }
+  }
+  auto init_reader = [&](int i) {
     reader_[i]->Initialize(file_list[i],
                            hyper_param_.sample_size);
     if (reader_[i] == NULL) {
@@ -158,82 +354,750 @@ void Solver::init_train() {
       exit(0);
     }
     LOG(INFO) << "Init Reader: " << file_list[i];
-  }
-  /*********************************************************
-   *  Read problem                                         *
-   *********************************************************/
-  DMatrix* matrix = NULL;
-  index_t max_feat = 0, max_field = 0;
+  };
+  // Create Reader. The list, the directory or the glob of the
+  // part files is one dataset of the parts (see MultiReader)
   for (int i = 0; i < num_reader; ++i) {
-    int num_samples = 0;
-    while(1) {
-      num_samples = reader_[i]->Samples(matrix, false);
-      if (num_samples == 0) { break; }
-      int tmp = find_max_feature(matrix, num_samples);
-      if (tmp > max_feat) {
-        max_feat = tmp;
+    if (hyper_param_.remap_feature) {
+      // The test set only uses the features of training set
+      if (!hyper_param_.cross_validation && i == 1) {
+        if (feature_map_.IsCounting()) {
+          feature_map_.OrderByFrequency();
+        }
+        feature_map_.Freeze();
       }
-      if (hyper_param_.score_func.compare("ffm") == 0) {
-        tmp = find_max_field(matrix, num_samples);
-        if (tmp > max_field) {
-          max_field = tmp;
+      if (feature_map_.IsCounting()) { num_counted++; }
+    }
+    std::vector<std::string> parts;
+    if (!split_file && !IsStdin(file_list[i]) &&
+        ExpandFileList(file_list[i], &parts) && parts.size() == 1) {
+      file_list[i] = parts[0];
+    }
+    if (parts.size() > 1) {
+      // The parts are loaded at the same time, and the feature
+      // map of the re-indexing is filled by one part at a time
+      int num_loader = hyper_param_.remap_feature ? 1 :
+                       std::min((int)parts.size(),
+                                std::max((int)thread_number_ / 2, 1));
+      int num_thread = std::max((int)thread_number_ / num_loader, 1);
+      // The last part of the training set (e.g., the newest day)
+      // has the weight 1.0, and each part before it decays
+      bool decay = i == 0 && hyper_param_.part_decay < 1.0;
+      std::vector<Reader*> part_readers(parts.size(), nullptr);
+      for (size_t j = 0; j < parts.size(); ++j) {
+        part_readers[j] = create_reader();
+        setup_reader(part_readers[j], i, num_thread);
+        if (decay) {
+          part_readers[j]->SetRowWeight(
+            std::pow(hyper_param_.part_decay, parts.size() - 1 - j));
         }
       }
+      reader_[i] = new MultiReader(part_readers, parts, num_loader);
+      printf("  %s: %lu files, loaded by %d threads \n",
+             i == 0 ? "Training set" : "Test set",
+             parts.size(), num_loader);
+      if (decay) {
+        printf("  Part decay: %g per part, %g for the oldest one \n",
+               hyper_param_.part_decay,
+               std::pow(hyper_param_.part_decay, parts.size() - 1));
+        LOG(INFO) << "Part decay: " << hyper_param_.part_decay
+                  << " of " << parts.size() << " parts";
+      }
+    } else {
+      if (i == 0 && hyper_param_.part_decay < 1.0) {
+        printf("[Warning] The training set has one file, and "
+               "-part_decay is ignored. \n");
+      }
+      reader_[i] = create_reader();
+      setup_reader(reader_[i], i, thread_number_);
+    }
+    if (!concurrent) { init_reader(i); }
+  }
+  if (concurrent) {
+    parallel_init(num_reader, init_reader);
+    printf("  %d datasets are loaded at the same time \n", num_reader);
+  }
+  if (feature_map_.IsCounting()) {
+    feature_map_.OrderByFrequency();
+  }
+  if (feature_map_.NumRare() > 0) {
+    printf("  Rare features (< %d times): %llu %s \n",
+           hyper_param_.min_count,
+           (unsigned long long)feature_map_.NumRare(),
+           hyper_param_.oov_feature ? "mapped to OOV" : "dropped");
+    LOG(INFO) << "Rare features: " << feature_map_.NumRare();
+  }
+  for (int i = 0; i < num_counted; ++i) {
+    reader_[i]->RemapFeatures();
+  }
+  // The training set is parsed only once, and
+  // each fold samples its rows from the data
+  if (hyper_param_.cross_validation && !split_file) {
+    CHECK_GE(hyper_param_.num_folds, 2);
+    cv_reader_ = dynamic_cast<InmemReader*>(reader_[0]);
+    CHECK_NOTNULL(cv_reader_);
+    reader_.assign(hyper_param_.num_folds, nullptr);
+    for (int i = 0; i < hyper_param_.num_folds; ++i) {
+      reader_[i] = new FoldReader(cv_reader_, hyper_param_.num_folds, i);
+      reader_[i]->SetRowCost(row_cost());
     }
-    // return to the begining of target file
-    reader_[i]->Reset();
+    parallel_init(hyper_param_.num_folds, [this](int i) {
+      reader_[i]->Initialize(hyper_param_.train_set_file,
+                             hyper_param_.sample_size);
+    });
+    num_reader = hyper_param_.num_folds;
+    LOG(INFO) << "Split data into "
+              << hyper_param_.num_folds
+              << " folds.";
+  }
+  /*********************************************************
+   *  Read problem                                         *
+   *********************************************************/
+  // The statistics of dataset are stored in the binary
+  // file, so we don't need a full pass over the data here
+  DataStats stats;
+  for (int i = 0; i < num_reader; ++i) {
+    stats.Merge(reader_[i]->Stats());
+  }
+  index_t max_feat = stats.max_feat;
+  index_t max_field = stats.max_field;
+  LOG(INFO) << "Number of row: " << stats.num_row
+            << ", number of node: " << stats.num_node
+            << ", positive rows: " << stats.num_positive
+            << ", label range: [" << stats.label_min
+            << ", " << stats.label_max << "]";
+  // The hashed model has a fixed number of features, and
+  // the re-indexed model has the features of the map
+  if (hyper_param_.remap_feature) {
+    hyper_param_.num_feature = feature_map_.Size();
+  } else if (hyper_param_.hash_bucket > 0) {
+    hyper_param_.num_feature = hyper_param_.hash_bucket +
+                               (hyper_param_.admit_count > 1 ? 1 : 0);
+  } else {
+    hyper_param_.num_feature = max_feat + 1;
+  }
+  // The online model without hashing grows with the stream
+  bool growing = hyper_param_.online && hyper_param_.hash_bucket == 0;
+  if (growing) {
+    LOG(INFO) << "Max number of feature: " << hyper_param_.max_feature;
+    printf("  Number of Feature: growing up to %d \n",
+           hyper_param_.max_feature);
+  } else {
+    LOG(INFO) << "Number of feature: " << hyper_param_.num_feature;
+    printf("  Number of Feature: %d \n", hyper_param_.num_feature);
   }
-  hyper_param_.num_feature = max_feat + 1;
-  LOG(INFO) << "Number of feature: " << hyper_param_.num_feature;
-  printf("  Number of Feature: %d \n", hyper_param_.num_feature);
+  // The fields of the online stream are the groups, or
+  // the fields of the warm-start model below
   if (hyper_param_.score_func.compare("ffm") == 0) {
     hyper_param_.num_field = max_field + 1;
-    LOG(INFO) << "Number of field: " << hyper_param_.num_field;
-    printf("  Number of Field: %d \n", hyper_param_.num_field);
+    if (hyper_param_.online) {
+      hyper_param_.num_field = field_groups_.Empty() ?
+                               0 : field_groups_.NumGroup();
+    }
+    if (hyper_param_.num_field > 0) {
+      LOG(INFO) << "Number of field: " << hyper_param_.num_field;
+      printf("  Number of Field: %d \n", hyper_param_.num_field);
+    }
   }
-  end = clock();
   printf("  Time cost for reading problem: %.2f sec \n",
-    (float)(end-start) / CLOCKS_PER_SEC);
+         read.Stop());
   /*********************************************************
    *  Init Model                                           *
    *********************************************************/
-  start = clock();
+  ScopedPhase init_model("init model");
   printf("Initialize model ...\n");
-  // Initialize parameters
+  // The states of the updater follow each linear weight
+  updater_ = create_updater();
+  CHECK_NOTNULL(updater_);
+  updater_->Initialize(updater_param());
+  // The worker of the parameter servers trains a local model
+  // of the features of each batch, which grows as needed
+  bool ps_mode = !hyper_param_.ps_servers.empty();
+  if (ps_mode) { init_ps_client(); }
+  // The nodes of the ring start from the same model
+  if (!hyper_param_.ring_nodes.empty()) { init_ring(); }
+  // The resumed training restores the model of its state by
+  // warm-start, instead of the model of -pre
+  std::string resume_file = hyper_param_.model_file + ".resume";
+  if (hyper_param_.resume && FileExist(resume_file.c_str()) &&
+      FileExist((resume_file + ".state").c_str())) {
+    hyper_param_.pre_model_file = resume_file;
+  }
+  // The former model of warm-start, which has the same
+  // structure, and the model grows to its features and fields
+  Model* pre_model = nullptr;
+  if (!hyper_param_.pre_model_file.empty()) {
+    pre_model = new Model(hyper_param_.pre_model_file);
+    check_pre_model(*pre_model);
+    hyper_param_.num_feature = std::max(hyper_param_.num_feature,
+                                        pre_model->GetNumFeature());
+    if (hyper_param_.score_func.compare("ffm") == 0) {
+      hyper_param_.num_field = std::max(hyper_param_.num_field,
+                                        pre_model->GetNumField());
+    }
+  }
+  // The simpler model of -init, which is not used by the resumed
+  // training. The model grows to its features and fields
+  Model* simple_model = nullptr;
+  if (!hyper_param_.init_model_file.empty() &&
+      hyper_param_.pre_model_file.empty()) {
+    simple_model = new Model(hyper_param_.init_model_file);
+    hyper_param_.num_feature = std::max(hyper_param_.num_feature,
+                                        simple_model->GetNumFeature());
+    if (hyper_param_.score_func.compare("ffm") == 0 &&
+        simple_model->GetScoreFunction().compare("ffm") == 0) {
+      hyper_param_.num_field = std::max(hyper_param_.num_field,
+                                        simple_model->GetNumField());
+    }
+  }
+  // The processes of the shared model agree on the structure
+  // after the warm-start model
+  if (shm_.IsOpen()) { init_shm(); }
+  // Initialize parameters. The shared model is initialized by
+  // the process 0, and the others wait for it in Map()
   model_ = new Model();
-  model_->Initialize(hyper_param_.score_func,
-                   hyper_param_.loss_func,
-                   hyper_param_.num_feature,
-                   hyper_param_.num_field,
-                   hyper_param_.num_K,
-                   hyper_param_.model_scale);
-  index_t num_param = model_->GetNumParameter();
+  model_->SetNumaPolicy(hyper_param_.numa_policy);
+  model_->SetSeed(hyper_param_.model_seed);
+  model_->SetHugePages(hyper_param_.huge_page);
+  model_->SetShards(hyper_param_.model_shards);
+  if (growing) {
+    model_->SetCapacity(std::max(hyper_param_.max_feature,
+                                 hyper_param_.num_feature));
+  }
+  LatentLayout layout = kLayoutInterleaved;
+  ParseLatentLayout(hyper_param_.latent_layout, &layout);
+  model_->SetLatentLayout(layout);
+  if (hyper_param_.sparse_latent) { init_latent_pairs(); }
+  if (!hyper_param_.field_k.empty()) { init_field_k(); }
+  bool shm_owner = hyper_param_.worker_id == 0;
+  if (shm_.IsOpen()) {
+    uint64 bytes = Model::SharedBytes(hyper_param_.score_func,
+                                      hyper_param_.num_feature,
+                                      hyper_param_.num_field,
+                                      hyper_param_.num_K,
+                                      updater_->LinearStride());
+    char* addr = shm_.Map(bytes);
+    if (addr == nullptr) {
+      printf("[Error] Cannot map the shared model: %s \n",
+             hyper_param_.shm_name.c_str());
+      exit(0);
+    }
+    model_->InitShared(hyper_param_.score_func,
+                       hyper_param_.loss_func,
+                       hyper_param_.num_feature,
+                       hyper_param_.num_field,
+                       hyper_param_.num_K,
+                       hyper_param_.model_scale,
+                       updater_->LinearStride(),
+                       addr, shm_owner);
+  } else if (!hyper_param_.param_file.empty()) {
+    if (!model_->InitFile(hyper_param_.score_func,
+                          hyper_param_.loss_func,
+                          hyper_param_.num_feature,
+                          hyper_param_.num_field,
+                          hyper_param_.num_K,
+                          hyper_param_.model_scale,
+                          updater_->LinearStride(),
+                          hyper_param_.param_file)) {
+      printf("[Error] Cannot create the parameter file: %s \n",
+             hyper_param_.param_file.c_str());
+      exit(0);
+    }
+    printf("  Parameters in the file: %s \n",
+           hyper_param_.param_file.c_str());
+  } else {
+    model_->Initialize(hyper_param_.score_func,
+                     hyper_param_.loss_func,
+                     ps_mode ? 1 : hyper_param_.num_feature,
+                     hyper_param_.num_field,
+                     hyper_param_.num_K,
+                     hyper_param_.model_scale,
+                     updater_->LinearStride());
+  }
+  if (pre_model != nullptr) {
+    if (!shm_.IsOpen() || shm_owner) {
+      model_->WarmStart(*pre_model);
+      printf("  Warm-start from model: %s (%d features)\n",
+             hyper_param_.pre_model_file.c_str(),
+             pre_model->GetNumFeature());
+      LOG(INFO) << "Warm-start from model: "
+                << hyper_param_.pre_model_file;
+    }
+    if (!pre_model->IsMapped()) { pre_model->Release(); }
+    delete pre_model;
+  }
+  if (simple_model != nullptr) {
+    if (!model_->CanInitFrom(*simple_model)) {
+      printf("[Error] The %s model (-k %d) of %s cannot initialize "
+             "the %s model of -k %d. \n",
+             simple_model->GetScoreFunction().c_str(),
+             simple_model->GetNumK(),
+             hyper_param_.init_model_file.c_str(),
+             hyper_param_.score_func.c_str(), hyper_param_.num_K);
+      exit(0);
+    }
+    if (!shm_.IsOpen() || shm_owner) {
+      model_->InitFrom(*simple_model);
+      printf("  Initialize from the %s model: %s (%d features)\n",
+             simple_model->GetScoreFunction().c_str(),
+             hyper_param_.init_model_file.c_str(),
+             simple_model->GetNumFeature());
+      LOG(INFO) << "Initialize from model: "
+                << hyper_param_.init_model_file;
+    }
+    if (!simple_model->IsMapped()) { simple_model->Release(); }
+    delete simple_model;
+  }
+  if (shm_.IsOpen() && shm_owner) { shm_.Publish(); }
+  // The huge pages may fall back to the available policy
+  if (hyper_param_.huge_page.compare("none") != 0 &&
+      model_->GetParameter_v() != nullptr) {
+    if (model_->HugePages() != hyper_param_.huge_page) {
+      printf("[Warning] The -hugepage '%s' is not available, and the "
+             "latent factor uses '%s'. \n",
+             hyper_param_.huge_page.c_str(),
+             model_->HugePages().c_str());
+    }
+    LOG(INFO) << "Huge pages of the latent factor: "
+              << model_->HugePages();
+  }
+  if (model_->GetNumShards() > 1) {
+    printf("  Model shards: %d (%d features each) \n",
+           model_->GetNumShards(), model_->GetShard(0).num_feat);
+    LOG(INFO) << "Model shards: " << model_->GetNumShards();
+  }
+  // The online rows out of the model (or its capacity) are dropped
+  if (hyper_param_.online) {
+    StreamReader* stream = dynamic_cast<StreamReader*>(reader_[0]);
+    CHECK_NOTNULL(stream);
+    bool ffm = hyper_param_.score_func.compare("ffm") == 0;
+    stream->SetLimits(growing ? model_->GetCapacity() :
+                                hyper_param_.num_feature,
+                      ffm ? hyper_param_.num_field : 0);
+    if (growing) {
+      Model* model = model_;
+      stream->SetGrowth([model](index_t num_feat) {
+        CHECK(model->Grow(num_feat));
+      });
+    }
+  }
+  uint64 num_param = model_->GetNumParameter();
   hyper_param_.num_param = num_param;
   LOG(INFO) << "Number parameters: " << num_param;
-  printf("  Model size: %.2f MB\n",
-           (double) num_param / (1024.0 * 1024.0));
-  end = clock();
+  printf("  Model size: %.2f MB (%llu parameters)\n",
+         (double) (model_->WeightBytes() + model_->StateBytes()) / MB,
+         (unsigned long long)num_param);
   printf("  Time cost for model initial: %.2f sec \n",
-     (float)(end-start) / CLOCKS_PER_SEC);
+         init_model.Stop());
   /*********************************************************
    *  Init score function                                  *
    *********************************************************/
+  // The tuning runs before the tracking of the updates, which
+  // would flag the features of the rows it times
+  if (hyper_param_.tune_kernel) { tune_kernel(); }
+  // The score flags the features updated in training
+  if (hyper_param_.checkpoint_delta) { model_->TrackDirtyFeatures(); }
+  // The score stamps the update time of the features
+  if (hyper_param_.ttl_minute > 0) { model_->TrackUpdateTime(); }
   score_ = create_score();
   score_->Initialize(hyper_param_.learning_rate,
-                     hyper_param_.regu_lambda);
+                     hyper_param_.regu_lambda,
+                     model_);
+  score_->SetPrefetchDistance(kernel_choice_.score.empty() ?
+                              hyper_param_.prefetch_distance :
+                              kernel_choice_.prefetch);
+  score_->SetUpdater(updater_);
+  score_->SetBatchSize(hyper_param_.batch_size);
+  score_->SetSqrtPrecision(sqrt_precision());
   LOG(INFO) << "Initialize score function.";
   /*********************************************************
    *  Init loss function                                   *
    *********************************************************/
   loss_ = create_loss();
-  loss_->Initialize(score_, hyper_param_.norm);
+  loss_->Initialize(score_, hyper_param_.norm,
+                    thread_number_, cpus_);
+  config_loss(loss_);
   LOG(INFO) << "Initialize loss function.";
   /*********************************************************
    *  Init metric                                          *
    *********************************************************/
   metric_ = create_metric();
-  metric_->Initialize(hyper_param_.metric);
+  metric_->Initialize(hyper_param_.metric, hyper_param_.exact_auc);
+  metric_->SetThreadPool(loss_->thread_pool());
   LOG(INFO) << "Initialize evaluation metric.";
+  // The asynchronous validation has its own unpinned threads.
+  // The shared pool of the same size would be the one of the
+  // training, whose ParallelFor() calls run one at a time
+  if (hyper_param_.async_valid > 0) {
+    valid_pool_.reset(new ThreadPool(hyper_param_.async_valid));
+    valid_loss_ = create_loss();
+    valid_loss_->Initialize(score_, hyper_param_.norm, valid_pool_.get());
+    valid_metric_ = create_metric();
+    valid_metric_->Initialize(hyper_param_.metric, hyper_param_.exact_auc);
+    valid_metric_->SetThreadPool(valid_loss_->thread_pool());
+    LOG(INFO) << "Initialize asynchronous validation with "
+              << hyper_param_.async_valid << " threads.";
+  }
+}
+
+// The worker says the number of features of its own data,
+// and the global model has the max of all the workers
+void Solver::init_ps_client() {
+  std::vector<std::string> servers;
+  SplitStringUsing(hyper_param_.ps_servers, ",", &servers);
+  PSHello hello;
+  memset(&hello, 0, sizeof(hello));
+  hello.worker_id = hyper_param_.worker_id;
+  hello.num_workers = hyper_param_.num_workers;
+  hello.score_func = hyper_param_.score_func.compare("linear") == 0 ? 0 :
+                     hyper_param_.score_func.compare("fm") == 0 ? 1 : 2;
+  hello.num_feature = hyper_param_.num_feature;
+  hello.num_field = hyper_param_.num_field;
+  hello.num_K = hyper_param_.num_K;
+  hello.linear_stride = updater_->LinearStride();
+  hello.staleness = hyper_param_.staleness;
+  hello.scale = hyper_param_.model_scale;
+  printf("  Connect to %lu parameter servers as worker %d of %d ... \n",
+         servers.size(), hyper_param_.worker_id, hyper_param_.num_workers);
+  index_t num_feature = 0;
+  index_t num_field = 0;
+  if (!ps_client_.Connect(servers, hello, &num_feature, &num_field)) {
+    printf("[Error] Cannot connect to the parameter servers: %s \n",
+           hyper_param_.ps_servers.c_str());
+    exit(0);
+  }
+  hyper_param_.num_feature = num_feature;
+  hyper_param_.num_field = num_field;
+  WireQuant quant = kWireFp32;
+  CHECK(ParseWireQuant(hyper_param_.ps_quant, &quant));
+  ps_client_.SetQuant(quant);
+  printf("  Global model: %d features, %d fields \n",
+         num_feature, num_field);
+  LOG(INFO) << "Connect to the parameter servers: "
+            << hyper_param_.ps_servers << ", global features: "
+            << num_feature;
+}
+
+// The initial model only depends on its structure, so the
+// nodes have the same model after they agree on the structure
+void Solver::init_ring() {
+  std::vector<std::string> nodes;
+  SplitStringUsing(hyper_param_.ring_nodes, ",", &nodes);
+  printf("  Connect to the ring of %lu nodes as node %d ... \n",
+         nodes.size(), hyper_param_.worker_id);
+  index_t num_feature = hyper_param_.num_feature;
+  index_t num_field = hyper_param_.num_field;
+  if (!ring_.Initialize(nodes, hyper_param_.worker_id) ||
+      !ring_.AllMax(&num_feature) ||
+      !ring_.AllMax(&num_field)) {
+    printf("[Error] Cannot connect to the nodes of the ring: %s \n",
+           hyper_param_.ring_nodes.c_str());
+    exit(0);
+  }
+  hyper_param_.num_feature = num_feature;
+  hyper_param_.num_field = num_field;
+  printf("  Model of the ring: %d features, %d fields \n",
+         num_feature, num_field);
+  LOG(INFO) << "Connect to the ring: " << hyper_param_.ring_nodes
+            << ", features: " << num_feature;
+}
+
+// The processes have the same structure of model, which is
+// the max of their features and fields
+void Solver::init_shm() {
+  printf("  Join the shared model %s of %d processes as process %d ... \n",
+         hyper_param_.shm_name.c_str(), hyper_param_.num_workers,
+         hyper_param_.worker_id);
+  index_t num_feature = hyper_param_.num_feature;
+  index_t num_field = hyper_param_.num_field;
+  if (!shm_.AllMax(&num_feature, &num_field)) {
+    printf("[Error] Cannot join the processes of the shared model: %s \n",
+           hyper_param_.shm_name.c_str());
+    exit(0);
+  }
+  hyper_param_.num_feature = num_feature;
+  hyper_param_.num_field = num_field;
+  printf("  Shared model: %d features, %d fields \n",
+         num_feature, num_field);
+  LOG(INFO) << "Join the shared model: " << hyper_param_.shm_name
+            << ", features: " << num_feature;
+}
+
+// The kernels are timed on the first rows of the training set
+// with the real model. A choice of the cache is only used if
+// it is still a candidate, e.g., of the given XLEARN_KERNEL
+void Solver::tune_kernel() {
+  static const index_t kTuneRows = 2000;
+  KernelTuner tuner(hyper_param_.score_func, model_, sqrt_precision());
+  if (!tuner.Eligible()) {
+    printf("[Warning] The kernels of this model cannot be tuned, "
+           "and the default ones are used. \n");
+    return;
+  }
+  const char* isa = getenv("XLEARN_KERNEL");
+  if (isa != nullptr) { tuner.FixIsa(GetScoreKernel().name); }
+  if (hyper_param_.prefetch_distance > 0) {
+    tuner.FixPrefetch(hyper_param_.prefetch_distance);
+  }
+  DMatrix sample;
+  sample.SetCSR(true);
+  DMatrix* matrix = nullptr;
+  reader_[0]->Reset();
+  index_t num_row = reader_[0]->Samples(matrix, false);
+  if (num_row > 0) {
+    num_row = std::min(num_row, kTuneRows);
+    sample.ResetMatrix(num_row);
+    for (index_t i = 0; i < num_row; ++i) {
+      sample.CopyRow(i, *matrix, i);
+    }
+  }
+  reader_[0]->Reset();
+  if (num_row == 0) { return; }
+  std::vector<KernelChoice> candidates = tuner.Candidates();
+  std::string cache_file = KernelTuner::DefaultCacheFile();
+  std::string key = tuner.CacheKey(sample);
+  KernelChoice choice;
+  bool cached = !cache_file.empty() &&
+                KernelTuner::LoadCache(cache_file, key, &choice);
+  if (cached) {
+    cached = false;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      cached |= candidates[i].ToString() == choice.ToString();
+    }
+  }
+  if (cached) {
+    printf("  Kernel: %s (cached) \n", choice.ToString().c_str());
+  } else {
+    Timer timer;
+    timer.tic();
+    choice = tuner.Tune(sample);
+    printf("  Kernel: %s (%.3f us/row, %d variants in %.2f sec) \n",
+           choice.ToString().c_str(), choice.usec_per_row,
+           (int)candidates.size(), timer.toc());
+    // The choice among the restricted candidates is not cached
+    bool fixed = isa != nullptr || hyper_param_.prefetch_distance > 0;
+    if (!cache_file.empty() && !fixed &&
+        !KernelTuner::SaveCache(cache_file, key, choice)) {
+      LOG(WARNING) << "Cannot write the kernel cache: " << cache_file;
+    }
+  }
+  LOG(INFO) << "Kernel of " << key << ": " << choice.ToString()
+            << (cached ? " (cached)" : "");
+  kernel_choice_ = choice;
+}
+
+// The (feature, field) pairs of the training set are found
+// in a pass over its rows, before the model is allocated
+void Solver::init_latent_pairs() {
+  std::shared_ptr<LatentPairs> pairs(new LatentPairs());
+  if (!hyper_param_.field_pairs_file.empty()) {
+    FieldPairMask mask;
+    if (!mask.Load(hyper_param_.field_pairs_file,
+                   hyper_param_.num_field)) {
+      printf("[Error] Cannot read the field pairs of %s \n",
+             hyper_param_.field_pairs_file.c_str());
+      exit(0);
+    }
+    uint64 num_all = (uint64)hyper_param_.num_field *
+                     (hyper_param_.num_field + 1) / 2;
+    printf("  Field pairs: %llu of %llu \n",
+           (unsigned long long)mask.NumPairs(),
+           (unsigned long long)num_all);
+    LOG(INFO) << "Field pairs: " << mask.NumPairs() << " of " << num_all;
+    pairs->SetFieldMask(mask);
+  }
+  DMatrix* matrix = nullptr;
+  reader_[0]->Reset();
+  while (reader_[0]->Samples(matrix, false) > 0) {
+    for (index_t i = 0; i < matrix->row_length; ++i) {
+      pairs->AddRow(matrix->GetRow(i), hyper_param_.num_field);
+    }
+  }
+  reader_[0]->Reset();
+  pairs->Build(hyper_param_.num_feature);
+  double num_dense = (double)hyper_param_.num_feature *
+                     hyper_param_.num_field;
+  printf("  Latent pairs: %llu (%.2f%% of the dense model) \n",
+         (unsigned long long)pairs->Size(),
+         pairs->Size() * 100.0 / num_dense);
+  LOG(INFO) << "Latent pairs: " << pairs->Size()
+            << " of " << num_dense;
+  model_->SetLatentPairs(pairs);
+}
+
+// The K of each field is read from the file, or chosen by the
+// distinct features of each field in a pass over the training set
+void Solver::init_field_k() {
+  index_t num_field = hyper_param_.num_field;
+  index_t num_K = hyper_param_.num_K;
+  FieldK field_k;
+  if (hyper_param_.field_k.compare("auto") != 0) {
+    if (!field_k.Load(hyper_param_.field_k, num_field, num_K)) {
+      printf("[Error] Cannot read the field K of %s (each K is "
+             "in [1, %d]) \n", hyper_param_.field_k.c_str(), num_K);
+      exit(0);
+    }
+  } else {
+    DMatrix* matrix = nullptr;
+    reader_[0]->Reset();
+    while (reader_[0]->Samples(matrix, false) > 0) {
+      for (index_t i = 0; i < matrix->row_length; ++i) {
+        field_k.AddRow(matrix->GetRow(i));
+      }
+    }
+    reader_[0]->Reset();
+    field_k.Learn(num_field, num_K);
+  }
+  // The latent factor shrinks with the mean K of the fields
+  double sum_k = 0;
+  std::string values;
+  for (index_t f = 0; f < num_field; ++f) {
+    sum_k += field_k.Get(f);
+    if (f > 0) { values += " "; }
+    values += StringPrintf("%d", field_k.Get(f));
+  }
+  double mean_k = num_field > 0 ? sum_k / num_field : 0;
+  printf("  Field K: mean %.1f of -k %d (%s) \n", mean_k, num_K,
+         values.c_str());
+  LOG(INFO) << "Field K: " << values;
+  model_->SetFieldK(field_k.Values());
+}
+
+// The strength of the field pair (a, b) is the sum of
+// |<V_i_fj, V_j_fi> * x_i * x_j| of its node pairs in a
+// pass over the training set
+void Solver::learn_field_pairs() {
+  index_t num_field = model_->GetNumField();
+  index_t aligned_k = model_->get_aligned_k();
+  LatentLayout layout = model_->GetLatentLayout();
+  std::vector<double> strength((uint64)num_field * num_field, 0);
+  DMatrix* matrix = nullptr;
+  reader_[0]->Reset();
+  while (reader_[0]->Samples(matrix, false) > 0) {
+    for (index_t r = 0; r < matrix->row_length; ++r) {
+      RowView row = matrix->GetRow(r);
+      real_t norm = hyper_param_.norm ? matrix->norm[r] : 1.0;
+      for (const Node* i = row.begin(); i != row.end(); ++i) {
+        for (const Node* j = i + 1; j != row.end(); ++j) {
+          const real_t* w1 = model_->GetLatentBlock(i->feat_id,
+                                                    j->field_id);
+          const real_t* w2 = model_->GetLatentBlock(j->feat_id,
+                                                    i->field_id);
+          if (w1 == nullptr || w2 == nullptr) { continue; }
+          real_t dot = 0;
+          for (index_t d = 0; d < aligned_k; ++d) {
+            index_t pos = LatentWeightPos(layout, d, aligned_k);
+            dot += w1[pos] * w2[pos];
+          }
+          index_t a = std::min(i->field_id, j->field_id);
+          index_t b = std::max(i->field_id, j->field_id);
+          strength[(uint64)a * num_field + b] +=
+            fabs(dot * i->feat_val * j->feat_val * norm);
+        }
+      }
+    }
+  }
+  reader_[0]->Reset();
+  FieldPairMask mask;
+  mask.Learn(strength, num_field, hyper_param_.field_pair_ratio);
+  mask.Serialize(hyper_param_.learn_field_pairs);
+  printf("  Field pairs: %llu kept in %s \n",
+         (unsigned long long)mask.NumPairs(),
+         hyper_param_.learn_field_pairs.c_str());
+  LOG(INFO) << "Field pairs: " << mask.NumPairs() << " kept in "
+            << hyper_param_.learn_field_pairs;
+}
+
+// Number of the features whose latent vectors are the
+// points of the fields in learn_field_groups()
+static const index_t kGroupFeatures = 256;
+
+// The point of the field f is the latent vectors V_i_f of the
+// features of the largest latent vectors, so the fields of a
+// group are used in the same way by the most of the model
+void Solver::learn_field_groups() {
+  index_t num_feature = model_->GetNumFeature();
+  index_t num_field = model_->GetNumField();
+  index_t num_K = model_->GetNumK();
+  index_t aligned_k = model_->get_aligned_k();
+  LatentLayout layout = model_->GetLatentLayout();
+  // The squared norm of the latent vectors of each feature
+  std::vector<std::pair<double, index_t> > norms(num_feature);
+  for (index_t i = 0; i < num_feature; ++i) {
+    double sum = 0;
+    for (index_t f = 0; f < num_field; ++f) {
+      const real_t* w = model_->GetLatentBlock(i, f);
+      if (w == nullptr) { continue; }
+      for (index_t d = 0; d < num_K; ++d) {
+        real_t v = w[LatentWeightPos(layout, d, aligned_k)];
+        sum += v * v;
+      }
+    }
+    norms[i] = std::make_pair(sum, i);
+  }
+  index_t num_sample = std::min(kGroupFeatures, num_feature);
+  std::partial_sort(norms.begin(), norms.begin() + num_sample,
+                    norms.end(),
+                    std::greater<std::pair<double, index_t> >());
+  index_t dim = num_sample * num_K;
+  std::vector<real_t> points((uint64)num_field * dim, 0);
+  for (index_t f = 0; f < num_field; ++f) {
+    for (index_t s = 0; s < num_sample; ++s) {
+      const real_t* w = model_->GetLatentBlock(norms[s].second, f);
+      if (w == nullptr) { continue; }
+      real_t* point = &points[(uint64)f * dim + (uint64)s * num_K];
+      for (index_t d = 0; d < num_K; ++d) {
+        point[d] = w[LatentWeightPos(layout, d, aligned_k)];
+      }
+    }
+  }
+  FieldGroups groups;
+  groups.Learn(points, num_field, dim, hyper_param_.num_field_groups);
+  groups.Serialize(hyper_param_.learn_field_groups);
+  printf("  Field groups: %d fields in %d groups kept in %s \n",
+         num_field, groups.NumGroup(),
+         hyper_param_.learn_field_groups.c_str());
+  LOG(INFO) << "Field groups: " << num_field << " fields in "
+            << groups.NumGroup() << " groups kept in "
+            << hyper_param_.learn_field_groups;
+}
+
+// The resident pages of each quarter of the features,
+// where the first one is the most frequent by --freq-order
+void Solver::print_resident() {
+  std::vector<real_t> fractions;
+  model_->ResidentFractions(4, &fractions);
+  std::string str;
+  for (size_t i = 0; i < fractions.size(); ++i) {
+    StringAppendF(&str, "%s%.1f%%", i == 0 ? "" : ", ",
+                  fractions[i] * 100);
+  }
+  printf("  Resident pages by feature quarters: %s \n", str.c_str());
+  LOG(INFO) << "Resident pages by feature quarters: " << str;
+}
+
+// The deltas are applied in the given order, and each of
+// them is loaded as a sparse model
+void Solver::apply_deltas() {
+  if (hyper_param_.delta_files.empty()) { return; }
+  std::vector<std::string> files;
+  SplitStringUsing(hyper_param_.delta_files, ",", &files);
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!FileExist(files[i].c_str())) {
+      printf("[Error] Cannot open the delta file %s \n",
+             files[i].c_str());
+      exit(0);
+    }
+    Model delta(files[i]);
+    if (!model_->ApplyDelta(delta)) {
+      printf("[Error] The delta file %s does not match the model, "
+             "or the model is memory-mappable or sparse. \n",
+             files[i].c_str());
+      exit(0);
+    }
+    LOG(INFO) << "Apply delta of " << delta.GetNumFeature()
+              << " features: " << files[i];
+  }
 }
 
 // Initialize predict task
@@ -241,12 +1105,14 @@ void Solver::init_predict() {
   /*********************************************************
    *  Read problem from model file                         *
    *********************************************************/
+   ScopedPhase load_model("load model");
    model_ = new Model(hyper_param_.model_file);
+   apply_deltas();
+   load_model.Stop();
    hyper_param_.score_func = model_->GetScoreFunction();
    hyper_param_.loss_func = model_->GetLossFunction();
    hyper_param_.num_feature = model_->GetNumFeature();
-   if (hyper_param_.score_func.compare("fm") == 0 ||
-       hyper_param_.score_func.compare("ffm") == 0) {
+   if (hyper_param_.score_func.compare("linear") != 0) {
      hyper_param_.num_K = model_->GetNumK();
    }
    if (hyper_param_.score_func.compare("ffm") == 0) {
@@ -257,8 +1123,101 @@ void Solver::init_predict() {
     *  Init Reader and read problem                         *
     *********************************************************/
    // Create Reader
+   ScopedPhase read("read");
    reader_.resize(1, create_reader());
    CHECK_NE(hyper_param_.predict_file.empty(), true);
+   reader_[0]->SetHashBucket(hyper_param_.hash_bucket);
+   reader_[0]->SetDense(hyper_param_.dense_data);
+   reader_[0]->SetThreadNumber(thread_number_);
+   reader_[0]->SetAffinity(cpus_);
+   // The feature map of the model trained with --remap
+   std::string dict_file = hyper_param_.model_file + ".dict";
+   // The dense block is not re-indexed by the feature map
+   if (hyper_param_.dense_data &&
+       (model_->IsSparse() || FileExist(dict_file.c_str()) ||
+        hyper_param_.score_func.compare("ffm") == 0)) {
+     printf("[Error] --dense cannot be used with the ffm model, the "
+            "sparse model or the model trained with --remap. \n");
+     exit(0);
+   }
+   index_t dense_num_feature = model_->IsSparse() ?
+                               model_->GetDenseNumFeature() :
+                               hyper_param_.num_feature;
+   if (model_->IsSparse()) {
+     // The sparse model is renumbered, and the ids of its
+     // features are raw ids, or the dense ids of --remap
+     FeatureMap dict;
+     bool has_dict = FileExist(dict_file.c_str());
+     if (has_dict) {
+       CHECK(dict.Deserialize(dict_file));
+       CHECK_EQ(dict.Size(), dense_num_feature);
+     }
+     const std::vector<index_t>& ids = model_->GetFeatureIds();
+     for (size_t i = 0; i < ids.size(); ++i) {
+       index_t id = 0;
+       if (has_dict && ids[i] == dict.OovId()) {
+         feature_map_.AddOov();
+       } else {
+         feature_map_.Map(has_dict ? dict.RawId(ids[i]) : ids[i], &id);
+       }
+     }
+     feature_map_.Freeze();
+     reader_[0]->SetFeatureMap(&feature_map_);
+     LOG(INFO) << "Load sparse model of " << ids.size()
+               << " features";
+   } else if (FileExist(dict_file.c_str())) {
+     CHECK(feature_map_.Deserialize(dict_file));
+     CHECK_EQ(feature_map_.Size(), hyper_param_.num_feature);
+     reader_[0]->SetFeatureMap(&feature_map_);
+     LOG(INFO) << "Load feature map: " << dict_file;
+   }
+   // The groups of the fields of the model trained with -field_groups
+   std::string groups_file = hyper_param_.model_file + ".groups";
+   if (FileExist(groups_file.c_str())) {
+     CHECK(field_groups_.Load(groups_file));
+     reader_[0]->SetFieldGroups(field_groups_);
+     LOG(INFO) << "Load field groups: " << groups_file;
+   }
+   // The crosses of the model trained with -cross
+   std::string cross_file = hyper_param_.model_file + ".cross";
+   if (FileExist(cross_file.c_str())) {
+     char* buffer = nullptr;
+     uint64 size = ReadFileToMemory(cross_file, &buffer);
+     std::string spec(buffer, size);
+     delete [] buffer;
+     spec.erase(spec.find_last_not_of(" \r\n") + 1);
+     CHECK(ParseCrosses(spec, &crosses_));
+     reader_[0]->SetCrosses(crosses_);
+     LOG(INFO) << "Load crosses: " << cross_file;
+   }
+   // The ids that the training of -admit has not admitted are
+   // the OOV feature after the buckets
+   std::string admit_file = hyper_param_.model_file + ".admit";
+   bool has_admit = hyper_param_.hash_bucket > 0 &&
+                    FileExist(admit_file.c_str());
+   if (has_admit) {
+     CHECK(admission_.Deserialize(admit_file));
+     reader_[0]->SetAdmission(&admission_, hyper_param_.hash_bucket);
+     LOG(INFO) << "Load admission filter: " << admit_file;
+   }
+   if (!FileExist(dict_file.c_str()) &&
+       hyper_param_.hash_bucket > 0 &&
+       hyper_param_.hash_bucket + (has_admit ? 1 : 0) !=
+       dense_num_feature) {
+     // The hashed ids must fit the model
+     printf("[Error] -hash %d does not match the number of "
+            "features (%d) in the model \n",
+            hyper_param_.hash_bucket, dense_num_feature);
+     exit(0);
+   }
+   // The ids of the predict file are counted in the first
+   // pass, and the rows are re-indexed after the model is
+   // compacted to these features
+   FeatureMap counter;
+   if (hyper_param_.lazy_model) {
+     counter.EnableFrequencyOrder();
+     reader_[0]->SetFeatureMap(&counter);
+   }
    reader_[0]->Initialize(hyper_param_.predict_file,
                           hyper_param_.sample_size);
    if (reader_[0] == NULL) {
@@ -267,17 +1226,128 @@ void Solver::init_predict() {
     exit(0);
    }
    LOG(INFO) << "Initialize Parser ans Reader.";
+   // The columns of the dense block are the features of the model
+   if (hyper_param_.dense_data &&
+       reader_[0]->Stats().num_row > 0 &&
+       reader_[0]->Stats().max_feat >= hyper_param_.num_feature) {
+     printf("[Error] The csv file has more columns than the "
+            "features (%d) of the model \n", hyper_param_.num_feature);
+     exit(0);
+   }
+   if (hyper_param_.lazy_model) {
+     load_input_features(counter);
+   }
+   read.Stop();
+   // Store the latent factor in 16 bits if needed. HOFM
+   // only has the kernel of the fp32 weights
+   if (hyper_param_.score_func.compare("hofm") == 0 &&
+       hyper_param_.latent_type.compare("fp32") != 0) {
+     printf("[Warning] The -v is not used by the hofm model, "
+            "and it is ignored. \n");
+     hyper_param_.latent_type = "fp32";
+   }
+   model_->ConvertLatent(hyper_param_.latent_type);
    /*********************************************************
     *  Init score function                                  *
     *********************************************************/
    score_ = create_score();
+   score_->Initialize(hyper_param_.learning_rate,
+                      hyper_param_.regu_lambda,
+                      model_);
+   score_->SetPrefetchDistance(hyper_param_.prefetch_distance);
    LOG(INFO) << "Initialize score function.";
    /*********************************************************
     *  Init loss function                                   *
     *********************************************************/
    loss_ = create_loss();
-   loss_->Initialize(score_, hyper_param_.norm);
+   loss_->Initialize(score_, hyper_param_.norm,
+                     thread_number_, cpus_);
    LOG(INFO) << "Initialize score function.";
+   init_ensemble();
+}
+
+// The models of -ensemble read the rows parsed for model_,
+// so they need its dense features. Each of them has its own
+// score and loss, and they run on the threads of loss_
+void Solver::init_ensemble() {
+  if (hyper_param_.ensemble_files.empty()) { return; }
+  std::vector<std::string> files;
+  SplitStringUsing(hyper_param_.ensemble_files, ",", &files);
+  ensemble_.resize(files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    ModelReplica& member = ensemble_[i];
+    member.model.reset(new Model(files[i]));
+    Model* model = member.model.get();
+    if (model_->IsSparse() || model->IsSparse() ||
+        model->GetNumFeature() != model_->GetNumFeature()) {
+      printf("[Error] The model %s of -ensemble should have the %d "
+             "features of the model, and the sparse models cannot be "
+             "used by -ensemble. \n",
+             files[i].c_str(), model_->GetNumFeature());
+      exit(0);
+    }
+    const std::string& score_func = model->GetScoreFunction();
+    if (score_func.compare("hofm") != 0) {
+      model->ConvertLatent(hyper_param_.latent_type);
+    }
+    member.score.reset(create_score(score_func, model));
+    CHECK_NOTNULL(member.score.get());
+    member.score->Initialize(hyper_param_.learning_rate,
+                             hyper_param_.regu_lambda,
+                             model);
+    member.score->SetPrefetchDistance(hyper_param_.prefetch_distance);
+    member.loss.reset(CREATE_LOSS(model->GetLossFunction().c_str()));
+    CHECK_NOTNULL(member.loss.get());
+    member.loss->Initialize(member.score.get(), hyper_param_.norm,
+                            loss_->thread_pool());
+    LOG(INFO) << "Load the model of -ensemble: " << files[i];
+  }
+}
+
+// Keep the features of the model that occur in the predict file, and
+// the dense ids are given in the order of descending frequency, so the
+// hottest ones are contiguous in the compact model. The counted ids are
+// mapped to the model by feature_map_ if it is loaded, and the ids of
+// its OOV id share one OOV id of the compact model
+void Solver::load_input_features(FeatureMap& counter) {
+  counter.OrderByFrequency();
+  bool has_map = feature_map_.IsFrozen();
+  std::vector<index_t> kept;
+  bool has_oov = false;
+  for (index_t i = 0; i < counter.Size(); ++i) {
+    index_t raw_id = counter.RawId(i);
+    index_t id = raw_id;
+    if (has_map ? !feature_map_.Map(raw_id, &id) :
+                  id >= model_->GetNumFeature()) {
+      continue;
+    }
+    if (has_map && id == feature_map_.OovId()) {
+      has_oov = true;
+      continue;
+    }
+    kept.push_back(id);
+    input_map_.Map(raw_id, &id);
+  }
+  if (has_oov) {
+    kept.push_back(feature_map_.OovId());
+    input_map_.AddOov();
+  }
+  input_map_.Freeze();
+  printf("Load %lu of %u features of the model \n",
+         kept.size(), model_->GetNumFeature());
+  // The model file needs at least one feature
+  if (kept.empty()) { kept.push_back(0); }
+  Model* compact = new Model;
+  compact->CompactFrom(*model_, kept);
+  // The pages of the mapped file are released by munmap()
+  if (!model_->IsMapped()) { model_->Release(); }
+  delete model_;
+  model_ = compact;
+  hyper_param_.num_feature = model_->GetNumFeature();
+  reader_[0]->SetFeatureMap(&input_map_);
+  reader_[0]->RemapFeatures();
+  LOG(INFO) << "Compact the model to " << kept.size()
+            << " features of the predict file";
 }
 
 /******************************************************************************
@@ -296,11 +1366,34 @@ void Solver::StartWork() {
 }
 
 // Train
+// The signal handler of the online training
+static void stop_online(int sig) {
+  StopOnlineStreams();
+}
+
+// The signal handler of the resumable training
+static void preempt_training(int sig) {
+  RequestPreemption();
+}
+
+// The bound of the bytes of a batch of the
+// tuned sample_size (see BatchTuner)
+static const uint64 kAutoBatchBytes = 64ULL << 20;
+
 void Solver::start_train_work() {
   int epoch = hyper_param_.num_epoch;
   bool early_stop = hyper_param_.early_stop;
   bool quiet = hyper_param_.quiet;
   bool save_model = hyper_param_.model_file == "none" ? false: true;
+  // Only the worker 0 of the parameter servers (or the node 0
+  // of the ring, whose model is the same, or the process 0 of
+  // the shared model) saves the model
+  bool ps_mode = !hyper_param_.ps_servers.empty();
+  bool ring_mode = !hyper_param_.ring_nodes.empty();
+  if ((ps_mode || ring_mode || shm_.IsOpen()) &&
+      hyper_param_.worker_id != 0) {
+    save_model = false;
+  }
   Trainer trainer;
   trainer.Initialize(reader_,  /* Reader list */
                      epoch,
@@ -308,27 +1401,304 @@ void Solver::start_train_work() {
                      loss_,
                      metric_,
                      early_stop,
-                     quiet);
+                     quiet,
+                     hyper_param_.stop_window);
+  if (valid_loss_ != nullptr) {
+    trainer.SetAsyncValidation(valid_loss_, valid_metric_);
+  }
+  if (hyper_param_.valid_batches > 0) {
+    trainer.SetValidBatches(hyper_param_.valid_batches);
+  }
+  if (hyper_param_.checkpoint_epoch > 0 ||
+      hyper_param_.checkpoint_minute > 0) {
+    trainer.SetCheckpoint(hyper_param_.model_file + ".ckpt",
+                          hyper_param_.checkpoint_epoch,
+                          hyper_param_.checkpoint_minute * 60,
+                          updater_,
+                          hyper_param_.mapped_model);
+    trainer.SetCheckpointDelta(hyper_param_.checkpoint_delta);
+    trainer.SetCheckpointChunked(hyper_param_.chunked_model);
+    if (hyper_param_.admit_count > 1) {
+      trainer.SetCheckpointAdmission(&admission_);
+    }
+  }
+  if (hyper_param_.online) {
+    trainer.SetOnline(true);
+    if (hyper_param_.ttl_minute > 0) {
+      trainer.SetEviction(std::max((uint32)(hyper_param_.ttl_minute * 60),
+                                   (uint32)1));
+    }
+    // The signals end the stream, and the model is saved
+    signal(SIGTERM, stop_online);
+    signal(SIGINT, stop_online);
+  }
+  std::string resume_file = hyper_param_.model_file + ".resume";
+  if (hyper_param_.resume) {
+    trainer.SetResume(resume_file, updater_);
+    // The signals save the state of the training and stop it
+    signal(SIGTERM, preempt_training);
+    signal(SIGINT, preempt_training);
+  }
+  if (hyper_param_.train_sample > 0) {
+    trainer.SetTrainSample(hyper_param_.train_sample);
+  }
+  if (hyper_param_.loss_sample > 0) {
+    trainer.SetLossSample(hyper_param_.loss_sample);
+  }
+  if (hyper_param_.auto_sample_size) {
+    trainer.SetAutoBatch(hyper_param_.sample_size, kAutoBatchBytes);
+  }
+  if (ring_mode) {
+    trainer.SetModelAverage(&ring_, hyper_param_.sync_batches);
+  }
+  if (metrics_log_.IsOpen()) { trainer.SetMetricsLog(&metrics_log_); }
+  // The heads k > 1 of the funnel are trained in the same pass
+  // of the rows, each on the label y >= k
+  std::vector<ModelReplica> heads(std::max(hyper_param_.num_heads - 1, 0));
+  if (hyper_param_.num_heads > 1) {
+    loss_->SetLabelThreshold(1);
+    if (valid_loss_ != nullptr) { valid_loss_->SetLabelThreshold(1); }
+    for (size_t i = 0; i < heads.size(); ++i) {
+      create_replica(hyper_param_.model_seed + i + 2, nullptr, &heads[i]);
+      heads[i].loss->SetLabelThreshold(i + 2);
+      trainer.AddModel(heads[i].model.get(),
+                       heads[i].loss.get(),
+                       heads[i].metric.get());
+    }
+    printf("  Train %d heads on the labels y >= 1, ..., y >= %d \n",
+           hyper_param_.num_heads, hyper_param_.num_heads);
+  }
+  // The full-batch solvers copy all the rows and build their
+  // transposed index once, before the first epoch
+  CoordDescent cd;
+  LBFGS lbfgs;
+  BatchSolver* batch = nullptr;
+  if (hyper_param_.opt_method == "als") {
+    batch = &cd;
+  } else if (hyper_param_.opt_method == "lbfgs") {
+    lbfgs.SetL1(hyper_param_.lambda_1);
+    batch = &lbfgs;
+  }
+  if (batch != nullptr) {
+    Timer timer;
+    timer.tic();
+    batch->Initialize(reader_, model_, loss_, hyper_param_.loss_func,
+                      hyper_param_.norm, hyper_param_.regu_lambda,
+                      loss_->thread_pool());
+    printf("  Build the transposed index of %llu rows (%.2f sec) \n",
+           (unsigned long long)batch->Rows().row_length, timer.toc());
+    trainer.SetBatchSolver(batch);
+  }
+  // The budget of the job, less the time of reading the data
+  if (hyper_param_.budget_minute > 0) {
+    real_t left = hyper_param_.budget_minute * 60 - job_timer_.toc();
+    printf("  Time budget of the training: %.1f sec \n", left);
+    trainer.SetTimeBudget(left);
+  }
   printf("Start to train ... \n");
   if (hyper_param_.cross_validation) {
-    trainer.CVTrain();
+    ScopedPhase train("cross-validation");
+    if (hyper_param_.cv_jobs > 1) {
+      train_cv_parallel();
+    } else {
+      trainer.CVTrain();
+    }
     printf("Finish training. \n");
   } else {
-    trainer.Train();
+    if (ps_mode) {
+      train_ps(save_model);
+    } else {
+      ScopedPhase train("train");
+      trainer.Train();
+      ring_.Close();
+    }
+    // The model of the preempted training is in its state
+    if (trainer.Preempted()) {
+      preempted_ = true;
+      printf("Stop the training, which continues from the state "
+             "by --resume \n");
+      return;
+    }
+    // The finished training removes its state
+    if (hyper_param_.resume) {
+      std::string state_file = resume_file + ".state";
+      if (FileExist(state_file.c_str())) { RemoveFile(state_file.c_str()); }
+      if (FileExist(resume_file.c_str())) { RemoveFile(resume_file.c_str()); }
+    }
+    // The hot set of the parameter file after the training
+    if (model_->IsFileBacked()) { print_resident(); }
+    // The process 0 saves the model after all the processes
+    if (shm_.IsOpen() && !shm_.Finish()) {
+      printf("[Warning] Some processes of the shared model %s are "
+             "lost before the end of the training. \n",
+             hyper_param_.shm_name.c_str());
+    }
+    if (hyper_param_.online) {
+      uint64 dropped =
+        dynamic_cast<StreamReader*>(reader_[0])->DroppedRows();
+      if (dropped > 0) {
+        printf("[Warning] Dropped %llu rows whose features or fields "
+               "are out of the model. \n", (unsigned long long)dropped);
+      }
+      if (hyper_param_.admit_count > 1) {
+        printf("  Occurrences of the features not admitted by -admit: "
+               "%llu \n", (unsigned long long)admission_.NumRejected());
+        LOG(INFO) << "Occurrences not admitted: "
+                  << admission_.NumRejected();
+      }
+      if (hyper_param_.ttl_minute > 0) {
+        printf("  Stale features evicted by -ttl_min: %llu \n",
+               (unsigned long long)trainer.NumEvicted());
+      }
+      if (model_->IsGrowable()) {
+        printf("  Number of Feature of the grown model: %d \n",
+               model_->GetNumFeature());
+        LOG(INFO) << "Grown features: " << model_->GetNumFeature();
+      }
+    }
+    train_stats_ = trainer.Stats();
+    for (size_t i = 0; i < reader_.size(); ++i) {
+      train_stats_.parse_time += reader_[i]->ParseTime();
+      train_stats_.cache_time += reader_[i]->CacheTime();
+    }
+    // The deferred regular of the lazy updater
+    updater_->Flush(model_->GetParameter_w(),
+                    model_->GetNumFeature());
+    for (size_t i = 0; i < heads.size(); ++i) {
+      heads[i].updater->Flush(heads[i].model->GetParameter_w(),
+                              heads[i].model->GetNumFeature());
+    }
     if (save_model) {
       printf("Finish training and start to save model ...\n"
              "  Filename: %s\n",
              hyper_param_.model_file.c_str());
-      trainer.SaveModel(hyper_param_.model_file);
+      ScopedPhase save("save model");
+      trainer.SaveModel(hyper_param_.model_file,
+                        hyper_param_.weights_only_model,
+                        hyper_param_.mapped_model,
+                        hyper_param_.sparse_model,
+                        hyper_param_.chunked_model);
+      // The head k is saved to model_file.head<k>
+      for (size_t i = 0; i < heads.size(); ++i) {
+        std::string head_file = hyper_param_.model_file + ".head" +
+                                std::to_string(i + 2);
+        Trainer::SaveModel(heads[i].model.get(), head_file,
+                           hyper_param_.weights_only_model,
+                           hyper_param_.mapped_model,
+                           hyper_param_.sparse_model,
+                           hyper_param_.chunked_model);
+        printf("  Head %d: %s\n", (int)i + 2, head_file.c_str());
+      }
+      // The feature map is used by prediction, and the stale
+      // map of the former model is removed
+      std::string dict_file = hyper_param_.model_file + ".dict";
+      if (hyper_param_.remap_feature) {
+        feature_map_.Serialize(dict_file);
+      } else if (FileExist(dict_file.c_str())) {
+        RemoveFile(dict_file.c_str());
+      }
+      // And the admission counts of the online features
+      std::string admit_file = hyper_param_.model_file + ".admit";
+      if (hyper_param_.admit_count > 1) {
+        admission_.Serialize(admit_file);
+      } else if (FileExist(admit_file.c_str())) {
+        RemoveFile(admit_file.c_str());
+      }
+      // So are the groups of the fields
+      std::string groups_file = hyper_param_.model_file + ".groups";
+      if (!field_groups_.Empty()) {
+        field_groups_.Serialize(groups_file);
+      } else if (FileExist(groups_file.c_str())) {
+        RemoveFile(groups_file.c_str());
+      }
+      // And the pairs of the crosses
+      std::string cross_file = hyper_param_.model_file + ".cross";
+      if (!crosses_.empty()) {
+        std::string line = hyper_param_.cross_fields + "\n";
+        FILE* file = OpenFileOrDie(cross_file.c_str(), "w");
+        WriteDataToDisk(file, line.data(), line.size());
+        Close(file);
+      } else if (FileExist(cross_file.c_str())) {
+        RemoveFile(cross_file.c_str());
+      }
+      if (!hyper_param_.learn_field_pairs.empty()) {
+        learn_field_pairs();
+      }
+      if (!hyper_param_.learn_field_groups.empty()) {
+        learn_field_groups();
+      }
     } else {
       printf("Finish training \n");
     }
   }
 }
 
+// The model of the servers is complete after the barrier
+// of all the workers, and then it is pulled for saving
+void Solver::train_ps(bool assemble) {
+  ScopedPhase train("train");
+  PSWorker worker;
+  worker.Initialize(reader_[0], loss_, metric_, model_, &ps_client_,
+                    hyper_param_.num_epoch, hyper_param_.quiet);
+  if (!worker.Train()) {
+    printf("[Error] Lost the connection of the parameter servers. \n");
+    exit(0);
+  }
+  train.AddRows(worker.NumRows());
+  if (assemble) {
+    model_->Release();
+    model_->Initialize(hyper_param_.score_func,
+                       hyper_param_.loss_func,
+                       hyper_param_.num_feature,
+                       hyper_param_.num_field,
+                       hyper_param_.num_K,
+                       hyper_param_.model_scale,
+                       updater_->LinearStride());
+    if (!ps_client_.PullAll(model_)) {
+      printf("[Error] Cannot pull the model from the parameter "
+             "servers. \n");
+      exit(0);
+    }
+  }
+  ps_client_.Close();
+}
+
 // Inference
 void Solver::start_inference_work() {
-
+  printf("Start to predict ... \n");
+  ScopedPhase phase("predict", true);
+  Predictor pdc;
+  pdc.Initialize(reader_[0], model_, loss_,
+                 hyper_param_.output_file,
+                 hyper_param_.binary_output);
+  for (size_t i = 0; i < ensemble_.size(); ++i) {
+    pdc.AddModel(ensemble_[i].model.get(), ensemble_[i].loss.get(),
+                 StringPrintf("%s.%lu", hyper_param_.output_file.c_str(),
+                              i + 1));
+  }
+  pdc.SetBlend(hyper_param_.blend_output);
+  loss_->ResetLoadStats();
+  index_t count = pdc.Predict();
+  phase.AddRows(count);
+  printf("Finish prediction of %d rows \n"
+         "  Output file: %s \n",
+         count, hyper_param_.output_file.c_str());
+  if (!ensemble_.empty()) {
+    if (hyper_param_.blend_output) {
+      printf("  The mean of %lu models \n", ensemble_.size() + 1);
+    } else {
+      printf("  Output files of -ensemble: %s.1 - %s.%lu \n",
+             hyper_param_.output_file.c_str(),
+             hyper_param_.output_file.c_str(), ensemble_.size());
+    }
+  }
+  const LoadStats& load = loss_->GetLoadStats();
+  printf("%s", load.Report().c_str());
+  LOG(INFO) << "Prediction: straggler (last / mean stop) mean: "
+            << load.straggler() << " max: " << load.straggler_max
+            << " in " << load.loops << " batches, sync time: "
+            << load.wall << " (wake-up: " << load.wakeup
+            << ", stragglers: " << load.tail << ")";
 }
 
 /******************************************************************************
@@ -342,13 +1712,27 @@ void Solver::FinalizeWork() {
   } else {
     finalize_inference_work();
   }
+  if (TraceLog::Enabled()) {
+    TraceLog::Get().Close();
+    printf("Write the trace to %s \n", hyper_param_.trace_file.c_str());
+  }
+  FlushLogger();
 }
 
 void Solver::finalize_train_work() {
+  PhaseTimer::Get().PrintSummary();
+  if (metrics_log_.IsOpen()) {
+    metrics_log_.Write(memory_record());
+    metrics_log_.Write(summary_record());
+    metrics_log_.Close();
+  }
+  // The process 0 removes the files of the shared model
+  shm_.Close();
   LOG(INFO) << "Finalize training work.";
 }
 
 void Solver::finalize_inference_work() {
+  PhaseTimer::Get().PrintSummary();
   LOG(INFO) << "Finalize inference work.";
 }
 
@@ -356,10 +1740,131 @@ void Solver::finalize_inference_work() {
  * The other helper functions                                                 *
  ******************************************************************************/
 
+MemoryStats Solver::GetMemoryStats() const {
+  MemoryStats stats;
+  if (model_ != nullptr) {
+    stats.model_weights = model_->WeightBytes();
+    stats.model_state = model_->StateBytes();
+  }
+  if (loss_ != nullptr) { stats.loss_replicas += loss_->MemorySize(); }
+  if (valid_loss_ != nullptr) {
+    stats.loss_replicas += valid_loss_->MemorySize();
+  }
+  std::vector<Reader*> readers = reader_;
+  if (cv_reader_ != nullptr) { readers.push_back(cv_reader_); }
+  for (size_t i = 0; i < readers.size(); ++i) {
+    stats.data_buffer += readers[i]->BufferSize();
+    stats.data_samples += readers[i]->SampleSize();
+    stats.parser_scratch = std::max(stats.parser_scratch,
+                                    readers[i]->ScratchSize());
+  }
+  stats.thread_pool = Executor::MemorySize();
+  stats.num_workers = Executor::NumWorker();
+  if (valid_pool_ != nullptr) {
+    stats.thread_pool += valid_pool_->MemorySize();
+    stats.num_workers += valid_pool_->size();
+  }
+  stats.thread_stacks = stats.num_workers * Executor::StackSize();
+  return stats;
+}
+
+JsonObject Solver::memory_record() const {
+  MemoryStats stats = GetMemoryStats();
+  JsonObject record;
+  record.AddString("type", "memory")
+        .AddInt("total", stats.Total())
+        .AddInt("model_weights", stats.model_weights)
+        .AddInt("model_state", stats.model_state)
+        .AddInt("loss_replicas", stats.loss_replicas)
+        .AddInt("data_buffer", stats.data_buffer)
+        .AddInt("data_samples", stats.data_samples)
+        .AddInt("parser_scratch", stats.parser_scratch)
+        .AddInt("thread_pool", stats.thread_pool)
+        .AddInt("thread_stacks", stats.thread_stacks)
+        .AddInt("num_workers", stats.num_workers);
+  return record;
+}
+
+// The phases are in the order of their first run
+JsonObject Solver::summary_record() const {
+  std::vector<PhaseStats> phases = PhaseTimer::Get().Phases();
+  std::vector<std::string> items;
+  for (size_t i = 0; i < phases.size(); ++i) {
+    if (phases[i].count == 0) { continue; }
+    JsonObject phase;
+    phase.AddString("path", phases[i].path)
+         .AddInt("count", phases[i].count)
+         .AddReal("total", phases[i].total)
+         .AddReal("max", phases[i].max);
+    if (phases[i].rows > 0) { phase.AddInt("rows", phases[i].rows); }
+    items.push_back(phase.ToString());
+  }
+  uint64 rows = 0, nnz = 0;
+  double time = 0;
+  for (size_t i = 0; i < train_stats_.epoch_rows.size(); ++i) {
+    rows += train_stats_.epoch_rows[i];
+    nnz += train_stats_.epoch_nnz[i];
+    time += train_stats_.epoch_time[i];
+  }
+  JsonObject record;
+  record.AddString("type", "summary")
+        .AddInt("epochs", train_stats_.epoch_rows.size())
+        .AddInt("rows", rows)
+        .AddInt("nnz", nnz)
+        .AddReal("update_time", time)
+        .AddReal("rows_per_sec", time > 0 ? rows / time : 0)
+        .AddReal("parse_time", train_stats_.parse_time)
+        .AddReal("cache_time", train_stats_.cache_time)
+        .AddRaw("phases", JsonArray(items));
+  return record;
+}
+
+// Bytes in KB, MB or GB
+static std::string print_bytes(uint64 bytes) {
+  if (bytes >= GB) {
+    return StringPrintf("%.2f GB", (double) bytes / GB);
+  } else if (bytes >= MB) {
+    return StringPrintf("%.2f MB", (double) bytes / MB);
+  }
+  return StringPrintf("%.2f KB", (double) bytes / KB);
+}
+
+void Solver::show_memory() const {
+  MemoryStats stats = GetMemoryStats();
+  std::string res;
+  SStringPrintf(&res, "Memory usage: %s\n",
+                print_bytes(stats.Total()).c_str());
+  StringAppendF(&res, "    Model weights: %s\n",
+                print_bytes(stats.model_weights).c_str());
+  StringAppendF(&res, "    Model optimizer state: %s\n",
+                print_bytes(stats.model_state).c_str());
+  StringAppendF(&res, "    Loss replicas: %s\n",
+                print_bytes(stats.loss_replicas).c_str());
+  StringAppendF(&res, "    Data buffer: %s\n",
+                print_bytes(stats.data_buffer).c_str());
+  StringAppendF(&res, "    Data samples: %s\n",
+                print_bytes(stats.data_samples).c_str());
+  StringAppendF(&res, "    Parser scratch (peak): %s\n",
+                print_bytes(stats.parser_scratch).c_str());
+  StringAppendF(&res, "    Thread pools: %s\n",
+                print_bytes(stats.thread_pool).c_str());
+  StringAppendF(&res, "    Thread stacks (reserved): %s for %lu workers\n",
+                print_bytes(stats.thread_stacks).c_str(),
+                stats.num_workers);
+  printf("  %s", res.c_str());
+  LOG(INFO) << res;
+}
+
 // Create Reader by a given string
 Reader* Solver::create_reader() {
   Reader* reader;
   std::string str = hyper_param_.on_disk ? "disk" : "memory";
+  if (!hyper_param_.is_train && hyper_param_.stream_predict) {
+    str = "stream";
+  }
+  if (hyper_param_.is_train && hyper_param_.online) {
+    str = "stream";
+  }
   reader = CREATE_READER(str.c_str());
   if (reader == NULL) {
     LOG(ERROR) << "Cannot create reader: " << str;
@@ -367,17 +1872,326 @@ Reader* Solver::create_reader() {
   return reader;
 }
 
-// Create Score by a given string
+// Create Score by a given string. For fm, ffm and hofm,
+// we first try the score specialized on the aligned K of
+// current model, such as "ffm_k8"
 Score* Solver::create_score() {
-  Score* score;
-  score = CREATE_SCORE(hyper_param_.score_func.c_str());
+  Score* score = NULL;
+  // The ffm model of the prediction is known after it is loaded
+  if (hyper_param_.use_gpu) {
+    if (hyper_param_.score_func.compare("ffm") == 0) {
+      score = CREATE_SCORE("ffm_gpu");
+      CHECK_NOTNULL(score);
+      LOG(INFO) << "Use the score on the GPU: ffm_gpu";
+      return score;
+    }
+    printf("[Warning] The --gpu can only be used by ffm, and "
+           "the %s model is scored on the CPU. \n",
+           hyper_param_.score_func.c_str());
+  }
+  // The score and the kernels of --tune-kernel
+  if (!kernel_choice_.score.empty()) {
+    score = CREATE_SCORE(kernel_choice_.score.c_str());
+    CHECK_NOTNULL(score);
+    CHECK(score->SelectKernel(kernel_choice_.isa));
+    return score;
+  }
+  return create_score(hyper_param_.score_func, model_);
+}
+
+Score* Solver::create_score(const std::string& score_func, Model* model) {
+  Score* score = NULL;
+  if (score_func.compare("linear") != 0) {
+    CHECK_NOTNULL(model);
+    std::string name = StringPrintf("%s_k%d",
+                        score_func.c_str(),
+                        model->get_aligned_k());
+    score = CREATE_SCORE(name.c_str());
+    if (score != NULL) {
+      LOG(INFO) << "Use the specialized score: " << name;
+      return score;
+    }
+  }
+  score = CREATE_SCORE(score_func.c_str());
   if (score == NULL) {
-    LOG(ERROR) << "Cannot create score: "
-               << hyper_param_.score_func;
+    LOG(ERROR) << "Cannot create score: " << score_func;
   }
   return score;
 }
 
+// Create Updater by a given string
+Updater* Solver::create_updater() {
+  Updater* updater;
+  // The full-batch solvers (-opt als and lbfgs) keep
+  // the model of adagrad
+  std::string method = hyper_param_.opt_method == "als" ||
+                       hyper_param_.opt_method == "lbfgs" ?
+                       "adagrad" : hyper_param_.opt_method;
+  updater = CREATE_UPDATER(method.c_str());
+  if (updater == NULL) {
+    LOG(ERROR) << "Cannot create updater: "
+               << hyper_param_.opt_method;
+  }
+  return updater;
+}
+
+// The parameters of the updaters of the linear term
+UpdaterParam Solver::updater_param() const {
+  UpdaterParam param;
+  param.learning_rate = hyper_param_.learning_rate;
+  param.regu_lambda = hyper_param_.regu_lambda;
+  param.alpha = hyper_param_.alpha;
+  param.beta = hyper_param_.beta;
+  param.lambda_1 = hyper_param_.lambda_1;
+  param.lambda_2 = hyper_param_.lambda_2;
+  param.sqrt_precision = sqrt_precision();
+  return param;
+}
+
+// The threads and the schedule of the training loss
+void Solver::config_loss(Loss* loss) {
+  if (hyper_param_.thread_mode.compare("local-bias") == 0) {
+    loss->SetThreadMode(kThreadLocalBias);
+  } else if (hyper_param_.thread_mode.compare("replica") == 0) {
+    loss->SetThreadMode(kThreadReplica);
+  }
+  loss->SetGrain(hyper_param_.grain);
+  if (hyper_param_.schedule.compare("steal") == 0) {
+    loss->SetSchedule(kScheduleSteal);
+  } else if (hyper_param_.schedule.compare("dynamic") == 0 ||
+            (hyper_param_.schedule.compare("auto") == 0 &&
+             hyper_param_.grain > 0)) {
+    loss->SetSchedule(kScheduleDynamic);
+  }
+  if (hyper_param_.neg_sample < 1.0) {
+    loss->SetNegWeight(1.0 / hyper_param_.neg_sample);
+  }
+}
+
+// The folds are taken by the jobs in order, and each job builds
+// the Trainer of its fold on a new model and new views of all the
+// folds, so no state is shared by the jobs but the parsed rows
+void Solver::train_cv_parallel() {
+  int num_folds = reader_.size();
+  int jobs = std::min(hyper_param_.cv_jobs, num_folds);
+  size_t threads = std::max(Executor::ThreadNumber(thread_number_) / jobs,
+                            (size_t)1);
+  printf("  Train %d folds at the same time, each by %lu threads \n",
+         jobs, threads);
+  // The views are created in order here, so the shuffle of
+  // each view does not depend on the order of the jobs
+  std::vector<std::vector<std::unique_ptr<Reader>>> views(num_folds);
+  for (int i = 0; i < num_folds; ++i) {
+    for (int j = 0; j < num_folds; ++j) {
+      Reader* fold = new FoldReader(cv_reader_, num_folds, j);
+      fold->SetRowCost(row_cost());
+      fold->Initialize(hyper_param_.train_set_file,
+                       hyper_param_.sample_size);
+      views[i].emplace_back(fold);
+    }
+  }
+  // The test metric of each epoch of each fold
+  std::vector<std::vector<MetricInfo>> result(num_folds);
+  std::atomic<int> next_fold(0);
+  auto run_job = [&](int job) {
+    std::vector<int> cpus;
+    for (size_t t = 0; t < cpus_.size(); ++t) {
+      if ((int)(t * jobs / cpus_.size()) == job) { cpus.push_back(cpus_[t]); }
+    }
+    ThreadPool pool(threads, cpus);
+    for (int i = next_fold++; i < num_folds; i = next_fold++) {
+      ModelReplica replica;
+      create_replica(hyper_param_.model_seed, &pool, &replica);
+      std::vector<Reader*> reader_list;
+      for (int j = 0; j < num_folds; ++j) {
+        reader_list.push_back(views[i][j].get());
+      }
+      Trainer trainer;
+      trainer.Initialize(reader_list,
+                         hyper_param_.num_epoch,
+                         replica.model.get(),
+                         replica.loss.get(),
+                         replica.metric.get(),
+                         hyper_param_.early_stop,
+                         true,  /* The epochs are shown at last */
+                         hyper_param_.stop_window);
+      if (hyper_param_.valid_batches > 0) {
+        trainer.SetValidBatches(hyper_param_.valid_batches);
+      }
+      if (hyper_param_.train_sample > 0) {
+        trainer.SetTrainSample(hyper_param_.train_sample);
+      }
+      if (hyper_param_.loss_sample > 0) {
+        trainer.SetLossSample(hyper_param_.loss_sample);
+      }
+      if (hyper_param_.auto_sample_size) {
+        trainer.SetAutoBatch(hyper_param_.sample_size, kAutoBatchBytes);
+      }
+      if (metrics_log_.IsOpen()) { trainer.SetMetricsLog(&metrics_log_); }
+      trainer.SetEpochCallback([&result, i](int epoch,
+                                            const MetricInfo& te_info) {
+        result[i].push_back(te_info);
+        return false;
+      });
+      trainer.TrainFold(i);
+      printf("  Finish fold %d/%d \n", i + 1, num_folds);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int job = 0; job < jobs; ++job) {
+    workers.emplace_back(run_job, job);
+  }
+  for (size_t job = 0; job < workers.size(); ++job) { workers[job].join(); }
+  // The metric of the fold is the best one of early-stopping,
+  // or the one of the last epoch
+  bool has_metric = hyper_param_.metric.compare("none") != 0;
+  bool larger = metric_->larger_is_better();
+  real_t sum_loss = 0, sum_metric = 0;
+  for (int i = 0; i < num_folds; ++i) {
+    CHECK(!result[i].empty());
+    size_t best = result[i].size() - 1;
+    if (hyper_param_.early_stop && has_metric) {
+      for (size_t n = 0; n < result[i].size(); ++n) {
+        real_t m = result[i][n].metric_val;
+        if (larger ? m > result[i][best].metric_val :
+                     m < result[i][best].metric_val) { best = n; }
+      }
+    }
+    const MetricInfo& info = result[i][best];
+    sum_loss += info.loss_val;
+    sum_metric += info.metric_val;
+    if (has_metric) {
+      printf("Cross-validation: %d/%d: epoch %lu, Test loss %.5f, "
+             "Test %s %.5f \n", i + 1, num_folds, best + 1,
+             info.loss_val, metric_->type().c_str(), info.metric_val);
+    } else {
+      printf("Cross-validation: %d/%d: epoch %lu, Test loss %.5f \n",
+             i + 1, num_folds, best + 1, info.loss_val);
+    }
+  }
+  if (has_metric) {
+    printf("  Average: Test loss %.5f, Test %s %.5f \n",
+           sum_loss / num_folds, metric_->type().c_str(),
+           sum_metric / num_folds);
+  } else {
+    printf("  Average: Test loss %.5f \n", sum_loss / num_folds);
+  }
+}
+
+// The replica has the structure of model_, and it is
+// initialized as a new model, and its updater, score, loss
+// and metric are configured as the ones of model_
+void Solver::create_replica(uint64 seed, ThreadPool* pool,
+                            ModelReplica* replica) {
+  Model* model = new Model();
+  replica->model.reset(model);
+  model->SetNumaPolicy(hyper_param_.numa_policy);
+  model->SetSeed(seed);
+  model->SetHugePages(hyper_param_.huge_page);
+  model->SetLatentLayout(model_->GetLatentLayout());
+  model->Initialize(hyper_param_.score_func,
+                    hyper_param_.loss_func,
+                    model_->GetNumFeature(),
+                    model_->GetNumField(),
+                    hyper_param_.num_K,
+                    hyper_param_.model_scale,
+                    updater_->LinearStride());
+  replica->updater.reset(create_updater());
+  replica->updater->Initialize(updater_param());
+  replica->score.reset(create_score());
+  replica->score->Initialize(hyper_param_.learning_rate,
+                             hyper_param_.regu_lambda,
+                             model);
+  replica->score->SetPrefetchDistance(kernel_choice_.score.empty() ?
+                                      hyper_param_.prefetch_distance :
+                                      kernel_choice_.prefetch);
+  replica->score->SetUpdater(replica->updater.get());
+  replica->score->SetBatchSize(hyper_param_.batch_size);
+  replica->score->SetSqrtPrecision(sqrt_precision());
+  replica->loss.reset(create_loss());
+  if (pool != nullptr) {
+    replica->loss->Initialize(replica->score.get(), hyper_param_.norm, pool);
+  } else {
+    replica->loss->Initialize(replica->score.get(), hyper_param_.norm,
+                              thread_number_, cpus_);
+  }
+  config_loss(replica->loss.get());
+  replica->metric.reset(create_metric());
+  replica->metric->Initialize(hyper_param_.metric, hyper_param_.exact_auc);
+  replica->metric->SetThreadPool(replica->loss->thread_pool());
+}
+
+// Precision of 1 / sqrt() given by -sqrt
+SqrtPrecision Solver::sqrt_precision() const {
+  if (hyper_param_.sqrt_precision.compare("newton") == 0) {
+    return kSqrtNewton;
+  } else if (hyper_param_.sqrt_precision.compare("exact") == 0) {
+    return kSqrtExact;
+  }
+  return kSqrtFast;
+}
+
+// The ranges of 'balanced' and 'steal' are split by the
+// cost of the rows, whose score grows with nnz^2 in ffm
+RowCost Solver::row_cost() const {
+  if (hyper_param_.schedule.compare("balanced") != 0 &&
+      hyper_param_.schedule.compare("steal") != 0) {
+    return kRowCostNone;
+  }
+  if (hyper_param_.score_func.compare("ffm") == 0) {
+    return kRowCostQuadratic;
+  }
+  return kRowCostLinear;
+}
+
+// The options must give the same structure of the model. The
+// weights-only model, e.g., the checkpoint of -ckpt, has no
+// gradient cache, and the training starts with new caches
+void Solver::check_pre_model(Model& pre_model) {
+  const char* filename = hyper_param_.pre_model_file.c_str();
+  bool weights_only = pre_model.IsWeightsOnly();
+  if (weights_only && (pre_model.IsSparse() ||
+      pre_model.GetLatentType() != kLatentFP32)) {
+    printf("[Error] The model %s is a sparse or quantized weights-only "
+           "model, which cannot warm-start the training. \n", filename);
+    exit(0);
+  }
+  if (weights_only) {
+    printf("[Warning] The model %s is weights-only, and the training "
+           "starts with new gradient caches. \n", filename);
+  }
+  if (pre_model.GetScoreFunction() != hyper_param_.score_func ||
+      pre_model.GetLossFunction() != hyper_param_.loss_func) {
+    printf("[Error] The model %s is trained by -s '%s' and the loss "
+           "'%s', which are different from the current task. \n",
+           filename, pre_model.GetScoreFunction().c_str(),
+           pre_model.GetLossFunction().c_str());
+    exit(0);
+  }
+  if (hyper_param_.score_func.compare("linear") != 0 &&
+      pre_model.GetNumK() != hyper_param_.num_K) {
+    printf("[Error] The model %s has -k %d, which is different from "
+           "-k %d. \n", filename, pre_model.GetNumK(),
+           hyper_param_.num_K);
+    exit(0);
+  }
+  if (!weights_only &&
+      pre_model.GetLinearStride() != updater_->LinearStride()) {
+    printf("[Error] The model %s is trained by another -opt method, "
+           "whose gradient caches cannot be used. \n", filename);
+    exit(0);
+  }
+  // The -admit model has the OOV feature after the buckets
+  if (hyper_param_.hash_bucket > 0 &&
+      pre_model.GetNumFeature() != hyper_param_.num_feature) {
+    printf("[Error] The model %s has %d features, which is different "
+           "from -hash %d%s. \n", filename, pre_model.GetNumFeature(),
+           hyper_param_.hash_bucket,
+           hyper_param_.admit_count > 1 ? " (and the OOV of -admit)" : "");
+    exit(0);
+  }
+}
+
 // Create Loss by a given string
 Loss* Solver::create_loss() {
   Loss* loss;
@@ -396,36 +2210,6 @@ Metric* Solver::create_metric() {
   return metric;
 }
 
-// Find max feature in a data matrix
-index_t Solver::find_max_feature(DMatrix* matrix, int num_samples) {
-  index_t res = 0;
-  for (int i = 0; i < num_samples; ++i) {
-    SparseRow* row = matrix->row[i];
-    for (SparseRow::const_iterator iter = row->begin();
-         iter != row->end(); ++iter) {
-      if (iter->feat_id > res) {
-        res = iter->feat_id;
-      }
-    }
-  }
-  return res;
-}
-
-// Find max field in a data matrix
-index_t Solver::find_max_field(DMatrix* matrix, int num_samples) {
-  index_t res = 0;
-  for (int i = 0; i < num_samples; ++i) {
-    SparseRow* row = matrix->row[i];
-    for (SparseRow::const_iterator iter = row->begin();
-         iter != row->end(); ++iter) {
-      if (iter->field_id > res) {
-        res = iter->field_id;
-      }
-    }
-  }
-  return res;
-}
-
 // Get host name
 std::string Solver::get_host_name() {
   struct utsname buf;
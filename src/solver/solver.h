@@ -24,20 +24,65 @@ of the xLearn.
 #ifndef XLEARN_SOLVER_SOLVER_H_
 #define XLEARN_SOLVER_SOLVER_H_
 
+#include <memory>
+
 #include "src/base/common.h"
 #include "src/data/hyper_parameters.h"
+#include "src/data/admission_filter.h"
 #include "src/data/data_structure.h"
 #include "src/data/model_parameters.h"
+#include "src/data/field_groups.h"
+#include "src/distributed/ps_client.h"
+#include "src/distributed/ring_allreduce.h"
+#include "src/distributed/shared_model.h"
 #include "src/reader/reader.h"
 #include "src/reader/parser.h"
 #include "src/reader/file_splitor.h"
+#include "src/score/kernel_tuner.h"
 #include "src/score/score_function.h"
 #include "src/loss/loss.h"
 #include "src/loss/metric.h"
 #include "src/solver/checker.h"
+#include "src/solver/inference.h"
+#include "src/solver/metrics_log.h"
 #include "src/solver/trainer.h"
 
 namespace xLearn {
+//------------------------------------------------------------------------------
+// MemoryStats is the bytes allocated by the subsystems of the Solver, which
+// are printed at the end of Initialize(). The model is split into the weights
+// and the gradient caches of the updater. The replicas of the Loss are
+// created by the first gradient pass, and the scratch of the Parser is the
+// peak of the parsing, which has been released.
+//------------------------------------------------------------------------------
+struct MemoryStats {
+  /* Weights of w, v and b, and the gradient caches */
+  uint64 model_weights = 0;
+  uint64 model_state = 0;
+  /* Replicas and per-thread partials of the Loss */
+  uint64 loss_replicas = 0;
+  /* The data buffers of the Readers (see Reader::BufferSize())
+  and the matrices of the samples */
+  uint64 data_buffer = 0;
+  uint64 data_samples = 0;
+  /* Peak scratch of parsing the txt files */
+  uint64 parser_scratch = 0;
+  /* Structures of the thread pools, and the stacks that are
+  reserved for the workers, which are not in Total() */
+  uint64 thread_pool = 0;
+  uint64 thread_stacks = 0;
+  size_t num_workers = 0;
+
+  uint64 Total() const {
+    return model_weights + model_state + loss_replicas + data_buffer +
+           data_samples + parser_scratch + thread_pool;
+  }
+};
+
+// The exit code of the training that is stopped by the preemption
+// and saves its state (see --resume), which is the one of SIGTERM
+const int kExitPreempted = 143;
+
 //------------------------------------------------------------------------------
 // Solver is entry class of xLearn, which can perform training or inference
 // tasks. There are three important functions in this class, including the
@@ -71,42 +116,169 @@ class Solver {
   // Finalize the xLearn environment
   void FinalizeWork();
 
+  // The time of reading the data and of each epoch
+  // of the training given by StartWork()
+  const TrainStats& GetTrainStats() const { return train_stats_; }
+
+  // True if the training is stopped by the preemption of --resume
+  bool Preempted() const { return preempted_; }
+
+  // The bytes allocated by the subsystems at the time
+  // of calling
+  MemoryStats GetMemoryStats() const;
+
  protected:
   // Main classes used by Solver
   xLearn::HyperParam hyper_param_;
   xLearn::Checker checker_;
-  xLearn::Model *model_;
+  xLearn::Model *model_ = nullptr;
   /* One Reader corresponds one file */
   std::vector<xLearn::Reader*> reader_;
+  /* The training set of in-memory cross-validation, and
+  the reader_ are its folds */
+  xLearn::InmemReader* cv_reader_ = nullptr;
   xLearn::FileSpliter splitor_;
-  xLearn::Score* score_;
-  xLearn::Loss* loss_;
-  xLearn::Metric* metric_;
+  xLearn::Score* score_ = nullptr;
+  xLearn::Updater* updater_ = nullptr;
+  xLearn::Loss* loss_ = nullptr;
+  xLearn::Metric* metric_ = nullptr;
+  /* The loss and metric of the asynchronous validation, and
+  its own pool, which is not one of the shared pools */
+  xLearn::Loss* valid_loss_ = nullptr;
+  xLearn::Metric* valid_metric_ = nullptr;
+  std::unique_ptr<xLearn::ThreadPool> valid_pool_;
+  /* Dense ids of the features given by --remap, which
+  is stored alongside the model file */
+  xLearn::FeatureMap feature_map_;
+  /* The admission of the online features given by -admit,
+  which is stored alongside the model file */
+  xLearn::AdmissionFilter admission_;
+  /* Dense ids of the features in the predict file
+  given by --lazy-model */
+  xLearn::FeatureMap input_map_;
+  /* Groups of the fields given by -field_groups, which
+  are stored alongside the model file */
+  xLearn::FieldGroups field_groups_;
+  /* Pairs of the fields of the hashed crosses given by
+  -cross, which are stored alongside the model file */
+  std::vector<xLearn::FieldCross> crosses_;
+  /* Statistics of the training */
+  TrainStats train_stats_;
+  /* The training is stopped by the preemption */
+  bool preempted_ = false;
+  /* Time since the start of the job, which counts in
+  the time budget of the training */
+  Timer job_timer_;
+  /* The NDJSON metrics given by -metrics */
+  MetricsLog metrics_log_;
+  /* Number of threads and the CPUs they are pinned to */
+  size_t thread_number_;
+  std::vector<int> cpus_;
+  /* The client of the parameter servers given by -ps */
+  xLearn::PSClient ps_client_;
+  /* The ring of the data-parallel nodes given by -ring */
+  xLearn::RingAllReduce ring_;
+  /* The model in the shared memory given by -shm */
+  xLearn::SharedModel shm_;
+  /* The kernels chosen by --tune-kernel, whose score
+  is empty if they are not tuned */
+  xLearn::KernelChoice kernel_choice_;
+
+  /* A model of the structure of model_ with its own updater,
+  score, loss and metric, e.g., the head k > 1 of -heads, or
+  the model of a fold of the parallel --cv */
+  struct ModelReplica {
+    std::unique_ptr<xLearn::Model> model;
+    std::unique_ptr<xLearn::Updater> updater;
+    std::unique_ptr<xLearn::Score> score;
+    std::unique_ptr<xLearn::Loss> loss;
+    std::unique_ptr<xLearn::Metric> metric;
+  };
+  /* The models of -ensemble, which score the batches
+  of the prediction after model_ */
+  std::vector<ModelReplica> ensemble_;
 
   // Create object by name
   xLearn::Reader* create_reader();
   xLearn::Score* create_score();
+  // The specialized score of the K of the model, or the
+  // generic score of the function if there is none
+  xLearn::Score* create_score(const std::string& score_func,
+                              xLearn::Model* model);
+  xLearn::Updater* create_updater();
   xLearn::Loss* create_loss();
   xLearn::Metric* create_metric();
+  // Precision of 1 / sqrt() in adagrad
+  SqrtPrecision sqrt_precision() const;
+  // The parameters of the updaters, and the
+  // configuration of the training losses
+  xLearn::UpdaterParam updater_param() const;
+  void config_loss(xLearn::Loss* loss);
+  // Create a new model of the seed, whose loss uses the
+  // pool, or the threads of the solver if it is nullptr
+  void create_replica(uint64 seed, ThreadPool* pool,
+                      ModelReplica* replica);
+  // Cost model of the rows for the schedule
+  RowCost row_cost() const;
+  // Exit if the former model cannot warm-start the model
+  void check_pre_model(Model& pre_model);
 
   // Initialize function
   void init_train();
   void init_predict();
+  // Compact the model to the features of the predict file
+  void load_input_features(xLearn::FeatureMap& counter);
+  // Apply the delta files of -delta to the model
+  void apply_deltas();
+  // Load the models of -ensemble, whose losses use
+  // the threads of loss_
+  void init_ensemble();
   void checker(int argc, char* argv[]);
   void init_log();
+  void init_trace();
+  void init_threads();
+  // Connect to the parameter servers, which gives
+  // the features and fields of the global model
+  void init_ps_client();
+  // Connect the nodes of the ring, which agree on the
+  // features and fields of the model
+  void init_ring();
+  // Join the processes of the shared model, which agree
+  // on the max structure of the model
+  void init_shm();
+  // Print the hot set of the parameter file
+  void print_resident();
+  // Find the (feature, field) pairs of the sparse latent factor
+  void init_latent_pairs();
+  // Give the latent vectors of each field the K of -field_k
+  void init_field_k();
+  // Choose the kernels of the score by timing them on the
+  // first rows of the training set, or by the cache
+  void tune_kernel();
+  // Write the strongest field pairs of the trained model
+  void learn_field_pairs();
+  // Write the groups of the fields clustered from the model
+  void learn_field_groups();
+  // Print the bytes of GetMemoryStats()
+  void show_memory() const;
+  // The "memory" and "summary" records of -metrics
+  JsonObject memory_record() const;
+  JsonObject summary_record() const;
 
   // Start function
   void start_train_work();
   void start_inference_work();
+  // Train as a worker of the parameter servers, and the
+  // global model is pulled into model_ if assemble is true
+  void train_ps(bool assemble);
+  // Train the folds of the in-memory cross-validation
+  // by the parallel jobs of -cv_jobs
+  void train_cv_parallel();
 
   // Finalize funcrion
   void finalize_train_work();
   void finalize_inference_work();
 
-  // Read problem and set the feature size and field size
-  index_t find_max_feature(DMatrix* matrix, int num_samples);
-  index_t find_max_field(DMatrix* matrix, int num_samples);
-
   // Used by log file suffix
   std::string get_host_name();
   std::string get_user_name();
@@ -0,0 +1,88 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the training of solver.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/data/model_parameters.h"
+#include "src/solver/solver.h"
+
+namespace xLearn {
+
+const std::string kTrainFile = "./test_solver_train.txt";
+const std::string kModelFile = "./test_solver_model.bin";
+
+// Train by the command line of xlearn_train
+static void train(std::vector<std::string> args) {
+  args.insert(args.begin(), "xlearn_train");
+  std::vector<char*> argv;
+  for (size_t i = 0; i < args.size(); ++i) {
+    argv.push_back(const_cast<char*>(args[i].c_str()));
+  }
+  Solver solver;
+  solver.SetTrain();
+  solver.Initialize(argv.size(), argv.data());
+  solver.StartWork();
+  solver.FinalizeWork();
+}
+
+// The weight of the feature of the model file
+static real_t weight(const std::string& filename, index_t feat) {
+  Model model(filename);
+  return model.GetParameter_w()[feat * model.GetLinearStride()];
+}
+
+// The rows of feature 1, 2 and 3 are the stages 0 (no click),
+// 1 (click) and 2 (conversion) of a funnel. Head 1 is the model
+// of the labels y >= 1, and head 2 of y >= 2 is saved to its file
+TEST(SOLVER_TEST, Train_heads) {
+  // The log file of the solver is named by the user
+  setenv("USER", "test", 0);
+  FILE* file = OpenFileOrDie(kTrainFile.c_str(), "w");
+  for (int i = 0; i < 300; ++i) {
+    fprintf(file, "%d %d:1\n", i % 3, i % 3 + 1);
+  }
+  Close(file);
+  train({ kTrainFile, "-s", "0", "-heads", "2", "-m", kModelFile,
+          "-e", "20", "-nthread", "1", "-l", "/tmp/test_solver_log",
+          "--quiet" });
+  std::string head_file = kModelFile + ".head2";
+  ASSERT_TRUE(FileExist(head_file.c_str()));
+  // Head 1: the click and the conversion are positive
+  EXPECT_LT(weight(kModelFile, 1), 0);
+  EXPECT_GT(weight(kModelFile, 2), 0);
+  EXPECT_GT(weight(kModelFile, 3), 0);
+  // Head 2: only the conversion is positive
+  EXPECT_LT(weight(head_file, 1), 0);
+  EXPECT_LT(weight(head_file, 2), 0);
+  EXPECT_GT(weight(head_file, 3), 0);
+  RemoveFile(kTrainFile.c_str());
+  RemoveFile((kTrainFile + ".bin").c_str());
+  RemoveFile((kTrainFile + ".bin.range").c_str());
+  RemoveFile(kModelFile.c_str());
+  RemoveFile(head_file.c_str());
+}
+
+}  // namespace xLearn
@@ -0,0 +1,412 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the library API of the training.
+*/
+
+#include "src/solver/train_api.h"
+
+#include <vector>
+
+#include "src/base/split_string.h"
+#include "src/base/stringprintf.h"
+#include "src/loss/loss.h"
+#include "src/loss/metric.h"
+#include "src/score/score_function.h"
+#include "src/score/updater.h"
+
+namespace xLearn {
+
+// The bound of the bytes of a batch of the
+// tuned sample_size (see BatchTuner)
+static const uint64 kAutoBatchBytes = 64ULL << 20;
+
+// Set the error and return the code
+static int fail(int code, const std::string& message, std::string* error) {
+  if (error != nullptr) { *error = message; }
+  return code;
+}
+
+// The options of the modes that are not supported by the library
+static bool check_mode(const HyperParam& param, std::string* error) {
+  const char* option = nullptr;
+  if (!param.is_train) {
+    option = "prediction";
+  } else if (param.on_disk) {
+    option = "--disk";
+  } else if (param.online) {
+    option = "--online";
+  } else if (param.cross_validation) {
+    option = "--cv";
+  } else if (!param.ps_servers.empty()) {
+    option = "-ps";
+  } else if (!param.ring_nodes.empty()) {
+    option = "-ring";
+  } else if (!param.shm_name.empty()) {
+    option = "-shm";
+  } else if (param.remap_feature || param.min_count > 0) {
+    option = "--remap";
+  } else if (!param.pre_model_file.empty()) {
+    option = "-pre";
+  } else if (!param.param_file.empty()) {
+    option = "-param_file";
+  } else if (param.checkpoint_epoch > 0 || param.checkpoint_minute > 0) {
+    option = "-ckpt";
+  } else if (param.async_valid > 0) {
+    option = "-async_valid";
+  } else if (!param.metrics_file.empty() || !param.trace_file.empty()) {
+    option = "-metrics_file";
+  } else if (param.sparse_latent || !param.learn_field_pairs.empty() ||
+             !param.field_groups_file.empty() ||
+             !param.learn_field_groups.empty()) {
+    option = "--sparse-latent";
+  } else if (!param.field_k.empty()) {
+    option = "-field_k";
+  } else if (param.admit_count > 1) {
+    option = "-admit";
+  } else if (param.neg_sample < 1.0 || param.dedup_rows) {
+    option = "-neg_sample";
+  } else if (param.part_decay < 1.0) {
+    option = "-part_decay";
+  }
+  if (option != nullptr) {
+    *error = StringPrintf("The library does not support %s", option);
+    return false;
+  }
+  return true;
+}
+
+// The values are checked as the Checker does, since
+// the HyperParam may not be given by the command line
+static bool check_value(const HyperParam& param, std::string* error) {
+  if (param.score_func != "linear" && param.score_func != "fm" &&
+      param.score_func != "ffm") {
+    *error = "Unknow score function: " + param.score_func;
+    return false;
+  }
+  if (param.num_epoch <= 0 || param.sample_size <= 0 ||
+      param.num_K <= 0 || param.learning_rate <= 0 ||
+      param.regu_lambda < 0 || param.stop_window <= 0) {
+    *error = "Illegal -e, -sample_size, -k, -r, -b or -stop_window";
+    return false;
+  }
+  std::vector<std::string> names;
+  SplitStringUsing(param.metric, ",", &names);
+  if (names.empty()) {
+    *error = "Unknow metric: " + param.metric;
+    return false;
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (!Metric::IsMetric(names[i])) {
+      *error = "Unknow metric: " + names[i];
+      return false;
+    }
+  }
+  return true;
+}
+
+// The options of the Readers, as the setup of the Solver
+static void setup_reader(const HyperParam& param, ThreadPool* pool,
+                         Reader* reader) {
+  reader->SetCompact(param.compact_data);
+  reader->SetSortRows(param.sort_nodes);
+  reader->SetDense(param.dense_data);
+  reader->SetCompress(param.compress_cache);
+  reader->SetShuffleBlock(param.shuffle_block);
+  reader->SetHashBucket(param.hash_bucket);
+  if (!param.cross_fields.empty()) {
+    std::vector<FieldCross> crosses;
+    CHECK(ParseCrosses(param.cross_fields, &crosses));
+    reader->SetCrosses(crosses);
+  }
+  reader->SetFullHash(param.full_hash_cache);
+  if (!param.cache_dir.empty()) {
+    reader->SetCacheDir(param.cache_dir, (uint64)param.cache_mb << 20);
+  }
+  reader->SetHugePages(param.huge_page.compare("none") != 0);
+  reader->SetThreadNumber(pool->size());
+  reader->SetThreadPool(pool);
+}
+
+int Load(const HyperParam& param, ThreadPool* pool,
+         DataSource* data, std::string* error) {
+  std::string message;
+  if (pool == nullptr || data == nullptr) {
+    return fail(kTrainErrArgument, "No thread pool or DataSource", error);
+  }
+  if (param.train_set_file.empty()) {
+    return fail(kTrainErrArgument, "No training set", error);
+  }
+  if (param.on_disk || param.online || !param.ps_servers.empty()) {
+    return fail(kTrainErrArgument,
+                "The library only loads the in-memory data", error);
+  }
+  std::vector<std::string> files(1, param.train_set_file);
+  if (!param.test_set_file.empty()) {
+    files.push_back(param.test_set_file);
+  }
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!Reader::CheckFile(files[i], param.hash_bucket,
+                           param.dense_data, &message)) {
+      return fail(kTrainErrData, message, error);
+    }
+  }
+  data->train_.reset();
+  data->test_.reset();
+  std::vector<std::unique_ptr<Reader>> readers;
+  for (size_t i = 0; i < files.size(); ++i) {
+    readers.emplace_back(new InmemReader());
+    setup_reader(param, pool, readers[i].get());
+    readers[i]->Initialize(files[i], param.sample_size);
+  }
+  data->hash_bucket_ = param.hash_bucket;
+  data->train_ = std::move(readers[0]);
+  if (readers.size() > 1) { data->test_ = std::move(readers[1]); }
+  return kTrainOK;
+}
+
+// The offsets should be in order, and the field and feature
+// ids are checked by the model of the training
+static bool check_rows(const RowData& rows, std::string* error) {
+  if (rows.offset == nullptr || rows.label == nullptr ||
+      rows.num_row == 0) {
+    *error = "No rows";
+    return false;
+  }
+  if (rows.offset[0] != 0 ||
+      (rows.node == nullptr && rows.offset[rows.num_row] > 0)) {
+    *error = "Illegal offset of the rows";
+    return false;
+  }
+  for (index_t i = 0; i < rows.num_row; ++i) {
+    if (rows.offset[i+1] < rows.offset[i]) {
+      *error = StringPrintf("Illegal offset of the row %u", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+int LoadRows(const HyperParam& param, ThreadPool* pool,
+             const RowData& train, const RowData* test,
+             DataSource* data, std::string* error) {
+  std::string message;
+  if (pool == nullptr || data == nullptr) {
+    return fail(kTrainErrArgument, "No thread pool or DataSource", error);
+  }
+  if (param.hash_bucket > 0 || param.sample_size <= 0) {
+    return fail(kTrainErrArgument,
+                "Illegal -hash or -sample_size of the rows", error);
+  }
+  std::vector<const RowData*> sets(1, &train);
+  if (test != nullptr) { sets.push_back(test); }
+  for (size_t i = 0; i < sets.size(); ++i) {
+    if (!check_rows(*sets[i], &message)) {
+      return fail(kTrainErrData, message, error);
+    }
+  }
+  data->train_.reset();
+  data->test_.reset();
+  std::vector<std::unique_ptr<Reader>> readers;
+  for (size_t i = 0; i < sets.size(); ++i) {
+    InmemReader* reader = new InmemReader();
+    readers.emplace_back(reader);
+    // The empty nodes are an empty array of the caller
+    static const Node kNoNode = Node();
+    const Node* node = sets[i]->node != nullptr ?
+                       sets[i]->node : &kNoNode;
+    reader->SetThreadNumber(pool->size());
+    reader->SetThreadPool(pool);
+    reader->InitializeRows(node, sets[i]->offset, sets[i]->label,
+                           sets[i]->num_row, param.sample_size);
+  }
+  data->hash_bucket_ = 0;
+  data->train_ = std::move(readers[0]);
+  if (readers.size() > 1) { data->test_ = std::move(readers[1]); }
+  return kTrainOK;
+}
+
+int ShareData(const HyperParam& param, ThreadPool* pool,
+              const DataSource& source, DataSource* view,
+              std::string* error) {
+  if (pool == nullptr || view == nullptr || view == &source) {
+    return fail(kTrainErrArgument, "No thread pool or view", error);
+  }
+  if (!source.IsLoaded()) {
+    return fail(kTrainErrState, "The DataSource is not loaded", error);
+  }
+  if (param.sample_size <= 0) {
+    return fail(kTrainErrArgument, "Illegal -sample_size", error);
+  }
+  std::vector<Reader*> sets(1, source.TrainSet());
+  if (source.TestSet() != nullptr) { sets.push_back(source.TestSet()); }
+  view->train_.reset();
+  view->test_.reset();
+  std::vector<std::unique_ptr<Reader>> readers;
+  for (size_t i = 0; i < sets.size(); ++i) {
+    const InmemReader* rows = dynamic_cast<const InmemReader*>(sets[i]);
+    CHECK_NOTNULL(rows);
+    // The only fold is all the rows
+    readers.emplace_back(new FoldReader(rows, 1, 0));
+    readers[i]->SetThreadNumber(pool->size());
+    readers[i]->SetThreadPool(pool);
+    readers[i]->Initialize("<shared>", param.sample_size);
+  }
+  view->hash_bucket_ = source.HashBucket();
+  view->train_ = std::move(readers[0]);
+  if (readers.size() > 1) { view->test_ = std::move(readers[1]); }
+  return kTrainOK;
+}
+
+int Train(const HyperParam& param, DataSource& data,
+          ThreadPool* pool, Model* model,
+          TrainStats* stats, std::string* error,
+          const std::function<bool(int, const MetricInfo&)>& on_epoch) {
+  std::string message;
+  if (pool == nullptr || model == nullptr) {
+    return fail(kTrainErrArgument, "No thread pool or model", error);
+  }
+  if (!check_mode(param, &message) || !check_value(param, &message)) {
+    return fail(kTrainErrArgument, message, error);
+  }
+  if (!data.IsLoaded()) {
+    return fail(kTrainErrState, "The DataSource is not loaded", error);
+  }
+  if (param.hash_bucket != data.HashBucket()) {
+    return fail(kTrainErrState,
+                "The DataSource is loaded by another -hash", error);
+  }
+  std::unique_ptr<Loss> loss(CREATE_LOSS(param.loss_func.c_str()));
+  if (loss == nullptr) {
+    return fail(kTrainErrArgument,
+                "Unknow loss function: " + param.loss_func, error);
+  }
+  std::unique_ptr<Updater> updater(
+    CREATE_UPDATER(param.opt_method.c_str()));
+  if (updater == nullptr) {
+    return fail(kTrainErrArgument,
+                "Unknow optimization method: " + param.opt_method, error);
+  }
+  // The readers are shared by the trainings, so the options of
+  // the former training are replaced
+  std::vector<Reader*> readers(1, data.TrainSet());
+  if (data.TestSet() != nullptr) { readers.push_back(data.TestSet()); }
+  RowCost cost = kRowCostNone;
+  if (param.schedule == "balanced" || param.schedule == "steal") {
+    cost = param.score_func == "ffm" ? kRowCostQuadratic : kRowCostLinear;
+  }
+  DataStats data_stats;
+  for (size_t i = 0; i < readers.size(); ++i) {
+    readers[i]->SetBatchSize(param.sample_size);
+    readers[i]->SetRowCost(cost);
+    data_stats.Merge(readers[i]->Stats());
+  }
+  index_t num_feature = param.hash_bucket > 0 ?
+                        param.hash_bucket : data_stats.max_feat + 1;
+  index_t num_field = param.score_func == "ffm" ?
+                      data_stats.max_field + 1 : 0;
+  // Init model
+  SqrtPrecision precision = kSqrtFast;
+  if (param.sqrt_precision == "newton") {
+    precision = kSqrtNewton;
+  } else if (param.sqrt_precision == "exact") {
+    precision = kSqrtExact;
+  }
+  UpdaterParam updater_param;
+  updater_param.learning_rate = param.learning_rate;
+  updater_param.regu_lambda = param.regu_lambda;
+  updater_param.alpha = param.alpha;
+  updater_param.beta = param.beta;
+  updater_param.lambda_1 = param.lambda_1;
+  updater_param.lambda_2 = param.lambda_2;
+  updater_param.sqrt_precision = precision;
+  updater->Initialize(updater_param);
+  LatentLayout layout = kLayoutInterleaved;
+  ParseLatentLayout(param.latent_layout, &layout);
+  model->SetSeed(param.model_seed);
+  model->SetLatentLayout(layout);
+  model->Initialize(param.score_func, param.loss_func,
+                    num_feature, num_field, param.num_K,
+                    param.model_scale, updater->LinearStride());
+  // Init score function, the specialized one of the K first
+  std::unique_ptr<Score> score;
+  if (param.score_func != "linear") {
+    std::string name = StringPrintf("%s_k%d", param.score_func.c_str(),
+                                    model->get_aligned_k());
+    score.reset(CREATE_SCORE(name.c_str()));
+  }
+  if (score == nullptr) {
+    score.reset(CREATE_SCORE(param.score_func.c_str()));
+  }
+  CHECK_NOTNULL(score.get());
+  score->Initialize(param.learning_rate, param.regu_lambda, model);
+  score->SetPrefetchDistance(param.prefetch_distance);
+  score->SetUpdater(updater.get());
+  score->SetBatchSize(param.batch_size);
+  score->SetSqrtPrecision(precision);
+  // Init loss function
+  loss->Initialize(score.get(), param.norm, pool);
+  if (param.thread_mode == "local-bias") {
+    loss->SetThreadMode(kThreadLocalBias);
+  } else if (param.thread_mode == "replica") {
+    loss->SetThreadMode(kThreadReplica);
+  }
+  loss->SetGrain(param.grain);
+  if (param.schedule == "steal") {
+    loss->SetSchedule(kScheduleSteal);
+  } else if (param.schedule == "dynamic" ||
+            (param.schedule == "auto" && param.grain > 0)) {
+    loss->SetSchedule(kScheduleDynamic);
+  }
+  // Init metric
+  Metric metric;
+  metric.Initialize(param.metric, param.exact_auc);
+  metric.SetThreadPool(pool);
+  // Train
+  Trainer trainer;
+  trainer.Initialize(readers, param.num_epoch, model, loss.get(),
+                     &metric, param.early_stop, param.quiet,
+                     param.stop_window);
+  if (param.valid_batches > 0) {
+    trainer.SetValidBatches(param.valid_batches);
+  }
+  if (param.train_sample > 0) {
+    trainer.SetTrainSample(param.train_sample);
+  }
+  if (param.loss_sample > 0) {
+    trainer.SetLossSample(param.loss_sample);
+  }
+  if (param.auto_sample_size) {
+    trainer.SetAutoBatch(param.sample_size, kAutoBatchBytes);
+  }
+  if (on_epoch) { trainer.SetEpochCallback(on_epoch); }
+  trainer.Train();
+  // The deferred regular of the lazy updater
+  updater->Flush(model->GetParameter_w(), model->GetNumFeature());
+  if (stats != nullptr) {
+    *stats = trainer.Stats();
+    for (size_t i = 0; i < readers.size(); ++i) {
+      stats->parse_time += readers[i]->ParseTime();
+      stats->cache_time += readers[i]->CacheTime();
+    }
+  }
+  return kTrainOK;
+}
+
+}  // namespace xLearn
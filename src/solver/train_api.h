@@ -0,0 +1,171 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the library API of the training, which can be
+embedded in a long-lived process.
+*/
+
+#ifndef XLEARN_SOLVER_TRAIN_API_H_
+#define XLEARN_SOLVER_TRAIN_API_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/hyper_parameters.h"
+#include "src/data/model_parameters.h"
+#include "src/reader/reader.h"
+#include "src/solver/trainer.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The library API trains a model in the process of the caller, e.g., a
+// worker that runs many trainings of the same data one after another. The
+// Solver is driven by the command line and exits the program on the errors,
+// while here the HyperParam is checked before anything is done, and the
+// errors are returned as the codes with a message:
+//
+//   ThreadPool pool(8);
+//   DataSource data;
+//   std::string error;
+//   if (Load(param, &pool, &data, &error) != kTrainOK) {
+//     ... error ...
+//   }
+//   /* The parsed data is used by many trainings */
+//   for (...) {
+//     Model model;
+//     TrainStats stats;
+//     if (Train(param, data, &pool, &model, &stats, &error) != kTrainOK) {
+//       ... error ...
+//     }
+//     model.Serialize("/tmp/model.bin");
+//   }
+//
+// There is no global state: the caller owns the thread pool, the data and
+// the model, which should outlive the calls, and the trainings of different
+// DataSources (and pools) can run at the same time. A DataSource is used by
+// one training at a time, and the concurrent trainings of the same data use
+// the views of it, which share its parsed rows (see ShareData):
+//
+//   DataSource view;
+//   ShareData(param, &job_pool, data, &view, &error);
+//   Train(param, view, &job_pool, &model, &stats, &error);
+// The in-memory training of linear, fm and ffm is
+// supported, and the options of the other modes (e.g., --disk, --online, the
+// distributed training, the checkpoints and the log files) are rejected.
+//------------------------------------------------------------------------------
+
+/* Error codes */
+enum TrainStatus {
+  kTrainOK = 0,
+  /* Illegal or unsupported HyperParam */
+  kTrainErrArgument = -1,
+  /* The data cannot be read */
+  kTrainErrData = -2,
+  /* The data is not loaded, or loaded by other options */
+  kTrainErrState = -3
+};
+
+// The rows in the memory of the caller, in the CSR layout: the nodes
+// of the i-th row are node[offset[i], offset[i+1]), and the offset has
+// num_row + 1 elements. The arrays of another language can be used
+// in place if they have this layout (see c_train_api.h)
+struct RowData {
+  const Node* node = nullptr;
+  const uint64* offset = nullptr;
+  const real_t* label = nullptr;
+  index_t num_row = 0;
+};
+
+// The parsed training set and the optional test set
+// (the validation set) of the in-memory training
+class DataSource {
+ public:
+  DataSource() { }
+  ~DataSource() { }
+
+  // True after a successful Load()
+  bool IsLoaded() const { return train_ != nullptr; }
+
+  Reader* TrainSet() const { return train_.get(); }
+  Reader* TestSet() const { return test_.get(); }
+
+  // The hash_bucket of the parsing, which is the
+  // number of features of the model if it is > 0
+  index_t HashBucket() const { return hash_bucket_; }
+
+ protected:
+  std::unique_ptr<Reader> train_;
+  std::unique_ptr<Reader> test_;
+  index_t hash_bucket_ = 0;
+
+  friend int Load(const HyperParam& param, ThreadPool* pool,
+                  DataSource* data, std::string* error);
+  friend int LoadRows(const HyperParam& param, ThreadPool* pool,
+                      const RowData& train, const RowData* test,
+                      DataSource* data, std::string* error);
+  friend int ShareData(const HyperParam& param, ThreadPool* pool,
+                       const DataSource& source, DataSource* view,
+                       std::string* error);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DataSource);
+};
+
+// Parse the train_set_file (and the test_set_file) of the param
+// by the threads of the pool. The options of the parsing, e.g.,
+// hash_bucket, dense_data, compact_data and cache_dir, are used,
+// and the binary cache is used as the command line does
+int Load(const HyperParam& param, ThreadPool* pool,
+         DataSource* data, std::string* error);
+
+// Use the rows of the caller as the training set (and the test
+// set, which can be nullptr). The nodes are not copied, and they
+// should outlive the DataSource. The features are not hashed, so
+// the hash_bucket should be 0
+int LoadRows(const HyperParam& param, ThreadPool* pool,
+             const RowData& train, const RowData* test,
+             DataSource* data, std::string* error);
+
+// Make the view of the loaded source, whose Readers (see FoldReader)
+// share the rows of the source and keep their own order and batches,
+// so the trainings of the views can run at the same time by their own
+// pools. The source should outlive the view and is not changed
+int ShareData(const HyperParam& param, ThreadPool* pool,
+              const DataSource& source, DataSource* view,
+              std::string* error);
+
+// Train the model on the loaded data by the threads of the pool.
+// The model should not be initialized, and it is initialized by
+// the param (the model_seed gives the same model for the same
+// param and data). The stats and error can be nullptr. The
+// on_epoch is called after each epoch (see SetEpochCallback)
+int Train(const HyperParam& param, DataSource& data,
+          ThreadPool* pool, Model* model,
+          TrainStats* stats = nullptr,
+          std::string* error = nullptr,
+          const std::function<bool(int, const MetricInfo&)>& on_epoch =
+            nullptr);
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_TRAIN_API_H_
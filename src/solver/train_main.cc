@@ -40,5 +40,5 @@ int main(int argc, char* argv[]) {
   real_t time_cost = timer.toc();
   printf("Total time cost: %.2f sec\n", time_cost);
 
-  return 0;
+  return solver.Preempted() ? xLearn::kExitPreempted : 0;
 }
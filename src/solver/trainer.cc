@@ -20,13 +20,52 @@ This file is the implementation of the Trainer class.
 */
 
 #include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include "src/solver/trainer.h"
+#include "src/base/file_util.h"
+#include "src/base/phase_timer.h"
+#include "src/base/trace.h"
 #include "src/data/data_structure.h"
 
 namespace xLearn {
 
+// The seed of the sample of the train rows, so that
+// the sample is the same in each run
+static const uint32 kSampleSeed = 2018;
+// The least probability of a row in the loss-based sampling, as
+// a fraction of the rate, so the loss of each row is refreshed
+static const real_t kLossSampleFloor = 0.1;
+// The number of the features swept at a time by the eviction,
+// so the sweep does not hold the cores from the training
+static const index_t kSweepChunk = 1 << 16;
+static const uint64 kResumeMagic = 0x454d55534552584cULL;  /* "LXRESUME" */
+// The time budget starts the next epoch only if the time left
+// holds at least this fraction of the pass over the rows
+static const real_t kBudgetMinPass = 0.1;
+// The pass over the rows leaves at least this fraction of the time
+// left for the validation and the checkpoint after it, whose time is
+// not measured yet in the first epoch, and may grow in the others
+static const real_t kBudgetMinRest = 0.1;
+
+// The preemption of the resumable training, which is set by
+// the signal handler, so it is a lock-free atomic
+static std::atomic<bool> preemption(false);
+
+void RequestPreemption() { preemption.store(true); }
+
+// The i-th metric of the info, which is 0 if the metrics
+// are not computed, e.g., the train info of quiet mode
+static real_t metric_value(const MetricInfo& info, size_t i) {
+  return i < info.metric_vals.size() ? info.metric_vals[i] : 0;
+}
+
 /*********************************************************
  *  Show head info                                       *
  *********************************************************/
@@ -36,44 +75,203 @@ void Trainer::show_head_info(bool validate) {
   std::cout.width(20);
   std::string str = "Train " + loss_->loss_type();
   std::cout << str;
-  std::cout.width(20);
-  str = "Train " + metric_->type();
-  std::cout << str;
-  if (validate) {
+  if (use_sample()) {
+    std::cout.width(12);
+    std::cout << "Train SE";
+  }
+  for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
     std::cout.width(20);
-    str = "Test " + loss_->loss_type();
+    str = "Train " + metric_->type(i);
     std::cout << str;
+  }
+  if (validate) {
     std::cout.width(20);
-    str = "Test " + metric_->type();
+    str = "Test " + loss_->loss_type();
     std::cout << str;
+    for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
+      std::cout.width(20);
+      str = "Test " + metric_->type(i);
+      std::cout << str;
+    }
   }
   std::cout.width(20);
   std::cout << "Time cost (s)";
+  std::cout.width(12);
+  std::cout << "Update (s)";
+  if (validate) {
+    std::cout.width(12);
+    std::cout << "Eval (s)";
+  }
+  std::cout.width(12);
+  std::cout << "Rows/sec";
+  std::cout.width(12);
+  std::cout << "Nnz/sec";
+  if (show_pairs()) {
+    std::cout.width(12);
+    std::cout << "Pairs/sec";
+  }
   std::cout << std::endl;
 }
 
 /*********************************************************
  *  Show train info                                      *
  *********************************************************/
-void Trainer::show_train_info(real_t tr_loss, real_t tr_metric,
-                              real_t te_loss, real_t te_metric,
+void Trainer::show_train_info(const MetricInfo& tr_info,
+                              const MetricInfo& te_info,
                               real_t time_cost, bool validate,
-                              index_t epoch) {
+                              index_t n, const EpochInfo& epoch) {
   std::cout.width(6);
-  std::cout << epoch;
-  std::cout.width(20);
-  std::cout << std::fixed << std::setprecision(5) << tr_loss;
+  std::cout << n;
   std::cout.width(20);
-  std::cout << std::fixed << std::setprecision(5) << tr_metric;
-  if (validate) {
+  std::cout << std::fixed << std::setprecision(5) << tr_info.loss_val;
+  if (use_sample()) {
+    std::cout.width(12);
+    std::cout << std::fixed << std::setprecision(5) << tr_info.loss_stderr;
+  }
+  for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
     std::cout.width(20);
-    std::cout << std::fixed << std::setprecision(5) << te_loss;
+    std::cout << std::fixed << std::setprecision(5)
+              << metric_value(tr_info, i);
+  }
+  if (validate) {
     std::cout.width(20);
-    std::cout << std::fixed << std::setprecision(5) << te_metric;
+    std::cout << std::fixed << std::setprecision(5) << te_info.loss_val;
+    for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
+      std::cout.width(20);
+      std::cout << std::fixed << std::setprecision(5)
+                << metric_value(te_info, i);
+    }
   }
   std::cout.width(20);
   std::cout << std::fixed << std::setprecision(2) << time_cost;
+  std::cout.width(12);
+  std::cout << std::fixed << std::setprecision(2) << epoch.update_time;
+  if (validate) {
+    std::cout.width(12);
+    std::cout << std::fixed << std::setprecision(2) << epoch.eval_time;
+  }
+  // The throughput of the gradient pass
+  double update_time = epoch.update_time;
+  double rows_per_sec = update_time > 0 ? epoch.rows / update_time : 0;
+  double nnz_per_sec = update_time > 0 ? epoch.nnz / update_time : 0;
+  double pairs_per_sec = update_time > 0 ? epoch.pairs / update_time : 0;
+  std::cout.width(12);
+  std::cout << std::fixed << std::setprecision(0) << rows_per_sec;
+  std::cout.width(12);
+  std::cout << std::fixed << std::setprecision(0) << nnz_per_sec;
+  if (show_pairs()) {
+    std::cout.width(12);
+    std::cout << std::fixed << std::setprecision(0) << pairs_per_sec;
+  }
   std::cout << std::endl;
+  LOG(INFO) << "Epoch " << n << ": update time (sec): "
+            << epoch.update_time << ", eval time (sec): "
+            << epoch.eval_time << ", rows/sec: " << rows_per_sec
+            << ", nnz/sec: " << nnz_per_sec
+            << ", pairs/sec: " << pairs_per_sec;
+}
+
+/*********************************************************
+ *  Write the metrics of an epoch                        *
+ *********************************************************/
+// The JSON object of all the metrics of the info, e.g.,
+// {"AUC":0.75,"LogLoss":0.5}
+std::string Trainer::metrics_json(const MetricInfo& info) {
+  JsonObject obj;
+  for (size_t i = 0; i < metric_->NumMetrics(); ++i) {
+    obj.AddReal(metric_->type(i), metric_value(info, i));
+  }
+  return obj.ToString();
+}
+
+void Trainer::record_epoch(int n, const MetricInfo* tr_info,
+                           const MetricInfo* te_info,
+                           real_t time_cost,
+                           const EpochInfo& epoch) {
+  if (metrics_log_ == nullptr) { return; }
+  JsonObject record;
+  record.AddString("type", "epoch");
+  if (fold_ >= 0) { record.AddInt("fold", fold_); }
+  record.AddInt("epoch", n)
+        .AddString("loss", loss_->loss_type())
+        .AddString("metric", metric_->type());
+  if (tr_info != nullptr) {
+    record.AddReal("train_loss", tr_info->loss_val)
+          .AddReal("train_metric", tr_info->metric_val);
+    record.AddRaw("train_metrics", metrics_json(*tr_info));
+    if (use_sample()) {
+      record.AddReal("train_loss_stderr", tr_info->loss_stderr)
+            .AddInt("train_sample_rows", sample_rows_);
+    }
+  }
+  if (te_info != nullptr) {
+    record.AddReal("test_loss", te_info->loss_val)
+          .AddReal("test_metric", te_info->metric_val);
+    record.AddRaw("test_metrics", metrics_json(*te_info));
+  }
+  double update_time = epoch.update_time;
+  record.AddReal("time", time_cost)
+        .AddReal("update_time", update_time)
+        .AddReal("eval_time", epoch.eval_time)
+        .AddInt("rows", epoch.rows)
+        .AddInt("nnz", epoch.nnz)
+        .AddInt("pairs", epoch.pairs)
+        .AddReal("rows_per_sec",
+                 update_time > 0 ? epoch.rows / update_time : 0)
+        .AddReal("nnz_per_sec",
+                 update_time > 0 ? epoch.nnz / update_time : 0)
+        .AddReal("pairs_per_sec",
+                 update_time > 0 ? epoch.pairs / update_time : 0)
+        .AddInt("threads", loss_->num_threads())
+        .AddReal("imbalance", epoch.imbalance)
+        .AddReal("utilization", epoch.utilization)
+        .AddReal("straggler", epoch.straggler)
+        .AddReal("straggler_max", epoch.straggler_max)
+        .AddReal("sync_time", epoch.sync_time)
+        .AddReal("tail_time", epoch.tail_time);
+  metrics_log_->Write(record);
+}
+
+/*********************************************************
+ *  Show the throughput of training                      *
+ *********************************************************/
+void Trainer::show_throughput(index_t num_rows, real_t time_cost,
+                              const LoadStats& load) {
+  if (time_cost <= 0) { return; }
+  real_t rows_per_sec = num_rows / time_cost;
+  size_t num_threads = loss_->num_threads();
+  printf("  Training throughput: %.0f rows/sec, %.0f rows/sec "
+         "per thread (%s, %lu threads)\n",
+         rows_per_sec, rows_per_sec / num_threads,
+         loss_->thread_mode_name().c_str(), num_threads);
+  LOG(INFO) << "Training throughput: " << rows_per_sec
+            << " rows/sec with " << num_threads << " threads in "
+            << loss_->thread_mode_name() << " mode";
+  printf("%s", load.Report().c_str());
+}
+
+/*********************************************************
+ *  Log the load of the threads in one epoch             *
+ *********************************************************/
+void Trainer::log_load(int epoch, const LoadStats& load) {
+  std::ostringstream busy, idle;
+  busy << std::fixed << std::setprecision(4);
+  idle << std::fixed << std::setprecision(4);
+  for (size_t i = 0; i < load.busy.size(); ++i) {
+    busy << (i == 0 ? "" : " ") << load.busy[i];
+    idle << (i == 0 ? "" : " ") << load.idle(i);
+  }
+  LOG(INFO) << "Epoch " << epoch << ": busy time of threads (sec): "
+            << busy.str() << ", wall time: " << load.wall
+            << ", imbalance (max / mean): " << load.imbalance()
+            << ", utilization: " << load.utilization()
+            << ", idle time (sec): " << idle.str()
+            << ", straggler (last / mean stop) mean: "
+            << load.straggler() << " max: " << load.straggler_max
+            << " in " << load.loops << " batches"
+            << ", sync time: " << load.wall
+            << " (wake-up: " << load.wakeup
+            << ", stragglers: " << load.tail << ")";
 }
 
 /*********************************************************
@@ -86,73 +284,950 @@ void Trainer::train(std::vector<Reader*> train_reader,
   if (!quiet_) {
     show_head_info(validate);
   }
-  for (int n = 0; n < epoch_; ++n) {
+  // Time of the gradient pass only, and the
+  // busy time of the threads in it
+  Timer grad_timer;
+  index_t num_rows = 0;
+  LoadStats total_load;
+  total_load.busy.assign(loss_->num_threads(), 0);
+  // The best validation of early-stopping, and its epoch and
+  // batch (0 for the end of epoch), whose model is kept in
+  // best_model_, or in best_valid_model_ if it is async
+  bool early_stop = early_stop_ && validate;
+  // The time budget keeps the best model without stopping early
+  bool keep_best = early_stop || (budget_ && validate);
+  int best_valid = -1;
+  int best_epoch = -1;
+  index_t best_batch = 0;
+  real_t best_metric = 0;
+  num_valid_ = 0;
+  start_sweeper();
+  // The validation of epoch n is in the background during
+  // epoch n+1, and its result is used after epoch n+1. The
+  // validation after the last epoch is waited for at last
+  bool async = valid_loss_ != nullptr && validate &&
+               (!quiet_ || keep_best);
+  // Keep the best model by the metric of the k-th validation,
+  // and return true if early-stopping stops the training
+  auto stop_by = [&](real_t metric, int k, int epoch,
+                     index_t batch, bool copy) -> bool {
+    bool better = metric_->larger_is_better() ?
+                  metric > best_metric : metric < best_metric;
+    if (best_valid < 0 || better) {
+      best_valid = k;
+      best_epoch = epoch;
+      best_batch = batch;
+      best_metric = metric;
+      if (copy) {
+        best_valid_model_.swap(valid_model_);
+      } else {
+        model_->Snapshot(&best_model_);
+      }
+      return false;
+    }
+    if (!early_stop || k - best_valid < stop_window_) { return false; }
+    if (batch > 0) {
+      printf("Early-stopping at epoch %d, batch %d \n", epoch, batch);
+    } else {
+      printf("Early-stopping at epoch %d \n", epoch);
+    }
+    return true;
+  };
+  // Wait for the validation in the background, and
+  // return true if early-stopping stops the training
+  auto finish_valid = [&]() -> bool {
+    int valid_epoch = wait_valid();
+    return keep_best && valid_epoch >= 0 &&
+           stop_by(valid_info_.metric_val, valid_index_,
+                   valid_epoch, valid_batch_, true);
+  };
+  // The validation every valid_batches_ batches, whose time
+  // is not counted in the gradient pass. The epoch is stopped
+  // if early-stopping stops the training. The model of the
+  // ring is averaged every sync_batches_ batches before that
+  bool stopped = false;
+  int n = 0;
+  index_t batch = 0;
+  real_t batch_valid_time = 0;
+  bool valid_batch = validate && valid_batches_ > 0;
+  std::function<bool()> on_batch = [&]() -> bool {
+    ++batch;
+    if (sync_batches_ > 0 && batch % sync_batches_ == 0) {
+      average_model(true);
+    }
+    if (online_) { checkpoint(batch - 1); }
+    if (!valid_batch || batch % valid_batches_ != 0) { return false; }
+    grad_timer.toc();
+    ScopedPhase evaluate("validate batch");
+    bool stop = false;
+    if (async) {
+      stop = finish_valid();
+      if (!stop) {
+        start_valid(test_reader, n, batch, MetricInfo(), 0, EpochInfo());
+      }
+    } else {
+      // The running train metric is kept aside
+      MetricCounter running = metric_->Counter();
+      MetricInfo te_info = CalcLossMetric(test_reader);
+      metric_->Reset();
+      metric_->Merge(running);
+      if (!quiet_) { show_batch_info(n, batch, te_info); }
+      stop = keep_best &&
+             stop_by(te_info.metric_val, num_valid_++, n, batch, false);
+    }
+    batch_valid_time += evaluate.Stop();
+    grad_timer.tic();
+    stopped = stop;
+    return stop;
+  };
+  bool use_batch = valid_batch || online_ ||
+                   (ring_ != nullptr && sync_batches_ > 0);
+  // The fixed sample of the train rows is copied before
+  // the first epoch, which is evaluated after each epoch
+  if (use_sample()) { sample_train_set(train_reader); }
+  if (loss_sample_ > 0) {
+    CHECK_EQ(train_reader.size(), 1);
+    row_loss_.assign(train_reader[0]->Stats().num_row, 0);
+  }
+  // The folds after the first one use the chosen size
+  if (tuner_ != nullptr && !set_batch_size(train_reader)) {
+    LOG(WARNING) << "The batch size is only tuned for the "
+                 << "in-memory training, and it is not changed";
+    tuner_.reset();
+  }
+  // The resumed training continues at the epoch and the batch of
+  // the state, after the sample of the train rows is copied
+  int first_epoch = 0;
+  index_t first_batch = 0;
+  if (!resume_file_.empty()) {
+    ResumeState state;
+    if (load_resume(&state, train_reader)) {
+      first_epoch = state.epoch;
+      first_batch = state.batch;
+      num_valid_ = state.num_valid;
+      best_valid = state.best_valid;
+      best_epoch = state.best_epoch;
+      best_batch = state.best_batch;
+      best_metric = state.best_metric;
+      best_model_.swap(state.best_model);
+      resume_pass_ = true;
+    }
+  }
+  // Save the state of the training that continues at the
+  // batch of the epoch, and stop the training
+  auto preempt = [&](int epoch, index_t batch) {
+    preempted_ = true;
+    ResumeState state;
+    state.epoch = epoch;
+    state.batch = batch;
+    state.num_valid = num_valid_;
+    state.best_valid = best_valid;
+    state.best_epoch = best_epoch;
+    state.best_batch = best_batch;
+    state.best_metric = best_metric;
+    state.best_model = best_model_;
+    save_resume(&state, train_reader);
+  };
+  // The wall time of the last pass over the rows, and of the
+  // rest of the last epoch, i.e., the validation and the checkpoint
+  auto epoch_start = std::chrono::steady_clock::now();
+  real_t last_pass = 0;
+  real_t last_rest = 0;
+  budget_cut_ = false;
+  for (n = first_epoch; n < epoch_; ++n) {
+    if (budget_) {
+      auto now = std::chrono::steady_clock::now();
+      if (n > first_epoch) {
+        last_rest = std::chrono::duration<real_t>(now - epoch_start).count() -
+                    last_pass;
+      }
+      epoch_start = now;
+      real_t left = std::chrono::duration<real_t>(train_end_ - now).count();
+      if (budget_cut_ ||
+          (n > first_epoch && left < last_rest + kBudgetMinPass * last_pass)) {
+        printf("The time budget stops the training before epoch %d \n", n);
+        LOG(INFO) << "The time budget stops the training before epoch "
+                  << n << " with " << left << " sec left";
+        break;
+      }
+      real_t rest = std::max(last_rest, kBudgetMinRest * left);
+      pass_end_ = train_end_ - std::chrono::milliseconds(
+                                   (int64)(rest * 1000));
+    }
     Timer timer;
     timer.tic();
     //----------------------------------------------------
     // Calc grad and update model
     //----------------------------------------------------
-    CalcGradUpdate(train_reader);
-    // we don't do any evaluation in a quiet model
+    // The train loss is the running loss of the scores
+    // before each update, so it needs no extra pass,
+    // unless it is evaluated on the sample of the rows
+    MetricInfo tr_info = { 0, 0 };
+    loss_->ResetLoadStats();
+    grad_timer.tic();
+    ScopedPhase gradient("gradient", true);
+    EpochInfo epoch_info;
+    index_t batch_base = resume_pass_ ? first_batch : 0;
+    batch = batch_base;
+    batch_valid_time = 0;
+    index_t epoch_rows = CalcGradUpdate(train_reader,
+                                        quiet_ ? nullptr : &tr_info,
+                                        &epoch_info,
+                                        use_batch ? &on_batch : nullptr);
+    // The nodes that have finished the epoch take part in
+    // the averages of the others until all of them finish
+    if (ring_ != nullptr) {
+      while (average_model(false) > 0) { }
+    }
+    gradient.AddRows(epoch_rows);
+    last_pass = gradient.Stop();
+    epoch_info.update_time = last_pass - batch_valid_time;
+    epoch_info.eval_time = batch_valid_time;
+    if (budget_cut_) {
+      printf("The time budget stops epoch %d after %d rows \n",
+             n, epoch_rows);
+      LOG(INFO) << "The time budget stops epoch " << n << " after "
+                << epoch_rows << " rows";
+    }
+    if (loss_sample_ > 0) { update_row_prob(train_reader[0]); }
+    if (use_sample()) {
+      ScopedPhase evaluate("evaluate sample");
+      tr_info = CalcSampleMetric();
+      epoch_info.eval_time += evaluate.Stop();
+    }
+    stats_.epoch_rows.push_back(epoch_rows);
+    stats_.epoch_time.push_back(epoch_info.update_time);
+    stats_.epoch_nnz.push_back(epoch_info.nnz);
+    stats_.epoch_pairs.push_back(epoch_info.pairs);
+    num_rows += epoch_rows;
+    grad_timer.toc();
+    const LoadStats& load = loss_->GetLoadStats();
+    log_load(n, load);
+    epoch_info.imbalance = load.imbalance();
+    epoch_info.utilization = load.utilization();
+    epoch_info.straggler = load.straggler();
+    epoch_info.straggler_max = load.straggler_max;
+    epoch_info.sync_time = load.wall;
+    epoch_info.tail_time = load.tail;
+    total_load.Merge(load);
+    if (stopped) { break; }
+    if (preempted_) {
+      preempt(n, batch_base + epoch_info.batches);
+      break;
+    }
+    if (!online_) { checkpoint(n); }
+    if (async) {
+      // The validation of the last epoch has run during the
+      // CalcGradUpdate() of this one, and it is only joined here,
+      // before the validation of this epoch is started
+      if (finish_valid()) {
+        stopped = true;
+        break;
+      }
+      start_valid(test_reader, n, 0, tr_info, timer.toc(), epoch_info);
+      continue;
+    }
+    // we don't do any evaluation in a quiet model, except
+    // the test metric of early-stopping and the callback
+    MetricInfo te_info = { 0, 0 };
     if (!quiet_) {
-      //----------------------------------------------------
-      // Calc Train loss
-      //----------------------------------------------------
-      MetricInfo tr_info = CalcLossMetric(train_reader);
       //----------------------------------------------------
       // Calc Test loss
       //----------------------------------------------------
-      MetricInfo te_info;
       if (validate) {
+        ScopedPhase evaluate("evaluate");
         te_info = CalcLossMetric(test_reader);
+        epoch_info.eval_time += evaluate.Stop();
       }
       real_t time_cost = timer.toc();
       // show train info
-      show_train_info(tr_info.loss_val, tr_info.metric_val,
-                      te_info.loss_val, te_info.metric_val,
-                      time_cost, validate, n);
+      show_train_info(tr_info, te_info, time_cost, validate, n, epoch_info);
+      if (validate && !extra_.empty()) { show_extra_info(test_reader); }
+      record_epoch(n, &tr_info, validate ? &te_info : nullptr,
+                   time_cost, epoch_info);
+    } else if (keep_best || (validate && on_epoch_)) {
+      ScopedPhase evaluate("evaluate");
+      te_info = CalcLossMetric(test_reader);
+      epoch_info.eval_time += evaluate.Stop();
+      record_epoch(n, nullptr, &te_info, timer.toc(), epoch_info);
+    } else {
+      record_epoch(n, nullptr, nullptr, timer.toc(), epoch_info);
+    }
+    //----------------------------------------------------
+    // Early-stopping on the test metric
+    //----------------------------------------------------
+    if (keep_best &&
+        stop_by(te_info.metric_val, num_valid_++, n, 0, false)) {
+      break;
+    }
+    if (on_epoch_ && on_epoch_(n, te_info)) {
+      LOG(INFO) << "The callback stops the training at epoch " << n;
+      break;
+    }
+    // The preemption during the validation saves the state
+    // of the next epoch, whose Readers start from the first row
+    if (!resume_file_.empty() && preemption.load() && n + 1 < epoch_) {
+      for (size_t i = 0; i < train_reader.size(); ++i) {
+        train_reader[i]->Reset();
+      }
+      preempt(n + 1, 0);
+      break;
     }
   }
+  if (async && !stopped) { finish_valid(); }
+  stop_sweeper();
+  wait_checkpoint();
+  if (loss_sample_ > 0) {
+    train_reader[0]->SetRowProb(std::vector<real_t>());
+  }
+  show_throughput(num_rows, grad_timer.get(), total_load);
+  // Restore the best model, but the state of the
+  // preemption keeps the current one
+  if (keep_best && best_valid >= 0 && !preempted_) {
+    if (async) {
+      model_->RestoreWeights(*best_valid_model_);
+    } else {
+      model_->Restore(best_model_);
+    }
+    if (best_batch > 0) {
+      printf("  Best epoch: %d, batch: %d, Test %s: %.5f \n", best_epoch,
+             best_batch, metric_->type().c_str(), best_metric);
+    } else {
+      printf("  Best epoch: %d, Test %s: %.5f \n", best_epoch,
+             metric_->type().c_str(), best_metric);
+    }
+    LOG(INFO) << "Restore the best model of epoch "
+              << best_epoch << ", batch " << best_batch;
+  }
+}
+
+// The sum of the weights of the rows of the matrix
+static double weighted_rows(const DMatrix* matrix) {
+  if (!matrix->HasWeight()) { return matrix->row_length; }
+  double sum = 0;
+  for (index_t i = 0; i < matrix->row_length; ++i) {
+    sum += matrix->weight[i];
+  }
+  return sum;
+}
+
+// The loss of a row is its own, which is not weighted
+void Trainer::record_row_loss(const Reader* reader,
+                              const DMatrix* matrix,
+                              const std::vector<real_t>& pred) {
+  const index_t* ids = reader->SampleIds();
+  for (index_t j = 0; j < matrix->row_length; ++j) {
+    CHECK_LT(ids[j], row_loss_.size());
+    real_t y = loss_->task_label(matrix->Y[j]);
+    row_loss_[ids[j]] = loss_->Evalute(&pred[j], &y, 1);
+  }
+}
+
+// The probability of a row is rate * loss / mean loss, which is
+// clipped into [rate * kLossSampleFloor, 1], so the expected number
+// of the kept rows is about rate of the rows
+void Trainer::update_row_prob(Reader* reader) {
+  double mean = 0;
+  for (size_t i = 0; i < row_loss_.size(); ++i) { mean += row_loss_[i]; }
+  mean = row_loss_.empty() ? 0 : mean / row_loss_.size();
+  row_prob_.resize(row_loss_.size());
+  double expected = 0;
+  for (size_t i = 0; i < row_loss_.size(); ++i) {
+    real_t p = mean > 0 ? loss_sample_ * row_loss_[i] / mean : loss_sample_;
+    p = std::min<real_t>(std::max(p, loss_sample_ * kLossSampleFloor), 1);
+    row_prob_[i] = p;
+    expected += p;
+  }
+  reader->SetRowProb(row_prob_);
+  LOG(INFO) << "Loss-based sampling keeps about " << (uint64)expected
+            << " of " << row_loss_.size() << " rows in the next epoch";
+}
+
+bool Trainer::set_batch_size(std::vector<Reader*>& reader_list) {
+  for (size_t i = 0; i < reader_list.size(); ++i) {
+    if (!reader_list[i]->SetBatchSize(tuner_->Size())) { return false; }
+  }
+  return true;
+}
+
+// The rows 0 ends the tuning
+void Trainer::tune_batch(index_t rows, double seconds, uint64 bytes,
+                         std::vector<Reader*>& reader_list) {
+  int size = tuner_->Size();
+  if (rows > 0) {
+    tuner_->Record(rows, seconds, bytes);
+  } else {
+    tuner_->Finish();
+  }
+  if (tuner_->Size() != size) { set_batch_size(reader_list); }
+  if (tuner_->Done()) {
+    LOG(INFO) << "Tune the batch size to " << tuner_->Size()
+              << " rows: " << (uint64)tuner_->RowsPerSec()
+              << " rows/sec, " << (uint64)tuner_->RowBytes()
+              << " bytes/row";
+    if (!quiet_) {
+      printf("  Batch size: %d rows (%.0f rows/sec) \n",
+             tuner_->Size(), tuner_->RowsPerSec());
+    }
+  }
+}
+
+void Trainer::show_extra_info(std::vector<Reader*>& test_reader) {
+  ScopedPhase evaluate("evaluate");
+  for (size_t k = 0; k < extra_.size(); ++k) {
+    MetricInfo info = CalcLossMetric(test_reader, extra_[k].model,
+                                     extra_[k].loss, extra_[k].metric);
+    printf("  Model %lu: Test loss %.5f, Test %s %.5f \n", k + 1,
+           info.loss_val, extra_[k].metric->type().c_str(),
+           info.metric_val);
+  }
 }
 
 // Calculate gradient and update model
-void Trainer::CalcGradUpdate(std::vector<Reader*>& reader) {
+index_t Trainer::CalcGradUpdate(std::vector<Reader*>& reader,
+                                MetricInfo* info,
+                                EpochInfo* epoch,
+                                const std::function<bool()>* on_batch) {
   CHECK_NE(reader.empty(), true);
-  for (int i = 0; i < reader.size(); ++i) {
-    reader[i]->Reset();
+  if (batch_ != nullptr) { return batch_epoch(info, epoch); }
+  index_t num_rows = 0;
+  std::vector<real_t> pred;
+  real_t loss_val = 0.0;
+  // The sum of the weights of the rows, which is the number
+  // of rows unless the negatives or the rows are weighted
+  double weight_sum = 0;
+  bool neg_weighted = loss_->neg_weight() != 1.0;
+  if (info != nullptr) { metric_->Reset(); }
+  bool stop = false;
+  bool tuning = tuner_ != nullptr && !tuner_->Done();
+  // The models of AddModel() are updated in the same pass
+  std::vector<Loss*> losses;
+  std::vector<Model*> models;
+  std::vector<std::vector<real_t>> preds;
+  if (!extra_.empty()) {
+    losses.push_back(loss_);
+    models.push_back(model_);
+    for (size_t k = 0; k < extra_.size(); ++k) {
+      losses.push_back(extra_[k].loss);
+      models.push_back(extra_[k].model);
+    }
+  }
+  for (int i = 0; i < reader.size() && !stop; ++i) {
+    // The first pass of the resumed training continues
+    // at the position of the restored Reader
+    if (!resume_pass_) { reader[i]->Reset(); }
     DMatrix* matrix = nullptr;
-    while (reader[i]->Samples(matrix)) {
-      loss_->CalcGrad(matrix, *model_);
+    index_t tmp = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while ((tmp = reader[i]->Samples(matrix)) > 0) {
+      bool need_pred = info != nullptr || loss_sample_ > 0;
+      if (!losses.empty()) {
+        Loss::CalcGradMulti(matrix, losses, models,
+                            need_pred ? &preds : nullptr);
+        if (need_pred) { pred.swap(preds[0]); }
+      } else if (need_pred) {
+        loss_->CalcGrad(matrix, *model_, &pred);
+      } else {
+        loss_->CalcGrad(matrix, *model_);
+      }
+      // The time of a batch includes its Samples()
+      if (tuning && !tuner_->Done()) {
+        auto end = std::chrono::steady_clock::now();
+        // The bytes of the CSR copy of the batch
+        uint64 bytes = tmp * (sizeof(real_t) * 3 + sizeof(uint64));
+        for (index_t j = 0; j < tmp; ++j) {
+          bytes += matrix->RowNNZ(j) * sizeof(Node);
+        }
+        tune_batch(tmp, std::chrono::duration<double>(end - begin).count(),
+                   bytes, reader);
+      }
+      if (loss_sample_ > 0) { record_row_loss(reader[i], matrix, pred); }
+      if (info != nullptr) {
+        const real_t* weight = matrix->HasWeight() ?
+                               matrix->weight.data() : nullptr;
+        loss_val += loss_->EvaluteMetric(pred, matrix->Y, metric_,
+                                         weight);
+        if (neg_weighted) {
+          for (index_t j = 0; j < tmp; ++j) {
+            weight_sum += loss_->row_weight(
+                            loss_->task_label(matrix->Y[j])) *
+                          matrix->RowWeight(j);
+          }
+        } else {
+          weight_sum += weighted_rows(matrix);
+        }
+      }
+      num_rows += tmp;
+      if (epoch != nullptr) {
+        epoch->batches++;
+        for (index_t j = 0; j < tmp; ++j) {
+          uint64 nnz = matrix->RowNNZ(j);
+          epoch->nnz += nnz;
+          if (nnz > 1) { epoch->pairs += nnz * (nnz - 1) / 2; }
+        }
+      }
+      if (on_batch != nullptr && (*on_batch)()) {
+        stop = true;
+        break;
+      }
+      if (!resume_file_.empty() && preemption.load()) {
+        preempted_ = true;
+        stop = true;
+        break;
+      }
+      if (budget_ && std::chrono::steady_clock::now() >= pass_end_) {
+        budget_cut_ = true;
+        stop = true;
+        break;
+      }
+      begin = std::chrono::steady_clock::now();
     }
   }
+  resume_pass_ = false;
+  // The data is smaller than the candidates
+  if (tuning && !tuner_->Done()) {
+    tune_batch(0, 0, 0, reader);
+  }
+  if (info != nullptr) {
+    info->loss_val = weight_sum > 0 ? loss_val / weight_sum : 0;
+    info->metric_vals = metric_->GetMetrics();
+    info->metric_val = info->metric_vals[0];
+    info->loss_stderr = 0;
+  }
+  if (epoch != nullptr) { epoch->rows = num_rows; }
+  return num_rows;
+}
+
+// The epoch of the full-batch solver, whose train info
+// is evaluated on the rows it copied
+index_t Trainer::batch_epoch(MetricInfo* info, EpochInfo* epoch) {
+  CHECK(extra_.empty());
+  index_t num_rows = batch_->Epoch();
+  const DMatrix& rows = batch_->Rows();
+  if (info != nullptr) {
+    metric_->Reset();
+    const real_t* weight = rows.HasWeight() ? rows.weight.data() : nullptr;
+    real_t loss_val = loss_->EvaluteMetric(batch_->Scores(), rows.Y,
+                                           metric_, weight);
+    double weight_sum = 0;
+    for (index_t j = 0; j < num_rows; ++j) {
+      weight_sum += loss_->row_weight(loss_->task_label(rows.Y[j])) *
+                    rows.RowWeight(j);
+    }
+    info->loss_val = weight_sum > 0 ? loss_val / weight_sum : 0;
+    info->metric_vals = metric_->GetMetrics();
+    info->metric_val = info->metric_vals[0];
+    info->loss_stderr = 0;
+  }
+  if (epoch != nullptr) {
+    epoch->batches = 1;
+    epoch->rows = num_rows;
+    for (index_t j = 0; j < num_rows; ++j) {
+      uint64 nnz = rows.RowNNZ(j);
+      epoch->nnz += nnz;
+      if (nnz > 1) { epoch->pairs += nnz * (nnz - 1) / 2; }
+    }
+  }
+  return num_rows;
 }
 
 // Calculate loss value
-MetricInfo Trainer::CalcLossMetric(std::vector<Reader*>& reader_list) {
+MetricInfo Trainer::CalcLossMetric(std::vector<Reader*>& reader_list,
+                                   Model* model,
+                                   Loss* loss,
+                                   Metric* metric) {
   CHECK_NE(reader_list.empty(), true);
   DMatrix* matrix = nullptr;
-  index_t count_sample = 0;
+  // The sum of the weights of the rows
+  double count_sample = 0;
   std::vector<real_t> pred;
   real_t loss_val = 0.0;
-  metric_->Reset();
+  metric->Reset();
   for (int i = 0; i < reader_list.size(); ++i) {
     reader_list[i]->Reset();
     for (;;) {
       index_t tmp = reader_list[i]->Samples(matrix);
       if (tmp == 0) { break; }
       if (tmp != pred.size()) { pred.resize(tmp); }
-      count_sample += tmp;
-      loss_->Predict(matrix, *model_, pred);
-      loss_val += loss_->Evalute(pred, matrix->Y);
-      metric_->Accumulate(matrix->Y, pred);
+      count_sample += weighted_rows(matrix);
+      loss_val += loss->PredictEvalute(matrix, *model, pred, metric);
     }
   }
   MetricInfo info;
   info.loss_val = loss_val / count_sample;
-  info.metric_val = metric_->GetMetric();
+  info.metric_vals = metric->GetMetrics();
+  info.metric_val = info.metric_vals[0];
+  info.loss_stderr = 0;
+  return info;
+}
+
+// Sample the rows of the train set by a fixed seed
+void Trainer::sample_train_set(std::vector<Reader*>& reader_list) {
+  CHECK_NE(reader_list.empty(), true);
+  sample_.clear();
+  sample_rows_ = 0;
+  sample_total_ = 0;
+  std::mt19937 generator(kSampleSeed);
+  std::bernoulli_distribution coin(sample_fraction_);
+  DMatrix* matrix = nullptr;
+  std::vector<index_t> rows;
+  for (size_t i = 0; i < reader_list.size(); ++i) {
+    reader_list[i]->Reset();
+    for (;;) {
+      index_t tmp = reader_list[i]->Samples(matrix);
+      if (tmp == 0) { break; }
+      sample_total_ += tmp;
+      rows.clear();
+      for (index_t j = 0; j < tmp; ++j) {
+        if (coin(generator)) { rows.push_back(j); }
+      }
+      if (rows.empty()) { continue; }
+      DMatrix* batch = new DMatrix();
+      batch->SetCSR(true);
+      batch->ResetMatrix(rows.size());
+      for (index_t j = 0; j < rows.size(); ++j) {
+        batch->CopyRow(j, *matrix, rows[j]);
+      }
+      sample_.emplace_back(batch);
+      sample_rows_ += rows.size();
+    }
+  }
+  LOG(INFO) << "Sample " << sample_rows_ << " of " << sample_total_
+            << " train rows to evaluate the train info";
+}
+
+// Calculate the loss value and the metric on the sample. The
+// loss of a row is weighted by the Loss and by the row, and the
+// loss value is the ratio of the weighted sums
+MetricInfo Trainer::CalcSampleMetric() {
+  std::vector<real_t> pred;
+  // The sums of w, w*l, w^2, w^2*l and w^2*l^2
+  double w_sum = 0, wl_sum = 0;
+  double w2_sum = 0, w2l_sum = 0, w2l2_sum = 0;
+  metric_->Reset();
+  for (size_t i = 0; i < sample_.size(); ++i) {
+    const DMatrix* matrix = sample_[i].get();
+    pred.resize(matrix->row_length);
+    loss_->PredictEvalute(matrix, *model_, pred, metric_);
+    for (index_t j = 0; j < matrix->row_length; ++j) {
+      real_t y = loss_->task_label(matrix->Y[j]);
+      double loss = loss_->Evalute(&pred[j], &y, 1);
+      double w = loss_->row_weight(y) * matrix->RowWeight(j);
+      w_sum += w;
+      wl_sum += w * loss;
+      w2_sum += w * w;
+      w2l_sum += w * w * loss;
+      w2l2_sum += w * w * loss * loss;
+    }
+  }
+  MetricInfo info;
+  info.metric_vals = metric_->GetMetrics();
+  info.metric_val = info.metric_vals[0];
+  info.loss_val = 0;
+  info.loss_stderr = 0;
+  index_t n = sample_rows_;
+  if (n == 0) { return info; }
+  double mean = wl_sum / w_sum;
+  info.loss_val = mean;
+  if (n > 1) {
+    // The standard error of the ratio of the sample without
+    // replacement, which is 0 if all the rows are sampled.
+    // It is the standard error of the mean if w = 1
+    double ss = w2l2_sum - 2 * mean * w2l_sum + mean * mean * w2_sum;
+    double var = std::max(ss, 0.0) / (w_sum * w_sum) * n / (n - 1);
+    double fpc = 1.0 - static_cast<double>(n) / sample_total_;
+    info.loss_stderr = sqrt(var * fpc);
+  }
   return info;
 }
 
+// The train info is shown with the test info
+void Trainer::start_valid(std::vector<Reader*>& test_reader, int epoch,
+                          index_t batch, const MetricInfo& tr_info,
+                          real_t time_cost, const EpochInfo& epoch_info) {
+  CHECK(!valid_thread_.joinable());
+  if (valid_model_ == nullptr) { valid_model_.reset(new Model()); }
+  valid_model_->CopyWeights(*model_);
+  valid_epoch_ = epoch;
+  valid_batch_ = batch;
+  valid_index_ = num_valid_++;
+  valid_thread_ = std::thread([this, &test_reader, epoch, batch,
+                               tr_info, time_cost, epoch_info]() {
+    TraceLog::Get().NameThread("validation");
+    ScopedTrace trace("validate", "trainer");
+    Timer timer;
+    timer.tic();
+    valid_info_ = CalcLossMetric(test_reader, valid_model_.get(),
+                                 valid_loss_, valid_metric_);
+    if (batch > 0) {
+      if (!quiet_) { show_batch_info(epoch, batch, valid_info_); }
+      return;
+    }
+    EpochInfo info = epoch_info;
+    info.eval_time = timer.toc();
+    if (!quiet_) {
+      show_train_info(tr_info, valid_info_, time_cost, true, epoch, info);
+    }
+    record_epoch(epoch, quiet_ ? nullptr : &tr_info, &valid_info_,
+                 time_cost, info);
+  });
+}
+
+int Trainer::average_model(bool active) {
+  ScopedPhase phase("allreduce");
+  int num_active = 0;
+  if (!ring_->Average(model_, active, &num_active)) {
+    LOG(FATAL) << "Lost the connection of the ring allreduce";
+  }
+  return num_active;
+}
+
+// The batch is counted from the start of the epoch
+void Trainer::show_batch_info(int epoch, index_t batch,
+                              const MetricInfo& te_info) {
+  printf("  Epoch %d, batch %d: Test loss: %.5f, Test %s: %.5f \n",
+         epoch, batch, te_info.loss_val, metric_->type().c_str(),
+         te_info.metric_val);
+  LOG(INFO) << "Validation of epoch " << epoch << ", batch " << batch
+            << ": loss " << te_info.loss_val << ", "
+            << metric_->type() << " " << te_info.metric_val;
+}
+
+int Trainer::wait_valid() {
+  if (!valid_thread_.joinable()) { return -1; }
+  ScopedTrace trace("wait for validation", "trainer");
+  valid_thread_.join();
+  return valid_epoch_;
+}
+
+// The copy is written to a temporary file first, which is renamed
+// to the checkpoint file, so the former checkpoint is kept if the
+// training is killed during the writing
+void Trainer::checkpoint(int epoch) {
+  if (ckpt_file_.empty()) { return; }
+  ckpt_timer_.toc();
+  ckpt_timer_.tic();
+  bool due = (ckpt_epochs_ > 0 && (epoch + 1) % ckpt_epochs_ == 0) ||
+             (ckpt_seconds_ > 0 && ckpt_timer_.get() >= ckpt_seconds_);
+  if (!due) { return; }
+  ckpt_timer_.reset();
+  // The time that the training waits for
+  ScopedPhase phase("checkpoint");
+  // The last checkpoint still uses the copy
+  wait_checkpoint();
+  ckpt_updater_->Flush(model_->GetParameter_w(),
+                       model_->GetNumFeature());
+  // The first checkpoint is the base of the deltas
+  bool delta = ckpt_delta_ && ckpt_model_ != nullptr;
+  if (ckpt_delta_) { model_->TakeDirtyFeatures(&ckpt_ids_); }
+  if (ckpt_model_ == nullptr) { ckpt_model_.reset(new Model()); }
+  ckpt_model_->CopyWeights(*model_);
+  std::string filename = ckpt_file_;
+  if (delta) {
+    filename += ".delta." + std::to_string(++ckpt_num_delta_);
+  }
+  ckpt_thread_ = std::thread([this, epoch, delta, filename]() {
+    TraceLog::Get().NameThread("checkpoint");
+    ScopedTrace trace("write checkpoint", "checkpoint");
+    Timer timer;
+    timer.tic();
+    std::string tmp_file = ckpt_file_ + ".tmp";
+    if (delta) {
+      ckpt_model_->SerializeSparse(tmp_file, ckpt_ids_);
+    } else if (ckpt_mapped_) {
+      ckpt_model_->SerializeMapped(tmp_file);
+    } else if (ckpt_chunked_) {
+      ckpt_model_->SerializeChunked(tmp_file, true);
+    } else {
+      ckpt_model_->Serialize(tmp_file, true);
+    }
+    if (rename(tmp_file.c_str(), filename.c_str()) != 0) {
+      LOG(ERROR) << "Cannot rename " << tmp_file
+                 << " to " << filename;
+      return;
+    }
+    // The deltas share the filter of the first checkpoint
+    if (ckpt_admission_ != nullptr) {
+      std::string admit_file = ckpt_file_ + ".admit";
+      ckpt_admission_->Serialize(tmp_file);
+      if (rename(tmp_file.c_str(), admit_file.c_str()) != 0) {
+        LOG(ERROR) << "Cannot rename " << tmp_file
+                   << " to " << admit_file;
+      }
+    }
+    LOG(INFO) << "Save checkpoint of " << (online_ ? "batch " : "epoch ")
+              << epoch << " to " << filename << " in "
+              << timer.toc() << " sec";
+  });
+}
+
+void Trainer::wait_checkpoint() {
+  if (ckpt_thread_.joinable()) { ckpt_thread_.join(); }
+}
+
+// The former state is removed before the model is written, and
+// the state is renamed last, so the state always comes with its
+// model. The deferred regular of the lazy updater is not flushed,
+// since the state keeps its step
+bool Trainer::save_resume(ResumeState* state,
+                          std::vector<Reader*>& train_reader) {
+  ScopedPhase phase("save resume state");
+  Timer timer;
+  timer.tic();
+  state->readers.resize(train_reader.size());
+  for (size_t i = 0; i < train_reader.size(); ++i) {
+    if (!train_reader[i]->SaveState(&state->readers[i])) {
+      printf("[Warning] The state of the Reader cannot be saved, "
+             "and the training cannot be resumed. \n");
+      return false;
+    }
+  }
+  std::string state_file = resume_file_ + ".state";
+  std::string tmp_file = resume_file_ + ".tmp";
+  if (FileExist(state_file.c_str())) { RemoveFile(state_file.c_str()); }
+  model_->Serialize(tmp_file, false);
+  if (rename(tmp_file.c_str(), resume_file_.c_str()) != 0) {
+    LOG(ERROR) << "Cannot rename " << tmp_file << " to " << resume_file_;
+    return false;
+  }
+  FILE* file = OpenFileOrDie(tmp_file.c_str(), "wb");
+  uint32 step = resume_updater_->Step();
+  uint8 has_best = !state->best_model.empty();
+  WriteDataToDisk(file, (char*)&kResumeMagic, sizeof(kResumeMagic));
+  WriteDataToDisk(file, (char*)&state->epoch, sizeof(state->epoch));
+  WriteDataToDisk(file, (char*)&state->batch, sizeof(state->batch));
+  WriteDataToDisk(file, (char*)&step, sizeof(step));
+  WriteDataToDisk(file, (char*)&state->num_valid, sizeof(state->num_valid));
+  WriteDataToDisk(file, (char*)&state->best_valid,
+                  sizeof(state->best_valid));
+  WriteDataToDisk(file, (char*)&state->best_epoch,
+                  sizeof(state->best_epoch));
+  WriteDataToDisk(file, (char*)&state->best_batch,
+                  sizeof(state->best_batch));
+  WriteDataToDisk(file, (char*)&state->best_metric,
+                  sizeof(state->best_metric));
+  WriteDataToDisk(file, (char*)&has_best, sizeof(has_best));
+  if (has_best) { WriteVectorToFile(file, state->best_model); }
+  uint64 num_reader = state->readers.size();
+  WriteDataToDisk(file, (char*)&num_reader, sizeof(num_reader));
+  for (size_t i = 0; i < state->readers.size(); ++i) {
+    WriteStringToFile(file, state->readers[i]);
+  }
+  Close(file);
+  if (rename(tmp_file.c_str(), state_file.c_str()) != 0) {
+    LOG(ERROR) << "Cannot rename " << tmp_file << " to " << state_file;
+    return false;
+  }
+  printf("Preempted at epoch %d, batch %d, and save the state to %s "
+         "in %.2f sec \n", state->epoch, state->batch,
+         resume_file_.c_str(), timer.toc());
+  LOG(INFO) << "Save the resume state of epoch " << state->epoch
+            << ", batch " << state->batch << " to " << resume_file_;
+  return true;
+}
+
+bool Trainer::load_resume(ResumeState* state,
+                          std::vector<Reader*>& train_reader) {
+  std::string state_file = resume_file_ + ".state";
+  if (!FileExist(resume_file_.c_str()) ||
+      !FileExist(state_file.c_str())) {
+    return false;
+  }
+  FILE* file = OpenFileOrDie(state_file.c_str(), "rb");
+  uint64 magic = 0;
+  uint32 step = 0;
+  uint8 has_best = 0;
+  uint64 num_reader = 0;
+  ReadDataFromDisk(file, (char*)&magic, sizeof(magic));
+  if (magic != kResumeMagic) {
+    LOG(FATAL) << state_file << " is not a resume state";
+  }
+  ReadDataFromDisk(file, (char*)&state->epoch, sizeof(state->epoch));
+  ReadDataFromDisk(file, (char*)&state->batch, sizeof(state->batch));
+  ReadDataFromDisk(file, (char*)&step, sizeof(step));
+  ReadDataFromDisk(file, (char*)&state->num_valid, sizeof(state->num_valid));
+  ReadDataFromDisk(file, (char*)&state->best_valid,
+                   sizeof(state->best_valid));
+  ReadDataFromDisk(file, (char*)&state->best_epoch,
+                   sizeof(state->best_epoch));
+  ReadDataFromDisk(file, (char*)&state->best_batch,
+                   sizeof(state->best_batch));
+  ReadDataFromDisk(file, (char*)&state->best_metric,
+                   sizeof(state->best_metric));
+  ReadDataFromDisk(file, (char*)&has_best, sizeof(has_best));
+  if (has_best) { ReadVectorFromFile(file, state->best_model); }
+  ReadDataFromDisk(file, (char*)&num_reader, sizeof(num_reader));
+  if (num_reader != train_reader.size()) {
+    LOG(FATAL) << state_file << " has " << num_reader
+               << " Readers, which is not the training";
+  }
+  state->readers.resize(num_reader);
+  for (size_t i = 0; i < num_reader; ++i) {
+    ReadStringFromFile(file, state->readers[i]);
+    if (!train_reader[i]->LoadState(state->readers[i])) {
+      LOG(FATAL) << "The state of the Reader in " << state_file
+                 << " does not match the training set";
+    }
+  }
+  Close(file);
+  resume_updater_->SetStep(step);
+  printf("Resume from epoch %d, batch %d of %s \n", state->epoch,
+         state->batch, resume_file_.c_str());
+  LOG(INFO) << "Resume from epoch " << state->epoch << ", batch "
+            << state->batch << " of " << resume_file_;
+  return true;
+}
+
+// The clock of the update time is the seconds since the start
+// of the training, and it is advanced every second. The whole
+// model is swept every tenth of the time-to-live
+void Trainer::start_sweeper() {
+  if (evict_ttl_ == 0) { return; }
+  CHECK_NOTNULL(model_->GetUpdateStamps());
+  sweep_stop_.store(false);
+  sweep_thread_ = std::thread([this]() {
+    TraceLog::Get().NameThread("sweeper");
+    FeatureStamps* stamps = model_->GetUpdateStamps();
+    index_t num_feat = model_->GetNumFeature();
+    uint32 interval = std::max(evict_ttl_ / 10, (uint32)1);
+    uint32 next_sweep = interval;
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(sweep_mutex_);
+    while (!sweep_cv_.wait_for(lock, std::chrono::seconds(1),
+                               [this]() { return sweep_stop_.load(); })) {
+      uint32 now = 1 + std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::steady_clock::now() - start).count();
+      stamps->clock.store(now, std::memory_order_relaxed);
+      if (now < next_sweep) { continue; }
+      next_sweep = now + interval;
+      lock.unlock();
+      uint64 evicted = 0;
+      for (index_t i = 0; i < num_feat && !sweep_stop_.load();
+           i += kSweepChunk) {
+        index_t end = std::min(num_feat, i + kSweepChunk);
+        evicted += model_->EvictStale(evict_ttl_, i, end);
+        std::this_thread::yield();
+      }
+      num_evicted_.fetch_add(evicted);
+      if (evicted > 0) {
+        LOG(INFO) << "Evict " << evicted << " stale features at "
+                  << now << " sec";
+      }
+      lock.lock();
+    }
+  });
+}
+
+void Trainer::stop_sweeper() {
+  if (!sweep_thread_.joinable()) { return; }
+  {
+    std::lock_guard<std::mutex> lock(sweep_mutex_);
+    sweep_stop_.store(true);
+  }
+  sweep_cv_.notify_all();
+  sweep_thread_.join();
+}
+
 // The basic
 void Trainer::Train() {
   // Get train Reader and test Reader
@@ -162,6 +1237,7 @@ void Trainer::Train() {
   if (reader_list_.size() == 2) {
     te_reader.push_back(reader_list_[1]);
   }
+  train_end_ = budget_end_;
   this->train(tr_reader, te_reader);
 }
 
@@ -170,20 +1246,32 @@ void Trainer::CVTrain() {
   // Use the i-th reader as validation Reader
   for (int i = 0; i < reader_list_.size(); ++i) {
     printf("Cross-validation: %d/%lu: \n", i+1, reader_list_.size());
-    // Get the train Reader and test Reader
-    std::vector<Reader*> tr_reader;
-    for (int j = 0; j < reader_list_.size(); ++j) {
-      if (i == j) { continue; }
-      tr_reader.push_back(reader_list_[j]);
-    }
-    std::vector<Reader*> te_reader;
-    te_reader.push_back(reader_list_[i]);
     if (i != 0) {
       // Re-init current model parameters
       model_->Reset();
     }
-    this->train(tr_reader, te_reader);
+    if (budget_) {
+      auto now = std::chrono::steady_clock::now();
+      train_end_ = now + (budget_end_ - now) / (reader_list_.size() - i);
+    }
+    TrainFold(i);
   }
 }
 
+void Trainer::TrainFold(int i) {
+  CHECK_GE(i, 0);
+  CHECK_LT(i, reader_list_.size());
+  // Get the train Reader and test Reader
+  std::vector<Reader*> tr_reader;
+  for (int j = 0; j < reader_list_.size(); ++j) {
+    if (i == j) { continue; }
+    tr_reader.push_back(reader_list_[j]);
+  }
+  std::vector<Reader*> te_reader;
+  te_reader.push_back(reader_list_[i]);
+  fold_ = i;
+  this->train(tr_reader, te_reader);
+  fold_ = -1;
+}
+
 } // namespace xLearn
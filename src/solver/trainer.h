@@ -23,25 +23,204 @@ This file defines the Trainer class.
 #ifndef XLEARN_SOLVER_TRAINER_H_
 #define XLEARN_SOLVER_TRAINER_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "src/base/common.h"
 #include "src/reader/reader.h"
+#include "src/data/admission_filter.h"
 #include "src/data/model_parameters.h"
+#include "src/distributed/ring_allreduce.h"
 #include "src/loss/loss.h"
 #include "src/loss/metric.h"
+#include "src/score/updater.h"
+#include "src/solver/batch_tuner.h"
+#include "src/solver/batch_solver.h"
+#include "src/solver/metrics_log.h"
 
 namespace xLearn {
 
 struct MetricInfo {
   real_t loss_val;
+  /* The first metric, which is used by early-stopping */
   real_t metric_val;
+  /* All the metrics, which are computed in the same pass */
+  std::vector<real_t> metric_vals;
+  /* Standard error of the loss_val evaluated on a sample
+  of the rows, and 0 if all the rows are evaluated */
+  real_t loss_stderr;
+};
+
+// The work and the time of an epoch, which are shown as
+// the throughput of the epoch
+struct EpochInfo {
+  index_t rows = 0;
+  /* Number of the batches of the gradient pass */
+  index_t batches = 0;
+  /* Number of nodes of the rows */
+  uint64 nnz = 0;
+  /* Number of the pairs of nodes in the rows, i.e., the
+  field-aware interactions computed by ffm */
+  uint64 pairs = 0;
+  /* Time (sec) of the gradient pass and the validation */
+  real_t update_time = 0;
+  real_t eval_time = 0;
+  /* Load of the threads in the gradient pass */
+  real_t imbalance = 0;
+  real_t utilization = 0;
+  /* Mean and max straggler ratio of the batches, and the
+  time (sec) the main thread waits for the pool */
+  real_t straggler = 0;
+  real_t straggler_max = 0;
+  real_t sync_time = 0;
+  real_t tail_time = 0;
 };
 
 //------------------------------------------------------------------------------
 // Trainer is the core class of xLearn, which can perform standard training
 // process (training set and test set) and cross_validation training process.
+//
+// By default, the validation of each epoch is done before the next epoch.
+// For the large test set, the weights of the model can be copied at the
+// end of each epoch and validated by the background threads of another
+// Loss, and the training goes on at once. The result of an epoch is shown
+// when its validation is done, and it is used by early-stopping at the end
+// of the next epoch, so the training can run one epoch more than the
+// synchronous one. At most one validation is in flight:
+//
+//   trainer.SetAsyncValidation(valid_loss, valid_metric);
+//
+// For the huge training set, the model can also be validated every N batches
+// of Samples() inside the epochs, synchronously or asynchronously as above.
+// Early-stopping then counts the stop window in validations, and restores the
+// model of the best batch:
+//
+//   trainer.SetValidBatches(1000);
+//
+// For the long training, a checkpoint of the model can be saved every N
+// epochs, or at the end of the first epoch after M seconds. The weights
+// of the model are copied at the end of the epoch, and the copy is
+// written to a temporary file and renamed to the checkpoint file by a
+// background thread, so the training does not wait for the disk and the
+// checkpoint file is always complete. At most one checkpoint is in flight:
+//
+//   trainer.SetCheckpoint("/tmp/model.ckpt", 5, 0, updater, false);
+//
+// For the incremental deployment, the checkpoints after the first one can
+// be the deltas of the features updated since the last checkpoint, which
+// are model.ckpt.delta.1, model.ckpt.delta.2, ... and are applied to the
+// first checkpoint in order (Model::ApplyDelta). The model needs to track
+// the updated features (Model::TrackDirtyFeatures) before the training:
+//
+//   trainer.SetCheckpointDelta(true);
+//
+// The full checkpoints can be in the chunked format, whose chunks are
+// checked by their CRC32C when they are loaded (Model::SerializeChunked):
+//
+//   trainer.SetCheckpointChunked(true);
+//
+// The online training makes one pass over an unbounded stream of data
+// (see StreamReader::SetOnline), and the checkpoints are saved during the
+// pass, every N batches or after M seconds, instead of after the epochs:
+//
+//   trainer.SetOnline(true);
+//
+// The online model can evict the features that are not updated for a
+// time-to-live, whose parameters are reset to the initial ones, so the
+// slots of the stale hashed ids are recycled for the new ones. The
+// features are swept by a background thread in small pieces, and the
+// model needs to track the update time (Model::TrackUpdateTime):
+//
+//   trainer.SetEviction(24 * 3600);       /* one day */
+//
+// The train loss and metric of an epoch are the running ones of the scores
+// before each update by default. For a clean train metric of the model at
+// the end of each epoch, a fixed random sample of the train rows (e.g., 1%)
+// is copied before the first epoch and evaluated after each epoch, and the
+// standard error of the sampled loss is shown along with it:
+//
+//   trainer.SetTrainSample(0.01);
+//
+// After the first epoch, most rows have a near-zero gradient. The update pass
+// of the later epochs can keep each row with a probability proportional to
+// its loss of the last time it was updated, so that about the given rate of
+// the rows are updated in each epoch, and a kept row is weighted by the
+// inverse of its probability (see Reader::SetRowProb()):
+//
+//   trainer.SetLossSample(0.3);
+//
+// The batch size (sample_size) of the in-memory training can be tuned by the
+// rows/sec of the batches of the first epoch (see BatchTuner), with the
+// batches no larger than the bytes, and the chosen size is used after that:
+//
+//   trainer.SetAutoBatch(20000, 64 << 20);
+//
+// The caller can watch the test metric of each epoch, e.g., the search of
+// the hyper-parameters (see search_main.cc), and stop a poor training early:
+//
+//   trainer.SetEpochCallback([](int epoch, const MetricInfo& te_info) {
+//     return te_info.metric_val < 0.6;   /* true stops the training */
+//   });
+//
+// Other models of the same rows, e.g., of other losses or K, or the linear
+// baseline of an fm model, can be trained in the same pass over the data
+// (see Loss::CalcGradMulti), so the reading and the decoding of the rows
+// are paid once for all the models:
+//
+//   trainer.AddModel(&lr_model, &lr_loss, &lr_metric);
+//
+// The training on the preemptible nodes can be resumed. After the call of
+// RequestPreemption(), e.g., by the handler of SIGTERM, the training saves
+// its state at the end of the current batch and stops: the model with its
+// gradient caches to the file, and the epoch, the early-stopping, the step
+// of the updater and the order and the position of the train Readers to
+// the file + ".state", which is written last. The next run restores the
+// model from the file by warm-start, and continues at the same row:
+//
+//   trainer.SetResume("/tmp/model.resume", updater);
+//
+// The training in a fixed window of time can have a wall-clock budget. The
+// time of each epoch is measured, and the next epoch is started only if the
+// time left holds a useful part of it. The pass over the rows is stopped in
+// time for the validation after it, whose time is measured by the last epoch
+// and is at least a tenth of the time left, so the last epoch may train on
+// a part of the data. The model of the best validation is kept, as early-stopping does:
+//
+//   trainer.SetTimeBudget(3600);       /* one hour */
+//
+// The linear and fm models can be trained by a full-batch solver instead
+// of the SGD of the Loss (see batch_solver.h), the coordinate descent or
+// L-BFGS, whose epoch runs on the rows it copied at loading. The
+// validation, the early-stopping and the checkpoints of the epochs are the
+// same:
+//
+//   trainer.SetBatchSolver(&cd);
 //------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// TrainStats records the number of rows and the time (sec) of the gradient
+// pass of each epoch in Train(), and the time of reading the data, which
+// are reported by the benchmark of training (bench_train.cc). The nnz and
+// pairs of each epoch are recorded along with the rows
+//------------------------------------------------------------------------------
+struct TrainStats {
+  real_t parse_time = 0;
+  real_t cache_time = 0;
+  std::vector<index_t> epoch_rows;
+  std::vector<real_t> epoch_time;
+  std::vector<uint64> epoch_nnz;
+  std::vector<uint64> epoch_pairs;
+};
+
+// Ask the training of Trainer::SetResume() to save its state and
+// stop after the current batch. It is async-signal-safe
+void RequestPreemption();
+
 class Trainer {
  public:
   Trainer() {}
@@ -54,12 +233,14 @@ class Trainer {
                   Loss* loss,
                   Metric* metric,
                   bool early_stop,
-                  bool quiet) {
+                  bool quiet,
+                  int stop_window = 2) {
     CHECK_NE(reader_list.empty(), true);
     CHECK_GT(epoch, 0);
     CHECK_NOTNULL(model);
     CHECK_NOTNULL(loss);
     CHECK_NOTNULL(metric);
+    CHECK_GT(stop_window, 0);
     reader_list_ = reader_list;
     epoch_ = epoch;
     model_ = model;
@@ -67,18 +248,214 @@ class Trainer {
     metric_ = metric;
     early_stop_ = early_stop;
     quiet_ = quiet;
+    stop_window_ = stop_window;
+  }
+
+  // Validate a weights-only copy of the model by the threads
+  // of valid_loss and the valid_metric, which are not used by
+  // the training
+  void SetAsyncValidation(Loss* valid_loss, Metric* valid_metric) {
+    CHECK_NOTNULL(valid_loss);
+    CHECK_NOTNULL(valid_metric);
+    valid_loss_ = valid_loss;
+    valid_metric_ = valid_metric;
+  }
+
+  // Validate the model every batches batches of each epoch,
+  // besides the end of each epoch
+  void SetValidBatches(index_t batches) {
+    CHECK_GT(batches, 0);
+    valid_batches_ = batches;
+  }
+
+  // Save the weights-only checkpoint of the model to filename
+  // every epochs epochs (0 for never), and at the end of the epoch
+  // after seconds seconds since the last one (0 for never). The
+  // deferred regular of the updater is applied before the copy.
+  // The checkpoint is memory-mappable if mapped is true
+  void SetCheckpoint(const std::string& filename,
+                     int epochs,
+                     real_t seconds,
+                     const Updater* updater,
+                     bool mapped = false) {
+    CHECK(!filename.empty());
+    CHECK_GE(epochs, 0);
+    CHECK_GE(seconds, 0);
+    CHECK_NOTNULL(updater);
+    ckpt_file_ = filename;
+    ckpt_epochs_ = epochs;
+    ckpt_seconds_ = seconds;
+    ckpt_updater_ = updater;
+    ckpt_mapped_ = mapped;
+  }
+
+  // Write the delta of the features updated since the last
+  // checkpoint instead of the checkpoint after the first one,
+  // which needs Model::TrackDirtyFeatures()
+  void SetCheckpointDelta(bool delta) {
+    ckpt_delta_ = delta;
+  }
+
+  // Write the checkpoints (but the deltas) in the chunked
+  // format of Model::SerializeChunked()
+  void SetCheckpointChunked(bool chunked) {
+    ckpt_chunked_ = chunked;
+  }
+
+  // Write the counts of the filter of the online features to
+  // the checkpoint file + ".admit" with each checkpoint, so
+  // the checkpoint is predicted as the model of -admit
+  void SetCheckpointAdmission(const AdmissionFilter* filter) {
+    ckpt_admission_ = filter;
+  }
+
+  // Save the checkpoints after the batches of the epoch, whose
+  // interval of SetCheckpoint() is in batches instead of epochs,
+  // for the online training of a single epoch
+  void SetOnline(bool online) {
+    online_ = online;
+  }
+
+  // Evict the features that are not updated for ttl seconds
+  // by a background thread during the training
+  void SetEviction(uint32 ttl_seconds) {
+    evict_ttl_ = ttl_seconds;
+  }
+
+  // Number of the features evicted by the training
+  inline uint64 NumEvicted() const { return num_evicted_.load(); }
+
+  // Evaluate the train loss and metric of each epoch
+  // on a fixed sample of this fraction of the train rows
+  void SetTrainSample(real_t fraction) {
+    CHECK_GT(fraction, 0);
+    CHECK_LE(fraction, 1);
+    sample_fraction_ = fraction;
+  }
+
+  // Update about this rate of the rows in each epoch after
+  // the first, which are sampled by their loss. Only a single
+  // in-memory train Reader is supported
+  void SetLossSample(real_t rate) {
+    CHECK_GT(rate, 0);
+    CHECK_LE(rate, 1);
+    loss_sample_ = rate;
+  }
+
+  // Tune the batch size of the train Readers, starting around
+  // base, during the first epoch. Only the in-memory train
+  // Readers support it, and it is ignored for the others
+  void SetAutoBatch(int base, uint64 max_bytes) {
+    tuner_.reset(new BatchTuner(base, max_bytes));
+  }
+
+  // Average the model of the nodes of the ring every batches
+  // batches (0 for never), and at the end of each epoch. All
+  // the nodes of the ring should train the same epochs
+  void SetModelAverage(RingAllReduce* ring, index_t batches) {
+    CHECK_NOTNULL(ring);
+    ring_ = ring;
+    sync_batches_ = batches;
+  }
+
+  // Write an "epoch" record of each epoch to the log
+  void SetMetricsLog(MetricsLog* log) { metrics_log_ = log; }
+
+  // Train the model by the loss along with the model of Initialize()
+  // in each pass over the rows. The loss has as many threads as the
+  // loss of Initialize(), and the model is evaluated by the metric on
+  // the test set after each epoch unless it is quiet. It is not used
+  // by early-stopping, the checkpoints and the samples of the rows
+  void AddModel(Model* model, Loss* loss, Metric* metric) {
+    CHECK_NOTNULL(model);
+    CHECK_NOTNULL(loss);
+    CHECK_NOTNULL(metric);
+    extra_.push_back({model, loss, metric});
+  }
+
+  // Train each epoch by the full-batch solver, which is
+  // initialized on the train Readers. The train info is
+  // the loss of the scores after the epoch
+  void SetBatchSolver(BatchSolver* batch) {
+    CHECK_NOTNULL(batch);
+    batch_ = batch;
+  }
+
+  // Call the callback with the test metric after the validation
+  // of each epoch, even in the quiet mode, and stop the training
+  // if it returns true. It is not called by the async validation
+  void SetEpochCallback(
+      const std::function<bool(int, const MetricInfo&)>& callback) {
+    on_epoch_ = callback;
+  }
+
+  // Save the state of the training to filename (and filename +
+  // ".state") when RequestPreemption() is called, and stop. If the
+  // state exists, the training continues from it, whose model is
+  // already restored from filename. Only the in-memory train Reader
+  // of Train() is supported, without the async validation
+  void SetResume(const std::string& filename, Updater* updater) {
+    CHECK(!filename.empty());
+    CHECK_NOTNULL(updater);
+    resume_file_ = filename;
+    resume_updater_ = updater;
+  }
+
+  // True if the training is stopped by the preemption
+  bool Preempted() const { return preempted_; }
+
+  // Finish the training in the seconds from now. The folds of
+  // cross-validation share the time left evenly
+  void SetTimeBudget(real_t seconds) {
+    budget_ = true;
+    budget_end_ = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds((int64)(std::max(seconds, (real_t)0) * 1000));
   }
 
   // Training without cross-validation
+  // The rows and time of the epochs of Train()
+  const TrainStats& Stats() const { return stats_; }
+
   void Train();
 
   // Training using cross-validation
   void CVTrain();
 
-  // Save model to disk file
-  void SaveModel(const std::string& filename) {
+  // Train the model of one fold of the cross-validation, whose
+  // test set is the i-th Reader and whose train set is the others.
+  // The folds of different Trainers (and models and Readers) can
+  // be trained at the same time
+  void TrainFold(int i);
+
+  // Save model to disk file. The weights-only file has
+  // no gradient cache and can only be used by prediction,
+  // and so do the memory-mappable file and the sparse file
+  void SaveModel(const std::string& filename,
+                 bool weights_only = false,
+                 bool mapped = false,
+                 bool sparse = false,
+                 bool chunked = false) {
+    SaveModel(model_, filename, weights_only, mapped, sparse, chunked);
+  }
+
+  // Save the given model in the format of SaveModel(),
+  // e.g., the models of AddModel()
+  static void SaveModel(Model* model,
+                        const std::string& filename,
+                        bool weights_only,
+                        bool mapped,
+                        bool sparse,
+                        bool chunked) {
     CHECK_NE(filename.compare("none"), 0);
-    model_->Serialize(filename);
+    if (sparse) {
+      model->SerializeSparse(filename);
+    } else if (mapped) {
+      model->SerializeMapped(filename);
+    } else if (chunked) {
+      model->SerializeChunked(filename, weights_only);
+    } else {
+      model->Serialize(filename, weights_only);
+    }
   }
 
  protected:
@@ -89,21 +466,268 @@ class Trainer {
   Metric* metric_;
   bool early_stop_;
   bool quiet_;
+  /* Training is stopped if the test metric has not been
+  improved for stop_window_ validations in early-stopping */
+  int stop_window_;
+  /* Snapshot of the best model in early-stopping */
+  std::vector<real_t> best_model_;
+  /* The Loss and Metric of the asynchronous validation,
+  which is synchronous if valid_loss_ is nullptr */
+  Loss* valid_loss_ = nullptr;
+  Metric* valid_metric_ = nullptr;
+  /* The weights-only copy of the model in validation, and
+  the copy of the best epoch of asynchronous early-stopping */
+  std::unique_ptr<Model> valid_model_;
+  std::unique_ptr<Model> best_valid_model_;
+  /* The thread of the validation, and its epoch, batch (0
+  for the end of epoch), index among the validations and
+  result. num_valid_ is the number of the validations */
+  std::thread valid_thread_;
+  int valid_epoch_ = -1;
+  index_t valid_batch_ = 0;
+  int valid_index_ = -1;
+  MetricInfo valid_info_;
+  int num_valid_ = 0;
+  /* Validate every valid_batches_ batches of each
+  epoch, which is not used if it is 0 */
+  index_t valid_batches_ = 0;
+  /* The checkpoint file, and the interval of checkpoints in
+  epochs and in seconds, which is not used if they are 0 */
+  std::string ckpt_file_;
+  int ckpt_epochs_ = 0;
+  real_t ckpt_seconds_ = 0;
+  const Updater* ckpt_updater_ = nullptr;
+  bool ckpt_mapped_ = false;
+  bool ckpt_chunked_ = false;
+  const AdmissionFilter* ckpt_admission_ = nullptr;
+  /* Write the deltas after the first checkpoint, the features of
+  the next delta, and the number of the written deltas */
+  bool ckpt_delta_ = false;
+  std::vector<index_t> ckpt_ids_;
+  int ckpt_num_delta_ = 0;
+  /* The checkpoints are saved after the batches */
+  bool online_ = false;
+  /* The weights-only copy of the model in the checkpoint,
+  and the thread which writes it to disk */
+  std::unique_ptr<Model> ckpt_model_;
+  std::thread ckpt_thread_;
+  Timer ckpt_timer_;
+  /* The time-to-live of the features in seconds, which is not
+  used if it is 0, the thread which sweeps the stale features,
+  and the number of the evicted features */
+  uint32 evict_ttl_ = 0;
+  std::thread sweep_thread_;
+  std::mutex sweep_mutex_;
+  std::condition_variable sweep_cv_;
+  std::atomic<bool> sweep_stop_{false};
+  std::atomic<uint64> num_evicted_{0};
+
+  /* The fraction of the sample of the train rows, which is
+  not used if it is 0, the batches of the sampled rows, and
+  the number of the sampled rows and of all the train rows */
+  real_t sample_fraction_ = 0;
+  std::vector<std::unique_ptr<DMatrix>> sample_;
+  index_t sample_rows_ = 0;
+  index_t sample_total_ = 0;
+
+  /* The rate of the rows updated in each epoch after the first,
+  which is not used if it is 0, the loss of each train row of the
+  last time it was updated, and the probability of keeping it */
+  real_t loss_sample_ = 0;
+  std::vector<real_t> row_loss_;
+  std::vector<real_t> row_prob_;
+
+  /* The tuning of the batch size, which is not used if it is
+  nullptr, and it is kept for the folds of cross-validation */
+  std::unique_ptr<BatchTuner> tuner_;
+
+  /* The ring of the data-parallel nodes, which is not used if it
+  is nullptr, and the model is averaged every sync_batches_ batches
+  of each epoch (0 for the end of each epoch only) */
+  RingAllReduce* ring_ = nullptr;
+  index_t sync_batches_ = 0;
+
+  /* Rows and time of each epoch */
+  TrainStats stats_;
+  /* The log of the epochs, or nullptr */
+  MetricsLog* metrics_log_ = nullptr;
+  /* The callback of each epoch (see SetEpochCallback) */
+  std::function<bool(int, const MetricInfo&)> on_epoch_;
+  /* The models trained along with model_ (see AddModel) */
+  struct ExtraModel {
+    Model* model;
+    Loss* loss;
+    Metric* metric;
+  };
+  std::vector<ExtraModel> extra_;
+  /* The full-batch solver of each epoch, or nullptr */
+  BatchSolver* batch_ = nullptr;
+  /* The file of the resume state, which is not used if it is
+  empty, and the updater whose step is saved. The resume_pass_
+  continues at the position of the restored Readers, and the
+  preempted_ training is stopped after its state is saved */
+  std::string resume_file_;
+  Updater* resume_updater_ = nullptr;
+  bool resume_pass_ = false;
+  bool preempted_ = false;
+  /* The end of the time budget, of the current train() and of
+  the current pass over the rows, which are not used if budget_
+  is false, and budget_cut_ is set if the pass is stopped */
+  bool budget_ = false;
+  std::chrono::steady_clock::time_point budget_end_;
+  std::chrono::steady_clock::time_point train_end_;
+  std::chrono::steady_clock::time_point pass_end_;
+  bool budget_cut_ = false;
+  /* The state of train() that is saved at the preemption */
+  struct ResumeState {
+    /* The epoch and the batches done in it */
+    int epoch = 0;
+    index_t batch = 0;
+    /* The early-stopping */
+    int num_valid = 0;
+    int best_valid = -1;
+    int best_epoch = -1;
+    index_t best_batch = 0;
+    real_t best_metric = 0;
+    std::vector<real_t> best_model;
+    /* The states of the train Readers */
+    std::vector<std::string> readers;
+  };
+  /* Current fold of cross-validation, or -1 */
+  int fold_ = -1;
 
   // Basic train function
   void train(std::vector<Reader*> train_reader,
              std::vector<Reader*> test_reader);
 
   void show_head_info(bool validate);
-  void show_train_info(real_t tr_loss, real_t tr_metric,
-                       real_t te_loss, real_t te_metric,
+  void show_train_info(const MetricInfo& tr_info,
+                       const MetricInfo& te_info,
                        real_t time_cost, bool validate,
-                       index_t n);
+                       index_t n, const EpochInfo& epoch);
+  // Show the test loss and metric of the models of AddModel()
+  void show_extra_info(std::vector<Reader*>& test_reader);
+
+  // Caculate gradient and update model, and
+  // return the number of the trained rows. If info is
+  // not null, it gets the running loss and metric of
+  // the scores computed before each update. If epoch is
+  // not null, it gets the rows, nnz and pairs. The
+  // on_batch is invoked after each batch if it is not
+  // null, and the epoch is stopped if it returns true
+  index_t CalcGradUpdate(std::vector<Reader*>& reader_list,
+                         MetricInfo* info = nullptr,
+                         EpochInfo* epoch = nullptr,
+                         const std::function<bool()>* on_batch = nullptr);
+
+  // CalcGradUpdate() of the full-batch solver of SetBatchSolver()
+  index_t batch_epoch(MetricInfo* info, EpochInfo* epoch);
+
+  // Set the batch size of the tuner_ to the train Readers.
+  // Return false if a Reader cannot change it
+  bool set_batch_size(std::vector<Reader*>& reader_list);
+
+  // Record a batch of the tuning, or end the tuning if the
+  // rows is 0, and log the chosen size
+  void tune_batch(index_t rows, double seconds, uint64 bytes,
+                  std::vector<Reader*>& reader_list);
+
+  // Write the "epoch" record to metrics_log_. The train and
+  // the test info are skipped if they are nullptr
+  void record_epoch(int n, const MetricInfo* tr_info,
+                    const MetricInfo* te_info, real_t time_cost,
+                    const EpochInfo& epoch);
 
-  // Caculate gradient and update model
-  void CalcGradUpdate(std::vector<Reader*>& reader_list);
+  // The JSON object of all the metrics of the info
+  std::string metrics_json(const MetricInfo& info);
+
+  // True if the pairs of nodes are shown, i.e., for ffm
+  bool show_pairs() {
+    return model_->GetScoreFunction().compare("ffm") == 0;
+  }
+
+  // Show the throughput of the gradient pass, which
+  // compares the thread modes of the loss
+  void show_throughput(index_t num_rows, real_t time_cost,
+                       const LoadStats& load);
+
+  // Log the busy time of the threads in the gradient
+  // pass of an epoch, and the imbalance of them
+  void log_load(int epoch, const LoadStats& load);
   // Calculate loss value and evaluation metric
-  MetricInfo CalcLossMetric(std::vector<Reader*>& reader_list);
+  MetricInfo CalcLossMetric(std::vector<Reader*>& reader_list) {
+    return CalcLossMetric(reader_list, model_, loss_, metric_);
+  }
+
+  // Calculate loss value and evaluation metric of the model
+  // by the loss and the metric
+  MetricInfo CalcLossMetric(std::vector<Reader*>& reader_list,
+                            Model* model,
+                            Loss* loss,
+                            Metric* metric);
+
+  // Copy a fixed random sample of sample_fraction_ of the
+  // rows of the readers into sample_
+  void sample_train_set(std::vector<Reader*>& reader_list);
+
+  // Calculate the loss value and the metric of the model on
+  // the sample_, and the standard error of the loss value
+  MetricInfo CalcSampleMetric();
+
+  // True if the train info is evaluated on the sample_
+  bool use_sample() const { return sample_fraction_ > 0 && !quiet_; }
+
+  // Record the loss of the rows of the matrix, which
+  // are the last Samples() of the reader, in row_loss_
+  void record_row_loss(const Reader* reader, const DMatrix* matrix,
+                       const std::vector<real_t>& pred);
+
+  // Set the probability of keeping each row in the next
+  // epoch of the reader by row_loss_
+  void update_row_prob(Reader* reader);
+
+  // Average the model of the nodes of the ring, and return
+  // the number of the nodes that are still in the epoch
+  int average_model(bool active);
+
+  // Copy the weights of the model, and start the validation
+  // of the copy in the background. The batch is 0 for the
+  // end of the epoch, otherwise the train info is not used
+  void start_valid(std::vector<Reader*>& test_reader, int epoch,
+                   index_t batch, const MetricInfo& tr_info,
+                   real_t time_cost, const EpochInfo& epoch_info);
+
+  // Show the test info of the validation after the batch
+  // of the epoch
+  void show_batch_info(int epoch, index_t batch,
+                       const MetricInfo& te_info);
+
+  // Wait for the validation in the background, and return
+  // its epoch, or -1 if there is no validation
+  int wait_valid();
+
+  // Copy the weights of the model at the end of the epoch (or
+  // the batch of the online training), and start writing the
+  // copy in the background if a checkpoint is due
+  void checkpoint(int epoch);
+
+  // Wait for the checkpoint in the background
+  void wait_checkpoint();
+
+  // Write the model and the state to resume_file_, and return
+  // false if a Reader cannot save its state
+  bool save_resume(ResumeState* state,
+                   std::vector<Reader*>& train_reader);
+
+  // Read the state of resume_file_ and restore the Readers and
+  // the updater. Return false if there is no state
+  bool load_resume(ResumeState* state,
+                   std::vector<Reader*>& train_reader);
+
+  // Start the thread which advances the clock of the update
+  // time and evicts the stale features, and stop it
+  void start_sweeper();
+  void stop_sweeper();
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Trainer);
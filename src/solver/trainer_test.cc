@@ -0,0 +1,301 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests trainer.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "src/base/thread_pool.h"
+#include "src/data/model_parameters.h"
+#include "src/loss/metric.h"
+#include "src/loss/squared_loss.h"
+#include "src/reader/reader.h"
+#include "src/score/fm_score.h"
+#include "src/score/linear_score.h"
+#include "src/solver/trainer.h"
+
+namespace xLearn {
+
+// The rows of the test, in the layout of InmemReader, whose
+// batches have the given number of rows
+struct Rows {
+  std::vector<Node> node;
+  std::vector<uint64> offset;
+  std::vector<real_t> label;
+  InmemReader reader;
+  Rows() : offset(1, 0) { }
+  void AddRow(const std::vector<Node>& row, real_t y) {
+    node.insert(node.end(), row.begin(), row.end());
+    offset.push_back(node.size());
+    label.push_back(y);
+  }
+  void Initialize(int batch) { Initialize(batch, &reader); }
+  void Initialize(int batch, InmemReader* other) {
+    other->InitializeRows(node.data(), offset.data(), label.data(),
+                          label.size(), batch);
+  }
+};
+
+// The test reader keeps the snapshot of the model at each
+// validation, which resets it before the rows are read
+class SnapshotReader : public InmemReader {
+ public:
+  explicit SnapshotReader(Model* model) : model_(model) { }
+
+  virtual void Reset() {
+    InmemReader::Reset();
+    snapshots.emplace_back();
+    model_->Snapshot(&snapshots.back());
+  }
+
+  std::vector<std::vector<real_t>> snapshots;
+
+ private:
+  Model* model_;
+};
+
+// The trainer of the test, which shows the protected members
+class TestTrainer : public Trainer {
+ public:
+  using Trainer::CalcLossMetric;
+  using Trainer::CalcSampleMetric;
+  using Trainer::sample_train_set;
+};
+
+// The model, the score, the loss and the metric of the squared
+// loss on one thread
+struct TestModel {
+  ThreadPool pool;
+  Model model;
+  LinearScore linear;
+  FMScore fm;
+  SquaredLoss loss;
+  Metric metric;
+  TestModel(const std::string& score_func, index_t num_feat, index_t k)
+    : pool(1) {
+    model.SetSeed(1);
+    model.Initialize(score_func, "squared", num_feat, 0, k);
+    Score* score = &linear;
+    if (score_func == "fm") { score = &fm; }
+    score->Initialize(0.1, 0, &model);
+    loss.Initialize(score, false, &pool);
+    metric.Initialize("mae");
+  }
+};
+
+// The linear model of the async validation, whose loss and
+// metric run on the thread of the validation
+struct AsyncModel : public TestModel {
+  ThreadPool valid_pool;
+  SquaredLoss valid_loss;
+  Metric valid_metric;
+  explicit AsyncModel(index_t num_feat)
+    : TestModel("linear", num_feat, 0), valid_pool(1) {
+    valid_loss.Initialize(&linear, false, &valid_pool);
+    valid_metric.Initialize("mae");
+  }
+};
+
+const index_t kStopFeat = 10;
+const int kStopBatch = 50;
+
+// The rows of the test of the batch validation: feature i % 10 of
+// row i, and the label y of the first rows and -y of the others
+static void add_rows(Rows* rows, index_t num_row,
+                     index_t num_first, real_t y) {
+  for (index_t i = 0; i < num_row; ++i) {
+    rows->AddRow({ { 0, i % kStopFeat, 1.0 } }, i < num_first ? y : -y);
+  }
+}
+
+// Train one epoch with the validation every 3 batches, whose 40
+// batches end between two of them. Early-stopping stops after 2
+// validations without a better one. The snapshots of the sync
+// validations are kept if it is given
+static void train_batches(index_t num_first, real_t y, TestModel* m,
+                          AsyncModel* async,
+                          std::vector<std::vector<real_t>>* snapshots) {
+  Rows train, test;
+  add_rows(&train, 2000, num_first, y);
+  add_rows(&test, 100, 100, y);
+  train.Initialize(kStopBatch);
+  SnapshotReader snapshot_reader(&m->model);
+  InmemReader* test_reader = &test.reader;
+  if (snapshots != nullptr) { test_reader = &snapshot_reader; }
+  test.Initialize(kStopBatch, test_reader);
+  std::vector<Reader*> reader_list = { &train.reader, test_reader };
+  Trainer trainer;
+  trainer.Initialize(reader_list, 1, &m->model, &m->loss, &m->metric,
+                     true, true, 2);
+  trainer.SetValidBatches(3);
+  if (async != nullptr) {
+    trainer.SetAsyncValidation(&async->valid_loss, &async->valid_metric);
+  }
+  trainer.Train();
+  if (snapshots != nullptr) { snapshots->swap(snapshot_reader.snapshots); }
+}
+
+// The MAE of the model on the test rows of train_batches()
+static real_t test_mae(TestModel* m, real_t y) {
+  Rows test;
+  add_rows(&test, 100, 100, y);
+  test.Initialize(kStopBatch);
+  std::vector<Reader*> reader_list(1, &test.reader);
+  TestTrainer trainer;
+  return trainer.CalcLossMetric(reader_list, &m->model,
+                                &m->loss, &m->metric).metric_val;
+}
+
+// The weights and the bias of the two models are the same
+static void expect_same_weights(Model* a, Model* b) {
+  EXPECT_EQ(a->GetParameter_b()[0], b->GetParameter_b()[0]);
+  for (index_t f = 0; f < kStopFeat; ++f) {
+    EXPECT_EQ(a->GetParameter_w()[f * a->GetLinearStride()],
+              b->GetParameter_w()[f * b->GetLinearStride()]);
+  }
+}
+
+// The first epoch has no measured time of its validation, which is
+// reserved, so the training of a budget shorter than one pass stops
+// inside it
+TEST(TRAINER_TEST, Time_budget) {
+  const index_t kNumFeat = 1000;
+  const index_t kNode = 20;
+  Rows train, test;
+  for (index_t i = 0; i < 400000; ++i) {
+    std::vector<Node> row;
+    for (index_t j = 0; j < kNode; ++j) {
+      row.push_back({ 0, (i * 7 + j * 131) % kNumFeat, 0.5 });
+    }
+    Rows* rows = i % 100 == 0 ? &test : &train;
+    rows->AddRow(row, (i % 3) * 0.5);
+  }
+  train.Initialize(1000);
+  test.Initialize(1000);
+  std::vector<Reader*> reader_list = { &train.reader, &test.reader };
+  TestModel m("fm", kNumFeat, 32);
+  Trainer trainer;
+  trainer.Initialize(reader_list, 100, &m.model, &m.loss, &m.metric,
+                     false, true);
+  const real_t kBudget = 0.1;
+  auto start = std::chrono::steady_clock::now();
+  trainer.SetTimeBudget(kBudget);
+  trainer.Train();
+  real_t elapsed = std::chrono::duration<real_t>(
+      std::chrono::steady_clock::now() - start).count();
+  EXPECT_LT(elapsed, kBudget);
+  // The budget stops the pass of the first epoch
+  ASSERT_EQ(trainer.Stats().epoch_rows.size(), 1);
+  EXPECT_LT(trainer.Stats().epoch_rows[0], train.label.size());
+}
+
+// The labels of the test rows are 1, and the train rows turn to -1
+// in the middle of the epoch, so the test metric gets worse after
+// it. The batch validations stop the epoch 2 validations after the
+// best one, and the model of the best one is restored
+TEST(TRAINER_TEST, Batch_early_stop) {
+  TestModel sync("linear", kStopFeat, 0);
+  std::vector<std::vector<real_t>> snapshots;
+  train_batches(1000, 1, &sync, nullptr, &snapshots);
+  std::vector<real_t> restored;
+  sync.model.Snapshot(&restored);
+  // The metric of each validation, whose first best one is kept
+  std::vector<real_t> mae;
+  for (size_t k = 0; k < snapshots.size(); ++k) {
+    sync.model.Restore(snapshots[k]);
+    mae.push_back(test_mae(&sync, 1));
+  }
+  size_t best = 0;
+  for (size_t k = 1; k < mae.size(); ++k) {
+    if (mae[k] < mae[best]) { best = k; }
+  }
+  // Stopped inside the epoch of 13 batch validations
+  ASSERT_LT(snapshots.size(), 13);
+  EXPECT_GT(best, 0);
+  EXPECT_EQ(snapshots.size(), best + 3);
+  EXPECT_EQ(restored, snapshots[best]);
+  // The async validation of the same rows restores the same
+  // weights, although it stops one validation later
+  AsyncModel async(kStopFeat);
+  train_batches(1000, 1, &async, &async, nullptr);
+  sync.model.Restore(restored);
+  expect_same_weights(&async.model, &sync.model);
+}
+
+// The labels of 100 are far from the model of one epoch, whose test
+// metric gets better up to the end of the epoch, so the
+// best model is the one of the validation after the last batch,
+// which is still in the background when the epoch ends
+TEST(TRAINER_TEST, Join_last_validation) {
+  TestModel sync("linear", kStopFeat, 0);
+  std::vector<std::vector<real_t>> snapshots;
+  train_batches(2000, 100, &sync, nullptr, &snapshots);
+  // The 13 batch validations and the one of the epoch
+  ASSERT_EQ(snapshots.size(), 14);
+  std::vector<real_t> restored;
+  sync.model.Snapshot(&restored);
+  EXPECT_EQ(restored, snapshots.back());
+  sync.model.Restore(snapshots[12]);
+  real_t last_batch_mae = test_mae(&sync, 100);
+  sync.model.Restore(restored);
+  EXPECT_LT(test_mae(&sync, 100), last_batch_mae);
+  AsyncModel async(kStopFeat);
+  train_batches(2000, 100, &async, &async, nullptr);
+  expect_same_weights(&async.model, &sync.model);
+}
+
+// The metric of the sample of the train rows, whose standard error of
+// the loss is 0 if all the rows are sampled. The loss of half of the
+// rows is near the loss of all of them
+TEST(TRAINER_TEST, Sample_metric) {
+  const index_t kNumFeat = 10;
+  Rows train;
+  for (index_t i = 0; i < 2000; ++i) {
+    train.AddRow({ { 0, i % kNumFeat, 1.0 } }, (i % 7) * 0.5);
+  }
+  train.Initialize(100);
+  std::vector<Reader*> reader_list(1, &train.reader);
+  TestModel m("linear", kNumFeat, 0);
+  real_t* w = m.model.GetParameter_w();
+  for (index_t f = 0; f < kNumFeat; ++f) {
+    w[f * m.model.GetLinearStride()] = f * 0.2;
+  }
+  TestTrainer trainer;
+  trainer.Initialize(reader_list, 1, &m.model, &m.loss, &m.metric,
+                     false, false);
+  MetricInfo full = trainer.CalcLossMetric(reader_list);
+  EXPECT_GT(full.loss_val, 0);
+  trainer.SetTrainSample(1.0);
+  trainer.sample_train_set(reader_list);
+  MetricInfo all = trainer.CalcSampleMetric();
+  EXPECT_NEAR(all.loss_val, full.loss_val, 1e-5 * full.loss_val);
+  EXPECT_NEAR(all.metric_val, full.metric_val, 1e-5 * full.metric_val);
+  EXPECT_EQ(all.loss_stderr, 0);
+  trainer.SetTrainSample(0.5);
+  trainer.sample_train_set(reader_list);
+  MetricInfo half = trainer.CalcSampleMetric();
+  EXPECT_GT(half.loss_stderr, 0);
+  EXPECT_LT(half.loss_stderr, 0.1 * full.loss_val);
+  EXPECT_NEAR(half.loss_val, full.loss_val, 4 * half.loss_stderr);
+}
+
+}  // namespace xLearn